@@ -0,0 +1,81 @@
+/*
+Title: HydroDynamics
+File Name: FluidSurfaceShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The two passes of FluidSurface.h that cover the screen, drawn with the fullscreen triangle
+of SdfVertexShader.glsl.
+
+With composite 0 it blurs the field along direction (one texel along x or y) with a 9 tap
+Gaussian, drawn into a texture of the same size. With composite 1 it reads the blurred
+field under the pixel and draws the fluid wherever the field is above threshold. Inside,
+the field is treated as a height that rises from the threshold over a few texels, and is
+lit from the top left, which leaves a bright rim along the surface.
+*/
+
+#version 400 core
+
+layout(location = 0) out vec4 out_color;
+
+in vec2 position;	// Where in the scene this is
+
+#include "FrameBlock.glsl"
+uniform sampler2D field;	// On texture unit 2
+uniform vec2 direction;
+uniform int composite;
+uniform float threshold;
+
+const float weights[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+void main(void)
+{
+	if (composite == 0)
+	{
+		vec2 size = vec2(textureSize(field, 0));
+		vec2 center = gl_FragCoord.xy / size;
+		vec2 texel = direction / size;
+		vec4 sum = texture(field, center) * weights[0];
+		for (int i = 1; i < 5; i++)
+		{
+			sum += (texture(field, center + texel * float(i)) + texture(field, center - texel * float(i))) * weights[i];
+		}
+		out_color = sum;
+		return;
+	}
+
+	// The field covers the whole view, whatever the size of the framebuffer drawn into.
+	vec4 clip = MVP * vec4(position, 0.0, 1.0);
+	vec4 value = texture(field, clip.xy / clip.w * 0.5 + 0.5);
+	if (value.a < threshold)
+	{
+		discard;
+	}
+
+	vec3 base = value.rgb / value.a;
+	float height = smoothstep(threshold, threshold * 2.0, value.a);
+	vec3 normal = normalize(vec3(-dFdx(height), -dFdy(height), 0.25));
+	vec3 light = normalize(vec3(-0.5, 0.5, 1.0));
+	float diffuse = 0.6 + 0.4 * max(dot(normal, light), 0.0);
+	float specular = pow(max(reflect(-light, normal).z, 0.0), 16.0) * (1.0 - height);
+	out_color = vec4(base * diffuse + vec3(specular), 1.0);
+}
@@ -36,8 +36,41 @@ delta time for the update function will always equal the physics timestep.
 layout(location = 0) out vec4 out_color; // Establishes the variable we will pass out of this shader.
 
 in vec4 color;	// Take in a vec4 for color
+
+#ifdef HEATMAP
+in float heat;					// Where on the colormap the pressure is, or below 0 for the plain color
+uniform sampler1D colormap;		// The colors of --heatmap, on texture unit 6
+#endif
+
+#ifdef RIPPLES
+in vec4 rippleSurface;			// x, the depth below the fill level, the height of the waves and the vessel (see VertexShader.glsl)
+
+#include "FrameBlock.glsl"
+#endif
  
 void main(void)
 {
 	out_color = color; // Set our out_color equal to our in color, basically making this a pass-through shader.
+#ifdef HEATMAP
+	if (heat >= 0.0)
+	{
+		out_color = vec4(texture(colormap, heat).rgb * color.rgb, color.a);
+	}
+#endif
+#ifdef RIPPLES
+	// The waves hang down from the fill level, so nothing above the quad has to be drawn. Two of them running against each other make
+	// the surface slosh rather than scroll, and every vessel starts them at a phase of its own. Just below the surface is lighter.
+	float height = rippleSurface.z;
+	if (height > 0.0)
+	{
+		float phase = rippleSurface.w * 2.39996;
+		float wave = height * (0.5 + 0.3 * sin(rippleSurface.x * 60.0 - time * 7.0 + phase) + 0.2 * sin(rippleSurface.x * 145.0 + time * 11.0 + 2.0 * phase));
+		float below = rippleSurface.y - wave;
+		if (below < 0.0)
+		{
+			discard;
+		}
+		out_color.rgb = mix(out_color.rgb, vec3(1.0), 0.4 * max(1.0 - below / height, 0.0));
+	}
+#endif
 }
\ No newline at end of file
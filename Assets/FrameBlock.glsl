@@ -0,0 +1,36 @@
+/*
+Title: HydroDynamics
+File Name: FrameBlock.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The Frame block every program of the scene and the UI reads its MVP from, included with
+#include "FrameBlock.glsl" (see Shaders.h). It has to be the same in every shader, since
+they all read the same uniform buffer, laid out as FrameBlock in FrameUniforms.h.
+*/
+
+layout(std140) uniform Frame
+{
+	mat4 MVP;
+	float time;			// Seconds since the start
+	float pointScale;	// Pixels per unit of the scene
+};
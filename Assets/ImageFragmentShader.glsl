@@ -0,0 +1,46 @@
+/*
+Title: HydroDynamics
+File Name: ImageFragmentShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Colors the pixels of the --background image, and discards the ones its alpha leaves out, like
+the space around a label.
+*/
+
+#version 400 core
+
+layout(location = 0) out vec4 out_color;
+
+in vec2 imagePosition;
+
+uniform sampler2D image;	// On texture unit 7
+
+void main(void)
+{
+	vec4 texel = texture(image, imagePosition);
+	if (texel.a < 0.5)
+	{
+		discard;
+	}
+	out_color = vec4(texel.rgb, 1.0);
+}
@@ -0,0 +1,42 @@
+/*
+Title: HydroDynamics
+File Name: ImageVertexShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Draws the --background image over the square from -1 to 1 of the scene, which is what the
+window shows at the start, as a triangle strip of 4 vertices worked out from gl_VertexID, so
+it needs no vertex buffer.
+*/
+
+#version 400 core
+
+out vec2 imagePosition;
+
+#include "FrameBlock.glsl"
+
+void main(void)
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	imagePosition = corner;
+	gl_Position = MVP * vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
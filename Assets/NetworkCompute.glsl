@@ -0,0 +1,230 @@
+/*
+Title: HydroDynamics
+File Name: NetworkCompute.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The passes of a step of the vessel network on the GPU (see GpuNetwork.h). Every pass is
+compiled from this file on its own, with PASS defined as the pass it is, and does the same
+as the phase of VesselNetwork::update() it is named after, in the same order of operations.
+Every invocation handles one vessel or one tube.
+
+The last two passes aren't part of the step: they reduce the state to the statistics of
+GpuNetwork::requestStatistics(). Every work group of PASS_REDUCE folds its vessels into one
+partial result in shared memory, and the single work group of PASS_REDUCE_FINAL folds the
+partials, always in the same order, so the sums come out the same every time. The histogram
+is counted with integer atomics, which don't depend on the order either.
+*/
+
+#version 430 core
+
+// The code that compiles this file inserts the defines of PASS and GROUP_SIZE here. The passes are numbered in the order of
+// GpuNetworkPass.
+#define PASS_PRESSURE 0
+#define PASS_FLOW 1
+#define PASS_APPLY 2
+#define PASS_REDUCE 3
+#define PASS_REDUCE_FINAL 4
+
+// The same as GPU_NETWORK_HISTOGRAM_BINS
+#define HISTOGRAM_BINS 32
+
+layout(local_size_x = GROUP_SIZE) in;
+
+// The same as GpuNetworkParameters
+layout(std140, binding = 0) uniform Parameters
+{
+	float dt;
+	float dtSquaredScale;
+	float scale;
+	float restFlow;
+	float restPressure;
+	int vesselCount;
+	int tubeCount;
+	float histogramTop;
+};
+
+// Every pass only declares the blocks it uses. The code that compiles this file assigns them their bindings by name.
+layout(std430) buffer Height { float height[]; };
+#if PASS == PASS_PRESSURE || PASS == PASS_FLOW
+layout(std430) buffer Pressure { float pressure[]; };
+#endif
+#if PASS == PASS_FLOW || PASS == PASS_REDUCE
+layout(std430) buffer ExternalPressure { float externalPressure[]; };
+#endif
+#if PASS == PASS_FLOW
+layout(std430) buffer DrainShare { float drainShare[]; };
+layout(std430) buffer TubeA { int tubeA[]; };
+layout(std430) buffer TubeB { int tubeB[]; };
+layout(std430) buffer InvInertance { float invInertance[]; };
+layout(std430) buffer Damping { float damping[]; };
+layout(std430) buffer Stiffness { float stiffness[]; };
+layout(std430) buffer Flow { float flow[]; };
+layout(std430) buffer Moved { uint moved[]; };					// Set to 1 by every tube that moved anything
+#endif
+#if PASS == PASS_FLOW || PASS == PASS_APPLY
+layout(std430) buffer Change { float change[]; };
+#endif
+#if PASS == PASS_APPLY || PASS == PASS_REDUCE
+layout(std430) buffer Width { float width[]; };
+#endif
+#if PASS == PASS_REDUCE || PASS == PASS_REDUCE_FINAL
+layout(std430) buffer Partials { vec4 partials[]; };			// Per work group: volume, highest pressure, lowest and highest height
+layout(std430) buffer Statistics								// The same as GpuNetworkStatistics
+{
+	float totalVolume;
+	float highestPressure;
+	float lowestHeight;
+	float highestHeight;
+	float statisticsTop;
+	uint histogram[HISTOGRAM_BINS];
+};
+
+// What every invocation of the group has folded so far, as in partials.
+shared vec4 folded[GROUP_SIZE];
+shared uint groupHistogram[HISTOGRAM_BINS];
+
+// Folds the results of the invocations of the group into folded[0], halving them every round.
+void foldGroup(vec4 own)
+{
+	uint k = gl_LocalInvocationID.x;
+	folded[k] = own;
+	memoryBarrierShared();
+	barrier();
+	for (uint stride = uint(GROUP_SIZE) / 2u; stride > 0u; stride /= 2u)
+	{
+		if (k < stride)
+		{
+			vec4 other = folded[k + stride];
+			folded[k] = vec4(folded[k].x + other.x, max(folded[k].y, other.y), min(folded[k].z, other.z), max(folded[k].w, other.w));
+		}
+		memoryBarrierShared();
+		barrier();
+	}
+}
+#endif
+#if PASS == PASS_APPLY
+layout(std430) buffer Bottom { float bottom[]; };
+layout(std430) buffer Top { float top[]; };						// Also the fill levels the renderer draws from
+layout(std430) buffer TubeStart { int tubeStart[]; };
+layout(std430) buffer TubeList { int tubeList[]; };				// tube * 2, plus 1 for the B end, like VesselNetwork::vesselTubes
+#endif
+
+void main(void)
+{
+	int i = int(gl_GlobalInvocationID.x);
+
+#if PASS == PASS_PRESSURE
+	if (i < vesselCount)
+	{
+		pressure[i] = height[i] * scale;
+	}
+
+#elif PASS == PASS_FLOW
+	// The backward Euler step of the tube kernel in SimdKernels.cpp, and the same limits. Every tube that moved sets the flag;
+	// they all write the same value, so it needs no atomics.
+	if (i < tubeCount)
+	{
+		int a = tubeA[i];
+		int b = tubeB[i];
+		float difference = (pressure[b] + externalPressure[b]) - (pressure[a] + externalPressure[a]);
+		float tubeFlow = (flow[i] + dt * difference * invInertance[i]) / (1.0 + dt * damping[i] + dtSquaredScale * stiffness[i] * invInertance[i]);
+		if (abs(tubeFlow) < restFlow && abs(difference) < restPressure)
+		{
+			tubeFlow = 0.0;
+		}
+
+		float volume = tubeFlow * dt;
+		volume = min(volume, height[b] * drainShare[b]);
+		volume = max(volume, -(height[a] * drainShare[a]));
+		flow[i] = volume / dt;
+		change[i] = volume;
+		if (volume != 0.0)
+		{
+			moved[0] = 1u;
+		}
+	}
+
+#elif PASS == PASS_APPLY
+	// Every vessel gathers the changes of its own tubes, so no two invocations write the same vessel.
+	if (i < vesselCount)
+	{
+		float sum = 0.0;
+		for (int k = tubeStart[i]; k < tubeStart[i + 1]; k++)
+		{
+			int entry = tubeList[k];
+			float c = change[entry >> 1];
+			sum += (entry & 1) != 0 ? -c : c;
+		}
+		height[i] += sum / width[i];
+		top[i] = bottom[i] + height[i];
+	}
+
+#elif PASS == PASS_REDUCE
+	// An invocation past the last vessel adds nothing. The histogram starts out cleared.
+	uint k = gl_LocalInvocationID.x;
+	if (k < uint(HISTOGRAM_BINS))
+	{
+		groupHistogram[k] = 0u;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	vec4 own = vec4(0.0, -3.4e38, 3.4e38, -3.4e38);
+	if (i < vesselCount)
+	{
+		float h = height[i];
+		own = vec4(h * width[i], h * scale + externalPressure[i], h, h);
+		int bin = clamp(int(h / histogramTop * float(HISTOGRAM_BINS)), 0, HISTOGRAM_BINS - 1);
+		atomicAdd(groupHistogram[bin], 1u);
+	}
+	foldGroup(own);
+	if (k == 0u)
+	{
+		partials[gl_WorkGroupID.x] = folded[0];
+	}
+	if (k < uint(HISTOGRAM_BINS) && groupHistogram[k] != 0u)
+	{
+		atomicAdd(histogram[k], groupHistogram[k]);
+	}
+
+#elif PASS == PASS_REDUCE_FINAL
+	// One work group, whose every invocation folds every GROUP_SIZE-th partial before they are all folded together.
+	uint k = gl_LocalInvocationID.x;
+	uint groups = uint(vesselCount + GROUP_SIZE - 1) / uint(GROUP_SIZE);
+	vec4 own = vec4(0.0, -3.4e38, 3.4e38, -3.4e38);
+	for (uint g = k; g < groups; g += uint(GROUP_SIZE))
+	{
+		vec4 other = partials[g];
+		own = vec4(own.x + other.x, max(own.y, other.y), min(own.z, other.z), max(own.w, other.w));
+	}
+	foldGroup(own);
+	if (k == 0u)
+	{
+		totalVolume = folded[0].x;
+		highestPressure = folded[0].y;
+		lowestHeight = folded[0].z;
+		highestHeight = folded[0].w;
+		statisticsTop = histogramTop;
+	}
+#endif
+}
@@ -0,0 +1,69 @@
+/*
+Title: HydroDynamics
+File Name: Nv12FragmentShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Turns a frame of a video (see VideoExport.h) into NV12, the layout the hardware encoders
+take, drawn with the fullscreen triangle of SdfVertexShader.glsl into a one channel image
+half again as tall as the frame. Its rows are the rows glReadPixels() gives, bottom first,
+so the top of the frame comes first, like the encoder wants it.
+
+The first height rows are the brightness (Y) of every pixel. The rows after them hold the
+color (U and V) of every 2 x 2 pixels, averaged, one after the other in a row. The colors
+are BT.709 with the limited range of video.
+*/
+
+#version 400 core
+
+layout(location = 0) out float out_value;
+
+uniform sampler2D image;	// On texture unit 8
+uniform int height;			// Of the frame
+
+// The pixel x, y of the frame, counted from the top like the encoder counts.
+vec3 frameColor(int x, int y)
+{
+	return texelFetch(image, ivec2(x, height - 1 - y), 0).rgb;
+}
+
+void main(void)
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	if (texel.y < height)
+	{
+		out_value = 16.0 / 255.0 + dot(frameColor(texel.x, texel.y), vec3(0.1826, 0.6142, 0.0620));
+		return;
+	}
+
+	int x = texel.x & ~1;
+	int y = (texel.y - height) * 2;
+	vec3 color = (frameColor(x, y) + frameColor(x + 1, y) + frameColor(x, y + 1) + frameColor(x + 1, y + 1)) * 0.25;
+	if ((texel.x & 1) == 0)
+	{
+		out_value = 128.0 / 255.0 + dot(color, vec3(-0.1006, -0.3386, 0.4392));
+	}
+	else
+	{
+		out_value = 128.0 / 255.0 + dot(color, vec3(0.4392, -0.3989, -0.0403));
+	}
+}
@@ -0,0 +1,397 @@
+/*
+Title: HydroDynamics
+File Name: ParticleCompute.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The passes of a substep of the particle fluid on the GPU (see GpuParticleFluid.h). Every
+pass is compiled from this file on its own, with PASS defined as the pass it is, and does
+the same as the loop of ParticleFluid.cpp it is named after. Every invocation handles one
+particle, except in the scan.
+*/
+
+#version 430 core
+
+// The code that compiles this file inserts the defines of PASS, GROUP_SIZE, SCAN_SIZE and MAX_NEIGHBORS here. The passes are
+// numbered in the order of GpuParticlePass.
+#define PASS_PREDICT 0
+#define PASS_SCAN 1
+#define PASS_SCATTER 2
+#define PASS_NEIGHBORS 3
+#define PASS_LAMBDA 4
+#define PASS_DELTA 5
+#define PASS_APPLY 6
+#define PASS_VELOCITY 7
+#define PASS_VISCOSITY 8
+#define PASS_MEASURE 9
+#define PASS_VERTICES 10
+
+#if PASS == PASS_SCAN
+layout(local_size_x = SCAN_SIZE) in;
+#else
+layout(local_size_x = GROUP_SIZE) in;
+#endif
+
+// The same as GpuParticleParameters
+layout(std140, binding = 0) uniform Parameters
+{
+	vec4 waterColor;
+	vec2 origin;
+	float radius;
+	float dt;
+	float gravity;
+	float poly6Scale;
+	float spikyScale;
+	float inverseRest;
+	float relaxation;
+	float closest;
+	float viscosityScale;
+	float speedWhite;
+	int columns;
+	int rows;
+	int particleCount;
+	int boxCount;
+	int vesselCount;
+};
+
+// Every pass only declares the blocks it uses, since the number of blocks a shader can have is limited. The code that compiles
+// this file assigns them their bindings by name.
+#define USES_POSITION (PASS == PASS_PREDICT || PASS == PASS_SCATTER || PASS == PASS_VELOCITY || PASS == PASS_MEASURE || PASS == PASS_VERTICES)
+#define USES_VELOCITY (USES_POSITION || PASS == PASS_VISCOSITY)
+#define USES_PREDICTED (PASS == PASS_PREDICT || (PASS >= PASS_SCATTER && PASS <= PASS_VISCOSITY))
+#define USES_NEIGHBORS (PASS == PASS_NEIGHBORS || PASS == PASS_LAMBDA || PASS == PASS_DELTA || PASS == PASS_VISCOSITY)
+#define USES_WALLS (PASS == PASS_NEIGHBORS || PASS == PASS_LAMBDA || PASS == PASS_DELTA)
+#define USES_BOXES (PASS == PASS_PREDICT || PASS == PASS_APPLY)
+#define USES_VESSELS (PASS == PASS_PREDICT || PASS == PASS_MEASURE)
+
+#if USES_POSITION
+layout(std430) buffer Position { vec2 position[]; };
+#endif
+#if USES_VELOCITY
+layout(std430) buffer Velocity { vec2 velocity[]; };
+#endif
+#if USES_PREDICTED
+layout(std430) buffer Predicted { vec2 predicted[]; };
+#endif
+#if PASS == PASS_SCATTER
+layout(std430) buffer SortedPosition { vec2 sortedPosition[]; };
+layout(std430) buffer SortedVelocity { vec2 sortedVelocity[]; };
+layout(std430) buffer SortedPredicted { vec2 sortedPredicted[]; };
+#endif
+#if PASS == PASS_PREDICT || PASS == PASS_SCATTER
+layout(std430) buffer CellOf { uint cellOf[]; };
+#endif
+#if PASS == PASS_PREDICT || PASS == PASS_SCAN || PASS == PASS_NEIGHBORS
+layout(std430) buffer CellStart { uint cellStart[]; };
+#endif
+#if PASS == PASS_SCAN || PASS == PASS_SCATTER
+layout(std430) buffer Cursor { uint cursor[]; };
+#endif
+#if USES_NEIGHBORS
+layout(std430) buffer Neighbors { int neighbors[]; };
+layout(std430) buffer NeighborCount { uint neighborCount[]; };	// Particles in the low byte, walls in the next one
+#endif
+#if PASS == PASS_LAMBDA || PASS == PASS_DELTA
+layout(std430) buffer Lambda { float lambda[]; };
+#endif
+#if PASS == PASS_DELTA || PASS == PASS_APPLY || PASS == PASS_VISCOSITY
+layout(std430) buffer Delta { vec2 delta[]; };
+#endif
+#if USES_WALLS
+layout(std430) buffer Walls { vec2 walls[]; };
+#endif
+#if PASS == PASS_NEIGHBORS
+layout(std430) buffer WallStart { uint wallStart[]; };
+#endif
+#if USES_BOXES
+layout(std430) buffer Boxes { vec4 boxes[]; };					// left, right, bottom, top
+#endif
+
+#if USES_VESSELS
+// The vessels sorted by their left walls
+struct Vessel
+{
+	float left;
+	float right;
+	float bottom;
+	int index;
+};
+layout(std430) buffer Vessels { Vessel vessels[]; };
+#endif
+#if PASS == PASS_PREDICT
+layout(std430) buffer ExtraGravity { float extraGravity[]; };
+#endif
+#if PASS == PASS_MEASURE
+layout(std430) buffer Measure { uint measure[]; };				// The speed of the fastest particle as float bits, then the count of every vessel
+#endif
+
+#if PASS == PASS_VERTICES
+struct Vertex
+{
+	vec2 position;
+	uint color;
+	uint padding;
+};
+layout(std430) buffer Vertices { Vertex vertices[]; };
+#endif
+
+#if PASS == PASS_SCAN
+shared uint totals[SCAN_SIZE];
+#endif
+
+uint cellAt(vec2 point)
+{
+	ivec2 cell = clamp(ivec2((point - origin) / radius), ivec2(1), ivec2(columns - 2, rows - 2));
+	return uint(cell.y * columns + cell.x);
+}
+
+#if USES_BOXES
+vec2 keepInside(vec2 point)
+{
+	vec2 best = point;
+	float bestDistance = -1.0;
+	for (int b = 0; b < boxCount; b++)
+	{
+		vec4 box = boxes[b];
+		vec2 inside = clamp(point, box.xz, box.yw);
+		if (inside == point)
+		{
+			return point;
+		}
+
+		vec2 offset = inside - point;
+		float distance = dot(offset, offset);
+		if (bestDistance < 0.0 || distance < bestDistance)
+		{
+			best = inside;
+			bestDistance = distance;
+		}
+	}
+	return best;
+}
+#endif
+
+#if USES_VESSELS
+int vesselAt(vec2 point)
+{
+	// The last vessel whose left wall is at or left of the point.
+	int low = 0;
+	int high = vesselCount;
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (vessels[middle].left <= point.x)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	if (low == 0)
+	{
+		return -1;
+	}
+	Vessel vessel = vessels[low - 1];
+	return point.x < vessel.right && point.y >= vessel.bottom ? vessel.index : -1;
+}
+#endif
+
+// The kernel and its gradient (divided by the distance) for two points offset apart, the same as in ParticleFluid::solveDensity().
+float kernel(inout vec2 offset, bool first, out float gradient)
+{
+	float distanceSquared = dot(offset, offset);
+	if (distanceSquared < closest * closest)
+	{
+		offset = vec2(first ? closest : -closest, 0.0);
+		distanceSquared = closest * closest;
+	}
+	if (distanceSquared >= radius * radius)
+	{
+		gradient = 0.0;
+		return 0.0;
+	}
+	float distance = sqrt(distanceSquared);
+	float difference = radius * radius - distanceSquared;
+	gradient = spikyScale * (radius - distance) * (radius - distance) / distance;
+	return poly6Scale * difference * difference * difference;
+}
+
+void main(void)
+{
+#if PASS == PASS_SCAN
+	// One group turns the counts of all cells into where every cell starts. Every invocation adds up a stretch of cells, the
+	// group scans the sums of the stretches, and then every invocation writes the starts of its stretch.
+	uint cells = uint(columns * rows);
+	uint stretch = (cells + SCAN_SIZE - 1) / SCAN_SIZE;
+	uint first = gl_LocalInvocationID.x * stretch;
+	uint last = min(first + stretch, cells);
+	uint sum = 0;
+	for (uint c = first; c < last; c++)
+	{
+		sum += cellStart[c];
+	}
+	totals[gl_LocalInvocationID.x] = sum;
+	barrier();
+
+	for (uint step = 1; step < SCAN_SIZE; step *= 2)
+	{
+		uint add = gl_LocalInvocationID.x >= step ? totals[gl_LocalInvocationID.x - step] : 0;
+		barrier();
+		totals[gl_LocalInvocationID.x] += add;
+		barrier();
+	}
+
+	uint start = totals[gl_LocalInvocationID.x] - sum;
+	for (uint c = first; c < last; c++)
+	{
+		uint count = cellStart[c];
+		cellStart[c] = start;
+		cursor[c] = start;
+		start += count;
+	}
+	if (gl_LocalInvocationID.x == SCAN_SIZE - 1)
+	{
+		cellStart[cells] = totals[SCAN_SIZE - 1];
+	}
+#else
+	int i = int(gl_GlobalInvocationID.x);
+	if (i >= particleCount)
+	{
+		return;
+	}
+
+#if PASS == PASS_PREDICT
+	int vessel = vesselAt(position[i]);
+	vec2 v = velocity[i];
+	v.y -= (gravity + (vessel >= 0 ? extraGravity[vessel] : 0.0)) * dt;
+	velocity[i] = v;
+	vec2 point = keepInside(position[i] + v * dt);
+	predicted[i] = point;
+	uint cell = cellAt(point);
+	cellOf[i] = cell;
+	atomicAdd(cellStart[cell], 1);
+#elif PASS == PASS_SCATTER
+	// The order within a cell is whichever order the invocations got there in.
+	uint k = atomicAdd(cursor[cellOf[i]], 1);
+	sortedPosition[k] = position[i];
+	sortedVelocity[k] = velocity[i];
+	sortedPredicted[k] = predicted[i];
+#elif PASS == PASS_NEIGHBORS
+	vec2 point = predicted[i];
+	int list = i * MAX_NEIGHBORS;
+	int count = 0;
+	int cell = int(cellAt(point));
+	for (int row = cell - columns; row <= cell + columns; row += columns)
+	{
+		uint last = cellStart[row + 2];
+		for (uint j = cellStart[row - 1]; j < last && count < MAX_NEIGHBORS; j++)
+		{
+			vec2 offset = point - predicted[j];
+			if (int(j) != i && dot(offset, offset) < radius * radius)
+			{
+				neighbors[list + count++] = int(j);
+			}
+		}
+	}
+	int fluid = count;
+	for (int row = cell - columns; row <= cell + columns; row += columns)
+	{
+		uint last = wallStart[row + 2];
+		for (uint k = wallStart[row - 1]; k < last && count < MAX_NEIGHBORS; k++)
+		{
+			vec2 offset = point - walls[k];
+			if (dot(offset, offset) < radius * radius)
+			{
+				neighbors[list + count++] = int(k);
+			}
+		}
+	}
+	neighborCount[i] = uint(fluid) | (uint(count - fluid) << 8);
+#elif PASS == PASS_LAMBDA
+	int list = i * MAX_NEIGHBORS;
+	int fluid = int(neighborCount[i] & 255u);
+	int count = fluid + int(neighborCount[i] >> 8);
+	float density = poly6Scale * radius * radius * radius * radius * radius * radius;
+	vec2 own = vec2(0.0);
+	float squares = 0.0;
+	for (int n = 0; n < count; n++)
+	{
+		int j = neighbors[list + n];
+		vec2 offset = predicted[i] - (n < fluid ? predicted[j] : walls[j]);
+		float gradient;
+		density += kernel(offset, n < fluid && j < i, gradient);
+		gradient *= inverseRest;
+		own += gradient * offset;
+		if (n < fluid)
+		{
+			squares += gradient * gradient * dot(offset, offset);
+		}
+	}
+
+	float constraint = density * inverseRest - 1.0;
+	lambda[i] = constraint > 0.0 ? -constraint / (squares + dot(own, own) + relaxation) : 0.0;
+#elif PASS == PASS_DELTA
+	int list = i * MAX_NEIGHBORS;
+	int fluid = int(neighborCount[i] & 255u);
+	int count = fluid + int(neighborCount[i] >> 8);
+	vec2 sum = vec2(0.0);
+	for (int n = 0; n < count; n++)
+	{
+		int j = neighbors[list + n];
+		vec2 offset = predicted[i] - (n < fluid ? predicted[j] : walls[j]);
+		float gradient;
+		kernel(offset, n < fluid && j < i, gradient);
+		sum += gradient * (lambda[i] + (n < fluid ? lambda[j] : lambda[i])) * offset;
+	}
+	delta[i] = sum * inverseRest;
+#elif PASS == PASS_APPLY
+	predicted[i] = keepInside(predicted[i] + delta[i]);
+#elif PASS == PASS_VELOCITY
+	velocity[i] = (predicted[i] - position[i]) / dt;
+#elif PASS == PASS_VISCOSITY
+	int list = i * MAX_NEIGHBORS;
+	int fluid = int(neighborCount[i] & 255u);
+	vec2 sum = vec2(0.0);
+	for (int n = 0; n < fluid; n++)
+	{
+		int j = neighbors[list + n];
+		vec2 offset = predicted[i] - predicted[j];
+		float difference = max(radius * radius - dot(offset, offset), 0.0);
+		sum += (velocity[j] - velocity[i]) * (difference * difference * difference);
+	}
+	delta[i] = velocity[i] + sum * viscosityScale;
+#elif PASS == PASS_MEASURE
+	int vessel = vesselAt(position[i]);
+	if (vessel >= 0)
+	{
+		atomicAdd(measure[1 + vessel], 1);
+	}
+	atomicMax(measure[0], floatBitsToUint(length(velocity[i])));
+#elif PASS == PASS_VERTICES
+	float speed = length(velocity[i]);
+	vertices[i].position = position[i];
+	vertices[i].color = packUnorm4x8(vec4(mix(waterColor.rgb, vec3(1.0), clamp(speed / speedWhite, 0.0, 1.0)), 1.0));
+	vertices[i].padding = 0;
+#endif
+#endif
+}
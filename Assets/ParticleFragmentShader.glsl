@@ -0,0 +1,58 @@
+/*
+Title: HydroDynamics
+File Name: ParticleFragmentShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Cuts the square of a point sprite into a disc. On its own it shades the disc a little
+darker towards its edge, so touching particles stay apart. With splat set, which is how
+FluidSurface.h draws the particles into its field, it writes how much of the particle
+covers the pixel instead, falling off from the center, and the color weighted by that.
+*/
+
+#version 400 core
+
+layout(location = 0) out vec4 out_color;
+
+in vec4 color;
+
+uniform int splat;
+
+void main(void)
+{
+	vec2 offset = gl_PointCoord * 2.0 - 1.0;
+	float distanceSquared = dot(offset, offset);
+	if (distanceSquared > 1.0)
+	{
+		discard;
+	}
+
+	if (splat != 0)
+	{
+		float weight = exp(-2.0 * distanceSquared);
+		out_color = vec4(color.rgb * weight, weight);
+	}
+	else
+	{
+		out_color = vec4(color.rgb * (0.7 + 0.3 * sqrt(1.0 - distanceSquared)), color.a);
+	}
+}
@@ -0,0 +1,50 @@
+/*
+Title: HydroDynamics
+File Name: ParticleVertexShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Draws every particle of --particles as a point sprite as large as the particle itself, so
+the particles grow and shrink with the zoom instead of staying a few pixels wide. The
+positions and colors come straight from the vertex buffer the simulation (or with --gpu,
+the compute shader) filled, and ParticleFragmentShader.glsl cuts the square of the point
+into a disc.
+*/
+
+#version 400 core
+
+layout(location = 0) in vec3 in_position;	// With --gpu only x and y are given, and z is 0
+layout(location = 1) in vec4 in_color;
+
+out vec4 color;
+
+#include "FrameBlock.glsl"
+uniform float radius;		// Of a particle, in the scene
+
+void main(void)
+{
+	color = in_color;
+	gl_Position = MVP * vec4(in_position, 1.0);
+
+	// Never smaller than 2 pixels, so the particles don't vanish when zoomed far out.
+	gl_PointSize = max(2.0 * radius * pointScale, 2.0);
+}
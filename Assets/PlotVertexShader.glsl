@@ -0,0 +1,88 @@
+/*
+Title: HydroDynamics
+File Name: PlotVertexShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Draws the series of a HistoryPlot (see HistoryPlot.h) straight from its pyramid of samples.
+Every instance is a series, drawn as a triangle strip with two vertices per pixel column:
+one at the smallest and one at the largest sample that falls into the column, half a pixel
+further out each, so the band between them is never thinner than a pixel. A column reads
+the level whose blocks are about as large as the samples it covers, which is two or three
+blocks, however many samples the chart shows.
+*/
+
+#version 400 core
+
+out vec4 color;
+
+#include "FrameBlock.glsl"
+uniform samplerBuffer pyramid;	// On texture unit 4: the minimum and maximum of every block of every level, all series side by side
+uniform int seriesCount;
+uniform int levelCount;
+uniform int ringSize;
+uniform int baseRing;			// Where in the ring the sample at the left edge is
+uniform int span;				// How many samples are across the chart
+uniform int validFrom;			// The first of them that was written
+uniform int columns;
+uniform float pixelHeight;		// In clip space
+uniform int levelOffset[24];	// Where every level starts, in blocks
+uniform vec4 seriesColor[8];
+uniform vec4 seriesLane[8];		// The smallest and largest sample of the series as stored, and the bottom and top of its part of the chart
+
+void main(void)
+{
+	int series = gl_InstanceID;
+	int column = gl_VertexID / 2;
+	bool upper = (gl_VertexID & 1) != 0;
+	float perColumn = float(span) / float(columns);
+
+	// Columns left of the first sample all collapse onto the lower vertex of the first column with one, so their triangles have
+	// no area.
+	int firstColumn = int(floor(float(validFrom) / perColumn));
+	if (column < firstColumn)
+	{
+		column = firstColumn;
+		upper = false;
+	}
+
+	int first = max(int(floor(float(column) * perColumn)), validFrom);
+	int last = min(max(int(floor(float(column + 1) * perColumn)), first + 1), span) - 1;
+	int level = min(int(floor(log2(max(perColumn, 1.0)))), levelCount - 1);
+	int ringBlocks = ringSize >> level;
+
+	vec2 range = vec2(1e30, -1e30);
+	for (int block = (baseRing + first) >> level; block <= (baseRing + last) >> level; block++)
+	{
+		vec2 extent = texelFetch(pyramid, (levelOffset[level] + (block & (ringBlocks - 1))) * seriesCount + series).rg;
+		range = vec2(min(range.x, extent.x), max(range.y, extent.y));
+	}
+
+	vec4 lane = seriesLane[series];
+	float value = upper ? range.y : range.x;
+	float height = clamp((value - lane.x) / max(lane.y - lane.x, 1e-20), 0.0, 1.0);
+	float y = mix(lane.z, lane.w, height) + (upper ? 0.5 : -0.5) * pixelHeight;
+	float x = -1.0 + 2.0 * (float(column) + 0.5) / float(columns);
+
+	color = seriesColor[series];
+	gl_Position = MVP * vec4(x, y, 0.0, 1.0);
+}
@@ -0,0 +1,81 @@
+/*
+Title: HydroDynamics
+File Name: SdfFragmentShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Draws the whole apparatus for --sdf in one pass, from a list of shapes instead of quads.
+Every shape is a rectangle, and its signed distance (negative inside) says how much of a
+pixel it covers: within half a pixel of the edge, the coverage goes from 1 to 0 with the
+distance, which antialiases the edges at any zoom without any extra samples. The shapes
+are composited in order, each over the ones before it.
+
+A shape is 3 texels of the shapes buffer:
+0: left, bottom, right and top
+1: its color
+2: 1 + the vessel whose fill level is added to its bottom and top, or 0 for none, and
+   whether the level is added to the bottom (y) and to the top (z)
+*/
+
+#version 400 core
+
+layout(location = 0) out vec4 out_color;
+
+in vec2 position;
+
+uniform samplerBuffer levels;	// The fill level (top edge) of every vessel, on texture unit 0
+uniform samplerBuffer shapes;	// On texture unit 1
+uniform int shapeCount;
+
+// The signed distance from p to a rectangle given as left, bottom, right and top.
+float boxDistance(vec2 p, vec4 box)
+{
+	vec2 q = abs(p - 0.5 * (box.xy + box.zw)) - 0.5 * (box.zw - box.xy);
+	return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0);
+}
+
+void main(void)
+{
+	// How large a pixel is in the scene. The MVP has no perspective, so this is the same everywhere.
+	float pixel = max(length(fwidth(position)) * 0.70710678, 1e-9);
+
+	vec3 color = vec3(0.0);
+	for (int i = 0; i < shapeCount; i++)
+	{
+		vec4 box = texelFetch(shapes, i * 3);
+		vec4 fill = texelFetch(shapes, i * 3 + 1);
+		vec4 follow = texelFetch(shapes, i * 3 + 2);
+		if (follow.x > 0.0)
+		{
+			float level = texelFetch(levels, int(follow.x) - 1).r;
+			box.y += follow.y * level;
+			box.w += follow.z * level;
+		}
+		if (box.w <= box.y)
+		{
+			continue;	// An empty vessel has nothing to draw, like its flat quad
+		}
+
+		float coverage = clamp(0.5 - boxDistance(position, box) / pixel, 0.0, 1.0);
+		color = mix(color, fill.rgb, coverage * fill.a);
+	}
+	out_color = vec4(color, 1.0);
+}
@@ -0,0 +1,43 @@
+/*
+Title: HydroDynamics
+File Name: SdfVertexShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Covers the screen with a single triangle for --sdf, and hands every pixel where it is in
+the scene, so SdfFragmentShader.glsl can work out which shapes cover it. No vertex buffer
+is read, the corners come from gl_VertexID.
+*/
+
+#version 400 core
+
+out vec2 position;	// Where in the scene this is
+
+#include "FrameBlock.glsl"
+
+void main(void)
+{
+	// The corners (-1, -1), (3, -1) and (-1, 3), which cover all of clip space.
+	vec2 corner = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID & 2) * 2.0 - 1.0);
+	vec4 scene = inverse(MVP) * vec4(corner, 0.0, 1.0);
+	position = scene.xy / scene.w;
+	gl_Position = vec4(corner, 0.0, 1.0);
+}
@@ -0,0 +1,116 @@
+/*
+Title: HydroDynamics
+File Name: SprayUpdate.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Advances the droplets of --spray by one frame, for SprayEffect.h. This is a vertex shader
+with nothing to draw: the rasterizer is off while it runs, and the varyings it writes are
+captured with transform feedback into the other of the two droplet buffers. That is all
+GL 4.0 has to write a buffer from a shader, so it runs where compute shaders don't.
+
+A droplet that is alive flies under gravity until its time is up or it falls back below
+the surface of the vessel it left. A dead one picks a vessel at random every frame, and is
+thrown up from it with a chance that grows with how fast the surface of that vessel moves,
+so the spray comes from where the water is rushing in or out.
+*/
+
+#version 400 core
+
+layout(location = 0) in vec4 in_state;		// x, y, and the velocity along both
+layout(location = 2) in vec2 in_droplet;	// The seconds the droplet has left (0 or less when it is dead), and its vessel
+
+out vec4 outState;
+out vec4 outColor;
+out vec2 outDroplet;
+
+uniform samplerBuffer vessels;	// left, right, top and how fast the top rises of every vessel, on texture unit 0
+uniform int vesselCount;
+uniform uint frame;			// Changes every frame, so the dice do too
+uniform float dt;
+uniform float gravity;
+uniform float spawnRate;	// Droplets a second for every dead droplet, per unit the surface moves in a second
+uniform float launchScale;	// How much faster than the surface a droplet is thrown up
+uniform float lifetime;
+
+// Where the dead droplets wait, far below anything the view shows, so their points are clipped.
+const vec4 parked = vec4(0.0, -1.0e9, 0.0, 0.0);
+
+// A hash of a number into 32 random bits (from the integer hash of Chris Wellons).
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+// A random number in [0, 1) for the droplet, the frame and which of the numbers of this frame it is.
+float random(uint droplet, uint k)
+{
+	return float(hash(droplet * 8U + k + hash(frame)) >> 8) / 16777216.0;
+}
+
+void main(void)
+{
+	uint id = uint(gl_VertexID);
+	vec4 state = in_state;
+	float life = in_droplet.x - dt;
+	int vessel = int(in_droplet.y);
+
+	if (in_droplet.x > 0.0)
+	{
+		state.w -= gravity * dt;
+		state.xy += state.zw * dt;
+		float top = texelFetch(vessels, vessel).z;
+		if (life <= 0.0 || (state.w < 0.0 && state.y < top))
+		{
+			life = 0.0;
+			state = parked;
+		}
+	}
+	else
+	{
+		life = 0.0;
+		state = parked;
+		vessel = min(int(random(id, 0U) * float(vesselCount)), vesselCount - 1);
+		vec4 source = texelFetch(vessels, vessel);
+		float speed = abs(source.w);
+		if (random(id, 1U) < min(speed * spawnRate * dt, 1.0))
+		{
+			// Thrown up and a little to either side, faster when the surface moves faster.
+			float x = mix(source.x, source.y, random(id, 2U));
+			float up = speed * launchScale * (0.5 + random(id, 3U));
+			float side = (random(id, 2U) - 0.5) * up;
+			state = vec4(x, source.z, side, up);
+			life = lifetime * (0.5 + 0.5 * random(id, 4U));
+		}
+	}
+
+	// Whiter the fresher the droplet is.
+	float fresh = clamp(life / lifetime, 0.0, 1.0);
+	outState = state;
+	outColor = vec4(mix(vec3(0.35, 0.55, 0.9), vec3(0.9, 0.95, 1.0), fresh), 1.0);
+	outDroplet = vec2(life, float(vessel));
+}
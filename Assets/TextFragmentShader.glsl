@@ -0,0 +1,45 @@
+/*
+Title: HydroDynamics
+File Name: TextFragmentShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Colors the pixels of a character that the glyph atlas sets, and discards the rest.
+*/
+
+#version 400 core
+
+layout(location = 0) out vec4 out_color;
+
+in vec2 atlasPosition;
+in vec4 color;
+
+uniform sampler2D atlas;	// On texture unit 3
+
+void main(void)
+{
+	if (texture(atlas, atlasPosition).r < 0.5)
+	{
+		discard;
+	}
+	out_color = color;
+}
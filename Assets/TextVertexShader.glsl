@@ -0,0 +1,47 @@
+/*
+Title: HydroDynamics
+File Name: TextVertexShader.glsl
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Draws the quads of the characters written with TextRenderer.h. The positions are in pixels
+from the top left of the window, which the MVP turns into clip space, and every vertex
+says where in the glyph atlas it is.
+*/
+
+#version 400 core
+
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec2 in_atlas;
+layout(location = 2) in vec4 in_color;
+
+out vec2 atlasPosition;
+out vec4 color;
+
+#include "FrameBlock.glsl"
+
+void main(void)
+{
+	atlasPosition = in_atlas;
+	color = in_color;
+	gl_Position = MVP * vec4(in_position, 0.0, 1.0);
+}
@@ -33,15 +33,77 @@ delta time for the update function will always equal the physics timestep.
 
 #version 400 core // Identifies the version of the shader, this line must be on a separate line from the rest of the shader code
  
+#ifdef INSTANCED
+// One rectangle per instance from a single unit quad, for --sweep-view and the bars of a zoomed out network. The quad gives the
+// corner in [0, 1] x [0, 1], and the attributes of the instance give the rectangle it is stretched over and its color.
+layout(location = 0) in vec2 in_corner;	// Which corner of the unit quad this is
+layout(location = 1) in vec4 in_rect;	// Per instance: left, bottom, right and top of the rectangle
+layout(location = 2) in vec4 in_color;	// Per instance: its color
+#else
 layout(location = 0) in vec3 in_position;	// Get in a vec3 for position
 layout(location = 1) in vec4 in_color;		// Get in a vec4 for color
+layout(location = 2) in float in_level;		// 1 + the vessel whose fill level is added to y, or 0 for none
+uniform samplerBuffer levels; // The fill level (top edge) of every vessel, on texture unit 0
+#endif
 
 out vec4 color; // Our vec4 color variable containing r, g, b, a
 
-uniform mat4 MVP; // Our uniform MVP matrix to modify our position values
+#if defined(HEATMAP) || defined(RIPPLES)
+uniform int vesselVertices;	// The vertices of the vessel quads, which come first, 4 each, or -1 if there are none (the grid)
+#endif
+
+#ifdef HEATMAP
+// For --heatmap: where this vertex is on the colormap, from 0 for no pressure to 1 for the top of it, or below 0 where there is no
+// fluid to color. The pressure below the fill level only grows with the depth, so working it out at the corners of a vessel quad
+// is exact across the whole quad. The grid has the pressure of every cell as an attribute instead.
+layout(location = 3) in float in_pressure;	// With the grid, the pressure of the cell of this vertex
+uniform vec2 heatScale;		// The density times gravity, and 1 over the pressure at the top of the colormap
+out float heat;
+#endif
+
+#ifdef RIPPLES
+// For --ripples: what the fragment shader needs to draw waves on the surface of a vessel, which are all worked out there from the
+// time and how fast the level moves. x is the x of the vertex, y how far it is below the fill level, z how high the waves of its
+// vessel are (0 outside the vessels, and for a level at rest), and w the vessel, which shifts the phase of its waves.
+uniform samplerBuffer levelSpeeds;	// How fast the level of every vessel moves, on texture unit 5
+uniform vec2 ripple;				// The highest a wave gets, and 1 over the speed of the level that makes it that high
+out vec4 rippleSurface;
+#endif
+
+#include "FrameBlock.glsl"
 
 void main(void)
 {
 	color = in_color;	// Pass the color through
-	gl_Position = MVP * vec4(in_position, 1.0); //w is 1.0, also notice cast to a vec4
-}
\ No newline at end of file
+#ifdef INSTANCED
+	gl_Position = MVP * vec4(mix(in_rect.xy, in_rect.zw, in_corner), 0.0, 1.0);
+#else
+	vec3 position = in_position;
+	if (in_level > 0.0)
+	{
+		position.y += texelFetch(levels, int(in_level) - 1).r;
+	}
+	gl_Position = MVP * vec4(position, 1.0); //w is 1.0, also notice cast to a vec4
+#ifdef HEATMAP
+	heat = -1.0;
+	if (vesselVertices < 0)
+	{
+		heat = max(in_pressure * heatScale.y, 0.0);
+	}
+	else if (gl_VertexID < vesselVertices)
+	{
+		heat = (texelFetch(levels, gl_VertexID / 4).r - position.y) * heatScale.x * heatScale.y;
+		color = vec4(1.0);
+	}
+#endif
+#ifdef RIPPLES
+	rippleSurface = vec4(0.0);
+	if (gl_VertexID < vesselVertices)
+	{
+		int vessel = gl_VertexID / 4;
+		float speed = abs(texelFetch(levelSpeeds, vessel).r);
+		rippleSurface = vec4(position.x, texelFetch(levels, vessel).r - position.y, ripple.x * min(speed * ripple.y, 1.0), float(vessel));
+	}
+#endif
+#endif
+}
@@ -0,0 +1,524 @@
+/*
+Title: HydroDynamics
+File Name: AlgebraicMultigrid.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+An algebraic multigrid preconditioner (smoothed aggregation) for the matrix of the implicit
+step (see ImplicitSolver.h), for the networks the geometric multigrid of the grid fluid
+can't help with: there is no grid to coarsen, and the tubes couple with strengths that can
+differ by orders of magnitude from one to the next.
+
+The coarser levels come from the matrix alone. Rows that are strongly coupled (|a_ij| above
+a fraction of sqrt(a_ii a_jj)) are grouped into aggregates, every aggregate becomes one row
+of the next level, and the prolongator P that takes a coarse solution back to the fine rows
+is the constant over each aggregate, smoothed by one damped Jacobi step so neighbouring
+aggregates blend into each other. The coarse matrix is P^T A P. That goes on until a level
+is small enough to factor outright (see SparseCholesky in SparseMatrix.h).
+
+Applying the preconditioner is one V-cycle from zero: a damped Jacobi sweep, the residual
+restricted to the next level, the cycle there, its solution prolonged back, and another
+sweep. The sweeps are the same before and after the coarse correction, which keeps the cycle
+symmetric as the conjugate gradient method needs. Everything but the coarsest solve is a
+sparse multiply or an update of every row on its own, so it runs on every core, with the
+same result either way.
+
+The aggregates only follow the pattern and size of the couplings, so they are built once
+per topology (setup()). When the values change, like when the step size does, refresh()
+smooths the prolongators and multiplies out the coarse matrices again over the same
+aggregates. Both build every level on every core, block of rows by block of rows, and only
+the aggregation goes through the rows in order on one thread, because every row it takes
+depends on the ones before.
+*/
+
+#include "AlgebraicMultigrid.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cmath>
+
+// The same blocking as the rest of the solver: levels with fewer rows than this are smoothed on one thread.
+#define AMG_PARALLEL_MIN 8192
+#define AMG_BLOCK_SIZE 4096
+
+// Coarsening stops at a level with at most this many rows, which is factored, or once a level would keep more than this fraction of
+// the rows of the one before.
+#define AMG_COARSEST_ROWS 512
+#define AMG_MAX_LEVELS 16
+#define AMG_MIN_COARSENING 0.8f
+
+// If the coarsest level can't be factored, it gets this many Jacobi sweeps instead.
+#define AMG_COARSEST_SWEEPS 20
+
+template <typename Body>
+static void forBlocks(int count, TaskPool* pool, const Body& body)
+{
+	if (pool != nullptr && count >= AMG_PARALLEL_MIN)
+	{
+		pool->parallelFor(count, AMG_BLOCK_SIZE, body);
+		return;
+	}
+
+	for (int begin = 0; begin < count; begin += AMG_BLOCK_SIZE)
+	{
+		body(begin, std::min(begin + AMG_BLOCK_SIZE, count));
+	}
+}
+
+// transposed = matrix^T, for a matrix with the given number of columns.
+static void transpose(const SparseMatrix& matrix, int columns, SparseMatrix& transposed)
+{
+	transposed.rows = columns;
+	transposed.rowStart.assign(columns + 1, 0);
+	for (int k = 0; k < matrix.nonZeros(); k++)
+	{
+		transposed.rowStart[matrix.column[k] + 1]++;
+	}
+	for (int c = 0; c < columns; c++)
+	{
+		transposed.rowStart[c + 1] += transposed.rowStart[c];
+	}
+
+	// Going through the rows in order keeps the columns of every transposed row sorted.
+	transposed.column.resize(matrix.nonZeros());
+	transposed.value.resize(matrix.nonZeros());
+	std::vector<int> fill(transposed.rowStart.begin(), transposed.rowStart.end() - 1);
+	for (int i = 0; i < matrix.rows; i++)
+	{
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1]; k++)
+		{
+			int slot = fill[matrix.column[k]]++;
+			transposed.column[slot] = i;
+			transposed.value[slot] = matrix.value[k];
+		}
+	}
+}
+
+// Adds up the entries of one row in a dense array with room for every column, and remembers which columns it touched.
+struct RowBuilder
+{
+	std::vector<double> sum;
+	std::vector<unsigned> seen;		// The generation of the row every column was last added to
+	std::vector<int> used;
+	unsigned generation = 0;
+
+	void start(int columns)
+	{
+		if ((int)seen.size() < columns)
+		{
+			sum.resize(columns);
+			seen.resize(columns, 0);
+		}
+		used.clear();
+		if (++generation == 0)
+		{
+			std::fill(seen.begin(), seen.end(), 0u);
+			generation = 1;
+		}
+	}
+
+	void add(int column, double value)
+	{
+		if (seen[column] != generation)
+		{
+			seen[column] = generation;
+			sum[column] = 0.0;
+			used.push_back(column);
+		}
+		sum[column] += value;
+	}
+};
+
+// Every thread that builds rows keeps its own, as large as the widest matrix it built.
+static thread_local RowBuilder rowBuilder;
+
+// Builds result, a matrix with the given number of columns, row by row, on the pool for large matrices, with row(i, builder)
+// adding the entries of row i. Every block of rows goes into a piece of its own, and the pieces are joined at the end. The entries
+// of a column are added up in the order they came, and entries that add up to 0 are kept, so the pattern and the values are the
+// same with or without a pool.
+template <typename Row>
+static void buildRows(int rows, int columns, TaskPool* pool, const Row& row, SparseMatrix& result)
+{
+	struct Piece
+	{
+		std::vector<int> length;
+		std::vector<int> column;
+		std::vector<float> value;
+	};
+	std::vector<Piece> pieces((rows + AMG_BLOCK_SIZE - 1) / AMG_BLOCK_SIZE);
+	forBlocks(rows, pool, [&](int begin, int end)
+	{
+		Piece& piece = pieces[begin / AMG_BLOCK_SIZE];
+		piece.length.reserve(end - begin);
+		RowBuilder& builder = rowBuilder;
+		for (int i = begin; i < end; i++)
+		{
+			builder.start(columns);
+			row(i, builder);
+			std::sort(builder.used.begin(), builder.used.end());
+			for (int c : builder.used)
+			{
+				piece.column.push_back(c);
+				piece.value.push_back((float)builder.sum[c]);
+			}
+			piece.length.push_back((int)builder.used.size());
+		}
+	});
+
+	std::vector<int> pieceStart(pieces.size() + 1, 0);
+	for (size_t p = 0; p < pieces.size(); p++)
+	{
+		pieceStart[p + 1] = pieceStart[p] + (int)pieces[p].column.size();
+	}
+	result.rows = rows;
+	result.rowStart.assign(rows + 1, 0);
+	result.column.resize(pieceStart.back());
+	result.value.resize(pieceStart.back());
+	forBlocks(rows, pool, [&](int begin, int end)
+	{
+		int p = begin / AMG_BLOCK_SIZE;
+		const Piece& piece = pieces[p];
+		int at = pieceStart[p];
+		std::copy(piece.column.begin(), piece.column.end(), result.column.begin() + at);
+		std::copy(piece.value.begin(), piece.value.end(), result.value.begin() + at);
+		for (int i = begin; i < end; i++)
+		{
+			at += piece.length[i - begin];
+			result.rowStart[i + 1] = at;
+		}
+	});
+}
+
+// product = a * b, where b has the given number of columns.
+static void multiplyMatrices(const SparseMatrix& a, const SparseMatrix& b, int columns, TaskPool* pool, SparseMatrix& product)
+{
+	buildRows(a.rows, columns, pool, [&](int i, RowBuilder& row)
+	{
+		for (int k = a.rowStart[i]; k < a.rowStart[i + 1]; k++)
+		{
+			int j = a.column[k];
+			double entry = a.value[k];
+			for (int m = b.rowStart[j]; m < b.rowStart[j + 1]; m++)
+			{
+				row.add(b.column[m], entry * b.value[m]);
+			}
+		}
+	}, product);
+}
+
+int AlgebraicMultigrid::aggregate(const SparseMatrix& matrix, std::vector<int>& aggregateOf) const
+{
+	int n = matrix.rows;
+	std::vector<float> diagonal(n, 0.0f);
+	for (int i = 0; i < n; i++)
+	{
+		int k = matrix.find(i, i);
+		diagonal[i] = k >= 0 ? matrix.value[k] : 0.0f;
+	}
+	float threshold = strength * strength;
+	auto strong = [&](int i, int k)
+	{
+		int j = matrix.column[k];
+		float a = matrix.value[k];
+		return j != i && a * a > threshold * diagonal[i] * diagonal[j];
+	};
+
+	// First every row whose strong neighbours are all still free starts an aggregate with them.
+	aggregateOf.assign(n, -1);
+	int count = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (aggregateOf[i] >= 0)
+		{
+			continue;
+		}
+		bool free = true;
+		bool coupled = false;
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1] && free; k++)
+		{
+			if (strong(i, k))
+			{
+				coupled = true;
+				free = aggregateOf[matrix.column[k]] < 0;
+			}
+		}
+		if (!free || !coupled)
+		{
+			continue;
+		}
+		aggregateOf[i] = count;
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1]; k++)
+		{
+			if (strong(i, k))
+			{
+				aggregateOf[matrix.column[k]] = count;
+			}
+		}
+		count++;
+	}
+
+	// Then the rows left over join the aggregate they are most strongly coupled to, as it was after the first pass.
+	std::vector<int> first(aggregateOf);
+	for (int i = 0; i < n; i++)
+	{
+		if (aggregateOf[i] >= 0)
+		{
+			continue;
+		}
+		float best = 0.0f;
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1]; k++)
+		{
+			int j = matrix.column[k];
+			if (strong(i, k) && first[j] >= 0 && std::fabs(matrix.value[k]) > best)
+			{
+				best = std::fabs(matrix.value[k]);
+				aggregateOf[i] = first[j];
+			}
+		}
+	}
+
+	// And whatever has no strong neighbour in an aggregate makes one of its own, with its free strong neighbours.
+	for (int i = 0; i < n; i++)
+	{
+		if (aggregateOf[i] >= 0)
+		{
+			continue;
+		}
+		aggregateOf[i] = count;
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1]; k++)
+		{
+			if (strong(i, k) && aggregateOf[matrix.column[k]] < 0)
+			{
+				aggregateOf[matrix.column[k]] = count;
+			}
+		}
+		count++;
+	}
+	return count;
+}
+
+void AlgebraicMultigrid::coarsen(int l, TaskPool* pool)
+{
+	const SparseMatrix& a = matrixOf(l);
+	Level& level = levels[l];
+	int n = a.rows;
+	int coarseRows = level.aggregates;
+
+	// The tentative prolongator T is 1 / sqrt(size) for every row of an aggregate, so its columns have length 1.
+	std::vector<int> size(coarseRows, 0);
+	for (int i = 0; i < n; i++)
+	{
+		size[level.aggregate[i]]++;
+	}
+	std::vector<float> tentative(n);
+
+	// P = (I - w D^-1 A) T, with w = 4 / (3 rho) and rho the largest eigenvalue of D^-1 A, bounded by the largest row sum of |a_ij| / a_ii.
+	// Every block of rows finds its own largest sum, and the largest of those is the same whatever order they come in.
+	std::vector<float> diagonal(n, 0.0f);
+	std::vector<float> blockRho((n + AMG_BLOCK_SIZE - 1) / AMG_BLOCK_SIZE, 0.0f);
+	forBlocks(n, pool, [&](int begin, int end)
+	{
+		float rho = 0.0f;
+		for (int i = begin; i < end; i++)
+		{
+			tentative[i] = 1.0f / std::sqrt((float)size[level.aggregate[i]]);
+			double sum = 0.0;
+			for (int k = a.rowStart[i]; k < a.rowStart[i + 1]; k++)
+			{
+				sum += std::fabs(a.value[k]);
+				diagonal[i] = a.column[k] == i ? a.value[k] : diagonal[i];
+			}
+			rho = std::max(rho, diagonal[i] > 0.0f ? (float)(sum / diagonal[i]) : 0.0f);
+		}
+		blockRho[begin / AMG_BLOCK_SIZE] = rho;
+	});
+	float rho = blockRho.empty() ? 0.0f : *std::max_element(blockRho.begin(), blockRho.end());
+	float weight = rho > 0.0f ? 4.0f / (3.0f * rho) : 0.0f;
+
+	buildRows(n, coarseRows, pool, [&](int i, RowBuilder& row)
+	{
+		row.add(level.aggregate[i], tentative[i]);
+		float scale = diagonal[i] > 0.0f ? weight / diagonal[i] : 0.0f;
+		for (int k = a.rowStart[i]; k < a.rowStart[i + 1]; k++)
+		{
+			int j = a.column[k];
+			row.add(level.aggregate[j], -scale * a.value[k] * tentative[j]);
+		}
+	}, level.prolongator);
+
+	transpose(level.prolongator, coarseRows, level.restriction);
+	SparseMatrix ap;
+	multiplyMatrices(a, level.prolongator, coarseRows, pool, ap);
+	multiplyMatrices(level.restriction, ap, coarseRows, pool, levels[l + 1].matrix);
+}
+
+void AlgebraicMultigrid::prepareSmoothers(TaskPool* pool)
+{
+	for (int l = 0; l < levelCount(); l++)
+	{
+		const SparseMatrix& a = matrixOf(l);
+		Level& level = levels[l];
+		level.inverseDiagonal.resize(a.rows);
+		level.rhs.resize(l == 0 ? 0 : a.rows);
+		level.solution.resize(l == 0 ? 0 : a.rows);
+		level.residual.resize(a.rows);
+
+		// The same weight as in the prolongator, 4 / (3 rho), with rho bounded the same way.
+		std::vector<float> blockRho((a.rows + AMG_BLOCK_SIZE - 1) / AMG_BLOCK_SIZE, 0.0f);
+		forBlocks(a.rows, pool, [&](int begin, int end)
+		{
+			float rho = 0.0f;
+			for (int i = begin; i < end; i++)
+			{
+				double sum = 0.0;
+				float diagonal = 0.0f;
+				for (int k = a.rowStart[i]; k < a.rowStart[i + 1]; k++)
+				{
+					sum += std::fabs(a.value[k]);
+					diagonal = a.column[k] == i ? a.value[k] : diagonal;
+				}
+				level.inverseDiagonal[i] = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+				rho = std::max(rho, (float)(sum * level.inverseDiagonal[i]));
+			}
+			blockRho[begin / AMG_BLOCK_SIZE] = rho;
+		});
+		float rho = blockRho.empty() ? 0.0f : *std::max_element(blockRho.begin(), blockRho.end());
+		level.smootherWeight = rho > 0.0f ? 4.0f / (3.0f * rho) : 0.0f;
+	}
+
+	const SparseMatrix& coarsest = matrixOf(levelCount() - 1);
+	coarseFactored = coarse.nonZeros() > 0 && coarse.factor(coarsest);
+}
+
+void AlgebraicMultigrid::setup(const SparseMatrix& matrix, TaskPool* pool)
+{
+	fine = &matrix;
+	levels.assign(1, Level());
+	while (levelCount() < AMG_MAX_LEVELS)
+	{
+		int l = levelCount() - 1;
+		const SparseMatrix& a = matrixOf(l);
+		if (a.rows <= AMG_COARSEST_ROWS)
+		{
+			break;
+		}
+		int count = aggregate(a, levels[l].aggregate);
+		if (count == 0 || count > a.rows * AMG_MIN_COARSENING)
+		{
+			levels[l].aggregate.clear();
+			break;
+		}
+		levels[l].aggregates = count;
+		levels.emplace_back();
+		coarsen(l, pool);
+	}
+
+	// The coarsest pattern stays the same as long as the aggregates do, so it is only analysed here.
+	coarse = SparseCholesky();
+	coarse.analyse(matrixOf(levelCount() - 1));
+	prepareSmoothers(pool);
+}
+
+void AlgebraicMultigrid::refresh(const SparseMatrix& matrix, TaskPool* pool)
+{
+	fine = &matrix;
+	for (int l = 0; l + 1 < levelCount(); l++)
+	{
+		coarsen(l, pool);
+	}
+	prepareSmoothers(pool);
+}
+
+void AlgebraicMultigrid::cycle(int l, const float* b, float* x, TaskPool* pool)
+{
+	const SparseMatrix& a = matrixOf(l);
+	Level& level = levels[l];
+	int n = a.rows;
+	const float* inverse = level.inverseDiagonal.data();
+	float weight = level.smootherWeight;
+	float* residual = level.residual.data();
+
+	// x += w D^-1 (b - A x)
+	auto sweep = [&]()
+	{
+		a.multiply(x, residual, pool);
+		forBlocks(n, pool, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				x[i] += weight * inverse[i] * (b[i] - residual[i]);
+			}
+		});
+	};
+
+	if (l == levelCount() - 1)
+	{
+		if (coarseFactored)
+		{
+			coarse.apply(b, x);
+			return;
+		}
+		std::fill(x, x + n, 0.0f);
+		for (int s = 0; s < AMG_COARSEST_SWEEPS; s++)
+		{
+			sweep();
+		}
+		return;
+	}
+
+	// The first sweep from x = 0 is just x = w D^-1 b.
+	forBlocks(n, pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			x[i] = weight * inverse[i] * b[i];
+		}
+	});
+
+	// Restrict the residual, solve for the error on the next level, and add it back.
+	Level& next = levels[l + 1];
+	a.multiply(x, residual, pool);
+	forBlocks(n, pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			residual[i] = b[i] - residual[i];
+		}
+	});
+	level.restriction.multiply(residual, next.rhs.data(), pool);
+	cycle(l + 1, next.rhs.data(), next.solution.data(), pool);
+	level.prolongator.multiply(next.solution.data(), residual, pool);
+	forBlocks(n, pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			x[i] += residual[i];
+		}
+	});
+
+	sweep();
+}
+
+void AlgebraicMultigrid::apply(const SparseMatrix& matrix, const float* r, float* z, TaskPool* pool)
+{
+	fine = &matrix;
+	cycle(0, r, z, pool);
+}
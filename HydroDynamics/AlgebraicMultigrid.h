@@ -0,0 +1,119 @@
+/*
+Title: HydroDynamics
+File Name: AlgebraicMultigrid.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+An algebraic multigrid preconditioner (smoothed aggregation) for the vessel system of the
+implicit step (see ImplicitSolver.h), for the networks the geometric multigrid of the grid
+fluid can't help with: there is no grid to coarsen, and the tubes couple the vessels with
+strengths that can differ by orders of magnitude from one to the next. It suits matrices
+like that one, a graph Laplacian plus a positive diagonal, whose smoothest errors are close
+to constant over strongly coupled rows.
+
+The coarser levels come from the matrix alone. Rows that are strongly coupled (|a_ij| above
+a fraction of sqrt(a_ii a_jj)) are grouped into aggregates, every aggregate becomes one row
+of the next level, and the prolongator P that takes a coarse solution back to the fine rows
+is the constant over each aggregate, smoothed by one damped Jacobi step so neighbouring
+aggregates blend into each other. The coarse matrix is P^T A P. That goes on until a level
+is small enough to factor outright (see SparseCholesky in SparseMatrix.h).
+
+Applying the preconditioner is one V-cycle from zero: a damped Jacobi sweep, the residual
+restricted to the next level, the cycle there, its solution prolonged back, and another
+sweep. The sweeps are the same before and after the coarse correction, which keeps the cycle
+symmetric as the conjugate gradient method needs. Everything but the coarsest solve is a
+sparse multiply or an update of every row on its own, so it runs on every core, with the
+same result either way.
+
+The aggregates only follow the pattern and size of the couplings, so they are built once
+per topology (setup()). When the values change, like when the step size does, refresh()
+smooths the prolongators and multiplies out the coarse matrices again over the same
+aggregates. Both build every level on every core, block of rows by block of rows, and only
+the aggregation goes through the rows in order on one thread, because every row it takes
+depends on the ones before.
+*/
+
+#ifndef _ALGEBRAIC_MULTIGRID_H
+#define _ALGEBRAIC_MULTIGRID_H
+
+#include <vector>
+#include "SparseMatrix.h"
+
+class TaskPool;
+
+class AlgebraicMultigrid
+{
+public:
+	// Two rows are coupled strongly if |a_ij| > strength * sqrt(a_ii a_jj).
+	float strength = 0.08f;
+
+	// Builds the levels for a symmetric positive definite matrix. The finest level is the matrix itself, which isn't copied, so
+	// refresh() and apply() take it again. Everything but the aggregation runs on the pool, with the same result without one.
+	void setup(const SparseMatrix& matrix, TaskPool* pool);
+
+	// Fills in the levels again for new values of the matrix of setup(), keeping the aggregates. Runs on the pool like setup().
+	void refresh(const SparseMatrix& matrix, TaskPool* pool);
+
+	// z = M^-1 r, one V-cycle. The result is the same with or without a pool.
+	void apply(const SparseMatrix& matrix, const float* r, float* z, TaskPool* pool);
+
+	// How many levels there are, including the finest, and how many rows the coarsest has. 0 before setup().
+	int levelCount() const { return (int)levels.size(); }
+	int coarsestRows() const { return levels.empty() ? 0 : matrixOf(levelCount() - 1).rows; }
+
+private:
+	struct Level
+	{
+		SparseMatrix matrix;			// A on this level. Empty on the finest, which is the matrix of setup().
+		std::vector<int> aggregate;		// Per row: the row of the next level it is part of. Empty on the coarsest.
+		int aggregates = 0;
+		SparseMatrix prolongator;		// P, from the rows of the next level to these
+		SparseMatrix restriction;		// P^T
+		std::vector<float> inverseDiagonal;
+		float smootherWeight = 0.0f;
+
+		// For apply(): the right hand side and the solution of this level (the arguments of apply() on the finest), and a residual.
+		std::vector<float> rhs;
+		std::vector<float> solution;
+		std::vector<float> residual;
+	};
+
+	const SparseMatrix& matrixOf(int level) const { return level == 0 ? *fine : levels[level].matrix; }
+
+	// Groups the rows of a matrix into aggregates. Returns how many there are.
+	int aggregate(const SparseMatrix& matrix, std::vector<int>& aggregateOf) const;
+
+	// Builds P and P^T of a level from its aggregates, and the matrix of the next level.
+	void coarsen(int level, TaskPool* pool);
+
+	// The Jacobi smoother of every level, and the factor of the coarsest.
+	void prepareSmoothers(TaskPool* pool);
+
+	void cycle(int level, const float* b, float* x, TaskPool* pool);
+
+	const SparseMatrix* fine = nullptr;	// The matrix of the call that is running
+	std::vector<Level> levels;
+	SparseCholesky coarse;
+	bool coarseFactored = false;
+};
+
+#endif // _ALGEBRAIC_MULTIGRID_H
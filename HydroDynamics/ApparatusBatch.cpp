@@ -0,0 +1,153 @@
+/*
+Title: HydroDynamics
+File Name: ApparatusBatch.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Many independent copies of the classic apparatus, stepped side by side with one stream of
+vector instructions, for sweeps (see Sweep.h).
+
+In a VesselNetwork every apparatus is a component of two vessels and a tube, so a step of the
+tube kernel gathers the heights and pressures of its ends from wherever they are, and the
+vessels then gather the changes of their tubes again. With one tube per component, most of
+every register goes to gathering. Here eight apparatus make up a block, and every attribute
+of the block is a row of eight floats (see ApparatusBlock in SimdKernels.h): one load fills a
+register with the heights of eight big vessels, and a single pass through the kernel steps
+the whole block without a gather or a scatter.
+
+The kernel does the operations of the network step in the same order, so every apparatus
+ends up exactly where it would in a network of its own, to the last bit. It only does the
+step the network takes in single precision with the local integrator; a sweep with other
+settings runs in a network. A lane that doesn't move falls asleep like a component of the
+network, and a block where all of them sleep is skipped.
+
+This file has no OpenGL dependency.
+*/
+
+#include "ApparatusBatch.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+
+void ApparatusBatch::clear()
+{
+	blocks.clear();
+	rests.clear();
+	awakeBlocks.clear();
+	blockAwake.clear();
+	apparatusCount = 0;
+}
+
+int ApparatusBatch::add(float bigWidth, float smallWidth, float bigHeight, float smallHeight, float pressure, float inertance, float damping)
+{
+	int i = apparatusCount++;
+	int l = i % BATCH_LANES;
+	if (l == 0)
+	{
+		// The lanes of a new block are empty and asleep until they get an apparatus. Their widths are 1, so the kernel doesn't divide
+		// by 0 on them.
+		ApparatusBlock block = {};
+		for (int k = 0; k < BATCH_LANES; k++)
+		{
+			block.bigWidth[k] = 1.0f;
+			block.smallWidth[k] = 1.0f;
+			block.stiffness[k] = 2.0f;
+			block.invInertance[k] = 1.0f;
+		}
+		blocks.push_back(block);
+		awakeBlocks.push_back((int)blocks.size() - 1);
+		blockAwake.push_back(0);
+	}
+
+	// The same values VesselNetwork::addTube() and rebuildTopology() work out for the tube.
+	ApparatusBlock& block = blocks.back();
+	block.bigHeight[l] = bigHeight;
+	block.smallHeight[l] = smallHeight;
+	block.bigWidth[l] = bigWidth;
+	block.smallWidth[l] = smallWidth;
+	block.pressure[l] = pressure;
+	block.invInertance[l] = 1.0f / inertance;
+	block.damping[l] = damping;
+	block.stiffness[l] = 1.0f / bigWidth + 1.0f / smallWidth;
+	block.flow[l] = 0.0f;
+	block.lowest[l] = bigHeight;
+	block.highest[l] = bigHeight;
+	block.awake[l] = -1;
+	blockAwake.back() |= 1 << l;
+	rests.push_back(-1);
+	return i;
+}
+
+bool ApparatusBatch::update(float density, float gravity, float dt, long long step, TaskPool* pool)
+{
+	if (awakeBlocks.empty())
+	{
+		return false;
+	}
+
+	float scale = gravity * density;
+	FlowStep flowStep;
+	flowStep.dt = dt;
+	flowStep.dtSquaredScale = dt * dt * scale;
+	flowStep.restFlow = REST_FLOW;
+	flowStep.restPressure = REST_HEIGHT * scale;
+
+	// Every block only writes itself and the rests of its own lanes, so any of them can run at the same time as any other.
+	const SimdKernels& simd = simdKernels();
+	auto stepBlocks = [&](int begin, int end)
+	{
+		for (int k = begin; k < end; k++)
+		{
+			int b = awakeBlocks[k];
+			int awake = simd.apparatusStep(blocks[b], scale, flowStep);
+			int resting = blockAwake[b] & ~awake;
+			for (int l = 0; resting != 0; l++, resting >>= 1)
+			{
+				if (resting & 1)
+				{
+					rests[b * BATCH_LANES + l] = step;
+				}
+			}
+			blockAwake[b] = awake;
+		}
+	};
+	int count = (int)awakeBlocks.size();
+	if (pool != nullptr && count > BATCH_POOL_BLOCKS)
+	{
+		pool->parallelFor(count, BATCH_POOL_BLOCKS, stepBlocks);
+	}
+	else
+	{
+		stepBlocks(0, count);
+	}
+
+	// A block that fell asleep as a whole doesn't come back, so it leaves the list.
+	size_t kept = 0;
+	for (int b : awakeBlocks)
+	{
+		if (blockAwake[b] != 0)
+		{
+			awakeBlocks[kept++] = b;
+		}
+	}
+	awakeBlocks.resize(kept);
+	return kept > 0;
+}
@@ -0,0 +1,88 @@
+/*
+Title: HydroDynamics
+File Name: ApparatusBatch.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Many independent copies of the classic apparatus, stepped side by side with one stream of
+vector instructions, for sweeps (see Sweep.h).
+
+In a VesselNetwork every apparatus is a component of two vessels and a tube, so a step of the
+tube kernel gathers the heights and pressures of its ends from wherever they are, and the
+vessels then gather the changes of their tubes again. With one tube per component, most of
+every register goes to gathering. Here eight apparatus make up a block, and every attribute
+of the block is a row of eight floats (see ApparatusBlock in SimdKernels.h): one load fills a
+register with the heights of eight big vessels, and a single pass through the kernel steps
+the whole block without a gather or a scatter.
+
+The kernel does the operations of the network step in the same order, so every apparatus
+ends up exactly where it would in a network of its own, to the last bit. It only does the
+step the network takes in single precision with the local integrator; a sweep with other
+settings runs in a network. A lane that doesn't move falls asleep like a component of the
+network, and a block where all of them sleep is skipped.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _APPARATUS_BATCH_H
+#define _APPARATUS_BATCH_H
+
+#include "SimdKernels.h"
+#include <vector>
+
+class TaskPool;
+
+// How many blocks every task of the pool gets.
+#define BATCH_POOL_BLOCKS 256
+
+class ApparatusBatch
+{
+public:
+	// Removes every apparatus.
+	void clear();
+
+	// Adds an apparatus like the classic one, with its big vessel pushed on by pressure, and returns its index.
+	int add(float bigWidth, float smallWidth, float bigHeight, float smallHeight, float pressure, float inertance, float damping);
+
+	int count() const { return apparatusCount; }
+
+	// Advances every apparatus that hasn't come to rest by dt, and remembers step as the step of those that come to rest in it.
+	// Returns false if nothing moved. The result is the same with or without a pool.
+	bool update(float density, float gravity, float dt, long long step, TaskPool* pool = nullptr);
+
+	float bigHeight(int i) const { return blocks[i / BATCH_LANES].bigHeight[i % BATCH_LANES]; }
+	float smallHeight(int i) const { return blocks[i / BATCH_LANES].smallHeight[i % BATCH_LANES]; }
+	float lowest(int i) const { return blocks[i / BATCH_LANES].lowest[i % BATCH_LANES]; }
+	float highest(int i) const { return blocks[i / BATCH_LANES].highest[i % BATCH_LANES]; }
+
+	// The step an apparatus came to rest in, or -1 while it moves.
+	long long restStep(int i) const { return rests[i]; }
+
+private:
+	std::vector<ApparatusBlock> blocks;
+	std::vector<long long> rests;
+	std::vector<int> awakeBlocks;		// The blocks with a lane that still moves
+	std::vector<int> blockAwake;		// Per block, the mask its last step returned
+	int apparatusCount = 0;
+};
+
+#endif // _APPARATUS_BATCH_H
@@ -0,0 +1,167 @@
+/*
+Title: HydroDynamics
+File Name: AssetLoader.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Loads assets (shader sources, images, and anything else that comes from a file) on a
+background thread, so the window opens right away instead of waiting for the disk.
+
+A job is a group of files. load() queues one and returns at once. The loader thread reads
+the files of the jobs one after the other, in the order they were queued. Creating the
+OpenGL objects from them has to happen on the thread that owns the context, so every job
+also has a completion, which finishLoads() runs on the calling thread for every job that has
+been read. The future of a job is ready once its completion has run, and says whether all of
+its files could be read.
+
+A job can also have a preparation, which runs on the loader thread right after its files were
+read, for work that doesn't need the context either, like decoding an image.
+
+Nothing in here knows about OpenGL.
+*/
+
+#include "AssetLoader.h"
+#include "MappedFile.h"
+#include "ThreadControl.h"
+
+AssetLoader::AssetLoader()
+{
+	thread = std::thread(&AssetLoader::run, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	thread.join();
+}
+
+std::future<bool> AssetLoader::load(const std::vector<std::string>& files, std::function<void(const LoadedFiles&)> completion,
+	std::function<void(LoadedFiles&)> prepare)
+{
+	std::unique_ptr<Job> job(new Job());
+	job->files = files;
+	job->completion = std::move(completion);
+	job->prepare = std::move(prepare);
+	std::future<bool> future = job->done.get_future();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(std::move(job));
+	}
+	changed.notify_all();
+	return future;
+}
+
+int AssetLoader::finishLoads()
+{
+	int finished = 0;
+	while (true)
+	{
+		std::unique_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (read.empty())
+			{
+				return finished;
+			}
+			job = std::move(read.front());
+			read.pop_front();
+		}
+
+		// Outside the lock, since the completion may well queue the next job.
+		job->completion(job->loaded);
+		job->done.set_value(job->loaded.read);
+		finished++;
+	}
+}
+
+void AssetLoader::finishAll()
+{
+	while (true)
+	{
+		finishLoads();
+		std::unique_lock<std::mutex> lock(mutex);
+		if (queued.empty() && reading == 0 && read.empty())
+		{
+			return;
+		}
+		changed.wait(lock, [this] { return !read.empty(); });
+	}
+}
+
+bool AssetLoader::busy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !queued.empty() || reading > 0 || !read.empty();
+}
+
+void AssetLoader::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		changed.wait(lock, [this] { return stopping || !queued.empty(); });
+		if (stopping)
+		{
+			return;
+		}
+
+		std::unique_ptr<Job> job = std::move(queued.front());
+		queued.pop_front();
+		reading++;
+		lock.unlock();
+
+		// A mapping can't outlive the read, since the completion runs later on another thread, so the contents are copied.
+		job->loaded.contents.resize(job->files.size());
+		for (size_t i = 0; i < job->files.size(); i++)
+		{
+			MappedFile file;
+			if (file.open(job->files[i].c_str()))
+			{
+				job->loaded.contents[i] = std::string(file.view());
+			}
+			else
+			{
+				job->loaded.read = false;
+			}
+		}
+		if (job->prepare)
+		{
+			job->prepare(job->loaded);
+		}
+
+		lock.lock();
+		read.push_back(std::move(job));
+		reading--;
+		changed.notify_all();
+		if (onJobRead != nullptr)
+		{
+			lock.unlock();
+			onJobRead();
+			lock.lock();
+		}
+	}
+}
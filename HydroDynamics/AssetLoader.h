@@ -0,0 +1,116 @@
+/*
+Title: HydroDynamics
+File Name: AssetLoader.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Loads assets (shader sources, images, and anything else that comes from a file) on a
+background thread, so the window opens right away instead of waiting for the disk.
+
+A job is a group of files. load() queues one and returns at once. The loader thread reads
+the files of the jobs one after the other, in the order they were queued. Creating the
+OpenGL objects from them has to happen on the thread that owns the context, so every job
+also has a completion, which finishLoads() runs on the calling thread for every job that has
+been read. The future of a job is ready once its completion has run, and says whether all of
+its files could be read.
+
+A job can also have a preparation, which runs on the loader thread right after its files were
+read, for work that doesn't need the context either, like decoding an image.
+
+Nothing in here knows about OpenGL.
+*/
+
+#ifndef _ASSET_LOADER_H
+#define _ASSET_LOADER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// The contents of the files of a job, in the order they were given to load(). read is false if any of them couldn't be read,
+// in which case those are empty.
+struct LoadedFiles
+{
+	std::vector<std::string> contents;
+	bool read = true;
+};
+
+class AssetLoader
+{
+public:
+	// Starts the loader thread.
+	AssetLoader();
+
+	// Stops the thread after the file it is reading. Completions that haven't run are dropped.
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// Queues reading files. Once they are read, prepare (if any) is called with them on the loader thread, and the next finishLoads()
+	// calls completion with them. prepare can change what it was given, and set read to false if it fails.
+	std::future<bool> load(const std::vector<std::string>& files, std::function<void(const LoadedFiles&)> completion,
+		std::function<void(LoadedFiles&)> prepare = nullptr);
+
+	// Runs the completions of the jobs that have been read, in the order they were queued. Never waits for the disk. Returns how
+	// many ran.
+	int finishLoads();
+
+	// Waits until every job queued so far has been read and runs all of their completions.
+	void finishAll();
+
+	// Whether any job is still queued, being read or waiting for its completion.
+	bool busy();
+
+	// Called on the loader thread whenever a job was read, for waking up whoever calls finishLoads().
+	void (*onJobRead)() = nullptr;
+
+private:
+	struct Job
+	{
+		std::vector<std::string> files;
+		std::function<void(const LoadedFiles&)> completion;
+		std::function<void(LoadedFiles&)> prepare;
+		std::promise<bool> done;
+		LoadedFiles loaded;
+	};
+
+	void run();
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping = false;
+
+	// Jobs move from queued to the loader thread and on to read, all in the same order. Both are protected by mutex.
+	std::deque<std::unique_ptr<Job>> queued;
+	std::deque<std::unique_ptr<Job>> read;
+	int reading = 0;
+};
+
+#endif // _ASSET_LOADER_H
@@ -0,0 +1,182 @@
+/*
+Title: HydroDynamics
+File Name: Autotune.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Picks how many threads step the network and how big the blocks they get are, by trying them
+on the scene that is loaded. What is fastest depends on the machine (its cores, its caches,
+how much a thread costs to wake) and on the scene (how many vessels and tubes, how they are
+stepped), so the defaults in VesselNetwork.h are only a guess that fits most of them.
+
+Trying every combination would take longer than it could ever save, so the tuning goes one
+setting at a time: first every thread count from 1 up to the number of hardware threads,
+doubling, with the default blocks; then, with the fastest of those, every block size from
+AUTOTUNE_MIN_BLOCK to AUTOTUNE_MAX_BLOCK, doubling. Every candidate steps copies of the
+network like the benchmarks do (see Benchmark.h), and the one with the lowest median wins.
+
+The result only depends on the machine and on the size and kind of the scene, so it can be
+kept in a result cache (see ResultCache.h) under tuningKey() and taken from there the next
+time instead of being measured again. The blocks only change how the work is cut up, never
+what a step computes, so a tuned run gives the same result as any other.
+
+This file has no OpenGL dependency.
+*/
+
+#include "Autotune.h"
+#include "Benchmark.h"
+#include "ResultCache.h"
+#include "TaskPool.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+// The median step of network with one setting. One thread steps it without a pool at all.
+static double timeSetting(const VesselNetwork& network, float density, float gravity, float dt, int threads, int block)
+{
+	VesselNetwork tuned = network;
+	ParallelTuning setting;
+	setting.threads = threads;
+	setting.block = block;
+	applyTuning(tuned, setting);
+	TaskPool* pool = threads > 1 ? new TaskPool(threads - 1) : nullptr;
+	BenchmarkResult result = benchmarkUpdate(tuned, AUTOTUNE_STEPS, AUTOTUNE_REPETITIONS, density, gravity, dt, pool);
+	delete pool;
+	return result.median;
+}
+
+ParallelTuning tuneParallel(const VesselNetwork& network, float density, float gravity, float dt, int maxThreads, std::ostream* out)
+{
+	ParallelTuning best;
+	best.block = PARALLEL_BLOCK_SIZE;
+	auto report = [&](int threads, int block, double nanoseconds)
+	{
+		if (out != nullptr)
+		{
+			*out << "  " << threads << (threads == 1 ? " thread" : " threads");
+			if (threads > 1)
+			{
+				*out << ", blocks of " << block;
+			}
+			*out << ": " << nanoseconds / 1e6 << " ms per step" << std::endl;
+		}
+	};
+
+	best.nanoseconds = timeSetting(network, density, gravity, dt, 1, best.block);
+	report(1, best.block, best.nanoseconds);
+	std::vector<int> threadCounts;
+	for (int threads = 2; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	if (maxThreads > 1)
+	{
+		threadCounts.push_back(maxThreads);
+	}
+	for (int threads : threadCounts)
+	{
+		double nanoseconds = timeSetting(network, density, gravity, dt, threads, best.block);
+		report(threads, best.block, nanoseconds);
+		if (nanoseconds < best.nanoseconds * (1.0 - AUTOTUNE_MARGIN))
+		{
+			best.threads = threads;
+			best.nanoseconds = nanoseconds;
+		}
+	}
+	if (best.threads == 1)
+	{
+		return best;
+	}
+
+	// Blocks bigger than the network are all the same one block, so the sizes stop at the first that holds all of it.
+	int largest = std::max(network.vesselCount(), network.tubeCount());
+	for (int block = AUTOTUNE_MIN_BLOCK; block <= AUTOTUNE_MAX_BLOCK; block *= 2)
+	{
+		if (block != PARALLEL_BLOCK_SIZE)
+		{
+			double nanoseconds = timeSetting(network, density, gravity, dt, best.threads, block);
+			report(best.threads, block, nanoseconds);
+			if (nanoseconds < best.nanoseconds * (1.0 - AUTOTUNE_MARGIN))
+			{
+				best.block = block;
+				best.nanoseconds = nanoseconds;
+			}
+		}
+		if (block >= largest)
+		{
+			break;
+		}
+	}
+	return best;
+}
+
+void applyTuning(VesselNetwork& network, const ParallelTuning& tuning)
+{
+	// The tuning was measured on this network, so a network that is large enough to be worth a pool at all is the wrong question
+	// here: with one thread it never uses one, with more it always does.
+	if (tuning.threads > 1)
+	{
+		network.setParallelSplit(tuning.block, 0);
+	}
+	else
+	{
+		network.setParallelSplit(network.parallelBlock, INT_MAX);
+	}
+}
+
+uint64_t tuningKey(const VesselNetwork& network, int maxThreads)
+{
+	// The tuning is told apart from the results of runs kept in the same cache by what comes first.
+	ResultKey key;
+	key.add("parallel tuning", 15);
+	key.add(maxThreads);
+	key.add(network.vesselCount());
+	key.add(network.tubeCount());
+	key.add(network.layered());
+	key.add(network.hasComponents());
+	key.add(network.profiled());
+	key.add(network.integrator);
+	key.add(network.precision);
+	key.add(network.scatter);
+	key.add(network.multirate);
+	key.add(network.drainLimit);
+	return key.value();
+}
+
+bool findTuning(ResultCache& cache, uint64_t key, ParallelTuning& tuning)
+{
+	std::vector<double> values;
+	if (!cache.find(key, values) || values.size() != 3)
+	{
+		return false;
+	}
+	tuning.threads = (int)values[0];
+	tuning.block = (int)values[1];
+	tuning.nanoseconds = values[2];
+	return true;
+}
+
+void storeTuning(ResultCache& cache, uint64_t key, const ParallelTuning& tuning)
+{
+	cache.store(key, { (double)tuning.threads, (double)tuning.block, tuning.nanoseconds });
+}
@@ -0,0 +1,84 @@
+/*
+Title: HydroDynamics
+File Name: Autotune.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Picks how many threads step the network and how big the blocks they get are, by trying them
+on the scene that is loaded. What is fastest depends on the machine (its cores, its caches,
+how much a thread costs to wake) and on the scene (how many vessels and tubes, how they are
+stepped), so the defaults in VesselNetwork.h are only a guess that fits most of them.
+
+Trying every combination would take longer than it could ever save, so the tuning goes one
+setting at a time: first every thread count from 1 up to the number of hardware threads,
+doubling, with the default blocks; then, with the fastest of those, every block size from
+AUTOTUNE_MIN_BLOCK to AUTOTUNE_MAX_BLOCK, doubling. Every candidate steps copies of the
+network like the benchmarks do (see Benchmark.h), and the one with the lowest median wins.
+
+The result only depends on the machine and on the size and kind of the scene, so it can be
+kept in a result cache (see ResultCache.h) under tuningKey() and taken from there the next
+time instead of being measured again. The blocks only change how the work is cut up, never
+what a step computes, so a tuned run gives the same result as any other.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _AUTOTUNE_H
+#define _AUTOTUNE_H
+
+#include <cstdint>
+#include <ostream>
+
+struct VesselNetwork;
+class ResultCache;
+
+#define AUTOTUNE_STEPS 10			// Steps per timed run
+#define AUTOTUNE_REPETITIONS 5		// Timed runs per candidate, after one to warm up
+#define AUTOTUNE_MIN_BLOCK 1024
+#define AUTOTUNE_MAX_BLOCK 32768
+
+// A candidate is only taken over the one before it if it is at least this much faster, so noise doesn't pick more threads than
+// help.
+#define AUTOTUNE_MARGIN 0.03
+
+struct ParallelTuning
+{
+	int threads = 1;			// Threads that step the network, counting the one calling update()
+	int block = 0;				// Vessels or tubes per block, with more than one thread
+	double nanoseconds = 0.0;	// The median step of this setting when it was measured
+};
+
+// Times the candidates on copies of network (stepped with density, gravity and dt), up to maxThreads threads, and returns the
+// fastest. If out isn't null, writes a line for every candidate.
+ParallelTuning tuneParallel(const VesselNetwork& network, float density, float gravity, float dt, int maxThreads, std::ostream* out);
+
+// Splits the work of network as tuning says. It is then stepped on a pool of tuning.threads threads, or without one.
+void applyTuning(VesselNetwork& network, const ParallelTuning& tuning);
+
+// The key of a tuning in a result cache: the number of threads the machine has, and the size of network and how it is stepped.
+uint64_t tuningKey(const VesselNetwork& network, int maxThreads);
+
+// Finds a tuning in a cache, or stores one there.
+bool findTuning(ResultCache& cache, uint64_t key, ParallelTuning& tuning);
+void storeTuning(ResultCache& cache, uint64_t key, const ParallelTuning& tuning);
+
+#endif // _AUTOTUNE_H
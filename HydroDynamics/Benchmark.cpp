@@ -0,0 +1,619 @@
+/*
+Title: HydroDynamics
+File Name: Benchmark.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Timing with repetition, for the benchmarks run with --benchmark (or by the HydroDynamicsBenchmark
+project, which runs them without being asked). A benchmark is a function that does a fixed
+amount of work and returns how long it took. It is run once to warm up the caches and the
+driver, which isn't counted, and then a number of times, and what is reported is the median
+of those runs, the fastest of them and how far they spread around the median. The median
+doesn't move when a single run is disturbed by something else on the machine, and the
+spread says how much a difference between two builds has to be before it means anything.
+
+To catch slowdowns, the times of every run can be kept in a file of baselines (JSON, one
+entry per commit and machine) and a new run compared with the newest baseline of the same
+machine. A benchmark has regressed when its median is more than a threshold slower than the
+baseline's and a Mann-Whitney U test of the two sets of runs says the difference is
+significant, so the noise between two runs of the same build doesn't count as a regression,
+and neither does a real but tiny difference.
+
+This file has no OpenGL dependency; the render and shader benchmarks live in main.cpp, next
+to what they time.
+*/
+
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+BenchmarkResult runBenchmark(int repetitions, const std::function<double()>& body)
+{
+	body();
+
+	std::vector<double> times;
+	for (int i = 0; i < repetitions; i++)
+	{
+		times.push_back(body());
+	}
+
+	BenchmarkResult result;
+	result.runs = (int)times.size();
+	if (times.empty())
+	{
+		return result;
+	}
+	std::sort(times.begin(), times.end());
+	result.times = times;
+	result.median = times[times.size() / 2];
+	result.fastest = times.front();
+
+	std::vector<double> distances;
+	for (double time : times)
+	{
+		distances.push_back(std::abs(time - result.median));
+	}
+	std::sort(distances.begin(), distances.end());
+	result.spread = result.median > 0.0 ? distances[distances.size() / 2] / result.median : 0.0;
+	return result;
+}
+
+void reportBenchmark(std::ostream& out, std::ostream* csv, const std::string& name, const char* unit, double itemsPerUnit, const char* items,
+	const BenchmarkResult& result)
+{
+	double itemsPerSecond = result.median > 0.0 ? itemsPerUnit * 1e9 / result.median : 0.0;
+	out << name << ": " << result.median << " ns per " << unit << " (fastest " << result.fastest << ", spread " << result.spread * 100.0
+		<< "%, " << result.runs << " runs)";
+	if (itemsPerUnit > 0.0)
+	{
+		out << ", " << itemsPerSecond << " " << items << " per second";
+	}
+	out << std::endl;
+
+	if (csv != nullptr)
+	{
+		*csv << name << "," << unit << "," << result.median << "," << result.fastest << "," << result.spread << "," << result.runs << ","
+			<< itemsPerSecond << std::endl;
+	}
+}
+
+void reportBenchmarkHeader(std::ostream& csv)
+{
+	csv << "benchmark,unit,median_ns,fastest_ns,spread,runs,items_per_second" << std::endl;
+}
+
+void buildBenchmarkNetwork(VesselNetwork& network, int vessels, float density, float gravity)
+{
+	network.clear();
+	for (int i = 0; i < vessels; i++)
+	{
+		network.addVessel((float)i, 0.0f, 0.1f + 0.01f * (i % 7), 0.2f + 0.3f * ((i * 37) % 11) / 11.0f);
+	}
+	for (int i = 0; i + 1 < vessels; i++)
+	{
+		network.addTube(i, i + 1);
+	}
+	network.computePressures(density, gravity);
+	network.rebuildTopology();
+}
+
+BenchmarkResult benchmarkUpdate(const VesselNetwork& network, int steps, int repetitions, float density, float gravity, float dt,
+	TaskPool* pool)
+{
+	// The copy is made before the clock starts, so only the steps are timed.
+	VesselNetwork copy;
+	return runBenchmark(repetitions, [&]()
+	{
+		copy = network;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < steps; i++)
+		{
+			copy.update(density, gravity, dt, pool);
+		}
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+		return (double)elapsed.count() / steps;
+	});
+}
+
+UpdateTimes timeUpdatePhases(const VesselNetwork& network, int steps, float density, float gravity, float dt, TaskPool* pool,
+	HardwareCounters* counters)
+{
+	UpdateTimes times;
+	times.counters = counters;
+	VesselNetwork copy = network;
+	copy.timing = &times;
+	for (int i = 0; i < steps; i++)
+	{
+		copy.update(density, gravity, dt, pool);
+	}
+	return times;
+}
+
+UpdateTraffic estimateUpdateTraffic(const VesselNetwork& network)
+{
+	double vessels = network.vesselCount();
+	double tubes = network.tubeCount();
+	UpdateTraffic traffic;
+	traffic.pressure = vessels * 2 * sizeof(float);
+	traffic.flow = tubes * (2 * sizeof(int) + 3 * sizeof(float) + 3 * sizeof(float) + 2 * 4 * sizeof(float));
+	bool compact = !network.compactTubes.empty();
+	traffic.apply = vessels * ((compact ? 2 : 1) * sizeof(int) + 7 * sizeof(float)) + tubes * 2 * ((compact ? sizeof(unsigned short) : sizeof(int)) + sizeof(float));
+	return traffic;
+}
+
+void reportUpdatePhases(std::ostream& out, const UpdateTimes& times)
+{
+	static const char* names[UPDATE_PHASES] = { "pressure", "flow", "reduction", "apply" };
+	static const double UpdateTimes::* seconds[UPDATE_PHASES] = { &UpdateTimes::pressure, &UpdateTimes::flow, &UpdateTimes::reduction,
+		&UpdateTimes::apply };
+	double steps = (double)std::max(times.steps, 1LL);
+	bool counted = times.counters != nullptr && times.counters->valid();
+	for (int p = 0; p < UPDATE_PHASES; p++)
+	{
+		out << "  " << names[p] << ": " << times.*seconds[p] / steps * 1e3 << " ms per step";
+		if (counted)
+		{
+			const CounterSample& counts = times.phaseCounters[p];
+			if (times.counters->available(COUNTER_CYCLES) && times.counters->available(COUNTER_INSTRUCTIONS) && counts.value[COUNTER_CYCLES] > 0)
+			{
+				out << ", IPC " << (double)counts.value[COUNTER_INSTRUCTIONS] / counts.value[COUNTER_CYCLES];
+			}
+			for (int c = COUNTER_L1_MISSES; c < COUNTER_COUNT; c++)
+			{
+				if (times.counters->available((HardwareCounter)c))
+				{
+					out << ", " << counts.value[c] / steps << " " << counterName((HardwareCounter)c);
+				}
+			}
+			out << " per step";
+		}
+		out << std::endl;
+	}
+}
+
+// A small reader for the JSON the baselines are written in, which is all it has to understand: objects, arrays, strings without
+// escapes other than \" and \\, and numbers.
+struct JsonValue
+{
+	enum Type { JSON_NULL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT } type = JSON_NULL;
+	double number = 0.0;
+	std::string text;
+	std::vector<JsonValue> items;
+	std::vector<std::pair<std::string, JsonValue>> members;
+
+	const JsonValue* member(const char* name) const
+	{
+		for (const std::pair<std::string, JsonValue>& entry : members)
+		{
+			if (entry.first == name)
+			{
+				return &entry.second;
+			}
+		}
+		return nullptr;
+	}
+};
+
+static void skipSpace(const std::string& text, size_t& at)
+{
+	while (at < text.size() && isspace((unsigned char)text[at]))
+	{
+		at++;
+	}
+}
+
+static bool parseJsonString(const std::string& text, size_t& at, std::string& result)
+{
+	if (text[at] != '"')
+	{
+		return false;
+	}
+	for (at++; at < text.size() && text[at] != '"'; at++)
+	{
+		if (text[at] == '\\' && at + 1 < text.size())
+		{
+			at++;
+		}
+		result += text[at];
+	}
+	if (at >= text.size())
+	{
+		return false;
+	}
+	at++;
+	return true;
+}
+
+static bool parseJson(const std::string& text, size_t& at, JsonValue& value)
+{
+	skipSpace(text, at);
+	if (at >= text.size())
+	{
+		return false;
+	}
+	char first = text[at];
+	if (first == '"')
+	{
+		value.type = JsonValue::JSON_STRING;
+		return parseJsonString(text, at, value.text);
+	}
+	if (first == '[' || first == '{')
+	{
+		bool object = first == '{';
+		char last = object ? '}' : ']';
+		value.type = object ? JsonValue::JSON_OBJECT : JsonValue::JSON_ARRAY;
+		at++;
+		skipSpace(text, at);
+		if (at < text.size() && text[at] == last)
+		{
+			at++;
+			return true;
+		}
+		while (at < text.size())
+		{
+			std::string name;
+			if (object)
+			{
+				skipSpace(text, at);
+				if (at >= text.size() || !parseJsonString(text, at, name))
+				{
+					return false;
+				}
+				skipSpace(text, at);
+				if (at >= text.size() || text[at] != ':')
+				{
+					return false;
+				}
+				at++;
+			}
+			JsonValue item;
+			if (!parseJson(text, at, item))
+			{
+				return false;
+			}
+			if (object)
+			{
+				value.members.push_back(std::make_pair(name, item));
+			}
+			else
+			{
+				value.items.push_back(item);
+			}
+			skipSpace(text, at);
+			if (at < text.size() && text[at] == ',')
+			{
+				at++;
+				continue;
+			}
+			if (at < text.size() && text[at] == last)
+			{
+				at++;
+				return true;
+			}
+			return false;
+		}
+		return false;
+	}
+	if (text.compare(at, 4, "null") == 0)
+	{
+		at += 4;
+		return true;
+	}
+	char* end = nullptr;
+	value.type = JsonValue::JSON_NUMBER;
+	value.number = strtod(text.c_str() + at, &end);
+	if (end == text.c_str() + at)
+	{
+		return false;
+	}
+	at = end - text.c_str();
+	return true;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& text)
+{
+	out << '"';
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out << '\\';
+		}
+		out << c;
+	}
+	out << '"';
+}
+
+bool BenchmarkBaselines::read(const std::string& fileName)
+{
+	entries.clear();
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		return true;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+
+	JsonValue root;
+	size_t at = 0;
+	const JsonValue* list = nullptr;
+	if (parseJson(text, at, root))
+	{
+		list = root.member("baselines");
+	}
+	if (list == nullptr || list->type != JsonValue::JSON_ARRAY)
+	{
+		std::cout << "Can't read the baselines in " << fileName << std::endl;
+		return false;
+	}
+
+	for (const JsonValue& item : list->items)
+	{
+		const JsonValue* commit = item.member("commit");
+		const JsonValue* machine = item.member("machine");
+		const JsonValue* time = item.member("time");
+		const JsonValue* results = item.member("results");
+		if (commit == nullptr || machine == nullptr || results == nullptr)
+		{
+			continue;
+		}
+		Entry entry;
+		entry.commit = commit->text;
+		entry.machine = machine->text;
+		entry.time = time != nullptr ? (long long)time->number : 0;
+		for (const JsonValue& result : results->items)
+		{
+			const JsonValue* name = result.member("name");
+			const JsonValue* unit = result.member("unit");
+			const JsonValue* times = result.member("times");
+			if (name == nullptr || unit == nullptr || times == nullptr || times->items.empty())
+			{
+				continue;
+			}
+			BenchmarkRecord record;
+			record.name = name->text;
+			record.unit = unit->text;
+			for (const JsonValue& run : times->items)
+			{
+				record.result.times.push_back(run.number);
+			}
+			std::sort(record.result.times.begin(), record.result.times.end());
+			record.result.runs = (int)record.result.times.size();
+			record.result.median = record.result.times[record.result.times.size() / 2];
+			record.result.fastest = record.result.times.front();
+			entry.records.push_back(record);
+		}
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+bool BenchmarkBaselines::write(const std::string& fileName) const
+{
+	std::ofstream file(fileName, std::ios::out);
+	if (!file.good())
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		return false;
+	}
+	file.precision(10);
+	file << "{\n\t\"baselines\": [";
+	for (size_t e = 0; e < entries.size(); e++)
+	{
+		const Entry& entry = entries[e];
+		file << (e > 0 ? "," : "") << "\n\t\t{\n\t\t\t\"commit\": ";
+		writeJsonString(file, entry.commit);
+		file << ",\n\t\t\t\"machine\": ";
+		writeJsonString(file, entry.machine);
+		file << ",\n\t\t\t\"time\": " << entry.time << ",\n\t\t\t\"results\": [";
+		for (size_t r = 0; r < entry.records.size(); r++)
+		{
+			const BenchmarkRecord& record = entry.records[r];
+			file << (r > 0 ? "," : "") << "\n\t\t\t\t{ \"name\": ";
+			writeJsonString(file, record.name);
+			file << ", \"unit\": ";
+			writeJsonString(file, record.unit);
+			file << ", \"median\": " << record.result.median << ", \"times\": [";
+			for (size_t t = 0; t < record.result.times.size(); t++)
+			{
+				file << (t > 0 ? ", " : "") << record.result.times[t];
+			}
+			file << "] }";
+		}
+		file << "\n\t\t\t]\n\t\t}";
+	}
+	file << "\n\t]\n}\n";
+	return file.good();
+}
+
+const std::vector<BenchmarkRecord>* BenchmarkBaselines::newest(const std::string& machine, std::string& commit) const
+{
+	const Entry* found = nullptr;
+	for (const Entry& entry : entries)
+	{
+		if (entry.machine == machine && (found == nullptr || entry.time >= found->time))
+		{
+			found = &entry;
+		}
+	}
+	if (found == nullptr)
+	{
+		return nullptr;
+	}
+	commit = found->commit;
+	return &found->records;
+}
+
+void BenchmarkBaselines::store(const std::string& commit, const std::string& machine, const std::vector<BenchmarkRecord>& records)
+{
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) { return entry.commit == commit && entry.machine == machine; }),
+		entries.end());
+	Entry entry;
+	entry.commit = commit;
+	entry.machine = machine;
+	entry.time = (long long)std::time(nullptr);
+	entry.records = records;
+	entries.push_back(entry);
+}
+
+double mannWhitneyP(const std::vector<double>& a, const std::vector<double>& b)
+{
+	// Rank both sets together, giving tied times the average of their ranks.
+	std::vector<std::pair<double, int>> all;
+	for (double time : a)
+	{
+		all.push_back(std::make_pair(time, 0));
+	}
+	for (double time : b)
+	{
+		all.push_back(std::make_pair(time, 1));
+	}
+	std::sort(all.begin(), all.end());
+
+	double rankSumA = 0.0;
+	double ties = 0.0;
+	for (size_t i = 0; i < all.size();)
+	{
+		size_t j = i;
+		while (j < all.size() && all[j].first == all[i].first)
+		{
+			j++;
+		}
+		double rank = (i + 1 + j) * 0.5;
+		for (size_t k = i; k < j; k++)
+		{
+			if (all[k].second == 0)
+			{
+				rankSumA += rank;
+			}
+		}
+		double count = (double)(j - i);
+		ties += count * count * count - count;
+		i = j;
+	}
+
+	double n1 = (double)a.size();
+	double n2 = (double)b.size();
+	double n = n1 + n2;
+	double u = rankSumA - n1 * (n1 + 1.0) * 0.5;
+	double variance = n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+	if (n1 == 0.0 || n2 == 0.0 || variance <= 0.0)
+	{
+		return 1.0;
+	}
+	double z = (std::abs(u - n1 * n2 * 0.5) - 0.5) / std::sqrt(variance);
+	return std::erfc(std::max(z, 0.0) / std::sqrt(2.0));
+}
+
+int compareBenchmarks(std::ostream& out, const std::vector<BenchmarkRecord>& baseline, const std::vector<BenchmarkRecord>& current,
+	double threshold)
+{
+	int regressions = 0;
+	for (const BenchmarkRecord& record : current)
+	{
+		const BenchmarkRecord* old = nullptr;
+		for (const BenchmarkRecord& candidate : baseline)
+		{
+			if (candidate.name == record.name && candidate.unit == record.unit)
+			{
+				old = &candidate;
+			}
+		}
+		if (old == nullptr || old->result.median <= 0.0)
+		{
+			out << record.name << ": no baseline" << std::endl;
+			continue;
+		}
+
+		double change = record.result.median / old->result.median - 1.0;
+		double p = mannWhitneyP(old->result.times, record.result.times);
+		bool significant = p < BENCHMARK_SIGNIFICANCE;
+		out << record.name << ": " << (change >= 0.0 ? "+" : "") << change * 100.0 << "% (p = " << p << ")";
+		if (significant && change > threshold)
+		{
+			out << ", REGRESSED";
+			regressions++;
+		}
+		else if (significant && change < 0.0)
+		{
+			out << ", faster";
+		}
+		out << std::endl;
+	}
+	return regressions;
+}
+
+void TwoVesselSolution::heights(double seconds, double& a, double& b) const
+{
+	// The columns are level at the mean height, and each is off it by its share of the difference.
+	double mean = (widthA * heightA + widthB * heightB) / (widthA + widthB);
+	double d0 = heightB - heightA;
+	double half = damping * 0.5;
+	double stiffness = (1.0 / widthA + 1.0 / widthB) * scale / inertance;
+	double d;
+	if (stiffness > half * half)
+	{
+		double omega = std::sqrt(stiffness - half * half);
+		d = std::exp(-half * seconds) * (d0 * std::cos(omega * seconds) + half * d0 / omega * std::sin(omega * seconds));
+	}
+	else if (stiffness == half * half)
+	{
+		d = std::exp(-half * seconds) * d0 * (1.0 + half * seconds);
+	}
+	else
+	{
+		double root = std::sqrt(half * half - stiffness);
+		double fast = -half - root;
+		double slow = -half + root;
+		double slowPart = -fast * d0 / (slow - fast);
+		d = slowPart * std::exp(slow * seconds) + (d0 - slowPart) * std::exp(fast * seconds);
+	}
+	a = mean - widthB / (widthA + widthB) * d;
+	b = mean + widthA / (widthA + widthB) * d;
+}
+
+AccuracyResult measureAccuracy(const VesselNetwork& network, const TwoVesselSolution& exact, double seconds, float density, float gravity,
+	float dt, int repetitions)
+{
+	AccuracyResult result;
+	result.steps = std::max(1LL, (long long)std::llround(seconds / dt));
+
+	VesselNetwork copy = network;
+	for (long long i = 1; i <= result.steps; i++)
+	{
+		copy.update(density, gravity, dt);
+		double a, b;
+		exact.heights((double)i * dt, a, b);
+		result.finalError = std::max(std::fabs(copy.height[0] - a), std::fabs(copy.height[1] - b));
+		result.maxError = std::max(result.maxError, result.finalError);
+	}
+
+	result.time = benchmarkUpdate(network, (int)result.steps, repetitions, density, gravity, dt, nullptr);
+	return result;
+}
@@ -0,0 +1,182 @@
+/*
+Title: HydroDynamics
+File Name: Benchmark.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Timing with repetition, for the benchmarks run with --benchmark (or by the HydroDynamicsBenchmark
+project, which runs them without being asked). A benchmark is a function that does a fixed
+amount of work and returns how long it took. It is run once to warm up the caches and the
+driver, which isn't counted, and then a number of times, and what is reported is the median
+of those runs, the fastest of them and how far they spread around the median. The median
+doesn't move when a single run is disturbed by something else on the machine, and the
+spread says how much a difference between two builds has to be before it means anything.
+
+To catch slowdowns, the times of every run can be kept in a file of baselines (JSON, one
+entry per commit and machine) and a new run compared with the newest baseline of the same
+machine. A benchmark has regressed when its median is more than a threshold slower than the
+baseline's and a Mann-Whitney U test of the two sets of runs says the difference is
+significant, so the noise between two runs of the same build doesn't count as a regression,
+and neither does a real but tiny difference.
+
+Speed is only half of what picks an integrator. Two vessels joined by one tube have an exact
+solution (TwoVesselSolution), so a run of them says how far each integrator strays from it at
+each step size as well as what a step costs (measureAccuracy()), which is what the accuracy
+benchmark of main.cpp (--accuracy-benchmark) compares them by.
+
+This file has no OpenGL dependency; the render and shader benchmarks live in main.cpp, next
+to what they time.
+*/
+
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "VesselNetwork.h"
+
+#define BENCHMARK_REPETITIONS 15
+
+// A benchmark only counts as regressed if the chance that the difference to the baseline is noise is below this.
+#define BENCHMARK_SIGNIFICANCE 0.01
+
+struct BenchmarkResult
+{
+	double median = 0.0;	// Nanoseconds per unit of work (a step, a frame, a program)
+	double fastest = 0.0;
+	double spread = 0.0;	// The median distance of the runs from the median, as a fraction of it
+	int runs = 0;
+	std::vector<double> times;	// Every run, from the fastest to the slowest
+};
+
+// A result with the name of its benchmark and its unit of work.
+struct BenchmarkRecord
+{
+	std::string name;
+	std::string unit;
+	BenchmarkResult result;
+};
+
+// The results of earlier runs, one entry per commit and machine.
+class BenchmarkBaselines
+{
+public:
+	// Reads the baselines from a file. A file that doesn't exist is no baselines at all; one that can't be parsed is an error.
+	bool read(const std::string& fileName);
+
+	// Writes every baseline to a file.
+	bool write(const std::string& fileName) const;
+
+	// The newest entry of a machine, or null if it has none.
+	const std::vector<BenchmarkRecord>* newest(const std::string& machine, std::string& commit) const;
+
+	// Adds an entry, replacing the one of the same commit and machine if there is one.
+	void store(const std::string& commit, const std::string& machine, const std::vector<BenchmarkRecord>& records);
+
+private:
+	struct Entry
+	{
+		std::string commit;
+		std::string machine;
+		long long time;			// When it was stored, in seconds since 1970
+		std::vector<BenchmarkRecord> records;
+	};
+	std::vector<Entry> entries;
+};
+
+// Runs body once to warm up and then repetitions times, and gathers the nanoseconds per unit of work it returns.
+BenchmarkResult runBenchmark(int repetitions, const std::function<double()>& body);
+
+// Writes a line with a result, in nanoseconds per unit and, if itemsPerUnit isn't 0, items per second (like vessels per second
+// for a step). If csv isn't null, the same as a line of comma separated values, which is easy to compare between builds.
+void reportBenchmark(std::ostream& out, std::ostream* csv, const std::string& name, const char* unit, double itemsPerUnit, const char* items,
+	const BenchmarkResult& result);
+
+// Writes the header of the comma separated values.
+void reportBenchmarkHeader(std::ostream& csv);
+
+// The two sided p-value of a Mann-Whitney U test of two sets of times, from the normal approximation (with the correction for
+// ties), which is close enough from about 8 runs each. Small values mean the two sets are unlikely to come from the same build.
+double mannWhitneyP(const std::vector<double>& a, const std::vector<double>& b);
+
+// Compares every result with the one of the same name in a baseline, and writes a line for each: how much slower or faster it is
+// and how significant that is. Returns how many of them regressed by more than threshold (a fraction of the baseline's median).
+int compareBenchmarks(std::ostream& out, const std::vector<BenchmarkRecord>& baseline, const std::vector<BenchmarkRecord>& current,
+	double threshold);
+
+// Fills network with a row of vessels connected one after the other, each filled to a different height, so all of them are
+// moving when the timing starts.
+void buildBenchmarkNetwork(VesselNetwork& network, int vessels, float density, float gravity);
+
+// Times update() on copies of network, steps steps per run. Every run starts from the same state.
+BenchmarkResult benchmarkUpdate(const VesselNetwork& network, int steps, int repetitions, float density, float gravity, float dt,
+	TaskPool* pool);
+
+// Steps a copy of network steps times with UpdateTimes switched on, and returns where the time went (and, if counters isn't null,
+// what the hardware counters counted in every phase).
+UpdateTimes timeUpdatePhases(const VesselNetwork& network, int steps, float density, float gravity, float dt, TaskPool* pool,
+	HardwareCounters* counters = nullptr);
+
+// How many bytes the phases of one single precision step read and write in memory, counting every array element they touch once
+// per step. Divided by the time of a phase, that is the memory bandwidth it reached (if nothing was served from the caches).
+struct UpdateTraffic
+{
+	double pressure;	// Per vessel: the height read, the pressure written
+	double flow;		// Per tube: its ends, its properties, its flow read and written, its change written, and 4 arrays of both ends
+	double apply;		// Per vessel: its tube list, width, delta, height, bottom and top; per end of a tube: the entry and the change
+};
+UpdateTraffic estimateUpdateTraffic(const VesselNetwork& network);
+
+// Writes a line per phase of update() with its time per step and, if times.counters is open, the instructions per cycle and the
+// L1 misses, last level misses and branch misses per step.
+void reportUpdatePhases(std::ostream& out, const UpdateTimes& times);
+
+// The exact motion of two vessels joined by one tube, with nothing pushing on them. The difference d = heightB - heightA of their
+// fluid columns is a damped oscillator, d'' + damping * d' + (1 / widthA + 1 / widthB) * density * gravity / inertance * d = 0,
+// and the volume stays what it was, so the columns end up level, at the height that holds it.
+struct TwoVesselSolution
+{
+	double widthA, widthB;
+	double heightA, heightB;	// At the start, with no flow through the tube
+	double inertance, damping;
+	double scale;				// density * gravity
+
+	// The heights of both columns after seconds.
+	void heights(double seconds, double& a, double& b) const;
+};
+
+struct AccuracyResult
+{
+	long long steps = 0;
+	double maxError = 0.0;		// The furthest a column got from the exact height, in meters
+	double finalError = 0.0;	// How far it was at the end
+	BenchmarkResult time;		// Nanoseconds per step
+};
+
+// Steps a copy of network (two vessels joined by tube 0, which exact describes) for seconds at dt, compares its heights with the
+// exact ones after every step, and then times the same steps repetitions times like benchmarkUpdate().
+AccuracyResult measureAccuracy(const VesselNetwork& network, const TwoVesselSolution& exact, double seconds, float density, float gravity,
+	float dt, int repetitions);
+
+#endif // _BENCHMARK_H
@@ -0,0 +1,361 @@
+/*
+Title: HydroDynamics
+File Name: Calibration.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Fits parameters of a network (tube conductances and damping, the density of the fluid, or
+any other parameter of Sensitivity.h) to levels measured in the real thing, by minimizing
+the sum of the squared differences between the simulated and the measured levels.
+
+Every evaluation steps the network once per SENSITIVITY_LANES parameters with the gradient
+of that sum (see sensitivityLoss()), and the batches run on the task pool at the same time.
+The minimizer is L-BFGS: it keeps the last CALIBRATION_HISTORY steps and the changes of the
+gradient over them, which approximate the curvature well enough to take steps of about the
+right length in every direction, and a backtracking line search makes sure every step
+lowers the sum. Widths, conductances and the density are fitted by their logarithm, so they
+stay positive and a step changes them by a factor rather than by an amount, which suits
+parameters that can be orders of magnitude apart. Damping and levels are kept at 0 or
+above.
+
+In a network of one fluid the density only ever multiplies the conductances, so fitting
+both finds one of many equally good pairs. Fit one of them, with the other one known.
+
+The measured levels are a text file with one sample per line, the step after which it was
+measured (0 for the start), the vessel and the level, separated by spaces or commas:
+
+	# step vessel height
+	0 0 0.6
+	60 0 0.52
+	60 2 0.11
+
+Vessels without samples, and steps in between, are simply not compared. Lines starting with
+# are comments, and a first line of names (like step,vessel,height) is skipped.
+
+This file has no OpenGL dependency.
+*/
+
+#include "Calibration.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Below these the gradient (in the fitted coordinates) or the relative improvement of an iteration counts as converged.
+#define CALIBRATION_GRADIENT_TOLERANCE 1e-12
+#define CALIBRATION_IMPROVEMENT_TOLERANCE 1e-12
+
+// The length of the first step, in the fitted coordinates, before there is any curvature to go by.
+#define CALIBRATION_FIRST_STEP 0.1
+
+bool readLevelSamples(const std::string& fileName, std::vector<LevelSample>& samples)
+{
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+
+	samples.clear();
+	std::string line;
+	int lineNumber = 0;
+	bool first = true;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		bool names = first && std::isalpha((unsigned char)line[0]);
+		first = false;
+		if (names)
+		{
+			continue;
+		}
+
+		std::replace(line.begin(), line.end(), ',', ' ');
+		std::istringstream fields(line);
+		LevelSample sample;
+		if (!(fields >> sample.step >> sample.vessel >> sample.height) || sample.step < 0)
+		{
+			std::cout << fileName << ":" << lineNumber << ": expected a step, a vessel and a level" << std::endl;
+			return false;
+		}
+		samples.push_back(sample);
+	}
+	if (samples.empty())
+	{
+		std::cout << fileName << " has no samples." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Whether a parameter is fitted by its logarithm.
+static bool fittedByLogarithm(SensitivityKind kind)
+{
+	return kind == SENSITIVITY_WIDTH || kind == SENSITIVITY_CONDUCTANCE || kind == SENSITIVITY_DENSITY;
+}
+
+// Everything one evaluation needs: the network to change, and where the parameters are in the fitted coordinates x.
+struct CalibrationProblem
+{
+	VesselNetwork trial;
+	float density;
+	float gravity;
+	float dt;
+	const std::vector<LevelSample>* samples;
+	const std::vector<SensitivityParameter>* parameters;
+	TaskPool* pool;
+	int evaluations = 0;
+};
+
+// Sets the parameters to x (kept at 0 or above where they have to be, which changes x to match) and works out the loss and its gradient
+// with respect to x.
+static bool evaluate(CalibrationProblem& problem, std::vector<double>& x, double& loss, std::vector<double>& gradient)
+{
+	const std::vector<SensitivityParameter>& parameters = *problem.parameters;
+	std::vector<double> values(parameters.size());
+	for (size_t p = 0; p < parameters.size(); p++)
+	{
+		if (fittedByLogarithm(parameters[p].kind))
+		{
+			values[p] = std::exp(x[p]);
+		}
+		else
+		{
+			x[p] = parameters[p].kind == SENSITIVITY_PRESSURE ? x[p] : std::max(x[p], 0.0);
+			values[p] = x[p];
+		}
+		setSensitivityValue(problem.trial, problem.density, parameters[p], values[p]);
+	}
+
+	problem.evaluations++;
+	if (!sensitivityLoss(problem.trial, problem.density, problem.gravity, problem.dt, *problem.samples, parameters, loss, gradient, problem.pool))
+	{
+		return false;
+	}
+	// d loss / d log(v) = v * d loss / d v
+	for (size_t p = 0; p < parameters.size(); p++)
+	{
+		if (fittedByLogarithm(parameters[p].kind))
+		{
+			gradient[p] *= values[p];
+		}
+	}
+	return true;
+}
+
+static double dot(const std::vector<double>& a, const std::vector<double>& b)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+// The L-BFGS direction: -H * gradient, with H the inverse curvature the remembered steps s and gradient changes y describe, worked
+// out by the two loop recursion.
+static void searchDirection(const std::vector<double>& gradient, const std::vector<std::vector<double>>& s, const std::vector<std::vector<double>>& y,
+	std::vector<double>& direction)
+{
+	size_t n = gradient.size();
+	size_t m = s.size();
+	direction = gradient;
+	std::vector<double> alpha(m);
+	std::vector<double> rho(m);
+	for (size_t k = m; k-- > 0;)
+	{
+		rho[k] = 1.0 / dot(y[k], s[k]);
+		alpha[k] = rho[k] * dot(s[k], direction);
+		for (size_t i = 0; i < n; i++)
+		{
+			direction[i] -= alpha[k] * y[k][i];
+		}
+	}
+
+	// The newest pair scales the starting curvature, which makes the first try of the line search about the right length.
+	double gamma = m > 0 ? dot(s[m - 1], y[m - 1]) / dot(y[m - 1], y[m - 1]) : 1.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		direction[i] *= gamma;
+	}
+	for (size_t k = 0; k < m; k++)
+	{
+		double beta = rho[k] * dot(y[k], direction);
+		for (size_t i = 0; i < n; i++)
+		{
+			direction[i] += (alpha[k] - beta) * s[k][i];
+		}
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		direction[i] = -direction[i];
+	}
+}
+
+bool calibrate(VesselNetwork& network, float& density, float gravity, float dt, const std::vector<LevelSample>& samples,
+	const std::vector<SensitivityParameter>& parameters, CalibrationResult& result, int iterations, TaskPool* pool)
+{
+	result = CalibrationResult();
+	size_t n = parameters.size();
+	std::vector<double> x(n);
+	for (size_t p = 0; p < n; p++)
+	{
+		double value = sensitivityValue(network, density, parameters[p]);
+		if (fittedByLogarithm(parameters[p].kind))
+		{
+			if (!(value > 0.0))
+			{
+				std::cout << "A " << sensitivityKindName(parameters[p].kind) << " has to be positive to be calibrated." << std::endl;
+				return false;
+			}
+			x[p] = std::log(value);
+		}
+		else
+		{
+			x[p] = value;
+		}
+	}
+
+	CalibrationProblem problem{ network, density, gravity, dt, &samples, &parameters, pool };
+	double loss;
+	std::vector<double> gradient;
+	if (!evaluate(problem, x, loss, gradient))
+	{
+		return false;
+	}
+	result.startLoss = loss;
+
+	std::vector<std::vector<double>> s;
+	std::vector<std::vector<double>> y;
+	std::vector<double> direction;
+	std::vector<double> trialX(n);
+	std::vector<double> trialGradient;
+	for (; result.iterations < iterations; result.iterations++)
+	{
+		double largest = 0.0;
+		for (double g : gradient)
+		{
+			largest = std::max(largest, std::fabs(g));
+		}
+		if (largest < CALIBRATION_GRADIENT_TOLERANCE || loss == 0.0)
+		{
+			result.converged = true;
+			break;
+		}
+
+		if (s.empty())
+		{
+			direction.resize(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				direction[i] = -gradient[i] * (CALIBRATION_FIRST_STEP / largest);
+			}
+		}
+		else
+		{
+			searchDirection(gradient, s, y, direction);
+		}
+
+		// A direction that doesn't go down means the remembered curvature is off, so it is forgotten.
+		double slope = dot(gradient, direction);
+		if (slope >= 0.0)
+		{
+			s.clear();
+			y.clear();
+			for (size_t i = 0; i < n; i++)
+			{
+				direction[i] = -gradient[i] * (CALIBRATION_FIRST_STEP / largest);
+			}
+			slope = dot(gradient, direction);
+		}
+
+		// Backtrack until the loss goes down by at least a little of what the slope promises (the Armijo condition).
+		double length = 1.0;
+		double trialLoss = loss;
+		bool found = false;
+		for (int backtrack = 0; backtrack < CALIBRATION_BACKTRACKS && !found; backtrack++, length *= 0.5)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				trialX[i] = x[i] + length * direction[i];
+			}
+			if (!evaluate(problem, trialX, trialLoss, trialGradient))
+			{
+				return false;
+			}
+			found = trialLoss <= loss + 1e-4 * length * slope;
+		}
+		if (!found)
+		{
+			result.converged = true;
+			break;
+		}
+
+		std::vector<double> step(n);
+		std::vector<double> change(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			step[i] = trialX[i] - x[i];
+			change[i] = trialGradient[i] - gradient[i];
+		}
+		// Only pairs with positive curvature keep the approximation positive definite.
+		if (dot(step, change) > 1e-300)
+		{
+			if (s.size() == CALIBRATION_HISTORY)
+			{
+				s.erase(s.begin());
+				y.erase(y.begin());
+			}
+			s.push_back(step);
+			y.push_back(change);
+		}
+
+		double improvement = loss - trialLoss;
+		x.swap(trialX);
+		gradient.swap(trialGradient);
+		loss = trialLoss;
+		if (improvement <= CALIBRATION_IMPROVEMENT_TOLERANCE * std::max(loss, 1e-300))
+		{
+			result.iterations++;
+			result.converged = true;
+			break;
+		}
+	}
+
+	// Leave the best parameters, which are the last ones accepted, in network.
+	for (size_t p = 0; p < n; p++)
+	{
+		setSensitivityValue(network, density, parameters[p], fittedByLogarithm(parameters[p].kind) ? std::exp(x[p]) : x[p]);
+	}
+	result.loss = loss;
+	result.evaluations = problem.evaluations;
+	return true;
+}
@@ -0,0 +1,91 @@
+/*
+Title: HydroDynamics
+File Name: Calibration.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Fits parameters of a network (tube conductances and damping, the density of the fluid, or
+any other parameter of Sensitivity.h) to levels measured in the real thing, by minimizing
+the sum of the squared differences between the simulated and the measured levels.
+
+Every evaluation steps the network once per SENSITIVITY_LANES parameters with the gradient
+of that sum (see sensitivityLoss()), and the batches run on the task pool at the same time.
+The minimizer is L-BFGS: it keeps the last CALIBRATION_HISTORY steps and the changes of the
+gradient over them, which approximate the curvature well enough to take steps of about the
+right length in every direction, and a backtracking line search makes sure every step
+lowers the sum. Widths, conductances and the density are fitted by their logarithm, so they
+stay positive and a step changes them by a factor rather than by an amount, which suits
+parameters that can be orders of magnitude apart. Damping and levels are kept at 0 or
+above.
+
+In a network of one fluid the density only ever multiplies the conductances, so fitting
+both finds one of many equally good pairs. Fit one of them, with the other one known.
+
+The measured levels are a text file with one sample per line, the step after which it was
+measured (0 for the start), the vessel and the level, separated by spaces or commas:
+
+	# step vessel height
+	0 0 0.6
+	60 0 0.52
+	60 2 0.11
+
+Vessels without samples, and steps in between, are simply not compared. Lines starting with
+# are comments, and a first line of names (like step,vessel,height) is skipped.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _CALIBRATION_H
+#define _CALIBRATION_H
+
+#include "Sensitivity.h"
+#include <string>
+#include <vector>
+
+class VesselNetwork;
+class TaskPool;
+
+// The number of steps L-BFGS remembers.
+#define CALIBRATION_HISTORY 8
+
+// The most iterations a calibration takes, and the most steps back the line search takes in one of them.
+#define CALIBRATION_ITERATIONS 100
+#define CALIBRATION_BACKTRACKS 30
+
+struct CalibrationResult
+{
+	int iterations = 0;
+	int evaluations = 0;		// How often the network was stepped with its gradient
+	double startLoss = 0.0;
+	double loss = 0.0;
+	bool converged = false;		// Whether it stopped because the gradient or the improvement got tiny, rather than at the last iteration
+};
+
+// Reads measured levels (see the description). Returns false (after printing an error) if the file can't be read or a line isn't a sample.
+bool readLevelSamples(const std::string& fileName, std::vector<LevelSample>& samples);
+
+// Fits parameters to samples, starting from their values in network and density, and leaves the best ones found there. Returns false,
+// with a message, if the network can't be differentiated (see sensitivities()), or a width, conductance or density to fit isn't positive.
+bool calibrate(VesselNetwork& network, float& density, float gravity, float dt, const std::vector<LevelSample>& samples,
+	const std::vector<SensitivityParameter>& parameters, CalibrationResult& result, int iterations = CALIBRATION_ITERATIONS, TaskPool* pool = nullptr);
+
+#endif // _CALIBRATION_H
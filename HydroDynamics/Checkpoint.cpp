@@ -0,0 +1,504 @@
+/*
+Title: HydroDynamics
+File Name: Checkpoint.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Saves and restores the complete state of a VesselNetwork in a compact binary file.
+
+The file is a fixed header followed by the raw arrays of the network, each starting on a
+CHECKPOINT_ALIGNMENT byte boundary, in little endian byte order, as a StateLayout (see
+StateLayout.h) describes them. Loading maps the file and copies every array straight into
+the network, so it takes as long as reading the file and there is nothing to parse.
+Everything that can be derived (right, top, pressure, degree and the tube topology) is
+rebuilt instead of stored. The flow through every tube is part of the state, so a restored
+run carries on swinging exactly where it was saved. A layered network also stores its
+fluids and the height of every layer, and a profiled network the widths that define its
+profiles and the profile of every vessel (the tables are built again from the widths). A
+network with components on its tubes stores them, with the changes still queued for them.
+
+A checkpoint is always written to a temporary file that replaces the old one only once it
+is complete, so a crash during a write never leaves a broken checkpoint behind.
+CheckpointWriter does the writing on a background thread.
+*/
+
+#include "Checkpoint.h"
+#include "StateLayout.h"
+#include "MappedFile.h"
+#include "ThreadControl.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// The arrays stored in a checkpoint, in file order.
+enum CheckpointArray
+{
+	CHECKPOINT_HEIGHT = 0,
+	CHECKPOINT_WIDTH,
+	CHECKPOINT_EXTERNAL_PRESSURE,
+	CHECKPOINT_LEFT,
+	CHECKPOINT_BOTTOM,
+	CHECKPOINT_TUBE_A,
+	CHECKPOINT_TUBE_B,
+	CHECKPOINT_TUBE_INV_INERTANCE,
+	CHECKPOINT_TUBE_DAMPING,
+	CHECKPOINT_TUBE_FLOW,
+	CHECKPOINT_FLUID_DENSITY,	// One per fluid
+	CHECKPOINT_LAYER_HEIGHT,	// One per fluid and vessel, all vessels of the first fluid, then of the second, ...
+	CHECKPOINT_VESSEL_PROFILE,	// One per vessel if there are profiles
+	CHECKPOINT_PROFILE_DEPTH,	// One per profile
+	CHECKPOINT_PROFILE_WIDTH,	// PROFILE_SAMPLES + 1 per profile
+	CHECKPOINT_TUBE_COMPONENT,	// One per tube if there are components
+	CHECKPOINT_TUBE_SETTING,
+	CHECKPOINT_TUBE_BASE_INV_INERTANCE,
+	CHECKPOINT_TUBE_BASE_DAMPING,
+	CHECKPOINT_EVENT_STEP,		// One per queued event, in the order they happen, 8 bytes each
+	CHECKPOINT_EVENT_TUBE,
+	CHECKPOINT_EVENT_ACTION,
+	CHECKPOINT_EVENT_VALUE,
+	CHECKPOINT_ARRAY_COUNT
+};
+
+// What the length of every array is counted in.
+enum CheckpointCount
+{
+	COUNT_VESSELS = 0,
+	COUNT_TUBES,
+	COUNT_FLUIDS,
+	COUNT_LAYERS,				// Fluids times vessels
+	COUNT_PROFILED_VESSELS,		// The vessels if there are profiles, 0 if there aren't
+	COUNT_PROFILES,
+	COUNT_PROFILE_SAMPLES,		// PROFILE_SAMPLES + 1 per profile
+	COUNT_COMPONENT_TUBES,
+	COUNT_EVENTS,
+	COUNT_KINDS
+};
+
+static constexpr StateLayout<CHECKPOINT_ARRAY_COUNT> checkpointLayout =
+{
+	{
+		layoutField<float>("height", COUNT_VESSELS),
+		layoutField<float>("width", COUNT_VESSELS),
+		layoutField<float>("externalPressure", COUNT_VESSELS),
+		layoutField<float>("left", COUNT_VESSELS),
+		layoutField<float>("bottom", COUNT_VESSELS),
+		layoutField<int32_t>("tubeA", COUNT_TUBES),
+		layoutField<int32_t>("tubeB", COUNT_TUBES),
+		layoutField<float>("tubeInvInertance", COUNT_TUBES),
+		layoutField<float>("tubeDamping", COUNT_TUBES),
+		layoutField<float>("tubeFlow", COUNT_TUBES),
+		layoutField<float>("fluidDensity", COUNT_FLUIDS),
+		layoutField<float>("layerHeight", COUNT_LAYERS),
+		layoutField<int32_t>("vesselProfile", COUNT_PROFILED_VESSELS),
+		layoutField<float>("profileDepth", COUNT_PROFILES),
+		layoutField<float>("profileWidth", COUNT_PROFILE_SAMPLES),
+		layoutField<int32_t>("tubeComponent", COUNT_COMPONENT_TUBES),
+		layoutField<float>("tubeSetting", COUNT_COMPONENT_TUBES),
+		layoutField<float>("tubeBaseInvInertance", COUNT_COMPONENT_TUBES),
+		layoutField<float>("tubeBaseDamping", COUNT_COMPONENT_TUBES),
+		layoutField<int64_t>("eventStep", COUNT_EVENTS),
+		layoutField<int32_t>("eventTube", COUNT_EVENTS),
+		layoutField<int32_t>("eventAction", COUNT_EVENTS),
+		layoutField<float>("eventValue", COUNT_EVENTS)
+	},
+	CHECKPOINT_ALIGNMENT
+};
+
+// The header at the start of the file. Only fixed size types, so the layout is the same with every compiler.
+struct CheckpointHeader
+{
+	char magic[8];				// "HYDROCKP"
+	uint32_t version;
+	uint32_t layout;			// checkpointLayout.fingerprint()
+	uint32_t headerSize;		// sizeof(CheckpointHeader), as a second check on the layout
+	uint32_t vesselCount;
+	uint32_t tubeCount;
+	uint32_t fluidCount;		// 0 for a network that isn't layered
+	uint32_t profileCount;		// 0 for a network without profiles
+	uint32_t componentTubes;	// tubeCount if the tubes have components, 0 if they don't
+	uint32_t eventCount;
+	uint32_t padding;
+	int64_t step;
+	float pistonPressure;
+	int32_t pistonVessel;
+	uint64_t offset[CHECKPOINT_ARRAY_COUNT];	// Where every array starts, from the start of the file
+	uint64_t fileSize;
+};
+
+static const char checkpointMagic[8] = { 'H', 'Y', 'D', 'R', 'O', 'C', 'K', 'P' };
+
+// Arrays are written as they are in memory, which is only the promised little endian on a little endian machine.
+static bool isLittleEndian()
+{
+	uint32_t one = 1;
+	unsigned char first;
+	memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+// The length of every kind of array for the counts in the header.
+static void headerCounts(const CheckpointHeader& header, uint64_t* counts)
+{
+	counts[COUNT_VESSELS] = header.vesselCount;
+	counts[COUNT_TUBES] = header.tubeCount;
+	counts[COUNT_FLUIDS] = header.fluidCount;
+	counts[COUNT_LAYERS] = (uint64_t)header.fluidCount * header.vesselCount;
+	counts[COUNT_PROFILED_VESSELS] = header.profileCount > 0 ? header.vesselCount : 0;
+	counts[COUNT_PROFILES] = header.profileCount;
+	counts[COUNT_PROFILE_SAMPLES] = (uint64_t)header.profileCount * (PROFILE_SAMPLES + 1);
+	counts[COUNT_COMPONENT_TUBES] = header.componentTubes;
+	counts[COUNT_EVENTS] = header.eventCount;
+}
+
+// Moves the finished temporary file over the old checkpoint in one step.
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool writeCheckpoint(const std::string& fileName, const VesselNetwork& network, const CheckpointInfo& info)
+{
+	if (!isLittleEndian())
+	{
+		std::cout << "Checkpoints can only be written on little endian machines." << std::endl;
+		return false;
+	}
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.layout = checkpointLayout.fingerprint();
+	header.headerSize = sizeof(CheckpointHeader);
+	header.vesselCount = (uint32_t)network.vesselCount();
+	header.tubeCount = (uint32_t)network.tubeCount();
+	header.fluidCount = (uint32_t)network.fluidCount();
+	header.profileCount = network.profiled() ? (uint32_t)network.profiles.count() : 0;
+	header.componentTubes = network.hasComponents() ? (uint32_t)network.tubeCount() : 0;
+	header.eventCount = (uint32_t)network.schedule.size();
+	header.step = info.step;
+	header.pistonPressure = info.pistonPressure;
+	header.pistonVessel = info.pistonVessel;
+	uint64_t counts[COUNT_KINDS];
+	headerCounts(header, counts);
+	header.fileSize = checkpointLayout.place(sizeof(CheckpointHeader), counts, header.offset);
+
+	// The layers are one array per fluid in memory, but one after the other in the file.
+	std::vector<float> layers;
+	for (const std::vector<float>& layer : network.layerHeight)
+	{
+		layers.insert(layers.end(), layer.begin(), layer.end());
+	}
+
+	// The events go in the order they happen, so loading can queue them again in that order.
+	std::vector<TubeEvent> events;
+	network.schedule.sorted(events);
+	std::vector<int64_t> eventStep;
+	std::vector<int32_t> eventTube;
+	std::vector<int32_t> eventAction;
+	std::vector<float> eventValue;
+	for (const TubeEvent& event : events)
+	{
+		eventStep.push_back(event.step);
+		eventTube.push_back(event.tube);
+		eventAction.push_back(event.action);
+		eventValue.push_back(event.value);
+	}
+
+	const void* arrays[CHECKPOINT_ARRAY_COUNT] =
+	{
+		network.height.data(), network.width.data(), network.externalPressure.data(),
+		network.left.data(), network.bottom.data(), network.tubeA.data(), network.tubeB.data(),
+		network.tubeInvInertance.data(), network.tubeDamping.data(), network.tubeFlow.data(),
+		network.fluidDensity.data(), layers.data(), network.vesselProfile.data(), network.profiles.depth.data(),
+		network.profiles.widths.data(), network.tubeComponent.data(), network.tubeSetting.data(), network.tubeBaseInvInertance.data(),
+		network.tubeBaseDamping.data(), eventStep.data(), eventTube.data(), eventAction.data(), eventValue.data()
+	};
+
+	std::string temporaryFile = fileName + ".tmp";
+	FILE* file = fopen(temporaryFile.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cout << "Can't write file: " << temporaryFile << std::endl;
+		return false;
+	}
+
+	static const char padding[CHECKPOINT_ALIGNMENT] = {};
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	uint64_t position = sizeof(header);
+	for (int i = 0; i < CHECKPOINT_ARRAY_COUNT && written; i++)
+	{
+		uint64_t bytes = checkpointLayout.bytes(i, counts);
+		written = fwrite(padding, 1, (size_t)(header.offset[i] - position), file) == header.offset[i] - position
+			&& fwrite(arrays[i], 1, (size_t)bytes, file) == bytes;
+		position = header.offset[i] + bytes;
+	}
+	written = written && fwrite(padding, 1, (size_t)(header.fileSize - position), file) == header.fileSize - position;
+	written = fclose(file) == 0 && written;
+
+	if (!written || !replaceFile(temporaryFile, fileName))
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		remove(temporaryFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool readCheckpoint(const std::string& fileName, VesselNetwork& network, CheckpointInfo& info)
+{
+	MappedFile file;
+	if (!file.open(fileName.c_str()))
+	{
+		return false;
+	}
+
+	// Everything is checked before the network is touched, so a bad file leaves the current state alone.
+	std::string_view data = file.view();
+	CheckpointHeader header;
+	bool valid = isLittleEndian() && data.size() >= sizeof(header);
+	if (valid)
+	{
+		memcpy(&header, data.data(), sizeof(header));
+		uint64_t counts[COUNT_KINDS];
+		headerCounts(header, counts);
+
+		valid = memcmp(header.magic, checkpointMagic, sizeof(header.magic)) == 0
+			&& header.version == CHECKPOINT_VERSION
+			&& header.layout == checkpointLayout.fingerprint()
+			&& header.headerSize == sizeof(CheckpointHeader)
+			&& checkpointLayout.matches(sizeof(CheckpointHeader), counts, header.offset, header.fileSize)
+			&& data.size() >= header.fileSize
+			&& header.pistonVessel >= 0 && (uint32_t)header.pistonVessel < header.vesselCount;
+	}
+	if (!valid)
+	{
+		std::cout << "Not a valid checkpoint (or written by another version): " << fileName << std::endl;
+		return false;
+	}
+
+	const float* height = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_HEIGHT);
+	const float* width = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_WIDTH);
+	const float* externalPressure = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_EXTERNAL_PRESSURE);
+	const float* left = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_LEFT);
+	const float* bottom = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_BOTTOM);
+	const int32_t* tubeA = checkpointLayout.array<int32_t>(data.data(), header.offset, CHECKPOINT_TUBE_A);
+	const int32_t* tubeB = checkpointLayout.array<int32_t>(data.data(), header.offset, CHECKPOINT_TUBE_B);
+	const float* tubeInvInertance = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_TUBE_INV_INERTANCE);
+	const float* tubeDamping = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_TUBE_DAMPING);
+	const float* tubeFlow = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_TUBE_FLOW);
+	const float* fluidDensity = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_FLUID_DENSITY);
+	const float* layerHeight = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_LAYER_HEIGHT);
+	const int32_t* vesselProfile = checkpointLayout.array<int32_t>(data.data(), header.offset, CHECKPOINT_VESSEL_PROFILE);
+	const float* profileDepth = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_PROFILE_DEPTH);
+	const float* profileWidth = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_PROFILE_WIDTH);
+	const int32_t* tubeComponent = checkpointLayout.array<int32_t>(data.data(), header.offset, CHECKPOINT_TUBE_COMPONENT);
+	const float* tubeSetting = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_TUBE_SETTING);
+	const float* tubeBaseInvInertance = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_TUBE_BASE_INV_INERTANCE);
+	const float* tubeBaseDamping = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_TUBE_BASE_DAMPING);
+	const int64_t* eventStep = checkpointLayout.array<int64_t>(data.data(), header.offset, CHECKPOINT_EVENT_STEP);
+	const int32_t* eventTube = checkpointLayout.array<int32_t>(data.data(), header.offset, CHECKPOINT_EVENT_TUBE);
+	const int32_t* eventAction = checkpointLayout.array<int32_t>(data.data(), header.offset, CHECKPOINT_EVENT_ACTION);
+	const float* eventValue = checkpointLayout.array<float>(data.data(), header.offset, CHECKPOINT_EVENT_VALUE);
+
+	for (uint32_t t = 0; t < header.tubeCount; t++)
+	{
+		if (tubeA[t] < 0 || (uint32_t)tubeA[t] >= header.vesselCount || tubeB[t] < 0 || (uint32_t)tubeB[t] >= header.vesselCount)
+		{
+			std::cout << "Not a valid checkpoint (a tube points outside the network): " << fileName << std::endl;
+			return false;
+		}
+	}
+
+	bool validComponents = header.componentTubes == 0 || header.componentTubes == header.tubeCount;
+	for (uint32_t t = 0; validComponents && t < header.componentTubes; t++)
+	{
+		validComponents = tubeComponent[t] >= COMPONENT_NONE && tubeComponent[t] <= COMPONENT_PUMP;
+	}
+	for (uint32_t e = 0; validComponents && e < header.eventCount; e++)
+	{
+		validComponents = eventTube[e] >= 0 && (uint32_t)eventTube[e] < header.componentTubes && eventAction[e] >= ACTION_OPEN
+			&& eventAction[e] <= ACTION_STOP;
+	}
+	if (!validComponents)
+	{
+		std::cout << "Not a valid checkpoint (a tube component or a queued change is broken): " << fileName << std::endl;
+		return false;
+	}
+
+	// The profiles are built again from their widths, which also checks them. They were resampled when they were first added, so
+	// adding them again gives the same tables, at the same indices.
+	VesselProfiles profiles;
+	for (uint32_t p = 0; p < header.profileCount; p++)
+	{
+		std::vector<float> widths(profileWidth + p * (PROFILE_SAMPLES + 1), profileWidth + (p + 1) * (PROFILE_SAMPLES + 1));
+		if (profiles.add(widths, profileDepth[p]) != (int)p)
+		{
+			std::cout << "Not a valid checkpoint (a profile is broken or there twice): " << fileName << std::endl;
+			return false;
+		}
+	}
+	for (uint32_t i = 0; header.profileCount > 0 && i < header.vesselCount; i++)
+	{
+		if (vesselProfile[i] < -1 || vesselProfile[i] >= (int32_t)header.profileCount)
+		{
+			std::cout << "Not a valid checkpoint (a vessel has a profile that isn't there): " << fileName << std::endl;
+			return false;
+		}
+	}
+
+	int vessels = (int)header.vesselCount;
+	int tubes = (int)header.tubeCount;
+
+	network.clear();
+	network.height.assign(height, height + vessels);
+	network.width.assign(width, width + vessels);
+	network.externalPressure.assign(externalPressure, externalPressure + vessels);
+	network.left.assign(left, left + vessels);
+	network.bottom.assign(bottom, bottom + vessels);
+	network.tubeA.assign(tubeA, tubeA + tubes);
+	network.tubeB.assign(tubeB, tubeB + tubes);
+	network.tubeInvInertance.assign(tubeInvInertance, tubeInvInertance + tubes);
+	network.tubeDamping.assign(tubeDamping, tubeDamping + tubes);
+	network.tubeFlow.assign(tubeFlow, tubeFlow + tubes);
+	network.fluidDensity.assign(fluidDensity, fluidDensity + header.fluidCount);
+	network.layerHeight.resize(header.fluidCount);
+	for (uint32_t f = 0; f < header.fluidCount; f++)
+	{
+		network.layerHeight[f].assign(layerHeight + f * vessels, layerHeight + (f + 1) * vessels);
+	}
+	if (header.profileCount > 0)
+	{
+		network.profiles = std::move(profiles);
+		network.vesselProfile.assign(vesselProfile, vesselProfile + vessels);
+	}
+	if (header.componentTubes > 0)
+	{
+		network.tubeComponent.assign(tubeComponent, tubeComponent + tubes);
+		network.tubeSetting.assign(tubeSetting, tubeSetting + tubes);
+		network.tubeBaseInvInertance.assign(tubeBaseInvInertance, tubeBaseInvInertance + tubes);
+		network.tubeBaseDamping.assign(tubeBaseDamping, tubeBaseDamping + tubes);
+	}
+	for (uint32_t e = 0; e < header.eventCount; e++)
+	{
+		network.schedule.push({ eventStep[e], 0, eventTube[e], (TubeAction)eventAction[e], eventValue[e] });
+	}
+
+	// The rest follows from what was stored.
+	network.pressure.assign(vessels, 0.0f);
+	network.delta.assign(vessels, 0.0f);
+	network.right.resize(vessels);
+	network.top.resize(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		network.right[i] = network.left[i] + network.width[i];
+		network.top[i] = network.bottom[i] + network.height[i];
+	}
+	network.degree.assign(vessels, 0);
+	for (int t = 0; t < tubes; t++)
+	{
+		network.degree[network.tubeA[t]]++;
+		network.degree[network.tubeB[t]]++;
+	}
+	network.topologyDirty = true;
+
+	info.step = header.step;
+	info.pistonPressure = header.pistonPressure;
+	info.pistonVessel = header.pistonVessel;
+	return true;
+}
+
+CheckpointWriter::CheckpointWriter()
+{
+	thread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	thread.join();
+}
+
+void CheckpointWriter::save(const std::string& fileName, const VesselNetwork& network, const CheckpointInfo& info)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingFile = fileName;
+		pendingNetwork = network;
+		pendingInfo = info;
+		hasPending = true;
+	}
+	changed.notify_all();
+}
+
+bool CheckpointWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return !hasPending && !writing; });
+	bool succeeded = !failed;
+	failed = false;
+	return succeeded;
+}
+
+void CheckpointWriter::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		changed.wait(lock, [this] { return stopping || hasPending; });
+		if (!hasPending)
+		{
+			// Stopping, and everything that was queued is on disk.
+			return;
+		}
+
+		// Take the pending checkpoint out, so save() can queue the next one while this one is written.
+		std::string fileName = std::move(pendingFile);
+		VesselNetwork network = std::move(pendingNetwork);
+		CheckpointInfo info = pendingInfo;
+		hasPending = false;
+		writing = true;
+
+		lock.unlock();
+		bool written = writeCheckpoint(fileName, network, info);
+		lock.lock();
+
+		writing = false;
+		failed |= !written;
+		changed.notify_all();
+	}
+}
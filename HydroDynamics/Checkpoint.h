@@ -0,0 +1,107 @@
+/*
+Title: HydroDynamics
+File Name: Checkpoint.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Saves and restores the complete state of a VesselNetwork in a compact binary file.
+
+The file is a fixed header followed by the raw arrays of the network, each starting on a
+CHECKPOINT_ALIGNMENT byte boundary, in little endian byte order, as a StateLayout (see
+StateLayout.h) describes them. Loading maps the file and copies every array straight into
+the network, so it takes as long as reading the file and there is nothing to parse.
+Everything that can be derived (right, top, pressure, degree and the tube topology) is
+rebuilt instead of stored. The flow through every tube is part of the state, so a restored
+run carries on swinging exactly where it was saved. A layered network also stores its
+fluids and the height of every layer, and a profiled network the widths that define its
+profiles and the profile of every vessel (the tables are built again from the widths). A
+network with components on its tubes stores them, with the changes still queued for them.
+
+A checkpoint is always written to a temporary file that replaces the old one only once it
+is complete, so a crash during a write never leaves a broken checkpoint behind.
+CheckpointWriter does the writing on a background thread.
+*/
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include "VesselNetwork.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Bump the version whenever the layout changes. Files with another version are refused.
+#define CHECKPOINT_VERSION 6
+#define CHECKPOINT_ALIGNMENT 64
+
+// The simulation state that isn't part of the network itself.
+struct CheckpointInfo
+{
+	long long step = 0;				// Number of physics steps simulated so far
+	float pistonPressure = 0.0f;	// The pressure the piston pushes with
+	int pistonVessel = 0;			// The vessel the piston sits on
+};
+
+// Writes the network to fileName. Returns false (after printing an error) if the file can't be written.
+bool writeCheckpoint(const std::string& fileName, const VesselNetwork& network, const CheckpointInfo& info);
+
+// Replaces the contents of network with the checkpoint in fileName. Returns false (after printing an error, and without touching
+// network) if the file can't be read or isn't a valid checkpoint.
+bool readCheckpoint(const std::string& fileName, VesselNetwork& network, CheckpointInfo& info);
+
+// Writes checkpoints on a background thread, so the simulation only pays for copying the arrays.
+class CheckpointWriter
+{
+public:
+	CheckpointWriter();
+
+	// Waits for the checkpoint that is being written, if there is one.
+	~CheckpointWriter();
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	// Takes a copy of the network and writes it in the background. If the previous checkpoint is still being written, this one
+	// replaces it in the queue, so a slow disk never builds up a backlog.
+	void save(const std::string& fileName, const VesselNetwork& network, const CheckpointInfo& info);
+
+	// Waits until everything passed to save() has been written. Returns false if any write failed since the last call.
+	bool flush();
+
+private:
+	void run();
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping = false;
+	bool writing = false;
+	bool failed = false;
+
+	bool hasPending = false;
+	std::string pendingFile;
+	VesselNetwork pendingNetwork;
+	CheckpointInfo pendingInfo;
+};
+
+#endif // _CHECKPOINT_H
@@ -0,0 +1,161 @@
+/*
+Title: HydroDynamics
+File Name: ComponentPlugins.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Components that plugins add on top of the network, like sensors that watch a vessel or
+controllers that push on it, without main.cpp knowing what they are.
+
+A kind of component is a class derived from ComponentPlugin, registered under a name from
+its own .cpp file with a static ComponentRegistration, which is all it takes to make it
+available to --component. The plugin never sees a single instance: once per step it is
+handed all of its instances at once as a ComponentBatch, a structure of arrays with the
+vessel, the settings and the state of every instance, and works through them in a loop of
+its own. So there is one virtual call per kind of component and step, however many
+instances there are, and the loop over them is plain code the compiler can see through
+(and vectorize).
+
+The instances hold Handles to their vessels (see HandleTable.h), which are looked up again
+right before every call, so they follow their vessels when others are added or removed.
+
+This file has no OpenGL dependency.
+*/
+
+#include "ComponentPlugins.h"
+#include "VesselNetwork.h"
+#include <iostream>
+#include <map>
+
+// The registered kinds. A function-local static, so it exists before the first registration whatever order the files start in.
+static std::map<std::string, std::function<std::unique_ptr<ComponentPlugin>()>>& registeredPlugins()
+{
+	static std::map<std::string, std::function<std::unique_ptr<ComponentPlugin>()>> plugins;
+	return plugins;
+}
+
+void registerComponentPlugin(const char* name, std::function<std::unique_ptr<ComponentPlugin>()> make)
+{
+	registeredPlugins()[name] = make;
+}
+
+std::vector<std::string> componentPluginNames()
+{
+	std::vector<std::string> names;
+	for (const auto& entry : registeredPlugins())
+	{
+		names.push_back(entry.first);
+	}
+	return names;
+}
+
+bool ComponentSet::add(VesselNetwork& network, const std::string& name, int vessel, const std::vector<float>& settings)
+{
+	auto found = registeredPlugins().find(name);
+	if (found == registeredPlugins().end())
+	{
+		std::cout << "There is no component called " << name << ", expected one of:";
+		for (const std::string& known : componentPluginNames())
+		{
+			std::cout << " " << known;
+		}
+		std::cout << std::endl;
+		return false;
+	}
+	if (vessel < 0 || vessel >= network.vesselCount())
+	{
+		std::cout << "The " << name << " can't sit on vessel " << vessel << ", there are " << network.vesselCount() << "." << std::endl;
+		return false;
+	}
+
+	Kind* kind = nullptr;
+	for (Kind& existing : kinds)
+	{
+		if (existing.name == name)
+		{
+			kind = &existing;
+		}
+	}
+	if (kind == nullptr)
+	{
+		kinds.emplace_back();
+		kind = &kinds.back();
+		kind->name = name;
+		kind->plugin = found->second();
+		kind->settingCount = kind->plugin->settingCount();
+		kind->stateCount = kind->plugin->stateCount();
+	}
+	if ((int)settings.size() != kind->settingCount)
+	{
+		std::cout << "The " << name << " takes " << kind->settingCount << " settings, not " << settings.size() << "." << std::endl;
+		return false;
+	}
+
+	// The handles only exist once the topology was built.
+	if (network.topologyDirty)
+	{
+		network.rebuildTopology();
+	}
+	kind->handles.push_back(network.vesselHandle(vessel));
+	kind->vessel.push_back(vessel);
+	kind->settings.insert(kind->settings.end(), settings.begin(), settings.end());
+	kind->state.resize(kind->state.size() + kind->stateCount, 0.0f);
+	return true;
+}
+
+ComponentBatch ComponentSet::batch(Kind& kind, const VesselNetwork& network)
+{
+	for (size_t i = 0; i < kind.handles.size(); i++)
+	{
+		kind.vessel[i] = network.vesselIndex(kind.handles[i]);
+	}
+	ComponentBatch result;
+	result.count = (int)kind.handles.size();
+	result.vessel = kind.vessel.data();
+	result.settings = kind.settings.data();
+	result.state = kind.state.data();
+	return result;
+}
+
+void ComponentSet::beforeStep(VesselNetwork& network, float dt)
+{
+	for (Kind& kind : kinds)
+	{
+		kind.plugin->beforeStep(network, batch(kind, network), dt);
+	}
+}
+
+void ComponentSet::afterStep(const VesselNetwork& network, float dt)
+{
+	for (Kind& kind : kinds)
+	{
+		kind.plugin->afterStep(network, batch(kind, network), dt);
+	}
+}
+
+void ComponentSet::report(std::ostream& out, const VesselNetwork& network)
+{
+	for (Kind& kind : kinds)
+	{
+		kind.plugin->report(out, network, batch(kind, network));
+	}
+}
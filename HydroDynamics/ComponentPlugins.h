@@ -0,0 +1,138 @@
+/*
+Title: HydroDynamics
+File Name: ComponentPlugins.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Components that plugins add on top of the network, like sensors that watch a vessel or
+controllers that push on it, without main.cpp knowing what they are.
+
+A kind of component is a class derived from ComponentPlugin, registered under a name from
+its own .cpp file with a static ComponentRegistration, which is all it takes to make it
+available to --component. The plugin never sees a single instance: once per step it is
+handed all of its instances at once as a ComponentBatch, a structure of arrays with the
+vessel, the settings and the state of every instance, and works through them in a loop of
+its own. So there is one virtual call per kind of component and step, however many
+instances there are, and the loop over them is plain code the compiler can see through
+(and vectorize).
+
+The instances hold Handles to their vessels (see HandleTable.h), which are looked up again
+right before every call, so they follow their vessels when others are added or removed.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _COMPONENT_PLUGINS_H
+#define _COMPONENT_PLUGINS_H
+
+#include "HandleTable.h"
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct VesselNetwork;
+
+// The instances of one kind of component. Instance i sits on vessel[i], an index into the network that is -1 if the vessel was
+// removed (the instance should be left alone then). Its settings are settings[i * settingCount()] on, as they were given, and its
+// state is state[i * stateCount()] on, which starts out 0 and is the plugin's to keep.
+struct ComponentBatch
+{
+	int count = 0;
+	const int* vessel = nullptr;
+	const float* settings = nullptr;
+	float* state = nullptr;
+};
+
+class ComponentPlugin
+{
+public:
+	virtual ~ComponentPlugin() {}
+
+	// How many settings an instance is created with, and how many floats of state it keeps.
+	virtual int settingCount() const = 0;
+	virtual int stateCount() const = 0;
+
+	// Right before a step of dt seconds: a controller sets what it controls (the external pressure of its vessel, for example).
+	virtual void beforeStep(VesselNetwork&, const ComponentBatch&, float) {}
+
+	// Right after the step: a sensor takes what it measures.
+	virtual void afterStep(const VesselNetwork&, const ComponentBatch&, float) {}
+
+	// At the end of the run, writes what the instances found out.
+	virtual void report(std::ostream&, const VesselNetwork&, const ComponentBatch&) {}
+};
+
+// Makes a kind of component available under a name. Use ComponentRegistration instead of calling this.
+void registerComponentPlugin(const char* name, std::function<std::unique_ptr<ComponentPlugin>()> make);
+
+// Registers Plugin under a name while the program starts, from a static in the file that defines it:
+//	static ComponentRegistration<LevelSensor> levelSensor("level-sensor");
+template <typename Plugin>
+struct ComponentRegistration
+{
+	explicit ComponentRegistration(const char* name)
+	{
+		registerComponentPlugin(name, [] { return std::unique_ptr<ComponentPlugin>(new Plugin()); });
+	}
+};
+
+// The names of every registered kind, in alphabetical order.
+std::vector<std::string> componentPluginNames();
+
+// The instances of every kind of component in a run, grouped by kind.
+class ComponentSet
+{
+public:
+	// Adds an instance of the kind called name on a vessel of network, with settings. Returns false (after printing why) if there is
+	// no such kind, the vessel doesn't exist or the number of settings doesn't fit the kind.
+	bool add(VesselNetwork& network, const std::string& name, int vessel, const std::vector<float>& settings);
+
+	// Call around every step of the network.
+	void beforeStep(VesselNetwork& network, float dt);
+	void afterStep(const VesselNetwork& network, float dt);
+
+	// Has every kind write what its instances found out.
+	void report(std::ostream& out, const VesselNetwork& network);
+
+	bool empty() const { return kinds.empty(); }
+
+private:
+	struct Kind
+	{
+		std::string name;
+		std::unique_ptr<ComponentPlugin> plugin;
+		int settingCount = 0;
+		int stateCount = 0;
+		std::vector<Handle> handles;
+		std::vector<int> vessel;		// Looked up from handles before every call
+		std::vector<float> settings;
+		std::vector<float> state;
+	};
+
+	ComponentBatch batch(Kind& kind, const VesselNetwork& network);
+
+	std::vector<Kind> kinds;
+};
+
+#endif // _COMPONENT_PLUGINS_H
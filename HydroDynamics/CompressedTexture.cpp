@@ -0,0 +1,475 @@
+/*
+Title: HydroDynamics
+File Name: CompressedTexture.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Loads images (the background diagram, labels, anything FreeImage can read) as block
+compressed textures with all of their mipmaps, which take a quarter (with alpha) or an eighth
+(without) of the memory plain RGBA8 takes, on the GPU and in the cache alike.
+
+Everything up to the upload happens on the loader thread of an AssetLoader: the image is
+decoded with FreeImage, its mipmaps are made by averaging 2 x 2 pixels down to 1 x 1, and every
+level is compressed to BC1 if the image is opaque, or to BC3 if it has alpha. The result is
+cached next to the image as IMAGE.bcn, which later runs read instead, as long as it is newer
+than the image. The thread that owns the context then only copies the blocks into a pixel
+unpack buffer and points glCompressedTexImage2D at it, so the driver takes them from there
+on its own time instead of the call waiting for the transfer.
+
+The compressor is the quick one: the end points of a block are the corners of the box around
+its colors, pulled in a little, and every pixel takes the nearest of the colors between them.
+That is plenty for diagrams and labels; photographic images would want a better one.
+*/
+
+#include "CompressedTexture.h"
+#include "FreeImage.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include "Logger.h"
+#include <sys/stat.h>
+#include <cstring>
+#include <climits>
+#include <memory>
+
+#define COMPRESSED_CACHE_MAGIC 0x314e4342	// "BCN1"
+#define COMPRESSED_CACHE_VERSION 1
+
+// The header at the start of a cache file. The offsets of the levels follow it, and then the blocks.
+struct CompressedCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int format;
+	int width;
+	int height;
+	int levels;
+	unsigned long long dataSize;
+};
+
+// The modification time of a file in seconds, or -1 if it doesn't exist.
+static long long modifiedTime(const std::string& file)
+{
+	struct stat info;
+	if (stat(file.c_str(), &info) != 0)
+	{
+		return -1;
+	}
+	return (long long)info.st_mtime;
+}
+
+static unsigned short pack565(const int color[3])
+{
+	return (unsigned short)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+// Widens a 5:6:5 color back to 8 bits per channel the way the GPU does, by repeating the high bits.
+static void unpack565(unsigned short packed, int color[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// Writes the 8 bytes of the BC1 color block of 16 RGBA pixels, in the four color mode BC3 also uses.
+static void compressColorBlock(const unsigned char* block, unsigned char* out)
+{
+	int low[3] = { 255, 255, 255 };
+	int high[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			low[c] = std::min(low[c], (int)block[i * 4 + c]);
+			high[c] = std::max(high[c], (int)block[i * 4 + c]);
+		}
+	}
+
+	// Pulling the corners in by a sixteenth of the box puts the colors between them where most of the pixels are.
+	for (int c = 0; c < 3; c++)
+	{
+		int inset = (high[c] - low[c]) >> 4;
+		low[c] += inset;
+		high[c] -= inset;
+	}
+
+	unsigned short end0 = pack565(high);
+	unsigned short end1 = pack565(low);
+	if (end0 < end1)
+	{
+		std::swap(end0, end1);
+	}
+
+	unsigned int indices = 0;
+	if (end0 != end1)
+	{
+		int palette[4][3];
+		unpack565(end0, palette[0]);
+		unpack565(end1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestDistance = INT_MAX;
+			for (int p = 0; p < 4; p++)
+			{
+				int distance = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = (int)block[i * 4 + c] - palette[p][c];
+					distance += d * d;
+				}
+				if (distance < bestDistance)
+				{
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= (unsigned int)best << (i * 2);
+		}
+	}
+
+	out[0] = (unsigned char)(end0 & 0xff);
+	out[1] = (unsigned char)(end0 >> 8);
+	out[2] = (unsigned char)(end1 & 0xff);
+	out[3] = (unsigned char)(end1 >> 8);
+	for (int b = 0; b < 4; b++)
+	{
+		out[4 + b] = (unsigned char)(indices >> (b * 8));
+	}
+}
+
+// Writes the 8 bytes of the BC3 alpha block of 16 RGBA pixels, with 6 alphas between the two ends.
+static void compressAlphaBlock(const unsigned char* block, unsigned char* out)
+{
+	int low = 255;
+	int high = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		low = std::min(low, (int)block[i * 4 + 3]);
+		high = std::max(high, (int)block[i * 4 + 3]);
+	}
+
+	unsigned long long indices = 0;
+	if (high != low)
+	{
+		int palette[8] = { high, low };
+		for (int p = 1; p < 7; p++)
+		{
+			palette[p + 1] = ((7 - p) * high + p * low) / 7;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			for (int p = 1; p < 8; p++)
+			{
+				if (std::abs(block[i * 4 + 3] - palette[p]) < std::abs(block[i * 4 + 3] - palette[best]))
+				{
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	}
+
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+	for (int b = 0; b < 6; b++)
+	{
+		out[2 + b] = (unsigned char)(indices >> (b * 8));
+	}
+}
+
+// Compresses one level of RGBA pixels, block by block. The blocks on the right and top edges of a size that isn't a multiple of 4
+// repeat the last column or row.
+static void compressLevel(const std::vector<unsigned char>& rgba, int width, int height, bool alpha, std::vector<unsigned char>& out)
+{
+	unsigned char block[64];
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			for (int y = 0; y < 4; y++)
+			{
+				for (int x = 0; x < 4; x++)
+				{
+					size_t pixel = (size_t)std::min(by + y, height - 1) * width + std::min(bx + x, width - 1);
+					memcpy(block + (y * 4 + x) * 4, &rgba[pixel * 4], 4);
+				}
+			}
+
+			size_t at = out.size();
+			out.resize(at + (alpha ? 16 : 8));
+			if (alpha)
+			{
+				compressAlphaBlock(block, &out[at]);
+				at += 8;
+			}
+			compressColorBlock(block, &out[at]);
+		}
+	}
+}
+
+void compressImage(const unsigned char* pixels, int width, int height, CompressedImage& image)
+{
+	// FreeImage keeps the bytes as BGRA, the blocks want them as RGBA.
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	bool alpha = false;
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		rgba[i * 4 + 0] = pixels[i * 4 + FI_RGBA_RED];
+		rgba[i * 4 + 1] = pixels[i * 4 + FI_RGBA_GREEN];
+		rgba[i * 4 + 2] = pixels[i * 4 + FI_RGBA_BLUE];
+		rgba[i * 4 + 3] = pixels[i * 4 + FI_RGBA_ALPHA];
+		alpha = alpha || rgba[i * 4 + 3] != 255;
+	}
+
+	image.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	image.width = width;
+	image.height = height;
+	image.levelOffset.clear();
+	image.data.clear();
+
+	std::vector<unsigned char> next;
+	int w = width;
+	int h = height;
+	while (true)
+	{
+		image.levelOffset.push_back(image.data.size());
+		compressLevel(rgba, w, h, alpha, image.data);
+		if (w == 1 && h == 1)
+		{
+			break;
+		}
+
+		// The next level averages 2 x 2 pixels of this one. An odd last row or column is averaged with itself.
+		int nextW = std::max(w / 2, 1);
+		int nextH = std::max(h / 2, 1);
+		next.resize((size_t)nextW * nextH * 4);
+		for (int y = 0; y < nextH; y++)
+		{
+			int y0 = std::min(y * 2, h - 1);
+			int y1 = std::min(y * 2 + 1, h - 1);
+			for (int x = 0; x < nextW; x++)
+			{
+				int x0 = std::min(x * 2, w - 1);
+				int x1 = std::min(x * 2 + 1, w - 1);
+				for (int c = 0; c < 4; c++)
+				{
+					int sum = rgba[((size_t)y0 * w + x0) * 4 + c] + rgba[((size_t)y0 * w + x1) * 4 + c] + rgba[((size_t)y1 * w + x0) * 4 + c]
+						+ rgba[((size_t)y1 * w + x1) * 4 + c];
+					next[((size_t)y * nextW + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		rgba.swap(next);
+		w = nextW;
+		h = nextH;
+	}
+}
+
+bool decodeImage(const std::string& file, std::string_view contents, CompressedImage& image)
+{
+	FIMEMORY* memory = FreeImage_OpenMemory((BYTE*)const_cast<char*>(contents.data()), (DWORD)contents.size());
+	FREE_IMAGE_FORMAT format = FreeImage_GetFileTypeFromMemory(memory, 0);
+	FIBITMAP* bitmap = format == FIF_UNKNOWN ? nullptr : FreeImage_LoadFromMemory(format, memory, 0);
+	FreeImage_CloseMemory(memory);
+	if (bitmap == nullptr)
+	{
+		LOG_ERROR("Can't decode the image {}.", file);
+		return false;
+	}
+
+	// Rows of 32 bits without padding, whatever the file had, and the bottom row first, which is also how OpenGL wants them.
+	FIBITMAP* converted = FreeImage_ConvertTo32Bits(bitmap);
+	FreeImage_Unload(bitmap);
+	if (converted == nullptr)
+	{
+		LOG_ERROR("Can't convert the image {} to 32 bits.", file);
+		return false;
+	}
+	int width = (int)FreeImage_GetWidth(converted);
+	int height = (int)FreeImage_GetHeight(converted);
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	FreeImage_ConvertToRawBits(pixels.data(), converted, width * 4, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+	FreeImage_Unload(converted);
+
+	compressImage(pixels.data(), width, height, image);
+	return true;
+}
+
+std::string compressedCacheFile(const std::string& file)
+{
+	return file + ".bcn";
+}
+
+bool readCompressedCache(const std::string& file, CompressedImage& image)
+{
+	std::string cacheFile = compressedCacheFile(file);
+	long long cacheTime = modifiedTime(cacheFile);
+	if (cacheTime < 0 || cacheTime < modifiedTime(file))
+	{
+		return false;
+	}
+
+	MappedFile cache;
+	if (!cache.open(cacheFile.c_str()))
+	{
+		return false;
+	}
+	std::string_view bytes = cache.view();
+	CompressedCacheHeader header;
+	if (bytes.size() < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, bytes.data(), sizeof(header));
+	size_t offsetBytes = sizeof(unsigned long long) * (header.levels > 0 ? header.levels : 0);
+	if (header.magic != COMPRESSED_CACHE_MAGIC || header.version != COMPRESSED_CACHE_VERSION || header.levels <= 0
+		|| bytes.size() != sizeof(header) + offsetBytes + header.dataSize)
+	{
+		return false;
+	}
+
+	image.format = header.format;
+	image.width = header.width;
+	image.height = header.height;
+	image.levelOffset.resize(header.levels);
+	for (int level = 0; level < header.levels; level++)
+	{
+		unsigned long long offset;
+		memcpy(&offset, bytes.data() + sizeof(header) + level * sizeof(offset), sizeof(offset));
+		image.levelOffset[level] = (size_t)offset;
+	}
+	const char* data = bytes.data() + sizeof(header) + offsetBytes;
+	image.data.assign(data, data + header.dataSize);
+	return true;
+}
+
+bool writeCompressedCache(const std::string& file, const CompressedImage& image)
+{
+	std::ofstream out(compressedCacheFile(file), std::ios::binary);
+	if (!out)
+	{
+		return false;
+	}
+	CompressedCacheHeader header = { COMPRESSED_CACHE_MAGIC, COMPRESSED_CACHE_VERSION, image.format, image.width, image.height, image.levels(),
+		(unsigned long long)image.data.size() };
+	out.write((const char*)&header, sizeof(header));
+	for (size_t offset : image.levelOffset)
+	{
+		unsigned long long wide = offset;
+		out.write((const char*)&wide, sizeof(wide));
+	}
+	out.write((const char*)image.data.data(), image.data.size());
+	return (bool)out;
+}
+
+GLuint uploadCompressedImage(const CompressedImage& image)
+{
+	if (!GLEW_EXT_texture_compression_s3tc)
+	{
+		LOG_WARNING("This driver has no S3TC, so compressed images can't be shown.");
+		return 0;
+	}
+
+	// The blocks of every level go into one unpack buffer, and the texture takes them from there once the driver gets to it.
+	GLuint unpackBuffer = 0;
+	glGenBuffers(1, &unpackBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, image.data.size(), nullptr, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.data.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped == nullptr)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &unpackBuffer);
+		LOG_ERROR("Can't map a buffer for an image of {} bytes.", image.data.size());
+		return 0;
+	}
+	memcpy(mapped, image.data.data(), image.data.size());
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	cachedBindTexture(GL_TEXTURE_2D, texture);
+	for (int level = 0; level < image.levels(); level++)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, image.levelWidth(level), image.levelHeight(level), 0,
+			(GLsizei)image.levelSize(level), (const void*)image.levelOffset[level]);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	cachedBindTexture(GL_TEXTURE_2D, 0);
+
+	// The buffer is only freed once the copies out of it are done.
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &unpackBuffer);
+	return texture;
+}
+
+void loadCompressedTextureAsync(AssetLoader& loader, const std::string& file, GLuint& texture, std::function<void()> then)
+{
+	// The image is only read if the cache is out of date, so the job has no files of its own and the preparation reads them.
+	std::shared_ptr<CompressedImage> image = std::make_shared<CompressedImage>();
+	loader.load({}, [image, file, &texture, then](const LoadedFiles& loaded)
+	{
+		if (loaded.read)
+		{
+			texture = uploadCompressedImage(*image);
+			if (texture != 0)
+			{
+				LOG_INFO("Loaded {} ({} x {}, {} KB on the GPU).", file, image->width, image->height, image->data.size() / 1024);
+			}
+		}
+		if (then)
+		{
+			then();
+		}
+	},
+	[image, file](LoadedFiles& loaded)
+	{
+		if (readCompressedCache(file, *image))
+		{
+			return;
+		}
+		MappedFile source;
+		if (!source.open(file.c_str()) || !decodeImage(file, source.view(), *image))
+		{
+			LOG_ERROR("Can't load the image {}.", file);
+			loaded.read = false;
+			return;
+		}
+		if (!writeCompressedCache(file, *image))
+		{
+			LOG_WARNING("Can't write the cache of the image {}, it will be compressed again next time.", compressedCacheFile(file));
+		}
+	});
+}
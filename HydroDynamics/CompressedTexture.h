@@ -0,0 +1,88 @@
+/*
+Title: HydroDynamics
+File Name: CompressedTexture.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Loads images (the background diagram, labels, anything FreeImage can read) as block
+compressed textures with all of their mipmaps, which take a quarter (with alpha) or an eighth
+(without) of the memory plain RGBA8 takes, on the GPU and in the cache alike.
+
+Everything up to the upload happens on the loader thread of an AssetLoader: the image is
+decoded with FreeImage, its mipmaps are made by averaging 2 x 2 pixels down to 1 x 1, and every
+level is compressed to BC1 if the image is opaque, or to BC3 if it has alpha. The result is
+cached next to the image as IMAGE.bcn, which later runs read instead, as long as it is newer
+than the image. The thread that owns the context then only copies the blocks into a pixel
+unpack buffer and points glCompressedTexImage2D at it, so the driver takes them from there
+on its own time instead of the call waiting for the transfer.
+
+The compressor is the quick one: the end points of a block are the corners of the box around
+its colors, pulled in a little, and every pixel takes the nearest of the colors between them.
+That is plenty for diagrams and labels; photographic images would want a better one.
+*/
+
+#ifndef _COMPRESSED_TEXTURE_H
+#define _COMPRESSED_TEXTURE_H
+
+#include "GLIncludes.h"
+#include "AssetLoader.h"
+#include <string_view>
+
+// A block compressed image with its mipmaps, as it is cached and sent to the GPU. The levels follow each other in data, from the
+// full size down to 1 x 1.
+struct CompressedImage
+{
+	GLenum format = 0;		// GL_COMPRESSED_RGB_S3TC_DXT1_EXT (BC1) or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT (BC3)
+	int width = 0;
+	int height = 0;
+	std::vector<size_t> levelOffset;
+	std::vector<unsigned char> data;
+
+	int levels() const { return (int)levelOffset.size(); }
+	int levelWidth(int level) const { return std::max(width >> level, 1); }
+	int levelHeight(int level) const { return std::max(height >> level, 1); }
+	size_t levelSize(int level) const { return (level + 1 < levels() ? levelOffset[level + 1] : data.size()) - levelOffset[level]; }
+};
+
+// Compresses an image of width x height pixels, 4 bytes each in the order FreeImage keeps them (BGRA on little endian machines),
+// with the bottom row first like OpenGL, and makes its mipmaps.
+void compressImage(const unsigned char* pixels, int width, int height, CompressedImage& image);
+
+// Decodes the image file contents with FreeImage and compresses it. Returns false (and logs why) if it can't be decoded.
+bool decodeImage(const std::string& file, std::string_view contents, CompressedImage& image);
+
+// The cache of an image, IMAGE.bcn next to it. read returns false if there is none, it is older than the image, or it has a layout
+// this build doesn't know.
+std::string compressedCacheFile(const std::string& file);
+bool readCompressedCache(const std::string& file, CompressedImage& image);
+bool writeCompressedCache(const std::string& file, const CompressedImage& image);
+
+// Creates a texture from a compressed image through a pixel unpack buffer, with linear filtering between its mipmaps. Returns 0
+// (and logs why) if the driver has no S3TC.
+GLuint uploadCompressedImage(const CompressedImage& image);
+
+// Queues loading an image as a compressed texture: from the cache if it is up to date, otherwise decoded and compressed on the
+// loader thread and then cached. Once it is in, finishLoads() creates the texture, writes it to texture, and calls then. texture
+// stays 0 if the image can't be read, and has to outlive the load.
+void loadCompressedTextureAsync(AssetLoader& loader, const std::string& file, GLuint& texture, std::function<void()> then = nullptr);
+
+#endif // _COMPRESSED_TEXTURE_H
@@ -0,0 +1,441 @@
+/*
+Title: HydroDynamics
+File Name: EnsembleFilter.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Data assimilation for a digital twin (see SensorIngest.h): an ensemble Kalman filter that
+pulls the simulated heights and flows towards the heights the plant measures, so the twin
+follows the plant instead of drifting away from it wherever the model isn't quite right.
+
+The ensemble is MEMBERS copies of the scene, side by side in one network like the copies of a
+scenario run (see Scenario.h), so a step of all of them is one step of that network, shared
+out over the cores, and a copy at rest falls asleep. They start from the state of the twin,
+every height moved by a random amount of the spread, follow the external pressures of the
+twin (the piston and the plant's) before every step, and step along with it.
+
+A step that measured heights then gets an analysis. The state of every member is its heights
+and its flows, and the analysis is the stochastic filter with perturbed measurements, worked
+out in the space of the ensemble: with A the deviations of the members from their mean, HA
+those at the measured vessels, D the measurements (each with noise of its own per member)
+less what every member has there, and r the noise of a measurement,
+
+	X += A W,	W = HA' (HA HA' / (N - 1) + r^2)^-1 D / (N - 1)
+
+and by the Woodbury identity the inverse never has to be of more than N x N, however many
+vessels were measured. HA' HA and HA' D are summed up over the measurements on the cores, W
+takes a Cholesky factorization of N x N, and the update of X is one matrix product over
+every height and flow of every member, in blocks of FILTER_BLOCK rows: the deviations of a
+block are worked out once into a buffer that stays in the cache, and every member adds its
+combination of them with loops the compiler vectorizes. Afterwards every height gets a
+random step of the spread, so the members don't all collapse onto the same state (which would
+leave nothing to correct), and the twin takes the mean of the members.
+
+The random numbers come from a hash of the analysis, the row and the member, so a run has the
+same result however the work was shared out. Each is the sum of four uniform ones, which is
+close enough to normal for noise and far cheaper than Box-Muller. There is no localization:
+the few members of a large network correlate distant vessels by chance, which the analysis
+takes at face value.
+
+This file has no OpenGL dependency.
+*/
+
+#include "EnsembleFilter.h"
+#include "ResultCache.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// The rows of the perturbations of the measurements, apart from those of the state.
+#define FILTER_MEASUREMENT_ROWS (1ULL << 62)
+
+// The chunks of measurements every thread of the pool sums up.
+#define FILTER_CHUNKS_PER_THREAD 4
+
+static uint64_t mix(uint64_t x)
+{
+	// The finalizer of splitmix64.
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+// Runs body over count items, on the pool if there is one.
+static void forRange(TaskPool* pool, int count, int blockSize, const std::function<void(int begin, int end)>& body)
+{
+	if (pool != nullptr)
+	{
+		pool->parallelFor(count, blockSize, body);
+	}
+	else
+	{
+		body(0, count);
+	}
+}
+
+bool EnsembleFilter::build(const VesselNetwork& scene, int memberCount, float measurementNoise, float modelSpread)
+{
+	if (!plainForCache(scene))
+	{
+		std::cout << "The ensemble filter only runs on a scene with one fluid, rectangular vessels and no tube components." << std::endl;
+		return false;
+	}
+	if (memberCount < 2 || memberCount > FILTER_MAX_MEMBERS)
+	{
+		std::cout << "The ensemble filter needs 2 to " << FILTER_MAX_MEMBERS << " members." << std::endl;
+		return false;
+	}
+
+	count = memberCount;
+	vesselCount = scene.vesselCount();
+	tubeCount = scene.tubeCount();
+	noise = measurementNoise;
+	spread = modelSpread;
+	analysisCount = 0;
+
+	// The copies never touch each other, so where they are side by side doesn't matter; they all keep the places of the scene.
+	members.clear();
+	members.integrator = scene.integrator;
+	members.solver.preconditioner = scene.solver.preconditioner;
+	members.precision = scene.precision;
+	for (int m = 0; m < count; m++)
+	{
+		int first = members.vesselCount();
+		for (int i = 0; i < vesselCount; i++)
+		{
+			float perturbed = std::max(0.0f, scene.height[i] + spread * gaussian((uint64_t)i, m));
+			members.addVessel(scene.left[i], scene.bottom[i], scene.width[i], perturbed);
+		}
+		for (int t = 0; t < tubeCount; t++)
+		{
+			int tube = members.addTube(first + scene.tubeA[t], first + scene.tubeB[t], 1.0f / scene.tubeInvInertance[t], scene.tubeDamping[t]);
+			members.tubeFlow[tube] = scene.tubeFlow[t];
+		}
+	}
+	members.rebuildTopology();
+	for (int m = 0; m < count; m++)
+	{
+		for (int i = 0; i < vesselCount; i++)
+		{
+			members.setExternalPressure(m * vesselCount + i, scene.externalPressure[i]);
+		}
+	}
+
+	measuredVessel.clear();
+	measuredHeight.clear();
+	measurementOf.assign(vesselCount, -1);
+	weights.assign((size_t)count * count, 0.0f);
+	lastSpread = 0.0;
+	lastInnovation = 0.0;
+	std::cout << "Assimilating the measured heights into " << count << " members of " << vesselCount << " vessels." << std::endl;
+	return true;
+}
+
+void EnsembleFilter::observe(int vessel, float measured)
+{
+	if (vessel < 0 || vessel >= vesselCount)
+	{
+		return;
+	}
+	if (measurementOf[vessel] < 0)
+	{
+		measurementOf[vessel] = (int)measuredVessel.size();
+		measuredVessel.push_back(vessel);
+		measuredHeight.push_back(measured);
+	}
+	else
+	{
+		measuredHeight[measurementOf[vessel]] = measured;
+	}
+}
+
+bool EnsembleFilter::step(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool)
+{
+	if (count == 0)
+	{
+		return false;
+	}
+	for (int m = 0; m < count; m++)
+	{
+		for (int i = 0; i < vesselCount; i++)
+		{
+			if (members.externalPressure[m * vesselCount + i] != network.externalPressure[i])
+			{
+				members.setExternalPressure(m * vesselCount + i, network.externalPressure[i]);
+			}
+		}
+	}
+	members.update(density, gravity, dt, pool);
+	if (measuredVessel.empty())
+	{
+		return false;
+	}
+
+	analyze(network, density, gravity, pool);
+	for (int vessel : measuredVessel)
+	{
+		measurementOf[vessel] = -1;
+	}
+	measuredVessel.clear();
+	measuredHeight.clear();
+	return true;
+}
+
+void EnsembleFilter::analyze(VesselNetwork& network, float density, float gravity, TaskPool* pool)
+{
+	analysisCount++;
+	int measurements = (int)measuredVessel.size();
+	int chunks = pool != nullptr ? std::min(measurements, pool->threadCount() * FILTER_CHUNKS_PER_THREAD) : 1;
+	size_t matrix = (size_t)count * count;
+	size_t chunkSize = 2 * matrix + 2;
+
+	// G = HA' HA and E = HA' D, every chunk of measurements on its own and then added up.
+	partials.assign(chunks * chunkSize, 0.0);
+	forRange(pool, chunks, 1, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			sumMeasurements((int)((long long)c * measurements / chunks), (int)((long long)(c + 1) * measurements / chunks), &partials[c * chunkSize]);
+		}
+	});
+	std::vector<double> g(matrix, 0.0);
+	std::vector<double> e(matrix, 0.0);
+	double squaredSpread = 0.0;
+	double squaredInnovation = 0.0;
+	for (int c = 0; c < chunks; c++)
+	{
+		const double* sums = &partials[c * chunkSize];
+		for (size_t k = 0; k < matrix; k++)
+		{
+			g[k] += sums[k];
+			e[k] += sums[matrix + k];
+		}
+		squaredSpread += sums[2 * matrix];
+		squaredInnovation += sums[2 * matrix + 1];
+	}
+	double scale = count - 1.0;
+	lastSpread = std::sqrt(squaredSpread / (measurements * scale));
+	lastInnovation = std::sqrt(squaredInnovation / measurements);
+
+	// K = (N - 1) I + G / r^2 is symmetric positive definite, so its Cholesky factor L (L L' = K) always exists.
+	double r2 = std::max((double)noise * noise, 1e-12);
+	std::vector<double> l(matrix, 0.0);
+	for (int j = 0; j < count; j++)
+	{
+		for (int i = j; i < count; i++)
+		{
+			double sum = g[i * count + j] / r2 + (i == j ? scale : 0.0);
+			for (int k = 0; k < j; k++)
+			{
+				sum -= l[i * count + k] * l[j * count + k];
+			}
+			l[i * count + j] = i == j ? std::sqrt(sum) : sum / l[j * count + j];
+		}
+	}
+
+	// Y = K^-1 E, column by column, and then W = (E / r^2 - G Y / r^4) / (N - 1).
+	std::vector<double> y(e);
+	for (int column = 0; column < count; column++)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			double sum = y[i * count + column];
+			for (int k = 0; k < i; k++)
+			{
+				sum -= l[i * count + k] * y[k * count + column];
+			}
+			y[i * count + column] = sum / l[i * count + i];
+		}
+		for (int i = count - 1; i >= 0; i--)
+		{
+			double sum = y[i * count + column];
+			for (int k = i + 1; k < count; k++)
+			{
+				sum -= l[k * count + i] * y[k * count + column];
+			}
+			y[i * count + column] = sum / l[i * count + i];
+		}
+	}
+	for (int k = 0; k < count; k++)
+	{
+		for (int j = 0; j < count; j++)
+		{
+			double gy = 0.0;
+			for (int i = 0; i < count; i++)
+			{
+				gy += g[k * count + i] * y[i * count + j];
+			}
+			weights[k * count + j] = (float)((e[k * count + j] / r2 - gy / (r2 * r2)) / scale);
+		}
+	}
+
+	// X += A W over every height and then every flow, and the mean of the members into the twin.
+	int rows = vesselCount + tubeCount;
+	forRange(pool, (rows + FILTER_BLOCK - 1) / FILTER_BLOCK, 1, [&](int begin, int end)
+	{
+		for (int block = begin; block < end; block++)
+		{
+			int first = block * FILTER_BLOCK;
+			int last = std::min(first + FILTER_BLOCK, rows);
+			if (first < vesselCount)
+			{
+				int heights = std::min(last, vesselCount);
+				updateRows(members.height.data(), network.height.data(), vesselCount, first, heights - first, true);
+				first = heights;
+			}
+			if (first < last)
+			{
+				updateRows(members.tubeFlow.data(), network.tubeFlow.data(), tubeCount, first - vesselCount, last - first, false);
+			}
+		}
+	});
+
+	for (int i = 0; i < members.vesselCount(); i++)
+	{
+		members.top[i] = members.bottom[i] + members.height[i];
+	}
+	for (int i = 0; i < vesselCount; i++)
+	{
+		network.top[i] = network.bottom[i] + network.height[i];
+	}
+	members.computePressures(density, gravity);
+	members.wakeAll();
+	network.computePressures(density, gravity);
+	network.wakeAll();
+}
+
+void EnsembleFilter::sumMeasurements(int begin, int end, double* sums) const
+{
+	size_t matrix = (size_t)count * count;
+	double deviation[FILTER_MAX_MEMBERS];
+	double difference[FILTER_MAX_MEMBERS];
+	for (int o = begin; o < end; o++)
+	{
+		int vessel = measuredVessel[o];
+		double mean = 0.0;
+		for (int m = 0; m < count; m++)
+		{
+			mean += members.height[m * vesselCount + vessel];
+		}
+		mean /= count;
+		for (int m = 0; m < count; m++)
+		{
+			double simulated = members.height[m * vesselCount + vessel];
+			deviation[m] = simulated - mean;
+			difference[m] = measuredHeight[o] + noise * gaussian(FILTER_MEASUREMENT_ROWS + o, m) - simulated;
+			sums[2 * matrix] += deviation[m] * deviation[m];
+		}
+		sums[2 * matrix + 1] += (measuredHeight[o] - mean) * (measuredHeight[o] - mean);
+
+		for (int k = 0; k < count; k++)
+		{
+			double* g = sums + k * count;
+			double* e = sums + matrix + k * count;
+			for (int j = 0; j < count; j++)
+			{
+				g[j] += deviation[k] * deviation[j];
+				e[j] += deviation[k] * difference[j];
+			}
+		}
+	}
+}
+
+void EnsembleFilter::updateRows(float* state, float* target, int stride, int first, int rows, bool heights)
+{
+	// The deviations of the block from its mean, before any member changes.
+	float mean[FILTER_BLOCK];
+	float deviations[FILTER_MAX_MEMBERS * FILTER_BLOCK];
+	for (int r = 0; r < rows; r++)
+	{
+		mean[r] = 0.0f;
+	}
+	for (int m = 0; m < count; m++)
+	{
+		const float* x = state + (size_t)m * stride + first;
+		for (int r = 0; r < rows; r++)
+		{
+			mean[r] += x[r];
+		}
+	}
+	for (int r = 0; r < rows; r++)
+	{
+		mean[r] /= count;
+	}
+	for (int m = 0; m < count; m++)
+	{
+		const float* x = state + (size_t)m * stride + first;
+		float* a = deviations + m * FILTER_BLOCK;
+		for (int r = 0; r < rows; r++)
+		{
+			a[r] = x[r] - mean[r];
+		}
+	}
+
+	for (int j = 0; j < count; j++)
+	{
+		float* x = state + (size_t)j * stride + first;
+		for (int k = 0; k < count; k++)
+		{
+			float w = weights[k * count + j];
+			const float* a = deviations + k * FILTER_BLOCK;
+			for (int r = 0; r < rows; r++)
+			{
+				x[r] += w * a[r];
+			}
+		}
+		if (heights)
+		{
+			for (int r = 0; r < rows; r++)
+			{
+				x[r] = std::max(0.0f, x[r] + spread * gaussian((uint64_t)(first + r), j));
+			}
+		}
+	}
+
+	for (int r = 0; r < rows; r++)
+	{
+		mean[r] = 0.0f;
+	}
+	for (int m = 0; m < count; m++)
+	{
+		const float* x = state + (size_t)m * stride + first;
+		for (int r = 0; r < rows; r++)
+		{
+			mean[r] += x[r];
+		}
+	}
+	for (int r = 0; r < rows; r++)
+	{
+		target[first + r] = mean[r] / count;
+	}
+}
+
+float EnsembleFilter::gaussian(uint64_t row, int member) const
+{
+	// Close enough to normal for noise, and far cheaper than Box-Muller: the sum of the four uniform numbers in the 16 bit quarters of
+	// a hash of where the number is used, moved to a mean of 0 and scaled to a variance of 1 (that of the sum being 4 / 12).
+	uint64_t key = mix(FILTER_SEED ^ mix(analysisCount) ^ (row * FILTER_MAX_MEMBERS + (uint64_t)member));
+	uint32_t sum = (uint32_t)(key & 0xFFFF) + (uint32_t)((key >> 16) & 0xFFFF) + (uint32_t)((key >> 32) & 0xFFFF) + (uint32_t)(key >> 48);
+	return ((float)sum * (1.0f / 65536.0f) - 2.0f) * 1.7320508f;
+}
@@ -0,0 +1,125 @@
+/*
+Title: HydroDynamics
+File Name: EnsembleFilter.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Data assimilation for a digital twin (see SensorIngest.h): an ensemble Kalman filter that
+pulls the simulated heights and flows towards the heights the plant measures, so the twin
+follows the plant instead of drifting away from it wherever the model isn't quite right.
+
+The ensemble is MEMBERS copies of the scene, side by side in one network like the copies of a
+scenario run (see Scenario.h), so a step of all of them is one step of that network, shared
+out over the cores, and a copy at rest falls asleep. They start from the state of the twin,
+every height moved by a random amount of the spread, follow the external pressures of the
+twin (the piston and the plant's) before every step, and step along with it.
+
+A step that measured heights then gets an analysis. The state of every member is its heights
+and its flows, and the analysis is the stochastic filter with perturbed measurements, worked
+out in the space of the ensemble: with A the deviations of the members from their mean, HA
+those at the measured vessels, D the measurements (each with noise of its own per member)
+less what every member has there, and r the noise of a measurement,
+
+	X += A W,	W = HA' (HA HA' / (N - 1) + r^2)^-1 D / (N - 1)
+
+and by the Woodbury identity the inverse never has to be of more than N x N, however many
+vessels were measured. HA' HA and HA' D are summed up over the measurements on the cores, W
+takes a Cholesky factorization of N x N, and the update of X is one matrix product over
+every height and flow of every member, in blocks of FILTER_BLOCK rows: the deviations of a
+block are worked out once into a buffer that stays in the cache, and every member adds its
+combination of them with loops the compiler vectorizes. Afterwards every height gets a
+random step of the spread, so the members don't all collapse onto the same state (which would
+leave nothing to correct), and the twin takes the mean of the members.
+
+The random numbers come from a hash of the analysis, the row and the member, so a run has the
+same result however the work was shared out. Each is the sum of four uniform ones, which is
+close enough to normal for noise and far cheaper than Box-Muller. There is no localization:
+the few members of a large network correlate distant vessels by chance, which the analysis
+takes at face value.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _ENSEMBLE_FILTER_H
+#define _ENSEMBLE_FILTER_H
+
+#include "VesselNetwork.h"
+#include <cstdint>
+#include <vector>
+
+class TaskPool;
+
+#define FILTER_MAX_MEMBERS 64
+#define FILTER_BLOCK 256				// Rows of the state a task of the update takes at once
+#define FILTER_SEED 0x5DEECE66DULL
+
+// How far off a measured height and the state of the model may be, in meters, unless the command line says otherwise.
+#define FILTER_DEFAULT_NOISE 0.005f
+#define FILTER_DEFAULT_SPREAD 0.005f
+
+class EnsembleFilter
+{
+public:
+	// Builds members copies of the state of scene, which has to be a plain network (see plainForCache()), noise being how far
+	// off a measurement may be and spread how far off the model. Returns false (after printing why) if it can't.
+	bool build(const VesselNetwork& scene, int members, float noise, float spread);
+
+	int memberCount() const { return count; }
+
+	// Takes a height the plant measured in vessel, for the analysis after the next step. A later one replaces an earlier one.
+	void observe(int vessel, float measured);
+
+	// Steps every member along with network, which has just taken its step, and if heights were measured, corrects the members and
+	// then network with them. Returns true if it changed network.
+	bool step(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool);
+
+	// From the last analysis: how far the members were spread at the measured vessels, and how far their mean was from the
+	// measurements (both the root of the mean square, in meters).
+	double priorSpread() const { return lastSpread; }
+	double innovation() const { return lastInnovation; }
+
+private:
+	void analyze(VesselNetwork& network, float density, float gravity, TaskPool* pool);
+	void sumMeasurements(int begin, int end, double* sums) const;
+	void updateRows(float* state, float* target, int stride, int first, int rows, bool heights);
+	float gaussian(uint64_t row, int member) const;
+
+	VesselNetwork members;
+	int count = 0;
+	int vesselCount = 0;
+	int tubeCount = 0;
+	float noise = FILTER_DEFAULT_NOISE;
+	float spread = FILTER_DEFAULT_SPREAD;
+	uint64_t analysisCount = 0;
+
+	std::vector<int> measuredVessel;
+	std::vector<float> measuredHeight;
+	std::vector<int> measurementOf;		// Per vessel, its index in measuredVessel, or -1
+
+	std::vector<double> partials;		// Per chunk of measurements, its share of HA' HA and of HA' D
+	std::vector<float> weights;			// W, N x N, by member of the deviation and then by member updated
+
+	double lastSpread = 0.0;
+	double lastInnovation = 0.0;
+};
+
+#endif // _ENSEMBLE_FILTER_H
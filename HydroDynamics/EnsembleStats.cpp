@@ -0,0 +1,240 @@
+/*
+Title: HydroDynamics
+File Name: EnsembleStats.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Statistics over the members of an ensemble (the variants of a sweep), worked out while they
+run, so a study of how thousands of variants spread over time doesn't have to write out the
+trajectory of every one of them and average them afterwards.
+
+Every quantity, at every time it is sampled, goes through a StreamStats: Welford's running
+mean and variance, which stay accurate even when the spread is tiny next to the mean, the
+lowest and highest value, and a t-digest for the quantiles. The t-digest (Dunning's merging
+variant) keeps the values as a sorted list of weighted centroids and merges neighbours as
+long as the k1 scale function allows, which keeps the centroids small near the tails, where
+quantiles need them to be precise, and large in the middle. With the default compression of
+100 it holds at most a few hundred centroids however many values went in, and its quantiles
+are off by far less than a percent of rank.
+
+An EnsembleStats writes one row of comma separated values per sampled time and quantity, as
+soon as the sample is complete, so it takes the same little memory whatever the length of
+the run: the time, the name of the quantity, how many members there were, their mean and
+standard deviation, the lowest and highest, and the 5th, 50th and 95th percentiles.
+
+This file has no OpenGL dependency.
+*/
+
+#include "EnsembleStats.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#define PI 3.14159265358979323846
+
+// The k1 scale function of the t-digest and its inverse: a centroid may only span one unit of k, and k changes fastest near q = 0
+// and q = 1.
+static double scaleOf(double q, double compression)
+{
+	return compression / (2.0 * PI) * asin(2.0 * q - 1.0);
+}
+
+static double quantileOf(double k, double compression)
+{
+	return k >= compression / 4.0 ? 1.0 : (sin(k * 2.0 * PI / compression) + 1.0) / 2.0;
+}
+
+void QuantileDigest::add(double value)
+{
+	if (total == 0.0 && buffer.empty())
+	{
+		lowest = value;
+		highest = value;
+	}
+	lowest = std::min(lowest, value);
+	highest = std::max(highest, value);
+	buffer.push_back({ value, 1.0 });
+	if (buffer.size() >= (size_t)(compression * DIGEST_BUFFER_FACTOR))
+	{
+		merge();
+	}
+}
+
+void QuantileDigest::merge()
+{
+	if (buffer.empty())
+	{
+		return;
+	}
+	for (const Centroid& c : buffer)
+	{
+		total += c.weight;
+	}
+	scratch.clear();
+	scratch.insert(scratch.end(), centroids.begin(), centroids.end());
+	scratch.insert(scratch.end(), buffer.begin(), buffer.end());
+	buffer.clear();
+	std::sort(scratch.begin(), scratch.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+	// Walk through the sorted centroids, and add every one to the last of the merged ones as long as that doesn't grow past one
+	// unit of k.
+	centroids.clear();
+	Centroid current = scratch[0];
+	double before = 0.0;
+	double limit = quantileOf(scaleOf(0.0, compression) + 1.0, compression) * total;
+	for (size_t i = 1; i < scratch.size(); i++)
+	{
+		const Centroid& next = scratch[i];
+		if (before + current.weight + next.weight <= limit)
+		{
+			current.mean += (next.mean - current.mean) * next.weight / (current.weight + next.weight);
+			current.weight += next.weight;
+			continue;
+		}
+		centroids.push_back(current);
+		before += current.weight;
+		limit = quantileOf(scaleOf(before / total, compression) + 1.0, compression) * total;
+		current = next;
+	}
+	centroids.push_back(current);
+}
+
+double QuantileDigest::quantile(double q)
+{
+	merge();
+	if (centroids.empty())
+	{
+		return 0.0;
+	}
+	if (q <= 0.0)
+	{
+		return lowest;
+	}
+	if (q >= 1.0)
+	{
+		return highest;
+	}
+
+	// Every centroid sits at the middle of the weight it covers. Between those middles (and from the extremes to the first and last
+	// of them) the value is interpolated linearly.
+	double target = q * total;
+	double previousHere = 0.0;
+	double previousValue = lowest;
+	double before = 0.0;
+	for (const Centroid& c : centroids)
+	{
+		double here = before + c.weight / 2.0;
+		if (target < here)
+		{
+			double f = here > previousHere ? (target - previousHere) / (here - previousHere) : 0.0;
+			return previousValue + f * (c.mean - previousValue);
+		}
+		previousHere = here;
+		previousValue = c.mean;
+		before += c.weight;
+	}
+	double f = total > previousHere ? (target - previousHere) / (total - previousHere) : 1.0;
+	return previousValue + f * (highest - previousValue);
+}
+
+void QuantileDigest::clear()
+{
+	centroids.clear();
+	buffer.clear();
+	total = 0.0;
+}
+
+size_t QuantileDigest::centroidCount()
+{
+	merge();
+	return centroids.size();
+}
+
+void StreamStats::add(double value)
+{
+	n++;
+	if (n == 1)
+	{
+		low = value;
+		high = value;
+	}
+	low = std::min(low, value);
+	high = std::max(high, value);
+
+	// Welford: the mean moves by a share of the difference, and the squares grow by the difference to the old mean times the one to
+	// the new mean.
+	double difference = value - average;
+	average += difference / n;
+	squares += difference * (value - average);
+	digest.add(value);
+}
+
+void StreamStats::clear()
+{
+	n = 0;
+	average = 0.0;
+	squares = 0.0;
+	digest.clear();
+}
+
+bool EnsembleStats::open(const std::string& name, const std::vector<std::string>& quantities)
+{
+	fileName = name;
+	file.open(fileName, std::ios::out);
+	if (!file.good())
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		return false;
+	}
+	names = quantities;
+	stats.assign(quantities.size(), StreamStats());
+	file.precision(9);
+	file << "time,quantity,count,mean,standard deviation,lowest,highest,p5,p50,p95" << std::endl;
+	return true;
+}
+
+void EnsembleStats::finishSample(const std::string& time)
+{
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		StreamStats& s = stats[i];
+		if (s.count() == 0)
+		{
+			continue;
+		}
+		file << time << "," << names[i] << "," << s.count() << "," << s.mean() << "," << sqrt(s.variance()) << "," << s.lowest() << ","
+			<< s.highest() << "," << s.quantile(0.05) << "," << s.quantile(0.5) << "," << s.quantile(0.95) << "\n";
+		s.clear();
+	}
+}
+
+bool EnsembleStats::close()
+{
+	file.flush();
+	bool good = file.good();
+	file.close();
+	if (!good)
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+	}
+	return good;
+}
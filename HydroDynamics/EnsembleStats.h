@@ -0,0 +1,145 @@
+/*
+Title: HydroDynamics
+File Name: EnsembleStats.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Statistics over the members of an ensemble (the variants of a sweep), worked out while they
+run, so a study of how thousands of variants spread over time doesn't have to write out the
+trajectory of every one of them and average them afterwards.
+
+Every quantity, at every time it is sampled, goes through a StreamStats: Welford's running
+mean and variance, which stay accurate even when the spread is tiny next to the mean, the
+lowest and highest value, and a t-digest for the quantiles. The t-digest (Dunning's merging
+variant) keeps the values as a sorted list of weighted centroids and merges neighbours as
+long as the k1 scale function allows, which keeps the centroids small near the tails, where
+quantiles need them to be precise, and large in the middle. With the default compression of
+100 it holds at most a few hundred centroids however many values went in, and its quantiles
+are off by far less than a percent of rank.
+
+An EnsembleStats writes one row of comma separated values per sampled time and quantity, as
+soon as the sample is complete, so it takes the same little memory whatever the length of
+the run: the time, the name of the quantity, how many members there were, their mean and
+standard deviation, the lowest and highest, and the 5th, 50th and 95th percentiles.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _ENSEMBLE_STATS_H
+#define _ENSEMBLE_STATS_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// How many centroids a digest keeps, roughly: twice this at most, and usually fewer.
+#define DIGEST_COMPRESSION 100.0
+
+// Values are collected until there are this many times the compression of them, and then merged into the centroids at once.
+#define DIGEST_BUFFER_FACTOR 8
+
+class QuantileDigest
+{
+public:
+	explicit QuantileDigest(double compression = DIGEST_COMPRESSION) : compression(compression) {}
+
+	void add(double value);
+
+	// The value below which a fraction q of the values lie, from 0 (the lowest) to 1 (the highest). 0 if nothing was added yet.
+	double quantile(double q);
+
+	void clear();
+
+	// How many centroids the values take up now.
+	size_t centroidCount();
+
+private:
+	struct Centroid
+	{
+		double mean;
+		double weight;
+	};
+
+	// Merges the buffer into the centroids.
+	void merge();
+
+	double compression;
+	std::vector<Centroid> centroids;
+	std::vector<Centroid> buffer;
+	std::vector<Centroid> scratch;
+	double total = 0.0;
+	double lowest = 0.0;
+	double highest = 0.0;
+};
+
+class StreamStats
+{
+public:
+	void add(double value);
+	void clear();
+
+	long long count() const { return n; }
+	double mean() const { return average; }
+	double variance() const { return n > 1 ? squares / (n - 1) : 0.0; }
+	double lowest() const { return low; }
+	double highest() const { return high; }
+	double quantile(double q) { return digest.quantile(q); }
+
+private:
+	long long n = 0;
+	double average = 0.0;
+	double squares = 0.0;		// The sum of the squared differences from the mean
+	double low = 0.0;
+	double high = 0.0;
+	QuantileDigest digest;
+};
+
+class EnsembleStats
+{
+public:
+	// Sample every this many steps (and at the start and the end). Set before the run.
+	long long every = 120;
+
+	// Opens the file and writes its header, with one StreamStats for each of quantities. Returns false (after printing an error) if
+	// the file can't be written.
+	bool open(const std::string& fileName, const std::vector<std::string>& quantities);
+
+	bool isOpen() const { return file.is_open(); }
+
+	// Adds the value of quantity of one member to the sample that is being collected.
+	void add(int quantity, double value) { stats[quantity].add(value); }
+
+	// Writes the rows of every quantity that got values, labelled with time, and starts the next sample. time is a string so the
+	// sample that closes a run can be told apart from the ones at fixed times.
+	void finishSample(const std::string& time);
+
+	// Closes the file. Returns false if anything couldn't be written.
+	bool close();
+
+private:
+	std::ofstream file;
+	std::string fileName;
+	std::vector<std::string> names;
+	std::vector<StreamStats> stats;
+};
+
+#endif // _ENSEMBLE_STATS_H
@@ -0,0 +1,135 @@
+/*
+Title: HydroDynamics
+File Name: FileWatcher.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Watches a group of files for changes on a background thread. The thread checks the
+modification times and sizes a few times per second. When one of them changes, it waits
+until the file has stopped changing (editors often write a file in several steps), reads
+the whole group and hands the new contents over. The render thread picks them up with
+takeChanges(), which never blocks on the disk.
+
+This is what shader hot reloading is built on, but nothing in here knows about OpenGL.
+*/
+
+#include "FileWatcher.h"
+#include "MappedFile.h"
+#include "ThreadControl.h"
+#include <chrono>
+#include <sys/stat.h>
+
+// A stamp made of the modification time and the size of a file, or -1 if it doesn't exist (for example while an editor replaces it).
+// The time only counts whole seconds on some systems, so the size catches a second save within the same second.
+static long long fileStamp(const std::string& fileName)
+{
+	struct stat info;
+	if (stat(fileName.c_str(), &info) != 0)
+	{
+		return -1;
+	}
+	return (long long)info.st_mtime * 1000003LL + (long long)info.st_size;
+}
+
+FileWatcher::FileWatcher(const std::vector<std::string>& files, int intervalMs)
+	: files(files), intervalMs(intervalMs)
+{
+	thread = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+bool FileWatcher::takeChanges(std::vector<std::string>& contents)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!hasPending)
+	{
+		return false;
+	}
+	contents = std::move(pending);
+	pending.clear();
+	hasPending = false;
+	return true;
+}
+
+void FileWatcher::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::vector<long long> seen(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		seen[i] = fileStamp(files[i]);
+	}
+
+	// Set when a change was seen; the files are only read on the next check that finds nothing new, so we never read half a save.
+	bool changed = false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping)
+	{
+		wake.wait_for(lock, std::chrono::milliseconds(intervalMs));
+		if (stopping)
+		{
+			break;
+		}
+
+		// Touching the disk doesn't need the lock, so takeChanges() is never held up by it.
+		lock.unlock();
+
+		bool changedNow = false;
+		bool allExist = true;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			long long stamp = fileStamp(files[i]);
+			changedNow |= stamp != seen[i];
+			allExist &= stamp >= 0;
+			seen[i] = stamp;
+		}
+
+		std::vector<std::string> contents;
+		bool ready = changed && !changedNow && allExist;
+		if (ready)
+		{
+			MappedFile file;
+			for (size_t i = 0; i < files.size() && ready; i++)
+			{
+				ready = file.open(files[i].c_str());
+				contents.push_back(std::string(file.view()));
+			}
+		}
+		changed = (changed || changedNow) && !ready;
+
+		lock.lock();
+		if (ready)
+		{
+			pending = std::move(contents);
+			hasPending = true;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/*
+Title: HydroDynamics
+File Name: FileWatcher.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Watches a group of files for changes on a background thread. The thread checks the
+modification times and sizes a few times per second. When one of them changes, it waits
+until the file has stopped changing (editors often write a file in several steps), reads
+the whole group and hands the new contents over. The render thread picks them up with
+takeChanges(), which never blocks on the disk.
+
+This is what shader hot reloading is built on, but nothing in here knows about OpenGL.
+*/
+
+#ifndef _FILE_WATCHER_H
+#define _FILE_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class FileWatcher
+{
+public:
+	// Starts watching the files, checking them every intervalMs milliseconds.
+	FileWatcher(const std::vector<std::string>& files, int intervalMs = 250);
+
+	// Stops the thread. Waits at most for the check that is currently running.
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// If any of the files changed since the last call, moves the contents of all of them into contents (in the order they were
+	// given to the constructor) and returns true. Otherwise returns false and leaves contents alone.
+	bool takeChanges(std::vector<std::string>& contents);
+
+private:
+	void run();
+
+	std::vector<std::string> files;
+	int intervalMs;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	// Filled in by the watcher thread, emptied by takeChanges(). Both are protected by mutex.
+	std::vector<std::string> pending;
+	bool hasPending = false;
+};
+
+#endif // _FILE_WATCHER_H
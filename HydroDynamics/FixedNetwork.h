@@ -0,0 +1,212 @@
+/*
+Title: HydroDynamics
+File Name: FixedNetwork.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A vessel network whose size and connections are known when the program is compiled.
+
+The topology is a type with the number of vessels and tubes and the two ends of every tube
+as constants, and density and gravity come from a second type, so all of them are
+template parameters of FixedNetwork. Every loop then has a fixed trip count, every vessel
+index is a constant and the number of tubes of every vessel is worked out by the compiler,
+so it can unroll the whole step and keep the state in registers. For small networks like
+the classic two-vessel apparatus this is much faster than the general VesselNetwork
+step, which has to walk index arrays.
+
+A step does exactly what VesselNetwork::update() does with PRECISION_SINGLE and
+INTEGRATOR_LOCAL, in the same order, so both give the same result to the last bit. The
+VesselNetwork stays the copy of the state everything else reads: update() takes the
+external pressures from it and writes the new heights and flows back into it.
+
+A topology looks like this:
+
+    struct Apparatus
+    {
+        static constexpr int vessels = 2;
+        static constexpr int tubes = 1;
+        static constexpr FixedTube tube[tubes] = { { 0, 1 } };
+    };
+
+and the physics like this:
+
+    struct Water
+    {
+        static constexpr float density = 1.0f;
+        static constexpr float gravity = 9.8f;
+    };
+*/
+
+#ifndef _FIXED_NETWORK_H
+#define _FIXED_NETWORK_H
+
+#include <cmath>
+#include "VesselNetwork.h"
+
+// The two vessels a tube connects. The flow goes from B to A.
+struct FixedTube
+{
+	int a;
+	int b;
+};
+
+template <typename Topology, typename Physics>
+class FixedNetwork
+{
+public:
+	static constexpr int VESSELS = Topology::vessels;
+	static constexpr int TUBES = Topology::tubes;
+	static constexpr float SCALE = Physics::gravity * Physics::density;
+
+	// Whether a network has exactly this topology, so this class can step it.
+	static bool matches(const VesselNetwork& network)
+	{
+		if (network.vesselCount() != VESSELS || network.tubeCount() != TUBES)
+		{
+			return false;
+		}
+		for (int t = 0; t < TUBES; t++)
+		{
+			if (network.tubeA[t] != Topology::tube[t].a || network.tubeB[t] != Topology::tube[t].b)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Takes over the state and the sizes of a network that matches(). Its topology has to be built (see VesselNetwork::rebuildTopology()).
+	void load(const VesselNetwork& network)
+	{
+		static_assert(valid(), "A tube of the topology connects a vessel that doesn't exist.");
+
+		// degree() only depends on the topology, so the compiler works it out for every vessel.
+		for (int i = 0; i < VESSELS; i++)
+		{
+			height[i] = network.height[i];
+			width[i] = network.width[i];
+			bottom[i] = network.bottom[i];
+			drainShare[i] = degree(i) > 0 ? width[i] / (float)degree(i) : 0.0f;
+		}
+		for (int t = 0; t < TUBES; t++)
+		{
+			invInertance[t] = network.tubeInvInertance[t];
+			damping[t] = network.tubeDamping[t];
+			stiffness[t] = 1.0f / width[Topology::tube[t].a] + 1.0f / width[Topology::tube[t].b];
+			flow[t] = network.tubeFlow[t];
+		}
+	}
+
+	// Advances the network by dt seconds and writes the new state into it. Returns false if nothing moved.
+	bool update(VesselNetwork& network, float dt)
+	{
+		float pressure[VESSELS];
+		for (int i = 0; i < VESSELS; i++)
+		{
+			network.pressure[i] = height[i] * SCALE;
+			pressure[i] = network.pressure[i] + network.externalPressure[i];
+		}
+
+		float dtSquaredScale = dt * dt * SCALE;
+		float restPressure = REST_HEIGHT * SCALE;
+		float delta[VESSELS] = {};
+		bool moved = false;
+		for (int t = 0; t < TUBES; t++)
+		{
+			const int a = Topology::tube[t].a;
+			const int b = Topology::tube[t].b;
+			float difference = pressure[b] - pressure[a];
+
+			float f = (flow[t] + dt * difference * invInertance[t]) / (1.0f + dt * damping[t] + dtSquaredScale * stiffness[t] * invInertance[t]);
+			if (std::fabs(f) < REST_FLOW && std::fabs(difference) < restPressure)
+			{
+				f = 0.0f;
+			}
+
+			float volume = f * dt;
+			float limitIntoA = height[b] * drainShare[b];
+			float limitIntoB = -(height[a] * drainShare[a]);
+			volume = volume < limitIntoA ? volume : limitIntoA;
+			volume = volume > limitIntoB ? volume : limitIntoB;
+
+			flow[t] = volume / dt;
+			network.tubeFlow[t] = flow[t];
+			network.tubeChange[t] = volume;
+
+			// Every vessel adds up its tubes in order, just like the gather of the general step.
+			delta[a] += volume;
+			delta[b] += -volume;
+			moved |= volume != 0.0f;
+		}
+
+		if (!moved)
+		{
+			return false;
+		}
+
+		for (int i = 0; i < VESSELS; i++)
+		{
+			float d = delta[i] / width[i];
+			height[i] += d;
+			network.delta[i] = d;
+			network.height[i] = height[i];
+			network.top[i] = bottom[i] + height[i];
+		}
+		return true;
+	}
+
+private:
+	// The number of tubes connected to a vessel.
+	static constexpr int degree(int vessel)
+	{
+		int count = 0;
+		for (int t = 0; t < TUBES; t++)
+		{
+			count += (Topology::tube[t].a == vessel ? 1 : 0) + (Topology::tube[t].b == vessel ? 1 : 0);
+		}
+		return count;
+	}
+
+	// Whether every tube connects two vessels that exist.
+	static constexpr bool valid()
+	{
+		for (int t = 0; t < TUBES; t++)
+		{
+			if (Topology::tube[t].a < 0 || Topology::tube[t].a >= VESSELS || Topology::tube[t].b < 0 || Topology::tube[t].b >= VESSELS)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	float height[VESSELS];
+	float width[VESSELS];
+	float bottom[VESSELS];
+	float drainShare[VESSELS];
+	float invInertance[TUBES];
+	float damping[TUBES];
+	float stiffness[TUBES];
+	float flow[TUBES];
+};
+
+#endif // _FIXED_NETWORK_H
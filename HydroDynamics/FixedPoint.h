@@ -0,0 +1,129 @@
+/*
+Title: HydroDynamics
+File Name: FixedPoint.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Q32.32 fixed point numbers for PRECISION_FIXED_POINT (see VesselNetwork.h): a 64 bit
+integer that counts 2^-32ths, so about 2.3e-10 apart, from -2^31 to 2^31.
+
+Float results depend on the machine and the compiler: x86 and ARM vectorize differently,
+some compilers fuse a multiply and an add into one rounding and others don't, and the order
+a sum is added up in changes its last bits. Integer addition and multiplication give the
+same bits everywhere, so a step worked out only with these functions is the same on every
+node, which is what lockstep sessions and distributed sweeps need. Products and quotients
+are truncated towards 0, on the magnitudes, so a negative value rounds exactly like the
+positive one.
+
+The product needs 128 bits in between. Where the compiler has a 128 bit integer that is
+used, everywhere else (MSVC) the halves are multiplied one by one. Both give the same bits.
+*/
+
+#ifndef _FIXED_POINT_H
+#define _FIXED_POINT_H
+
+#include <cmath>
+#include <cstdint>
+
+typedef int64_t Fixed;
+
+#define FIXED_FRACTION_BITS 32
+#define FIXED_ONE ((Fixed)1 << FIXED_FRACTION_BITS)
+#define FIXED_SCALE 4294967296.0
+
+// Rounds value to the nearest fixed point number. A float or double times 2^32 is exact, and so is the rounding, so the same value
+// gives the same number everywhere. Values outside the range are clamped to it.
+inline Fixed toFixed(double value)
+{
+	double scaled = value * FIXED_SCALE;
+	if (!(scaled > -9.2e18))
+	{
+		return value != value ? 0 : INT64_MIN + 1;
+	}
+	if (scaled > 9.2e18)
+	{
+		return INT64_MAX;
+	}
+	return (Fixed)std::llround(scaled);
+}
+
+inline double fromFixed(Fixed value)
+{
+	return (double)value / FIXED_SCALE;
+}
+
+inline uint64_t fixedMagnitude(Fixed value)
+{
+	return value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+}
+
+inline Fixed fixedSigned(uint64_t magnitude, bool negative)
+{
+	return negative ? (Fixed)(0 - magnitude) : (Fixed)magnitude;
+}
+
+// a * b, truncated towards 0.
+inline Fixed fixedMultiply(Fixed a, Fixed b)
+{
+	uint64_t x = fixedMagnitude(a);
+	uint64_t y = fixedMagnitude(b);
+#if defined(__SIZEOF_INT128__)
+	uint64_t product = (uint64_t)(((unsigned __int128)x * y) >> FIXED_FRACTION_BITS);
+#else
+	uint64_t xLow = x & 0xffffffffu, xHigh = x >> 32;
+	uint64_t yLow = y & 0xffffffffu, yHigh = y >> 32;
+
+	// Bits 32 to 95 of the 128 bit product, which wrap around just like the cast above.
+	uint64_t product = ((xHigh * yHigh) << 32) + xHigh * yLow + xLow * yHigh + ((xLow * yLow) >> 32);
+#endif
+	return fixedSigned(product, (a < 0) != (b < 0));
+}
+
+// a / b, truncated towards 0. b can't be 0, and the quotient has to be in range.
+inline Fixed fixedDivide(Fixed a, Fixed b)
+{
+	uint64_t x = fixedMagnitude(a);
+	uint64_t y = fixedMagnitude(b);
+#if defined(__SIZEOF_INT128__)
+	uint64_t quotient = (uint64_t)(((unsigned __int128)x << FIXED_FRACTION_BITS) / y);
+#else
+	// Long division of the 96 bit x * 2^32 by y, one bit at a time.
+	uint64_t remainder = x >> 32;
+	uint64_t rest = x << 32;
+	uint64_t quotient = 0;
+	for (int bit = 0; bit < 64; bit++)
+	{
+		bool over = (remainder >> 63) != 0;
+		remainder = (remainder << 1) | (rest >> 63);
+		rest <<= 1;
+		quotient <<= 1;
+		if (over || remainder >= y)
+		{
+			remainder -= y;
+			quotient |= 1;
+		}
+	}
+#endif
+	return fixedSigned(quotient, (a < 0) != (b < 0));
+}
+
+#endif // _FIXED_POINT_H
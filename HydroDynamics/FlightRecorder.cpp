@@ -0,0 +1,351 @@
+/*
+Title: HydroDynamics
+File Name: FlightRecorder.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A flight recorder that keeps the last few seconds of a run in a file, so they can be looked
+at after the process died. The profiler spans, the inputs that were applied and a summary of
+every fixed step go into a ring of fixed size records in a file that is mapped into memory.
+Writing a record is one atomic increment to claim a slot and a few stores into the mapping,
+the same as TraceRecorder, and nothing is ever flushed or written by hand: the pages belong
+to the operating system, which writes them back to the file even if the process crashes or
+is killed.
+
+A run that ends normally writes a "clean exit" mark last. A ring without that mark belongs
+to a run that didn't get that far, and its last records show what it was doing.
+flightDump() turns a ring into the JSON trace event format of traceWrite(), with the inputs,
+steps and marks as instant events and counters.
+*/
+
+#include "FlightRecorder.h"
+#include "InputLog.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define FLIGHT_VERSION 1
+
+// The atomics live in the mapping, where another process (the dump) reads them as plain memory, so they have to be nothing but
+// the value itself.
+static_assert(std::atomic<unsigned long long>::is_always_lock_free, "The flight recorder needs lock free 64 bit atomics");
+static_assert(sizeof(std::atomic<unsigned long long>) == sizeof(unsigned long long), "The flight recorder needs plain 64 bit atomics");
+
+// The start of the file, one cache line.
+struct FlightHeader
+{
+	char magic[4];						// "HDFR"
+	unsigned int version;
+	unsigned int recordSize;
+	unsigned int pad;
+	unsigned long long capacity;		// Number of records in the ring, a power of two
+	long long startTime;				// Wall clock time the recording started, in seconds since 1970
+	std::atomic<unsigned long long> next;	// Index of the next record to be written
+	unsigned long long process;
+	unsigned long long reserved[2];
+};
+
+// One cache line per record, so two threads never write the same line.
+struct FlightRecord
+{
+	std::atomic<unsigned long long> sequence;	// 1 + the index the record was written at, 0 while it is being written
+	double time;						// Seconds since the recording started
+	unsigned int kind;
+	unsigned int thread;
+	char name[16];
+	double values[3];
+};
+
+static_assert(sizeof(FlightHeader) == 64, "The flight recorder header should be one cache line");
+static_assert(sizeof(FlightRecord) == 64, "A flight recorder record should be one cache line");
+
+static std::atomic<FlightHeader*> header(nullptr);
+static FlightRecord* records = nullptr;
+static unsigned long long mask = 0;
+static std::chrono::steady_clock::time_point origin;
+
+static std::atomic<unsigned int> nextThread(0);
+static thread_local unsigned int threadNumber = nextThread.fetch_add(1);
+
+// Maps size bytes of a new file for writing. The file is cut to exactly that size, so it doesn't keep the records of an older,
+// bigger ring. The handles are closed right away; the view keeps the mapping alive by itself.
+static void* mapForWriting(const std::string& fileName, size_t size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+	void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size) : nullptr;
+	if (mapping != nullptr)
+	{
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	return data;
+#else
+	int descriptor = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (descriptor < 0)
+	{
+		return nullptr;
+	}
+	void* data = ftruncate(descriptor, (off_t)size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+	::close(descriptor);
+	return data == MAP_FAILED ? nullptr : data;
+#endif
+}
+
+bool flightStart(const std::string& fileName, double seconds)
+{
+	if (header.load() != nullptr)
+	{
+		return true;
+	}
+
+	unsigned long long wanted = (unsigned long long)(seconds * FLIGHT_RECORDS_PER_SECOND);
+	unsigned long long capacity = 1;
+	while (capacity < wanted)
+	{
+		capacity *= 2;
+	}
+	void* data = mapForWriting(fileName, sizeof(FlightHeader) + capacity * sizeof(FlightRecord));
+	if (data == nullptr)
+	{
+		std::cout << "Can't create the flight recorder file: " << fileName << std::endl;
+		return false;
+	}
+
+	// A new file reads as zeros, so every sequence is already 0 and the ring is empty.
+	FlightHeader* start = (FlightHeader*)data;
+	memcpy(start->magic, "HDFR", 4);
+	start->version = FLIGHT_VERSION;
+	start->recordSize = sizeof(FlightRecord);
+	start->capacity = capacity;
+	start->startTime = (long long)time(nullptr);
+#ifdef _WIN32
+	start->process = GetCurrentProcessId();
+#else
+	start->process = (unsigned long long)getpid();
+#endif
+	start->next.store(0);
+
+	origin = std::chrono::steady_clock::now();
+	records = (FlightRecord*)(start + 1);
+	mask = capacity - 1;
+	header.store(start, std::memory_order_release);
+	return true;
+}
+
+bool flightRecording()
+{
+	return header.load(std::memory_order_relaxed) != nullptr;
+}
+
+// Claims the next record of the ring and fills it in, clearing the sequence while it is written, like TraceRecorder does. A
+// process that dies halfway through leaves a record with a sequence of 0, which the dump skips.
+static void record(FlightKind kind, const char* name, double a, double b, double c)
+{
+	FlightHeader* start = header.load(std::memory_order_acquire);
+	if (start == nullptr)
+	{
+		return;
+	}
+	unsigned long long index = start->next.fetch_add(1, std::memory_order_relaxed);
+	FlightRecord& entry = records[index & mask];
+
+	entry.sequence.store(0, std::memory_order_relaxed);
+	entry.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+	entry.kind = kind;
+	entry.thread = threadNumber;
+	strncpy(entry.name, name, sizeof(entry.name) - 1);
+	entry.name[sizeof(entry.name) - 1] = '\0';
+	entry.values[0] = a;
+	entry.values[1] = b;
+	entry.values[2] = c;
+	entry.sequence.store(index + 1, std::memory_order_release);
+}
+
+void flightSpan(const char* name, double milliseconds)
+{
+	record(FLIGHT_SPAN, name, milliseconds, 0.0, 0.0);
+}
+
+void flightInput(int command, int vessel, float value)
+{
+	record(FLIGHT_INPUT, "input", command, vessel, value);
+}
+
+void flightStep(long long step, bool resting, float pistonHeight, float pistonPressure)
+{
+	record(FLIGHT_STEP, resting ? "step (rest)" : "step", (double)step, pistonHeight, pistonPressure);
+}
+
+void flightMark(const char* text)
+{
+	record(FLIGHT_MARK, text, 0.0, 0.0, 0.0);
+}
+
+void flightStop()
+{
+	if (header.load() == nullptr)
+	{
+		return;
+	}
+	flightMark("clean exit");
+
+	// The file is left mapped: a thread that is still running while the process exits could be halfway through a record, and
+	// the operating system writes the pages back and unmaps them when the process ends anyway.
+	header.store(nullptr);
+}
+
+// Writes a name for the trace, with the characters JSON doesn't allow in a string replaced.
+static void writeName(FILE* file, const char* name)
+{
+	for (const char* c = name; *c != '\0'; c++)
+	{
+		fputc(*c == '"' || *c == '\\' || (unsigned char)*c < 32 ? '_' : *c, file);
+	}
+}
+
+bool flightDump(const std::string& fileName, const std::string& outputFile)
+{
+	MappedFile mapped;
+	if (!mapped.open(fileName.c_str()))
+	{
+		return false;
+	}
+	std::string_view data = mapped.view();
+	const FlightHeader* start = (const FlightHeader*)data.data();
+	if (data.size() < sizeof(FlightHeader) || memcmp(start->magic, "HDFR", 4) != 0 || start->version != FLIGHT_VERSION ||
+		start->recordSize != sizeof(FlightRecord) || start->capacity == 0 || (start->capacity & (start->capacity - 1)) != 0 ||
+		data.size() < sizeof(FlightHeader) + start->capacity * sizeof(FlightRecord))
+	{
+		std::cout << "Not a flight recorder file: " << fileName << std::endl;
+		return false;
+	}
+	const FlightRecord* ring = (const FlightRecord*)(start + 1);
+	unsigned long long capacity = start->capacity;
+
+	FILE* file = outputFile.empty() ? stdout : fopen(outputFile.c_str(), "w");
+	if (file == nullptr)
+	{
+		std::cout << "Can't write file: " << outputFile << std::endl;
+		return false;
+	}
+
+	// Only the last capacity records are still in the ring, and the ones whose sequence doesn't match were either being written
+	// when the process died or were already overwritten by a newer record.
+	unsigned long long end = start->next.load(std::memory_order_acquire);
+	unsigned long long begin = end > capacity ? end - capacity : 0;
+	unsigned long long kept = 0;
+	unsigned long long torn = 0;
+	double firstTime = 0.0;
+	double lastTime = 0.0;
+	const FlightRecord* last = nullptr;
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (unsigned long long i = begin; i < end; i++)
+	{
+		const FlightRecord& entry = ring[i & (capacity - 1)];
+		if (entry.sequence.load(std::memory_order_acquire) != i + 1)
+		{
+			torn++;
+			continue;
+		}
+		char name[sizeof(entry.name)];
+		memcpy(name, entry.name, sizeof(name));
+		name[sizeof(name) - 1] = '\0';
+
+		// The trace format uses microseconds. A span is recorded when it ends, so it started its duration earlier.
+		double microseconds = entry.time * 1000000.0;
+		fprintf(file, "%s{\"name\":\"", kept == 0 ? "" : ",\n");
+		if (entry.kind == FLIGHT_INPUT)
+		{
+			InputEvent event;
+			event.step = 0;
+			event.command = (InputCommand)((int)entry.values[0] >= 0 && (int)entry.values[0] < INPUT_COMMAND_COUNT ? (int)entry.values[0] : 0);
+			event.vessel = (int)entry.values[1];
+			event.value = (float)entry.values[2];
+			writeName(file, formatInputCommand(event).c_str());
+			fprintf(file, "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", entry.thread, microseconds);
+		}
+		else if (entry.kind == FLIGHT_STEP)
+		{
+			writeName(file, name);
+			fprintf(file, "\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"step\":%.0f,\"piston height\":%g,\"piston pressure\":%g}}",
+				entry.thread, microseconds, entry.values[0], entry.values[1], entry.values[2]);
+		}
+		else if (entry.kind == FLIGHT_MARK)
+		{
+			writeName(file, name);
+			fprintf(file, "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", entry.thread, microseconds);
+		}
+		else
+		{
+			writeName(file, name);
+			double duration = entry.values[0] * 1000.0;
+			fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", entry.thread, microseconds - duration, duration);
+		}
+		if (kept == 0)
+		{
+			firstTime = entry.time;
+		}
+		lastTime = entry.time;
+		last = &entry;
+		kept++;
+	}
+	fprintf(file, "\n]}\n");
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+
+	// The summary goes to the error stream when the trace itself is printed, so the trace can still be redirected to a file.
+	bool clean = last != nullptr && last->kind == FLIGHT_MARK && strncmp(last->name, "clean exit", sizeof(last->name)) == 0;
+	time_t started = (time_t)start->startTime;
+	char startText[64];
+	strftime(startText, sizeof(startText), "%Y-%m-%d %H:%M:%S", localtime(&started));
+	FILE* summary = outputFile.empty() ? stderr : stdout;
+	fprintf(summary, "%s: process %llu started %s, %llu records written, %llu kept covering %.3f s up to %.3f s",
+		fileName.c_str(), start->process, startText, end, kept, lastTime - firstTime, lastTime);
+	if (torn > 0)
+	{
+		fprintf(summary, ", %llu unfinished or overwritten while copying", torn);
+	}
+	fprintf(summary, "\n%s\n", clean ? "The run exited cleanly." : "The run didn't exit cleanly: the last records are what it was doing when it stopped.");
+	return true;
+}
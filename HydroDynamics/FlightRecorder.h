@@ -0,0 +1,77 @@
+/*
+Title: HydroDynamics
+File Name: FlightRecorder.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A flight recorder that keeps the last few seconds of a run in a file, so they can be looked
+at after the process died. The profiler spans, the inputs that were applied and a summary of
+every fixed step go into a ring of fixed size records in a file that is mapped into memory.
+Writing a record is one atomic increment to claim a slot and a few stores into the mapping,
+the same as TraceRecorder, and nothing is ever flushed or written by hand: the pages belong
+to the operating system, which writes them back to the file even if the process crashes or
+is killed.
+
+A run that ends normally writes a "clean exit" mark last. A ring without that mark belongs
+to a run that didn't get that far, and its last records show what it was doing.
+flightDump() turns a ring into the JSON trace event format of traceWrite(), with the inputs,
+steps and marks as instant events and counters.
+*/
+
+#ifndef _FLIGHT_RECORDER_H
+#define _FLIGHT_RECORDER_H
+
+#include <string>
+
+// Records kept per second of the ring. It is rounded up to a power of two records in total.
+#define FLIGHT_RECORDS_PER_SECOND 2048
+
+enum FlightKind
+{
+	FLIGHT_SPAN,				// A profiler scope, values: duration in milliseconds
+	FLIGHT_INPUT,				// An applied input, values: command, vessel, value
+	FLIGHT_STEP,				// A fixed step, values: step, piston height, piston pressure
+	FLIGHT_MARK,				// A line of text
+	FLIGHT_KIND_COUNT
+};
+
+// Creates (or overwrites) the ring file with room for about seconds seconds of records and starts recording into it. Returns
+// false (after printing an error) if the file can't be created or mapped.
+bool flightStart(const std::string& fileName, double seconds);
+
+// Writes the "clean exit" mark and unmaps the file.
+void flightStop();
+
+bool flightRecording();
+
+void flightSpan(const char* name, double milliseconds);
+void flightInput(int command, int vessel, float value);
+void flightStep(long long step, bool resting, float pistonHeight, float pistonPressure);
+
+// Only the first 15 characters of text are kept.
+void flightMark(const char* text);
+
+// Reads a ring written by a run (which may have been killed), writes its records as a trace to outputFile (or prints it if that
+// is empty) and prints a summary. Returns false if the file isn't a flight recorder ring.
+bool flightDump(const std::string& fileName, const std::string& outputFile);
+
+#endif // _FLIGHT_RECORDER_H
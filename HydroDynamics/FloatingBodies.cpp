@@ -0,0 +1,374 @@
+/*
+Title: HydroDynamics
+File Name: FloatingBodies.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Floats in the vessels with --floats: rigid boxes that the fluid holds up, like the level
+indicators of a real tank, bobbing on the surface and piling up against the walls and each
+other. They don't turn, as if every float ran on a guide, and they only read the network: it
+holds them up, but doesn't rise when they push down on it.
+
+A float is pulled down by gravity and pushed up by the weight of the fluid it displaces,
+which in the two dimensions of the scene is the density of the fluid times gravity times
+its width times how deep its bottom is below the surface of its vessel. Where it is in the
+fluid, it is also dragged towards the speed of the surface, so a float rides up and down on
+a swinging level instead of lagging behind it, and comes to rest with it. The floor and the
+walls of its vessel stop it.
+
+Contacts between floats are found by sweep and prune, along the axis the floats are spread
+out along the most (x over a row of vessels, y up a stack in one of them): the floats are
+kept sorted by where they start along it, which an insertion sort restores in about linear
+time since they hardly move between two steps; one sweep then only compares a float with
+those whose span along the axis it overlaps, and keeps the pairs that overlap along the
+other axis as well. The vessels whose walls and floors the floats hit are sorted by their
+left walls once, so finding the vessel of a float is one binary search. With thousands of
+floats a step costs about as much as going over them a few times.
+
+The contacts take the speeds and the overlaps apart, like the split impulses of Box2D:
+FLOAT_CONTACT_PASSES passes first take the speed at which two floats in contact approach
+each other out of both, the lighter one changing more, and stop the floats at the walls and
+the floor; then the floats move, and as many passes push the ones that still overlap apart
+along the axis they overlap least in without touching their speeds. Turning those pushes
+into speed, as the particles do (see ParticleFluid.h), flings the floats of a tall pile
+about when the surface under it rises quickly. No float is left faster than it moved in a
+step, which takes the speed out of the middle of a pile that the passes don't reach.
+
+This file has no OpenGL dependency.
+*/
+
+#include "FloatingBodies.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+void FloatingBodies::clear()
+{
+	positionX.clear();
+	positionY.clear();
+	velocityX.clear();
+	velocityY.clear();
+	halfWidth.clear();
+	halfHeight.clear();
+	mass.clear();
+	vessel.clear();
+	surface.clear();
+	order.clear();
+	pairs.clear();
+	vesselOrder.clear();
+	vesselLeft.clear();
+	sweepAxis = -1;
+	lastContacts = 0;
+}
+
+int FloatingBodies::add(float x, float y, float width, float height, float density)
+{
+	int body = count();
+	positionX.push_back(x);
+	positionY.push_back(y);
+	velocityX.push_back(0.0f);
+	velocityY.push_back(0.0f);
+	halfWidth.push_back(0.5f * width);
+	halfHeight.push_back(0.5f * height);
+	mass.push_back(density * width * height);
+	vessel.push_back(-1);
+	surface.push_back(NAN);
+	order.push_back(body);
+	return body;
+}
+
+// Of a velocity and another along the same axis, the slower one if they are the same way, or none.
+static float slowest(float velocity, float moved)
+{
+	if (velocity * moved <= 0.0f)
+	{
+		return 0.0f;
+	}
+	return std::abs(moved) < std::abs(velocity) ? moved : velocity;
+}
+
+void FloatingBodies::scatter(const VesselNetwork& network, int bodyCount, float size, float densityRatio, float fluidDensity)
+{
+	if (network.vesselCount() == 0 || bodyCount <= 0)
+	{
+		return;
+	}
+	double totalWidth = 0.0;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		totalWidth += network.width[i];
+	}
+	if (size <= 0.0f)
+	{
+		size = FLOAT_DEFAULT_SIZE_FRACTION * (float)(totalWidth / network.vesselCount());
+	}
+
+	// Every vessel gets the bodies its share of the widths adds up to, rounded so they add up to bodyCount.
+	double covered = 0.0;
+	int placed = 0;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		covered += network.width[i];
+		int last = i + 1 == network.vesselCount() ? bodyCount : (int)(bodyCount * covered / totalWidth);
+		int columns = std::max(1, (int)(network.width[i] / (size * 1.1f)));
+		float spacing = network.width[i] / columns;
+
+		// A body at rest is densityRatio of its height deep in the fluid.
+		float firstY = network.top[i] - densityRatio * size + 0.5f * size;
+		for (int k = 0; placed < last; k++, placed++)
+		{
+			add(network.left[i] + (k % columns + 0.5f) * spacing, firstY + (k / columns) * size * 1.05f, size, size, densityRatio * fluidDensity);
+		}
+	}
+	std::cout << count() << " floats of " << size << " m" << std::endl;
+}
+
+bool FloatingBodies::step(const VesselNetwork& network, float density, float gravity, float dt)
+{
+	if (count() == 0 || network.vesselCount() == 0)
+	{
+		return false;
+	}
+	locate(network);
+	startX = positionX;
+	startY = positionY;
+
+	for (int i = 0; i < count(); i++)
+	{
+		int v = vessel[i];
+		float level = network.top[v];
+		float surfaceSpeed = std::isnan(surface[i]) ? 0.0f : (level - surface[i]) / dt;
+		surface[i] = level;
+
+		// The weight of what the body displaces holds it up, and the fluid around it drags it along with the surface.
+		float height = 2.0f * halfHeight[i];
+		float depth = std::min(std::max(level - (positionY[i] - halfHeight[i]), 0.0f), height);
+		velocityY[i] += (density * gravity * 2.0f * halfWidth[i] * depth / mass[i] - gravity) * dt;
+		float drag = std::min(1.0f, FLOAT_DRAG * depth / height * dt);
+		velocityY[i] += (surfaceSpeed - velocityY[i]) * drag;
+		velocityX[i] -= velocityX[i] * drag;
+	}
+
+	// The speeds first, where the bodies touch before they move.
+	sweep();
+	for (int pass = 0; pass < FLOAT_CONTACT_PASSES; pass++)
+	{
+		stopAtWalls(network, dt);
+		for (size_t p = 0; p < pairs.size(); p += 2)
+		{
+			int a = pairs[p];
+			int b = pairs[p + 1];
+			float dx = positionX[b] - positionX[a];
+			float dy = positionY[b] - positionY[a];
+			float overlapX = halfWidth[a] + halfWidth[b] - std::abs(dx);
+			float overlapY = halfHeight[a] + halfHeight[b] - std::abs(dy);
+			if (overlapX <= 0.0f || overlapY <= 0.0f)
+			{
+				continue;
+			}
+			bool alongX = overlapX < overlapY;
+			float* velocity = alongX ? velocityX.data() : velocityY.data();
+			float normal = (alongX ? dx : dy) < 0.0f ? -1.0f : 1.0f;
+			float approach = (velocity[b] - velocity[a]) * normal;
+			if (approach < 0.0f)
+			{
+				float inverseA = 1.0f / mass[a];
+				float inverseB = 1.0f / mass[b];
+				float impulse = -approach / (inverseA + inverseB);
+				velocity[a] -= normal * impulse * inverseA;
+				velocity[b] += normal * impulse * inverseB;
+			}
+		}
+	}
+	lastContacts = (int)(pairs.size() / 2);
+
+	for (int i = 0; i < count(); i++)
+	{
+		positionX[i] += velocityX[i] * dt;
+		positionY[i] += velocityY[i] * dt;
+	}
+
+	// Then what still overlaps, apart along the axis it overlaps least in, the lighter body moving more.
+	for (int pass = 0; pass < FLOAT_CONTACT_PASSES; pass++)
+	{
+		for (size_t p = 0; p < pairs.size(); p += 2)
+		{
+			int a = pairs[p];
+			int b = pairs[p + 1];
+			float dx = positionX[b] - positionX[a];
+			float dy = positionY[b] - positionY[a];
+			float overlapX = halfWidth[a] + halfWidth[b] - std::abs(dx);
+			float overlapY = halfHeight[a] + halfHeight[b] - std::abs(dy);
+			if (overlapX <= 0.0f || overlapY <= 0.0f)
+			{
+				continue;
+			}
+			float inverseA = 1.0f / mass[a];
+			float inverseB = 1.0f / mass[b];
+			bool alongX = overlapX < overlapY;
+			float* position = alongX ? positionX.data() : positionY.data();
+			float normal = (alongX ? dx : dy) < 0.0f ? -1.0f : 1.0f;
+			float push = (alongX ? overlapX : overlapY) * FLOAT_CORRECTION / (inverseA + inverseB);
+			position[a] -= normal * push * inverseA;
+			position[b] += normal * push * inverseB;
+		}
+		collideWalls(network);
+	}
+
+	// A body in a pile the speed passes didn't reach keeps falling into those under it, which push it back every step; no body is
+	// faster than it moved, so it stands still with the pile instead of gathering speed it lets go of at once when the pile moves.
+	float inverseDt = 1.0f / dt;
+	bool moved = false;
+	for (int i = 0; i < count(); i++)
+	{
+		velocityX[i] = slowest(velocityX[i], (positionX[i] - startX[i]) * inverseDt);
+		velocityY[i] = slowest(velocityY[i], (positionY[i] - startY[i]) * inverseDt);
+		moved = moved || positionX[i] != startX[i] || positionY[i] != startY[i];
+	}
+	return moved;
+}
+
+void FloatingBodies::locate(const VesselNetwork& network)
+{
+	if ((int)vesselOrder.size() != network.vesselCount())
+	{
+		vesselOrder.resize(network.vesselCount());
+		for (int i = 0; i < network.vesselCount(); i++)
+		{
+			vesselOrder[i] = i;
+		}
+		std::sort(vesselOrder.begin(), vesselOrder.end(), [&](int a, int b) { return network.left[a] < network.left[b]; });
+		vesselLeft.resize(vesselOrder.size());
+		for (size_t k = 0; k < vesselOrder.size(); k++)
+		{
+			vesselLeft[k] = network.left[vesselOrder[k]];
+		}
+		std::fill(vessel.begin(), vessel.end(), -1);
+	}
+
+	// The vessel whose walls a body is between, or the one to the left of it if it is between none; a body stays in its vessel
+	// while it is over none at all.
+	for (int i = 0; i < count(); i++)
+	{
+		size_t k = std::upper_bound(vesselLeft.begin(), vesselLeft.end(), positionX[i]) - vesselLeft.begin();
+		int v = vesselOrder[k > 0 ? k - 1 : 0];
+		if ((positionX[i] <= network.right[v] || vessel[i] < 0) && v != vessel[i])
+		{
+			vessel[i] = v;
+			surface[i] = NAN;
+		}
+	}
+}
+
+void FloatingBodies::stopAtWalls(const VesselNetwork& network, float dt)
+{
+	float inverseDt = 1.0f / dt;
+	for (int i = 0; i < count(); i++)
+	{
+		int v = vessel[i];
+		float left = network.left[v] + halfWidth[i];
+		float right = network.right[v] - halfWidth[i];
+		if (left > right)
+		{
+			velocityX[i] = (0.5f * (left + right) - positionX[i]) * inverseDt;
+		}
+		else
+		{
+			velocityX[i] = std::min(std::max(velocityX[i], (left - positionX[i]) * inverseDt), (right - positionX[i]) * inverseDt);
+		}
+		velocityY[i] = std::max(velocityY[i], (network.bottom[v] + halfHeight[i] - positionY[i]) * inverseDt);
+	}
+}
+
+void FloatingBodies::collideWalls(const VesselNetwork& network)
+{
+	for (int i = 0; i < count(); i++)
+	{
+		int v = vessel[i];
+		float left = network.left[v] + halfWidth[i];
+		float right = network.right[v] - halfWidth[i];
+		positionX[i] = left > right ? 0.5f * (left + right) : std::min(std::max(positionX[i], left), right);
+		positionY[i] = std::max(positionY[i], network.bottom[v] + halfHeight[i]);
+	}
+}
+
+void FloatingBodies::sweep()
+{
+	// The axis along which the centers vary the most has the fewest bodies on top of each other.
+	double sumX = 0.0, sumY = 0.0, squaresX = 0.0, squaresY = 0.0;
+	for (int i = 0; i < count(); i++)
+	{
+		sumX += positionX[i];
+		sumY += positionY[i];
+		squaresX += (double)positionX[i] * positionX[i];
+		squaresY += (double)positionY[i] * positionY[i];
+	}
+	int axis = squaresX - sumX * sumX / count() >= squaresY - sumY * sumY / count() ? 0 : 1;
+	const float* position = axis == 0 ? positionX.data() : positionY.data();
+	const float* half = axis == 0 ? halfWidth.data() : halfHeight.data();
+	const float* otherPosition = axis == 0 ? positionY.data() : positionX.data();
+	const float* otherHalf = axis == 0 ? halfHeight.data() : halfWidth.data();
+
+	// After a step the order is still nearly right, which an insertion sort fixes in about linear time. Along a new axis it is not.
+	auto start = [&](int body) { return position[body] - half[body]; };
+	if (axis != sweepAxis)
+	{
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return start(a) < start(b); });
+		sweepAxis = axis;
+	}
+	for (size_t k = 1; k < order.size(); k++)
+	{
+		int body = order[k];
+		float key = start(body);
+		size_t j = k;
+		for (; j > 0 && start(order[j - 1]) > key; j--)
+		{
+			order[j] = order[j - 1];
+		}
+		order[j] = body;
+	}
+
+	pairs.clear();
+	active.clear();
+	for (int body : order)
+	{
+		// The bodies whose span ended before this one starts are done with.
+		float begin = start(body);
+		size_t kept = 0;
+		for (int other : active)
+		{
+			if (position[other] + half[other] < begin)
+			{
+				continue;
+			}
+			active[kept++] = other;
+			if (std::abs(otherPosition[other] - otherPosition[body]) < otherHalf[other] + otherHalf[body])
+			{
+				pairs.push_back(other);
+				pairs.push_back(body);
+			}
+		}
+		active.resize(kept);
+		active.push_back(body);
+	}
+}
@@ -0,0 +1,133 @@
+/*
+Title: HydroDynamics
+File Name: FloatingBodies.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Floats in the vessels with --floats: rigid boxes that the fluid holds up, like the level
+indicators of a real tank, bobbing on the surface and piling up against the walls and each
+other. They don't turn, as if every float ran on a guide, and they only read the network: it
+holds them up, but doesn't rise when they push down on it.
+
+A float is pulled down by gravity and pushed up by the weight of the fluid it displaces,
+which in the two dimensions of the scene is the density of the fluid times gravity times
+its width times how deep its bottom is below the surface of its vessel. Where it is in the
+fluid, it is also dragged towards the speed of the surface, so a float rides up and down on
+a swinging level instead of lagging behind it, and comes to rest with it. The floor and the
+walls of its vessel stop it.
+
+Contacts between floats are found by sweep and prune, along the axis the floats are spread
+out along the most (x over a row of vessels, y up a stack in one of them): the floats are
+kept sorted by where they start along it, which an insertion sort restores in about linear
+time since they hardly move between two steps; one sweep then only compares a float with
+those whose span along the axis it overlaps, and keeps the pairs that overlap along the
+other axis as well. The vessels whose walls and floors the floats hit are sorted by their
+left walls once, so finding the vessel of a float is one binary search. With thousands of
+floats a step costs about as much as going over them a few times.
+
+The contacts take the speeds and the overlaps apart, like the split impulses of Box2D:
+FLOAT_CONTACT_PASSES passes first take the speed at which two floats in contact approach
+each other out of both, the lighter one changing more, and stop the floats at the walls and
+the floor; then the floats move, and as many passes push the ones that still overlap apart
+along the axis they overlap least in without touching their speeds. Turning those pushes
+into speed, as the particles do (see ParticleFluid.h), flings the floats of a tall pile
+about when the surface under it rises quickly. No float is left faster than it moved in a
+step, which takes the speed out of the middle of a pile that the passes don't reach.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _FLOATING_BODIES_H
+#define _FLOATING_BODIES_H
+
+#include <vector>
+
+struct VesselNetwork;
+
+// How fast a body takes the speed of the surface when it is fully under it, per second.
+#define FLOAT_DRAG 8.0f
+
+// The passes over the contacts every step, and how much of an overlap every pass takes out.
+#define FLOAT_CONTACT_PASSES 4
+#define FLOAT_CORRECTION 0.8f
+
+// The size of a float as a part of the average width of the vessels, unless the command line says otherwise, and the density of a
+// float as a part of that of the fluid.
+#define FLOAT_DEFAULT_SIZE_FRACTION 0.1f
+#define FLOAT_DEFAULT_DENSITY_RATIO 0.5f
+
+class FloatingBodies
+{
+public:
+	// Per body, as a structure of arrays, in the order the bodies were added: the center, the velocity, half the width and half
+	// the height, the mass (per meter of depth) and the vessel it is in.
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+	std::vector<float> halfWidth;
+	std::vector<float> halfHeight;
+	std::vector<float> mass;
+	std::vector<int> vessel;
+
+	// How many pairs of bodies touched in the last step.
+	int lastContacts = 0;
+
+	void clear();
+
+	// Adds a box of width by height with its center at (x, y), as dense as density, and returns its index.
+	int add(float x, float y, float width, float height, float density);
+
+	// Adds count square bodies of size (or FLOAT_DEFAULT_SIZE_FRACTION of the average width of the vessels for 0) as dense as
+	// densityRatio times fluidDensity, shared out over the vessels by their widths, in rows floating on their surfaces.
+	void scatter(const VesselNetwork& network, int count, float size, float densityRatio, float fluidDensity);
+
+	int count() const { return (int)positionX.size(); }
+
+	// Advances every body by dt, held up by the fluid of network, which is as dense as density. Returns false if none of them moved.
+	bool step(const VesselNetwork& network, float density, float gravity, float dt);
+
+private:
+	// Sorts the vessels by their left walls if the network changed, and finds the vessel every body is over.
+	void locate(const VesselNetwork& network);
+
+	// Slows every body down just enough not to go through the walls or the floor of its vessel within dt.
+	void stopAtWalls(const VesselNetwork& network, float dt);
+
+	// Keeps every body inside the walls and above the floor of its vessel.
+	void collideWalls(const VesselNetwork& network);
+
+	// Sorts order along the axis the bodies are spread out along the most, and fills pairs with those that overlap.
+	void sweep();
+
+	std::vector<int> vesselOrder;	// The vessels by their left walls
+	std::vector<float> vesselLeft;	// and those walls, in that order
+	std::vector<int> order;			// The bodies by where they start along sweepAxis
+	int sweepAxis = -1;				// 0 for x, 1 for y, -1 before the first sweep
+	std::vector<int> active;		// Scratch for sweep(): the bodies whose span in x the sweep is in
+	std::vector<int> pairs;			// Two bodies each
+	std::vector<float> surface;		// Per body, the surface of its vessel in the last step, or NAN before its first
+	std::vector<float> startX;		// Scratch for step(): where the bodies were before it
+	std::vector<float> startY;
+};
+
+#endif // _FLOATING_BODIES_H
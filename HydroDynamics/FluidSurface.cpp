@@ -0,0 +1,224 @@
+/*
+Title: HydroDynamics
+File Name: FluidSurface.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A surface over the particles of --particles, reconstructed in screen space, so the fluid
+reads as one body of water instead of a cloud of dots.
+
+Every particle is drawn as a round splat (a point sprite, see ParticleFragmentShader.glsl)
+into a floating point texture with additive blending: the alpha of a pixel adds up how
+much of the particles around it covers it, and its color the colors of those particles
+weighted the same way. The texture is a fraction of the size of the window, since it is
+blurred anyway. A separable Gaussian blur, first along x and then along y, smooths the
+lumps of the single particles into a continuous field. Where that field is above
+FLUID_SURFACE_THRESHOLD is inside the fluid: the surface program covers the screen with
+one triangle and draws those pixels, lit as if the field were a height, so the fluid gets
+a bright rim where it ends.
+
+The splats and the two blurs are passes of a FrameGraph with a target each, so the three
+targets share the two textures the blur ping-pongs between, and the textures are created
+again for a new window size without anything here keeping track of them.
+
+None of this touches the particles on the CPU. The splats read the same vertex buffer the
+points are drawn from, which the GPU itself writes with --gpu.
+*/
+
+#include "FluidSurface.h"
+#include "GLState.h"
+#include "Shaders.h"
+#include <algorithm>
+#include <iostream>
+
+// Loads a program from two files. The shaders aren't needed once it is linked, and files that don't change while it runs aren't
+// watched for reloading.
+static GLuint loadProgram(const char* vertexFile, const char* fragmentFile)
+{
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	GLuint program = loadProgramFiles(vertexFile, fragmentFile, vertexShader, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return program;
+}
+
+bool FluidSurface::build(const char* particleVertexFile, const char* particleFragmentFile, const char* fullscreenVertexFile,
+	const char* surfaceFragmentFile)
+{
+	destroy();
+	splatProgram = loadProgram(particleVertexFile, particleFragmentFile);
+	blurProgram = loadProgram(fullscreenVertexFile, surfaceFragmentFile);
+	drawProgram = loadProgram(fullscreenVertexFile, surfaceFragmentFile);
+	if (splatProgram == 0 || blurProgram == 0 || drawProgram == 0)
+	{
+		std::cout << "Can't build the programs of the fluid surface." << std::endl;
+		destroy();
+		failed = true;
+		return false;
+	}
+
+	// The uniforms that never change are set once. The blur and the surface are the same shaders, told apart by composite.
+	attachFrameBlock(splatProgram);
+	attachFrameBlock(blurProgram);
+	attachFrameBlock(drawProgram);
+	cachedUseProgram(splatProgram);
+	glUniform1i(glGetUniformLocation(splatProgram, "splat"), 1);
+	splatRadius = glGetUniformLocation(splatProgram, "radius");
+
+	cachedUseProgram(blurProgram);
+	glUniform1i(glGetUniformLocation(blurProgram, "field"), 2);
+	glUniform1i(glGetUniformLocation(blurProgram, "composite"), 0);
+	blurDirection = glGetUniformLocation(blurProgram, "direction");
+
+	cachedUseProgram(drawProgram);
+	glUniform1i(glGetUniformLocation(drawProgram, "field"), 2);
+	glUniform1i(glGetUniformLocation(drawProgram, "composite"), 1);
+	glUniform1f(glGetUniformLocation(drawProgram, "threshold"), FLUID_SURFACE_THRESHOLD);
+	cachedUseProgram(0);
+
+	// The fullscreen triangle makes its corners from gl_VertexID, but a vertex array still has to be bound to draw it.
+	glGenVertexArrays(1, &vao);
+	failed = false;
+	return true;
+}
+
+bool FluidSurface::resize(int width, int height)
+{
+	if (splatProgram == 0 || failed)
+	{
+		return false;
+	}
+	fieldWidth = std::max(width / FLUID_SURFACE_DOWNSCALE, 1);
+	fieldHeight = std::max(height / FLUID_SURFACE_DOWNSCALE, 1);
+	return true;
+}
+
+// Blurs the field in from along one axis into to.
+void FluidSurface::blur(FrameGraph& frameGraph, int from, int to, bool alongX)
+{
+	frameGraph.target(to).bind();
+	cachedUseProgram(blurProgram);
+	cachedBindVertexArray(vao);
+	cachedActiveTexture(GL_TEXTURE2);
+	cachedBindTexture(GL_TEXTURE_2D, frameGraph.target(from).texture());
+	glUniform2f(blurDirection, alongX ? 1.0f : 0.0f, alongX ? 0.0f : 1.0f);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	cachedBindTexture(GL_TEXTURE_2D, 0);
+	cachedActiveTexture(GL_TEXTURE0);
+}
+
+bool FluidSurface::render(GLuint particleVao, GLsizei count, const glm::mat4& mvp, float pixelSize, float radius)
+{
+	GLint framebuffer = 0;
+	GLint viewport[4] = {};
+	GLfloat clearColor[4] = {};
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+	frame.setFrame((float)glfwGetTime(), 1.0f / (pixelSize * FLUID_SURFACE_DOWNSCALE));
+	int view = frame.view(mvp);
+	frame.upload();
+	frame.bind(view);
+	splatVao = particleVao;
+	splatCount = count;
+	splatSize = radius * FLUID_SURFACE_SPLAT_RADIUS;
+
+	// Linear filtering, since the surface reads the field stretched over the whole window, and no depth.
+	FrameTargetDesc desc;
+	desc.width = fieldWidth;
+	desc.height = fieldHeight;
+	desc.format = GL_RGBA16F;
+	desc.sampled = true;
+	int splats = graph.addTarget("fluid splats", desc);
+	int blurredX = graph.addTarget("fluid blurred along x", desc);
+	int field = graph.addTarget("fluid field", desc);
+
+	// The splats add up, in any order, so there is no depth test.
+	int pass = graph.addPass("fluid splats", [this, splats](FrameGraph& frameGraph)
+	{
+		frameGraph.target(splats).bind();
+		cachedClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		cachedDisable(GL_DEPTH_TEST);
+		cachedEnable(GL_BLEND);
+		cachedBlendFunc(GL_ONE, GL_ONE);
+		cachedEnable(GL_PROGRAM_POINT_SIZE);
+		cachedUseProgram(splatProgram);
+		glUniform1f(splatRadius, splatSize);
+		cachedBindVertexArray(splatVao);
+		glDrawArrays(GL_POINTS, 0, splatCount);
+		cachedDisable(GL_BLEND);
+	});
+	graph.writes(pass, splats);
+
+	pass = graph.addPass("fluid blur x", [this, splats, blurredX](FrameGraph& frameGraph) { blur(frameGraph, splats, blurredX, true); });
+	graph.reads(pass, splats);
+	graph.writes(pass, blurredX);
+	pass = graph.addPass("fluid blur y", [this, blurredX, field](FrameGraph& frameGraph) { blur(frameGraph, blurredX, field, false); });
+	graph.reads(pass, blurredX);
+	graph.writes(pass, field);
+
+	// The field leaves the graph for the surface program, which draws with everything else.
+	pass = graph.addPass("fluid field", [this, field](FrameGraph& frameGraph) { fieldTexture = frameGraph.target(field).texture(); });
+	graph.reads(pass, field);
+	graph.sideEffect(pass);
+	if (!graph.execute())
+	{
+		std::cout << "Can't create the " << fieldWidth << "x" << fieldHeight << " textures of the fluid surface, drawing the particles instead." << std::endl;
+		fieldTexture = 0;
+		failed = true;
+	}
+
+	cachedBindVertexArray(0);
+	cachedUseProgram(0);
+	cachedEnable(GL_DEPTH_TEST);
+	cachedBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	cachedViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	cachedClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+	return !failed;
+}
+
+void FluidSurface::bindField()
+{
+	cachedActiveTexture(GL_TEXTURE2);
+	cachedBindTexture(GL_TEXTURE_2D, fieldTexture);
+	cachedActiveTexture(GL_TEXTURE0);
+}
+
+void FluidSurface::destroy()
+{
+	cachedDeleteProgram(splatProgram);
+	cachedDeleteProgram(blurProgram);
+	cachedDeleteProgram(drawProgram);
+	cachedDeleteVertexArrays(1, &vao);
+	graph.destroy();
+	frame.destroy();
+	splatProgram = 0;
+	blurProgram = 0;
+	drawProgram = 0;
+	vao = 0;
+	fieldTexture = 0;
+	fieldWidth = 0;
+	fieldHeight = 0;
+}
@@ -0,0 +1,116 @@
+/*
+Title: HydroDynamics
+File Name: FluidSurface.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A surface over the particles of --particles, reconstructed in screen space, so the fluid
+reads as one body of water instead of a cloud of dots.
+
+Every particle is drawn as a round splat (a point sprite, see ParticleFragmentShader.glsl)
+into a floating point texture with additive blending: the alpha of a pixel adds up how
+much of the particles around it covers it, and its color the colors of those particles
+weighted the same way. The texture is a fraction of the size of the window, since it is
+blurred anyway. A separable Gaussian blur, first along x and then along y, smooths the
+lumps of the single particles into a continuous field. Where that field is above
+FLUID_SURFACE_THRESHOLD is inside the fluid: the surface program covers the screen with
+one triangle and draws those pixels, lit as if the field were a height, so the fluid gets
+a bright rim where it ends.
+
+The splats and the two blurs are passes of a FrameGraph with a target each, so the three
+targets share the two textures the blur ping-pongs between, and the textures are created
+again for a new window size without anything here keeping track of them.
+
+None of this touches the particles on the CPU. The splats read the same vertex buffer the
+points are drawn from, which the GPU itself writes with --gpu.
+*/
+
+#ifndef _FLUID_SURFACE_H
+#define _FLUID_SURFACE_H
+
+#include "GLIncludes.h"
+#include "FrameUniforms.h"
+#include "FrameGraph.h"
+
+// The splat of a particle reaches this many spacings from its center, so it overlaps its neighbours, and the field inside the
+// fluid adds up to about 1.4.
+#define FLUID_SURFACE_SPLAT_RADIUS 1.0f
+
+// Where the blurred field is above this is inside the fluid. Half of what it is deep inside puts the surface just outside the
+// outermost particles.
+#define FLUID_SURFACE_THRESHOLD 0.5f
+
+// The texture is this many times smaller than the window along each side.
+#define FLUID_SURFACE_DOWNSCALE 2
+
+class FluidSurface
+{
+public:
+	// Builds the programs: the splats from the particle shaders, and the blur and the surface from a fullscreen triangle and the
+	// surface shader. Returns false if any of them doesn't build.
+	bool build(const char* particleVertexFile, const char* particleFragmentFile, const char* fullscreenVertexFile,
+		const char* surfaceFragmentFile);
+
+	// Sizes the textures for a window of width x height. Returns false if the programs didn't build or the textures couldn't be created.
+	bool resize(int width, int height);
+
+	// Splats the count points of vao, which are particles of the given radius in the scene, and blurs them. mvp is where they are
+	// on screen and pixelSize how large a pixel of the window is in the scene. Leaves the framebuffer that was bound, its
+	// viewport and the clear color as they were, but its own view bound to the Frame block. Returns false if the textures can't be
+	// created, and then doesn't try again.
+	bool render(GLuint vao, GLsizei count, const glm::mat4& mvp, float pixelSize, float radius);
+
+	// Binds the blurred field to texture unit 2, where the surface program reads it. It draws 3 vertices from emptyVao(), and gets
+	// the MVP like every other program, since it works out from it where on screen it is.
+	void bindField();
+	GLuint surfaceProgram() const { return drawProgram; }
+	GLuint emptyVao() const { return vao; }
+
+	// Frees everything.
+	void destroy();
+
+	bool valid() const { return fieldTexture != 0; }
+
+private:
+	GLuint splatProgram = 0;
+	GLuint blurProgram = 0;
+	GLuint drawProgram = 0;
+	GLuint vao = 0;
+	FrameGraph graph;
+	GLuint fieldTexture = 0;		// The blurred field of the last render()
+	int fieldWidth = 0;
+	int fieldHeight = 0;
+	bool failed = false;			// Once creating the textures failed, it isn't tried again
+	FrameUniforms frame;			// The splats are a fraction of the size of the window, so their points are too
+
+	GLint splatRadius = -1;
+	GLint blurDirection = -1;
+
+	// What the passes of render() draw.
+	GLuint splatVao = 0;
+	GLsizei splatCount = 0;
+	float splatSize = 0.0f;
+
+	void blur(FrameGraph& frameGraph, int from, int to, bool alongX);
+};
+
+#endif // _FLUID_SURFACE_H
@@ -0,0 +1,131 @@
+/*
+Title: HydroDynamics
+File Name: FrameArena.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A linear allocator for the temporaries of a frame. Allocating moves a pointer forward in
+one block, and reset() at the start of the next frame moves it back, so nothing is ever
+freed on its own and the heap is never touched in the steady state.
+
+If a frame needs more than the block holds, the rest comes from extra blocks on the heap,
+and the next reset() replaces the block with one large enough for the whole frame, so
+only the first frames that need more memory than before allocate anything.
+
+FrameText writes formatted text into an arena, for the HUD and the window title, and
+FrameSpan is an array in one. Only trivially copyable and trivially destructible data
+can live in an arena, since nothing in it is ever destroyed.
+
+Every slot of a TripleBuffer can hold an arena of its own, which is reset when the writer
+fills the slot again. The reader never sees the slot at that time, so that is how data of
+any length crosses from the simulation thread to the render thread without allocating.
+*/
+
+#include "FrameArena.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+FrameArena::FrameArena(size_t capacity) : block(new char[capacity]), blockSize(capacity)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+	delete[] block;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	size_t start = (offset + alignment - 1) & ~(alignment - 1);
+	usedBytes += bytes + (start - offset);
+	peakBytes = std::max(peakBytes, usedBytes);
+	if (start + bytes <= blockSize)
+	{
+		offset = start + bytes;
+		return block + start;
+	}
+
+	// new[] aligns to alignof(std::max_align_t), which is enough for everything but over-aligned types.
+	char* extra = new char[std::max<size_t>(bytes, 1)];
+	overflow.push_back(extra);
+	return extra;
+}
+
+void FrameArena::reset()
+{
+	if (!overflow.empty())
+	{
+		for (char* extra : overflow)
+		{
+			delete[] extra;
+		}
+		overflow.clear();
+		delete[] block;
+		blockSize = std::max(blockSize * 2, peakBytes);
+		block = new char[blockSize];
+	}
+	offset = 0;
+	usedBytes = 0;
+}
+
+FrameText::FrameText(FrameArena& arena, size_t capacity) : arena(arena), capacity(std::max<size_t>(capacity, 1))
+{
+	text = (char*)arena.allocate(this->capacity, 1);
+	text[0] = 0;
+}
+
+void FrameText::append(const char* format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	va_list copy;
+	va_copy(copy, arguments);
+	int written = vsnprintf(text + length, capacity - length, format, arguments);
+	va_end(arguments);
+	if (written < 0)
+	{
+		va_end(copy);
+		text[length] = 0;
+		return;
+	}
+	if (length + written >= capacity)
+	{
+		size_t grown = std::max(capacity * 2, length + written + 1);
+		char* moved = (char*)arena.allocate(grown, 1);
+		memcpy(moved, text, length);
+		text = moved;
+		capacity = grown;
+		vsnprintf(text + length, capacity - length, format, copy);
+	}
+	va_end(copy);
+	length += written;
+}
+
+void FrameText::pop()
+{
+	if (length > 0)
+	{
+		text[--length] = 0;
+	}
+}
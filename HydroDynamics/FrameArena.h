@@ -0,0 +1,142 @@
+/*
+Title: HydroDynamics
+File Name: FrameArena.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A linear allocator for the temporaries of a frame. Allocating moves a pointer forward in
+one block, and reset() at the start of the next frame moves it back, so nothing is ever
+freed on its own and the heap is never touched in the steady state.
+
+If a frame needs more than the block holds, the rest comes from extra blocks on the heap,
+and the next reset() replaces the block with one large enough for the whole frame, so
+only the first frames that need more memory than before allocate anything.
+
+FrameText writes formatted text into an arena, for the HUD and the window title, and
+FrameSpan is an array in one. Only trivially copyable and trivially destructible data
+can live in an arena, since nothing in it is ever destroyed.
+
+Every slot of a TripleBuffer can hold an arena of its own, which is reset when the writer
+fills the slot again. The reader never sees the slot at that time, so that is how data of
+any length crosses from the simulation thread to the render thread without allocating.
+*/
+
+#ifndef _FRAME_ARENA_H
+#define _FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// The size of the block of a new arena. It grows to whatever a frame needed.
+#define FRAME_ARENA_BYTES (64 * 1024)
+
+// count values of T in an arena. Stays valid until the arena is reset.
+template <typename T>
+struct FrameSpan
+{
+	T* data = nullptr;
+	size_t count = 0;
+
+	T* begin() const { return data; }
+	T* end() const { return data + count; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T& operator[](size_t i) const { return data[i]; }
+};
+
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacity = FRAME_ARENA_BYTES);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// Returns bytes of memory aligned to alignment (a power of two), valid until the next reset().
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	template <typename T>
+	FrameSpan<T> allocateSpan(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Nothing in a FrameArena is ever destroyed");
+		FrameSpan<T> span;
+		span.data = count > 0 ? (T*)allocate(count * sizeof(T), alignof(T)) : nullptr;
+		span.count = count;
+		return span;
+	}
+
+	template <typename T>
+	FrameSpan<T> copy(const std::vector<T>& from)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable data can be copied into a FrameArena");
+		FrameSpan<T> span = allocateSpan<T>(from.size());
+		if (span.count > 0)
+		{
+			memcpy(span.data, from.data(), from.size() * sizeof(T));
+		}
+		return span;
+	}
+
+	// Forgets everything allocated since the last reset. If that needed extra blocks, the block grows to hold all of it.
+	void reset();
+
+	// Bytes allocated since the last reset, and the most that was ever allocated between two resets.
+	size_t used() const { return usedBytes; }
+	size_t peak() const { return peakBytes; }
+	size_t capacity() const { return blockSize; }
+
+private:
+	char* block;
+	size_t blockSize;
+	size_t offset = 0;				// In block
+	std::vector<char*> overflow;	// Extra blocks of this frame, freed by reset()
+	size_t usedBytes = 0;
+	size_t peakBytes = 0;
+};
+
+// Text written into an arena with printf() style formats. When it outgrows its memory it moves to more of the arena, which leaves
+// the old memory unused until the reset, so append() is cheap but shouldn't be used for huge texts.
+class FrameText
+{
+public:
+	explicit FrameText(FrameArena& arena, size_t capacity = 256);
+
+	void append(const char* format, ...);
+
+	// The text so far, followed by a 0, so data() can be passed to functions that take a C string.
+	std::string_view view() const { return std::string_view(text, length); }
+	const char* data() const { return text; }
+
+	// Takes the last character off, if there is one.
+	void pop();
+
+private:
+	FrameArena& arena;
+	char* text;
+	size_t length = 0;
+	size_t capacity;
+};
+
+#endif // _FRAME_ARENA_H
@@ -0,0 +1,264 @@
+/*
+Title: HydroDynamics
+File Name: FrameCapture.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Saves screenshots and recordings of the framebuffer without stalling the render loop.
+
+A plain glReadPixels makes the CPU wait until the GPU has finished drawing the frame.
+Instead, the pixels are read into one of a ring of CAPTURE_BUFFERS pixel buffer objects,
+which returns right away, and a fence is placed behind the copy. A few frames later, once
+the fence has signaled, the buffer is mapped and the pixels are handed to a worker thread
+that encodes and writes the file with FreeImage (PNG for 8 bit captures, EXR for floating
+point ones).
+
+If every buffer is still busy, the capture is dropped instead of waiting for one.
+*/
+
+#include "FrameCapture.h"
+#include "FreeImage.h"
+#include "ThreadControl.h"
+#include "Logger.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+
+// A capture that has been read into a pixel buffer and is waiting for the GPU.
+struct CaptureSlot
+{
+	GLuint buffer;
+	GLsync fence;
+	bool busy;
+
+	int width;
+	int height;
+	CaptureFormat format;
+	std::string fileName;
+};
+
+// A capture whose pixels are in memory, waiting to be encoded.
+struct CaptureJob
+{
+	std::vector<unsigned char> pixels;
+	int width;
+	int height;
+	CaptureFormat format;
+	std::string fileName;
+};
+
+static CaptureSlot slots[CAPTURE_BUFFERS];
+static int nextSlot = 0;
+
+static std::thread worker;
+static std::mutex jobMutex;
+static std::condition_variable jobReady;
+static std::deque<CaptureJob> jobs;
+static bool stopping = false;
+
+static int bytesPerPixel(CaptureFormat format)
+{
+	return format == CAPTURE_EXR ? 4 * sizeof(float) : 4;
+}
+
+// Runs on the worker thread. OpenGL puts the bottom row first, which is also how FreeImage stores its rows.
+static void encode(CaptureJob& job)
+{
+	FIBITMAP* bitmap = nullptr;
+	BOOL saved = FALSE;
+
+	if (job.format == CAPTURE_PNG)
+	{
+		// The pixels were read as BGRA, which is the byte order FreeImage uses on little endian machines.
+		bitmap = FreeImage_ConvertFromRawBits(job.pixels.data(), job.width, job.height, job.width * 4, 32,
+			FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+		if (bitmap != nullptr)
+		{
+			saved = FreeImage_Save(FIF_PNG, bitmap, job.fileName.c_str(), PNG_DEFAULT);
+		}
+	}
+	else
+	{
+		bitmap = FreeImage_AllocateT(FIT_RGBAF, job.width, job.height);
+		if (bitmap != nullptr)
+		{
+			size_t rowSize = job.width * bytesPerPixel(CAPTURE_EXR);
+			for (int y = 0; y < job.height; y++)
+			{
+				memcpy(FreeImage_GetScanLine(bitmap, y), job.pixels.data() + y * rowSize, rowSize);
+			}
+			saved = FreeImage_Save(FIF_EXR, bitmap, job.fileName.c_str(), EXR_DEFAULT);
+		}
+	}
+
+	if (!saved)
+	{
+		std::cout << "Failed to save the capture " << job.fileName << std::endl;
+	}
+	if (bitmap != nullptr)
+	{
+		FreeImage_Unload(bitmap);
+	}
+}
+
+static void runWorker()
+{
+	applyThreadRole(THREAD_ROLE_CAPTURE);
+	std::unique_lock<std::mutex> lock(jobMutex);
+	while (true)
+	{
+		jobReady.wait(lock, [] { return stopping || !jobs.empty(); });
+		if (jobs.empty())
+		{
+			// Only stop once everything queued before destroyFrameCapture() is written.
+			return;
+		}
+
+		CaptureJob job = std::move(jobs.front());
+		jobs.pop_front();
+
+		lock.unlock();
+		encode(job);
+		lock.lock();
+	}
+}
+
+void initFrameCapture()
+{
+	for (int i = 0; i < CAPTURE_BUFFERS; i++)
+	{
+		glGenBuffers(1, &slots[i].buffer);
+		slots[i].fence = 0;
+		slots[i].busy = false;
+	}
+	nextSlot = 0;
+
+	stopping = false;
+	worker = std::thread(runWorker);
+}
+
+bool captureFrame(const std::string& fileName, int width, int height, CaptureFormat format)
+{
+	CaptureSlot& slot = slots[nextSlot];
+	if (slot.busy)
+	{
+		LOG_WARNING("Dropped the capture {}, every capture buffer is still busy.", fileName);
+		return false;
+	}
+
+	slot.width = width;
+	slot.height = height;
+	slot.format = format;
+	slot.fileName = fileName;
+
+	// With a pixel pack buffer bound, glReadPixels only queues a copy on the GPU and returns.
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * bytesPerPixel(format), nullptr, GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	if (format == CAPTURE_PNG)
+	{
+		glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	else
+	{
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, nullptr);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.busy = true;
+	nextSlot = (nextSlot + 1) % CAPTURE_BUFFERS;
+	return true;
+}
+
+// Copies a finished slot out of its buffer and queues it for encoding.
+static void finishSlot(CaptureSlot& slot)
+{
+	CaptureJob job;
+	job.width = slot.width;
+	job.height = slot.height;
+	job.format = slot.format;
+	job.fileName = std::move(slot.fileName);
+	job.pixels.resize((size_t)slot.width * slot.height * bytesPerPixel(slot.format));
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+	if (mapped != nullptr)
+	{
+		memcpy(job.pixels.data(), mapped, job.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	slot.busy = false;
+
+	if (mapped == nullptr)
+	{
+		std::cout << "Failed to read back the capture " << job.fileName << std::endl;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back(std::move(job));
+	}
+	jobReady.notify_one();
+}
+
+void updateFrameCapture()
+{
+	for (int i = 0; i < CAPTURE_BUFFERS; i++)
+	{
+		// A timeout of 0 only asks whether the fence has signaled yet, it never waits.
+		if (slots[i].busy && glClientWaitSync(slots[i].fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+		{
+			finishSlot(slots[i]);
+		}
+	}
+}
+
+void destroyFrameCapture()
+{
+	// At shutdown we do want to wait, so captures that were still on the GPU are not lost.
+	for (int i = 0; i < CAPTURE_BUFFERS; i++)
+	{
+		if (slots[i].busy)
+		{
+			glClientWaitSync(slots[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			finishSlot(slots[i]);
+		}
+		glDeleteBuffers(1, &slots[i].buffer);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+	jobReady.notify_one();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+}
@@ -0,0 +1,65 @@
+/*
+Title: HydroDynamics
+File Name: FrameCapture.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Saves screenshots and recordings of the framebuffer without stalling the render loop.
+
+A plain glReadPixels makes the CPU wait until the GPU has finished drawing the frame.
+Instead, the pixels are read into one of a ring of CAPTURE_BUFFERS pixel buffer objects,
+which returns right away, and a fence is placed behind the copy. A few frames later, once
+the fence has signaled, the buffer is mapped and the pixels are handed to a worker thread
+that encodes and writes the file with FreeImage (PNG for 8 bit captures, EXR for floating
+point ones).
+
+If every buffer is still busy, the capture is dropped instead of waiting for one.
+*/
+
+#ifndef _FRAME_CAPTURE_H
+#define _FRAME_CAPTURE_H
+
+#include "GLIncludes.h"
+
+// How many captures can be waiting on the GPU at once.
+#define CAPTURE_BUFFERS 4
+
+enum CaptureFormat
+{
+	CAPTURE_PNG = 0,	// 8 bits per channel
+	CAPTURE_EXR			// 32 bit floats per channel
+};
+
+// Creates the pixel buffers and starts the encoding thread. Needs a current OpenGL context.
+void initFrameCapture();
+
+// Queues a copy of the current framebuffer (width x height pixels) to be saved as fileName. Call after rendering and before swapping.
+// Returns false if the capture had to be dropped because every buffer was still busy.
+bool captureFrame(const std::string& fileName, int width, int height, CaptureFormat format = CAPTURE_PNG);
+
+// Hands every capture the GPU has finished to the encoding thread. Never waits for the GPU. Call once per frame.
+void updateFrameCapture();
+
+// Waits for every queued capture to be written, then frees the buffers and stops the encoding thread.
+void destroyFrameCapture();
+
+#endif // _FRAME_CAPTURE_H
@@ -0,0 +1,244 @@
+/*
+Title: HydroDynamics
+File Name: FrameGraph.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A frame graph: a frame declares the passes it draws and the render targets they read and
+write, and execute() works out what actually has to happen before running any of it.
+
+A pass that has a side effect (it draws into the window, writes a file or feeds a stream)
+always runs. Any other pass only runs if a pass that runs later reads what it writes;
+everything else is culled. So a pass that draws the scene again at the size of the
+screenshots costs nothing on the frames no screenshot is taken, without the caller
+tracking which passes depend on which.
+
+The targets are transient: they only hold something from the first pass that runs with
+them to the last one. What a target of the frame holds at the end stays there until the
+next execute(), for reading back or drawing with, but no longer. That lets two
+targets of the same description whose passes don't overlap share one OffscreenTarget, like
+the ping-pong of a blur, and the OffscreenTargets are kept in a pool from one frame to the
+next, so a frame like the last one creates nothing. A target of the pool that no frame
+needed for FRAME_GRAPH_IDLE_FRAMES executes in a row is freed, so the memory of a capture
+goes back once nobody captures.
+
+A graph is declared anew every frame, on the thread the OpenGL context is current on. The
+passes run in the order they were added, which has to be an order that works; execute()
+doesn't reorder them.
+*/
+
+#include "FrameGraph.h"
+#include "TraceRecorder.h"
+#include <iostream>
+
+int FrameGraph::addTarget(const char* name, const FrameTargetDesc& desc)
+{
+	Target target;
+	target.name = name;
+	target.desc = desc;
+	target.firstPass = -1;
+	target.lastPass = -1;
+	target.pooled = -1;
+	targets.push_back(target);
+	return (int)targets.size() - 1;
+}
+
+int FrameGraph::addPass(const char* name, PassFunction run)
+{
+	// The passes past passCount are the ones of earlier frames, which keep their lists, so declaring the same frame again
+	// allocates nothing.
+	if (passCount == (int)passes.size())
+	{
+		passes.emplace_back();
+	}
+	Pass& pass = passes[passCount++];
+	pass.name = name;
+	pass.run = std::move(run);
+	pass.reads.clear();
+	pass.writes.clear();
+	pass.sideEffect = false;
+	pass.culled = false;
+	return passCount - 1;
+}
+
+void FrameGraph::reads(int pass, int target)
+{
+	passes[pass].reads.push_back(target);
+}
+
+void FrameGraph::writes(int pass, int target)
+{
+	passes[pass].writes.push_back(target);
+}
+
+void FrameGraph::sideEffect(int pass)
+{
+	passes[pass].sideEffect = true;
+}
+
+// Goes through the passes from the last to the first. What a pass that runs reads is needed, and a pass runs if it has a side
+// effect or writes something needed later. Then every target gets the first and last pass that runs with it.
+void FrameGraph::cull()
+{
+	needed.assign(targets.size(), 0);
+	for (int p = passCount - 1; p >= 0; p--)
+	{
+		Pass& pass = passes[p];
+		bool runs = pass.sideEffect;
+		for (int target : pass.writes)
+		{
+			runs = runs || needed[target] != 0;
+		}
+		pass.culled = !runs;
+		if (runs)
+		{
+			for (int target : pass.reads)
+			{
+				needed[target] = 1;
+			}
+		}
+	}
+
+	for (int p = 0; p < passCount; p++)
+	{
+		if (passes[p].culled)
+		{
+			continue;
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			for (int t : i == 0 ? passes[p].reads : passes[p].writes)
+			{
+				Target& target = targets[t];
+				target.firstPass = target.firstPass < 0 ? p : target.firstPass;
+				target.lastPass = p;
+			}
+		}
+	}
+}
+
+// Hands out the OffscreenTargets in the order the targets are first used. One whose last pass came before the first pass of a
+// target is free for it again.
+bool FrameGraph::allocate()
+{
+	for (std::unique_ptr<Pooled>& pooled : pool)
+	{
+		pooled->freeAfter = -1;
+	}
+
+	for (int p = 0; p < passCount; p++)
+	{
+		for (Target& target : targets)
+		{
+			if (target.firstPass != p)
+			{
+				continue;
+			}
+			for (int i = 0; i < (int)pool.size() && target.pooled < 0; i++)
+			{
+				if (pool[i]->desc == target.desc && pool[i]->freeAfter < p)
+				{
+					target.pooled = i;
+				}
+			}
+			if (target.pooled < 0)
+			{
+				std::unique_ptr<Pooled> pooled(new Pooled());
+				pooled->desc = target.desc;
+				const FrameTargetDesc& desc = target.desc;
+				if (!pooled->target.create(desc.width, desc.height, desc.samples, desc.format, desc.sampled, desc.depth))
+				{
+					std::cout << "Can't create the target " << target.name << " of the frame." << std::endl;
+					return false;
+				}
+				pool.push_back(std::move(pooled));
+				target.pooled = (int)pool.size() - 1;
+			}
+			pool[target.pooled]->freeAfter = target.lastPass;
+			pool[target.pooled]->idleFrames = 0;
+		}
+	}
+	return true;
+}
+
+bool FrameGraph::execute()
+{
+	cull();
+	bool allocated = allocate();
+
+	lastRan = 0;
+	lastCulled = 0;
+	for (int p = 0; p < passCount; p++)
+	{
+		Pass& pass = passes[p];
+		if (pass.culled)
+		{
+			lastCulled++;
+		}
+		else if (allocated)
+		{
+			unsigned long long start = traceNow();
+			pass.run(*this);
+			if (traceEnabled())
+			{
+				traceSpan(pass.name, start, traceNow() - start);
+			}
+			lastRan++;
+		}
+	}
+
+	// What no frame needed for a while goes back to the driver.
+	for (size_t i = 0; i < pool.size();)
+	{
+		if (pool[i]->freeAfter < 0 && ++pool[i]->idleFrames > FRAME_GRAPH_IDLE_FRAMES)
+		{
+			pool[i]->target.destroy();
+			pool.erase(pool.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	targets.clear();
+	for (int p = 0; p < passCount; p++)
+	{
+		passes[p].run = nullptr;
+	}
+	passCount = 0;
+	return allocated;
+}
+
+OffscreenTarget& FrameGraph::target(int target)
+{
+	return pool[targets[target].pooled]->target;
+}
+
+void FrameGraph::destroy()
+{
+	for (std::unique_ptr<Pooled>& pooled : pool)
+	{
+		pooled->target.destroy();
+	}
+	pool.clear();
+}
@@ -0,0 +1,150 @@
+/*
+Title: HydroDynamics
+File Name: FrameGraph.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A frame graph: a frame declares the passes it draws and the render targets they read and
+write, and execute() works out what actually has to happen before running any of it.
+
+A pass that has a side effect (it draws into the window, writes a file or feeds a stream)
+always runs. Any other pass only runs if a pass that runs later reads what it writes;
+everything else is culled. So a pass that draws the scene again at the size of the
+screenshots costs nothing on the frames no screenshot is taken, without the caller
+tracking which passes depend on which.
+
+The targets are transient: they only hold something from the first pass that runs with
+them to the last one. What a target of the frame holds at the end stays there until the
+next execute(), for reading back or drawing with, but no longer. That lets two
+targets of the same description whose passes don't overlap share one OffscreenTarget, like
+the ping-pong of a blur, and the OffscreenTargets are kept in a pool from one frame to the
+next, so a frame like the last one creates nothing. A target of the pool that no frame
+needed for FRAME_GRAPH_IDLE_FRAMES executes in a row is freed, so the memory of a capture
+goes back once nobody captures.
+
+A graph is declared anew every frame, on the thread the OpenGL context is current on. The
+passes run in the order they were added, which has to be an order that works; execute()
+doesn't reorder them.
+*/
+
+#ifndef _FRAME_GRAPH_H
+#define _FRAME_GRAPH_H
+
+#include "OffscreenTarget.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+#define FRAME_GRAPH_IDLE_FRAMES 120
+
+// What a target is made of. Targets with the same description can share an OffscreenTarget.
+struct FrameTargetDesc
+{
+	int width = 0;
+	int height = 0;
+	int samples = 1;
+	GLenum format = GL_RGBA8;
+	bool sampled = false;	// Read by a shader, so the finished image is a texture
+	bool depth = false;
+
+	bool operator==(const FrameTargetDesc& other) const
+	{
+		return width == other.width && height == other.height && samples == other.samples && format == other.format
+			&& sampled == other.sampled && depth == other.depth;
+	}
+};
+
+class FrameGraph
+{
+public:
+	typedef std::function<void(FrameGraph&)> PassFunction;
+
+	~FrameGraph() { destroy(); }
+
+	// Declares a target. Returns its number for reads(), writes() and target(). name is kept, so it has to stay valid.
+	int addTarget(const char* name, const FrameTargetDesc& desc);
+
+	// Declares a pass, which run() draws. Returns its number. name is kept, so it has to stay valid.
+	int addPass(const char* name, PassFunction run);
+
+	void reads(int pass, int target);
+	void writes(int pass, int target);
+
+	// Marks a pass as having an effect outside of the graph, so it is never culled.
+	void sideEffect(int pass);
+
+	// Culls the passes nothing needs, gives every target that is used an OffscreenTarget and runs the passes that are left, then
+	// forgets the declarations. Returns false, and runs nothing, if a target can't be created.
+	bool execute();
+
+	// The OffscreenTarget of a target, for the passes that read or write it while they run.
+	OffscreenTarget& target(int target);
+
+	// Frees the pool.
+	void destroy();
+
+	// Of the last execute(): how many passes it ran and culled, and how many OffscreenTargets the pool has.
+	int ranPasses() const { return lastRan; }
+	int culledPasses() const { return lastCulled; }
+	int pooledTargets() const { return (int)pool.size(); }
+
+private:
+	struct Target
+	{
+		const char* name;
+		FrameTargetDesc desc;
+		int firstPass;		// The first and last pass that runs with it, or -1
+		int lastPass;
+		int pooled;			// Its OffscreenTarget in pool, or -1
+	};
+
+	struct Pass
+	{
+		const char* name;
+		PassFunction run;
+		std::vector<int> reads;
+		std::vector<int> writes;
+		bool sideEffect;
+		bool culled;
+	};
+
+	struct Pooled
+	{
+		FrameTargetDesc desc;
+		OffscreenTarget target;
+		int freeAfter;		// The last pass of this frame that uses it, or -1
+		int idleFrames;
+	};
+
+	std::vector<Target> targets;
+	std::vector<char> needed;		// While culling, which targets a pass that runs reads
+	std::vector<Pass> passes;
+	int passCount = 0;
+	std::vector<std::unique_ptr<Pooled>> pool;
+	int lastRan = 0;
+	int lastCulled = 0;
+
+	void cull();
+	bool allocate();
+};
+
+#endif // _FRAME_GRAPH_H
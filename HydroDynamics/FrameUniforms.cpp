@@ -0,0 +1,126 @@
+/*
+Title: HydroDynamics
+File Name: FrameUniforms.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The data every vertex shader of the scene and the UI shares, in a uniform buffer instead of
+uniforms of every program: the MVP matrix, the time and the size of a pixel. The shaders
+declare it as the std140 block Frame, which is bound to FRAME_BLOCK_BINDING.
+
+A frame can draw with a few different MVPs (the scene, the screen space UI, the cells of a
+sweep), and every one of them is a view: a FrameBlock in the buffer. The views are collected
+while the draws are set up, and uploaded with one orphaning glBufferData and one
+glBufferSubData. A draw then only binds the range of its view, which is one call however many
+programs share it, where the uniforms had to be set for every program on its own.
+
+The per-vessel data (the fill levels) don't fit in a uniform buffer once a network has more
+than a few thousand vessels, so they stay in the texture buffer uploadLevels() fills once a
+frame.
+*/
+
+#include "FrameUniforms.h"
+#include <cstring>
+
+static_assert(sizeof(FrameBlock) == 80, "FrameBlock has to match the std140 layout of the Frame block");
+
+bool attachFrameBlock(GLuint program)
+{
+	GLuint index = glGetUniformBlockIndex(program, "Frame");
+	if (index == GL_INVALID_INDEX)
+	{
+		return false;
+	}
+	glUniformBlockBinding(program, index, FRAME_BLOCK_BINDING);
+	return true;
+}
+
+void FrameUniforms::setFrame(float frameTime, float framePointScale)
+{
+	time = frameTime;
+	pointScale = framePointScale;
+}
+
+int FrameUniforms::view(const glm::mat4& mvp)
+{
+	// Only a handful of views come up in a frame, so a search is all it takes.
+	for (int i = 0; i < (int)views.size(); i++)
+	{
+		if (memcmp(&views[i].mvp, &mvp, sizeof(glm::mat4)) == 0)
+		{
+			return i;
+		}
+	}
+	FrameBlock block = {};
+	block.mvp = mvp;
+	views.push_back(block);
+	return (int)views.size() - 1;
+}
+
+void FrameUniforms::upload()
+{
+	if (buffer == 0)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = ((GLsizeiptr)sizeof(FrameBlock) + alignment - 1) / alignment * alignment;
+		glGenBuffers(1, &buffer);
+	}
+	bound = -1;
+	if (views.empty())
+	{
+		return;
+	}
+
+	staging.assign(views.size() * stride, 0);
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		views[i].time = time;
+		views[i].pointScale = pointScale;
+		memcpy(staging.data() + i * stride, &views[i], sizeof(FrameBlock));
+	}
+
+	// Orphaning lets the driver hand out new memory while the draws of the last frame still read the old, instead of waiting for them.
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)staging.size(), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)staging.size(), staging.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	views.clear();
+}
+
+void FrameUniforms::bind(int view)
+{
+	if (view == bound)
+	{
+		return;
+	}
+	bound = view;
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, buffer, view * stride, sizeof(FrameBlock));
+}
+
+void FrameUniforms::destroy()
+{
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	views.clear();
+	bound = -1;
+}
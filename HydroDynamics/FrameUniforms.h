@@ -0,0 +1,96 @@
+/*
+Title: HydroDynamics
+File Name: FrameUniforms.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The data every vertex shader of the scene and the UI shares, in a uniform buffer instead of
+uniforms of every program: the MVP matrix, the time and the size of a pixel. The shaders
+declare it as the std140 block Frame, which is bound to FRAME_BLOCK_BINDING.
+
+A frame can draw with a few different MVPs (the scene, the screen space UI, the cells of a
+sweep), and every one of them is a view: a FrameBlock in the buffer. The views are collected
+while the draws are set up, and uploaded with one orphaning glBufferData and one
+glBufferSubData. A draw then only binds the range of its view, which is one call however many
+programs share it, where the uniforms had to be set for every program on its own.
+
+The per-vessel data (the fill levels) don't fit in a uniform buffer once a network has more
+than a few thousand vessels, so they stay in the texture buffer uploadLevels() fills once a
+frame.
+*/
+
+#ifndef _FRAME_UNIFORMS_H
+#define _FRAME_UNIFORMS_H
+
+#include "GLIncludes.h"
+
+// The binding point of the Frame block. 0 is the Parameters block of the compute shaders.
+#define FRAME_BLOCK_BINDING 1
+
+// The Frame block of the shaders, laid out as std140 lays it out.
+struct FrameBlock
+{
+	glm::mat4 mvp;
+	float time;				// Seconds since the start, for anything that moves by itself
+	float pointScale;		// Pixels per unit of the scene, for points that keep their size in the scene
+	float pad[2];
+};
+
+// Connects the Frame block of program to FRAME_BLOCK_BINDING. Returns false if the program has no such block. Programs remember
+// it, so this is needed once after linking.
+bool attachFrameBlock(GLuint program);
+
+class FrameUniforms
+{
+public:
+	FrameUniforms() {}
+	~FrameUniforms() {}
+
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+	// Sets what every view of the next upload shares.
+	void setFrame(float time, float pointScale);
+
+	// Returns the view with this MVP, adding it if there isn't one yet since the last upload.
+	int view(const glm::mat4& mvp);
+
+	// Uploads the views collected since the last upload and forgets which one is bound.
+	void upload();
+
+	// Binds a view that was uploaded, unless it is bound already.
+	void bind(int view);
+
+	// Frees the buffer. Needs the context it was made in, or one sharing with it.
+	void destroy();
+
+private:
+	std::vector<FrameBlock> views;
+	std::vector<unsigned char> staging;
+	float time = 0.0f;
+	float pointScale = 1.0f;
+	GLuint buffer = 0;
+	GLsizeiptr stride = 0;		// sizeof(FrameBlock) rounded up to the alignment the driver wants for a bound range
+	int bound = -1;
+};
+
+#endif // _FRAME_UNIFORMS_H
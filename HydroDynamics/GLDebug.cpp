@@ -0,0 +1,193 @@
+/*
+Title: HydroDynamics
+File Name: GLDebug.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Diagnostics for OpenGL errors in development builds, at no cost in release builds.
+
+With KHR_debug (core since OpenGL 4.3, and offered by most 4.0 drivers as an extension), the
+driver reports errors, undefined behavior and performance problems to a callback as they
+happen, with a message saying what was wrong. Debug builds create a debug context and turn
+the callback on; release builds only do with --gl-debug. Messages go to the log (see
+Logger.h) at a level that follows their severity. Notifications are filtered out, as are a
+few informational messages drivers send all the time, and a message that keeps coming is
+only logged GL_DEBUG_REPEAT_LIMIT times.
+
+Drivers without KHR_debug only have glGetError(). GL_CHECK(call) makes a call and then asks
+glGetError() whether it failed, and GL_CHECK_ERRORS(where) asks at one point whether
+anything since the last check failed. In release builds GL_CHECK(call) is only the call and
+GL_CHECK_ERRORS() is nothing, unless GL_DEBUG_CHECKS is defined.
+*/
+
+#include "GLDebug.h"
+#include "Logger.h"
+#include <atomic>
+#include <mutex>
+
+// Messages some drivers send all the time that say nothing is wrong: where a buffer lives, that a shader is recompiled for
+// the current state, and that a texture has no mipmaps.
+static const GLuint ignoredIds[] = { 131169, 131185, 131204, 131218 };
+
+// How often every message was logged. A small table, since only a handful of different messages ever come.
+#define REPEAT_TABLE 64
+static std::mutex repeatLock;
+static GLuint repeatIds[REPEAT_TABLE];
+static int repeatCounts[REPEAT_TABLE];
+static int repeatUsed = 0;
+
+static const char* sourceName(GLenum source)
+{
+	switch (source)
+	{
+	case GL_DEBUG_SOURCE_API: return "api";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+static const char* typeName(GLenum type)
+{
+	switch (type)
+	{
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+// Counts a message, and returns how often it came before (a message that doesn't fit in the table any more counts as dropped).
+static int repeats(GLuint id)
+{
+	std::lock_guard<std::mutex> lock(repeatLock);
+	for (int i = 0; i < repeatUsed; i++)
+	{
+		if (repeatIds[i] == id)
+		{
+			return repeatCounts[i]++;
+		}
+	}
+	if (repeatUsed == REPEAT_TABLE)
+	{
+		return GL_DEBUG_REPEAT_LIMIT + 1;
+	}
+	repeatIds[repeatUsed] = id;
+	repeatCounts[repeatUsed] = 1;
+	repeatUsed++;
+	return 0;
+}
+
+// The driver may call this on any of its threads, unless the output is synchronous.
+static void GLAPIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message,
+	const void* userParam)
+{
+	(void)length;
+	(void)userParam;
+	int count = repeats(id);
+	if (count > GL_DEBUG_REPEAT_LIMIT)
+	{
+		return;
+	}
+	if (count == GL_DEBUG_REPEAT_LIMIT)
+	{
+		LOG_WARNING("GL {} {} {}: repeated {} times, not logging it anymore", sourceName(source), typeName(type), id, count);
+		return;
+	}
+
+	if (severity == GL_DEBUG_SEVERITY_HIGH || type == GL_DEBUG_TYPE_ERROR)
+	{
+		LOG_ERROR("GL {} {} {}: {}", sourceName(source), typeName(type), id, message);
+	}
+	else if (severity == GL_DEBUG_SEVERITY_MEDIUM)
+	{
+		LOG_WARNING("GL {} {} {}: {}", sourceName(source), typeName(type), id, message);
+	}
+	else
+	{
+		LOG_INFO("GL {} {} {}: {}", sourceName(source), typeName(type), id, message);
+	}
+}
+
+void requestGlDebugContext()
+{
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+}
+
+bool enableGlDebugOutput(bool synchronous)
+{
+	if (!GLEW_KHR_debug && !GLEW_VERSION_4_3)
+	{
+		return false;
+	}
+
+	glEnable(GL_DEBUG_OUTPUT);
+	if (synchronous)
+	{
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	glDebugMessageCallback(debugMessage, nullptr);
+
+	// Everything but the notifications, and none of the messages that never mean anything.
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DONT_CARE, GL_DONT_CARE, (GLsizei)(sizeof(ignoredIds) / sizeof(ignoredIds[0])), ignoredIds,
+		GL_FALSE);
+	return true;
+}
+
+static const char* errorName(GLenum error)
+{
+	switch (error)
+	{
+	case GL_INVALID_ENUM: return "GL_INVALID_ENUM";
+	case GL_INVALID_VALUE: return "GL_INVALID_VALUE";
+	case GL_INVALID_OPERATION: return "GL_INVALID_OPERATION";
+	case GL_INVALID_FRAMEBUFFER_OPERATION: return "GL_INVALID_FRAMEBUFFER_OPERATION";
+	case GL_OUT_OF_MEMORY: return "GL_OUT_OF_MEMORY";
+	case GL_STACK_UNDERFLOW: return "GL_STACK_UNDERFLOW";
+	case GL_STACK_OVERFLOW: return "GL_STACK_OVERFLOW";
+	default: return "unknown error";
+	}
+}
+
+bool checkGlErrors(const char* where, const char* file, int line)
+{
+	// Errors queue up until they are read, one per kind. A context that was lost keeps returning GL_CONTEXT_LOST, so stop after a few.
+	bool clean = true;
+	for (int i = 0; i < 8; i++)
+	{
+		GLenum error = glGetError();
+		if (error == GL_NO_ERROR)
+		{
+			break;
+		}
+		LOG_ERROR("{} after {} ({}:{})", errorName(error), where, file, line);
+		clean = false;
+	}
+	return clean;
+}
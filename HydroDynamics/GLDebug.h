@@ -0,0 +1,72 @@
+/*
+Title: HydroDynamics
+File Name: GLDebug.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Diagnostics for OpenGL errors in development builds, at no cost in release builds.
+
+With KHR_debug (core since OpenGL 4.3, and offered by most 4.0 drivers as an extension), the
+driver reports errors, undefined behavior and performance problems to a callback as they
+happen, with a message saying what was wrong. Debug builds create a debug context and turn
+the callback on; release builds only do with --gl-debug. Messages go to the log (see
+Logger.h) at a level that follows their severity. Notifications are filtered out, as are a
+few informational messages drivers send all the time, and a message that keeps coming is
+only logged GL_DEBUG_REPEAT_LIMIT times.
+
+Drivers without KHR_debug only have glGetError(). GL_CHECK(call) makes a call and then asks
+glGetError() whether it failed, and GL_CHECK_ERRORS(where) asks at one point whether
+anything since the last check failed. In release builds GL_CHECK(call) is only the call and
+GL_CHECK_ERRORS() is nothing, unless GL_DEBUG_CHECKS is defined.
+*/
+
+#ifndef _GL_DEBUG_H
+#define _GL_DEBUG_H
+
+#include "GLIncludes.h"
+
+// How many times the same message is logged before the rest of them are dropped.
+#define GL_DEBUG_REPEAT_LIMIT 10
+
+#if defined(_DEBUG) && !defined(GL_DEBUG_CHECKS)
+#define GL_DEBUG_CHECKS
+#endif
+
+// Asks for a debug context for the windows created from now on. Call before glfwCreateWindow().
+void requestGlDebugContext();
+
+// Installs the callback in the current context, if the driver has KHR_debug. Returns false if it doesn't. synchronous makes the
+// driver report a message before the call that caused it returns, so a breakpoint in the callback stops on that call.
+bool enableGlDebugOutput(bool synchronous);
+
+// Logs every error glGetError() has queued, with where it was noticed. Returns false if there was one.
+bool checkGlErrors(const char* where, const char* file, int line);
+
+#ifdef GL_DEBUG_CHECKS
+#define GL_CHECK(call) do { call; checkGlErrors(#call, __FILE__, __LINE__); } while (0)
+#define GL_CHECK_ERRORS(where) checkGlErrors(where, __FILE__, __LINE__)
+#else
+#define GL_CHECK(call) call
+#define GL_CHECK_ERRORS(where) ((void)0)
+#endif
+
+#endif // _GL_DEBUG_H
@@ -44,33 +44,71 @@ recalculates when the object's orientation changes, simply uncomment the rotate
 #include <vector>
 #include <string>
 #include <algorithm>
-#include "GL\glew.h"
-#include "glfw\glfw3.h"
-#include "glm\glm.hpp"
-#include "glm\gtc\matrix_transform.hpp"
-#include "glm\gtc\type_ptr.hpp"
-#include "glm\gtc\quaternion.hpp"
-#include "glm\gtx\quaternion.hpp"
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtx/quaternion.hpp"
 
 // We create a VertexFormat struct, which defines how the data passed into the shader code wil be formatted
 struct VertexFormat
 {
 	glm::vec4 color;	// A vector4 for color has 4 floats: red, green, blue, and alpha
 	glm::vec3 position;	// A vector3 for position has 3 float: x, y, and z coordinates
+	float level;		// 1 + the vessel whose fill level the vertex shader adds to y, or 0 for none
 
 	// Default constructor
 	VertexFormat()
 	{
 		color = glm::vec4(0.0f);
 		position = glm::vec3(0.0f);
+		level = 0.0f;
 	}
 
 	// Constructor
-	VertexFormat(const glm::vec3 &pos, const glm::vec4 &iColor)
+	VertexFormat(const glm::vec3 &pos, const glm::vec4 &iColor, float iLevel = 0.0f)
 	{
 		position = pos;
 		color = iColor;
+		level = iLevel;
 	}
 };
 
+// A smaller vertex for the scene, which is flat and has far more vertices than anything else: x and y as half floats (z is left
+// out, so the shader gets 0) and the color as 4 normalized bytes. 12 bytes instead of the 32 of a VertexFormat. Set up the
+// attributes of an array of them with setPackedVertexAttributes().
+struct PackedVertex
+{
+	unsigned int position;	// glm::packHalf2x16 of x and y
+	unsigned int color;		// glm::packUnorm4x8 of the color, red in the lowest byte
+	float level;			// The same as VertexFormat::level
+
+	PackedVertex()
+	{
+		position = 0;
+		color = 0;
+		level = 0.0f;
+	}
+
+	PackedVertex(const glm::vec2 &pos, const glm::vec4 &iColor, float iLevel = 0.0f)
+	{
+		position = glm::packHalf2x16(pos);
+		color = glm::packUnorm4x8(iColor);
+		level = iLevel;
+	}
+};
+
+// Points attributes 0 (position), 1 (color) and 2 (level) of the bound vertex array at the PackedVertex array in the bound buffer.
+inline void setPackedVertexAttributes()
+{
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, color));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, level));
+}
+
 #endif _GL_INCLUDES_H
\ No newline at end of file
@@ -0,0 +1,403 @@
+/*
+Title: HydroDynamics
+File Name: GLState.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A thin layer in front of the OpenGL calls that change state, which remembers what every
+context has bound and set and leaves out the calls that wouldn't change anything. The render
+passes each set what they need without knowing what the pass before them left behind, and
+most of those calls are the same from frame to frame (the clear color, the program of the
+scene, the depth test), which the driver would otherwise have to check every time.
+
+Every call counts as a request, and the ones that reach the driver as changes. The counts of
+the last frame are shown on the HUD and, while tracing, recorded as counters.
+
+Every context has a cache of its own, which is switched with makeContextCurrent() (use it
+instead of glfwMakeContextCurrent() for the contexts that draw). A cache only knows what went
+through it: it starts out knowing nothing, so the first call of every kind reaches the
+driver. Objects have to be deleted through it as well, because GL unbinds a deleted object
+and can hand its name to a new one. Code that changes the state some other way calls
+forgetGlState() afterwards.
+*/
+
+#include "GLState.h"
+#include <mutex>
+
+// The capabilities that are cached. Any other one goes straight to the driver.
+static const GLenum cachedCapabilities[] = { GL_DEPTH_TEST, GL_BLEND, GL_SCISSOR_TEST, GL_CULL_FACE, GL_RASTERIZER_DISCARD,
+	GL_PROGRAM_POINT_SIZE, GL_MULTISAMPLE, GL_FRAMEBUFFER_SRGB };
+#define CAPABILITY_COUNT (int)(sizeof(cachedCapabilities) / sizeof(cachedCapabilities[0]))
+
+// The texture targets that are cached per unit.
+static const GLenum cachedTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_BUFFER, GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_2D_ARRAY };
+#define TARGET_COUNT (int)(sizeof(cachedTargets) / sizeof(cachedTargets[0]))
+
+// A value of the cache together with whether it is known at all.
+template <typename T>
+struct Known
+{
+	T value{};
+	bool known = false;
+
+	// Returns true if value is something else than what is known, and remembers it.
+	bool set(const T& newValue)
+	{
+		if (known && value == newValue)
+		{
+			return false;
+		}
+		value = newValue;
+		known = true;
+		return true;
+	}
+};
+
+struct GlStateCache
+{
+	Known<GLuint> program;
+	Known<GLuint> vao;
+	Known<GLuint> drawFramebuffer;
+	Known<GLuint> readFramebuffer;
+	Known<GLenum> activeUnit;
+	Known<GLuint> textures[GL_STATE_TEXTURE_UNITS][TARGET_COUNT];
+	Known<bool> capabilities[CAPABILITY_COUNT];
+	Known<glm::vec4> clearColor;
+	Known<GLfloat> pointSize;
+	Known<GLfloat> lineWidth;
+	Known<glm::ivec4> viewport;
+	Known<glm::uvec2> blendFunc;
+	Known<GLboolean> depthMask;
+};
+
+// The caches of every context. Only makeContextCurrent() and forgetGlContext() look at the list, and only the thread a context is
+// current on uses its cache.
+static std::mutex contextLock;
+static std::vector<std::pair<GLFWwindow*, GlStateCache*>> contexts;
+static thread_local GlStateCache* current = nullptr;
+
+static thread_local GlStateCounts counts = { 0, 0 };
+static thread_local GlStateCounts lastCounts = { 0, 0 };
+
+void makeContextCurrent(GLFWwindow* window)
+{
+	glfwMakeContextCurrent(window);
+	current = nullptr;
+	if (window == nullptr)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(contextLock);
+	for (const std::pair<GLFWwindow*, GlStateCache*>& context : contexts)
+	{
+		if (context.first == window)
+		{
+			current = context.second;
+			return;
+		}
+	}
+	current = new GlStateCache();
+	contexts.push_back({ window, current });
+}
+
+void forgetGlContext(GLFWwindow* window)
+{
+	std::lock_guard<std::mutex> lock(contextLock);
+	for (size_t i = 0; i < contexts.size(); i++)
+	{
+		if (contexts[i].first == window)
+		{
+			if (current == contexts[i].second)
+			{
+				current = nullptr;
+			}
+			delete contexts[i].second;
+			contexts.erase(contexts.begin() + i);
+			return;
+		}
+	}
+}
+
+void forgetGlState()
+{
+	if (current != nullptr)
+	{
+		*current = GlStateCache();
+	}
+}
+
+// Counts a request, and returns whether it has to reach the driver: always without a cache, otherwise if it changes value.
+template <typename T>
+static bool changes(Known<T> GlStateCache::* member, const T& value)
+{
+	counts.requests++;
+	if (current != nullptr && !((current->*member).set(value)))
+	{
+		return false;
+	}
+	counts.changes++;
+	return true;
+}
+
+static bool changes(Known<GLuint>& entry, GLuint value)
+{
+	counts.requests++;
+	if (!entry.set(value))
+	{
+		return false;
+	}
+	counts.changes++;
+	return true;
+}
+
+static int capabilityIndex(GLenum capability)
+{
+	for (int i = 0; i < CAPABILITY_COUNT; i++)
+	{
+		if (cachedCapabilities[i] == capability)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int targetIndex(GLenum target)
+{
+	for (int i = 0; i < TARGET_COUNT; i++)
+	{
+		if (cachedTargets[i] == target)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+void cachedUseProgram(GLuint program)
+{
+	if (changes(&GlStateCache::program, program))
+	{
+		glUseProgram(program);
+	}
+}
+
+void cachedBindVertexArray(GLuint vao)
+{
+	if (changes(&GlStateCache::vao, vao))
+	{
+		glBindVertexArray(vao);
+	}
+}
+
+void cachedBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	// GL_FRAMEBUFFER binds both, so it is a change if either of them changes.
+	counts.requests++;
+	bool changed = current == nullptr;
+	if (current != nullptr)
+	{
+		if (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER)
+		{
+			changed |= current->drawFramebuffer.set(framebuffer);
+		}
+		if (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER)
+		{
+			changed |= current->readFramebuffer.set(framebuffer);
+		}
+	}
+	if (changed)
+	{
+		counts.changes++;
+		glBindFramebuffer(target, framebuffer);
+	}
+}
+
+void cachedActiveTexture(GLenum unit)
+{
+	if (changes(&GlStateCache::activeUnit, unit))
+	{
+		glActiveTexture(unit);
+	}
+}
+
+void cachedBindTexture(GLenum target, GLuint texture)
+{
+	// Without knowing the unit, there is no telling whether the bind changes anything.
+	int targetSlot = targetIndex(target);
+	int unit = current != nullptr && current->activeUnit.known ? (int)(current->activeUnit.value - GL_TEXTURE0) : -1;
+	if (targetSlot < 0 || unit < 0 || unit >= GL_STATE_TEXTURE_UNITS)
+	{
+		counts.requests++;
+		counts.changes++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (changes(current->textures[unit][targetSlot], texture))
+	{
+		glBindTexture(target, texture);
+	}
+}
+
+static void setCapability(GLenum capability, bool enabled)
+{
+	int index = capabilityIndex(capability);
+	counts.requests++;
+	if (index >= 0 && current != nullptr && !current->capabilities[index].set(enabled))
+	{
+		return;
+	}
+	counts.changes++;
+	enabled ? glEnable(capability) : glDisable(capability);
+}
+
+void cachedEnable(GLenum capability)
+{
+	setCapability(capability, true);
+}
+
+void cachedDisable(GLenum capability)
+{
+	setCapability(capability, false);
+}
+
+void cachedClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	if (changes(&GlStateCache::clearColor, glm::vec4(red, green, blue, alpha)))
+	{
+		glClearColor(red, green, blue, alpha);
+	}
+}
+
+void cachedPointSize(GLfloat size)
+{
+	if (changes(&GlStateCache::pointSize, size))
+	{
+		glPointSize(size);
+	}
+}
+
+void cachedLineWidth(GLfloat width)
+{
+	if (changes(&GlStateCache::lineWidth, width))
+	{
+		glLineWidth(width);
+	}
+}
+
+void cachedViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (changes(&GlStateCache::viewport, glm::ivec4(x, y, width, height)))
+	{
+		glViewport(x, y, width, height);
+	}
+}
+
+void cachedBlendFunc(GLenum source, GLenum destination)
+{
+	if (changes(&GlStateCache::blendFunc, glm::uvec2(source, destination)))
+	{
+		glBlendFunc(source, destination);
+	}
+}
+
+void cachedDepthMask(GLboolean enabled)
+{
+	if (changes(&GlStateCache::depthMask, enabled))
+	{
+		glDepthMask(enabled);
+	}
+}
+
+// A deleted program stays in use until another one is, but its name can be handed out again, so the cache can't tell the two apart.
+void cachedDeleteProgram(GLuint program)
+{
+	glDeleteProgram(program);
+	if (current != nullptr && current->program.value == program)
+	{
+		current->program.known = false;
+	}
+}
+
+// Deleting a bound vertex array, framebuffer or texture binds 0 in its place.
+void cachedDeleteVertexArrays(GLsizei count, const GLuint* vaos)
+{
+	glDeleteVertexArrays(count, vaos);
+	for (GLsizei i = 0; current != nullptr && i < count; i++)
+	{
+		if (current->vao.value == vaos[i])
+		{
+			current->vao.value = 0;
+		}
+	}
+}
+
+void cachedDeleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+{
+	glDeleteFramebuffers(count, framebuffers);
+	for (GLsizei i = 0; current != nullptr && i < count; i++)
+	{
+		if (current->drawFramebuffer.value == framebuffers[i])
+		{
+			current->drawFramebuffer.value = 0;
+		}
+		if (current->readFramebuffer.value == framebuffers[i])
+		{
+			current->readFramebuffer.value = 0;
+		}
+	}
+}
+
+void cachedDeleteTextures(GLsizei count, const GLuint* textures)
+{
+	glDeleteTextures(count, textures);
+	for (GLsizei i = 0; current != nullptr && i < count; i++)
+	{
+		for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+		{
+			for (int target = 0; target < TARGET_COUNT; target++)
+			{
+				if (current->textures[unit][target].value == textures[i])
+				{
+					current->textures[unit][target].value = 0;
+				}
+			}
+		}
+	}
+}
+
+GlStateCounts glStateCounts()
+{
+	return counts;
+}
+
+GlStateCounts lastGlStateFrame()
+{
+	return lastCounts;
+}
+
+void endGlStateFrame()
+{
+	lastCounts = counts;
+	counts = { 0, 0 };
+}
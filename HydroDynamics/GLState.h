@@ -0,0 +1,91 @@
+/*
+Title: HydroDynamics
+File Name: GLState.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A thin layer in front of the OpenGL calls that change state, which remembers what every
+context has bound and set and leaves out the calls that wouldn't change anything. The render
+passes each set what they need without knowing what the pass before them left behind, and
+most of those calls are the same from frame to frame (the clear color, the program of the
+scene, the depth test), which the driver would otherwise have to check every time.
+
+Every call counts as a request, and the ones that reach the driver as changes. The counts of
+the last frame are shown on the HUD and, while tracing, recorded as counters.
+
+Every context has a cache of its own, which is switched with makeContextCurrent() (use it
+instead of glfwMakeContextCurrent() for the contexts that draw). A cache only knows what went
+through it: it starts out knowing nothing, so the first call of every kind reaches the
+driver. Objects have to be deleted through it as well, because GL unbinds a deleted object
+and can hand its name to a new one. Code that changes the state some other way calls
+forgetGlState() afterwards.
+*/
+
+#ifndef _GL_STATE_H
+#define _GL_STATE_H
+
+#include "GLIncludes.h"
+
+// Texture units the cache keeps track of. Binds on units beyond it always reach the driver.
+#define GL_STATE_TEXTURE_UNITS 8
+
+struct GlStateCounts
+{
+	int requests;	// Calls to the functions below
+	int changes;	// Of those, the ones that reached the driver
+};
+
+// Makes window's context current on the calling thread together with its cache, which is created the first time. Pass nullptr to
+// release the context.
+void makeContextCurrent(GLFWwindow* window);
+
+// Drops the cache of a context that is about to be destroyed. Its pointer might be reused for a new window.
+void forgetGlContext(GLFWwindow* window);
+
+// Forgets everything about the current context, so the next call of every kind reaches the driver again.
+void forgetGlState();
+
+void cachedUseProgram(GLuint program);
+void cachedBindVertexArray(GLuint vao);
+void cachedBindFramebuffer(GLenum target, GLuint framebuffer);
+void cachedActiveTexture(GLenum unit);
+void cachedBindTexture(GLenum target, GLuint texture);
+void cachedEnable(GLenum capability);
+void cachedDisable(GLenum capability);
+void cachedClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+void cachedPointSize(GLfloat size);
+void cachedLineWidth(GLfloat width);
+void cachedViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void cachedBlendFunc(GLenum source, GLenum destination);
+void cachedDepthMask(GLboolean enabled);
+
+void cachedDeleteProgram(GLuint program);
+void cachedDeleteVertexArrays(GLsizei count, const GLuint* vaos);
+void cachedDeleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+void cachedDeleteTextures(GLsizei count, const GLuint* textures);
+
+// The counts of the calling thread since the last endGlStateFrame(), and of the frame that call ended.
+GlStateCounts glStateCounts();
+GlStateCounts lastGlStateFrame();
+void endGlStateFrame();
+
+#endif // _GL_STATE_H
@@ -0,0 +1,490 @@
+/*
+Title: HydroDynamics
+File Name: GpuNetwork.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Steps a VesselNetwork on the GPU with OpenGL 4.3 compute shaders, for networks so large
+that the CPU can't step them at the physics rate.
+
+The state of the network lives in shader storage buffers, one per array of the network, and
+never leaves the GPU: a step is three dispatches of the shaders compiled from
+NetworkCompute.glsl (the pressures, the flows of the tubes and the gather into the
+vessels), with one invocation per vessel or tube, just like the phases of
+VesselNetwork::update(). Every vessel gathers its own tubes, so nothing needs atomics and a
+step gives the same result every time it runs on the same GPU. It isn't bit for bit the
+CPU step, since the GPU is free to fuse multiplies and adds. Unlike the CPU step, every
+component is stepped whether it is asleep or not, which costs the GPU next to nothing.
+
+The buffer of the top edges is the one the renderer draws the fill levels from, so nothing
+is copied to or from the CPU to show a step. What does come back every step is whether
+anything moved and the heights and pressures of the first few vessels (for the HUD and the
+plots), which waits for the GPU to finish the step, like GpuParticleFluid does. Anything
+that needs the whole state on the CPU (checkpoints, the live export, the remote viewers) calls
+readBack() first, and anything that changes it there calls load() afterwards. The external
+pressures are sent again every step wherever they changed.
+
+Statistics over the whole network (its volume, the highest pressure, the range of the
+heights and a histogram of them) are reduced on the GPU instead, by two more passes, so
+only a few bytes come back. requestStatistics() queues the passes and a copy of their
+result into one of GPU_NETWORK_STATISTICS_SLOTS small buffers, with a fence behind it, and
+pollStatistics() picks the result up a frame or so later, once the fence has signaled.
+Neither of them waits for the GPU.
+
+Telemetry records the heights and pressures of every vessel after every step, which is too
+much to wait for every step. queueState() has the GPU copy them into one of
+GPU_NETWORK_STATE_SLOTS buffers of their own, behind a fence, along with a copy of the
+external pressures the step had, and takeStates() hands every copy whose fence has signaled
+on, oldest first, so the steps arrive in order a few steps late. A buffer is only mapped
+once its copy is done, so mapping it never waits, and the consumer reads straight from the
+mapping. If all of them are still on their way, queueState() waits for the oldest, which is
+what keeps a slow bus from dropping steps.
+
+All buffers are ordinary OpenGL objects, so they can be shared with the renderer's context
+when update() runs on a different thread.
+*/
+
+#include "GpuNetwork.h"
+#include "GLState.h"
+#include "VesselNetwork.h"
+#include "Shaders.h"
+#include <algorithm>
+#include <cstring>
+
+// The names of the blocks in NetworkCompute.glsl, in the order of Role.
+static const char* blockNames[] =
+{
+	"Height", "Pressure", "ExternalPressure", "DrainShare", "TubeA", "TubeB", "InvInertance", "Damping", "Stiffness", "Flow", "Moved",
+	"Change", "Width", "Bottom", "Top", "TubeStart", "TubeList", "Partials", "Statistics"
+};
+
+bool GpuNetwork::build(VesselNetwork& network, const char* shaderFile, int watchedVessels)
+{
+	if (!GLEW_VERSION_4_3)
+	{
+		std::cout << "Stepping the network on the GPU needs OpenGL 4.3, this driver has " << glGetString(GL_VERSION) << "." << std::endl;
+		return false;
+	}
+	if (network.layered() || network.profiled() || network.hasComponents() || network.drainLimit != DRAIN_EVEN)
+	{
+		std::cout << "A layered or profiled network, or one with tube components or outflow drain limits, can't be stepped on the GPU." << std::endl;
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(shaderFile))
+	{
+		return false;
+	}
+	std::string source(file.view());
+	for (int pass = 0; pass < GPU_NETWORK_PASS_COUNT; pass++)
+	{
+		passes[pass].program = compilePass(source, pass);
+		if (passes[pass].program == 0)
+		{
+			std::cout << "Pass " << pass << " of " << shaderFile << " failed to build." << std::endl;
+			destroy();
+			return false;
+		}
+	}
+
+	if (network.topologyDirty)
+	{
+		network.rebuildTopology();
+	}
+	vessels = network.vesselCount();
+	tubes = network.tubeCount();
+	watched = std::min(watchedVessels, vessels);
+
+	buffers[ROLE_HEIGHT] = createBuffer(sizeof(float) * vessels, network.height.data());
+	buffers[ROLE_PRESSURE] = createBuffer(sizeof(float) * vessels, network.pressure.data());
+	buffers[ROLE_EXTERNAL_PRESSURE] = createBuffer(sizeof(float) * vessels, network.externalPressure.data());
+	buffers[ROLE_DRAIN_SHARE] = createBuffer(sizeof(float) * vessels, network.drainShare.data());
+	buffers[ROLE_WIDTH] = createBuffer(sizeof(float) * vessels, network.width.data());
+	buffers[ROLE_BOTTOM] = createBuffer(sizeof(float) * vessels, network.bottom.data());
+	buffers[ROLE_TOP] = createBuffer(sizeof(float) * vessels, network.top.data());
+	buffers[ROLE_TUBE_A] = createBuffer(sizeof(int) * tubes, network.tubeA.data());
+	buffers[ROLE_TUBE_B] = createBuffer(sizeof(int) * tubes, network.tubeB.data());
+	buffers[ROLE_INV_INERTANCE] = createBuffer(sizeof(float) * tubes, network.tubeInvInertance.data());
+	buffers[ROLE_DAMPING] = createBuffer(sizeof(float) * tubes, network.tubeDamping.data());
+	buffers[ROLE_STIFFNESS] = createBuffer(sizeof(float) * tubes, network.tubeStiffness.data());
+	buffers[ROLE_FLOW] = createBuffer(sizeof(float) * tubes, network.tubeFlow.data());
+	buffers[ROLE_CHANGE] = createBuffer(sizeof(float) * tubes, nullptr);
+	buffers[ROLE_MOVED] = createBuffer(sizeof(GLuint), nullptr);
+	buffers[ROLE_TUBE_START] = createBuffer(sizeof(int) * network.vesselTubeStart.size(), network.vesselTubeStart.data());
+	buffers[ROLE_TUBE_LIST] = createBuffer(sizeof(int) * network.vesselTubes.size(), network.vesselTubes.data());
+	int groups = (vessels + GPU_NETWORK_GROUP_SIZE - 1) / GPU_NETWORK_GROUP_SIZE;
+	buffers[ROLE_PARTIALS] = createBuffer(4 * sizeof(float) * groups, nullptr);
+	buffers[ROLE_STATISTICS] = createBuffer(sizeof(GpuNetworkStatistics), nullptr);
+	sentExternal = network.externalPressure;
+
+	parameters.restFlow = REST_FLOW;
+	parameters.vesselCount = vessels;
+	parameters.tubeCount = tubes;
+	parameters.histogramTop = std::max(vessels > 0 ? *std::max_element(network.height.begin(), network.height.end()) : 0.0f, REST_HEIGHT);
+	glGenBuffers(1, &parameterBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, parameterBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(parameters), &parameters, GL_DYNAMIC_DRAW);
+	return true;
+}
+
+GLuint GpuNetwork::compilePass(const std::string& source, int pass)
+{
+	// The defines go right after the #version line, which has to come first. #line keeps the line numbers of errors the same as in
+	// the file.
+	size_t version = source.find("#version");
+	size_t afterVersion = version == std::string::npos ? std::string::npos : source.find('\n', version);
+	if (afterVersion == std::string::npos)
+	{
+		std::cout << "The network shader has no #version line." << std::endl;
+		return 0;
+	}
+	afterVersion++;
+	int nextLine = (int)std::count(source.begin(), source.begin() + afterVersion, '\n') + 1;
+
+	std::string defines = "#define PASS " + std::to_string(pass) + "\n"
+		+ "#define GROUP_SIZE " + std::to_string(GPU_NETWORK_GROUP_SIZE) + "\n"
+		+ "#line " + std::to_string(nextLine) + "\n";
+	std::string code = source.substr(0, afterVersion) + defines + source.substr(afterVersion);
+
+	GLuint shader = createShader(code, GL_COMPUTE_SHADER);
+	if (shader == 0)
+	{
+		return 0;
+	}
+	GLuint program = createComputeProgram(shader);
+	glDeleteShader(shader);
+	if (program == 0)
+	{
+		return 0;
+	}
+
+	// Every block the pass uses gets the next binding, so each pass needs no more bindings than it has blocks.
+	passes[pass].roles.clear();
+	for (int role = 0; role < ROLE_COUNT; role++)
+	{
+		GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, blockNames[role]);
+		if (block != GL_INVALID_INDEX)
+		{
+			glShaderStorageBlockBinding(program, block, (GLuint)passes[pass].roles.size());
+			passes[pass].roles.push_back(role);
+		}
+	}
+	return program;
+}
+
+GLuint GpuNetwork::createBuffer(size_t size, const void* data)
+{
+	// An empty buffer can't be bound, so a network without tubes still gets a few bytes.
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, (size_t)16), size > 0 ? data : nullptr, GL_DYNAMIC_COPY);
+	return buffer;
+}
+
+void GpuNetwork::upload(int role, const void* data, size_t offset, size_t size)
+{
+	if (size > 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[role]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, (const char*)data + offset);
+	}
+}
+
+void GpuNetwork::download(int role, void* data, size_t offset, size_t size)
+{
+	if (size > 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[role]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, (char*)data + offset);
+	}
+}
+
+void GpuNetwork::dispatch(int pass, int invocations)
+{
+	const Pass& shader = passes[pass];
+	cachedUseProgram(shader.program);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, parameterBuffer);
+	for (size_t k = 0; k < shader.roles.size(); k++)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, (GLuint)k, buffers[shader.roles[k]]);
+	}
+	glDispatchCompute((std::max(invocations, 1) + GPU_NETWORK_GROUP_SIZE - 1) / GPU_NETWORK_GROUP_SIZE, 1, 1);
+
+	// Every pass reads what the one before it wrote.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+bool GpuNetwork::update(VesselNetwork& network, float density, float gravity, float dt)
+{
+	// Only the stretch of external pressures that changed since the last step is sent, which is usually just the piston's.
+	int first = vessels;
+	int last = -1;
+	for (int i = 0; i < vessels; i++)
+	{
+		if (network.externalPressure[i] != sentExternal[i])
+		{
+			first = std::min(first, i);
+			last = i;
+			sentExternal[i] = network.externalPressure[i];
+		}
+	}
+	if (last >= first)
+	{
+		upload(ROLE_EXTERNAL_PRESSURE, sentExternal.data(), sizeof(float) * first, sizeof(float) * (last - first + 1));
+	}
+
+	float scale = gravity * density;
+	parameters.dt = dt;
+	parameters.dtSquaredScale = dt * dt * scale;
+	parameters.scale = scale;
+	parameters.restPressure = REST_HEIGHT * scale;
+	glBindBuffer(GL_UNIFORM_BUFFER, parameterBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(parameters), &parameters);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[ROLE_MOVED]);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	dispatch(GPU_NETWORK_PRESSURE, vessels);
+	dispatch(GPU_NETWORK_FLOW, tubes);
+	dispatch(GPU_NETWORK_APPLY, vessels);
+
+	// The renderer reads the tops as a texture, and copyLevels() and the reads below go through the buffer interface.
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// This waits for the GPU to finish the step. The watched vessels come back with the pressure the step started with, which is
+	// also what the CPU step leaves behind.
+	GLuint moved = 0;
+	download(ROLE_MOVED, &moved, 0, sizeof(moved));
+	download(ROLE_HEIGHT, network.height.data(), 0, sizeof(float) * watched);
+	download(ROLE_PRESSURE, network.pressure.data(), 0, sizeof(float) * watched);
+	return moved != 0;
+}
+
+void GpuNetwork::readBack(VesselNetwork& network)
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	download(ROLE_HEIGHT, network.height.data(), 0, sizeof(float) * vessels);
+	download(ROLE_PRESSURE, network.pressure.data(), 0, sizeof(float) * vessels);
+	download(ROLE_TOP, network.top.data(), 0, sizeof(float) * vessels);
+	download(ROLE_FLOW, network.tubeFlow.data(), 0, sizeof(float) * tubes);
+}
+
+void GpuNetwork::load(const VesselNetwork& network)
+{
+	upload(ROLE_HEIGHT, network.height.data(), 0, sizeof(float) * vessels);
+	upload(ROLE_PRESSURE, network.pressure.data(), 0, sizeof(float) * vessels);
+	upload(ROLE_TOP, network.top.data(), 0, sizeof(float) * vessels);
+	upload(ROLE_FLOW, network.tubeFlow.data(), 0, sizeof(float) * tubes);
+	sentExternal = network.externalPressure;
+	upload(ROLE_EXTERNAL_PRESSURE, sentExternal.data(), 0, sizeof(float) * vessels);
+}
+
+void GpuNetwork::copyLevels(GLuint& buffer)
+{
+	size_t size = sizeof(float) * std::max(vessels, 1);
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, buffers[ROLE_TOP]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+}
+
+bool GpuNetwork::requestStatistics(long long step)
+{
+	StatisticsSlot& slot = statisticsSlots[nextSlot];
+	if (slot.fence != nullptr)
+	{
+		return false;
+	}
+	if (slot.buffer == 0)
+	{
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GpuNetworkStatistics), nullptr, GL_STREAM_READ);
+	}
+
+	// The top of the histogram may have moved up since the last step sent the parameters.
+	glBindBuffer(GL_UNIFORM_BUFFER, parameterBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(parameters), &parameters);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[ROLE_STATISTICS]);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	dispatch(GPU_NETWORK_REDUCE, vessels);
+	dispatch(GPU_NETWORK_REDUCE_FINAL, 1);
+
+	// The copy is queued behind the passes like they are, and the fence signals once it is done.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffers[ROLE_STATISTICS]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GpuNetworkStatistics));
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.step = step;
+	glFlush();
+	nextSlot = (nextSlot + 1) % GPU_NETWORK_STATISTICS_SLOTS;
+	return true;
+}
+
+bool GpuNetwork::pollStatistics(GpuNetworkStatistics& result, long long& step)
+{
+	// The slots are on their way back from the oldest, right after nextSlot, to the newest, and their fences signal in that order.
+	bool found = false;
+	for (int k = 1; k <= GPU_NETWORK_STATISTICS_SLOTS; k++)
+	{
+		StatisticsSlot& slot = statisticsSlots[(nextSlot + k) % GPU_NETWORK_STATISTICS_SLOTS];
+		if (slot.fence == nullptr)
+		{
+			continue;
+		}
+
+		// A timeout of 0 only asks whether the fence has signaled yet, it never waits.
+		if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			break;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+		const void* mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, sizeof(GpuNetworkStatistics), GL_MAP_READ_BIT);
+		if (mapped == nullptr)
+		{
+			continue;
+		}
+		memcpy(&result, mapped, sizeof(GpuNetworkStatistics));
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		step = slot.step;
+		found = true;
+	}
+
+	// Heights above the top all land in the last bin, so the histogram grows to the highest height seen so far.
+	if (found)
+	{
+		parameters.histogramTop = std::max(parameters.histogramTop, result.highestHeight);
+	}
+	return found;
+}
+
+void GpuNetwork::queueState(long long step, const VesselNetwork& network, const GpuStateConsumer& consume)
+{
+	StateSlot& slot = stateSlots[nextState];
+	if (slot.fence != nullptr)
+	{
+		// The slots are taken in order, so this is the oldest one.
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		takeState(slot, consume);
+	}
+	size_t size = sizeof(float) * vessels;
+	if (slot.buffer == 0)
+	{
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, std::max(2 * size, (size_t)16), nullptr, GL_STREAM_READ);
+	}
+
+	// update() already put a barrier behind the step for reads through the buffer interface.
+	glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+	if (size > 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffers[ROLE_HEIGHT]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffers[ROLE_PRESSURE]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, size, size);
+	}
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.step = step;
+	slot.externalPressure.assign(network.externalPressure.begin(), network.externalPressure.begin() + vessels);
+	glFlush();
+	nextState = (nextState + 1) % GPU_NETWORK_STATE_SLOTS;
+}
+
+void GpuNetwork::takeStates(const GpuStateConsumer& consume, bool wait)
+{
+	for (int k = 0; k < GPU_NETWORK_STATE_SLOTS; k++)
+	{
+		StateSlot& slot = stateSlots[(nextState + k) % GPU_NETWORK_STATE_SLOTS];
+		if (slot.fence == nullptr)
+		{
+			continue;
+		}
+		GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			return;
+		}
+		takeState(slot, consume);
+	}
+}
+
+void GpuNetwork::takeState(StateSlot& slot, const GpuStateConsumer& consume)
+{
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	// The consumer reads straight from the mapped copy, which is unmapped again once it is done.
+	glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+	const float* mapped = (const float*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, std::max(2 * sizeof(float) * vessels, (size_t)16), GL_MAP_READ_BIT);
+	if (mapped == nullptr)
+	{
+		std::cout << "Failed to read back the state of step " << slot.step << " from the GPU." << std::endl;
+		return;
+	}
+	consume(slot.step, mapped, mapped + vessels, slot.externalPressure.data());
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+}
+
+void GpuNetwork::destroy()
+{
+	for (Pass& pass : passes)
+	{
+		cachedDeleteProgram(pass.program);
+		pass.program = 0;
+		pass.roles.clear();
+	}
+	glDeleteBuffers(ROLE_COUNT, buffers);
+	for (GLuint& buffer : buffers)
+	{
+		buffer = 0;
+	}
+	glDeleteBuffers(1, &parameterBuffer);
+	parameterBuffer = 0;
+	for (StatisticsSlot& slot : statisticsSlots)
+	{
+		glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+		slot = StatisticsSlot();
+	}
+	nextSlot = 0;
+	for (StateSlot& slot : stateSlots)
+	{
+		glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+		slot = StateSlot();
+	}
+	nextState = 0;
+	vessels = 0;
+	tubes = 0;
+	watched = 0;
+}
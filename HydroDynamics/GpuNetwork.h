@@ -0,0 +1,245 @@
+/*
+Title: HydroDynamics
+File Name: GpuNetwork.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Steps a VesselNetwork on the GPU with OpenGL 4.3 compute shaders, for networks so large
+that the CPU can't step them at the physics rate.
+
+The state of the network lives in shader storage buffers, one per array of the network, and
+never leaves the GPU: a step is three dispatches of the shaders compiled from
+NetworkCompute.glsl (the pressures, the flows of the tubes and the gather into the
+vessels), with one invocation per vessel or tube, just like the phases of
+VesselNetwork::update(). Every vessel gathers its own tubes, so nothing needs atomics and a
+step gives the same result every time it runs on the same GPU. It isn't bit for bit the
+CPU step, since the GPU is free to fuse multiplies and adds. Unlike the CPU step, every
+component is stepped whether it is asleep or not, which costs the GPU next to nothing.
+
+The buffer of the top edges is the one the renderer draws the fill levels from, so nothing
+is copied to or from the CPU to show a step. What does come back every step is whether
+anything moved and the heights and pressures of the first few vessels (for the HUD and the
+plots), which waits for the GPU to finish the step, like GpuParticleFluid does. Anything
+that needs the whole state on the CPU (checkpoints, the live export, the remote viewers) calls
+readBack() first, and anything that changes it there calls load() afterwards. The external
+pressures are sent again every step wherever they changed.
+
+Statistics over the whole network (its volume, the highest pressure, the range of the
+heights and a histogram of them) are reduced on the GPU instead, by two more passes, so
+only a few bytes come back. requestStatistics() queues the passes and a copy of their
+result into one of GPU_NETWORK_STATISTICS_SLOTS small buffers, with a fence behind it, and
+pollStatistics() picks the result up a frame or so later, once the fence has signaled.
+Neither of them waits for the GPU.
+
+Telemetry records the heights and pressures of every vessel after every step, which is too
+much to wait for every step. queueState() has the GPU copy them into one of
+GPU_NETWORK_STATE_SLOTS buffers of their own, behind a fence, along with a copy of the
+external pressures the step had, and takeStates() hands every copy whose fence has signaled
+on, oldest first, so the steps arrive in order a few steps late. A buffer is only mapped
+once its copy is done, so mapping it never waits, and the consumer reads straight from the
+mapping. If all of them are still on their way, queueState() waits for the oldest, which is
+what keeps a slow bus from dropping steps.
+
+All buffers are ordinary OpenGL objects, so they can be shared with the renderer's context
+when update() runs on a different thread.
+*/
+
+#ifndef _GPU_NETWORK_H
+#define _GPU_NETWORK_H
+
+#include "GLIncludes.h"
+#include <functional>
+#include <vector>
+
+struct VesselNetwork;
+
+// How many vessels or tubes every work group handles.
+#define GPU_NETWORK_GROUP_SIZE 256
+
+// The number of bins of the histogram of heights (HISTOGRAM_BINS in NetworkCompute.glsl), and how many requests for statistics can
+// be on their way back at once.
+#define GPU_NETWORK_HISTOGRAM_BINS 32
+#define GPU_NETWORK_STATISTICS_SLOTS 3
+
+// How many copies of the state for telemetry can be on their way back at once.
+#define GPU_NETWORK_STATE_SLOTS 4
+
+// The passes, in the order of the PASS_ defines of NetworkCompute.glsl.
+enum GpuNetworkPass
+{
+	GPU_NETWORK_PRESSURE = 0,
+	GPU_NETWORK_FLOW,
+	GPU_NETWORK_APPLY,
+	GPU_NETWORK_REDUCE,
+	GPU_NETWORK_REDUCE_FINAL,
+	GPU_NETWORK_PASS_COUNT
+};
+
+// The uniform block of NetworkCompute.glsl, in std140 layout (which for these is the order they are in).
+struct GpuNetworkParameters
+{
+	float dt;
+	float dtSquaredScale;
+	float scale;
+	float restFlow;
+	float restPressure;
+	int vesselCount;
+	int tubeCount;
+	float histogramTop;
+};
+
+// The Statistics block of NetworkCompute.glsl, in std430 layout.
+struct GpuNetworkStatistics
+{
+	float volume;						// The volume of all vessels
+	float highestPressure;				// The highest pressure at the bottom of a vessel, with the external pressure
+	float lowestHeight;
+	float highestHeight;
+	float histogramTop;					// The height the top bin of the histogram ends at; it starts at 0
+	GLuint histogram[GPU_NETWORK_HISTOGRAM_BINS];	// How many vessels have a height in every bin (the top one also has those above)
+};
+
+// Takes a copy of the state after step that came back from the GPU: the height and the pressure of every vessel, and the external
+// pressure it had. The arrays only last for the call.
+typedef std::function<void(long long step, const float* height, const float* pressure, const float* externalPressure)> GpuStateConsumer;
+
+class GpuNetwork
+{
+public:
+	// Compiles the passes from shaderFile and uploads the network, rebuilding its topology first if it has to. Needs a current
+	// OpenGL 4.3 context. Returns false (and prints why) if the context can't run compute shaders or a pass doesn't compile.
+	// watchedVessels is how many of the first vessels update() brings back every step.
+	bool build(VesselNetwork& network, const char* shaderFile, int watchedVessels);
+
+	// Advances the network by dt seconds, like VesselNetwork::update(). Only the heights and pressures of the watched vessels are
+	// written back into network. Returns false if nothing moved.
+	bool update(VesselNetwork& network, float density, float gravity, float dt);
+
+	// Copies the whole state (heights, pressures, tops and flows) back into network.
+	void readBack(VesselNetwork& network);
+
+	// Sends the heights, pressures, tops, flows and external pressures of network again, after they were changed on the CPU. The
+	// topology has to be the one the network was built with.
+	void load(const VesselNetwork& network);
+
+	// The buffer with the top edge of every vessel, as floats, which is what the renderer reads the fill levels from.
+	GLuint levelBuffer() const { return buffers[ROLE_TOP]; }
+
+	// Copies the top edges into buffer, which is created if it is 0, for a renderer that draws a step while the next one runs.
+	void copyLevels(GLuint& buffer);
+
+	// Queues the reduction of the current state to GpuNetworkStatistics, tagged with step. The histogram goes up to the highest
+	// height any earlier result had (or the one at build()). Returns false, and queues nothing, if every slot is still waiting for
+	// the GPU.
+	bool requestStatistics(long long step);
+
+	// Takes the newest result that has come back since the last call. Returns false if none has.
+	bool pollStatistics(GpuNetworkStatistics& result, long long& step);
+
+	// Queues a copy of the heights and pressures as they are now, after step, with the external pressures of network. If every
+	// slot is still on its way back, waits for the oldest one and hands it to consume first.
+	void queueState(long long step, const VesselNetwork& network, const GpuStateConsumer& consume);
+
+	// Hands every copy that has come back to consume, oldest first. With wait, waits for all of them to come back.
+	void takeStates(const GpuStateConsumer& consume, bool wait);
+
+	int vesselCount() const { return vessels; }
+
+	// Frees all the buffers and programs.
+	void destroy();
+
+private:
+	// The buffers, by the name of their block in NetworkCompute.glsl.
+	enum Role
+	{
+		ROLE_HEIGHT = 0,
+		ROLE_PRESSURE,
+		ROLE_EXTERNAL_PRESSURE,
+		ROLE_DRAIN_SHARE,
+		ROLE_TUBE_A,
+		ROLE_TUBE_B,
+		ROLE_INV_INERTANCE,
+		ROLE_DAMPING,
+		ROLE_STIFFNESS,
+		ROLE_FLOW,
+		ROLE_MOVED,
+		ROLE_CHANGE,
+		ROLE_WIDTH,
+		ROLE_BOTTOM,
+		ROLE_TOP,
+		ROLE_TUBE_START,
+		ROLE_TUBE_LIST,
+		ROLE_PARTIALS,
+		ROLE_STATISTICS,
+		ROLE_COUNT
+	};
+
+	// A buffer the statistics are copied back through, and the fence behind the copy (null while the slot is free).
+	struct StatisticsSlot
+	{
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+		long long step = 0;
+	};
+
+	// The same for a copy of the state: the heights, then the pressures, and the external pressures, which stay on the CPU.
+	struct StateSlot
+	{
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+		long long step = 0;
+		std::vector<float> externalPressure;
+	};
+
+	// Hands the copy in the given slot to consume, and frees the slot. Its fence has to have signaled.
+	void takeState(StateSlot& slot, const GpuStateConsumer& consume);
+
+	// A compiled pass, and the roles of the buffers it binds, in the order of their bindings.
+	struct Pass
+	{
+		GLuint program = 0;
+		std::vector<int> roles;
+	};
+
+	GLuint compilePass(const std::string& source, int pass);
+	void dispatch(int pass, int invocations);
+
+	// Creates a buffer from data, or of size bytes of nothing if data is null.
+	GLuint createBuffer(size_t size, const void* data);
+	void upload(int role, const void* data, size_t offset, size_t size);
+	void download(int role, void* data, size_t offset, size_t size);
+
+	int vessels = 0;
+	int tubes = 0;
+	int watched = 0;
+	Pass passes[GPU_NETWORK_PASS_COUNT];
+	GLuint buffers[ROLE_COUNT] = {};
+	GLuint parameterBuffer = 0;
+	GpuNetworkParameters parameters = {};
+	std::vector<float> sentExternal;	// The external pressures as the GPU has them
+	StatisticsSlot statisticsSlots[GPU_NETWORK_STATISTICS_SLOTS];
+	int nextSlot = 0;					// The slot the next request goes into; the oldest one on its way back is after it
+	StateSlot stateSlots[GPU_NETWORK_STATE_SLOTS];
+	int nextState = 0;					// The same for the copies of the state
+};
+
+#endif // _GPU_NETWORK_H
@@ -0,0 +1,347 @@
+/*
+Title: HydroDynamics
+File Name: GpuParticleFluid.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Steps a ParticleFluid on the GPU with OpenGL 4.3 compute shaders, for far more particles
+than the CPU can keep up with.
+
+The particles are kept in shader storage buffers and never leave the GPU: every pass of a
+substep (prediction, the counting sort into the neighbour grid, the neighbour lists, the
+iterations of the density constraints and the velocity smoothing) is a dispatch of one of
+the shaders compiled from ParticleCompute.glsl, with one invocation per particle. The sort
+counts the particles per cell with atomics, scans the counts in a single work group and
+scatters the particles into the sorted order, so the order within a cell depends on the
+order the invocations ran in, and the result is not exactly the same from run to run.
+
+The fluid is laid out on the CPU by ParticleFluid::build() (the particles, the walls, the
+grid and the constants), and uploaded once. After every step only the fastest speed and
+the number of particles in every vessel come back, which the network needs for its levels
+and the next step for its number of substeps. That read waits for the GPU to finish the
+step, so the thread that calls update() keeps the GPU busy but not itself.
+
+The renderer draws the particles straight from a buffer that writeVertices() fills on the
+GPU, so no positions are copied to or from the CPU. All buffers are ordinary OpenGL objects,
+so they can be shared with the renderer's context when update() runs on a different thread.
+*/
+
+#include "GpuParticleFluid.h"
+#include "GLState.h"
+#include "ParticleFluid.h"
+#include "VesselNetwork.h"
+#include "Shaders.h"
+#include <cstring>
+
+// The names of the blocks in ParticleCompute.glsl, in the order of Role.
+static const char* blockNames[] =
+{
+	"Position", "Velocity", "Predicted", "SortedPosition", "SortedVelocity", "SortedPredicted", "CellOf", "CellStart", "Cursor",
+	"Neighbors", "NeighborCount", "Lambda", "Delta", "Walls", "WallStart", "Boxes", "Vessels", "ExtraGravity", "Measure", "Vertices"
+};
+
+bool GpuParticleFluid::build(ParticleFluid& particles, const char* shaderFile)
+{
+	if (!GLEW_VERSION_4_3)
+	{
+		std::cout << "Running the particles on the GPU needs OpenGL 4.3, this driver has " << glGetString(GL_VERSION) << "." << std::endl;
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(shaderFile))
+	{
+		return false;
+	}
+	std::string source(file.view());
+	for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+	{
+		passes[pass].program = compilePass(source, pass);
+		if (passes[pass].program == 0)
+		{
+			std::cout << "Pass " << pass << " of " << shaderFile << " failed to build." << std::endl;
+			destroy();
+			return false;
+		}
+	}
+
+	fluid = &particles;
+	count = particles.particleCount();
+	cells = particles.columns * particles.rows;
+	int vesselCount = (int)particles.vessels.size();
+
+	std::vector<float> pairs(count * 2);
+	for (int i = 0; i < count; i++)
+	{
+		pairs[i * 2] = particles.positionX[i];
+		pairs[i * 2 + 1] = particles.positionY[i];
+	}
+	buffers[ROLE_POSITION] = createBuffer(sizeof(float) * pairs.size(), pairs.data());
+	for (int i = 0; i < count; i++)
+	{
+		pairs[i * 2] = particles.velocityX[i];
+		pairs[i * 2 + 1] = particles.velocityY[i];
+	}
+	buffers[ROLE_VELOCITY] = createBuffer(sizeof(float) * pairs.size(), pairs.data());
+
+	size_t pairSize = sizeof(float) * 2 * count;
+	buffers[ROLE_PREDICTED] = createBuffer(pairSize, nullptr);
+	buffers[ROLE_SORTED_POSITION] = createBuffer(pairSize, nullptr);
+	buffers[ROLE_SORTED_VELOCITY] = createBuffer(pairSize, nullptr);
+	buffers[ROLE_SORTED_PREDICTED] = createBuffer(pairSize, nullptr);
+	buffers[ROLE_DELTA] = createBuffer(pairSize, nullptr);
+	buffers[ROLE_CELL_OF] = createBuffer(sizeof(GLuint) * count, nullptr);
+	buffers[ROLE_CELL_START] = createBuffer(sizeof(GLuint) * (cells + 1), nullptr);
+	buffers[ROLE_CURSOR] = createBuffer(sizeof(GLuint) * cells, nullptr);
+	buffers[ROLE_NEIGHBORS] = createBuffer(sizeof(GLint) * count * PARTICLE_MAX_NEIGHBORS, nullptr);
+	buffers[ROLE_NEIGHBOR_COUNT] = createBuffer(sizeof(GLuint) * count, nullptr);
+	buffers[ROLE_LAMBDA] = createBuffer(sizeof(float) * count, nullptr);
+
+	int wallCount = (int)particles.wallX.size();
+	std::vector<float> walls(wallCount * 2);
+	for (int k = 0; k < wallCount; k++)
+	{
+		walls[k * 2] = particles.wallX[k];
+		walls[k * 2 + 1] = particles.wallY[k];
+	}
+	buffers[ROLE_WALLS] = createBuffer(sizeof(float) * walls.size(), walls.data());
+	buffers[ROLE_WALL_START] = createBuffer(sizeof(GLint) * particles.wallStart.size(), particles.wallStart.data());
+
+	std::vector<float> boxes;
+	for (const ParticleFluid::Box& box : particles.boxes)
+	{
+		boxes.insert(boxes.end(), { box.left, box.right, box.bottom, box.top });
+	}
+	buffers[ROLE_BOXES] = createBuffer(sizeof(float) * boxes.size(), boxes.data());
+
+	// The same as Vessel in the shader: three floats and the index of the vessel.
+	std::vector<float> vessels(vesselCount * 4);
+	for (int k = 0; k < vesselCount; k++)
+	{
+		int vessel = particles.byLeft[k];
+		vessels[k * 4] = particles.vessels[vessel].left;
+		vessels[k * 4 + 1] = particles.vessels[vessel].right;
+		vessels[k * 4 + 2] = particles.vessels[vessel].bottom;
+		memcpy(&vessels[k * 4 + 3], &vessel, sizeof(vessel));
+	}
+	buffers[ROLE_VESSELS] = createBuffer(sizeof(float) * vessels.size(), vessels.data());
+	buffers[ROLE_EXTRA_GRAVITY] = createBuffer(sizeof(float) * vesselCount, nullptr);
+	buffers[ROLE_MEASURE] = createBuffer(sizeof(GLuint) * (vesselCount + 1), nullptr);
+	measured.assign(vesselCount + 1, 0);
+
+	parameters.originX = particles.originX;
+	parameters.originY = particles.originY;
+	parameters.radius = particles.radius;
+	parameters.poly6Scale = particles.poly6Scale;
+	parameters.spikyScale = particles.spikyScale;
+	parameters.inverseRest = 1.0f / particles.restDensity;
+	parameters.relaxation = particles.relaxation;
+	parameters.closest = PARTICLE_CLOSEST * particles.spacing;
+	parameters.viscosityScale = PARTICLE_VISCOSITY * particles.poly6Scale / particles.restDensity;
+	parameters.columns = particles.columns;
+	parameters.rows = particles.rows;
+	parameters.particleCount = count;
+	parameters.boxCount = (int)particles.boxes.size();
+	parameters.vesselCount = vesselCount;
+
+	glGenBuffers(1, &parameterBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, parameterBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(parameters), &parameters, GL_DYNAMIC_DRAW);
+	return true;
+}
+
+GLuint GpuParticleFluid::compilePass(const std::string& source, int pass)
+{
+	// The defines go right after the #version line, which has to come first. #line keeps the line numbers of errors the same as in
+	// the file.
+	size_t version = source.find("#version");
+	size_t afterVersion = version == std::string::npos ? std::string::npos : source.find('\n', version);
+	if (afterVersion == std::string::npos)
+	{
+		std::cout << "The particle shader has no #version line." << std::endl;
+		return 0;
+	}
+	afterVersion++;
+	int nextLine = (int)std::count(source.begin(), source.begin() + afterVersion, '\n') + 1;
+
+	std::string defines = "#define PASS " + std::to_string(pass) + "\n"
+		+ "#define GROUP_SIZE " + std::to_string(GPU_PARTICLE_GROUP_SIZE) + "\n"
+		+ "#define SCAN_SIZE " + std::to_string(GPU_PARTICLE_SCAN_SIZE) + "\n"
+		+ "#define MAX_NEIGHBORS " + std::to_string(PARTICLE_MAX_NEIGHBORS) + "\n"
+		+ "#line " + std::to_string(nextLine) + "\n";
+	std::string code = source.substr(0, afterVersion) + defines + source.substr(afterVersion);
+
+	GLuint shader = createShader(code, GL_COMPUTE_SHADER);
+	if (shader == 0)
+	{
+		return 0;
+	}
+	GLuint program = createComputeProgram(shader);
+	glDeleteShader(shader);
+	if (program == 0)
+	{
+		return 0;
+	}
+
+	// Every block the pass uses gets the next binding, so each pass needs no more bindings than it has blocks.
+	passes[pass].roles.clear();
+	for (int role = 0; role < ROLE_COUNT; role++)
+	{
+		GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, blockNames[role]);
+		if (block != GL_INVALID_INDEX)
+		{
+			glShaderStorageBlockBinding(program, block, (GLuint)passes[pass].roles.size());
+			passes[pass].roles.push_back(role);
+		}
+	}
+	return program;
+}
+
+GLuint GpuParticleFluid::createBuffer(size_t size, const void* data)
+{
+	// An empty buffer can't be bound, so a network without walls still gets a few bytes.
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, (size_t)16), size > 0 ? data : nullptr, GL_DYNAMIC_COPY);
+	return buffer;
+}
+
+GLuint GpuParticleFluid::createVertexBuffer() const
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GpuParticleVertex) * std::max(count, 1), nullptr, GL_DYNAMIC_COPY);
+	return buffer;
+}
+
+void GpuParticleFluid::dispatch(int pass, int invocations)
+{
+	const Pass& shader = passes[pass];
+	cachedUseProgram(shader.program);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, parameterBuffer);
+	for (size_t k = 0; k < shader.roles.size(); k++)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, (GLuint)k, buffers[shader.roles[k]]);
+	}
+
+	int groupSize = pass == GPU_PASS_SCAN ? GPU_PARTICLE_SCAN_SIZE : GPU_PARTICLE_GROUP_SIZE;
+	glDispatchCompute((invocations + groupSize - 1) / groupSize, 1, 1);
+
+	// Every pass reads what the one before it wrote.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuParticleFluid::substep(float gravity, float dt)
+{
+	parameters.dt = dt;
+	parameters.gravity = gravity;
+	glBindBuffer(GL_UNIFORM_BUFFER, parameterBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(parameters), &parameters);
+
+	// Predict and count the particles per cell, turn the counts into where the cells start, and move every particle to its place
+	// in the sorted order. From then on the sorted arrays are the arrays of the particles.
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[ROLE_CELL_START]);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	dispatch(GPU_PASS_PREDICT, count);
+	dispatch(GPU_PASS_SCAN, GPU_PARTICLE_SCAN_SIZE);
+	dispatch(GPU_PASS_SCATTER, count);
+	std::swap(buffers[ROLE_POSITION], buffers[ROLE_SORTED_POSITION]);
+	std::swap(buffers[ROLE_VELOCITY], buffers[ROLE_SORTED_VELOCITY]);
+	std::swap(buffers[ROLE_PREDICTED], buffers[ROLE_SORTED_PREDICTED]);
+
+	dispatch(GPU_PASS_NEIGHBORS, count);
+	for (int iteration = 0; iteration < PARTICLE_ITERATIONS; iteration++)
+	{
+		dispatch(GPU_PASS_LAMBDA, count);
+		dispatch(GPU_PASS_DELTA, count);
+		dispatch(GPU_PASS_APPLY, count);
+	}
+
+	// The smoothed velocities end up in the delta buffer, which then becomes the velocity buffer.
+	dispatch(GPU_PASS_VELOCITY, count);
+	dispatch(GPU_PASS_VISCOSITY, count);
+	std::swap(buffers[ROLE_POSITION], buffers[ROLE_PREDICTED]);
+	std::swap(buffers[ROLE_VELOCITY], buffers[ROLE_DELTA]);
+}
+
+bool GpuParticleFluid::update(VesselNetwork& network, float density, float gravity, float dt)
+{
+	int vesselCount = network.vesselCount();
+	fluid->lastSubsteps = fluid->planSubsteps(network, density, gravity, dt);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[ROLE_EXTRA_GRAVITY]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * vesselCount, fluid->extraGravity.data());
+
+	for (int s = 0; s < fluid->lastSubsteps; s++)
+	{
+		substep(gravity, dt / fluid->lastSubsteps);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[ROLE_MEASURE]);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	dispatch(GPU_PASS_MEASURE, count);
+
+	// This waits for the GPU to finish the step.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[ROLE_MEASURE]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * measured.size(), measured.data());
+
+	memcpy(&fluid->fastest, &measured[0], sizeof(float));
+	for (int i = 0; i < vesselCount; i++)
+	{
+		fluid->vesselCounts[i] = (int)measured[i + 1];
+	}
+	fluid->applyCounts(network, density, gravity);
+	return fluid->fastest * dt > REST_HEIGHT;
+}
+
+void GpuParticleFluid::writeVertices(GLuint buffer, const glm::vec4& waterColor, float speedWhite)
+{
+	memcpy(parameters.waterColor, glm::value_ptr(waterColor), sizeof(parameters.waterColor));
+	parameters.speedWhite = speedWhite;
+	glBindBuffer(GL_UNIFORM_BUFFER, parameterBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(parameters), &parameters);
+
+	buffers[ROLE_VERTICES] = buffer;
+	dispatch(GPU_PASS_VERTICES, count);
+	buffers[ROLE_VERTICES] = 0;
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuParticleFluid::destroy()
+{
+	for (Pass& pass : passes)
+	{
+		cachedDeleteProgram(pass.program);
+		pass.program = 0;
+		pass.roles.clear();
+	}
+	glDeleteBuffers(ROLE_COUNT, buffers);
+	for (GLuint& buffer : buffers)
+	{
+		buffer = 0;
+	}
+	glDeleteBuffers(1, &parameterBuffer);
+	parameterBuffer = 0;
+	fluid = nullptr;
+	count = 0;
+}
@@ -0,0 +1,183 @@
+/*
+Title: HydroDynamics
+File Name: GpuParticleFluid.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Steps a ParticleFluid on the GPU with OpenGL 4.3 compute shaders, for far more particles
+than the CPU can keep up with.
+
+The particles are kept in shader storage buffers and never leave the GPU: every pass of a
+substep (prediction, the counting sort into the neighbour grid, the neighbour lists, the
+iterations of the density constraints and the velocity smoothing) is a dispatch of one of
+the shaders compiled from ParticleCompute.glsl, with one invocation per particle. The sort
+counts the particles per cell with atomics, scans the counts in a single work group and
+scatters the particles into the sorted order, so the order within a cell depends on the
+order the invocations ran in, and the result is not exactly the same from run to run.
+
+The fluid is laid out on the CPU by ParticleFluid::build() (the particles, the walls, the
+grid and the constants), and uploaded once. After every step only the fastest speed and
+the number of particles in every vessel come back, which the network needs for its levels
+and the next step for its number of substeps. That read waits for the GPU to finish the
+step, so the thread that calls update() keeps the GPU busy but not itself.
+
+The renderer draws the particles straight from a buffer that writeVertices() fills on the
+GPU, so no positions are copied to or from the CPU. All buffers are ordinary OpenGL objects,
+so they can be shared with the renderer's context when update() runs on a different thread.
+*/
+
+#ifndef _GPU_PARTICLE_FLUID_H
+#define _GPU_PARTICLE_FLUID_H
+
+#include "GLIncludes.h"
+
+class ParticleFluid;
+struct VesselNetwork;
+
+// How many particles every work group handles, and how many invocations the group that scans the cells has.
+#define GPU_PARTICLE_GROUP_SIZE 256
+#define GPU_PARTICLE_SCAN_SIZE 1024
+
+// The passes, in the order of the PASS_ defines of ParticleCompute.glsl.
+enum GpuParticlePass
+{
+	GPU_PASS_PREDICT = 0,
+	GPU_PASS_SCAN,
+	GPU_PASS_SCATTER,
+	GPU_PASS_NEIGHBORS,
+	GPU_PASS_LAMBDA,
+	GPU_PASS_DELTA,
+	GPU_PASS_APPLY,
+	GPU_PASS_VELOCITY,
+	GPU_PASS_VISCOSITY,
+	GPU_PASS_MEASURE,
+	GPU_PASS_VERTICES,
+	GPU_PASS_COUNT
+};
+
+// What writeVertices() writes for every particle. The color is 4 bytes, red first.
+struct GpuParticleVertex
+{
+	float x;
+	float y;
+	unsigned int color;
+	unsigned int padding;
+};
+
+// The uniform block of ParticleCompute.glsl, in std140 layout (which for these is the order they are in).
+struct GpuParticleParameters
+{
+	float waterColor[4];
+	float originX;
+	float originY;
+	float radius;
+	float dt;
+	float gravity;
+	float poly6Scale;
+	float spikyScale;
+	float inverseRest;
+	float relaxation;
+	float closest;
+	float viscosityScale;
+	float speedWhite;
+	int columns;
+	int rows;
+	int particleCount;
+	int boxCount;
+	int vesselCount;
+	int padding[3];
+};
+
+class GpuParticleFluid
+{
+public:
+	// Compiles the passes from shaderFile and uploads particles, which have to be built. Needs a current OpenGL 4.3 context.
+	// Returns false (and prints why) if the context can't run compute shaders or a pass doesn't compile.
+	bool build(ParticleFluid& particles, const char* shaderFile);
+
+	// Advances the particles by dt seconds, like ParticleFluid::update(). The positions in the ParticleFluid aren't changed; the
+	// particles only exist on the GPU from now on. Returns false if nothing moved.
+	bool update(VesselNetwork& network, float density, float gravity, float dt);
+
+	// Creates a buffer large enough for writeVertices().
+	GLuint createVertexBuffer() const;
+
+	// Fills buffer with a GpuParticleVertex per particle, from where they are now and a color from their speed: waterColor at
+	// rest, up to white at speedWhite.
+	void writeVertices(GLuint buffer, const glm::vec4& waterColor, float speedWhite);
+
+	int particleCount() const { return count; }
+
+	// Frees all the buffers and programs.
+	void destroy();
+
+private:
+	// The buffers, by the name of their block in ParticleCompute.glsl.
+	enum Role
+	{
+		ROLE_POSITION = 0,
+		ROLE_VELOCITY,
+		ROLE_PREDICTED,
+		ROLE_SORTED_POSITION,
+		ROLE_SORTED_VELOCITY,
+		ROLE_SORTED_PREDICTED,
+		ROLE_CELL_OF,
+		ROLE_CELL_START,
+		ROLE_CURSOR,
+		ROLE_NEIGHBORS,
+		ROLE_NEIGHBOR_COUNT,
+		ROLE_LAMBDA,
+		ROLE_DELTA,
+		ROLE_WALLS,
+		ROLE_WALL_START,
+		ROLE_BOXES,
+		ROLE_VESSELS,
+		ROLE_EXTRA_GRAVITY,
+		ROLE_MEASURE,
+		ROLE_VERTICES,
+		ROLE_COUNT
+	};
+
+	// A compiled pass, and the roles of the buffers it binds, in the order of their bindings.
+	struct Pass
+	{
+		GLuint program = 0;
+		std::vector<int> roles;
+	};
+
+	GLuint compilePass(const std::string& source, int pass);
+	void dispatch(int pass, int invocations);
+	void substep(float gravity, float dt);
+
+	// Creates a buffer from data, or of size bytes of nothing if data is null.
+	GLuint createBuffer(size_t size, const void* data);
+
+	ParticleFluid* fluid = nullptr;
+	int count = 0;
+	int cells = 0;
+	Pass passes[GPU_PASS_COUNT];
+	GLuint buffers[ROLE_COUNT] = {};
+	GLuint parameterBuffer = 0;
+	GpuParticleParameters parameters = {};
+	std::vector<unsigned int> measured;		// What came back from the last step
+};
+
+#endif // _GPU_PARTICLE_FLUID_H
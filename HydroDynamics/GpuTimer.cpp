@@ -0,0 +1,149 @@
+/*
+Title: HydroDynamics
+File Name: GpuTimer.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Measures how long the GPU spends on each render pass with GL_TIME_ELAPSED queries.
+
+The GPU runs behind the CPU, so the result of a query is not ready until a frame or two
+after it was issued. Asking for it right away would make the CPU wait for the GPU and
+throw away the overlap between them. Instead every pass has a ring of GPU_TIMER_FRAMES
+queries: each frame uses the next one, and reads back the oldest one, which the GPU has
+normally finished long ago. If it isn't finished yet, we keep showing the last result
+instead of waiting.
+
+The results are fed into the same profiler as the CPU timers.
+*/
+
+#include "GpuTimer.h"
+#include "TracyZones.h"
+
+#ifdef HYDRO_TRACY
+#include <tracy/TracyOpenGL.hpp>
+#include <optional>
+
+// Every pass is also a GPU zone for Tracy, named like its scope. Tracy wants a location per zone that lives forever.
+static tracy::SourceLocationData tracyPasses[PROFILE_COUNT];
+static std::optional<tracy::GpuCtxScope> tracyPass;
+#endif
+
+static GLuint queries[GPU_TIMER_FRAMES][PROFILE_COUNT];
+
+// Whether a query was actually issued, so we never read one that has no result coming.
+static bool issued[GPU_TIMER_FRAMES][PROFILE_COUNT];
+
+// The newest result of every pass, in milliseconds.
+static double lastResult[PROFILE_COUNT];
+static bool hasResult[PROFILE_COUNT];
+
+static int currentFrame = 0;
+static bool timing = false;
+
+void initGpuTimers()
+{
+	glGenQueries(GPU_TIMER_FRAMES * PROFILE_COUNT, &queries[0][0]);
+	for (int f = 0; f < GPU_TIMER_FRAMES; f++)
+	{
+		for (int i = 0; i < PROFILE_COUNT; i++)
+		{
+			issued[f][i] = false;
+		}
+	}
+
+#ifdef HYDRO_TRACY
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		tracyPasses[i] = { profilerScope((ProfileId)i).name, "gpuTimerBegin", __FILE__, (uint32_t)__LINE__, 0 };
+	}
+	TracyGpuContext;
+#endif
+}
+
+void gpuTimerBegin(ProfileId pass)
+{
+	// GL_TIME_ELAPSED queries can't be nested, so a second begin without an end is ignored.
+	if (timing)
+	{
+		return;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[currentFrame][pass]);
+	issued[currentFrame][pass] = true;
+	timing = true;
+#ifdef HYDRO_TRACY
+	tracyPass.emplace(&tracyPasses[pass], true);
+#endif
+}
+
+void gpuTimerEnd()
+{
+	if (!timing)
+	{
+		return;
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	timing = false;
+#ifdef HYDRO_TRACY
+	tracyPass.reset();
+#endif
+}
+
+void gpuTimersEndFrame()
+{
+	// Move to the next set of queries. It is the oldest one, issued GPU_TIMER_FRAMES - 1 frames ago, so its results are the
+	// ones most likely to be ready.
+	currentFrame = (currentFrame + 1) % GPU_TIMER_FRAMES;
+#ifdef HYDRO_TRACY
+	TracyGpuCollect;
+#endif
+
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		if (issued[currentFrame][i])
+		{
+			// Only read the result if it's available. Reading it otherwise would block until the GPU catches up.
+			GLint available = 0;
+			glGetQueryObjectiv(queries[currentFrame][i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(queries[currentFrame][i], GL_QUERY_RESULT, &nanoseconds);
+				lastResult[i] = nanoseconds / 1000000.0;
+				hasResult[i] = true;
+			}
+
+			// If it wasn't ready, the query is simply reused for this frame; we just lose that sample.
+			issued[currentFrame][i] = false;
+		}
+
+		if (hasResult[i])
+		{
+			profilerSet((ProfileId)i, lastResult[i]);
+		}
+	}
+}
+
+void destroyGpuTimers()
+{
+	glDeleteQueries(GPU_TIMER_FRAMES * PROFILE_COUNT, &queries[0][0]);
+}
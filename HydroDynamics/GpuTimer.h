@@ -0,0 +1,60 @@
+/*
+Title: HydroDynamics
+File Name: GpuTimer.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Measures how long the GPU spends on each render pass with GL_TIME_ELAPSED queries.
+
+The GPU runs behind the CPU, so the result of a query is not ready until a frame or two
+after it was issued. Asking for it right away would make the CPU wait for the GPU and
+throw away the overlap between them. Instead every pass has a ring of GPU_TIMER_FRAMES
+queries: each frame uses the next one, and reads back the oldest one, which the GPU has
+normally finished long ago. If it isn't finished yet, we keep showing the last result
+instead of waiting.
+
+The results are fed into the same profiler as the CPU timers.
+*/
+
+#ifndef _GPU_TIMER_H
+#define _GPU_TIMER_H
+
+#include "GLIncludes.h"
+#include "Profiler.h"
+
+// How many frames of queries are in flight at once.
+#define GPU_TIMER_FRAMES 3
+
+// Creates the query objects. Needs a current OpenGL context.
+void initGpuTimers();
+
+// Starts and stops timing a pass. Passes can't overlap, but every pass id can be used once per frame.
+void gpuTimerBegin(ProfileId pass);
+void gpuTimerEnd();
+
+// Reads back whichever results are ready, hands them to the profiler and moves on to the next set of queries.
+// Call once per frame, before profilerEndFrame().
+void gpuTimersEndFrame();
+
+// Frees the query objects.
+void destroyGpuTimers();
+
+#endif // _GPU_TIMER_H
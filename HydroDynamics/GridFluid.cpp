@@ -0,0 +1,1295 @@
+/*
+Title: HydroDynamics
+File Name: GridFluid.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+An incompressible fluid on a grid, for seeing how the fluid actually moves inside the
+vessels and the tubes instead of only where its levels are.
+
+The apparatus of a VesselNetwork is laid out on a grid of square cells: the columns of
+the vessels (from their floors up to a ceiling) and the tubes along the floor are open,
+everything else is solid wall. Every open cell is either fluid or air, depending on how
+full of fluid it is. Velocities live on the faces between cells (a MAC grid): the
+horizontal velocity on the vertical faces and the vertical velocity on the horizontal
+faces, so the difference of two neighbouring pressures acts directly on the face between
+them.
+
+Every step:
+- carries the velocities and the fill of every cell along the flow (semi-Lagrangian
+  advection, traced back with a midpoint step),
+- adds gravity to every face next to fluid,
+- solves for the pressure that makes the flow divergence free and subtracts its gradient
+  (the projection), and
+- extends the velocities a few cells into the air, so the surface has something to move
+  along in the next step.
+
+The air is at the pressure pushed onto the vessel it is in (the piston), or 0. The
+pressure is a Poisson equation over the fluid cells, which GridPressureSolver solves
+(with multigrid, by default), starting from the pressure of the last step.
+
+Most of the bounding box of an apparatus is wall or air that no fluid is near, so the grid
+is stored in tiles (see GridTiles.h), and only the tiles of a narrow band around the fluid
+are kept: the open tiles (those a vessel or a tube goes through) within GRID_BAND_TILES
+tiles of a tile that holds fluid, and those of the mouths of the tubes. Everything else
+costs next to nothing, so the resolution can go up as far as the fluid allows, not the
+bounding box or the vessels. After every step the band is checked against the fluid, and
+laid out again once the fluid came within a tile of its edge, or moved a tile further from
+it than it was laid out for; the fields are carried over to the new tiles, and the new
+ones start out as still air. The fluid never gets near the edge of the band, and further
+from it than the velocities are extended there is only still air with no fluid in it,
+which the steps treat the same as a wall. Only the pressure solve sees a difference: its
+coarser levels are smaller, so it converges along another path to the same tolerance.
+Every stage works cell by cell, so it is split into blocks of tiles on the task pool. The
+result doesn't depend on the number of threads.
+
+Tracing the fields back smears them a little every step, which damps the waves and
+rounds off the surface. With ADVECTION_FLIP the fluid is carried by particles instead
+(FLIP/PIC): every particle keeps its own position and velocity, which only pass through
+the grid for the forces and the projection. Every step the particles move through the
+velocities of the grid, are sorted by the tile they are in (and along a Morton curve
+inside it, see ParticleSort.h) and are splatted onto the faces around them; the fill of every cell is how
+many particles it holds. After the projection every particle takes over how much the
+grid velocity around it changed (FLIP, which keeps all the detail but gets noisy), mixed
+with a little of the grid velocity itself (PIC, which is smooth but damped). The splat is
+split by tile: every tile collects its own particles into a private tile with a border
+of one face all around, and every face then adds up the private tiles it is in, so no two
+threads ever write the same value and the result doesn't depend on their number.
+
+A tube is much thinner than a vessel, and laid out as cells it needs the grid to be fine
+enough to hold it. With TUBES_REDUCED the tubes aren't cells at all: every tube is the
+lumped pipe of the network instead (its inertance and its friction, see
+DEFAULT_TUBE_INERTANCE), driven by the difference of the pressures the last projection
+left in the cells at both of its mouths. Its flow (kept in the tubeFlow of the network)
+leaves one mouth and enters the other as a source in the projection, so the fluid in a
+vessel moves away from the mouth or towards it as the tube fills or drains it. With
+ADVECTION_FLIP the particles that flow through a tube are taken from the cells of one
+mouth and put into those of the other.
+
+This file has no OpenGL dependency.
+*/
+
+#include "GridFluid.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+#include "SimdKernels.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// Grids with fewer cells than this are stepped on one thread. Either way the work is done in blocks of GRID_BLOCK_TILES tiles.
+#define GRID_PARALLEL_MIN 8192
+#define GRID_BLOCK_TILES 2
+
+// How many cells into the air the velocities are extended every step
+#define GRID_EXTRAPOLATE_LAYERS 4
+
+// How many tiles around the fluid are kept (see the description). One tile is already more than the velocities are extended by.
+#define GRID_BAND_TILES 2
+
+// With ADVECTION_FLIP, the particles in a full cell, and the private tiles of the splat: a tile with a border of one face, which
+// holds the weighted sums of u and v and their weights.
+#define GRID_PARTICLES_PER_CELL (GRID_PARTICLES_PER_SIDE * GRID_PARTICLES_PER_SIDE)
+#define GRID_TRANSFER_SIDE (GRID_TILE + 2)
+#define GRID_TRANSFER_FLOATS (4 * GRID_TRANSFER_SIDE * GRID_TRANSFER_SIDE)
+
+// Runs body on the slots [0, tiles) in blocks, on the pool if it is worth it and on this thread otherwise. The blocks are the same
+// either way.
+template <typename Body>
+static void forTiles(const GridTiles& grid, TaskPool* pool, const Body& body)
+{
+	int tiles = grid.tileCount();
+	if (pool != nullptr && grid.cellCount() >= GRID_PARALLEL_MIN)
+	{
+		pool->parallelFor(tiles, GRID_BLOCK_TILES, body);
+		return;
+	}
+
+	for (int begin = 0; begin < tiles; begin += GRID_BLOCK_TILES)
+	{
+		body(begin, std::min(begin + GRID_BLOCK_TILES, tiles));
+	}
+}
+
+// Runs body(cell, x, y) on every cell of the grid, tile by tile. The cells of the edge tiles that are past the edge of the grid
+// are left out; they are walls and stay 0.
+template <typename Body>
+static void forCells(const GridTiles& grid, int begin, int end, const Body& body)
+{
+	for (int slot = begin; slot < end; slot++)
+	{
+		int left = grid.tileLeft(slot);
+		int bottom = grid.tileBottom(slot);
+		int cell = GridTiles::firstCell(slot);
+		for (int y = bottom; y < bottom + GRID_TILE; y++)
+		{
+			for (int x = left; x < left + GRID_TILE; x++, cell++)
+			{
+				if (x < grid.columns && y < grid.rows)
+				{
+					body(cell, x, y);
+				}
+			}
+		}
+	}
+}
+
+template <typename Body>
+static void forCells(const GridTiles& grid, TaskPool* pool, const Body& body)
+{
+	forTiles(grid, pool, [&](int begin, int end) { forCells(grid, begin, end, body); });
+}
+
+// The value of a field at cell, or 0 if there is no such cell.
+static inline float valueAt(const std::vector<float>& field, int cell)
+{
+	return cell >= 0 ? field[cell] : 0.0f;
+}
+
+bool GridFluid::build(const VesselNetwork& network, int resolution, float ceiling)
+{
+	int vessels = network.vesselCount();
+	if (vessels == 0 || resolution <= 0)
+	{
+		std::cout << "There is nothing to lay out on a grid." << std::endl;
+		return false;
+	}
+
+	float minX = network.left[0];
+	float maxX = network.right[0];
+	float minY = network.bottom[0];
+	for (int i = 1; i < vessels; i++)
+	{
+		minX = std::min(minX, network.left[i]);
+		maxX = std::max(maxX, network.right[i]);
+		minY = std::min(minY, network.bottom[i]);
+	}
+	if (ceiling <= minY)
+	{
+		std::cout << "The ceiling of the grid has to be above the floor of the vessels." << std::endl;
+		return false;
+	}
+
+	cellSize = std::max(maxX - minX, ceiling - minY) / resolution;
+	columns = std::max(1, (int)std::lround((maxX - minX) / cellSize));
+	rows = std::max(1, (int)std::lround((ceiling - minY) / cellSize));
+	originX = minX;
+	originY = minY;
+
+	// The first column and row whose center is at or past a coordinate.
+	auto firstColumn = [&](float x) { return std::min(std::max((int)std::ceil((x - originX) / cellSize - 0.5f), 0), columns); };
+	auto firstRow = [&](float y) { return std::min(std::max((int)std::ceil((y - originY) / cellSize - 0.5f), 0), rows); };
+
+	// Every vessel opens the cells whose centers are between its walls and above its floor, and is at least one cell wide.
+	vesselColumns.resize(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		VesselColumns& column = vesselColumns[i];
+		column.begin = std::min(firstColumn(network.left[i]), columns - 1);
+		column.end = std::max(firstColumn(network.right[i]), column.begin + 1);
+		column.bottom = std::min(firstRow(network.bottom[i]), rows - 1);
+	}
+
+	// Every tube runs along the floor between the walls of its vessels (like it is drawn) and is at least one cell tall.
+	tubeCells.resize(network.tubeCount());
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		if (network.left[b] < network.left[a])
+		{
+			std::swap(a, b);
+		}
+		float floor = std::max(network.bottom[a], network.bottom[b]);
+		TubeCells& tube = tubeCells[t];
+		tube.begin = firstColumn(network.right[a]);
+		tube.end = firstColumn(network.left[b]);
+		tube.bottom = std::min(firstRow(floor), rows - 1);
+		tube.top = std::min(std::max(firstRow(floor + GRID_TUBE_HEIGHT), tube.bottom + 1), rows);
+	}
+
+	// The tiles something goes through are open. The grid starts out with all of them, and keeps only the band around the fluid
+	// once it is filled.
+	openTiles.assign(GridTiles::tilesFor(columns) * GridTiles::tilesFor(rows), 0);
+	auto open = [&](int left, int right, int bottom, int top)
+	{
+		if (left >= right || bottom >= top)
+		{
+			return;
+		}
+		for (int y = bottom >> GRID_TILE_BITS; y <= (top - 1) >> GRID_TILE_BITS; y++)
+		{
+			for (int x = left >> GRID_TILE_BITS; x <= (right - 1) >> GRID_TILE_BITS; x++)
+			{
+				openTiles[y * GridTiles::tilesFor(columns) + x] = 1;
+			}
+		}
+	};
+	for (const VesselColumns& column : vesselColumns)
+	{
+		open(column.begin, column.end, column.bottom, rows);
+	}
+	if (tubeModel == TUBES_CELLS)
+	{
+		for (const TubeCells& tube : tubeCells)
+		{
+			open(tube.begin, tube.end, tube.bottom, tube.top);
+		}
+	}
+
+	// The mouth of a reduced tube is the column of its vessel next to the wall the tube leaves through, over the rows the cells of
+	// the tube would have had.
+	mouthStart.assign(1, 0);
+	mouthCells.clear();
+	for (int t = 0; t < network.tubeCount() && tubeModel == TUBES_REDUCED; t++)
+	{
+		const TubeCells& tube = tubeCells[t];
+		for (int end = 0; end < 2; end++)
+		{
+			int vessel = end == 0 ? network.tubeA[t] : network.tubeB[t];
+			int other = end == 0 ? network.tubeB[t] : network.tubeA[t];
+			const VesselColumns& column = vesselColumns[vessel];
+			int x = network.left[other] < network.left[vessel] ? column.begin : column.end - 1;
+			for (int y = std::max(tube.bottom, column.bottom); y < std::max(tube.top, column.bottom + 1); y++)
+			{
+				mouthCells.push_back(y * columns + x);
+			}
+			mouthStart.push_back((int)mouthCells.size());
+		}
+	}
+	tubeCarry.assign(tubeModel == TUBES_REDUCED ? network.tubeCount() : 0, 0.0f);
+	tubeMoves = 0;
+
+	layOut(openTiles);
+	int cells = tiles.cellCount();
+	fraction = std::vector<float>(cells, 0.0f);
+	pressure = std::vector<float>(cells, 0.0f);
+	u = std::vector<float>(cells, 0.0f);
+	v = std::vector<float>(cells, 0.0f);
+	for (int i = 0; i < vessels; i++)
+	{
+		const VesselColumns& column = vesselColumns[i];
+		for (int y = column.bottom; y < rows; y++)
+		{
+			// The cell holding the surface is filled part of the way.
+			float fill = std::min(std::max((network.top[i] - (originY + y * cellSize)) / cellSize, 0.0f), 1.0f);
+			for (int x = column.begin; x < column.end; x++)
+			{
+				fraction[tiles.at(x, y)] = fill;
+			}
+		}
+	}
+	for (const TubeCells& tube : tubeCells)
+	{
+		for (int y = tube.bottom; y < tube.top && tubeModel == TUBES_CELLS; y++)
+		{
+			for (int x = tube.begin; x < tube.end; x++)
+			{
+				int cell = tiles.at(x, y);
+				if (cellVessel[cell] < 0)
+				{
+					fraction[cell] = 1.0f;
+				}
+			}
+		}
+	}
+
+	fluidCells = 0.0;
+	for (float f : fraction)
+	{
+		fluidCells += f;
+	}
+
+	if (advection == ADVECTION_FLIP)
+	{
+		seedParticles();
+	}
+	classify(network.externalPressure.data(), nullptr);
+	followFluid(network.externalPressure.data(), nullptr);
+	layoutChanges++;
+	return true;
+}
+
+void GridFluid::layOut(const std::vector<char>& needed)
+{
+	// The band can shrink, so every field is made anew rather than resized, which would keep the memory it had.
+	tiles.build(columns, rows, needed);
+	int cells = tiles.cellCount();
+	solid = std::vector<char>(cells, 1);
+	cellVessel = std::vector<int>(cells, -1);
+	for (int i = 0; i < (int)vesselColumns.size(); i++)
+	{
+		const VesselColumns& column = vesselColumns[i];
+		for (int y = column.bottom; y < rows; y++)
+		{
+			for (int x = column.begin; x < column.end; x++)
+			{
+				int cell = tiles.at(x, y);
+				if (cell >= 0)
+				{
+					solid[cell] = 0;
+					cellVessel[cell] = i;
+				}
+			}
+		}
+	}
+	for (const TubeCells& tube : tubeCells)
+	{
+		for (int y = tube.bottom; y < tube.top && tubeModel == TUBES_CELLS; y++)
+		{
+			for (int x = tube.begin; x < tube.end; x++)
+			{
+				int cell = tiles.at(x, y);
+				if (cell >= 0)
+				{
+					solid[cell] = 0;
+				}
+			}
+		}
+	}
+
+	// A face is open if it is inside the grid and between two cells that aren't walls. The faces on the right and top edge of the
+	// grid never are, which is why they aren't stored.
+	uOpen = std::vector<char>(cells, 0);
+	vOpen = std::vector<char>(cells, 0);
+	auto open = [&](int cell) { return cell >= 0 && !solid[cell]; };
+	forCells(tiles, 0, tiles.tileCount(), [&](int cell, int x, int y)
+	{
+		uOpen[cell] = x > 0 && open(cell) && open(tiles.left(cell));
+		vOpen[cell] = y > 0 && open(cell) && open(tiles.below(cell));
+	});
+
+	// The advection kernels weigh the cells they sample with this instead of looking at solid.
+	openWeight = std::vector<float>(cells);
+	for (int cell = 0; cell < cells; cell++)
+	{
+		openWeight[cell] = solid[cell] ? 0.0f : 1.0f;
+	}
+
+	cellType = std::vector<char>(cells, GRID_SOLID);
+	airPressure = std::vector<float>(cells, 0.0f);
+	nextFraction = std::vector<float>(cells, 0.0f);
+	nextU = std::vector<float>(cells, 0.0f);
+	nextV = std::vector<float>(cells, 0.0f);
+	uKnown = std::vector<char>(cells, 0);
+	vKnown = std::vector<char>(cells, 0);
+	nextKnown = std::vector<char>(cells, 0);
+	rhs = std::vector<float>(cells, 0.0f);
+	inflow = std::vector<float>(tubeModel == TUBES_REDUCED ? cells : 0, 0.0f);
+	if (advection == ADVECTION_FLIP)
+	{
+		transfer = std::vector<float>((size_t)tiles.tileCount() * GRID_TRANSFER_FLOATS, 0.0f);
+		savedU = std::vector<float>(cells, 0.0f);
+		savedV = std::vector<float>(cells, 0.0f);
+		cellFill = std::vector<float>(cells, 0.0f);
+		particleStart = std::vector<int>(cells + 1, 0);
+		particleKeyBits = keyBits((unsigned int)cells - 1);
+		particleSorter.reset();
+	}
+	solver.resize(tiles);
+}
+
+void GridFluid::followFluid(const float* externalPressure, TaskPool* pool)
+{
+	// The tiles that hold fluid, and those of the mouths, which the tubes need whether there is fluid at them or not.
+	int tileColumns = tiles.tileColumns;
+	int tileRows = tiles.tileRows;
+	wetTiles.assign(tileColumns * tileRows, 0);
+	for (int slot = 0; slot < tiles.tileCount(); slot++)
+	{
+		const float* cell = &fraction[GridTiles::firstCell(slot)];
+		if (std::any_of(cell, cell + GRID_TILE_CELLS, [](float f) { return f > 0.0f; }))
+		{
+			wetTiles[(tiles.tileBottom(slot) >> GRID_TILE_BITS) * tileColumns + (tiles.tileLeft(slot) >> GRID_TILE_BITS)] = 1;
+		}
+	}
+	for (int packed : mouthCells)
+	{
+		wetTiles[((packed / columns) >> GRID_TILE_BITS) * tileColumns + ((packed % columns) >> GRID_TILE_BITS)] = 1;
+	}
+
+	// The open tiles within reach tiles of a wet one, each way and diagonally: first along the rows, then along the columns.
+	auto band = [&](int reach)
+	{
+		spreadTiles.assign(wetTiles.size(), 0);
+		for (int y = 0; y < tileRows; y++)
+		{
+			for (int x = 0; x < tileColumns; x++)
+			{
+				for (int from = std::max(x - reach, 0); from <= std::min(x + reach, tileColumns - 1) && !spreadTiles[y * tileColumns + x]; from++)
+				{
+					spreadTiles[y * tileColumns + x] = wetTiles[y * tileColumns + from];
+				}
+			}
+		}
+		bandTiles.assign(wetTiles.size(), 0);
+		for (int y = 0; y < tileRows; y++)
+		{
+			for (int x = 0; x < tileColumns; x++)
+			{
+				char& kept = bandTiles[y * tileColumns + x];
+				for (int from = std::max(y - reach, 0); from <= std::min(y + reach, tileRows - 1) && !kept; from++)
+				{
+					kept = spreadTiles[from * tileColumns + x];
+				}
+				kept &= openTiles[y * tileColumns + x];
+			}
+		}
+	};
+
+	// Laid out again if a tile within one of the fluid isn't kept, or a kept tile is further from it than the band reaches, plus one.
+	bool stale = false;
+	band(1);
+	for (int tile = 0; tile < tileColumns * tileRows && !stale; tile++)
+	{
+		stale = bandTiles[tile] && tiles.slotAt(tile % tileColumns, tile / tileColumns) < 0;
+	}
+	if (!stale)
+	{
+		band(GRID_BAND_TILES + 1);
+		for (int slot = 0; slot < tiles.tileCount() && !stale; slot++)
+		{
+			stale = !bandTiles[(tiles.tileBottom(slot) >> GRID_TILE_BITS) * tileColumns + (tiles.tileLeft(slot) >> GRID_TILE_BITS)];
+		}
+	}
+	if (!stale)
+	{
+		return;
+	}
+
+	band(GRID_BAND_TILES);
+	GridTiles previous = tiles;
+	layOut(bandTiles);
+	auto carry = [&](std::vector<float>& field)
+	{
+		std::vector<float> moved(tiles.cellCount(), 0.0f);
+		for (int slot = 0; slot < tiles.tileCount(); slot++)
+		{
+			int from = previous.slotAt(tiles.tileLeft(slot) >> GRID_TILE_BITS, tiles.tileBottom(slot) >> GRID_TILE_BITS);
+			if (from >= 0)
+			{
+				std::copy(field.begin() + GridTiles::firstCell(from), field.begin() + GridTiles::firstCell(from + 1),
+					moved.begin() + GridTiles::firstCell(slot));
+			}
+		}
+		field.swap(moved);
+	};
+	carry(fraction);
+	carry(u);
+	carry(v);
+	carry(pressure);
+
+	// The particles are sorted into the buckets of the new tiles, which gives the fill of their cells again.
+	if (advection == ADVECTION_FLIP)
+	{
+		sortParticles(pool);
+	}
+	classify(externalPressure, pool);
+	layoutChanges++;
+}
+
+void GridFluid::advect(float dt, TaskPool* pool)
+{
+	// The kernels trace every face and cell back along the flow (see SimdKernels.h), a row of a tile at a time.
+	AdvectGrid grid;
+	grid.slots = tiles.slotTable();
+	grid.tileColumns = tiles.tileColumns;
+	grid.columns = columns;
+	grid.rows = rows;
+	grid.u = u.data();
+	grid.v = v.data();
+	grid.fraction = fraction.data();
+	grid.open = openWeight.data();
+	grid.uOpen = uOpen.data();
+	grid.vOpen = vOpen.data();
+	grid.nextU = nextU.data();
+	grid.nextV = nextV.data();
+	grid.nextFraction = nextFraction.data();
+	grid.scale = dt / cellSize;
+
+	const SimdKernels& kernels = simdKernels();
+	forTiles(tiles, pool, [&](int begin, int end)
+	{
+		for (int slot = begin; slot < end; slot++)
+		{
+			int first = GridTiles::firstCell(slot);
+			int left = tiles.tileLeft(slot);
+			int bottom = tiles.tileBottom(slot);
+			for (int row = 0; row < GRID_TILE; row++)
+			{
+				kernels.advect(grid, first + row * GRID_TILE, left, bottom + row, GRID_TILE);
+			}
+		}
+	});
+
+	u.swap(nextU);
+	v.swap(nextV);
+	fraction.swap(nextFraction);
+
+	// Tracing back doesn't conserve the fluid exactly, a little of it is smeared away at the surface every step. Whatever went
+	// missing is spread evenly over the cells of the surface, so the levels don't sink over a long run.
+	double filled = 0.0;
+	int surfaceCells = 0;
+	for (int cell = 0; cell < tiles.cellCount(); cell++)
+	{
+		filled += fraction[cell];
+		surfaceCells += fraction[cell] > 0.0f && fraction[cell] < 1.0f;
+	}
+	if (surfaceCells > 0)
+	{
+		float missing = (float)((fluidCells - filled) / surfaceCells);
+		for (int cell = 0; cell < tiles.cellCount(); cell++)
+		{
+			if (fraction[cell] > 0.0f && fraction[cell] < 1.0f)
+			{
+				fraction[cell] = std::min(std::max(fraction[cell] + missing, 0.0f), 1.0f);
+			}
+		}
+	}
+}
+
+void GridFluid::classify(const float* externalPressure, TaskPool* pool)
+{
+	forCells(tiles, pool, [&](int cell, int, int)
+	{
+		if (solid[cell])
+		{
+			cellType[cell] = GRID_SOLID;
+			return;
+		}
+		cellType[cell] = fraction[cell] >= 0.5f ? GRID_FLUID : GRID_AIR;
+		airPressure[cell] = cellVessel[cell] >= 0 ? externalPressure[cellVessel[cell]] : 0.0f;
+	});
+}
+
+void GridFluid::addGravity(float gravity, float dt, TaskPool* pool)
+{
+	// Faces on the edge of the grid or next to a wall don't move. Every other vertical face next to fluid falls.
+	forCells(tiles, pool, [&](int cell, int, int)
+	{
+		u[cell] = uOpen[cell] ? u[cell] : 0.0f;
+		if (!vOpen[cell])
+		{
+			v[cell] = 0.0f;
+		}
+		else if (cellType[tiles.below(cell)] == GRID_FLUID || cellType[cell] == GRID_FLUID)
+		{
+			v[cell] -= gravity * dt;
+		}
+	});
+}
+
+float GridFluid::project(float density, float dt, TaskPool* pool)
+{
+	// The right hand side: how much fluid flows out of every fluid cell, plus the pressure of the air around it.
+	// With p the pressure, the new velocities are u - dt / (density * h) * (difference in p), and their divergence has to be 0.
+	// A cell at the mouth of a reduced tube has to let out what the tube brings in.
+	float divergenceScale = density * cellSize / dt;
+	float inflowScale = 1.0f / cellSize;
+	auto isAir = [&](int cell) { return cell >= 0 && cellType[cell] == GRID_AIR; };
+	forCells(tiles, pool, [&](int cell, int, int)
+	{
+		if (cellType[cell] != GRID_FLUID)
+		{
+			rhs[cell] = 0.0f;
+			return;
+		}
+
+		int left = tiles.left(cell);
+		int right = tiles.right(cell);
+		int below = tiles.below(cell);
+		int above = tiles.above(cell);
+		float divergence = valueAt(u, right) - u[cell] + valueAt(v, above) - v[cell];
+		if (!inflow.empty())
+		{
+			divergence -= inflow[cell] * inflowScale;
+		}
+		float sum = -divergenceScale * divergence;
+		if (isAir(left))
+		{
+			sum += airPressure[left];
+		}
+		if (isAir(right))
+		{
+			sum += airPressure[right];
+		}
+		if (isAir(below))
+		{
+			sum += airPressure[below];
+		}
+		if (isAir(above))
+		{
+			sum += airPressure[above];
+		}
+		rhs[cell] = sum;
+	});
+
+	solver.solve(cellType.data(), rhs.data(), pressure.data(), pool);
+
+	// Subtract the pressure gradient from every face next to fluid. Faces with air on both sides are left for extrapolate().
+	float gradientScale = dt / (density * cellSize);
+	auto cellPressure = [&](int cell) { return cellType[cell] == GRID_FLUID ? pressure[cell] : airPressure[cell]; };
+	int blocks = (tiles.tileCount() + GRID_BLOCK_TILES - 1) / GRID_BLOCK_TILES;
+	blockSums.assign(blocks, 0.0);
+	forTiles(tiles, pool, [&](int begin, int end)
+	{
+		double fastest = 0.0;
+		forCells(tiles, begin, end, [&](int cell, int, int)
+		{
+			uKnown[cell] = 0;
+			if (uOpen[cell])
+			{
+				int left = tiles.left(cell);
+				if (cellType[left] == GRID_FLUID || cellType[cell] == GRID_FLUID)
+				{
+					u[cell] -= gradientScale * (cellPressure(cell) - cellPressure(left));
+					uKnown[cell] = 1;
+					fastest = std::max(fastest, (double)std::abs(u[cell]));
+				}
+			}
+
+			vKnown[cell] = 0;
+			if (vOpen[cell])
+			{
+				int below = tiles.below(cell);
+				if (cellType[below] == GRID_FLUID || cellType[cell] == GRID_FLUID)
+				{
+					v[cell] -= gradientScale * (cellPressure(cell) - cellPressure(below));
+					vKnown[cell] = 1;
+					fastest = std::max(fastest, (double)std::abs(v[cell]));
+				}
+			}
+		});
+		blockSums[begin / GRID_BLOCK_TILES] = fastest;
+	});
+
+	double fastest = 0.0;
+	for (int i = 0; i < blocks; i++)
+	{
+		fastest = std::max(fastest, blockSums[i]);
+	}
+	return (float)fastest;
+}
+
+// Extends a face field by one layer: every open face that isn't known yet takes the average of the known faces around it. The faces
+// are stored with the cells they belong to, so the faces around a face are those of the cells around its cell.
+static void extendLayer(const GridTiles& tiles, const std::vector<float>& value, const std::vector<char>& known, const std::vector<char>& open,
+	std::vector<float>& nextValue, std::vector<char>& nextKnown, TaskPool* pool)
+{
+	nextValue = value;
+	nextKnown = known;
+	forCells(tiles, pool, [&](int cell, int, int)
+	{
+		if (known[cell] || !open[cell])
+		{
+			return;
+		}
+
+		float sum = 0.0f;
+		int count = 0;
+		int around[4] = { tiles.left(cell), tiles.right(cell), tiles.below(cell), tiles.above(cell) };
+		for (int k = 0; k < 4; k++)
+		{
+			if (around[k] >= 0 && known[around[k]])
+			{
+				sum += value[around[k]];
+				count++;
+			}
+		}
+		if (count > 0)
+		{
+			nextValue[cell] = sum / count;
+			nextKnown[cell] = 1;
+		}
+	});
+}
+
+void GridFluid::extrapolate(TaskPool* pool)
+{
+	for (int layer = 0; layer < GRID_EXTRAPOLATE_LAYERS; layer++)
+	{
+		extendLayer(tiles, u, uKnown, uOpen, nextU, nextKnown, pool);
+		u.swap(nextU);
+		uKnown.swap(nextKnown);
+		extendLayer(tiles, v, vKnown, vOpen, nextV, nextKnown, pool);
+		v.swap(nextV);
+		vKnown.swap(nextKnown);
+	}
+
+	// Air further away than that doesn't move.
+	for (size_t face = 0; face < u.size(); face++)
+	{
+		u[face] = uKnown[face] ? u[face] : 0.0f;
+		v[face] = vKnown[face] ? v[face] : 0.0f;
+	}
+}
+
+void GridFluid::measure(VesselNetwork& network, float density, float gravity) const
+{
+	// The particles can be packed tighter than full in places, which the fill of the cells counts, so the levels don't sink.
+	const std::vector<float>& filledCells = advection == ADVECTION_FLIP ? cellFill : fraction;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		const VesselColumns& column = vesselColumns[i];
+		double filled = 0.0;
+		for (int y = column.bottom; y < rows; y++)
+		{
+			for (int x = column.begin; x < column.end; x++)
+			{
+				filled += valueAt(filledCells, tiles.at(x, y));
+			}
+		}
+
+		float height = (float)(filled * cellSize / (column.end - column.begin));
+		network.height[i] = height;
+		network.top[i] = network.bottom[i] + height;
+		network.pressure[i] = density * gravity * height;
+	}
+}
+
+// Where a point falls in a field of width x height values, in units of its own spacing: the values to its bottom left (x0, y0) and
+// top right (x1, y1), and how far it is between them, clamped to the edges of the field like bilinear sampling is.
+struct FieldPoint
+{
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	float fx;
+	float fy;
+};
+
+static inline FieldPoint fieldPoint(int width, int height, float x, float y)
+{
+	FieldPoint p;
+	x = std::min(std::max(x, 0.0f), (float)(width - 1));
+	y = std::min(std::max(y, 0.0f), (float)(height - 1));
+	p.x0 = std::max(std::min((int)x, width - 2), 0);
+	p.y0 = std::max(std::min((int)y, height - 2), 0);
+	p.x1 = std::min(p.x0 + 1, width - 1);
+	p.y1 = std::min(p.y0 + 1, height - 1);
+	p.fx = x - p.x0;
+	p.fy = y - p.y0;
+	return p;
+}
+
+static inline float sampleAt(const GridTiles& tiles, const std::vector<float>& field, const FieldPoint& p)
+{
+	float bottomLeft = valueAt(field, tiles.at(p.x0, p.y0));
+	float topLeft = valueAt(field, tiles.at(p.x0, p.y1));
+	float bottom = bottomLeft + (valueAt(field, tiles.at(p.x1, p.y0)) - bottomLeft) * p.fx;
+	float top = topLeft + (valueAt(field, tiles.at(p.x1, p.y1)) - topLeft) * p.fx;
+	return bottom + (top - bottom) * p.fy;
+}
+
+// Particle positions are in cells, like those of advect(): u is at (x, y + 0.5) and v at (x + 0.5, y).
+static inline FieldPoint uPoint(const GridFluid& grid, float x, float y)
+{
+	return fieldPoint(grid.columns + 1, grid.rows, x, y - 0.5f);
+}
+
+static inline FieldPoint vPoint(const GridFluid& grid, float x, float y)
+{
+	return fieldPoint(grid.columns, grid.rows + 1, x - 0.5f, y);
+}
+
+// The position of cell (x, y) of a tile along a Morton (Z order) curve through the tile.
+static inline int tileMorton(int x, int y)
+{
+	int code = 0;
+	for (int bit = 0; bit < GRID_TILE_BITS; bit++)
+	{
+		code |= ((x >> bit) & 1) << (2 * bit);
+		code |= ((y >> bit) & 1) << (2 * bit + 1);
+	}
+	return code;
+}
+
+void GridFluid::seedParticles()
+{
+	// A regular lattice in every cell that isn't a wall, with as many of its rows as the cell is full, from the bottom up.
+	particleX.clear();
+	particleY.clear();
+	const float step = 1.0f / GRID_PARTICLES_PER_SIDE;
+	forCells(tiles, 0, tiles.tileCount(), [&](int cell, int x, int y)
+	{
+		if (solid[cell])
+		{
+			return;
+		}
+		for (int j = 0; j < GRID_PARTICLES_PER_SIDE; j++)
+		{
+			if ((j + 0.5f) * step >= fraction[cell])
+			{
+				break;
+			}
+			for (int i = 0; i < GRID_PARTICLES_PER_SIDE; i++)
+			{
+				particleX.push_back(x + (i + 0.5f) * step);
+				particleY.push_back(y + (j + 0.5f) * step);
+			}
+		}
+	});
+	particleU.assign(particleX.size(), 0.0f);
+	particleV.assign(particleX.size(), 0.0f);
+	sortParticles(nullptr);
+}
+
+void GridFluid::moveParticles(float dt, TaskPool* pool)
+{
+	// How far a velocity moves a particle in one step, in cells
+	float scale = dt / cellSize;
+	auto velocity = [&](float x, float y, float& vx, float& vy)
+	{
+		vx = sampleAt(tiles, u, uPoint(*this, x, y));
+		vy = sampleAt(tiles, v, vPoint(*this, x, y));
+	};
+	auto open = [&](float x, float y)
+	{
+		if (x < 0.0f || y < 0.0f || x >= columns || y >= rows)
+		{
+			return false;
+		}
+		int cell = tiles.at((int)x, (int)y);
+		return cell >= 0 && !solid[cell];
+	};
+
+	// Every particle moves through the projected velocities, with a midpoint step like advect() traces back. A particle that would
+	// end up in a wall slides along it if it can, and otherwise stays where it is; either way it loses the velocity into the wall.
+	forTiles(tiles, pool, [&](int begin, int end)
+	{
+		for (int i = particleStart[GridTiles::firstCell(begin)]; i < particleStart[GridTiles::firstCell(end)]; i++)
+		{
+			float x = particleX[i];
+			float y = particleY[i];
+			float vx, vy;
+			velocity(x, y, vx, vy);
+			float midX = x + 0.5f * scale * vx;
+			float midY = y + 0.5f * scale * vy;
+			velocity(midX, midY, vx, vy);
+			float toX = x + scale * vx;
+			float toY = y + scale * vy;
+
+			if (open(toX, toY))
+			{
+				particleX[i] = toX;
+				particleY[i] = toY;
+			}
+			else if (open(toX, y))
+			{
+				particleX[i] = toX;
+				particleV[i] = 0.0f;
+			}
+			else if (open(x, toY))
+			{
+				particleY[i] = toY;
+				particleU[i] = 0.0f;
+			}
+			else
+			{
+				particleU[i] = 0.0f;
+				particleV[i] = 0.0f;
+			}
+		}
+	});
+}
+
+void GridFluid::sortParticles(TaskPool* pool)
+{
+	// Every particle is in a cell that isn't a wall, so its tile is kept.
+	int count = (int)particleX.size();
+	int cells = tiles.cellCount();
+	particleKeys.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		int x = (int)particleX[i];
+		int y = (int)particleY[i];
+		int slot = tiles.slotAt(x >> GRID_TILE_BITS, y >> GRID_TILE_BITS);
+		particleKeys[i] = (unsigned int)(GridTiles::firstCell(slot) + tileMorton(x & (GRID_TILE - 1), y & (GRID_TILE - 1)));
+	}
+
+	if (particleSorter.sort(particleKeys, particleKeyBits, pool, particleOrder))
+	{
+		auto reorder = [&](std::vector<float>& values)
+		{
+			particleScratch.resize(count);
+			for (int i = 0; i < count; i++)
+			{
+				particleScratch[i] = values[particleOrder[i]];
+			}
+			values.swap(particleScratch);
+		};
+		reorder(particleX);
+		reorder(particleY);
+		reorder(particleU);
+		reorder(particleV);
+	}
+
+	particleStart.assign(cells + 1, 0);
+	for (int i = 0; i < count; i++)
+	{
+		particleStart[particleKeys[i] + 1]++;
+	}
+	for (int c = 0; c < cells; c++)
+	{
+		particleStart[c + 1] += particleStart[c];
+	}
+
+	// The fill of every cell follows from its bucket.
+	forCells(tiles, 0, tiles.tileCount(), [&](int cell, int x, int y)
+	{
+		int bucket = (cell & ~(GRID_TILE_CELLS - 1)) + tileMorton(x & (GRID_TILE - 1), y & (GRID_TILE - 1));
+		float fill = (particleStart[bucket + 1] - particleStart[bucket]) / (float)GRID_PARTICLES_PER_CELL;
+		cellFill[cell] = fill;
+		fraction[cell] = solid[cell] ? 0.0f : std::min(fill, 1.0f);
+	});
+}
+
+// Adds value with the bilinear weights of p to the four faces around it, in the private tile of a tile whose bottom left cell is at
+// (left, bottom). The faces are all within one face of the tile.
+static inline void splat(float* sum, float* weight, const FieldPoint& p, float value, int left, int bottom)
+{
+	int x0 = p.x0 - left + 1;
+	int x1 = p.x1 - left + 1;
+	int y0 = (p.y0 - bottom + 1) * GRID_TRANSFER_SIDE;
+	int y1 = (p.y1 - bottom + 1) * GRID_TRANSFER_SIDE;
+	float w[4] = { (1.0f - p.fx) * (1.0f - p.fy), p.fx * (1.0f - p.fy), (1.0f - p.fx) * p.fy, p.fx * p.fy };
+	int at[4] = { y0 + x0, y0 + x1, y1 + x0, y1 + x1 };
+	for (int k = 0; k < 4; k++)
+	{
+		sum[at[k]] += w[k] * value;
+		weight[at[k]] += w[k];
+	}
+}
+
+void GridFluid::particlesToGrid(TaskPool* pool)
+{
+	// Every tile splats its own particles into its private tile: the weighted sums of u and v and their weights, on the faces of
+	// the tile and one face around it.
+	const int side = GRID_TRANSFER_SIDE * GRID_TRANSFER_SIDE;
+	forTiles(tiles, pool, [&](int begin, int end)
+	{
+		for (int slot = begin; slot < end; slot++)
+		{
+			float* own = transfer.data() + (size_t)slot * GRID_TRANSFER_FLOATS;
+			std::fill(own, own + GRID_TRANSFER_FLOATS, 0.0f);
+			int left = tiles.tileLeft(slot);
+			int bottom = tiles.tileBottom(slot);
+			for (int i = particleStart[GridTiles::firstCell(slot)]; i < particleStart[GridTiles::firstCell(slot + 1)]; i++)
+			{
+				splat(own, own + side, uPoint(*this, particleX[i], particleY[i]), particleU[i], left, bottom);
+				splat(own + 2 * side, own + 3 * side, vPoint(*this, particleX[i], particleY[i]), particleV[i], left, bottom);
+			}
+		}
+	});
+
+	// Then every face adds up the private tiles it is in: its own and those of the 8 tiles around it, always in the same order. The
+	// faces nothing was splatted on are left for extrapolate().
+	forTiles(tiles, pool, [&](int begin, int end)
+	{
+		float sum[4][GRID_TILE_CELLS];
+		for (int slot = begin; slot < end; slot++)
+		{
+			std::fill(&sum[0][0], &sum[0][0] + 4 * GRID_TILE_CELLS, 0.0f);
+			int tileX = tiles.tileLeft(slot) >> GRID_TILE_BITS;
+			int tileY = tiles.tileBottom(slot) >> GRID_TILE_BITS;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int from = tiles.slotAt(tileX + dx, tileY + dy);
+					if (from < 0)
+					{
+						continue;
+					}
+					const float* other = transfer.data() + (size_t)from * GRID_TRANSFER_FLOATS;
+					for (int y = 0; y < GRID_TILE; y++)
+					{
+						int row = y - dy * GRID_TILE + 1;
+						if (row < 0 || row >= GRID_TRANSFER_SIDE)
+						{
+							continue;
+						}
+						for (int x = 0; x < GRID_TILE; x++)
+						{
+							int column = x - dx * GRID_TILE + 1;
+							if (column < 0 || column >= GRID_TRANSFER_SIDE)
+							{
+								continue;
+							}
+							int at = row * GRID_TRANSFER_SIDE + column;
+							for (int k = 0; k < 4; k++)
+							{
+								sum[k][y * GRID_TILE + x] += other[k * side + at];
+							}
+						}
+					}
+				}
+			}
+
+			int first = GridTiles::firstCell(slot);
+			for (int k = 0; k < GRID_TILE_CELLS; k++)
+			{
+				int cell = first + k;
+				uKnown[cell] = uOpen[cell] && sum[1][k] > 0.0f;
+				vKnown[cell] = vOpen[cell] && sum[3][k] > 0.0f;
+				u[cell] = uKnown[cell] ? sum[0][k] / sum[1][k] : 0.0f;
+				v[cell] = vKnown[cell] ? sum[2][k] / sum[3][k] : 0.0f;
+			}
+		}
+	});
+
+	// The faces around the fluid get velocities too, before they are saved, or the particles next to the air would take the whole
+	// extrapolated velocity for a change.
+	extrapolate(pool);
+	savedU = u;
+	savedV = v;
+}
+
+void GridFluid::gridToParticles(TaskPool* pool)
+{
+	float pic = 1.0f - flipRatio;
+	forTiles(tiles, pool, [&](int begin, int end)
+	{
+		for (int i = particleStart[GridTiles::firstCell(begin)]; i < particleStart[GridTiles::firstCell(end)]; i++)
+		{
+			FieldPoint pu = uPoint(*this, particleX[i], particleY[i]);
+			FieldPoint pv = vPoint(*this, particleX[i], particleY[i]);
+			float newU = sampleAt(tiles, u, pu);
+			float newV = sampleAt(tiles, v, pv);
+			particleU[i] = flipRatio * (particleU[i] + newU - sampleAt(tiles, savedU, pu)) + pic * newU;
+			particleV[i] = flipRatio * (particleV[i] + newV - sampleAt(tiles, savedV, pv)) + pic * newV;
+		}
+	});
+}
+
+// 32 well mixed bits of a number (the integer hash of Chris Wellons).
+static inline unsigned int scatterHash(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+float GridFluid::flowThroughTubes(VesselNetwork& network, float dt)
+{
+	for (int packed : mouthCells)
+	{
+		inflow[tiles.at(packed % columns, packed / columns)] = 0.0f;
+	}
+
+	// Like a tube of the network, the flow runs from B to A, driven by the difference in pressure and held back by the friction
+	// (implicitly, so it can't overshoot). The pressure of a mouth is that of its cells: the last projection's where they are fluid,
+	// the air's where they aren't.
+	float cellArea = cellSize * cellSize;
+	float fastest = 0.0f;
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		float mouthPressure[2] = {};
+		int fluid[2] = {};
+		for (int end = 0; end < 2; end++)
+		{
+			int first = mouthStart[2 * t + end];
+			int last = mouthStart[2 * t + end + 1];
+			for (int k = first; k < last; k++)
+			{
+				int cell = tiles.at(mouthCells[k] % columns, mouthCells[k] / columns);
+				bool isFluid = cellType[cell] == GRID_FLUID;
+				mouthPressure[end] += isFluid ? pressure[cell] : airPressure[cell];
+				fluid[end] += isFluid;
+			}
+			mouthPressure[end] /= last - first;
+		}
+
+		float flow = network.tubeFlow[t];
+		flow = (flow + dt * (mouthPressure[1] - mouthPressure[0]) * network.tubeInvInertance[t]) / (1.0f + dt * network.tubeDamping[t]);
+
+		// The fluid only leaves a mouth that holds some, and no more than its fluid cells hold in a step.
+		int source = flow > 0.0f ? 1 : 0;
+		float limit = fluid[source] * cellArea / dt;
+		flow = std::min(std::max(flow, -limit), limit);
+		if (std::abs(flow) < REST_FLOW)
+		{
+			flow = 0.0f;
+		}
+		network.tubeFlow[t] = flow;
+
+		// It is taken evenly from the fluid cells of one mouth and added evenly to all cells of the other.
+		for (int end = 0; end < 2; end++)
+		{
+			int first = mouthStart[2 * t + end];
+			int last = mouthStart[2 * t + end + 1];
+			float share = end == source ? -std::abs(flow) / std::max(fluid[end], 1) : std::abs(flow) / (last - first);
+			for (int k = first; k < last; k++)
+			{
+				int cell = tiles.at(mouthCells[k] % columns, mouthCells[k] / columns);
+				if (end != source || cellType[cell] == GRID_FLUID)
+				{
+					inflow[cell] += share;
+				}
+			}
+			fastest = std::max(fastest, std::abs(flow) / (cellSize * (last - first)));
+		}
+	}
+	return fastest;
+}
+
+void GridFluid::carryThroughTubes(const VesselNetwork& network, float dt)
+{
+	float cellArea = cellSize * cellSize;
+	if (advection != ADVECTION_FLIP)
+	{
+		// The projection only lets fluid cells take in what a tube brings, so a mouth that isn't fluid yet fills straight away.
+		for (int packed : mouthCells)
+		{
+			int cell = tiles.at(packed % columns, packed / columns);
+			if (inflow[cell] > 0.0f && cellType[cell] != GRID_FLUID)
+			{
+				fraction[cell] = std::min(fraction[cell] + inflow[cell] * dt / cellArea, 1.0f);
+			}
+		}
+		return;
+	}
+
+	// Whole particles move from the mouth the flow leaves to the other one, to a point in its next cell that a hash of how many were
+	// moved so far picks (so no two land on top of each other and stay there), and leave it at the speed of the flow. The buckets
+	// are still those of this step, since the particles haven't moved since the sort.
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		float flow = network.tubeFlow[t];
+		tubeCarry[t] += flow * dt * GRID_PARTICLES_PER_CELL / cellArea;
+		int from = tubeCarry[t] > 0.0f ? 2 * t + 1 : 2 * t;
+		int to = from ^ 1;
+		int targets = mouthStart[to + 1] - mouthStart[to];
+		float direction = mouthCells[mouthStart[to]] % columns > mouthCells[mouthStart[from]] % columns ? 1.0f : -1.0f;
+		float speed = std::abs(flow) / (cellSize * targets);
+		int moved = 0;
+		for (int k = mouthStart[from]; k < mouthStart[from + 1] && std::abs(tubeCarry[t]) >= 1.0f; k++)
+		{
+			int x = mouthCells[k] % columns;
+			int y = mouthCells[k] / columns;
+			int bucket = GridTiles::firstCell(tiles.slotAt(x >> GRID_TILE_BITS, y >> GRID_TILE_BITS)) + tileMorton(x & (GRID_TILE - 1), y & (GRID_TILE - 1));
+			for (int p = particleStart[bucket]; p < particleStart[bucket + 1] && std::abs(tubeCarry[t]) >= 1.0f; p++)
+			{
+				int target = mouthCells[mouthStart[to] + moved % targets];
+				unsigned int spot = scatterHash(tubeMoves++);
+				particleX[p] = target % columns + ((spot & 0xffff) + 0.5f) / 65536.0f;
+				particleY[p] = target / columns + ((spot >> 16) + 0.5f) / 65536.0f;
+				particleU[p] = direction * speed;
+				particleV[p] = 0.0f;
+				tubeCarry[t] -= tubeCarry[t] > 0.0f ? 1.0f : -1.0f;
+				moved++;
+			}
+		}
+
+		// A mouth that ran out of particles can't give what is left, which would otherwise pile up for as long as it stays dry.
+		tubeCarry[t] = std::min(std::max(tubeCarry[t], -1.0f), 1.0f);
+	}
+}
+
+bool GridFluid::update(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool)
+{
+	if (advection == ADVECTION_FLIP)
+	{
+		moveParticles(dt, pool);
+		sortParticles(pool);
+		particlesToGrid(pool);
+	}
+	else
+	{
+		advect(dt, pool);
+	}
+	classify(network.externalPressure.data(), pool);
+	addGravity(gravity, dt, pool);
+	float tubeSpeed = tubeModel == TUBES_REDUCED ? flowThroughTubes(network, dt) : 0.0f;
+	float fastest = std::max(project(density, dt, pool), tubeSpeed);
+	extrapolate(pool);
+	if (advection == ADVECTION_FLIP)
+	{
+		gridToParticles(pool);
+	}
+	if (tubeModel == TUBES_REDUCED)
+	{
+		carryThroughTubes(network, dt);
+	}
+	measure(network, density, gravity);
+	followFluid(network.externalPressure.data(), pool);
+
+	// Like a tube of the network, the fluid is at rest once nothing moves more than REST_HEIGHT in a step.
+	return fastest * dt > REST_HEIGHT;
+}
+
+void GridFluid::cellSpeeds(std::vector<float>& result) const
+{
+	result.assign(tiles.cellCount(), 0.0f);
+	forCells(tiles, 0, tiles.tileCount(), [&](int cell, int, int)
+	{
+		float vx = 0.5f * (u[cell] + valueAt(u, tiles.right(cell)));
+		float vy = 0.5f * (v[cell] + valueAt(v, tiles.above(cell)));
+		result[cell] = std::sqrt(vx * vx + vy * vy);
+	});
+}
+
+void GridFluid::cellPressures(std::vector<float>& result) const
+{
+	result.assign(tiles.cellCount(), 0.0f);
+	forCells(tiles, 0, tiles.tileCount(), [&](int cell, int, int)
+	{
+		if (cellType[cell] == GRID_FLUID)
+		{
+			result[cell] = pressure[cell];
+		}
+		else if (cellType[cell] == GRID_AIR)
+		{
+			result[cell] = airPressure[cell];
+		}
+	});
+}
+
+double GridFluid::totalVolume() const
+{
+	if (advection == ADVECTION_FLIP)
+	{
+		return (double)particleX.size() / GRID_PARTICLES_PER_CELL * cellSize * cellSize;
+	}
+	double filled = 0.0;
+	for (float f : fraction)
+	{
+		filled += f;
+	}
+	return filled * cellSize * cellSize;
+}
+
+size_t GridFluid::bytes() const
+{
+	size_t floats = fraction.capacity() + u.capacity() + v.capacity() + pressure.capacity() + airPressure.capacity() + nextFraction.capacity()
+		+ nextU.capacity() + nextV.capacity() + rhs.capacity() + openWeight.capacity() + particleX.capacity() + particleY.capacity()
+		+ particleU.capacity() + particleV.capacity() + particleScratch.capacity() + transfer.capacity() + savedU.capacity() + savedV.capacity()
+		+ cellFill.capacity() + inflow.capacity() + tubeCarry.capacity();
+	size_t chars = cellType.capacity() + solid.capacity() + uOpen.capacity() + vOpen.capacity() + uKnown.capacity() + vKnown.capacity()
+		+ nextKnown.capacity() + openTiles.capacity() + wetTiles.capacity() + bandTiles.capacity() + spreadTiles.capacity();
+	size_t ints = cellVessel.capacity() + particleStart.capacity() + particleKeys.capacity() + particleOrder.capacity() + mouthStart.capacity()
+		+ mouthCells.capacity();
+	return floats * sizeof(float) + chars + ints * sizeof(int) + tiles.bytes() + solver.bytes();
+}
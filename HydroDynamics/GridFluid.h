@@ -0,0 +1,280 @@
+/*
+Title: HydroDynamics
+File Name: GridFluid.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+An incompressible fluid on a grid, for seeing how the fluid actually moves inside the
+vessels and the tubes instead of only where its levels are.
+
+The apparatus of a VesselNetwork is laid out on a grid of square cells: the columns of
+the vessels (from their floors up to a ceiling) and the tubes along the floor are open,
+everything else is solid wall. Every open cell is either fluid or air, depending on how
+full of fluid it is. Velocities live on the faces between cells (a MAC grid): the
+horizontal velocity on the vertical faces and the vertical velocity on the horizontal
+faces, so the difference of two neighbouring pressures acts directly on the face between
+them.
+
+Every step:
+- carries the velocities and the fill of every cell along the flow (semi-Lagrangian
+  advection, traced back with a midpoint step),
+- adds gravity to every face next to fluid,
+- solves for the pressure that makes the flow divergence free and subtracts its gradient
+  (the projection), and
+- extends the velocities a few cells into the air, so the surface has something to move
+  along in the next step.
+
+The air is at the pressure pushed onto the vessel it is in (the piston), or 0. The
+pressure is a Poisson equation over the fluid cells, which GridPressureSolver solves
+(with multigrid, by default), starting from the pressure of the last step.
+
+Most of the bounding box of an apparatus is wall or air that no fluid is near, so the grid
+is stored in tiles (see GridTiles.h), and only the tiles of a narrow band around the fluid
+are kept: the open tiles (those a vessel or a tube goes through) within GRID_BAND_TILES
+tiles of a tile that holds fluid, and those of the mouths of the tubes. Everything else
+costs next to nothing, so the resolution can go up as far as the fluid allows, not the
+bounding box or the vessels. After every step the band is checked against the fluid, and
+laid out again once the fluid came within a tile of its edge, or moved a tile further from
+it than it was laid out for; the fields are carried over to the new tiles, and the new
+ones start out as still air. The fluid never gets near the edge of the band, and further
+from it than the velocities are extended there is only still air with no fluid in it,
+which the steps treat the same as a wall. Only the pressure solve sees a difference: its
+coarser levels are smaller, so it converges along another path to the same tolerance.
+Every stage works cell by cell, so it is split into blocks of tiles on the task pool. The
+result doesn't depend on the number of threads.
+
+Tracing the fields back smears them a little every step, which damps the waves and
+rounds off the surface. With ADVECTION_FLIP the fluid is carried by particles instead
+(FLIP/PIC): every particle keeps its own position and velocity, which only pass through
+the grid for the forces and the projection. Every step the particles move through the
+velocities of the grid, are sorted by the tile they are in (and along a Morton curve
+inside it, see ParticleSort.h) and are splatted onto the faces around them; the fill of every cell is how
+many particles it holds. After the projection every particle takes over how much the
+grid velocity around it changed (FLIP, which keeps all the detail but gets noisy), mixed
+with a little of the grid velocity itself (PIC, which is smooth but damped). The splat is
+split by tile: every tile collects its own particles into a private tile with a border
+of one face all around, and every face then adds up the private tiles it is in, so no two
+threads ever write the same value and the result doesn't depend on their number.
+
+A tube is much thinner than a vessel, and laid out as cells it needs the grid to be fine
+enough to hold it. With TUBES_REDUCED the tubes aren't cells at all: every tube is the
+lumped pipe of the network instead (its inertance and its friction, see
+DEFAULT_TUBE_INERTANCE), driven by the difference of the pressures the last projection
+left in the cells at both of its mouths. Its flow (kept in the tubeFlow of the network)
+leaves one mouth and enters the other as a source in the projection, so the fluid in a
+vessel moves away from the mouth or towards it as the tube fills or drains it. With
+ADVECTION_FLIP the particles that flow through a tube are taken from the cells of one
+mouth and put into those of the other.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _GRID_FLUID_H
+#define _GRID_FLUID_H
+
+#include <cstddef>
+#include <vector>
+#include "GridPressureSolver.h"
+#include "GridTiles.h"
+#include "ParticleSort.h"
+
+struct VesselNetwork;
+class TaskPool;
+
+// How tall a tube is on the grid, the same as it is drawn
+#define GRID_TUBE_HEIGHT 0.02f
+
+enum GridAdvection
+{
+	ADVECTION_SEMI_LAGRANGIAN = 0,	// The fields are traced back along the flow
+	ADVECTION_FLIP					// Particles carry the fluid (FLIP/PIC)
+};
+
+enum GridTubeModel
+{
+	TUBES_CELLS = 0,	// The tubes are open cells along the floor
+	TUBES_REDUCED		// Every tube is a lumped pipe between the cells at its mouths
+};
+
+// With ADVECTION_FLIP, every full cell starts with this many particles in a row and a column, and the part of the grid velocity
+// the particles take over as it is (PIC) rather than its change (FLIP).
+#define GRID_PARTICLES_PER_SIDE 2
+#define GRID_FLIP_RATIO 0.95f
+
+class GridFluid
+{
+public:
+	GridPressureSolver solver;
+
+	// The grid, with row 0 at the bottom. The bottom left corner of cell (x, y) is at (originX + x * cellSize, originY + y * cellSize),
+	// and its values are at index tiles.at(x, y) of every field, if it is in a tile that is kept. The tiles follow the fluid, and
+	// layoutChanges goes up every time they are laid out anew (by build() too), for whatever is drawn in their order.
+	int columns = 0;
+	int rows = 0;
+	float cellSize = 0.0f;
+	float originX = 0.0f;
+	float originY = 0.0f;
+	GridTiles tiles;
+	int layoutChanges = 0;
+
+	// Per cell: how full of fluid it is, from 0 to 1, and whether it is solid, fluid or air (a GridCell).
+	std::vector<float> fraction;
+	std::vector<char> cellType;
+
+	// Per face, stored with the cell it belongs to: u[cell] is the horizontal velocity on the left face of the cell, and v[cell]
+	// the vertical velocity on its bottom face. The faces on the right and top edge of the grid are always closed.
+	std::vector<float> u;
+	std::vector<float> v;
+
+	// Per cell, from the last projection
+	std::vector<float> pressure;
+
+	// How the fluid is carried, which has to be set before build(). With ADVECTION_FLIP, flipRatio is how much of the change of the
+	// grid velocity the particles take over (1 is pure FLIP, 0 pure PIC).
+	GridAdvection advection = ADVECTION_SEMI_LAGRANGIAN;
+	float flipRatio = GRID_FLIP_RATIO;
+
+	// How the tubes are simulated, which has to be set before build() too.
+	GridTubeModel tubeModel = TUBES_CELLS;
+
+	// With ADVECTION_FLIP, per particle as a structure of arrays: where it is, in cells from the bottom left corner of the grid, and
+	// its velocity. The order changes every step.
+	std::vector<float> particleX;
+	std::vector<float> particleY;
+	std::vector<float> particleU;
+	std::vector<float> particleV;
+
+	// Lays the vessels and tubes of a network out on a grid with about resolution cells across the longer side, open from the
+	// lowest floor up to ceiling, and fills them up to the current heights of the vessels. The tubes start full (with TUBES_REDUCED,
+	// they aren't on the grid, and their flow is the one the network has).
+	// Returns false (and prints why) if the network has no vessels or the ceiling is below them.
+	bool build(const VesselNetwork& network, int resolution, float ceiling);
+
+	// Advances the fluid by dt seconds, with the external pressures of the network pushing on the air above every vessel.
+	// Afterwards the height (and top and pressure) of every vessel in the network is how much fluid is in its column.
+	// Returns false if nothing moved.
+	bool update(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool = nullptr);
+
+	// The speed at the center of every cell, for drawing, in the order of the fields.
+	void cellSpeeds(std::vector<float>& result) const;
+
+	// The pressure of every cell, for drawing, in the order of the fields: that of the fluid in a fluid cell, that of the air above
+	// it in an air cell, and 0 in a wall.
+	void cellPressures(std::vector<float>& result) const;
+
+	// The volume of all fluid on the grid.
+	double totalVolume() const;
+
+	// The memory the fields, the index and the pressure solve take.
+	size_t bytes() const;
+
+private:
+	// The cells of a vessel: columns begin to end - 1, from row bottom up.
+	struct VesselColumns
+	{
+		int begin;
+		int end;
+		int bottom;
+	};
+
+	// The cells of a tube along the floor: columns begin to end - 1, rows bottom to top - 1.
+	struct TubeCells
+	{
+		int begin;
+		int end;
+		int bottom;
+		int top;
+	};
+
+	// Keeps the tiles of needed (one per tile of the grid), with the walls and open faces of their cells, and sizes every field for
+	// them. Only the fields that are worked out anew every step get their values; the others are up to the caller.
+	void layOut(const std::vector<char>& needed);
+
+	// Lays the tiles out again around the fluid if it came too close to the edge of the band or moved away from it (see the
+	// description), carrying the fields over.
+	void followFluid(const float* externalPressure, TaskPool* pool);
+
+	void advect(float dt, TaskPool* pool);
+	void classify(const float* externalPressure, TaskPool* pool);
+	void addGravity(float gravity, float dt, TaskPool* pool);
+	float project(float density, float dt, TaskPool* pool);	// Returns the fastest velocity on a face next to fluid
+	void extrapolate(TaskPool* pool);
+	void measure(VesselNetwork& network, float density, float gravity) const;
+
+	// With TUBES_REDUCED: advances the flow of every tube from the pressures of the last projection and writes the inflow of the
+	// cells at its mouths, returning the fastest the fluid leaves a mouth. Then, after the projection, fills the mouths that aren't
+	// fluid straight away, and with ADVECTION_FLIP moves the particles that flowed through.
+	float flowThroughTubes(VesselNetwork& network, float dt);
+	void carryThroughTubes(const VesselNetwork& network, float dt);
+
+	// The steps of ADVECTION_FLIP, in the order update() runs them.
+	void seedParticles();
+	void moveParticles(float dt, TaskPool* pool);
+	void sortParticles(TaskPool* pool);
+	void particlesToGrid(TaskPool* pool);
+	void gridToParticles(TaskPool* pool);
+
+	std::vector<char> solid;			// Per cell, the walls, which never change
+	std::vector<float> openWeight;		// Per cell, 0 on the walls and 1 everywhere else, for the advection kernels
+	std::vector<int> cellVessel;		// Per cell, the vessel whose column it is in, or -1
+	std::vector<float> airPressure;		// Per cell, the pressure of the air in it
+	std::vector<VesselColumns> vesselColumns;	// Per vessel
+	std::vector<TubeCells> tubeCells;			// Per tube
+	std::vector<char> openTiles;		// Per tile of the grid, whether a vessel or a tube goes through it
+	std::vector<char> wetTiles;			// Per tile of the grid, whether it holds fluid (or a mouth), and the band around those
+	std::vector<char> bandTiles;
+	std::vector<char> spreadTiles;
+	double fluidCells = 0.0;					// How many cells the fluid filled when the grid was built
+	std::vector<float> nextFraction;
+	std::vector<float> nextU;
+	std::vector<float> nextV;
+	std::vector<char> uOpen;			// Per face, whether it is inside the grid and not next to a wall
+	std::vector<char> vOpen;
+	std::vector<char> uKnown;			// Per face, whether the velocity came out of the projection (or was extended already)
+	std::vector<char> vKnown;
+	std::vector<char> nextKnown;
+	std::vector<float> rhs;				// Per cell, the right hand side of the pressure solve
+
+	// With TUBES_REDUCED, the cells at the mouths of every tube: those of end e (2 * t at vessel tubeA[t], 2 * t + 1 at tubeB[t])
+	// are mouthCells[mouthStart[e]] to mouthCells[mouthStart[e + 1] - 1], each packed as y * columns + x.
+	std::vector<int> mouthStart;
+	std::vector<int> mouthCells;
+	std::vector<float> inflow;			// Per cell, the area a second the tubes add to it (or take from it)
+	std::vector<float> tubeCarry;		// Per tube, the particles that flowed from B to A and haven't been moved yet
+	unsigned int tubeMoves = 0;			// How many particles went through a tube, for where the next one lands
+	std::vector<double> blockSums;
+
+	// With ADVECTION_FLIP: the particles are sorted into one bucket per cell, and the buckets of a tile are in a row, in Morton
+	// order. The particles in the bucket of cell c are particleStart[c] to particleStart[c + 1] - 1.
+	std::vector<int> particleStart;
+	std::vector<unsigned int> particleKeys;	// Per particle, its bucket
+	std::vector<int> particleOrder;
+	ParticleSorter particleSorter;
+	int particleKeyBits = 0;
+	std::vector<float> particleScratch;
+	std::vector<float> transfer;		// Per slot, the private tile of the splat (see particlesToGrid())
+	std::vector<float> savedU;			// The velocities the particles gave the grid, for the change after the projection
+	std::vector<float> savedV;
+	std::vector<float> cellFill;		// Per cell, the particles in it, in full cells (which can be more than 1)
+};
+
+#endif // _GRID_FLUID_H
@@ -0,0 +1,732 @@
+/*
+Title: HydroDynamics
+File Name: GridPressureSolver.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Solves the pressure equation of the grid fluid (see GridFluid.h): a Poisson equation over
+the fluid cells of a grid, where every fluid cell's pressure times the number of its open
+neighbours, minus the pressures of its fluid neighbours, equals a given right hand side.
+Walls are left out, and the pressure of the air is known, so it is part of the right hand
+side.
+
+The default method is the conjugate gradient method, preconditioned by one geometric
+multigrid V-cycle. Every coarser grid covers 2x2 cells of the one below it, down to a few
+cells across. On every level the error is smoothed with red-black Gauss-Seidel: first
+every cell whose x + y is even is solved from its neighbours, which are all odd, then
+every odd one. Half a sweep only reads the other colour, so all tiles of it run in
+parallel, and a whole row can be done in SIMD registers (see StencilRow in
+SimdKernels.h). The sweeps after the coarse correction go through the colours in the
+opposite order to the sweeps before it, which keeps the V-cycle symmetric, as the
+conjugate gradient method needs. The number of iterations barely grows with the size of
+the grid.
+
+Plain Jacobi iteration is there for comparison: it is just as parallel, but the error
+only spreads by one cell per sweep, so it needs far more sweeps as the grid grows.
+
+Every level is stored in tiles like the grid (see GridTiles.h), with a tile over every
+2x2 tiles of the level below that are kept. Every row of a tile goes through the SIMD
+kernels, with the rows above and below it found in the tiles next to it where needed, and
+only the first and last cell of a row, whose neighbours to the side are in other tiles,
+are done one at a time. A tile that isn't kept reads as a wall. The result is the same as
+that of a dense grid, apart from the order the dot products add up their blocks in.
+*/
+
+#include "GridPressureSolver.h"
+#include "SimdKernels.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Levels with fewer cells than this run on one thread. Either way the work is done in blocks of PRESSURE_BLOCK_TILES tiles.
+#define PRESSURE_PARALLEL_MIN 8192
+#define PRESSURE_BLOCK_TILES 2
+
+// The hierarchy coarsens until neither side has more cells than this.
+#define PRESSURE_COARSEST 8
+
+// Red-black sweeps before and after the coarse correction on every level, and on the coarsest one.
+#define PRESSURE_SMOOTH_SWEEPS 2
+#define PRESSURE_COARSE_SWEEPS 8
+
+// What a half sweep reads and writes per cell: the right hand side, the inverse diagonal, the two links and the solution, which it
+// writes back. Only for the estimate of lastSmoothEstimatedBytes.
+#define PRESSURE_SWEEP_BYTES (6 * sizeof(float))
+
+// Rows of tiles between one half sweep of a wavefront and the next (see smooth()). At least 2, so the half sweeps of a step never
+// read what another one of them writes.
+#define PRESSURE_WAVEFRONT_HOP 2
+
+// Jacobi checks how far it has got every this many sweeps, since the check costs about as much as a sweep.
+#define PRESSURE_JACOBI_CHECK 10
+
+// Runs body on the slots [0, tiles) in blocks, on the pool if it is worth it and on this thread otherwise. The blocks are the same
+// either way.
+template <typename Body>
+static void forTiles(const GridTiles& tiles, TaskPool* pool, const Body& body)
+{
+	int count = tiles.tileCount();
+	if (pool != nullptr && tiles.cellCount() >= PRESSURE_PARALLEL_MIN)
+	{
+		pool->parallelFor(count, PRESSURE_BLOCK_TILES, body);
+		return;
+	}
+
+	for (int begin = 0; begin < count; begin += PRESSURE_BLOCK_TILES)
+	{
+		body(begin, std::min(begin + PRESSURE_BLOCK_TILES, count));
+	}
+}
+
+// Runs body(cell, x, y) on every cell of the tiles in the slots [begin, end) that is inside the grid.
+template <typename Body>
+static void forCells(const GridTiles& tiles, int begin, int end, const Body& body)
+{
+	for (int slot = begin; slot < end; slot++)
+	{
+		int left = tiles.tileLeft(slot);
+		int bottom = tiles.tileBottom(slot);
+		int cell = GridTiles::firstCell(slot);
+		for (int y = bottom; y < bottom + GRID_TILE; y++)
+		{
+			for (int x = left; x < left + GRID_TILE; x++, cell++)
+			{
+				if (x < tiles.columns && y < tiles.rows)
+				{
+					body(cell, x, y);
+				}
+			}
+		}
+	}
+}
+
+template <typename Body>
+static void forCells(const GridTiles& tiles, TaskPool* pool, const Body& body)
+{
+	forTiles(tiles, pool, [&](int begin, int end) { forCells(tiles, begin, end, body); });
+}
+
+// Runs body(cell, fine) on every cell of a coarse level that is inside the grid, with fine the first cell of the 2x2 under it in the
+// level below (the others are at fine + 1, fine + GRID_TILE and fine + GRID_TILE + 1), or -1 if their tile isn't kept. A tile of
+// the coarse level covers 2x2 tiles of the fine one, and the 2x2 cells are always in the same one of them. The ones past the edge
+// of the fine level are solid, in tiles that are kept.
+template <typename Body>
+static void forCoarseCells(const GridTiles& coarse, const GridTiles& fine, TaskPool* pool, const Body& body)
+{
+	const int half = GRID_TILE / 2;
+	forTiles(coarse, pool, [&](int begin, int end)
+	{
+		for (int slot = begin; slot < end; slot++)
+		{
+			int left = coarse.tileLeft(slot);
+			int bottom = coarse.tileBottom(slot);
+			for (int quarter = 0; quarter < 4; quarter++)
+			{
+				int column = (quarter & 1) * half;
+				int row = (quarter >> 1) * half;
+				int fineSlot = fine.slotAt((left + column) >> (GRID_TILE_BITS - 1), (bottom + row) >> (GRID_TILE_BITS - 1));
+				for (int y = 0; y < half; y++)
+				{
+					for (int x = 0; x < half; x++)
+					{
+						if (left + column + x < coarse.columns && bottom + row + y < coarse.rows)
+						{
+							body(GridTiles::firstCell(slot) + (row + y) * GRID_TILE + column + x,
+								fineSlot >= 0 ? GridTiles::firstCell(fineSlot) + 2 * y * GRID_TILE + 2 * x : -1);
+						}
+					}
+				}
+			}
+		}
+	});
+}
+
+void GridPressureSolver::resize(const GridTiles& tiles)
+{
+	levels.clear();
+	GridTiles current = tiles;
+	while (true)
+	{
+		// Every array has one more tile at the end, which stays 0 (see tileSweep()).
+		Level level;
+		level.tiles = current;
+		int count = current.cellCount() + GRID_TILE_CELLS;
+		level.type.assign(count, GRID_SOLID);
+		level.diagonal.assign(count, 0.0f);
+		level.inverseDiagonal.assign(count, 0.0f);
+		level.linkRight.assign(count, 0.0f);
+		level.linkUp.assign(count, 0.0f);
+		level.rhs.assign(count, 0.0f);
+		level.solution.assign(count, 0.0f);
+		level.scratch.assign(count, 0.0f);
+
+		// The slots go through the tiles row by row.
+		for (int slot = 0; slot < current.tileCount(); slot++)
+		{
+			while ((int)level.rowStart.size() <= (current.tileBottom(slot) >> GRID_TILE_BITS))
+			{
+				level.rowStart.push_back(slot);
+			}
+		}
+		level.rowStart.push_back(current.tileCount());
+		levels.push_back(std::move(level));
+
+		if (current.columns <= PRESSURE_COARSEST && current.rows <= PRESSURE_COARSEST)
+		{
+			break;
+		}
+		GridTiles coarse;
+		coarse.coarsen(current);
+		current = coarse;
+	}
+
+	// The grid can shrink from one resize to the next, so the arrays are made anew rather than resized, which would keep their memory.
+	int count = tiles.cellCount() + GRID_TILE_CELLS;
+	target = std::vector<float>(count, 0.0f);
+	result = std::vector<float>(count, 0.0f);
+	residual = std::vector<float>(count, 0.0f);
+	direction = std::vector<float>(count, 0.0f);
+	product = std::vector<float>(count, 0.0f);
+}
+
+void GridPressureSolver::prepare(const char* type, TaskPool* pool)
+{
+	Level& top = levels[0];
+	forTiles(top.tiles, pool, [&](int begin, int end)
+	{
+		std::copy(type + GridTiles::firstCell(begin), type + GridTiles::firstCell(end), top.type.begin() + GridTiles::firstCell(begin));
+	});
+
+	// A coarse cell is air if any of its 2x2 cells is, since it has to keep the pressure of the surface, and otherwise fluid if
+	// any of them is. Cells past the edge of an odd sized level, or in tiles that aren't kept, are solid.
+	for (size_t l = 1; l < levels.size(); l++)
+	{
+		const Level& fine = levels[l - 1];
+		Level& coarse = levels[l];
+		forCoarseCells(coarse.tiles, fine.tiles, pool, [&](int cell, int first)
+		{
+			bool air = false;
+			bool fluid = false;
+			for (int k = 0; k < 4; k++)
+			{
+				char kind = first >= 0 ? fine.type[first + (k & 1) + (k >> 1) * GRID_TILE] : (char)GRID_SOLID;
+				air |= kind == GRID_AIR;
+				fluid |= kind == GRID_FLUID;
+			}
+			coarse.type[cell] = air ? GRID_AIR : (fluid ? GRID_FLUID : GRID_SOLID);
+		});
+	}
+
+	for (Level& level : levels)
+	{
+		Level* current = &level;
+		forCells(level.tiles, pool, [current](int cell, int, int)
+		{
+			Level& level = *current;
+			const GridTiles& tiles = level.tiles;
+			auto typeOf = [&](int neighbour) { return neighbour >= 0 ? level.type[neighbour] : (char)GRID_SOLID; };
+			char right = typeOf(tiles.right(cell));
+			char above = typeOf(tiles.above(cell));
+			bool fluid = level.type[cell] == GRID_FLUID;
+			int open = (typeOf(tiles.left(cell)) != GRID_SOLID) + (right != GRID_SOLID) + (typeOf(tiles.below(cell)) != GRID_SOLID)
+				+ (above != GRID_SOLID);
+
+			level.diagonal[cell] = fluid ? (float)open : 0.0f;
+			level.inverseDiagonal[cell] = fluid && open > 0 ? 1.0f / open : 0.0f;
+			level.linkRight[cell] = fluid && right == GRID_FLUID ? 1.0f : 0.0f;
+			level.linkUp[cell] = fluid && above == GRID_FLUID ? 1.0f : 0.0f;
+		});
+	}
+}
+
+// The stencil of a level from its first cell, for tileSweep().
+static StencilRow levelStencil(const std::vector<float>& diagonal, const std::vector<float>& inverseDiagonal, const std::vector<float>& linkRight,
+	const std::vector<float>& linkUp)
+{
+	StencilRow stencil;
+	stencil.diagonal = diagonal.data();
+	stencil.inverseDiagonal = inverseDiagonal.data();
+	stencil.linkRight = linkRight.data();
+	stencil.linkUp = linkUp.data();
+	stencil.stride = GRID_TILE;
+	stencil.strideBelow = GRID_TILE;
+	stencil.count = GRID_TILE;
+	return stencil;
+}
+
+// Goes over the tiles in the slots [begin, end) of a level for one of the kernels. Every row of a tile is a whole SIMD register wide,
+// and rowBody(row, first, odd) runs the kernel on it: first is the cell it starts at, and odd tells whether the x + y of that cell is
+// odd. The rows above and below the first and last row of a tile are in the tiles above and below it, which the row finds with
+// strideBelow and stride, and where those aren't kept they are the extra tile at the end of the arrays, which stays 0.
+//
+// Only the first and last cell of a row have neighbours in the tiles to the left and right. The kernels take the cells next to them
+// in the arrays instead, and what they write there is overwritten by sideBody(cell, next) afterwards, where next holds the
+// neighbours of the cell by GridTiles::Neighbour. In a half sweep these are cells of the colour being written, which nothing reads
+// until it is done. With parity 0 or 1 sideBody only gets the cells whose x + y has it.
+template <typename RowBody, typename SideBody>
+static void tileSweep(const GridTiles& tiles, const StencilRow& stencil, int begin, int end, int parity, const RowBody& rowBody,
+	const SideBody& sideBody)
+{
+	const int lastRow = GRID_TILE_CELLS - GRID_TILE;
+	for (int slot = begin; slot < end; slot++)
+	{
+		int tile = GridTiles::firstCell(slot);
+		int side[GridTiles::NEIGHBOUR_COUNT];
+		for (int k = 0; k < GridTiles::NEIGHBOUR_COUNT; k++)
+		{
+			int next = tiles.nextSlot(slot, (GridTiles::Neighbour)k);
+			side[k] = GridTiles::firstCell(next >= 0 ? next : tiles.tileCount());
+		}
+
+		for (int r = 0; r < GRID_TILE; r++)
+		{
+			// The kernels read the cell before a row, which the first row of all doesn't have, so it starts a cell later. A tile
+			// starts at an even x and y.
+			int skip = slot == 0 && r == 0 ? 1 : 0;
+			int first = tile + r * GRID_TILE + skip;
+			StencilRow row = stencil;
+			row.diagonal += first;
+			row.inverseDiagonal += first;
+			row.linkRight += first;
+			row.linkUp += first;
+			row.stride = r < GRID_TILE - 1 ? GRID_TILE : side[GridTiles::NEIGHBOUR_ABOVE] - (tile + lastRow);
+			row.strideBelow = r > 0 ? GRID_TILE : tile - (side[GridTiles::NEIGHBOUR_BELOW] + lastRow);
+			row.count = GRID_TILE - skip;
+			rowBody(row, first, (r + skip) & 1);
+		}
+
+		for (int r = 0; r < GRID_TILE; r++)
+		{
+			for (int column = 0; column < GRID_TILE; column += GRID_TILE - 1)
+			{
+				if (parity >= 0 && ((r + column) & 1) != parity)
+				{
+					continue;
+				}
+				int cell = tile + r * GRID_TILE + column;
+				int next[GridTiles::NEIGHBOUR_COUNT];
+				next[GridTiles::NEIGHBOUR_LEFT] = column > 0 ? cell - 1 : side[GridTiles::NEIGHBOUR_LEFT] + r * GRID_TILE + GRID_TILE - 1;
+				next[GridTiles::NEIGHBOUR_RIGHT] = column > 0 ? side[GridTiles::NEIGHBOUR_RIGHT] + r * GRID_TILE : cell + 1;
+				next[GridTiles::NEIGHBOUR_BELOW] = r > 0 ? cell - GRID_TILE : side[GridTiles::NEIGHBOUR_BELOW] + lastRow + column;
+				next[GridTiles::NEIGHBOUR_ABOVE] = r < GRID_TILE - 1 ? cell + GRID_TILE : side[GridTiles::NEIGHBOUR_ABOVE] + column;
+				sideBody(cell, next);
+			}
+		}
+	}
+}
+
+// A cell in the first or last column of a tile, with the same operations in the same order as the kernels (see SimdKernels.cpp).
+float GridPressureSolver::edgeStencil(const Level& level, const float* x, int cell, const int* next)
+{
+	int left = next[GridTiles::NEIGHBOUR_LEFT];
+	int right = next[GridTiles::NEIGHBOUR_RIGHT];
+	int below = next[GridTiles::NEIGHBOUR_BELOW];
+	int above = next[GridTiles::NEIGHBOUR_ABOVE];
+	float sum = level.diagonal[cell] * x[cell];
+	sum -= level.linkRight[left] * x[left];
+	sum -= level.linkRight[cell] * x[right];
+	sum -= level.linkUp[below] * x[below];
+	sum -= level.linkUp[cell] * x[above];
+	return sum;
+}
+
+float GridPressureSolver::edgeRelax(const Level& level, const float* rhs, const float* from, int cell, const int* next)
+{
+	int left = next[GridTiles::NEIGHBOUR_LEFT];
+	int right = next[GridTiles::NEIGHBOUR_RIGHT];
+	int below = next[GridTiles::NEIGHBOUR_BELOW];
+	int above = next[GridTiles::NEIGHBOUR_ABOVE];
+	float sum = rhs[cell];
+	sum += level.linkRight[left] * from[left];
+	sum += level.linkRight[cell] * from[right];
+	sum += level.linkUp[below] * from[below];
+	sum += level.linkUp[cell] * from[above];
+	return sum * level.inverseDiagonal[cell];
+}
+
+void GridPressureSolver::applyOperator(const Level& level, const float* x, float* y, TaskPool* pool) const
+{
+	const SimdKernels& kernels = simdKernels();
+	StencilRow stencil = levelStencil(level.diagonal, level.inverseDiagonal, level.linkRight, level.linkUp);
+	forTiles(level.tiles, pool, [&](int begin, int end)
+	{
+		tileSweep(level.tiles, stencil, begin, end, -1, [&](const StencilRow& row, int first, int) { kernels.stencil(row, x + first, y + first); },
+			[&](int cell, const int* next) { y[cell] = edgeStencil(level, x, cell, next); });
+	});
+}
+
+// Relaxes every cell whose x + y has the given parity in the tiles in the slots [begin, end).
+void GridPressureSolver::relaxTiles(Level& level, int parity, int begin, int end)
+{
+	const SimdKernels& kernels = simdKernels();
+	StencilRow stencil = levelStencil(level.diagonal, level.inverseDiagonal, level.linkRight, level.linkUp);
+	float* solution = level.solution.data();
+	const float* rhs = level.rhs.data();
+	tileSweep(level.tiles, stencil, begin, end, parity,
+		[&](const StencilRow& row, int first, int odd) { kernels.relax(row, rhs + first, solution + first, solution + first, (odd + parity) & 1); },
+		[&](int cell, const int* next) { solution[cell] = edgeRelax(level, rhs, solution, cell, next); });
+}
+
+// Relaxes every cell whose x + y has the given parity.
+void GridPressureSolver::halfSweep(Level& level, int parity, TaskPool* pool)
+{
+	forTiles(level.tiles, pool, [&](int begin, int end) { relaxTiles(level, parity, begin, end); });
+}
+
+// Whole sweeps go through the level once per half sweep, and on a large level every one of them brings it all in from memory
+// again. With temporal blocking the half sweeps go through it together instead, as a wavefront: at step t, half sweep h works on
+// row of tiles t - PRESSURE_WAVEFRONT_HOP * h. A row only reads the rows next to it, and by the time half sweep h gets to a row,
+// half sweep h - 1 is done with the rows on both sides of it, but half sweep h + 1 hasn't got to any of them yet, so every cell
+// sees exactly the values it would have seen in whole sweeps. The rows a step works on span a few rows of tiles, which are still in
+// the cache from the steps before it, so the level comes in from memory about once for all of the sweeps.
+void GridPressureSolver::smooth(Level& level, int sweeps, bool reverse, TaskPool* pool)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CounterSample before;
+	bool counted = counters != nullptr && counters->read(before);
+	int first = reverse ? 1 : 0;
+	if (!temporalBlocking)
+	{
+		for (int sweep = 0; sweep < sweeps; sweep++)
+		{
+			halfSweep(level, first, pool);
+			halfSweep(level, 1 - first, pool);
+		}
+		finishSmooth(start, counted ? &before : nullptr, 2.0 * sweeps * level.tiles.cellCount() * PRESSURE_SWEEP_BYTES);
+		return;
+	}
+
+	int rows = (int)level.rowStart.size() - 1;
+	int halves = 2 * sweeps;
+	bool parallel = pool != nullptr && level.tiles.cellCount() >= PRESSURE_PARALLEL_MIN;
+	for (int step = 0; step < rows + PRESSURE_WAVEFRONT_HOP * (halves - 1); step++)
+	{
+		wave.clear();
+		int tiles = 0;
+		for (int half = 0; half < halves; half++)
+		{
+			int row = step - PRESSURE_WAVEFRONT_HOP * half;
+			if (row >= 0 && row < rows)
+			{
+				WaveRow part = { level.rowStart[row], level.rowStart[row + 1], (first + half) & 1 };
+				wave.push_back(part);
+				tiles += part.end - part.begin;
+			}
+		}
+
+		// The rows of a step don't depend on each other, so their tiles all run at once, in blocks that can span rows.
+		auto run = [&](int begin, int end)
+		{
+			int offset = 0;
+			for (const WaveRow& part : wave)
+			{
+				int from = std::max(begin, offset);
+				int to = std::min(end, offset + part.end - part.begin);
+				if (from < to)
+				{
+					relaxTiles(level, part.parity, part.begin + from - offset, part.begin + to - offset);
+				}
+				offset += part.end - part.begin;
+			}
+		};
+		if (parallel)
+		{
+			pool->parallelFor(tiles, PRESSURE_BLOCK_TILES, run);
+		}
+		else
+		{
+			run(0, tiles);
+		}
+	}
+	finishSmooth(start, counted ? &before : nullptr, (double)level.tiles.cellCount() * PRESSURE_SWEEP_BYTES);
+}
+
+void GridPressureSolver::finishSmooth(std::chrono::steady_clock::time_point start, const CounterSample* before, double estimatedBytes)
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	lastSmoothMilliseconds += elapsed.count();
+	lastSmoothEstimatedBytes += estimatedBytes;
+	CounterSample after;
+	if (before != nullptr && counters->read(after))
+	{
+		lastSmoothCounters.addDifference(*before, after);
+	}
+}
+
+// solution = M^-1 rhs on a level, where M is one V-cycle from this level down.
+void GridPressureSolver::vCycle(int index, TaskPool* pool)
+{
+	Level& level = levels[index];
+	std::fill(level.solution.begin(), level.solution.end(), 0.0f);
+
+	if (index + 1 == (int)levels.size())
+	{
+		smooth(level, PRESSURE_COARSE_SWEEPS, false, pool);
+		smooth(level, PRESSURE_COARSE_SWEEPS, true, pool);
+		return;
+	}
+
+	smooth(level, PRESSURE_SMOOTH_SWEEPS, false, pool);
+	applyOperator(level, level.solution.data(), level.scratch.data(), pool);
+
+	// The coarse right hand side is the residual added up over every 2x2 block. A coarse cell stands for 4 fine cells, but every
+	// coarse face for 2 fine faces, which makes the coarse operator half of what adding up the fine one would give. Halving the
+	// right hand side makes up for that.
+	Level& coarse = levels[index + 1];
+	forCoarseCells(coarse.tiles, level.tiles, pool, [&](int cell, int first)
+	{
+		float sum = 0.0f;
+		if (coarse.type[cell] == GRID_FLUID)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				int fine = first + (k & 1) + (k >> 1) * GRID_TILE;
+				if (level.type[fine] == GRID_FLUID)
+				{
+					sum += level.rhs[fine] - level.scratch[fine];
+				}
+			}
+		}
+		coarse.rhs[cell] = 0.5f * sum;
+	});
+
+	vCycle(index + 1, pool);
+
+	// A fine tile is a quarter of a coarse one. The cells past the edge of the grid are solid, so they don't have to be skipped.
+	forTiles(level.tiles, pool, [&](int begin, int end)
+	{
+		for (int slot = begin; slot < end; slot++)
+		{
+			int left = level.tiles.tileLeft(slot);
+			int bottom = level.tiles.tileBottom(slot);
+			int coarseSlot = coarse.tiles.slotAt(left >> (GRID_TILE_BITS + 1), bottom >> (GRID_TILE_BITS + 1));
+			int corner = GridTiles::firstCell(coarseSlot) + ((bottom >> GRID_TILE_BITS) & 1) * (GRID_TILE / 2) * GRID_TILE
+				+ ((left >> GRID_TILE_BITS) & 1) * (GRID_TILE / 2);
+			int cell = GridTiles::firstCell(slot);
+			for (int y = 0; y < GRID_TILE; y++)
+			{
+				for (int x = 0; x < GRID_TILE; x++, cell++)
+				{
+					if (level.type[cell] == GRID_FLUID)
+					{
+						level.solution[cell] += coarse.solution[corner + (y >> 1) * GRID_TILE + (x >> 1)];
+					}
+				}
+			}
+		}
+	});
+
+	smooth(level, PRESSURE_SMOOTH_SWEEPS, true, pool);
+}
+
+double GridPressureSolver::dot(const float* a, const float* b, TaskPool* pool)
+{
+	const Level& top = levels[0];
+	int blocks = (top.tiles.tileCount() + PRESSURE_BLOCK_TILES - 1) / PRESSURE_BLOCK_TILES;
+	blockSums.assign(blocks, 0.0);
+	forTiles(top.tiles, pool, [&](int begin, int end)
+	{
+		double sum = 0.0;
+		for (int cell = GridTiles::firstCell(begin); cell < GridTiles::firstCell(end); cell++)
+		{
+			sum += (double)a[cell] * b[cell];
+		}
+		blockSums[begin / PRESSURE_BLOCK_TILES] = sum;
+	});
+
+	double total = 0.0;
+	for (int i = 0; i < blocks; i++)
+	{
+		total += blockSums[i];
+	}
+	return total;
+}
+
+void GridPressureSolver::conjugateGradient(TaskPool* pool)
+{
+	Level& top = levels[0];
+	int count = (int)result.size();
+	double rhsNorm = std::sqrt(dot(target.data(), target.data(), pool));
+
+	applyOperator(top, result.data(), product.data(), pool);
+	for (int i = 0; i < count; i++)
+	{
+		residual[i] = target[i] - product[i];
+	}
+
+	double residualNorm = std::sqrt(dot(residual.data(), residual.data(), pool));
+	lastResidual = rhsNorm > 0.0 ? (float)(residualNorm / rhsNorm) : 0.0f;
+	if (rhsNorm == 0.0 || residualNorm <= tolerance * rhsNorm)
+	{
+		return;
+	}
+
+	top.rhs = residual;
+	vCycle(0, pool);
+	direction = top.solution;
+	double rz = dot(residual.data(), top.solution.data(), pool);
+
+	while (lastIterations < maxIterations)
+	{
+		applyOperator(top, direction.data(), product.data(), pool);
+		double curvature = dot(direction.data(), product.data(), pool);
+		if (curvature <= 0.0)
+		{
+			break;
+		}
+
+		float step = (float)(rz / curvature);
+		forTiles(top.tiles, pool, [&](int begin, int end)
+		{
+			for (int i = GridTiles::firstCell(begin); i < GridTiles::firstCell(end); i++)
+			{
+				result[i] += step * direction[i];
+				residual[i] -= step * product[i];
+			}
+		});
+		residualNorm = std::sqrt(dot(residual.data(), residual.data(), pool));
+		lastIterations++;
+		if (residualNorm <= tolerance * rhsNorm)
+		{
+			break;
+		}
+
+		top.rhs = residual;
+		vCycle(0, pool);
+		double rzNext = dot(residual.data(), top.solution.data(), pool);
+		float beta = (float)(rzNext / rz);
+		rz = rzNext;
+		forTiles(top.tiles, pool, [&](int begin, int end)
+		{
+			for (int i = GridTiles::firstCell(begin); i < GridTiles::firstCell(end); i++)
+			{
+				direction[i] = top.solution[i] + beta * direction[i];
+			}
+		});
+	}
+	lastResidual = (float)(residualNorm / rhsNorm);
+}
+
+void GridPressureSolver::jacobi(TaskPool* pool)
+{
+	Level& top = levels[0];
+	const SimdKernels& kernels = simdKernels();
+	StencilRow stencil = levelStencil(top.diagonal, top.inverseDiagonal, top.linkRight, top.linkUp);
+	double rhsNorm = std::sqrt(dot(target.data(), target.data(), pool));
+	if (rhsNorm == 0.0)
+	{
+		lastResidual = 0.0f;
+		return;
+	}
+
+	// Sweeps back and forth between result and direction.
+	direction = result;
+	float* from = result.data();
+	float* to = direction.data();
+	while (true)
+	{
+		if (lastIterations % PRESSURE_JACOBI_CHECK == 0)
+		{
+			applyOperator(top, from, product.data(), pool);
+			for (size_t i = 0; i < residual.size(); i++)
+			{
+				residual[i] = target[i] - product[i];
+			}
+			lastResidual = (float)(std::sqrt(dot(residual.data(), residual.data(), pool)) / rhsNorm);
+			if (lastResidual <= tolerance || lastIterations >= maxIterations)
+			{
+				break;
+			}
+		}
+
+		forTiles(top.tiles, pool, [&](int begin, int end)
+		{
+			tileSweep(top.tiles, stencil, begin, end, -1,
+				[&](const StencilRow& row, int first, int) { kernels.relax(row, &target[first], from + first, to + first, -1); },
+				[&](int cell, const int* next) { to[cell] = edgeRelax(top, target.data(), from, cell, next); });
+		});
+		std::swap(from, to);
+		lastIterations++;
+	}
+
+	if (from != result.data())
+	{
+		result = direction;
+	}
+}
+
+void GridPressureSolver::solve(const char* type, const float* rhs, float* pressure, TaskPool* pool)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	prepare(type, pool);
+
+	// The fields of the grid are in the same tiles as level 0, so they map one to one.
+	Level& top = levels[0];
+	forTiles(top.tiles, pool, [&](int begin, int end)
+	{
+		for (int cell = GridTiles::firstCell(begin); cell < GridTiles::firstCell(end); cell++)
+		{
+			bool fluid = top.type[cell] == GRID_FLUID;
+			target[cell] = fluid ? rhs[cell] : 0.0f;
+			result[cell] = fluid ? pressure[cell] : 0.0f;
+		}
+	});
+
+	lastIterations = 0;
+	lastSmoothCounters = CounterSample();
+	lastSmoothMilliseconds = 0.0;
+	lastSmoothEstimatedBytes = 0.0;
+	if (method == PRESSURE_JACOBI)
+	{
+		jacobi(pool);
+	}
+	else
+	{
+		conjugateGradient(pool);
+	}
+
+	forTiles(top.tiles, pool, [&](int begin, int end)
+	{
+		for (int cell = GridTiles::firstCell(begin); cell < GridTiles::firstCell(end); cell++)
+		{
+			if (top.type[cell] == GRID_FLUID)
+			{
+				pressure[cell] = result[cell];
+			}
+		}
+	});
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	lastMilliseconds = elapsed.count();
+}
+
+size_t GridPressureSolver::bytes() const
+{
+	size_t total = (target.capacity() + result.capacity() + residual.capacity() + direction.capacity() + product.capacity()) * sizeof(float);
+	for (const Level& level : levels)
+	{
+		total += level.tiles.bytes() + level.type.capacity() + level.rowStart.capacity() * sizeof(int) + (level.diagonal.capacity() + level.inverseDiagonal.capacity()
+			+ level.linkRight.capacity() + level.linkUp.capacity() + level.rhs.capacity() + level.solution.capacity()
+			+ level.scratch.capacity()) * sizeof(float);
+	}
+	return total;
+}
@@ -0,0 +1,179 @@
+/*
+Title: HydroDynamics
+File Name: GridPressureSolver.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Solves the pressure equation of the grid fluid (see GridFluid.h): a Poisson equation over
+the fluid cells of a grid, where every fluid cell's pressure times the number of its open
+neighbours, minus the pressures of its fluid neighbours, equals a given right hand side.
+Walls are left out, and the pressure of the air is known, so it is part of the right hand
+side.
+
+The default method is the conjugate gradient method, preconditioned by one geometric
+multigrid V-cycle. Every coarser grid covers 2x2 cells of the one below it, down to a few
+cells across. On every level the error is smoothed with red-black Gauss-Seidel: first
+every cell whose x + y is even is solved from its neighbours, which are all odd, then
+every odd one. Half a sweep only reads the other colour, so all tiles of it run in
+parallel, and a whole row can be done in SIMD registers (see StencilRow in
+SimdKernels.h). The sweeps after the coarse correction go through the colours in the
+opposite order to the sweeps before it, which keeps the V-cycle symmetric, as the
+conjugate gradient method needs. The number of iterations barely grows with the size of
+the grid.
+
+Plain Jacobi iteration is there for comparison: it is just as parallel, but the error
+only spreads by one cell per sweep, so it needs far more sweeps as the grid grows.
+
+Every level is stored in tiles like the grid (see GridTiles.h), with a tile over every
+2x2 tiles of the level below that are kept. Every row of a tile goes through the SIMD
+kernels, with the rows above and below it found in the tiles next to it where needed, and
+only the first and last cell of a row, whose neighbours to the side are in other tiles,
+are done one at a time. A tile that isn't kept reads as a wall. The result is the same as
+that of a dense grid, apart from the order the dot products add up their blocks in.
+*/
+
+#ifndef _GRID_PRESSURE_SOLVER_H
+#define _GRID_PRESSURE_SOLVER_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+#include "GridTiles.h"
+#include "HardwareCounters.h"
+
+class TaskPool;
+
+// What a cell of the grid is
+enum GridCell
+{
+	GRID_SOLID = 0,
+	GRID_FLUID,
+	GRID_AIR
+};
+
+enum PressureMethod
+{
+	PRESSURE_MULTIGRID = 0,		// Conjugate gradient with a multigrid V-cycle as the preconditioner
+	PRESSURE_JACOBI				// Jacobi sweeps, for comparison
+};
+
+class GridPressureSolver
+{
+public:
+	PressureMethod method = PRESSURE_MULTIGRID;
+
+	// The solve stops once the residual is this much smaller than the right hand side, or after maxIterations (conjugate gradient
+	// iterations, or Jacobi sweeps).
+	float tolerance = 1e-4f;
+	int maxIterations = 100;
+
+	// If set, the smoothing sweeps of the V-cycle go through a level together as a wavefront, so every part of it gets all of its
+	// sweeps while it is in the cache (see smooth()). The result is the same either way.
+	bool temporalBlocking = true;
+
+	// What the last solve did, for tuning and benchmarks.
+	int lastIterations = 0;
+	float lastResidual = 0.0f;
+	double lastMilliseconds = 0.0;
+
+	// If set, the smoothing sweeps are counted by it, and lastSmoothCounters is what they counted in the last solve. The counters
+	// only see the thread that opened them, so a solve that is counted has to run without a pool.
+	HardwareCounters* counters = nullptr;
+	CounterSample lastSmoothCounters;
+
+	// How long the smoothing sweeps of the last solve took, and an estimate of what they had to bring in from memory, assuming
+	// nothing stays in the cache from one pass over a level to the next: the arrays a half sweep reads and writes, once per half
+	// sweep with whole sweeps or once per smooth() with the wavefront. It is a model, not a measurement; lastSmoothCounters is that.
+	double lastSmoothMilliseconds = 0.0;
+	double lastSmoothEstimatedBytes = 0.0;
+
+	// Makes room for a grid laid out in tiles and builds the hierarchy of coarser grids.
+	void resize(const GridTiles& tiles);
+
+	// Solves for the pressure of every fluid cell. type holds a GridCell per cell, rhs the right hand side and pressure the first
+	// guess; on return pressure holds the solution in the fluid cells, and the rest of it is unchanged. All three are in the tiles
+	// of resize(), with tiles.cellCount() values each. The result is the same with or without a pool.
+	void solve(const char* type, const float* rhs, float* pressure, TaskPool* pool);
+
+	// The memory the levels and the conjugate gradient method take.
+	size_t bytes() const;
+
+private:
+	struct Level
+	{
+		GridTiles tiles;
+		std::vector<char> type;
+		std::vector<float> diagonal;
+		std::vector<float> inverseDiagonal;
+		std::vector<float> linkRight;
+		std::vector<float> linkUp;
+		std::vector<float> rhs;
+		std::vector<float> solution;
+		std::vector<float> scratch;
+		std::vector<int> rowStart;		// The first slot of every row of tiles, and the number of slots after the last one
+	};
+
+	// The tiles of one row that a step of the wavefront relaxes, and the colour.
+	struct WaveRow
+	{
+		int begin;
+		int end;
+		int parity;
+	};
+
+	// Sets up the cell types and stencils of every level for the fluid cells of this solve.
+	void prepare(const char* type, TaskPool* pool);
+
+	// The stencil and the relaxation of a cell on the edge of its tile, which the kernels can't do. next holds its neighbours by
+	// GridTiles::Neighbour, or -1.
+	static float edgeStencil(const Level& level, const float* x, int cell, const int* next);
+	static float edgeRelax(const Level& level, const float* rhs, const float* from, int cell, const int* next);
+
+	void applyOperator(const Level& level, const float* x, float* y, TaskPool* pool) const;
+	void relaxTiles(Level& level, int parity, int begin, int end);
+	void halfSweep(Level& level, int parity, TaskPool* pool);
+	void smooth(Level& level, int sweeps, bool reverse, TaskPool* pool);
+
+	// Adds the time since start, the estimate and, if the counters were read into before, what they counted since to what the last
+	// solve's smoothing took.
+	void finishSmooth(std::chrono::steady_clock::time_point start, const CounterSample* before, double estimatedBytes);
+	void vCycle(int index, TaskPool* pool);
+
+	void conjugateGradient(TaskPool* pool);
+	void jacobi(TaskPool* pool);
+
+	// The sum of a[i] * b[i] over level 0, always added up in the same blocks and the same order.
+	double dot(const float* a, const float* b, TaskPool* pool);
+
+	std::vector<Level> levels;
+
+	// Over level 0: the right hand side and the pressure, and what the conjugate gradient method works with.
+	std::vector<float> target;
+	std::vector<float> result;
+	std::vector<float> residual;
+	std::vector<float> direction;
+	std::vector<float> product;
+	std::vector<double> blockSums;
+	std::vector<WaveRow> wave;
+};
+
+#endif // _GRID_PRESSURE_SOLVER_H
@@ -0,0 +1,102 @@
+/*
+Title: HydroDynamics
+File Name: GridTiles.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Sparse storage for the grids of the grid fluid (see GridFluid.h) and of its pressure solve.
+Most of the bounding box of an apparatus is wall, the space between the vessels and under
+the tubes, or air no fluid is near. A dense grid keeps every value of every field for those
+cells too, and every stage of a step walks through them.
+
+Instead, the grid is cut into tiles of GRID_TILE x GRID_TILE cells, and only the tiles that
+are needed are kept (for the grid fluid, the band around its fluid). The tiles that are kept
+get a slot each, and every field is one array of GRID_TILE_CELLS values per slot, with the
+cells of a tile row by row. The index is a table with the slot of every tile of the grid
+(or -1), which costs one int per GRID_TILE_CELLS cells, so finding a cell is a shift, a
+lookup and an add. A cell that isn't in a kept tile is a wall; it has no values, and reading
+one gives 0.
+
+Next to its slot, every tile remembers the slots of the four tiles around it, so the
+neighbours of a cell are found without the table: inside the tile they are the next value
+or the next row, and on its edge they are in the tile next to it. The tiles on the right
+and top edge of the grid can stick out of it; the cells past the edge are kept as walls,
+so the neighbours of a cell inside the grid never have to be checked for the edge.
+
+A coarser level of the multigrid hierarchy has a tile wherever any of the 2x2 tiles under
+it is kept.
+*/
+
+#include "GridTiles.h"
+
+void GridTiles::build(int columnCount, int rowCount, const std::vector<char>& needed)
+{
+	columns = columnCount;
+	rows = rowCount;
+	tileColumns = tilesFor(columns);
+	tileRows = tilesFor(rows);
+	// Made anew, so a layout with fewer tiles than the last one gives back the memory it doesn't need.
+	slots = std::vector<int>(tileColumns * tileRows, -1);
+	tileX = std::vector<int>();
+	tileY = std::vector<int>();
+
+	// The slots go row by row, so the tiles of a row of the grid are next to each other in memory.
+	for (int y = 0; y < tileRows; y++)
+	{
+		for (int x = 0; x < tileColumns; x++)
+		{
+			if (needed[y * tileColumns + x])
+			{
+				slots[y * tileColumns + x] = (int)tileX.size();
+				tileX.push_back(x);
+				tileY.push_back(y);
+			}
+		}
+	}
+	link();
+}
+
+void GridTiles::coarsen(const GridTiles& fine)
+{
+	int coarseColumns = (fine.columns + 1) / 2;
+	int coarseRows = (fine.rows + 1) / 2;
+	int coarseTileColumns = tilesFor(coarseColumns);
+	std::vector<char> needed(coarseTileColumns * tilesFor(coarseRows), 0);
+	for (int slot = 0; slot < fine.tileCount(); slot++)
+	{
+		needed[(fine.tileY[slot] / 2) * coarseTileColumns + fine.tileX[slot] / 2] = 1;
+	}
+	build(coarseColumns, coarseRows, needed);
+}
+
+void GridTiles::link()
+{
+	neighbours = std::vector<int>(tileX.size() * NEIGHBOUR_COUNT, -1);
+	for (int slot = 0; slot < tileCount(); slot++)
+	{
+		int* next = &neighbours[slot * NEIGHBOUR_COUNT];
+		next[NEIGHBOUR_LEFT] = slotAt(tileX[slot] - 1, tileY[slot]);
+		next[NEIGHBOUR_RIGHT] = slotAt(tileX[slot] + 1, tileY[slot]);
+		next[NEIGHBOUR_BELOW] = slotAt(tileX[slot], tileY[slot] - 1);
+		next[NEIGHBOUR_ABOVE] = slotAt(tileX[slot], tileY[slot] + 1);
+	}
+}
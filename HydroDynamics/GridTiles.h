@@ -0,0 +1,152 @@
+/*
+Title: HydroDynamics
+File Name: GridTiles.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Sparse storage for the grids of the grid fluid (see GridFluid.h) and of its pressure solve.
+Most of the bounding box of an apparatus is wall, the space between the vessels and under
+the tubes, or air no fluid is near. A dense grid keeps every value of every field for those
+cells too, and every stage of a step walks through them.
+
+Instead, the grid is cut into tiles of GRID_TILE x GRID_TILE cells, and only the tiles that
+are needed are kept (for the grid fluid, the band around its fluid). The tiles that are kept
+get a slot each, and every field is one array of GRID_TILE_CELLS values per slot, with the
+cells of a tile row by row. The index is a table with the slot of every tile of the grid
+(or -1), which costs one int per GRID_TILE_CELLS cells, so finding a cell is a shift, a
+lookup and an add. A cell that isn't in a kept tile is a wall; it has no values, and reading
+one gives 0.
+
+Next to its slot, every tile remembers the slots of the four tiles around it, so the
+neighbours of a cell are found without the table: inside the tile they are the next value
+or the next row, and on its edge they are in the tile next to it. The tiles on the right
+and top edge of the grid can stick out of it; the cells past the edge are kept as walls,
+so the neighbours of a cell inside the grid never have to be checked for the edge.
+
+A coarser level of the multigrid hierarchy has a tile wherever any of the 2x2 tiles under
+it is kept.
+*/
+
+#ifndef _GRID_TILES_H
+#define _GRID_TILES_H
+
+#include <cstddef>
+#include <vector>
+
+#define GRID_TILE_BITS 3
+#define GRID_TILE (1 << GRID_TILE_BITS)
+#define GRID_TILE_CELLS (GRID_TILE * GRID_TILE)
+
+class GridTiles
+{
+public:
+	enum Neighbour
+	{
+		NEIGHBOUR_LEFT = 0,
+		NEIGHBOUR_RIGHT,
+		NEIGHBOUR_BELOW,
+		NEIGHBOUR_ABOVE,
+		NEIGHBOUR_COUNT
+	};
+
+	// The grid, in cells and in tiles.
+	int columns = 0;
+	int rows = 0;
+	int tileColumns = 0;
+	int tileRows = 0;
+
+	// Lays out a grid of columns x rows cells that keeps the tiles (x, y) for which needed[y * tileColumns + x] isn't 0, with
+	// tilesFor(columns) x tilesFor(rows) tiles.
+	void build(int columns, int rows, const std::vector<char>& needed);
+
+	// Lays out the next coarser level of fine: half as many cells each way (rounded up), with a tile over every 2x2 tiles of fine
+	// that keep any.
+	void coarsen(const GridTiles& fine);
+
+	static int tilesFor(int cells) { return (cells + GRID_TILE - 1) >> GRID_TILE_BITS; }
+
+	int tileCount() const { return (int)tileX.size(); }
+	int cellCount() const { return tileCount() * GRID_TILE_CELLS; }
+
+	// The index of cell (x, y) in the fields, or -1 if it is outside the grid or in a tile that isn't kept.
+	int at(int x, int y) const
+	{
+		if (x < 0 || y < 0 || x >= columns || y >= rows)
+		{
+			return -1;
+		}
+		int slot = slots[(y >> GRID_TILE_BITS) * tileColumns + (x >> GRID_TILE_BITS)];
+		return slot < 0 ? -1 : slot * GRID_TILE_CELLS + ((y & (GRID_TILE - 1)) << GRID_TILE_BITS) + (x & (GRID_TILE - 1));
+	}
+
+	// Where a cell is on the grid. The cells of the tiles on the right and top edge can be past it.
+	int cellX(int cell) const { return (tileX[cell >> (2 * GRID_TILE_BITS)] << GRID_TILE_BITS) + (cell & (GRID_TILE - 1)); }
+	int cellY(int cell) const { return (tileY[cell >> (2 * GRID_TILE_BITS)] << GRID_TILE_BITS) + ((cell >> GRID_TILE_BITS) & (GRID_TILE - 1)); }
+	bool inside(int cell) const { return cellX(cell) < columns && cellY(cell) < rows; }
+
+	// The first cell of the tile in a slot, and where the tile is.
+	static int firstCell(int slot) { return slot * GRID_TILE_CELLS; }
+	int tileLeft(int slot) const { return tileX[slot] << GRID_TILE_BITS; }
+	int tileBottom(int slot) const { return tileY[slot] << GRID_TILE_BITS; }
+
+	// The cells next to a cell, or -1 if they aren't in a kept tile.
+	int left(int cell) const { return (cell & (GRID_TILE - 1)) != 0 ? cell - 1 : across(cell, NEIGHBOUR_LEFT, GRID_TILE - 1); }
+	int right(int cell) const { return (cell & (GRID_TILE - 1)) != GRID_TILE - 1 ? cell + 1 : across(cell, NEIGHBOUR_RIGHT, 1 - GRID_TILE); }
+	int below(int cell) const
+	{
+		return (cell & (GRID_TILE_CELLS - GRID_TILE)) != 0 ? cell - GRID_TILE : across(cell, NEIGHBOUR_BELOW, GRID_TILE_CELLS - GRID_TILE);
+	}
+	int above(int cell) const
+	{
+		return (cell & (GRID_TILE_CELLS - GRID_TILE)) != GRID_TILE_CELLS - GRID_TILE ? cell + GRID_TILE
+			: across(cell, NEIGHBOUR_ABOVE, GRID_TILE - GRID_TILE_CELLS);
+	}
+
+	// The slot of tile (x, y), or -1 if it is outside the grid or isn't kept.
+	int slotAt(int x, int y) const { return x < 0 || y < 0 || x >= tileColumns || y >= tileRows ? -1 : slots[y * tileColumns + x]; }
+
+	// The slot of the tile next to the one in a slot, or -1 if it isn't kept.
+	int nextSlot(int slot, Neighbour side) const { return neighbours[slot * NEIGHBOUR_COUNT + side]; }
+
+	// The slot of every tile of the grid, row by row, or -1, for the kernels that find cells on their own (see SimdKernels.h).
+	const int* slotTable() const { return slots.data(); }
+
+	// The memory the index takes.
+	size_t bytes() const { return (slots.capacity() + tileX.capacity() + tileY.capacity() + neighbours.capacity()) * sizeof(int); }
+
+private:
+	// The cell in the tile next to the one of cell, offset from the same spot in that tile.
+	int across(int cell, Neighbour side, int offset) const
+	{
+		int slot = nextSlot(cell >> (2 * GRID_TILE_BITS), side);
+		return slot < 0 ? -1 : (slot << (2 * GRID_TILE_BITS)) + (cell & (GRID_TILE_CELLS - 1)) + offset;
+	}
+
+	void link();
+
+	std::vector<int> slots;			// Per tile of the grid, its slot, or -1
+	std::vector<int> tileX;			// Per slot, where its tile is
+	std::vector<int> tileY;
+	std::vector<int> neighbours;	// Per slot, the slots to its left, right, below and above, or -1
+};
+
+#endif // _GRID_TILES_H
@@ -0,0 +1,117 @@
+/*
+Title: HydroDynamics
+File Name: HandleTable.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Stable handles to the elements of a dense array that elements are removed from by moving
+the last one into the gap (like the vessels and tubes of a VesselNetwork). The array stays
+packed, so loops over it never skip holes, but an index can change whenever something is
+removed. A handle never does.
+
+A handle is a slot and a generation. Every slot knows the index of its element, and every
+index knows its slot, so looking a handle up and moving an element are both O(1). Removing
+an element frees its slot and counts up its generation, so a handle to it (or a copy of
+one) no longer matches once the slot is reused and is simply found to be stale.
+*/
+
+#include "HandleTable.h"
+
+Handle HandleTable::add()
+{
+	Handle handle;
+	if (freeSlots.empty())
+	{
+		handle.slot = (int)indexOf.size();
+		indexOf.push_back(0);
+		generationOf.push_back(0);
+	}
+	else
+	{
+		handle.slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	handle.generation = generationOf[handle.slot];
+	indexOf[handle.slot] = (int)slotOf.size();
+	slotOf.push_back(handle.slot);
+	return handle;
+}
+
+int HandleTable::index(Handle handle) const
+{
+	if (handle.slot < 0 || handle.slot >= (int)indexOf.size() || generationOf[handle.slot] != handle.generation)
+	{
+		return -1;
+	}
+	return indexOf[handle.slot];
+}
+
+Handle HandleTable::handle(int index) const
+{
+	Handle handle;
+	if (index >= 0 && index < (int)slotOf.size())
+	{
+		handle.slot = slotOf[index];
+		handle.generation = generationOf[handle.slot];
+	}
+	return handle;
+}
+
+void HandleTable::removeSwap(int index)
+{
+	int removed = slotOf[index];
+	int last = slotOf.back();
+	slotOf[index] = last;
+	indexOf[last] = index;
+	slotOf.pop_back();
+
+	indexOf[removed] = -1;
+	generationOf[removed]++;
+	freeSlots.push_back(removed);
+}
+
+void HandleTable::resize(int count)
+{
+	while ((int)slotOf.size() < count)
+	{
+		add();
+	}
+	while ((int)slotOf.size() > count)
+	{
+		removeSwap((int)slotOf.size() - 1);
+	}
+}
+
+void HandleTable::clear()
+{
+	// The generations stay, so handles from before the clear are still recognized as stale.
+	for (int slot = 0; slot < (int)indexOf.size(); slot++)
+	{
+		if (indexOf[slot] >= 0)
+		{
+			indexOf[slot] = -1;
+			generationOf[slot]++;
+			freeSlots.push_back(slot);
+		}
+	}
+	slotOf.clear();
+}
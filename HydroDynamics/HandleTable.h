@@ -0,0 +1,80 @@
+/*
+Title: HydroDynamics
+File Name: HandleTable.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Stable handles to the elements of a dense array that elements are removed from by moving
+the last one into the gap (like the vessels and tubes of a VesselNetwork). The array stays
+packed, so loops over it never skip holes, but an index can change whenever something is
+removed. A handle never does.
+
+A handle is a slot and a generation. Every slot knows the index of its element, and every
+index knows its slot, so looking a handle up and moving an element are both O(1). Removing
+an element frees its slot and counts up its generation, so a handle to it (or a copy of
+one) no longer matches once the slot is reused and is simply found to be stale.
+*/
+
+#ifndef _HANDLE_TABLE_H
+#define _HANDLE_TABLE_H
+
+#include <vector>
+
+struct Handle
+{
+	int slot = -1;
+	unsigned int generation = 0;
+
+	bool operator==(const Handle& other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+class HandleTable
+{
+public:
+	// Gives the element appended at the end of the array (at index size()) a handle.
+	Handle add();
+
+	// The index of the element a handle refers to, or -1 if it was removed.
+	int index(Handle handle) const;
+	bool valid(Handle handle) const { return index(handle) >= 0; }
+
+	// The handle of the element at an index.
+	Handle handle(int index) const;
+
+	// Call when the element at index was removed by moving the last one into its place (or was the last one itself).
+	void removeSwap(int index);
+
+	// Adds or drops handles at the end until there is one per element, for arrays that were filled without add().
+	void resize(int count);
+
+	void clear();
+	int size() const { return (int)slotOf.size(); }
+
+private:
+	std::vector<int> indexOf;					// Per slot, the index of its element, or -1 if the slot is free
+	std::vector<unsigned int> generationOf;		// Per slot
+	std::vector<int> slotOf;					// Per index, its slot
+	std::vector<int> freeSlots;
+};
+
+#endif // _HANDLE_TABLE_H
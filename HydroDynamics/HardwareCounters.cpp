@@ -0,0 +1,185 @@
+/*
+Title: HydroDynamics
+File Name: HardwareCounters.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Hardware performance counters of the CPU: cycles, instructions, L1 data cache misses, last
+level cache misses and branch misses. Timings say how long the vessel loop takes; these say
+why, for example whether it waits for memory (many last level misses, few instructions per
+cycle) or mispredicts its branches.
+
+The counters come from perf_event on Linux, opened as one group, so all of them start and
+stop together and can be compared with each other. When the CPU has fewer counters than
+asked for, the kernel takes turns between them, and the values are scaled up by how long
+each of them really ran. Some machines (virtual ones, mostly) have no counters at all, and
+a counter the CPU doesn't have is simply left out.
+
+Windows only lets drivers program the counters, so on Windows open() returns false and
+nothing is counted.
+
+They count the thread that opened them, and only while it runs in user mode. Work that a
+TaskPool hands to its other threads isn't counted, so for complete numbers run on one thread.
+*/
+
+#include "HardwareCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+void CounterSample::addDifference(const CounterSample& from, const CounterSample& to)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		value[i] += to.value[i] - from.value[i];
+	}
+}
+
+HardwareCounters::~HardwareCounters()
+{
+	close();
+}
+
+#ifdef __linux__
+// Opens one event as part of the group led by group, or as the leader if group is -1. The leader starts disabled and enables the
+// whole group at once.
+static int openEvent(unsigned int type, unsigned long long config, int group)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group == -1 ? 1 : 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool HardwareCounters::open()
+{
+	close();
+	static const unsigned int types[COUNTER_COUNT] =
+	{
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+	};
+	static const unsigned long long configs[COUNTER_COUNT] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	// The first counter that opens leads the group, and the ones the machine doesn't have are left out.
+	int leader = -1;
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		int fd = openEvent(types[i], configs[i], leader);
+		if (fd < 0)
+		{
+			continue;
+		}
+		if (leader < 0)
+		{
+			leader = fd;
+		}
+		fds[i] = fd;
+		slot[i] = opened++;
+	}
+	if (leader < 0)
+	{
+		return false;
+	}
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+}
+
+void HardwareCounters::close()
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		if (fds[i] >= 0)
+		{
+			::close(fds[i]);
+		}
+		fds[i] = -1;
+		slot[i] = -1;
+	}
+	opened = 0;
+}
+
+bool HardwareCounters::read(CounterSample& sample) const
+{
+	if (opened == 0)
+	{
+		return false;
+	}
+
+	// The group reads as the number of counters, the time it was enabled, the time it really ran, and then every value.
+	int leader = -1;
+	for (int i = 0; i < COUNTER_COUNT && leader < 0; i++)
+	{
+		leader = fds[i];
+	}
+	unsigned long long data[3 + COUNTER_COUNT];
+	ssize_t size = ::read(leader, data, sizeof(unsigned long long) * (3 + opened));
+	if (size != (ssize_t)(sizeof(unsigned long long) * (3 + opened)) || data[2] == 0)
+	{
+		return false;
+	}
+	double scale = (double)data[1] / data[2];
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		sample.value[i] = slot[i] >= 0 ? (unsigned long long)(data[3 + slot[i]] * scale) : 0;
+	}
+	return true;
+}
+#else
+bool HardwareCounters::open()
+{
+	return false;
+}
+
+void HardwareCounters::close()
+{
+}
+
+bool HardwareCounters::read(CounterSample&) const
+{
+	return false;
+}
+#endif
+
+const char* counterName(HardwareCounter counter)
+{
+	static const char* names[COUNTER_COUNT] = { "cycles", "instructions", "L1 misses", "LLC misses", "branch misses" };
+	return names[counter];
+}
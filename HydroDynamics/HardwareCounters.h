@@ -0,0 +1,93 @@
+/*
+Title: HydroDynamics
+File Name: HardwareCounters.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Hardware performance counters of the CPU: cycles, instructions, L1 data cache misses, last
+level cache misses and branch misses. Timings say how long the vessel loop takes; these say
+why, for example whether it waits for memory (many last level misses, few instructions per
+cycle) or mispredicts its branches.
+
+The counters come from perf_event on Linux, opened as one group, so all of them start and
+stop together and can be compared with each other. When the CPU has fewer counters than
+asked for, the kernel takes turns between them, and the values are scaled up by how long
+each of them really ran. Some machines (virtual ones, mostly) have no counters at all, and
+a counter the CPU doesn't have is simply left out.
+
+Windows only lets drivers program the counters, so on Windows open() returns false and
+nothing is counted.
+
+They count the thread that opened them, and only while it runs in user mode. Work that a
+TaskPool hands to its other threads isn't counted, so for complete numbers run on one thread.
+*/
+
+#ifndef _HARDWARE_COUNTERS_H
+#define _HARDWARE_COUNTERS_H
+
+enum HardwareCounter
+{
+	COUNTER_CYCLES = 0,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_L1_MISSES,		// Reads that missed the L1 data cache
+	COUNTER_LLC_MISSES,		// Accesses that missed the last level cache and went to memory
+	COUNTER_BRANCH_MISSES,
+	COUNTER_COUNT
+};
+
+struct CounterSample
+{
+	unsigned long long value[COUNTER_COUNT] = {};
+
+	// Adds the difference between two samples.
+	void addDifference(const CounterSample& from, const CounterSample& to);
+};
+
+class HardwareCounters
+{
+public:
+	~HardwareCounters();
+
+	// Opens and starts every counter this machine has for the calling thread. Returns false if it has none (or this isn't Linux).
+	bool open();
+
+	// Stops and closes them.
+	void close();
+
+	bool valid() const { return opened > 0; }
+
+	// Whether the machine has the counter. Counters it doesn't have always read 0.
+	bool available(HardwareCounter counter) const { return slot[counter] >= 0; }
+
+	// Reads every counter. Returns false (and leaves sample alone) if they can't be read.
+	bool read(CounterSample& sample) const;
+
+private:
+	int fds[COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+	int slot[COUNTER_COUNT] = { -1, -1, -1, -1, -1 };	// Where the counter is in the group, or -1 if it isn't there
+	int opened = 0;
+};
+
+// The name of a counter, for reports.
+const char* counterName(HardwareCounter counter);
+
+#endif // _HARDWARE_COUNTERS_H
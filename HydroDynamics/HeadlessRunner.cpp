@@ -0,0 +1,493 @@
+/*
+Title: HydroDynamics
+File Name: HeadlessRunner.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+HydroDynamicsHeadless, the simulation as a command line program for machines without a
+display or OpenGL, like the servers the sweeps and the regression runs go to. It is built
+from the HydroDynamicsCore sources alone (see HydroSolver.h), so it needs nothing but a
+compiler:
+
+	HydroDynamicsHeadless --scene big.bin --steps 10000 --threads 0 --checkpoint after.bin
+	HydroDynamicsHeadless --generate manifold 1000000 --steps 200 --integrator implicit
+
+It steps a scene (or a generated network, see NetworkGenerator.h) for as many fixed steps as
+it is asked to, and tells how long that took. With --workloads it runs the benchmark
+workloads instead: a network of every kind generated by NetworkGenerator, stepped with every
+integrator, each timed like benchmarkUpdate() times the network of the benchmark suite. That
+covers the paths of the step a real run takes, which is what the profile guided build trains
+on (see the pgo-train target of CMakeLists.txt).
+
+With --serve SOCKET it becomes a pool of --workers warm worker processes (see WorkerPool.h)
+for the jobs of a sweep or a test suite, which then don't each start the program and read
+the scene again:
+
+	HydroDynamicsHeadless --scene big.bin --serve /tmp/hydro.sock --workers 8
+
+Every job is a line with the options of one run, "--steps 5000 --pressure 2.5", of which
+--steps, --pressure, --physics-hz, --integrator, --preconditioner and --checkpoint can be
+given; whatever a job leaves out is what the command line said. It starts from the scene as
+it was read, and is answered with "done STEPS SECONDS VOLUME rest|moving" (the steps taken,
+the time they took, the volume after them and whether the network came to rest), or with
+"error" and the reason.
+
+With --query it answers a question about a telemetry file the viewer recorded (see
+Telemetry.h) instead, from the summaries in the file: the smallest, largest and mean height,
+pressure and external pressure of one vessel between two times, in seconds of simulated
+time at --physics-hz steps per second:
+
+	HydroDynamicsHeadless --query run.tlm 42 10 20 --physics-hz 1000
+
+The viewer (HydroDynamics --headless) runs the same step with everything else the window
+has, like telemetry, sweeps and the remote control, but needs OpenGL to start.
+*/
+
+#include "HydroSolver.h"
+#include "VesselNetwork.h"
+#include "NetworkGenerator.h"
+#include "TaskPool.h"
+#include "WorkerPool.h"
+#include "Telemetry.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every workload has this many vessels, and is stepped this many steps per run, WORKLOAD_REPETITIONS times.
+#define WORKLOAD_VESSELS 200000
+#define WORKLOAD_STEPS 10
+#define WORKLOAD_REPETITIONS 3
+
+static bool parseTopology(const std::string& name, NetworkTopology& topology)
+{
+	const char* names[] = { "grid", "tree", "geometric", "manifold" };
+	for (int i = 0; i < 4; i++)
+	{
+		if (name == names[i])
+		{
+			topology = (NetworkTopology)i;
+			return true;
+		}
+	}
+	std::cout << "Unknown kind of network " << name << ", expected grid, tree, geometric or manifold" << std::endl;
+	return false;
+}
+
+static bool parseIntegrator(const std::string& name, Integrator& integrator)
+{
+	const char* names[] = { "local", "implicit", "adaptive", "symplectic" };
+	for (int i = 0; i < 4; i++)
+	{
+		if (name == names[i])
+		{
+			integrator = (Integrator)i;
+			return true;
+		}
+	}
+	std::cout << "Unknown integrator " << name << ", expected local, implicit, adaptive or symplectic" << std::endl;
+	return false;
+}
+
+static bool parsePreconditioner(const std::string& name, SolverPreconditioner& preconditioner)
+{
+	const char* names[] = { "jacobi", "ic", "direct", "amg" };
+	for (int i = 0; i < 4; i++)
+	{
+		if (name == names[i])
+		{
+			preconditioner = (SolverPreconditioner)i;
+			return true;
+		}
+	}
+	std::cout << "Unknown preconditioner " << name << ", expected jacobi, ic, direct or amg" << std::endl;
+	return false;
+}
+
+// With --serve, the scene every job starts from, read before the workers are forked, and the solver a worker runs its jobs on, made
+// with its first one so its threads start in the worker.
+static HydroSolver* poolScene = nullptr;
+static HydroSolver* poolSolver = nullptr;
+static int poolThreads = 1;
+
+// Runs one job of the pool, given as the options of a run on the command line.
+static std::string runJob(const std::string& job)
+{
+	long long steps = 1000;
+	double hz = 0.0;
+	bool pressureGiven = false;
+	float pressure = 0.0f;
+	bool integratorGiven = false;
+	Integrator integrator = INTEGRATOR_LOCAL;
+	bool preconditionerGiven = false;
+	SolverPreconditioner preconditioner = PRECONDITIONER_JACOBI;
+	std::string checkpointFile;
+	std::istringstream options(job);
+	std::string option, value;
+	while (options >> option)
+	{
+		if (!(options >> value))
+		{
+			return "error " + option + " needs a value";
+		}
+		if (option == "--steps")
+		{
+			steps = atoll(value.c_str());
+		}
+		else if (option == "--pressure")
+		{
+			pressure = (float)atof(value.c_str());
+			pressureGiven = true;
+		}
+		else if (option == "--physics-hz")
+		{
+			hz = atof(value.c_str());
+		}
+		else if (option == "--integrator")
+		{
+			integratorGiven = parseIntegrator(value, integrator);
+			if (!integratorGiven)
+			{
+				return "error unknown integrator " + value;
+			}
+		}
+		else if (option == "--preconditioner")
+		{
+			preconditionerGiven = parsePreconditioner(value, preconditioner);
+			if (!preconditionerGiven)
+			{
+				return "error unknown preconditioner " + value;
+			}
+		}
+		else if (option == "--checkpoint")
+		{
+			checkpointFile = value;
+		}
+		else
+		{
+			return "error a job can't set " + option;
+		}
+	}
+	if (steps < 0 || hz < 0.0)
+	{
+		return "error --steps and --physics-hz can't be negative";
+	}
+
+	if (poolSolver == nullptr)
+	{
+		poolSolver = new HydroSolver(poolThreads);
+	}
+	HydroSolver& solver = *poolSolver;
+	solver.startFrom(*poolScene);
+	if (integratorGiven)
+	{
+		solver.network().integrator = integrator;
+	}
+	if (preconditionerGiven)
+	{
+		solver.network().solver.preconditioner = preconditioner;
+	}
+	if (hz > 0.0)
+	{
+		solver.setStepRate(hz);
+	}
+	if (pressureGiven)
+	{
+		solver.setPistonPressure(pressure);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool moving = true;
+	long long taken = 0;
+	while (taken < steps && moving)
+	{
+		moving = solver.step();
+		taken++;
+	}
+	std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+	if (!checkpointFile.empty() && !solver.saveCheckpoint(checkpointFile.c_str()))
+	{
+		return "error can't write " + checkpointFile;
+	}
+	std::ostringstream answer;
+	answer.precision(9);
+	answer << "done " << taken << " " << took.count() << " " << solver.totalVolume() << (moving ? " moving" : " rest");
+	return answer.str();
+}
+
+// Writes the range of every field of vessel from one time to another in a telemetry file.
+static int runQuery(const std::string& fileName, int vessel, double from, double to, double hz)
+{
+	TelemetryReader reader;
+	if (!reader.open(fileName))
+	{
+		return 1;
+	}
+	if (vessel < 0 || vessel >= reader.vesselCount())
+	{
+		std::cout << fileName << " has " << reader.vesselCount() << " vessels, there is no vessel " << vessel << std::endl;
+		return 1;
+	}
+
+	const char* fields[TELEMETRY_FIELDS] = { "height", "pressure", "external pressure" };
+	long long first = (long long)std::ceil(from * hz);
+	long long last = (long long)std::floor(to * hz);
+	std::cout << "Vessel " << vessel << " from step " << first << " to " << last << ":" << std::endl;
+	for (int f = 0; f < TELEMETRY_FIELDS; f++)
+	{
+		TelemetryRange range;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!reader.summarize(vessel, f, first, last, range))
+		{
+			std::cout << "Nothing was recorded from step " << first << " to " << last << " of " << fileName << std::endl;
+			return 1;
+		}
+		std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+		std::cout << fields[f] << ": " << range.minimum << " to " << range.maximum << ", mean " << range.mean << " over " << range.steps
+			<< " steps (" << range.summaries << " summaries and " << range.blocksRead << " blocks read in " << took.count() * 1e3 << " ms)"
+			<< std::endl;
+	}
+	return 0;
+}
+
+// Steps every kind of network with every integrator, and writes the median and fastest time per step of each.
+static int runWorkloads(int threads)
+{
+	const char* topologies[] = { "grid", "tree", "geometric", "manifold" };
+	const char* integrators[] = { "local", "implicit", "adaptive", "symplectic" };
+	int workers = threads == 0 ? (int)std::max(1u, std::thread::hardware_concurrency()) : threads;
+	TaskPool* pool = workers > 1 ? new TaskPool(workers - 1) : nullptr;
+	float dt = 1.0f / 120.0f;
+	for (int t = 0; t < 4; t++)
+	{
+		GeneratorSettings settings;
+		settings.topology = (NetworkTopology)t;
+		settings.vessels = WORKLOAD_VESSELS;
+		VesselNetwork generated;
+		generateNetwork(settings, generated);
+		generated.computePressures(1.0f, 9.8f);
+		for (int i = 0; i < 4; i++)
+		{
+			generated.integrator = (Integrator)i;
+			std::vector<double> times;
+			for (int r = 0; r < WORKLOAD_REPETITIONS; r++)
+			{
+				VesselNetwork copy = generated;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int s = 0; s < WORKLOAD_STEPS; s++)
+				{
+					copy.update(1.0f, 9.8f, dt, pool);
+				}
+				std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+				times.push_back((double)elapsed.count() / WORKLOAD_STEPS);
+			}
+			std::sort(times.begin(), times.end());
+			std::cout << topologies[t] << ", " << integrators[i] << ": " << times[times.size() / 2] / 1e6 << " ms per step (fastest "
+				<< times[0] / 1e6 << " ms), " << generated.vesselCount() << " vessels and " << generated.tubeCount() << " tubes" << std::endl;
+		}
+	}
+	delete pool;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string sceneFile;
+	std::string checkpointFile;
+	std::string servePath;
+	int workers = (int)std::max(1u, std::thread::hardware_concurrency());
+	bool generate = false;
+	bool workloads = false;
+	std::string queryFile;
+	int queryVessel = 0;
+	double queryFrom = 0.0;
+	double queryTo = 0.0;
+	GeneratorSettings generator;
+	long long steps = 1000;
+	int threads = 1;
+	double hz = 120.0;
+	float pressure = 0.0f;
+	bool integratorGiven = false;
+	Integrator integrator = INTEGRATOR_LOCAL;
+	SolverPreconditioner preconditioner = PRECONDITIONER_JACOBI;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--scene" && hasValue)
+		{
+			sceneFile = argv[++i];
+		}
+		else if (arg == "--generate" && i + 2 < argc)
+		{
+			if (!parseTopology(argv[++i], generator.topology))
+			{
+				return 1;
+			}
+			generator.vessels = atoi(argv[++i]);
+			generate = true;
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			generator.seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--steps" && hasValue)
+		{
+			steps = atoll(argv[++i]);
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if (arg == "--physics-hz" && hasValue)
+		{
+			hz = atof(argv[++i]);
+		}
+		else if (arg == "--pressure" && hasValue)
+		{
+			pressure = (float)atof(argv[++i]);
+		}
+		else if (arg == "--integrator" && hasValue)
+		{
+			if (!parseIntegrator(argv[++i], integrator))
+			{
+				return 1;
+			}
+			integratorGiven = true;
+		}
+		else if (arg == "--preconditioner" && hasValue)
+		{
+			if (!parsePreconditioner(argv[++i], preconditioner))
+			{
+				return 1;
+			}
+		}
+		else if (arg == "--checkpoint" && hasValue)
+		{
+			checkpointFile = argv[++i];
+		}
+		else if (arg == "--serve" && hasValue)
+		{
+			servePath = argv[++i];
+		}
+		else if (arg == "--workers" && hasValue)
+		{
+			workers = atoi(argv[++i]);
+		}
+		else if (arg == "--workloads")
+		{
+			workloads = true;
+		}
+		else if (arg == "--query" && i + 4 < argc)
+		{
+			queryFile = argv[++i];
+			queryVessel = atoi(argv[++i]);
+			queryFrom = atof(argv[++i]);
+			queryTo = atof(argv[++i]);
+		}
+		else
+		{
+			std::cout << "Usage: HydroDynamicsHeadless [--scene FILE | --generate grid|tree|geometric|manifold VESSELS [--seed N]] [--steps N] "
+				"[--threads N] [--physics-hz HZ] [--pressure P] [--integrator local|implicit|adaptive|symplectic] "
+				"[--preconditioner jacobi|ic|direct|amg] [--checkpoint FILE | --serve SOCKET [--workers N]] | --workloads "
+				"[--threads N] | --query TELEMETRY VESSEL FROM TO [--physics-hz HZ]" << std::endl;
+			return 1;
+		}
+	}
+	if (steps < 0 || threads < 0 || hz <= 0.0 || (generate && generator.vessels < 1) || (generate && !sceneFile.empty()))
+	{
+		std::cout << "--steps and --threads can't be negative, --physics-hz has to be above 0, and --generate needs at least 1 vessel "
+			"and can't be combined with --scene." << std::endl;
+		return 1;
+	}
+	if (!servePath.empty() && (workers < 1 || workloads || !checkpointFile.empty()))
+	{
+		std::cout << "--serve needs at least 1 worker, and its jobs write their own checkpoints, so it can't be combined with --workloads "
+			"or --checkpoint." << std::endl;
+		return 1;
+	}
+	if (workloads)
+	{
+		return runWorkloads(threads);
+	}
+	if (!queryFile.empty())
+	{
+		return runQuery(queryFile, queryVessel, queryFrom, queryTo, hz);
+	}
+
+	// The threads of a pool start in its workers.
+	HydroSolver solver(servePath.empty() ? threads : 1);
+	if (!sceneFile.empty() && !solver.loadScene(sceneFile.c_str()))
+	{
+		return 1;
+	}
+	if (generate)
+	{
+		// The piston stays on vessel 0, where the generator puts it.
+		generateNetwork(generator, solver.network());
+		solver.network().computePressures(1.0f, 9.8f);
+	}
+	if (integratorGiven)
+	{
+		solver.network().integrator = integrator;
+	}
+	solver.network().solver.preconditioner = preconditioner;
+	solver.setStepRate(hz);
+	solver.setPistonPressure(pressure);
+	if (!servePath.empty())
+	{
+		poolScene = &solver;
+		poolThreads = threads;
+		return servePool(servePath, workers, runJob) ? 0 : 1;
+	}
+
+	double volume = solver.totalVolume();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool moving = true;
+	long long taken = 0;
+	while (taken < steps && moving)
+	{
+		moving = solver.step();
+		taken++;
+	}
+	std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+	std::cout << taken << " steps of " << solver.vesselCount() << " vessels and " << solver.tubeCount() << " tubes in " << took.count() << " s, "
+		<< (taken > 0 ? took.count() / taken * 1e3 : 0.0) << " ms per step" << (moving ? "" : ", at rest") << std::endl;
+	std::cout << "Volume " << solver.totalVolume() << " (" << solver.totalVolume() - volume << " since the start)" << std::endl;
+	const ImplicitSolver& implicit = solver.network().solver;
+	if (solver.network().integrator == INTEGRATOR_IMPLICIT && taken > 0)
+	{
+		std::cout << "Last solve: " << implicit.lastIterations << " iterations, residual " << implicit.lastResidual
+			<< (preconditioner == PRECONDITIONER_DIRECT && !implicit.lastDirect ? ", the network was too large to factor" : "")
+			<< (preconditioner == PRECONDITIONER_MULTIGRID ? ", " + std::to_string(implicit.lastVesselIterations) + " over the vessels" : "") << std::endl;
+	}
+	if (!checkpointFile.empty() && !solver.saveCheckpoint(checkpointFile.c_str()))
+	{
+		return 1;
+	}
+	return 0;
+}
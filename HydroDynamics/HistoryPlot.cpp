@@ -0,0 +1,332 @@
+/*
+Title: HydroDynamics
+File Name: HistoryPlot.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scrolling charts of many series of samples (the heights and pressures of the vessels, one
+sample per physics step), kept on the GPU in a ring buffer and drawn with one instanced
+triangle strip per series, reading the samples straight from the buffer.
+
+The chart has far more samples than pixels, so every pixel column shows the range from the
+smallest to the largest sample that falls into it, which keeps spikes visible however far
+the chart is zoomed out. Looking at every sample for that would cost millions of reads per
+frame, so the buffer doesn't just hold the samples: it is a pyramid of levels, where level
+L holds the minimum and maximum of every block of 2^L consecutive samples. Level 0 is the
+samples themselves. A column picks the level whose blocks are about as large as the
+samples it covers, so it only reads two or three blocks whatever the zoom.
+
+Every level is a ring of its own, as long as the ring of samples divided by its block size,
+and a block starts over as soon as its first sample is written again, so it always covers
+the newest samples written to it. A new sample changes one block of every level. The
+pyramid is mirrored on the CPU, where the samples are added, and the blocks changed since
+the last upload() are written from there with one small glBufferSubData per level.
+
+The pyramid is kept in half floats, which halves it. Half floats only count to 65504 and
+only have 11 bits, so a series isn't stored as it is but as how far it is from its first
+finite sample, times a power of two. That starts out as large as a float can tell the first
+sample from its neighbours, and whenever a sample would land further out than 32768, it is
+halved as often as it takes and everything stored of the series goes with it in the mirror,
+which the next upload() then writes in whole. The buffer is never read back. Halving a half
+float only changes its exponent, and the scale only drops when a series spreads further than
+it ever did, so that loses nothing and happens a few times a run. No sample is stored
+further out than the series has spread, so rounding it costs less than a 2000th of the
+height of the chart, and none of them gets near 65504.
+*/
+
+#include "HistoryPlot.h"
+#include "GLState.h"
+#include "Logger.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+bool HistoryPlot::create(int seriesCount, int capacity)
+{
+	destroy();
+	series = std::max(std::min(seriesCount, PLOT_MAX_SERIES), 1);
+
+	// The whole pyramid is about twice the samples, and all of it has to fit into one texture buffer.
+	GLint maxTexels = 65536;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	ringSize = 1;
+	while ((long long)ringSize * 2 <= capacity && (long long)ringSize * 4 * series <= maxTexels && ringSize < (1 << (PLOT_MAX_LEVELS - 1)))
+	{
+		ringSize *= 2;
+	}
+
+	levels = 0;
+	int blocks = 0;
+	levelOffset.clear();
+	for (int size = ringSize; size >= 1; size /= 2)
+	{
+		levelOffset.push_back(blocks);
+		blocks += size;
+		levels++;
+	}
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::uint) * blocks * series, nullptr, GL_DYNAMIC_DRAW);
+	glGenTextures(1, &texture);
+	cachedBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG16F, buffer);
+	cachedBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (glGetError() != GL_NO_ERROR)
+	{
+		std::cout << "Can't create a plot of " << series << " x " << ringSize << " samples." << std::endl;
+		destroy();
+		return false;
+	}
+
+	total = 0;
+	mirror.assign((size_t)blocks * series, 0);
+	changedFirst.assign(levels, -1);
+	changedLast.assign(levels, -1);
+	rewrite = false;
+	current.assign(levels * series, glm::vec2(0.0f));
+	extent.assign(series, glm::vec2(FLT_MAX, -FLT_MAX));
+	origin.assign(series, 0.0f);
+	scale.assign(series, 1.0f);
+	clampWarned = false;
+	colors.assign(series, glm::vec4(1.0f));
+	lanes.assign(series, glm::vec2(-1.0f, 1.0f));
+	return true;
+}
+
+void HistoryPlot::add(const float* values)
+{
+	if (buffer == 0)
+	{
+		return;
+	}
+	float stored[PLOT_MAX_SERIES];
+	for (int s = 0; s < series; s++)
+	{
+		// A sample that isn't finite, or too far from the first to subtract it, is drawn at the first.
+		float value = values[s];
+		stored[s] = 0.0f;
+		if (!std::isfinite(value) || !std::isfinite(value - origin[s]))
+		{
+			continue;
+		}
+
+		// Until a series has a finite sample, its extent is empty. The first one is the origin, and the scale starts out mapping the
+		// spacing of floats around it to the smallest normal half float, 2^-14, or to less for the tiniest origins.
+		if (extent[s].x > extent[s].y)
+		{
+			int exponent = 0;
+			std::frexp(value, &exponent);
+			origin[s] = value;
+			scale[s] = std::ldexp(1.0f, std::min(10 - exponent, 100));
+		}
+		extent[s] = glm::vec2(std::min(extent[s].x, value), std::max(extent[s].y, value));
+
+		double offset = (double)(value - origin[s]) * scale[s];
+		if (std::fabs(offset) > PLOT_OFFSET_LIMIT)
+		{
+			rescale(s, offset);
+			offset = (double)(value - origin[s]) * scale[s];
+		}
+		if (!(std::fabs(offset) <= 65504.0f))
+		{
+			if (!clampWarned)
+			{
+				LOG_WARNING("Plot series {} left the range of half floats and is clamped.", s);
+				clampWarned = true;
+			}
+			offset = std::max(std::min(offset, 65504.0), -65504.0);
+		}
+		stored[s] = (float)offset;
+	}
+
+	for (int level = 0; level < levels; level++)
+	{
+		// The block this sample goes into either starts with it, or carries on from the samples before it.
+		bool starts = (total & ((1LL << level) - 1)) == 0;
+		glm::vec2* range = &current[level * series];
+		for (int s = 0; s < series; s++)
+		{
+			range[s] = starts ? glm::vec2(stored[s]) : glm::vec2(std::min(range[s].x, stored[s]), std::max(range[s].y, stored[s]));
+		}
+
+		long long block = total >> level;
+		size_t position = (size_t)(levelOffset[level] + (block & ((ringSize >> level) - 1))) * series;
+		std::transform(range, range + series, mirror.begin() + position, [](const glm::vec2& r) { return glm::packHalf2x16(r); });
+		if (changedFirst[level] < 0)
+		{
+			changedFirst[level] = block;
+		}
+		changedLast[level] = block;
+	}
+	total++;
+}
+
+void HistoryPlot::rescale(int s, double offset)
+{
+	// The factor can be smaller than a float, so it is applied in double. The blocks that were never written are zeros, which stay.
+	int exponent = 0;
+	std::frexp(offset / PLOT_OFFSET_LIMIT, &exponent);
+	double factor = std::ldexp(1.0, -exponent);
+	scale[s] = (float)((double)scale[s] * factor);
+	for (int level = 0; level < levels; level++)
+	{
+		glm::vec2& range = current[level * series + s];
+		range = glm::vec2(glm::dvec2(range) * factor);
+	}
+	for (size_t i = s; i < mirror.size(); i += series)
+	{
+		mirror[i] = glm::packHalf2x16(glm::vec2(glm::dvec2(glm::unpackHalf2x16(mirror[i])) * factor));
+	}
+	rewrite = true;
+}
+
+void HistoryPlot::upload()
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	if (rewrite)
+	{
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::uint) * mirror.size(), mirror.data());
+		rewrite = false;
+	}
+	else
+	{
+		for (int level = 0; level < levels; level++)
+		{
+			if (changedFirst[level] >= 0)
+			{
+				write(level, changedFirst[level], (int)std::min(changedLast[level] - changedFirst[level] + 1, (long long)(ringSize >> level)));
+			}
+		}
+	}
+	changedFirst.assign(levels, -1);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void HistoryPlot::write(int level, long long first, int count)
+{
+	// The blocks sit at the same place in the mirror as in the buffer, so both parts are copied as they are.
+	int ringBlocks = ringSize >> level;
+	int position = (int)(first & (ringBlocks - 1));
+	int untilEnd = std::min(count, ringBlocks - position);
+	GLsizeiptr blockSize = sizeof(glm::uint) * series;
+	const glm::uint* values = mirror.data() + (size_t)levelOffset[level] * series;
+	glBufferSubData(GL_TEXTURE_BUFFER, (levelOffset[level] + position) * blockSize, untilEnd * blockSize, values + (size_t)position * series);
+	if (count > untilEnd)
+	{
+		glBufferSubData(GL_TEXTURE_BUFFER, levelOffset[level] * blockSize, (count - untilEnd) * blockSize, values);
+	}
+}
+
+void HistoryPlot::setStyle(int seriesIndex, const glm::vec4& color, float bottom, float top)
+{
+	if (seriesIndex >= 0 && seriesIndex < series)
+	{
+		colors[seriesIndex] = color;
+		lanes[seriesIndex] = glm::vec2(bottom, top);
+	}
+}
+
+GLsizei HistoryPlot::prepare(GLuint program, int columns, int rows, long long span)
+{
+	if (buffer == 0 || columns <= 0 || rows <= 0)
+	{
+		return 0;
+	}
+
+	// Until the ring is full, the chart grows to the left as samples come in, and afterwards it scrolls.
+	if (span <= 0 || span > ringSize)
+	{
+		span = std::max(std::min(total, (long long)ringSize), (long long)columns);
+		span = std::min(span, (long long)ringSize);
+	}
+
+	// The oldest block a column reads must not share its place in the ring with the block being filled, which has started over
+	// with the newest samples. Leaving out the oldest two blocks of the level the columns read keeps them apart.
+	long long block = 1;
+	while (block * 2 <= span / columns)
+	{
+		block *= 2;
+	}
+	span = std::min(span, ringSize - 2 * block);
+
+	// The shader counts the samples of the chart from 0 at the left edge. Sample i is at position baseRing + i of the ring, and only
+	// the ones from validFrom on were written.
+	long long base = total - span;
+	int baseRing = (int)(base & (ringSize - 1));
+	int validFrom = (int)std::max(-base, 0LL);
+
+	glm::vec4 seriesLane[PLOT_MAX_SERIES];
+	for (int s = 0; s < series; s++)
+	{
+		seriesLane[s] = glm::vec4((extent[s].x - origin[s]) * scale[s], (extent[s].y - origin[s]) * scale[s], lanes[s].x, lanes[s].y);
+	}
+
+	if (program != preparedProgram)
+	{
+		preparedProgram = program;
+		cachedUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "pyramid"), 4);
+		locations[0] = glGetUniformLocation(program, "seriesCount");
+		locations[1] = glGetUniformLocation(program, "levelCount");
+		locations[2] = glGetUniformLocation(program, "ringSize");
+		locations[3] = glGetUniformLocation(program, "baseRing");
+		locations[4] = glGetUniformLocation(program, "span");
+		locations[5] = glGetUniformLocation(program, "validFrom");
+		locations[6] = glGetUniformLocation(program, "columns");
+		locations[7] = glGetUniformLocation(program, "pixelHeight");
+		locations[8] = glGetUniformLocation(program, "levelOffset");
+		locations[9] = glGetUniformLocation(program, "seriesColor");
+		locations[10] = glGetUniformLocation(program, "seriesLane");
+	}
+	cachedUseProgram(program);
+	glUniform1i(locations[0], series);
+	glUniform1i(locations[1], levels);
+	glUniform1i(locations[2], ringSize);
+	glUniform1i(locations[3], baseRing);
+	glUniform1i(locations[4], (int)span);
+	glUniform1i(locations[5], validFrom);
+	glUniform1i(locations[6], columns);
+	glUniform1f(locations[7], 2.0f / rows);
+	glUniform1iv(locations[8], levels, levelOffset.data());
+	glUniform4fv(locations[9], series, &colors[0][0]);
+	glUniform4fv(locations[10], series, &seriesLane[0][0]);
+
+	cachedActiveTexture(GL_TEXTURE4);
+	cachedBindTexture(GL_TEXTURE_BUFFER, texture);
+	cachedActiveTexture(GL_TEXTURE0);
+	return columns * 2;
+}
+
+void HistoryPlot::destroy()
+{
+	cachedDeleteTextures(1, &texture);
+	glDeleteBuffers(1, &buffer);
+	texture = 0;
+	buffer = 0;
+	preparedProgram = 0;
+	total = 0;
+	mirror = std::vector<glm::uint>();
+}
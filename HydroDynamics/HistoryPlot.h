@@ -0,0 +1,136 @@
+/*
+Title: HydroDynamics
+File Name: HistoryPlot.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scrolling charts of many series of samples (the heights and pressures of the vessels, one
+sample per physics step), kept on the GPU in a ring buffer and drawn with one instanced
+triangle strip per series, reading the samples straight from the buffer.
+
+The chart has far more samples than pixels, so every pixel column shows the range from the
+smallest to the largest sample that falls into it, which keeps spikes visible however far
+the chart is zoomed out. Looking at every sample for that would cost millions of reads per
+frame, so the buffer doesn't just hold the samples: it is a pyramid of levels, where level
+L holds the minimum and maximum of every block of 2^L consecutive samples. Level 0 is the
+samples themselves. A column picks the level whose blocks are about as large as the
+samples it covers, so it only reads two or three blocks whatever the zoom.
+
+Every level is a ring of its own, as long as the ring of samples divided by its block size,
+and a block starts over as soon as its first sample is written again, so it always covers
+the newest samples written to it. A new sample changes one block of every level. The
+pyramid is mirrored on the CPU, where the samples are added, and the blocks changed since
+the last upload() are written from there with one small glBufferSubData per level.
+
+The pyramid is kept in half floats, which halves it. Half floats only count to 65504 and
+only have 11 bits, so a series isn't stored as it is but as how far it is from its first
+finite sample, times a power of two. That starts out as large as a float can tell the first
+sample from its neighbours, and whenever a sample would land further out than 32768, it is
+halved as often as it takes and everything stored of the series goes with it in the mirror,
+which the next upload() then writes in whole. The buffer is never read back. Halving a half
+float only changes its exponent, and the scale only drops when a series spreads further than
+it ever did, so that loses nothing and happens a few times a run. No sample is stored
+further out than the series has spread, so rounding it costs less than a 2000th of the
+height of the chart, and none of them gets near 65504.
+*/
+
+#ifndef _HISTORY_PLOT_H
+#define _HISTORY_PLOT_H
+
+#include "GLIncludes.h"
+#include <vector>
+
+// The most series and levels a plot can have, which is how large the uniform arrays of PlotVertexShader.glsl are.
+#define PLOT_MAX_SERIES 8
+#define PLOT_MAX_LEVELS 24
+
+// How far from the first sample a sample may be stored, well inside the 65504 of a half float.
+#define PLOT_OFFSET_LIMIT 32768.0f
+
+class HistoryPlot
+{
+public:
+	// Creates the pyramid for seriesCount series of up to capacity samples each, rounded down to a power of two and to what fits
+	// into a texture buffer on this driver. It takes 8 bytes per sample per series on the GPU, and as many for the mirror on the CPU.
+	// Returns false if it can't be created.
+	bool create(int seriesCount, int capacity);
+
+	// Adds a sample of every series, values[0] to values[seriesCount - 1]. It is uploaded with the next upload().
+	void add(const float* values);
+
+	// Writes the blocks changed since the last upload into the buffer, or all of it after a series was rescaled.
+	void upload();
+
+	// The color of a series, and the part of the chart it is drawn in, from bottom to top in clip space.
+	void setStyle(int series, const glm::vec4& color, float bottom, float top);
+
+	// Binds the pyramid to texture unit 4 and sets the uniforms of program (made from PlotVertexShader.glsl) to draw the newest
+	// span samples (all that are kept if span is 0 or more than that) over the columns x rows pixels of the viewport. Each series is
+	// scaled from the smallest to the largest sample it ever had. Returns how many vertices to draw per series, one instance each.
+	GLsizei prepare(GLuint program, int columns, int rows, long long span);
+
+	// Frees the buffer.
+	void destroy();
+
+	int seriesCount() const { return series; }
+	int capacity() const { return ringSize; }
+	long long sampleCount() const { return total; }
+
+private:
+	GLuint buffer = 0;
+	GLuint texture = 0;
+	int series = 0;
+	int ringSize = 0;					// Samples per series, a power of two
+	int levels = 0;
+	std::vector<int> levelOffset;		// Where every level starts, in blocks of all series
+	long long total = 0;				// Samples added so far
+
+	// The buffer as it is on the GPU: the minimum and maximum of every series in every block of every level as glm::packHalf2x16.
+	// For every level, the first block changed since the last upload (counted from the first sample ever, or -1 if none) and the
+	// last one, which is the block still being filled. After a rescale, all of it is written.
+	std::vector<glm::uint> mirror;
+	std::vector<long long> changedFirst;
+	std::vector<long long> changedLast;
+	bool rewrite = false;
+	std::vector<glm::vec2> current;		// The block every level is filling, for every series, as it is stored
+
+	// The uniforms of the program prepare() was called with last.
+	GLuint preparedProgram = 0;
+	GLint locations[11] = {};
+
+	std::vector<glm::vec2> extent;		// The smallest and the largest sample of every series
+	std::vector<float> origin;			// The first finite sample of every series, which it is stored relative to
+	std::vector<float> scale;			// And what the rest of it is multiplied with
+	bool clampWarned = false;
+	std::vector<glm::vec4> colors;
+	std::vector<glm::vec2> lanes;
+
+	// Writes count blocks of a level from the mirror, starting at block first (counted from the first sample ever), which may wrap
+	// around its ring.
+	void write(int level, long long first, int count);
+
+	// Divides the scale of a series by the power of two that brings offset, a sample as it would be stored, within PLOT_OFFSET_LIMIT,
+	// together with everything stored of the series so far.
+	void rescale(int series, double offset);
+};
+
+#endif // _HISTORY_PLOT_H
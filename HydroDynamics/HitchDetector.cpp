@@ -0,0 +1,100 @@
+/*
+Title: HydroDynamics
+File Name: HitchDetector.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Catches the occasional long frame (a hitch) while it happens, so an intermittent stall can be
+looked at afterwards without having to reproduce it under a profiler.
+
+Every frame time is compared with the median of the last HITCH_BASELINE_FRAMES frames. A
+frame that takes factor times as long as that, and at least HITCH_MINIMUM_MILLISECONDS more,
+is a hitch. The median is what the frames normally take: a few slow frames don't raise it,
+so one hitch doesn't hide the next. After a hitch the detector ignores the frames for
+HITCH_COOLDOWN_SECONDS, because the capture it led to, and whatever caused it, often make
+the next frames slow as well.
+
+With --hitch-capture PREFIX, the window writes the trace ring (see TraceRecorder.h) and a
+screenshot of the next frame for every hitch. The trace is written on a thread of its own,
+since writing all of the ring takes longer than a frame.
+*/
+
+#include "HitchDetector.h"
+#include "ThreadControl.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+
+HitchDetector::~HitchDetector()
+{
+	if (writer.joinable())
+	{
+		writer.join();
+	}
+}
+
+bool HitchDetector::addFrame(double milliseconds, double now)
+{
+	// The baseline is taken before the frame is added, so a hitch is measured against the frames before it. Until half the
+	// window is full there isn't a baseline yet.
+	bool hitch = false;
+	if (frameCount >= HITCH_BASELINE_FRAMES / 2)
+	{
+		float sorted[HITCH_BASELINE_FRAMES];
+		std::copy(frames, frames + frameCount, sorted);
+		std::nth_element(sorted, sorted + frameCount / 2, sorted + frameCount);
+		lastBaseline = sorted[frameCount / 2];
+		hitch = milliseconds > lastBaseline * factor && milliseconds - lastBaseline > HITCH_MINIMUM_MILLISECONDS &&
+			now - lastHitch > HITCH_COOLDOWN_SECONDS;
+	}
+
+	frames[nextFrame] = (float)milliseconds;
+	nextFrame = (nextFrame + 1) % HITCH_BASELINE_FRAMES;
+	frameCount = std::min(frameCount + 1, HITCH_BASELINE_FRAMES);
+	if (hitch)
+	{
+		lastHitch = now;
+		hitches++;
+	}
+	return hitch;
+}
+
+bool HitchDetector::writeTrace(const std::string& fileName)
+{
+	if (writing.load())
+	{
+		return false;
+	}
+	if (writer.joinable())
+	{
+		writer.join();
+	}
+
+	// The ring is written to while this reads it, which traceWrite() allows for: it skips the events that are being overwritten.
+	writing.store(true);
+	writer = std::thread([this, fileName]()
+	{
+		applyThreadRole(THREAD_ROLE_IO);
+		traceWrite(fileName);
+		writing.store(false);
+	});
+	return true;
+}
@@ -0,0 +1,87 @@
+/*
+Title: HydroDynamics
+File Name: HitchDetector.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Catches the occasional long frame (a hitch) while it happens, so an intermittent stall can be
+looked at afterwards without having to reproduce it under a profiler.
+
+Every frame time is compared with the median of the last HITCH_BASELINE_FRAMES frames. A
+frame that takes factor times as long as that, and at least HITCH_MINIMUM_MILLISECONDS more,
+is a hitch. The median is what the frames normally take: a few slow frames don't raise it,
+so one hitch doesn't hide the next. After a hitch the detector ignores the frames for
+HITCH_COOLDOWN_SECONDS, because the capture it led to, and whatever caused it, often make
+the next frames slow as well.
+
+With --hitch-capture PREFIX, the window writes the trace ring (see TraceRecorder.h) and a
+screenshot of the next frame for every hitch. The trace is written on a thread of its own,
+since writing all of the ring takes longer than a frame.
+*/
+
+#ifndef _HITCH_DETECTOR_H
+#define _HITCH_DETECTOR_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#define HITCH_BASELINE_FRAMES 120
+#define HITCH_DEFAULT_FACTOR 2.5
+#define HITCH_MINIMUM_MILLISECONDS 8.0
+#define HITCH_COOLDOWN_SECONDS 2.0
+
+class HitchDetector
+{
+public:
+	explicit HitchDetector(double factor = HITCH_DEFAULT_FACTOR) : factor(factor) {}
+	~HitchDetector();
+
+	HitchDetector(const HitchDetector&) = delete;
+	HitchDetector& operator=(const HitchDetector&) = delete;
+
+	void setFactor(double value) { factor = value; }
+
+	// Adds the time of the frame that ended at now (in seconds). Returns true if it was a hitch.
+	bool addFrame(double milliseconds, double now);
+
+	// What the frames before the last one took, normally. 0 until there were enough of them.
+	double baseline() const { return lastBaseline; }
+	int hitchCount() const { return hitches; }
+
+	// Starts writing the trace ring to fileName on another thread. Returns false if the last one isn't written yet.
+	bool writeTrace(const std::string& fileName);
+
+private:
+	double factor;
+	float frames[HITCH_BASELINE_FRAMES];	// The last frame times, oldest overwritten first
+	int frameCount = 0;
+	int nextFrame = 0;
+	double lastBaseline = 0.0;
+	double lastHitch = -HITCH_COOLDOWN_SECONDS;
+	int hitches = 0;
+
+	std::thread writer;
+	std::atomic<bool> writing{ false };
+};
+
+#endif // _HITCH_DETECTOR_H
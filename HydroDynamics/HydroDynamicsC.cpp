@@ -0,0 +1,191 @@
+/*
+Title: HydroDynamics
+File Name: HydroDynamicsC.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The C functions of the HydroDynamicsCore library, for programs that can't use its C++ class:
+C itself, or any language that calls into a DLL through a C interface. Every function forwards
+to a HydroSolver (see HydroSolver.h) behind an opaque handle, takes and returns only plain
+types.
+
+The functions that can fail return 1 on success and 0 on failure, after printing what went
+wrong. The ones that read a vessel or a tube return 0 for one that isn't there.
+
+This file has no OpenGL dependency.
+*/
+
+#include "HydroDynamicsC.h"
+#include "HydroSolver.h"
+#include <iostream>
+#include <new>
+
+static HydroSolver* solverOf(HydroHandle solver)
+{
+	return reinterpret_cast<HydroSolver*>(solver);
+}
+
+HydroHandle hydroCreate(int threads)
+{
+	HydroSolver* solver = new (std::nothrow) HydroSolver(threads);
+	if (solver == nullptr)
+	{
+		std::cout << "Not enough memory for a solver." << std::endl;
+	}
+	return reinterpret_cast<HydroHandle>(solver);
+}
+
+void hydroDestroy(HydroHandle solver)
+{
+	delete solverOf(solver);
+}
+
+void hydroReset(HydroHandle solver)
+{
+	solverOf(solver)->reset();
+}
+
+int hydroLoadScene(HydroHandle solver, const char* fileName)
+{
+	return fileName != nullptr && solverOf(solver)->loadScene(fileName) ? 1 : 0;
+}
+
+int hydroSaveCheckpoint(HydroHandle solver, const char* fileName)
+{
+	return fileName != nullptr && solverOf(solver)->saveCheckpoint(fileName) ? 1 : 0;
+}
+
+void hydroSetDensity(HydroHandle solver, float density)
+{
+	solverOf(solver)->setDensity(density);
+}
+
+void hydroSetGravity(HydroHandle solver, float gravity)
+{
+	solverOf(solver)->setGravity(gravity);
+}
+
+void hydroSetStepRate(HydroHandle solver, double hz)
+{
+	solverOf(solver)->setStepRate(hz);
+}
+
+void hydroSetPistonPressure(HydroHandle solver, float pressure)
+{
+	solverOf(solver)->setPistonPressure(pressure);
+}
+
+void hydroSetPistonMass(HydroHandle solver, float mass)
+{
+	solverOf(solver)->setPistonMass(mass);
+}
+
+void hydroSetExternalPressure(HydroHandle solver, int vessel, float pressure)
+{
+	solverOf(solver)->setExternalPressure(vessel, pressure);
+}
+
+int hydroStep(HydroHandle solver, int steps)
+{
+	return solverOf(solver)->step(steps) ? 1 : 0;
+}
+
+int hydroSettle(HydroHandle solver)
+{
+	return solverOf(solver)->settle() ? 1 : 0;
+}
+
+long long hydroStepCount(HydroHandle solver)
+{
+	return solverOf(solver)->stepCount();
+}
+
+double hydroTime(HydroHandle solver)
+{
+	return solverOf(solver)->time();
+}
+
+int hydroVesselCount(HydroHandle solver)
+{
+	return solverOf(solver)->vesselCount();
+}
+
+int hydroTubeCount(HydroHandle solver)
+{
+	return solverOf(solver)->tubeCount();
+}
+
+int hydroPistonVessel(HydroHandle solver)
+{
+	return solverOf(solver)->pistonVessel();
+}
+
+float hydroLevel(HydroHandle solver, int vessel)
+{
+	return solverOf(solver)->level(vessel);
+}
+
+float hydroHeight(HydroHandle solver, int vessel)
+{
+	return solverOf(solver)->height(vessel);
+}
+
+float hydroFlow(HydroHandle solver, int tube)
+{
+	return solverOf(solver)->flow(tube);
+}
+
+double hydroTotalVolume(HydroHandle solver)
+{
+	return solverOf(solver)->totalVolume();
+}
+
+int hydroLevels(HydroHandle solver, float* levels, int count)
+{
+	HydroSolver* s = solverOf(solver);
+	int n = count < s->vesselCount() ? count : s->vesselCount();
+	for (int i = 0; i < n; i++)
+	{
+		levels[i] = s->level(i);
+	}
+	return n;
+}
+
+const float* hydroLevelArray(HydroHandle solver)
+{
+	return solverOf(solver)->levels();
+}
+
+const float* hydroHeightArray(HydroHandle solver)
+{
+	return solverOf(solver)->heights();
+}
+
+const float* hydroPressureArray(HydroHandle solver)
+{
+	return solverOf(solver)->pressures();
+}
+
+const float* hydroFlowArray(HydroHandle solver)
+{
+	return solverOf(solver)->flows();
+}
@@ -0,0 +1,99 @@
+/*
+Title: HydroDynamics
+File Name: HydroDynamicsC.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The C functions of the HydroDynamicsCore library, for programs that can't use its C++ class:
+C itself, or any language that calls into a DLL through a C interface. Every function forwards
+to a HydroSolver (see HydroSolver.h) behind an opaque handle, takes and returns only plain
+types.
+
+The functions that can fail return 1 on success and 0 on failure, after printing what went
+wrong. The ones that read a vessel or a tube return 0 for one that isn't there.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _HYDRO_DYNAMICS_C_H
+#define _HYDRO_DYNAMICS_C_H
+
+#ifndef HYDRO_API
+#if defined(_WIN32) && defined(HYDRODYNAMICS_EXPORTS)
+#define HYDRO_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(HYDRODYNAMICS_DLL)
+#define HYDRO_API __declspec(dllimport)
+#else
+#define HYDRO_API
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HydroSolverHandle* HydroHandle;
+
+// Creates a solver with the classic apparatus, stepping on threads threads (0 for every core). Free it with hydroDestroy().
+HYDRO_API HydroHandle hydroCreate(int threads);
+HYDRO_API void hydroDestroy(HydroHandle solver);
+
+HYDRO_API void hydroReset(HydroHandle solver);
+HYDRO_API int hydroLoadScene(HydroHandle solver, const char* fileName);
+HYDRO_API int hydroSaveCheckpoint(HydroHandle solver, const char* fileName);
+
+HYDRO_API void hydroSetDensity(HydroHandle solver, float density);
+HYDRO_API void hydroSetGravity(HydroHandle solver, float gravity);
+HYDRO_API void hydroSetStepRate(HydroHandle solver, double hz);
+HYDRO_API void hydroSetPistonPressure(HydroHandle solver, float pressure);
+HYDRO_API void hydroSetPistonMass(HydroHandle solver, float mass);
+HYDRO_API void hydroSetExternalPressure(HydroHandle solver, int vessel, float pressure);
+
+// Advances by steps fixed steps, and returns 0 if nothing moved in the last of them.
+HYDRO_API int hydroStep(HydroHandle solver, int steps);
+HYDRO_API int hydroSettle(HydroHandle solver);
+
+HYDRO_API long long hydroStepCount(HydroHandle solver);
+HYDRO_API double hydroTime(HydroHandle solver);
+HYDRO_API int hydroVesselCount(HydroHandle solver);
+HYDRO_API int hydroTubeCount(HydroHandle solver);
+HYDRO_API int hydroPistonVessel(HydroHandle solver);
+HYDRO_API float hydroLevel(HydroHandle solver, int vessel);
+HYDRO_API float hydroHeight(HydroHandle solver, int vessel);
+HYDRO_API float hydroFlow(HydroHandle solver, int tube);
+HYDRO_API double hydroTotalVolume(HydroHandle solver);
+
+// Copies the levels of the first count vessels into levels, and returns how many there were.
+HYDRO_API int hydroLevels(HydroHandle solver, float* levels, int count);
+
+// The arrays of the network itself, like HydroSolver::levels() and the others: read them in place, and ask again after a reset or
+// a scene was loaded. The pressures are those of the fluid columns, without what pushes on them from outside.
+HYDRO_API const float* hydroLevelArray(HydroHandle solver);
+HYDRO_API const float* hydroHeightArray(HydroHandle solver);
+HYDRO_API const float* hydroPressureArray(HydroHandle solver);
+HYDRO_API const float* hydroFlowArray(HydroHandle solver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _HYDRO_DYNAMICS_C_H
@@ -0,0 +1,281 @@
+/*
+Title: HydroDynamics
+File Name: HydroSolver.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The simulation without the window, for programs that want to run it inside their own process
+instead of starting HydroDynamics: a service answering what-if questions about a network, a
+test harness, another language through the C functions of HydroDynamicsC.h.
+
+A HydroSolver owns a network, the piston on it and the threads that step it, and runs the same
+step the application runs in its loop: the piston pushes with the pressure it was given, the
+network moves one fixed step, and the piston follows the surface. It starts out with the
+classic apparatus, or with any scene or checkpoint readScene() takes.
+
+Both are built into the HydroDynamicsCore library, which has every part of the simulation and
+nothing that draws, so it doesn't need OpenGL, GLFW or a display. The state lives behind a
+pointer, so the class has the same size and layout whatever the headers of the simulation
+look like, and only plain types cross into the library. network() hands out the network
+itself for anything the class doesn't cover; only a program built with the same compiler and
+the same headers can safely use that.
+
+This file has no OpenGL dependency.
+*/
+
+#include "HydroSolver.h"
+#include "VesselNetwork.h"
+#include "Piston.h"
+#include "Scene.h"
+#include "Checkpoint.h"
+#include "TaskPool.h"
+
+#define DEFAULT_SOLVER_DENSITY 1.0f
+#define DEFAULT_SOLVER_GRAVITY 9.8f
+#define DEFAULT_SOLVER_HZ 120.0
+
+struct HydroSolver::State
+{
+	VesselNetwork network;
+	Piston piston;
+	TaskPool* pool = nullptr;
+	float density = DEFAULT_SOLVER_DENSITY;
+	float gravity = DEFAULT_SOLVER_GRAVITY;
+	double hz = DEFAULT_SOLVER_HZ;
+	float pistonPressure = 0.0f;
+	long long step = 0;
+};
+
+HydroSolver::HydroSolver(int threads)
+{
+	state = new State();
+	if (threads != 1)
+	{
+		state->pool = new TaskPool(threads > 1 ? threads - 1 : 0);
+	}
+	reset();
+}
+
+HydroSolver::~HydroSolver()
+{
+	delete state->pool;
+	delete state;
+}
+
+void HydroSolver::reset()
+{
+	VesselNetwork& network = state->network;
+	network.clear();
+	int big = network.addVessel(-0.75f, -0.5f, 0.5f, 0.5f);
+	int small = network.addVessel(0.5f, -0.5f, 0.25f, 0.5f);
+	network.addTube(big, small);
+	network.computePressures(state->density, state->gravity);
+	state->piston.vessel = big;
+	state->piston.velocity = 0.0f;
+	state->pistonPressure = 0.0f;
+	state->step = 0;
+}
+
+bool HydroSolver::loadScene(const char* fileName)
+{
+	CheckpointInfo info;
+	if (!readScene(fileName, state->network, info))
+	{
+		return false;
+	}
+	state->network.computePressures(state->density, state->gravity);
+	state->piston.vessel = info.pistonVessel;
+	state->piston.velocity = 0.0f;
+	state->pistonPressure = info.pistonPressure;
+	state->step = info.step;
+	return true;
+}
+
+void HydroSolver::startFrom(const HydroSolver& other)
+{
+	if (&other == this)
+	{
+		return;
+	}
+	TaskPool* pool = state->pool;
+	*state = *other.state;
+	state->pool = pool;
+}
+
+bool HydroSolver::saveCheckpoint(const char* fileName) const
+{
+	CheckpointInfo info;
+	info.step = state->step;
+	info.pistonPressure = state->pistonPressure;
+	info.pistonVessel = state->piston.vessel;
+	return writeCheckpoint(fileName, state->network, info);
+}
+
+void HydroSolver::setDensity(float value)
+{
+	state->density = value;
+	state->network.computePressures(state->density, state->gravity);
+	state->network.wakeAll();
+}
+
+void HydroSolver::setGravity(float value)
+{
+	state->gravity = value;
+	state->network.computePressures(state->density, state->gravity);
+	state->network.wakeAll();
+}
+
+void HydroSolver::setStepRate(double hz)
+{
+	state->hz = hz > 0.0 ? hz : DEFAULT_SOLVER_HZ;
+}
+
+void HydroSolver::setPistonPressure(float pressure)
+{
+	state->pistonPressure = pressure;
+}
+
+void HydroSolver::setPistonMass(float mass)
+{
+	state->piston.mass = mass > 0.0f ? mass : 0.0f;
+}
+
+void HydroSolver::setExternalPressure(int vessel, float pressure)
+{
+	if (vessel >= 0 && vessel < state->network.vesselCount() && vessel != state->piston.vessel)
+	{
+		state->network.setExternalPressure(vessel, pressure);
+	}
+}
+
+bool HydroSolver::step(int steps)
+{
+	VesselNetwork& network = state->network;
+	Piston& piston = state->piston;
+	float dt = (float)(1.0 / state->hz);
+	bool moved = false;
+	for (int i = 0; i < steps && network.vesselCount() > 0; i++)
+	{
+		// The same step as the loop of the application: the piston pushes, the network moves, and the piston follows the surface.
+		piston.force = state->pistonPressure * network.width[piston.vessel];
+		piston.couple(network, state->density, state->gravity, dt);
+		network.runSchedule(state->step);
+		moved = network.update(state->density, state->gravity, dt, state->pool);
+		piston.follow(network);
+		state->step++;
+	}
+	return moved;
+}
+
+bool HydroSolver::settle()
+{
+	// At rest the piston doesn't accelerate, so it pushes with its resting pressure instead of the one of the last step.
+	VesselNetwork& network = state->network;
+	Piston& piston = state->piston;
+	if (network.vesselCount() == 0)
+	{
+		return false;
+	}
+	piston.force = state->pistonPressure * network.width[piston.vessel];
+	network.setExternalPressure(piston.vessel, piston.restingPressure(network, state->gravity));
+	if (!network.settle(state->density, state->gravity))
+	{
+		return false;
+	}
+	piston.velocity = 0.0f;
+	return true;
+}
+
+long long HydroSolver::stepCount() const
+{
+	return state->step;
+}
+
+double HydroSolver::time() const
+{
+	return state->step / state->hz;
+}
+
+int HydroSolver::vesselCount() const
+{
+	return state->network.vesselCount();
+}
+
+int HydroSolver::tubeCount() const
+{
+	return state->network.tubeCount();
+}
+
+int HydroSolver::pistonVessel() const
+{
+	return state->piston.vessel;
+}
+
+float HydroSolver::level(int vessel) const
+{
+	return vessel >= 0 && vessel < vesselCount() ? state->network.top[vessel] : 0.0f;
+}
+
+float HydroSolver::height(int vessel) const
+{
+	return vessel >= 0 && vessel < vesselCount() ? state->network.height[vessel] : 0.0f;
+}
+
+float HydroSolver::flow(int tube) const
+{
+	return tube >= 0 && tube < tubeCount() ? state->network.tubeFlow[tube] : 0.0f;
+}
+
+double HydroSolver::totalVolume() const
+{
+	return state->network.totalVolume();
+}
+
+const float* HydroSolver::levels() const
+{
+	return state->network.top.data();
+}
+
+const float* HydroSolver::heights() const
+{
+	return state->network.height.data();
+}
+
+const float* HydroSolver::pressures() const
+{
+	return state->network.pressure.data();
+}
+
+const float* HydroSolver::flows() const
+{
+	return state->network.tubeFlow.data();
+}
+
+VesselNetwork& HydroSolver::network()
+{
+	return state->network;
+}
+
+const VesselNetwork& HydroSolver::network() const
+{
+	return state->network;
+}
@@ -0,0 +1,138 @@
+/*
+Title: HydroDynamics
+File Name: HydroSolver.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The simulation without the window, for programs that want to run it inside their own process
+instead of starting HydroDynamics: a service answering what-if questions about a network, a
+test harness, another language through the C functions of HydroDynamicsC.h.
+
+A HydroSolver owns a network, the piston on it and the threads that step it, and runs the same
+step the application runs in its loop: the piston pushes with the pressure it was given, the
+network moves one fixed step, and the piston follows the surface. It starts out with the
+classic apparatus, or with any scene or checkpoint readScene() takes.
+
+Both are built into the HydroDynamicsCore library, which has every part of the simulation and
+nothing that draws, so it doesn't need OpenGL, GLFW or a display. The state lives behind a
+pointer, so the class has the same size and layout whatever the headers of the simulation
+look like, and only plain types cross into the library. network() hands out the network
+itself for anything the class doesn't cover; only a program built with the same compiler and
+the same headers can safely use that.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _HYDRO_SOLVER_H
+#define _HYDRO_SOLVER_H
+
+// Building the library exports the functions, and a program that links to it defines HYDRODYNAMICS_DLL to import them. The
+// applications compile the sources in directly and need neither.
+#ifndef HYDRO_API
+#if defined(_WIN32) && defined(HYDRODYNAMICS_EXPORTS)
+#define HYDRO_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(HYDRODYNAMICS_DLL)
+#define HYDRO_API __declspec(dllimport)
+#else
+#define HYDRO_API
+#endif
+#endif
+
+struct VesselNetwork;
+
+class HYDRO_API HydroSolver
+{
+public:
+	// Starts with the classic apparatus, stepping on threads threads (1 steps on the calling thread only, 0 on every core).
+	explicit HydroSolver(int threads = 1);
+	~HydroSolver();
+
+	HydroSolver(const HydroSolver&) = delete;
+	HydroSolver& operator=(const HydroSolver&) = delete;
+
+	// Starts over with the classic apparatus: a big and a small vessel, both filled half a meter, and the piston on the big one.
+	void reset();
+
+	// Starts over with a scene or checkpoint, text or binary. Returns false (after printing what is wrong, and keeping the network
+	// it had) if the file can't be read.
+	bool loadScene(const char* fileName);
+
+	// Starts over from the state other is in, the network, the piston and the settings, by copying it instead of reading its file
+	// again. The threads stay those of this solver, and a network as large as the one this solver had takes no new memory.
+	void startFrom(const HydroSolver& other);
+
+	// Writes the network as a checkpoint, which loadScene() (and --restore) can start from. Returns false if the file can't be written.
+	bool saveCheckpoint(const char* fileName) const;
+
+	// The fluid and the gravity the step uses. Changing them takes effect with the next step.
+	void setDensity(float value);
+	void setGravity(float value);
+
+	// How many steps the simulation takes per simulated second (120 by default, like the application).
+	void setStepRate(double hz);
+
+	// The pressure the piston pushes with, and its mass per depth (0 pushes with exactly that pressure).
+	void setPistonPressure(float pressure);
+	void setPistonMass(float mass);
+
+	// A pressure pushing on the surface of any other vessel from outside.
+	void setExternalPressure(int vessel, float pressure);
+
+	// Advances the simulation by steps fixed steps. Returns false if nothing moved in the last of them.
+	bool step(int steps = 1);
+
+	// Moves straight to the rest state with the current pressures, without stepping through the motion. Returns false (and
+	// changes nothing) for a network whose rest state has no closed form (see VesselNetwork::settle()).
+	bool settle();
+
+	long long stepCount() const;
+	double time() const;
+	int vesselCount() const;
+	int tubeCount() const;
+	int pistonVessel() const;
+
+	// Where the surface of a vessel is, and how high the fluid in it stands.
+	float level(int vessel) const;
+	float height(int vessel) const;
+
+	// The flow through a tube, from its end B to its end A, in square meters per second.
+	float flow(int tube) const;
+
+	// The volume of fluid in all vessels.
+	double totalVolume() const;
+
+	// The arrays of the network itself, vesselCount() (or tubeCount()) entries long, for reading the whole state without copying
+	// it. Stepping only changes the values; the pointers stay valid until the solver is reset, loads a scene or is destroyed.
+	const float* levels() const;
+	const float* heights() const;
+	const float* pressures() const;
+	const float* flows() const;
+
+	VesselNetwork& network();
+	const VesselNetwork& network() const;
+
+private:
+	struct State;
+	State* state;
+};
+
+#endif // _HYDRO_SOLVER_H
@@ -0,0 +1,711 @@
+/*
+Title: HydroDynamics
+File Name: ImplicitSolver.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Solves for the flow through every tube of a network at the end of a step (backward Euler
+over the whole network at once).
+
+The default step treats every tube on its own: a tube sees how its own flow changes the
+pressure difference it is pushing against, but not how the flows of neighbouring tubes
+do. That is exact for the classic apparatus, but in a network where narrow vessels are
+shared by several tubes, the tubes all push the same vessel at once and large steps make
+them overshoot. The implicit step takes every tube into account together. The new flows q
+of all tubes satisfy
+
+    (L / dt + R) q + dt * density * gravity * K q = (L / dt) q_old + dp
+
+where L is the inertance and R the friction of each tube, dp the pressure differences at
+the start of the step, and K = G^T W^-1 G. G maps tube flows to the vessels they fill,
+and W holds the widths of the vessels. The matrix is symmetric and positive definite, so
+it is solved with the conjugate gradient method. The previous step's flows are the first
+guess, which is usually very close.
+
+The matrix is stored in CSR form (see SparseMatrix.h). Two tubes are coupled when they
+share a vessel, so every row has an entry for the tube itself and one for every other
+tube at either of its ends. The pattern and the values of K are built once per topology;
+the matrix itself only changes when the step size, density * gravity or the inertance or
+damping of a tube does. The conjugate gradient method is preconditioned either by the
+diagonal of the matrix, which is cheap and runs on every core, by an incomplete Cholesky
+factorization, which needs far fewer iterations on large stiff networks but applies it on
+one thread, by algebraic multigrid, which keeps the iterations about as few as the network
+grows and runs on every core, or by the complete factorization, which solves the system
+outright.
+
+Multigrid doesn't work on the matrix of the tubes itself: how two tubes couple depends on
+which way round they happen to be, and the flows it can hardly tell apart are the ones that
+go round in loops, which no grouping of tubes describes. It works on the vessels instead.
+With D the diagonal the tubes have on their own (L / dt + R) and c = dt * density * gravity,
+
+    A^-1 = D^-1 - D^-1 G^T S^-1 G D^-1, with S = W / c + G D^-1 G^T
+
+and S is a graph Laplacian over the vessels, weighted by how easily every tube lets fluid
+through, plus the widths on its diagonal: just what smoothed aggregation is made for (see
+AlgebraicMultigrid.h). The preconditioner is that formula, with S^-1 worked out by the
+conjugate gradient method over the vessels, preconditioned by a V-cycle, to the same
+tolerance as the solve. One V-cycle alone is not enough: whatever it leaves of the error
+grows with how stiff the tube is, and the stiff tubes are why the step is implicit. With the
+inner solve, the iterations over the tubes stay at one or two, and those over the vessels
+hardly grow with the size of the network.
+
+The complete factorization pays off on mid-size networks that keep their topology. Its
+elimination order and pattern are worked out once per topology, the numbers only again when
+the matrix changes, and every other step only does the two substitutions, after which the
+conjugate gradient method has nothing left to do but check. When the factor would be too
+large the solve goes on with the incomplete factorization instead.
+
+Editing the network while it runs doesn't start all of that over. The solver keeps the ends
+of the tubes and the widths of the vessels it built the matrix for, and when a rebuild only
+added vessels and tubes after them, it adds the rows of the new tubes to the matrix and to
+the factor (see SparseCholesky::append()). A valve or pump that changes the inertance of a
+few tubes only changes their diagonal entries, which the factor takes in as rank one
+updates. Either way the cost follows the size of the change rather than of the network.
+*/
+
+#include "ImplicitSolver.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+#include <cmath>
+#include <algorithm>
+
+// The same blocking as the rest of the update: networks with fewer tubes than this are solved on one thread.
+#define SOLVER_PARALLEL_MIN 8192
+#define SOLVER_BLOCK_SIZE 4096
+
+// More changed tubes than this at once, or more tubes added in one rebuild, are taken in by filling in or factoring the whole matrix
+// again, which is cheaper by then.
+#define SOLVER_MAX_UPDATES 256
+#define SOLVER_MAX_APPENDED 256
+
+// Runs body on [0, count) in blocks, on the pool if it is worth it and on this thread otherwise. The blocks are the same either way.
+template <typename Body>
+static void forBlocks(int count, TaskPool* pool, const Body& body)
+{
+	if (pool != nullptr && count >= SOLVER_PARALLEL_MIN)
+	{
+		pool->parallelFor(count, SOLVER_BLOCK_SIZE, body);
+		return;
+	}
+
+	for (int begin = 0; begin < count; begin += SOLVER_BLOCK_SIZE)
+	{
+		body(begin, std::min(begin + SOLVER_BLOCK_SIZE, count));
+	}
+}
+
+double ImplicitSolver::dot(const float* a, const float* b, int count, TaskPool* pool)
+{
+	int blocks = (count + SOLVER_BLOCK_SIZE - 1) / SOLVER_BLOCK_SIZE;
+	blockSums.assign(blocks, 0.0);
+	forBlocks(count, pool, [&](int begin, int end)
+	{
+		double sum = 0.0;
+		for (int i = begin; i < end; i++)
+		{
+			sum += (double)a[i] * b[i];
+		}
+		blockSums[begin / SOLVER_BLOCK_SIZE] = sum;
+	});
+
+	double total = 0.0;
+	for (int i = 0; i < blocks; i++)
+	{
+		total += blockSums[i];
+	}
+	return total;
+}
+
+// Sorts the entries of a row by column, and adds up the ones in the same column.
+static void sortAndMerge(std::vector<std::pair<int, float>>& row)
+{
+	std::sort(row.begin(), row.end(), [](const std::pair<int, float>& x, const std::pair<int, float>& y) { return x.first < y.first; });
+	size_t kept = 0;
+	for (size_t k = 0; k < row.size(); k++)
+	{
+		if (kept > 0 && row[k].first == row[kept - 1].first)
+		{
+			row[kept - 1].second += row[k].second;
+			continue;
+		}
+		row[kept++] = row[k];
+	}
+	row.resize(kept);
+}
+
+// The row of K for tube t, sorted by column. K = G^T W^-1 G. G has +1 for the A end of a tube and -1 for the B end, so K[t][s] adds
+// up sign(t) * sign(s) / width over every vessel tubes t and s both touch. That includes t itself, which gives the diagonal
+// 1 / widthA + 1 / widthB.
+static void couplingRow(const VesselNetwork& network, int t, std::vector<std::pair<int, float>>& row)
+{
+	const int* start = network.vesselTubeStart.data();
+	const int* list = network.vesselTubes.data();
+
+	row.clear();
+	row.emplace_back(t, 0.0f);	// Always have a diagonal, even for a tube that connects a vessel to itself
+	for (int end = 0; end < 2; end++)
+	{
+		int vessel = end == 0 ? network.tubeA[t] : network.tubeB[t];
+		float sign = end == 0 ? 1.0f : -1.0f;
+		for (int k = start[vessel]; k < start[vessel + 1]; k++)
+		{
+			int entry = list[k];
+			row.emplace_back(entry >> 1, ((entry & 1) ? -sign : sign) / network.width[vessel]);
+		}
+	}
+
+	// Merge the duplicates: the diagonal, and tubes that share both vessels.
+	sortAndMerge(row);
+}
+
+void ImplicitSolver::assemble(const VesselNetwork& network)
+{
+	int tubes = network.tubeCount();
+	matrix.rows = tubes;
+	matrix.rowStart.assign(tubes + 1, 0);
+	matrix.column.clear();
+	couplingValue.clear();
+	diagonalIndex.resize(tubes);
+
+	std::vector<std::pair<int, float>> row;
+	for (int t = 0; t < tubes; t++)
+	{
+		couplingRow(network, t, row);
+		for (const std::pair<int, float>& entry : row)
+		{
+			if (entry.first == t)
+			{
+				diagonalIndex[t] = (int)matrix.column.size();
+			}
+			matrix.column.push_back(entry.first);
+			couplingValue.push_back(entry.second);
+		}
+		matrix.rowStart[t + 1] = (int)matrix.column.size();
+	}
+
+	matrix.value.resize(couplingValue.size());
+	builtA = network.tubeA;
+	builtB = network.tubeB;
+	builtWidth = network.width;
+	assembledVersion = network.topologyVersion;
+	assembledDt = 0.0f;
+	factored = false;
+	analysed = false;
+	directFactored = false;
+	aggregated = false;
+}
+
+bool ImplicitSolver::extend(const VesselNetwork& network)
+{
+	int tubes = network.tubeCount();
+	int kept = matrix.rows;
+	if (assembledVersion < 0 || assembledDt == 0.0f || tubes < kept || network.vesselCount() < (int)builtWidth.size() ||
+		!std::equal(builtA.begin(), builtA.end(), network.tubeA.begin()) || !std::equal(builtB.begin(), builtB.end(), network.tubeB.begin()) ||
+		!std::equal(builtWidth.begin(), builtWidth.end(), network.width.begin()))
+	{
+		return false;
+	}
+
+	builtA = network.tubeA;
+	builtB = network.tubeB;
+	builtWidth = network.width;
+	assembledVersion = network.topologyVersion;
+	if (tubes == kept)
+	{
+		return true;
+	}
+
+	// The rows of the new tubes. Their entries in the columns of old tubes go into the rows of those tubes too (K is symmetric),
+	// after all of their old entries, since every new tube comes after every old one.
+	std::vector<std::vector<std::pair<int, float>>> rows(tubes - kept);
+	std::vector<int> extra(kept + 1, 0);
+	for (int t = kept; t < tubes; t++)
+	{
+		couplingRow(network, t, rows[t - kept]);
+		for (const std::pair<int, float>& entry : rows[t - kept])
+		{
+			if (entry.first < kept)
+			{
+				extra[entry.first + 1]++;
+			}
+		}
+	}
+	for (int t = 0; t < kept; t++)
+	{
+		extra[t + 1] += extra[t];
+	}
+
+	float dt = assembledDt;
+	float coupling = dt * assembledScale;
+	const float* invInertance = network.tubeInvInertance.data();
+	const float* damping = network.tubeDamping.data();
+	SparseMatrix grown;
+	std::vector<float> grownCoupling;
+	grown.rows = tubes;
+	grown.rowStart.assign(tubes + 1, 0);
+	grown.column.reserve(matrix.column.size() + 2 * extra[kept] + tubes - kept);
+	std::vector<int> fill(kept);
+	diagonalIndex.resize(tubes);
+	for (int t = 0; t < kept; t++)
+	{
+		int begin = matrix.rowStart[t];
+		int end = matrix.rowStart[t + 1];
+		grown.rowStart[t] = (int)grown.column.size();
+		diagonalIndex[t] += grown.rowStart[t] - begin;
+		grown.column.insert(grown.column.end(), matrix.column.begin() + begin, matrix.column.begin() + end);
+		grown.value.insert(grown.value.end(), matrix.value.begin() + begin, matrix.value.begin() + end);
+		grownCoupling.insert(grownCoupling.end(), couplingValue.begin() + begin, couplingValue.begin() + end);
+		fill[t] = (int)grown.column.size();
+		grown.column.resize(grown.column.size() + extra[t + 1] - extra[t]);
+		grown.value.resize(grown.column.size());
+		grownCoupling.resize(grown.column.size());
+	}
+	for (int t = kept; t < tubes; t++)
+	{
+		for (const std::pair<int, float>& entry : rows[t - kept])
+		{
+			if (entry.first < kept)
+			{
+				int k = fill[entry.first]++;
+				grown.column[k] = t;
+				grown.value[k] = coupling * entry.second;
+				grownCoupling[k] = entry.second;
+			}
+		}
+	}
+	inverseDiagonal.resize(tubes);
+	for (int t = kept; t < tubes; t++)
+	{
+		grown.rowStart[t] = (int)grown.column.size();
+		for (const std::pair<int, float>& entry : rows[t - kept])
+		{
+			if (entry.first == t)
+			{
+				diagonalIndex[t] = (int)grown.column.size();
+			}
+			grown.column.push_back(entry.first);
+			grown.value.push_back(coupling * entry.second);
+			grownCoupling.push_back(entry.second);
+		}
+		float& diagonal = grown.value[diagonalIndex[t]];
+		diagonal += 1.0f / (dt * invInertance[t]) + damping[t] / invInertance[t];
+		inverseDiagonal[t] = 1.0f / diagonal;
+	}
+	grown.rowStart[tubes] = (int)grown.column.size();
+	matrix = std::move(grown);
+	couplingValue.swap(grownCoupling);
+	builtInvInertance.insert(builtInvInertance.end(), invInertance + kept, invInertance + tubes);
+	builtDamping.insert(builtDamping.end(), damping + kept, damping + tubes);
+
+	// IC(0) is cheap to redo, and so are the multigrid levels, which need new aggregates for the new rows. The complete factor
+	// grows by the new rows if it is up to date and they are few enough; otherwise it is analysed again, unless it was too large
+	// already.
+	factored = false;
+	aggregated = false;
+	directFactored = directFactored && tubes - kept <= SOLVER_MAX_APPENDED && direct.append(matrix);
+	analysed = analysed && (directFactored || !directUsable);
+	return true;
+}
+
+void ImplicitSolver::assembleVessels(const VesselNetwork& network)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	float dt = assembledDt;
+	float coupling = dt * assembledScale;
+	const float* invInertance = network.tubeInvInertance.data();
+	const float* damping = network.tubeDamping.data();
+
+	// 1 / (L / dt + R) = dt / (L + dt * R), with L = 1 / invInertance and R = damping * L.
+	selfInverse.resize(tubes);
+	for (int t = 0; t < tubes; t++)
+	{
+		selfInverse[t] = dt * invInertance[t] / (1.0f + dt * damping[t]);
+	}
+	vesselRhs.resize(vessels);
+	vesselSolution.resize(vessels);
+	vesselResidual.resize(vessels);
+	vesselPreconditioned.resize(vessels);
+	vesselDirection.resize(vessels);
+	vesselProduct.resize(vessels);
+
+	vesselMatrix.rows = 0;
+	vesselMatrix.rowStart.assign(1, 0);
+	vesselMatrix.column.clear();
+	vesselMatrix.value.clear();
+	if (coupling == 0.0f)
+	{
+		return;
+	}
+
+	// Row v of S: its width / c on the diagonal, and for every tube to another vessel, how easily it lets fluid through on the
+	// diagonal and the same negated towards the other end. A tube that connects a vessel to itself moves nothing, so it adds nothing.
+	const int* start = network.vesselTubeStart.data();
+	const int* list = network.vesselTubes.data();
+	vesselMatrix.rows = vessels;
+	vesselMatrix.rowStart.assign(vessels + 1, 0);
+	std::vector<std::pair<int, float>> row;
+	for (int v = 0; v < vessels; v++)
+	{
+		row.clear();
+		row.emplace_back(v, network.width[v] / coupling);
+		for (int k = start[v]; k < start[v + 1]; k++)
+		{
+			int t = list[k] >> 1;
+			int other = (list[k] & 1) ? network.tubeA[t] : network.tubeB[t];
+			if (other != v)
+			{
+				row.emplace_back(v, selfInverse[t]);
+				row.emplace_back(other, -selfInverse[t]);
+			}
+		}
+		sortAndMerge(row);
+		for (const std::pair<int, float>& entry : row)
+		{
+			vesselMatrix.column.push_back(entry.first);
+			vesselMatrix.value.push_back(entry.second);
+		}
+		vesselMatrix.rowStart[v + 1] = (int)vesselMatrix.column.size();
+	}
+}
+
+void ImplicitSolver::solveVessels(TaskPool* pool)
+{
+	int vessels = vesselMatrix.rows;
+	float* x = vesselSolution.data();
+	float* r = vesselResidual.data();
+	float* z = vesselPreconditioned.data();
+	float* p = vesselDirection.data();
+	float* q = vesselProduct.data();
+
+	std::fill(vesselSolution.begin(), vesselSolution.end(), 0.0f);
+	vesselResidual = vesselRhs;
+	double rhsNorm = std::sqrt(dot(r, r, vessels, pool));
+	if (rhsNorm == 0.0)
+	{
+		return;
+	}
+	multigrid.apply(vesselMatrix, r, z, pool);
+	vesselDirection = vesselPreconditioned;
+	double rz = dot(r, z, vessels, pool);
+	double residualNorm = rhsNorm;
+
+	for (int iteration = 0; iteration < maxIterations && residualNorm > tolerance * rhsNorm; iteration++)
+	{
+		vesselMatrix.multiply(p, q, pool);
+		double curvature = dot(p, q, vessels, pool);
+		if (curvature <= 0.0)
+		{
+			break;
+		}
+		float alpha = (float)(rz / curvature);
+		forBlocks(vessels, pool, [&](int begin, int end)
+		{
+			for (int v = begin; v < end; v++)
+			{
+				x[v] += alpha * p[v];
+				r[v] -= alpha * q[v];
+			}
+		});
+		multigrid.apply(vesselMatrix, r, z, pool);
+
+		double rzNext = dot(r, z, vessels, pool);
+		float beta = (float)(rzNext / rz);
+		rz = rzNext;
+		forBlocks(vessels, pool, [&](int begin, int end)
+		{
+			for (int v = begin; v < end; v++)
+			{
+				p[v] = z[v] + beta * p[v];
+			}
+		});
+		residualNorm = std::sqrt(dot(r, r, vessels, pool));
+		lastVesselIterations++;
+	}
+}
+
+bool ImplicitSolver::updateTubes(const VesselNetwork& network)
+{
+	int tubes = matrix.rows;
+	const float* invInertance = network.tubeInvInertance.data();
+	const float* damping = network.tubeDamping.data();
+	std::vector<int> changed;
+	for (int t = 0; t < tubes; t++)
+	{
+		if (invInertance[t] != builtInvInertance[t] || damping[t] != builtDamping[t])
+		{
+			changed.push_back(t);
+			if ((int)changed.size() > SOLVER_MAX_UPDATES)
+			{
+				return false;
+			}
+		}
+	}
+
+	float dt = assembledDt;
+	float coupling = dt * assembledScale;
+	for (int t : changed)
+	{
+		int diagonal = diagonalIndex[t];
+		float value = coupling * couplingValue[diagonal] + 1.0f / (dt * invInertance[t]) + damping[t] / invInertance[t];
+		double change = (double)value - matrix.value[diagonal];
+		matrix.value[diagonal] = value;
+		inverseDiagonal[t] = 1.0f / value;
+		builtInvInertance[t] = invInertance[t];
+		builtDamping[t] = damping[t];
+		directFactored = directFactored && direct.updateDiagonal(t, change);
+	}
+	factored = factored && changed.empty();
+	multigridCurrent = multigridCurrent && changed.empty();
+	return true;
+}
+
+void ImplicitSolver::precondition(const VesselNetwork& network, const float* r, float* z, TaskPool* pool)
+{
+	if (preconditioner == PRECONDITIONER_DIRECT)
+	{
+		if (!analysed)
+		{
+			directUsable = direct.analyse(matrix);
+			analysed = true;
+			directFactored = false;
+		}
+		if (directUsable && !directFactored)
+		{
+			directUsable = direct.factor(matrix);
+			directFactored = directUsable;
+		}
+		lastDirect = directUsable;
+		if (directUsable)
+		{
+			direct.apply(r, z);
+			return;
+		}
+	}
+
+	if (preconditioner == PRECONDITIONER_MULTIGRID)
+	{
+		if (!aggregated || !multigridCurrent)
+		{
+			assembleVessels(network);
+			if (vesselMatrix.rows > 0 && !aggregated)
+			{
+				multigrid.setup(vesselMatrix, pool);
+			}
+			else if (vesselMatrix.rows > 0)
+			{
+				multigrid.refresh(vesselMatrix, pool);
+			}
+			aggregated = vesselMatrix.rows > 0;
+			multigridCurrent = true;
+		}
+
+		// z = D^-1 (r - G^T y) with S y = G D^-1 r. G D^-1 r is gathered by every vessel from its own tubes.
+		int tubes = matrix.rows;
+		int vessels = network.vesselCount();
+		const int* start = network.vesselTubeStart.data();
+		const int* list = network.vesselTubes.data();
+		const int* tubeA = network.tubeA.data();
+		const int* tubeB = network.tubeB.data();
+		const float* inverse = selfInverse.data();
+		float* y = vesselSolution.data();
+		if (vesselMatrix.rows == 0)
+		{
+			std::fill(vesselSolution.begin(), vesselSolution.end(), 0.0f);
+		}
+		else
+		{
+			forBlocks(vessels, pool, [&](int begin, int end)
+			{
+				for (int v = begin; v < end; v++)
+				{
+					float sum = 0.0f;
+					for (int k = start[v]; k < start[v + 1]; k++)
+					{
+						int t = list[k] >> 1;
+						sum += (list[k] & 1) ? -inverse[t] * r[t] : inverse[t] * r[t];
+					}
+					vesselRhs[v] = sum;
+				}
+			});
+			solveVessels(pool);
+		}
+		forBlocks(tubes, pool, [&](int begin, int end)
+		{
+			for (int t = begin; t < end; t++)
+			{
+				z[t] = inverse[t] * (r[t] - (y[tubeA[t]] - y[tubeB[t]]));
+			}
+		});
+		return;
+	}
+
+	if (preconditioner != PRECONDITIONER_JACOBI)
+	{
+		if (!factored)
+		{
+			cholesky.factor(matrix);
+			factored = true;
+		}
+		cholesky.apply(r, z);
+		return;
+	}
+
+	forBlocks(matrix.rows, pool, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			z[t] = r[t] * inverseDiagonal[t];
+		}
+	});
+}
+
+void ImplicitSolver::solve(const VesselNetwork& network, const float* difference, float dt, float scale, float* flow, TaskPool* pool)
+{
+	int tubes = network.tubeCount();
+	residual.resize(tubes);
+	preconditioned.resize(tubes);
+	direction.resize(tubes);
+	product.resize(tubes);
+
+	const float* invInertance = network.tubeInvInertance.data();
+	const float* damping = network.tubeDamping.data();
+
+	// After a rebuild that kept the old tubes, their inertance and damping are checked too, since whatever rebuilt the network may
+	// have loaded new ones.
+	bool checkTubes = network.tubeVersion != assembledTubeVersion;
+	if (assembledVersion != network.topologyVersion)
+	{
+		checkTubes = true;
+		if (!extend(network))
+		{
+			assemble(network);
+		}
+	}
+
+	// Since L = 1 / invInertance and R = damping * L, both sides are kept as they are instead of scaled by invInertance,
+	// which keeps the matrix symmetric.
+	if (dt != assembledDt || scale != assembledScale || (checkTubes && !updateTubes(network)))
+	{
+		inverseDiagonal.resize(tubes);
+		float coupling = dt * scale;
+		forBlocks(tubes, pool, [&](int begin, int end)
+		{
+			for (int t = begin; t < end; t++)
+			{
+				for (int k = matrix.rowStart[t]; k < matrix.rowStart[t + 1]; k++)
+				{
+					matrix.value[k] = coupling * couplingValue[k];
+				}
+				int diagonal = diagonalIndex[t];
+				matrix.value[diagonal] += 1.0f / (dt * invInertance[t]) + damping[t] / invInertance[t];
+				inverseDiagonal[t] = 1.0f / matrix.value[diagonal];
+			}
+		});
+		builtInvInertance.assign(invInertance, invInertance + tubes);
+		builtDamping.assign(damping, damping + tubes);
+		assembledDt = dt;
+		assembledScale = scale;
+		factored = false;
+		directFactored = false;
+		multigridCurrent = false;
+	}
+	assembledTubeVersion = network.tubeVersion;
+
+	// The right hand side goes into residual first.
+	forBlocks(tubes, pool, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			residual[t] = flow[t] / (dt * invInertance[t]) + difference[t];
+		}
+	});
+
+	double rhsNorm = std::sqrt(dot(residual.data(), residual.data(), tubes, pool));
+	lastIterations = 0;
+	lastResidual = 0.0f;
+	lastVesselIterations = 0;
+	if (rhsNorm == 0.0)
+	{
+		forBlocks(tubes, pool, [&](int begin, int end)
+		{
+			for (int t = begin; t < end; t++)
+			{
+				flow[t] = 0.0f;
+			}
+		});
+		return;
+	}
+
+	// r = b - A x, starting from the flows of the last step.
+	matrix.multiply(flow, product.data(), pool);
+	forBlocks(tubes, pool, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			residual[t] -= product[t];
+		}
+	});
+	precondition(network, residual.data(), preconditioned.data(), pool);
+	direction = preconditioned;
+
+	double rz = dot(residual.data(), preconditioned.data(), tubes, pool);
+	double residualNorm = std::sqrt(dot(residual.data(), residual.data(), tubes, pool));
+
+	while (lastIterations < maxIterations && residualNorm > tolerance * rhsNorm)
+	{
+		matrix.multiply(direction.data(), product.data(), pool);
+		double curvature = dot(direction.data(), product.data(), tubes, pool);
+		if (curvature <= 0.0)
+		{
+			// Only possible through rounding once the residual is tiny; the current flows are as good as it gets.
+			break;
+		}
+		float alpha = (float)(rz / curvature);
+
+		forBlocks(tubes, pool, [&](int begin, int end)
+		{
+			for (int t = begin; t < end; t++)
+			{
+				flow[t] += alpha * direction[t];
+				residual[t] -= alpha * product[t];
+			}
+		});
+		precondition(network, residual.data(), preconditioned.data(), pool);
+
+		double rzNext = dot(residual.data(), preconditioned.data(), tubes, pool);
+		float beta = (float)(rzNext / rz);
+		rz = rzNext;
+
+		forBlocks(tubes, pool, [&](int begin, int end)
+		{
+			for (int t = begin; t < end; t++)
+			{
+				direction[t] = preconditioned[t] + beta * direction[t];
+			}
+		});
+
+		residualNorm = std::sqrt(dot(residual.data(), residual.data(), tubes, pool));
+		lastIterations++;
+	}
+
+	lastResidual = (float)(residualNorm / rhsNorm);
+}
@@ -0,0 +1,193 @@
+/*
+Title: HydroDynamics
+File Name: ImplicitSolver.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Solves for the flow through every tube of a network at the end of a step (backward Euler
+over the whole network at once).
+
+The default step treats every tube on its own: a tube sees how its own flow changes the
+pressure difference it is pushing against, but not how the flows of neighbouring tubes
+do. That is exact for the classic apparatus, but in a network where narrow vessels are
+shared by several tubes, the tubes all push the same vessel at once and large steps make
+them overshoot. The implicit step takes every tube into account together. The new flows q
+of all tubes satisfy
+
+    (L / dt + R) q + dt * density * gravity * K q = (L / dt) q_old + dp
+
+where L is the inertance and R the friction of each tube, dp the pressure differences at
+the start of the step, and K = G^T W^-1 G. G maps tube flows to the vessels they fill,
+and W holds the widths of the vessels. The matrix is symmetric and positive definite, so
+it is solved with the conjugate gradient method. The previous step's flows are the first
+guess, which is usually very close.
+
+The matrix is stored in CSR form (see SparseMatrix.h). Two tubes are coupled when they
+share a vessel, so every row has an entry for the tube itself and one for every other
+tube at either of its ends. The pattern and the values of K are built once per topology;
+the matrix itself only changes when the step size, density * gravity or the inertance or
+damping of a tube does. The conjugate gradient method is preconditioned either by the
+diagonal of the matrix, which is cheap and runs on every core, by an incomplete Cholesky
+factorization, which needs far fewer iterations on large stiff networks but applies it on
+one thread, by algebraic multigrid, which keeps the iterations about as few as the network
+grows and runs on every core, or by the complete factorization, which solves the system
+outright.
+
+Multigrid doesn't work on the matrix of the tubes itself: how two tubes couple depends on
+which way round they happen to be, and the flows it can hardly tell apart are the ones that
+go round in loops, which no grouping of tubes describes. It works on the vessels instead.
+With D the diagonal the tubes have on their own (L / dt + R) and c = dt * density * gravity,
+
+    A^-1 = D^-1 - D^-1 G^T S^-1 G D^-1, with S = W / c + G D^-1 G^T
+
+and S is a graph Laplacian over the vessels, weighted by how easily every tube lets fluid
+through, plus the widths on its diagonal: just what smoothed aggregation is made for (see
+AlgebraicMultigrid.h). The preconditioner is that formula, with S^-1 worked out by the
+conjugate gradient method over the vessels, preconditioned by a V-cycle, to the same
+tolerance as the solve. One V-cycle alone is not enough: whatever it leaves of the error
+grows with how stiff the tube is, and the stiff tubes are why the step is implicit. With the
+inner solve, the iterations over the tubes stay at one or two, and those over the vessels
+hardly grow with the size of the network.
+
+The complete factorization pays off on mid-size networks that keep their topology. Its
+elimination order and pattern are worked out once per topology, the numbers only again when
+the matrix changes, and every other step only does the two substitutions, after which the
+conjugate gradient method has nothing left to do but check. When the factor would be too
+large the solve goes on with the incomplete factorization instead.
+
+Editing the network while it runs doesn't start all of that over. The solver keeps the ends
+of the tubes and the widths of the vessels it built the matrix for, and when a rebuild only
+added vessels and tubes after them, it adds the rows of the new tubes to the matrix and to
+the factor (see SparseCholesky::append()). A valve or pump that changes the inertance of a
+few tubes only changes their diagonal entries, which the factor takes in as rank one
+updates. Either way the cost follows the size of the change rather than of the network.
+*/
+
+#ifndef _IMPLICIT_SOLVER_H
+#define _IMPLICIT_SOLVER_H
+
+#include <vector>
+#include "SparseMatrix.h"
+#include "AlgebraicMultigrid.h"
+
+struct VesselNetwork;
+class TaskPool;
+
+enum SolverPreconditioner
+{
+	PRECONDITIONER_JACOBI = 0,				// The diagonal of the matrix
+	PRECONDITIONER_INCOMPLETE_CHOLESKY,		// IC(0), see SparseMatrix.h
+	PRECONDITIONER_DIRECT,					// The complete Cholesky factorization, so the first iteration solves the system
+	PRECONDITIONER_MULTIGRID				// A V-cycle of smoothed aggregation multigrid over the vessels, see above
+};
+
+class ImplicitSolver
+{
+public:
+	SolverPreconditioner preconditioner = PRECONDITIONER_JACOBI;
+
+	// The solve stops once the residual is this much smaller than the right hand side, or after maxIterations.
+	float tolerance = 1e-6f;
+	int maxIterations = 200;
+
+	// What the last solve did, for the profiler and for tuning.
+	int lastIterations = 0;
+	float lastResidual = 0.0f;
+	bool lastDirect = false;	// Whether PRECONDITIONER_DIRECT got its factorization, or fell back to IC(0)
+	int lastVesselIterations = 0;	// With PRECONDITIONER_MULTIGRID, the iterations over the vessels, all of the solve's together
+
+	// Solves for the new flow of every tube. difference holds the pressure difference (B minus A) of every tube at the start of
+	// the step and scale is density * gravity. flow holds the flows of the last step on entry and the new flows on return.
+	// If a pool is given and the network is large enough, the work is spread across every core. The result is the same either way.
+	void solve(const VesselNetwork& network, const float* difference, float dt, float scale, float* flow, TaskPool* pool);
+
+private:
+	// Builds the pattern of the matrix and the values of K for the current topology of the network.
+	void assemble(const VesselNetwork& network);
+
+	// Catches up with a rebuild that only added vessels and tubes to the network the matrix was built for. Returns false, and
+	// changes nothing, if anything else changed.
+	bool extend(const VesselNetwork& network);
+
+	// Takes in the tubes whose inertance or damping changed since the matrix was filled in, one by one. Returns false, and changes
+	// nothing, if there are too many for that to be worth it.
+	bool updateTubes(const VesselNetwork& network);
+
+	// z = M^-1 r, where M is the preconditioner.
+	void precondition(const VesselNetwork& network, const float* r, float* z, TaskPool* pool);
+
+	// Fills in S and D^-1 of the multigrid preconditioner for the current values.
+	void assembleVessels(const VesselNetwork& network);
+
+	// Solves S vesselSolution = vesselRhs, preconditioned by the V-cycle.
+	void solveVessels(TaskPool* pool);
+
+	// The sum of a[i] * b[i]. Always added up in the same blocks and the same order, so it doesn't depend on the threads.
+	double dot(const float* a, const float* b, int count, TaskPool* pool);
+
+	// A = diag(L / dt + R) + dt * density * gravity * K. matrix holds A, and couplingValue the values of K over the same pattern.
+	SparseMatrix matrix;
+	std::vector<float> couplingValue;
+	std::vector<int> diagonalIndex;		// Per tube: where its diagonal entry is in matrix.value
+	IncompleteCholesky cholesky;
+	SparseCholesky direct;
+	AlgebraicMultigrid multigrid;
+	SparseMatrix vesselMatrix;				// S, see above. No rows if c is 0, where D^-1 is all there is to A^-1.
+	std::vector<float> selfInverse;			// Per tube: 1 / the diagonal of D
+	std::vector<float> vesselRhs;			// Per vessel: G D^-1 r, S^-1 of that, and the vectors of the conjugate gradient method
+	std::vector<float> vesselSolution;
+	std::vector<float> vesselResidual;
+	std::vector<float> vesselPreconditioned;
+	std::vector<float> vesselDirection;
+	std::vector<float> vesselProduct;
+
+	// What the matrix was last built for. It is rebuilt when any of them changes.
+	int assembledVersion = -1;
+	int assembledTubeVersion = -1;
+	float assembledDt = 0.0f;
+	float assembledScale = 0.0f;
+	bool factored = false;			// Whether cholesky is up to date
+	bool analysed = false;			// Whether direct has been analysed for the pattern, and directUsable whether it fit
+	bool directUsable = false;
+	bool directFactored = false;	// Whether direct is up to date
+	bool aggregated = false;		// Whether multigrid has its levels for the pattern, and multigridCurrent whether for the values
+	bool multigridCurrent = false;
+
+	// What the matrix was built for: the ends of every tube, the width of every vessel, and the inertance and damping of every tube.
+	std::vector<int> builtA;
+	std::vector<int> builtB;
+	std::vector<float> builtWidth;
+	std::vector<float> builtInvInertance;
+	std::vector<float> builtDamping;
+
+	// Per tube
+	std::vector<float> inverseDiagonal;	// 1 / (the diagonal of A), the Jacobi preconditioner
+	std::vector<float> residual;
+	std::vector<float> preconditioned;
+	std::vector<float> direction;
+	std::vector<float> product;
+
+	// Partial sums of dot(), one per block.
+	std::vector<double> blockSums;
+};
+
+#endif // _IMPLICIT_SOLVER_H
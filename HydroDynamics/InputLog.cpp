@@ -0,0 +1,192 @@
+/*
+Title: HydroDynamics
+File Name: InputLog.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A log of the operator's input, stamped with the physics step it took effect on.
+
+Keys don't change the simulation directly. They queue an InputCommand, which the next
+physics step applies before stepping. The step number is the only clock involved, so
+replaying a log applies exactly the same commands before exactly the same steps. A replay
+(windowed or headless) gives bit for bit the same result as the session that recorded it,
+no matter how fast either of them ran.
+
+Commands come from the keys, or from test automation and other controllers through the
+remote control (see RemoteControl.h), which sends them as they are written in the log.
+
+The file is plain text, one event per line: the step, then the name of the command and its
+arguments, if it has any. Lines starting with # are comments.
+*/
+
+#include "InputLog.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// The names used in the file, indexed by InputCommand, and the arguments that follow them: a vessel, a value or both. The piston
+// commands have a value that can be left out.
+static const char* commandNames[INPUT_COMMAND_COUNT] = { "pressure+", "pressure-", "pressure", "external", "fill", "rewind" };
+static const bool commandVessel[INPUT_COMMAND_COUNT] = { false, false, false, true, true, false };
+static const bool commandValue[INPUT_COMMAND_COUNT] = { false, false, true, true, true, true };
+static const bool commandStep[INPUT_COMMAND_COUNT] = { true, true, false, false, false, false };
+
+bool parseInputCommand(const std::string& text, InputEvent& event)
+{
+	std::istringstream fields(text);
+	std::string name;
+	if (!(fields >> name))
+	{
+		return false;
+	}
+	for (int c = 0; c < INPUT_COMMAND_COUNT; c++)
+	{
+		if (name != commandNames[c])
+		{
+			continue;
+		}
+		event.command = (InputCommand)c;
+		event.vessel = -1;
+		event.value = 0.0f;
+		if ((commandVessel[c] && !(fields >> event.vessel)) || (commandValue[c] && !(fields >> event.value)))
+		{
+			return false;
+		}
+		if (commandStep[c] && !(fields >> event.value))
+		{
+			if (!fields.eof())
+			{
+				return false;
+			}
+			event.value = INPUT_PRESSURE_STEP;
+		}
+		std::string rest;
+		return !(fields >> rest);
+	}
+	return false;
+}
+
+std::string formatInputCommand(const InputEvent& event)
+{
+	std::ostringstream text;
+	text << commandNames[event.command];
+	if (commandVessel[event.command])
+	{
+		text << " " << event.vessel;
+	}
+	if (commandValue[event.command] || (commandStep[event.command] && event.value != INPUT_PRESSURE_STEP))
+	{
+		// Enough digits that the value reads back the same, so a replay sets exactly what was recorded.
+		text << " " << std::setprecision(9) << event.value;
+	}
+	return text.str();
+}
+
+void InputLog::add(long long step, InputCommand command, int vessel, float value)
+{
+	InputEvent event;
+	event.step = step;
+	event.command = command;
+	event.vessel = vessel;
+	event.value = value;
+	events.push_back(event);
+}
+
+bool InputLog::next(long long step, InputEvent& event)
+{
+	// Events of steps that were skipped (for example by restoring a later checkpoint) are dropped.
+	while (replayed < events.size() && events[replayed].step < step)
+	{
+		replayed++;
+	}
+
+	if (replayed < events.size() && events[replayed].step == step)
+	{
+		event = events[replayed++];
+		return true;
+	}
+	return false;
+}
+
+void InputLog::truncate(long long step)
+{
+	while (!events.empty() && events.back().step >= step)
+	{
+		events.pop_back();
+	}
+	replayed = std::min(replayed, events.size());
+}
+
+bool InputLog::write(const std::string& fileName) const
+{
+	std::ofstream file(fileName, std::ios::out);
+	if (!file.good())
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		return false;
+	}
+
+	file << "# HydroDynamics input log: step command" << std::endl;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		file << events[i].step << " " << formatInputCommand(events[i]) << "\n";
+	}
+	return file.good();
+}
+
+bool InputLog::read(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<InputEvent> loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		InputEvent event;
+		std::string command;
+		bool valid = fields >> event.step && std::getline(fields, command) && parseInputCommand(command, event);
+		if (!valid || (!loaded.empty() && event.step < loaded.back().step))
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a valid event: " << line << std::endl;
+			return false;
+		}
+		loaded.push_back(event);
+	}
+
+	events.swap(loaded);
+	replayed = 0;
+	return true;
+}
@@ -0,0 +1,117 @@
+/*
+Title: HydroDynamics
+File Name: InputLog.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A log of the operator's input, stamped with the physics step it took effect on.
+
+Keys don't change the simulation directly. They queue an InputCommand, which the next
+physics step applies before stepping. The step number is the only clock involved, so
+replaying a log applies exactly the same commands before exactly the same steps. A replay
+(windowed or headless) gives bit for bit the same result as the session that recorded it,
+no matter how fast either of them ran.
+
+Commands come from the keys, or from test automation and other controllers through the
+remote control (see RemoteControl.h), which sends them as they are written in the log.
+
+The file is plain text, one event per line: the step, then the name of the command and its
+arguments, if it has any. Lines starting with # are comments. The piston keys push by the
+pressure step of the settings (see Settings.h); since that can change while the program
+runs, a step other than INPUT_PRESSURE_STEP is written after the command, "pressure+ 0.5",
+so a replay pushes exactly as hard.
+*/
+
+#ifndef _INPUT_LOG_H
+#define _INPUT_LOG_H
+
+#include <string>
+#include <vector>
+
+// How far pressure+ and pressure- push when they don't say.
+#define INPUT_PRESSURE_STEP 0.1f
+
+enum InputCommand
+{
+	INPUT_PRESSURE_UP = 0,		// Push harder on the piston, by value
+	INPUT_PRESSURE_DOWN,		// Pull back on the piston, by value
+	INPUT_SET_PRESSURE,			// Push on the piston with value
+	INPUT_SET_EXTERNAL,			// Push on the surface of vessel with value (the piston pushes on its own vessel itself)
+	INPUT_ADD_FLUID,			// Add value meters of fluid to vessel (or take them out, if negative)
+	INPUT_REWIND,				// Go back value steps in the history of the session (see RewindHistory.h). Never recorded: a recording
+								// forgets the steps that were gone back over instead, so it replays what the session ended up doing.
+	INPUT_COMMAND_COUNT
+};
+
+struct InputEvent
+{
+	long long step;			// The command is applied right before this step runs
+	InputCommand command;
+	int vessel = -1;		// The arguments, for the commands that have them
+	float value = 0.0f;
+};
+
+// A command on its way from the keyboard or the remote control to the simulation, with the time (in seconds) it was sent.
+// The time is only used to measure input latency; when the command is applied is decided by the step alone.
+struct QueuedInput
+{
+	InputCommand command;
+	int vessel;
+	float value;
+	double time;
+	long long step;		// The step a remote controller meant the command for, or -1 for the next one
+};
+
+// Reads a command written as it is in the log, without the step: "pressure+", "pressure 1.5" or "fill 3 0.2". Returns false if
+// it isn't one. The step of the event is left alone.
+bool parseInputCommand(const std::string& text, InputEvent& event);
+
+// Writes the command of event the way parseInputCommand() reads it, with enough digits that its value reads back the same.
+std::string formatInputCommand(const InputEvent& event);
+
+class InputLog
+{
+public:
+	// Adds an event. Events have to be added in the order of their steps.
+	void add(long long step, InputCommand command, int vessel = -1, float value = 0.0f);
+
+	// Returns the events of the given step, one per call, in the order they were recorded, then false once there are no more.
+	// Steps have to be asked for in increasing order, as a replay does.
+	bool next(long long step, InputEvent& event);
+
+	// Forgets the events from step on.
+	void truncate(long long step);
+
+	bool write(const std::string& fileName) const;
+
+	// Replaces the log with the events in the file. Returns false (after printing an error) if the file can't be read or
+	// contains something that isn't an event.
+	bool read(const std::string& fileName);
+
+	size_t size() const { return events.size(); }
+
+private:
+	std::vector<InputEvent> events;
+	size_t replayed = 0;
+};
+
+#endif // _INPUT_LOG_H
@@ -0,0 +1,174 @@
+/*
+Title: HydroDynamics
+File Name: LatencyMeter.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Measures how long it takes from a key press until its effect is on screen. The key
+press is stamped with glfwGetTime() when key_callback() gets it, and travels with the
+command to the simulation thread. The step that applies it is published in a snapshot,
+and the first frame drawn from that snapshot reports it back here, right after the swap.
+
+That gives two delays for every key press. The first is until the frame that shows it was
+handed to the driver. The second is until the GPU actually finished drawing it. For that
+a fence and a GL_TIMESTAMP query are put behind the frame. updateLatencyMeter() checks the
+fence without waiting, and once it has passed, the query says when the GPU got there,
+which is turned into glfwGetTime() seconds with the offset between the two clocks taken at
+init. When the screen shows the frame after that depends on the present mode and the display,
+which OpenGL can't see.
+
+A key press can also wait before key_callback() gets it at all: GLFW only hands events
+over while the window thread polls or waits for them, and the stamp is taken after that. So
+the times between two reads of the events are measured too. A key press that comes in
+between waits up to that long unseen.
+
+All of them are traced as counters, and reportLatency() prints their distributions.
+*/
+
+#include "LatencyMeter.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+
+struct LatencyFrame
+{
+	GLsync fence = nullptr;
+	GLuint query = 0;
+	std::vector<double> inputTimes;
+};
+
+static LatencyFrame frames[LATENCY_FRAMES];
+static double gpuClockOffset = 0.0;			// glfwGetTime() minus the GPU timestamp, in seconds
+static std::vector<double> presentedDelays;	// In milliseconds
+static std::vector<double> completedDelays;
+static std::vector<double> unreadTimes;
+static int skippedFrames = 0;
+
+void initLatencyMeter()
+{
+	for (int i = 0; i < LATENCY_FRAMES; i++)
+	{
+		glGenQueries(1, &frames[i].query);
+	}
+
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	gpuClockOffset = glfwGetTime() - gpuTime / 1e9;
+}
+
+void latencyFramePresented(const std::vector<double>& inputTimes)
+{
+	if (inputTimes.empty())
+	{
+		return;
+	}
+
+	double now = glfwGetTime();
+	for (double time : inputTimes)
+	{
+		presentedDelays.push_back((now - time) * 1000.0);
+		traceCounter("input to present ms", presentedDelays.back());
+	}
+
+	for (int i = 0; i < LATENCY_FRAMES; i++)
+	{
+		LatencyFrame& frame = frames[i];
+		if (frame.fence == nullptr)
+		{
+			glQueryCounter(frame.query, GL_TIMESTAMP);
+			frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			frame.inputTimes = inputTimes;
+			return;
+		}
+	}
+	skippedFrames++;
+}
+
+void latencyEventsRead(double unreadSeconds)
+{
+	unreadTimes.push_back(unreadSeconds * 1000.0);
+	traceCounter("events unread ms", unreadTimes.back());
+}
+
+void updateLatencyMeter()
+{
+	for (int i = 0; i < LATENCY_FRAMES; i++)
+	{
+		LatencyFrame& frame = frames[i];
+		if (frame.fence == nullptr || glClientWaitSync(frame.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			continue;
+		}
+
+		// The fence comes after the query, so its result is there by now.
+		GLuint64 gpuTime = 0;
+		glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpuTime);
+		double completed = gpuTime / 1e9 + gpuClockOffset;
+		for (double time : frame.inputTimes)
+		{
+			completedDelays.push_back((completed - time) * 1000.0);
+			traceCounter("input to GPU done ms", completedDelays.back());
+		}
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+	}
+}
+
+// Prints one distribution of samples, what says what they are of. Sorts the samples.
+static void reportDelays(std::ostream& out, const char* name, std::vector<double>& delays, const char* what = "key presses")
+{
+	std::sort(delays.begin(), delays.end());
+	size_t last = delays.size() - 1;
+	out << "  " << name << ": " << delays.size() << " " << what << ", median " << delays[last / 2] << " ms, 90% " << delays[last * 9 / 10]
+		<< " ms, 99% " << delays[last * 99 / 100] << " ms, max " << delays[last] << " ms" << std::endl;
+}
+
+void reportLatency(std::ostream& out)
+{
+	if (presentedDelays.empty())
+	{
+		return;
+	}
+
+	out << "Input latency:" << std::endl;
+	reportDelays(out, "until presented", presentedDelays);
+	if (!completedDelays.empty())
+	{
+		reportDelays(out, "until drawn by the GPU", completedDelays);
+	}
+	if (!unreadTimes.empty())
+	{
+		reportDelays(out, "events unread before a read", unreadTimes, "reads");
+	}
+	if (skippedFrames > 0)
+	{
+		out << "  " << skippedFrames << " frames weren't followed to the GPU, since " << LATENCY_FRAMES << " were already waiting." << std::endl;
+	}
+}
+
+void destroyLatencyMeter()
+{
+	for (int i = 0; i < LATENCY_FRAMES; i++)
+	{
+		glDeleteSync(frames[i].fence);
+		glDeleteQueries(1, &frames[i].query);
+		frames[i].fence = nullptr;
+	}
+}
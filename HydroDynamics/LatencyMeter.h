@@ -0,0 +1,74 @@
+/*
+Title: HydroDynamics
+File Name: LatencyMeter.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Measures how long it takes from a key press until its effect is on screen. The key
+press is stamped with glfwGetTime() when key_callback() gets it, and travels with the
+command to the simulation thread. The step that applies it is published in a snapshot,
+and the first frame drawn from that snapshot reports it back here, right after the swap.
+
+That gives two delays for every key press. The first is until the frame that shows it was
+handed to the driver. The second is until the GPU actually finished drawing it. For that
+a fence and a GL_TIMESTAMP query are put behind the frame. updateLatencyMeter() checks the
+fence without waiting, and once it has passed, the query says when the GPU got there,
+which is turned into glfwGetTime() seconds with the offset between the two clocks taken at
+init. When the screen shows the frame after that depends on the present mode and the display,
+which OpenGL can't see.
+
+A key press can also wait before key_callback() gets it at all: GLFW only hands events
+over while the window thread polls or waits for them, and the stamp is taken after that. So
+the times between two reads of the events are measured too. A key press that comes in
+between waits up to that long unseen.
+
+All of them are traced as counters, and reportLatency() prints their distributions.
+*/
+
+#ifndef _LATENCY_METER_H
+#define _LATENCY_METER_H
+
+#include "GLIncludes.h"
+#include <iostream>
+#include <vector>
+
+// How many frames can be waiting for the GPU at once. Frames beyond that aren't measured.
+#define LATENCY_FRAMES 8
+
+// Creates the queries and measures the offset between the clocks of the GPU and of glfwGetTime(). Needs a current OpenGL context.
+void initLatencyMeter();
+
+// Call right after the swap of a frame that is the first to show the key presses made at inputTimes.
+void latencyFramePresented(const std::vector<double>& inputTimes);
+
+// Call before every read of the window events, with how long ago the last read ended.
+void latencyEventsRead(double unreadSeconds);
+
+// Records the frames the GPU has finished since the last call. Never waits. Call once per frame.
+void updateLatencyMeter();
+
+// Prints the number, median, 90th and 99th percentile and maximum of the delays, if anything was measured.
+void reportLatency(std::ostream& out);
+
+// Frees the queries and fences.
+void destroyLatencyMeter();
+
+#endif // _LATENCY_METER_H
@@ -0,0 +1,106 @@
+/*
+Title: HydroDynamics
+File Name: LevelComponents.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The components that come with the program, as examples of what a plugin looks like (see
+ComponentPlugins.h). Nothing else refers to them: the registrations at the bottom are all
+that makes them available to --component.
+
+level-sensor (no settings) keeps the lowest, highest and mean level of its vessel over the
+run, and reports them at the end.
+
+level-controller TARGET GAIN holds the level of its vessel near TARGET (a height above its
+floor) by pushing on the surface with GAIN times how far the level is above the target,
+and not at all while it is below. It replaces the external pressure of the vessel, so on
+the vessel of the piston it takes over from the piston.
+*/
+
+#include "ComponentPlugins.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <iostream>
+
+// The classes are final, so the calls inside their loops are direct.
+class LevelSensor final : public ComponentPlugin
+{
+public:
+	int settingCount() const override { return 0; }
+	int stateCount() const override { return 4; }	// Lowest, highest, sum of the levels, and how many were taken
+
+	void afterStep(const VesselNetwork& network, const ComponentBatch& batch, float) override
+	{
+		const float* height = network.height.data();
+		for (int i = 0; i < batch.count; i++)
+		{
+			if (batch.vessel[i] < 0)
+			{
+				continue;
+			}
+			float level = height[batch.vessel[i]];
+			float* state = batch.state + i * 4;
+			state[0] = state[3] > 0.0f ? std::min(state[0], level) : level;
+			state[1] = state[3] > 0.0f ? std::max(state[1], level) : level;
+			state[2] += level;
+			state[3] += 1.0f;
+		}
+	}
+
+	void report(std::ostream& out, const VesselNetwork&, const ComponentBatch& batch) override
+	{
+		for (int i = 0; i < batch.count; i++)
+		{
+			const float* state = batch.state + i * 4;
+			if (batch.vessel[i] < 0 || state[3] == 0.0f)
+			{
+				continue;
+			}
+			out << "Level of vessel " << batch.vessel[i] << ": lowest " << state[0] << ", highest " << state[1] << ", mean "
+				<< state[2] / state[3] << " over " << state[3] << " steps" << std::endl;
+		}
+	}
+};
+
+class LevelController final : public ComponentPlugin
+{
+public:
+	int settingCount() const override { return 2; }	// The target level, and the pressure per unit it is above
+	int stateCount() const override { return 0; }
+
+	void beforeStep(VesselNetwork& network, const ComponentBatch& batch, float) override
+	{
+		for (int i = 0; i < batch.count; i++)
+		{
+			int vessel = batch.vessel[i];
+			if (vessel < 0)
+			{
+				continue;
+			}
+			const float* settings = batch.settings + i * 2;
+			network.setExternalPressure(vessel, std::max(settings[1] * (network.height[vessel] - settings[0]), 0.0f));
+		}
+	}
+};
+
+static ComponentRegistration<LevelSensor> levelSensor("level-sensor");
+static ComponentRegistration<LevelController> levelController("level-controller");
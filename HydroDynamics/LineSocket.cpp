@@ -0,0 +1,428 @@
+/*
+Title: HydroDynamics
+File Name: LineSocket.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The smallest TCP connection that gets the job done: it sends and receives whole lines of
+text, which is all the sweep workers and their coordinator (see SweepCluster.h) say to each
+other. Winsock on Windows, BSD sockets everywhere else.
+
+The state stream (see StateStream.h) sends bytes instead of lines. Its server can't wait for
+any one client, so it switches its connections to non-blocking and sends what each of them
+takes with sendSome(). The remote control (see RemoteControl.h) and the lockstep sessions
+(see Lockstep.h) read their connections the same way, with pollLine().
+*/
+
+#include "LineSocket.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET NativeSocket;
+#define closeSocket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <unistd.h>
+typedef int NativeSocket;
+#define closeSocket ::close
+#endif
+
+// Writing to a connection the other end has closed raises SIGPIPE on Linux unless the send says not to.
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// Winsock has to be started once before any socket is used. It stays up until the program exits.
+static bool startSockets()
+{
+#ifdef _WIN32
+	static bool started = false;
+	if (!started)
+	{
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		if (!started)
+		{
+			std::cout << "Can't start Winsock." << std::endl;
+		}
+	}
+	return started;
+#else
+	return true;
+#endif
+}
+
+static NativeSocket native(std::intptr_t handle)
+{
+	return (NativeSocket)handle;
+}
+
+LineConnection::~LineConnection()
+{
+	close();
+}
+
+bool LineConnection::connect(const std::string& host, int port)
+{
+	close();
+	if (!startSockets())
+	{
+		return false;
+	}
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+	{
+		std::cout << "Can't find host: " << host << std::endl;
+		return false;
+	}
+
+	for (addrinfo* address = addresses; address != nullptr && handle == -1; address = address->ai_next)
+	{
+		NativeSocket socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if ((std::intptr_t)socket == -1)
+		{
+			continue;
+		}
+		if (::connect(socket, address->ai_addr, (int)address->ai_addrlen) != 0)
+		{
+			closeSocket(socket);
+			continue;
+		}
+		handle = (std::intptr_t)socket;
+	}
+	freeaddrinfo(addresses);
+
+	if (handle == -1)
+	{
+		std::cout << "Can't connect to " << host << ":" << port << std::endl;
+		return false;
+	}
+	received.clear();
+	return true;
+}
+
+bool LineConnection::sendLine(const std::string& line)
+{
+	if (handle == -1)
+	{
+		return false;
+	}
+
+	std::string message = line + "\n";
+	size_t sent = 0;
+	while (sent < message.size())
+	{
+		int count = (int)::send(native(handle), message.data() + sent, (int)(message.size() - sent), SEND_FLAGS);
+		if (count <= 0)
+		{
+			close();
+			return false;
+		}
+		sent += count;
+	}
+	return true;
+}
+
+// Moves the first whole line out of what was received, if there is one.
+bool LineConnection::takeLine(std::string& line)
+{
+	size_t end = received.find('\n');
+	if (end == std::string::npos)
+	{
+		return false;
+	}
+	line = received.substr(0, end);
+	received.erase(0, end + 1);
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.pop_back();
+	}
+	return true;
+}
+
+bool LineConnection::receiveLine(std::string& line)
+{
+	while (!takeLine(line))
+	{
+		if (handle == -1)
+		{
+			return false;
+		}
+		char buffer[4096];
+		int count = (int)::recv(native(handle), buffer, sizeof(buffer), 0);
+		if (count <= 0)
+		{
+			close();
+			return false;
+		}
+		received.append(buffer, count);
+	}
+	return true;
+}
+
+bool LineConnection::pollLine(std::string& line)
+{
+	while (!takeLine(line))
+	{
+		if (handle == -1)
+		{
+			return false;
+		}
+		char buffer[4096];
+		int count = (int)::recv(native(handle), buffer, sizeof(buffer), 0);
+		if (count > 0)
+		{
+			received.append(buffer, count);
+			continue;
+		}
+#ifdef _WIN32
+		bool empty = count < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+		bool empty = count < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
+#endif
+		if (!empty)
+		{
+			close();
+		}
+		return false;
+	}
+	return true;
+}
+
+bool LineConnection::receive(void* data, size_t size)
+{
+	while (received.size() < size)
+	{
+		if (handle == -1)
+		{
+			return false;
+		}
+		char buffer[4096];
+		int count = (int)::recv(native(handle), buffer, sizeof(buffer), 0);
+		if (count <= 0)
+		{
+			close();
+			return false;
+		}
+		received.append(buffer, count);
+	}
+
+	memcpy(data, received.data(), size);
+	received.erase(0, size);
+	return true;
+}
+
+bool LineConnection::setNonBlocking()
+{
+	if (handle == -1)
+	{
+		return false;
+	}
+#ifdef _WIN32
+	u_long enable = 1;
+	return ioctlsocket(native(handle), FIONBIO, &enable) == 0;
+#else
+	int flags = fcntl(native(handle), F_GETFL, 0);
+	return flags != -1 && fcntl(native(handle), F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+long long LineConnection::sendSome(const void* data, size_t size)
+{
+	if (handle == -1)
+	{
+		return -1;
+	}
+
+	int count = (int)::send(native(handle), (const char*)data, (int)size, SEND_FLAGS);
+	if (count >= 0)
+	{
+		return count;
+	}
+#ifdef _WIN32
+	bool full = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	bool full = errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+	if (full)
+	{
+		return 0;
+	}
+	close();
+	return -1;
+}
+
+long long LineConnection::receiveSome(void* data, size_t size)
+{
+	// What a line or a receive() left behind comes first.
+	if (!received.empty())
+	{
+		size_t count = std::min(size, received.size());
+		memcpy(data, received.data(), count);
+		received.erase(0, count);
+		return (long long)count;
+	}
+	if (handle == -1)
+	{
+		return -1;
+	}
+
+	int count = (int)::recv(native(handle), (char*)data, (int)size, 0);
+	if (count > 0)
+	{
+		return count;
+	}
+#ifdef _WIN32
+	bool empty = count < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	bool empty = count < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
+#endif
+	if (empty)
+	{
+		return 0;
+	}
+	close();
+	return -1;
+}
+
+void LineConnection::shutdown()
+{
+	if (handle != -1)
+	{
+#ifdef _WIN32
+		::shutdown(native(handle), SD_BOTH);
+#else
+		::shutdown(native(handle), SHUT_RDWR);
+#endif
+	}
+}
+
+void LineConnection::close()
+{
+	if (handle != -1)
+	{
+		closeSocket(native(handle));
+		handle = -1;
+	}
+}
+
+LineListener::~LineListener()
+{
+	close();
+}
+
+bool LineListener::listen(int port)
+{
+	close();
+	if (!startSockets())
+	{
+		return false;
+	}
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo* address = nullptr;
+	if (getaddrinfo(nullptr, std::to_string(port).c_str(), &hints, &address) != 0)
+	{
+		std::cout << "Can't listen on port " << port << std::endl;
+		return false;
+	}
+
+	NativeSocket socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+	int reuse = 1;
+	bool listening = (std::intptr_t)socket != -1
+		&& setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse)) == 0
+		&& bind(socket, address->ai_addr, (int)address->ai_addrlen) == 0
+		&& ::listen(socket, SOMAXCONN) == 0;
+	freeaddrinfo(address);
+
+	if (!listening)
+	{
+		if ((std::intptr_t)socket != -1)
+		{
+			closeSocket(socket);
+		}
+		std::cout << "Can't listen on port " << port << std::endl;
+		return false;
+	}
+	handle = (std::intptr_t)socket;
+	return true;
+}
+
+bool LineListener::accept(LineConnection& connection, int timeoutMilliseconds)
+{
+	if (handle == -1)
+	{
+		return false;
+	}
+
+	fd_set ready;
+	FD_ZERO(&ready);
+	FD_SET(native(handle), &ready);
+	timeval timeout;
+	timeout.tv_sec = timeoutMilliseconds / 1000;
+	timeout.tv_usec = (timeoutMilliseconds % 1000) * 1000;
+	if (select((int)handle + 1, &ready, nullptr, nullptr, &timeout) <= 0)
+	{
+		return false;
+	}
+
+	NativeSocket socket = ::accept(native(handle), nullptr, nullptr);
+	if ((std::intptr_t)socket == -1)
+	{
+		return false;
+	}
+	connection.close();
+	connection.handle = (std::intptr_t)socket;
+	connection.received.clear();
+	return true;
+}
+
+void LineListener::close()
+{
+	if (handle != -1)
+	{
+		closeSocket(native(handle));
+		handle = -1;
+	}
+}
@@ -0,0 +1,114 @@
+/*
+Title: HydroDynamics
+File Name: LineSocket.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The smallest TCP connection that gets the job done: it sends and receives whole lines of
+text, which is all the sweep workers and their coordinator (see SweepCluster.h) say to each
+other. Winsock on Windows, BSD sockets everywhere else.
+
+The state stream (see StateStream.h) sends bytes instead of lines. Its server can't wait for
+any one client, so it switches its connections to non-blocking and sends what each of them
+takes with sendSome(). The remote control (see RemoteControl.h) and the lockstep sessions
+(see Lockstep.h) read their connections the same way, with pollLine().
+*/
+
+#ifndef _LINE_SOCKET_H
+#define _LINE_SOCKET_H
+
+#include <string>
+#include <cstdint>
+
+class LineConnection
+{
+public:
+	LineConnection() {}
+	~LineConnection();
+
+	// A socket belongs to exactly one LineConnection.
+	LineConnection(const LineConnection&) = delete;
+	LineConnection& operator=(const LineConnection&) = delete;
+
+	// Connects to host:port. Returns false (after printing an error) if that fails.
+	bool connect(const std::string& host, int port);
+
+	// Sends line and a newline. Returns false if the connection is gone.
+	bool sendLine(const std::string& line);
+
+	// Waits for the next line and returns it without its newline. Returns false once the connection is gone.
+	bool receiveLine(std::string& line);
+
+	// The same without waiting, on a non-blocking connection: returns a line if a whole one arrived, otherwise false. Check isOpen()
+	// to tell whether there was nothing yet or the connection is gone.
+	bool pollLine(std::string& line);
+
+	// Waits until exactly size bytes arrived. Returns false once the connection is gone.
+	bool receive(void* data, size_t size);
+
+	// Makes sendSome() return at once instead of waiting for the other end to take the data.
+	bool setNonBlocking();
+
+	// Sends as much of data as the connection takes. Returns the number of bytes sent, or -1 once the connection is gone.
+	long long sendSome(const void* data, size_t size);
+
+	// Receives what has arrived, up to size bytes, straight into data. On a non-blocking connection it returns 0 at once if nothing
+	// has; otherwise it waits for something. Returns -1 once the connection is gone.
+	long long receiveSome(void* data, size_t size);
+
+	// Ends the connection in both directions, which makes a receive() waiting on another thread return false. close() still has to
+	// be called after that.
+	void shutdown();
+
+	void close();
+	bool isOpen() const { return handle != -1; }
+
+private:
+	friend class LineListener;
+
+	bool takeLine(std::string& line);
+
+	std::intptr_t handle = -1;
+	std::string received;	// What arrived after the last whole line
+};
+
+class LineListener
+{
+public:
+	LineListener() {}
+	~LineListener();
+
+	LineListener(const LineListener&) = delete;
+	LineListener& operator=(const LineListener&) = delete;
+
+	// Listens on port on every interface. Returns false (after printing an error) if that fails.
+	bool listen(int port);
+
+	// Waits up to timeoutMilliseconds for a connection. Returns true and hands it to connection if one came in.
+	bool accept(LineConnection& connection, int timeoutMilliseconds);
+
+	void close();
+
+private:
+	std::intptr_t handle = -1;
+};
+
+#endif // _LINE_SOCKET_H
@@ -0,0 +1,312 @@
+/*
+Title: HydroDynamics
+File Name: LiveExport.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Publishes the height, pressure and external pressure of every vessel into a named block of
+shared memory (--live-export NAME), so dashboards and other tools can watch a running
+simulation without parsing its output. Readers map the same block and read the arrays
+straight out of it, as often as they like.
+
+The block is a LiveStateHeader followed by the three arrays, each starting on a
+LIVE_STATE_ALIGNMENT byte boundary as a StateLayout (see StateLayout.h) places them, whose
+fingerprint the header carries. It is guarded by a sequence lock: the writer makes the
+sequence odd, writes the arrays and makes it even again, and a reader copies what it needs
+between two reads of the sequence and tries again if they differ or were odd. The writer
+never waits for a reader, so however many readers there are and however fast they read, the
+simulation pays for copying the three arrays and nothing else.
+
+The block is sized for the vessels there are when it is created. If the network grows
+later, only that many vessels are published, and vesselCount in the header says how many.
+On Windows the name is that of a file mapping in the session of the simulation; everywhere
+else it is a POSIX shared memory object (a leading / is added if it has none).
+*/
+
+#include "LiveExport.h"
+#include "StateLayout.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A reader that keeps landing in the middle of an update gives up after this many tries.
+#define LIVE_STATE_RETRIES 1000
+
+SharedBlock::~SharedBlock()
+{
+	close();
+}
+
+bool SharedBlock::create(const std::string& name, size_t size)
+{
+	close();
+#ifdef _WIN32
+	systemName = name;
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name.c_str());
+	base = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+	if (base == nullptr)
+	{
+		std::cout << "Can't create the shared memory " << name << std::endl;
+		close();
+		return false;
+	}
+#else
+	systemName = name.empty() || name[0] != '/' ? "/" + name : name;
+	int descriptor = shm_open(systemName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (descriptor < 0 || ftruncate(descriptor, (off_t)size) != 0)
+	{
+		std::cout << "Can't create the shared memory " << systemName << std::endl;
+		if (descriptor >= 0)
+		{
+			::close(descriptor);
+		}
+		return false;
+	}
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (address == MAP_FAILED)
+	{
+		std::cout << "Can't map the shared memory " << systemName << std::endl;
+		shm_unlink(systemName.c_str());
+		return false;
+	}
+	base = (char*)address;
+#endif
+	length = size;
+	owner = true;
+	return true;
+}
+
+bool SharedBlock::open(const std::string& name)
+{
+	close();
+#ifdef _WIN32
+	systemName = name;
+	mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	base = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	MEMORY_BASIC_INFORMATION info;
+	if (base == nullptr || VirtualQuery(base, &info, sizeof(info)) == 0)
+	{
+		std::cout << "There is no shared memory " << name << std::endl;
+		close();
+		return false;
+	}
+	length = info.RegionSize;
+#else
+	systemName = name.empty() || name[0] != '/' ? "/" + name : name;
+	int descriptor = shm_open(systemName.c_str(), O_RDONLY, 0);
+	struct stat info;
+	if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size == 0)
+	{
+		std::cout << "There is no shared memory " << systemName << std::endl;
+		if (descriptor >= 0)
+		{
+			::close(descriptor);
+		}
+		return false;
+	}
+	void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (address == MAP_FAILED)
+	{
+		std::cout << "Can't map the shared memory " << systemName << std::endl;
+		return false;
+	}
+	base = (char*)address;
+	length = (size_t)info.st_size;
+#endif
+	owner = false;
+	return true;
+}
+
+void SharedBlock::close()
+{
+#ifdef _WIN32
+	if (base != nullptr)
+	{
+		UnmapViewOfFile(base);
+	}
+	if (mapping != nullptr)
+	{
+		CloseHandle(mapping);
+	}
+	mapping = nullptr;
+#else
+	if (base != nullptr)
+	{
+		munmap(base, length);
+		if (owner)
+		{
+			shm_unlink(systemName.c_str());
+		}
+	}
+#endif
+	base = nullptr;
+	length = 0;
+	owner = false;
+}
+
+// The arrays are all as long as the capacity.
+static constexpr StateLayout<3> liveStateLayout =
+{
+	{
+		layoutField<float>("height", 0),
+		layoutField<float>("pressure", 0),
+		layoutField<float>("externalPressure", 0)
+	},
+	LIVE_STATE_ALIGNMENT
+};
+
+bool LiveExport::open(const std::string& name, int vesselCount)
+{
+	close();
+
+	uint64_t capacity = (uint64_t)vesselCount;
+	uint64_t offsets[3];
+	uint64_t size = liveStateLayout.place(sizeof(LiveStateHeader), &capacity, offsets);
+	if (!block.create(name, (size_t)size))
+	{
+		return false;
+	}
+
+	// The sequence stays odd until the header is complete, so a reader that opens the block early never takes it for a state.
+	memset(block.data(), 0, block.size());
+	header = new (block.data()) LiveStateHeader();
+	header->sequence.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->version = LIVE_STATE_VERSION;
+	header->layout = liveStateLayout.fingerprint();
+	header->capacity = (uint32_t)vesselCount;
+	for (int i = 0; i < 3; i++)
+	{
+		header->arrayOffset[i] = offsets[i];
+		arrays[i] = liveStateLayout.array<float>(block.data(), offsets, i);
+	}
+	memcpy(header->magic, "HYDROSHM", 8);
+	header->sequence.store(2, std::memory_order_release);
+	return true;
+}
+
+void LiveExport::close()
+{
+	block.close();
+	header = nullptr;
+}
+
+void LiveExport::publish(long long step, double time, const VesselNetwork& network)
+{
+	uint32_t count = std::min((uint32_t)network.vesselCount(), header->capacity);
+	uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+
+	// Readers that see the odd sequence, or the arrays changing under them, try again.
+	header->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	header->vesselCount = count;
+	header->step = step;
+	header->time = time;
+	memcpy(arrays[0], network.height.data(), count * sizeof(float));
+	memcpy(arrays[1], network.pressure.data(), count * sizeof(float));
+	memcpy(arrays[2], network.externalPressure.data(), count * sizeof(float));
+
+	header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool LiveStateReader::open(const std::string& name)
+{
+	close();
+	if (!block.open(name))
+	{
+		return false;
+	}
+
+	const LiveStateHeader* candidate = (const LiveStateHeader*)block.data();
+	if (block.size() < sizeof(LiveStateHeader) || memcmp(candidate->magic, "HYDROSHM", 8) != 0 ||
+		candidate->version != LIVE_STATE_VERSION || candidate->layout != liveStateLayout.fingerprint())
+	{
+		std::cout << "The shared memory " << name << " isn't a live state of version " << LIVE_STATE_VERSION << std::endl;
+		close();
+		return false;
+	}
+	uint64_t capacity = candidate->capacity;
+	uint64_t offsets[3];
+	uint64_t size = liveStateLayout.place(sizeof(LiveStateHeader), &capacity, offsets);
+	if (!liveStateLayout.matches(sizeof(LiveStateHeader), &capacity, candidate->arrayOffset, size) || size > block.size())
+	{
+		std::cout << "The shared memory " << name << " isn't laid out the way its header says." << std::endl;
+		close();
+		return false;
+	}
+	header = candidate;
+	return true;
+}
+
+void LiveStateReader::close()
+{
+	block.close();
+	header = nullptr;
+}
+
+bool LiveStateReader::read(LiveState& state) const
+{
+	state.height.reserve(header->capacity);
+	state.pressure.reserve(header->capacity);
+	state.externalPressure.reserve(header->capacity);
+
+	for (int attempt = 0; attempt < LIVE_STATE_RETRIES; attempt++)
+	{
+		uint64_t before = header->sequence.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			continue;
+		}
+
+		uint32_t count = std::min(header->vesselCount, header->capacity);
+		state.step = header->step;
+		state.time = header->time;
+		state.height.resize(count);
+		state.pressure.resize(count);
+		state.externalPressure.resize(count);
+		memcpy(state.height.data(), liveStateLayout.array<float>(block.data(), header->arrayOffset, 0), count * sizeof(float));
+		memcpy(state.pressure.data(), liveStateLayout.array<float>(block.data(), header->arrayOffset, 1), count * sizeof(float));
+		memcpy(state.externalPressure.data(), liveStateLayout.array<float>(block.data(), header->arrayOffset, 2), count * sizeof(float));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->sequence.load(std::memory_order_relaxed) == before)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,147 @@
+/*
+Title: HydroDynamics
+File Name: LiveExport.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Publishes the height, pressure and external pressure of every vessel into a named block of
+shared memory (--live-export NAME), so dashboards and other tools can watch a running
+simulation without parsing its output. Readers map the same block and read the arrays
+straight out of it, as often as they like.
+
+The block is a LiveStateHeader followed by the three arrays, each starting on a
+LIVE_STATE_ALIGNMENT byte boundary as a StateLayout (see StateLayout.h) places them, whose
+fingerprint the header carries. It is guarded by a sequence lock: the writer makes the
+sequence odd, writes the arrays and makes it even again, and a reader copies what it needs
+between two reads of the sequence and tries again if they differ or were odd. The writer
+never waits for a reader, so however many readers there are and however fast they read, the
+simulation pays for copying the three arrays and nothing else.
+
+The block is sized for the vessels there are when it is created. If the network grows
+later, only that many vessels are published, and vesselCount in the header says how many.
+On Windows the name is that of a file mapping in the session of the simulation; everywhere
+else it is a POSIX shared memory object (a leading / is added if it has none).
+*/
+
+#ifndef _LIVE_EXPORT_H
+#define _LIVE_EXPORT_H
+
+#include "VesselNetwork.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define LIVE_STATE_VERSION 2
+#define LIVE_STATE_ALIGNMENT 64
+
+// The sequence has to work between processes, so it can't fall back to a lock.
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The live state needs a lock-free 64 bit atomic");
+
+struct LiveStateHeader
+{
+	char magic[8];						// "HYDROSHM"
+	uint32_t version;					// LIVE_STATE_VERSION
+	uint32_t capacity;					// How many vessels the arrays have room for
+	uint64_t arrayOffset[3];			// Where the heights, pressures and external pressures start, from the start of the block
+	std::atomic<uint64_t> sequence;		// Odd while the writer is in the middle of an update
+	uint32_t vesselCount;				// How many of them are valid
+	uint32_t layout;					// The fingerprint of the layout of the arrays
+	int64_t step;						// The physics step the state is from
+	double time;						// The simulated time of that step, in seconds
+};
+
+// Where a block of shared memory is mapped.
+class SharedBlock
+{
+public:
+	SharedBlock() {}
+	~SharedBlock();
+
+	SharedBlock(const SharedBlock&) = delete;
+	SharedBlock& operator=(const SharedBlock&) = delete;
+
+	// Creates the block (or resizes one left behind by a crash) with size bytes, or opens an existing one. Returns false (after
+	// printing an error) if that fails.
+	bool create(const std::string& name, size_t size);
+	bool open(const std::string& name);
+
+	// Unmaps the block, and removes its name if this one created it.
+	void close();
+
+	char* data() const { return base; }
+	size_t size() const { return length; }
+
+private:
+	char* base = nullptr;
+	size_t length = 0;
+	std::string systemName;
+	bool owner = false;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+};
+
+class LiveExport
+{
+public:
+	// Creates the block for vesselCount vessels. Returns false (after printing an error) if it can't be created.
+	bool open(const std::string& name, int vesselCount);
+	void close();
+	bool isOpen() const { return header != nullptr; }
+
+	// Copies the state of the network after step into the block.
+	void publish(long long step, double time, const VesselNetwork& network);
+
+private:
+	SharedBlock block;
+	LiveStateHeader* header = nullptr;
+	float* arrays[3] = {};
+};
+
+// The state as a reader copied it out of the block.
+struct LiveState
+{
+	long long step = 0;
+	double time = 0.0;
+	std::vector<float> height;
+	std::vector<float> pressure;
+	std::vector<float> externalPressure;
+};
+
+// What a dashboard uses to read the block.
+class LiveStateReader
+{
+public:
+	// Opens the block a simulation published. Returns false (after printing an error) if there is none or it isn't a live state.
+	bool open(const std::string& name);
+	void close();
+
+	// Copies a consistent state out of the block. Returns false if the writer kept changing it for LIVE_STATE_RETRIES tries in a row.
+	bool read(LiveState& state) const;
+
+private:
+	SharedBlock block;
+	const LiveStateHeader* header = nullptr;
+};
+
+#endif // _LIVE_EXPORT_H
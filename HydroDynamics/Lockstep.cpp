@@ -0,0 +1,344 @@
+/*
+Title: HydroDynamics
+File Name: Lockstep.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Lets several operators share one apparatus over the network (--lockstep-host PORT on one
+machine, --lockstep-join HOST:PORT on the others). Every machine runs the whole simulation
+itself, and all they send each other are the input commands, stamped with the physics step
+they are applied on, like an input log (see InputLog.h). Since a step only depends on the
+state before it and the commands applied to it, every machine goes through exactly the same
+states, and the traffic is a few bytes per second whatever the size of the network. That
+only holds if the step gives the same bits on every machine, so sessions run in fixed point
+(see FixedPoint.h).
+
+The host is the clock. Its own commands, and those the peers send it, are applied by its
+next step like any other input and then sent to every peer with their step. After every
+step the host may let the peers run up to it, since all input before it is out: it sends
+that step with the commands, or at the latest every LOCKSTEP_GRANT_MILLISECONDS. A peer
+never runs a step it wasn't granted, so it always has the input of the step before running
+it, and it stays behind the host by the time the commands take to arrive. A peer that
+drops further back than LOCKSTEP_LAG_STEPS steps as fast as it can until it caught up.
+
+Every LOCKSTEP_CHECK_STEPS steps the host also sends a hash of its state, which every peer
+compares with its own once it gets there, so a session that went out of step says so.
+
+A peer joins with the key of its setup (the scene and the settings), and the host turns it
+away if that isn't the key of its own setup. It then gets every command so far and catches
+up from the start. One thread on every machine does all the talking, polling the
+connections every LOCKSTEP_POLL_MILLISECONDS. The simulation thread only hands it lines and
+takes the commands and steps it received.
+*/
+
+#include "Lockstep.h"
+#include "ThreadControl.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+// What the two ends say to each other, one line each:
+//   peer to host: "join KEY" once, then commands as the remote control takes them ("pressure 1.5")
+//   host to peer: "welcome" or "refused REASON", then "input STEP COMMAND", "step STEP" (run up to here) and "check STEP HASH"
+
+LockstepSession::~LockstepSession()
+{
+	stop();
+}
+
+bool LockstepSession::host(int port, uint64_t key, long long step, void(*onCommand)(const InputEvent& event))
+{
+	stop();
+	if (!listener.listen(port))
+	{
+		return false;
+	}
+	sessionKey = key;
+	steppedTo = step;
+	commandHandler = onCommand;
+	hosting = true;
+	stopping = false;
+	thread = std::thread(&LockstepSession::runHost, this);
+	std::cout << "Hosting a lockstep session on port " << port << std::endl;
+	return true;
+}
+
+bool LockstepSession::join(const std::string& hostName, int port, uint64_t key, void(*onGranted)())
+{
+	stop();
+	std::ostringstream hello;
+	hello << "join " << std::hex << key;
+	if (!connection.connect(hostName, port) || !connection.sendLine(hello.str()) || !connection.setNonBlocking())
+	{
+		std::cout << "Can't join the lockstep session at " << hostName << ":" << port << std::endl;
+		connection.close();
+		return false;
+	}
+	sessionKey = key;
+	grantHandler = onGranted;
+	peering = true;
+	stopping = false;
+	thread = std::thread(&LockstepSession::runPeer, this);
+	return true;
+}
+
+void LockstepSession::stop()
+{
+	if (thread.joinable())
+	{
+		stopping = true;
+		thread.join();
+	}
+	listener.close();
+	peers.clear();
+	peerJoined.clear();
+	connection.close();
+	hosting = false;
+	peering = false;
+}
+
+void LockstepSession::applied(const InputEvent& event)
+{
+	std::ostringstream line;
+	line << "input " << event.step << " " << formatInputCommand(event);
+	std::lock_guard<std::mutex> lock(outboxLock);
+	outbox.push_back(line.str());
+}
+
+void LockstepSession::stepped(long long step, uint64_t stateHash)
+{
+	std::lock_guard<std::mutex> lock(outboxLock);
+	if (checkDue(step))
+	{
+		std::ostringstream line;
+		line << "check " << step << " " << std::hex << stateHash;
+		outbox.push_back(line.str());
+	}
+	steppedTo = step;
+}
+
+bool LockstepSession::next(long long step, InputEvent& event)
+{
+	std::lock_guard<std::mutex> lock(receivedLock);
+	return received.next(step, event);
+}
+
+void LockstepSession::send(const InputEvent& event)
+{
+	std::lock_guard<std::mutex> lock(outboxLock);
+	outbox.push_back(formatInputCommand(event));
+}
+
+bool LockstepSession::check(long long step, uint64_t stateHash)
+{
+	std::lock_guard<std::mutex> lock(receivedLock);
+	std::map<long long, uint64_t>::iterator found = checks.find(step);
+	bool same = found == checks.end() || found->second == stateHash;
+	checks.erase(checks.begin(), checks.upper_bound(step));
+	return same;
+}
+
+void LockstepSession::hostLine(LineConnection& peer, bool& joined, const std::string& line)
+{
+	if (!joined)
+	{
+		std::istringstream fields(line);
+		std::string word;
+		uint64_t key = 0;
+		if (!(fields >> word >> std::hex >> key) || word != "join" || key != sessionKey)
+		{
+			peer.sendLine("refused the scene or the settings differ from those of the host");
+			peer.close();
+			std::cout << "Turned away a peer with a different setup." << std::endl;
+			return;
+		}
+
+		// Everything so far, then the step the others were let run to, so the new peer starts where everyone else did.
+		peer.sendLine("welcome");
+		for (const std::string& sent : history)
+		{
+			peer.sendLine(sent);
+		}
+		if (sentStep >= 0)
+		{
+			peer.sendLine("step " + std::to_string(sentStep));
+		}
+		joined = true;
+		std::cout << "A peer joined the lockstep session." << std::endl;
+		return;
+	}
+
+	InputEvent event;
+	if (!parseInputCommand(line, event) || event.command == INPUT_REWIND
+		|| ((event.command == INPUT_SET_EXTERNAL || event.command == INPUT_ADD_FLUID) && event.vessel < 0))
+	{
+		std::cout << "Ignoring a command of a peer: " << line << std::endl;
+		return;
+	}
+	commandHandler(event);
+}
+
+void LockstepSession::runHost()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	sentStep = -1;
+	history.clear();
+	std::chrono::steady_clock::time_point sentTime = std::chrono::steady_clock::now();
+	std::vector<std::string> lines;
+	while (!stopping)
+	{
+		// Waiting for a new peer is what paces the loop.
+		std::unique_ptr<LineConnection> connection(new LineConnection());
+		if (listener.accept(*connection, LOCKSTEP_POLL_MILLISECONDS) && connection->setNonBlocking())
+		{
+			peers.push_back(std::move(connection));
+			peerJoined.push_back(0);
+		}
+
+		for (size_t i = 0; i < peers.size(); i++)
+		{
+			std::string line;
+			bool joined = peerJoined[i] != 0;
+			while (peers[i]->pollLine(line))
+			{
+				hostLine(*peers[i], joined, line);
+			}
+			peerJoined[i] = joined;
+		}
+
+		long long step;
+		{
+			std::lock_guard<std::mutex> lock(outboxLock);
+			lines.swap(outbox);
+			step = steppedTo;
+		}
+
+		// The step goes out right behind the commands, so a command is never further than one round from the peers, and otherwise
+		// often enough that the peers don't hold up more than they have to.
+		history.insert(history.end(), lines.begin(), lines.end());
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (step != sentStep && (!lines.empty() || now - sentTime >= std::chrono::milliseconds(LOCKSTEP_GRANT_MILLISECONDS)))
+		{
+			lines.push_back("step " + std::to_string(step));
+			sentStep = step;
+			sentTime = now;
+		}
+		for (size_t i = 0; i < peers.size(); i++)
+		{
+			for (size_t k = 0; k < lines.size() && peerJoined[i]; k++)
+			{
+				peers[i]->sendLine(lines[k]);
+			}
+		}
+		lines.clear();
+
+		for (size_t i = 0; i < peers.size();)
+		{
+			if (peers[i]->isOpen())
+			{
+				i++;
+				continue;
+			}
+			if (peerJoined[i])
+			{
+				std::cout << "A peer left the lockstep session." << std::endl;
+			}
+			peers.erase(peers.begin() + i);
+			peerJoined.erase(peerJoined.begin() + i);
+		}
+	}
+}
+
+void LockstepSession::peerLine(const std::string& line)
+{
+	std::istringstream fields(line);
+	std::string word;
+	fields >> word;
+	if (word == "welcome")
+	{
+		std::cout << "Joined the lockstep session." << std::endl;
+	}
+	else if (word == "refused")
+	{
+		std::cout << "The host " << line << std::endl;
+		connection.close();
+	}
+	else if (word == "input")
+	{
+		InputEvent event;
+		std::string command;
+		if (fields >> event.step && std::getline(fields, command) && parseInputCommand(command, event))
+		{
+			std::lock_guard<std::mutex> lock(receivedLock);
+			received.add(event.step, event.command, event.vessel, event.value);
+		}
+	}
+	else if (word == "check")
+	{
+		long long step;
+		uint64_t hash;
+		if (fields >> step >> std::hex >> hash)
+		{
+			std::lock_guard<std::mutex> lock(receivedLock);
+			checks[step] = hash;
+		}
+	}
+	else if (word == "step")
+	{
+		long long step;
+		if (fields >> step)
+		{
+			grant = step;
+			grantHandler();
+		}
+	}
+}
+
+void LockstepSession::runPeer()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::vector<std::string> lines;
+	while (!stopping)
+	{
+		std::string line;
+		while (connection.pollLine(line))
+		{
+			peerLine(line);
+		}
+		{
+			std::lock_guard<std::mutex> lock(outboxLock);
+			lines.swap(outbox);
+		}
+		for (const std::string& command : lines)
+		{
+			connection.sendLine(command);
+		}
+		lines.clear();
+
+		if (!connection.isOpen())
+		{
+			std::cout << "The lockstep session ended, stopping at step " << grant.load() << "." << std::endl;
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(LOCKSTEP_POLL_MILLISECONDS));
+	}
+}
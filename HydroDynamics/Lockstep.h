@@ -0,0 +1,150 @@
+/*
+Title: HydroDynamics
+File Name: Lockstep.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Lets several operators share one apparatus over the network (--lockstep-host PORT on one
+machine, --lockstep-join HOST:PORT on the others). Every machine runs the whole simulation
+itself, and all they send each other are the input commands, stamped with the physics step
+they are applied on, like an input log (see InputLog.h). Since a step only depends on the
+state before it and the commands applied to it, every machine goes through exactly the same
+states, and the traffic is a few bytes per second whatever the size of the network. That
+only holds if the step gives the same bits on every machine, so sessions run in fixed point
+(see FixedPoint.h).
+
+The host is the clock. Its own commands, and those the peers send it, are applied by its
+next step like any other input and then sent to every peer with their step. After every
+step the host may let the peers run up to it, since all input before it is out: it sends
+that step with the commands, or at the latest every LOCKSTEP_GRANT_MILLISECONDS. A peer
+never runs a step it wasn't granted, so it always has the input of the step before running
+it, and it stays behind the host by the time the commands take to arrive. A peer that
+drops further back than LOCKSTEP_LAG_STEPS steps as fast as it can until it caught up.
+
+Every LOCKSTEP_CHECK_STEPS steps the host also sends a hash of its state, which every peer
+compares with its own once it gets there, so a session that went out of step says so.
+
+A peer joins with the key of its setup (the scene and the settings), and the host turns it
+away if that isn't the key of its own setup. It then gets every command so far and catches
+up from the start. One thread on every machine does all the talking, polling the
+connections every LOCKSTEP_POLL_MILLISECONDS. The simulation thread only hands it lines and
+takes the commands and steps it received.
+*/
+
+#ifndef _LOCKSTEP_H
+#define _LOCKSTEP_H
+
+#include "InputLog.h"
+#include "LineSocket.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOCKSTEP_POLL_MILLISECONDS 1
+#define LOCKSTEP_GRANT_MILLISECONDS 100
+#define LOCKSTEP_LAG_STEPS 30
+#define LOCKSTEP_CHECK_STEPS 600
+
+class LockstepSession
+{
+public:
+	LockstepSession() {}
+	~LockstepSession();
+
+	LockstepSession(const LockstepSession&) = delete;
+	LockstepSession& operator=(const LockstepSession&) = delete;
+
+	// Listens on port for peers with the same key, and starts the thread, which calls onCommand for every command a peer sends
+	// (on that thread). step is the step the session starts at. Returns false (after printing an error) if the port can't be used.
+	bool host(int port, uint64_t key, long long step, void(*onCommand)(const InputEvent& event));
+
+	// Connects to the host at host:port and starts the thread, which calls onGranted whenever the host lets this peer run more
+	// steps (on that thread). Returns false (after printing an error) if the host can't be reached.
+	bool join(const std::string& hostName, int port, uint64_t key, void(*onGranted)());
+
+	// Stops the thread and closes every connection.
+	void stop();
+
+	bool isHost() const { return hosting; }
+	bool isPeer() const { return peering; }
+
+	// Host, on the simulation thread: event was applied before its step, and the step before step has run. A state hash is only
+	// sent for the steps checkDue() asks for.
+	void applied(const InputEvent& event);
+	void stepped(long long step, uint64_t stateHash);
+
+	// Peer, on the simulation thread: the commands of the host for step, one per call, then false once there are no more.
+	bool next(long long step, InputEvent& event);
+
+	// Peer: the steps before granted() may run.
+	long long granted() const { return grant.load(); }
+
+	// Peer: hands a command of the operator to the host, which sends it back with the step it is applied on.
+	void send(const InputEvent& event);
+
+	// Peer: compares the state after step with that of the host, if checkDue(). Returns false if they differ.
+	bool check(long long step, uint64_t stateHash);
+
+	static bool checkDue(long long step) { return step % LOCKSTEP_CHECK_STEPS == 0; }
+
+private:
+	void runHost();
+	void runPeer();
+	void hostLine(LineConnection& peer, bool& joined, const std::string& line);
+	void peerLine(const std::string& line);
+
+	bool hosting = false;
+	bool peering = false;
+	uint64_t sessionKey = 0;
+	std::thread thread;
+	std::atomic<bool> stopping{ false };
+
+	// Host: the peers, whether each has sent its key yet, and every command and check sent so far and the last step granted, for
+	// the ones that join later.
+	LineListener listener;
+	std::vector<std::unique_ptr<LineConnection>> peers;
+	std::vector<char> peerJoined;
+	std::vector<std::string> history;
+	long long sentStep = -1;
+	void(*commandHandler)(const InputEvent& event) = nullptr;
+
+	// Host: the lines the simulation thread handed over since the last round, and the latest step it ran. Peer: the commands of the
+	// operator on their way to the host.
+	std::mutex outboxLock;
+	std::vector<std::string> outbox;
+	long long steppedTo = 0;
+
+	// Peer: the connection to the host, and what it sent.
+	LineConnection connection;
+	void(*grantHandler)() = nullptr;
+	std::mutex receivedLock;
+	InputLog received;
+	std::map<long long, uint64_t> checks;
+	std::atomic<long long> grant{ 0 };
+};
+
+#endif // _LOCKSTEP_H
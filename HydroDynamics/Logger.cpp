@@ -0,0 +1,263 @@
+/*
+Title: HydroDynamics
+File Name: Logger.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Messages from the threads that can't wait for the console. Writing to std::cout with
+std::endl flushes the stream every line, which can block for as long as the terminal takes,
+and the render and simulation threads can't afford that once they report every event.
+
+A message is logged with one of the LOG_ macros and a format whose {} are replaced by the
+arguments, in order:
+
+	LOG_INFO("Went back {} steps, to step {}", steps, target);
+
+The format has to be a string literal, since only the pointer to it is kept. Logging copies
+the pointer, the numbers and the text of the arguments into a fixed size entry and pushes
+it onto a lock-free queue (see MpscQueue.h); nothing is formatted and nothing is allocated.
+A writer thread takes the entries off the queue, formats them and writes them out, and
+flushes when it has caught up. If the queue is full, the message is dropped and counted
+instead of waiting, and the writer says how many it lost.
+
+Messages below LOG_COMPILED_LEVEL don't even get compiled: their macro is empty, and so is
+the work of their arguments. Those above it can still be filtered at run time with
+logSetLevel(). Until logStart() and after logStop(), messages are written right away on the
+calling thread, so nothing is lost before the writer runs.
+*/
+
+#include "Logger.h"
+#include "MpscQueue.h"
+#include "ThreadControl.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+static MpscQueue<LogEntry, LOG_QUEUE_CAPACITY> logQueue;
+static std::atomic<bool> logRunning(false);
+static std::atomic<int> logSubmitting(0);		// Threads between checking logRunning and pushing, which logStop() waits for
+static std::atomic<int> logThreshold(LOG_LEVEL_DEBUG);
+static std::atomic<long long> logDropped(0);
+static std::mutex logDirectLock;				// For the messages written right away, while there is no writer
+static std::thread logWriter;
+static std::ofstream logFile;
+static const std::chrono::steady_clock::time_point logEpoch = std::chrono::steady_clock::now();
+
+static const char* levelNames[] = { "debug", "info", "warning", "error" };
+
+// Replaces every {} of the format with the next argument.
+static void formatEntry(const LogEntry& entry, std::string& line)
+{
+	line.clear();
+	int next = 0;
+	char number[32];
+	for (const char* c = entry.format; *c != '\0'; c++)
+	{
+		if (c[0] != '{' || c[1] != '}' || next == entry.argumentCount)
+		{
+			line += *c;
+			continue;
+		}
+		const LogArgument& argument = entry.arguments[next++];
+		c++;
+		switch (argument.kind)
+		{
+		case LogArgument::INTEGER:
+			snprintf(number, sizeof(number), "%lld", argument.integer);
+			line += number;
+			break;
+		case LogArgument::UNSIGNED:
+			snprintf(number, sizeof(number), "%llu", argument.whole);
+			line += number;
+			break;
+		case LogArgument::REAL:
+			// The same as a double written to a stream with the default precision.
+			snprintf(number, sizeof(number), "%g", argument.real);
+			line += number;
+			break;
+		default:
+			line.append(entry.text + argument.textStart, argument.textLength);
+			break;
+		}
+	}
+}
+
+static void writeEntry(const LogEntry& entry, std::string& line)
+{
+	formatEntry(entry, line);
+	if (logFile.is_open())
+	{
+		char prefix[48];
+		snprintf(prefix, sizeof(prefix), "%.3f %s ", entry.time, levelNames[entry.level]);
+		logFile << prefix << line << '\n';
+	}
+	else
+	{
+		std::cout << line << '\n';
+	}
+}
+
+static void flushOutput()
+{
+	if (logFile.is_open())
+	{
+		logFile.flush();
+	}
+	else
+	{
+		std::cout.flush();
+	}
+}
+
+// Takes everything off the queue. Returns whether there was anything.
+static bool drainQueue(std::string& line)
+{
+	bool wrote = false;
+	LogEntry entry;
+	while (logQueue.pop(entry))
+	{
+		writeEntry(entry, line);
+		wrote = true;
+	}
+	long long dropped = logDropped.exchange(0);
+	if (dropped > 0)
+	{
+		LogEntry note;
+		note.format = "Dropped {} log messages, the queue was full.";
+		note.level = LOG_LEVEL_WARNING;
+		note.argumentCount = 1;
+		note.textUsed = 0;
+		note.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - logEpoch).count();
+		note.arguments[0].kind = LogArgument::INTEGER;
+		note.arguments[0].integer = dropped;
+		writeEntry(note, line);
+		wrote = true;
+	}
+	if (wrote)
+	{
+		flushOutput();
+	}
+	return wrote;
+}
+
+static void writerLoop()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::string line;
+	while (logRunning.load())
+	{
+		if (!drainQueue(line))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITE_MILLISECONDS));
+		}
+	}
+}
+
+bool logStart(const std::string& fileName)
+{
+	if (logRunning.load())
+	{
+		return true;
+	}
+	if (!fileName.empty())
+	{
+		logFile.open(fileName, std::ios::out);
+		if (!logFile.good())
+		{
+			std::cout << "Can't write file: " << fileName << std::endl;
+			return false;
+		}
+	}
+	logRunning.store(true);
+	logWriter = std::thread(writerLoop);
+	return true;
+}
+
+void logStop()
+{
+	if (!logRunning.exchange(false))
+	{
+		return;
+	}
+	logWriter.join();
+
+	// The messages of threads that saw the writer running just before it stopped come in last.
+	while (logSubmitting.load() > 0)
+	{
+		std::this_thread::yield();
+	}
+	std::string line;
+	drainQueue(line);
+	if (logFile.is_open())
+	{
+		logFile.close();
+	}
+}
+
+void logSetLevel(int level)
+{
+	logThreshold.store(level);
+}
+
+bool parseLogLevel(const std::string& name, int& level)
+{
+	for (int l = LOG_LEVEL_DEBUG; l <= LOG_LEVEL_ERROR; l++)
+	{
+		if (name == levelNames[l])
+		{
+			level = l;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool logWanted(int level)
+{
+	return level >= logThreshold.load(std::memory_order_relaxed);
+}
+
+void logSubmit(LogEntry& entry)
+{
+	entry.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - logEpoch).count();
+	logSubmitting.fetch_add(1);
+	if (logRunning.load())
+	{
+		if (!logQueue.push(entry))
+		{
+			logDropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		logSubmitting.fetch_sub(1);
+		return;
+	}
+	logSubmitting.fetch_sub(1);
+
+	// Without a writer, the message goes out right away.
+	std::lock_guard<std::mutex> guard(logDirectLock);
+	std::string line;
+	writeEntry(entry, line);
+	flushOutput();
+}
@@ -0,0 +1,205 @@
+/*
+Title: HydroDynamics
+File Name: Logger.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Messages from the threads that can't wait for the console. Writing to std::cout with
+std::endl flushes the stream every line, which can block for as long as the terminal takes,
+and the render and simulation threads can't afford that once they report every event.
+
+A message is logged with one of the LOG_ macros and a format whose {} are replaced by the
+arguments, in order:
+
+	LOG_INFO("Went back {} steps, to step {}", steps, target);
+
+The format has to be a string literal, since only the pointer to it is kept. Logging copies
+the pointer, the numbers and the text of the arguments into a fixed size entry and pushes
+it onto a lock-free queue (see MpscQueue.h); nothing is formatted and nothing is allocated.
+A writer thread takes the entries off the queue, formats them and writes them out, and
+flushes when it has caught up. If the queue is full, the message is dropped and counted
+instead of waiting, and the writer says how many it lost.
+
+Messages below LOG_COMPILED_LEVEL don't even get compiled: their macro is empty, and so is
+the work of their arguments. Those above it can still be filtered at run time with
+logSetLevel(). Until logStart() and after logStop(), messages are written right away on the
+calling thread, so nothing is lost before the writer runs.
+*/
+
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include <string>
+#include <cstring>
+#include <type_traits>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+// Messages below this level are left out of the build.
+#ifndef LOG_COMPILED_LEVEL
+#ifdef _DEBUG
+#define LOG_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// Entries the queue holds, the most arguments a message takes, and how much of their text it keeps.
+#define LOG_QUEUE_CAPACITY 4096
+#define LOG_MAX_ARGUMENTS 6
+#define LOG_TEXT_BYTES 112
+
+// How long the writer sleeps when it has caught up.
+#define LOG_WRITE_MILLISECONDS 10
+
+struct LogArgument
+{
+	enum Kind : unsigned char { INTEGER, UNSIGNED, REAL, TEXT } kind;
+	unsigned char textStart;		// For text, where it is in the text of the entry, and how long
+	unsigned char textLength;
+	union
+	{
+		long long integer;
+		unsigned long long whole;
+		double real;
+	};
+};
+
+struct LogEntry
+{
+	const char* format;
+	int level;
+	int argumentCount;
+	int textUsed;
+	double time;					// Seconds since the program started
+	LogArgument arguments[LOG_MAX_ARGUMENTS];
+	char text[LOG_TEXT_BYTES];
+};
+
+// Starts the writer thread, which writes to fileName (with the time and level of every message) or to the console.
+// Returns false (after printing why) if the file can't be written.
+bool logStart(const std::string& fileName = "");
+
+// Writes everything that is still queued and stops the writer.
+void logStop();
+
+// Leaves out messages below level from now on.
+void logSetLevel(int level);
+
+// Parses "debug", "info", "warning" or "error". Returns false if it's none of them.
+bool parseLogLevel(const std::string& name, int& level);
+
+// Queues an entry that was filled in. Use the LOG_ macros instead.
+void logSubmit(LogEntry& entry);
+bool logWanted(int level);
+
+inline void logAdd(LogEntry& entry, const char* value)
+{
+	if (entry.argumentCount == LOG_MAX_ARGUMENTS)
+	{
+		return;
+	}
+	LogArgument& argument = entry.arguments[entry.argumentCount++];
+	size_t length = value != nullptr ? strlen(value) : 0;
+	size_t room = LOG_TEXT_BYTES - entry.textUsed;
+	length = length < room ? length : room;
+	argument.kind = LogArgument::TEXT;
+	argument.textStart = (unsigned char)entry.textUsed;
+	argument.textLength = (unsigned char)length;
+	memcpy(entry.text + entry.textUsed, value, length);
+	entry.textUsed += (int)length;
+}
+
+inline void logAdd(LogEntry& entry, const std::string& value)
+{
+	logAdd(entry, value.c_str());
+}
+
+inline void logAdd(LogEntry& entry, char* value)
+{
+	logAdd(entry, (const char*)value);
+}
+
+template <typename T>
+inline void logAdd(LogEntry& entry, T value)
+{
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Log arguments have to be numbers or text");
+	if (entry.argumentCount == LOG_MAX_ARGUMENTS)
+	{
+		return;
+	}
+	LogArgument& argument = entry.arguments[entry.argumentCount++];
+	if (std::is_floating_point<T>::value)
+	{
+		argument.kind = LogArgument::REAL;
+		argument.real = (double)value;
+	}
+	else if (std::is_unsigned<T>::value)
+	{
+		argument.kind = LogArgument::UNSIGNED;
+		argument.whole = (unsigned long long)value;
+	}
+	else
+	{
+		argument.kind = LogArgument::INTEGER;
+		argument.integer = (long long)value;
+	}
+}
+
+template <typename... Args>
+void logMessage(int level, const char* format, const Args&... args)
+{
+	if (!logWanted(level))
+	{
+		return;
+	}
+	LogEntry entry;
+	entry.format = format;
+	entry.level = level;
+	entry.argumentCount = 0;
+	entry.textUsed = 0;
+	int expand[] = { 0, (logAdd(entry, args), 0)... };
+	(void)expand;
+	logSubmit(entry);
+}
+
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logMessage(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) logMessage(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if LOG_COMPILED_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) logMessage(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+#define LOG_ERROR(...) logMessage(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif // _LOGGER_H
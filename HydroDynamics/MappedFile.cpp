@@ -0,0 +1,238 @@
+/*
+Title: HydroDynamics
+File Name: MappedFile.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Read-only access to a file by mapping it into memory (MapViewOfFile on Windows, mmap
+everywhere else). Nothing is copied when the file is opened; the operating system pages the
+contents in when they are first touched, and view() hands out a string_view straight into the
+mapping. This is how shaders and other assets are loaded, so a large file never exists twice
+in memory. The view is only valid while the MappedFile is open.
+
+A reader that walks through a file much larger than memory tells the operating system which
+part it is about to read with willNeed() and which part it is done with with release(), so
+only the parts in use stay resident.
+*/
+
+#include "MappedFile.h"
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(data, other.data);
+		std::swap(size, other.size);
+		std::swap(opened, other.opened);
+#ifdef _WIN32
+		std::swap(fileHandle, other.fileHandle);
+		std::swap(mappingHandle, other.mappingHandle);
+#else
+		std::swap(descriptor, other.descriptor);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const char* fileName)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	size = (size_t)fileSize.QuadPart;
+
+	// Windows refuses to map an empty file, but there is nothing to map anyway.
+	if (size > 0)
+	{
+		mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		data = mappingHandle ? (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (data == nullptr)
+		{
+			std::cout << "Can't map file: " << fileName << std::endl;
+			opened = true;
+			close();
+			return false;
+		}
+	}
+#else
+	descriptor = ::open(fileName, O_RDONLY);
+	struct stat info;
+	if (descriptor < 0 || fstat(descriptor, &info) != 0)
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		if (descriptor >= 0)
+		{
+			::close(descriptor);
+			descriptor = -1;
+		}
+		return false;
+	}
+	size = (size_t)info.st_size;
+
+	// mmap fails on a length of 0, so an empty file simply has no mapping.
+	if (size > 0)
+	{
+		void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (mapping == MAP_FAILED)
+		{
+			std::cout << "Can't map file: " << fileName << std::endl;
+			opened = true;
+			close();
+			return false;
+		}
+		data = (const char*)mapping;
+	}
+#endif
+
+	opened = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!opened)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	if (data != nullptr)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != nullptr)
+	{
+		CloseHandle(mappingHandle);
+	}
+	CloseHandle(fileHandle);
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+#else
+	if (data != nullptr)
+	{
+		munmap((void*)data, size);
+	}
+	::close(descriptor);
+	descriptor = -1;
+#endif
+
+	data = nullptr;
+	size = 0;
+	opened = false;
+}
+
+// Rounds a range of the file out to whole pages for willNeed(), or in to the pages it covers completely for release(), and
+// clips it to the file. Returns false if nothing is left.
+static bool pageRange(size_t fileSize, size_t& offset, size_t& length, bool inward)
+{
+#ifdef _WIN32
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	size_t page = system.dwPageSize;
+#else
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	size_t end = offset + length < fileSize ? offset + length : fileSize;
+	if (inward)
+	{
+		offset = (offset + page - 1) / page * page;
+		end = end == fileSize ? end : end / page * page;
+	}
+	else
+	{
+		offset = offset / page * page;
+	}
+	if (offset >= end)
+	{
+		return false;
+	}
+	length = end - offset;
+	return true;
+}
+
+void MappedFile::willNeed(size_t offset, size_t length) const
+{
+	if (data == nullptr || !pageRange(size, offset, length, false))
+	{
+		return;
+	}
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+	WIN32_MEMORY_RANGE_ENTRY range = { (void*)(data + offset), length };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+	madvise((void*)(data + offset), length, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::release(size_t offset, size_t length) const
+{
+	if (data == nullptr || !pageRange(size, offset, length, true))
+	{
+		return;
+	}
+#ifdef _WIN32
+	// Unlocking pages that aren't locked takes them out of the working set of the process.
+	VirtualUnlock((void*)(data + offset), length);
+#else
+	madvise((void*)(data + offset), length, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,82 @@
+/*
+Title: HydroDynamics
+File Name: MappedFile.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Read-only access to a file by mapping it into memory (MapViewOfFile on Windows, mmap
+everywhere else). Nothing is copied when the file is opened; the operating system pages the
+contents in when they are first touched, and view() hands out a string_view straight into the
+mapping. This is how shaders and other assets are loaded, so a large file never exists twice
+in memory. The view is only valid while the MappedFile is open.
+
+A reader that walks through a file much larger than memory tells the operating system which
+part it is about to read with willNeed() and which part it is done with with release(), so
+only the parts in use stay resident.
+*/
+
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <string_view>
+
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	// A mapping belongs to exactly one MappedFile, so it can be moved but not copied.
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	// Maps the whole file. Returns false (after printing an error) if it can't be opened. An empty file opens fine and has an empty view.
+	bool open(const char* fileName);
+
+	// Unmaps the file. Any view handed out before is invalid afterwards.
+	void close();
+
+	// Starts reading the pages of a range of the file in the background, so they are there by the time they are touched.
+	void willNeed(size_t offset, size_t length) const;
+
+	// Lets the operating system drop the pages of a range from memory. They stay valid and are read again if they are touched.
+	void release(size_t offset, size_t length) const;
+
+	bool isOpen() const { return opened; }
+	std::string_view view() const { return std::string_view(data, size); }
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+	bool opened = false;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
+
+#endif // _MAPPED_FILE_H
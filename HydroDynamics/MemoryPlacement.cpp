@@ -0,0 +1,168 @@
+/*
+Title: HydroDynamics
+File Name: MemoryPlacement.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Where the memory of large arrays lives. On a machine with several NUMA nodes (like a dual
+socket server), memory attached to the other socket takes longer to reach, so the threads
+that work on a part of an array should run on the node that holds it. These functions pin
+threads to a node and move the pages of a range of memory to a node, which is the only way
+to place memory that was already touched when it was allocated (as a std::vector's is).
+
+Huge pages of 2 MB cover long arrays with far fewer TLB entries than 4 KB pages.
+adviseHugePages() asks for them for a range of memory that is already allocated.
+
+On Linux everything goes through sched_setaffinity, mbind and madvise. Windows can pin
+threads to a node, but has no way to move or enlarge pages after they were allocated, so
+the other two report that they didn't do anything. Everything is optional: a false result
+only means the memory stays where it is.
+*/
+
+#include "MemoryPlacement.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cstdio>
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+int numaNodeCount()
+{
+	ULONG highest = 0;
+	return GetNumaHighestNodeNumber(&highest) ? (int)highest + 1 : 1;
+}
+
+bool pinThreadToNode(std::thread& thread, int node)
+{
+	GROUP_AFFINITY affinity = {};
+	if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || affinity.Mask == 0)
+	{
+		return false;
+	}
+	return SetThreadGroupAffinity(thread.native_handle(), &affinity, nullptr) != 0;
+}
+
+bool moveToNode(void*, size_t, int)
+{
+	return false;
+}
+
+bool adviseHugePages(void*, size_t)
+{
+	return false;
+}
+#else
+// From linux/mempolicy.h, which isn't always installed.
+#define POLICY_PREFERRED 1
+#define POLICY_MOVE 2
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+int numaNodeCount()
+{
+	int nodes = 0;
+	while (true)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", nodes);
+		if (access(path, F_OK) != 0)
+		{
+			break;
+		}
+		nodes++;
+	}
+	return nodes > 0 ? nodes : 1;
+}
+
+bool pinThreadToNode(std::thread& thread, int node)
+{
+	// The cores of the node, as a list of ranges like "0-7,16-23".
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	int first, last, count = 0;
+	while (fscanf(file, "%d", &first) == 1)
+	{
+		last = first;
+		if (fscanf(file, "-%d", &last) != 1)
+		{
+			last = first;
+		}
+		for (int core = first; core <= last && core < CPU_SETSIZE; core++)
+		{
+			CPU_SET(core, &cores);
+			count++;
+		}
+		if (fgetc(file) != ',')
+		{
+			break;
+		}
+	}
+	fclose(file);
+	return count > 0 && pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores) == 0;
+}
+
+// The whole pages inside the range, rounded in to multiples of pageSize. Returns false if there are none.
+static bool innerPages(void* data, size_t bytes, size_t pageSize, uintptr_t& begin, uintptr_t& end)
+{
+	begin = ((uintptr_t)data + pageSize - 1) & ~(uintptr_t)(pageSize - 1);
+	end = ((uintptr_t)data + bytes) & ~(uintptr_t)(pageSize - 1);
+	return end > begin;
+}
+
+bool moveToNode(void* data, size_t bytes, int node)
+{
+	uintptr_t begin, end;
+	if (node < 0 || node >= 256 || !innerPages(data, bytes, (size_t)sysconf(_SC_PAGESIZE), begin, end))
+	{
+		return false;
+	}
+	unsigned long mask[256 / (8 * sizeof(unsigned long))] = {};
+	mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+	return syscall(SYS_mbind, (void*)begin, (unsigned long)(end - begin), POLICY_PREFERRED, mask, 256UL + 1, POLICY_MOVE) == 0;
+}
+
+bool adviseHugePages(void* data, size_t bytes)
+{
+	uintptr_t begin, end;
+	if (!innerPages(data, bytes, HUGE_PAGE_BYTES, begin, end))
+	{
+		return false;
+	}
+	return madvise((void*)begin, end - begin, MADV_HUGEPAGE) == 0;
+}
+#endif
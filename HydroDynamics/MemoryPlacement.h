@@ -0,0 +1,60 @@
+/*
+Title: HydroDynamics
+File Name: MemoryPlacement.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Where the memory of large arrays lives. On a machine with several NUMA nodes (like a dual
+socket server), memory attached to the other socket takes longer to reach, so the threads
+that work on a part of an array should run on the node that holds it. These functions pin
+threads to a node and move the pages of a range of memory to a node, which is the only way
+to place memory that was already touched when it was allocated (as a std::vector's is).
+
+Huge pages of 2 MB cover long arrays with far fewer TLB entries than 4 KB pages.
+adviseHugePages() asks for them for a range of memory that is already allocated.
+
+On Linux everything goes through sched_setaffinity, mbind and madvise. Windows can pin
+threads to a node, but has no way to move or enlarge pages after they were allocated, so
+the other two report that they didn't do anything. Everything is optional: a false result
+only means the memory stays where it is.
+*/
+
+#ifndef _MEMORY_PLACEMENT_H
+#define _MEMORY_PLACEMENT_H
+
+#include <cstddef>
+#include <thread>
+
+// NUMA nodes of this machine, 1 if it has none or we can't tell.
+int numaNodeCount();
+
+// Lets a thread run only on the cores of a node. Returns false if it couldn't.
+bool pinThreadToNode(std::thread& thread, int node);
+
+// Moves the pages inside [data, data + bytes) to a node, and makes it the node new pages of that range come from. Pages that are only
+// partly inside the range are left alone. Returns false if nothing could be moved.
+bool moveToNode(void* data, size_t bytes, int node);
+
+// Asks for the range to be backed by 2 MB pages, where the OS has transparent huge pages turned on. Returns false if it said no.
+bool adviseHugePages(void* data, size_t bytes);
+
+#endif // _MEMORY_PLACEMENT_H
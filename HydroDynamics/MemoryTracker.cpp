@@ -0,0 +1,211 @@
+/*
+Title: HydroDynamics
+File Name: MemoryTracker.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Counts every allocation the program makes with new and delete. The global operators are
+replaced in MemoryTracker.cpp, and every block gets a small header recording its size and
+the subsystem that was running when it was allocated, so the memory in use, the peak and
+the number of allocations can be told apart per subsystem.
+
+The subsystem is a tag per thread: setMemoryTag() sets the default of a thread, and
+MEMORY_SCOPE(tag) charges everything allocated in a block to another tag. Counting is a
+few relaxed atomic additions per allocation, so it is always on.
+
+Memory from malloc() and from the drivers isn't seen, only what goes through new.
+*/
+
+#include "MemoryTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Placed in front of every block. 16 bytes, so the block after it keeps the alignment malloc() gives it.
+struct alignas(16) BlockHeader
+{
+	size_t size;
+	int tag;
+};
+
+struct TagCounters
+{
+	std::atomic<long long> bytes{ 0 };
+	std::atomic<long long> peakBytes{ 0 };
+	std::atomic<long long> allocations{ 0 };
+	std::atomic<long long> blocks{ 0 };
+};
+
+// Zero initialized before any constructor runs, so allocations made by the constructors of other globals are counted too.
+static TagCounters tagCounters[MEMORY_TAG_COUNT];
+static std::atomic<long long> totalBytes{ 0 };
+static std::atomic<long long> totalPeakBytes{ 0 };
+static thread_local int threadTag = MEMORY_OTHER;
+static thread_local long long threadCount = 0;
+
+static const char* tagNames[MEMORY_TAG_COUNT] =
+{
+	"other",
+	"simulation",
+	"render",
+	"shaders",
+	"hud",
+	"capture"
+};
+
+static void raisePeak(std::atomic<long long>& peak, long long value)
+{
+	long long current = peak.load(std::memory_order_relaxed);
+	while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+static void* trackedAllocate(size_t size)
+{
+	BlockHeader* header = (BlockHeader*)malloc(sizeof(BlockHeader) + size);
+	if (header == nullptr)
+	{
+		return nullptr;
+	}
+	header->size = size;
+	header->tag = threadTag;
+	threadCount++;
+
+	TagCounters& counters = tagCounters[header->tag];
+	raisePeak(counters.peakBytes, counters.bytes.fetch_add((long long)size, std::memory_order_relaxed) + (long long)size);
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+	counters.blocks.fetch_add(1, std::memory_order_relaxed);
+	raisePeak(totalPeakBytes, totalBytes.fetch_add((long long)size, std::memory_order_relaxed) + (long long)size);
+	return header + 1;
+}
+
+static void trackedFree(void* block)
+{
+	if (block == nullptr)
+	{
+		return;
+	}
+	BlockHeader* header = (BlockHeader*)block - 1;
+	TagCounters& counters = tagCounters[header->tag];
+	counters.bytes.fetch_sub((long long)header->size, std::memory_order_relaxed);
+	counters.blocks.fetch_sub(1, std::memory_order_relaxed);
+	totalBytes.fetch_sub((long long)header->size, std::memory_order_relaxed);
+	free(header);
+}
+
+MemoryTag setMemoryTag(MemoryTag tag)
+{
+	MemoryTag previous = (MemoryTag)threadTag;
+	threadTag = tag;
+	return previous;
+}
+
+MemoryStats memoryStats(MemoryTag tag)
+{
+	MemoryStats stats = {};
+	if (tag != MEMORY_TAG_COUNT)
+	{
+		stats.bytes = tagCounters[tag].bytes.load(std::memory_order_relaxed);
+		stats.peakBytes = tagCounters[tag].peakBytes.load(std::memory_order_relaxed);
+		stats.allocations = tagCounters[tag].allocations.load(std::memory_order_relaxed);
+		stats.blocks = tagCounters[tag].blocks.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++)
+	{
+		stats.allocations += tagCounters[i].allocations.load(std::memory_order_relaxed);
+		stats.blocks += tagCounters[i].blocks.load(std::memory_order_relaxed);
+	}
+	stats.bytes = totalBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = totalPeakBytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+long long threadAllocations()
+{
+	return threadCount;
+}
+
+const char* memoryTagName(MemoryTag tag)
+{
+	return tag < MEMORY_TAG_COUNT ? tagNames[tag] : "all";
+}
+
+// The replaced operators. The aligned ones (for types with alignas above 16) are left to the library, which pairs them with its own
+// aligned delete, so they aren't counted.
+void* operator new(size_t size)
+{
+	void* block = trackedAllocate(size);
+	if (block == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAllocate(size);
+}
+
+void operator delete(void* block) noexcept
+{
+	trackedFree(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+	trackedFree(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+	trackedFree(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+	trackedFree(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept
+{
+	trackedFree(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept
+{
+	trackedFree(block);
+}
@@ -0,0 +1,88 @@
+/*
+Title: HydroDynamics
+File Name: MemoryTracker.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Counts every allocation the program makes with new and delete. The global operators are
+replaced in MemoryTracker.cpp, and every block gets a small header recording its size and
+the subsystem that was running when it was allocated, so the memory in use, the peak and
+the number of allocations can be told apart per subsystem.
+
+The subsystem is a tag per thread: setMemoryTag() sets the default of a thread, and
+MEMORY_SCOPE(tag) charges everything allocated in a block to another tag. Counting is a
+few relaxed atomic additions per allocation, so it is always on.
+
+Memory from malloc() and from the drivers isn't seen, only what goes through new.
+*/
+
+#ifndef _MEMORY_TRACKER_H
+#define _MEMORY_TRACKER_H
+
+// The subsystems that memory is charged to. Add new ones before MEMORY_TAG_COUNT and give them a name in MemoryTracker.cpp.
+enum MemoryTag
+{
+	MEMORY_OTHER = 0,	// Anything that isn't tagged, mostly the setup
+	MEMORY_SIMULATION,	// The simulation thread: the network, the fluid models and the snapshots
+	MEMORY_RENDER,		// Drawing the frame
+	MEMORY_SHADERS,		// Loading, compiling and reloading shaders
+	MEMORY_HUD,			// The text of the HUD and the profiler overlay
+	MEMORY_CAPTURE,		// Screenshots, recordings and video export
+	MEMORY_TAG_COUNT
+};
+
+struct MemoryStats
+{
+	long long bytes;		// In use right now
+	long long peakBytes;	// The most that was ever in use at once
+	long long allocations;	// Total number of allocations so far
+	long long blocks;		// Blocks in use right now
+};
+
+// Sets the tag of everything the calling thread allocates from now on, and returns the one it had.
+MemoryTag setMemoryTag(MemoryTag tag);
+
+// The totals of one tag, or with MEMORY_TAG_COUNT those of all of them together.
+MemoryStats memoryStats(MemoryTag tag = MEMORY_TAG_COUNT);
+
+// Allocations the calling thread has made so far. The difference between two frames is the allocations of the frame.
+long long threadAllocations();
+
+const char* memoryTagName(MemoryTag tag);
+
+// Charges everything allocated in the block it is declared in to another tag.
+struct MemoryScope
+{
+	MemoryTag previous;
+
+	explicit MemoryScope(MemoryTag tag) : previous(setMemoryTag(tag)) {}
+	~MemoryScope()
+	{
+		setMemoryTag(previous);
+	}
+};
+
+#define MEMORY_CONCAT_INNER(a, b) a##b
+#define MEMORY_CONCAT(a, b) MEMORY_CONCAT_INNER(a, b)
+#define MEMORY_SCOPE(tag) MemoryScope MEMORY_CONCAT(memoryScope, __LINE__)(tag)
+
+#endif // _MEMORY_TRACKER_H
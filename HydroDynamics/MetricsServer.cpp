@@ -0,0 +1,260 @@
+/*
+Title: HydroDynamics
+File Name: MetricsServer.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Serves live performance numbers over HTTP (--metrics-port PORT) in the Prometheus text
+format, which Prometheus and anything else that speaks OpenMetrics can scrape from
+http://host:PORT/metrics.
+
+A background thread answers every scrape. It only reads numbers that are kept in atomics:
+the frame history the profiler publishes (see profilerPublish() in Profiler.h), from which it
+works out the percentiles of every scope when it is asked, the memory of every subsystem (see
+MemoryTracker.h), and the gauges the program adds with gauge(), counter() and gauges(). The main loop
+never waits for it and never does more than a few relaxed stores for it, and none at all
+while the endpoint is off.
+*/
+
+#include "MetricsServer.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include "ThreadControl.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+// The percentiles of every profiled scope that go into a scrape.
+static const double quantiles[] = { 0.5, 0.9, 0.99 };
+
+MetricsServer::~MetricsServer()
+{
+	stop();
+}
+
+void MetricsServer::gauge(const char* name, const char* help, double(*read)())
+{
+	metrics.push_back({ name, help, "gauge", read });
+}
+
+void MetricsServer::counter(const char* name, const char* help, double(*read)())
+{
+	metrics.push_back({ name, help, "counter", read });
+}
+
+void MetricsServer::gauges(const char* name, const char* help, const char* label, const std::vector<std::string>* labels,
+	const std::atomic<float>* values)
+{
+	families.push_back({ name, help, label, labels, values });
+}
+
+bool MetricsServer::start(int port)
+{
+	stop();
+	if (!listener.listen(port))
+	{
+		return false;
+	}
+	profilerPublish();
+	stopping = false;
+	thread = std::thread(&MetricsServer::run, this);
+	return true;
+}
+
+void MetricsServer::stop()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+	stopping = true;
+	thread.join();
+	listener.close();
+}
+
+void MetricsServer::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	while (!stopping)
+	{
+		// Scrapers come every few seconds and don't stay, so they are answered one at a time.
+		LineConnection connection;
+		if (listener.accept(connection, METRICS_POLL_MILLISECONDS) && connection.setNonBlocking())
+		{
+			answer(connection);
+		}
+	}
+}
+
+// Reads the request up to the empty line that ends its header and answers it. Only GET /metrics (or /) is served.
+void MetricsServer::answer(LineConnection& connection)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(METRICS_REQUEST_MILLISECONDS);
+	std::string request;
+	std::string line;
+	bool ended = false;
+	while (!ended && connection.isOpen() && !stopping && std::chrono::steady_clock::now() < deadline)
+	{
+		if (!connection.pollLine(line))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (request.empty())
+		{
+			request = line;
+		}
+		ended = line.empty();
+	}
+	if (!ended)
+	{
+		connection.close();
+		return;
+	}
+
+	std::string status = "200 OK";
+	std::string body;
+	std::istringstream words(request);
+	std::string method, path;
+	words >> method >> path;
+	if (method != "GET" && method != "HEAD")
+	{
+		status = "405 Method Not Allowed";
+	}
+	else if (path != "/metrics" && path != "/")
+	{
+		status = "404 Not Found";
+	}
+	else
+	{
+		body = text();
+	}
+
+	std::ostringstream response;
+	response << "HTTP/1.1 " << status << "\r\n";
+	response << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+	response << "Content-Length: " << body.size() << "\r\n";
+	response << "Connection: close\r\n\r\n";
+	if (method != "HEAD")
+	{
+		response << body;
+	}
+
+	// The connection doesn't wait, so whatever it didn't take yet is sent again until it did, or until the scraper gave up.
+	std::string data = response.str();
+	size_t sent = 0;
+	while (sent < data.size() && !stopping && std::chrono::steady_clock::now() < deadline + std::chrono::milliseconds(METRICS_REQUEST_MILLISECONDS))
+	{
+		long long count = connection.sendSome(data.data() + sent, data.size() - sent);
+		if (count < 0)
+		{
+			break;
+		}
+		sent += (size_t)count;
+		if (count == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	connection.shutdown();
+	connection.close();
+}
+
+// Writes a number the way the format wants it, with enough digits that it reads back the same.
+static void writeValue(std::ostringstream& text, double value)
+{
+	char digits[32];
+	snprintf(digits, sizeof(digits), "%.17g", value);
+	text << digits << "\n";
+}
+
+std::string MetricsServer::text() const
+{
+	std::ostringstream text;
+
+	// Every scope of the profiler as percentiles over the frames in its history, with the slowest frame as quantile 1.
+	text << "# HELP hydro_scope_milliseconds Time spent in a profiled scope per frame, over the last frames.\n";
+	text << "# TYPE hydro_scope_milliseconds gauge\n";
+	float samples[PROFILE_HISTORY];
+	for (int id = 0; id < PROFILE_COUNT; id++)
+	{
+		int count = profilerPublishedHistory((ProfileId)id, samples);
+		if (count == 0)
+		{
+			continue;
+		}
+		std::sort(samples, samples + count);
+		const char* scope = profilerScope((ProfileId)id).name;
+		for (double quantile : quantiles)
+		{
+			text << "hydro_scope_milliseconds{scope=\"" << scope << "\",quantile=\"" << quantile << "\"} ";
+			writeValue(text, samples[std::min(count - 1, (int)(count * quantile))]);
+		}
+		text << "hydro_scope_milliseconds{scope=\"" << scope << "\",quantile=\"1\"} ";
+		writeValue(text, samples[count - 1]);
+	}
+	text << "# HELP hydro_frames_total Frames the window has drawn.\n";
+	text << "# TYPE hydro_frames_total counter\n";
+	text << "hydro_frames_total ";
+	writeValue(text, (double)profilerPublishedFrames());
+
+	text << "# HELP hydro_memory_bytes Memory allocated with new, per subsystem.\n";
+	text << "# TYPE hydro_memory_bytes gauge\n";
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+	{
+		text << "hydro_memory_bytes{subsystem=\"" << memoryTagName((MemoryTag)tag) << "\"} ";
+		writeValue(text, (double)memoryStats((MemoryTag)tag).bytes);
+	}
+	MemoryStats total = memoryStats();
+	text << "# HELP hydro_memory_peak_bytes The most memory that was ever allocated with new at once.\n";
+	text << "# TYPE hydro_memory_peak_bytes gauge\n";
+	text << "hydro_memory_peak_bytes ";
+	writeValue(text, (double)total.peakBytes);
+	text << "# HELP hydro_allocations_total Allocations made with new.\n";
+	text << "# TYPE hydro_allocations_total counter\n";
+	text << "hydro_allocations_total ";
+	writeValue(text, (double)total.allocations);
+
+	for (const Metric& metric : metrics)
+	{
+		text << "# HELP " << metric.name << " " << metric.help << "\n";
+		text << "# TYPE " << metric.name << " " << metric.type << "\n";
+		text << metric.name << " ";
+		writeValue(text, metric.read());
+	}
+	for (const Family& family : families)
+	{
+		text << "# HELP " << family.name << " " << family.help << "\n";
+		text << "# TYPE " << family.name << " gauge\n";
+		for (size_t i = 0; i < family.labels->size(); i++)
+		{
+			text << family.name << "{" << family.label << "=\"" << (*family.labels)[i] << "\"} ";
+			writeValue(text, family.values[i].load(std::memory_order_relaxed));
+		}
+	}
+	return text.str();
+}
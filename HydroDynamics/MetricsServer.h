@@ -0,0 +1,109 @@
+/*
+Title: HydroDynamics
+File Name: MetricsServer.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Serves live performance numbers over HTTP (--metrics-port PORT) in the Prometheus text
+format, which Prometheus and anything else that speaks OpenMetrics can scrape from
+http://host:PORT/metrics.
+
+A background thread answers every scrape. It only reads numbers that are kept in atomics:
+the frame history the profiler publishes (see profilerPublish() in Profiler.h), from which it
+works out the percentiles of every scope when it is asked, the memory of every subsystem (see
+MemoryTracker.h), and the gauges the program adds with gauge(), counter() and gauges(). The main loop
+never waits for it and never does more than a few relaxed stores for it, and none at all
+while the endpoint is off.
+*/
+
+#ifndef _METRICS_SERVER_H
+#define _METRICS_SERVER_H
+
+#include "LineSocket.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How long the thread waits for a scraper before checking whether it should stop, and how long a scraper gets to send its request.
+#define METRICS_POLL_MILLISECONDS 100
+#define METRICS_REQUEST_MILLISECONDS 1000
+
+class MetricsServer
+{
+public:
+	MetricsServer() {}
+	~MetricsServer();
+
+	MetricsServer(const MetricsServer&) = delete;
+	MetricsServer& operator=(const MetricsServer&) = delete;
+
+	// Adds a number to every scrape. read is called on the thread of the server, so it may only read atomics and things that
+	// don't change. Add them before start().
+	void gauge(const char* name, const char* help, double(*read)());
+	void counter(const char* name, const char* help, double(*read)());
+
+	// Adds a gauge for every one of labels, told apart by a label called label: name{label="labels[i]"} is values[i]. Both have to
+	// stay where they are while the server runs. Add them before start().
+	void gauges(const char* name, const char* help, const char* label, const std::vector<std::string>* labels, const std::atomic<float>* values);
+
+	// Listens on port, starts publishing the profiler history and starts the thread. Returns false (after printing an error) if the
+	// port can't be used.
+	bool start(int port);
+
+	// Stops the thread and disconnects the scraper, if one is connected.
+	void stop();
+
+	bool running() const { return thread.joinable(); }
+
+	// The text of a scrape.
+	std::string text() const;
+
+private:
+	struct Metric
+	{
+		const char* name;
+		const char* help;
+		const char* type;
+		double(*read)();
+	};
+
+	struct Family
+	{
+		const char* name;
+		const char* help;
+		const char* label;
+		const std::vector<std::string>* labels;
+		const std::atomic<float>* values;
+	};
+
+	void run();
+	void answer(LineConnection& connection);
+
+	LineListener listener;
+	std::vector<Metric> metrics;
+	std::vector<Family> families;
+	std::thread thread;
+	std::atomic<bool> stopping{ false };
+};
+
+#endif // _METRICS_SERVER_H
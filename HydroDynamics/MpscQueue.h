@@ -0,0 +1,114 @@
+/*
+Title: HydroDynamics
+File Name: MpscQueue.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A fixed size, lock-free queue for any number of producer threads and one consumer thread.
+
+Every slot carries a sequence number that says whose turn it is: a producer claims the next
+tail index with a compare-and-swap once the slot there says it is free, fills the slot and
+then publishes it by moving its sequence on with a release store. The consumer waits for
+that sequence before it reads the slot, and hands it back to the producers of the next lap
+the same way. A producer that stalls between claiming and publishing only holds up the
+consumer at its own slot, never the other producers. push() fails instead of waiting when the
+queue is full, so no producer ever blocks.
+*/
+
+#ifndef _MPSC_QUEUE_H
+#define _MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Capacity has to be a power of two, so the indices can wrap with a mask.
+template <typename T, size_t Capacity>
+class MpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "MpscQueue capacity must be a power of two");
+
+public:
+	MpscQueue()
+	{
+		for (size_t i = 0; i < Capacity; i++)
+		{
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// Any thread. Returns false (and drops the value) if the queue is full.
+	bool push(const T& value)
+	{
+		size_t tailIndex = tail.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Slot& slot = slots[tailIndex & (Capacity - 1)];
+			size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence == tailIndex)
+			{
+				// The slot is free in this lap; claim it, unless another producer got there first.
+				if (tail.compare_exchange_weak(tailIndex, tailIndex + 1, std::memory_order_relaxed))
+				{
+					slot.value = value;
+					slot.sequence.store(tailIndex + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (sequence < tailIndex)
+			{
+				// Still holding the value of the last lap, which the consumer hasn't read yet.
+				return false;
+			}
+			else
+			{
+				tailIndex = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Consumer only. Returns false if the queue is empty, or the next value is still being written.
+	bool pop(T& value)
+	{
+		Slot& slot = slots[head & (Capacity - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+		{
+			return false;
+		}
+		value = slot.value;
+		slot.sequence.store(head + Capacity, std::memory_order_release);
+		head++;
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	alignas(64) size_t head = 0;
+	Slot slots[Capacity];
+};
+
+#endif // _MPSC_QUEUE_H
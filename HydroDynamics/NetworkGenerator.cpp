@@ -0,0 +1,328 @@
+/*
+Title: HydroDynamics
+File Name: NetworkGenerator.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Builds synthetic networks of any size for load testing (--generate-scene), and writes them
+straight to the binary scene form (see Scene.h), so a benchmark of a million vessels doesn't
+need a text file of a million lines first. The same settings and seed give the same network
+every time.
+
+There are four kinds of network:
+
+	grid		a square lattice. A comb (the first row and every column) keeps it connected,
+				and the other tubes of the lattice are kept at random, as many as the
+				degree asks for, up to 4.
+	tree		a tree grown level by level, where every vessel has degree - 1 children on
+				average. It is laid out with its root at the top.
+	geometric	a random geometric graph: vessels scattered over a square, with a tube
+				between every two of them that are closer than the distance that gives the
+				degree on average. It can fall apart into pieces.
+	manifold	like a water main and its branches: a spanning tree of a random geometric
+				graph, grown from the vessel closest to the middle, with a few of its other
+				tubes kept to close loops, as many as the degree asks for. Pieces the
+				geometric graph doesn't reach stay on their own.
+
+Degree is the average number of tubes per vessel (of an inner vessel for a tree, since every
+tree has about two per vessel); 0 takes the default of the kind (4, 3, 6 and 2.6). The widths of the vessels are either uniform, width * (1 +- spread), or lognormal,
+width * exp(spread * a normal deviate), which gives a few big reservoirs among many narrow
+vessels. The vessels start filled to random heights, and the tubes of the geometric kinds get
+an inertance in proportion to their length.
+
+The random numbers come from a std::mt19937 turned into floats by hand, like those of a sweep,
+so a grid, a tree and uniform widths come out the same with every compiler. The lognormal
+widths and the distances also go through the math library, which may round differently.
+
+This file has no OpenGL dependency.
+*/
+
+#include "NetworkGenerator.h"
+#include "VesselNetwork.h"
+#include "Checkpoint.h"
+#include "TiledScene.h"
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// The default degrees, indexed by NetworkTopology.
+static const float defaultDegree[] = { 4.0f, 3.0f, 6.0f, 2.6f };
+
+// The geometric graph a manifold is cut from has this many tubes per vessel, enough that almost all of it is one piece.
+#define MANIFOLD_GRAPH_DEGREE 8.0f
+
+// A float in [0, 1) from the top 24 bits of the generator, which is exactly representable.
+static float randomUnit(std::mt19937& random)
+{
+	return (float)(random() >> 8) * (1.0f / 16777216.0f);
+}
+
+static float randomWidth(const GeneratorSettings& settings, std::mt19937& random)
+{
+	float u = randomUnit(random);
+	if (settings.widths == WIDTHS_UNIFORM)
+	{
+		return std::max(settings.width * (1.0f + settings.widthSpread * (2.0f * u - 1.0f)), settings.width * 0.01f);
+	}
+	// Box-Muller, with 1 - u so the logarithm never sees 0.
+	float normal = std::sqrt(-2.0f * std::log(1.0f - u)) * std::cos(6.2831853f * randomUnit(random));
+	return settings.width * std::exp(settings.widthSpread * normal);
+}
+
+// A tube between a and b, as long as the distance between them.
+static void addTubeOfLength(VesselNetwork& network, int a, int b, const std::vector<float>& x, const std::vector<float>& y, float spacing)
+{
+	float length = std::hypot(x[a] - x[b], y[a] - y[b]);
+	network.addTube(a, b, DEFAULT_TUBE_INERTANCE * std::max(length / spacing, 0.1f), DEFAULT_TUBE_DAMPING);
+}
+
+// Every pair of points closer than radius, each once, with the lower index first.
+static void closePairs(const std::vector<float>& x, const std::vector<float>& y, float radius, std::vector<std::pair<int, int>>& pairs)
+{
+	int count = (int)x.size();
+	SpatialGrid grid;
+	grid.build(x.data(), y.data(), x.data(), y.data(), count);
+	std::vector<int> found;
+	for (int i = 0; i < count; i++)
+	{
+		grid.query(x[i] - radius, y[i] - radius, x[i] + radius, y[i] + radius, found);
+		for (int j : found)
+		{
+			if (j > i && std::hypot(x[i] - x[j], y[i] - y[j]) < radius)
+			{
+				pairs.push_back({ i, j });
+			}
+		}
+	}
+}
+
+static void generateGrid(const GeneratorSettings& settings, float degree, float spacing, std::mt19937& random, VesselNetwork& network)
+{
+	int columns = std::max(1, (int)std::ceil(std::sqrt((double)settings.vessels)));
+	for (int i = 0; i < settings.vessels; i++)
+	{
+		network.addVessel((i % columns) * spacing, -(i / columns) * spacing, randomWidth(settings, random), 0.2f + 0.6f * randomUnit(random));
+	}
+
+	// The comb has a tube per vessel, two per vessel on average, and every other tube of the lattice adds two more.
+	float keep = std::min(std::max((degree - 2.0f) * 0.5f, 0.0f), 1.0f);
+	for (int i = 0; i < settings.vessels; i++)
+	{
+		int column = i % columns;
+		if (i >= columns)
+		{
+			network.addTube(i - columns, i);
+		}
+		if (column > 0 && (i < columns || randomUnit(random) < keep))
+		{
+			network.addTube(i - 1, i);
+		}
+	}
+}
+
+static void generateTree(const GeneratorSettings& settings, float degree, float spacing, std::mt19937& random, VesselNetwork& network)
+{
+	// Every vessel of a level has its children on the next, so the levels are stretches of the numbering.
+	float children = std::max(degree - 1.0f, 1.0f);
+	std::vector<int> parent(settings.vessels, -1);
+	std::vector<int> level(settings.vessels, 0);
+	int next = 1;
+	for (int i = 0; i < settings.vessels && next < settings.vessels; i++)
+	{
+		int count = (int)(children + randomUnit(random));
+		for (int c = 0; c < count && next < settings.vessels; c++)
+		{
+			parent[next] = i;
+			level[next] = level[i] + 1;
+			next++;
+		}
+		// A vessel without children would end the tree early if it were the last one of its level.
+		if (count == 0 && i + 1 == next)
+		{
+			parent[next] = i;
+			level[next] = level[i] + 1;
+			next++;
+		}
+	}
+
+	int start = 0;
+	while (start < settings.vessels)
+	{
+		int end = start;
+		while (end < settings.vessels && level[end] == level[start])
+		{
+			end++;
+		}
+		for (int i = start; i < end; i++)
+		{
+			float x = (i - start - (end - start - 1) * 0.5f) * spacing;
+			network.addVessel(x, -level[i] * spacing, randomWidth(settings, random), 0.2f + 0.6f * randomUnit(random));
+		}
+		start = end;
+	}
+	for (int i = 1; i < settings.vessels; i++)
+	{
+		network.addTube(parent[i], i);
+	}
+}
+
+static void generateGeometric(const GeneratorSettings& settings, float degree, float spacing, std::mt19937& random, VesselNetwork& network)
+{
+	// Scattered over a square with one vessel per spacing^2, a disk of this radius holds degree other vessels on average.
+	float side = std::sqrt((float)settings.vessels) * spacing;
+	std::vector<float> x(settings.vessels);
+	std::vector<float> y(settings.vessels);
+	for (int i = 0; i < settings.vessels; i++)
+	{
+		x[i] = randomUnit(random) * side;
+		y[i] = -randomUnit(random) * side;
+	}
+
+	bool manifold = settings.topology == TOPOLOGY_MANIFOLD;
+	if (manifold)
+	{
+		// The main starts in the middle, and the piston sits on it.
+		int middle = 0;
+		for (int i = 1; i < settings.vessels; i++)
+		{
+			if (std::hypot(x[i] - side * 0.5f, y[i] + side * 0.5f) < std::hypot(x[middle] - side * 0.5f, y[middle] + side * 0.5f))
+			{
+				middle = i;
+			}
+		}
+		std::swap(x[0], x[middle]);
+		std::swap(y[0], y[middle]);
+	}
+	for (int i = 0; i < settings.vessels; i++)
+	{
+		network.addVessel(x[i], y[i], randomWidth(settings, random), 0.2f + 0.6f * randomUnit(random));
+	}
+
+	float graphDegree = manifold ? MANIFOLD_GRAPH_DEGREE : degree;
+	std::vector<std::pair<int, int>> pairs;
+	closePairs(x, y, spacing * std::sqrt(graphDegree / 3.14159265f), pairs);
+	if (!manifold)
+	{
+		for (const std::pair<int, int>& pair : pairs)
+		{
+			addTubeOfLength(network, pair.first, pair.second, x, y, spacing);
+		}
+		return;
+	}
+
+	// A breadth first search from the middle keeps the tubes of a spanning tree, which gives the main with its branches.
+	std::vector<int> start(settings.vessels + 1, 0);
+	for (const std::pair<int, int>& pair : pairs)
+	{
+		start[pair.first + 1]++;
+		start[pair.second + 1]++;
+	}
+	for (int i = 0; i < settings.vessels; i++)
+	{
+		start[i + 1] += start[i];
+	}
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	std::vector<int> neighbor(pairs.size() * 2);
+	std::vector<int> pairOf(pairs.size() * 2);
+	for (size_t p = 0; p < pairs.size(); p++)
+	{
+		neighbor[fill[pairs[p].first]] = pairs[p].second;
+		pairOf[fill[pairs[p].first]++] = (int)p;
+		neighbor[fill[pairs[p].second]] = pairs[p].first;
+		pairOf[fill[pairs[p].second]++] = (int)p;
+	}
+
+	std::vector<char> visited(settings.vessels, 0);
+	std::vector<char> inTree(pairs.size(), 0);
+	std::vector<int> queue;
+	queue.reserve(settings.vessels);
+	queue.push_back(0);
+	visited[0] = 1;
+	for (size_t q = 0; q < queue.size(); q++)
+	{
+		int v = queue[q];
+		for (int e = start[v]; e < start[v + 1]; e++)
+		{
+			if (!visited[neighbor[e]])
+			{
+				visited[neighbor[e]] = 1;
+				inTree[pairOf[e]] = 1;
+				queue.push_back(neighbor[e]);
+			}
+		}
+	}
+
+	// The tree has about two tubes per vessel. The others close loops, each adding two more.
+	double others = (double)pairs.size() - (double)(queue.size() - 1);
+	double loops = std::max(0.0, (degree - 2.0) * 0.5 * settings.vessels);
+	float keep = others > 0.0 ? (float)std::min(loops / others, 1.0) : 0.0f;
+	for (size_t p = 0; p < pairs.size(); p++)
+	{
+		if (inTree[p] || randomUnit(random) < keep)
+		{
+			addTubeOfLength(network, pairs[p].first, pairs[p].second, x, y, spacing);
+		}
+	}
+}
+
+void generateNetwork(const GeneratorSettings& settings, VesselNetwork& network)
+{
+	network.clear();
+	std::mt19937 random(settings.seed);
+	float degree = settings.degree > 0.0f ? settings.degree : defaultDegree[settings.topology];
+	float spacing = settings.width * GENERATOR_SPACING;
+	switch (settings.topology)
+	{
+	case TOPOLOGY_GRID:
+		generateGrid(settings, degree, spacing, random, network);
+		break;
+	case TOPOLOGY_TREE:
+		generateTree(settings, degree, spacing, random, network);
+		break;
+	case TOPOLOGY_GEOMETRIC:
+	case TOPOLOGY_MANIFOLD:
+		generateGeometric(settings, degree, spacing, random, network);
+		break;
+	}
+}
+
+bool generateScene(const GeneratorSettings& settings, const std::string& fileName, float tileSize, VesselOrder order)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	VesselNetwork network;
+	generateNetwork(settings, network);
+	CheckpointInfo info;
+	if (order != ORDER_AS_LOADED)
+	{
+		std::vector<int> newOrder;
+		vesselOrder(network, order, newOrder);
+		reorderNetwork(network, newOrder);
+		info.pistonVessel = (int)(std::find(newOrder.begin(), newOrder.end(), 0) - newOrder.begin());
+	}
+	std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+	std::cout << "Generated " << network.vesselCount() << " vessels and " << network.tubeCount() << " tubes in " << took.count() << " ms, "
+		<< 2.0 * network.tubeCount() / std::max(network.vesselCount(), 1) << " tubes per vessel" << std::endl;
+	return tileSize > 0.0f ? writeTiledScene(fileName, network, info, tileSize) : writeCheckpoint(fileName, network, info);
+}
@@ -0,0 +1,103 @@
+/*
+Title: HydroDynamics
+File Name: NetworkGenerator.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Builds synthetic networks of any size for load testing (--generate-scene), and writes them
+straight to the binary scene form (see Scene.h), so a benchmark of a million vessels doesn't
+need a text file of a million lines first. The same settings and seed give the same network
+every time.
+
+There are four kinds of network:
+
+	grid		a square lattice. A comb (the first row and every column) keeps it connected,
+				and the other tubes of the lattice are kept at random, as many as the
+				degree asks for, up to 4.
+	tree		a tree grown level by level, where every vessel has degree - 1 children on
+				average. It is laid out with its root at the top.
+	geometric	a random geometric graph: vessels scattered over a square, with a tube
+				between every two of them that are closer than the distance that gives the
+				degree on average. It can fall apart into pieces.
+	manifold	like a water main and its branches: a spanning tree of a random geometric
+				graph, grown from the vessel closest to the middle, with a few of its other
+				tubes kept to close loops, as many as the degree asks for. Pieces the
+				geometric graph doesn't reach stay on their own.
+
+Degree is the average number of tubes per vessel (of an inner vessel for a tree, since every
+tree has about two per vessel); 0 takes the default of the kind (4, 3, 6 and 2.6). The widths of the vessels are either uniform, width * (1 +- spread), or lognormal,
+width * exp(spread * a normal deviate), which gives a few big reservoirs among many narrow
+vessels. The vessels start filled to random heights, and the tubes of the geometric kinds get
+an inertance in proportion to their length.
+
+The random numbers come from a std::mt19937 turned into floats by hand, like those of a sweep,
+so a grid, a tree and uniform widths come out the same with every compiler. The lognormal
+widths and the distances also go through the math library, which may round differently.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _NETWORK_GENERATOR_H
+#define _NETWORK_GENERATOR_H
+
+#include "NetworkOrder.h"
+#include <string>
+
+struct VesselNetwork;
+
+enum NetworkTopology
+{
+	TOPOLOGY_GRID = 0,
+	TOPOLOGY_TREE,
+	TOPOLOGY_GEOMETRIC,
+	TOPOLOGY_MANIFOLD
+};
+
+enum WidthDistribution
+{
+	WIDTHS_UNIFORM = 0,
+	WIDTHS_LOGNORMAL
+};
+
+// Vessels are this many of their mean widths apart.
+#define GENERATOR_SPACING 3.0f
+
+struct GeneratorSettings
+{
+	NetworkTopology topology = TOPOLOGY_GRID;
+	int vessels = 1000;
+	unsigned seed = 1;
+	float degree = 0.0f;			// Tubes per vessel on average, or 0 for the default of the topology
+	WidthDistribution widths = WIDTHS_UNIFORM;
+	float width = 0.1f;				// The mean width of a uniform distribution, the median of a lognormal one
+	float widthSpread = 0.5f;		// How far the widths spread around it
+};
+
+// Replaces the contents of network with a generated one.
+void generateNetwork(const GeneratorSettings& settings, VesselNetwork& network);
+
+// Generates a network and writes it to fileName in the binary form, or cut into tiles of tileSize if that is above 0, with the
+// vessels renumbered in order first. The piston sits on vessel 0 (the corner of a grid, the root of a tree or a manifold). Returns false if the
+// file can't be written.
+bool generateScene(const GeneratorSettings& settings, const std::string& fileName, float tileSize = 0.0f, VesselOrder order = ORDER_AS_LOADED);
+
+#endif // _NETWORK_GENERATOR_H
@@ -0,0 +1,220 @@
+/*
+Title: HydroDynamics
+File Name: NetworkLod.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Summaries of a network for drawing it from far away, when there are far more vessels on
+screen than pixels to show them with. The plane the vessels stand on is cut into square
+tiles, and every tile gives one bar: from the lowest floor of its vessels up to their
+average level, weighted by their width. Tiles are grouped into levels, where a tile of
+level k + 1 covers 2 x 2 tiles of level k, up to a single tile for the whole network.
+
+Given how large a pixel is, levelFor() picks the finest level whose tiles are still a few
+pixels across, so the number of bars that can be on screen only depends on the size of the
+window. A vessel belongs to the tile its center is in, on every level. When its level moves,
+update() adds the change to its tile on every level, so a frame costs time in proportion to
+the vessels that moved, times the number of levels, and nothing for the ones at rest.
+
+This file has no OpenGL dependency.
+*/
+
+#include "NetworkLod.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+void NetworkLod::build(const VesselNetwork& network)
+{
+	int vessels = network.vesselCount();
+	levels.clear();
+	leafColumn.resize(vessels);
+	leafRow.resize(vessels);
+	vesselWidth.resize(vessels);
+	lastTop = network.top;
+
+	// The tiles start at about the width of a vessel, and grow until there aren't too many of them.
+	float lowX = FLT_MAX, lowY = FLT_MAX, highX = -FLT_MAX, highY = -FLT_MAX;
+	double totalWidth = 0.0;
+	widestVessel = 0.0f;
+	fullHeight = 0.0f;
+	for (int i = 0; i < vessels; i++)
+	{
+		float center = 0.5f * (network.left[i] + network.right[i]);
+		vesselWidth[i] = network.right[i] - network.left[i];
+		lowX = std::min(lowX, center);
+		highX = std::max(highX, center);
+		lowY = std::min(lowY, network.bottom[i]);
+		highY = std::max(highY, network.bottom[i]);
+		totalWidth += vesselWidth[i];
+		widestVessel = std::max(widestVessel, vesselWidth[i]);
+		fullHeight = std::max(fullHeight, network.top[i] - network.bottom[i]);
+	}
+	if (vessels == 0)
+	{
+		lowX = lowY = highX = highY = 0.0f;
+	}
+	originX = lowX;
+	originY = lowY;
+	meanWidth = vessels > 0 ? (float)(totalWidth / vessels) : 0.0f;
+	fullHeight = std::max(fullHeight, FLT_MIN);
+
+	float size = std::max({ meanWidth, (highX - lowX) / LOD_MAX_LEAF_TILES, (highY - lowY) / LOD_MAX_LEAF_TILES, FLT_MIN });
+	int columns, rows;
+	for (;;)
+	{
+		columns = (int)((highX - lowX) / size) + 1;
+		rows = (int)((highY - lowY) / size) + 1;
+		if ((long long)columns * rows <= LOD_MAX_LEAF_TILES)
+		{
+			break;
+		}
+		size *= 2.0f;
+	}
+
+	for (int i = 0; i < vessels; i++)
+	{
+		float center = 0.5f * (network.left[i] + network.right[i]);
+		leafColumn[i] = std::min((int)((center - originX) / size), columns - 1);
+		leafRow[i] = std::min((int)((network.bottom[i] - originY) / size), rows - 1);
+	}
+
+	// Every level halves the tiles of the one below it, down to a single tile.
+	for (;;)
+	{
+		Level level;
+		level.columns = columns;
+		level.rows = rows;
+		level.tileSize = size;
+		int tiles = columns * rows;
+		level.width.assign(tiles, 0.0);
+		level.widthBottom.assign(tiles, 0.0);
+		level.widthTop.assign(tiles, 0.0);
+		level.left.assign(tiles, FLT_MAX);
+		level.right.assign(tiles, -FLT_MAX);
+		level.floor.assign(tiles, FLT_MAX);
+
+		int shift = (int)levels.size();
+		for (int i = 0; i < vessels; i++)
+		{
+			int tile = (leafRow[i] >> shift) * columns + (leafColumn[i] >> shift);
+			level.width[tile] += vesselWidth[i];
+			level.widthBottom[tile] += (double)vesselWidth[i] * network.bottom[i];
+			level.widthTop[tile] += (double)vesselWidth[i] * network.top[i];
+			level.left[tile] = std::min(level.left[tile], network.left[i]);
+			level.right[tile] = std::max(level.right[tile], network.right[i]);
+			level.floor[tile] = std::min(level.floor[tile], network.bottom[i]);
+		}
+		levels.push_back(std::move(level));
+
+		if (columns == 1 && rows == 1)
+		{
+			break;
+		}
+		columns = (columns + 1) / 2;
+		rows = (rows + 1) / 2;
+		size *= 2.0f;
+	}
+}
+
+bool NetworkLod::update(const std::vector<float>& top)
+{
+	if (top.size() != lastTop.size())
+	{
+		return false;
+	}
+
+	bool changed = false;
+	int count = (int)top.size();
+	int levelTotal = (int)levels.size();
+	for (int i = 0; i < count; i++)
+	{
+		if (top[i] == lastTop[i])
+		{
+			continue;
+		}
+		double change = (double)vesselWidth[i] * ((double)top[i] - lastTop[i]);
+		lastTop[i] = top[i];
+		changed = true;
+		for (int k = 0; k < levelTotal; k++)
+		{
+			Level& level = levels[k];
+			level.widthTop[(leafRow[i] >> k) * level.columns + (leafColumn[i] >> k)] += change;
+		}
+	}
+	return changed;
+}
+
+int NetworkLod::levelFor(float pixelSize) const
+{
+	float smallest = LOD_TILE_PIXELS * pixelSize;
+	if (levels.empty() || meanWidth >= smallest)
+	{
+		return -1;
+	}
+	for (int k = 0; k < (int)levels.size(); k++)
+	{
+		if (levels[k].tileSize >= smallest)
+		{
+			return k;
+		}
+	}
+	return (int)levels.size() - 1;
+}
+
+void NetworkLod::query(int level, float x0, float x1, float y1, std::vector<LodTile>& result) const
+{
+	result.clear();
+	if (level < 0 || level >= (int)levels.size())
+	{
+		return;
+	}
+
+	// A vessel can stick out of its tile by up to half its width, so the columns are widened by the widest one. The clamping is
+	// done in float, since the view can be far larger than an int.
+	const Level& tiles = levels[level];
+	float size = tiles.tileSize;
+	float margin = widestVessel;
+	int c0 = (int)std::min(std::max(std::floor((x0 - margin - originX) / size), 0.0f), (float)tiles.columns);
+	int c1 = (int)std::min(std::floor((x1 + margin - originX) / size), (float)(tiles.columns - 1));
+	int r1 = (int)std::min(std::floor((y1 - originY) / size), (float)(tiles.rows - 1));
+	for (int r = 0; r <= r1; r++)
+	{
+		for (int c = c0; c <= c1; c++)
+		{
+			int tile = r * tiles.columns + c;
+			double width = tiles.width[tile];
+			if (width <= 0.0 || tiles.right[tile] < x0 || tiles.left[tile] > x1 || tiles.floor[tile] > y1)
+			{
+				continue;
+			}
+
+			LodTile bar;
+			bar.left = tiles.left[tile];
+			bar.right = tiles.right[tile];
+			bar.bottom = tiles.floor[tile];
+			bar.top = (float)(tiles.widthTop[tile] / width);
+			bar.fill = (float)((tiles.widthTop[tile] - tiles.widthBottom[tile]) / width) / fullHeight;
+			result.push_back(bar);
+		}
+	}
+}
@@ -0,0 +1,109 @@
+/*
+Title: HydroDynamics
+File Name: NetworkLod.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Summaries of a network for drawing it from far away, when there are far more vessels on
+screen than pixels to show them with. The plane the vessels stand on is cut into square
+tiles, and every tile gives one bar: from the lowest floor of its vessels up to their
+average level, weighted by their width. Tiles are grouped into levels, where a tile of
+level k + 1 covers 2 x 2 tiles of level k, up to a single tile for the whole network.
+
+Given how large a pixel is, levelFor() picks the finest level whose tiles are still a few
+pixels across, so the number of bars that can be on screen only depends on the size of the
+window. A vessel belongs to the tile its center is in, on every level. When its level moves,
+update() adds the change to its tile on every level, so a frame costs time in proportion to
+the vessels that moved, times the number of levels, and nothing for the ones at rest.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _NETWORK_LOD_H
+#define _NETWORK_LOD_H
+
+#include <vector>
+
+struct VesselNetwork;
+
+// The finest level never has more tiles than this.
+#define LOD_MAX_LEAF_TILES 262144
+
+// Vessels and tiles narrower than this many pixels are too small to draw one by one.
+#define LOD_TILE_PIXELS 4.0f
+
+// The bar drawn for one tile, and how full its vessels are on average, relative to the tallest column of the network when the
+// summaries were built.
+struct LodTile
+{
+	float left;
+	float bottom;
+	float right;
+	float top;
+	float fill;
+};
+
+class NetworkLod
+{
+public:
+	// Builds the tiles of every level over the vessels of the network, and fills them from network.top.
+	void build(const VesselNetwork& network);
+
+	// Brings the average levels up to date with top (one per vessel), touching only the vessels whose top changed since the last
+	// call. Returns true if any did.
+	bool update(const std::vector<float>& top);
+
+	// The level to draw when a pixel is pixelSize across, or -1 if the vessels are large enough to be drawn themselves.
+	int levelFor(float pixelSize) const;
+
+	// Replaces result with the bars of the tiles of a level that hold vessels and can be seen in the view from x0 to x1 whose top
+	// is at y1: those that overlap it in x and whose floor is below its top.
+	void query(int level, float x0, float x1, float y1, std::vector<LodTile>& result) const;
+
+	int levelCount() const { return (int)levels.size(); }
+
+private:
+	struct Level
+	{
+		int columns = 0;
+		int rows = 0;
+		float tileSize = 1.0f;
+		std::vector<double> width;			// Per tile, the width of its vessels together, and the sum of their floors and tops
+		std::vector<double> widthBottom;	// times their widths, which the averages are taken from
+		std::vector<double> widthTop;
+		std::vector<float> left;			// The walls of its leftmost and rightmost vessels, and its lowest floor
+		std::vector<float> right;
+		std::vector<float> floor;
+	};
+
+	float originX = 0.0f;
+	float originY = 0.0f;
+	float meanWidth = 0.0f;
+	float widestVessel = 0.0f;
+	float fullHeight = 1.0f;
+	std::vector<Level> levels;
+	std::vector<int> leafColumn;		// Per vessel, the tile of the finest level it belongs to
+	std::vector<int> leafRow;
+	std::vector<float> vesselWidth;
+	std::vector<float> lastTop;
+};
+
+#endif // _NETWORK_LOD_H
@@ -0,0 +1,311 @@
+/*
+Title: HydroDynamics
+File Name: NetworkOrder.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Renumbers the vessels of a network so the ones connected by tubes are close to each other in
+memory. Vessels loaded from a scene come in whatever order the file lists them, so the two
+ends of a tube can be anywhere in the arrays and the step reads them at random. After
+reordering, the tubes of a vessel mostly lead to vessels a few entries away, which are
+already in the cache.
+
+Two orders are offered. Reverse Cuthill-McKee only looks at the tubes: it numbers every
+component breadth first from a vessel at its edge, visiting the neighbors with the fewest
+tubes first, and then reverses the whole order, which keeps the spread of the neighbor
+numbers (the bandwidth) small. The Hilbert order only looks at where the vessels are: it
+sorts them along a Hilbert curve through the bounding box of the scene, which keeps
+vessels that are close on screen close in memory, without having to follow the tubes.
+
+The tubes are sorted by their lower end afterwards, so the step walks the tubes in about
+the same order as the vessels.
+*/
+
+#include "NetworkOrder.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// The neighbors of every vessel in compressed form, like VesselNetwork::vesselTubes but with the vessel at the other end, so this
+// works on a network whose topology hasn't been built yet.
+static void neighborLists(const VesselNetwork& network, std::vector<int>& start, std::vector<int>& neighbors)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	start.assign(vessels + 1, 0);
+	for (int t = 0; t < tubes; t++)
+	{
+		start[network.tubeA[t] + 1]++;
+		start[network.tubeB[t] + 1]++;
+	}
+	for (int i = 0; i < vessels; i++)
+	{
+		start[i + 1] += start[i];
+	}
+	neighbors.resize(start[vessels]);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (int t = 0; t < tubes; t++)
+	{
+		neighbors[fill[network.tubeA[t]]++] = network.tubeB[t];
+		neighbors[fill[network.tubeB[t]]++] = network.tubeA[t];
+	}
+}
+
+// Numbers the component of first breadth first, appending to order, and returns the last vessel it reached (the one farthest from
+// first). With sorted set, the neighbors of every vessel are visited from the fewest tubes to the most. level marks the vessels that
+// were reached, with the number of this walk.
+static int walkBreadthFirst(int first, const std::vector<int>& start, const std::vector<int>& neighbors, std::vector<int>& level, int walk,
+	bool sorted, std::vector<int>& order)
+{
+	size_t head = order.size();
+	order.push_back(first);
+	level[first] = walk;
+	while (head < order.size())
+	{
+		int i = order[head++];
+		size_t added = order.size();
+		for (int k = start[i]; k < start[i + 1]; k++)
+		{
+			int j = neighbors[k];
+			if (level[j] != walk)
+			{
+				level[j] = walk;
+				order.push_back(j);
+			}
+		}
+		if (sorted)
+		{
+			std::stable_sort(order.begin() + added, order.end(), [&](int x, int y) { return start[x + 1] - start[x] < start[y + 1] - start[y]; });
+		}
+	}
+	return order.back();
+}
+
+static void cuthillMcKeeOrder(const VesselNetwork& network, std::vector<int>& order)
+{
+	int vessels = network.vesselCount();
+	std::vector<int> start;
+	std::vector<int> neighbors;
+	neighborLists(network, start, neighbors);
+
+	// Every walk gets its own number in level, so nothing has to be cleared between them.
+	std::vector<int> level(vessels, -1);
+	std::vector<int> scratch;
+	int walk = 0;
+	order.clear();
+	order.reserve(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		if (level[i] >= 0)
+		{
+			continue;
+		}
+
+		// Walking twice from the lowest vessel of a component lands on a vessel about as far from everything as there is, which
+		// is where the numbering starts.
+		scratch.clear();
+		int far = walkBreadthFirst(i, start, neighbors, level, walk++, false, scratch);
+		scratch.clear();
+		far = walkBreadthFirst(far, start, neighbors, level, walk++, false, scratch);
+
+		walkBreadthFirst(far, start, neighbors, level, walk++, true, order);
+	}
+	std::reverse(order.begin(), order.end());
+}
+
+// The distance along a Hilbert curve through a grid of n * n cells (n a power of two) of the cell (x, y).
+static uint64_t hilbertDistance(uint32_t n, uint32_t x, uint32_t y)
+{
+	uint64_t distance = 0;
+	for (uint32_t s = n / 2; s > 0; s /= 2)
+	{
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		distance += (uint64_t)s * s * ((3 * rx) ^ ry);
+
+		// Rotate the quadrant, so the curve inside it starts where the last one ended.
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return distance;
+}
+
+static void hilbertOrder(const VesselNetwork& network, std::vector<int>& order)
+{
+	int vessels = network.vesselCount();
+	std::vector<float> x(vessels);
+	std::vector<float> y(vessels);
+	float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+	for (int i = 0; i < vessels; i++)
+	{
+		x[i] = (network.left[i] + network.right[i]) * 0.5f;
+		y[i] = network.bottom[i];
+		minX = std::min(minX, x[i]);
+		maxX = std::max(maxX, x[i]);
+		minY = std::min(minY, y[i]);
+		maxY = std::max(maxY, y[i]);
+	}
+
+	// One scale for both axes, so the cells are square and the curve doesn't favor one direction.
+	const uint32_t cells = 1u << HILBERT_ORDER_BITS;
+	float extent = std::max(maxX - minX, maxY - minY);
+	float scale = extent > 0.0f ? (cells - 1) / extent : 0.0f;
+	std::vector<uint64_t> distance(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		uint32_t cx = std::min(cells - 1, (uint32_t)((x[i] - minX) * scale));
+		uint32_t cy = std::min(cells - 1, (uint32_t)((y[i] - minY) * scale));
+		distance[i] = hilbertDistance(cells, cx, cy);
+	}
+
+	order.resize(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return distance[a] < distance[b]; });
+}
+
+void vesselOrder(const VesselNetwork& network, VesselOrder kind, std::vector<int>& order)
+{
+	if (kind == ORDER_CUTHILL_MCKEE)
+	{
+		cuthillMcKeeOrder(network, order);
+		return;
+	}
+	if (kind == ORDER_HILBERT)
+	{
+		hilbertOrder(network, order);
+		return;
+	}
+	order.resize(network.vesselCount());
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		order[i] = i;
+	}
+}
+
+// Replaces values with values[order[0]], values[order[1]], ...
+template <typename T>
+static void permute(std::vector<T>& values, const std::vector<int>& order, std::vector<T>& scratch)
+{
+	scratch.resize(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		scratch[i] = values[order[i]];
+	}
+	values.swap(scratch);
+}
+
+void reorderNetwork(VesselNetwork& network, const std::vector<int>& order)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+
+	std::vector<float> scratch;
+	std::vector<int> intScratch;
+	permute(network.height, order, scratch);
+	permute(network.width, order, scratch);
+	permute(network.pressure, order, scratch);
+	permute(network.externalPressure, order, scratch);
+	permute(network.left, order, scratch);
+	permute(network.right, order, scratch);
+	permute(network.bottom, order, scratch);
+	permute(network.top, order, scratch);
+	permute(network.delta, order, scratch);
+	permute(network.degree, order, intScratch);
+	for (std::vector<float>& layer : network.layerHeight)
+	{
+		permute(layer, order, scratch);
+	}
+	if (network.profiled())
+	{
+		permute(network.vesselProfile, order, intScratch);
+	}
+
+	// Point the tubes at the new indices, then sort them by their lower end (and their upper end after that). The ends keep
+	// their sides, since the flow of a tube runs from B to A.
+	std::vector<int> newIndex(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		newIndex[order[i]] = i;
+	}
+	for (int t = 0; t < tubes; t++)
+	{
+		network.tubeA[t] = newIndex[network.tubeA[t]];
+		network.tubeB[t] = newIndex[network.tubeB[t]];
+	}
+	std::vector<int> tubeOrder(tubes);
+	for (int t = 0; t < tubes; t++)
+	{
+		tubeOrder[t] = t;
+	}
+	const std::vector<int>& a = network.tubeA;
+	const std::vector<int>& b = network.tubeB;
+	std::stable_sort(tubeOrder.begin(), tubeOrder.end(), [&](int x, int y)
+	{
+		int lowX = std::min(a[x], b[x]), lowY = std::min(a[y], b[y]);
+		return lowX != lowY ? lowX < lowY : std::max(a[x], b[x]) < std::max(a[y], b[y]);
+	});
+	permute(network.tubeA, tubeOrder, intScratch);
+	permute(network.tubeB, tubeOrder, intScratch);
+	permute(network.tubeInvInertance, tubeOrder, scratch);
+	permute(network.tubeDamping, tubeOrder, scratch);
+	permute(network.tubeFlow, tubeOrder, scratch);
+	if (network.hasComponents())
+	{
+		permute(network.tubeComponent, tubeOrder, intScratch);
+		permute(network.tubeSetting, tubeOrder, scratch);
+		permute(network.tubeBaseInvInertance, tubeOrder, scratch);
+		permute(network.tubeBaseDamping, tubeOrder, scratch);
+		std::vector<int> newTube(tubes);
+		for (int t = 0; t < tubes; t++)
+		{
+			newTube[tubeOrder[t]] = t;
+		}
+		network.schedule.renumber(newTube);
+	}
+
+	// Everything derived from the order is rebuilt, and the precise state is copied again from the floats.
+	network.vesselHandles.clear();
+	network.tubeHandles.clear();
+	network.topologyDirty = true;
+	network.preciseDirty = true;
+}
+
+double averageTubeSpan(const VesselNetwork& network)
+{
+	double sum = 0.0;
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		sum += std::abs(network.tubeA[t] - network.tubeB[t]);
+	}
+	return network.tubeCount() > 0 ? sum / network.tubeCount() : 0.0;
+}
@@ -0,0 +1,71 @@
+/*
+Title: HydroDynamics
+File Name: NetworkOrder.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Renumbers the vessels of a network so the ones connected by tubes are close to each other in
+memory. Vessels loaded from a scene come in whatever order the file lists them, so the two
+ends of a tube can be anywhere in the arrays and the step reads them at random. After
+reordering, the tubes of a vessel mostly lead to vessels a few entries away, which are
+already in the cache.
+
+Two orders are offered. Reverse Cuthill-McKee only looks at the tubes: it numbers every
+component breadth first from a vessel at its edge, visiting the neighbors with the fewest
+tubes first, and then reverses the whole order, which keeps the spread of the neighbor
+numbers (the bandwidth) small. The Hilbert order only looks at where the vessels are: it
+sorts them along a Hilbert curve through the bounding box of the scene, which keeps
+vessels that are close on screen close in memory, without having to follow the tubes.
+
+The tubes are sorted by their lower end afterwards, so the step walks the tubes in about
+the same order as the vessels.
+*/
+
+#ifndef _NETWORK_ORDER_H
+#define _NETWORK_ORDER_H
+
+#include <vector>
+
+struct VesselNetwork;
+
+enum VesselOrder
+{
+	ORDER_AS_LOADED = 0,		// Leave the vessels where they are
+	ORDER_CUTHILL_MCKEE,		// Reverse Cuthill-McKee over the tubes
+	ORDER_HILBERT				// Along a Hilbert curve through the positions of the vessels
+};
+
+// The Hilbert order places the vessels on a grid of 2^HILBERT_ORDER_BITS cells per side first.
+#define HILBERT_ORDER_BITS 16
+
+// Fills order with the old index of every vessel in the new order: order[new] = old.
+void vesselOrder(const VesselNetwork& network, VesselOrder kind, std::vector<int>& order);
+
+// Moves vessel order[i] to index i, with all of its arrays and layers, points the tubes at the new indices and sorts them by their
+// lower end. The network has to be rebuilt afterwards (which update() does on its own), and every vessel and tube gets a new
+// handle, so this is meant for a network that was just loaded.
+void reorderNetwork(VesselNetwork& network, const std::vector<int>& order);
+
+// How many entries apart the two ends of a tube are, on average over all tubes. The lower, the better the step uses the cache.
+double averageTubeSpan(const VesselNetwork& network);
+
+#endif // _NETWORK_ORDER_H
@@ -0,0 +1,215 @@
+/*
+Title: HydroDynamics
+File Name: NetworkPartition.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Splits the vessels of a network into parts of about the same size, cutting as few tubes as
+it can, so every part can be stepped on a core (or a machine) of its own and only the vessels
+at the cuts have to be exchanged (see PartitionedNetwork.h).
+
+This works like the recursive bisection of METIS, without the coarsening. A set of vessels
+is split in two by growing one half breadth first from a vessel at the edge of the graph
+(found by walking breadth first twice, which lands on a vessel about as far from everything
+as there is), until it holds its share of the vessels. That gives a compact half with a
+short border. Then a few refinement passes move vessels across the border wherever that cuts
+fewer tubes and keeps the halves within PARTITION_IMBALANCE of their share. Each half is split
+again until there are as many parts as asked for; the numbers of parts don't have to be
+powers of two.
+
+Takes time of about the number of tubes times the depth of the recursion.
+*/
+
+#include "NetworkPartition.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <cstdlib>
+
+// The neighbours of every vessel in compressed form: those of vessel i are neighbours[start[i]] to neighbours[start[i + 1] - 1].
+struct VesselGraph
+{
+	std::vector<int> start;
+	std::vector<int> neighbours;
+};
+
+// Walks breadth first through the vessels of the set (those with side[i] == set) from first, and appends them to order in the order
+// they are reached. Vessels already in order are skipped (visited marks them). Returns the last vessel reached.
+static int walk(const VesselGraph& graph, const std::vector<int>& side, int set, int first, std::vector<char>& visited, std::vector<int>& order)
+{
+	size_t head = order.size();
+	order.push_back(first);
+	visited[first] = 1;
+	while (head < order.size())
+	{
+		int vessel = order[head++];
+		for (int k = graph.start[vessel]; k < graph.start[vessel + 1]; k++)
+		{
+			int next = graph.neighbours[k];
+			if (side[next] == set && !visited[next])
+			{
+				visited[next] = 1;
+				order.push_back(next);
+			}
+		}
+	}
+	return order.back();
+}
+
+// Splits the vessels of set (all with side[i] == set) into parts parts numbered from firstPart, writing them into side.
+// Every number in side that is still to be split is negative, so it can't collide with a finished part. visited is scratch with an
+// entry per vessel, all 0, and is left that way.
+static void bisect(const VesselGraph& graph, const std::vector<int>& members, std::vector<int>& side, std::vector<char>& visited,
+	int set, int firstPart, int parts)
+{
+	if (parts == 1)
+	{
+		for (int vessel : members)
+		{
+			side[vessel] = firstPart;
+		}
+		return;
+	}
+
+	int partsLeft = parts / 2;
+	int count = (int)members.size();
+	int target = (int)((long long)count * partsLeft / parts);
+	int slack = std::max(1, (int)(PARTITION_IMBALANCE * target));
+
+	// Order the set breadth first from a vessel at its edge, and give the first target of them to the left half. A set made of
+	// several separate pieces takes them one after the other.
+	std::vector<int> order;
+	order.reserve(count);
+	std::vector<int> probe;
+	for (int vessel : members)
+	{
+		if (visited[vessel])
+		{
+			continue;
+		}
+		probe.clear();
+		int far = walk(graph, side, set, vessel, visited, probe);
+		for (int v : probe)
+		{
+			visited[v] = 0;
+		}
+		walk(graph, side, set, far, visited, order);
+	}
+	for (int vessel : order)
+	{
+		visited[vessel] = 0;
+	}
+
+	int leftSet = set * 2 - 1;	// Stays negative, and differs from every other set at any depth
+	int rightSet = set * 2 - 2;
+	for (int i = 0; i < count; i++)
+	{
+		side[order[i]] = i < target ? leftSet : rightSet;
+	}
+
+	// Move vessels across the border if more of their tubes go to the other half than stay in their own, as long as the
+	// halves stay within the slack of their share.
+	int leftCount = target;
+	for (int pass = 0; pass < PARTITION_REFINE_PASSES; pass++)
+	{
+		bool movedAny = false;
+		for (int vessel : order)
+		{
+			int own = side[vessel];
+			int other = own == leftSet ? rightSet : leftSet;
+			int internal = 0;
+			int external = 0;
+			for (int k = graph.start[vessel]; k < graph.start[vessel + 1]; k++)
+			{
+				int next = side[graph.neighbours[k]];
+				internal += next == own;
+				external += next == other;
+			}
+			int newLeft = leftCount + (own == leftSet ? -1 : 1);
+			bool balanced = std::abs(newLeft - target) <= slack && newLeft >= partsLeft && count - newLeft >= parts - partsLeft;
+			if (external > internal && balanced)
+			{
+				side[vessel] = other;
+				leftCount = newLeft;
+				movedAny = true;
+			}
+		}
+		if (!movedAny)
+		{
+			break;
+		}
+	}
+
+	std::vector<int> left;
+	std::vector<int> right;
+	left.reserve(leftCount);
+	right.reserve(count - leftCount);
+	for (int vessel : members)
+	{
+		(side[vessel] == leftSet ? left : right).push_back(vessel);
+	}
+	bisect(graph, left, side, visited, leftSet, firstPart, partsLeft);
+	bisect(graph, right, side, visited, rightSet, firstPart + partsLeft, parts - partsLeft);
+}
+
+int partitionNetwork(const VesselNetwork& network, int parts, std::vector<int>& partOf)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	parts = std::max(1, std::min(parts, vessels));
+
+	VesselGraph graph;
+	graph.start.assign(vessels + 1, 0);
+	for (int t = 0; t < tubes; t++)
+	{
+		graph.start[network.tubeA[t] + 1]++;
+		graph.start[network.tubeB[t] + 1]++;
+	}
+	for (int i = 0; i < vessels; i++)
+	{
+		graph.start[i + 1] += graph.start[i];
+	}
+	graph.neighbours.resize(tubes * 2);
+	std::vector<int> fill(graph.start.begin(), graph.start.end() - 1);
+	for (int t = 0; t < tubes; t++)
+	{
+		graph.neighbours[fill[network.tubeA[t]]++] = network.tubeB[t];
+		graph.neighbours[fill[network.tubeB[t]]++] = network.tubeA[t];
+	}
+
+	std::vector<int> members(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		members[i] = i;
+	}
+	partOf.assign(vessels, -1);
+	if (vessels > 0)
+	{
+		std::vector<char> visited(vessels, 0);
+		bisect(graph, members, partOf, visited, -1, 0, parts);
+	}
+
+	int cut = 0;
+	for (int t = 0; t < tubes; t++)
+	{
+		cut += partOf[network.tubeA[t]] != partOf[network.tubeB[t]];
+	}
+	return cut;
+}
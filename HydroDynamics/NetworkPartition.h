@@ -0,0 +1,58 @@
+/*
+Title: HydroDynamics
+File Name: NetworkPartition.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Splits the vessels of a network into parts of about the same size, cutting as few tubes as
+it can, so every part can be stepped on a core (or a machine) of its own and only the vessels
+at the cuts have to be exchanged (see PartitionedNetwork.h).
+
+This works like the recursive bisection of METIS, without the coarsening. A set of vessels
+is split in two by growing one half breadth first from a vessel at the edge of the graph
+(found by walking breadth first twice, which lands on a vessel about as far from everything
+as there is), until it holds its share of the vessels. That gives a compact half with a
+short border. Then a few refinement passes move vessels across the border wherever that cuts
+fewer tubes and keeps the halves within PARTITION_IMBALANCE of their share. Each half is split
+again until there are as many parts as asked for; the numbers of parts don't have to be
+powers of two.
+
+Takes time of about the number of tubes times the depth of the recursion.
+*/
+
+#ifndef _NETWORK_PARTITION_H
+#define _NETWORK_PARTITION_H
+
+#include <vector>
+
+struct VesselNetwork;
+
+// How far a part may end up from its share of the vessels, as a fraction of the share.
+#define PARTITION_IMBALANCE 0.03f
+
+// How many times the border between two halves is refined.
+#define PARTITION_REFINE_PASSES 4
+
+// Sets partOf[i] to the part (from 0 to parts - 1) of vessel i, and returns the number of tubes that connect vessels of
+// different parts.
+int partitionNetwork(const VesselNetwork& network, int parts, std::vector<int>& partOf);
+
+#endif // _NETWORK_PARTITION_H
@@ -0,0 +1,175 @@
+/*
+Title: HydroDynamics
+File Name: OffscreenTarget.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A framebuffer of our own to draw into instead of the window, of any size and with any
+number of samples per pixel, for the scene on screen, screenshots and videos.
+
+With more than one sample, the color and depth are multisampled renderbuffers, so the
+edges of everything drawn are antialiased, and a second framebuffer with a plain color
+renderbuffer of the same size is what the samples are resolved into with glBlitFramebuffer.
+Anything reading the image (glReadPixels, or a blit to the window) reads that one. With
+one sample there is nothing to resolve, and the image is read straight from where it was
+drawn.
+
+A target that is sampled keeps that finished image in a texture instead, for a shader to
+read (see FrameGraph.h), filtered linearly and repeating its last texel past the edge.
+*/
+
+#include "OffscreenTarget.h"
+#include "GLState.h"
+#include <algorithm>
+#include <iostream>
+
+// Creates a renderbuffer of width x height, multisampled if samples is more than 1, and attaches it to the bound framebuffer.
+static GLuint attachRenderbuffer(GLenum attachment, GLenum format, int width, int height, int samples)
+{
+	GLuint renderbuffer = 0;
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	if (samples > 1)
+	{
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, format, width, height);
+	}
+	else
+	{
+		glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+	}
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	return renderbuffer;
+}
+
+// Creates a texture of width x height to be sampled, and attaches it to the bound framebuffer as its color.
+static GLuint attachTexture(GLenum format, int width, int height)
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	cachedBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	cachedBindTexture(GL_TEXTURE_2D, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	return texture;
+}
+
+bool OffscreenTarget::create(int width, int height, int samples, GLenum colorFormat, bool sampled, bool depth)
+{
+	destroy();
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	targetSamples = std::max(std::min(samples, (int)maxSamples), 1);
+	targetWidth = width;
+	targetHeight = height;
+
+	glGenFramebuffers(1, &drawFramebuffer);
+	cachedBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+	if (sampled && targetSamples == 1)
+	{
+		colorTexture = attachTexture(colorFormat, width, height);
+	}
+	else
+	{
+		colorBuffer = attachRenderbuffer(GL_COLOR_ATTACHMENT0, colorFormat, width, height, targetSamples);
+	}
+	if (depth)
+	{
+		depthBuffer = attachRenderbuffer(GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24, width, height, targetSamples);
+	}
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	if (complete && targetSamples > 1)
+	{
+		glGenFramebuffers(1, &resolveFramebuffer);
+		cachedBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+		if (sampled)
+		{
+			colorTexture = attachTexture(colorFormat, width, height);
+		}
+		else
+		{
+			resolveBuffer = attachRenderbuffer(GL_COLOR_ATTACHMENT0, colorFormat, width, height, 1);
+		}
+		complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete)
+	{
+		std::cout << "Can't create a " << width << "x" << height << " framebuffer with " << targetSamples << " samples." << std::endl;
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+void OffscreenTarget::bind()
+{
+	cachedBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+	cachedViewport(0, 0, targetWidth, targetHeight);
+}
+
+void OffscreenTarget::resolve()
+{
+	if (resolveFramebuffer != 0)
+	{
+		cachedBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+		cachedBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+		glBlitFramebuffer(0, 0, targetWidth, targetHeight, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	cachedBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer());
+}
+
+void OffscreenTarget::present(int width, int height)
+{
+	// Stretching needs GL_LINEAR, and a copy of the same size is exact with GL_NEAREST.
+	bool sameSize = width == targetWidth && height == targetHeight;
+	cachedBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer());
+	cachedBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, targetWidth, targetHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, sameSize ? GL_NEAREST : GL_LINEAR);
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void OffscreenTarget::destroy()
+{
+	cachedDeleteFramebuffers(1, &drawFramebuffer);
+	glDeleteRenderbuffers(1, &colorBuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	cachedDeleteFramebuffers(1, &resolveFramebuffer);
+	glDeleteRenderbuffers(1, &resolveBuffer);
+	cachedDeleteTextures(1, &colorTexture);
+	drawFramebuffer = 0;
+	colorBuffer = 0;
+	depthBuffer = 0;
+	resolveFramebuffer = 0;
+	resolveBuffer = 0;
+	colorTexture = 0;
+}
@@ -0,0 +1,86 @@
+/*
+Title: HydroDynamics
+File Name: OffscreenTarget.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A framebuffer of our own to draw into instead of the window, of any size and with any
+number of samples per pixel, for the scene on screen, screenshots and videos.
+
+With more than one sample, the color and depth are multisampled renderbuffers, so the
+edges of everything drawn are antialiased, and a second framebuffer with a plain color
+renderbuffer of the same size is what the samples are resolved into with glBlitFramebuffer.
+Anything reading the image (glReadPixels, or a blit to the window) reads that one. With
+one sample there is nothing to resolve, and the image is read straight from where it was
+drawn.
+
+A target that is sampled keeps that finished image in a texture instead, for a shader to
+read (see FrameGraph.h), filtered linearly and repeating its last texel past the edge.
+*/
+
+#ifndef _OFFSCREEN_TARGET_H
+#define _OFFSCREEN_TARGET_H
+
+#include "GLIncludes.h"
+
+class OffscreenTarget
+{
+public:
+	// Creates the framebuffers for a width x height image of colorFormat, with a depth buffer if depth is set, freeing any it had
+	// before. More samples than the driver supports are clamped to its maximum. With sampled, the finished image is a texture.
+	// Returns false (and has nothing) if the driver can't create them.
+	bool create(int width, int height, int samples, GLenum colorFormat = GL_RGBA8, bool sampled = false, bool depth = true);
+
+	// Binds the framebuffer to draw into and sets the viewport to all of it.
+	void bind();
+
+	// Resolves the samples into the plain framebuffer if there are any, and binds the finished image as GL_READ_FRAMEBUFFER.
+	void resolve();
+
+	// Copies the finished image (after resolve()) to the window, stretched over width x height pixels of it.
+	void present(int width, int height);
+
+	// Frees the framebuffers.
+	void destroy();
+
+	bool valid() const { return drawFramebuffer != 0; }
+	int width() const { return targetWidth; }
+	int height() const { return targetHeight; }
+	int samples() const { return targetSamples; }
+
+	// The texture holding the finished image of a sampled target, or 0.
+	GLuint texture() const { return colorTexture; }
+
+private:
+	GLuint drawFramebuffer = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+	GLuint resolveFramebuffer = 0;	// Only with more than one sample
+	GLuint resolveBuffer = 0;
+	GLuint colorTexture = 0;		// Only if sampled, in place of the buffer the image is read from
+	int targetWidth = 0;
+	int targetHeight = 0;
+	int targetSamples = 1;
+
+	GLuint readFramebuffer() const { return resolveFramebuffer != 0 ? resolveFramebuffer : drawFramebuffer; }
+};
+
+#endif // _OFFSCREEN_TARGET_H
@@ -0,0 +1,752 @@
+/*
+Title: HydroDynamics
+File Name: ParticleFluid.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The fluid as a cloud of particles (smoothed particle hydrodynamics), for splashes and a
+surface that can break up, which the levels of a VesselNetwork and the cells of a
+GridFluid can't show.
+
+The particles fill the vessels of a network up to their heights, and the tubes along the
+floor, and can go anywhere inside the vessels (up to a ceiling) and the tubes. Every
+particle carries the same amount of fluid. The density at a particle is the sum of a
+smooth kernel over its neighbours within the smoothing radius, and the fluid is kept
+incompressible by moving the particles until no particle is denser than the fluid at rest
+(position based fluids: the density at every particle is a constraint, which a few Jacobi
+iterations solve). The velocities follow from how far the particles moved, and are
+smoothed a little towards those of their neighbours (XSPH viscosity). The walls are lined
+with particles that never move, so the fluid next to a wall has as many neighbours as
+anywhere else.
+
+The neighbours are found through a uniform grid with cells as large as the smoothing
+radius. Every substep the particles are sorted by their cell along a Morton curve (see
+ParticleSort.h, which only merges the few particles that changed cells when it can), and
+all their arrays are reordered in that order, so the particles of a cell are next to each
+other in memory, and so are most of the 3x3 cells around a particle. Every particle then
+collects its neighbours into a short list, which all the iterations of
+the substep work through. Every pass over the particles runs in blocks on the task pool;
+every particle only writes its own values, so the result doesn't depend on the number of
+threads.
+
+The piston pushes on the fluid in its vessel as an extra downward acceleration of every
+particle in the vessel, as large as it has to be for the pressure at the bottom to rise by
+the external pressure.
+
+This file has no OpenGL dependency.
+*/
+
+#include "ParticleFluid.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Fewer particles than this are stepped on one thread. Either way the work is done in blocks of PARTICLE_BLOCK particles.
+#define PARTICLE_PARALLEL_MIN 4096
+#define PARTICLE_BLOCK 1024
+
+// The smoothing radius, in spacings. Twice the spacing gives every particle about a dozen neighbours.
+#define PARTICLE_RADIUS 2.0f
+
+// How soft the constraints are, relative to how stiff they are for particles at rest. Softer constraints are more stable but let
+// the fluid compress more.
+#define PARTICLE_RELAXATION 0.1f
+
+// A step is split into substeps so that no particle moves more than PARTICLE_CFL spacings in one of them, and gravity alone
+// doesn't squeeze the fluid by more than PARTICLE_SQUEEZE spacings before the constraints push back. The few iterations can only
+// carry the push of the floor a few particles up, so a deep column of fluid sinks and bounces if its substeps are too long.
+#define PARTICLE_CFL 0.5f
+#define PARTICLE_SQUEEZE 0.01f
+#define PARTICLE_MAX_SUBSTEPS 16
+
+#define PI 3.14159265f
+
+// Runs body on the particles [0, count) in blocks, on the pool if it is worth it and on this thread otherwise.
+template <typename Body>
+static void forParticles(int count, TaskPool* pool, const Body& body)
+{
+	if (pool != nullptr && count >= PARTICLE_PARALLEL_MIN)
+	{
+		pool->parallelFor(count, PARTICLE_BLOCK, body);
+		return;
+	}
+
+	for (int begin = 0; begin < count; begin += PARTICLE_BLOCK)
+	{
+		body(begin, std::min(begin + PARTICLE_BLOCK, count));
+	}
+}
+
+bool ParticleFluid::build(const VesselNetwork& network, int count, float ceiling)
+{
+	int vesselCount = network.vesselCount();
+	if (vesselCount == 0 || count <= 0)
+	{
+		std::cout << "There is nothing to fill with particles." << std::endl;
+		return false;
+	}
+
+	float minX = network.left[0];
+	float maxX = network.right[0];
+	float minY = network.bottom[0];
+	for (int i = 1; i < vesselCount; i++)
+	{
+		minX = std::min(minX, network.left[i]);
+		maxX = std::max(maxX, network.right[i]);
+		minY = std::min(minY, network.bottom[i]);
+	}
+	if (ceiling <= minY)
+	{
+		std::cout << "The ceiling of the particles has to be above the floor of the vessels." << std::endl;
+		return false;
+	}
+
+	// A tube runs along the floor between the walls of its vessels, like it is drawn. Its box reaches from the middle of one vessel
+	// to the middle of the other, so together with the vessels the boxes leave no gap where they meet.
+	double volume = 0.0;
+	for (int i = 0; i < vesselCount; i++)
+	{
+		volume += (double)network.height[i] * network.width[i];
+	}
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		if (network.left[b] < network.left[a])
+		{
+			std::swap(a, b);
+		}
+		volume += std::max(network.left[b] - network.right[a], 0.0f) * PARTICLE_TUBE_HEIGHT;
+	}
+	if (volume <= 0.0)
+	{
+		std::cout << "There is no fluid to fill with particles." << std::endl;
+		return false;
+	}
+
+	spacing = (float)std::sqrt(volume / count);
+	radius = PARTICLE_RADIUS * spacing;
+
+	// Across a vessel and up a tube the spacing is stretched a little, so a whole number of particles fits between the walls.
+	boxes.clear();
+	vessels.resize(vesselCount);
+	for (int i = 0; i < vesselCount; i++)
+	{
+		int across = std::max((int)std::lround(network.width[i] / spacing), 1);
+		Box vessel = { network.left[i], network.right[i], network.bottom[i], ceiling, network.width[i] / across, spacing };
+		vessels[i] = vessel;
+		boxes.push_back(vessel);
+	}
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		float from = 0.5f * (network.left[a] + network.right[a]);
+		float to = 0.5f * (network.left[b] + network.right[b]);
+		float floor = std::max(network.bottom[a], network.bottom[b]);
+		int up = std::max((int)std::lround(PARTICLE_TUBE_HEIGHT / spacing), 1);
+		Box tube = { std::min(from, to), std::max(from, to), floor, floor + PARTICLE_TUBE_HEIGHT, spacing, PARTICLE_TUBE_HEIGHT / up };
+		boxes.push_back(tube);
+	}
+
+	byLeft.resize(vesselCount);
+	for (int i = 0; i < vesselCount; i++)
+	{
+		byLeft[i] = i;
+	}
+	std::sort(byLeft.begin(), byLeft.end(), [&](int a, int b) { return vessels[a].left < vessels[b].left; });
+	lefts.resize(vesselCount);
+	for (int i = 0; i < vesselCount; i++)
+	{
+		lefts[i] = vessels[byLeft[i]].left;
+	}
+
+	// Fill the vessels up to their heights, and the parts of the tubes outside the vessels, with particles on the lattice of
+	// their box.
+	positionX.clear();
+	positionY.clear();
+	for (int i = 0; i < vesselCount; i++)
+	{
+		const Box& box = boxes[i];
+		for (float y = box.bottom + 0.5f * box.stepY; y < network.top[i]; y += box.stepY)
+		{
+			for (float x = box.left + 0.5f * box.stepX; x < box.right; x += box.stepX)
+			{
+				positionX.push_back(x);
+				positionY.push_back(y);
+			}
+		}
+	}
+	for (int t = vesselCount; t < (int)boxes.size(); t++)
+	{
+		const Box& box = boxes[t];
+		for (float y = box.bottom + 0.5f * box.stepY; y < box.top; y += box.stepY)
+		{
+			for (float x = box.left + 0.5f * box.stepX; x < box.right; x += box.stepX)
+			{
+				if (vesselAt(x, y) < 0)
+				{
+					positionX.push_back(x);
+					positionY.push_back(y);
+				}
+			}
+		}
+	}
+
+	int particles = particleCount();
+	particleVolume = (float)(volume / std::max(particles, 1));
+	velocityX.assign(particles, 0.0f);
+	velocityY.assign(particles, 0.0f);
+	predictedX = positionX;
+	predictedY = positionY;
+	lambda.assign(particles, 0.0f);
+	deltaX.assign(particles, 0.0f);
+	deltaY.assign(particles, 0.0f);
+	scratch.assign(particles, 0.0f);
+	cellOf.assign(particles, 0);
+	order.assign(particles, 0);
+	cellKeys.assign(particles, 0);
+	neighbors.assign(particles * PARTICLE_MAX_NEIGHBORS, 0);
+	neighborCount.assign(particles, 0);
+	wallCount.assign(particles, 0);
+	extraGravity.assign(vesselCount, 0.0f);
+	vesselCounts.assign(vesselCount, 0);
+	fastest = 0.0f;
+	lastSubsteps = 0;
+
+	// The neighbour grid covers everything the particles can reach, plus the border.
+	originX = minX - radius;
+	originY = minY - radius;
+	columns = (int)std::ceil((maxX - minX) / radius) + 2;
+	rows = (int)std::ceil((ceiling - minY) / radius) + 2;
+	cellStart.assign(columns * rows, 0);
+	cellEnd.assign(columns * rows, 0);
+	keyBits = cellKeyBits(sortOrder, columns, rows);
+	sorter.reset();
+	sortMilliseconds = 0.0;
+
+	// The kernels in 2D, scaled to integrate to 1.
+	poly6Scale = 4.0f / (PI * std::pow(radius, 8.0f));
+	spikyScale = -30.0f / (PI * std::pow(radius, 5.0f));
+
+	// The density and the stiffness of the constraint at a particle in the middle of the lattice.
+	restDensity = 0.0f;
+	float gradientSquared = 0.0f;
+	int reach = (int)PARTICLE_RADIUS + 1;
+	for (int b = -reach; b <= reach; b++)
+	{
+		for (int a = -reach; a <= reach; a++)
+		{
+			float distanceSquared = (a * a + b * b) * spacing * spacing;
+			if (distanceSquared < radius * radius)
+			{
+				float difference = radius * radius - distanceSquared;
+				restDensity += poly6Scale * difference * difference * difference;
+				float distance = std::sqrt(distanceSquared);
+				float gradient = spikyScale * (radius - distance) * (radius - distance);
+				gradientSquared += gradient * gradient;
+			}
+		}
+	}
+	relaxation = PARTICLE_RELAXATION * gradientSquared / (restDensity * restDensity);
+
+	buildWalls();
+	return true;
+}
+
+int ParticleFluid::cellAt(float x, float y) const
+{
+	int column = std::min(std::max((int)std::floor((x - originX) / radius), 0), columns - 1);
+	int row = std::min(std::max((int)std::floor((y - originY) / radius), 0), rows - 1);
+	return row * columns + column;
+}
+
+void ParticleFluid::buildWalls()
+{
+	int layers = (int)std::ceil(PARTICLE_RADIUS);
+
+	// Whether a point is in the open, in any of the vessels or tubes.
+	auto open = [&](float x, float y)
+	{
+		for (const Box& box : boxes)
+		{
+			if (x > box.left && x < box.right && y > box.bottom && y < box.top)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// The particles go into the cells they are in, and a particle too close to one that is already there (where two boxes meet) is
+	// left out.
+	std::vector<std::vector<float>> cellParticles(columns * rows);
+	auto add = [&](float x, float y)
+	{
+		if (open(x, y))
+		{
+			return;
+		}
+		int cell = cellAt(x, y);
+		float closest = 0.5f * spacing;
+		for (int row = -columns; row <= columns; row += columns)
+		{
+			for (int c = std::max(cell + row - 1, 0); c <= std::min(cell + row + 1, columns * rows - 1); c++)
+			{
+				const std::vector<float>& list = cellParticles[c];
+				for (size_t k = 0; k < list.size(); k += 2)
+				{
+					float dx = list[k] - x;
+					float dy = list[k + 1] - y;
+					if (dx * dx + dy * dy < closest * closest)
+					{
+						return;
+					}
+				}
+			}
+		}
+		cellParticles[cell].push_back(x);
+		cellParticles[cell].push_back(y);
+	};
+
+	// Every box is lined with layers of particles outside its walls, on the lattice the box is filled with, so much so that the
+	// lattice just goes on into the walls.
+	for (const Box& box : boxes)
+	{
+		int across = (int)std::ceil((box.right - box.left) / box.stepX - 0.01f);
+		int up = (int)std::ceil((box.top - box.bottom) / box.stepY - 0.01f);
+		for (int layer = 0; layer < layers; layer++)
+		{
+			for (int k = -layers; k < across + layers; k++)
+			{
+				float x = box.left + (k + 0.5f) * box.stepX;
+				add(x, box.bottom - (layer + 0.5f) * box.stepY);
+				add(x, box.top + (layer + 0.5f) * box.stepY);
+			}
+			for (int k = 0; k < up; k++)
+			{
+				float y = box.bottom + (k + 0.5f) * box.stepY;
+				add(box.left - (layer + 0.5f) * box.stepX, y);
+				add(box.right + (layer + 0.5f) * box.stepX, y);
+			}
+		}
+	}
+
+	wallStart.assign(columns * rows + 1, 0);
+	wallX.clear();
+	wallY.clear();
+	for (int c = 0; c < columns * rows; c++)
+	{
+		wallStart[c] = (int)wallX.size();
+		for (size_t k = 0; k < cellParticles[c].size(); k += 2)
+		{
+			wallX.push_back(cellParticles[c][k]);
+			wallY.push_back(cellParticles[c][k + 1]);
+		}
+	}
+	wallStart[columns * rows] = (int)wallX.size();
+}
+
+void ParticleFluid::keepInside(float& x, float& y) const
+{
+	float bestX = x;
+	float bestY = y;
+	float bestDistance = -1.0f;
+	for (const Box& box : boxes)
+	{
+		float insideX = std::min(std::max(x, box.left), box.right);
+		float insideY = std::min(std::max(y, box.bottom), box.top);
+		if (insideX == x && insideY == y)
+		{
+			return;
+		}
+
+		float distance = (insideX - x) * (insideX - x) + (insideY - y) * (insideY - y);
+		if (bestDistance < 0.0f || distance < bestDistance)
+		{
+			bestX = insideX;
+			bestY = insideY;
+			bestDistance = distance;
+		}
+	}
+	x = bestX;
+	y = bestY;
+}
+
+int ParticleFluid::vesselAt(float x, float y) const
+{
+	int k = (int)(std::upper_bound(lefts.begin(), lefts.end(), x) - lefts.begin()) - 1;
+	if (k < 0)
+	{
+		return -1;
+	}
+	int vessel = byLeft[k];
+	return x < vessels[vessel].right && y >= vessels[vessel].bottom ? vessel : -1;
+}
+
+void ParticleFluid::sortByCell(TaskPool* pool)
+{
+	auto start = std::chrono::steady_clock::now();
+	int particles = particleCount();
+	auto cellPosition = [&](int i, int& x, int& y)
+	{
+		x = std::min(std::max((int)((predictedX[i] - originX) / radius), 1), columns - 2);
+		y = std::min(std::max((int)((predictedY[i] - originY) / radius), 1), rows - 2);
+	};
+	for (int i = 0; i < particles; i++)
+	{
+		int x, y;
+		cellPosition(i, x, y);
+		cellKeys[i] = cellKey(sortOrder, x, y, columns);
+	}
+
+	// Every cell keeps its particles in the order they were in, so the order only changes where particles moved to another cell.
+	if (sorter.sort(cellKeys, keyBits, pool, order))
+	{
+		std::vector<float>* arrays[] = { &positionX, &positionY, &velocityX, &velocityY, &predictedX, &predictedY };
+		for (std::vector<float>* array : arrays)
+		{
+			const float* from = array->data();
+			for (int k = 0; k < particles; k++)
+			{
+				scratch[k] = from[order[k]];
+			}
+			array->swap(scratch);
+		}
+	}
+
+	std::fill(cellStart.begin(), cellStart.end(), 0);
+	std::fill(cellEnd.begin(), cellEnd.end(), 0);
+	for (int k = 0; k < particles; k++)
+	{
+		int x, y;
+		cellPosition(k, x, y);
+		cellOf[k] = y * columns + x;
+		if (k == 0 || cellKeys[k] != cellKeys[k - 1])
+		{
+			cellStart[cellOf[k]] = k;
+		}
+		cellEnd[cellOf[k]] = k + 1;
+	}
+	sortMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ParticleFluid::findNeighbors(TaskPool* pool)
+{
+	float radiusSquared = radius * radius;
+	forParticles(particleCount(), pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float x = predictedX[i];
+			float y = predictedY[i];
+			int* list = &neighbors[i * PARTICLE_MAX_NEIGHBORS];
+			int count = 0;
+
+			// The particles are sorted by cell, so every cell of the 3x3 around the particle is one range.
+			int cell = cellOf[i];
+			for (int row = cell - columns; row <= cell + columns; row += columns)
+			{
+				for (int c = row - 1; c <= row + 1; c++)
+				{
+					for (int j = cellStart[c]; j < cellEnd[c] && count < PARTICLE_MAX_NEIGHBORS; j++)
+					{
+						float dx = x - predictedX[j];
+						float dy = y - predictedY[j];
+						if (j != i && dx * dx + dy * dy < radiusSquared)
+						{
+							list[count++] = j;
+						}
+					}
+				}
+			}
+			neighborCount[i] = (unsigned char)count;
+
+			// The walls never move, so they stay sorted row by row, and the three cells of every row are one range.
+			for (int row = cell - columns; row <= cell + columns; row += columns)
+			{
+				int last = wallStart[row + 2];
+				for (int k = wallStart[row - 1]; k < last && count < PARTICLE_MAX_NEIGHBORS; k++)
+				{
+					float dx = x - wallX[k];
+					float dy = y - wallY[k];
+					if (dx * dx + dy * dy < radiusSquared)
+					{
+						list[count++] = k;
+					}
+				}
+			}
+			wallCount[i] = (unsigned char)(count - neighborCount[i]);
+		}
+	});
+}
+
+void ParticleFluid::solveDensity(TaskPool* pool)
+{
+	int particles = particleCount();
+	float inverseRest = 1.0f / restDensity;
+	float radiusSquared = radius * radius;
+	float closest = PARTICLE_CLOSEST * spacing;
+
+	// The kernel and its gradient (divided by the distance) for two points dx, dy apart. Points on top of each other are pushed
+	// apart sideways, the one that comes first in the arrays to the left.
+	auto kernel = [&](float& dx, float& dy, bool first, float& gradient)
+	{
+		float distanceSquared = dx * dx + dy * dy;
+		if (distanceSquared < closest * closest)
+		{
+			dx = first ? closest : -closest;
+			dy = 0.0f;
+			distanceSquared = closest * closest;
+		}
+		if (distanceSquared >= radiusSquared)
+		{
+			gradient = 0.0f;
+			return 0.0f;
+		}
+		float distance = std::sqrt(distanceSquared);
+		float difference = radiusSquared - distanceSquared;
+		gradient = spikyScale * (radius - distance) * (radius - distance) / distance;
+		return poly6Scale * difference * difference * difference;
+	};
+
+	for (int iteration = 0; iteration < PARTICLE_ITERATIONS; iteration++)
+	{
+		// How far every particle has to move along the gradient of its constraint. A particle that isn't denser than the fluid at
+		// rest is left alone, so the surface doesn't pull together into clumps.
+		forParticles(particles, pool, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				const int* list = &neighbors[i * PARTICLE_MAX_NEIGHBORS];
+				int count = neighborCount[i];
+				int walls = count + wallCount[i];
+				float density = poly6Scale * radiusSquared * radiusSquared * radiusSquared;
+				float ownX = 0.0f;
+				float ownY = 0.0f;
+				float squares = 0.0f;
+				for (int n = 0; n < walls; n++)
+				{
+					int j = list[n];
+					float dx = predictedX[i] - (n < count ? predictedX[j] : wallX[j]);
+					float dy = predictedY[i] - (n < count ? predictedY[j] : wallY[j]);
+					float gradient;
+					density += kernel(dx, dy, n < count && j < i, gradient);
+					gradient *= inverseRest;
+					ownX += gradient * dx;
+					ownY += gradient * dy;
+					if (n < count)
+					{
+						squares += gradient * gradient * (dx * dx + dy * dy);
+					}
+				}
+
+				float constraint = density * inverseRest - 1.0f;
+				lambda[i] = constraint > 0.0f ? -constraint / (squares + ownX * ownX + ownY * ownY + relaxation) : 0.0f;
+			}
+		});
+
+		// The walls push back as hard as the particle pushes on them.
+		forParticles(particles, pool, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				const int* list = &neighbors[i * PARTICLE_MAX_NEIGHBORS];
+				int count = neighborCount[i];
+				int walls = count + wallCount[i];
+				float sumX = 0.0f;
+				float sumY = 0.0f;
+				for (int n = 0; n < walls; n++)
+				{
+					int j = list[n];
+					float dx = predictedX[i] - (n < count ? predictedX[j] : wallX[j]);
+					float dy = predictedY[i] - (n < count ? predictedY[j] : wallY[j]);
+					float gradient;
+					kernel(dx, dy, n < count && j < i, gradient);
+					gradient *= lambda[i] + (n < count ? lambda[j] : lambda[i]);
+					sumX += gradient * dx;
+					sumY += gradient * dy;
+				}
+				deltaX[i] = sumX * inverseRest;
+				deltaY[i] = sumY * inverseRest;
+			}
+		});
+
+		forParticles(particles, pool, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				predictedX[i] += deltaX[i];
+				predictedY[i] += deltaY[i];
+				keepInside(predictedX[i], predictedY[i]);
+			}
+		});
+	}
+}
+
+void ParticleFluid::smoothVelocities(TaskPool* pool)
+{
+	float radiusSquared = radius * radius;
+	float scale = PARTICLE_VISCOSITY * poly6Scale / restDensity;
+	forParticles(particleCount(), pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const int* list = &neighbors[i * PARTICLE_MAX_NEIGHBORS];
+			float sumX = 0.0f;
+			float sumY = 0.0f;
+			for (int n = 0; n < neighborCount[i]; n++)
+			{
+				int j = list[n];
+				float dx = predictedX[i] - predictedX[j];
+				float dy = predictedY[i] - predictedY[j];
+				float difference = std::max(radiusSquared - dx * dx - dy * dy, 0.0f);
+				float weight = difference * difference * difference;
+				sumX += (velocityX[j] - velocityX[i]) * weight;
+				sumY += (velocityY[j] - velocityY[i]) * weight;
+			}
+			deltaX[i] = velocityX[i] + sumX * scale;
+			deltaY[i] = velocityY[i] + sumY * scale;
+		}
+	});
+	velocityX.swap(deltaX);
+	velocityY.swap(deltaY);
+}
+
+void ParticleFluid::substep(float gravity, float dt, TaskPool* pool)
+{
+	int particles = particleCount();
+
+	// Gravity (and the piston) act on the velocities, and the particles move to where those take them.
+	forParticles(particles, pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			int vessel = vesselAt(positionX[i], positionY[i]);
+			velocityY[i] -= (gravity + (vessel >= 0 ? extraGravity[vessel] : 0.0f)) * dt;
+			predictedX[i] = positionX[i] + velocityX[i] * dt;
+			predictedY[i] = positionY[i] + velocityY[i] * dt;
+			keepInside(predictedX[i], predictedY[i]);
+		}
+	});
+
+	sortByCell(pool);
+	CounterSample before;
+	bool counting = counters != nullptr && counters->read(before);
+	findNeighbors(pool);
+	solveDensity(pool);
+
+	// The velocity is how far the particle actually moved, smoothed towards its neighbours.
+	float inverseDt = 1.0f / dt;
+	forParticles(particles, pool, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			velocityX[i] = (predictedX[i] - positionX[i]) * inverseDt;
+			velocityY[i] = (predictedY[i] - positionY[i]) * inverseDt;
+		}
+	});
+	smoothVelocities(pool);
+	CounterSample after;
+	if (counting && counters->read(after))
+	{
+		neighborCounts.addDifference(before, after);
+		countedSubsteps++;
+	}
+	positionX.swap(predictedX);
+	positionY.swap(predictedY);
+}
+
+void ParticleFluid::measure(VesselNetwork& network, float density, float gravity)
+{
+	std::fill(vesselCounts.begin(), vesselCounts.end(), 0);
+
+	float fastestSquared = 0.0f;
+	for (int i = 0; i < particleCount(); i++)
+	{
+		int vessel = vesselAt(positionX[i], positionY[i]);
+		if (vessel >= 0)
+		{
+			vesselCounts[vessel]++;
+		}
+		fastestSquared = std::max(fastestSquared, velocityX[i] * velocityX[i] + velocityY[i] * velocityY[i]);
+	}
+	fastest = std::sqrt(fastestSquared);
+	applyCounts(network, density, gravity);
+}
+
+void ParticleFluid::applyCounts(VesselNetwork& network, float density, float gravity) const
+{
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		float height = vesselCounts[i] * particleVolume / network.width[i];
+		network.height[i] = height;
+		network.top[i] = network.bottom[i] + height;
+		network.pressure[i] = density * gravity * height;
+	}
+}
+
+int ParticleFluid::planSubsteps(const VesselNetwork& network, float density, float gravity, float dt)
+{
+	// The piston adds externalPressure / (density * height) to the gravity in its vessel, which adds externalPressure to the pressure
+	// at the bottom of the column.
+	float strongest = gravity;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		float column = std::max(network.height[i], spacing);
+		extraGravity[i] = density > 0.0f ? network.externalPressure[i] / (density * column) : 0.0f;
+		strongest = std::max(strongest, gravity + extraGravity[i]);
+	}
+
+	float bySpeed = (fastest + strongest * dt) * dt / (PARTICLE_CFL * spacing);
+	float bySqueeze = dt * std::sqrt(std::max(strongest, 0.0f) / (PARTICLE_SQUEEZE * spacing));
+	return std::min(std::max((int)std::ceil(std::max(bySpeed, bySqueeze)), 1), PARTICLE_MAX_SUBSTEPS);
+}
+
+bool ParticleFluid::update(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool)
+{
+	lastSubsteps = planSubsteps(network, density, gravity, dt);
+	for (int s = 0; s < lastSubsteps; s++)
+	{
+		substep(gravity, dt / lastSubsteps, pool);
+	}
+	measure(network, density, gravity);
+
+	// Like a tube of the network, the fluid is at rest once nothing moves more than REST_HEIGHT in a step.
+	return fastest * dt > REST_HEIGHT;
+}
+
+void ParticleFluid::speeds(std::vector<float>& result) const
+{
+	result.resize(particleCount());
+	for (int i = 0; i < particleCount(); i++)
+	{
+		result[i] = std::sqrt(velocityX[i] * velocityX[i] + velocityY[i] * velocityY[i]);
+	}
+}
+
+double ParticleFluid::totalVolume() const
+{
+	return (double)particleVolume * particleCount();
+}
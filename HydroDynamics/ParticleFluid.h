@@ -0,0 +1,214 @@
+/*
+Title: HydroDynamics
+File Name: ParticleFluid.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The fluid as a cloud of particles (smoothed particle hydrodynamics), for splashes and a
+surface that can break up, which the levels of a VesselNetwork and the cells of a
+GridFluid can't show.
+
+The particles fill the vessels of a network up to their heights, and the tubes along the
+floor, and can go anywhere inside the vessels (up to a ceiling) and the tubes. Every
+particle carries the same amount of fluid. The density at a particle is the sum of a
+smooth kernel over its neighbours within the smoothing radius, and the fluid is kept
+incompressible by moving the particles until no particle is denser than the fluid at rest
+(position based fluids: the density at every particle is a constraint, which a few Jacobi
+iterations solve). The velocities follow from how far the particles moved, and are
+smoothed a little towards those of their neighbours (XSPH viscosity). The walls are lined
+with particles that never move, so the fluid next to a wall has as many neighbours as
+anywhere else.
+
+The neighbours are found through a uniform grid with cells as large as the smoothing
+radius. Every substep the particles are sorted by their cell along a Morton curve (see
+ParticleSort.h, which only merges the few particles that changed cells when it can), and
+all their arrays are reordered in that order, so the particles of a cell are next to each
+other in memory, and so are most of the 3x3 cells around a particle. Every particle then
+collects its neighbours into a short list, which all the iterations of
+the substep work through. Every pass over the particles runs in blocks on the task pool;
+every particle only writes its own values, so the result doesn't depend on the number of
+threads.
+
+The piston pushes on the fluid in its vessel as an extra downward acceleration of every
+particle in the vessel, as large as it has to be for the pressure at the bottom to rise by
+the external pressure.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _PARTICLE_FLUID_H
+#define _PARTICLE_FLUID_H
+
+#include <vector>
+#include "HardwareCounters.h"
+#include "ParticleSort.h"
+
+struct VesselNetwork;
+class TaskPool;
+
+// How tall a tube is. That is a lot taller than it is drawn, because in a tube only a few particles tall the particles lock into
+// each other and hold the levels apart.
+#define PARTICLE_TUBE_HEIGHT 0.1f
+
+// How many neighbours a particle keeps track of. Even squeezed together, a particle has fewer than this within its radius.
+#define PARTICLE_MAX_NEIGHBORS 32
+
+// Iterations of the density constraints per substep.
+#define PARTICLE_ITERATIONS 4
+
+// How much of the difference to the average velocity of its neighbours every particle loses per substep.
+#define PARTICLE_VISCOSITY 0.05f
+
+// Particles closer than this (in spacings) are treated as this far apart, so the ones pushed into the same corner get apart.
+#define PARTICLE_CLOSEST 0.01f
+
+class ParticleFluid
+{
+public:
+	// Per particle, as a structure of arrays. The order changes every step.
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+
+	// The distance between particles at rest, and the smoothing radius, which is twice as large.
+	float spacing = 0.0f;
+	float radius = 0.0f;
+
+	// How many substeps the last step took
+	int lastSubsteps = 0;
+
+	// The order of the cells the particles are sorted in, which has to be set before build(), and how the sorts went.
+	ParticleOrder sortOrder = PARTICLE_ORDER_MORTON;
+	ParticleSorter sorter;
+	double sortMilliseconds = 0.0;
+
+	// If set, the counters are read around the passes over the neighbours of every substep (finding them, the density constraints
+	// and the smoothing), and what they counted is added to neighborCounts.
+	HardwareCounters* counters = nullptr;
+	CounterSample neighborCounts;
+	long long countedSubsteps = 0;
+
+	// Fills the vessels of a network up to their current heights, and its tubes, with about count particles. The particles can
+	// move up to ceiling. Returns false (and prints why) if the network has no fluid or the ceiling is below it.
+	bool build(const VesselNetwork& network, int count, float ceiling);
+
+	// Advances the particles by dt seconds, with the external pressures of the network pushing on its vessels. Afterwards the
+	// height (and top and pressure) of every vessel in the network is how much fluid is in it. Returns false if nothing moved.
+	bool update(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool = nullptr);
+
+	int particleCount() const { return (int)positionX.size(); }
+
+	// The speed of every particle, for drawing.
+	void speeds(std::vector<float>& result) const;
+
+	// The volume of all the fluid, which never changes.
+	double totalVolume() const;
+
+private:
+	// Steps the same particles on the GPU, from the layout and the constants worked out here.
+	friend class GpuParticleFluid;
+
+	// A rectangle the particles can move in (a vessel, or a tube), and the distance between the particles it is filled with.
+	struct Box
+	{
+		float left;
+		float right;
+		float bottom;
+		float top;
+		float stepX;
+		float stepY;
+	};
+
+	void substep(float gravity, float dt, TaskPool* pool);
+	void sortByCell(TaskPool* pool);
+	void findNeighbors(TaskPool* pool);
+	void solveDensity(TaskPool* pool);
+	void smoothVelocities(TaskPool* pool);
+	void keepInside(float& x, float& y) const;
+	void measure(VesselNetwork& network, float density, float gravity);
+
+	// Works out the acceleration of the piston in every vessel, and how many substeps the next step of dt needs.
+	int planSubsteps(const VesselNetwork& network, float density, float gravity, float dt);
+
+	// Sets the heights, tops and pressures of the network from vesselCounts.
+	void applyCounts(VesselNetwork& network, float density, float gravity) const;
+
+	// Lines the walls of every box with particles that don't move (see wallX).
+	void buildWalls();
+
+	// The cell of the neighbour grid a point is in.
+	int cellAt(float x, float y) const;
+
+	// Returns the vessel a point is in, or -1.
+	int vesselAt(float x, float y) const;
+
+	std::vector<Box> boxes;			// The vessels up to the ceiling, then the tubes
+	std::vector<Box> vessels;		// Per vessel, where its fluid is counted
+	std::vector<int> byLeft;		// The vessels sorted by their left walls, to find the one a particle is in
+	std::vector<float> lefts;		// Their left walls in that order
+
+	// The neighbour grid: cells of radius x radius, with a border of empty cells all around, so the 3x3 cells around any particle
+	// exist. The cells are numbered row by row, and the particles in cell c are cellStart[c] to cellEnd[c] - 1.
+	int columns = 0;
+	int rows = 0;
+	float originX = 0.0f;
+	float originY = 0.0f;
+	std::vector<int> cellStart;
+	std::vector<int> cellEnd;
+	std::vector<int> cellOf;		// Per particle, its cell
+	std::vector<unsigned int> cellKeys;	// Per particle, the key of its cell in sortOrder
+	std::vector<int> order;			// Per sorted particle, where it was before the sort
+	int keyBits = 0;
+
+	// The particles that line the walls, sorted by cell once. The ones in cell c are wallStart[c] to wallStart[c + 1] - 1.
+	std::vector<float> wallX;
+	std::vector<float> wallY;
+	std::vector<int> wallStart;
+
+	// Per particle, up to PARTICLE_MAX_NEIGHBORS neighbours for the substep: the particles at neighbors[i * PARTICLE_MAX_NEIGHBORS]
+	// and on, and then the wall particles, so the first neighborCount[i] are particles and the next wallCount[i] walls.
+	std::vector<int> neighbors;
+	std::vector<unsigned char> neighborCount;
+	std::vector<unsigned char> wallCount;
+
+	// Per particle, for the substep
+	std::vector<float> predictedX;
+	std::vector<float> predictedY;
+	std::vector<float> lambda;
+	std::vector<float> deltaX;		// Also the smoothed velocities
+	std::vector<float> deltaY;
+	std::vector<float> scratch;		// For reordering
+
+	std::vector<float> extraGravity;	// Per vessel, the acceleration of the piston
+	std::vector<int> vesselCounts;		// Per vessel, the particles in it
+
+	// The volume every particle carries, and the kernel sum and the softness of the constraint, both measured on particles at
+	// rest at the spacing.
+	float particleVolume = 0.0f;
+	float restDensity = 0.0f;
+	float relaxation = 0.0f;
+	float poly6Scale = 0.0f;
+	float spikyScale = 0.0f;
+	float fastest = 0.0f;			// The fastest particle after the last step
+};
+
+#endif // _PARTICLE_FLUID_H
@@ -0,0 +1,238 @@
+/*
+Title: HydroDynamics
+File Name: ParticleSort.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Sorts particles by the cell they are in, for ParticleFluid and the FLIP mode of
+GridFluid. Particles drift through the space as they move, and keeping their arrays in
+the order of their cells is what keeps the particles a pass works on close to each other
+in memory. The key of a cell is its position along a Morton (Z order) curve, which
+interleaves the bits of its column and row, so cells that are close in either direction
+get close keys (a row order keeps the cells of a row close, but puts the row above a whole
+row away).
+
+Between two sorts most particles stay in their cells. The sorter remembers the keys of
+the last sort, and if only a few particles changed theirs, it takes those out, sorts them
+on their own and merges them back into the others, which are still in order. Otherwise it
+runs a least significant digit radix sort over the bits the keys use, PARTICLE_SORT_BITS
+at a time, in blocks on the task pool: every block counts its digits, the counts give
+every block its own place for every digit, and every block moves its particles there.
+Both give exactly the same order (by key, and by the order from before for equal keys), so
+which one runs never changes a result.
+*/
+
+#include "ParticleSort.h"
+#include "TaskPool.h"
+#include <algorithm>
+
+// Fewer particles than this are sorted on one thread. Either way the radix sort works in blocks of PARTICLE_SORT_BLOCK particles.
+#define PARTICLE_SORT_PARALLEL_MIN 16384
+#define PARTICLE_SORT_BLOCK 8192
+
+#define PARTICLE_SORT_DIGITS (1 << PARTICLE_SORT_BITS)
+
+// Spreads the low 16 bits of x out to the even bits.
+static unsigned int spreadBits(unsigned int x)
+{
+	x &= 0xffff;
+	x = (x | (x << 8)) & 0x00ff00ff;
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x;
+}
+
+unsigned int cellKey(ParticleOrder order, int x, int y, int columns)
+{
+	if (order == PARTICLE_ORDER_ROWS)
+	{
+		return (unsigned int)(y * columns + x);
+	}
+	return spreadBits((unsigned int)x) | (spreadBits((unsigned int)y) << 1);
+}
+
+int cellKeyBits(ParticleOrder order, int columns, int rows)
+{
+	return keyBits(order == PARTICLE_ORDER_ROWS ? (unsigned int)(columns * rows - 1) : cellKey(order, columns - 1, rows - 1, columns));
+}
+
+int keyBits(unsigned int largest)
+{
+	int bits = 0;
+	while (bits < 32 && (largest >> bits) != 0)
+	{
+		bits++;
+	}
+	return bits;
+}
+
+// Runs body on the blocks [0, blocks), on the pool if it is worth it and on this thread otherwise.
+template <typename Body>
+static void forBlocks(int blocks, int count, TaskPool* pool, const Body& body)
+{
+	if (pool != nullptr && count >= PARTICLE_SORT_PARALLEL_MIN)
+	{
+		pool->parallelFor(blocks, 1, [&](int begin, int end)
+		{
+			for (int b = begin; b < end; b++)
+			{
+				body(b);
+			}
+		});
+		return;
+	}
+
+	for (int b = 0; b < blocks; b++)
+	{
+		body(b);
+	}
+}
+
+bool ParticleSorter::sort(std::vector<unsigned int>& keys, int bits, TaskPool* pool, std::vector<int>& order)
+{
+	int count = (int)keys.size();
+	if (previous.size() != keys.size())
+	{
+		full++;
+		movedParticles += count;
+		radixSort(keys, bits, pool, order);
+		previous = keys;
+		return true;
+	}
+
+	moved.clear();
+	stayed.clear();
+	for (int i = 0; i < count; i++)
+	{
+		if (keys[i] != previous[i])
+		{
+			moved.push_back(i);
+		}
+	}
+	movedParticles += moved.size();
+	if (moved.empty())
+	{
+		skipped++;
+		return false;
+	}
+
+	if ((long long)moved.size() * PARTICLE_SORT_INCREMENTAL > count)
+	{
+		full++;
+		radixSort(keys, bits, pool, order);
+		previous = keys;
+		return true;
+	}
+
+	// The particles that stayed are still in the order of their keys. The ones that moved are sorted on their own (by key, and by
+	// where they are for equal keys, like the radix sort does it), and both are merged, again by key and then by place.
+	incremental++;
+	for (int i = 0, next = 0; i < count; i++)
+	{
+		if (next < (int)moved.size() && moved[next] == i)
+		{
+			next++;
+			continue;
+		}
+		stayed.push_back(i);
+	}
+	std::stable_sort(moved.begin(), moved.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+	auto before = [&](int a, int b) { return keys[a] < keys[b] || (keys[a] == keys[b] && a < b); };
+	order.resize(count);
+	std::merge(stayed.begin(), stayed.end(), moved.begin(), moved.end(), order.begin(), before);
+
+	keyScratch.resize(count);
+	for (int k = 0; k < count; k++)
+	{
+		keyScratch[k] = keys[order[k]];
+	}
+	keys.swap(keyScratch);
+	previous = keys;
+	return true;
+}
+
+void ParticleSorter::radixSort(std::vector<unsigned int>& keys, int bits, TaskPool* pool, std::vector<int>& order)
+{
+	int count = (int)keys.size();
+	int blocks = (count + PARTICLE_SORT_BLOCK - 1) / PARTICLE_SORT_BLOCK;
+	order.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		order[i] = i;
+	}
+	keyScratch.resize(count);
+	orderScratch.resize(count);
+	counts.resize((size_t)blocks * PARTICLE_SORT_DIGITS);
+
+	for (int shift = 0; shift < bits; shift += PARTICLE_SORT_BITS)
+	{
+		// Every block counts its digits.
+		forBlocks(blocks, count, pool, [&](int b)
+		{
+			int* blockCounts = &counts[(size_t)b * PARTICLE_SORT_DIGITS];
+			std::fill(blockCounts, blockCounts + PARTICLE_SORT_DIGITS, 0);
+			int end = std::min((b + 1) * PARTICLE_SORT_BLOCK, count);
+			for (int i = b * PARTICLE_SORT_BLOCK; i < end; i++)
+			{
+				blockCounts[(keys[i] >> shift) & (PARTICLE_SORT_DIGITS - 1)]++;
+			}
+		});
+
+		// The keys with a digit go after all those with a smaller one, and within a digit, every block after the blocks before it.
+		int place = 0;
+		for (int digit = 0; digit < PARTICLE_SORT_DIGITS; digit++)
+		{
+			for (int b = 0; b < blocks; b++)
+			{
+				int& slot = counts[(size_t)b * PARTICLE_SORT_DIGITS + digit];
+				int blockCount = slot;
+				slot = place;
+				place += blockCount;
+			}
+		}
+
+		// Every block moves its keys to its places, in order, which keeps the sort stable.
+		forBlocks(blocks, count, pool, [&](int b)
+		{
+			int* next = &counts[(size_t)b * PARTICLE_SORT_DIGITS];
+			int end = std::min((b + 1) * PARTICLE_SORT_BLOCK, count);
+			for (int i = b * PARTICLE_SORT_BLOCK; i < end; i++)
+			{
+				int to = next[(keys[i] >> shift) & (PARTICLE_SORT_DIGITS - 1)]++;
+				keyScratch[to] = keys[i];
+				orderScratch[to] = order[i];
+			}
+		});
+		keys.swap(keyScratch);
+		order.swap(orderScratch);
+	}
+}
+
+void ParticleSorter::reset()
+{
+	previous.clear();
+	skipped = 0;
+	incremental = 0;
+	full = 0;
+	movedParticles = 0;
+}
@@ -0,0 +1,97 @@
+/*
+Title: HydroDynamics
+File Name: ParticleSort.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Sorts particles by the cell they are in, for ParticleFluid and the FLIP mode of
+GridFluid. Particles drift through the space as they move, and keeping their arrays in
+the order of their cells is what keeps the particles a pass works on close to each other
+in memory. The key of a cell is its position along a Morton (Z order) curve, which
+interleaves the bits of its column and row, so cells that are close in either direction
+get close keys (a row order keeps the cells of a row close, but puts the row above a whole
+row away).
+
+Between two sorts most particles stay in their cells. The sorter remembers the keys of
+the last sort, and if only a few particles changed theirs, it takes those out, sorts them
+on their own and merges them back into the others, which are still in order. Otherwise it
+runs a least significant digit radix sort over the bits the keys use, PARTICLE_SORT_BITS
+at a time, in blocks on the task pool: every block counts its digits, the counts give
+every block its own place for every digit, and every block moves its particles there.
+Both give exactly the same order (by key, and by the order from before for equal keys), so
+which one runs never changes a result.
+*/
+
+#ifndef _PARTICLE_SORT_H
+#define _PARTICLE_SORT_H
+
+#include <vector>
+
+class TaskPool;
+
+// The bits of the key every pass of the radix sort sorts by
+#define PARTICLE_SORT_BITS 8
+
+// The sort is incremental if at most 1 in this many particles changed their key
+#define PARTICLE_SORT_INCREMENTAL 16
+
+enum ParticleOrder
+{
+	PARTICLE_ORDER_MORTON = 0,	// Along a Morton curve through the cells
+	PARTICLE_ORDER_ROWS			// Row by row, which is what the counting sort used to do, for comparison
+};
+
+// The key of cell (x, y) in order, and the most bits the key of a cell of a columns x rows grid can need.
+unsigned int cellKey(ParticleOrder order, int x, int y, int columns);
+int cellKeyBits(ParticleOrder order, int columns, int rows);
+
+// The bits a key needs to hold every value up to largest.
+int keyBits(unsigned int largest);
+
+class ParticleSorter
+{
+public:
+	// How many sorts found nothing to do, merged the particles that moved, or sorted everything, since the last reset().
+	long long skipped = 0;
+	long long incremental = 0;
+	long long full = 0;
+	long long movedParticles = 0;	// Particles whose key changed, over all the sorts
+
+	// Sorts the keys of the particles (with at most bits bits each) and sets order[k] to the particle that goes to place k. Returns
+	// false if the order is the same as before, in which case order is left alone and the arrays don't have to be reordered.
+	bool sort(std::vector<unsigned int>& keys, int bits, TaskPool* pool, std::vector<int>& order);
+
+	// Forgets the keys of the last sort, for particles that were reordered or added in between, and clears the statistics.
+	void reset();
+
+private:
+	void radixSort(std::vector<unsigned int>& keys, int bits, TaskPool* pool, std::vector<int>& order);
+
+	std::vector<unsigned int> previous;	// The keys after the last sort
+	std::vector<unsigned int> keyScratch;
+	std::vector<int> orderScratch;
+	std::vector<int> moved;				// The particles whose key changed
+	std::vector<int> stayed;			// and the others
+	std::vector<int> counts;			// Per block, how many of its keys have every digit, and then where they go
+};
+
+#endif // _PARTICLE_SORT_H
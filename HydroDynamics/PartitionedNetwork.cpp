@@ -0,0 +1,286 @@
+/*
+Title: HydroDynamics
+File Name: PartitionedNetwork.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Steps a very large network as a set of ranks, each owning a part of the vessels (see
+NetworkPartition.h) and running on a thread of its own, the way a distributed solver would
+run each part on a node of its own.
+
+Every rank is a VesselNetwork of its own, holding the vessels it owns, every tube that
+touches one of them, and a halo: a copy of every vessel of another rank at the far end of one
+of those tubes. A tube that is cut by the partition is in both ranks. The flow of a tube only
+depends on its two vessels at the start of the step, so both ranks work out exactly the same
+flow for it, and each one only keeps the change to its own vessel. All a rank needs from the
+others is the heights of its halo before every step, and all it hands out is the heights of
+its vessels that are in another rank's halo. The steps come out bit for bit the same as
+stepping the whole network at once.
+
+There is no barrier between the steps. A rank publishes the heights after every step into
+one of two mailboxes and counts the step, and a rank only waits for the ranks it shares tubes
+with to get to the step it needs. Ranks far apart in the network run ahead of each other by
+as many steps as there are ranks between them, so waiting on a slow part only holds up its
+neighbours, and the copying of one rank overlaps the stepping of the others. The mailboxes
+alternate, so a rank can run one step ahead of its neighbours without anyone overwriting
+heights that haven't been read yet.
+
+Only single precision and the local integrator work this way: the implicit integrator solves
+all tubes together, and more precise state isn't exchanged. The external pressures are
+copied when the ranks are built and stay as they are while stepping.
+*/
+
+#include "PartitionedNetwork.h"
+#include "NetworkPartition.h"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+
+bool PartitionedNetwork::build(const VesselNetwork& network, int rankTarget)
+{
+	ranks.clear();
+	if (network.layered() || network.profiled() || network.hasComponents() || network.precision != PRECISION_SINGLE
+		|| network.integrator != INTEGRATOR_LOCAL || network.drainLimit != DRAIN_EVEN)
+	{
+		std::cout << "Only a plain network (a single fluid, rectangular vessels, plain tubes and even drain limits), stepped in single precision "
+			"with the local integrator, can be split into ranks." << std::endl;
+		return false;
+	}
+
+	std::vector<int> partOf;
+	cutTubes = partitionNetwork(network, rankTarget, partOf);
+	int count = 0;
+	for (int part : partOf)
+	{
+		count = std::max(count, part + 1);
+	}
+	for (int r = 0; r < count; r++)
+	{
+		ranks.emplace_back(new Rank());
+	}
+
+	// The local number of every vessel in the rank that owns it, and in every rank that has it in its halo.
+	int vessels = network.vesselCount();
+	std::vector<int> ownedIndex(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		Rank& rank = *ranks[partOf[i]];
+		ownedIndex[i] = (int)rank.vessels.size();
+		rank.vessels.push_back(i);
+	}
+	for (std::unique_ptr<Rank>& rank : ranks)
+	{
+		rank->owned = (int)rank->vessels.size();
+	}
+
+	// The tubes of every rank in their order in the whole network, so every vessel adds up its changes in the same order as there.
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		int rankA = partOf[a];
+		int rankB = partOf[b];
+		ranks[rankA]->tubes.push_back(t);
+		if (rankB != rankA)
+		{
+			ranks[rankB]->tubes.push_back(t);
+		}
+	}
+
+	for (int r = 0; r < count; r++)
+	{
+		Rank& rank = *ranks[r];
+
+		// Halo vessels are found when a tube reaches out of the rank, and numbered after the owned ones.
+		std::vector<int> halo;
+		std::unordered_map<int, int> haloIndex;
+		auto localVessel = [&](int vessel)
+		{
+			if (partOf[vessel] == r)
+			{
+				return ownedIndex[vessel];
+			}
+			std::unordered_map<int, int>::iterator found = haloIndex.find(vessel);
+			if (found != haloIndex.end())
+			{
+				return found->second;
+			}
+			halo.push_back(vessel);
+			return haloIndex[vessel] = rank.owned + (int)halo.size() - 1;
+		};
+
+		VesselNetwork& part = rank.network;
+		part.integrator = INTEGRATOR_LOCAL;
+		part.precision = PRECISION_SINGLE;
+		for (int i = 0; i < rank.owned; i++)
+		{
+			int vessel = rank.vessels[i];
+			part.addVessel(network.left[vessel], network.bottom[vessel], network.width[vessel], network.height[vessel]);
+			part.externalPressure.back() = network.externalPressure[vessel];
+		}
+		std::vector<int> ends;
+		for (int t : rank.tubes)
+		{
+			ends.push_back(localVessel(network.tubeA[t]));
+			ends.push_back(localVessel(network.tubeB[t]));
+		}
+		for (int vessel : halo)
+		{
+			part.addVessel(network.left[vessel], network.bottom[vessel], network.width[vessel], network.height[vessel]);
+			part.externalPressure.back() = network.externalPressure[vessel];
+			rank.vessels.push_back(vessel);
+		}
+		for (size_t i = 0; i < rank.tubes.size(); i++)
+		{
+			int t = rank.tubes[i];
+			int tube = part.addTube(ends[i * 2], ends[i * 2 + 1]);
+			part.tubeInvInertance[tube] = network.tubeInvInertance[t];
+			part.tubeDamping[tube] = network.tubeDamping[t];
+			part.tubeFlow[tube] = network.tubeFlow[t];
+		}
+
+		// A halo vessel only has the tubes of this rank here, but may only be drained by its share of all of its tubes.
+		part.rebuildTopology();
+		for (size_t h = 0; h < halo.size(); h++)
+		{
+			int vessel = halo[h];
+			part.drainShare[rank.owned + h] = network.width[vessel] / (float)network.degree[vessel];
+		}
+	}
+
+	// Now that every rank knows its halo, every rank knows what it has to hand out, and to whom.
+	std::vector<int> slotOf(vessels, -1);
+	for (int r = 0; r < count; r++)
+	{
+		Rank& rank = *ranks[r];
+		for (int h = rank.owned; h < (int)rank.vessels.size(); h++)
+		{
+			int vessel = rank.vessels[h];
+			Rank& owner = *ranks[partOf[vessel]];
+			if (slotOf[vessel] < 0)
+			{
+				slotOf[vessel] = (int)owner.outgoing.size();
+				owner.outgoing.push_back(ownedIndex[vessel]);
+			}
+			rank.haloRank.push_back(partOf[vessel]);
+			rank.haloSlot.push_back(slotOf[vessel]);
+			if (std::find(rank.neighbours.begin(), rank.neighbours.end(), partOf[vessel]) == rank.neighbours.end())
+			{
+				rank.neighbours.push_back(partOf[vessel]);
+				owner.neighbours.push_back(r);
+			}
+		}
+	}
+	for (std::unique_ptr<Rank>& rank : ranks)
+	{
+		std::sort(rank->neighbours.begin(), rank->neighbours.end());
+		rank->neighbours.erase(std::unique(rank->neighbours.begin(), rank->neighbours.end()), rank->neighbours.end());
+		rank->mailbox[0].resize(rank->outgoing.size());
+		rank->mailbox[1].resize(rank->outgoing.size());
+		for (size_t i = 0; i < rank->outgoing.size(); i++)
+		{
+			rank->mailbox[0][i] = rank->network.height[rank->outgoing[i]];
+		}
+		rank->stepsDone = 0;
+	}
+	return true;
+}
+
+void PartitionedNetwork::runRank(int r, float density, float gravity, float dt, long long steps)
+{
+	Rank& rank = *ranks[r];
+	VesselNetwork& part = rank.network;
+	long long first = rank.stepsDone.load();
+	for (long long step = first; step < first + steps; step++)
+	{
+		// Wait for the neighbours to get as far as this rank, then pick up the heights of the halo.
+		for (int n : rank.neighbours)
+		{
+			while (ranks[n]->stepsDone.load(std::memory_order_acquire) < step)
+			{
+				std::this_thread::yield();
+			}
+		}
+		for (size_t h = 0; h < rank.haloRank.size(); h++)
+		{
+			int vessel = rank.owned + (int)h;
+			float height = ranks[rank.haloRank[h]]->mailbox[step & 1][rank.haloSlot[h]];
+			if (part.height[vessel] != height)
+			{
+				part.height[vessel] = height;
+				part.top[vessel] = part.bottom[vessel] + height;
+				part.wake(vessel);
+			}
+		}
+
+		part.update(density, gravity, dt);
+
+		// Hand out the heights after this step. The mailbox being written was last read for the step before the one the
+		// neighbours are in now, so nobody can still need it.
+		std::vector<float>& out = rank.mailbox[(step + 1) & 1];
+		for (size_t i = 0; i < rank.outgoing.size(); i++)
+		{
+			out[i] = part.height[rank.outgoing[i]];
+		}
+		rank.stepsDone.store(step + 1, std::memory_order_release);
+	}
+}
+
+void PartitionedNetwork::run(float density, float gravity, float dt, long long steps)
+{
+	std::vector<std::thread> threads;
+	for (int r = 0; r < rankCount(); r++)
+	{
+		threads.emplace_back(&PartitionedNetwork::runRank, this, r, density, gravity, dt, steps);
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void PartitionedNetwork::gather(VesselNetwork& network) const
+{
+	if (network.topologyDirty)
+	{
+		network.rebuildTopology();
+	}
+	for (const std::unique_ptr<Rank>& rank : ranks)
+	{
+		const VesselNetwork& part = rank->network;
+		for (int i = 0; i < rank->owned; i++)
+		{
+			int vessel = rank->vessels[i];
+			network.height[vessel] = part.height[i];
+			network.top[vessel] = part.top[i];
+			network.pressure[vessel] = part.pressure[i];
+		}
+
+		// A cut tube has the same flow in both of its ranks, so it doesn't matter which one it comes from.
+		for (size_t i = 0; i < rank->tubes.size(); i++)
+		{
+			network.tubeFlow[rank->tubes[i]] = part.tubeFlow[i];
+			network.tubeChange[rank->tubes[i]] = part.tubeChange[i];
+		}
+	}
+	network.wakeAll();
+}
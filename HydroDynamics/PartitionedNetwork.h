@@ -0,0 +1,101 @@
+/*
+Title: HydroDynamics
+File Name: PartitionedNetwork.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Steps a very large network as a set of ranks, each owning a part of the vessels (see
+NetworkPartition.h) and running on a thread of its own, the way a distributed solver would
+run each part on a node of its own.
+
+Every rank is a VesselNetwork of its own, holding the vessels it owns, every tube that
+touches one of them, and a halo: a copy of every vessel of another rank at the far end of one
+of those tubes. A tube that is cut by the partition is in both ranks. The flow of a tube only
+depends on its two vessels at the start of the step, so both ranks work out exactly the same
+flow for it, and each one only keeps the change to its own vessel. All a rank needs from the
+others is the heights of its halo before every step, and all it hands out is the heights of
+its vessels that are in another rank's halo. The steps come out bit for bit the same as
+stepping the whole network at once.
+
+There is no barrier between the steps. A rank publishes the heights after every step into
+one of two mailboxes and counts the step, and a rank only waits for the ranks it shares tubes
+with to get to the step it needs. Ranks far apart in the network run ahead of each other by
+as many steps as there are ranks between them, so waiting on a slow part only holds up its
+neighbours, and the copying of one rank overlaps the stepping of the others. The mailboxes
+alternate, so a rank can run one step ahead of its neighbours without anyone overwriting
+heights that haven't been read yet.
+
+Only single precision and the local integrator work this way: the implicit integrator solves
+all tubes together, and more precise state isn't exchanged. The external pressures are
+copied when the ranks are built and stay as they are while stepping.
+*/
+
+#ifndef _PARTITIONED_NETWORK_H
+#define _PARTITIONED_NETWORK_H
+
+#include "VesselNetwork.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+
+class PartitionedNetwork
+{
+public:
+	// Splits network into ranks ranks. Returns false (after printing why) if the network can't be stepped this way.
+	bool build(const VesselNetwork& network, int ranks);
+
+	// Steps every rank steps times, each on a thread of its own, and returns once all of them are done.
+	void run(float density, float gravity, float dt, long long steps);
+
+	// Copies the heights and flows back into network, which has to be the one the ranks were built from.
+	void gather(VesselNetwork& network) const;
+
+	int rankCount() const { return (int)ranks.size(); }
+	int cutTubes = 0;		// Tubes between vessels of different ranks
+
+private:
+	struct Rank
+	{
+		VesselNetwork network;
+		std::vector<int> vessels;	// Per local vessel, its number in the whole network. The ones this rank owns come first.
+		std::vector<int> tubes;		// Per local tube, its number in the whole network
+		int owned = 0;
+		std::vector<int> neighbours;	// The ranks this one shares tubes with
+
+		// What this rank hands out: the local vessels that are in the halo of another rank, and their heights after every step,
+		// in the mailbox of the number of steps done so far modulo 2.
+		std::vector<int> outgoing;
+		std::vector<float> mailbox[2];
+
+		// Per halo vessel (local vessel owned + i), which rank owns it and where in that rank's mailbox it is.
+		std::vector<int> haloRank;
+		std::vector<int> haloSlot;
+
+		std::atomic<long long> stepsDone{ 0 };
+	};
+
+	// Runs steps steps of rank r.
+	void runRank(int r, float density, float gravity, float dt, long long steps);
+
+	std::vector<std::unique_ptr<Rank>> ranks;
+};
+
+#endif // _PARTITIONED_NETWORK_H
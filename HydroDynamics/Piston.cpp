@@ -0,0 +1,188 @@
+/*
+Title: HydroDynamics
+File Name: Piston.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The piston as a rigid body that sits on the fluid in its vessel. It has a mass and is driven
+by a force from outside (the keys, or a force profile a controller wrote), and it pushes onto
+the fluid with whatever pressure it takes to move together with the surface.
+
+The piston can't leave the surface: it is sealed against the walls of its vessel, so pulling
+on it sucks the fluid up with it. That means its acceleration is the acceleration of the
+surface, which the tubes of the vessel decide. The pressure is solved together with the step
+of those tubes: from the same backward Euler step VesselNetwork uses for every tube, the flow
+each tube of the vessel ends the step with falls linearly as the pressure on the vessel
+rises, so is the acceleration of the surface, and the pressure that makes the piston's own
+mass * acceleration = pressure * width - force - mass * gravity come out right follows in
+closed form. A heavy piston adds its inertia to the fluid, so the levels swing slower, and
+its weight pushes them apart. A piston without mass just pushes with force / width, which is
+how the piston worked before it had a mass.
+
+Everything is per unit of depth, like the rest of the scene: the mass is a mass per depth and
+the force a force per depth, so force / width is a pressure.
+
+This file has no OpenGL dependency.
+*/
+
+#include "Piston.h"
+#include "VesselNetwork.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+// The pressure of the fluid alone at the bottom of a vessel, from its current heights.
+static float fluidPressure(const VesselNetwork& network, int vessel, float density, float gravity)
+{
+	if (!network.layered())
+	{
+		return density * gravity * network.height[vessel];
+	}
+	float pressure = 0.0f;
+	for (int f = 0; f < network.fluidCount(); f++)
+	{
+		pressure += network.fluidDensity[f] * gravity * network.layerHeight[f][vessel];
+	}
+	return pressure;
+}
+
+float Piston::restingPressure(const VesselNetwork& network, float gravity) const
+{
+	return (force + mass * gravity) / network.width[vessel];
+}
+
+void Piston::couple(VesselNetwork& network, float density, float gravity, float dt)
+{
+	float width = network.width[vessel];
+	float resting = restingPressure(network, gravity);
+	if (network.topologyDirty)
+	{
+		network.rebuildTopology();
+	}
+
+	// For every tube, the flow into the vessel at the end of the step is (inflow + dt * invInertance * (difference - pressure)) /
+	// denominator, with difference the pressure at its other end minus that of the fluid in the vessel. Summed over the tubes,
+	// the surface speeds up by (gain - pressure * loss) / (width * dt) beyond what the resting pressure would give it.
+	// Tubes that are at rest at the resting pressure are left out, so a piston at rest keeps exactly that pressure and lets the
+	// network fall asleep.
+	float gain = 0.0f;
+	float loss = 0.0f;
+	float restPressure = REST_HEIGHT * density * gravity;
+	float dtSquaredScale = dt * dt * density * gravity;
+	float own = fluidPressure(network, vessel, density, gravity);
+	for (int i = network.vesselTubeStart[vessel]; i < network.vesselTubeStart[vessel + 1]; i++)
+	{
+		int t = network.vesselTubes[i] >> 1;
+		bool isB = (network.vesselTubes[i] & 1) != 0;
+		int other = isB ? network.tubeA[t] : network.tubeB[t];
+		float inflow = isB ? -network.tubeFlow[t] : network.tubeFlow[t];
+		float difference = fluidPressure(network, other, density, gravity) + network.externalPressure[other] - own;
+		if (inflow == 0.0f && std::fabs(difference - resting) < restPressure)
+		{
+			continue;
+		}
+
+		float invInertance = network.tubeInvInertance[t];
+		float denominator = 1.0f + dt * network.tubeDamping[t] + dtSquaredScale * network.tubeStiffness[t] * invInertance;
+		gain += (inflow + dt * invInertance * (difference - resting)) / denominator - inflow;
+		loss += dt * invInertance / denominator;
+	}
+
+	// mass * (gain - (pressure - resting) * loss) / (width * dt) = (pressure - resting) * width
+	pressure = mass > 0.0f ? resting + mass * gain / (width * width * dt + mass * loss) : resting;
+	network.setExternalPressure(vessel, pressure);
+}
+
+void Piston::follow(const VesselNetwork& network)
+{
+	float inflow = 0.0f;
+	for (int i = network.vesselTubeStart[vessel]; i < network.vesselTubeStart[vessel + 1]; i++)
+	{
+		int t = network.vesselTubes[i] >> 1;
+		inflow += (network.vesselTubes[i] & 1) != 0 ? -network.tubeFlow[t] : network.tubeFlow[t];
+	}
+	velocity = inflow / network.width[vessel];
+}
+
+bool ForceProfile::read(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<double> loadedTimes;
+	std::vector<float> loadedForces;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		double time;
+		float value;
+		if (!(fields >> time >> value) || (!loadedTimes.empty() && time < loadedTimes.back()))
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a valid sample: " << line << std::endl;
+			return false;
+		}
+		loadedTimes.push_back(time);
+		loadedForces.push_back(value);
+	}
+
+	times.swap(loadedTimes);
+	forces.swap(loadedForces);
+	cursor = 0;
+	return true;
+}
+
+float ForceProfile::at(double time)
+{
+	if (times.empty())
+	{
+		return 0.0f;
+	}
+
+	// Move the cursor to the last sample at or before time.
+	if (cursor >= times.size() || times[cursor] > time)
+	{
+		cursor = 0;
+	}
+	while (cursor + 1 < times.size() && times[cursor + 1] <= time)
+	{
+		cursor++;
+	}
+
+	if (time <= times[cursor] || cursor + 1 == times.size())
+	{
+		return forces[cursor];
+	}
+	double blend = (time - times[cursor]) / (times[cursor + 1] - times[cursor]);
+	return (float)(forces[cursor] + (forces[cursor + 1] - forces[cursor]) * blend);
+}
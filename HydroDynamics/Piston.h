@@ -0,0 +1,95 @@
+/*
+Title: HydroDynamics
+File Name: Piston.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The piston as a rigid body that sits on the fluid in its vessel. It has a mass and is driven
+by a force from outside (the keys, or a force profile a controller wrote), and it pushes onto
+the fluid with whatever pressure it takes to move together with the surface.
+
+The piston can't leave the surface: it is sealed against the walls of its vessel, so pulling
+on it sucks the fluid up with it. That means its acceleration is the acceleration of the
+surface, which the tubes of the vessel decide. The pressure is solved together with the step
+of those tubes: from the same backward Euler step VesselNetwork uses for every tube, the flow
+each tube of the vessel ends the step with falls linearly as the pressure on the vessel
+rises, so is the acceleration of the surface, and the pressure that makes the piston's own
+mass * acceleration = pressure * width - force - mass * gravity come out right follows in
+closed form. A heavy piston adds its inertia to the fluid, so the levels swing slower, and
+its weight pushes them apart. A piston without mass just pushes with force / width, which is
+how the piston worked before it had a mass.
+
+Everything is per unit of depth, like the rest of the scene: the mass is a mass per depth and
+the force a force per depth, so force / width is a pressure.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _PISTON_H
+#define _PISTON_H
+
+#include <string>
+#include <vector>
+
+struct VesselNetwork;
+
+class Piston
+{
+public:
+	int vessel = 0;
+	float mass = 0.0f;
+	float force = 0.0f;			// Pushing down from outside. Set it before every step.
+	float pressure = 0.0f;		// What the piston pushed onto the fluid with in the last step
+	float velocity = 0.0f;		// How fast it (and the surface under it) moves up after the last step
+
+	// The pressure the piston pushes with while it doesn't accelerate: its force and weight spread over its width.
+	float restingPressure(const VesselNetwork& network, float gravity) const;
+
+	// Works out the pressure for the next step of the network by dt and sets it as the external pressure of the vessel. Call it
+	// right before the step.
+	void couple(VesselNetwork& network, float density, float gravity, float dt);
+
+	// Picks up how fast the surface moves after the step. Call it right after the step.
+	void follow(const VesselNetwork& network);
+};
+
+// A force over time, as a controller would drive the piston with, read from a text file with one sample per line: the time in
+// seconds, then the force. Lines starting with # are comments. Between samples the force is interpolated linearly, and before the
+// first and after the last sample it holds their force.
+class ForceProfile
+{
+public:
+	// Replaces the profile with the samples in the file. Returns false (after printing an error) if the file can't be read, or a
+	// line isn't a sample or goes back in time.
+	bool read(const std::string& fileName);
+
+	// The force at time seconds. Fastest if asked for in increasing order of time, as the simulation does.
+	float at(double time);
+
+	bool empty() const { return times.empty(); }
+
+private:
+	std::vector<double> times;
+	std::vector<float> forces;
+	size_t cursor = 0;
+};
+
+#endif // _PISTON_H
@@ -0,0 +1,39 @@
+/*
+Title: HydroDynamics
+File Name: PowerSource.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Tells whether the machine runs on battery, for the power saving mode of the render loop (see
+--power-saving in main.cpp). On Windows that comes from GetSystemPowerStatus(). On Linux it
+comes from the mains supplies under /sys/class/power_supply: the machine is on battery when
+it has at least one and none of them is online. Reading it takes a few system calls, so the
+render loop only asks every few seconds.
+*/
+
+#ifndef _POWER_SOURCE_H
+#define _POWER_SOURCE_H
+
+// True if the machine runs on battery. Where that can't be told (a desktop, or no such information), false.
+bool onBatteryPower();
+
+#endif // _POWER_SOURCE_H
@@ -0,0 +1,682 @@
+/*
+Title: HydroDynamics
+File Name: PressureSchedule.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+External pressures that follow a formula, on as many vessels as the scene has. A schedule
+file has one line per group of vessels, with the vessels and then the expression for the
+pressure on each of them; lines starting with # are comments, and a later line wins where
+two name the same vessel:
+
+	0				2 * ramp(0, 5)							the pressure on vessel 0
+	10-99			0.5 + 0.5 * sin(2 * t + 0.1 * i)		on vessels 10 to 99
+	all				0.2 * max(h - 0.5, 0)					on every vessel
+
+An expression has + - * / ^, parentheses, numbers and the variables t (the time of the step
+in seconds), i (the index of the vessel), x (the middle of the vessel), w (its width) and h
+(its fluid height when the step starts). The functions are sin, cos, exp, sqrt, abs, min,
+max, clamp(v, low, high), step(t0) (0 before t0, 1 after) and ramp(t0, t1) (from 0 at t0 to
+1 at t1).
+
+Nothing is interpreted per vessel. Every expression is compiled into the bytecode of a stack
+machine whose registers are whole batches of SCHEDULE_BATCH vessels, so every instruction is
+one short loop over a batch that the compiler vectorizes, and the cost of decoding it is paid
+once per batch instead of once per vessel. The parts of an expression that don't depend on
+the vessel (like ramp(0, 5), or sin(2 * t)) are split off into a program of their own that
+runs once per step on plain floats, and the batches only read its results, so the per-vessel
+code is just what really differs between vessels. Constants are folded while compiling.
+Large groups are evaluated on the cores of a TaskPool, and then only the vessels whose pressure
+really changed are set, so a component at rest under a constant pressure stays asleep.
+
+The piston's vessel takes its pressure from the piston, which a schedule can't override.
+
+This file has no OpenGL dependency.
+*/
+
+#include "PressureSchedule.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// The operation of an instruction on plain floats, for folding constants and for the uniform program.
+static float scalarOp(ScheduleOp op, float a, float b, float c)
+{
+	switch (op)
+	{
+	case SCHEDULE_ADD: return a + b;
+	case SCHEDULE_SUBTRACT: return a - b;
+	case SCHEDULE_MULTIPLY: return a * b;
+	case SCHEDULE_DIVIDE: return a / b;
+	case SCHEDULE_POWER: return std::pow(a, b);
+	case SCHEDULE_NEGATE: return -a;
+	case SCHEDULE_SIN: return std::sin(a);
+	case SCHEDULE_COS: return std::cos(a);
+	case SCHEDULE_EXP: return std::exp(a);
+	case SCHEDULE_SQRT: return std::sqrt(a);
+	case SCHEDULE_ABS: return std::abs(a);
+	case SCHEDULE_MIN: return std::min(a, b);
+	case SCHEDULE_MAX: return std::max(a, b);
+	case SCHEDULE_CLAMP: return std::min(std::max(a, b), c);
+	case SCHEDULE_STEP: return a >= b ? 1.0f : 0.0f;
+	case SCHEDULE_RAMP: return c > b ? std::min(std::max((a - b) / (c - b), 0.0f), 1.0f) : (a >= b ? 1.0f : 0.0f);
+	default: return 0.0f;
+	}
+}
+
+static int operandCount(ScheduleOp op)
+{
+	switch (op)
+	{
+	case SCHEDULE_NEGATE:
+	case SCHEDULE_SIN:
+	case SCHEDULE_COS:
+	case SCHEDULE_EXP:
+	case SCHEDULE_SQRT:
+	case SCHEDULE_ABS:
+		return 1;
+	case SCHEDULE_CLAMP:
+	case SCHEDULE_RAMP:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+// The expression as a tree, which the parser builds and the code generator flattens.
+struct ScheduleNode
+{
+	ScheduleOp op;
+	float value = 0.0f;
+	int operands[3] = { -1, -1, -1 };
+	bool uniform = true;		// Doesn't depend on the vessel
+};
+
+class ScheduleParser
+{
+public:
+	std::vector<ScheduleNode> nodes;
+	std::string error;
+
+	explicit ScheduleParser(const std::string& text) : text(text) {}
+
+	// Parses the whole text, and returns its root node or -1.
+	int parse()
+	{
+		int root = expression();
+		skipSpaces();
+		if (root >= 0 && position < text.size())
+		{
+			fail("unexpected " + text.substr(position, 1));
+			return -1;
+		}
+		return root;
+	}
+
+private:
+	const std::string& text;
+	size_t position = 0;
+
+	int fail(const std::string& message)
+	{
+		if (error.empty())
+		{
+			error = message + " at column " + std::to_string(position + 1);
+		}
+		return -1;
+	}
+
+	void skipSpaces()
+	{
+		while (position < text.size() && isspace((unsigned char)text[position]))
+		{
+			position++;
+		}
+	}
+
+	bool accept(char c)
+	{
+		skipSpaces();
+		if (position < text.size() && text[position] == c)
+		{
+			position++;
+			return true;
+		}
+		return false;
+	}
+
+	int leaf(ScheduleOp op, float value = 0.0f)
+	{
+		ScheduleNode node;
+		node.op = op;
+		node.value = value;
+		node.uniform = op == SCHEDULE_CONSTANT || op == SCHEDULE_TIME;
+		nodes.push_back(node);
+		return (int)nodes.size() - 1;
+	}
+
+	// A node of op on its operands, folded into a constant if they all are.
+	int operation(ScheduleOp op, int a, int b = -1, int c = -1)
+	{
+		if (a < 0 || (operandCount(op) > 1 && b < 0) || (operandCount(op) > 2 && c < 0))
+		{
+			return -1;
+		}
+		ScheduleNode node;
+		node.op = op;
+		node.operands[0] = a;
+		node.operands[1] = b;
+		node.operands[2] = c;
+		bool constant = true;
+		for (int k = 0; k < operandCount(op); k++)
+		{
+			node.uniform = node.uniform && nodes[node.operands[k]].uniform;
+			constant = constant && nodes[node.operands[k]].op == SCHEDULE_CONSTANT;
+		}
+		if (constant)
+		{
+			float value = scalarOp(op, nodes[a].value, b >= 0 ? nodes[b].value : 0.0f, c >= 0 ? nodes[c].value : 0.0f);
+			return leaf(SCHEDULE_CONSTANT, value);
+		}
+		nodes.push_back(node);
+		return (int)nodes.size() - 1;
+	}
+
+	int expression()
+	{
+		int left = term();
+		while (left >= 0)
+		{
+			if (accept('+'))
+			{
+				left = operation(SCHEDULE_ADD, left, term());
+			}
+			else if (accept('-'))
+			{
+				left = operation(SCHEDULE_SUBTRACT, left, term());
+			}
+			else
+			{
+				break;
+			}
+		}
+		return left;
+	}
+
+	int term()
+	{
+		int left = unary();
+		while (left >= 0)
+		{
+			if (accept('*'))
+			{
+				left = operation(SCHEDULE_MULTIPLY, left, unary());
+			}
+			else if (accept('/'))
+			{
+				left = operation(SCHEDULE_DIVIDE, left, unary());
+			}
+			else
+			{
+				break;
+			}
+		}
+		return left;
+	}
+
+	int unary()
+	{
+		if (accept('-'))
+		{
+			return operation(SCHEDULE_NEGATE, unary());
+		}
+		int base = primary();
+		if (base >= 0 && accept('^'))
+		{
+			return operation(SCHEDULE_POWER, base, unary());
+		}
+		return base;
+	}
+
+	int primary()
+	{
+		skipSpaces();
+		if (position >= text.size())
+		{
+			return fail("expected a value");
+		}
+		if (accept('('))
+		{
+			int inner = expression();
+			return inner >= 0 && !accept(')') ? fail("expected )") : inner;
+		}
+
+		char c = text[position];
+		if (isdigit((unsigned char)c) || c == '.')
+		{
+			char* end = nullptr;
+			float value = strtof(text.c_str() + position, &end);
+			position = end - text.c_str();
+			return leaf(SCHEDULE_CONSTANT, value);
+		}
+		if (!isalpha((unsigned char)c))
+		{
+			return fail(std::string("unexpected ") + c);
+		}
+		size_t start = position;
+		while (position < text.size() && isalnum((unsigned char)text[position]))
+		{
+			position++;
+		}
+		std::string name = text.substr(start, position - start);
+
+		static const struct { const char* name; ScheduleOp op; } variables[] =
+		{
+			{ "t", SCHEDULE_TIME }, { "i", SCHEDULE_INDEX }, { "x", SCHEDULE_X }, { "w", SCHEDULE_WIDTH }, { "h", SCHEDULE_HEIGHT }
+		};
+		for (const auto& variable : variables)
+		{
+			if (name == variable.name)
+			{
+				return leaf(variable.op);
+			}
+		}
+
+		static const struct { const char* name; ScheduleOp op; int arguments; } functions[] =
+		{
+			{ "sin", SCHEDULE_SIN, 1 }, { "cos", SCHEDULE_COS, 1 }, { "exp", SCHEDULE_EXP, 1 }, { "sqrt", SCHEDULE_SQRT, 1 },
+			{ "abs", SCHEDULE_ABS, 1 }, { "min", SCHEDULE_MIN, 2 }, { "max", SCHEDULE_MAX, 2 }, { "clamp", SCHEDULE_CLAMP, 3 },
+			{ "step", SCHEDULE_STEP, 1 }, { "ramp", SCHEDULE_RAMP, 2 }
+		};
+		for (const auto& function : functions)
+		{
+			if (name != function.name)
+			{
+				continue;
+			}
+			if (!accept('('))
+			{
+				return fail("expected ( after " + name);
+			}
+			int arguments[3] = { -1, -1, -1 };
+			for (int k = 0; k < function.arguments; k++)
+			{
+				if (k > 0 && !accept(','))
+				{
+					return fail(name + " takes " + std::to_string(function.arguments) + " arguments");
+				}
+				arguments[k] = expression();
+				if (arguments[k] < 0)
+				{
+					return -1;
+				}
+			}
+			if (!accept(')'))
+			{
+				return fail("expected )");
+			}
+
+			// step and ramp are of the time, which goes in as their first operand.
+			if (function.op == SCHEDULE_STEP || function.op == SCHEDULE_RAMP)
+			{
+				return operation(function.op, leaf(SCHEDULE_TIME), arguments[0], arguments[1]);
+			}
+			return operation(function.op, arguments[0], arguments[1], arguments[2]);
+		}
+		return fail("unknown name " + name);
+	}
+};
+
+// Flattens the tree into the two programs, keeping track of how deep their stacks get.
+struct ScheduleGenerator
+{
+	const std::vector<ScheduleNode>& nodes;
+	ScheduleProgram& program;
+	int uniformDepth = 0;
+	int varyingDepth = 0;
+
+	void emit(std::vector<ScheduleInstruction>& code, int& depth, ScheduleOp op, float value, int popped, int pushed)
+	{
+		ScheduleInstruction instruction;
+		instruction.op = op;
+		instruction.value = value;
+		code.push_back(instruction);
+		depth += pushed - popped;
+		program.depth = std::max(program.depth, depth);
+	}
+
+	// The code of node in code, which is either of the two programs.
+	void generate(int index, std::vector<ScheduleInstruction>& code, int& depth)
+	{
+		const ScheduleNode& node = nodes[index];
+		if (&code == &program.varying && node.uniform && node.op != SCHEDULE_CONSTANT)
+		{
+			// Worked out once per step, and only read here.
+			int slot = program.uniformSlots++;
+			generate(index, program.uniform, uniformDepth);
+			emit(program.uniform, uniformDepth, SCHEDULE_STORE, (float)slot, 1, 0);
+			emit(code, depth, SCHEDULE_UNIFORM, (float)slot, 0, 1);
+			return;
+		}
+		if (node.op <= SCHEDULE_HEIGHT)
+		{
+			emit(code, depth, node.op, node.value, 0, 1);
+			return;
+		}
+		int operands = operandCount(node.op);
+		for (int k = 0; k < operands; k++)
+		{
+			generate(node.operands[k], code, depth);
+		}
+		emit(code, depth, node.op, 0.0f, operands, 1);
+	}
+};
+
+bool compileSchedule(const std::string& expression, ScheduleProgram& program, std::string& error)
+{
+	ScheduleParser parser(expression);
+	int root = parser.parse();
+	if (root < 0)
+	{
+		error = parser.error;
+		return false;
+	}
+
+	program = ScheduleProgram();
+	ScheduleGenerator generator{ parser.nodes, program };
+	generator.generate(root, program.varying, generator.varyingDepth);
+	if (program.depth > SCHEDULE_MAX_DEPTH)
+	{
+		error = "it needs a stack of " + std::to_string(program.depth) + ", more than " + std::to_string(SCHEDULE_MAX_DEPTH);
+		return false;
+	}
+	return true;
+}
+
+bool PressureSchedule::read(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<Group> loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		std::istringstream fields(line);
+		Group group;
+		if (line.empty() || line[0] == '#' || !(fields >> group.text))
+		{
+			continue;
+		}
+
+		bool valid = true;
+		if (group.text != "all")
+		{
+			char* end = nullptr;
+			group.first = (int)strtol(group.text.c_str(), &end, 10);
+			group.last = group.first;
+			if (*end == '-')
+			{
+				group.last = (int)strtol(end + 1, &end, 10);
+			}
+			valid = end != group.text.c_str() && *end == '\0' && group.first >= 0 && group.last >= group.first;
+		}
+		std::string expression;
+		std::getline(fields, expression);
+		std::string error = "it names no vessels";
+		if (!valid || !compileSchedule(expression, group.program, error))
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a valid schedule, " << error << ": " << line << std::endl;
+			return false;
+		}
+		group.slots.resize(group.program.uniformSlots);
+		loaded.push_back(group);
+	}
+	groups.swap(loaded);
+	return true;
+}
+
+void PressureSchedule::bind(const VesselNetwork& network, int pistonVessel)
+{
+	int vessels = network.vesselCount();
+	std::vector<int> owner(vessels, -1);
+	for (int g = 0; g < (int)groups.size(); g++)
+	{
+		int last = groups[g].last < 0 ? vessels - 1 : groups[g].last;
+		if (last >= vessels)
+		{
+			std::cout << "The scene has no vessel " << last << ", the schedule of " << groups[g].text << " stops at vessel " << vessels - 1 << "." << std::endl;
+			last = vessels - 1;
+		}
+		for (int i = groups[g].first; i <= last; i++)
+		{
+			owner[i] = g;
+		}
+	}
+	if (pistonVessel >= 0 && pistonVessel < vessels)
+	{
+		owner[pistonVessel] = -1;
+	}
+
+	for (Group& group : groups)
+	{
+		group.vessels.clear();
+	}
+	for (int i = 0; i < vessels; i++)
+	{
+		if (owner[i] >= 0)
+		{
+			groups[owner[i]].vessels.push_back(i);
+		}
+	}
+	for (Group& group : groups)
+	{
+		group.pressures.resize(group.vessels.size());
+	}
+}
+
+void PressureSchedule::evaluateBatch(Group& group, const VesselNetwork& network, float time, int begin, int end)
+{
+	float stack[SCHEDULE_MAX_DEPTH][SCHEDULE_BATCH];
+	const int* vessels = group.vessels.data() + begin;
+	const float* slots = group.slots.data();
+	int n = end - begin;
+	int top = -1;
+	for (const ScheduleInstruction& instruction : group.program.varying)
+	{
+		// Every case is one loop over the batch, with nothing in it but the operation.
+		float* a = top >= 0 ? stack[top] : nullptr;
+		float* b = top >= 1 ? stack[top - 1] : nullptr;
+		float* c = top >= 2 ? stack[top - 2] : nullptr;
+		float* next = top + 1 < SCHEDULE_MAX_DEPTH ? stack[top + 1] : nullptr;
+		switch (instruction.op)
+		{
+		case SCHEDULE_CONSTANT:
+		case SCHEDULE_UNIFORM:
+		{
+			float value = instruction.op == SCHEDULE_CONSTANT ? instruction.value : slots[(int)instruction.value];
+			std::fill(next, next + n, value);
+			top++;
+			break;
+		}
+		case SCHEDULE_TIME:
+			std::fill(next, next + n, time);
+			top++;
+			break;
+		case SCHEDULE_INDEX:
+			for (int k = 0; k < n; k++) next[k] = (float)vessels[k];
+			top++;
+			break;
+		case SCHEDULE_X:
+			for (int k = 0; k < n; k++) next[k] = (network.left[vessels[k]] + network.right[vessels[k]]) * 0.5f;
+			top++;
+			break;
+		case SCHEDULE_WIDTH:
+			for (int k = 0; k < n; k++) next[k] = network.width[vessels[k]];
+			top++;
+			break;
+		case SCHEDULE_HEIGHT:
+			for (int k = 0; k < n; k++) next[k] = network.height[vessels[k]];
+			top++;
+			break;
+
+		// The operands are on the stack in order, so the last one is on top: a is the top, b below it, c below that.
+		case SCHEDULE_ADD:
+			for (int k = 0; k < n; k++) b[k] = b[k] + a[k];
+			top--;
+			break;
+		case SCHEDULE_SUBTRACT:
+			for (int k = 0; k < n; k++) b[k] = b[k] - a[k];
+			top--;
+			break;
+		case SCHEDULE_MULTIPLY:
+			for (int k = 0; k < n; k++) b[k] = b[k] * a[k];
+			top--;
+			break;
+		case SCHEDULE_DIVIDE:
+			for (int k = 0; k < n; k++) b[k] = b[k] / a[k];
+			top--;
+			break;
+		case SCHEDULE_POWER:
+			for (int k = 0; k < n; k++) b[k] = std::pow(b[k], a[k]);
+			top--;
+			break;
+		case SCHEDULE_MIN:
+			for (int k = 0; k < n; k++) b[k] = std::min(b[k], a[k]);
+			top--;
+			break;
+		case SCHEDULE_MAX:
+			for (int k = 0; k < n; k++) b[k] = std::max(b[k], a[k]);
+			top--;
+			break;
+		case SCHEDULE_STEP:
+			for (int k = 0; k < n; k++) b[k] = b[k] >= a[k] ? 1.0f : 0.0f;
+			top--;
+			break;
+		case SCHEDULE_NEGATE:
+			for (int k = 0; k < n; k++) a[k] = -a[k];
+			break;
+		case SCHEDULE_SIN:
+			for (int k = 0; k < n; k++) a[k] = std::sin(a[k]);
+			break;
+		case SCHEDULE_COS:
+			for (int k = 0; k < n; k++) a[k] = std::cos(a[k]);
+			break;
+		case SCHEDULE_EXP:
+			for (int k = 0; k < n; k++) a[k] = std::exp(a[k]);
+			break;
+		case SCHEDULE_SQRT:
+			for (int k = 0; k < n; k++) a[k] = std::sqrt(a[k]);
+			break;
+		case SCHEDULE_ABS:
+			for (int k = 0; k < n; k++) a[k] = std::abs(a[k]);
+			break;
+		case SCHEDULE_CLAMP:
+			for (int k = 0; k < n; k++) c[k] = std::min(std::max(c[k], b[k]), a[k]);
+			top -= 2;
+			break;
+		case SCHEDULE_RAMP:
+			for (int k = 0; k < n; k++) c[k] = scalarOp(SCHEDULE_RAMP, c[k], b[k], a[k]);
+			top -= 2;
+			break;
+		default:
+			break;
+		}
+	}
+	std::copy(stack[0], stack[0] + n, group.pressures.begin() + begin);
+}
+
+// Runs the uniform program of a group, which only ever sees the time.
+static void runUniform(const ScheduleProgram& program, float time, std::vector<float>& slots)
+{
+	float stack[SCHEDULE_MAX_DEPTH];
+	int top = -1;
+	for (const ScheduleInstruction& instruction : program.uniform)
+	{
+		ScheduleOp op = instruction.op;
+		if (op == SCHEDULE_CONSTANT || op == SCHEDULE_TIME)
+		{
+			stack[++top] = op == SCHEDULE_CONSTANT ? instruction.value : time;
+		}
+		else if (op == SCHEDULE_STORE)
+		{
+			slots[(int)instruction.value] = stack[top--];
+		}
+		else
+		{
+			int operands = operandCount(op);
+			top -= operands - 1;
+			stack[top] = scalarOp(op, stack[top], operands > 1 ? stack[top + 1] : 0.0f, operands > 2 ? stack[top + 2] : 0.0f);
+		}
+	}
+}
+
+int PressureSchedule::apply(VesselNetwork& network, double time, TaskPool* pool)
+{
+	float now = (float)time;
+	int changed = 0;
+	for (Group& group : groups)
+	{
+		runUniform(group.program, now, group.slots);
+		int count = (int)group.vessels.size();
+		int batches = (count + SCHEDULE_BATCH - 1) / SCHEDULE_BATCH;
+		auto evaluate = [&](int begin, int end)
+		{
+			for (int b = begin; b < end; b++)
+			{
+				evaluateBatch(group, network, now, b * SCHEDULE_BATCH, std::min(count, (b + 1) * SCHEDULE_BATCH));
+			}
+		};
+		if (pool != nullptr && batches > SCHEDULE_POOL_BATCHES)
+		{
+			pool->parallelFor(batches, SCHEDULE_POOL_BATCHES, evaluate);
+		}
+		else
+		{
+			evaluate(0, batches);
+		}
+
+		// Setting a pressure wakes its component, which isn't safe to do from several threads, and only needs doing where it changed.
+		for (int k = 0; k < count; k++)
+		{
+			int vessel = group.vessels[k];
+			if (network.externalPressure[vessel] != group.pressures[k])
+			{
+				network.setExternalPressure(vessel, group.pressures[k]);
+				changed++;
+			}
+		}
+	}
+	return changed;
+}
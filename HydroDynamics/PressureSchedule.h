@@ -0,0 +1,151 @@
+/*
+Title: HydroDynamics
+File Name: PressureSchedule.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+External pressures that follow a formula, on as many vessels as the scene has. A schedule
+file has one line per group of vessels, with the vessels and then the expression for the
+pressure on each of them; lines starting with # are comments, and a later line wins where
+two name the same vessel:
+
+	0				2 * ramp(0, 5)							the pressure on vessel 0
+	10-99			0.5 + 0.5 * sin(2 * t + 0.1 * i)		on vessels 10 to 99
+	all				0.2 * max(h - 0.5, 0)					on every vessel
+
+An expression has + - * / ^, parentheses, numbers and the variables t (the time of the step
+in seconds), i (the index of the vessel), x (the middle of the vessel), w (its width) and h
+(its fluid height when the step starts). The functions are sin, cos, exp, sqrt, abs, min,
+max, clamp(v, low, high), step(t0) (0 before t0, 1 after) and ramp(t0, t1) (from 0 at t0 to
+1 at t1).
+
+Nothing is interpreted per vessel. Every expression is compiled into the bytecode of a stack
+machine whose registers are whole batches of SCHEDULE_BATCH vessels, so every instruction is
+one short loop over a batch that the compiler vectorizes, and the cost of decoding it is paid
+once per batch instead of once per vessel. The parts of an expression that don't depend on
+the vessel (like ramp(0, 5), or sin(2 * t)) are split off into a program of their own that
+runs once per step on plain floats, and the batches only read its results, so the per-vessel
+code is just what really differs between vessels. Constants are folded while compiling.
+Large groups are evaluated on the cores of a TaskPool, and then only the vessels whose pressure
+really changed are set, so a component at rest under a constant pressure stays asleep.
+
+The piston's vessel takes its pressure from the piston, which a schedule can't override.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _PRESSURE_SCHEDULE_H
+#define _PRESSURE_SCHEDULE_H
+
+#include <string>
+#include <vector>
+
+struct VesselNetwork;
+class TaskPool;
+
+// The vessels every instruction of a program works on at once.
+#define SCHEDULE_BATCH 256
+
+// The deepest the stack of a program may get, and the most batches a group evaluates in one block on the pool.
+#define SCHEDULE_MAX_DEPTH 16
+#define SCHEDULE_POOL_BATCHES 16
+
+enum ScheduleOp
+{
+	SCHEDULE_CONSTANT = 0,	// Pushes value
+	SCHEDULE_UNIFORM,		// Pushes the result slot of the uniform program
+	SCHEDULE_TIME,
+	SCHEDULE_INDEX,
+	SCHEDULE_X,
+	SCHEDULE_WIDTH,
+	SCHEDULE_HEIGHT,
+	SCHEDULE_ADD,
+	SCHEDULE_SUBTRACT,
+	SCHEDULE_MULTIPLY,
+	SCHEDULE_DIVIDE,
+	SCHEDULE_POWER,
+	SCHEDULE_NEGATE,
+	SCHEDULE_SIN,
+	SCHEDULE_COS,
+	SCHEDULE_EXP,
+	SCHEDULE_SQRT,
+	SCHEDULE_ABS,
+	SCHEDULE_MIN,
+	SCHEDULE_MAX,
+	SCHEDULE_CLAMP,
+	SCHEDULE_STEP,
+	SCHEDULE_RAMP,
+	SCHEDULE_STORE			// Pops into the result slot (of the uniform program)
+};
+
+struct ScheduleInstruction
+{
+	ScheduleOp op;
+	float value;			// The constant, or the slot
+};
+
+// A compiled expression: the program that runs once per step, and the one that runs per batch of vessels.
+struct ScheduleProgram
+{
+	std::vector<ScheduleInstruction> uniform;
+	std::vector<ScheduleInstruction> varying;
+	int uniformSlots = 0;
+	int depth = 0;			// The deepest the stack of either gets
+};
+
+// Compiles an expression. Returns false (and sets error) if it isn't one, or needs a deeper stack than SCHEDULE_MAX_DEPTH.
+bool compileSchedule(const std::string& expression, ScheduleProgram& program, std::string& error);
+
+class PressureSchedule
+{
+public:
+	// Reads a schedule file and compiles its expressions. Returns false (after printing an error) if the file can't be read or a
+	// line doesn't compile.
+	bool read(const std::string& fileName);
+
+	bool empty() const { return groups.empty(); }
+
+	// Works out the vessels of every group on network, the last group that names a vessel getting it, and leaves out the piston's
+	// vessel. Vessels past the end of the network are left out too, with a warning. Call it again whenever the network is replaced.
+	void bind(const VesselNetwork& network, int pistonVessel);
+
+	// Sets the external pressures for the step at time seconds. Returns the number of vessels whose pressure changed.
+	int apply(VesselNetwork& network, double time, TaskPool* pool = nullptr);
+
+private:
+	struct Group
+	{
+		std::string text;				// The vessels as the file names them
+		int first = 0;
+		int last = -1;					// -1 for the end of the network
+		ScheduleProgram program;
+		std::vector<int> vessels;		// After bind()
+		std::vector<float> pressures;	// What apply() evaluated, per vessel
+		std::vector<float> slots;		// The results of the uniform program
+	};
+	std::vector<Group> groups;
+
+	// Runs the varying program of group on vessels [begin, end) of its list, at most SCHEDULE_BATCH of them.
+	static void evaluateBatch(Group& group, const VesselNetwork& network, float time, int begin, int end);
+};
+
+#endif // _PRESSURE_SCHEDULE_H
@@ -0,0 +1,178 @@
+/*
+Title: HydroDynamics
+File Name: Profiler.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A lightweight frame profiler. Put PROFILE_SCOPE(id) at the top of a block and the time
+until the end of the block is added to that scope for the current frame. At the end of
+every frame, profilerEndFrame() stores the total of every scope in a ring of the last
+PROFILE_HISTORY frames, from which the rolling minimum, mean and 99th percentile are
+calculated.
+
+The timers only read a clock and add to a number, so they are cheap enough to leave in
+the main loop of a release build.
+*/
+
+#include "Profiler.h"
+#include "FlightRecorder.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+
+static ProfileScope scopes[PROFILE_COUNT] =
+{
+	{ "frame" },
+	{ "update" },
+	{ "render" },
+	{ "swap" },
+	{ "poll" },
+	{ "gpu scene" },
+	{ "gpu overlay" },
+};
+
+static int nextFrame = 0;
+static int recordedFrames = 0;
+
+// The same history again for other threads, only written while something reads it.
+static std::atomic<bool> publishing(false);
+static std::atomic<float> published[PROFILE_COUNT][PROFILE_HISTORY];
+static std::atomic<long long> publishedFrames(0);
+
+void profilerAdd(ProfileId id, double milliseconds)
+{
+	scopes[id].current += milliseconds;
+	scopes[id].calls++;
+}
+
+void profilerEndScope(ProfileId id, std::chrono::steady_clock::time_point start)
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+	profilerAdd(id, elapsed.count() / 1000000.0);
+
+	if (traceEnabled())
+	{
+		unsigned long long now = traceNow();
+		unsigned long long duration = (unsigned long long)elapsed.count();
+		traceSpan(scopes[id].name, now > duration ? now - duration : 0, duration);
+	}
+	if (flightRecording())
+	{
+		flightSpan(scopes[id].name, elapsed.count() / 1000000.0);
+	}
+}
+
+void profilerSet(ProfileId id, double milliseconds)
+{
+	scopes[id].current = milliseconds;
+	scopes[id].calls = 1;
+}
+
+void profilerEndFrame()
+{
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		scopes[i].history[nextFrame] = (float)scopes[i].current;
+		scopes[i].lastCalls = scopes[i].calls;
+		scopes[i].current = 0.0;
+		scopes[i].calls = 0;
+	}
+
+	// Published frames count from 0 in their own ring, so the first ones are at the start of it before it wrapped.
+	if (publishing.load(std::memory_order_relaxed))
+	{
+		long long frame = publishedFrames.load(std::memory_order_relaxed);
+		for (int i = 0; i < PROFILE_COUNT; i++)
+		{
+			published[i][frame % PROFILE_HISTORY].store(scopes[i].history[nextFrame], std::memory_order_relaxed);
+		}
+		publishedFrames.store(frame + 1, std::memory_order_release);
+	}
+
+	nextFrame = (nextFrame + 1) % PROFILE_HISTORY;
+	if (recordedFrames < PROFILE_HISTORY)
+	{
+		recordedFrames++;
+	}
+}
+
+void profilerPublish()
+{
+	publishing.store(true);
+}
+
+int profilerPublishedHistory(ProfileId id, float* samples)
+{
+	// A frame that ends while this copies may already be in there, which only moves the window by one frame.
+	int count = (int)std::min<long long>(publishedFrames.load(std::memory_order_acquire), PROFILE_HISTORY);
+	for (int i = 0; i < count; i++)
+	{
+		samples[i] = published[id][i].load(std::memory_order_relaxed);
+	}
+	return count;
+}
+
+long long profilerPublishedFrames()
+{
+	return publishedFrames.load(std::memory_order_acquire);
+}
+
+ProfileStats profilerStats(ProfileId id)
+{
+	ProfileStats stats = { 0.0f, 0.0f, 0.0f, 0.0f };
+	if (recordedFrames == 0)
+	{
+		return stats;
+	}
+
+	// Copy the history so we can sort it to find the percentile. It is only PROFILE_HISTORY floats, and this is only
+	// called when the numbers are displayed, not every frame.
+	float sorted[PROFILE_HISTORY];
+	std::copy(scopes[id].history, scopes[id].history + recordedFrames, sorted);
+	std::sort(sorted, sorted + recordedFrames);
+
+	double sum = 0.0;
+	for (int i = 0; i < recordedFrames; i++)
+	{
+		sum += sorted[i];
+	}
+
+	stats.min = sorted[0];
+	stats.mean = (float)(sum / recordedFrames);
+	stats.p99 = sorted[std::min(recordedFrames - 1, (int)(recordedFrames * 0.99f))];
+	stats.last = scopes[id].history[profilerNewestFrame()];
+	return stats;
+}
+
+const ProfileScope& profilerScope(ProfileId id)
+{
+	return scopes[id];
+}
+
+int profilerFrameCount()
+{
+	return recordedFrames;
+}
+
+int profilerNewestFrame()
+{
+	return (nextFrame + PROFILE_HISTORY - 1) % PROFILE_HISTORY;
+}
@@ -0,0 +1,126 @@
+/*
+Title: HydroDynamics
+File Name: Profiler.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A lightweight frame profiler. Put PROFILE_SCOPE(id) at the top of a block and the time
+until the end of the block is added to that scope for the current frame. At the end of
+every frame, profilerEndFrame() stores the total of every scope in a ring of the last
+PROFILE_HISTORY frames, from which the rolling minimum, mean and 99th percentile are
+calculated.
+
+The timers only read a clock and add to a number, so they are cheap enough to leave in
+the main loop of a release build.
+*/
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <atomic>
+#include <chrono>
+
+// How many frames of history every scope keeps.
+#define PROFILE_HISTORY 256
+
+// The scopes that are timed. Add new ones before PROFILE_COUNT and give them a name in Profiler.cpp.
+enum ProfileId
+{
+	PROFILE_FRAME = 0,	// The whole iteration of the main loop
+	PROFILE_UPDATE,		// All calls to update() in the frame
+	PROFILE_RENDER,		// renderScene()
+	PROFILE_SWAP,		// glfwSwapBuffers()
+	PROFILE_POLL,		// glfwPollEvents()
+	PROFILE_GPU_SCENE,	// GPU time of drawing the apparatus, measured with timer queries (see GpuTimer.h)
+	PROFILE_GPU_OVERLAY,// GPU time of drawing the profiler overlay
+	PROFILE_COUNT
+};
+
+struct ProfileStats
+{
+	float min;		// milliseconds
+	float mean;
+	float p99;
+	float last;
+};
+
+struct ProfileScope
+{
+	const char* name;
+	double current;					// Milliseconds spent in this scope so far this frame
+	float history[PROFILE_HISTORY];	// Totals of the last frames, oldest overwritten first
+	int calls;						// How many times the scope was entered this frame
+	int lastCalls;
+};
+
+// Adds elapsed milliseconds to a scope for the current frame.
+void profilerAdd(ProfileId id, double milliseconds);
+
+// Ends a scope that started at start: adds the elapsed time to it and, while tracing, records it as a span (see TraceRecorder.h).
+void profilerEndScope(ProfileId id, std::chrono::steady_clock::time_point start);
+
+// Adds a sample that was measured somewhere else (for example on the GPU) as this frame's total for a scope.
+void profilerSet(ProfileId id, double milliseconds);
+
+// Closes the current frame: every scope's total goes into its history and the totals start over.
+void profilerEndFrame();
+
+// Calculates the rolling statistics of a scope over the frames in its history.
+ProfileStats profilerStats(ProfileId id);
+
+// Direct access to a scope, e.g. for its name or for drawing the history.
+const ProfileScope& profilerScope(ProfileId id);
+
+// Number of frames that have been recorded (stops counting at PROFILE_HISTORY).
+int profilerFrameCount();
+
+// Index in the history of the most recently finished frame.
+int profilerNewestFrame();
+
+// Makes profilerEndFrame() also store the totals of every frame in atomics, where another thread (the metrics endpoint, see
+// MetricsServer.h) can read them while the frames go on.
+void profilerPublish();
+
+// From any thread: copies the published totals of a scope into samples, which has room for PROFILE_HISTORY of them, in no
+// particular order. Returns how many there are.
+int profilerPublishedHistory(ProfileId id, float* samples);
+
+// From any thread: the number of frames that ended since publishing started.
+long long profilerPublishedFrames();
+
+// Times the block it is declared in and adds the result to a scope when it goes out of scope.
+struct ScopedTimer
+{
+	ProfileId id;
+	std::chrono::steady_clock::time_point start;
+
+	explicit ScopedTimer(ProfileId scope) : id(scope), start(std::chrono::steady_clock::now()) {}
+	~ScopedTimer()
+	{
+		profilerEndScope(id, start);
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(id) ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(id)
+
+#endif // _PROFILER_H
@@ -0,0 +1,180 @@
+/*
+Title: HydroDynamics
+File Name: ProfilerOverlay.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Draws the profiler numbers on top of the scene. Every scope gets a horizontal bar for its
+mean time with a tick at its 99th percentile and a faint bar from its minimum, and below
+them is a graph of the frame time of the last PROFILE_HISTORY frames. A white line marks
+the frame budget. The same numbers are also available as text for the window title.
+*/
+
+#include "ProfilerOverlay.h"
+#include "GLState.h"
+
+// 3 quads per scope (minimum, mean, 99th percentile tick), one per frame in the graph and one for the budget line.
+#define OVERLAY_QUADS (PROFILE_COUNT * 3 + PROFILE_HISTORY + 1)
+
+// The overlay lives in the top left corner of the screen, in clip space.
+#define OVERLAY_LEFT -0.98f
+#define OVERLAY_TOP 0.98f
+#define OVERLAY_WIDTH 0.9f
+#define BAR_HEIGHT 0.03f
+#define GRAPH_HEIGHT 0.2f
+
+static GLuint overlayVao;
+static GLuint overlayVbo;
+static GLuint overlayEbo;
+static VertexFormat overlayVertices[OVERLAY_QUADS * 4];
+
+// One color per scope, so the bars can be told apart.
+static const glm::vec4 scopeColors[PROFILE_COUNT] =
+{
+	glm::vec4(0.9f, 0.9f, 0.9f, 1.0f),	// frame
+	glm::vec4(0.2f, 0.8f, 0.2f, 1.0f),	// update
+	glm::vec4(0.2f, 0.6f, 1.0f, 1.0f),	// render
+	glm::vec4(1.0f, 0.6f, 0.1f, 1.0f),	// swap
+	glm::vec4(0.8f, 0.3f, 0.8f, 1.0f),	// poll
+	glm::vec4(0.1f, 0.9f, 0.9f, 1.0f),	// gpu scene
+	glm::vec4(0.9f, 0.9f, 0.2f, 1.0f),	// gpu overlay
+};
+
+// Writes an axis aligned rectangle, given its left, bottom, right and top edges.
+static int writeRect(int quad, float x0, float y0, float x1, float y1, glm::vec4 color)
+{
+	VertexFormat* out = &overlayVertices[quad * 4];
+	out[0] = VertexFormat(glm::vec3(x0, y0, 0.0f), color);
+	out[1] = VertexFormat(glm::vec3(x1, y0, 0.0f), color);
+	out[2] = VertexFormat(glm::vec3(x1, y1, 0.0f), color);
+	out[3] = VertexFormat(glm::vec3(x0, y1, 0.0f), color);
+	return quad + 1;
+}
+
+void initProfilerOverlay()
+{
+	GLuint indices[OVERLAY_QUADS * 6];
+	for (int i = 0; i < OVERLAY_QUADS; i++)
+	{
+		GLuint first = (GLuint)(i * 4);
+		indices[i * 6 + 0] = first + 0;
+		indices[i * 6 + 1] = first + 1;
+		indices[i * 6 + 2] = first + 2;
+		indices[i * 6 + 3] = first + 0;
+		indices[i * 6 + 4] = first + 2;
+		indices[i * 6 + 5] = first + 3;
+	}
+
+	glGenVertexArrays(1, &overlayVao);
+	cachedBindVertexArray(overlayVao);
+
+	// The bars change every frame, so GL_STREAM_DRAW.
+	glGenBuffers(1, &overlayVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, overlayVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(overlayVertices), nullptr, GL_STREAM_DRAW);
+
+	glGenBuffers(1, &overlayEbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, overlayEbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, color));
+
+	cachedBindVertexArray(0);
+}
+
+void queueProfilerOverlay(RenderQueue& queue, GLuint program, float budgetMilliseconds)
+{
+	// The full width of the overlay is two frame budgets, so a frame that is over budget is easy to spot.
+	float scale = OVERLAY_WIDTH / (2.0f * budgetMilliseconds);
+	int quad = 0;
+
+	// One row per scope.
+	float y = OVERLAY_TOP;
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		ProfileStats stats = profilerStats((ProfileId)i);
+		glm::vec4 color = scopeColors[i];
+		glm::vec4 faint = glm::vec4(glm::vec3(color) * 0.4f, 1.0f);
+
+		float y0 = y - BAR_HEIGHT;
+		quad = writeRect(quad, OVERLAY_LEFT, y0, OVERLAY_LEFT + glm::min(stats.mean, 2.0f * budgetMilliseconds) * scale, y, color);
+		quad = writeRect(quad, OVERLAY_LEFT, y0 + BAR_HEIGHT * 0.7f, OVERLAY_LEFT + glm::min(stats.min, 2.0f * budgetMilliseconds) * scale, y, faint);
+
+		float tick = OVERLAY_LEFT + glm::min(stats.p99, 2.0f * budgetMilliseconds) * scale;
+		quad = writeRect(quad, tick - 0.003f, y0, tick + 0.003f, y, glm::vec4(1.0f, 0.2f, 0.2f, 1.0f));
+
+		y -= BAR_HEIGHT * 1.5f;
+	}
+
+	// Graph of the frame time of every frame in the history, the oldest on the left.
+	const ProfileScope& frame = profilerScope(PROFILE_FRAME);
+	float graphBottom = y - GRAPH_HEIGHT;
+	float barWidth = OVERLAY_WIDTH / PROFILE_HISTORY;
+	float graphScale = GRAPH_HEIGHT / (2.0f * budgetMilliseconds);
+	int newest = profilerNewestFrame();
+	for (int i = 0; i < PROFILE_HISTORY; i++)
+	{
+		int index = (newest + 1 + i) % PROFILE_HISTORY;
+		float ms = i < PROFILE_HISTORY - profilerFrameCount() ? 0.0f : frame.history[index];
+		float x = OVERLAY_LEFT + i * barWidth;
+		glm::vec4 color = ms > budgetMilliseconds ? glm::vec4(1.0f, 0.3f, 0.2f, 1.0f) : glm::vec4(0.3f, 0.9f, 0.3f, 1.0f);
+		quad = writeRect(quad, x, graphBottom, x + barWidth, graphBottom + glm::min(ms, 2.0f * budgetMilliseconds) * graphScale, color);
+	}
+
+	// The frame budget, halfway up the graph.
+	float budgetY = graphBottom + budgetMilliseconds * graphScale;
+	quad = writeRect(quad, OVERLAY_LEFT, budgetY - 0.002f, OVERLAY_LEFT + OVERLAY_WIDTH, budgetY + 0.002f, glm::vec4(1.0f));
+
+	// Replace the whole buffer. Orphaning it with glBufferData first lets the driver hand us fresh memory instead of waiting for
+	// the GPU to finish reading last frame's bars.
+	glBindBuffer(GL_ARRAY_BUFFER, overlayVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(overlayVertices), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(VertexFormat) * quad * 4, overlayVertices);
+
+	// The overlay is drawn over everything in screen space, so no depth test and an identity MVP.
+	DrawItem item;
+	item.layer = RENDER_LAYER_OVERLAY;
+	item.program = program;
+	item.vao = overlayVao;
+	item.indexType = GL_UNSIGNED_INT;
+	item.count = quad * 6;
+	item.depthTest = false;
+	queue.add(item);
+}
+
+void destroyProfilerOverlay()
+{
+	cachedDeleteVertexArrays(1, &overlayVao);
+	glDeleteBuffers(1, &overlayVbo);
+	glDeleteBuffers(1, &overlayEbo);
+}
+
+void profilerSummary(FrameText& text)
+{
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		ProfileStats stats = profilerStats((ProfileId)i);
+		text.append("%s%s %.2fms (p99 %.2f)", i > 0 ? " | " : "", profilerScope((ProfileId)i).name, stats.mean, stats.p99);
+	}
+}
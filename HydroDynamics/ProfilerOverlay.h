@@ -0,0 +1,52 @@
+/*
+Title: HydroDynamics
+File Name: ProfilerOverlay.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Draws the profiler numbers on top of the scene. Every scope gets a horizontal bar for its
+mean time with a tick at its 99th percentile and a faint bar from its minimum, and below
+them is a graph of the frame time of the last PROFILE_HISTORY frames. A white line marks
+the frame budget. The same numbers are also available as text for the window title.
+*/
+
+#ifndef _PROFILER_OVERLAY_H
+#define _PROFILER_OVERLAY_H
+
+#include "GLIncludes.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "FrameArena.h"
+
+// Creates the buffers used by the overlay. Needs a current OpenGL context.
+void initProfilerOverlay();
+
+// Writes the overlay and adds it to the queue in RENDER_LAYER_OVERLAY, drawn with program. The overlay is in clip space, so its
+// MVP is identity.
+void queueProfilerOverlay(RenderQueue& queue, GLuint program, float budgetMilliseconds);
+
+// Frees the buffers of the overlay.
+void destroyProfilerOverlay();
+
+// Appends a one line summary like "frame 16.7ms (p99 17.2) | update 0.02ms | ..." to text.
+void profilerSummary(FrameText& text);
+
+#endif // _PROFILER_OVERLAY_H
@@ -0,0 +1,136 @@
+/*
+Title: HydroDynamics
+File Name: RemoteControl.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Lets test automation and other external controllers send commands to the simulation over
+TCP (--control-port PORT) instead of simulating key presses.
+
+Every line a controller sends is one command, written as it is in an input log (see
+InputLog.h) without the step: "pressure+", "pressure 1.5", "external 3 200",
+"fill 3 0.2" or "rewind 600". The command goes into the same input queue as the keys, so the
+next physics step applies it, and records it if the input is being recorded (all but a
+rewind). Every line is answered with "ok", or with "error" and the reason.
+
+A controller that follows the steps over a slow link can put the step a command was meant
+for in front of it, "at 1200 pressure 1.5". With --speculate, a command for a step that
+already ran takes the simulation back to that step and runs the steps since again with it
+(see main.cpp); otherwise, and for a step still to come, it is applied on the next step.
+
+One background thread serves every controller. It polls the connections every
+CONTROL_POLL_MILLISECONDS, so a command waits at most that long before it is queued.
+*/
+
+#include "RemoteControl.h"
+#include "ThreadControl.h"
+#include <cstdlib>
+#include <iostream>
+
+RemoteControl::~RemoteControl()
+{
+	stop();
+}
+
+bool RemoteControl::start(int port, void(*onCommand)(const InputEvent& event))
+{
+	stop();
+	if (!listener.listen(port))
+	{
+		return false;
+	}
+	handler = onCommand;
+	stopping = false;
+	thread = std::thread(&RemoteControl::run, this);
+	return true;
+}
+
+void RemoteControl::stop()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+	stopping = true;
+	thread.join();
+	listener.close();
+	controllers.clear();
+}
+
+void RemoteControl::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	while (!stopping)
+	{
+		// Waiting for a new controller is what paces the loop.
+		std::unique_ptr<LineConnection> connection(new LineConnection());
+		if (listener.accept(*connection, CONTROL_POLL_MILLISECONDS) && connection->setNonBlocking())
+		{
+			controllers.push_back(std::move(connection));
+		}
+
+		for (size_t i = 0; i < controllers.size();)
+		{
+			LineConnection& controller = *controllers[i];
+			std::string line;
+			while (controller.pollLine(line))
+			{
+				InputEvent event;
+				event.step = -1;
+				size_t command = 0;
+				if (line.compare(0, 3, "at ") == 0)
+				{
+					char* end = nullptr;
+					event.step = std::strtoll(line.c_str() + 3, &end, 10);
+					command = end - line.c_str();
+					if (end == line.c_str() + 3 || event.step < 0)
+					{
+						controller.sendLine("error not a step: " + line);
+						continue;
+					}
+				}
+				if (!parseInputCommand(line.substr(command), event))
+				{
+					controller.sendLine("error not a command: " + line);
+				}
+				else if ((event.command == INPUT_SET_EXTERNAL || event.command == INPUT_ADD_FLUID) && event.vessel < 0)
+				{
+					controller.sendLine("error not a vessel: " + line);
+				}
+				else
+				{
+					handler(event);
+					controller.sendLine("ok");
+				}
+			}
+
+			if (controller.isOpen())
+			{
+				i++;
+			}
+			else
+			{
+				controllers.erase(controllers.begin() + i);
+			}
+		}
+	}
+}
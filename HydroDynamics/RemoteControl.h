@@ -0,0 +1,82 @@
+/*
+Title: HydroDynamics
+File Name: RemoteControl.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Lets test automation and other external controllers send commands to the simulation over
+TCP (--control-port PORT) instead of simulating key presses.
+
+Every line a controller sends is one command, written as it is in an input log (see
+InputLog.h) without the step: "pressure+", "pressure 1.5", "external 3 200",
+"fill 3 0.2" or "rewind 600". The command goes into the same input queue as the keys, so the
+next physics step applies it, and records it if the input is being recorded (all but a
+rewind). Every line is answered with "ok", or with "error" and the reason.
+
+A controller that follows the steps over a slow link can put the step a command was meant
+for in front of it, "at 1200 pressure 1.5". With --speculate, a command for a step that
+already ran takes the simulation back to that step and runs the steps since again with it
+(see main.cpp); otherwise, and for a step still to come, it is applied on the next step.
+
+One background thread serves every controller. It polls the connections every
+CONTROL_POLL_MILLISECONDS, so a command waits at most that long before it is queued.
+*/
+
+#ifndef _REMOTE_CONTROL_H
+#define _REMOTE_CONTROL_H
+
+#include "InputLog.h"
+#include "LineSocket.h"
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#define CONTROL_POLL_MILLISECONDS 1
+
+class RemoteControl
+{
+public:
+	RemoteControl() {}
+	~RemoteControl();
+
+	RemoteControl(const RemoteControl&) = delete;
+	RemoteControl& operator=(const RemoteControl&) = delete;
+
+	// Listens on port and starts the thread, which calls onCommand for every command that arrives (on that thread). Returns false
+	// (after printing an error) if the port can't be used.
+	bool start(int port, void(*onCommand)(const InputEvent& event));
+
+	// Stops the thread and disconnects every controller.
+	void stop();
+
+private:
+	void run();
+
+	LineListener listener;
+	void(*handler)(const InputEvent& event) = nullptr;
+	std::thread thread;
+	std::atomic<bool> stopping{ false };
+	std::vector<std::unique_ptr<LineConnection>> controllers;
+};
+
+#endif // _REMOTE_CONTROL_H
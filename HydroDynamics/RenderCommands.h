@@ -0,0 +1,80 @@
+/*
+Title: HydroDynamics
+File Name: RenderCommands.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A buffer of render commands that any thread can record, for the render thread to replay
+later. OpenGL only takes calls on the thread its context is current on, so working out
+what to draw (the instances of a large scene, say) would be stuck on that one thread too.
+Recording doesn't touch OpenGL at all: a draw is a DrawItem (see RenderQueue.h) and an
+upload is a range of bytes for a buffer, copied into the command buffer or written into it
+in place. Every thread, or every block of a parallelFor(), records into a buffer of its
+own, so recording needs no locks, and the render thread replays the buffers one after the
+other once they are done.
+
+replay() does the uploads in the order they were recorded, through GL_COPY_WRITE_BUFFER so
+no binding a draw relies on changes, then adds the draws to a RenderQueue, which sorts
+them like any other. It empties the buffer but keeps its memory, so a buffer recorded
+every frame stops allocating after the first.
+*/
+
+#ifndef _RENDER_COMMANDS_H
+#define _RENDER_COMMANDS_H
+
+#include "RenderQueue.h"
+#include <vector>
+
+class RenderCommands
+{
+public:
+	// Records a draw.
+	void draw(const DrawItem& item);
+
+	// Records writing size bytes into buffer at offset. The bytes are copied, so data can be reused right away.
+	void upload(GLuint buffer, GLintptr offset, const void* data, size_t size);
+
+	// Records writing size bytes into buffer at offset, and returns where to put them, which saves the copy of upload(). The
+	// pointer is good until the next upload() or write().
+	void* write(GLuint buffer, GLintptr offset, size_t size);
+
+	// Does the uploads and adds the draws to queue, on the thread of the context, then empties the buffer.
+	void replay(RenderQueue& queue);
+
+	void clear();
+	bool empty() const { return draws.empty() && uploads.empty(); }
+
+private:
+	struct Upload
+	{
+		GLuint buffer;
+		GLintptr offset;
+		size_t begin;	// Where the bytes start in bytes
+		size_t size;
+	};
+
+	std::vector<DrawItem> draws;
+	std::vector<Upload> uploads;
+	std::vector<unsigned char> bytes;
+};
+
+#endif // _RENDER_COMMANDS_H
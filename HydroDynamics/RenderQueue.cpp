@@ -0,0 +1,205 @@
+/*
+Title: HydroDynamics
+File Name: RenderQueue.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Collects everything that is drawn in a frame as a list of draw items instead of issuing the
+draws right away, then sorts them and draws them with as few calls and state changes as
+possible.
+
+An item names the program, the vertex array, the range of vertices or indices, and the state
+it needs (depth test, point size and the MVP matrix). Items are drawn in order of their
+layer, which is how the caller says that one thing has to be drawn over another. Within a
+layer they are sorted by program and state, so every program, vertex array and state is set
+once per layer. Items with the same state whose ranges follow each other in the same buffer
+are merged into a single draw. That way new objects or UI only add draws when they actually
+need different state.
+
+The MVP is sent to a program only when it differs from the one last sent to it.
+*/
+
+#include "RenderQueue.h"
+#include "GLDebug.h"
+#include "GLState.h"
+#include <cstring>
+
+// Whether two items can be drawn with the same state.
+static bool sameState(const DrawItem& a, const DrawItem& b)
+{
+	return a.layer == b.layer && a.program == b.program && a.vao == b.vao && a.mode == b.mode && a.indexType == b.indexType
+		&& a.depthTest == b.depthTest && a.pointSize == b.pointSize && memcmp(&a.mvp, &b.mvp, sizeof(glm::mat4)) == 0;
+}
+
+void RenderQueue::add(const DrawItem& item)
+{
+	if (item.count > 0)
+	{
+		items.push_back(item);
+	}
+}
+
+void RenderQueue::flush()
+{
+	// Sorting a list of indices keeps the items where they are, and stable_sort keeps the items of the same state in the order
+	// they were added, which is also what makes their ranges follow each other.
+	order.resize(items.size());
+	for (int i = 0; i < (int)items.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b)
+	{
+		const DrawItem& x = items[a];
+		const DrawItem& y = items[b];
+		if (x.layer != y.layer) return x.layer < y.layer;
+		if (x.program != y.program) return x.program < y.program;
+		if (x.depthTest != y.depthTest) return x.depthTest > y.depthTest;
+		if (x.pointSize != y.pointSize) return x.pointSize < y.pointSize;
+		return x.vao < y.vao;
+	});
+
+	// Every MVP goes into the uniform buffer once, in one upload, before anything is drawn.
+	views.resize(items.size());
+	for (int i = 0; i < (int)items.size(); i++)
+	{
+		views[i] = frame.view(items[i].mvp);
+	}
+	frame.upload();
+
+	GLuint program = 0;
+	GLuint vao = 0;
+	bool depthTest = true;
+	float pointSize = 0.0f;
+	cachedEnable(GL_DEPTH_TEST);
+
+	lastItems = (int)items.size();
+	lastDraws = 0;
+	for (int i = 0; i < (int)order.size();)
+	{
+		const DrawItem& item = items[order[i]];
+
+		// Everything after it with the same state that continues its range goes into the same draw.
+		GLsizei count = item.count;
+		int next = i + 1;
+		while (item.instances == 0 && item.indirectBuffer == 0 && next < (int)order.size())
+		{
+			const DrawItem& other = items[order[next]];
+			if (other.instances != 0 || other.indirectBuffer != 0 || !sameState(item, other) || other.first != item.first + count)
+			{
+				break;
+			}
+			count += other.count;
+			next++;
+		}
+
+		if (item.program != program)
+		{
+			program = item.program;
+			cachedUseProgram(program);
+			attach(program);
+		}
+		frame.bind(views[order[i]]);
+		if (item.vao != vao)
+		{
+			vao = item.vao;
+			cachedBindVertexArray(vao);
+		}
+		if (item.depthTest != depthTest)
+		{
+			depthTest = item.depthTest;
+			depthTest ? cachedEnable(GL_DEPTH_TEST) : cachedDisable(GL_DEPTH_TEST);
+		}
+		if (item.mode == GL_POINTS && item.pointSize != pointSize)
+		{
+			pointSize = item.pointSize;
+			cachedPointSize(pointSize);
+		}
+
+		draw(item, count);
+		lastDraws++;
+		i = next;
+	}
+
+	cachedBindVertexArray(0);
+	cachedEnable(GL_DEPTH_TEST);
+	GL_CHECK_ERRORS("RenderQueue::flush");
+	items.clear();
+}
+
+void RenderQueue::setFrame(float time, float pointScale)
+{
+	frame.setFrame(time, pointScale);
+}
+
+void RenderQueue::forgetPrograms()
+{
+	programs.clear();
+}
+
+void RenderQueue::destroy()
+{
+	frame.destroy();
+	programs.clear();
+}
+
+void RenderQueue::attach(GLuint program)
+{
+	if (std::find(programs.begin(), programs.end(), program) == programs.end())
+	{
+		attachFrameBlock(program);
+		programs.push_back(program);
+	}
+}
+
+void RenderQueue::draw(const DrawItem& item, GLsizei count)
+{
+	if (item.indirectBuffer != 0)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, item.indirectBuffer);
+		glMultiDrawElementsIndirect(item.mode, item.indexType, nullptr, count, 0);
+		return;
+	}
+
+	if (item.indexType == 0)
+	{
+		if (item.instances > 0)
+		{
+			glDrawArraysInstanced(item.mode, item.first, count, item.instances);
+		}
+		else
+		{
+			glDrawArrays(item.mode, item.first, count);
+		}
+		return;
+	}
+
+	GLsizeiptr indexSize = item.indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : item.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : 1;
+	const void* offset = (const void*)(item.first * indexSize);
+	if (item.instances > 0)
+	{
+		glDrawElementsInstanced(item.mode, count, item.indexType, offset, item.instances);
+	}
+	else
+	{
+		glDrawElements(item.mode, count, item.indexType, offset);
+	}
+}
@@ -0,0 +1,121 @@
+/*
+Title: HydroDynamics
+File Name: RenderQueue.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Collects everything that is drawn in a frame as a list of draw items instead of issuing the
+draws right away, then sorts them and draws them with as few calls and state changes as
+possible.
+
+An item names the program, the vertex array, the range of vertices or indices, and the state
+it needs (depth test, point size and the MVP matrix). Items are drawn in order of their
+layer, which is how the caller says that one thing has to be drawn over another. Within a
+layer they are sorted by program and state, so every program, vertex array and state is set
+once per layer. Items with the same state whose ranges follow each other in the same buffer
+are merged into a single draw. That way new objects or UI only add draws when they actually
+need different state.
+
+The MVPs reach the shaders through the Frame block (see FrameUniforms.h): every MVP of a
+flush is one view in a uniform buffer uploaded once, and a draw only binds another range
+when its MVP differs from the draw before it, whichever program that was.
+
+An item can also point at a buffer of indirect draw commands, which draws all of them with
+one glMultiDrawElementsIndirect. Those items are never merged.
+*/
+
+#ifndef _RENDER_QUEUE_H
+#define _RENDER_QUEUE_H
+
+#include "GLIncludes.h"
+#include "FrameUniforms.h"
+
+// The layers used by the program, from the back to the front.
+enum RenderLayer
+{
+	RENDER_LAYER_IMAGE = 0,	// Behind everything else, like the background image
+	RENDER_LAYER_BACK,		// Behind the scene, like the grid mesh
+	RENDER_LAYER_SCENE,		// The vessels, tubes and piston
+	RENDER_LAYER_FRONT,		// In front of it, like the particles, which have no depth
+	RENDER_LAYER_OVERLAY	// Screen space UI, drawn without the depth test
+};
+
+// One command in an indirect buffer, laid out as glMultiDrawElementsIndirect reads it.
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+struct DrawItem
+{
+	int layer = RENDER_LAYER_SCENE;
+	GLuint program = 0;
+	GLuint vao = 0;
+	GLenum mode = GL_TRIANGLES;
+	GLenum indexType = 0;		// GL_UNSIGNED_INT to draw indices from the element buffer of the vertex array, 0 to draw vertices
+	GLint first = 0;			// The first index or vertex
+	GLsizei count = 0;
+	GLsizei instances = 0;		// More than 0 for an instanced draw
+	GLuint indirectBuffer = 0;	// If set, count DrawElementsIndirectCommands from this buffer are drawn instead of a range
+	bool depthTest = true;
+	float pointSize = 1.0f;
+	glm::mat4 mvp = glm::mat4(1.0f);
+};
+
+class RenderQueue
+{
+public:
+	void add(const DrawItem& item);
+
+	// Draws every item added since the last flush and empties the queue. Leaves no vertex array bound and the depth test on.
+	void flush();
+
+	// Sets the time and the pixels per unit of the scene the shaders see in the next flushes.
+	void setFrame(float time, float pointScale);
+
+	// Forgets which programs have their Frame block connected. Call when a program is deleted, since its name can be reused.
+	void forgetPrograms();
+
+	// Frees the uniform buffer. Needs the context it was made in, or one sharing with it.
+	void destroy();
+
+	// How many items the last flush drew, and with how many draw calls.
+	int flushedItems() const { return lastItems; }
+	int flushedDraws() const { return lastDraws; }
+
+private:
+	std::vector<DrawItem> items;
+	std::vector<int> order;
+	std::vector<int> views;			// The view of every item in frame
+	std::vector<GLuint> programs;	// The programs whose Frame block is connected
+	FrameUniforms frame;
+	int lastItems = 0;
+	int lastDraws = 0;
+
+	void attach(GLuint program);
+	void draw(const DrawItem& item, GLsizei count);
+};
+
+#endif // _RENDER_QUEUE_H
@@ -0,0 +1,179 @@
+/*
+Title: HydroDynamics
+File Name: ResultCache.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Remembers the results of runs by what went into them, so a run that was already done
+doesn't have to be done again. A run is identified by a 64 bit FNV-1a hash of everything
+the step reads (the state and the sizes of the network, and how it is stepped) and of how
+long it runs. Two different runs have the same key with a chance of about one in 2^64 per
+pair, which is taken as never.
+
+The cache lives in memory, so a sweep with the same variant twice only runs it once, and
+can be kept in a file between runs: load() it before and save() it after, and whatever was
+already worked out the last time comes back at once. The file is written under another name
+and then moved over the old one, so a run that was killed leaves the last complete cache.
+
+The file is little endian: the magic "HYDRORC1", a uint32 version and a uint32 entry count,
+then for every entry the uint64 key, a uint32 value count and that many float64 values.
+
+This file has no OpenGL dependency.
+*/
+
+#include "ResultCache.h"
+#include "VesselNetwork.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+static const char cacheMagic[8] = { 'H', 'Y', 'D', 'R', 'O', 'R', 'C', '1' };
+
+void ResultKey::add(const void* data, size_t bytes)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+void ResultKey::addNetwork(const VesselNetwork& network)
+{
+	add(network.height);
+	add(network.width);
+	add(network.bottom);
+	add(network.externalPressure);
+	add(network.tubeA);
+	add(network.tubeB);
+	add(network.tubeInvInertance);
+	add(network.tubeDamping);
+	add(network.tubeFlow);
+	add(network.integrator);
+	add(network.precision);
+	add(network.scatter);
+	add(network.multirate);
+	add(network.drainLimit);
+	add(network.solver.preconditioner);
+	add(network.adaptive.tolerance);
+}
+
+bool plainForCache(const VesselNetwork& network)
+{
+	return !network.layered() && !network.profiled() && !network.hasComponents();
+}
+
+bool ResultCache::find(uint64_t key, std::vector<double>& values)
+{
+	auto entry = entries.find(key);
+	if (entry == entries.end())
+	{
+		misses++;
+		return false;
+	}
+	values = entry->second;
+	hits++;
+	return true;
+}
+
+void ResultCache::store(uint64_t key, const std::vector<double>& values)
+{
+	entries[key] = values;
+}
+
+bool ResultCache::load(const std::string& fileName)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return true;
+	}
+
+	char magic[8];
+	uint32_t version = 0;
+	uint32_t count = 0;
+	bool valid = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, cacheMagic, sizeof(magic)) == 0
+		&& fread(&version, sizeof(version), 1, file) == 1 && version == RESULT_CACHE_VERSION && fread(&count, sizeof(count), 1, file) == 1;
+	for (uint32_t i = 0; i < count && valid; i++)
+	{
+		uint64_t key;
+		uint32_t valueCount;
+		valid = fread(&key, sizeof(key), 1, file) == 1 && fread(&valueCount, sizeof(valueCount), 1, file) == 1;
+		std::vector<double> values(valid ? valueCount : 0);
+		valid = valid && fread(values.data(), sizeof(double), valueCount, file) == valueCount;
+		if (valid)
+		{
+			entries[key].swap(values);
+		}
+	}
+	fclose(file);
+
+	if (!valid)
+	{
+		std::cout << fileName << " isn't a result cache of this version." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ResultCache::save(const std::string& fileName) const
+{
+	std::string temporaryFile = fileName + ".tmp";
+	FILE* file = fopen(temporaryFile.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cout << "Can't write file: " << temporaryFile << std::endl;
+		return false;
+	}
+
+	uint32_t version = RESULT_CACHE_VERSION;
+	uint32_t count = (uint32_t)entries.size();
+	bool written = fwrite(cacheMagic, sizeof(cacheMagic), 1, file) == 1 && fwrite(&version, sizeof(version), 1, file) == 1
+		&& fwrite(&count, sizeof(count), 1, file) == 1;
+	for (auto entry = entries.begin(); entry != entries.end() && written; ++entry)
+	{
+		uint32_t valueCount = (uint32_t)entry->second.size();
+		written = fwrite(&entry->first, sizeof(entry->first), 1, file) == 1 && fwrite(&valueCount, sizeof(valueCount), 1, file) == 1
+			&& fwrite(entry->second.data(), sizeof(double), valueCount, file) == valueCount;
+	}
+	written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+	written = written && MoveFileExA(temporaryFile.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	written = written && rename(temporaryFile.c_str(), fileName.c_str()) == 0;
+#endif
+	if (!written)
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		remove(temporaryFile.c_str());
+		return false;
+	}
+	return true;
+}
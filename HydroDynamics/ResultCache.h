@@ -0,0 +1,109 @@
+/*
+Title: HydroDynamics
+File Name: ResultCache.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Remembers the results of runs by what went into them, so a run that was already done
+doesn't have to be done again. A run is identified by a 64 bit FNV-1a hash of everything
+the step reads (the state and the sizes of the network, and how it is stepped) and of how
+long it runs. Two different runs have the same key with a chance of about one in 2^64 per
+pair, which is taken as never.
+
+The cache lives in memory, so a sweep with the same variant twice only runs it once, and
+can be kept in a file between runs: load() it before and save() it after, and whatever was
+already worked out the last time comes back at once. The file is written under another name
+and then moved over the old one, so a run that was killed leaves the last complete cache.
+
+The file is little endian: the magic "HYDRORC1", a uint32 version and a uint32 entry count,
+then for every entry the uint64 key, a uint32 value count and that many float64 values.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _RESULT_CACHE_H
+#define _RESULT_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VesselNetwork;
+
+#define RESULT_CACHE_VERSION 1
+
+// Builds a key out of everything added to it, in order.
+class ResultKey
+{
+public:
+	void add(const void* data, size_t bytes);
+
+	template <typename T>
+	void add(const T& value) { add(&value, sizeof(value)); }
+
+	template <typename T>
+	void add(const std::vector<T>& values)
+	{
+		add(values.size());
+		add(values.data(), values.size() * sizeof(T));
+	}
+
+	// Everything about a network the step reads, with how it is stepped. Only plain networks (see plainForCache()) have all of that
+	// in the arrays added here.
+	void addNetwork(const VesselNetwork& network);
+
+	uint64_t value() const { return hash; }
+
+private:
+	uint64_t hash = 14695981039346656037ull;
+};
+
+// Whether the results of a network can be cached: one fluid, rectangular vessels and no tube components, whose state is all in the
+// arrays ResultKey::addNetwork() reads.
+bool plainForCache(const VesselNetwork& network);
+
+class ResultCache
+{
+public:
+	// Finds the results stored for key. Returns false if there are none.
+	bool find(uint64_t key, std::vector<double>& values);
+	void store(uint64_t key, const std::vector<double>& values);
+
+	// Reads the entries of a cache file, on top of those already there. A file that doesn't exist is an empty cache; one that
+	// isn't a cache returns false (after printing an error).
+	bool load(const std::string& fileName);
+	bool save(const std::string& fileName) const;
+
+	size_t size() const { return entries.size(); }
+	void clear() { entries.clear(); }
+
+	// How many find() calls found something, and how many didn't.
+	long long hits = 0;
+	long long misses = 0;
+
+private:
+	std::unordered_map<uint64_t, std::vector<double>> entries;
+};
+
+#endif // _RESULT_CACHE_H
@@ -0,0 +1,91 @@
+/*
+Title: HydroDynamics
+File Name: RetainedFrame.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+An offscreen copy of the scene that is kept from one frame to the next, so a frame where
+only a small part of the scene changed only clears and draws that part, and a frame where
+nothing changed draws nothing at all.
+
+The default framebuffer can't be used for that, since what the back buffer holds after a
+swap is undefined. Instead the scene is drawn into an OffscreenTarget of the size of the
+window, multisampled if asked to. begin() binds it and, with the scissor test, limits the
+clear and every draw after it to the rectangle that changed. present() resolves the
+samples and copies the whole image to the back buffer, and the overlay is drawn on top of
+it there as before.
+*/
+
+#include "RetainedFrame.h"
+#include "GLState.h"
+#include <iostream>
+
+bool RetainedFrame::resize(int width, int height, int samples)
+{
+	if (failed || width <= 0 || height <= 0)
+	{
+		return false;
+	}
+	if (target.valid() && width == target.width() && height == target.height() && samples == requestedSamples)
+	{
+		return true;
+	}
+
+	complete = false;
+	requestedSamples = samples;
+	if (!target.create(width, height, samples))
+	{
+		std::cout << "Drawing all of the scene every frame instead." << std::endl;
+		failed = true;
+		return false;
+	}
+	return true;
+}
+
+void RetainedFrame::begin(int x, int y, int width, int height)
+{
+	target.bind();
+	cachedEnable(GL_SCISSOR_TEST);
+	glScissor(x, y, width, height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (x <= 0 && y <= 0 && x + width >= target.width() && y + height >= target.height())
+	{
+		complete = true;
+	}
+}
+
+void RetainedFrame::end()
+{
+	cachedDisable(GL_SCISSOR_TEST);
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RetainedFrame::present()
+{
+	target.resolve();
+	target.present(target.width(), target.height());
+}
+
+void RetainedFrame::destroy()
+{
+	target.destroy();
+	complete = false;
+}
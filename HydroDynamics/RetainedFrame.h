@@ -0,0 +1,76 @@
+/*
+Title: HydroDynamics
+File Name: RetainedFrame.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+An offscreen copy of the scene that is kept from one frame to the next, so a frame where
+only a small part of the scene changed only clears and draws that part, and a frame where
+nothing changed draws nothing at all.
+
+The default framebuffer can't be used for that, since what the back buffer holds after a
+swap is undefined. Instead the scene is drawn into an OffscreenTarget of the size of the
+window, multisampled if asked to. begin() binds it and, with the scissor test, limits the
+clear and every draw after it to the rectangle that changed. present() resolves the
+samples and copies the whole image to the back buffer, and the overlay is drawn on top of
+it there as before.
+*/
+
+#ifndef _RETAINED_FRAME_H
+#define _RETAINED_FRAME_H
+
+#include "OffscreenTarget.h"
+
+class RetainedFrame
+{
+public:
+	// Makes sure the framebuffer is width x height with this many samples, creating it again if it isn't, which loses the image.
+	// Returns false if it can't be created.
+	bool resize(int width, int height, int samples);
+
+	// Binds the framebuffer and clears the rectangle from (x, y), in pixels from the bottom left, that is width x height. Everything
+	// drawn until end() only touches that rectangle. Clearing all of it makes the image valid.
+	void begin(int x, int y, int width, int height);
+
+	// Stops limiting the draws and binds the default framebuffer again.
+	void end();
+
+	// Copies the image to the back buffer.
+	void present();
+
+	// Forgets the image, so the next frame has to draw all of it, for example after the shaders changed.
+	void invalidate() { complete = false; }
+
+	// Frees the framebuffer.
+	void destroy();
+
+	bool valid() const { return complete; }
+	int width() const { return target.width(); }
+	int height() const { return target.height(); }
+
+private:
+	OffscreenTarget target;
+	int requestedSamples = 1;	// What was asked for, which the target may have clamped
+	bool complete = false;
+	bool failed = false;		// Once creating it failed, it isn't tried again
+};
+
+#endif // _RETAINED_FRAME_H
@@ -0,0 +1,218 @@
+/*
+Title: HydroDynamics
+File Name: RewindHistory.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The state of the last few minutes of a session, kept so the simulation can go back to any
+step of them and carry on from there.
+
+The state of a step is a frame of floats (the levels, the flows and whatever else the caller
+puts in). Every so often a frame is kept whole, as a keyframe, and every step after it only
+as what changed since the step before: for every value that changed, the number of values
+skipped since the last one as a varint, then the bits of the new value XORed with the old
+ones, also as a varint. A value that moves a little keeps its sign, exponent and top bits,
+so its XOR is a small number and takes two or three bytes, and one that didn't move takes
+none, so a network at rest costs next to nothing. Decoding gives back exactly the bits that
+were recorded, and going on from a rewound step gives exactly the same steps as before.
+
+A keyframe and the steps after it form a group. A new group starts every
+REWIND_KEYFRAME_STEPS steps, or sooner once the changes since the keyframe take more room than
+the keyframe itself, so going back to any step costs one keyframe and at most that many
+changes. The groups are kept oldest first, and once they take more than the memory the
+history was given the oldest ones are dropped, so it holds as many of the last steps as
+fit. The storage of a dropped group is used again for the next one.
+
+This file has no OpenGL dependency.
+*/
+
+#include "RewindHistory.h"
+#include <cstring>
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+static uint32_t getVarint(const uint8_t*& p)
+{
+	uint32_t value = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		uint8_t byte = *p++;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (byte < 0x80)
+		{
+			return value;
+		}
+	}
+}
+
+static uint32_t bitsOf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+void RewindHistory::startGroup(long long step, const float* values, size_t count)
+{
+	Group group;
+	if (!spare.empty())
+	{
+		group = std::move(spare.back());
+		spare.pop_back();
+	}
+	group.firstStep = step;
+	group.keyframe.assign(values, values + count);
+	group.bytes.clear();
+	group.changes.clear();
+	used += group.size();
+	groups.push_back(std::move(group));
+}
+
+void RewindHistory::retire(Group& group)
+{
+	used -= group.size();
+	if (spare.empty())
+	{
+		spare.push_back(std::move(group));
+	}
+}
+
+void RewindHistory::dropOldest()
+{
+	retire(groups.front());
+	groups.pop_front();
+}
+
+void RewindHistory::record(long long step, const float* values, size_t count)
+{
+	bool follows = !groups.empty() && step == newestStep() + 1 && count == last.size();
+	Group* group = follows ? &groups.back() : nullptr;
+	if (group == nullptr || group->changes.size() + 1 >= REWIND_KEYFRAME_STEPS || group->bytes.size() > count * sizeof(float))
+	{
+		startGroup(step, values, count);
+	}
+	else
+	{
+		size_t before = group->size();
+		uint32_t skipped = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t change = bitsOf(values[i]) ^ bitsOf(last[i]);
+			if (change == 0)
+			{
+				skipped++;
+				continue;
+			}
+			putVarint(group->bytes, skipped);
+			putVarint(group->bytes, change);
+			skipped = 0;
+		}
+		group->changes.push_back((uint32_t)group->bytes.size());
+		used += group->size() - before;
+	}
+	last.assign(values, values + count);
+
+	while (groups.size() > 1 && used > memory)
+	{
+		dropOldest();
+	}
+}
+
+void RewindHistory::decode(const Group& group, long long step, std::vector<float>& values)
+{
+	values = group.keyframe;
+	const uint8_t* p = group.bytes.data();
+	for (long long s = group.firstStep + 1; s <= step; s++)
+	{
+		const uint8_t* end = group.bytes.data() + group.changes[(size_t)(s - group.firstStep - 1)];
+		size_t i = 0;
+		while (p < end)
+		{
+			i += getVarint(p);
+			uint32_t bits = bitsOf(values[i]) ^ getVarint(p);
+			memcpy(&values[i], &bits, sizeof(bits));
+			i++;
+		}
+	}
+}
+
+bool RewindHistory::find(long long step, std::vector<float>& values) const
+{
+	if (groups.empty() || step < oldestStep() || step > newestStep())
+	{
+		return false;
+	}
+	// The groups cover the steps one after the other, so the one that holds step is the last that starts before it.
+	size_t low = 0;
+	size_t high = groups.size();
+	while (high - low > 1)
+	{
+		size_t middle = (low + high) / 2;
+		(groups[middle].firstStep <= step ? low : high) = middle;
+	}
+	const Group& group = groups[low];
+	if (step > group.firstStep + (long long)group.changes.size())
+	{
+		return false;
+	}
+	decode(group, step, values);
+	return true;
+}
+
+bool RewindHistory::rewind(long long step, std::vector<float>& values)
+{
+	if (!find(step, values))
+	{
+		return false;
+	}
+	while (groups.back().firstStep > step)
+	{
+		retire(groups.back());
+		groups.pop_back();
+	}
+	Group& group = groups.back();
+	size_t before = group.size();
+	size_t kept = (size_t)(step - group.firstStep);
+	group.bytes.resize(kept > 0 ? group.changes[kept - 1] : 0);
+	group.changes.resize(kept);
+	used -= before - group.size();
+	last = values;
+	return true;
+}
+
+void RewindHistory::clear()
+{
+	while (!groups.empty())
+	{
+		dropOldest();
+	}
+	last.clear();
+	used = 0;
+}
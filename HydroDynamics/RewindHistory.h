@@ -0,0 +1,108 @@
+/*
+Title: HydroDynamics
+File Name: RewindHistory.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The state of the last few minutes of a session, kept so the simulation can go back to any
+step of them and carry on from there.
+
+The state of a step is a frame of floats (the levels, the flows and whatever else the caller
+puts in). Every so often a frame is kept whole, as a keyframe, and every step after it only
+as what changed since the step before: for every value that changed, the number of values
+skipped since the last one as a varint, then the bits of the new value XORed with the old
+ones, also as a varint. A value that moves a little keeps its sign, exponent and top bits,
+so its XOR is a small number and takes two or three bytes, and one that didn't move takes
+none, so a network at rest costs next to nothing. Decoding gives back exactly the bits that
+were recorded, and going on from a rewound step gives exactly the same steps as before.
+
+A keyframe and the steps after it form a group. A new group starts every
+REWIND_KEYFRAME_STEPS steps, or sooner once the changes since the keyframe take more room than
+the keyframe itself, so going back to any step costs one keyframe and at most that many
+changes. The groups are kept oldest first, and once they take more than the memory the
+history was given the oldest ones are dropped, so it holds as many of the last steps as
+fit. The storage of a dropped group is used again for the next one.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _REWIND_HISTORY_H
+#define _REWIND_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// The most steps a keyframe covers, and the default memory of a history.
+#define REWIND_KEYFRAME_STEPS 120
+#define REWIND_DEFAULT_MEMORY (256u << 20)
+
+class RewindHistory
+{
+public:
+	explicit RewindHistory(size_t memory = REWIND_DEFAULT_MEMORY) : memory(memory) {}
+
+	// The most bytes the history takes (roughly; the newest group is always kept, however big it is).
+	void setMemory(size_t bytes) { memory = bytes; }
+
+	// Adds the state after step. A step that doesn't follow the last one, or a frame of another size, starts a new group.
+	void record(long long step, const float* values, size_t count);
+
+	// The state after step, into values. Returns false if the history doesn't go back that far, or not to that step.
+	bool find(long long step, std::vector<float>& values) const;
+
+	// The same, and forgets every step after it, so the next record() carries on from there.
+	bool rewind(long long step, std::vector<float>& values);
+
+	// The oldest and the newest step there is (both -1 if there is none).
+	long long oldestStep() const { return groups.empty() ? -1 : groups.front().firstStep; }
+	long long newestStep() const { return groups.empty() ? -1 : groups.back().firstStep + (long long)groups.back().changes.size(); }
+
+	size_t bytes() const { return used; }
+	void clear();
+
+private:
+	struct Group
+	{
+		long long firstStep = 0;
+		std::vector<float> keyframe;
+		std::vector<uint8_t> bytes;			// The changes of every step after the keyframe, one after the other
+		std::vector<uint32_t> changes;		// Where the changes of step firstStep + 1 + i end in bytes
+		size_t size() const { return keyframe.size() * sizeof(float) + bytes.size() + changes.size() * sizeof(uint32_t); }
+	};
+
+	// Applies the changes of group from its keyframe up to step.
+	static void decode(const Group& group, long long step, std::vector<float>& values);
+
+	void startGroup(long long step, const float* values, size_t count);
+	void retire(Group& group);
+	void dropOldest();
+
+	size_t memory;
+	size_t used = 0;
+	std::deque<Group> groups;
+	std::vector<Group> spare;		// The storage of a dropped group, to start the next one in
+	std::vector<float> last;		// The newest frame, which the changes of the next step are against
+};
+
+#endif // _REWIND_HISTORY_H
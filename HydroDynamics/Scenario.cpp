@@ -0,0 +1,501 @@
+/*
+Title: HydroDynamics
+File Name: Scenario.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scripted test scenarios, instead of someone holding Space and Left Shift with a stopwatch.
+A scenario file is plain text, lines starting with # are comments, and every scenario is a
+script of one command per line:
+
+	scenario push-and-release		starts the next scenario, with its name
+	ramp piston 2.0 5				ramps the pressure on the piston's vessel to 2.0 over 5 seconds
+	hold 3							waits 3 seconds
+	set piston 0					sets the pressure on the piston's vessel to 0 at once
+	settle 60						waits until the apparatus is at rest, failing after 60 seconds
+	expect level 1 0.2 0.3			fails unless vessel 1 holds 0.2 to 0.3 of fluid
+
+Instead of piston, a command can name any vessel by its index in the scene.
+
+A script is a coroutine: it runs until a command has to wait for the simulation, and is
+resumed by the fixed step the simulation steps with once the wait is over. Only where it is
+in its script is kept between two resumptions (the command it's on and when it wakes up), so
+a script costs a few bytes and nothing at all while it waits, and no script needs a
+thread. The scheduler keeps the scripts in a heap by when they wake up, and only resumes
+those that are due; a ramp is resumed every step, since it sets a new pressure every step.
+
+For a run of many scenarios, every one gets its own copy of the scene, side by side in one
+network. Copies never affect each other, so that is the same as running every scenario on its
+own, but their steps are shared out over the cores, and a copy that has come to rest falls
+asleep. While every copy is asleep, the run jumps straight to the step the next script wakes
+up at. The results are one line of comma separated values per scenario: its name, whether it
+passed, failed or is still running, when it ended, and why it failed.
+
+The window plays one scenario on its own apparatus instead, where the pressure on the piston's
+vessel goes to the piston like the keys would push it.
+
+This file has no OpenGL dependency.
+*/
+
+#include "Scenario.h"
+#include "VesselNetwork.h"
+#include "ResultCache.h"
+#include "Logger.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <queue>
+#include <functional>
+#include <cmath>
+#include <cstdlib>
+
+bool ScenarioRunner::read(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+	return parse(file, fileName);
+}
+
+// Reads "piston" or the index of a vessel.
+static bool readVessel(std::istream& fields, int& vessel)
+{
+	std::string word;
+	if (!(fields >> word))
+	{
+		return false;
+	}
+	if (word == "piston")
+	{
+		vessel = -1;
+		return true;
+	}
+	char* end = nullptr;
+	long index = strtol(word.c_str(), &end, 10);
+	vessel = (int)index;
+	return *end == '\0' && index >= 0;
+}
+
+bool ScenarioRunner::parse(std::istream& in, const std::string& fileName)
+{
+	std::vector<ScenarioScript> parsed;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		std::string name;
+		if (!(fields >> name))
+		{
+			continue;
+		}
+		if (name == "scenario")
+		{
+			ScenarioScript script;
+			if (!(fields >> script.name))
+			{
+				std::cout << fileName << " line " << lineNumber << ": a scenario needs a name." << std::endl;
+				return false;
+			}
+			parsed.push_back(script);
+			continue;
+		}
+		if (parsed.empty())
+		{
+			std::cout << fileName << " line " << lineNumber << ": commands have to come after the scenario line they belong to." << std::endl;
+			return false;
+		}
+
+		ScenarioLine command;
+		command.lineNumber = lineNumber;
+		bool valid;
+		if (name == "set")
+		{
+			command.command = SCENARIO_SET;
+			valid = readVessel(fields, command.vessel) && (bool)(fields >> command.value);
+		}
+		else if (name == "ramp")
+		{
+			command.command = SCENARIO_RAMP;
+			valid = readVessel(fields, command.vessel) && (bool)(fields >> command.value >> command.seconds) && command.seconds >= 0.0;
+		}
+		else if (name == "hold")
+		{
+			command.command = SCENARIO_HOLD;
+			valid = (bool)(fields >> command.seconds) && command.seconds >= 0.0;
+		}
+		else if (name == "settle")
+		{
+			command.command = SCENARIO_SETTLE;
+			valid = (bool)(fields >> command.seconds) && command.seconds >= 0.0;
+		}
+		else if (name == "expect")
+		{
+			std::string quantity;
+			command.command = SCENARIO_EXPECT_LEVEL;
+			valid = (bool)(fields >> quantity) && quantity == "level" && readVessel(fields, command.vessel)
+				&& (bool)(fields >> command.value >> command.highest) && command.value <= command.highest;
+		}
+		else
+		{
+			valid = false;
+		}
+
+		std::string rest;
+		if (!valid || fields >> rest)
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a valid command: " << line << std::endl;
+			return false;
+		}
+		parsed.back().lines.push_back(command);
+	}
+
+	scripts.swap(parsed);
+	instances.clear();
+	return true;
+}
+
+int ScenarioRunner::find(const std::string& name) const
+{
+	for (int i = 0; i < scenarioCount(); i++)
+	{
+		if (scripts[i].name == name)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool ScenarioRunner::checkVessels(const ScenarioScript& script, int vesselCount) const
+{
+	for (const ScenarioLine& line : script.lines)
+	{
+		if (line.vessel >= vesselCount)
+		{
+			std::cout << "Scenario " << script.name << " (line " << line.lineNumber << ") names vessel " << line.vessel << ", but the scene only has "
+				<< vesselCount << "." << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ScenarioRunner::build(const VesselNetwork& scene, int pistonVessel, VesselNetwork& network)
+{
+	if (!plainForCache(scene))
+	{
+		std::cout << "Scenarios can only run side by side on a scene with one fluid, rectangular vessels and no tube components." << std::endl;
+		return false;
+	}
+	for (const ScenarioScript& script : scripts)
+	{
+		if (!checkVessels(script, scene.vesselCount()))
+		{
+			return false;
+		}
+	}
+
+	network.clear();
+	network.integrator = scene.integrator;
+	network.solver.preconditioner = scene.solver.preconditioner;
+	network.precision = scene.precision;
+
+	float sceneLeft = INFINITY;
+	float sceneRight = -INFINITY;
+	for (int i = 0; i < scene.vesselCount(); i++)
+	{
+		sceneLeft = std::min(sceneLeft, scene.left[i]);
+		sceneRight = std::max(sceneRight, scene.right[i]);
+	}
+	float spacing = scene.vesselCount() > 0 ? sceneRight - sceneLeft + SCENARIO_SPACING : 0.0f;
+
+	instances.assign(scripts.size(), Instance());
+	for (int s = 0; s < scenarioCount(); s++)
+	{
+		Instance& instance = instances[s];
+		instance.script = s;
+		instance.firstVessel = network.vesselCount();
+		instance.vesselCount = scene.vesselCount();
+		instance.pistonVessel = instance.firstVessel + pistonVessel;
+
+		float x = s * spacing;
+		for (int i = 0; i < scene.vesselCount(); i++)
+		{
+			network.addVessel(scene.left[i] + x, scene.bottom[i], scene.width[i], scene.height[i]);
+		}
+		for (int t = 0; t < scene.tubeCount(); t++)
+		{
+			int tube = network.addTube(instance.firstVessel + scene.tubeA[t], instance.firstVessel + scene.tubeB[t], 1.0f / scene.tubeInvInertance[t],
+				scene.tubeDamping[t]);
+			network.tubeFlow[tube] = scene.tubeFlow[t];
+		}
+	}
+	network.rebuildTopology();
+	for (const Instance& instance : instances)
+	{
+		for (int i = 0; i < scene.vesselCount(); i++)
+		{
+			network.setExternalPressure(instance.firstVessel + i, scene.externalPressure[i]);
+		}
+	}
+	return true;
+}
+
+bool ScenarioRunner::atRest(const Instance& instance, const VesselNetwork& network)
+{
+	// Before the first step there are no components yet, and everything is awake.
+	if (network.componentOf.size() != (size_t)network.vesselCount())
+	{
+		return false;
+	}
+	for (int i = instance.firstVessel; i < instance.firstVessel + instance.vesselCount; i++)
+	{
+		if (network.componentAwake[network.componentOf[i]])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ScenarioRunner::resumeInstance(Instance& instance, VesselNetwork& network, float* pistonPressure, long long step, float dt)
+{
+	const ScenarioScript& script = scripts[instance.script];
+	bool changed = false;
+	auto vesselOf = [&](int vessel) { return vessel < 0 ? instance.pistonVessel : instance.firstVessel + vessel; };
+	auto pressureOf = [&](int vessel)
+	{
+		return pistonPressure != nullptr && vessel == instance.pistonVessel ? *pistonPressure : network.externalPressure[vessel];
+	};
+	auto push = [&](int vessel, float value)
+	{
+		if (pressureOf(vessel) == value)
+		{
+			return;
+		}
+		if (pistonPressure != nullptr && vessel == instance.pistonVessel)
+		{
+			*pistonPressure = value;
+		}
+		else
+		{
+			network.setExternalPressure(vessel, value);
+		}
+		changed = true;
+	};
+	auto stepsOf = [&](double seconds) { return (long long)std::llround(seconds / dt); };
+
+	while (instance.next < (int)script.lines.size())
+	{
+		const ScenarioLine& line = script.lines[instance.next];
+		int vessel = vesselOf(line.vessel);
+		if (line.command == SCENARIO_SET)
+		{
+			push(vessel, line.value);
+			instance.next++;
+		}
+		else if (line.command == SCENARIO_RAMP)
+		{
+			// A ramp that was just reached starts from the pressure there is, and is resumed every step until it's over.
+			if (instance.waitStart == -1)
+			{
+				instance.waitStart = step;
+				instance.waitEnd = step + stepsOf(line.seconds);
+				instance.rampFrom = pressureOf(vessel);
+			}
+			if (step >= instance.waitEnd)
+			{
+				push(vessel, line.value);
+				instance.waitStart = -1;
+				instance.next++;
+				continue;
+			}
+			double blend = (double)(step - instance.waitStart) / (instance.waitEnd - instance.waitStart);
+			push(vessel, (float)(instance.rampFrom + (line.value - instance.rampFrom) * blend));
+			instance.wake = step + 1;
+			return changed;
+		}
+		else if (line.command == SCENARIO_HOLD)
+		{
+			instance.next++;
+			long long steps = stepsOf(line.seconds);
+			if (steps > 0)
+			{
+				instance.wake = step + steps;
+				return changed;
+			}
+		}
+		else if (line.command == SCENARIO_SETTLE)
+		{
+			if (instance.waitStart == -1)
+			{
+				instance.waitStart = step;
+				instance.waitEnd = step + stepsOf(line.seconds);
+			}
+			if (!changed && atRest(instance, network))
+			{
+				instance.waitStart = -1;
+				instance.next++;
+				continue;
+			}
+			if (step >= instance.waitEnd)
+			{
+				std::ostringstream failure;
+				failure << "line " << line.lineNumber << " didn't come to rest within " << line.seconds << " s";
+				instance.failure = failure.str();
+				instance.result = SCENARIO_FAILED;
+				instance.endStep = step;
+				return changed;
+			}
+			instance.wake = step + 1;
+			return changed;
+		}
+		else
+		{
+			float level = network.height[vessel];
+			if (level < line.value || level > line.highest)
+			{
+				std::ostringstream failure;
+				failure << "line " << line.lineNumber << " expected vessel " << (line.vessel < 0 ? "piston" : std::to_string(line.vessel)) << " at "
+					<< line.value << " to " << line.highest << " but it was at " << level;
+				instance.failure = failure.str();
+				instance.result = SCENARIO_FAILED;
+				instance.endStep = step;
+				return changed;
+			}
+			instance.next++;
+		}
+	}
+	instance.result = SCENARIO_PASSED;
+	instance.endStep = step;
+	return changed;
+}
+
+long long ScenarioRunner::run(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool)
+{
+	// The scripts by the step they wake up at, the soonest first.
+	typedef std::pair<long long, int> Wakeup;
+	std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> due;
+	for (int i = 0; i < (int)instances.size(); i++)
+	{
+		due.push(Wakeup(instances[i].wake, i));
+	}
+
+	long long step = 0;
+	bool moved = true;
+	while (!due.empty())
+	{
+		// With everything asleep, nothing happens until the next script wakes up.
+		if (!moved && due.top().first > step)
+		{
+			step = due.top().first;
+		}
+
+		bool changed = false;
+		while (!due.empty() && due.top().first <= step)
+		{
+			int index = due.top().second;
+			due.pop();
+			changed = resumeInstance(instances[index], network, nullptr, step, dt) || changed;
+			if (instances[index].result == SCENARIO_RUNNING)
+			{
+				due.push(Wakeup(instances[index].wake, index));
+			}
+		}
+		if (due.empty())
+		{
+			break;
+		}
+
+		moved = network.update(density, gravity, dt, pool) || changed;
+		step++;
+	}
+	return step;
+}
+
+bool ScenarioRunner::play(int scenario, const VesselNetwork& network, int pistonVessel, long long step)
+{
+	if (!checkVessels(scripts[scenario], network.vesselCount()))
+	{
+		return false;
+	}
+	instances.assign(1, Instance());
+	Instance& instance = instances[0];
+	instance.script = scenario;
+	instance.vesselCount = network.vesselCount();
+	instance.pistonVessel = pistonVessel;
+	instance.startStep = step;
+	instance.wake = step;
+	std::cout << "Playing scenario " << scripts[scenario].name << std::endl;
+	return true;
+}
+
+bool ScenarioRunner::resume(VesselNetwork& network, float& pistonPressure, long long step, float dt)
+{
+	Instance& instance = instances[0];
+	if (instance.result == SCENARIO_RUNNING && instance.wake <= step)
+	{
+		resumeInstance(instance, network, &pistonPressure, step, dt);
+	}
+	if (instance.result == SCENARIO_RUNNING)
+	{
+		return true;
+	}
+
+	// This runs on the simulation thread, which can't wait for the console.
+	LOG_INFO("Scenario {} {} after {} s{}{}", scripts[instance.script].name, instance.result == SCENARIO_PASSED ? "passed" : "failed",
+		(instance.endStep - instance.startStep) * (double)dt, instance.failure.empty() ? "" : ": ", instance.failure);
+	return false;
+}
+
+void ScenarioRunner::writeResults(std::ostream& out, float dt) const
+{
+	static const char* resultNames[] = { "running", "passed", "failed" };
+	out << "scenario,name,result,end time,failure" << std::endl;
+	for (int i = 0; i < (int)instances.size(); i++)
+	{
+		const Instance& instance = instances[i];
+		out << i << "," << scripts[instance.script].name << "," << resultNames[instance.result] << ","
+			<< (instance.result == SCENARIO_RUNNING ? -1.0 : (instance.endStep - instance.startStep) * (double)dt) << "," << instance.failure << std::endl;
+	}
+}
+
+int ScenarioRunner::passedCount() const
+{
+	int passed = 0;
+	for (const Instance& instance : instances)
+	{
+		passed += instance.result == SCENARIO_PASSED;
+	}
+	return passed;
+}
@@ -0,0 +1,176 @@
+/*
+Title: HydroDynamics
+File Name: Scenario.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scripted test scenarios, instead of someone holding Space and Left Shift with a stopwatch.
+A scenario file is plain text, lines starting with # are comments, and every scenario is a
+script of one command per line:
+
+	scenario push-and-release		starts the next scenario, with its name
+	ramp piston 2.0 5				ramps the pressure on the piston's vessel to 2.0 over 5 seconds
+	hold 3							waits 3 seconds
+	set piston 0					sets the pressure on the piston's vessel to 0 at once
+	settle 60						waits until the apparatus is at rest, failing after 60 seconds
+	expect level 1 0.2 0.3			fails unless vessel 1 holds 0.2 to 0.3 of fluid
+
+Instead of piston, a command can name any vessel by its index in the scene.
+
+A script is a coroutine: it runs until a command has to wait for the simulation, and is
+resumed by the fixed step the simulation steps with once the wait is over. Only where it is
+in its script is kept between two resumptions (the command it's on and when it wakes up), so
+a script costs a few bytes and nothing at all while it waits, and no script needs a
+thread. The scheduler keeps the scripts in a heap by when they wake up, and only resumes
+those that are due; a ramp is resumed every step, since it sets a new pressure every step.
+
+For a run of many scenarios, every one gets its own copy of the scene, side by side in one
+network. Copies never affect each other, so that is the same as running every scenario on its
+own, but their steps are shared out over the cores, and a copy that has come to rest falls
+asleep. While every copy is asleep, the run jumps straight to the step the next script wakes
+up at. The results are one line of comma separated values per scenario: its name, whether it
+passed, failed or is still running, when it ended, and why it failed.
+
+The window plays one scenario on its own apparatus instead, where the pressure on the piston's
+vessel goes to the piston like the keys would push it.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SCENARIO_H
+#define _SCENARIO_H
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+struct VesselNetwork;
+class TaskPool;
+
+// The copies of the scene are laid out side by side, this far apart.
+#define SCENARIO_SPACING 1.0f
+
+enum ScenarioCommand
+{
+	SCENARIO_SET = 0,
+	SCENARIO_RAMP,
+	SCENARIO_HOLD,
+	SCENARIO_SETTLE,
+	SCENARIO_EXPECT_LEVEL
+};
+
+enum ScenarioResult
+{
+	SCENARIO_RUNNING = 0,
+	SCENARIO_PASSED,
+	SCENARIO_FAILED
+};
+
+// One line of a script.
+struct ScenarioLine
+{
+	ScenarioCommand command;
+	int vessel = -1;			// In the scene, or -1 for the piston's vessel
+	float value = 0.0f;			// The pressure to set or ramp to, or the lowest level expected
+	float highest = 0.0f;		// The highest level expected
+	double seconds = 0.0;		// How long a ramp or a hold takes, or how long to wait for the rest
+	int lineNumber = 0;
+};
+
+struct ScenarioScript
+{
+	std::string name;
+	std::vector<ScenarioLine> lines;
+};
+
+class ScenarioRunner
+{
+public:
+	std::vector<ScenarioScript> scripts;
+
+	// Reads a scenario file. Returns false (after printing an error) if the file can't be read or contains a line that isn't a
+	// valid command.
+	bool read(const std::string& fileName);
+
+	// The same for the contents of a scenario file that was already read. name is only used in the errors.
+	bool parse(std::istream& in, const std::string& name);
+
+	int scenarioCount() const { return (int)scripts.size(); }
+
+	// The scenario called name, or -1.
+	int find(const std::string& name) const;
+
+	// Replaces the contents of network with one copy of scene per scenario, the vessels and tubes of copy i after those of copy i - 1,
+	// and starts every script at step 0. Returns false (after printing why) if the scene isn't a plain network (see plainForCache())
+	// or a script names a vessel the scene doesn't have.
+	bool build(const VesselNetwork& scene, int pistonVessel, VesselNetwork& network);
+
+	// Steps network with the scripts until every one of them has ended, and returns the number of steps.
+	long long run(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool = nullptr);
+
+	// Plays scenario on the network of the window from step on, with pistonVessel as the piston's vessel. Returns false (after
+	// printing why) if the script names a vessel network doesn't have.
+	bool play(int scenario, const VesselNetwork& network, int pistonVessel, long long step);
+
+	// Resumes the played scenario if it is due at step, right before that step is taken. The pressure it pushes onto the piston's
+	// vessel goes into pistonPressure. Returns false once the scenario has ended, after printing how.
+	bool resume(VesselNetwork& network, float& pistonPressure, long long step, float dt);
+
+	// Writes the first line of the results, which names the columns, and then the results of every scenario that was run.
+	void writeResults(std::ostream& out, float dt) const;
+
+	// How many scenarios of the last run passed.
+	int passedCount() const;
+
+private:
+	// Where a script is: everything a coroutine would keep in its frame.
+	struct Instance
+	{
+		int script = 0;
+		int firstVessel = 0;		// Where its copy of the scene starts
+		int vesselCount = 0;
+		int pistonVessel = 0;
+		long long startStep = 0;
+		int next = 0;				// The line to run when it is resumed
+		long long wake = 0;			// The step to resume it at
+		long long waitStart = -1;	// Where the current ramp or settle started, or -1 outside of one
+		long long waitEnd = 0;		// And where it ends
+		float rampFrom = 0.0f;
+		ScenarioResult result = SCENARIO_RUNNING;
+		long long endStep = 0;
+		std::string failure;
+	};
+
+	// Runs the script of instance from where it stopped at step until it has to wait, or ends. pistonPressure, if given, stands in for
+	// the external pressure of the piston's vessel. Returns whether it changed a pressure.
+	bool resumeInstance(Instance& instance, VesselNetwork& network, float* pistonPressure, long long step, float dt);
+
+	// Whether every component of the copy of instance is asleep.
+	static bool atRest(const Instance& instance, const VesselNetwork& network);
+
+	bool checkVessels(const ScenarioScript& script, int vesselCount) const;
+
+	std::vector<Instance> instances;
+};
+
+#endif // _SCENARIO_H
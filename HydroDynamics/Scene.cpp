@@ -0,0 +1,508 @@
+/*
+Title: HydroDynamics
+File Name: Scene.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scene files describe a network of vessels, tubes and fluids to start the simulation from,
+instead of the classic apparatus that setup() builds.
+
+The text form is one item per line, and lines starting with # are comments:
+
+	vessel -0.75 -0.5 0.5 0.5	a vessel with its bottom left corner at (-0.75, -0.5), 0.5 wide
+								and filled 0.5 high. Vessels are numbered from 0 in the order
+								they appear.
+	tube 0 1					a tube between the bottoms of vessels 0 and 1, optionally
+	tube 0 1 3.7 0.8			followed by its inertance and damping
+	fluid 1000					a fluid of that density. The first one takes over the fluid the
+								vessels are filled with, and the later ones start out empty.
+	layer 1 1 0.1				fluid 1 stands 0.1 high in vessel 1, on top of what is there
+	pressure 1 0.5				a pressure pushing on the surface of vessel 1 from outside
+	piston 0					the vessel the piston sits on (the default is 0)
+	shape 2 cone 0.4			vessel 2 is a cone (or a bowl) 0.4 deep, as wide as the vessel
+								at its top, with straight walls above that
+	profile 3 0.3 0 0.2 0.5		vessel 3 is 0.3 deep, with those widths at evenly spaced
+								heights from its bottom to that depth (see VesselProfile.h)
+
+	valve 0 0.5					tube 0 has a valve, half open (the default is open), and tube 1
+	checkvalve 1				one that only lets fluid from its second vessel into its first
+	pump 2 0.01					tube 2 has a pump, moving 0.01 from its second vessel into its
+								first every second (the default is 0, stopped)
+	at 600 close 0				at the start of step 600 the valve of tube 0 closes. The other
+	at 600 start 2 -0.02		changes are open TUBE OPENING, start TUBE FLOW and stop TUBE
+								(see TubeComponents.h). Tubes are numbered from 0 in the order
+								they appear.
+
+The height a vessel is filled to stays the same when it gets a profile, so it holds less
+than the rectangle would.
+
+Parsing text is slow for big networks, so a scene can be compiled (--compile-scene) into
+the binary form, which is a checkpoint of the scene before its first step (see
+Checkpoint.h). Loading that maps the file and copies the arrays straight into the network,
+with nothing to parse. readScene() takes either form, and so also starts from any
+checkpoint. A scene too big to load at once can be compiled into tiles instead, which are
+streamed in around the view (see TiledScene.h).
+
+Scene files list their vessels in any order, which can leave the ends of every tube far
+apart in memory. Either function can renumber the vessels on the way in so connected
+vessels sit next to each other (see NetworkOrder.h). A compiled scene keeps that order, so
+it doesn't have to be reordered every time it is loaded.
+
+This file has no OpenGL dependency.
+*/
+
+#include "Scene.h"
+#include "MappedFile.h"
+#include "TiledScene.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+struct SceneVessel
+{
+	float x;
+	float y;
+	float width;
+	float height;
+};
+
+struct SceneTube
+{
+	int a;
+	int b;
+	float inertance;
+	float damping;
+};
+
+struct SceneLayer
+{
+	int vessel;
+	int fluid;
+	float height;
+};
+
+struct ScenePressure
+{
+	int vessel;
+	float value;
+};
+
+struct SceneComponent
+{
+	int tube;
+	TubeComponent component;
+	float setting;
+};
+
+struct SceneEvent
+{
+	int step;
+	int tube;
+	TubeAction action;
+	float value;
+};
+
+struct SceneProfile
+{
+	int vessel;
+	float depth;
+	std::vector<float> widths;	// Empty for a named shape
+	ProfileShape shape;
+};
+
+// Reads the fields of a line one at a time. A field is copied into a small buffer first, since the mapped file has no 0 at the end
+// for strtof() to stop at.
+class SceneLine
+{
+public:
+	SceneLine(const char* begin, const char* end) : position(begin), end(end) {}
+
+	std::string_view word()
+	{
+		while (position < end && (*position == ' ' || *position == '\t' || *position == '\r'))
+		{
+			position++;
+		}
+		const char* start = position;
+		while (position < end && *position != ' ' && *position != '\t' && *position != '\r')
+		{
+			position++;
+		}
+		return std::string_view(start, position - start);
+	}
+
+	bool number(float& value)
+	{
+		char buffer[64];
+		char* stop;
+		if (!copyWord(buffer, sizeof(buffer)))
+		{
+			return false;
+		}
+		value = strtof(buffer, &stop);
+		return *stop == 0;
+	}
+
+	bool integer(int& value)
+	{
+		char buffer[64];
+		char* stop;
+		if (!copyWord(buffer, sizeof(buffer)))
+		{
+			return false;
+		}
+		long parsed = strtol(buffer, &stop, 10);
+		value = (int)parsed;
+		return *stop == 0 && parsed >= 0 && parsed <= 0x7fffffff;
+	}
+
+	// Whether there is nothing left on the line. Doesn't move on, so the fields after it can still be read.
+	bool finished()
+	{
+		const char* start = position;
+		bool empty = word().empty();
+		position = start;
+		return empty;
+	}
+
+private:
+	const char* position;
+	const char* end;
+
+	bool copyWord(char* buffer, size_t size)
+	{
+		std::string_view text = word();
+		if (text.empty() || text.size() >= size)
+		{
+			return false;
+		}
+		memcpy(buffer, text.data(), text.size());
+		buffer[text.size()] = 0;
+		return true;
+	}
+};
+
+bool parseScene(std::string_view text, const std::string& fileName, VesselNetwork& network, CheckpointInfo& info)
+{
+	std::vector<SceneVessel> vessels;
+	std::vector<SceneTube> tubes;
+	std::vector<float> fluids;
+	std::vector<SceneLayer> layers;
+	std::vector<ScenePressure> pressures;
+	std::vector<SceneProfile> profiles;
+	std::vector<SceneComponent> components;
+	std::vector<SceneEvent> events;
+	std::vector<TubeComponent> componentOf;	// Per tube, what sits on it so far
+	int piston = 0;
+
+	// Everything is read and checked before the network is touched.
+	const char* position = text.data();
+	const char* end = text.data() + text.size();
+	for (int lineNumber = 1; position < end; lineNumber++)
+	{
+		const char* lineEnd = (const char*)memchr(position, '\n', end - position);
+		lineEnd = lineEnd != nullptr ? lineEnd : end;
+		SceneLine line(position, lineEnd);
+		position = lineEnd + 1;
+
+		std::string_view name = line.word();
+		if (name.empty() || name[0] == '#')
+		{
+			continue;
+		}
+
+		bool valid;
+		const char* problem = "isn't a valid line";
+		SceneComponent component;
+		if (name == "vessel")
+		{
+			SceneVessel vessel;
+			valid = line.number(vessel.x) && line.number(vessel.y) && line.number(vessel.width) && line.number(vessel.height) && line.finished();
+			if (valid && (vessel.width <= 0.0f || vessel.height < 0.0f))
+			{
+				valid = false;
+				problem = "needs a width above 0 and a height of at least 0";
+			}
+			vessels.push_back(vessel);
+		}
+		else if (name == "tube")
+		{
+			SceneTube tube = { 0, 0, DEFAULT_TUBE_INERTANCE, DEFAULT_TUBE_DAMPING };
+			valid = line.integer(tube.a) && line.integer(tube.b);
+			valid = valid && (line.finished() || (line.number(tube.inertance) && line.number(tube.damping) && line.finished()));
+			if (valid && (tube.a >= (int)vessels.size() || tube.b >= (int)vessels.size() || tube.a == tube.b))
+			{
+				valid = false;
+				problem = "has to connect two different vessels defined above it";
+			}
+			else if (valid && (tube.inertance <= 0.0f || tube.damping < 0.0f))
+			{
+				valid = false;
+				problem = "needs an inertance above 0 and a damping of at least 0";
+			}
+			tubes.push_back(tube);
+		}
+		else if (name == "fluid")
+		{
+			float density;
+			valid = line.number(density) && line.finished();
+			if (valid && density <= 0.0f)
+			{
+				valid = false;
+				problem = "needs a density above 0";
+			}
+			fluids.push_back(density);
+		}
+		else if (name == "layer")
+		{
+			SceneLayer layer;
+			valid = line.integer(layer.vessel) && line.integer(layer.fluid) && line.number(layer.height) && line.finished();
+			if (valid && (layer.vessel >= (int)vessels.size() || layer.fluid >= (int)fluids.size() || layer.height < 0.0f))
+			{
+				valid = false;
+				problem = "needs a vessel and a fluid defined above it and a height of at least 0";
+			}
+			layers.push_back(layer);
+		}
+		else if (name == "pressure")
+		{
+			ScenePressure pressure;
+			valid = line.integer(pressure.vessel) && line.number(pressure.value) && line.finished();
+			if (valid && pressure.vessel >= (int)vessels.size())
+			{
+				valid = false;
+				problem = "needs a vessel defined above it";
+			}
+			pressures.push_back(pressure);
+		}
+		else if (name == "piston")
+		{
+			valid = line.integer(piston) && line.finished();
+		}
+		else if (name == "shape")
+		{
+			SceneProfile profile;
+			valid = line.integer(profile.vessel) && parseProfileShape(std::string(line.word()), profile.shape) && line.number(profile.depth)
+				&& line.finished();
+			if (valid && (profile.vessel >= (int)vessels.size() || profile.depth <= 0.0f))
+			{
+				valid = false;
+				problem = "needs a vessel defined above it, cone or bowl, and a depth above 0";
+			}
+			profiles.push_back(profile);
+		}
+		else if (name == "profile")
+		{
+			SceneProfile profile;
+			valid = line.integer(profile.vessel) && line.number(profile.depth);
+			float width;
+			while (valid && !line.finished())
+			{
+				valid = line.number(width);
+				profile.widths.push_back(width);
+			}
+			if (valid && (profile.vessel >= (int)vessels.size() || profile.depth <= 0.0f || profile.widths.size() < 2
+				|| profile.widths.back() <= 0.0f || *std::min_element(profile.widths.begin(), profile.widths.end()) < 0.0f))
+			{
+				valid = false;
+				problem = "needs a vessel defined above it, a depth above 0 and at least two widths of at least 0, the last one above 0";
+			}
+			profiles.push_back(profile);
+		}
+		else if (parseTubeComponent(std::string(name), component.component))
+		{
+			component.setting = component.component == COMPONENT_VALVE ? 1.0f : 0.0f;
+			valid = line.integer(component.tube) && (line.finished() || (component.component != COMPONENT_CHECK_VALVE
+				&& line.number(component.setting) && line.finished()));
+			if (valid && (component.tube >= (int)tubes.size()
+				|| (component.component == COMPONENT_VALVE && !(component.setting >= 0.0f && component.setting <= 1.0f))))
+			{
+				valid = false;
+				problem = "needs a tube defined above it (and a valve an opening from 0 to 1)";
+			}
+			if (valid)
+			{
+				componentOf.resize(tubes.size(), COMPONENT_NONE);
+				componentOf[component.tube] = component.component;
+			}
+			components.push_back(component);
+		}
+		else if (name == "at")
+		{
+			SceneEvent event;
+			bool closes = false;
+			valid = line.integer(event.step) && parseTubeAction(std::string(line.word()), event.action, closes) && line.integer(event.tube);
+			event.value = 0.0f;
+			valid = valid && (closes || event.action == ACTION_STOP || line.number(event.value)) && line.finished();
+			TubeComponent on = valid && event.tube < (int)componentOf.size() ? componentOf[event.tube] : COMPONENT_NONE;
+			if (valid && (event.action == ACTION_OPEN ? on != COMPONENT_VALVE || !(event.value >= 0.0f && event.value <= 1.0f) : on != COMPONENT_PUMP))
+			{
+				valid = false;
+				problem = "needs a step, open, close, start or stop, and a tube with a valve (opening from 0 to 1) or pump defined above it";
+			}
+			events.push_back(event);
+		}
+		else
+		{
+			valid = false;
+			problem = "starts with something that isn't vessel, tube, fluid, layer, pressure, piston, shape, profile, valve, checkvalve, pump or at";
+		}
+
+		if (!valid)
+		{
+			std::cout << fileName << ":" << lineNumber << ": " << std::string(name) << " " << problem << std::endl;
+			return false;
+		}
+	}
+	if (vessels.empty() || piston >= (int)vessels.size())
+	{
+		std::cout << fileName << ": " << (vessels.empty() ? "has no vessels" : "the piston sits on a vessel that isn't there") << std::endl;
+		return false;
+	}
+
+	network.clear();
+	for (const SceneVessel& vessel : vessels)
+	{
+		network.addVessel(vessel.x, vessel.y, vessel.width, vessel.height);
+	}
+	for (const SceneTube& tube : tubes)
+	{
+		network.addTube(tube.a, tube.b, tube.inertance, tube.damping);
+	}
+	for (const ScenePressure& pressure : pressures)
+	{
+		network.externalPressure[pressure.vessel] = pressure.value;
+	}
+
+	// The layers go straight into the arrays, since setLayer() recomputes the whole network every time. The heights follow from
+	// them once at the end.
+	for (float density : fluids)
+	{
+		network.addFluid(density);
+	}
+	for (const SceneLayer& layer : layers)
+	{
+		network.layerHeight[layer.fluid][layer.vessel] = layer.height;
+	}
+	if (!layers.empty())
+	{
+		for (int i = 0; i < network.vesselCount(); i++)
+		{
+			float sum = 0.0f;
+			for (int f = 0; f < network.fluidCount(); f++)
+			{
+				sum += network.layerHeight[f][i];
+			}
+			network.height[i] = sum;
+			network.top[i] = network.bottom[i] + sum;
+		}
+	}
+
+	// Like the layers, the profiles go straight into the arrays, so the heights stay as the file gives them.
+	if (!profiles.empty())
+	{
+		network.vesselProfile.assign(network.vesselCount(), -1);
+	}
+	for (const SceneProfile& profile : profiles)
+	{
+		float width = network.width[profile.vessel];
+		int index = profile.widths.empty() ? network.profiles.add(profile.shape, width, profile.depth) : network.profiles.add(profile.widths, profile.depth);
+		network.vesselProfile[profile.vessel] = index;
+	}
+
+	for (const SceneComponent& component : components)
+	{
+		network.setComponent(component.tube, component.component, component.setting);
+	}
+	for (const SceneEvent& event : events)
+	{
+		network.scheduleTube(event.step, event.tube, event.action, event.value);
+	}
+
+	info = CheckpointInfo();
+	info.pistonVessel = piston;
+	return true;
+}
+
+bool readScene(const std::string& fileName, VesselNetwork& network, CheckpointInfo& info, VesselOrder order)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool loaded;
+	{
+		MappedFile file;
+		if (!file.open(fileName.c_str()))
+		{
+			return false;
+		}
+		std::string_view text = file.view();
+		if (text.size() >= 8 && memcmp(text.data(), "HYDROCKP", 8) == 0)
+		{
+			file.close();
+			loaded = readCheckpoint(fileName, network, info);
+		}
+		else
+		{
+			loaded = parseScene(text, fileName, network, info);
+		}
+	}
+
+	if (loaded)
+	{
+		std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+		std::cout << "Loaded " << fileName << ": " << network.vesselCount() << " vessels and " << network.tubeCount() << " tubes in "
+			<< took.count() << " ms" << std::endl;
+	}
+
+	if (loaded && order != ORDER_AS_LOADED)
+	{
+		start = std::chrono::steady_clock::now();
+		double span = averageTubeSpan(network);
+		std::vector<int> newOrder;
+		vesselOrder(network, order, newOrder);
+		reorderNetwork(network, newOrder);
+		for (int i = 0; i < network.vesselCount(); i++)
+		{
+			if (newOrder[i] == info.pistonVessel)
+			{
+				info.pistonVessel = i;
+				break;
+			}
+		}
+		std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+		std::cout << "Reordered the vessels in " << took.count() << " ms: a tube spans " << averageTubeSpan(network)
+			<< " vessels on average instead of " << span << std::endl;
+	}
+	return loaded;
+}
+
+bool compileScene(const std::string& textFile, const std::string& binaryFile, float tileSize, VesselOrder order)
+{
+	VesselNetwork network;
+	CheckpointInfo info;
+	if (!readScene(textFile, network, info, order))
+	{
+		return false;
+	}
+	return tileSize > 0.0f ? writeTiledScene(binaryFile, network, info, tileSize) : writeCheckpoint(binaryFile, network, info);
+}
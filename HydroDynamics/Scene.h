@@ -0,0 +1,77 @@
+/*
+Title: HydroDynamics
+File Name: Scene.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scene files describe a network of vessels, tubes and fluids to start the simulation from,
+instead of the classic apparatus that setup() builds.
+
+The text form is one item per line, and lines starting with # are comments:
+
+	vessel -0.75 -0.5 0.5 0.5	a vessel with its bottom left corner at (-0.75, -0.5), 0.5 wide
+								and filled 0.5 high. Vessels are numbered from 0 in the order
+								they appear.
+	tube 0 1					a tube between the bottoms of vessels 0 and 1, optionally
+	tube 0 1 3.7 0.8			followed by its inertance and damping
+	fluid 1000					a fluid of that density. The first one takes over the fluid the
+								vessels are filled with, and the later ones start out empty.
+	layer 1 1 0.1				fluid 1 stands 0.1 high in vessel 1, on top of what is there
+	pressure 1 0.5				a pressure pushing on the surface of vessel 1 from outside
+	piston 0					the vessel the piston sits on (the default is 0)
+
+Parsing text is slow for big networks, so a scene can be compiled (--compile-scene) into
+the binary form, which is a checkpoint of the scene before its first step (see
+Checkpoint.h). Loading that maps the file and copies the arrays straight into the network,
+with nothing to parse. readScene() takes either form, and so also starts from any
+checkpoint. A scene too big to load at once can be compiled into tiles instead, which are
+streamed in around the view (see TiledScene.h).
+
+Scene files list their vessels in any order, which can leave the ends of every tube far
+apart in memory. Either function can renumber the vessels on the way in so connected
+vessels sit next to each other (see NetworkOrder.h). A compiled scene keeps that order, so
+it doesn't have to be reordered every time it is loaded.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SCENE_H
+#define _SCENE_H
+
+#include "Checkpoint.h"
+#include "NetworkOrder.h"
+#include <string>
+#include <string_view>
+
+// Replaces the contents of network with the scene in fileName, text or binary, and sets the piston vessel in info. The pressure
+// of the piston and the step are only stored in the binary form, so a text scene starts at step 0 without any. Returns false
+// (after printing what is wrong, and without touching network) if the file can't be read or isn't a valid scene.
+// Unless order is ORDER_AS_LOADED, the vessels are renumbered in that order, and so is the piston vessel in info.
+bool readScene(const std::string& fileName, VesselNetwork& network, CheckpointInfo& info, VesselOrder order = ORDER_AS_LOADED);
+
+// The same for a text scene that is already in memory. fileName is only used in the error messages.
+bool parseScene(std::string_view text, const std::string& fileName, VesselNetwork& network, CheckpointInfo& info);
+
+// Reads a scene and writes it in the binary form, or cut into tiles of tileSize if that is above 0. Returns false if either fails.
+bool compileScene(const std::string& textFile, const std::string& binaryFile, float tileSize = 0.0f, VesselOrder order = ORDER_AS_LOADED);
+
+#endif // _SCENE_H
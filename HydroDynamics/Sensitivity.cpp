@@ -0,0 +1,389 @@
+/*
+Title: HydroDynamics
+File Name: Sensitivity.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+How the levels a network ends at depend on its widths, its external pressures, the levels it
+starts at, the conductances and damping of its tubes and the density of its fluid, worked
+out in the same run that works out the levels themselves.
+
+Finite differences need two runs for every parameter, and the result still depends on how
+far the parameter was moved. Forward mode differentiation carries the derivative of every
+number along with it instead: a Dual holds a value and its derivatives with respect to
+SENSITIVITY_LANES parameters (its tangents), and every operation on it applies the chain
+rule to all of them. The local step of VesselNetwork is templated on the type it computes
+in, like the precise step, and stepped once with Duals per SENSITIVITY_LANES parameters.
+The tangents are plain fixed size loops, which the compiler turns into SIMD operations, so
+eight of them cost about as much as two or three runs with doubles. Batches of parameters
+are independent, so they run on the task pool at the same time.
+
+The step is the one of PRECISION_DOUBLE with INTEGRATOR_LOCAL, on every vessel: nothing is
+put to sleep, since a resting vessel still has derivatives. The branches of the step (the
+rest clamp and the drain limits) are decided by the values, so the derivatives are those of
+the branch that was taken, which is the exact derivative almost everywhere.
+
+sensitivityLoss() differentiates how far a run is from measured levels instead, as the sum
+of the squared differences at the steps they were measured at. That is what a calibration
+minimizes (see Calibration.h).
+
+This file has no OpenGL dependency.
+*/
+
+#include "Sensitivity.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <iostream>
+
+// A copy of everything about the network that can be a parameter, and the flows that carry the state from one step to the next.
+template <typename Real>
+struct SensitivityState
+{
+	std::vector<Real> height;
+	std::vector<Real> width;
+	std::vector<Real> externalPressure;
+	std::vector<Real> invInertance;
+	std::vector<Real> damping;
+	std::vector<Real> flow;
+	std::vector<Real> pressure;
+	std::vector<Real> delta;
+	Real density;
+};
+
+// The same operations as preciseTubeFlow() (see VesselNetwork.cpp) and the height update after it, in Real, and with the stiffness
+// and the drain shares worked out from the widths every step, since they depend on them.
+template <typename Real>
+static void sensitivityStep(const VesselNetwork& network, SensitivityState<Real>& state, double gravity, double dt)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	Real scale = state.density * gravity;
+	for (int i = 0; i < vessels; i++)
+	{
+		state.pressure[i] = state.height[i] * scale + state.externalPressure[i];
+		state.delta[i] = Real(0.0);
+	}
+
+	Real dtSquaredScale = scale * (dt * dt);
+	double restPressure = REST_HEIGHT * valueOf(scale);
+	for (int t = 0; t < tubes; t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		Real difference = state.pressure[b] - state.pressure[a];
+
+		const Real& invInertance = state.invInertance[t];
+		Real stiffness = Real(1.0) / state.width[a] + Real(1.0) / state.width[b];
+		Real f = (state.flow[t] + difference * invInertance * dt)
+			/ (Real(1.0) + state.damping[t] * dt + dtSquaredScale * stiffness * invInertance);
+
+		if (std::fabs(valueOf(f)) < REST_FLOW && std::fabs(valueOf(difference)) < restPressure)
+		{
+			f = Real(0.0);
+		}
+
+		Real volume = f * dt;
+		Real limitIntoA = state.height[b] * state.width[b] / (double)network.degree[b];
+		Real limitIntoB = -(state.height[a] * state.width[a] / (double)network.degree[a]);
+		if (volume > limitIntoA)
+		{
+			volume = limitIntoA;
+		}
+		if (volume < limitIntoB)
+		{
+			volume = limitIntoB;
+		}
+
+		state.flow[t] = volume / dt;
+		state.delta[a] += volume;
+		state.delta[b] -= volume;
+	}
+
+	for (int i = 0; i < vessels; i++)
+	{
+		state.height[i] += state.delta[i] / state.width[i];
+	}
+}
+
+typedef Dual<SENSITIVITY_LANES> SensitivityReal;
+
+// Steps one batch of up to SENSITIVITY_LANES parameters, starting at parameter first, and calls observe(step, state) with the state
+// it starts at (step 0) and after every step.
+template <typename Observe>
+static void runBatch(const VesselNetwork& network, float density, float gravity, double dt, long long steps,
+	const std::vector<SensitivityParameter>& parameters, size_t first, Observe observe)
+{
+	int vessels = network.vesselCount();
+
+	SensitivityState<SensitivityReal> state;
+	state.height.assign(network.height.begin(), network.height.end());
+	state.width.assign(network.width.begin(), network.width.end());
+	state.externalPressure.assign(network.externalPressure.begin(), network.externalPressure.end());
+	state.invInertance.assign(network.tubeInvInertance.begin(), network.tubeInvInertance.end());
+	state.damping.assign(network.tubeDamping.begin(), network.tubeDamping.end());
+	state.flow.assign(network.tubeFlow.begin(), network.tubeFlow.end());
+	state.pressure.resize(vessels);
+	state.delta.resize(vessels);
+	state.density = density;
+
+	// Two lanes can have the same parameter, so every lane only sets its own tangent.
+	size_t lanes = std::min((size_t)SENSITIVITY_LANES, parameters.size() - std::min(first, parameters.size()));
+	for (size_t k = 0; k < lanes; k++)
+	{
+		const SensitivityParameter& parameter = parameters[first + k];
+		switch (parameter.kind)
+		{
+		case SENSITIVITY_WIDTH:
+			state.width[parameter.index].tangent[k] = 1.0;
+			break;
+		case SENSITIVITY_PRESSURE:
+			state.externalPressure[parameter.index].tangent[k] = 1.0;
+			break;
+		case SENSITIVITY_HEIGHT:
+			state.height[parameter.index].tangent[k] = 1.0;
+			break;
+		case SENSITIVITY_CONDUCTANCE:
+			state.invInertance[parameter.index].tangent[k] = 1.0;
+			break;
+		case SENSITIVITY_DAMPING:
+			state.damping[parameter.index].tangent[k] = 1.0;
+			break;
+		case SENSITIVITY_DENSITY:
+			state.density.tangent[k] = 1.0;
+			break;
+		}
+	}
+
+	observe(0, state, lanes);
+	for (long long s = 1; s <= steps; s++)
+	{
+		sensitivityStep(network, state, gravity, dt);
+		observe(s, state, lanes);
+	}
+}
+
+// Runs every batch of parameters, on the pool if there is more than one. Without parameters there is still one batch, for the levels.
+template <typename Batch>
+static void runBatches(size_t parameterCount, TaskPool* pool, Batch batch)
+{
+	int batches = std::max(1, (int)((parameterCount + SENSITIVITY_LANES - 1) / SENSITIVITY_LANES));
+	auto body = [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			batch((size_t)i * SENSITIVITY_LANES);
+		}
+	};
+	if (pool != nullptr && batches > 1)
+	{
+		pool->parallelFor(batches, 1, body);
+	}
+	else
+	{
+		body(0, batches);
+	}
+}
+
+static bool checkParameters(const VesselNetwork& network, const std::vector<SensitivityParameter>& parameters)
+{
+	if (network.layered() || network.profiled() || network.hasComponents() || network.drainLimit != DRAIN_EVEN)
+	{
+		std::cout << "Only a plain network (one fluid, rectangular vessels, no tube components, drained evenly) can be differentiated." << std::endl;
+		return false;
+	}
+	for (const SensitivityParameter& parameter : parameters)
+	{
+		int count = parameter.kind == SENSITIVITY_DENSITY ? 1 : sensitivityOfTube(parameter.kind) ? network.tubeCount() : network.vesselCount();
+		if (parameter.index < 0 || parameter.index >= count)
+		{
+			std::cout << "There is no " << (sensitivityOfTube(parameter.kind) ? "tube " : parameter.kind == SENSITIVITY_DENSITY ? "fluid " : "vessel ")
+				<< parameter.index << " to differentiate by." << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool sensitivities(const VesselNetwork& network, float density, float gravity, float dt, long long steps,
+	const std::vector<SensitivityParameter>& parameters, std::vector<double>& heights, std::vector<double>& derivatives, TaskPool* pool)
+{
+	if (!checkParameters(network, parameters))
+	{
+		return false;
+	}
+
+	int vessels = network.vesselCount();
+	size_t count = parameters.size();
+	heights.assign(vessels, 0.0);
+	derivatives.assign((size_t)vessels * count, 0.0);
+	runBatches(count, pool, [&](size_t first)
+	{
+		runBatch(network, density, gravity, dt, steps, parameters, first, [&](long long step, const SensitivityState<SensitivityReal>& state, size_t lanes)
+		{
+			if (step < steps)
+			{
+				return;
+			}
+			// Every batch works out the same levels, the first one keeps them.
+			for (int i = 0; i < vessels; i++)
+			{
+				if (first == 0)
+				{
+					heights[i] = state.height[i].value;
+				}
+				for (size_t k = 0; k < lanes; k++)
+				{
+					derivatives[i * count + first + k] = state.height[i].tangent[k];
+				}
+			}
+		});
+	});
+	return true;
+}
+
+bool sensitivityLoss(const VesselNetwork& network, float density, float gravity, float dt, const std::vector<LevelSample>& samples,
+	const std::vector<SensitivityParameter>& parameters, double& loss, std::vector<double>& gradient, TaskPool* pool)
+{
+	if (!checkParameters(network, parameters))
+	{
+		return false;
+	}
+	long long lastStep = 0;
+	for (const LevelSample& sample : samples)
+	{
+		if (sample.vessel < 0 || sample.vessel >= network.vesselCount() || sample.step < 0)
+		{
+			std::cout << "The sample of vessel " << sample.vessel << " at step " << sample.step << " isn't in the network." << std::endl;
+			return false;
+		}
+		lastStep = std::max(lastStep, sample.step);
+	}
+
+	std::vector<LevelSample> sorted(samples);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const LevelSample& x, const LevelSample& y) { return x.step < y.step; });
+
+	loss = 0.0;
+	gradient.assign(parameters.size(), 0.0);
+	runBatches(parameters.size(), pool, [&](size_t first)
+	{
+		double batchLoss = 0.0;
+		double batchGradient[SENSITIVITY_LANES] = {};
+		size_t next = 0;
+		size_t batchLanes = 0;
+		runBatch(network, density, gravity, dt, lastStep, parameters, first, [&](long long step, const SensitivityState<SensitivityReal>& state, size_t lanes)
+		{
+			batchLanes = lanes;
+			for (; next < sorted.size() && sorted[next].step == step; next++)
+			{
+				const SensitivityReal& height = state.height[sorted[next].vessel];
+				double difference = height.value - sorted[next].height;
+				batchLoss += difference * difference;
+				for (size_t k = 0; k < lanes; k++)
+				{
+					batchGradient[k] += 2.0 * difference * height.tangent[k];
+				}
+			}
+		});
+		if (first == 0)
+		{
+			loss = batchLoss;
+		}
+		for (size_t k = 0; k < batchLanes; k++)
+		{
+			gradient[first + k] = batchGradient[k];
+		}
+	});
+	return true;
+}
+
+double sensitivityValue(const VesselNetwork& network, float density, const SensitivityParameter& parameter)
+{
+	switch (parameter.kind)
+	{
+	case SENSITIVITY_WIDTH:
+		return network.width[parameter.index];
+	case SENSITIVITY_PRESSURE:
+		return network.externalPressure[parameter.index];
+	case SENSITIVITY_HEIGHT:
+		return network.height[parameter.index];
+	case SENSITIVITY_CONDUCTANCE:
+		return network.tubeInvInertance[parameter.index];
+	case SENSITIVITY_DAMPING:
+		return network.tubeDamping[parameter.index];
+	default:
+		return density;
+	}
+}
+
+void setSensitivityValue(VesselNetwork& network, float& density, const SensitivityParameter& parameter, double value)
+{
+	switch (parameter.kind)
+	{
+	case SENSITIVITY_WIDTH:
+		network.width[parameter.index] = (float)value;
+		network.topologyDirty = true;
+		break;
+	case SENSITIVITY_PRESSURE:
+		network.setExternalPressure(parameter.index, (float)value);
+		return;
+	case SENSITIVITY_HEIGHT:
+		network.height[parameter.index] = (float)value;
+		network.top[parameter.index] = network.bottom[parameter.index] + network.height[parameter.index];
+		network.preciseDirty = true;
+		break;
+	case SENSITIVITY_CONDUCTANCE:
+		network.tubeInvInertance[parameter.index] = (float)value;
+		network.rateVersion = -1;
+		network.tubeVersion++;
+		break;
+	case SENSITIVITY_DAMPING:
+		network.tubeDamping[parameter.index] = (float)value;
+		network.rateVersion = -1;
+		network.tubeVersion++;
+		break;
+	case SENSITIVITY_DENSITY:
+		density = (float)value;
+		break;
+	}
+	network.wakeAll();
+}
+
+bool parseSensitivityKind(const std::string& name, SensitivityKind& kind)
+{
+	const char* names[] = { "width", "pressure", "height", "conductance", "damping", "density" };
+	for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+	{
+		if (name == names[i])
+		{
+			kind = (SensitivityKind)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* sensitivityKindName(SensitivityKind kind)
+{
+	const char* names[] = { "width", "pressure", "height", "conductance", "damping", "density" };
+	return names[kind];
+}
@@ -0,0 +1,247 @@
+/*
+Title: HydroDynamics
+File Name: Sensitivity.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+How the levels a network ends at depend on its widths, its external pressures, the levels it
+starts at, the conductances and damping of its tubes and the density of its fluid, worked
+out in the same run that works out the levels themselves.
+
+Finite differences need two runs for every parameter, and the result still depends on how
+far the parameter was moved. Forward mode differentiation carries the derivative of every
+number along with it instead: a Dual holds a value and its derivatives with respect to
+SENSITIVITY_LANES parameters (its tangents), and every operation on it applies the chain
+rule to all of them. The local step of VesselNetwork is templated on the type it computes
+in, like the precise step, and stepped once with Duals per SENSITIVITY_LANES parameters.
+The tangents are plain fixed size loops, which the compiler turns into SIMD operations, so
+eight of them cost about as much as two or three runs with doubles. Batches of parameters
+are independent, so they run on the task pool at the same time.
+
+The step is the one of PRECISION_DOUBLE with INTEGRATOR_LOCAL, on every vessel: nothing is
+put to sleep, since a resting vessel still has derivatives. The branches of the step (the
+rest clamp and the drain limits) are decided by the values, so the derivatives are those of
+the branch that was taken, which is the exact derivative almost everywhere.
+
+sensitivityLoss() differentiates how far a run is from measured levels instead, as the sum
+of the squared differences at the steps they were measured at. That is what a calibration
+minimizes (see Calibration.h).
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SENSITIVITY_H
+#define _SENSITIVITY_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+class VesselNetwork;
+class TaskPool;
+
+// The number of parameters one run differentiates by.
+#define SENSITIVITY_LANES 8
+
+// A value and its derivatives with respect to LANES parameters.
+template <int LANES>
+struct Dual
+{
+	double value;
+	double tangent[LANES];
+
+	Dual() : Dual(0.0) {}
+	Dual(double v) : value(v)
+	{
+		for (int k = 0; k < LANES; k++)
+		{
+			tangent[k] = 0.0;
+		}
+	}
+
+	// A parameter: its own value, with a derivative of 1 with respect to itself in lane.
+	static Dual seed(double v, int lane)
+	{
+		Dual result(v);
+		result.tangent[lane] = 1.0;
+		return result;
+	}
+
+	Dual& operator+=(const Dual& other)
+	{
+		value += other.value;
+		for (int k = 0; k < LANES; k++)
+		{
+			tangent[k] += other.tangent[k];
+		}
+		return *this;
+	}
+
+	Dual& operator-=(const Dual& other)
+	{
+		value -= other.value;
+		for (int k = 0; k < LANES; k++)
+		{
+			tangent[k] -= other.tangent[k];
+		}
+		return *this;
+	}
+};
+
+template <int LANES>
+inline Dual<LANES> operator-(const Dual<LANES>& x)
+{
+	Dual<LANES> result;
+	result.value = -x.value;
+	for (int k = 0; k < LANES; k++)
+	{
+		result.tangent[k] = -x.tangent[k];
+	}
+	return result;
+}
+
+template <int LANES>
+inline Dual<LANES> operator+(Dual<LANES> x, const Dual<LANES>& y)
+{
+	return x += y;
+}
+
+template <int LANES>
+inline Dual<LANES> operator-(Dual<LANES> x, const Dual<LANES>& y)
+{
+	return x -= y;
+}
+
+template <int LANES>
+inline Dual<LANES> operator*(const Dual<LANES>& x, const Dual<LANES>& y)
+{
+	Dual<LANES> result;
+	result.value = x.value * y.value;
+	for (int k = 0; k < LANES; k++)
+	{
+		result.tangent[k] = x.tangent[k] * y.value + x.value * y.tangent[k];
+	}
+	return result;
+}
+
+template <int LANES>
+inline Dual<LANES> operator*(const Dual<LANES>& x, double y)
+{
+	Dual<LANES> result;
+	result.value = x.value * y;
+	for (int k = 0; k < LANES; k++)
+	{
+		result.tangent[k] = x.tangent[k] * y;
+	}
+	return result;
+}
+
+template <int LANES>
+inline Dual<LANES> operator*(double x, const Dual<LANES>& y)
+{
+	return y * x;
+}
+
+template <int LANES>
+inline Dual<LANES> operator/(const Dual<LANES>& x, const Dual<LANES>& y)
+{
+	// (x / y)' = (x' - (x / y) * y') / y
+	Dual<LANES> result;
+	result.value = x.value / y.value;
+	double inverse = 1.0 / y.value;
+	for (int k = 0; k < LANES; k++)
+	{
+		result.tangent[k] = (x.tangent[k] - result.value * y.tangent[k]) * inverse;
+	}
+	return result;
+}
+
+template <int LANES>
+inline Dual<LANES> operator/(const Dual<LANES>& x, double y)
+{
+	return x * (1.0 / y);
+}
+
+// Comparisons only look at the values, so a branch is taken the way the plain step takes it.
+template <int LANES>
+inline bool operator<(const Dual<LANES>& x, const Dual<LANES>& y) { return x.value < y.value; }
+
+template <int LANES>
+inline bool operator>(const Dual<LANES>& x, const Dual<LANES>& y) { return x.value > y.value; }
+
+template <int LANES>
+inline double valueOf(const Dual<LANES>& x) { return x.value; }
+
+inline double valueOf(double x) { return x; }
+
+// What a derivative is taken with respect to.
+enum SensitivityKind
+{
+	SENSITIVITY_WIDTH = 0,	// The width of a vessel
+	SENSITIVITY_PRESSURE,	// The external pressure on a vessel
+	SENSITIVITY_HEIGHT,		// The level a vessel starts at
+	SENSITIVITY_CONDUCTANCE,	// The inverse inertance of a tube
+	SENSITIVITY_DAMPING,	// The damping of a tube
+	SENSITIVITY_DENSITY		// The density of the fluid (index 0, the only one)
+};
+
+struct SensitivityParameter
+{
+	SensitivityKind kind;
+	int index;	// The vessel or the tube
+};
+
+// A level measured in a vessel after a step (0 for the level it starts at).
+struct LevelSample
+{
+	long long step;
+	int vessel;
+	float height;
+};
+
+// Steps a copy of network by dt for steps steps, and writes the levels it ends at into heights, and the derivative of the level of
+// vessel i with respect to parameter p into derivatives[i * parameters.size() + p]. The external pressures stay what they are in
+// network. Returns false, with a message, if the network isn't a plain one (no layers, profiles or tube components, and drained
+// evenly) or a parameter doesn't exist.
+bool sensitivities(const VesselNetwork& network, float density, float gravity, float dt, long long steps,
+	const std::vector<SensitivityParameter>& parameters, std::vector<double>& heights, std::vector<double>& derivatives, TaskPool* pool = nullptr);
+
+// Steps a copy of network by dt up to the last step of samples, and works out loss, the sum of (level - sample)^2 over samples, and
+// its derivative with respect to every parameter into gradient. Returns false, like sensitivities(), if the network can't be
+// differentiated or a sample is of a vessel that doesn't exist.
+bool sensitivityLoss(const VesselNetwork& network, float density, float gravity, float dt, const std::vector<LevelSample>& samples,
+	const std::vector<SensitivityParameter>& parameters, double& loss, std::vector<double>& gradient, TaskPool* pool = nullptr);
+
+// The value of a parameter in network (or density), and setting it. setSensitivityValue() marks whatever depends on it out of date.
+double sensitivityValue(const VesselNetwork& network, float density, const SensitivityParameter& parameter);
+void setSensitivityValue(VesselNetwork& network, float& density, const SensitivityParameter& parameter, double value);
+
+// Finds a kind by its name (width, pressure, height, conductance, damping or density). Returns false if there is none with that name.
+bool parseSensitivityKind(const std::string& name, SensitivityKind& kind);
+
+// Whether parameters of this kind are tubes rather than vessels.
+inline bool sensitivityOfTube(SensitivityKind kind) { return kind == SENSITIVITY_CONDUCTANCE || kind == SENSITIVITY_DAMPING; }
+
+// The name of a kind, as parseSensitivityKind() takes it.
+const char* sensitivityKindName(SensitivityKind kind);
+
+#endif // _SENSITIVITY_H
@@ -0,0 +1,323 @@
+/*
+Title: HydroDynamics
+File Name: SensorIngest.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Takes the readings of the plant a digital twin follows, live, and hands them to the
+simulation as boundary conditions. The plant sends them over TCP (--ingest-port PORT) or
+writes them into a ring of shared memory the simulation creates (--ingest-shm NAME); either
+way the stream is the same, little-endian frames of an IngestFrameHeader followed by its
+count IngestReadings:
+
+	magic "HDIN", count, time (plant seconds)		16 bytes
+	vessel, kind, value								12 bytes per reading
+
+A reading is either the external pressure on a vessel or the height of its fluid. The
+simulation applies it as the same command the keys and the remote control use (an external
+pressure, or fluid added or taken out until the height is right), so it is recorded with
+the rest of the input and a twin session can be replayed without the plant.
+
+A background thread receives the frames straight into its buffer (or finds them where they
+are in the ring) and reads their fields in place, without going through text or copying the
+stream anywhere else. It hands the readings to the simulation through a lock-free queue, so
+a step only ever takes what is already there and never waits for the plant.
+
+The plant's clock isn't the simulation's. The first frame fixes the offset: its time is taken
+to be the simulated time of the step that first sees it, and every later frame is applied at
+the step its time falls on from there, so frames that arrive in bursts still take effect
+as far apart as they were measured. A frame that arrives after its step has passed is late,
+and applied at once.
+
+In the ring, the plant writes whole frames at written (modulo the capacity, wrapping around
+the end) and then moves written on past them with a release store. A frame may have no more than
+INGEST_BUFFER_SIZE bytes, and a plant that gets more than the capacity less that ahead of the
+reader may be overwriting frames that weren't read yet; the reader notices, drops them and
+goes on from the newest.
+
+This file has no OpenGL dependency.
+*/
+
+#include "SensorIngest.h"
+#include "ThreadControl.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+// How far ahead of the reader the plant may get before the frame it is writing could reach what the reader hasn't read.
+#define INGEST_RING_SLACK (INGEST_RING_CAPACITY - INGEST_BUFFER_SIZE)
+
+SensorIngest::~SensorIngest()
+{
+	close();
+}
+
+bool SensorIngest::listen(int port)
+{
+	close();
+	if (!listener.listen(port))
+	{
+		return false;
+	}
+	buffer.resize(INGEST_BUFFER_SIZE);
+	stopping = false;
+	thread = std::thread(&SensorIngest::serve, this);
+	return true;
+}
+
+bool SensorIngest::attach(const std::string& name)
+{
+	close();
+	if (!block.create(name, sizeof(IngestRingHeader) + INGEST_RING_CAPACITY))
+	{
+		return false;
+	}
+
+	// The magic comes last, so a plant that opens the ring early doesn't write into it before it is ready.
+	memset(block.data(), 0, block.size());
+	ring = new (block.data()) IngestRingHeader();
+	ring->version = INGEST_RING_VERSION;
+	ring->capacity = INGEST_RING_CAPACITY;
+	ring->written.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(ring->magic, INGEST_RING_MAGIC, sizeof(ring->magic));
+
+	// The buffer only holds frames that wrap around the end of the ring.
+	buffer.resize(INGEST_BUFFER_SIZE);
+	stopping = false;
+	thread = std::thread(&SensorIngest::watch, this);
+	return true;
+}
+
+void SensorIngest::close()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+	stopping = true;
+	thread.join();
+	listener.close();
+	block.close();
+	ring = nullptr;
+
+	std::cout << "Ingested " << frames << " sensor frames and applied " << applied << " readings (" << late << " late, " << dropped
+		<< " dropped";
+	if (overruns > 0)
+	{
+		std::cout << ", the plant lapped the ring " << overruns << " times";
+	}
+	std::cout << ")." << std::endl;
+
+	IngestEvent event;
+	while (queue.pop(event))
+	{
+	}
+	waiting = false;
+	synchronized = false;
+	frames = 0;
+	dropped = 0;
+	overruns = 0;
+	applied = 0;
+	late = 0;
+	lastTime = 0.0;
+}
+
+void SensorIngest::take(double time, void(*apply)(const IngestEvent& reading))
+{
+	while (waiting || queue.pop(pending))
+	{
+		if (!synchronized)
+		{
+			offset = time - pending.time;
+			synchronized = true;
+		}
+		double due = pending.time + offset;
+		if (due > time)
+		{
+			waiting = true;
+			break;
+		}
+		if (due < lastTime)
+		{
+			late++;
+		}
+		waiting = false;
+		apply(pending);
+		applied++;
+	}
+	lastTime = time;
+}
+
+void SensorIngest::serve()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	LineConnection plant;
+	size_t filled = 0;
+	while (!stopping)
+	{
+		// Until the plant connects, waiting for it is what paces the loop.
+		if (!plant.isOpen())
+		{
+			if (listener.accept(plant, INGEST_POLL_MILLISECONDS))
+			{
+				filled = 0;
+				if (!plant.setNonBlocking())
+				{
+					plant.close();
+				}
+			}
+			continue;
+		}
+
+		long long count = plant.receiveSome(buffer.data() + filled, buffer.size() - filled);
+		if (count <= 0)
+		{
+			if (count == 0)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(INGEST_POLL_MILLISECONDS));
+			}
+			continue;
+		}
+		filled += (size_t)count;
+
+		// Every whole frame is read where it arrived. Only the start of one that isn't complete yet moves to the front.
+		size_t start = 0;
+		long long length;
+		while ((length = parse(buffer.data() + start, filled - start)) > 0)
+		{
+			publish();
+			start += (size_t)length;
+		}
+		if (length < 0)
+		{
+			std::cout << "The plant sent something that isn't a sensor frame, closing its connection." << std::endl;
+			plant.close();
+			continue;
+		}
+		memmove(buffer.data(), buffer.data() + start, filled - start);
+		filled -= start;
+	}
+}
+
+void SensorIngest::watch()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	const char* stream = block.data() + sizeof(IngestRingHeader);
+	uint64_t position = 0;
+	while (!stopping)
+	{
+		uint64_t written = ring->written.load(std::memory_order_acquire);
+		if (written == position)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(INGEST_POLL_MILLISECONDS));
+			continue;
+		}
+		if (written < position || written - position > INGEST_RING_SLACK)
+		{
+			overruns++;
+			position = written;
+			continue;
+		}
+
+		while (position < written)
+		{
+			size_t at = (size_t)(position & (INGEST_RING_CAPACITY - 1));
+			size_t available = (size_t)(written - position);
+			size_t before = std::min(available, (size_t)INGEST_RING_CAPACITY - at);
+			long long length = parse(stream + at, before);
+			if (length == 0 && available > before)
+			{
+				// Only a frame that wraps around the end is copied, to have it in one piece.
+				size_t copied = std::min(available, buffer.size());
+				memcpy(buffer.data(), stream + at, before);
+				memcpy(buffer.data() + before, stream, copied - before);
+				length = parse(buffer.data(), copied);
+			}
+			if (length <= 0)
+			{
+				std::cout << "The plant wrote something into the ring that isn't a sensor frame, skipping to the newest." << std::endl;
+				position = written;
+				break;
+			}
+
+			// The frame only counts if the plant can't have been writing over it while it was read.
+			if (ring->written.load(std::memory_order_acquire) - position > INGEST_RING_SLACK)
+			{
+				break;
+			}
+			publish();
+			position += (uint64_t)length;
+		}
+	}
+}
+
+long long SensorIngest::parse(const char* data, size_t size)
+{
+	IngestFrameHeader header;
+	if (size < sizeof(header))
+	{
+		return 0;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != INGEST_MAGIC || header.count > (INGEST_BUFFER_SIZE - sizeof(header)) / sizeof(IngestReading))
+	{
+		return -1;
+	}
+	size_t length = sizeof(header) + header.count * sizeof(IngestReading);
+	if (size < length)
+	{
+		return 0;
+	}
+
+	// The memcpy only stands in for the load a reading can't do itself, since nothing keeps it aligned.
+	frameEvents.clear();
+	const char* readings = data + sizeof(header);
+	for (uint32_t i = 0; i < header.count; i++)
+	{
+		IngestReading reading;
+		memcpy(&reading, readings + i * sizeof(reading), sizeof(reading));
+		if (reading.kind >= INGEST_KIND_COUNT || reading.vessel > (uint32_t)INT_MAX || !std::isfinite(reading.value))
+		{
+			dropped++;
+			continue;
+		}
+		frameEvents.push_back({ header.time, (int)reading.vessel, (IngestKind)reading.kind, reading.value });
+	}
+	return (long long)length;
+}
+
+void SensorIngest::publish()
+{
+	for (const IngestEvent& event : frameEvents)
+	{
+		if (!queue.push(event))
+		{
+			dropped++;
+		}
+	}
+	frames++;
+}
@@ -0,0 +1,178 @@
+/*
+Title: HydroDynamics
+File Name: SensorIngest.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Takes the readings of the plant a digital twin follows, live, and hands them to the
+simulation as boundary conditions. The plant sends them over TCP (--ingest-port PORT) or
+writes them into a ring of shared memory the simulation creates (--ingest-shm NAME); either
+way the stream is the same, little-endian frames of an IngestFrameHeader followed by its
+count IngestReadings:
+
+	magic "HDIN", count, time (plant seconds)		16 bytes
+	vessel, kind, value								12 bytes per reading
+
+A reading is either the external pressure on a vessel or the height of its fluid. The
+simulation applies it as the same command the keys and the remote control use (an external
+pressure, or fluid added or taken out until the height is right), so it is recorded with
+the rest of the input and a twin session can be replayed without the plant.
+
+A background thread receives the frames straight into its buffer (or finds them where they
+are in the ring) and reads their fields in place, without going through text or copying the
+stream anywhere else. It hands the readings to the simulation through a lock-free queue, so
+a step only ever takes what is already there and never waits for the plant.
+
+The plant's clock isn't the simulation's. The first frame fixes the offset: its time is taken
+to be the simulated time of the step that first sees it, and every later frame is applied at
+the step its time falls on from there, so frames that arrive in bursts still take effect
+as far apart as they were measured. A frame that arrives after its step has passed is late,
+and applied at once.
+
+In the ring, the plant writes whole frames at written (modulo the capacity, wrapping around
+the end) and then moves written on past them with a release store. A frame may have no more than
+INGEST_BUFFER_SIZE bytes, and a plant that gets more than the capacity less that ahead of the
+reader may be overwriting frames that weren't read yet; the reader notices, drops them and
+goes on from the newest.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SENSOR_INGEST_H
+#define _SENSOR_INGEST_H
+
+#include "LineSocket.h"
+#include "LiveExport.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define INGEST_MAGIC 0x4E494448u			// "HDIN" in the order the bytes are sent
+#define INGEST_RING_MAGIC "HYDROING"
+#define INGEST_RING_VERSION 1
+#define INGEST_RING_CAPACITY (4 << 20)		// Bytes of stream the ring holds, a power of two
+#define INGEST_BUFFER_SIZE (1 << 20)		// Bytes a TCP frame may have at most
+#define INGEST_QUEUE_SIZE 65536				// Readings on their way to the simulation
+#define INGEST_POLL_MILLISECONDS 1
+
+enum IngestKind
+{
+	INGEST_EXTERNAL_PRESSURE = 0,	// value is the pressure on the surface of vessel
+	INGEST_HEIGHT,					// value is how high the fluid in vessel stands, in meters
+	INGEST_KIND_COUNT
+};
+
+struct IngestFrameHeader
+{
+	uint32_t magic;		// INGEST_MAGIC
+	uint32_t count;		// How many IngestReadings follow
+	double time;		// When the plant took them, in seconds of its own clock
+};
+
+struct IngestReading
+{
+	uint32_t vessel;
+	uint32_t kind;		// An IngestKind
+	float value;
+};
+
+static_assert(sizeof(IngestFrameHeader) == 16 && sizeof(IngestReading) == 12, "The ingest frames have to be packed as they are sent");
+
+// The start of the shared memory; the stream follows it.
+struct IngestRingHeader
+{
+	char magic[8];						// INGEST_RING_MAGIC
+	uint32_t version;					// INGEST_RING_VERSION
+	uint32_t capacity;					// INGEST_RING_CAPACITY
+	std::atomic<uint64_t> written;		// How many bytes of the stream the plant has finished
+};
+
+// A reading as the simulation gets it, with the plant time of its frame.
+struct IngestEvent
+{
+	double time;
+	int vessel;
+	IngestKind kind;
+	float value;
+};
+
+class SensorIngest
+{
+public:
+	SensorIngest() {}
+	~SensorIngest();
+
+	SensorIngest(const SensorIngest&) = delete;
+	SensorIngest& operator=(const SensorIngest&) = delete;
+
+	// Listens on port for the plant, or creates the ring called name, and starts the thread. Returns false (after printing an
+	// error) if that fails.
+	bool listen(int port);
+	bool attach(const std::string& name);
+
+	// Stops the thread and says how many readings came in.
+	void close();
+	bool isOpen() const { return thread.joinable(); }
+
+	// Simulation thread only. Calls apply for every reading that is due by time (the simulated time of the step, in seconds), in
+	// the order they came in, and leaves the rest for a later step.
+	void take(double time, void(*apply)(const IngestEvent& reading));
+
+private:
+	void serve();
+	void watch();
+
+	// Reads the frame at data, which has size bytes, into frameEvents. Returns how many bytes it took, 0 if the whole frame isn't
+	// there yet, or -1 if data doesn't start a frame at all.
+	long long parse(const char* data, size_t size);
+
+	// Hands frameEvents to the simulation.
+	void publish();
+
+	std::thread thread;
+	std::atomic<bool> stopping{ false };
+	LineListener listener;
+	SharedBlock block;
+	IngestRingHeader* ring = nullptr;
+	std::vector<char> buffer;
+	std::vector<IngestEvent> frameEvents;
+	SpscQueue<IngestEvent, INGEST_QUEUE_SIZE> queue;
+
+	// What the thread counts.
+	std::atomic<long long> frames{ 0 };
+	std::atomic<long long> dropped{ 0 };		// Readings that weren't valid, or didn't fit into the queue
+	std::atomic<long long> overruns{ 0 };		// Times the plant lapped the reader of the ring
+
+	// What the simulation keeps.
+	bool waiting = false;		// pending was taken from the queue but isn't due yet
+	IngestEvent pending;
+	bool synchronized = false;
+	double offset = 0.0;		// Simulated time minus plant time
+	long long applied = 0;
+	long long late = 0;
+	double lastTime = 0.0;
+};
+
+#endif // _SENSOR_INGEST_H
@@ -0,0 +1,265 @@
+/*
+Title: HydroDynamics
+File Name: Sensors.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Virtual sensors (--sensors FILE) that sample the level or the pressure of a vessel, or the
+flow through a tube, each at a rate of its own, so what a run writes grows with the number
+of sensors instead of the size of the network. A sensor file has one line per sensor with
+its name, what it measures, the vessel or tube, how many samples it takes per second and
+how it downsamples the steps in between; lines starting with # are comments:
+
+	# name		kind		index	rate	downsampling
+	inlet		level		0		10		mean		the mean level of vessel 0 over every 0.1 s
+	valve		flow		12		100		last		the flow through tube 12, 100 times a second
+	deep		pressure	40		1		max			the highest pressure on the floor of vessel 40 every second
+
+The rate is in samples per second of simulated time; 0 (or any rate at or above the physics
+rate) samples every step. The downsampling is mean (the default), last, min or max, over the
+steps since the sample before. A pressure is the one at the floor of the vessel, with the
+external pressure pushing on it, like the HUD shows.
+
+sample() runs once after every step. The sensors are kept as arrays grouped by what they
+measure, and each group is one loop that gathers its values from the arrays of the network
+and folds them into all four reductions at once, without branching on the downsampling.
+Only the sensors whose sample is due then produce one. The sensors hold Handles (see
+HandleTable.h), so they follow their vessels and tubes when others are added or removed,
+and one whose vessel or tube was removed stops sampling.
+
+The samples go to a CSV file (--sensor-output FILE) with one line per sample: the step, its
+time, the name of the sensor and the value. The newest sample of every sensor is also kept
+in an atomic, for readers on other threads like the metrics endpoint.
+
+This file has no OpenGL dependency.
+*/
+
+#include "Sensors.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+// The names of the kinds and the downsamplings in the file, in the order of their enums.
+static const char* kindNames[SENSOR_KIND_COUNT] = { "level", "pressure", "flow" };
+static const char* downsamplingNames[] = { "mean", "last", "min", "max" };
+
+// The buffer of the CSV file, so the samples of many steps go to the disk in one write.
+#define SENSOR_FILE_BUFFER (1 << 16)
+
+SensorSet::~SensorSet()
+{
+	close();
+}
+
+bool SensorSet::read(const std::string& fileName)
+{
+	std::ifstream in(fileName, std::ios::in);
+	if (!in.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+
+	std::vector<Sensor> loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		lineNumber++;
+		std::istringstream fields(line);
+		Sensor sensor;
+		std::string kind;
+		if (line.empty() || line[0] == '#' || !(fields >> sensor.name))
+		{
+			continue;
+		}
+
+		std::string downsampling = "mean";
+		bool valid = (bool)(fields >> kind >> sensor.index >> sensor.rate);
+		fields >> downsampling;
+		int k = (int)(std::find(kindNames, kindNames + SENSOR_KIND_COUNT, kind) - kindNames);
+		int d = (int)(std::find(std::begin(downsamplingNames), std::end(downsamplingNames), downsampling) - downsamplingNames);
+		if (!valid || k == SENSOR_KIND_COUNT || d == (int)std::size(downsamplingNames) || sensor.index < 0 || !(sensor.rate >= 0.0f))
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a sensor, expected a name, level, pressure or flow, an index, a "
+				"rate and mean, last, min or max: " << line << std::endl;
+			return false;
+		}
+		sensor.kind = (SensorKind)k;
+		sensor.downsampling = (SensorDownsampling)d;
+		loaded.push_back(sensor);
+	}
+
+	sensors.swap(loaded);
+	sensorNames.clear();
+	for (const Sensor& sensor : sensors)
+	{
+		sensorNames.push_back(sensor.name);
+	}
+	newest.reset(new std::atomic<float>[sensors.size()]);
+	for (size_t s = 0; s < sensors.size(); s++)
+	{
+		newest[s].store(0.0f, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+void SensorSet::bind(const VesselNetwork& network, double physicsHz)
+{
+	stepSeconds = 1.0 / physicsHz;
+	for (Group& group : groups)
+	{
+		group = Group();
+	}
+	for (int s = 0; s < (int)sensors.size(); s++)
+	{
+		const Sensor& sensor = sensors[s];
+		bool tube = sensor.kind == SENSOR_FLOW;
+		if (sensor.index >= (tube ? network.tubeCount() : network.vesselCount()))
+		{
+			std::cout << "The scene has no " << (tube ? "tube " : "vessel ") << sensor.index << ", leaving out the sensor "
+				<< sensor.name << "." << std::endl;
+			continue;
+		}
+
+		// A sample spans a whole number of steps, at least one.
+		Group& group = groups[sensor.kind];
+		int period = sensor.rate > 0.0f ? std::max(1, (int)std::lround(physicsHz / sensor.rate)) : 1;
+		group.sensor.push_back(s);
+		group.handle.push_back(tube ? network.tubeHandle(sensor.index) : network.vesselHandle(sensor.index));
+		group.period.push_back(period);
+		group.remaining.push_back(period);
+		group.sum.push_back(0.0);
+		group.lowest.push_back(FLT_MAX);
+		group.highest.push_back(-FLT_MAX);
+		group.last.push_back(0.0f);
+		group.index.push_back(sensor.index);
+	}
+}
+
+bool SensorSet::open(const std::string& fileName)
+{
+	close();
+	file = fopen(fileName.c_str(), "w");
+	if (file == nullptr)
+	{
+		std::cout << "Can't create the sensor file " << fileName << std::endl;
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, SENSOR_FILE_BUFFER);
+	failed = fputs("step,time,sensor,value\n", file) < 0;
+	return true;
+}
+
+bool SensorSet::close()
+{
+	if (file == nullptr)
+	{
+		return true;
+	}
+	bool succeeded = !failed && fclose(file) == 0;
+	file = nullptr;
+	failed = false;
+	return succeeded;
+}
+
+void SensorSet::sample(const VesselNetwork& network, long long step)
+{
+	taken.clear();
+	for (int kind = 0; kind < SENSOR_KIND_COUNT; kind++)
+	{
+		Group& group = groups[kind];
+		int count = (int)group.sensor.size();
+		if (count == 0)
+		{
+			continue;
+		}
+
+		// Follow the handles first, so the loop below only reads arrays.
+		for (int k = 0; k < count; k++)
+		{
+			group.index[k] = kind == SENSOR_FLOW ? network.tubeIndex(group.handle[k]) : network.vesselIndex(group.handle[k]);
+		}
+
+		const float* source = kind == SENSOR_LEVEL ? network.height.data() : kind == SENSOR_PRESSURE ? network.pressure.data()
+			: network.tubeFlow.data();
+		const float* external = kind == SENSOR_PRESSURE ? network.externalPressure.data() : nullptr;
+		bool due = false;
+		for (int k = 0; k < count; k++)
+		{
+			int i = group.index[k];
+			if (i < 0)
+			{
+				continue;
+			}
+			float value = source[i] + (external != nullptr ? external[i] : 0.0f);
+			group.sum[k] += value;
+			group.lowest[k] = std::min(group.lowest[k], value);
+			group.highest[k] = std::max(group.highest[k], value);
+			group.last[k] = value;
+			due |= --group.remaining[k] == 0;
+		}
+		if (!due)
+		{
+			continue;
+		}
+
+		for (int k = 0; k < count; k++)
+		{
+			if (group.remaining[k] != 0)
+			{
+				continue;
+			}
+			int s = group.sensor[k];
+			float value = group.last[k];
+			switch (sensors[s].downsampling)
+			{
+			case SENSOR_MEAN: value = (float)(group.sum[k] / group.period[k]); break;
+			case SENSOR_MIN: value = group.lowest[k]; break;
+			case SENSOR_MAX: value = group.highest[k]; break;
+			default: break;
+			}
+			taken.push_back({ step, s, value });
+			newest[s].store(value, std::memory_order_relaxed);
+
+			group.remaining[k] = group.period[k];
+			group.sum[k] = 0.0;
+			group.lowest[k] = FLT_MAX;
+			group.highest[k] = -FLT_MAX;
+		}
+	}
+
+	if (file == nullptr || taken.empty())
+	{
+		return;
+	}
+	for (const SensorSample& sample : taken)
+	{
+		failed |= fprintf(file, "%lld,%.9g,%s,%.9g\n", sample.step, sample.step * stepSeconds, sensors[sample.sensor].name.c_str(),
+			sample.value) < 0;
+	}
+}
@@ -0,0 +1,166 @@
+/*
+Title: HydroDynamics
+File Name: Sensors.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Virtual sensors (--sensors FILE) that sample the level or the pressure of a vessel, or the
+flow through a tube, each at a rate of its own, so what a run writes grows with the number
+of sensors instead of the size of the network. A sensor file has one line per sensor with
+its name, what it measures, the vessel or tube, how many samples it takes per second and
+how it downsamples the steps in between; lines starting with # are comments:
+
+	# name		kind		index	rate	downsampling
+	inlet		level		0		10		mean		the mean level of vessel 0 over every 0.1 s
+	valve		flow		12		100		last		the flow through tube 12, 100 times a second
+	deep		pressure	40		1		max			the highest pressure on the floor of vessel 40 every second
+
+The rate is in samples per second of simulated time; 0 (or any rate at or above the physics
+rate) samples every step. The downsampling is mean (the default), last, min or max, over the
+steps since the sample before. A pressure is the one at the floor of the vessel, with the
+external pressure pushing on it, like the HUD shows.
+
+sample() runs once after every step. The sensors are kept as arrays grouped by what they
+measure, and each group is one loop that gathers its values from the arrays of the network
+and folds them into all four reductions at once, without branching on the downsampling.
+Only the sensors whose sample is due then produce one. The sensors hold Handles (see
+HandleTable.h), so they follow their vessels and tubes when others are added or removed,
+and one whose vessel or tube was removed stops sampling.
+
+The samples go to a CSV file (--sensor-output FILE) with one line per sample: the step, its
+time, the name of the sensor and the value. The newest sample of every sensor is also kept
+in an atomic, for readers on other threads like the metrics endpoint.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SENSORS_H
+#define _SENSORS_H
+
+#include "HandleTable.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct VesselNetwork;
+
+// What a sensor measures.
+enum SensorKind
+{
+	SENSOR_LEVEL = 0,
+	SENSOR_PRESSURE,
+	SENSOR_FLOW,
+	SENSOR_KIND_COUNT
+};
+
+// How a sensor turns the steps between two samples into one value.
+enum SensorDownsampling
+{
+	SENSOR_MEAN = 0,
+	SENSOR_LAST,
+	SENSOR_MIN,
+	SENSOR_MAX
+};
+
+struct SensorSample
+{
+	long long step;
+	int sensor;
+	float value;
+};
+
+class SensorSet
+{
+public:
+	SensorSet() {}
+	~SensorSet();
+
+	SensorSet(const SensorSet&) = delete;
+	SensorSet& operator=(const SensorSet&) = delete;
+
+	// Reads a sensor file. Returns false (after printing an error) if the file can't be read or a line isn't a sensor.
+	bool read(const std::string& fileName);
+
+	bool empty() const { return sensors.empty(); }
+	int count() const { return (int)sensors.size(); }
+	const std::vector<std::string>& names() const { return sensorNames; }
+
+	// Finds the vessels and tubes of the sensors in network and works out how many steps of physicsHz every sample spans. Sensors
+	// on vessels or tubes the network doesn't have are left out, with a warning. Call it again whenever the network is replaced;
+	// it starts every sensor over.
+	void bind(const VesselNetwork& network, double physicsHz);
+
+	// Creates the CSV file the samples go to. Returns false if it can't be created.
+	bool open(const std::string& fileName);
+
+	// Writes everything sampled so far and closes the file. Returns false if any write failed.
+	bool close();
+
+	// Folds the state of the network after step into every sensor and takes the samples that are due, which are then in samples()
+	// until the next call, and in the file if one is open.
+	void sample(const VesselNetwork& network, long long step);
+
+	const std::vector<SensorSample>& samples() const { return taken; }
+
+	// The newest sample of every sensor (0 before the first), which any thread may read while sample() runs. Created by read(), so
+	// it stays where it is from then on.
+	const std::atomic<float>* latest() const { return newest.get(); }
+
+private:
+	struct Sensor
+	{
+		std::string name;
+		SensorKind kind = SENSOR_LEVEL;
+		int index = 0;				// As the file names it
+		float rate = 0.0f;
+		SensorDownsampling downsampling = SENSOR_MEAN;
+	};
+
+	// The bound sensors that measure one kind of thing, as arrays. Every sensor keeps the sum, the lowest, the highest and the last
+	// value of the steps since its last sample, and counts down the steps to its next one.
+	struct Group
+	{
+		std::vector<int> sensor;		// Into sensors
+		std::vector<Handle> handle;
+		std::vector<int> period;		// Steps per sample
+		std::vector<int> remaining;
+		std::vector<double> sum;
+		std::vector<float> lowest;
+		std::vector<float> highest;
+		std::vector<float> last;
+		std::vector<int> index;			// Looked up from handle before every pass
+	};
+
+	std::vector<Sensor> sensors;
+	std::vector<std::string> sensorNames;
+	Group groups[SENSOR_KIND_COUNT];
+	std::unique_ptr<std::atomic<float>[]> newest;
+	std::vector<SensorSample> taken;
+	double stepSeconds = 0.0;
+
+	FILE* file = nullptr;
+	bool failed = false;
+};
+
+#endif // _SENSORS_H
@@ -0,0 +1,126 @@
+/*
+Title: HydroDynamics
+File Name: Settings.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The settings that can be changed while the program runs, from a settings file given with
+--config. It is plain text with one setting per line, "name = value", and lines starting
+with # are comments:
+
+	pressure_step = 0.1			how much Space and Left Shift push or pull on the piston
+	gamepad_pressure = 5		the pressure on the piston with the stick all the way up
+	window_width = 800			the size of the window
+	window_height = 800
+	density = 1.0				the fluid and the gravity, only read at the start
+	gravity = 9.8
+
+A setting that isn't in the file keeps its value from the command line (or its default).
+The window loop watches the file with a FileWatcher and reads it again whenever it changes.
+
+Readers never lock anything. The settings in use are an immutable snapshot, and settings()
+is one atomic load of the pointer to it. A reload builds a whole new snapshot and swaps the
+pointer, so a reader on another thread sees either all of the old settings or all of the
+new ones, never a mix. A replaced snapshot is never freed, since a reader may still be
+looking at it; a reload costs a few dozen bytes, and they only happen when someone edits the
+file.
+
+Only one thread may publish settings; in the application that is the main thread.
+*/
+
+#include "Settings.h"
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <sstream>
+
+// Every snapshot that was ever published, the one in use last. A deque never moves what it holds, so the pointers stay valid.
+static const Settings defaultSettings;
+static std::deque<Settings> published;
+static std::atomic<const Settings*> current(&defaultSettings);
+
+const Settings& settings()
+{
+	return *current.load(std::memory_order_acquire);
+}
+
+void publishSettings(const Settings& settings)
+{
+	published.push_back(settings);
+	current.store(&published.back(), std::memory_order_release);
+}
+
+bool parseSettings(const std::string& text, const std::string& fileName, const Settings& base, Settings& settings)
+{
+	Settings parsed = base;
+	std::istringstream lines(text);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(lines, line))
+	{
+		lineNumber++;
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+		{
+			continue;
+		}
+
+		size_t equals = line.find('=');
+		std::istringstream name(line.substr(0, equals == std::string::npos ? 0 : equals));
+		std::istringstream value(equals == std::string::npos ? std::string() : line.substr(equals + 1));
+		std::string key, rest;
+		float number = 0.0f;
+		if (!(name >> key) || (name >> rest) || !(value >> number) || (value >> rest))
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a setting: " << line << std::endl;
+			return false;
+		}
+
+		bool positive = number > 0.0f;
+		if (key == "pressure_step")
+			parsed.pressureStep = number;
+		else if (key == "gamepad_pressure")
+			parsed.gamepadPressure = number;
+		else if (key == "window_width")
+			parsed.windowWidth = (int)number;
+		else if (key == "window_height")
+			parsed.windowHeight = (int)number;
+		else if (key == "density")
+			parsed.density = number;
+		else if (key == "gravity")
+			parsed.gravity = number;
+		else
+		{
+			std::cout << fileName << " line " << lineNumber << ": unknown setting " << key << ", expected pressure_step, gamepad_pressure, "
+				"window_width, window_height, density or gravity" << std::endl;
+			return false;
+		}
+		if (!positive || ((key == "window_width" || key == "window_height") && number < 1.0f))
+		{
+			std::cout << fileName << " line " << lineNumber << ": " << key << " has to be positive." << std::endl;
+			return false;
+		}
+	}
+
+	settings = parsed;
+	return true;
+}
@@ -0,0 +1,76 @@
+/*
+Title: HydroDynamics
+File Name: Settings.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The settings that can be changed while the program runs, from a settings file given with
+--config. It is plain text with one setting per line, "name = value", and lines starting
+with # are comments:
+
+	pressure_step = 0.1			how much Space and Left Shift push or pull on the piston
+	gamepad_pressure = 5		the pressure on the piston with the stick all the way up
+	window_width = 800			the size of the window
+	window_height = 800
+	density = 1.0				the fluid and the gravity, only read at the start
+	gravity = 9.8
+
+A setting that isn't in the file keeps its value from the command line (or its default).
+The window loop watches the file with a FileWatcher and reads it again whenever it changes.
+
+Readers never lock anything. The settings in use are an immutable snapshot, and settings()
+is one atomic load of the pointer to it. A reload builds a whole new snapshot and swaps the
+pointer, so a reader on another thread sees either all of the old settings or all of the
+new ones, never a mix. A replaced snapshot is never freed, since a reader may still be
+looking at it; a reload costs a few dozen bytes, and they only happen when someone edits the
+file.
+
+Only one thread may publish settings; in the application that is the main thread.
+*/
+
+#ifndef _SETTINGS_H
+#define _SETTINGS_H
+
+#include <string>
+
+struct Settings
+{
+	float pressureStep = 0.1f;
+	float gamepadPressure = 5.0f;
+	int windowWidth = 800;
+	int windowHeight = 800;
+	float density = 1.0f;
+	float gravity = 9.8f;
+};
+
+// The snapshot in use. The reference stays valid until the program exits, but a later publishSettings() doesn't change what it
+// refers to, so readers that want to follow a reload call this again instead of keeping it.
+const Settings& settings();
+
+// Makes a copy of settings the snapshot in use.
+void publishSettings(const Settings& settings);
+
+// Reads the settings in text, a settings file read from fileName (which is only used in messages), on top of base. Returns false
+// and leaves settings alone if a line can't be read or a value makes no sense.
+bool parseSettings(const std::string& text, const std::string& fileName, const Settings& base, Settings& settings);
+
+#endif // _SETTINGS_H
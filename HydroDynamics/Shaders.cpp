@@ -0,0 +1,672 @@
+/*
+Title: HydroDynamics
+File Name: Shaders.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Loading, compiling and linking of shaders, plus an on-disk cache of linked programs.
+
+Compiling GLSL from text on every launch is slow on some drivers. After a program is
+linked for the first time, its binary is saved with glGetProgramBinary. On the next
+launch, if the sources and the driver are the same, the binary is handed straight back
+to the driver with glProgramBinary and no compiling happens at all. The cache file is
+keyed by a hash of both sources and the vendor, renderer and version strings of the
+driver; anything that doesn't match (or that the driver refuses) falls back to compiling.
+*/
+
+#include "Shaders.h"
+#include "GLDebug.h"
+#include "GLState.h"
+#include "MemoryTracker.h"
+#include "TracyZones.h"
+#include <cstdio>
+#include <sys/stat.h>
+#include <sstream>
+#include <iomanip>
+
+// Written at the start of every cache file, so a file from a different version of this code is never loaded.
+#define SHADER_CACHE_MAGIC 0x48594443u	// "HYDC"
+#define SHADER_CACHE_VERSION 1
+
+// Creates a shader and starts compiling it, without waiting for the result. Asking for the status is what waits, which
+// finishShader() does.
+static GLuint startShader(std::string_view sourceCode, GLenum shaderType)
+{
+	// glCreateShader, creates a shader given a type (such as GL_VERTEX_SHADER) and returns a GLuint reference to that shader.
+	GLuint shader = glCreateShader(shaderType);
+	// We establish a pointer to our shader code and get its size. The code doesn't have to end in a null character, since we pass the size
+	// along, which is what lets us hand over a view straight into a mapped file.
+	const char *shader_code_ptr = sourceCode.data();
+	const int shader_code_size = (int)sourceCode.size();
+
+	// glShaderSource replaces the source code in a shader object
+	// It takes the reference to the shader (a GLuint), a count of the number of elements in the string array (in case you're passing in multiple strings), a pointer to the string array 
+	// that contains your source code, and a size variable determining the length of the array.
+	glShaderSource(shader, 1, &shader_code_ptr, &shader_code_size);
+	GL_CHECK(glCompileShader(shader)); // This just compiles the shader, given the source code.
+	return shader;
+}
+
+// startShader() for SPIR-V: hands the module to the driver and specializes its main. Only the SPIR-V of Python/compile_spirv.py is
+// passed, which has no specialization constants.
+static GLuint startSpirvShader(std::string_view binary, GLenum shaderType)
+{
+	GLuint shader = glCreateShader(shaderType);
+	glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, binary.data(), (GLsizei)binary.size());
+	GL_CHECK(glSpecializeShaderARB(shader, "main", 0, nullptr, nullptr));
+	return shader;
+}
+
+// Waits for a shader startShader() began. If it failed to compile, prints the error log, deletes it and sets it to 0.
+static bool finishShader(GLuint& shader)
+{
+	GLint isCompiled = 0;
+
+	// Check the compile status to see if the shader compiled correctly.
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+
+	if (isCompiled == GL_FALSE)
+	{
+		char infolog[1024];
+		glGetShaderInfoLog(shader, 1024, NULL, infolog);
+
+		// Print the compile error.
+		std::cout << "The shader failed to compile with the error:" << std::endl << infolog << std::endl;
+
+		// Provide the infolog in whatever manor you deem best.
+		// Exit with failure.
+		glDeleteShader(shader); // Don't leak the shader.
+		shader = 0;
+
+		// NOTE: I almost always put a break point here, so that instead of the program continuing with a deleted/failed shader, it stops and gives me a chance to look at what may 
+		// have gone wrong. You can check the console output to see what the error was, and usually that will point you in the right direction.
+		return false;
+	}
+	return true;
+}
+
+// This method will consolidate some of the shader code we've written to return a GLuint to the compiled shader.
+// It only requires the shader source code and the shader type.
+GLuint createShader(std::string_view sourceCode, GLenum shaderType)
+{
+	TRACY_ZONE("createShader");
+	GLuint shader = startShader(sourceCode, shaderType);
+	finishShader(shader);
+	return shader;
+}
+
+// Links a vertex and fragment shader into a program and returns the reference to it, or 0 if linking failed.
+GLuint createProgram(GLuint vertexShader, GLuint fragmentShader)
+{
+	GLuint shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, vertexShader);
+	glAttachShader(shaderProgram, fragmentShader);
+	GL_CHECK(glLinkProgram(shaderProgram));
+
+	GLint isLinked = 0;
+
+	// Check the link status the same way we check the compile status of a shader.
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
+
+	if (isLinked == GL_FALSE)
+	{
+		char infolog[1024];
+		glGetProgramInfoLog(shaderProgram, 1024, NULL, infolog);
+
+		// Print the link error.
+		std::cout << "The shader program failed to link with the error:" << std::endl << infolog << std::endl;
+
+		cachedDeleteProgram(shaderProgram); // Don't leak the program.
+		return 0;
+	}
+
+	return shaderProgram;
+}
+
+GLuint createComputeProgram(GLuint computeShader)
+{
+	GLuint shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, computeShader);
+	GL_CHECK(glLinkProgram(shaderProgram));
+
+	GLint isLinked = 0;
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
+	if (isLinked == GL_FALSE)
+	{
+		char infolog[1024];
+		glGetProgramInfoLog(shaderProgram, 1024, NULL, infolog);
+		std::cout << "The compute program failed to link with the error:" << std::endl << infolog << std::endl;
+
+		cachedDeleteProgram(shaderProgram);
+		return 0;
+	}
+
+	return shaderProgram;
+}
+
+GLuint createFeedbackProgram(GLuint vertexShader, const char* const* varyings, int count)
+{
+	// The varyings have to be named before linking, since they decide how the program is laid out.
+	GLuint shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, vertexShader);
+	glTransformFeedbackVaryings(shaderProgram, count, varyings, GL_INTERLEAVED_ATTRIBS);
+	GL_CHECK(glLinkProgram(shaderProgram));
+
+	GLint isLinked = 0;
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
+	if (isLinked == GL_FALSE)
+	{
+		char infolog[1024];
+		glGetProgramInfoLog(shaderProgram, 1024, NULL, infolog);
+		std::cout << "The transform feedback program failed to link with the error:" << std::endl << infolog << std::endl;
+
+		cachedDeleteProgram(shaderProgram);
+		return 0;
+	}
+
+	return shaderProgram;
+}
+
+unsigned long long hashString(std::string_view text, unsigned long long hash)
+{
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// The directory of file, with its separator at the end, or nothing if it has none.
+static std::string directoryOf(const std::string& file)
+{
+	size_t slash = file.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : file.substr(0, slash + 1);
+}
+
+// Appends source to out line by line, with the files it includes in place of their #include. included lists the files seen so far,
+// the source number of a file is where it is in there. #line directives keep the line numbers of the errors right.
+static bool expandShader(std::string_view source, const std::string& file, const std::vector<std::string>& defines,
+	std::vector<std::string>& included, std::string& out)
+{
+	int sourceNumber = (int)included.size() - 1;
+	int line = 0;
+	size_t start = 0;
+	bool inComment = false;
+	while (start < source.size())
+	{
+		size_t end = std::min(source.find('\n', start), source.size());
+		std::string_view text = source.substr(start, end - start);
+		start = end + 1;
+		line++;
+
+		// A line that starts inside a comment is no directive, like the #include the license header of a file might talk about.
+		size_t first = text.find_first_not_of(" \t");
+		std::string_view directive = inComment || first == std::string_view::npos ? std::string_view() : text.substr(first);
+		for (size_t i = 0; i + 1 < text.size(); i++)
+		{
+			if (!inComment && text[i] == '/' && text[i + 1] == '/')
+			{
+				break;
+			}
+			if (text[i] == (inComment ? '*' : '/') && text[i + 1] == (inComment ? '/' : '*'))
+			{
+				inComment = !inComment;
+				i++;
+			}
+		}
+
+		if (directive.compare(0, 8, "#include") == 0)
+		{
+			size_t open = directive.find('"');
+			size_t close = open == std::string_view::npos ? open : directive.find('"', open + 1);
+			if (close == std::string_view::npos)
+			{
+				std::cout << file << "(" << line << "): #include needs the name of a file in quotes." << std::endl;
+				return false;
+			}
+			std::string name = directoryOf(file) + std::string(directive.substr(open + 1, close - open - 1));
+			if (std::find(included.begin(), included.end(), name) == included.end())
+			{
+				MappedFile include;
+				if (!include.open(name.c_str()))
+				{
+					std::cout << file << "(" << line << "): can't include " << name << "." << std::endl;
+					return false;
+				}
+				included.push_back(name);
+				out += "#line 1 " + std::to_string(included.size() - 1) + "\n";
+				if (!expandShader(include.view(), name, {}, included, out))
+				{
+					return false;
+				}
+			}
+			out += "#line " + std::to_string(line + 1) + " " + std::to_string(sourceNumber) + "\n";
+			continue;
+		}
+
+		out.append(text.data(), text.size());
+		out += '\n';
+		if (!defines.empty() && directive.compare(0, 8, "#version") == 0)
+		{
+			for (const std::string& name : defines)
+			{
+				out += "#define " + name + "\n";
+			}
+			out += "#line " + std::to_string(line + 1) + " " + std::to_string(sourceNumber) + "\n";
+		}
+	}
+	return true;
+}
+
+bool preprocessShader(std::string_view source, const std::string& file, const std::vector<std::string>& defines, std::string& out,
+	std::vector<std::string>* files)
+{
+	out.clear();
+	out.reserve(source.size() + 256);
+	std::vector<std::string> included = { file };
+	bool expanded = expandShader(source, file, defines, included, out);
+	if (files != nullptr)
+	{
+		files->swap(included);
+	}
+	return expanded;
+}
+
+std::string spirvFile(const std::string& file, const std::vector<std::string>& defines)
+{
+	size_t dot = file.rfind('.');
+	std::string name = dot == std::string::npos || dot < file.find_last_of("/\\") + 1 ? file : file.substr(0, dot);
+	for (const std::string& define : defines)
+	{
+		name += "." + define;
+	}
+	return name + ".spv";
+}
+
+// The modification time of a file in seconds, or -1 if it doesn't exist.
+static long long modifiedTime(const std::string& file)
+{
+	struct stat info;
+	if (stat(file.c_str(), &info) != 0)
+	{
+		return -1;
+	}
+	return (long long)info.st_mtime;
+}
+
+// The header at the start of a cache file. The binary itself follows right after it.
+struct ShaderCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	GLenum format;
+	GLint length;
+};
+
+// The key covers both sources and the driver, since a binary is only valid for the exact driver that produced it.
+static unsigned long long programCacheKey(std::string_view vertexSource, std::string_view fragmentSource)
+{
+	unsigned long long key = hashString(vertexSource);
+	key = hashString(fragmentSource, key);
+	key = hashString((const char*)glGetString(GL_VENDOR), key);
+	key = hashString((const char*)glGetString(GL_RENDERER), key);
+	key = hashString((const char*)glGetString(GL_VERSION), key);
+	return key;
+}
+
+static std::string programCacheFile(unsigned long long key)
+{
+	std::ostringstream name;
+	name << "ShaderCache_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return name.str();
+}
+
+// Tries to create a program from a cache file. Returns 0 if there is no usable binary.
+static GLuint loadProgramBinary(unsigned long long key)
+{
+	FILE* file = fopen(programCacheFile(key).c_str(), "rb");
+	if (file == nullptr)
+	{
+		return 0;
+	}
+
+	ShaderCacheHeader header;
+	std::vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& header.magic == SHADER_CACHE_MAGIC && header.version == SHADER_CACHE_VERSION && header.key == key && header.length > 0;
+	if (valid)
+	{
+		binary.resize(header.length);
+		valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+
+	if (!valid)
+	{
+		return 0;
+	}
+
+	GLuint shaderProgram = glCreateProgram();
+	glProgramBinary(shaderProgram, header.format, binary.data(), header.length);
+
+	// The driver is allowed to refuse a binary (after an update, for example), in which case we compile as normal.
+	GLint isLinked = 0;
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
+	if (isLinked == GL_FALSE)
+	{
+		cachedDeleteProgram(shaderProgram);
+		return 0;
+	}
+	return shaderProgram;
+}
+
+static void saveProgramBinary(GLuint shaderProgram, unsigned long long key)
+{
+	GLint length = 0;
+	glGetProgramiv(shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	ShaderCacheHeader header;
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+	header.format = 0;
+	header.length = 0;
+
+	std::vector<char> binary(length);
+	glGetProgramBinary(shaderProgram, length, &header.length, &header.format, binary.data());
+
+	FILE* file = fopen(programCacheFile(key).c_str(), "wb");
+	if (file == nullptr)
+	{
+		// Not being able to write the cache is not an error, it just means the next launch compiles again.
+		return;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(binary.data(), 1, header.length, file);
+	fclose(file);
+}
+
+// Lets a driver with ARB_parallel_shader_compile compile on as many threads as it likes. Without it, drivers pick on their own.
+static void allowParallelCompile()
+{
+#ifdef GL_ARB_parallel_shader_compile
+	if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+	}
+#endif
+}
+
+void loadProgramsCached(std::vector<ProgramSources>& programs)
+{
+	TRACY_ZONE("loadProgramsCached");
+	MEMORY_SCOPE(MEMORY_SHADERS);
+
+	// Program binaries are core in 4.1, and available on 4.0 drivers through the extension.
+	bool binariesSupported = GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+
+	std::vector<unsigned long long> keys(programs.size(), 0);
+	std::vector<size_t> compiling;
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		ProgramSources& sources = programs[i];
+		sources.program = 0;
+		sources.vertexShader = 0;
+		sources.fragmentShader = 0;
+		if (binariesSupported)
+		{
+			keys[i] = programCacheKey(sources.vertex, sources.fragment);
+			sources.program = loadProgramBinary(keys[i]);
+		}
+		if (sources.program == 0)
+		{
+			compiling.push_back(i);
+		}
+	}
+	if (compiling.empty())
+	{
+		return;
+	}
+
+	// Everything is started before anything is waited for, so the compiles and links of all the programs can overlap. The first
+	// pass takes the SPIR-V of the programs that have it, the second compiles the GLSL of those whose SPIR-V the driver refused.
+	allowParallelCompile();
+	bool spirvSupported = GLEW_ARB_gl_spirv != 0;
+	for (int pass = 0; pass < 2 && !compiling.empty(); pass++)
+	{
+		std::vector<bool> fromSpirv(programs.size(), false);
+		for (size_t i : compiling)
+		{
+			ProgramSources& sources = programs[i];
+			fromSpirv[i] = pass == 0 && spirvSupported && !sources.vertexSpirv.empty() && !sources.fragmentSpirv.empty();
+			if (fromSpirv[i])
+			{
+				sources.vertexShader = startSpirvShader(sources.vertexSpirv, GL_VERTEX_SHADER);
+				sources.fragmentShader = startSpirvShader(sources.fragmentSpirv, GL_FRAGMENT_SHADER);
+			}
+			else
+			{
+				sources.vertexShader = startShader(sources.vertex, GL_VERTEX_SHADER);
+				sources.fragmentShader = startShader(sources.fragment, GL_FRAGMENT_SHADER);
+			}
+		}
+		for (size_t i : compiling)
+		{
+			GLuint shaderProgram = glCreateProgram();
+			glAttachShader(shaderProgram, programs[i].vertexShader);
+			glAttachShader(shaderProgram, programs[i].fragmentShader);
+
+			// Tell the driver we want to read the binary back, so it keeps it around after linking.
+			if (binariesSupported)
+			{
+				glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+			GL_CHECK(glLinkProgram(shaderProgram));
+			programs[i].program = shaderProgram;
+		}
+
+		std::vector<size_t> refused;
+		for (size_t i : compiling)
+		{
+			ProgramSources& sources = programs[i];
+			bool compiled = finishShader(sources.vertexShader);
+			compiled = finishShader(sources.fragmentShader) && compiled;
+			GLint isLinked = 0;
+			if (compiled)
+			{
+				glGetProgramiv(sources.program, GL_LINK_STATUS, &isLinked);
+			}
+			if (compiled && isLinked == GL_FALSE)
+			{
+				char infolog[1024];
+				glGetProgramInfoLog(sources.program, 1024, NULL, infolog);
+				std::cout << "The shader program failed to link with the error:" << std::endl << infolog << std::endl;
+			}
+			if (isLinked == GL_FALSE)
+			{
+				cachedDeleteProgram(sources.program);
+				sources.program = 0;
+				if (fromSpirv[i])
+				{
+					std::cout << "The driver refused the SPIR-V of a program, compiling its GLSL instead." << std::endl;
+					glDeleteShader(sources.vertexShader);
+					glDeleteShader(sources.fragmentShader);
+					refused.push_back(i);
+				}
+				continue;
+			}
+
+			if (binariesSupported)
+			{
+				saveProgramBinary(sources.program, keys[i]);
+			}
+		}
+		compiling.swap(refused);
+	}
+}
+
+GLuint loadProgramCached(std::string_view vertexSource, std::string_view fragmentSource, GLuint& vertexShader, GLuint& fragmentShader)
+{
+	std::vector<ProgramSources> programs(1);
+	programs[0].vertex = vertexSource;
+	programs[0].fragment = fragmentSource;
+	loadProgramsCached(programs);
+	vertexShader = programs[0].vertexShader;
+	fragmentShader = programs[0].fragmentShader;
+	return programs[0].program;
+}
+
+GLuint loadProgramFiles(const char* vertexFile, const char* fragmentFile, GLuint& vertexShader, GLuint& fragmentShader)
+{
+	TRACY_ZONE("loadProgramFiles");
+	MEMORY_SCOPE(MEMORY_SHADERS);
+	vertexShader = 0;
+	fragmentShader = 0;
+
+	// The files only stay mapped until they are preprocessed, for the duration of this call.
+	MappedFile vertexFileData;
+	MappedFile fragmentFileData;
+	if (!vertexFileData.open(vertexFile) || !fragmentFileData.open(fragmentFile))
+	{
+		return 0;
+	}
+	std::vector<ProgramSources> programs(1);
+	if (!preprocessShader(vertexFileData.view(), vertexFile, {}, programs[0].vertex)
+		|| !preprocessShader(fragmentFileData.view(), fragmentFile, {}, programs[0].fragment))
+	{
+		return 0;
+	}
+	loadProgramsCached(programs);
+	vertexShader = programs[0].vertexShader;
+	fragmentShader = programs[0].fragmentShader;
+	return programs[0].program;
+}
+
+void loadProgramVariantsAsync(AssetLoader& loader, const std::vector<ProgramVariant>& variants, std::function<void()> then)
+{
+	// Where the files of a variant are in the job, and when its SPIR-V was written (-1 if it has none).
+	struct VariantFiles
+	{
+		size_t source[2];
+		size_t spirv[2] = {};
+		long long spirvTime = -1;
+	};
+
+	// Every file is read once, however many variants are built from it. The SPIR-V is only read if it is there, so a missing one
+	// doesn't fail the sources along with it.
+	std::vector<std::string> files;
+	std::vector<VariantFiles> fileOf(variants.size());
+	auto add = [&files](const std::string& name)
+	{
+		size_t index = std::find(files.begin(), files.end(), name) - files.begin();
+		if (index == files.size())
+		{
+			files.push_back(name);
+		}
+		return index;
+	};
+	for (size_t i = 0; i < variants.size(); i++)
+	{
+		const ProgramVariant& variant = variants[i];
+		fileOf[i].source[0] = add(variant.vertexFile);
+		fileOf[i].source[1] = add(variant.fragmentFile);
+		if (variant.spirv)
+		{
+			std::string vertexSpirv = spirvFile(variant.vertexFile, variant.defines);
+			std::string fragmentSpirv = spirvFile(variant.fragmentFile, variant.defines);
+			long long vertexTime = modifiedTime(vertexSpirv);
+			long long fragmentTime = modifiedTime(fragmentSpirv);
+			if (vertexTime >= 0 && fragmentTime >= 0)
+			{
+				fileOf[i].spirv[0] = add(vertexSpirv);
+				fileOf[i].spirv[1] = add(fragmentSpirv);
+				fileOf[i].spirvTime = std::min(vertexTime, fragmentTime);
+			}
+		}
+	}
+
+	loader.load(files, [variants, files, fileOf, then](const LoadedFiles& loaded)
+	{
+		MEMORY_SCOPE(MEMORY_SHADERS);
+		std::vector<ProgramSources> programs;
+		std::vector<size_t> built;
+		for (size_t i = 0; i < variants.size(); i++)
+		{
+			const ProgramVariant& variant = variants[i];
+			*variant.program = 0;
+			*variant.vertexShader = 0;
+			*variant.fragmentShader = 0;
+			const VariantFiles& where = fileOf[i];
+			ProgramSources sources;
+			std::vector<std::string> vertexFiles;
+			std::vector<std::string> fragmentFiles;
+			if (!loaded.read || !preprocessShader(loaded.contents[where.source[0]], files[where.source[0]], variant.defines, sources.vertex, &vertexFiles)
+				|| !preprocessShader(loaded.contents[where.source[1]], files[where.source[1]], variant.defines, sources.fragment, &fragmentFiles))
+			{
+				continue;
+			}
+
+			// SPIR-V that is older than any of the files its GLSL comes from was made from sources that changed since.
+			bool current = where.spirvTime >= 0;
+			vertexFiles.insert(vertexFiles.end(), fragmentFiles.begin(), fragmentFiles.end());
+			for (const std::string& file : vertexFiles)
+			{
+				current = current && modifiedTime(file) <= where.spirvTime;
+			}
+			if (current)
+			{
+				sources.vertexSpirv = loaded.contents[where.spirv[0]];
+				sources.fragmentSpirv = loaded.contents[where.spirv[1]];
+			}
+			else if (where.spirvTime >= 0)
+			{
+				std::cout << "The SPIR-V of " << files[where.source[0]] << " is older than its sources, run Python/compile_spirv.py again." << std::endl;
+			}
+			programs.push_back(std::move(sources));
+			built.push_back(i);
+		}
+
+		loadProgramsCached(programs);
+		for (size_t k = 0; k < built.size(); k++)
+		{
+			const ProgramVariant& variant = variants[built[k]];
+			*variant.program = programs[k].program;
+			*variant.vertexShader = programs[k].vertexShader;
+			*variant.fragmentShader = programs[k].fragmentShader;
+		}
+		if (then)
+		{
+			then();
+		}
+	});
+}
+
+void loadProgramFilesAsync(AssetLoader& loader, const char* vertexFile, const char* fragmentFile, GLuint& program, GLuint& vertexShader,
+	GLuint& fragmentShader, std::function<void()> then)
+{
+	loadProgramVariantsAsync(loader, { { vertexFile, fragmentFile, {}, &program, &vertexShader, &fragmentShader } }, then);
+}
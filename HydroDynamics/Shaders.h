@@ -0,0 +1,137 @@
+/*
+Title: HydroDynamics
+File Name: Shaders.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Loading (through MappedFile, or in the background through an AssetLoader), compiling and linking of shaders, plus an
+on-disk cache of linked programs.
+
+Compiling GLSL from text on every launch is slow on some drivers. After a program is
+linked for the first time, its binary is saved with glGetProgramBinary. On the next
+launch, if the sources and the driver are the same, the binary is handed straight back
+to the driver with glProgramBinary and no compiling happens at all. The cache file is
+keyed by a hash of both sources and the vendor, renderer and version strings of the
+driver; anything that doesn't match (or that the driver refuses) falls back to compiling.
+
+The shader files go through a small preprocessor before the driver sees them. It expands
+#include "file" (found next to the file that includes it, and included once however often
+it is named), and defines the names a permutation asks for right after the #version line,
+so one file can be built as several variants with #ifdef. The cache key is taken from what
+the preprocessor made, so every variant has a binary of its own. Errors in an included file
+are reported as source 1, 2, ... in the order the files were included, the file itself is 0.
+
+The programs needed at the start are built together: every shader of every program that
+isn't in the cache is compiled and every program linked before the status of any of them is
+asked for, which lets a driver that compiles on threads of its own (and every driver with
+ARB_parallel_shader_compile) work on all of them at once instead of one after the other.
+
+Parsing the GLSL is most of that time on some drivers, and how long it takes differs from
+one driver to the next. Python/compile_spirv.py compiles the variants of the scene shaders
+to SPIR-V ahead of time, into files next to the sources (see spirvFile()). Where the driver
+has ARB_gl_spirv, those are handed to it with glShaderBinary and glSpecializeShaderARB,
+and only the SPIR-V is checked and turned into code, never parsed. The SPIR-V is only used
+while it is newer than every file its GLSL was made from, and the GLSL is compiled instead
+whenever there is none or the driver refuses it. Names don't have to survive in SPIR-V, so
+the shaders built this way take their bindings from the file (the script assigns them) and
+never need a uniform looked up by name.
+*/
+
+#ifndef _SHADERS_H
+#define _SHADERS_H
+
+#include "GLIncludes.h"
+#include "MappedFile.h"
+#include "AssetLoader.h"
+
+// Compiles a shader of the given type. Prints the error log and returns 0 if compiling fails.
+GLuint createShader(std::string_view sourceCode, GLenum shaderType);
+
+// Links a vertex and fragment shader into a program and returns the reference to it, or 0 if linking failed.
+GLuint createProgram(GLuint vertexShader, GLuint fragmentShader);
+
+// Links a compute shader into a program on its own, or returns 0 if linking failed.
+GLuint createComputeProgram(GLuint computeShader);
+
+// Links a vertex shader on its own into a program whose count varyings are captured with transform feedback, interleaved in one
+// buffer in the order given. Returns 0 if linking failed.
+GLuint createFeedbackProgram(GLuint vertexShader, const char* const* varyings, int count);
+
+// Expands the #includes of source, which was read from file, into out, and defines every name of defines after its #version line.
+// If files is given, it gets every file that was read, file first. Prints the file and line and returns false if an included file
+// can't be read.
+bool preprocessShader(std::string_view source, const std::string& file, const std::vector<std::string>& defines, std::string& out,
+	std::vector<std::string>* files = nullptr);
+
+// Where Python/compile_spirv.py writes the SPIR-V of file built with defines: next to it, with the defines in the name, so
+// ../Assets/VertexShader.glsl with INSTANCED is ../Assets/VertexShader.INSTANCED.spv.
+std::string spirvFile(const std::string& file, const std::vector<std::string>& defines);
+
+// Returns a linked program for the two preprocessed sources, from the cache if possible. If it had to be compiled, the compiled shaders are
+// returned in vertexShader and fragmentShader (otherwise they are 0), and the binary is saved for next time.
+GLuint loadProgramCached(std::string_view vertexSource, std::string_view fragmentSource, GLuint& vertexShader, GLuint& fragmentShader);
+
+// The sources of a program to link with loadProgramsCached(), and what came of it. program is 0 if it failed.
+struct ProgramSources
+{
+	std::string vertex;
+	std::string fragment;
+	std::string vertexSpirv;	// The SPIR-V of both, tried before the GLSL if it's there and the driver takes SPIR-V
+	std::string fragmentSpirv;
+	GLuint program = 0;
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+};
+
+// loadProgramCached() for several programs at once, which compiles and links all of the ones that aren't cached side by side.
+void loadProgramsCached(std::vector<ProgramSources>& programs);
+
+// Maps the two shader files into memory, preprocesses them and passes them to loadProgramCached(). Returns 0 if a file can't be read.
+GLuint loadProgramFiles(const char* vertexFile, const char* fragmentFile, GLuint& vertexShader, GLuint& fragmentShader);
+
+// One permutation of a program: the two files built with a set of defines, and where the program and its shaders go.
+struct ProgramVariant
+{
+	const char* vertexFile;
+	const char* fragmentFile;
+	std::vector<std::string> defines;
+	GLuint* program;
+	GLuint* vertexShader;
+	GLuint* fragmentShader;
+	bool spirv = false;		// Whether Python/compile_spirv.py builds it, so its SPIR-V is looked for
+};
+
+// Reads the files of all the variants on the loader thread, and builds them together with loadProgramsCached() in the loader's
+// finishLoads(), then calls then. The programs stay 0 if a file can't be read. Everything the variants point at has to outlive
+// the load.
+void loadProgramVariantsAsync(AssetLoader& loader, const std::vector<ProgramVariant>& variants, std::function<void()> then = nullptr);
+
+// loadProgramFiles() with the files read on the loader thread. The program and its shaders are written once it is linked, in the loader's
+// finishLoads() (so on the thread that owns the context), and then is called after that. They stay 0 if a file can't be read.
+// All of the references have to outlive the load.
+void loadProgramFilesAsync(AssetLoader& loader, const char* vertexFile, const char* fragmentFile, GLuint& program, GLuint& vertexShader,
+	GLuint& fragmentShader, std::function<void()> then = nullptr);
+
+// A 64 bit FNV-1a hash, continuing from a previous hash so several strings can be combined.
+unsigned long long hashString(std::string_view text, unsigned long long hash = 14695981039346656037ULL);
+
+#endif // _SHADERS_H
@@ -0,0 +1,333 @@
+/*
+Title: HydroDynamics
+File Name: ShallowWater.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Lets the surface of wide vessels slosh. A VesselNetwork keeps a single flat level per
+vessel, which is fine for a narrow vessel but makes a wide tank look like a piston. Here
+every vessel at least SHALLOW_WATER_MIN_WIDTH wide gets a profile across its width: a row
+of cells with a depth and a discharge (depth times velocity) each, stepped with the 1D
+shallow water equations. Those are the cheapest model that has real surface waves: the
+fluid is assumed to move the same all the way down, so a cell only knows how deep it is
+and how fast it moves, and a row costs what one row of the grid would cost.
+
+The cells are stepped with a finite volume scheme: the Rusanov flux across every face
+between two cells (a SIMD kernel, see SimdKernels.h), and the walls at both ends, which
+nothing crosses. Friction at the floor slowly takes the energy out of the waves.
+
+The profiles are coupled to the tubes through the network. A tube feels the pressure of
+the cell at the end of the profile its tube comes in at (the side facing the other
+vessel), and the volume it moves goes into or out of that cell, so whatever flows out
+through the floor pulls the surface down there first and the wave that makes carries it
+across the vessel. Between steps the network holds the average level of every profile, so
+the output, the piston and everything else that reads the network see a flat level as
+before.
+
+This file has no OpenGL dependency.
+*/
+
+#include "ShallowWater.h"
+#include "VesselNetwork.h"
+#include "SimdKernels.h"
+#include "TaskPool.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// Fewer profiles than this are stepped on one thread.
+#define SHALLOW_WATER_PARALLEL_MIN 8
+
+bool ShallowWater::build(const VesselNetwork& network, int cells, float minWidth)
+{
+	vessels.clear();
+	cellWidth.clear();
+	start.assign(1, 0);
+	mouthCells.clear();
+	depth.clear();
+	discharge.clear();
+	profileOf.assign(network.vesselCount(), -1);
+
+	cells = std::max(cells, 2);
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		if (network.width[i] < minWidth)
+		{
+			continue;
+		}
+		profileOf[i] = (int)vessels.size();
+		vessels.push_back(i);
+		cellWidth.push_back(network.width[i] / cells);
+		mouthCells.push_back(std::min(std::max((int)std::lround(SHALLOW_WATER_MOUTH_WIDTH / cellWidth.back()), 1), cells));
+		depth.insert(depth.end(), cells, network.height[i]);
+		discharge.insert(discharge.end(), cells, 0.0f);
+		start.push_back((int)depth.size());
+	}
+	if (vessels.empty())
+	{
+		std::cout << "No vessel is at least " << minWidth << " wide, so none of them gets a shallow water profile." << std::endl;
+		return false;
+	}
+
+	// A tube comes in at the side of a vessel that faces the vessel at its other end.
+	int tubes = network.tubeCount();
+	mouthA.assign(tubes, -1);
+	mouthB.assign(tubes, -1);
+	for (int t = 0; t < tubes; t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		float centerA = network.left[a] + 0.5f * network.width[a];
+		float centerB = network.left[b] + 0.5f * network.width[b];
+		if (profileOf[a] >= 0)
+		{
+			mouthA[t] = centerB < centerA ? start[profileOf[a]] : start[profileOf[a] + 1] - 1;
+		}
+		if (profileOf[b] >= 0)
+		{
+			mouthB[t] = centerA < centerB ? start[profileOf[b]] : start[profileOf[b] + 1] - 1;
+		}
+	}
+
+	mouthCount.assign(vessels.size(), 0);
+	for (int t = 0; t < tubes; t++)
+	{
+		if (mouthA[t] >= 0)
+		{
+			mouthCount[profileOf[network.tubeA[t]]]++;
+		}
+		if (mouthB[t] >= 0)
+		{
+			mouthCount[profileOf[network.tubeB[t]]]++;
+		}
+	}
+	mouthDepth.assign(vessels.size(), 0.0f);
+	depthFlux.assign(depth.size(), 0.0f);
+	dischargeFlux.assign(depth.size(), 0.0f);
+	fastest.assign(vessels.size(), 0.0f);
+	lastSubsteps = 0;
+	return true;
+}
+
+int ShallowWater::stepProfile(int p, float gravity, float dt)
+{
+	int first = start[p];
+	int cells = start[p + 1] - first;
+	float* h = &depth[first];
+	float* q = &discharge[first];
+	float* fluxH = &depthFlux[first];
+	float* fluxQ = &dischargeFlux[first];
+	float dx = cellWidth[p];
+
+	ShallowRow row = { h, q, fluxH, fluxQ, cells, gravity, SHALLOW_WATER_DRY };
+	const SimdKernels& kernels = simdKernels();
+	float remaining = dt;
+	int substeps = 0;
+	while (remaining > 0.0f)
+	{
+		// No wave may cross more than SHALLOW_WATER_CFL of a cell in a substep, which also keeps every depth from going below 0.
+		// The last substep allowed takes whatever time is left.
+		float wave = 0.0f;
+		for (int k = 0; k < cells; k++)
+		{
+			float velocity = h[k] > SHALLOW_WATER_DRY ? q[k] / h[k] : 0.0f;
+			wave = std::max(wave, std::fabs(velocity) + std::sqrt(gravity * h[k]));
+		}
+		float sub = remaining;
+		if (substeps + 1 < SHALLOW_WATER_MAX_SUBSTEPS && wave * remaining > SHALLOW_WATER_CFL * dx)
+		{
+			sub = SHALLOW_WATER_CFL * dx / wave;
+		}
+		remaining = sub < remaining ? remaining - sub : 0.0f;
+		substeps++;
+		float scale = sub / dx;
+		float friction = 1.0f / (1.0f + sub * SHALLOW_WATER_DAMPING);
+
+		kernels.shallowFluxes(row);
+
+		// Nothing crosses the walls, but the fluid next to them pushes on them with the weight of its column.
+		float wallLeft = 0.5f * gravity * h[0] * h[0];
+		float wallRight = 0.5f * gravity * h[cells - 1] * h[cells - 1];
+		for (int k = 0; k < cells; k++)
+		{
+			float inH = k > 0 ? fluxH[k - 1] : 0.0f;
+			float outH = k + 1 < cells ? fluxH[k] : 0.0f;
+			float inQ = k > 0 ? fluxQ[k - 1] : wallLeft;
+			float outQ = k + 1 < cells ? fluxQ[k] : wallRight;
+			h[k] = std::max(h[k] - scale * (outH - inH), 0.0f);
+			q[k] = h[k] > SHALLOW_WATER_DRY ? (q[k] - scale * (outQ - inQ)) * friction : 0.0f;
+		}
+	}
+
+	float velocity = 0.0f;
+	for (int k = 0; k < cells; k++)
+	{
+		velocity = std::max(velocity, h[k] > SHALLOW_WATER_DRY ? std::fabs(q[k] / h[k]) : 0.0f);
+	}
+	fastest[p] = velocity;
+	return substeps;
+}
+
+float ShallowWater::mouthLevel(int p, int wall) const
+{
+	int step = wall == start[p] ? 1 : -1;
+	float sum = 0.0f;
+	for (int i = 0; i < mouthCells[p]; i++)
+	{
+		sum += depth[wall + i * step];
+	}
+	return sum / mouthCells[p];
+}
+
+void ShallowWater::pour(int p, int wall, float volume)
+{
+	int step = wall == start[p] ? 1 : -1;
+	int cells = mouthCells[p];
+	float change = volume / (cellWidth[p] * cells);
+	if (volume >= 0.0f)
+	{
+		for (int i = 0; i < cells; i++)
+		{
+			depth[wall + i * step] += change;
+		}
+		return;
+	}
+
+	// Every cell of the mouth gives the same share of what it holds, so none of them goes below 0. If the mouth doesn't hold enough,
+	// the rest comes from the cells next to it, towards the other wall.
+	float held = mouthLevel(p, wall);
+	float needed = -change;
+	float keep = needed < held ? 1.0f - needed / held : 0.0f;
+	for (int i = 0; i < cells; i++)
+	{
+		depth[wall + i * step] *= keep;
+	}
+	needed = (needed - std::min(needed, held)) * cells;
+	for (int k = wall + cells * step; needed > 0.0f && k >= start[p] && k < start[p + 1]; k += step)
+	{
+		float taken = std::min(depth[k], needed);
+		depth[k] -= taken;
+		needed -= taken;
+	}
+}
+
+bool ShallowWater::update(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool)
+{
+	int profiles = profileCount();
+
+	// The tubes feel the depth where they come in (averaged, for a vessel with several tubes).
+	std::fill(mouthDepth.begin(), mouthDepth.end(), 0.0f);
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		if (mouthA[t] >= 0)
+		{
+			mouthDepth[profileOf[network.tubeA[t]]] += mouthLevel(profileOf[network.tubeA[t]], mouthA[t]);
+		}
+		if (mouthB[t] >= 0)
+		{
+			mouthDepth[profileOf[network.tubeB[t]]] += mouthLevel(profileOf[network.tubeB[t]], mouthB[t]);
+		}
+	}
+	for (int p = 0; p < profiles; p++)
+	{
+		int vessel = vessels[p];
+		if (mouthCount[p] == 0)
+		{
+			continue;
+		}
+		float height = mouthDepth[p] / mouthCount[p];
+		if (network.height[vessel] != height)
+		{
+			network.height[vessel] = height;
+			network.wake(vessel);
+		}
+	}
+
+	bool moved = network.update(density, gravity, dt, pool);
+
+	// The volume every tube moved goes into or out of its mouth.
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		float change = network.tubeChange[t];
+		if (change == 0.0f)
+		{
+			continue;
+		}
+		if (mouthA[t] >= 0)
+		{
+			pour(profileOf[network.tubeA[t]], mouthA[t], change);
+		}
+		if (mouthB[t] >= 0)
+		{
+			pour(profileOf[network.tubeB[t]], mouthB[t], -change);
+		}
+	}
+
+	std::vector<int> substeps(profiles, 0);
+	auto stepProfiles = [&](int begin, int end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			substeps[p] = stepProfile(p, gravity, dt);
+		}
+	};
+	if (pool != nullptr && profiles >= SHALLOW_WATER_PARALLEL_MIN)
+	{
+		pool->parallelFor(profiles, 1, stepProfiles);
+	}
+	else
+	{
+		stepProfiles(0, profiles);
+	}
+
+	// Between steps the network holds the average level of every profile.
+	lastSubsteps = 0;
+	for (int p = 0; p < profiles; p++)
+	{
+		int vessel = vessels[p];
+		double volume = 0.0;
+		for (int k = start[p]; k < start[p + 1]; k++)
+		{
+			volume += depth[k];
+		}
+		float height = (float)(volume / (start[p + 1] - start[p]));
+		network.height[vessel] = height;
+		network.top[vessel] = network.bottom[vessel] + height;
+		network.pressure[vessel] = density * gravity * height;
+
+		lastSubsteps = std::max(lastSubsteps, substeps[p]);
+		moved |= fastest[p] * dt > REST_HEIGHT;
+	}
+	return moved;
+}
+
+double ShallowWater::totalVolume() const
+{
+	double volume = 0.0;
+	for (int p = 0; p < profileCount(); p++)
+	{
+		for (int k = start[p]; k < start[p + 1]; k++)
+		{
+			volume += (double)depth[k] * cellWidth[p];
+		}
+	}
+	return volume;
+}
@@ -0,0 +1,129 @@
+/*
+Title: HydroDynamics
+File Name: ShallowWater.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Lets the surface of wide vessels slosh. A VesselNetwork keeps a single flat level per
+vessel, which is fine for a narrow vessel but makes a wide tank look like a piston. Here
+every vessel at least SHALLOW_WATER_MIN_WIDTH wide gets a profile across its width: a row
+of cells with a depth and a discharge (depth times velocity) each, stepped with the 1D
+shallow water equations. Those are the cheapest model that has real surface waves: the
+fluid is assumed to move the same all the way down, so a cell only knows how deep it is
+and how fast it moves, and a row costs what one row of the grid would cost.
+
+The cells are stepped with a finite volume scheme: the Rusanov flux across every face
+between two cells (a SIMD kernel, see SimdKernels.h), and the walls at both ends, which
+nothing crosses. Friction at the floor slowly takes the energy out of the waves.
+
+The profiles are coupled to the tubes through the network. A tube feels the pressure of
+the cell at the end of the profile its tube comes in at (the side facing the other
+vessel), and the volume it moves goes into or out of that cell, so whatever flows out
+through the floor pulls the surface down there first and the wave that makes carries it
+across the vessel. Between steps the network holds the average level of every profile, so
+the output, the piston and everything else that reads the network see a flat level as
+before.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SHALLOW_WATER_H
+#define _SHALLOW_WATER_H
+
+#include <vector>
+
+struct VesselNetwork;
+class TaskPool;
+
+// Vessels narrower than this keep a flat level.
+#define SHALLOW_WATER_MIN_WIDTH 0.4f
+
+// How fast the friction at the floor slows the fluid down, in 1 / s.
+#define SHALLOW_WATER_DAMPING 0.5f
+
+// A profile is stepped in substeps short enough that no wave crosses more than this part of a cell in one.
+#define SHALLOW_WATER_CFL 0.5f
+#define SHALLOW_WATER_MAX_SUBSTEPS 64
+
+// A tube opens into a profile over this much of its floor, next to the wall facing the other end of the tube.
+#define SHALLOW_WATER_MOUTH_WIDTH 0.1f
+
+// Cells shallower than this count as dry and don't move.
+#define SHALLOW_WATER_DRY 1e-5f
+
+class ShallowWater
+{
+public:
+	// Per profile: the vessel it belongs to, how wide its cells are, and where its cells start in depth and discharge. The cells of
+	// profile p are start[p] to start[p + 1] - 1, from left to right.
+	std::vector<int> vessels;
+	std::vector<float> cellWidth;
+	std::vector<int> start;
+
+	// Per cell of all profiles
+	std::vector<float> depth;
+	std::vector<float> discharge;
+
+	// Per vessel of the network, its profile, or -1 if it keeps a flat level
+	std::vector<int> profileOf;
+
+	// The most substeps any profile took in the last step
+	int lastSubsteps = 0;
+
+	// Gives every vessel of the network at least minWidth wide a profile of cells cells, flat at its current height. Returns false
+	// (and prints why) if no vessel is that wide.
+	bool build(const VesselNetwork& network, int cells, float minWidth = SHALLOW_WATER_MIN_WIDTH);
+
+	// Steps the network and the profiles by dt seconds. Returns false if nothing moved.
+	bool update(VesselNetwork& network, float density, float gravity, float dt, TaskPool* pool = nullptr);
+
+	int profileCount() const { return (int)vessels.size(); }
+
+	// The volume of fluid in all profiles.
+	double totalVolume() const;
+
+private:
+	// The average depth over the mouth of a tube that comes in at the given wall cell of profile p.
+	float mouthLevel(int p, int wall) const;
+
+	// Spreads volume over that mouth, or takes it away from there if it is negative.
+	void pour(int p, int wall, float volume);
+
+	// Steps profile p by dt and returns how many substeps that took.
+	int stepProfile(int p, float gravity, float dt);
+
+	// Per tube, the cell (in depth) at the wall its end at vessel A or B comes in next to, or -1 if that vessel keeps a flat level.
+	// Per profile, how many cells from there on inwards the mouth of a tube covers.
+	std::vector<int> mouthA;
+	std::vector<int> mouthB;
+	std::vector<int> mouthCells;
+
+	// Per profile, how many tube ends come in at it, and the depth the network was given for its pressure in this step (the
+	// average over those ends)
+	std::vector<int> mouthCount;
+	std::vector<float> mouthDepth;
+
+	std::vector<float> depthFlux;		// Per cell, the flux across the face to its right (unused for the last cell)
+	std::vector<float> dischargeFlux;
+	std::vector<float> fastest;			// Per profile, the fastest the fluid moved after the last step
+};
+
+#endif // _SHALLOW_WATER_H
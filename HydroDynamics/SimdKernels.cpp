@@ -0,0 +1,1061 @@
+/*
+Title: HydroDynamics
+File Name: SimdKernels.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+SIMD versions of the inner loops of VesselNetwork::update(), of the pressure solve of the
+grid (see GridPressureSolver.h) and of the shallow water profiles (see ShallowWater.h).
+Each loop has a plain
+scalar version that runs anywhere, an SSE2 version that works on 4 floats at a time
+and an AVX2 version that works on 8 floats at a time.
+
+Which version is used is decided once at runtime by asking the CPU what it supports,
+so the same executable runs on old and new machines and uses the widest instructions
+available on each of them.
+*/
+
+#include "SimdKernels.h"
+#include "GridTiles.h"
+#include "VesselProfile.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HYDRO_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets us use any intrinsic in any function.
+#define HYDRO_TARGET_AVX2
+#else
+#include <cpuid.h>
+// GCC and Clang need to be told which functions are allowed to use AVX2, since the rest of the program is built without it.
+#define HYDRO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define HYDRO_X86 0
+#endif
+
+#pragma region Scalar
+static void pressuresScalar(const float* height, float* pressure, int count, float scale)
+{
+	for (int i = 0; i < count; i++)
+	{
+		pressure[i] = height[i] * scale;
+	}
+}
+
+// The flow of a single tube. Every SIMD version does exactly these operations in this order, just on several tubes at once,
+// so all of them give the same result to the last bit.
+static inline void tubeFlow(int t, const TubeFlowData& tubes, const VesselFlowData& vessels, const FlowStep& step)
+{
+	int a = tubes.tubeA[t];
+	int b = tubes.tubeB[t];
+	float pressureA = vessels.pressure[a] + vessels.externalPressure[a];
+	float pressureB = vessels.pressure[b] + vessels.externalPressure[b];
+	float difference = pressureB - pressureA;
+
+	// The fluid in the tube accelerates with the difference in pressure and is slowed by friction: L dq/dt = dp - R q.
+	// Both the friction and the drop in dp as the levels move (stiffness * q * dt * density * gravity) are taken at the end of the
+	// step (backward Euler), which is what keeps large steps from blowing up.
+	float invInertance = tubes.invInertance[t];
+	float flow = (tubes.flow[t] + step.dt * difference * invInertance)
+		/ (1.0f + step.dt * tubes.damping[t] + step.dtSquaredScale * tubes.stiffness[t] * invInertance);
+
+	if (fabsf(flow) < step.restFlow && fabsf(difference) < step.restPressure)
+	{
+		flow = 0.0f;
+	}
+
+	// Don't let a tube take more than its share of either of its vessels.
+	float volume = flow * step.dt;
+	float limitIntoA = vessels.height[b] * vessels.drainShare[b];
+	float limitIntoB = -(vessels.height[a] * vessels.drainShare[a]);
+	volume = volume < limitIntoA ? volume : limitIntoA;
+	volume = volume > limitIntoB ? volume : limitIntoB;
+
+	tubes.flow[t] = volume / step.dt;
+	tubes.change[t] = volume;
+}
+
+static bool tubeFlowsScalar(const TubeFlowData& tubes, int begin, int end, const VesselFlowData& vessels, const FlowStep& step)
+{
+	bool moved = false;
+	for (int t = begin; t < end; t++)
+	{
+		tubeFlow(t, tubes, vessels, step);
+		moved |= tubes.change[t] != 0.0f;
+	}
+	return moved;
+}
+
+static void applyScalar(float* height, const float* delta, const float* bottom, float* top, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		height[i] += delta[i];
+		top[i] = bottom[i] + height[i];
+	}
+}
+
+// A lookup in a profile table, clamped instead of checked, and the straight walls above it. k and f are what the SIMD versions
+// work out for eight vessels at once.
+static inline float profileLookup(const float* table, float position)
+{
+	position = position > 0.0f ? position : 0.0f;
+	int k = (int)position;
+	k = k < PROFILE_SAMPLES - 1 ? k : PROFILE_SAMPLES - 1;
+	float f = position - (float)k;
+	f = f < 1.0f ? f : 1.0f;
+	return table[k] + f * (table[k + 1] - table[k]);
+}
+
+static inline void profileVessel(const ProfileData& profiles, int j, float* height, const float* delta, const float* width, const float* bottom,
+	float* top)
+{
+	int i = profiles.vessel[j];
+	int p = profiles.profile[j];
+	int base = p * (PROFILE_SAMPLES + 1);
+	float d = delta[i];
+	float before = height[i] - d;
+
+	float above = before - profiles.depth[p];
+	float volume = profileLookup(profiles.volumeTable + base, before * profiles.heightScale[p]) + (above > 0.0f ? above : 0.0f) * profiles.topWidth[p];
+	float after = volume + d * width[i];
+
+	// The two tables are only close to inverses of each other, so the height moves by the difference of two lookups in the height
+	// table. A vessel that gained nothing stays exactly where it was, instead of creeping towards where the tables agree.
+	float overBefore = volume - profiles.fullVolume[p];
+	float overAfter = after - profiles.fullVolume[p];
+	float from = profileLookup(profiles.heightTable + base, volume * profiles.volumeScale[p]) + (overBefore > 0.0f ? overBefore : 0.0f) / profiles.topWidth[p];
+	float to = profileLookup(profiles.heightTable + base, after * profiles.volumeScale[p]) + (overAfter > 0.0f ? overAfter : 0.0f) / profiles.topWidth[p];
+	float h = before + (to - from);
+	h = h > 0.0f ? h : 0.0f;
+	height[i] = h;
+	top[i] = bottom[i] + h;
+}
+
+static void profileApplyScalar(const ProfileData& profiles, int begin, int end, float* height, const float* delta, const float* width,
+	const float* bottom, float* top)
+{
+	for (int j = begin; j < end; j++)
+	{
+		profileVessel(profiles, j, height, delta, width, bottom, top);
+	}
+}
+
+// One cell of the stencil and of a relaxation. As with the tubes, the SIMD versions do the same operations in the same order.
+static inline float stencilCell(const StencilRow& row, const float* x, int i)
+{
+	float sum = row.diagonal[i] * x[i];
+	sum -= row.linkRight[i - 1] * x[i - 1];
+	sum -= row.linkRight[i] * x[i + 1];
+	sum -= row.linkUp[i - row.strideBelow] * x[i - row.strideBelow];
+	sum -= row.linkUp[i] * x[i + row.stride];
+	return sum;
+}
+
+static inline float relaxCell(const StencilRow& row, const float* rhs, const float* from, int i)
+{
+	float sum = rhs[i];
+	sum += row.linkRight[i - 1] * from[i - 1];
+	sum += row.linkRight[i] * from[i + 1];
+	sum += row.linkUp[i - row.strideBelow] * from[i - row.strideBelow];
+	sum += row.linkUp[i] * from[i + row.stride];
+	return sum * row.inverseDiagonal[i];
+}
+
+static void stencilRange(const StencilRow& row, const float* x, float* y, int begin)
+{
+	for (int i = begin; i < row.count; i++)
+	{
+		y[i] = stencilCell(row, x, i);
+	}
+}
+
+static void relaxRange(const StencilRow& row, const float* rhs, const float* from, float* to, int parity, int begin)
+{
+	if (parity < 0)
+	{
+		for (int i = begin; i < row.count; i++)
+		{
+			to[i] = relaxCell(row, rhs, from, i);
+		}
+		return;
+	}
+
+	for (int i = begin + ((begin & 1) != parity); i < row.count; i += 2)
+	{
+		to[i] = relaxCell(row, rhs, from, i);
+	}
+}
+
+static void stencilScalar(const StencilRow& row, const float* x, float* y)
+{
+	stencilRange(row, x, y, 0);
+}
+
+static void relaxScalar(const StencilRow& row, const float* rhs, const float* from, float* to, int parity)
+{
+	relaxRange(row, rhs, from, to, parity, 0);
+}
+
+// The flux across one face of a shallow water row. The flux of each side is averaged, and the difference between the sides is
+// damped by the fastest wave on either of them.
+static inline void shallowFace(const ShallowRow& row, int k)
+{
+	float depthLeft = row.depth[k];
+	float depthRight = row.depth[k + 1];
+	float dischargeLeft = row.discharge[k];
+	float dischargeRight = row.discharge[k + 1];
+	float velocityLeft = depthLeft > row.dry ? dischargeLeft / depthLeft : 0.0f;
+	float velocityRight = depthRight > row.dry ? dischargeRight / depthRight : 0.0f;
+
+	float halfGravity = 0.5f * row.gravity;
+	float momentumLeft = dischargeLeft * velocityLeft + halfGravity * depthLeft * depthLeft;
+	float momentumRight = dischargeRight * velocityRight + halfGravity * depthRight * depthRight;
+	float waveLeft = fabsf(velocityLeft) + sqrtf(row.gravity * depthLeft);
+	float waveRight = fabsf(velocityRight) + sqrtf(row.gravity * depthRight);
+	float wave = waveLeft > waveRight ? waveLeft : waveRight;
+
+	row.depthFlux[k] = 0.5f * (dischargeLeft + dischargeRight) - 0.5f * wave * (depthRight - depthLeft);
+	row.dischargeFlux[k] = 0.5f * (momentumLeft + momentumRight) - 0.5f * wave * (dischargeRight - dischargeLeft);
+}
+
+static void shallowRange(const ShallowRow& row, int begin)
+{
+	for (int k = begin; k + 1 < row.count; k++)
+	{
+		shallowFace(row, k);
+	}
+}
+
+static void shallowScalar(const ShallowRow& row)
+{
+	shallowRange(row, 0);
+}
+
+// The same comparisons as the SSE and AVX minimum and maximum, so every version of the advection agrees even on the sign of a zero.
+static inline float minimum(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float maximum(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+// Like GridTiles::at(), for cells that aren't left or below the grid.
+static inline int advectCell(const AdvectGrid& grid, int x, int y)
+{
+	if (x >= grid.columns || y >= grid.rows)
+	{
+		return -1;
+	}
+	int slot = grid.slots[(y >> GRID_TILE_BITS) * grid.tileColumns + (x >> GRID_TILE_BITS)];
+	return slot < 0 ? -1 : slot * GRID_TILE_CELLS + ((y & (GRID_TILE - 1)) << GRID_TILE_BITS) + (x & (GRID_TILE - 1));
+}
+
+static inline float advectValue(const float* field, int cell)
+{
+	return cell >= 0 ? field[cell] : 0.0f;
+}
+
+// Samples a field of width x height values at (x, y), in units of its own spacing, clamped to its edges. Value (i, j) of the field
+// is in cell (i, j) of the grid, and is 0 where there is no cell: the faces on the right and top edge of the grid and the cells of
+// the tiles that aren't kept are all walls, where every field is 0.
+static inline float advectBilinear(const AdvectGrid& grid, const float* field, int width, int height, float x, float y)
+{
+	x = minimum(maximum(x, 0.0f), (float)(width - 1));
+	y = minimum(maximum(y, 0.0f), (float)(height - 1));
+	int x0 = std::max(std::min((int)x, width - 2), 0);
+	int y0 = std::max(std::min((int)y, height - 2), 0);
+	int x1 = std::min(x0 + 1, width - 1);
+	int y1 = std::min(y0 + 1, height - 1);
+	float fx = x - (float)x0;
+	float fy = y - (float)y0;
+
+	float bottomLeft = advectValue(field, advectCell(grid, x0, y0));
+	float topLeft = advectValue(field, advectCell(grid, x0, y1));
+	float bottom = bottomLeft + (advectValue(field, advectCell(grid, x1, y0)) - bottomLeft) * fx;
+	float top = topLeft + (advectValue(field, advectCell(grid, x1, y1)) - topLeft) * fx;
+	return bottom + (top - bottom) * fy;
+}
+
+// Positions are in cells, with (0, 0) at the bottom left corner of the grid. u is stored at (x, y + 0.5) and v at (x + 0.5, y).
+static inline float advectU(const AdvectGrid& grid, float x, float y)
+{
+	return advectBilinear(grid, grid.u, grid.columns + 1, grid.rows, x, y - 0.5f);
+}
+
+static inline float advectV(const AdvectGrid& grid, float x, float y)
+{
+	return advectBilinear(grid, grid.v, grid.columns, grid.rows + 1, x - 0.5f, y);
+}
+
+// Like advectBilinear(), but walls don't count, so fluid next to a wall doesn't get mixed with the empty wall. The weight of every
+// cell is multiplied by its open mask rather than skipped, the way the SIMD versions have to do it.
+static inline float advectFraction(const AdvectGrid& grid, float x, float y)
+{
+	x = minimum(maximum(x - 0.5f, 0.0f), (float)(grid.columns - 1));
+	y = minimum(maximum(y - 0.5f, 0.0f), (float)(grid.rows - 1));
+	int x0 = std::max(std::min((int)x, grid.columns - 2), 0);
+	int y0 = std::max(std::min((int)y, grid.rows - 2), 0);
+	int x1 = std::min(x0 + 1, grid.columns - 1);
+	int y1 = std::min(y0 + 1, grid.rows - 1);
+	float fx = x - (float)x0;
+	float fy = y - (float)y0;
+
+	int cell[4] = { advectCell(grid, x0, y0), advectCell(grid, x1, y0), advectCell(grid, x0, y1), advectCell(grid, x1, y1) };
+	float weight[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+	float sum = 0.0f;
+	float total = 0.0f;
+	for (int k = 0; k < 4; k++)
+	{
+		float open = advectValue(grid.open, cell[k]);
+		sum += advectValue(grid.fraction, cell[k]) * weight[k] * open;
+		total += weight[k] * open;
+	}
+	return total > 0.0f ? sum / total : 0.0f;
+}
+
+// Traces a point back along the flow: first half a step, to find the velocity in the middle of the path, then the whole step with
+// that velocity.
+static inline void traceBack(const AdvectGrid& grid, float x, float y, float vx, float vy, float& fromX, float& fromY)
+{
+	float halfScale = 0.5f * grid.scale;
+	float midX = x - halfScale * vx;
+	float midY = y - halfScale * vy;
+	fromX = x - grid.scale * advectU(grid, midX, midY);
+	fromY = y - grid.scale * advectV(grid, midX, midY);
+}
+
+static void advectRange(const AdvectGrid& grid, int first, int x, int y, int begin, int count)
+{
+	for (int i = begin; i < count; i++)
+	{
+		int cell = first + i;
+		float fromX, fromY;
+		float px = (float)(x + i);
+		float py = (float)y;
+		if (!grid.uOpen[cell])
+		{
+			grid.nextU[cell] = 0.0f;
+		}
+		else
+		{
+			traceBack(grid, px, py + 0.5f, grid.u[cell], advectV(grid, px, py + 0.5f), fromX, fromY);
+			grid.nextU[cell] = advectU(grid, fromX, fromY);
+		}
+
+		if (!grid.vOpen[cell])
+		{
+			grid.nextV[cell] = 0.0f;
+		}
+		else
+		{
+			traceBack(grid, px + 0.5f, py, advectU(grid, px + 0.5f, py), grid.v[cell], fromX, fromY);
+			grid.nextV[cell] = advectV(grid, fromX, fromY);
+		}
+
+		if (grid.open[cell] == 0.0f)
+		{
+			grid.nextFraction[cell] = 0.0f;
+		}
+		else
+		{
+			traceBack(grid, px + 0.5f, py + 0.5f, advectU(grid, px + 0.5f, py + 0.5f), advectV(grid, px + 0.5f, py + 0.5f), fromX, fromY);
+			grid.nextFraction[cell] = minimum(maximum(advectFraction(grid, fromX, fromY), 0.0f), 1.0f);
+		}
+	}
+}
+
+static void advectScalar(const AdvectGrid& grid, int first, int x, int y, int count)
+{
+	advectRange(grid, first, x, y, 0, count);
+}
+
+// The same operations in the same order as tubeFlow() and gatherAndApply() in VesselNetwork.cpp. The small vessel has no pressure
+// from outside, and both vessels have only the one tube, so its drain share is its width and the changes need no sum.
+static inline void apparatusLane(ApparatusBlock& block, int l, float scale, const FlowStep& step)
+{
+	float pressureA = block.bigHeight[l] * scale + block.pressure[l];
+	float pressureB = block.smallHeight[l] * scale;
+	float difference = pressureB - pressureA;
+
+	float invInertance = block.invInertance[l];
+	float flow = (block.flow[l] + step.dt * difference * invInertance)
+		/ (1.0f + step.dt * block.damping[l] + step.dtSquaredScale * block.stiffness[l] * invInertance);
+	if (fabsf(flow) < step.restFlow && fabsf(difference) < step.restPressure)
+	{
+		flow = 0.0f;
+	}
+
+	float volume = flow * step.dt;
+	float limitIntoA = block.smallHeight[l] * block.smallWidth[l];
+	float limitIntoB = -(block.bigHeight[l] * block.bigWidth[l]);
+	volume = volume < limitIntoA ? volume : limitIntoA;
+	volume = volume > limitIntoB ? volume : limitIntoB;
+	block.flow[l] = volume / step.dt;
+
+	// A lane where nothing moved stays exactly as it is from now on, like a component of the network that fell asleep.
+	if (volume == 0.0f)
+	{
+		block.awake[l] = 0;
+		return;
+	}
+	block.bigHeight[l] += volume / block.bigWidth[l];
+	block.smallHeight[l] += -volume / block.smallWidth[l];
+	block.lowest[l] = block.bigHeight[l] < block.lowest[l] ? block.bigHeight[l] : block.lowest[l];
+	block.highest[l] = block.highest[l] < block.bigHeight[l] ? block.bigHeight[l] : block.highest[l];
+}
+
+static int apparatusStepScalar(ApparatusBlock& block, float scale, const FlowStep& step)
+{
+	int awake = 0;
+	for (int l = 0; l < BATCH_LANES; l++)
+	{
+		if (block.awake[l])
+		{
+			apparatusLane(block, l, scale, step);
+			awake |= block.awake[l] ? 1 << l : 0;
+		}
+	}
+	return awake;
+}
+#pragma endregion Scalar
+
+#if HYDRO_X86
+#pragma region SSE2
+static void pressuresSSE2(const float* height, float* pressure, int count, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_ps(pressure + i, _mm_mul_ps(_mm_loadu_ps(height + i), s));
+	}
+
+	// The last few vessels that don't fill a whole register.
+	pressuresScalar(height + i, pressure + i, count - i, scale);
+}
+
+static void applySSE2(float* height, const float* delta, const float* bottom, float* top, int count)
+{
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 h = _mm_add_ps(_mm_loadu_ps(height + i), _mm_loadu_ps(delta + i));
+		_mm_storeu_ps(height + i, h);
+		_mm_storeu_ps(top + i, _mm_add_ps(_mm_loadu_ps(bottom + i), h));
+	}
+	applyScalar(height + i, delta + i, bottom + i, top + i, count - i);
+}
+
+static void stencilSSE2(const StencilRow& row, const float* x, float* y)
+{
+	const float* below = x - row.strideBelow;
+	const float* above = x + row.stride;
+	const float* linkDown = row.linkUp - row.strideBelow;
+	int i = 0;
+	for (; i + 4 <= row.count; i += 4)
+	{
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(row.diagonal + i), _mm_loadu_ps(x + i));
+		sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_loadu_ps(row.linkRight + i - 1), _mm_loadu_ps(x + i - 1)));
+		sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_loadu_ps(row.linkRight + i), _mm_loadu_ps(x + i + 1)));
+		sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_loadu_ps(linkDown + i), _mm_loadu_ps(below + i)));
+		sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_loadu_ps(row.linkUp + i), _mm_loadu_ps(above + i)));
+		_mm_storeu_ps(y + i, sum);
+	}
+	stencilRange(row, x, y, i);
+}
+
+// Every cell of the register is relaxed, and for half a red-black sweep the ones of the other parity are put back as they were.
+// Those are only read by the cells being relaxed, never changed, so working in place is safe. The left neighbours are shifted in
+// from the registers loaded before instead of loaded again: that load would overlap the store just before it, which stalls.
+static void relaxSSE2(const StencilRow& row, const float* rhs, const float* from, float* to, int parity)
+{
+	const float* below = from - row.strideBelow;
+	const float* above = from + row.stride;
+	const float* linkDown = row.linkUp - row.strideBelow;
+	__m128 keep = parity < 0 ? _mm_setzero_ps() : _mm_castsi128_ps(parity == 0 ? _mm_set_epi32(-1, 0, -1, 0) : _mm_set_epi32(0, -1, 0, -1));
+	__m128 previous = _mm_set1_ps(from[-1]);
+	int i = 0;
+	for (; i + 4 <= row.count; i += 4)
+	{
+		// left = (previous[3], center[0], center[1], center[2])
+		__m128 center = _mm_loadu_ps(from + i);
+		__m128 left = _mm_shuffle_ps(_mm_shuffle_ps(previous, center, _MM_SHUFFLE(0, 0, 3, 3)), center, _MM_SHUFFLE(2, 1, 2, 0));
+		previous = center;
+
+		__m128 sum = _mm_loadu_ps(rhs + i);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row.linkRight + i - 1), left));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row.linkRight + i), _mm_loadu_ps(from + i + 1)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(linkDown + i), _mm_loadu_ps(below + i)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row.linkUp + i), _mm_loadu_ps(above + i)));
+		sum = _mm_mul_ps(sum, _mm_loadu_ps(row.inverseDiagonal + i));
+		_mm_storeu_ps(to + i, _mm_or_ps(_mm_and_ps(keep, center), _mm_andnot_ps(keep, sum)));
+	}
+	relaxRange(row, rhs, from, to, parity, i);
+}
+
+// The same operations as shallowFace() on 4 faces at once. The velocity of a dry cell is divided by the dry depth instead and then
+// masked away, so no lane divides by 0.
+static void shallowSSE2(const ShallowRow& row)
+{
+	__m128 dry = _mm_set1_ps(row.dry);
+	__m128 gravity = _mm_set1_ps(row.gravity);
+	__m128 halfGravity = _mm_set1_ps(0.5f * row.gravity);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	int k = 0;
+	for (; k + 4 < row.count; k += 4)
+	{
+		__m128 depthLeft = _mm_loadu_ps(row.depth + k);
+		__m128 depthRight = _mm_loadu_ps(row.depth + k + 1);
+		__m128 dischargeLeft = _mm_loadu_ps(row.discharge + k);
+		__m128 dischargeRight = _mm_loadu_ps(row.discharge + k + 1);
+		__m128 velocityLeft = _mm_and_ps(_mm_cmpgt_ps(depthLeft, dry), _mm_div_ps(dischargeLeft, _mm_max_ps(depthLeft, dry)));
+		__m128 velocityRight = _mm_and_ps(_mm_cmpgt_ps(depthRight, dry), _mm_div_ps(dischargeRight, _mm_max_ps(depthRight, dry)));
+
+		__m128 momentumLeft = _mm_add_ps(_mm_mul_ps(dischargeLeft, velocityLeft), _mm_mul_ps(_mm_mul_ps(halfGravity, depthLeft), depthLeft));
+		__m128 momentumRight = _mm_add_ps(_mm_mul_ps(dischargeRight, velocityRight), _mm_mul_ps(_mm_mul_ps(halfGravity, depthRight), depthRight));
+		__m128 waveLeft = _mm_add_ps(_mm_andnot_ps(sign, velocityLeft), _mm_sqrt_ps(_mm_mul_ps(gravity, depthLeft)));
+		__m128 waveRight = _mm_add_ps(_mm_andnot_ps(sign, velocityRight), _mm_sqrt_ps(_mm_mul_ps(gravity, depthRight)));
+		__m128 halfWave = _mm_mul_ps(half, _mm_max_ps(waveLeft, waveRight));
+
+		_mm_storeu_ps(row.depthFlux + k, _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(dischargeLeft, dischargeRight)),
+			_mm_mul_ps(halfWave, _mm_sub_ps(depthRight, depthLeft))));
+		_mm_storeu_ps(row.dischargeFlux + k, _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(momentumLeft, momentumRight)),
+			_mm_mul_ps(halfWave, _mm_sub_ps(dischargeRight, dischargeLeft))));
+	}
+	shallowRange(row, k);
+}
+
+// SSE2 has no blend, so the lanes that keep their values are picked with and, andnot and or.
+static inline __m128 selectSSE2(__m128 mask, __m128 ifSet, __m128 ifClear)
+{
+	return _mm_or_ps(_mm_and_ps(mask, ifSet), _mm_andnot_ps(mask, ifClear));
+}
+
+// One half of a block, the lanes from l on.
+static int apparatusHalfSSE2(ApparatusBlock& block, int l, float scale, const FlowStep& step)
+{
+	__m128 dt = _mm_set1_ps(step.dt);
+	__m128 zero = _mm_setzero_ps();
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	__m128 awake = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(block.awake + l)));
+	__m128 big = _mm_loadu_ps(block.bigHeight + l);
+	__m128 small = _mm_loadu_ps(block.smallHeight + l);
+	__m128 bigWidth = _mm_loadu_ps(block.bigWidth + l);
+	__m128 smallWidth = _mm_loadu_ps(block.smallWidth + l);
+
+	__m128 s = _mm_set1_ps(scale);
+	__m128 difference = _mm_sub_ps(_mm_mul_ps(small, s), _mm_add_ps(_mm_mul_ps(big, s), _mm_loadu_ps(block.pressure + l)));
+	__m128 invInertance = _mm_loadu_ps(block.invInertance + l);
+	__m128 numerator = _mm_add_ps(_mm_loadu_ps(block.flow + l), _mm_mul_ps(_mm_mul_ps(dt, difference), invInertance));
+	__m128 denominator = _mm_add_ps(_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(dt, _mm_loadu_ps(block.damping + l))),
+		_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(step.dtSquaredScale), _mm_loadu_ps(block.stiffness + l)), invInertance));
+	__m128 flow = _mm_div_ps(numerator, denominator);
+	__m128 atRest = _mm_and_ps(_mm_cmplt_ps(_mm_and_ps(flow, absMask), _mm_set1_ps(step.restFlow)),
+		_mm_cmplt_ps(_mm_and_ps(difference, absMask), _mm_set1_ps(step.restPressure)));
+	flow = _mm_andnot_ps(atRest, flow);
+
+	__m128 volume = _mm_mul_ps(flow, dt);
+	volume = _mm_min_ps(volume, _mm_mul_ps(small, smallWidth));
+	volume = _mm_max_ps(volume, _mm_xor_ps(_mm_mul_ps(big, bigWidth), signMask));
+	_mm_storeu_ps(block.flow + l, selectSSE2(awake, _mm_div_ps(volume, dt), _mm_loadu_ps(block.flow + l)));
+
+	// Only the lanes that were awake and moved change.
+	__m128 moved = _mm_and_ps(awake, _mm_cmpneq_ps(volume, zero));
+	big = selectSSE2(moved, _mm_add_ps(big, _mm_div_ps(volume, bigWidth)), big);
+	small = selectSSE2(moved, _mm_add_ps(small, _mm_div_ps(_mm_xor_ps(volume, signMask), smallWidth)), small);
+	_mm_storeu_ps(block.bigHeight + l, big);
+	_mm_storeu_ps(block.smallHeight + l, small);
+	_mm_storeu_ps(block.lowest + l, _mm_min_ps(big, _mm_loadu_ps(block.lowest + l)));
+	_mm_storeu_ps(block.highest + l, _mm_max_ps(big, _mm_loadu_ps(block.highest + l)));
+	_mm_storeu_si128((__m128i*)(block.awake + l), _mm_castps_si128(moved));
+	return _mm_movemask_ps(moved) << l;
+}
+
+static int apparatusStepSSE2(ApparatusBlock& block, float scale, const FlowStep& step)
+{
+	return apparatusHalfSSE2(block, 0, scale, step) | apparatusHalfSSE2(block, 4, scale, step);
+}
+#pragma endregion SSE2
+
+#pragma region AVX2
+// Every AVX2 kernel clears the upper halves of the registers before it goes on to the scalar code for the last few elements.
+// Running SSE instructions (which all the scalar float code is) while they are in use makes the CPU keep merging them into every
+// result, which slows down everything that follows, not just the kernel.
+HYDRO_TARGET_AVX2 static void pressuresAVX2(const float* height, float* pressure, int count, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(pressure + i, _mm256_mul_ps(_mm256_loadu_ps(height + i), s));
+	}
+	_mm256_zeroupper();
+	pressuresScalar(height + i, pressure + i, count - i, scale);
+}
+
+// Tubes point at arbitrary vessels, so the vessel data is collected with gather instructions.
+// The results go to per tube arrays; adding them into the vessels is done afterwards, since AVX2 has no scatter.
+HYDRO_TARGET_AVX2 static bool tubeFlowsAVX2(const TubeFlowData& tubes, int begin, int end, const VesselFlowData& vessels, const FlowStep& step)
+{
+	__m256 dt = _mm256_set1_ps(step.dt);
+	__m256 dtSquaredScale = _mm256_set1_ps(step.dtSquaredScale);
+	__m256 restFlow = _mm256_set1_ps(step.restFlow);
+	__m256 restPressure = _mm256_set1_ps(step.restPressure);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	__m256 anyMoved = zero;
+
+	int t = begin;
+	for (; t + 8 <= end; t += 8)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(tubes.tubeA + t));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(tubes.tubeB + t));
+
+		__m256 pressureA = _mm256_add_ps(_mm256_i32gather_ps(vessels.pressure, a, 4), _mm256_i32gather_ps(vessels.externalPressure, a, 4));
+		__m256 pressureB = _mm256_add_ps(_mm256_i32gather_ps(vessels.pressure, b, 4), _mm256_i32gather_ps(vessels.externalPressure, b, 4));
+		__m256 difference = _mm256_sub_ps(pressureB, pressureA);
+
+		__m256 invInertance = _mm256_loadu_ps(tubes.invInertance + t);
+		__m256 numerator = _mm256_add_ps(_mm256_loadu_ps(tubes.flow + t), _mm256_mul_ps(_mm256_mul_ps(dt, difference), invInertance));
+		__m256 denominator = _mm256_add_ps(_mm256_add_ps(one, _mm256_mul_ps(dt, _mm256_loadu_ps(tubes.damping + t))),
+			_mm256_mul_ps(_mm256_mul_ps(dtSquaredScale, _mm256_loadu_ps(tubes.stiffness + t)), invInertance));
+		__m256 flow = _mm256_div_ps(numerator, denominator);
+
+		// Instead of branching, build a mask of the tubes that are at rest and zero out their flow.
+		__m256 atRest = _mm256_and_ps(_mm256_cmp_ps(_mm256_and_ps(flow, absMask), restFlow, _CMP_LT_OQ),
+			_mm256_cmp_ps(_mm256_and_ps(difference, absMask), restPressure, _CMP_LT_OQ));
+		flow = _mm256_andnot_ps(atRest, flow);
+
+		// min and max pick their second operand unless the first is smaller (or larger), exactly like the scalar version.
+		__m256 volume = _mm256_mul_ps(flow, dt);
+		__m256 limitIntoA = _mm256_mul_ps(_mm256_i32gather_ps(vessels.height, b, 4), _mm256_i32gather_ps(vessels.drainShare, b, 4));
+		__m256 limitIntoB = _mm256_xor_ps(_mm256_mul_ps(_mm256_i32gather_ps(vessels.height, a, 4), _mm256_i32gather_ps(vessels.drainShare, a, 4)), signMask);
+		volume = _mm256_min_ps(volume, limitIntoA);
+		volume = _mm256_max_ps(volume, limitIntoB);
+
+		_mm256_storeu_ps(tubes.flow + t, _mm256_div_ps(volume, dt));
+		_mm256_storeu_ps(tubes.change + t, volume);
+
+		anyMoved = _mm256_or_ps(anyMoved, _mm256_cmp_ps(volume, zero, _CMP_NEQ_UQ));
+	}
+
+	bool moved = _mm256_movemask_ps(anyMoved) != 0;
+	_mm256_zeroupper();
+	moved |= tubeFlowsScalar(tubes, t, end, vessels, step);
+	return moved;
+}
+
+HYDRO_TARGET_AVX2 static void applyAVX2(float* height, const float* delta, const float* bottom, float* top, int count)
+{
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 h = _mm256_add_ps(_mm256_loadu_ps(height + i), _mm256_loadu_ps(delta + i));
+		_mm256_storeu_ps(height + i, h);
+		_mm256_storeu_ps(top + i, _mm256_add_ps(_mm256_loadu_ps(bottom + i), h));
+	}
+	_mm256_zeroupper();
+	applyScalar(height + i, delta + i, bottom + i, top + i, count - i);
+}
+
+// profileLookup() for eight positions in eight tables, which start at the entries base.
+HYDRO_TARGET_AVX2 static inline __m256 profileLookupAVX2(const float* tables, __m256i base, __m256 position)
+{
+	position = _mm256_max_ps(position, _mm256_setzero_ps());
+	__m256i k = _mm256_min_epi32(_mm256_cvttps_epi32(position), _mm256_set1_epi32(PROFILE_SAMPLES - 1));
+	__m256 f = _mm256_min_ps(_mm256_sub_ps(position, _mm256_cvtepi32_ps(k)), _mm256_set1_ps(1.0f));
+	__m256i index = _mm256_add_epi32(base, k);
+	__m256 low = _mm256_i32gather_ps(tables, index, 4);
+	__m256 high = _mm256_i32gather_ps(tables, _mm256_add_epi32(index, _mm256_set1_epi32(1)), 4);
+	return _mm256_add_ps(low, _mm256_mul_ps(f, _mm256_sub_ps(high, low)));
+}
+
+// The profiled vessels are scattered over the network, so everything about them is gathered, and the results are stored one by one.
+HYDRO_TARGET_AVX2 static void profileApplyAVX2(const ProfileData& profiles, int begin, int end, float* height, const float* delta, const float* width,
+	const float* bottom, float* top)
+{
+	__m256 zero = _mm256_setzero_ps();
+	int j = begin;
+	for (; j + 8 <= end; j += 8)
+	{
+		__m256i i = _mm256_loadu_si256((const __m256i*)(profiles.vessel + j));
+		__m256i p = _mm256_loadu_si256((const __m256i*)(profiles.profile + j));
+		__m256i base = _mm256_mullo_epi32(p, _mm256_set1_epi32(PROFILE_SAMPLES + 1));
+		__m256 d = _mm256_i32gather_ps(delta, i, 4);
+		__m256 before = _mm256_sub_ps(_mm256_i32gather_ps(height, i, 4), d);
+
+		__m256 above = _mm256_sub_ps(before, _mm256_i32gather_ps(profiles.depth, p, 4));
+		__m256 volume = _mm256_add_ps(profileLookupAVX2(profiles.volumeTable, base, _mm256_mul_ps(before, _mm256_i32gather_ps(profiles.heightScale, p, 4))),
+			_mm256_mul_ps(_mm256_max_ps(above, zero), _mm256_i32gather_ps(profiles.topWidth, p, 4)));
+		__m256 after = _mm256_add_ps(volume, _mm256_mul_ps(d, _mm256_i32gather_ps(width, i, 4)));
+
+		__m256 fullVolume = _mm256_i32gather_ps(profiles.fullVolume, p, 4);
+		__m256 volumeScale = _mm256_i32gather_ps(profiles.volumeScale, p, 4);
+		__m256 topWidth = _mm256_i32gather_ps(profiles.topWidth, p, 4);
+		__m256 from = _mm256_add_ps(profileLookupAVX2(profiles.heightTable, base, _mm256_mul_ps(volume, volumeScale)),
+			_mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(volume, fullVolume), zero), topWidth));
+		__m256 to = _mm256_add_ps(profileLookupAVX2(profiles.heightTable, base, _mm256_mul_ps(after, volumeScale)),
+			_mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(after, fullVolume), zero), topWidth));
+		__m256 h = _mm256_max_ps(_mm256_add_ps(before, _mm256_sub_ps(to, from)), zero);
+		__m256 t = _mm256_add_ps(_mm256_i32gather_ps(bottom, i, 4), h);
+
+		alignas(32) int index[8];
+		alignas(32) float heights[8];
+		alignas(32) float tops[8];
+		_mm256_store_si256((__m256i*)index, i);
+		_mm256_store_ps(heights, h);
+		_mm256_store_ps(tops, t);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			height[index[lane]] = heights[lane];
+			top[index[lane]] = tops[lane];
+		}
+	}
+	_mm256_zeroupper();
+	profileApplyScalar(profiles, j, end, height, delta, width, bottom, top);
+}
+
+HYDRO_TARGET_AVX2 static void stencilAVX2(const StencilRow& row, const float* x, float* y)
+{
+	const float* below = x - row.strideBelow;
+	const float* above = x + row.stride;
+	const float* linkDown = row.linkUp - row.strideBelow;
+	int i = 0;
+	for (; i + 8 <= row.count; i += 8)
+	{
+		__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(row.diagonal + i), _mm256_loadu_ps(x + i));
+		sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(row.linkRight + i - 1), _mm256_loadu_ps(x + i - 1)));
+		sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(row.linkRight + i), _mm256_loadu_ps(x + i + 1)));
+		sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(linkDown + i), _mm256_loadu_ps(below + i)));
+		sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(row.linkUp + i), _mm256_loadu_ps(above + i)));
+		_mm256_storeu_ps(y + i, sum);
+	}
+	_mm256_zeroupper();
+	stencilRange(row, x, y, i);
+}
+
+HYDRO_TARGET_AVX2 static void relaxAVX2(const StencilRow& row, const float* rhs, const float* from, float* to, int parity)
+{
+	const float* below = from - row.strideBelow;
+	const float* above = from + row.stride;
+	const float* linkDown = row.linkUp - row.strideBelow;
+	__m256 keep = parity < 0 ? _mm256_setzero_ps() : _mm256_castsi256_ps(parity == 0
+		? _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0) : _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+	__m256i rotate = _mm256_set_epi32(6, 5, 4, 3, 2, 1, 0, 7);
+	__m256 previous = _mm256_set1_ps(from[-1]);
+	int i = 0;
+	for (; i + 8 <= row.count; i += 8)
+	{
+		// left = (previous[7], center[0], ..., center[6])
+		__m256 center = _mm256_loadu_ps(from + i);
+		__m256 left = _mm256_blend_ps(_mm256_permutevar8x32_ps(center, rotate), _mm256_permutevar8x32_ps(previous, rotate), 0x01);
+		previous = center;
+
+		__m256 sum = _mm256_loadu_ps(rhs + i);
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(row.linkRight + i - 1), left));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(row.linkRight + i), _mm256_loadu_ps(from + i + 1)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(linkDown + i), _mm256_loadu_ps(below + i)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(row.linkUp + i), _mm256_loadu_ps(above + i)));
+		sum = _mm256_mul_ps(sum, _mm256_loadu_ps(row.inverseDiagonal + i));
+		_mm256_storeu_ps(to + i, _mm256_blendv_ps(sum, center, keep));
+	}
+	_mm256_zeroupper();
+	relaxRange(row, rhs, from, to, parity, i);
+}
+
+HYDRO_TARGET_AVX2 static void shallowAVX2(const ShallowRow& row)
+{
+	__m256 dry = _mm256_set1_ps(row.dry);
+	__m256 gravity = _mm256_set1_ps(row.gravity);
+	__m256 halfGravity = _mm256_set1_ps(0.5f * row.gravity);
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	int k = 0;
+	for (; k + 8 < row.count; k += 8)
+	{
+		__m256 depthLeft = _mm256_loadu_ps(row.depth + k);
+		__m256 depthRight = _mm256_loadu_ps(row.depth + k + 1);
+		__m256 dischargeLeft = _mm256_loadu_ps(row.discharge + k);
+		__m256 dischargeRight = _mm256_loadu_ps(row.discharge + k + 1);
+		__m256 velocityLeft = _mm256_and_ps(_mm256_cmp_ps(depthLeft, dry, _CMP_GT_OQ), _mm256_div_ps(dischargeLeft, _mm256_max_ps(depthLeft, dry)));
+		__m256 velocityRight = _mm256_and_ps(_mm256_cmp_ps(depthRight, dry, _CMP_GT_OQ), _mm256_div_ps(dischargeRight, _mm256_max_ps(depthRight, dry)));
+
+		__m256 momentumLeft = _mm256_add_ps(_mm256_mul_ps(dischargeLeft, velocityLeft), _mm256_mul_ps(_mm256_mul_ps(halfGravity, depthLeft), depthLeft));
+		__m256 momentumRight = _mm256_add_ps(_mm256_mul_ps(dischargeRight, velocityRight), _mm256_mul_ps(_mm256_mul_ps(halfGravity, depthRight), depthRight));
+		__m256 waveLeft = _mm256_add_ps(_mm256_andnot_ps(sign, velocityLeft), _mm256_sqrt_ps(_mm256_mul_ps(gravity, depthLeft)));
+		__m256 waveRight = _mm256_add_ps(_mm256_andnot_ps(sign, velocityRight), _mm256_sqrt_ps(_mm256_mul_ps(gravity, depthRight)));
+		__m256 halfWave = _mm256_mul_ps(half, _mm256_max_ps(waveLeft, waveRight));
+
+		_mm256_storeu_ps(row.depthFlux + k, _mm256_sub_ps(_mm256_mul_ps(half, _mm256_add_ps(dischargeLeft, dischargeRight)),
+			_mm256_mul_ps(halfWave, _mm256_sub_ps(depthRight, depthLeft))));
+		_mm256_storeu_ps(row.dischargeFlux + k, _mm256_sub_ps(_mm256_mul_ps(half, _mm256_add_ps(momentumLeft, momentumRight)),
+			_mm256_mul_ps(halfWave, _mm256_sub_ps(dischargeRight, dischargeLeft))));
+	}
+	_mm256_zeroupper();
+	shallowRange(row, k);
+}
+
+// advectCell() for eight cells. The slots of their tiles are only gathered where the cells are inside the grid.
+HYDRO_TARGET_AVX2 static inline __m256i advectCellAVX2(const AdvectGrid& grid, __m256i x, __m256i y)
+{
+	__m256i none = _mm256_set1_epi32(-1);
+	__m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(grid.columns), x), _mm256_cmpgt_epi32(_mm256_set1_epi32(grid.rows), y));
+	__m256i tile = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(y, GRID_TILE_BITS), _mm256_set1_epi32(grid.tileColumns)),
+		_mm256_srai_epi32(x, GRID_TILE_BITS));
+	__m256i slot = _mm256_mask_i32gather_epi32(none, grid.slots, tile, inside, 4);
+	__m256i within = _mm256_set1_epi32(GRID_TILE - 1);
+	__m256i cell = _mm256_add_epi32(_mm256_slli_epi32(slot, 2 * GRID_TILE_BITS),
+		_mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(y, within), GRID_TILE_BITS), _mm256_and_si256(x, within)));
+	return _mm256_blendv_epi8(cell, none, _mm256_cmpgt_epi32(_mm256_setzero_si256(), slot));
+}
+
+// The values of a field at eight cells, or 0 where there is no cell: the missing cells are masked out of the gather.
+HYDRO_TARGET_AVX2 static inline __m256 advectValueAVX2(const float* field, __m256i cell)
+{
+	__m256 found = _mm256_castsi256_ps(_mm256_cmpgt_epi32(cell, _mm256_set1_epi32(-1)));
+	return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), field, cell, found, 4);
+}
+
+// The corners and weights of the bilinear sample at (x, y) of a width x height field, clamped to its edges.
+HYDRO_TARGET_AVX2 static inline void advectCornersAVX2(const AdvectGrid& grid, int width, int height, __m256 x, __m256 y, __m256i* cell, __m256& fx,
+	__m256& fy)
+{
+	__m256i one = _mm256_set1_epi32(1);
+	x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps((float)(width - 1)));
+	y = _mm256_min_ps(_mm256_max_ps(y, _mm256_setzero_ps()), _mm256_set1_ps((float)(height - 1)));
+	__m256i x0 = _mm256_max_epi32(_mm256_min_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32(width - 2)), _mm256_setzero_si256());
+	__m256i y0 = _mm256_max_epi32(_mm256_min_epi32(_mm256_cvttps_epi32(y), _mm256_set1_epi32(height - 2)), _mm256_setzero_si256());
+	__m256i x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), _mm256_set1_epi32(width - 1));
+	__m256i y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), _mm256_set1_epi32(height - 1));
+	fx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+	fy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+	cell[0] = advectCellAVX2(grid, x0, y0);
+	cell[1] = advectCellAVX2(grid, x1, y0);
+	cell[2] = advectCellAVX2(grid, x0, y1);
+	cell[3] = advectCellAVX2(grid, x1, y1);
+}
+
+HYDRO_TARGET_AVX2 static inline __m256 advectBilinearAVX2(const AdvectGrid& grid, const float* field, int width, int height, __m256 x, __m256 y)
+{
+	__m256i cell[4];
+	__m256 fx, fy;
+	advectCornersAVX2(grid, width, height, x, y, cell, fx, fy);
+	__m256 bottomLeft = advectValueAVX2(field, cell[0]);
+	__m256 topLeft = advectValueAVX2(field, cell[2]);
+	__m256 bottom = _mm256_add_ps(bottomLeft, _mm256_mul_ps(_mm256_sub_ps(advectValueAVX2(field, cell[1]), bottomLeft), fx));
+	__m256 top = _mm256_add_ps(topLeft, _mm256_mul_ps(_mm256_sub_ps(advectValueAVX2(field, cell[3]), topLeft), fx));
+	return _mm256_add_ps(bottom, _mm256_mul_ps(_mm256_sub_ps(top, bottom), fy));
+}
+
+HYDRO_TARGET_AVX2 static inline __m256 advectUAVX2(const AdvectGrid& grid, __m256 x, __m256 y)
+{
+	return advectBilinearAVX2(grid, grid.u, grid.columns + 1, grid.rows, x, _mm256_sub_ps(y, _mm256_set1_ps(0.5f)));
+}
+
+HYDRO_TARGET_AVX2 static inline __m256 advectVAVX2(const AdvectGrid& grid, __m256 x, __m256 y)
+{
+	return advectBilinearAVX2(grid, grid.v, grid.columns, grid.rows + 1, _mm256_sub_ps(x, _mm256_set1_ps(0.5f)), y);
+}
+
+HYDRO_TARGET_AVX2 static inline __m256 advectFractionAVX2(const AdvectGrid& grid, __m256 x, __m256 y)
+{
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256i cell[4];
+	__m256 fx, fy;
+	advectCornersAVX2(grid, grid.columns, grid.rows, _mm256_sub_ps(x, half), _mm256_sub_ps(y, half), cell, fx, fy);
+	__m256 weight[4] = { _mm256_mul_ps(_mm256_sub_ps(one, fx), _mm256_sub_ps(one, fy)), _mm256_mul_ps(fx, _mm256_sub_ps(one, fy)),
+		_mm256_mul_ps(_mm256_sub_ps(one, fx), fy), _mm256_mul_ps(fx, fy) };
+	__m256 sum = _mm256_setzero_ps();
+	__m256 total = _mm256_setzero_ps();
+	for (int k = 0; k < 4; k++)
+	{
+		__m256 open = advectValueAVX2(grid.open, cell[k]);
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_mul_ps(advectValueAVX2(grid.fraction, cell[k]), weight[k]), open));
+		total = _mm256_add_ps(total, _mm256_mul_ps(weight[k], open));
+	}
+	__m256 filled = _mm256_cmp_ps(total, _mm256_setzero_ps(), _CMP_GT_OQ);
+	// Where there is nothing to weigh, the division is thrown away.
+	return _mm256_and_ps(filled, _mm256_div_ps(sum, total));
+}
+
+HYDRO_TARGET_AVX2 static inline void traceBackAVX2(const AdvectGrid& grid, __m256 x, __m256 y, __m256 vx, __m256 vy, __m256& fromX, __m256& fromY)
+{
+	__m256 halfScale = _mm256_set1_ps(0.5f * grid.scale);
+	__m256 scale = _mm256_set1_ps(grid.scale);
+	__m256 midX = _mm256_sub_ps(x, _mm256_mul_ps(halfScale, vx));
+	__m256 midY = _mm256_sub_ps(y, _mm256_mul_ps(halfScale, vy));
+	fromX = _mm256_sub_ps(x, _mm256_mul_ps(scale, advectUAVX2(grid, midX, midY)));
+	fromY = _mm256_sub_ps(y, _mm256_mul_ps(scale, advectVAVX2(grid, midX, midY)));
+}
+
+// Eight bytes of a mask, as eight lanes that are all ones where the byte isn't 0.
+HYDRO_TARGET_AVX2 static inline __m256 advectMaskAVX2(const char* mask)
+{
+	__m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)mask));
+	return _mm256_castsi256_ps(_mm256_cmpgt_epi32(bytes, _mm256_setzero_si256()));
+}
+
+// Every cell is traced back for all three fields, and the masks clear the ones that are walls, instead of branching per cell.
+HYDRO_TARGET_AVX2 static void advectAVX2(const AdvectGrid& grid, int first, int x, int y, int count)
+{
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 zero = _mm256_setzero_ps();
+	__m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 py = _mm256_set1_ps((float)y);
+	__m256 pyHalf = _mm256_add_ps(py, half);
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		int cell = first + i;
+		__m256 px = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x + i), lanes));
+		__m256 pxHalf = _mm256_add_ps(px, half);
+		__m256 fromX, fromY;
+
+		traceBackAVX2(grid, px, pyHalf, _mm256_loadu_ps(grid.u + cell), advectVAVX2(grid, px, pyHalf), fromX, fromY);
+		_mm256_storeu_ps(grid.nextU + cell, _mm256_and_ps(advectMaskAVX2(grid.uOpen + cell), advectUAVX2(grid, fromX, fromY)));
+
+		traceBackAVX2(grid, pxHalf, py, advectUAVX2(grid, pxHalf, py), _mm256_loadu_ps(grid.v + cell), fromX, fromY);
+		_mm256_storeu_ps(grid.nextV + cell, _mm256_and_ps(advectMaskAVX2(grid.vOpen + cell), advectVAVX2(grid, fromX, fromY)));
+
+		__m256 open = _mm256_cmp_ps(_mm256_loadu_ps(grid.open + cell), zero, _CMP_NEQ_OQ);
+		traceBackAVX2(grid, pxHalf, pyHalf, advectUAVX2(grid, pxHalf, pyHalf), advectVAVX2(grid, pxHalf, pyHalf), fromX, fromY);
+		__m256 f = _mm256_min_ps(_mm256_max_ps(advectFractionAVX2(grid, fromX, fromY), zero), one);
+		_mm256_storeu_ps(grid.nextFraction + cell, _mm256_and_ps(open, f));
+	}
+	_mm256_zeroupper();
+	advectRange(grid, first, x, y, i, count);
+}
+
+// A whole block in one register per attribute.
+HYDRO_TARGET_AVX2 static int apparatusStepAVX2(ApparatusBlock& block, float scale, const FlowStep& step)
+{
+	__m256 dt = _mm256_set1_ps(step.dt);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	__m256 awake = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)block.awake));
+	__m256 big = _mm256_loadu_ps(block.bigHeight);
+	__m256 small = _mm256_loadu_ps(block.smallHeight);
+	__m256 bigWidth = _mm256_loadu_ps(block.bigWidth);
+	__m256 smallWidth = _mm256_loadu_ps(block.smallWidth);
+
+	__m256 s = _mm256_set1_ps(scale);
+	__m256 difference = _mm256_sub_ps(_mm256_mul_ps(small, s), _mm256_add_ps(_mm256_mul_ps(big, s), _mm256_loadu_ps(block.pressure)));
+	__m256 invInertance = _mm256_loadu_ps(block.invInertance);
+	__m256 numerator = _mm256_add_ps(_mm256_loadu_ps(block.flow), _mm256_mul_ps(_mm256_mul_ps(dt, difference), invInertance));
+	__m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(dt, _mm256_loadu_ps(block.damping))),
+		_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(step.dtSquaredScale), _mm256_loadu_ps(block.stiffness)), invInertance));
+	__m256 flow = _mm256_div_ps(numerator, denominator);
+	__m256 atRest = _mm256_and_ps(_mm256_cmp_ps(_mm256_and_ps(flow, absMask), _mm256_set1_ps(step.restFlow), _CMP_LT_OQ),
+		_mm256_cmp_ps(_mm256_and_ps(difference, absMask), _mm256_set1_ps(step.restPressure), _CMP_LT_OQ));
+	flow = _mm256_andnot_ps(atRest, flow);
+
+	__m256 volume = _mm256_mul_ps(flow, dt);
+	volume = _mm256_min_ps(volume, _mm256_mul_ps(small, smallWidth));
+	volume = _mm256_max_ps(volume, _mm256_xor_ps(_mm256_mul_ps(big, bigWidth), signMask));
+	_mm256_storeu_ps(block.flow, _mm256_blendv_ps(_mm256_loadu_ps(block.flow), _mm256_div_ps(volume, dt), awake));
+
+	__m256 moved = _mm256_and_ps(awake, _mm256_cmp_ps(volume, zero, _CMP_NEQ_UQ));
+	big = _mm256_blendv_ps(big, _mm256_add_ps(big, _mm256_div_ps(volume, bigWidth)), moved);
+	small = _mm256_blendv_ps(small, _mm256_add_ps(small, _mm256_div_ps(_mm256_xor_ps(volume, signMask), smallWidth)), moved);
+	_mm256_storeu_ps(block.bigHeight, big);
+	_mm256_storeu_ps(block.smallHeight, small);
+	_mm256_storeu_ps(block.lowest, _mm256_min_ps(big, _mm256_loadu_ps(block.lowest)));
+	_mm256_storeu_ps(block.highest, _mm256_max_ps(big, _mm256_loadu_ps(block.highest)));
+	_mm256_storeu_si256((__m256i*)block.awake, _mm256_castps_si256(moved));
+	int result = _mm256_movemask_ps(moved);
+	_mm256_zeroupper();
+	return result;
+}
+#pragma endregion AVX2
+#endif
+
+static const SimdKernels kernelTable[] =
+{
+	{ SIMD_SCALAR, "scalar", pressuresScalar, tubeFlowsScalar, applyScalar, profileApplyScalar, stencilScalar, relaxScalar, shallowScalar, advectScalar, apparatusStepScalar },
+#if HYDRO_X86
+	{ SIMD_SSE2, "SSE2", pressuresSSE2, tubeFlowsScalar, applySSE2, profileApplyScalar, stencilSSE2, relaxSSE2, shallowSSE2, advectScalar, apparatusStepSSE2 },
+	{ SIMD_AVX2, "AVX2", pressuresAVX2, tubeFlowsAVX2, applyAVX2, profileApplyAVX2, stencilAVX2, relaxAVX2, shallowAVX2, advectAVX2, apparatusStepAVX2 },
+#endif
+};
+
+SimdLevel detectSimdLevel()
+{
+#if HYDRO_X86
+	int info[4] = { 0, 0, 0, 0 };
+	int extended[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+	__cpuid(info, 1);
+	__cpuidex(extended, 7, 0);
+	unsigned long long xcr0 = (info[2] & (1 << 27)) ? _xgetbv(0) : 0;
+#else
+	__cpuid(1, info[0], info[1], info[2], info[3]);
+	__cpuid_count(7, 0, extended[0], extended[1], extended[2], extended[3]);
+	unsigned long long xcr0 = 0;
+	if (info[2] & (1 << 27))
+	{
+		unsigned int eax, edx;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		xcr0 = ((unsigned long long)edx << 32) | eax;
+	}
+#endif
+	// AVX2 needs the CPU to support it (leaf 7, EBX bit 5) and the OS to save the wide registers on a context switch (XCR0 bits 1 and 2).
+	bool osSavesYmm = (xcr0 & 6) == 6;
+	if (osSavesYmm && (extended[1] & (1 << 5)))
+	{
+		return SIMD_AVX2;
+	}
+
+	// Every x64 CPU has SSE2, but 32 bit ones might not (leaf 1, EDX bit 26).
+	if (info[3] & (1 << 26))
+	{
+		return SIMD_SSE2;
+	}
+#endif
+	return SIMD_SCALAR;
+}
+
+static SimdLevel activeLevel = detectSimdLevel();
+
+const SimdKernels& simdKernels()
+{
+	return kernelTable[activeLevel];
+}
+
+void setSimdLevel(SimdLevel level)
+{
+	SimdLevel best = detectSimdLevel();
+	activeLevel = level < best ? level : best;
+}
@@ -0,0 +1,212 @@
+/*
+Title: HydroDynamics
+File Name: SimdKernels.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+SIMD versions of the inner loops of VesselNetwork::update(), of the pressure solve of the
+grid (see GridPressureSolver.h), of its advection (see GridFluid.h), of the shallow water
+profiles (see ShallowWater.h) and of the batched apparatus of a sweep (see ApparatusBatch.h).
+Each loop has a plain
+scalar version that runs anywhere, an SSE2 version that works on 4 floats at a time
+and an AVX2 version that works on 8 floats at a time.
+
+Which version is used is decided once at runtime by asking the CPU what it supports,
+so the same executable runs on old and new machines and uses the widest instructions
+available on each of them.
+*/
+
+#ifndef _SIMD_KERNELS_H
+#define _SIMD_KERNELS_H
+
+enum SimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+// Everything the tube flow kernel reads and writes about the tubes. The arrays are indexed by tube.
+struct TubeFlowData
+{
+	const int* tubeA;
+	const int* tubeB;
+	const float* invInertance;
+	const float* damping;
+	const float* stiffness;
+	float* flow;		// In: the flow of the last step. Out: the flow of this step.
+	float* change;		// Out: the volume moved from B to A in this step.
+};
+
+// What it reads about the vessels. The arrays are indexed by vessel.
+struct VesselFlowData
+{
+	const float* height;
+	const float* pressure;
+	const float* externalPressure;
+	const float* drainShare;
+};
+
+struct FlowStep
+{
+	float dt;
+	float dtSquaredScale;	// dt * dt * density * gravity
+	float restFlow;			// A tube with less flow than this and
+	float restPressure;		// less difference in pressure than this is at rest.
+};
+
+// The profiled vessels (see VesselProfile.h), and the tables of their profiles.
+struct ProfileData
+{
+	const int* vessel;			// Per profiled vessel, in increasing order: its index
+	const int* profile;			// and its profile
+	const float* volumeTable;	// PROFILE_SAMPLES + 1 entries per profile
+	const float* heightTable;
+	const float* depth;			// Per profile
+	const float* fullVolume;
+	const float* topWidth;
+	const float* heightScale;
+	const float* volumeScale;
+};
+
+// One row of the 5 point stencil of the grid pressure solve. Every array points at the first cell of the row, and the neighbours of
+// every cell in the row, including the one before the first and the one after the last, have to be there to be read: the kernels
+// don't check for edges.
+struct StencilRow
+{
+	const float* diagonal;			// Per cell, the number of neighbours that aren't walls, or 0 if the cell isn't fluid
+	const float* inverseDiagonal;	// 1 / diagonal, or 0 if the cell isn't fluid
+	const float* linkRight;			// 1 if the cell and the one to its right are both fluid, otherwise 0
+	const float* linkUp;			// The same for the cell above it. The links of the row below start at linkUp - strideBelow.
+	int stride;						// Distance from a cell to the one above it
+	int strideBelow;				// Distance from a cell to the one below it, which is only not stride when the rows aren't evenly spaced
+	int count;						// Cells in the row
+};
+
+// One row of cells of a shallow water profile, and the fluxes across the faces between them. Face k is between cell k and cell
+// k + 1, so a row of count cells has count - 1 faces.
+struct ShallowRow
+{
+	const float* depth;
+	const float* discharge;		// Depth times velocity
+	float* depthFlux;			// Out: per face, the volume (per unit of width) crossing it per second
+	float* dischargeFlux;		// Out: per face, the same for the discharge
+	int count;					// Cells in the row
+	float gravity;
+	float dry;					// Cells shallower than this have no velocity
+};
+
+// The fields of the grid fluid, for tracing its cells back along the flow. The fields are stored in tiles (see GridTiles.h): slots
+// has the slot of every tile of the grid, and the cells of a tile are in rows of 8 from its first cell on. The masks are worked out
+// once when the grid is built, so the kernels don't have to look for walls.
+struct AdvectGrid
+{
+	const int* slots;
+	int tileColumns;
+	int columns;				// Cells of the grid
+	int rows;
+	const float* u;				// Per cell, the velocity of its left face
+	const float* v;				// and of its bottom face
+	const float* fraction;		// How full it is
+	const float* open;			// 1 if it isn't a wall, otherwise 0
+	const char* uOpen;			// Whether its left face is inside the grid and not next to a wall
+	const char* vOpen;			// The same for its bottom face
+	float* nextU;				// Out: the values traced back, 0 on the walls
+	float* nextV;
+	float* nextFraction;
+	float scale;				// How far a velocity moves something in one step, in cells
+};
+
+// The number of apparatus in one block of an ApparatusBatch: one AVX2 register of floats.
+#define BATCH_LANES 8
+
+// A block of independent copies of the classic apparatus (a big vessel, a small vessel and a tube from the small one to the big
+// one), one per lane, with every attribute of all of them next to each other. An array of these is an array of structures of
+// arrays, so a kernel loads one attribute of a whole block into a register instead of gathering it.
+struct ApparatusBlock
+{
+	float bigHeight[BATCH_LANES];
+	float smallHeight[BATCH_LANES];
+	float bigWidth[BATCH_LANES];
+	float smallWidth[BATCH_LANES];
+	float pressure[BATCH_LANES];		// Pushing on the big vessel from outside
+	float invInertance[BATCH_LANES];
+	float damping[BATCH_LANES];
+	float stiffness[BATCH_LANES];		// 1 / bigWidth + 1 / smallWidth
+	float flow[BATCH_LANES];			// From the small vessel into the big one
+	float lowest[BATCH_LANES];			// The lowest and the highest the big vessel has stood
+	float highest[BATCH_LANES];
+	int awake[BATCH_LANES];				// -1 while the lane moves, 0 once it came to rest (and for lanes without an apparatus)
+};
+
+// A table of function pointers, one per kernel. All versions of a kernel produce the same results.
+struct SimdKernels
+{
+	SimdLevel level;
+	const char* name;
+
+	// pressure[i] = height[i] * scale
+	void(*pressures)(const float* height, float* pressure, int count, float scale);
+
+	// Advances the flow of tubes begin to end - 1 by one step and computes the volume each of them moves (0 if it is at rest).
+	// Returns true if any of them moved anything.
+	bool(*tubeFlows)(const TubeFlowData& tubes, int begin, int end, const VesselFlowData& vessels, const FlowStep& step);
+
+	// height[i] += delta[i], top[i] = bottom[i] + height[i]
+	void(*apply)(float* height, const float* delta, const float* bottom, float* top, int count);
+
+	// For the profiled vessels begin to end - 1, after apply() moved them by delta as if they were rectangles: moves them by the
+	// same volume (delta * width) through their profile instead, and sets their top again.
+	void(*profileApply)(const ProfileData& profiles, int begin, int end, float* height, const float* delta, const float* width, const float* bottom,
+		float* top);
+
+	// y = A x over a row: diagonal * x minus x of every linked neighbour.
+	void(*stencil)(const StencilRow& row, const float* x, float* y);
+
+	// to[i] = (rhs[i] + from of every linked neighbour) * inverseDiagonal[i], which solves cell i given its neighbours.
+	// With parity 0 or 1 only the cells at even or odd positions in the row are written, and from is the same array as to: their
+	// neighbours in the row and the rows next to it are all of the other parity, so this is half of a red-black Gauss-Seidel sweep.
+	// With parity -1 every cell is written, which is a Jacobi sweep, and from and to have to be different arrays.
+	void(*relax)(const StencilRow& row, const float* rhs, const float* from, float* to, int parity);
+
+	// The Rusanov (local Lax-Friedrichs) flux of the shallow water equations across every face of a row.
+	void(*shallowFluxes)(const ShallowRow& row);
+
+	// Semi-Lagrangian advection of count cells of a row, from cell first at (x, y) on: traces the faces and the middle of every cell
+	// back along the flow and samples u, v and fraction where they came from. cell first + i has to be at (x + i, y), so the cells
+	// can't leave their tile row.
+	void(*advect)(const AdvectGrid& grid, int first, int x, int y, int count);
+
+	// Steps every awake lane of a block exactly like VesselNetwork::update() steps the same apparatus in single precision with the
+	// local integrator, to the last bit, and puts the lanes where nothing moved to sleep. Returns a mask of the lanes still awake.
+	int(*apparatusStep)(ApparatusBlock& block, float scale, const FlowStep& step);
+};
+
+// Asks the CPU which instruction sets it supports.
+SimdLevel detectSimdLevel();
+
+// Returns the kernels for the best level this CPU supports (or the level forced with setSimdLevel()).
+const SimdKernels& simdKernels();
+
+// Forces a specific level, for example to compare them in a benchmark. Levels the CPU doesn't support fall back to the best one it does.
+void setSimdLevel(SimdLevel level);
+
+#endif // _SIMD_KERNELS_H
@@ -0,0 +1,651 @@
+/*
+Title: HydroDynamics
+File Name: SparseMatrix.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A sparse matrix in compressed sparse row (CSR) form, and an incomplete Cholesky
+factorization of it for use as a preconditioner.
+
+In CSR form the non-zero entries are stored row after row: row i owns the entries
+rowStart[i] to rowStart[i + 1] - 1, whose column numbers are in column and values in
+value. Within a row the columns are sorted. Multiplying by the matrix streams through the
+three arrays once, and rows are independent, so it splits across cores in blocks.
+
+The incomplete Cholesky factorization (IC(0)) finds a lower triangular L with the same
+pattern as the lower half of the matrix so that L L^T is close to it. Applying it takes a
+forward and a backward substitution. Those run row after row, so unlike the multiply they
+stay on one thread.
+
+The complete Cholesky factorization (SparseCholesky) finds the exact L, which fills in
+entries the matrix doesn't have. How much depends on the order the rows are eliminated in,
+so the rows are first put in minimum degree order, which always eliminates the row with
+the fewest remaining neighbours next. Working out that order and the pattern of L only
+needs the pattern of the matrix, so it is done once (analyse()), and the numbers are filled
+in separately (factor()) whenever the values change. Solving with the factor is then only
+the two substitutions.
+
+Small changes to the matrix don't need either. A change of one diagonal entry is a rank one
+update of L L^T, which only touches the columns on the way from that row to the last one
+in the elimination tree (the tree in which the parent of a column is the first row below
+its diagonal). Rows and columns added at the end are eliminated last, after all the old
+ones: every new row of L comes from a sparse forward substitution with the old L, and the
+few new columns from a small dense factorization of what is left. Both keep the old
+elimination order, so after many additions the factor fills in more than a new analysis
+would make it.
+*/
+
+#include "SparseMatrix.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <set>
+
+// Matrices with fewer rows than this are multiplied on one thread.
+#define SPARSE_PARALLEL_MIN 8192
+#define SPARSE_BLOCK_SIZE 4096
+
+// The most entries SparseCholesky keeps in L (a little over 256 MB with their rows). Networks that would need more are left to
+// the iterative solve.
+#define CHOLESKY_MAX_NONZEROS (32 * 1024 * 1024)
+
+void SparseMatrix::multiply(const float* x, float* y, TaskPool* pool) const
+{
+	const int* start = rowStart.data();
+	const int* col = column.data();
+	const float* val = value.data();
+
+	auto multiplyRows = [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float sum = 0.0f;
+			for (int k = start[i]; k < start[i + 1]; k++)
+			{
+				sum += val[k] * x[col[k]];
+			}
+			y[i] = sum;
+		}
+	};
+
+	if (pool != nullptr && rows >= SPARSE_PARALLEL_MIN)
+	{
+		pool->parallelFor(rows, SPARSE_BLOCK_SIZE, multiplyRows);
+	}
+	else
+	{
+		multiplyRows(0, rows);
+	}
+}
+
+int SparseMatrix::find(int row, int col) const
+{
+	const int* begin = column.data() + rowStart[row];
+	const int* end = column.data() + rowStart[row + 1];
+	const int* found = std::lower_bound(begin, end, col);
+	return (found != end && *found == col) ? (int)(found - column.data()) : -1;
+}
+
+bool IncompleteCholesky::tryFactor(const SparseMatrix& matrix, float diagonalShift)
+{
+	int n = matrix.rows;
+
+	// Copy the lower half of every row (columns up to and including the diagonal).
+	lower.rows = n;
+	lower.rowStart.assign(n + 1, 0);
+	lower.column.clear();
+	lower.value.clear();
+	for (int i = 0; i < n; i++)
+	{
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1]; k++)
+		{
+			int j = matrix.column[k];
+			if (j <= i)
+			{
+				lower.column.push_back(j);
+				lower.value.push_back(j == i ? matrix.value[k] * (1.0f + diagonalShift) : matrix.value[k]);
+			}
+		}
+		lower.rowStart[i + 1] = (int)lower.column.size();
+
+		// Every row needs its diagonal, as the last entry.
+		if (lower.rowStart[i + 1] == lower.rowStart[i] || lower.column.back() != i)
+		{
+			return false;
+		}
+	}
+
+	// Row by row: L[i][j] = (A[i][j] - sum over m < j of L[i][m] L[j][m]) / L[j][j], and L[i][i] = sqrt(A[i][i] - sum of L[i][m]^2).
+	// Both sums only run over the pattern, which is what makes the factorization incomplete.
+	for (int i = 0; i < n; i++)
+	{
+		int rowEnd = lower.rowStart[i + 1];
+		for (int k = lower.rowStart[i]; k < rowEnd; k++)
+		{
+			int j = lower.column[k];
+
+			// Sparse dot product of row i and row j over the columns before j. Both rows are sorted, so it is a merge.
+			double sum = 0.0;
+			int a = lower.rowStart[i];
+			int b = lower.rowStart[j];
+			int bEnd = lower.rowStart[j + 1] - 1;	// Skip the diagonal of row j
+			while (a < k && b < bEnd)
+			{
+				int ca = lower.column[a];
+				int cb = lower.column[b];
+				if (ca == cb)
+				{
+					sum += (double)lower.value[a] * lower.value[b];
+					a++;
+					b++;
+				}
+				else if (ca < cb)
+				{
+					a++;
+				}
+				else
+				{
+					b++;
+				}
+			}
+
+			if (j < i)
+			{
+				lower.value[k] = (float)((lower.value[k] - sum) / lower.value[lower.rowStart[j + 1] - 1]);
+			}
+			else
+			{
+				double pivot = lower.value[k] - sum;
+				if (pivot <= 0.0)
+				{
+					return false;
+				}
+				lower.value[k] = (float)std::sqrt(pivot);
+			}
+		}
+	}
+	return true;
+}
+
+void IncompleteCholesky::factor(const SparseMatrix& matrix)
+{
+	shift = 0.0f;
+	while (!tryFactor(matrix, shift))
+	{
+		shift = shift == 0.0f ? 1e-3f : shift * 2.0f;
+	}
+	scratch.resize(matrix.rows);
+}
+
+void IncompleteCholesky::apply(const float* r, float* z) const
+{
+	int n = lower.rows;
+	const int* start = lower.rowStart.data();
+	const int* col = lower.column.data();
+	const float* val = lower.value.data();
+	float* y = const_cast<float*>(scratch.data());
+
+	// Forward: L y = r
+	for (int i = 0; i < n; i++)
+	{
+		double sum = r[i];
+		int diagonal = start[i + 1] - 1;
+		for (int k = start[i]; k < diagonal; k++)
+		{
+			sum -= (double)val[k] * y[col[k]];
+		}
+		y[i] = (float)(sum / val[diagonal]);
+	}
+
+	// Backward: L^T z = y. L^T is only stored by rows of L, so every solved z[i] is pushed out to the rows it appears in.
+	for (int i = 0; i < n; i++)
+	{
+		z[i] = y[i];
+	}
+	for (int i = n - 1; i >= 0; i--)
+	{
+		int diagonal = start[i + 1] - 1;
+		z[i] /= val[diagonal];
+		for (int k = start[i]; k < diagonal; k++)
+		{
+			z[col[k]] -= val[k] * z[i];
+		}
+	}
+}
+
+bool SparseCholesky::analyse(const SparseMatrix& matrix)
+{
+	int n = matrix.rows;
+	order.clear();
+	position.clear();
+	columnStart.clear();
+	row.clear();
+	value.clear();
+
+	// The neighbours every row has among the rows that haven't been eliminated yet, sorted.
+	std::vector<std::vector<int>> neighbours(n);
+	for (int i = 0; i < n; i++)
+	{
+		for (int k = matrix.rowStart[i]; k < matrix.rowStart[i + 1]; k++)
+		{
+			if (matrix.column[k] != i)
+			{
+				neighbours[i].push_back(matrix.column[k]);
+			}
+		}
+	}
+
+	// The rows by how many neighbours they have left, the fewest first and the lowest row among equals, so the order only
+	// depends on the pattern.
+	std::set<std::pair<int, int>> degree;
+	for (int i = 0; i < n; i++)
+	{
+		degree.insert({ (int)neighbours[i].size(), i });
+	}
+
+	// Eliminating a row connects all of its neighbours with each other, which is where the fill comes from. The neighbours it has
+	// left at that point are exactly the rows below the diagonal in its column of L, so the pattern comes out of the same loop.
+	order.resize(n);
+	position.resize(n);
+	columnStart.assign(n + 1, 0);
+	std::vector<int> below;
+	std::vector<int> merged;
+	long long entries = 0;
+	for (int k = 0; k < n; k++)
+	{
+		int v = degree.begin()->second;
+		degree.erase(degree.begin());
+		order[k] = v;
+		position[v] = k;
+
+		std::vector<int>& adjacent = neighbours[v];
+		entries += 1 + (long long)adjacent.size();
+		if (entries > CHOLESKY_MAX_NONZEROS)
+		{
+			order.clear();
+			position.clear();
+			columnStart.clear();
+			return false;
+		}
+		below.insert(below.end(), adjacent.begin(), adjacent.end());
+		columnStart[k + 1] = (int)below.size();
+
+		for (int u : adjacent)
+		{
+			std::vector<int>& other = neighbours[u];
+			merged.clear();
+			std::set_union(other.begin(), other.end(), adjacent.begin(), adjacent.end(), std::back_inserter(merged));
+			merged.erase(std::remove_if(merged.begin(), merged.end(), [&](int w) { return w == u || w == v; }), merged.end());
+
+			degree.erase({ (int)other.size(), u });
+			other.swap(merged);
+			degree.insert({ (int)other.size(), u });
+		}
+		std::vector<int>().swap(adjacent);
+	}
+
+	// Renumber the rows in elimination order and put every diagonal in front of its column.
+	row.resize(n + below.size());
+	for (int j = 0; j < n; j++)
+	{
+		int begin = columnStart[j];
+		int end = columnStart[j + 1];
+		int to = begin + j;
+		row[to] = j;
+		for (int k = begin; k < end; k++)
+		{
+			row[to + 1 + k - begin] = position[below[k]];
+		}
+		std::sort(row.begin() + to + 1, row.begin() + to + 1 + (end - begin));
+	}
+	for (int j = 1; j <= n; j++)
+	{
+		columnStart[j] += j;
+	}
+	return true;
+}
+
+bool SparseCholesky::factor(const SparseMatrix& matrix)
+{
+	int n = (int)order.size();
+	if (n != matrix.rows)
+	{
+		return false;
+	}
+	value.resize(row.size());
+	accumulator.assign(n, 0.0);
+	pending.assign(n, -1);
+	nextPending.assign(n, -1);
+	firstBelow.assign(n, 0);
+
+	// Column by column (left looking). pending[j] starts the list, linked through nextPending, of the earlier columns with an
+	// entry in row j, and firstBelow[c] is where that entry is in column c.
+	for (int j = 0; j < n; j++)
+	{
+		// Column j of the matrix in elimination order. The matrix is symmetric, so that is its row order[j].
+		int original = order[j];
+		for (int k = matrix.rowStart[original]; k < matrix.rowStart[original + 1]; k++)
+		{
+			int i = position[matrix.column[k]];
+			if (i >= j)
+			{
+				accumulator[i] = matrix.value[k];
+			}
+		}
+
+		// L[i][j] -= L[i][c] * L[j][c] over the rows i >= j of every column c in the list. Afterwards c moves on to the list of
+		// the next row it has an entry in.
+		int c = pending[j];
+		while (c >= 0)
+		{
+			int next = nextPending[c];
+			int p = firstBelow[c];
+			int end = columnStart[c + 1];
+			double entry = value[p];
+			for (int q = p; q < end; q++)
+			{
+				accumulator[row[q]] -= (double)value[q] * entry;
+			}
+			if (++p < end)
+			{
+				firstBelow[c] = p;
+				nextPending[c] = pending[row[p]];
+				pending[row[p]] = c;
+			}
+			c = next;
+		}
+
+		double pivot = accumulator[j];
+		accumulator[j] = 0.0;
+		if (!(pivot > 0.0))
+		{
+			return false;
+		}
+		double diagonal = std::sqrt(pivot);
+		int begin = columnStart[j];
+		int end = columnStart[j + 1];
+		value[begin] = (float)diagonal;
+		for (int q = begin + 1; q < end; q++)
+		{
+			value[q] = (float)(accumulator[row[q]] / diagonal);
+			accumulator[row[q]] = 0.0;
+		}
+		if (begin + 1 < end)
+		{
+			firstBelow[j] = begin + 1;
+			nextPending[j] = pending[row[begin + 1]];
+			pending[row[begin + 1]] = j;
+		}
+	}
+	scratch.resize(n);
+	return true;
+}
+
+void SparseCholesky::apply(const float* r, float* z) const
+{
+	int n = (int)order.size();
+	const int* start = columnStart.data();
+	const int* rows = row.data();
+	const float* val = value.data();
+	double* y = scratch.data();
+
+	for (int k = 0; k < n; k++)
+	{
+		y[k] = r[order[k]];
+	}
+
+	// Forward: L y = r, a column at a time.
+	for (int j = 0; j < n; j++)
+	{
+		y[j] /= val[start[j]];
+		for (int q = start[j] + 1; q < start[j + 1]; q++)
+		{
+			y[rows[q]] -= (double)val[q] * y[j];
+		}
+	}
+
+	// Backward: L^T z = y. Column j of L is row j of L^T.
+	for (int j = n - 1; j >= 0; j--)
+	{
+		double sum = y[j];
+		for (int q = start[j] + 1; q < start[j + 1]; q++)
+		{
+			sum -= (double)val[q] * y[rows[q]];
+		}
+		y[j] = sum / val[start[j]];
+	}
+
+	for (int k = 0; k < n; k++)
+	{
+		z[order[k]] = (float)y[k];
+	}
+}
+
+bool SparseCholesky::updateDiagonal(int i, double change)
+{
+	// L' L'^T = L L^T + sign * w w^T with w = sqrt(|change|) at row i, one column at a time. w only ever has entries in the rows of
+	// the columns it went through, and those are all further up the elimination tree, so the columns on the way up are all it takes.
+	double sign = change < 0.0 ? -1.0 : 1.0;
+	int j = position[i];
+	accumulator[j] = std::sqrt(std::fabs(change));
+	bool positive = true;
+	for (; j >= 0; j = parent(j))
+	{
+		double w = accumulator[j];
+		accumulator[j] = 0.0;
+		int begin = columnStart[j];
+		int end = columnStart[j + 1];
+		double diagonal = value[begin];
+		double squared = diagonal * diagonal + sign * w * w;
+		if (!positive || !(squared > 0.0))
+		{
+			// Only the rest of w is cleared, so the accumulator is all zeros again.
+			positive = false;
+			for (int q = begin + 1; q < end; q++)
+			{
+				accumulator[row[q]] = 0.0;
+			}
+			continue;
+		}
+
+		double updated = std::sqrt(squared);
+		double c = updated / diagonal;
+		double s = w / diagonal;
+		value[begin] = (float)updated;
+		for (int q = begin + 1; q < end; q++)
+		{
+			double entry = (value[q] + sign * s * accumulator[row[q]]) / c;
+			accumulator[row[q]] = c * accumulator[row[q]] - s * entry;
+			value[q] = (float)entry;
+		}
+	}
+	return positive;
+}
+
+bool SparseCholesky::append(const SparseMatrix& matrix)
+{
+	int n = (int)order.size();
+	int added = matrix.rows - n;
+	if (added <= 0)
+	{
+		return added == 0;
+	}
+
+	// With A = [A11 A12; A12^T A22] in elimination order, the new rows of L are B = (L^-1 A12)^T and the new columns are the
+	// factor C of A22 - B B^T. Every row of B is a sparse forward substitution: its pattern is the entries of that column of A12 and
+	// everything above them in the elimination tree, and the columns of L in increasing order are a valid order to solve in.
+	std::vector<std::vector<std::pair<int, double>>> newRows(added);
+	std::vector<int> mark(n, -1);
+	std::vector<int> reach;
+	for (int k = 0; k < added; k++)
+	{
+		int r = n + k;
+		reach.clear();
+		for (int p = matrix.rowStart[r]; p < matrix.rowStart[r + 1]; p++)
+		{
+			if (matrix.column[p] >= n)
+			{
+				continue;
+			}
+			int j = position[matrix.column[p]];
+			accumulator[j] = matrix.value[p];
+			for (; j >= 0 && mark[j] != k; j = parent(j))
+			{
+				mark[j] = k;
+				reach.push_back(j);
+			}
+		}
+		std::sort(reach.begin(), reach.end());
+
+		for (int j : reach)
+		{
+			int begin = columnStart[j];
+			double x = accumulator[j] / value[begin];
+			accumulator[j] = 0.0;
+			for (int q = begin + 1; q < columnStart[j + 1]; q++)
+			{
+				accumulator[row[q]] -= (double)value[q] * x;
+			}
+			newRows[k].emplace_back(j, x);
+		}
+	}
+
+	// S = A22 - B B^T, factored in place as a dense matrix (only the lower half is used). There are only a few new rows.
+	std::vector<double> dense((size_t)added * added, 0.0);
+	std::vector<double> spread(n, 0.0);
+	for (int k = 0; k < added; k++)
+	{
+		int r = n + k;
+		for (int p = matrix.rowStart[r]; p < matrix.rowStart[r + 1]; p++)
+		{
+			int c = matrix.column[p] - n;
+			if (c >= 0 && c <= k)
+			{
+				dense[(size_t)k * added + c] = matrix.value[p];
+			}
+		}
+		for (const std::pair<int, double>& entry : newRows[k])
+		{
+			spread[entry.first] = entry.second;
+		}
+		for (int l = 0; l <= k; l++)
+		{
+			double sum = 0.0;
+			for (const std::pair<int, double>& entry : newRows[l])
+			{
+				sum += spread[entry.first] * entry.second;
+			}
+			dense[(size_t)k * added + l] -= sum;
+		}
+		for (const std::pair<int, double>& entry : newRows[k])
+		{
+			spread[entry.first] = 0.0;
+		}
+	}
+	for (int j = 0; j < added; j++)
+	{
+		double pivot = dense[(size_t)j * added + j];
+		for (int m = 0; m < j; m++)
+		{
+			pivot -= dense[(size_t)j * added + m] * dense[(size_t)j * added + m];
+		}
+		if (!(pivot > 0.0))
+		{
+			return false;
+		}
+		double diagonal = std::sqrt(pivot);
+		dense[(size_t)j * added + j] = diagonal;
+		for (int i = j + 1; i < added; i++)
+		{
+			double sum = dense[(size_t)i * added + j];
+			for (int m = 0; m < j; m++)
+			{
+				sum -= dense[(size_t)i * added + m] * dense[(size_t)j * added + m];
+			}
+			dense[(size_t)i * added + j] = sum / diagonal;
+		}
+	}
+
+	// Lay out the new factor: every old column gets the new rows that reach it at its end (they come after all of its rows), and
+	// the new columns follow, whole. The entries that happen to be 0 are kept, so the pattern stays that of a real elimination, which
+	// factor() and updateDiagonal() depend on.
+	std::vector<int> extra(n + 1, 0);
+	for (int k = 0; k < added; k++)
+	{
+		for (const std::pair<int, double>& entry : newRows[k])
+		{
+			extra[entry.first + 1]++;
+		}
+	}
+	for (int j = 0; j < n; j++)
+	{
+		extra[j + 1] += extra[j];
+	}
+
+	std::vector<int> newStart(n + added + 1);
+	std::vector<int> newRow;
+	std::vector<float> newValue;
+	newRow.reserve(row.size() + extra[n] + (size_t)added * (added + 1) / 2);
+	newValue.reserve(newRow.capacity());
+	std::vector<int> fill(n);
+	for (int j = 0; j < n; j++)
+	{
+		newStart[j] = (int)newRow.size();
+		newRow.insert(newRow.end(), row.begin() + columnStart[j], row.begin() + columnStart[j + 1]);
+		newValue.insert(newValue.end(), value.begin() + columnStart[j], value.begin() + columnStart[j + 1]);
+		fill[j] = (int)newRow.size();
+		newRow.resize(newRow.size() + extra[j + 1] - extra[j]);
+		newValue.resize(newRow.size());
+	}
+	for (int k = 0; k < added; k++)
+	{
+		for (const std::pair<int, double>& entry : newRows[k])
+		{
+			newRow[fill[entry.first]] = n + k;
+			newValue[fill[entry.first]++] = (float)entry.second;
+		}
+	}
+	for (int j = 0; j < added; j++)
+	{
+		newStart[n + j] = (int)newRow.size();
+		newRow.push_back(n + j);
+		newValue.push_back((float)dense[(size_t)j * added + j]);
+		for (int i = j + 1; i < added; i++)
+		{
+			newRow.push_back(n + i);
+			newValue.push_back((float)dense[(size_t)i * added + j]);
+		}
+	}
+	newStart[n + added] = (int)newRow.size();
+
+	columnStart.swap(newStart);
+	row.swap(newRow);
+	value.swap(newValue);
+	for (int k = 0; k < added; k++)
+	{
+		order.push_back(n + k);
+		position.push_back(n + k);
+	}
+	accumulator.assign(n + added, 0.0);
+	scratch.resize(n + added);
+	return true;
+}
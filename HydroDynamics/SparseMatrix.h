@@ -0,0 +1,149 @@
+/*
+Title: HydroDynamics
+File Name: SparseMatrix.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A sparse matrix in compressed sparse row (CSR) form, and an incomplete Cholesky
+factorization of it for use as a preconditioner.
+
+In CSR form the non-zero entries are stored row after row: row i owns the entries
+rowStart[i] to rowStart[i + 1] - 1, whose column numbers are in column and values in
+value. Within a row the columns are sorted. Multiplying by the matrix streams through the
+three arrays once, and rows are independent, so it splits across cores in blocks.
+
+The incomplete Cholesky factorization (IC(0)) finds a lower triangular L with the same
+pattern as the lower half of the matrix so that L L^T is close to it. Applying it takes a
+forward and a backward substitution. Those run row after row, so unlike the multiply they
+stay on one thread.
+
+The complete Cholesky factorization (SparseCholesky) finds the exact L, which fills in
+entries the matrix doesn't have. How much depends on the order the rows are eliminated in,
+so the rows are first put in minimum degree order, which always eliminates the row with
+the fewest remaining neighbours next. Working out that order and the pattern of L only
+needs the pattern of the matrix, so it is done once (analyse()), and the numbers are filled
+in separately (factor()) whenever the values change. Solving with the factor is then only
+the two substitutions.
+
+Small changes to the matrix don't need either. A change of one diagonal entry is a rank one
+update of L L^T, which only touches the columns on the way from that row to the last one
+in the elimination tree (the tree in which the parent of a column is the first row below
+its diagonal). Rows and columns added at the end are eliminated last, after all the old
+ones: every new row of L comes from a sparse forward substitution with the old L, and the
+few new columns from a small dense factorization of what is left. Both keep the old
+elimination order, so after many additions the factor fills in more than a new analysis
+would make it.
+*/
+
+#ifndef _SPARSE_MATRIX_H
+#define _SPARSE_MATRIX_H
+
+#include <vector>
+
+class TaskPool;
+
+struct SparseMatrix
+{
+	int rows = 0;
+	std::vector<int> rowStart;	// rows + 1 entries
+	std::vector<int> column;
+	std::vector<float> value;
+
+	int nonZeros() const { return (int)column.size(); }
+
+	// y = this * x. Uses the pool for large matrices. The result is the same with or without a pool.
+	void multiply(const float* x, float* y, TaskPool* pool) const;
+
+	// Returns the index into column/value of entry (row, col), or -1 if it is not part of the pattern.
+	int find(int row, int col) const;
+};
+
+class IncompleteCholesky
+{
+public:
+	// Factors a symmetric positive definite matrix. IC(0) can break down on matrices that are far from diagonally dominant;
+	// in that case the diagonal is raised a little and the factorization is tried again, which always ends up working.
+	void factor(const SparseMatrix& matrix);
+
+	// z = (L L^T)^-1 r
+	void apply(const float* r, float* z) const;
+
+	// How much the diagonal had to be raised (as a fraction of itself) for the last factorization to succeed. 0 if it wasn't.
+	float shift = 0.0f;
+
+private:
+	bool tryFactor(const SparseMatrix& matrix, float diagonalShift);
+
+	// The rows of L, with the diagonal as the last entry of every row.
+	SparseMatrix lower;
+	std::vector<float> scratch;
+};
+
+class SparseCholesky
+{
+public:
+	// Works out the elimination order and the pattern of L for the pattern of a symmetric matrix. Returns false if L would have
+	// more entries than is reasonable to keep (see SparseMatrix.cpp), in which case the matrix is too large or too connected for
+	// a direct solve.
+	bool analyse(const SparseMatrix& matrix);
+
+	// Fills in L for the values of a matrix with the pattern analyse() saw. Returns false if the matrix isn't positive definite.
+	bool factor(const SparseMatrix& matrix);
+
+	// z = (L L^T)^-1 r, in the original order of the rows.
+	void apply(const float* r, float* z) const;
+
+	// Adds change to the diagonal entry of row i of the factored matrix. Returns false if that leaves it no longer positive
+	// definite, in which case the factor is broken until the next factor().
+	bool updateDiagonal(int i, double change);
+
+	// Factors a matrix that is the last one factored with rows and columns added after its last row, and the old entries
+	// unchanged. Returns false if it isn't positive definite, in which case the factor is broken until the next analyse().
+	bool append(const SparseMatrix& matrix);
+
+	// The entries of L, including the diagonal. 0 before analyse().
+	int nonZeros() const { return (int)row.size(); }
+
+private:
+	// The parent of column j in the elimination tree, or -1 for a root.
+	int parent(int j) const { return columnStart[j] + 1 < columnStart[j + 1] ? row[columnStart[j] + 1] : -1; }
+
+	// order[k] is the row of the matrix eliminated k-th, and position[i] where row i of the matrix went.
+	std::vector<int> order;
+	std::vector<int> position;
+
+	// L by columns, in elimination order: column j owns the entries columnStart[j] to columnStart[j + 1] - 1, the diagonal first
+	// and then the rows below it, sorted.
+	std::vector<int> columnStart;
+	std::vector<int> row;
+	std::vector<float> value;
+
+	// For factor(): the column being built, and the columns that still have to be subtracted from a later one.
+	std::vector<double> accumulator;
+	std::vector<int> pending;
+	std::vector<int> nextPending;
+	std::vector<int> firstBelow;
+
+	mutable std::vector<double> scratch;
+};
+
+#endif // _SPARSE_MATRIX_H
@@ -0,0 +1,171 @@
+/*
+Title: HydroDynamics
+File Name: SpatialGrid.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A uniform grid over the bounding boxes of a set of items, for finding the items inside a
+rectangle without looking at all of them, like the vessels and tubes that are on screen.
+
+The grid spans the boxes of all items and has about as many cells as there are items. Every
+item is listed in each cell its box overlaps, in compressed form (the items of a cell are
+one stretch of a single array). A query visits only the cells the rectangle overlaps, so it
+takes time in proportion to what it finds, not to the number of items.
+
+This file has no OpenGL dependency.
+*/
+
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+void SpatialGrid::build(const float* minX, const float* minY, const float* maxX, const float* maxY, int count)
+{
+	boxes.resize(count * 4);
+	float lowX = FLT_MAX, lowY = FLT_MAX, highX = -FLT_MAX, highY = -FLT_MAX;
+	for (int i = 0; i < count; i++)
+	{
+		boxes[i * 4 + 0] = minX[i];
+		boxes[i * 4 + 1] = minY[i];
+		boxes[i * 4 + 2] = maxX[i];
+		boxes[i * 4 + 3] = maxY[i];
+		lowX = std::min(lowX, minX[i]);
+		lowY = std::min(lowY, minY[i]);
+		highX = std::max(highX, maxX[i]);
+		highY = std::max(highY, maxY[i]);
+	}
+	if (count == 0)
+	{
+		lowX = lowY = highX = highY = 0.0f;
+	}
+
+	// About one cell per item, with square cells over the area the items cover. An axis with no extent (all items on one line, like
+	// vessels that all stand on the same floor) gets a single cell, and the other axis all the cells.
+	float width = highX - lowX;
+	float height = highY - lowY;
+	int most = std::min(std::max(count, 1), SPATIAL_GRID_MAX_CELLS);
+	columns = 1;
+	rows = 1;
+	if (width > 0.0f && height > 0.0f)
+	{
+		float cellSize = std::sqrt(width * height / std::max(count, 1));
+		columns = std::min(std::max((int)std::ceil(width / cellSize), 1), SPATIAL_GRID_MAX_CELLS);
+		rows = std::min(std::max((int)std::ceil(height / cellSize), 1), SPATIAL_GRID_MAX_CELLS);
+	}
+	else if (width > 0.0f)
+	{
+		columns = most;
+	}
+	else if (height > 0.0f)
+	{
+		rows = most;
+	}
+	originX = lowX;
+	originY = lowY;
+	cellWidth = width > 0.0f ? width / columns : 1.0f;
+	cellHeight = height > 0.0f ? height / rows : 1.0f;
+
+	// Count the items of every cell, turn the counts into starts, then fill the cells.
+	int cells = columns * rows;
+	cellStart.assign(cells + 1, 0);
+	for (int i = 0; i < count; i++)
+	{
+		int c0, r0, c1, r1;
+		cellRange(minX[i], minY[i], maxX[i], maxY[i], c0, r0, c1, r1);
+		for (int r = r0; r <= r1; r++)
+		{
+			for (int c = c0; c <= c1; c++)
+			{
+				cellStart[r * columns + c + 1]++;
+			}
+		}
+	}
+	for (int c = 0; c < cells; c++)
+	{
+		cellStart[c + 1] += cellStart[c];
+	}
+
+	cellItems.resize(cellStart[cells]);
+	std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+	for (int i = 0; i < count; i++)
+	{
+		int c0, r0, c1, r1;
+		cellRange(minX[i], minY[i], maxX[i], maxY[i], c0, r0, c1, r1);
+		for (int r = r0; r <= r1; r++)
+		{
+			for (int c = c0; c <= c1; c++)
+			{
+				cellItems[fill[r * columns + c]++] = i;
+			}
+		}
+	}
+
+	seen.assign(count, -1);
+	queryCount = 0;
+}
+
+void SpatialGrid::cellRange(float x0, float y0, float x1, float y1, int& c0, int& r0, int& c1, int& r1) const
+{
+	// Clamped in float before the conversion, so a rectangle far outside the grid (or infinite) doesn't overflow the int.
+	float columnsLimit = (float)(columns - 1);
+	float rowsLimit = (float)(rows - 1);
+	c0 = (int)std::min(std::max(std::floor((x0 - originX) / cellWidth), 0.0f), columnsLimit);
+	c1 = (int)std::min(std::max(std::floor((x1 - originX) / cellWidth), 0.0f), columnsLimit);
+	r0 = (int)std::min(std::max(std::floor((y0 - originY) / cellHeight), 0.0f), rowsLimit);
+	r1 = (int)std::min(std::max(std::floor((y1 - originY) / cellHeight), 0.0f), rowsLimit);
+}
+
+void SpatialGrid::query(float x0, float y0, float x1, float y1, std::vector<int>& result) const
+{
+	result.clear();
+	int count = itemCount();
+	if (count == 0 || x1 < x0 || y1 < y0)
+	{
+		return;
+	}
+
+	int c0, r0, c1, r1;
+	cellRange(x0, y0, x1, y1, c0, r0, c1, r1);
+	queryCount++;
+	for (int r = r0; r <= r1; r++)
+	{
+		for (int c = c0; c <= c1; c++)
+		{
+			int cell = r * columns + c;
+			for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+			{
+				int i = cellItems[k];
+				if (seen[i] == queryCount)
+				{
+					continue;
+				}
+				seen[i] = queryCount;
+				const float* box = &boxes[i * 4];
+				if (box[2] >= x0 && box[0] <= x1 && box[3] >= y0 && box[1] <= y1)
+				{
+					result.push_back(i);
+				}
+			}
+		}
+	}
+	std::sort(result.begin(), result.end());
+}
@@ -0,0 +1,71 @@
+/*
+Title: HydroDynamics
+File Name: SpatialGrid.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A uniform grid over the bounding boxes of a set of items, for finding the items inside a
+rectangle without looking at all of them, like the vessels and tubes that are on screen.
+
+The grid spans the boxes of all items and has about as many cells as there are items. Every
+item is listed in each cell its box overlaps, in compressed form (the items of a cell are
+one stretch of a single array). A query visits only the cells the rectangle overlaps, so it
+takes time in proportion to what it finds, not to the number of items.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SPATIAL_GRID_H
+#define _SPATIAL_GRID_H
+
+#include <vector>
+
+// A grid never has more cells than this along either axis.
+#define SPATIAL_GRID_MAX_CELLS 1024
+
+class SpatialGrid
+{
+public:
+	// Builds the grid over count boxes; item i spans minX[i] to maxX[i] and minY[i] to maxY[i]. A box can be flat or a point.
+	void build(const float* minX, const float* minY, const float* maxX, const float* maxY, int count);
+
+	// Replaces result with every item whose box overlaps the rectangle from (x0, y0) to (x1, y1), each once and in increasing order.
+	void query(float x0, float y0, float x1, float y1, std::vector<int>& result) const;
+
+	int itemCount() const { return (int)boxes.size() / 4; }
+
+private:
+	float originX = 0.0f;
+	float originY = 0.0f;
+	float cellWidth = 1.0f;
+	float cellHeight = 1.0f;
+	int columns = 0;
+	int rows = 0;
+	std::vector<float> boxes;		// minX, minY, maxX, maxY of every item
+	std::vector<int> cellStart;		// The items of cell c are cellItems[cellStart[c]] to cellItems[cellStart[c + 1] - 1]
+	std::vector<int> cellItems;
+	mutable std::vector<int> seen;	// Per item, the last query that found it, so an item in several cells is reported once
+	mutable int queryCount = 0;
+
+	void cellRange(float x0, float y0, float x1, float y1, int& c0, int& r0, int& c1, int& r1) const;
+};
+
+#endif // _SPATIAL_GRID_H
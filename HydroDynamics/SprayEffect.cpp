@@ -0,0 +1,216 @@
+/*
+Title: HydroDynamics
+File Name: SprayEffect.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Spray over the vessels with --spray: droplets thrown up where the water moves fast, falling
+back into it. It is made for GL 4.0, which has no compute shaders (those came with 4.3,
+which is what --gpu needs), so the droplets are advanced with transform feedback instead.
+
+The droplets live in two vertex buffers, and each frame one of them is read and the other
+written. SprayUpdate.glsl runs once for every droplet with the rasterizer off, and the
+varyings it writes are captured into the other buffer, which is then drawn as points with
+the particle shaders. The CPU only uploads one record per vessel every frame (its walls,
+its level and how fast the level moves), the droplets themselves never leave the GPU.
+*/
+
+#include "SprayEffect.h"
+#include "GLState.h"
+#include "Shaders.h"
+#include "VesselNetwork.h"
+#include <algorithm>
+#include <iostream>
+
+// What the update writes for every droplet, in this order, and how a droplet is laid out in the buffers.
+static const char* const sprayVaryings[] = { "outState", "outColor", "outDroplet" };
+
+struct SprayDroplet
+{
+	GLfloat state[4];		// x, y, and the velocity along both
+	GLfloat color[4];
+	GLfloat droplet[2];		// The seconds it has left, and its vessel
+};
+
+bool SprayEffect::build(const VesselNetwork& network, const char* updateFile, const char* vertexFile, const char* fragmentFile)
+{
+	destroy();
+	MappedFile file;
+	if (!file.open(updateFile))
+	{
+		return false;
+	}
+	GLuint updateShader = createShader(file.view(), GL_VERTEX_SHADER);
+	if (updateShader != 0)
+	{
+		updateProgram = createFeedbackProgram(updateShader, sprayVaryings, 3);
+		glDeleteShader(updateShader);
+	}
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	particleProgram = loadProgramFiles(vertexFile, fragmentFile, vertexShader, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	if (updateProgram == 0 || particleProgram == 0)
+	{
+		std::cout << "Can't build the programs of the spray." << std::endl;
+		destroy();
+		return false;
+	}
+
+	cachedUseProgram(updateProgram);
+	glUniform1i(glGetUniformLocation(updateProgram, "vessels"), 0);
+	glUniform1f(glGetUniformLocation(updateProgram, "spawnRate"), SPRAY_SPAWN_RATE);
+	glUniform1f(glGetUniformLocation(updateProgram, "launchScale"), SPRAY_LAUNCH_SCALE);
+	glUniform1f(glGetUniformLocation(updateProgram, "lifetime"), SPRAY_LIFETIME);
+	updateVesselCount = glGetUniformLocation(updateProgram, "vesselCount");
+	updateFrame = glGetUniformLocation(updateProgram, "frame");
+	updateDt = glGetUniformLocation(updateProgram, "dt");
+	updateGravity = glGetUniformLocation(updateProgram, "gravity");
+
+	float width = 0.0f;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		width += network.right[i] - network.left[i];
+	}
+	width = network.vesselCount() > 0 ? width / network.vesselCount() : 1.0f;
+	cachedUseProgram(particleProgram);
+	glUniform1i(glGetUniformLocation(particleProgram, "splat"), 0);
+	glUniform1f(glGetUniformLocation(particleProgram, "radius"), width * SPRAY_RADIUS_FRACTION);
+	cachedUseProgram(0);
+
+	// Every droplet starts out dead, parked where the update parks them, so the first frame already rolls the dice for all of them.
+	std::vector<SprayDroplet> droplets(SPRAY_DROPLETS);
+	for (SprayDroplet& droplet : droplets)
+	{
+		droplet = SprayDroplet{ { 0.0f, -1.0e9f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } };
+	}
+	glGenBuffers(2, buffers);
+	glGenTransformFeedbacks(2, feedbacks);
+	glGenVertexArrays(2, updateVaos);
+	glGenVertexArrays(2, drawVaos);
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(SprayDroplet) * droplets.size(), droplets.data(), GL_DYNAMIC_COPY);
+
+		cachedBindVertexArray(updateVaos[i]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SprayDroplet), (void*)offsetof(SprayDroplet, state));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SprayDroplet), (void*)offsetof(SprayDroplet, droplet));
+
+		// The particle shader takes a vec3 for the position, which gets z = 0 from the 2 floats given.
+		cachedBindVertexArray(drawVaos[i]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SprayDroplet), (void*)offsetof(SprayDroplet, state));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SprayDroplet), (void*)offsetof(SprayDroplet, color));
+
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedbacks[i]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[i]);
+	}
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+	cachedBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &vesselBuffer);
+	glGenTextures(1, &vesselTexture);
+	current = 0;
+	frame = 0;
+	return true;
+}
+
+void SprayEffect::update(const VesselNetwork& network, const std::vector<float>& from, const std::vector<float>& to, float alpha,
+	float stepSeconds, float dt, float gravity)
+{
+	// The buffer grows with the network, it is only made again when a scene with more vessels is loaded.
+	int count = network.vesselCount();
+	vessels.resize(count * 4);
+	float riseScale = stepSeconds > 0.0f ? 1.0f / stepSeconds : 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		float* vessel = &vessels[i * 4];
+		vessel[0] = network.left[i];
+		vessel[1] = network.right[i];
+		vessel[2] = from[i] + (to[i] - from[i]) * alpha;
+		vessel[3] = (to[i] - from[i]) * riseScale;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, vesselBuffer);
+	if (count > vesselCapacity)
+	{
+		vesselCapacity = count;
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * vessels.size(), vessels.data(), GL_STREAM_DRAW);
+		cachedActiveTexture(GL_TEXTURE0);
+		cachedBindTexture(GL_TEXTURE_BUFFER, vesselTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vesselBuffer);
+	}
+	else
+	{
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(float) * vessels.size(), vessels.data());
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	cachedActiveTexture(GL_TEXTURE0);
+	cachedBindTexture(GL_TEXTURE_BUFFER, vesselTexture);
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Read the droplets from one buffer and write them to the other, drawing nothing.
+	int next = 1 - current;
+	cachedUseProgram(updateProgram);
+	glUniform1i(updateVesselCount, count);
+	glUniform1ui(updateFrame, frame++);
+	glUniform1f(updateDt, std::min(dt, SPRAY_MAX_DT));
+	glUniform1f(updateGravity, gravity);
+	cachedEnable(GL_RASTERIZER_DISCARD);
+	cachedBindVertexArray(updateVaos[current]);
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedbacks[next]);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, SPRAY_DROPLETS);
+	glEndTransformFeedback();
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+	cachedBindVertexArray(0);
+	cachedDisable(GL_RASTERIZER_DISCARD);
+	cachedUseProgram(0);
+	current = next;
+}
+
+void SprayEffect::destroy()
+{
+	cachedDeleteProgram(updateProgram);
+	cachedDeleteProgram(particleProgram);
+	glDeleteBuffers(2, buffers);
+	glDeleteTransformFeedbacks(2, feedbacks);
+	cachedDeleteVertexArrays(2, updateVaos);
+	cachedDeleteVertexArrays(2, drawVaos);
+	glDeleteBuffers(1, &vesselBuffer);
+	cachedDeleteTextures(1, &vesselTexture);
+	updateProgram = particleProgram = 0;
+	buffers[0] = buffers[1] = 0;
+	feedbacks[0] = feedbacks[1] = 0;
+	updateVaos[0] = updateVaos[1] = 0;
+	drawVaos[0] = drawVaos[1] = 0;
+	vesselBuffer = vesselTexture = 0;
+	vesselCapacity = 0;
+}
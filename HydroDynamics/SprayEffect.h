@@ -0,0 +1,106 @@
+/*
+Title: HydroDynamics
+File Name: SprayEffect.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Spray over the vessels with --spray: droplets thrown up where the water moves fast, falling
+back into it. It is made for GL 4.0, which has no compute shaders (those came with 4.3,
+which is what --gpu needs), so the droplets are advanced with transform feedback instead.
+
+The droplets live in two vertex buffers, and each frame one of them is read and the other
+written. SprayUpdate.glsl runs once for every droplet with the rasterizer off, and the
+varyings it writes are captured into the other buffer, which is then drawn as points with
+the particle shaders. The CPU only uploads one record per vessel every frame (its walls,
+its level and how fast the level moves), the droplets themselves never leave the GPU.
+*/
+
+#ifndef _SPRAY_EFFECT_H
+#define _SPRAY_EFFECT_H
+
+#include "GLIncludes.h"
+#include <vector>
+
+class VesselNetwork;
+
+// How many droplets there are, alive or not. They all run through the update every frame, the dead ones only to roll the dice.
+#define SPRAY_DROPLETS 16384
+
+// The radius of a droplet, as a part of the average width of the vessels.
+#define SPRAY_RADIUS_FRACTION 0.01f
+
+// A dead droplet comes back this many times a second for every unit its vessel's level moves in a second.
+#define SPRAY_SPAWN_RATE 2.0f
+
+// A droplet is thrown up about this many times faster than the level it comes from moves.
+#define SPRAY_LAUNCH_SCALE 4.0f
+
+// The longest a droplet lives, in seconds.
+#define SPRAY_LIFETIME 1.5f
+
+// Longer frames are advanced by this many seconds only, so the droplets don't jump after a stall.
+#define SPRAY_MAX_DT 0.05f
+
+class SprayEffect
+{
+public:
+	// Builds the update program from updateFile and the program that draws the droplets from the particle shaders, and the two
+	// buffers of SPRAY_DROPLETS dead droplets. The droplets are as large as SPRAY_RADIUS_FRACTION of the vessels of network.
+	// Returns false if anything doesn't build.
+	bool build(const VesselNetwork& network, const char* updateFile, const char* vertexFile, const char* fragmentFile);
+
+	// Uploads the vessels at the levels blended from from to to by alpha, which moved from from to to in stepSeconds, and advances
+	// the droplets by dt seconds. Leaves texture unit 0 bound to the vessels, and the rasterizer on.
+	void update(const VesselNetwork& network, const std::vector<float>& from, const std::vector<float>& to, float alpha,
+		float stepSeconds, float dt, float gravity);
+
+	// The droplets as they are after the last update, to be drawn as SPRAY_DROPLETS points with drawProgram(). The size of a point
+	// follows the pointScale of the Frame block.
+	GLuint drawProgram() const { return particleProgram; }
+	GLuint dropletVao() const { return drawVaos[current]; }
+
+	// Frees everything.
+	void destroy();
+
+	bool valid() const { return updateProgram != 0; }
+
+private:
+	GLuint updateProgram = 0;
+	GLuint particleProgram = 0;
+	GLuint buffers[2] = {};
+	GLuint feedbacks[2] = {};		// The transform feedback object that writes into each buffer
+	GLuint updateVaos[2] = {};		// The state of the droplets from each buffer, for the update
+	GLuint drawVaos[2] = {};		// and their positions and colors, for drawing
+	GLuint vesselBuffer = 0;
+	GLuint vesselTexture = 0;
+	int current = 0;				// The buffer that holds the droplets now
+	int vesselCapacity = 0;
+	unsigned int frame = 0;
+	std::vector<float> vessels;
+
+	GLint updateVesselCount = -1;
+	GLint updateFrame = -1;
+	GLint updateDt = -1;
+	GLint updateGravity = -1;
+};
+
+#endif // _SPRAY_EFFECT_H
@@ -0,0 +1,89 @@
+/*
+Title: HydroDynamics
+File Name: SpscQueue.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A fixed size, lock-free queue for exactly one producer thread and one consumer thread.
+
+The producer only ever writes the tail and the consumer only ever writes the head, so
+neither needs a lock or a compare-and-swap. Each index is published with a release store
+and read with an acquire load, which makes the element written before it visible to the
+other side. push() fails instead of waiting when the queue is full, so the producer never
+blocks. The two indices sit on separate cache lines so the two threads don't keep stealing
+the same line from each other.
+*/
+
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Capacity has to be a power of two, so the indices can wrap with a mask.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+	// Producer only. Returns false (and drops the value) if the queue is full.
+	bool push(const T& value)
+	{
+		size_t tailIndex = tail.load(std::memory_order_relaxed);
+		if (tailIndex - head.load(std::memory_order_acquire) == Capacity)
+		{
+			return false;
+		}
+		items[tailIndex & (Capacity - 1)] = value;
+		tail.store(tailIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false if the queue is empty.
+	bool pop(T& value)
+	{
+		size_t headIndex = head.load(std::memory_order_relaxed);
+		if (headIndex == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		value = items[headIndex & (Capacity - 1)];
+		head.store(headIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Any thread. The number of values waiting, which may already be out of date when it returns.
+	size_t size() const
+	{
+		size_t headIndex = head.load(std::memory_order_relaxed);
+		size_t tailIndex = tail.load(std::memory_order_relaxed);
+		return tailIndex > headIndex ? tailIndex - headIndex : 0;
+	}
+
+private:
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	T items[Capacity];
+};
+
+#endif // _SPSC_QUEUE_H
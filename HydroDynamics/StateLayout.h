@@ -0,0 +1,137 @@
+/*
+Title: HydroDynamics
+File Name: StateLayout.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Describes a binary layout of state once, at compile time, for every place that puts the
+state into memory someone else reads: checkpoint files (see Checkpoint.h) and the shared
+memory of the live export (see LiveExport.h).
+
+A layout is a header followed by arrays of fixed size elements, each starting on an
+alignment boundary, so a reader that maps the bytes can use every array where it is,
+without parsing or copying anything. A StateLayout is the list of those arrays, each with
+the size of its elements and which of a few counts (vessels, tubes, ...) says how many of
+them there are. place() works out where every array starts for a given set of counts.
+
+fingerprint() is a hash of the whole list, names included, worked out by the compiler.
+Headers store it next to their version number and readers refuse any other, so an array
+that was added, removed, reordered or made wider is caught even where nobody remembered
+to bump the version.
+
+The element types have to be trivially copyable, and the bytes are whatever order the
+machine uses, which the users only write on little endian machines.
+*/
+
+#ifndef _STATE_LAYOUT_H
+#define _STATE_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// One array of a layout.
+struct LayoutField
+{
+	const char* name;
+	uint32_t elementSize;
+	uint32_t count;			// Which of the counts passed to place() is the number of elements
+};
+
+// Describes an array of elements of type T.
+template <typename T>
+constexpr LayoutField layoutField(const char* name, uint32_t count)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable elements can be used where they are stored");
+	return { name, (uint32_t)sizeof(T), count };
+}
+
+template <size_t FIELDS>
+struct StateLayout
+{
+	LayoutField fields[FIELDS];
+	uint64_t alignment;
+
+	static constexpr size_t size() { return FIELDS; }
+
+	constexpr uint64_t align(uint64_t offset) const
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// How many bytes array i takes with the given counts.
+	constexpr uint64_t bytes(size_t i, const uint64_t* counts) const
+	{
+		return counts[fields[i].count] * fields[i].elementSize;
+	}
+
+	// Writes where every array starts after a header of headerBytes, and returns the size of the whole layout.
+	constexpr uint64_t place(uint64_t headerBytes, const uint64_t* counts, uint64_t* offsets) const
+	{
+		uint64_t offset = align(headerBytes);
+		for (size_t i = 0; i < FIELDS; i++)
+		{
+			offsets[i] = offset;
+			offset = align(offset + bytes(i, counts));
+		}
+		return offset;
+	}
+
+	// Whether offsets and size are what place() gives for the counts, which is what a reader checks before it uses the arrays.
+	bool matches(uint64_t headerBytes, const uint64_t* counts, const uint64_t* offsets, uint64_t size) const
+	{
+		uint64_t expected[FIELDS] = {};
+		return place(headerBytes, counts, expected) == size && memcmp(expected, offsets, sizeof(expected)) == 0;
+	}
+
+	// FNV-1a of the names, element sizes and counts of the arrays and of the alignment.
+	constexpr uint32_t fingerprint() const
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < FIELDS; i++)
+		{
+			for (const char* c = fields[i].name; *c != 0; c++)
+			{
+				hash = (hash ^ (unsigned char)*c) * 16777619u;
+			}
+			hash = (hash ^ fields[i].elementSize) * 16777619u;
+			hash = (hash ^ fields[i].count) * 16777619u;
+		}
+		return (uint32_t)((hash ^ alignment) * 16777619u);
+	}
+
+	// Array i of the layout at base, in place.
+	template <typename T>
+	T* array(char* base, const uint64_t* offsets, size_t i) const
+	{
+		return (T*)(base + offsets[i]);
+	}
+
+	template <typename T>
+	const T* array(const char* base, const uint64_t* offsets, size_t i) const
+	{
+		return (const T*)(base + offsets[i]);
+	}
+};
+
+#endif // _STATE_LAYOUT_H
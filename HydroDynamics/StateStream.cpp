@@ -0,0 +1,483 @@
+/*
+Title: HydroDynamics
+File Name: StateStream.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Streams the fill levels of the network to any number of remote viewers over TCP
+(--stream-port PORT), so operators can watch one simulation from elsewhere.
+
+publish() only copies the heights and leaves everything else to a background thread, which
+turns them into frames at the rate they are published (--stream-hz). Every height is
+quantized to the tolerance of the stream, and a frame only holds the vessels whose quantized
+height changed since the frame before, so a network at rest costs nothing and one that
+moves in a few places costs little. Every STREAM_KEYFRAME_FRAMES frames (and whenever the
+number of vessels changes) a keyframe holds all of them instead. If the thread falls behind,
+the heights published meanwhile are simply replaced by newer ones, and the next frame holds
+all the changes since the last one.
+
+Every frame is encoded once and the same bytes go to every client, so the work per vessel
+doesn't grow with the number of clients. A client that connects is sent the last keyframe and
+the frames since then, and one that can't keep up with STREAM_CLIENT_BACKLOG bytes waiting
+is dropped rather than held up for, or holding up, the others.
+
+A frame is a StreamFrameHeader followed by one entry per changed vessel, in the order of the
+vessels: the number of vessels skipped since the entry before as a varint, then the change
+of its quantized height as a zigzag varint (its whole quantized height in a keyframe).
+Everything is little endian. StateStreamClient decodes it.
+
+A viewer (--stream-view HOST:PORT, see StreamView) gets a frame every few steps, or none
+for a while when the connection stalls, but draws every step. StreamInterpolator keeps the
+last STREAM_VIEW_FRAMES frames and plays them STREAM_PLAYOUT_FRAMES frame intervals behind
+the newest, so there is almost always a frame on either side of the step it shows, and the
+heights are interpolated between them. When the newest frame is late, the heights go on
+along the last two frames for at most STREAM_EXTRAPOLATION_FRAMES intervals and then hold.
+The playout speeds up or slows down a little to stay at its distance behind the newest
+frame, and jumps there when a frame shows it is far off (after connecting, or after the
+server was at rest and sent nothing).
+*/
+
+#include "StateStream.h"
+#include "ThreadControl.h"
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// How long the thread waits for a connection before it looks for new heights again, which is the most a frame is delayed by.
+#define STREAM_POLL_MILLISECONDS 5
+
+static void appendVarint(std::string& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out += (char)(value | 0x80);
+		value >>= 7;
+	}
+	out += (char)value;
+}
+
+static bool readVarint(const std::string& in, size_t& position, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && position < in.size(); shift += 7)
+	{
+		unsigned char byte = (unsigned char)in[position++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (0 - ((uint64_t)value >> 63));
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)((value >> 1) ^ (0 - (value & 1)));
+}
+
+static int64_t quantize(float value, float tolerance)
+{
+	return std::isfinite(value) ? (int64_t)std::llround((double)value / tolerance) : 0;
+}
+
+StateStreamServer::~StateStreamServer()
+{
+	stop();
+}
+
+bool StateStreamServer::start(int port, float streamTolerance)
+{
+	stop();
+	if (!listener.listen(port))
+	{
+		return false;
+	}
+	tolerance = streamTolerance;
+	stopping = false;
+	fresh = false;
+	frames = 0;
+	bytesEncoded = 0;
+	sent.clear();
+	history.clear();
+	thread = std::thread(&StateStreamServer::run, this);
+	return true;
+}
+
+void StateStreamServer::publish(long long step, const VesselNetwork& network)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	published.assign(network.height.begin(), network.height.end());
+	publishedStep = step;
+	fresh = true;
+}
+
+void StateStreamServer::stop()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+	stopping = true;
+	thread.join();
+	listener.close();
+	connected.clear();
+	clients = 0;
+	if (frames > 0)
+	{
+		std::cout << "State stream: " << frames << " frames of " << bytesEncoded / frames << " bytes on average" << std::endl;
+	}
+}
+
+std::shared_ptr<const std::string> StateStreamServer::encodeFrame(long long step, const std::vector<float>& values)
+{
+	bool keyframe = frames % STREAM_KEYFRAME_FRAMES == 0 || sent.size() != values.size();
+	if (keyframe)
+	{
+		sent.assign(values.size(), 0);
+	}
+
+	std::string frame(sizeof(StreamFrameHeader), '\0');
+	uint32_t changed = 0;
+	long long previous = -1;
+	for (size_t v = 0; v < values.size(); v++)
+	{
+		int64_t q = quantize(values[v], tolerance);
+		if (q == sent[v] && !keyframe)
+		{
+			continue;
+		}
+		appendVarint(frame, (uint64_t)((long long)v - previous - 1));
+		appendVarint(frame, zigzag((int64_t)((uint64_t)q - (uint64_t)sent[v])));
+		sent[v] = q;
+		previous = (long long)v;
+		changed++;
+	}
+
+	// Nothing moved far enough to show, so there is nothing to send.
+	if (changed == 0 && !keyframe)
+	{
+		return nullptr;
+	}
+
+	StreamFrameHeader header;
+	memcpy(header.magic, "HYST", 4);
+	header.bytes = (uint32_t)(frame.size() - sizeof(header));
+	header.type = keyframe ? STREAM_KEYFRAME : STREAM_DELTA;
+	header.changed = changed;
+	header.step = step;
+	header.tolerance = tolerance;
+	header.vesselCount = (uint32_t)values.size();
+	memcpy(&frame[0], &header, sizeof(header));
+
+	frames++;
+	bytesEncoded += (long long)frame.size();
+	return std::make_shared<const std::string>(std::move(frame));
+}
+
+// Sends what the client takes of its queue. Returns false if it is gone or fell too far behind.
+bool StateStreamServer::flush(Client& client)
+{
+	while (!client.queued.empty())
+	{
+		const std::string& frame = *client.queued.front();
+		long long count = client.connection.sendSome(frame.data() + client.sentOfFront, frame.size() - client.sentOfFront);
+		if (count < 0)
+		{
+			return false;
+		}
+		if (count == 0)
+		{
+			break;
+		}
+		client.sentOfFront += (size_t)count;
+		client.queuedBytes -= (size_t)count;
+		if (client.sentOfFront == frame.size())
+		{
+			client.queued.pop_front();
+			client.sentOfFront = 0;
+		}
+	}
+	return client.queuedBytes <= STREAM_CLIENT_BACKLOG;
+}
+
+void StateStreamServer::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	long long step = 0;
+	while (!stopping)
+	{
+		std::unique_ptr<Client> client(new Client());
+		if (listener.accept(client->connection, STREAM_POLL_MILLISECONDS) && client->connection.setNonBlocking())
+		{
+			// It starts from the last keyframe, like everyone else did.
+			for (const std::shared_ptr<const std::string>& frame : history)
+			{
+				client->queued.push_back(frame);
+				client->queuedBytes += frame->size();
+			}
+			connected.push_back(std::move(client));
+			clients = (int)connected.size();
+		}
+
+		bool update = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (fresh)
+			{
+				heights.swap(published);
+				step = publishedStep;
+				fresh = false;
+				update = true;
+			}
+		}
+
+		std::shared_ptr<const std::string> frame = update ? encodeFrame(step, heights) : nullptr;
+		if (frame != nullptr)
+		{
+			const StreamFrameHeader* header = (const StreamFrameHeader*)frame->data();
+			if (header->type == STREAM_KEYFRAME)
+			{
+				history.clear();
+			}
+			history.push_back(frame);
+			for (std::unique_ptr<Client>& c : connected)
+			{
+				c->queued.push_back(frame);
+				c->queuedBytes += frame->size();
+			}
+		}
+
+		for (size_t i = 0; i < connected.size();)
+		{
+			if (flush(*connected[i]))
+			{
+				i++;
+				continue;
+			}
+			if (connected[i]->connection.isOpen())
+			{
+				std::cout << "Dropped a state stream client that couldn't keep up." << std::endl;
+			}
+			connected.erase(connected.begin() + i);
+			clients = (int)connected.size();
+		}
+	}
+}
+
+bool StateStreamClient::connect(const std::string& host, int port)
+{
+	quantized.clear();
+	levels.clear();
+	return connection.connect(host, port);
+}
+
+bool StateStreamClient::receive()
+{
+	StreamFrameHeader header;
+	if (!connection.receive(&header, sizeof(header)))
+	{
+		return false;
+	}
+	if (memcmp(header.magic, "HYST", 4) != 0 || (header.type == STREAM_DELTA && header.vesselCount != quantized.size()))
+	{
+		std::cout << "The state stream is damaged." << std::endl;
+		connection.close();
+		return false;
+	}
+	payload.resize(header.bytes);
+	if (header.bytes > 0 && !connection.receive(&payload[0], header.bytes))
+	{
+		return false;
+	}
+
+	if (header.type == STREAM_KEYFRAME)
+	{
+		quantized.assign(header.vesselCount, 0);
+		levels.assign(header.vesselCount, 0.0f);
+	}
+	size_t position = 0;
+	long long previous = -1;
+	for (uint32_t i = 0; i < header.changed; i++)
+	{
+		uint64_t gap, change;
+		if (!readVarint(payload, position, gap) || !readVarint(payload, position, change) || previous + 1 + (long long)gap >= (long long)quantized.size())
+		{
+			std::cout << "The state stream is damaged." << std::endl;
+			connection.close();
+			return false;
+		}
+		long long v = previous + 1 + (long long)gap;
+		quantized[v] = (int64_t)((uint64_t)quantized[v] + (uint64_t)unzigzag(change));
+		levels[v] = (float)(quantized[v] * (double)header.tolerance);
+		previous = v;
+	}
+	frameStep = header.step;
+	return true;
+}
+
+void StreamInterpolator::add(long long step, const std::vector<float>& heights)
+{
+	if (heights.empty())
+	{
+		return;
+	}
+	if (!frames.empty() && frames.back().heights.size() != heights.size())
+	{
+		clear();
+	}
+	if (!frames.empty() && step <= frames.back().step)
+	{
+		return;
+	}
+
+	if (!frames.empty())
+	{
+		double gap = (double)(step - frames.back().step);
+		interval = interval > 0.0 ? interval * 0.9 + gap * 0.1 : gap;
+	}
+	frames.push_back({ step, heights });
+	while (frames.size() > STREAM_VIEW_FRAMES)
+	{
+		frames.pop_front();
+	}
+
+	// Only a new frame tells how far off the playout is, so this is the only place it jumps: when it is ahead of the newest frame
+	// (the server was at rest and sent nothing) or behind the oldest one that is kept.
+	if (!started || playout > (double)frames.back().step + STREAM_EXTRAPOLATION_FRAMES * interval || playout < (double)frames.front().step)
+	{
+		playout = target();
+		started = true;
+	}
+}
+
+bool StreamInterpolator::next(std::vector<float>& heights)
+{
+	if (frames.empty())
+	{
+		return false;
+	}
+
+	// A fiftieth of the distance per step pulls the playout back to where it belongs within a few seconds, at no more than a
+	// quarter faster or slower. Past the last frame it stops where the extrapolation does, so the heights hold still and go on
+	// from there once the next frame arrives, instead of jumping to where they would have got in the meantime.
+	const Frame& last = frames.back();
+	double limit = (double)last.step + STREAM_EXTRAPOLATION_FRAMES * interval;
+	playout = std::min(std::max(playout, limit), playout + 1.0 + std::max(-0.25, std::min(0.25, (target() - playout) * 0.02)));
+
+	beyond = playout > (double)last.step;
+	if (frames.size() == 1 || playout <= (double)frames.front().step)
+	{
+		heights = (frames.size() == 1 ? last : frames.front()).heights;
+		return true;
+	}
+	if (beyond)
+	{
+		const Frame& before = frames[frames.size() - 2];
+		double ahead = playout - (double)last.step;
+		float t = (float)(ahead / (double)(last.step - before.step));
+		heights.resize(last.heights.size());
+		for (size_t i = 0; i < heights.size(); i++)
+		{
+			heights[i] = std::max(0.0f, last.heights[i] + (last.heights[i] - before.heights[i]) * t);
+		}
+		return true;
+	}
+
+	size_t k = 1;
+	while ((double)frames[k].step < playout)
+	{
+		k++;
+	}
+	const Frame& a = frames[k - 1];
+	const Frame& b = frames[k];
+	float t = (float)((playout - (double)a.step) / (double)(b.step - a.step));
+	heights.resize(a.heights.size());
+	for (size_t i = 0; i < heights.size(); i++)
+	{
+		heights[i] = a.heights[i] + (b.heights[i] - a.heights[i]) * t;
+	}
+	return true;
+}
+
+void StreamInterpolator::clear()
+{
+	frames.clear();
+	interval = 0.0;
+	playout = 0.0;
+	started = false;
+	beyond = false;
+}
+
+StreamView::~StreamView()
+{
+	stop();
+}
+
+bool StreamView::start(const std::string& host, int port)
+{
+	stop();
+	interpolator.clear();
+	if (!client.connect(host, port))
+	{
+		return false;
+	}
+	thread = std::thread(&StreamView::run, this);
+	return true;
+}
+
+bool StreamView::next(std::vector<float>& heights, long long& step)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!interpolator.next(heights))
+	{
+		return false;
+	}
+	step = (long long)interpolator.position();
+	return true;
+}
+
+void StreamView::stop()
+{
+	if (thread.joinable())
+	{
+		client.disconnect();
+		thread.join();
+	}
+}
+
+void StreamView::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	while (client.receive())
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		interpolator.add(client.step(), client.heights());
+	}
+	std::cout << "The state stream ended." << std::endl;
+}
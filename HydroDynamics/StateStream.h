@@ -0,0 +1,233 @@
+/*
+Title: HydroDynamics
+File Name: StateStream.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Streams the fill levels of the network to any number of remote viewers over TCP
+(--stream-port PORT), so operators can watch one simulation from elsewhere.
+
+publish() only copies the heights and leaves everything else to a background thread, which
+turns them into frames at the rate they are published (--stream-hz). Every height is
+quantized to the tolerance of the stream, and a frame only holds the vessels whose quantized
+height changed since the frame before, so a network at rest costs nothing and one that
+moves in a few places costs little. Every STREAM_KEYFRAME_FRAMES frames (and whenever the
+number of vessels changes) a keyframe holds all of them instead. If the thread falls behind,
+the heights published meanwhile are simply replaced by newer ones, and the next frame holds
+all the changes since the last one.
+
+Every frame is encoded once and the same bytes go to every client, so the work per vessel
+doesn't grow with the number of clients. A client that connects is sent the last keyframe and
+the frames since then, and one that can't keep up with STREAM_CLIENT_BACKLOG bytes waiting
+is dropped rather than held up for, or holding up, the others.
+
+A frame is a StreamFrameHeader followed by one entry per changed vessel, in the order of the
+vessels: the number of vessels skipped since the entry before as a varint, then the change
+of its quantized height as a zigzag varint (its whole quantized height in a keyframe).
+Everything is little endian. StateStreamClient decodes it.
+
+A viewer (--stream-view HOST:PORT, see StreamView) gets a frame every few steps, or none
+for a while when the connection stalls, but draws every step. StreamInterpolator keeps the
+last STREAM_VIEW_FRAMES frames and plays them STREAM_PLAYOUT_FRAMES frame intervals behind
+the newest, so there is almost always a frame on either side of the step it shows, and the
+heights are interpolated between them. When the newest frame is late, the heights go on
+along the last two frames for at most STREAM_EXTRAPOLATION_FRAMES intervals and then hold.
+The playout speeds up or slows down a little to stay at its distance behind the newest
+frame, and jumps there when a frame shows it is far off (after connecting, or after the
+server was at rest and sent nothing).
+*/
+
+#ifndef _STATE_STREAM_H
+#define _STATE_STREAM_H
+
+#include "VesselNetwork.h"
+#include "LineSocket.h"
+#include <memory>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#define STREAM_KEYFRAME_FRAMES 600
+#define STREAM_CLIENT_BACKLOG (4 << 20)
+#define STREAM_VIEW_FRAMES 8
+#define STREAM_PLAYOUT_FRAMES 1.5
+#define STREAM_EXTRAPOLATION_FRAMES 2.0
+
+enum StreamFrameType
+{
+	STREAM_KEYFRAME = 1,
+	STREAM_DELTA
+};
+
+struct StreamFrameHeader
+{
+	char magic[4];			// "HYST"
+	uint32_t bytes;			// Of the entries that follow
+	uint32_t type;			// StreamFrameType
+	uint32_t changed;		// Number of entries
+	int64_t step;			// The physics step the heights are from
+	float tolerance;		// Quantized heights are multiples of this
+	uint32_t vesselCount;
+};
+
+class StateStreamServer
+{
+public:
+	StateStreamServer() {}
+	~StateStreamServer();
+
+	StateStreamServer(const StateStreamServer&) = delete;
+	StateStreamServer& operator=(const StateStreamServer&) = delete;
+
+	// Listens on port and starts the thread that sends the frames. Returns false (after printing an error) if the port can't be used.
+	bool start(int port, float tolerance);
+
+	// Hands the heights of the network after step to the stream.
+	void publish(long long step, const VesselNetwork& network);
+
+	// Stops the thread and drops every client.
+	void stop();
+
+	int clientCount() const { return clients.load(); }
+
+private:
+	struct Client
+	{
+		LineConnection connection;
+		std::deque<std::shared_ptr<const std::string>> queued;
+		size_t sentOfFront = 0;		// How much of the first queued frame went out already
+		size_t queuedBytes = 0;
+	};
+
+	void run();
+	std::shared_ptr<const std::string> encodeFrame(long long step, const std::vector<float>& heights);
+	bool flush(Client& client);
+
+	LineListener listener;
+	float tolerance = 0.0f;
+	std::thread thread;
+	std::atomic<bool> stopping{ false };
+	std::atomic<int> clients{ 0 };
+
+	// Handed over by publish(): the newest heights and their step, and whether the thread has seen them yet.
+	std::mutex mutex;
+	std::vector<float> published;
+	long long publishedStep = 0;
+	bool fresh = false;
+
+	// Only touched by the thread.
+	std::vector<float> heights;
+	std::vector<int64_t> sent;	// The quantized height of every vessel as of the last frame
+	long long frames = 0;
+	long long bytesEncoded = 0;
+	std::vector<std::shared_ptr<const std::string>> history;	// The last keyframe and the frames since
+	std::vector<std::unique_ptr<Client>> connected;
+};
+
+class StateStreamClient
+{
+public:
+	// Connects to a server. Returns false (after printing an error) if that fails.
+	bool connect(const std::string& host, int port);
+
+	// Waits for the next frame and applies it. Returns false once the connection is gone or the stream is damaged.
+	bool receive();
+
+	// The heights as of the last frame. Empty until the first keyframe arrived.
+	const std::vector<float>& heights() const { return levels; }
+	long long step() const { return frameStep; }
+
+	// Makes a receive() waiting on another thread return false.
+	void disconnect() { connection.shutdown(); }
+
+private:
+	LineConnection connection;
+	std::vector<int64_t> quantized;
+	std::vector<float> levels;
+	std::string payload;
+	long long frameStep = 0;
+};
+
+class StreamInterpolator
+{
+public:
+	// Adds the heights of a frame. Frames that aren't newer than the newest are dropped, and a frame with another number of vessels
+	// starts over.
+	void add(long long step, const std::vector<float>& heights);
+
+	// Moves the playout one step on and writes the heights there. Returns false until the first frame arrived.
+	bool next(std::vector<float>& heights);
+
+	double position() const { return playout; }
+	bool extrapolating() const { return beyond; }
+	void clear();
+
+private:
+	struct Frame
+	{
+		long long step;
+		std::vector<float> heights;
+	};
+
+	double target() const { return frames.back().step - STREAM_PLAYOUT_FRAMES * interval; }
+
+	std::deque<Frame> frames;
+	double interval = 0.0;		// The steps between two frames, averaged
+	double playout = 0.0;
+	bool started = false;
+	bool beyond = false;
+};
+
+// Receives a stream on its own thread and plays it through a StreamInterpolator.
+class StreamView
+{
+public:
+	StreamView() {}
+	~StreamView();
+
+	StreamView(const StreamView&) = delete;
+	StreamView& operator=(const StreamView&) = delete;
+
+	// Connects to the server and starts the thread. Returns false (after printing an error) if that fails.
+	bool start(const std::string& host, int port);
+
+	// Moves the playout one step on and writes the heights there, and the step they are from. Returns false until the first frame
+	// arrived.
+	bool next(std::vector<float>& heights, long long& step);
+
+	void stop();
+	bool isOpen() const { return thread.joinable(); }
+
+private:
+	void run();
+
+	StateStreamClient client;
+	std::thread thread;
+	std::mutex mutex;
+	StreamInterpolator interpolator;
+};
+
+#endif // _STATE_STREAM_H
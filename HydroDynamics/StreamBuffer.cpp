@@ -0,0 +1,118 @@
+/*
+Title: HydroDynamics
+File Name: StreamBuffer.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A buffer for data that is written again every frame, mapped persistently into the memory of
+the program so the data is written straight into memory the GPU reads from.
+
+glBufferSubData copies the data into the driver first, and if the GPU is still drawing from
+the buffer, the driver has to either wait for it or quietly make another copy. Instead, this
+buffer is created once with glBufferStorage and mapped for good with GL_MAP_PERSISTENT_BIT
+and GL_MAP_COHERENT_BIT, and it has STREAM_SEGMENTS copies (segments) of the data. Every
+write goes into the next segment while the GPU can still be drawing from the others, and a
+fence after the draws of every frame says when the GPU is done with a segment, so it is only
+written again once that fence has passed. With three segments that is normally long ago,
+and the CPU never waits.
+
+Needs OpenGL 4.4 or ARB_buffer_storage. Without it, create() returns false and the caller
+keeps using an ordinary buffer.
+*/
+
+#include "StreamBuffer.h"
+#include <cstring>
+
+bool StreamBuffer::create(GLsizeiptr segmentSize, const void* data)
+{
+	if (!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) || segmentSize <= 0)
+	{
+		return false;
+	}
+
+	size = segmentSize;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+	glBufferStorage(GL_ARRAY_BUFFER, size * STREAM_SEGMENTS, nullptr, flags);
+	memory = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size * STREAM_SEGMENTS, flags);
+	if (memory == nullptr)
+	{
+		glDeleteBuffers(1, &id);
+		id = 0;
+		return false;
+	}
+
+	for (int i = 0; i < STREAM_SEGMENTS; i++)
+	{
+		memcpy(memory + i * size, data, size);
+	}
+	current = 0;
+	return true;
+}
+
+void* StreamBuffer::beginWrite()
+{
+	current = (current + 1) % STREAM_SEGMENTS;
+
+	// The fence was placed after the last frame that drew from this segment. Flushing makes sure it actually reaches the GPU,
+	// otherwise we could wait for a fence that is still sitting in the queue of the driver.
+	GLsync& done = fences[current];
+	if (done != nullptr)
+	{
+		GLenum status = glClientWaitSync(done, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (status == GL_TIMEOUT_EXPIRED)
+		{
+			status = glClientWaitSync(done, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(done);
+		done = nullptr;
+	}
+	return memory + current * size;
+}
+
+void StreamBuffer::fence()
+{
+	if (fences[current] != nullptr)
+	{
+		glDeleteSync(fences[current]);
+	}
+	fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::destroy()
+{
+	for (GLsync& done : fences)
+	{
+		if (done != nullptr)
+		{
+			glDeleteSync(done);
+			done = nullptr;
+		}
+	}
+	if (id != 0)
+	{
+		// Deleting a buffer unmaps it.
+		glDeleteBuffers(1, &id);
+		id = 0;
+	}
+	memory = nullptr;
+}
@@ -0,0 +1,79 @@
+/*
+Title: HydroDynamics
+File Name: StreamBuffer.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A buffer for data that is written again every frame, mapped persistently into the memory of
+the program so the data is written straight into memory the GPU reads from.
+
+glBufferSubData copies the data into the driver first, and if the GPU is still drawing from
+the buffer, the driver has to either wait for it or quietly make another copy. Instead, this
+buffer is created once with glBufferStorage and mapped for good with GL_MAP_PERSISTENT_BIT
+and GL_MAP_COHERENT_BIT, and it has STREAM_SEGMENTS copies (segments) of the data. Every
+write goes into the next segment while the GPU can still be drawing from the others, and a
+fence after the draws of every frame says when the GPU is done with a segment, so it is only
+written again once that fence has passed. With three segments that is normally long ago,
+and the CPU never waits.
+
+Needs OpenGL 4.4 or ARB_buffer_storage. Without it, create() returns false and the caller
+keeps using an ordinary buffer.
+*/
+
+#ifndef _STREAM_BUFFER_H
+#define _STREAM_BUFFER_H
+
+#include "GLIncludes.h"
+
+// How many copies of the data are in the buffer.
+#define STREAM_SEGMENTS 3
+
+class StreamBuffer
+{
+public:
+	// Creates the buffer with segments of segmentSize bytes and copies data into every one of them, so the parts that are never
+	// written again are there in all of them. Returns false (and creates nothing) if the driver can't map buffers persistently.
+	bool create(GLsizeiptr segmentSize, const void* data);
+
+	// Moves on to the next segment and returns where to write it. If the GPU could still be drawing from it, waits until it
+	// is done first. Draws read from this segment from now on.
+	void* beginWrite();
+
+	// Call after the draws of every frame: the current segment stays in use by the GPU until then.
+	void fence();
+
+	// Frees the buffer and the fences.
+	void destroy();
+
+	GLuint buffer() const { return id; }
+	int segment() const { return current; }
+	GLintptr offset() const { return current * size; }	// Where the current segment starts in the buffer
+	bool valid() const { return memory != nullptr; }
+
+private:
+	GLuint id = 0;
+	char* memory = nullptr;
+	GLsizeiptr size = 0;
+	int current = 0;
+	GLsync fences[STREAM_SEGMENTS] = {};
+};
+
+#endif // _STREAM_BUFFER_H
@@ -0,0 +1,475 @@
+/*
+Title: HydroDynamics
+File Name: Sweep.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Runs many variants of the classic apparatus in one go, for parameter sweeps and Monte Carlo
+studies. A sweep file says which parameters to vary and how; every other parameter keeps the
+value of the classic apparatus.
+
+All variants go into one VesselNetwork, each as a component of its own (two vessels and a
+tube). Components never affect each other, so this is the same as running every variant on
+its own, but the network steps all their tubes with the SIMD kernels and splits them over
+the cores of a TaskPool, and a variant that has come to rest falls asleep and costs nothing
+from then on. Thousands of variants take one process start and a few milliseconds per step.
+
+With the batched layout (the default), variants that the network would step in single
+precision with the local integrator go into an ApparatusBatch instead, eight to a block of
+vector registers (see ApparatusBatch.h). They end up at exactly the same levels, only
+faster, so the network is only used for the other settings and for showing the variants.
+
+The sweep file is plain text, one setting per line, and lines starting with # are comments:
+
+	big-width 0.4 0.5 0.6			a list of values
+	small-height range 0.2 0.8 7	7 values evenly spaced from 0.2 to 0.8
+	pressure random 0 2				a random value from 0 to 2 for every sample
+	samples 1000					how many samples of the random parameters to draw for every
+									combination of the others (the default is 1)
+	seed 7							where the random numbers start (the default is 1)
+
+The parameters are big-width, small-width, big-height, small-height, pressure (on the big
+vessel), inertance and damping (of the tube). Every combination of the listed values is a
+variant, times the samples. The random numbers come from a std::mt19937 and are turned into
+floats by hand, so the same file gives the same variants with every compiler.
+
+The results are one line of comma separated values per variant: its parameters, the levels
+it ended at, the lowest and highest level the big vessel reached, and when it came to rest
+(-1 if it didn't). Given an EnsembleStats, the run also writes how the levels of all the
+variants it steps spread at regular times, and how their results spread at the end (see
+EnsembleStats.h).
+
+This file has no OpenGL dependency.
+*/
+
+#include "Sweep.h"
+#include "VesselNetwork.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+
+// The names used in the file and in the results, and the values of the classic apparatus, indexed by SweepParameter.
+static const char* parameterNames[SWEEP_PARAMETER_COUNT] =
+{
+	"big-width", "small-width", "big-height", "small-height", "pressure", "inertance", "damping"
+};
+static const float parameterDefaults[SWEEP_PARAMETER_COUNT] =
+{
+	0.5f, 0.25f, 0.5f, 0.5f, 0.0f, DEFAULT_TUBE_INERTANCE, DEFAULT_TUBE_DAMPING
+};
+
+// A float in [0, 1) from the top 24 bits of the generator, which is exactly representable.
+static float randomUnit(std::mt19937& random)
+{
+	return (float)(random() >> 8) * (1.0f / 16777216.0f);
+}
+
+bool Sweep::read(const std::string& fileName)
+{
+	std::ifstream file(fileName, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << fileName << std::endl;
+		return false;
+	}
+	return parse(file, fileName);
+}
+
+bool Sweep::parse(std::istream& in, const std::string& fileName)
+{
+	// Per parameter, the listed values, or the range of a random one.
+	std::vector<std::vector<float>> values(SWEEP_PARAMETER_COUNT);
+	std::vector<char> isRandom(SWEEP_PARAMETER_COUNT, 0);
+	std::vector<float> low(SWEEP_PARAMETER_COUNT, 0.0f);
+	std::vector<float> high(SWEEP_PARAMETER_COUNT, 0.0f);
+	for (int p = 0; p < SWEEP_PARAMETER_COUNT; p++)
+	{
+		values[p].push_back(parameterDefaults[p]);
+	}
+	long long samples = 1;
+	unsigned int seed = 1;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		std::string name;
+		fields >> name;
+		int parameter = SWEEP_PARAMETER_COUNT;
+		for (int p = 0; p < SWEEP_PARAMETER_COUNT; p++)
+		{
+			if (name == parameterNames[p])
+			{
+				parameter = p;
+			}
+		}
+
+		bool valid = true;
+		if (name == "samples")
+		{
+			valid = (bool)(fields >> samples) && samples > 0;
+		}
+		else if (name == "seed")
+		{
+			valid = (bool)(fields >> seed);
+		}
+		else if (parameter == SWEEP_PARAMETER_COUNT)
+		{
+			valid = false;
+		}
+		else
+		{
+			std::string kind;
+			fields >> kind;
+			std::vector<float> listed;
+			isRandom[parameter] = 0;
+			if (kind == "range")
+			{
+				float first;
+				float last;
+				int count;
+				valid = (bool)(fields >> first >> last >> count) && count > 0;
+				for (int i = 0; valid && i < count; i++)
+				{
+					listed.push_back(count == 1 ? first : first + (last - first) * i / (count - 1));
+				}
+			}
+			else if (kind == "random")
+			{
+				valid = (bool)(fields >> low[parameter] >> high[parameter]);
+				isRandom[parameter] = 1;
+				listed.push_back(parameterDefaults[parameter]);
+			}
+			else
+			{
+				std::istringstream list(line);
+				list >> name;
+				float value;
+				while (list >> value)
+				{
+					listed.push_back(value);
+				}
+				valid = !listed.empty() && list.eof();
+			}
+			values[parameter].swap(listed);
+		}
+
+		if (!valid)
+		{
+			std::cout << fileName << " line " << lineNumber << " is not a valid setting: " << line << std::endl;
+			return false;
+		}
+	}
+
+	// Every combination of the listed values, with the first parameter changing slowest, and the samples of each in a row.
+	long long combinations = 1;
+	for (int p = 0; p < SWEEP_PARAMETER_COUNT; p++)
+	{
+		combinations *= (long long)values[p].size();
+	}
+	std::mt19937 random(seed);
+	variants.clear();
+	variants.reserve((size_t)(combinations * samples));
+	for (long long c = 0; c < combinations; c++)
+	{
+		SweepVariant variant;
+		long long rest = c;
+		for (int p = SWEEP_PARAMETER_COUNT - 1; p >= 0; p--)
+		{
+			long long count = (long long)values[p].size();
+			variant.value[p] = values[p][(size_t)(rest % count)];
+			rest /= count;
+		}
+		for (long long s = 0; s < samples; s++)
+		{
+			for (int p = 0; p < SWEEP_PARAMETER_COUNT; p++)
+			{
+				if (isRandom[p])
+				{
+					variant.value[p] = low[p] + (high[p] - low[p]) * randomUnit(random);
+				}
+			}
+			variants.push_back(variant);
+		}
+	}
+
+	for (const SweepVariant& variant : variants)
+	{
+		if (variant.value[SWEEP_BIG_WIDTH] <= 0.0f || variant.value[SWEEP_SMALL_WIDTH] <= 0.0f
+			|| variant.value[SWEEP_BIG_HEIGHT] < 0.0f || variant.value[SWEEP_SMALL_HEIGHT] < 0.0f
+			|| variant.value[SWEEP_INERTANCE] <= 0.0f || variant.value[SWEEP_DAMPING] < 0.0f)
+		{
+			std::cout << fileName << " makes a variant with a width or inertance that isn't positive, or a height or damping below 0." << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// The key of a variant run with settings. maxSteps is part of it, since a variant that doesn't come to rest ends where the steps do.
+static uint64_t variantKey(const SweepVariant& variant, const SweepSettings& settings)
+{
+	ResultKey key;
+	key.add(variant.value);
+	key.add(settings.density);
+	key.add(settings.gravity);
+	key.add(settings.dt);
+	key.add(settings.maxSteps);
+	key.add(settings.integrator);
+	key.add(settings.preconditioner);
+	key.add(settings.precision);
+	return key.value();
+}
+
+bool Sweep::batchable(const SweepSettings& settings)
+{
+	return settings.layout == SWEEP_LAYOUT_BATCHED && settings.integrator == INTEGRATOR_LOCAL && settings.precision == PRECISION_SINGLE;
+}
+
+void Sweep::build(VesselNetwork& network, const SweepSettings& settings, int begin, int end, ResultCache* resultCache)
+{
+	network.clear();
+	batch.clear();
+	batched = batchable(settings);
+	network.integrator = settings.integrator;
+	network.solver.preconditioner = settings.preconditioner;
+	network.precision = settings.precision;
+
+	first = begin;
+	cache = resultCache;
+	int count = end - begin;
+	built.assign(count, -1);
+	builtKeys.clear();
+	cachedResults.assign(cache != nullptr ? (size_t)count * SWEEP_RESULT_COUNT : 0, 0.0);
+
+	// A variant that came up before in this chunk is built once, like the ones the cache already has.
+	std::unordered_map<uint64_t, int> apparatusOf;
+	std::vector<double> values;
+	for (int i = 0; i < count; i++)
+	{
+		const float* value = variants[begin + i].value;
+		if (cache != nullptr)
+		{
+			uint64_t key = variantKey(variants[begin + i], settings);
+			auto before = apparatusOf.find(key);
+			if (before != apparatusOf.end())
+			{
+				built[i] = before->second;
+				continue;
+			}
+			if (cache->find(key, values) && values.size() == SWEEP_RESULT_COUNT)
+			{
+				std::copy(values.begin(), values.end(), cachedResults.begin() + (size_t)i * SWEEP_RESULT_COUNT);
+				continue;
+			}
+			apparatusOf[key] = (int)builtKeys.size();
+			builtKeys.push_back(key);
+		}
+
+		if (batched)
+		{
+			built[i] = batch.add(value[SWEEP_BIG_WIDTH], value[SWEEP_SMALL_WIDTH], value[SWEEP_BIG_HEIGHT], value[SWEEP_SMALL_HEIGHT],
+				value[SWEEP_PRESSURE], value[SWEEP_INERTANCE], value[SWEEP_DAMPING]);
+			continue;
+		}
+		int apparatus = network.vesselCount() / 2;
+		built[i] = apparatus;
+		float x = apparatus * SWEEP_SPACING;
+		int big = network.addVessel(x - 0.75f, -0.5f, value[SWEEP_BIG_WIDTH], value[SWEEP_BIG_HEIGHT]);
+		int small = network.addVessel(x + 0.5f, -0.5f, value[SWEEP_SMALL_WIDTH], value[SWEEP_SMALL_HEIGHT]);
+		network.addTube(big, small, value[SWEEP_INERTANCE], value[SWEEP_DAMPING]);
+	}
+	if (batched)
+	{
+		restStep.assign(batch.count(), -1);
+		lowest.resize(batch.count());
+		highest.resize(batch.count());
+		return;
+	}
+	network.rebuildTopology();
+	int apparatuses = network.vesselCount() / 2;
+	for (int i = 0; i < count; i++)
+	{
+		if (built[i] >= 0)
+		{
+			network.setExternalPressure(2 * built[i], variants[begin + i].value[SWEEP_PRESSURE]);
+		}
+	}
+
+	lowest.resize(apparatuses);
+	highest.resize(apparatuses);
+	for (int i = 0; i < apparatuses; i++)
+	{
+		lowest[i] = network.height[2 * i];
+		highest[i] = network.height[2 * i];
+	}
+	restStep.assign(apparatuses, -1);
+}
+
+std::vector<std::string> Sweep::ensembleQuantities()
+{
+	return { "big level", "small level", "lowest", "highest", "rest time" };
+}
+
+void Sweep::sampleEnsemble(const VesselNetwork& network, const SweepSettings& settings, EnsembleStats& ensemble, const std::string& time,
+	bool end) const
+{
+	for (int i = 0; i < builtCount(); i++)
+	{
+		ensemble.add(0, batched ? batch.bigHeight(i) : network.height[2 * i]);
+		ensemble.add(1, batched ? batch.smallHeight(i) : network.height[2 * i + 1]);
+		if (end)
+		{
+			ensemble.add(2, lowest[i]);
+			ensemble.add(3, highest[i]);
+			if (restStep[i] >= 0)
+			{
+				ensemble.add(4, restStep[i] * (double)settings.dt);
+			}
+		}
+	}
+	ensemble.finishSample(time);
+}
+
+long long Sweep::run(VesselNetwork& network, const SweepSettings& settings, TaskPool* pool, EnsembleStats* ensemble)
+{
+	long long steps = 0;
+	bool moved = builtCount() > 0;
+	bool sampling = ensemble != nullptr && ensemble->isOpen() && builtCount() > 0;
+	long long every = sampling ? std::max(1LL, ensemble->every) : 0;
+	auto sampleAt = [&](long long step)
+	{
+		if (sampling && step % every == 0)
+		{
+			std::ostringstream time;
+			time << step * (double)settings.dt;
+			sampleEnsemble(network, settings, *ensemble, time.str(), false);
+		}
+	};
+	sampleAt(0);
+
+	// The batch keeps track of the levels and the rest steps itself.
+	if (batched)
+	{
+		while (moved && steps < settings.maxSteps)
+		{
+			moved = batch.update(settings.density, settings.gravity, settings.dt, steps + 1, pool);
+			steps++;
+			sampleAt(steps);
+		}
+		for (int i = 0; i < builtCount(); i++)
+		{
+			lowest[i] = batch.lowest(i);
+			highest[i] = batch.highest(i);
+			restStep[i] = batch.restStep(i);
+		}
+	}
+	while (!batched && moved && steps < settings.maxSteps)
+	{
+		moved = network.update(settings.density, settings.gravity, settings.dt, pool);
+		steps++;
+
+		for (int i = 0; i < (int)restStep.size(); i++)
+		{
+			if (restStep[i] >= 0)
+			{
+				continue;
+			}
+			float height = network.height[2 * i];
+			lowest[i] = std::min(lowest[i], height);
+			highest[i] = std::max(highest[i], height);
+			if (!network.componentAwake[i])
+			{
+				restStep[i] = steps;
+			}
+		}
+		sampleAt(steps);
+	}
+	if (sampling)
+	{
+		sampleEnsemble(network, settings, *ensemble, "end", true);
+	}
+
+	if (cache != nullptr)
+	{
+		std::vector<double> values;
+		for (int i = 0; i < (int)builtKeys.size(); i++)
+		{
+			results(i, network, settings, values);
+			cache->store(builtKeys[i], values);
+		}
+	}
+	return steps;
+}
+
+void Sweep::results(int apparatus, const VesselNetwork& network, const SweepSettings& settings, std::vector<double>& values) const
+{
+	float big = batched ? batch.bigHeight(apparatus) : network.height[2 * apparatus];
+	float small = batched ? batch.smallHeight(apparatus) : network.height[2 * apparatus + 1];
+	values.assign({ big, small, lowest[apparatus], highest[apparatus],
+		restStep[apparatus] >= 0 ? restStep[apparatus] * (double)settings.dt : -1.0 });
+}
+
+void Sweep::writeHeader(std::ostream& out) const
+{
+	out << "variant";
+	for (int p = 0; p < SWEEP_PARAMETER_COUNT; p++)
+	{
+		out << "," << parameterNames[p];
+	}
+	out << ",big level,small level,lowest,highest,rest time" << std::endl;
+}
+
+void Sweep::writeResults(std::ostream& out, const VesselNetwork& network, const SweepSettings& settings) const
+{
+	std::vector<double> values;
+	for (int i = 0; i < (int)built.size(); i++)
+	{
+		if (built[i] >= 0)
+		{
+			results(built[i], network, settings, values);
+		}
+		else
+		{
+			values.assign(cachedResults.begin() + (size_t)i * SWEEP_RESULT_COUNT, cachedResults.begin() + (size_t)(i + 1) * SWEEP_RESULT_COUNT);
+		}
+		out << first + i;
+		for (int p = 0; p < SWEEP_PARAMETER_COUNT; p++)
+		{
+			out << "," << variants[first + i].value[p];
+		}
+		for (double value : values)
+		{
+			out << "," << value;
+		}
+		out << std::endl;
+	}
+}
@@ -0,0 +1,187 @@
+/*
+Title: HydroDynamics
+File Name: Sweep.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Runs many variants of the classic apparatus in one go, for parameter sweeps and Monte Carlo
+studies. A sweep file says which parameters to vary and how; every other parameter keeps the
+value of the classic apparatus.
+
+All variants go into one VesselNetwork, each as a component of its own (two vessels and a
+tube). Components never affect each other, so this is the same as running every variant on
+its own, but the network steps all their tubes with the SIMD kernels and splits them over
+the cores of a TaskPool, and a variant that has come to rest falls asleep and costs nothing
+from then on. Thousands of variants take one process start and a few milliseconds per step.
+
+With the batched layout (the default), variants that the network would step in single
+precision with the local integrator go into an ApparatusBatch instead, eight to a block of
+vector registers (see ApparatusBatch.h). They end up at exactly the same levels, only
+faster, so the network is only used for the other settings and for showing the variants.
+
+The sweep file is plain text, one setting per line, and lines starting with # are comments:
+
+	big-width 0.4 0.5 0.6			a list of values
+	small-height range 0.2 0.8 7	7 values evenly spaced from 0.2 to 0.8
+	pressure random 0 2				a random value from 0 to 2 for every sample
+	samples 1000					how many samples of the random parameters to draw for every
+									combination of the others (the default is 1)
+	seed 7							where the random numbers start (the default is 1)
+
+The parameters are big-width, small-width, big-height, small-height, pressure (on the big
+vessel), inertance and damping (of the tube). Every combination of the listed values is a
+variant, times the samples. The random numbers come from a std::mt19937 and are turned into
+floats by hand, so the same file gives the same variants with every compiler.
+
+The results are one line of comma separated values per variant: its parameters, the levels
+it ended at, the lowest and highest level the big vessel reached, and when it came to rest
+(-1 if it didn't). Given an EnsembleStats, the run also writes how the levels of all the
+variants it steps spread at regular times, and how their results spread at the end (see
+EnsembleStats.h).
+
+Given a ResultCache, only the variants it has no results for are built and run, and each of
+them only once, however often it comes up: the results of the others are copied from the
+cache, which keeps the results of everything that was run.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include "VesselNetwork.h"
+#include "ApparatusBatch.h"
+#include "ResultCache.h"
+#include "EnsembleStats.h"
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+class TaskPool;
+
+// The apparatus of every variant is laid out like the classic one, SWEEP_SPACING further right than the one before it.
+#define SWEEP_SPACING 4.0f
+
+// The number of results of a variant: both levels, the lowest and the highest level of the big vessel, and the rest time.
+#define SWEEP_RESULT_COUNT 5
+
+enum SweepParameter
+{
+	SWEEP_BIG_WIDTH = 0,
+	SWEEP_SMALL_WIDTH,
+	SWEEP_BIG_HEIGHT,
+	SWEEP_SMALL_HEIGHT,
+	SWEEP_PRESSURE,
+	SWEEP_INERTANCE,
+	SWEEP_DAMPING,
+	SWEEP_PARAMETER_COUNT
+};
+
+struct SweepVariant
+{
+	float value[SWEEP_PARAMETER_COUNT];
+};
+
+// Where the variants are stepped: as components of a VesselNetwork, or in the blocks of an ApparatusBatch if the settings allow it.
+enum SweepLayout
+{
+	SWEEP_LAYOUT_NETWORK = 0,
+	SWEEP_LAYOUT_BATCHED
+};
+
+// How every variant is stepped. The same for all of them.
+struct SweepSettings
+{
+	float density = 1.0f;
+	float gravity = 9.8f;
+	float dt = 1.0f / 120.0f;
+	long long maxSteps = 1000;		// Stepping stops after this many steps, or earlier once every variant has come to rest
+	Integrator integrator = INTEGRATOR_LOCAL;
+	SolverPreconditioner preconditioner = PRECONDITIONER_JACOBI;
+	Precision precision = PRECISION_SINGLE;
+	SweepLayout layout = SWEEP_LAYOUT_BATCHED;
+};
+
+class Sweep
+{
+public:
+	std::vector<SweepVariant> variants;
+
+	// Reads a sweep file and expands it into variants. Returns false (after printing an error) if the file can't be read or
+	// contains a line that isn't a valid setting.
+	bool read(const std::string& fileName);
+
+	// The same for the contents of a sweep file that was already read. name is only used in the errors.
+	bool parse(std::istream& in, const std::string& name);
+
+	int variantCount() const { return (int)variants.size(); }
+
+	// Replaces the contents of network with one apparatus per variant from begin to end - 1: vessels 2 * i (big) and 2 * i + 1
+	// (small) and tube i belong to variant begin + i, and so does component i. Every big vessel gets the pressure of its variant.
+	// With a cache, only the variants from begin to end - 1 the cache has no results for are built, each of them once, in order.
+	// If the batched layout applies to the settings, the variants go into the batch of the sweep instead and network is left empty.
+	void build(VesselNetwork& network, const SweepSettings& settings, int begin, int end, ResultCache* cache = nullptr);
+
+	// Steps the variants that were built until all of them have come to rest or settings.maxSteps is reached, and keeps track of
+	// the lowest and highest levels and of when every variant came to rest. Returns the number of steps. The results go into the
+	// cache given to build(). With an open ensemble, the levels of the variants that were built are sampled into it at the start,
+	// every ensemble->every steps and at the end, where their results are added too (see ensembleQuantities()).
+	long long run(VesselNetwork& network, const SweepSettings& settings, TaskPool* pool = nullptr, EnsembleStats* ensemble = nullptr);
+
+	// The quantities a run samples into its ensemble: both levels, and at the end also the lowest and highest level of the big
+	// vessel and the rest time of the variants that came to rest.
+	static std::vector<std::string> ensembleQuantities();
+
+	// The number of variants from the last build() that were found in its cache or came up before, and so weren't built.
+	int cachedCount() const { return (int)built.size() - builtCount(); }
+
+	// Writes the first line of the results, which names the columns.
+	void writeHeader(std::ostream& out) const;
+
+	// Writes the results of the variants that were built and run.
+	void writeResults(std::ostream& out, const VesselNetwork& network, const SweepSettings& settings) const;
+
+private:
+	int builtCount() const { return (int)restStep.size(); }
+
+	// Adds the levels of every built apparatus to the ensemble, and finishes the sample with time.
+	void sampleEnsemble(const VesselNetwork& network, const SweepSettings& settings, EnsembleStats& ensemble, const std::string& time, bool end) const;
+
+	// The SWEEP_RESULT_COUNT results of a built apparatus, as the cache keeps them.
+	void results(int apparatus, const VesselNetwork& network, const SweepSettings& settings, std::vector<double>& values) const;
+
+	// Whether the layout and the settings of the last build() put the variants into batch.
+	static bool batchable(const SweepSettings& settings);
+	bool batched = false;
+	ApparatusBatch batch;
+
+	int first = 0;					// The variant that was built first
+	ResultCache* cache = nullptr;
+	std::vector<int> built;			// For every variant from first on, the apparatus it was built as, or -1 if it comes from the cache
+	std::vector<uint64_t> builtKeys;	// For every apparatus, the key of its variant
+	std::vector<double> cachedResults;	// For every variant from first on, its results if they come from the cache
+	std::vector<float> lowest;
+	std::vector<float> highest;
+	std::vector<long long> restStep;
+};
+
+#endif // _SWEEP_H
@@ -0,0 +1,360 @@
+/*
+Title: HydroDynamics
+File Name: SweepCluster.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Spreads a sweep (see Sweep.h) over many machines. One process is the coordinator: it owns
+the sweep file and the results, and hands out the variants in chunks. Any number of workers
+connect to it over TCP, on the same machine or on others, and each of them asks for a chunk,
+steps it with all of its cores, sends back the results and asks for the next one. A fast
+machine simply asks more often, so the load balances itself, and workers can join at any
+time.
+
+A chunk that was handed out is only done once its results are back. If a worker goes away
+in the middle of a chunk, the chunk goes back into the queue, and once the queue is empty
+the workers that are still around are handed the chunks that are still out, so one slow or
+stuck machine can't hold up the end of the sweep. Whichever copy comes back first counts.
+
+The coordinator sends every worker the sweep file and the settings to step with, so the
+workers need nothing but the address of the coordinator. Expanding a sweep file always gives
+the same variants, so a chunk is just a range of variant numbers. The coordinator writes the
+results in the order of the variants, as the chunks come in, so the output is the same as
+that of a sweep run in one process.
+
+Everything said between the two is lines of text:
+	worker: hello
+	coordinator: settings DENSITY GRAVITY DT MAX_STEPS INTEGRATOR PRECONDITIONER PRECISION,
+	then spec LINE for every line of the sweep file, then end
+	worker: next
+	coordinator: chunk BEGIN END, or wait (try again in a moment), or done
+	worker: row CSV for every variant of the chunk, then finished
+*/
+
+#include "SweepCluster.h"
+#include "LineSocket.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+
+// The state of a sweep on the coordinator, shared by the threads that talk to the workers.
+struct SweepQueue
+{
+	std::mutex lock;
+	int chunkCount = 0;
+	int chunkSize = 0;
+	int variantCount = 0;
+	std::vector<int> pending;			// Chunks nobody is working on, the next one to hand out last
+	std::vector<int> handedOut;			// Per chunk, how many workers are working on it right now
+	std::vector<char> done;
+	std::map<int, std::string> waiting;	// Results of finished chunks that can't be written yet, because one before them isn't done
+	int nextToWrite = 0;
+	int doneCount = 0;
+	std::ostream* out = nullptr;
+	std::atomic<bool> finished{ false };
+};
+
+// Picks the chunk for a worker that asks for one: the next one in the queue, or else a second copy of one that's out with a
+// single worker. Returns -1 if there's nothing to hand out.
+static int takeChunk(SweepQueue& queue)
+{
+	std::lock_guard<std::mutex> guard(queue.lock);
+	int chunk = -1;
+	if (!queue.pending.empty())
+	{
+		chunk = queue.pending.back();
+		queue.pending.pop_back();
+	}
+	else
+	{
+		for (int c = 0; c < queue.chunkCount; c++)
+		{
+			if (!queue.done[c] && queue.handedOut[c] < 2 && (chunk < 0 || queue.handedOut[c] < queue.handedOut[chunk]))
+			{
+				chunk = c;
+			}
+		}
+	}
+	if (chunk >= 0)
+	{
+		queue.handedOut[chunk]++;
+	}
+	return chunk;
+}
+
+// A worker is done with a chunk, with its results, or failed (and rows is null).
+static void returnChunk(SweepQueue& queue, int chunk, const std::string* rows)
+{
+	std::lock_guard<std::mutex> guard(queue.lock);
+	queue.handedOut[chunk]--;
+	if (queue.done[chunk])
+	{
+		return;
+	}
+	if (rows == nullptr)
+	{
+		// Nobody else works on it, so it goes back to the queue, to be handed out next.
+		if (queue.handedOut[chunk] == 0)
+		{
+			queue.pending.push_back(chunk);
+		}
+		return;
+	}
+
+	queue.done[chunk] = 1;
+	queue.doneCount++;
+	queue.pending.erase(std::remove(queue.pending.begin(), queue.pending.end(), chunk), queue.pending.end());
+	queue.waiting[chunk] = *rows;
+	while (!queue.waiting.empty() && queue.waiting.begin()->first == queue.nextToWrite)
+	{
+		*queue.out << queue.waiting.begin()->second;
+		queue.waiting.erase(queue.waiting.begin());
+		queue.nextToWrite++;
+	}
+	std::cout << "\r" << queue.doneCount << " of " << queue.chunkCount << " chunks done" << std::flush;
+	if (queue.doneCount == queue.chunkCount)
+	{
+		std::cout << std::endl;
+		queue.finished = true;
+	}
+}
+
+// Talks to one worker until it goes away or the sweep is done.
+static void serveWorker(SweepQueue& queue, LineConnection& connection, const std::string& greeting)
+{
+	std::string line;
+	if (!connection.receiveLine(line) || line != "hello" || !connection.sendLine(greeting))
+	{
+		return;
+	}
+
+	while (connection.receiveLine(line))
+	{
+		if (line != "next")
+		{
+			return;
+		}
+		if (queue.finished)
+		{
+			connection.sendLine("done");
+			return;
+		}
+
+		int chunk = takeChunk(queue);
+		if (chunk < 0)
+		{
+			if (!connection.sendLine("wait"))
+			{
+				return;
+			}
+			continue;
+		}
+
+		int begin = chunk * queue.chunkSize;
+		int end = std::min(begin + queue.chunkSize, queue.variantCount);
+		std::string rows;
+		bool complete = connection.sendLine("chunk " + std::to_string(begin) + " " + std::to_string(end));
+		while (complete && connection.receiveLine(line) && line != "finished")
+		{
+			if (line.compare(0, 4, "row ") != 0)
+			{
+				complete = false;
+				break;
+			}
+			rows.append(line, 4, std::string::npos);
+			rows += '\n';
+		}
+		complete &= connection.isOpen() && line == "finished";
+		returnChunk(queue, chunk, complete ? &rows : nullptr);
+		if (!complete)
+		{
+			return;
+		}
+	}
+}
+
+bool serveSweep(const std::string& specText, const std::string& specName, const SweepSettings& settings, int port, int chunkSize, std::ostream& out)
+{
+	Sweep sweep;
+	std::istringstream spec(specText);
+	if (!sweep.parse(spec, specName))
+	{
+		return false;
+	}
+
+	LineListener listener;
+	if (!listener.listen(port))
+	{
+		return false;
+	}
+
+	SweepQueue queue;
+	queue.variantCount = sweep.variantCount();
+	queue.chunkSize = std::max(chunkSize, 1);
+	queue.chunkCount = (queue.variantCount + queue.chunkSize - 1) / queue.chunkSize;
+	for (int c = queue.chunkCount - 1; c >= 0; c--)
+	{
+		queue.pending.push_back(c);
+	}
+	queue.handedOut.assign(queue.chunkCount, 0);
+	queue.done.assign(queue.chunkCount, 0);
+	queue.out = &out;
+	queue.finished = queue.chunkCount == 0;
+
+	// Floats are written with enough digits to come back exactly.
+	std::ostringstream greeting;
+	greeting << std::setprecision(9) << "settings " << settings.density << " " << settings.gravity << " " << settings.dt << " "
+		<< settings.maxSteps << " " << (int)settings.integrator << " " << (int)settings.preconditioner << " " << (int)settings.precision << "\n";
+	std::istringstream lines(specText);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		greeting << "spec " << line << "\n";
+	}
+	greeting << "end";
+	std::string greetingText = greeting.str();
+
+	sweep.writeHeader(out);
+	std::cout << "Serving " << queue.variantCount << " variants in " << queue.chunkCount << " chunks on port " << port << std::endl;
+
+	// One thread per worker. They only wait on their own connection, so a slow worker holds up nobody else.
+	std::vector<std::unique_ptr<LineConnection>> connections;
+	std::vector<std::thread> threads;
+	while (!queue.finished)
+	{
+		std::unique_ptr<LineConnection> connection(new LineConnection());
+		if (listener.accept(*connection, SWEEP_WAIT_MILLISECONDS))
+		{
+			LineConnection* worker = connection.get();
+			connections.push_back(std::move(connection));
+			threads.emplace_back([&queue, worker, &greetingText]() { serveWorker(queue, *worker, greetingText); });
+		}
+	}
+	listener.close();
+
+	// Workers that were given a copy of a chunk that's done already come back with it and are then told the sweep is done.
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	return true;
+}
+
+bool runSweepWorker(const std::string& host, int port, TaskPool* pool, SweepLayout layout, const std::atomic<bool>* stop)
+{
+	LineConnection connection;
+	if (!connection.connect(host, port))
+	{
+		return false;
+	}
+
+	// The settings, then the sweep file.
+	std::string line;
+	SweepSettings settings;
+	int integrator = 0;
+	int preconditioner = 0;
+	int precision = 0;
+	if (!connection.sendLine("hello") || !connection.receiveLine(line))
+	{
+		std::cout << "The coordinator at " << host << ":" << port << " didn't answer." << std::endl;
+		return false;
+	}
+	std::istringstream fields(line);
+	std::string name;
+	fields >> name >> settings.density >> settings.gravity >> settings.dt >> settings.maxSteps >> integrator >> preconditioner >> precision;
+	settings.integrator = (Integrator)integrator;
+	settings.preconditioner = (SolverPreconditioner)preconditioner;
+	settings.precision = (Precision)precision;
+	settings.layout = layout;
+
+	std::string specText;
+	while (connection.receiveLine(line) && line != "end")
+	{
+		specText.append(line, std::min(line.size(), (size_t)5), std::string::npos);
+		specText += '\n';
+	}
+	Sweep sweep;
+	std::istringstream spec(specText);
+	if (name != "settings" || line != "end" || !sweep.parse(spec, host + ":" + std::to_string(port)))
+	{
+		std::cout << "The coordinator at " << host << ":" << port << " didn't send a valid sweep." << std::endl;
+		return false;
+	}
+
+	// Variants that come up in more than one chunk are only run the first time.
+	VesselNetwork network;
+	ResultCache cache;
+	long long variants = 0;
+	while (connection.sendLine("next") && connection.receiveLine(line))
+	{
+		if (stop != nullptr && stop->load())
+		{
+			std::cout << "Ran " << variants << " variants, leaving the sweep." << std::endl;
+			return true;
+		}
+		if (line == "done")
+		{
+			std::cout << "Ran " << variants << " variants, the sweep is done." << std::endl;
+			return true;
+		}
+		if (line == "wait")
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(SWEEP_WAIT_MILLISECONDS));
+			continue;
+		}
+
+		std::istringstream chunk(line);
+		int begin = 0;
+		int end = 0;
+		if (!(chunk >> name >> begin >> end) || name != "chunk" || begin < 0 || end > sweep.variantCount() || begin > end)
+		{
+			break;
+		}
+		sweep.build(network, settings, begin, end, &cache);
+		sweep.run(network, settings, pool);
+
+		// The whole chunk goes out in one send.
+		std::ostringstream rows;
+		sweep.writeResults(rows, network, settings);
+		std::istringstream results(rows.str());
+		std::string message;
+		while (std::getline(results, line))
+		{
+			message += "row " + line + "\n";
+		}
+		if (!connection.sendLine(message + "finished"))
+		{
+			break;
+		}
+		variants += end - begin;
+	}
+
+	std::cout << "Lost the coordinator at " << host << ":" << port << " after " << variants << " variants." << std::endl;
+	return false;
+}
@@ -0,0 +1,79 @@
+/*
+Title: HydroDynamics
+File Name: SweepCluster.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Spreads a sweep (see Sweep.h) over many machines. One process is the coordinator: it owns
+the sweep file and the results, and hands out the variants in chunks. Any number of workers
+connect to it over TCP, on the same machine or on others, and each of them asks for a chunk,
+steps it with all of its cores, sends back the results and asks for the next one. A fast
+machine simply asks more often, so the load balances itself, and workers can join at any
+time.
+
+A chunk that was handed out is only done once its results are back. If a worker goes away
+in the middle of a chunk, the chunk goes back into the queue, and once the queue is empty
+the workers that are still around are handed a second copy of the chunks that are still out,
+so one slow or stuck machine can't hold up the end of the sweep. Whichever copy comes back first counts.
+
+The coordinator sends every worker the sweep file and the settings to step with, so the
+workers need nothing but the address of the coordinator. Expanding a sweep file always gives
+the same variants, so a chunk is just a range of variant numbers. The coordinator writes the
+results in the order of the variants, as the chunks come in, so the output is the same as
+that of a sweep run in one process.
+
+Everything said between the two is lines of text:
+	worker: hello
+	coordinator: settings DENSITY GRAVITY DT MAX_STEPS INTEGRATOR PRECONDITIONER PRECISION,
+	then spec LINE for every line of the sweep file, then end
+	worker: next
+	coordinator: chunk BEGIN END, or wait (try again in a moment), or done
+	worker: row CSV for every variant of the chunk, then finished
+*/
+
+#ifndef _SWEEP_CLUSTER_H
+#define _SWEEP_CLUSTER_H
+
+#include "Sweep.h"
+#include <string>
+#include <ostream>
+#include <atomic>
+
+class TaskPool;
+
+// How many variants a chunk has, unless the command line says otherwise.
+#define SWEEP_DEFAULT_CHUNK 1000
+
+// Workers told to wait ask again after this long.
+#define SWEEP_WAIT_MILLISECONDS 500
+
+// Runs the coordinator of the sweep in specText (the contents of the file called specName) on port until every chunk of chunkSize
+// variants is done, and writes the results to out. Returns false (after printing why) if the sweep file isn't valid or the port
+// can't be used.
+bool serveSweep(const std::string& specText, const std::string& specName, const SweepSettings& settings, int port, int chunkSize, std::ostream& out);
+
+// Works for the coordinator at host:port until it says the sweep is done, stepping the chunks with layout. Returns false if the
+// connection can't be made or is lost before then. If stop is given, the worker also quits (and returns true) once it is set,
+// after the chunk it is on; the coordinator hands that one out again.
+bool runSweepWorker(const std::string& host, int port, TaskPool* pool, SweepLayout layout = SWEEP_LAYOUT_BATCHED,
+	const std::atomic<bool>* stop = nullptr);
+
+#endif // _SWEEP_CLUSTER_H
@@ -0,0 +1,282 @@
+/*
+Title: HydroDynamics
+File Name: TaskPool.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A small job system with one worker thread per core. Work is handed out as blocks of
+an index range. Every worker has its own queue of blocks and takes work from the back
+of it; a worker whose queue runs dry steals from the front of another worker's queue.
+That way the work evens itself out even when some blocks take longer than others,
+without every thread fighting over one shared queue.
+
+The thread that calls parallelFor() works on blocks too, and only returns once every
+block has been run. Several threads may call it at the same time, each waiting for its own
+blocks only.
+
+Every call has a priority class, the one its thread set with setCallerPriority(). Blocks
+of the interactive class (the default, which the simulation of the window steps with) are
+always taken before any batch block, from any queue, so a sweep working in the background
+only gets the threads the window leaves idle. A batch block that has already started runs
+to its end, so batch work should come in small blocks. The thread calling a batch
+parallelFor() helps with interactive blocks too, but an interactive caller never picks up
+batch blocks, so its step is never held up behind one.
+*/
+
+#include "TaskPool.h"
+#include "MemoryPlacement.h"
+#include <iostream>
+
+static thread_local TaskPriority threadPriority = TASK_PRIORITY_INTERACTIVE;
+
+TaskPool::TaskPool(int workerCount, ThreadRole role)
+	: queuedTasks(0), stopping(false), role(role)
+{
+	for (int p = 0; p < TASK_PRIORITY_COUNT; p++)
+	{
+		queuedClass[p].store(0);
+	}
+	if (workerCount <= 0)
+	{
+		// hardware_concurrency() counts the calling thread too, and it is allowed to return 0 if it doesn't know.
+		workerCount = (int)std::thread::hardware_concurrency() - 1;
+		if (workerCount < 0)
+		{
+			workerCount = 0;
+		}
+	}
+
+	// One queue per worker and one for the calling thread.
+	for (int i = 0; i <= workerCount; i++)
+	{
+		queues.push_back(new WorkerQueue());
+	}
+
+	for (int i = 0; i < workerCount; i++)
+	{
+		workers.push_back(std::thread(&TaskPool::workerLoop, this, i));
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	for (size_t i = 0; i < queues.size(); i++)
+	{
+		delete queues[i];
+	}
+}
+
+void TaskPool::parallelFor(int count, int blockSize, const RangeFunction& body)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	if (blockSize <= 0)
+	{
+		blockSize = 1;
+	}
+
+	int blocks = (count + blockSize - 1) / blockSize;
+	int threads = threadCount();
+
+	// With one block (or no workers) there is nothing to share, so skip the queues entirely.
+	if (blocks == 1 || threads == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	TaskPriority priority = threadPriority;
+	std::atomic<int> unfinished(blocks);
+
+	// Deal the blocks out round robin. Neighbouring blocks land on different threads, which spreads the work evenly from the start.
+	// Pinned threads each get a contiguous stretch instead, the part of the range whose memory is on their node. Their own work comes
+	// off the back, so they run it from the end of the stretch.
+	int owner = 0;
+	for (int i = 0; i < blocks; i++)
+	{
+		Task task;
+		task.body = &body;
+		task.begin = i * blockSize;
+		task.end = task.begin + blockSize < count ? task.begin + blockSize : count;
+		task.unfinished = &unfinished;
+
+		if (pinned())
+		{
+			while (owner + 1 < threads && i >= firstBlock(owner + 1, threads, blocks))
+			{
+				owner++;
+			}
+		}
+		WorkerQueue* queue = queues[pinned() ? owner : i % threads];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		queue->tasks[priority].push_back(task);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		queuedClass[priority].fetch_add(blocks);
+		queuedTasks.fetch_add(blocks);
+	}
+	wakeUp.notify_all();
+
+	// The calling thread uses the last queue (shared with any other thread calling at the same time), and helps out until every one
+	// of its blocks is done. It only takes blocks of its own priority or higher.
+	int self = threads - 1;
+	while (unfinished.load() > 0)
+	{
+		Task task;
+		if (takeTask(self, priority, task))
+		{
+			runTask(task);
+		}
+		else
+		{
+			// Everything left is already being run by someone else.
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool TaskPool::pinToNumaNodes()
+{
+	int nodes = numaNodeCount();
+	if (nodes < 2)
+	{
+		return false;
+	}
+	int threads = threadCount();
+	threadNodes.resize(threads);
+	for (int i = 0; i < threads; i++)
+	{
+		threadNodes[i] = (int)((long long)i * nodes / threads);
+		if (i < (int)workers.size() && !pinThreadToNode(workers[i], threadNodes[i]))
+		{
+			std::cout << "Couldn't pin worker " << i << " to NUMA node " << threadNodes[i] << std::endl;
+		}
+	}
+	return true;
+}
+
+void TaskPool::workerLoop(int index)
+{
+	applyThreadRole(role);
+	while (true)
+	{
+		Task task;
+		if (takeTask(index, (TaskPriority)(TASK_PRIORITY_COUNT - 1), task))
+		{
+			runTask(task);
+			continue;
+		}
+
+		// No work anywhere, so sleep until parallelFor() queues more (or the pool is destroyed).
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wakeUp.wait(guard, [this] { return stopping || queuedTasks.load() > 0; });
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
+
+void TaskPool::setCallerPriority(TaskPriority priority)
+{
+	threadPriority = priority;
+}
+
+TaskPriority TaskPool::callerPriority()
+{
+	return threadPriority;
+}
+
+// Takes a task of the highest priority there is, down to lowest. A class only goes to our own queue if no other thread has one of
+// a higher class waiting, so interactive work anywhere comes before batch work here.
+bool TaskPool::takeTask(int index, TaskPriority lowest, Task& task)
+{
+	for (int p = 0; p <= lowest; p++)
+	{
+		if (queuedClass[p].load() > 0 && (popTask(index, p, task) || stealTask(index, p, task)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool TaskPool::popTask(int index, int priority, Task& task)
+{
+	WorkerQueue* queue = queues[index];
+	std::lock_guard<std::mutex> guard(queue->lock);
+	std::deque<Task>& tasks = queue->tasks[priority];
+	if (tasks.empty())
+	{
+		return false;
+	}
+
+	// Our own work comes off the back.
+	task = tasks.back();
+	tasks.pop_back();
+	queuedClass[priority].fetch_sub(1);
+	queuedTasks.fetch_sub(1);
+	return true;
+}
+
+bool TaskPool::stealTask(int thief, int priority, Task& task)
+{
+	int count = threadCount();
+	for (int offset = 1; offset < count; offset++)
+	{
+		WorkerQueue* queue = queues[(thief + offset) % count];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		std::deque<Task>& tasks = queue->tasks[priority];
+		if (tasks.empty())
+		{
+			continue;
+		}
+
+		// Stolen work comes off the front, the opposite end from where the owner is working.
+		task = tasks.front();
+		tasks.pop_front();
+		queuedClass[priority].fetch_sub(1);
+		queuedTasks.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+void TaskPool::runTask(const Task& task)
+{
+	(*task.body)(task.begin, task.end);
+	task.unfinished->fetch_sub(1);
+}
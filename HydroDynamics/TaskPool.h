@@ -0,0 +1,133 @@
+/*
+Title: HydroDynamics
+File Name: TaskPool.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A small job system with one worker thread per core. Work is handed out as blocks of
+an index range. Every worker has its own queue of blocks and takes work from the back
+of it; a worker whose queue runs dry steals from the front of another worker's queue.
+That way the work evens itself out even when some blocks take longer than others,
+without every thread fighting over one shared queue.
+
+The thread that calls parallelFor() works on blocks too, and only returns once every
+block has been run. Several threads may call it at the same time, each waiting for its own
+blocks only.
+
+Every call has a priority class, the one its thread set with setCallerPriority(). Blocks
+of the interactive class (the default, which the simulation of the window steps with) are
+always taken before any batch block, from any queue, so a sweep working in the background
+only gets the threads the window leaves idle. A batch block that has already started runs
+to its end, so batch work should come in small blocks. The thread calling a batch
+parallelFor() helps with interactive blocks too, but an interactive caller never picks up
+batch blocks, so its step is never held up behind one.
+
+On a machine with several NUMA nodes, pinToNumaNodes() spreads the workers over the nodes
+and deals every thread one contiguous stretch of the blocks instead, so each thread starts
+on the same part of the range every time and the memory of that part can be kept on its
+node (see MemoryPlacement.h). Stealing still evens out the work.
+*/
+
+#ifndef _TASK_POOL_H
+#define _TASK_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include "ThreadControl.h"
+
+enum TaskPriority
+{
+	TASK_PRIORITY_INTERACTIVE = 0,	// Work someone is waiting on, like the step of the apparatus in the window
+	TASK_PRIORITY_BATCH,			// Background work, which only runs on threads nothing interactive needs
+	TASK_PRIORITY_COUNT
+};
+
+class TaskPool
+{
+public:
+	// A function that processes the indices [begin, end).
+	typedef std::function<void(int begin, int end)> RangeFunction;
+
+	// Creates the pool. A workerCount of 0 uses one thread per hardware thread (counting the calling thread). The workers apply the
+	// settings of role (see ThreadControl.h).
+	explicit TaskPool(int workerCount = 0, ThreadRole role = THREAD_ROLE_WORKER);
+	~TaskPool();
+
+	// Splits [0, count) into blocks of blockSize indices and runs body on every block, spread across all threads.
+	// Blocks must not depend on each other, and body must not call parallelFor() itself. The blocks have the priority of the
+	// calling thread.
+	void parallelFor(int count, int blockSize, const RangeFunction& body);
+
+	// The priority of the parallelFor() calls of the calling thread, in every pool. Threads start out interactive.
+	static void setCallerPriority(TaskPriority priority);
+	static TaskPriority callerPriority();
+
+	// Number of threads that run blocks, including the calling thread.
+	int threadCount() const { return (int)queues.size(); }
+
+	// Pins worker i to NUMA node i * nodes / threadCount(), so the nodes get neighbouring workers, and deals out contiguous
+	// stretches from then on. The calling thread isn't pinned. Returns false (and changes nothing) if there is only one node.
+	bool pinToNumaNodes();
+	bool pinned() const { return !threadNodes.empty(); }
+
+	// With pinned(), the node of a thread (the calling thread counts as the last node), and the first block thread i is dealt.
+	int threadNode(int thread) const { return pinned() ? threadNodes[thread] : 0; }
+	static int firstBlock(int thread, int threads, int blocks) { return (int)((long long)thread * blocks / threads); }
+
+private:
+	struct Task
+	{
+		const RangeFunction* body;
+		int begin;
+		int end;
+		std::atomic<int>* unfinished;	// The blocks of its parallelFor() that haven't finished yet
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks[TASK_PRIORITY_COUNT];
+	};
+
+	void workerLoop(int index);
+	bool takeTask(int index, TaskPriority lowest, Task& task);
+	bool popTask(int index, int priority, Task& task);
+	bool stealTask(int thief, int priority, Task& task);
+	void runTask(const Task& task);
+
+	std::vector<std::thread> workers;
+	std::vector<WorkerQueue*> queues;	// One per worker, plus the last one for the thread calling parallelFor()
+	std::vector<int> threadNodes;		// Per thread, its NUMA node, once pinned
+
+	std::mutex sleepLock;
+	std::condition_variable wakeUp;
+	std::atomic<int> queuedTasks;		// Tasks sitting in any queue, so sleeping workers know when to wake
+	std::atomic<int> queuedClass[TASK_PRIORITY_COUNT];	// The same per priority, so a class nobody queued for isn't searched
+	bool stopping;
+	ThreadRole role;
+};
+
+#endif // _TASK_POOL_H
@@ -0,0 +1,800 @@
+/*
+Title: HydroDynamics
+File Name: Telemetry.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Records the height, pressure and external pressure of every vessel after every physics
+step, without slowing the simulation down, and the total volume of the network. The tubes
+only ever move volume from one vessel to another, so the total is a conservation counter:
+anything it gains or loses is rounding, or fluid added from outside.
+
+record() only copies the three arrays into the current block (adding up the volume on the
+way, so it costs nothing extra), which holds
+TELEMETRY_BLOCK_STEPS steps. A full block is handed to a background thread that formats it
+and writes it to the file in one go, while the simulation fills the next block. Blocks are
+reused, so recording allocates nothing once it is running. If the disk can't keep up and
+TELEMETRY_QUEUE_BLOCKS blocks are waiting, record() waits for the writer rather than
+using more and more memory.
+
+Three formats are supported:
+- CSV (for file names ending in .csv): one line per step with the step number and the
+  total volume, then height, pressure and external pressure of every vessel in turn.
+- Columnar binary (anything else). The file starts with a TelemetryFileHeader. It is
+  followed by blocks, and each block has:
+    - a uint32 step count n, followed by 4 bytes of padding;
+    - n int64 step numbers;
+    - n float64 total volumes (from version 3 on);
+    - then, for every vessel, its n heights, n pressures and n external pressures as float32.
+  Everything is little endian. Every column of a block is contiguous, so one series can be
+  read without touching the others.
+- Compressed (anything but .csv, when open() is given a tolerance for every field). Values
+  come back within half their tolerance, and a network that settles takes next to no space
+  at all (see TelemetryCodec.h). The file starts with a TelemetryFileHeader whose magic is
+  "HYDROTLZ", followed by the tolerances as TELEMETRY_FIELDS float32 and 4 bytes of padding.
+  Each block has a uint32 step count, a uint32 byte count, the int64 numbers of its first
+  and last step and (from version 3 on) the n total volumes as float64, followed by that
+  many bytes of the block coded as a whole by encodeTelemetryBlock().
+After the last block of both binary formats comes the index: a TelemetryIndexEntry for every
+block, then a TelemetryIndexTrailer. (Version 1 files have no index.)
+
+From version 4 on, both binary formats also hold summaries, for questions like the highest
+level of one vessel over ten minutes of a run that would otherwise read all of it. A summary
+has the smallest and the largest value of every vessel and field over a run of blocks, and
+their sum, for the mean. Every block is summarized, every two summaries of neighbouring
+blocks 2k and 2k + 1 are summarized again, every two of those, and so on, like a segment
+tree: level L summarizes 2^L blocks. The writer thread builds them as the blocks come, and
+only keeps the summaries still waiting for their neighbour, one per level. Each one is
+written as soon as it is complete, between the blocks, as a uint32 0 (where a block has its
+step count), a uint32 byte count, a TelemetrySummaryEntry and the summaries; close() then
+writes a TelemetrySummaryEntry for every one and a TelemetrySummaryTrailer just before the
+index. TelemetryReader::summarize() answers a range of steps from a few summaries, never
+more than two per level, and only reads the blocks at either end that the range covers in
+part. The summaries are of the values record() saw, so in a compressed file they can be
+half a tolerance away from the values the blocks decode to.
+
+TelemetryReader reads both binary formats back. It finds the block of any step in the index,
+so jumping to a step of a run of many GB only touches that block: the file is mapped, and
+the operating system pages in the parts that are read. A file without an index, because it
+is old or the run was killed before close(), is read by walking the blocks from the start.
+*/
+
+#include "Telemetry.h"
+#include "TelemetryCodec.h"
+#include "ThreadControl.h"
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+
+// 1 MB of buffering in the C library on top of our blocks, so the writes that reach the OS are large.
+#define TELEMETRY_FILE_BUFFER (1 << 20)
+
+TelemetryWriter::~TelemetryWriter()
+{
+	close();
+}
+
+bool TelemetryWriter::open(const std::string& fileName, int vesselCount, const float* fieldTolerance)
+{
+	close();
+
+	csv = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0;
+	compressed = !csv && fieldTolerance != nullptr;
+	for (int f = 0; f < TELEMETRY_FIELDS; f++)
+	{
+		tolerance[f] = compressed ? fieldTolerance[f] : 0.0f;
+		if (compressed && !(tolerance[f] > 0.0f))
+		{
+			std::cout << "The telemetry tolerance has to be above 0: " << tolerance[f] << std::endl;
+			return false;
+		}
+	}
+
+	file = fopen(fileName.c_str(), csv ? "w" : "wb");
+	if (file == nullptr)
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, TELEMETRY_FILE_BUFFER);
+
+	vessels = vesselCount;
+	failed = false;
+	stopping = false;
+
+	if (csv)
+	{
+		fprintf(file, "step,volume");
+		for (int v = 0; v < vessels; v++)
+		{
+			fprintf(file, ",height%d,pressure%d,externalPressure%d", v, v, v);
+		}
+		fprintf(file, "\n");
+	}
+	else
+	{
+		TelemetryFileHeader header;
+		memcpy(header.magic, compressed ? "HYDROTLZ" : "HYDROTLM", 8);
+		header.version = TELEMETRY_VERSION;
+		header.vesselCount = (uint32_t)vessels;
+		header.fieldCount = TELEMETRY_FIELDS;
+		header.blockSteps = TELEMETRY_BLOCK_STEPS;
+		fwrite(&header, sizeof(header), 1, file);
+		written = sizeof(header);
+
+		if (compressed)
+		{
+			float padded[TELEMETRY_FIELDS + 1] = {};
+			memcpy(padded, tolerance, sizeof(tolerance));
+			fwrite(padded, sizeof(padded), 1, file);
+			written += sizeof(padded);
+		}
+	}
+	index.clear();
+	summaryIndex.clear();
+	waiting.clear();
+	waitingSteps.clear();
+	rawBytes = sizeof(TelemetryFileHeader);
+
+	current.steps.clear();
+	current.steps.reserve(TELEMETRY_BLOCK_STEPS);
+	current.volumes.clear();
+	current.volumes.reserve(TELEMETRY_BLOCK_STEPS);
+	current.values.clear();
+	current.values.reserve((size_t)TELEMETRY_BLOCK_STEPS * vessels * TELEMETRY_FIELDS);
+
+	thread = std::thread(&TelemetryWriter::run, this);
+	return true;
+}
+
+void TelemetryWriter::record(long long step, const VesselNetwork& network)
+{
+	double volume = appendStep(step, network.height.data(), network.pressure.data(), network.externalPressure.data(), network.width.data());
+
+	// Only the single precision state of rectangles is all in the arrays that were just read.
+	bool rectangles = network.precision == PRECISION_SINGLE && !network.profiled();
+	endStep(rectangles ? volume : network.totalVolume());
+}
+
+void TelemetryWriter::record(long long step, const float* height, const float* pressure, const float* externalPressure, const float* width)
+{
+	endStep(appendStep(step, height, pressure, externalPressure, width));
+}
+
+double TelemetryWriter::appendStep(long long step, const float* height, const float* pressure, const float* externalPressure,
+	const float* width)
+{
+	current.steps.push_back(step);
+
+	size_t start = current.values.size();
+	current.values.resize(start + (size_t)vessels * TELEMETRY_FIELDS);
+	float* out = current.values.data() + start;
+	double volume = 0.0;
+	for (int v = 0; v < vessels; v++)
+	{
+		out[v * TELEMETRY_FIELDS + 0] = height[v];
+		out[v * TELEMETRY_FIELDS + 1] = pressure[v];
+		out[v * TELEMETRY_FIELDS + 2] = externalPressure[v];
+		volume += (double)height[v] * width[v];
+	}
+	return volume;
+}
+
+void TelemetryWriter::endStep(double volume)
+{
+	current.volumes.push_back(volume);
+	if (current.steps.size() < TELEMETRY_BLOCK_STEPS)
+	{
+		return;
+	}
+
+	// Hand the full block over and continue in a spare one (or a new one while the pool of blocks is still growing).
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return queued.size() < TELEMETRY_QUEUE_BLOCKS; });
+	queued.push_back(std::move(current));
+
+	current = Block();
+	if (!spare.empty())
+	{
+		current = std::move(spare.back());
+		spare.pop_back();
+	}
+	current.steps.clear();
+	current.volumes.clear();
+	current.values.clear();
+	current.steps.reserve(TELEMETRY_BLOCK_STEPS);
+	current.volumes.reserve(TELEMETRY_BLOCK_STEPS);
+	current.values.reserve((size_t)TELEMETRY_BLOCK_STEPS * vessels * TELEMETRY_FIELDS);
+
+	lock.unlock();
+	changed.notify_all();
+}
+
+void TelemetryWriter::writeBlock(const Block& block)
+{
+	size_t steps = block.steps.size();
+
+	if (csv)
+	{
+		char number[32];
+		for (size_t s = 0; s < steps; s++)
+		{
+			line.clear();
+			snprintf(number, sizeof(number), "%lld,%.17g", (long long)block.steps[s], block.volumes[s]);
+			line += number;
+
+			const float* values = block.values.data() + s * vessels * TELEMETRY_FIELDS;
+			for (int i = 0; i < vessels * TELEMETRY_FIELDS; i++)
+			{
+				snprintf(number, sizeof(number), ",%.9g", values[i]);
+				line += number;
+			}
+			line += '\n';
+			fwrite(line.data(), 1, line.size(), file);
+		}
+	}
+	else
+	{
+		// Transpose the block from one row per step into one column per vessel and field.
+		columns.resize(block.values.size());
+		for (size_t s = 0; s < steps; s++)
+		{
+			const float* row = block.values.data() + s * vessels * TELEMETRY_FIELDS;
+			for (int i = 0; i < vessels * TELEMETRY_FIELDS; i++)
+			{
+				columns[i * steps + s] = row[i];
+			}
+		}
+
+		uint64_t rawSize = 8 + steps * (sizeof(int64_t) + sizeof(double)) + columns.size() * sizeof(float);
+		rawBytes += rawSize;
+		index.push_back({ written, block.steps.front(), block.steps.back() });
+		if (!compressed)
+		{
+			uint32_t blockHeader[2] = { (uint32_t)steps, 0 };
+			fwrite(blockHeader, sizeof(blockHeader), 1, file);
+			fwrite(block.steps.data(), sizeof(int64_t), steps, file);
+			fwrite(block.volumes.data(), sizeof(double), steps, file);
+			fwrite(columns.data(), sizeof(float), columns.size(), file);
+			written += rawSize;
+			summarizeBlock(block);
+			return;
+		}
+
+		coded.clear();
+		encodeTelemetryBlock(block.steps.data(), columns.data(), (int)steps, vessels * TELEMETRY_FIELDS, tolerance, TELEMETRY_FIELDS,
+			coded);
+
+		uint32_t blockHeader[2] = { (uint32_t)steps, (uint32_t)coded.size() };
+		int64_t range[2] = { block.steps.front(), block.steps.back() };
+		fwrite(blockHeader, sizeof(blockHeader), 1, file);
+		fwrite(range, sizeof(range), 1, file);
+		fwrite(block.volumes.data(), sizeof(double), steps, file);
+		fwrite(coded.data(), 1, coded.size(), file);
+		written += sizeof(blockHeader) + sizeof(range) + steps * sizeof(double) + coded.size();
+		summarizeBlock(block);
+	}
+}
+
+void TelemetryWriter::summarizeBlock(const Block& block)
+{
+	size_t count = (size_t)vessels * TELEMETRY_FIELDS;
+	summary.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		summary[i] = { FLT_MAX, -FLT_MAX, 0.0 };
+	}
+	for (size_t s = 0; s < block.steps.size(); s++)
+	{
+		const float* row = block.values.data() + s * count;
+		for (size_t i = 0; i < count; i++)
+		{
+			summary[i].minimum = std::min(summary[i].minimum, row[i]);
+			summary[i].maximum = std::max(summary[i].maximum, row[i]);
+			summary[i].sum += row[i];
+		}
+	}
+
+	// The summary of blocks first to first + 2^level - 1 waits for the next as many blocks if first is an even multiple of
+	// 2^level. Otherwise the one waiting on its level is its neighbour, and the two together summarize the next level up.
+	uint64_t first = index.size() - 1;
+	uint64_t steps = block.steps.size();
+	for (int level = 0; ; level++)
+	{
+		writeSummary(level, first, steps, summary);
+		if ((int)waiting.size() <= level)
+		{
+			waiting.resize(level + 1);
+			waitingSteps.resize(level + 1);
+		}
+		if (((first >> level) & 1) == 0)
+		{
+			std::swap(waiting[level], summary);
+			waitingSteps[level] = steps;
+			return;
+		}
+
+		const std::vector<TelemetrySummary>& before = waiting[level];
+		for (size_t i = 0; i < count; i++)
+		{
+			summary[i].minimum = std::min(summary[i].minimum, before[i].minimum);
+			summary[i].maximum = std::max(summary[i].maximum, before[i].maximum);
+			summary[i].sum += before[i].sum;
+		}
+		first -= 1ULL << level;
+		steps += waitingSteps[level];
+	}
+}
+
+void TelemetryWriter::writeSummary(int level, uint64_t firstBlock, uint64_t steps, const std::vector<TelemetrySummary>& values)
+{
+	uint32_t recordHeader[2] = { 0, (uint32_t)(sizeof(TelemetrySummaryEntry) + values.size() * sizeof(TelemetrySummary)) };
+	TelemetrySummaryEntry entry = { written + sizeof(recordHeader) + sizeof(TelemetrySummaryEntry), firstBlock, steps, (uint32_t)level, 0 };
+	fwrite(recordHeader, sizeof(recordHeader), 1, file);
+	fwrite(&entry, sizeof(entry), 1, file);
+	fwrite(values.data(), sizeof(TelemetrySummary), values.size(), file);
+	written += sizeof(recordHeader) + recordHeader[1];
+	summaryIndex.push_back(entry);
+}
+
+void TelemetryWriter::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		changed.wait(lock, [this] { return stopping || !queued.empty(); });
+		if (queued.empty())
+		{
+			return;
+		}
+
+		Block block = std::move(queued.front());
+		queued.pop_front();
+
+		lock.unlock();
+		writeBlock(block);
+		lock.lock();
+
+		spare.push_back(std::move(block));
+		changed.notify_all();
+	}
+}
+
+bool TelemetryWriter::close()
+{
+	if (file == nullptr)
+	{
+		return true;
+	}
+
+	// The last, partly filled block goes out too.
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!current.steps.empty())
+		{
+			queued.push_back(std::move(current));
+			current = Block();
+		}
+		stopping = true;
+	}
+	changed.notify_all();
+	thread.join();
+
+	if (!csv)
+	{
+		TelemetrySummaryTrailer summaryTrailer;
+		memcpy(summaryTrailer.magic, "TLMSUMRY", 8);
+		summaryTrailer.summaryOffset = written;
+		summaryTrailer.summaryCount = summaryIndex.size();
+		fwrite(summaryIndex.data(), sizeof(TelemetrySummaryEntry), summaryIndex.size(), file);
+		fwrite(&summaryTrailer, sizeof(summaryTrailer), 1, file);
+		written += summaryIndex.size() * sizeof(TelemetrySummaryEntry) + sizeof(summaryTrailer);
+
+		TelemetryIndexTrailer trailer;
+		memcpy(trailer.magic, "TLMINDEX", 8);
+		trailer.indexOffset = written;
+		trailer.blockCount = index.size();
+		fwrite(index.data(), sizeof(TelemetryIndexEntry), index.size(), file);
+		fwrite(&trailer, sizeof(trailer), 1, file);
+		written += index.size() * sizeof(TelemetryIndexEntry) + sizeof(trailer);
+	}
+	if (compressed)
+	{
+		std::cout << "Telemetry: " << written / 1024 << " KB written instead of " << rawBytes / 1024 << " KB ("
+			<< (double)rawBytes / written << " times smaller)" << std::endl;
+	}
+
+	failed |= ferror(file) != 0;
+	failed |= fclose(file) != 0;
+	file = nullptr;
+	queued.clear();
+	spare.clear();
+
+	if (failed)
+	{
+		std::cout << "Writing the telemetry failed, the file is incomplete." << std::endl;
+	}
+	return !failed;
+}
+
+bool TelemetryReader::open(const std::string& fileName)
+{
+	close();
+	if (!file.open(fileName.c_str()))
+	{
+		return false;
+	}
+
+	std::string_view data = file.view();
+	TelemetryFileHeader header;
+	if (data.size() < sizeof(header))
+	{
+		std::cout << "Not a telemetry file: " << fileName << std::endl;
+		close();
+		return false;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+
+	compressed = memcmp(header.magic, "HYDROTLZ", 8) == 0;
+	if ((!compressed && memcmp(header.magic, "HYDROTLM", 8) != 0) || header.fieldCount != TELEMETRY_FIELDS)
+	{
+		std::cout << "Not a telemetry file: " << fileName << std::endl;
+		close();
+		return false;
+	}
+	if (header.version > TELEMETRY_VERSION || (compressed && header.version < 2))
+	{
+		std::cout << "Telemetry file " << fileName << " has version " << header.version << ", expected " << TELEMETRY_VERSION << std::endl;
+		close();
+		return false;
+	}
+	vessels = (int)header.vesselCount;
+	version = (int)header.version;
+
+	size_t start = sizeof(header);
+	if (compressed)
+	{
+		if (data.size() < start + sizeof(tolerance))
+		{
+			std::cout << "Telemetry file " << fileName << " is incomplete." << std::endl;
+			close();
+			return false;
+		}
+		memcpy(tolerance, data.data() + start, sizeof(tolerance));
+		start += (TELEMETRY_FIELDS + 1) * sizeof(float);
+	}
+
+	TelemetryIndexTrailer trailer;
+	if (header.version < 2 || data.size() < start + sizeof(trailer))
+	{
+		walkBlocks(fileName, start);
+		return true;
+	}
+	memcpy(&trailer, data.data() + data.size() - sizeof(trailer), sizeof(trailer));
+	if (memcmp(trailer.magic, "TLMINDEX", 8) != 0 || trailer.indexOffset < start ||
+		trailer.indexOffset + trailer.blockCount * sizeof(TelemetryIndexEntry) + sizeof(trailer) != data.size())
+	{
+		walkBlocks(fileName, start);
+		return true;
+	}
+
+	blocks.resize((size_t)trailer.blockCount);
+	memcpy(blocks.data(), data.data() + trailer.indexOffset, blocks.size() * sizeof(TelemetryIndexEntry));
+
+	// A file with an index has the entries of its summaries right before it.
+	TelemetrySummaryTrailer summaryTrailer;
+	if (version >= 4 && trailer.indexOffset >= start + sizeof(summaryTrailer))
+	{
+		memcpy(&summaryTrailer, data.data() + trailer.indexOffset - sizeof(summaryTrailer), sizeof(summaryTrailer));
+		if (memcmp(summaryTrailer.magic, "TLMSUMRY", 8) == 0 && summaryTrailer.summaryOffset >= start &&
+			summaryTrailer.summaryOffset + summaryTrailer.summaryCount * sizeof(TelemetrySummaryEntry) + sizeof(summaryTrailer) ==
+			trailer.indexOffset)
+		{
+			std::vector<TelemetrySummaryEntry> entries((size_t)summaryTrailer.summaryCount);
+			memcpy(entries.data(), data.data() + summaryTrailer.summaryOffset, entries.size() * sizeof(TelemetrySummaryEntry));
+			indexSummaries(entries);
+		}
+	}
+	return true;
+}
+
+void TelemetryReader::walkBlocks(const std::string& fileName, size_t offset)
+{
+	// Both formats say how long every block is, so the index can be rebuilt from the blocks themselves.
+	std::string_view data = file.view();
+	size_t seriesBytes = (size_t)vessels * TELEMETRY_FIELDS * sizeof(float);
+	size_t volumeBytes = version >= 3 ? sizeof(double) : 0;
+	std::vector<TelemetrySummaryEntry> entries;
+	while (offset + 8 <= data.size())
+	{
+		uint32_t blockHeader[2];
+		memcpy(blockHeader, data.data() + offset, sizeof(blockHeader));
+		TelemetryIndexEntry entry = { offset, 0, 0 };
+		size_t size;
+		if (version >= 4 && blockHeader[0] == 0)
+		{
+			// Summaries have 0 where blocks have their step count.
+			size = sizeof(blockHeader) + blockHeader[1];
+			if (blockHeader[1] < sizeof(TelemetrySummaryEntry) || offset + size > data.size())
+			{
+				break;
+			}
+			entries.emplace_back();
+			memcpy(&entries.back(), data.data() + offset + sizeof(blockHeader), sizeof(TelemetrySummaryEntry));
+			offset += size;
+			continue;
+		}
+		if (compressed)
+		{
+			int64_t range[2];
+			size = sizeof(blockHeader) + sizeof(range) + (size_t)blockHeader[0] * volumeBytes + blockHeader[1];
+			if (offset + size > data.size())
+			{
+				break;
+			}
+			memcpy(range, data.data() + offset + sizeof(blockHeader), sizeof(range));
+			entry.firstStep = range[0];
+			entry.lastStep = range[1];
+		}
+		else
+		{
+			size = sizeof(blockHeader) + (size_t)blockHeader[0] * (sizeof(int64_t) + volumeBytes + seriesBytes);
+			if (blockHeader[0] == 0 || offset + size > data.size())
+			{
+				break;
+			}
+			const char* steps = data.data() + offset + sizeof(blockHeader);
+			memcpy(&entry.firstStep, steps, sizeof(int64_t));
+			memcpy(&entry.lastStep, steps + (blockHeader[0] - 1) * sizeof(int64_t), sizeof(int64_t));
+		}
+		blocks.push_back(entry);
+		offset += size;
+	}
+	if (offset != data.size())
+	{
+		std::cout << "Telemetry file " << fileName << " has no index and ends in the middle of a block, reading the blocks before it."
+			<< std::endl;
+	}
+	indexSummaries(entries);
+}
+
+void TelemetryReader::indexSummaries(const std::vector<TelemetrySummaryEntry>& entries)
+{
+	size_t values = (size_t)vessels * TELEMETRY_FIELDS * sizeof(TelemetrySummary);
+	for (const TelemetrySummaryEntry& entry : entries)
+	{
+		if (entry.level >= 63 || entry.firstBlock % (1ULL << entry.level) != 0 || entry.firstBlock + (1ULL << entry.level) > blocks.size()
+			|| entry.offset + values > file.view().size())
+		{
+			continue;
+		}
+		if (summaryAt.size() <= entry.level)
+		{
+			summaryAt.resize(entry.level + 1);
+		}
+		std::vector<int>& level = summaryAt[entry.level];
+		size_t at = (size_t)(entry.firstBlock >> entry.level);
+		if (level.size() <= at)
+		{
+			level.resize(at + 1, -1);
+		}
+		level[at] = (int)summaries.size();
+		summaries.push_back(entry);
+	}
+}
+
+void TelemetryReader::close()
+{
+	file.close();
+	blocks.clear();
+	summaries.clear();
+	summaryAt.clear();
+	vessels = 0;
+	version = 0;
+	compressed = false;
+	cachedBlock = -1;
+}
+
+int TelemetryReader::findBlock(long long step) const
+{
+	auto after = std::upper_bound(blocks.begin(), blocks.end(), step,
+		[](long long value, const TelemetryIndexEntry& entry) { return value < entry.firstStep; });
+	return (int)(after - blocks.begin()) - 1;
+}
+
+bool TelemetryReader::readBlock(int i, std::vector<int64_t>& steps, std::vector<double>& volumes, std::vector<float>& columns)
+{
+	std::string_view data = file.view();
+	uint32_t blockHeader[2];
+	if (i < 0 || i >= blockCount() || blocks[i].offset + sizeof(blockHeader) > data.size())
+	{
+		std::cout << "There is no telemetry block " << i << std::endl;
+		return false;
+	}
+	uint64_t offset = blocks[i].offset;
+	memcpy(blockHeader, data.data() + offset, sizeof(blockHeader));
+	const char* body = data.data() + offset + sizeof(blockHeader);
+	size_t seriesCount = (size_t)vessels * TELEMETRY_FIELDS;
+	size_t volumeBytes = version >= 3 ? blockHeader[0] * sizeof(double) : 0;
+	volumes.assign(blockHeader[0], NAN);
+
+	if (!compressed)
+	{
+		steps.resize(blockHeader[0]);
+		columns.resize(blockHeader[0] * seriesCount);
+		memcpy(steps.data(), body, steps.size() * sizeof(int64_t));
+		memcpy(volumes.data(), body + steps.size() * sizeof(int64_t), volumeBytes);
+		memcpy(columns.data(), body + steps.size() * sizeof(int64_t) + volumeBytes, columns.size() * sizeof(float));
+		return true;
+	}
+
+	body += 2 * sizeof(int64_t);
+	if (offset + sizeof(blockHeader) + 2 * sizeof(int64_t) + volumeBytes + blockHeader[1] > data.size())
+	{
+		std::cout << "Telemetry block " << i << " is damaged." << std::endl;
+		return false;
+	}
+	memcpy(volumes.data(), body, volumeBytes);
+	body += volumeBytes;
+	if (!decodeTelemetryBlock((const unsigned char*)body, blockHeader[1], (int)blockHeader[0], (int)seriesCount, tolerance,
+		TELEMETRY_FIELDS, steps, columns))
+	{
+		std::cout << "Telemetry block " << i << " is damaged." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool TelemetryReader::readStep(long long step, std::vector<float>& values, double* volume)
+{
+	int block = findBlock(step);
+	if (block < 0)
+	{
+		return false;
+	}
+	if (block != cachedBlock)
+	{
+		if (cachedBlock >= 0)
+		{
+			file.release(blocks[cachedBlock].offset, blockEnd(cachedBlock) - blocks[cachedBlock].offset);
+		}
+		cachedBlock = -1;
+		if (!readBlock(block, cachedSteps, cachedVolumes, cachedColumns) || cachedSteps.empty())
+		{
+			return false;
+		}
+		cachedBlock = block;
+		if (block + 1 < blockCount())
+		{
+			file.willNeed(blocks[block + 1].offset, blockEnd(block + 1) - blocks[block + 1].offset);
+		}
+	}
+
+	size_t count = cachedSteps.size();
+	size_t s = std::upper_bound(cachedSteps.begin(), cachedSteps.end(), (int64_t)step) - cachedSteps.begin();
+	s = s > 0 ? s - 1 : 0;
+	values.resize((size_t)vessels * TELEMETRY_FIELDS);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		values[i] = cachedColumns[i * count + s];
+	}
+	if (volume != nullptr)
+	{
+		*volume = cachedVolumes[s];
+	}
+	return true;
+}
+
+bool TelemetryReader::summarize(int vessel, int field, long long first, long long last, TelemetryRange& range)
+{
+	range = TelemetryRange();
+	if (vessel < 0 || vessel >= vessels || field < 0 || field >= TELEMETRY_FIELDS || first > last)
+	{
+		return false;
+	}
+
+	std::string_view data = file.view();
+	size_t series = (size_t)vessel * TELEMETRY_FIELDS + field;
+	float minimum = FLT_MAX;
+	float maximum = -FLT_MAX;
+	double sum = 0.0;
+	std::vector<int64_t> steps;
+	std::vector<double> volumes;
+	std::vector<float> columns;
+
+	int b = std::max(findBlock(first), 0);
+	while (b < blockCount() && blocks[b].firstStep <= last)
+	{
+		if (blocks[b].lastStep < first)
+		{
+			b++;
+			continue;
+		}
+
+		// The largest run of blocks from b on that has a summary and lies in the range whole. Runs of 2^level blocks start at
+		// multiples of 2^level.
+		int found = -1;
+		int level = 0;
+		for (int l = 0; l < (int)summaryAt.size() && (b & ((1 << l) - 1)) == 0; l++)
+		{
+			int end = b + (1 << l) - 1;
+			if (end >= blockCount() || blocks[b].firstStep < first || blocks[end].lastStep > last)
+			{
+				break;
+			}
+			size_t at = (size_t)b >> l;
+			if (at < summaryAt[l].size() && summaryAt[l][at] >= 0)
+			{
+				found = summaryAt[l][at];
+				level = l;
+			}
+		}
+
+		if (found >= 0)
+		{
+			TelemetrySummary summary;
+			memcpy(&summary, data.data() + summaries[found].offset + series * sizeof(TelemetrySummary), sizeof(summary));
+			minimum = std::min(minimum, summary.minimum);
+			maximum = std::max(maximum, summary.maximum);
+			sum += summary.sum;
+			range.steps += (long long)summaries[found].steps;
+			range.summaries++;
+			b += 1 << level;
+			continue;
+		}
+
+		if (!readBlock(b, steps, volumes, columns))
+		{
+			return false;
+		}
+		const float* column = columns.data() + series * steps.size();
+		for (size_t s = 0; s < steps.size(); s++)
+		{
+			if (steps[s] >= first && steps[s] <= last)
+			{
+				minimum = std::min(minimum, column[s]);
+				maximum = std::max(maximum, column[s]);
+				sum += column[s];
+				range.steps++;
+			}
+		}
+		range.blocksRead++;
+		b++;
+	}
+
+	if (range.steps == 0)
+	{
+		return false;
+	}
+	range.minimum = minimum;
+	range.maximum = maximum;
+	range.mean = sum / range.steps;
+	return true;
+}
+
+// Where block i ends: where the next one starts, or for the last one, the index or the end of the file.
+size_t TelemetryReader::blockEnd(int i) const
+{
+	return i + 1 < blockCount() ? (size_t)blocks[i + 1].offset : file.view().size();
+}
@@ -0,0 +1,300 @@
+/*
+Title: HydroDynamics
+File Name: Telemetry.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Records the height, pressure and external pressure of every vessel after every physics
+step, without slowing the simulation down, and the total volume of the network. The tubes
+only ever move volume from one vessel to another, so the total is a conservation counter:
+anything it gains or loses is rounding, or fluid added from outside.
+
+record() only copies the three arrays into the current block (adding up the volume on the
+way, so it costs nothing extra), which holds
+TELEMETRY_BLOCK_STEPS steps. A full block is handed to a background thread that formats it
+and writes it to the file in one go, while the simulation fills the next block. Blocks are
+reused, so recording allocates nothing once it is running. If the disk can't keep up and
+TELEMETRY_QUEUE_BLOCKS blocks are waiting, record() waits for the writer rather than
+using more and more memory.
+
+Three formats are supported:
+- CSV (for file names ending in .csv): one line per step with the step number and the
+  total volume, then height, pressure and external pressure of every vessel in turn.
+- Columnar binary (anything else). The file starts with a TelemetryFileHeader. It is
+  followed by blocks, and each block has:
+    - a uint32 step count n, followed by 4 bytes of padding;
+    - n int64 step numbers;
+    - n float64 total volumes (from version 3 on);
+    - then, for every vessel, its n heights, n pressures and n external pressures as float32.
+  Everything is little endian. Every column of a block is contiguous, so one series can be
+  read without touching the others.
+- Compressed (anything but .csv, when open() is given a tolerance for every field). Values
+  come back within half their tolerance, and a network that settles takes next to no space
+  at all (see TelemetryCodec.h). The file starts with a TelemetryFileHeader whose magic is
+  "HYDROTLZ", followed by the tolerances as TELEMETRY_FIELDS float32 and 4 bytes of padding.
+  Each block has a uint32 step count, a uint32 byte count, the int64 numbers of its first
+  and last step and (from version 3 on) the n total volumes as float64, followed by that
+  many bytes of the block coded as a whole by encodeTelemetryBlock().
+After the last block of both binary formats comes the index: a TelemetryIndexEntry for every
+block, then a TelemetryIndexTrailer. (Version 1 files have no index.)
+
+From version 4 on, both binary formats also hold summaries, for questions like the highest
+level of one vessel over ten minutes of a run that would otherwise read all of it. A summary
+has the smallest and the largest value of every vessel and field over a run of blocks, and
+their sum, for the mean. Every block is summarized, every two summaries of neighbouring
+blocks 2k and 2k + 1 are summarized again, every two of those, and so on, like a segment
+tree: level L summarizes 2^L blocks. The writer thread builds them as the blocks come, and
+only keeps the summaries still waiting for their neighbour, one per level. Each one is
+written as soon as it is complete, between the blocks, as a uint32 0 (where a block has its
+step count), a uint32 byte count, a TelemetrySummaryEntry and the summaries; close() then
+writes a TelemetrySummaryEntry for every one and a TelemetrySummaryTrailer just before the
+index. TelemetryReader::summarize() answers a range of steps from a few summaries, never
+more than two per level, and only reads the blocks at either end that the range covers in
+part. The summaries are of the values record() saw, so in a compressed file they can be
+half a tolerance away from the values the blocks decode to.
+
+TelemetryReader reads both binary formats back. It finds the block of any step in the index,
+so jumping to a step of a run of many GB only touches that block: the file is mapped, and
+the operating system pages in the parts that are read. A file without an index, because it
+is old or the run was killed before close(), is read by walking the blocks from the start.
+*/
+
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include "VesselNetwork.h"
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define TELEMETRY_BLOCK_STEPS 4096
+#define TELEMETRY_QUEUE_BLOCKS 4
+#define TELEMETRY_VERSION 4
+
+// The values recorded for every vessel, in the order they appear in both formats.
+#define TELEMETRY_FIELDS 3
+
+struct TelemetryFileHeader
+{
+	char magic[8];			// "HYDROTLM"
+	uint32_t version;
+	uint32_t vesselCount;
+	uint32_t fieldCount;	// TELEMETRY_FIELDS
+	uint32_t blockSteps;	// The most steps a block can hold (the last block is usually shorter)
+};
+
+// Where a block of a binary file starts, and the steps it holds.
+struct TelemetryIndexEntry
+{
+	uint64_t offset;		// From the start of the file, at the step count of the block
+	int64_t firstStep;
+	int64_t lastStep;
+};
+
+// The last bytes of a binary file.
+struct TelemetryIndexTrailer
+{
+	char magic[8];			// "TLMINDEX"
+	uint64_t indexOffset;	// Where the first TelemetryIndexEntry is
+	uint64_t blockCount;
+};
+
+// One field of one vessel over a run of blocks.
+struct TelemetrySummary
+{
+	float minimum;
+	float maximum;
+	double sum;
+};
+
+// Where the summaries of 2^level blocks from firstBlock on are: a TelemetrySummary for every vessel and field, in the order
+// readStep() has them.
+struct TelemetrySummaryEntry
+{
+	uint64_t offset;		// From the start of the file, at the first TelemetrySummary
+	uint64_t firstBlock;
+	uint64_t steps;			// How many steps the blocks hold
+	uint32_t level;
+	uint32_t padding;
+};
+
+// Just before the index of a binary file from version 4 on.
+struct TelemetrySummaryTrailer
+{
+	char magic[8];			// "TLMSUMRY"
+	uint64_t summaryOffset;	// Where the first TelemetrySummaryEntry is
+	uint64_t summaryCount;
+};
+
+// What TelemetryReader::summarize() found.
+struct TelemetryRange
+{
+	float minimum = 0.0f;
+	float maximum = 0.0f;
+	double mean = 0.0;
+	long long steps = 0;	// The steps recorded in the range
+	int summaries = 0;		// How many summaries it was answered from
+	int blocksRead = 0;		// And how many blocks it had to read
+};
+
+class TelemetryWriter
+{
+public:
+	TelemetryWriter() {}
+	~TelemetryWriter();
+
+	TelemetryWriter(const TelemetryWriter&) = delete;
+	TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+	// Creates the file for a network of vesselCount vessels and starts the writer thread. Returns false if the file can't be created.
+	// With a tolerance for every field (all above 0) a binary file is compressed, otherwise the values are written as they are.
+	bool open(const std::string& fileName, int vesselCount, const float* tolerance = nullptr);
+
+	// Appends the state of the network after the given step. The network has to keep the vessel count given to open().
+	void record(long long step, const VesselNetwork& network);
+
+	// The same from arrays of vesselCount values that aren't in a network, like a copy that came back from the GPU (see
+	// GpuNetwork::queueState()). The volume is added up from height * width.
+	void record(long long step, const float* height, const float* pressure, const float* externalPressure, const float* width);
+
+	// Writes everything recorded so far and closes the file. Returns false if any write failed.
+	bool close();
+
+private:
+	// step-major while recording: values[(s * vessels + v) * TELEMETRY_FIELDS + field]
+	struct Block
+	{
+		std::vector<int64_t> steps;
+		std::vector<double> volumes;
+		std::vector<float> values;
+	};
+
+	// Appends the values of one step to the current block and returns the volume of its rectangles. endStep() adds the total volume
+	// and hands the block over once it is full.
+	double appendStep(long long step, const float* height, const float* pressure, const float* externalPressure, const float* width);
+	void endStep(double volume);
+
+	void run();
+	void writeBlock(const Block& block);
+
+	// Summarizes the block just written, and every run of blocks it completes.
+	void summarizeBlock(const Block& block);
+	void writeSummary(int level, uint64_t firstBlock, uint64_t steps, const std::vector<TelemetrySummary>& values);
+
+	FILE* file = nullptr;
+	bool csv = false;
+	bool compressed = false;
+	float tolerance[TELEMETRY_FIELDS];
+	int vessels = 0;
+
+	// Kept by the writer thread for a binary file: the index so far, the bytes written and what they would have been uncompressed.
+	std::vector<TelemetryIndexEntry> index;
+	uint64_t written = 0;
+	uint64_t rawBytes = 0;
+	std::vector<unsigned char> coded;	// Scratch space for the writer thread to code a block into
+
+	// Also the writer thread's: every summary written so far, and for every level the one waiting for its neighbour, with its steps.
+	std::vector<TelemetrySummaryEntry> summaryIndex;
+	std::vector<std::vector<TelemetrySummary>> waiting;
+	std::vector<uint64_t> waitingSteps;
+	std::vector<TelemetrySummary> summary;	// Scratch space for the summary being built
+
+	Block current;
+	std::vector<float> columns;	// Scratch space for the writer thread to turn a block into columns
+	std::string line;			// Scratch space for the writer thread to build a line of CSV
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<Block> queued;
+	std::vector<Block> spare;
+	bool stopping = false;
+	bool failed = false;
+};
+
+// Reads a binary or compressed telemetry file, one block at a time.
+class TelemetryReader
+{
+public:
+	// Opens the file and finds its blocks. Returns false (after printing an error) if it isn't a complete telemetry file.
+	bool open(const std::string& fileName);
+	void close();
+
+	bool isOpen() const { return file.isOpen(); }
+	int vesselCount() const { return vessels; }
+	int blockCount() const { return (int)blocks.size(); }
+	bool isCompressed() const { return compressed; }
+
+	// The first and the last step in the file (both 0 if it has none).
+	long long firstStep() const { return blocks.empty() ? 0 : blocks.front().firstStep; }
+	long long lastStep() const { return blocks.empty() ? 0 : blocks.back().lastStep; }
+
+	// The block that holds step, or the last one before it if no block does. Returns -1 if step comes before the file.
+	int findBlock(long long step) const;
+
+	// The steps of block i, their total volumes (NaN in files from before version 3), and the block in columns as it was written:
+	// for every vessel its n heights, n pressures and n external pressures. Returns false (after printing an error) if the block is
+	// damaged.
+	bool readBlock(int i, std::vector<int64_t>& steps, std::vector<double>& volumes, std::vector<float>& columns);
+
+	// The state after step, or after the last step recorded before it, as record() saw it: values[v * TELEMETRY_FIELDS + field].
+	// Returns false if step comes before the file or its block is damaged. The block stays decoded, so the steps around it are cheap.
+	// Moving on to another block releases the pages of the one before and starts reading the one after it, so going through the
+	// whole file keeps the same few blocks in memory however long it is.
+	// With volume set, it gets the total volume at that step.
+	bool readStep(long long step, std::vector<float>& values, double* volume = nullptr);
+
+	// The smallest, the largest and the mean value of one field of a vessel over the steps from first to last, both included. The
+	// blocks the range covers whole are answered from the summaries (blocks of files from before version 4 are all read). Returns
+	// false if no step was recorded in the range, or a block it had to read is damaged.
+	bool summarize(int vessel, int field, long long first, long long last, TelemetryRange& range);
+
+private:
+	void walkBlocks(const std::string& fileName, size_t offset);
+	size_t blockEnd(int i) const;
+
+	// Keeps the summaries that are complete and lie within the file, and indexes them by level and first block.
+	void indexSummaries(const std::vector<TelemetrySummaryEntry>& entries);
+
+	MappedFile file;
+	bool compressed = false;
+	int version = 0;
+	int vessels = 0;
+	float tolerance[TELEMETRY_FIELDS];
+	std::vector<TelemetryIndexEntry> blocks;
+	std::vector<TelemetrySummaryEntry> summaries;
+	std::vector<std::vector<int>> summaryAt;	// For every level, the summary of every run of blocks there is, or -1
+
+	// The block readStep() read last.
+	int cachedBlock = -1;
+	std::vector<int64_t> cachedSteps;
+	std::vector<double> cachedVolumes;
+	std::vector<float> cachedColumns;
+};
+
+#endif // _TELEMETRY_H
@@ -0,0 +1,397 @@
+/*
+Title: HydroDynamics
+File Name: TelemetryCodec.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The codec of the compressed telemetry format (see Telemetry.h), which stores a block of
+steps in a fraction of the space of the raw floats.
+
+Every series (one field of one vessel over the steps of a block) is quantized to the
+tolerance of its field, so every value is a whole number of tolerances and comes back within
+half a tolerance of what was recorded. The heights and pressures change smoothly, so each
+value is predicted from the two before it (carrying on in a straight line) and only the
+difference to the prediction is kept, which is 0 or close to it most of the time, and exactly
+0 for a vessel at rest. Those residuals are entropy coded with an adaptive binary range
+coder: the number of bits of a residual is coded with probabilities that depend on its field
+and on the size of the residual before it, the highest bit below that with probabilities of its
+own, and the rest as they are. Every block is coded on its own, so it can be decoded without
+the ones before it.
+
+This file has no OpenGL dependency.
+*/
+
+#include "TelemetryCodec.h"
+#include <cmath>
+
+// The probabilities of the range coder are 11 bit fixed point, and move a 32nd of the way towards every bit they see.
+#define CODEC_PROBABILITY_BITS 11
+#define CODEC_ADAPT_SHIFT 5
+#define CODEC_TOP (1u << 24)
+
+// The size of a residual is its number of bits, 0 to 64, coded as 7 bits from the highest down through a tree of probabilities.
+// The tree is picked by the size of the residual before it in the same series, up to CODEC_LENGTH_CONTEXTS - 1.
+#define CODEC_LENGTH_BITS 7
+#define CODEC_LENGTH_CONTEXTS 16
+
+// Quantized values beyond this are clamped, so the residuals always fit in 64 bits.
+#define CODEC_MAX_QUANTIZED 4611686018427387904.0
+
+struct CodecModel
+{
+	uint16_t length[CODEC_LENGTH_CONTEXTS][1 << CODEC_LENGTH_BITS];
+	uint16_t highBit[65];
+
+	CodecModel()
+	{
+		for (auto& tree : length)
+		{
+			for (uint16_t& p : tree)
+			{
+				p = 1 << (CODEC_PROBABILITY_BITS - 1);
+			}
+		}
+		for (uint16_t& p : highBit)
+		{
+			p = 1 << (CODEC_PROBABILITY_BITS - 1);
+		}
+	}
+};
+
+class RangeEncoder
+{
+public:
+	RangeEncoder(std::vector<unsigned char>& output) : out(output) {}
+
+	void bit(uint16_t& probability, int value)
+	{
+		uint32_t bound = (range >> CODEC_PROBABILITY_BITS) * probability;
+		if (value == 0)
+		{
+			range = bound;
+			probability += ((1 << CODEC_PROBABILITY_BITS) - probability) >> CODEC_ADAPT_SHIFT;
+		}
+		else
+		{
+			low += bound;
+			range -= bound;
+			probability -= probability >> CODEC_ADAPT_SHIFT;
+		}
+		normalize();
+	}
+
+	// Bits that are as likely to be 0 as 1, without a probability.
+	void direct(uint64_t value, int count)
+	{
+		for (int i = count - 1; i >= 0; i--)
+		{
+			range >>= 1;
+			if ((value >> i) & 1)
+			{
+				low += range;
+			}
+			normalize();
+		}
+	}
+
+	void finish()
+	{
+		for (int i = 0; i < 5; i++)
+		{
+			shiftLow();
+		}
+	}
+
+private:
+	void normalize()
+	{
+		while (range < CODEC_TOP)
+		{
+			range <<= 8;
+			shiftLow();
+		}
+	}
+
+	// Moves the top byte of low out. A byte of 0xFF might still get a carry, so those wait in cacheSize until it is known.
+	void shiftLow()
+	{
+		if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0)
+		{
+			unsigned char carry = (unsigned char)(low >> 32);
+			unsigned char pending = cache;
+			do
+			{
+				out.push_back((unsigned char)(pending + carry));
+				pending = 0xFF;
+			} while (--cacheSize != 0);
+			cache = (unsigned char)(low >> 24);
+		}
+		cacheSize++;
+		low = (low & 0x00FFFFFFu) << 8;
+	}
+
+	std::vector<unsigned char>& out;
+	uint64_t low = 0;
+	uint32_t range = 0xFFFFFFFFu;
+	unsigned char cache = 0;
+	uint64_t cacheSize = 1;
+};
+
+class RangeDecoder
+{
+public:
+	RangeDecoder(const unsigned char* data, size_t size) : in(data), end(data + size)
+	{
+		for (int i = 0; i < 5; i++)
+		{
+			code = (code << 8) | next();
+		}
+	}
+
+	int bit(uint16_t& probability)
+	{
+		uint32_t bound = (range >> CODEC_PROBABILITY_BITS) * probability;
+		int value;
+		if (code < bound)
+		{
+			range = bound;
+			probability += ((1 << CODEC_PROBABILITY_BITS) - probability) >> CODEC_ADAPT_SHIFT;
+			value = 0;
+		}
+		else
+		{
+			code -= bound;
+			range -= bound;
+			probability -= probability >> CODEC_ADAPT_SHIFT;
+			value = 1;
+		}
+		normalize();
+		return value;
+	}
+
+	uint64_t direct(int count)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < count; i++)
+		{
+			range >>= 1;
+			int b = code >= range;
+			code -= range & (0u - (uint32_t)b);
+			value = (value << 1) | (uint64_t)b;
+			normalize();
+		}
+		return value;
+	}
+
+	// Whether the decoder read past the end of the data (the coder itself reads up to 4 bytes ahead, which it always wrote) or
+	// decoded something no encoder writes.
+	bool failed() const { return overrunBytes > 0 || corrupt; }
+	void setCorrupt() { corrupt = true; }
+
+private:
+	unsigned char next()
+	{
+		if (in < end)
+		{
+			return *in++;
+		}
+		overrunBytes++;
+		return 0;
+	}
+
+	void normalize()
+	{
+		while (range < CODEC_TOP)
+		{
+			range <<= 8;
+			code = (code << 8) | next();
+		}
+	}
+
+	const unsigned char* in;
+	const unsigned char* end;
+	uint32_t code = 0;
+	uint32_t range = 0xFFFFFFFFu;
+	int overrunBytes = 0;
+	bool corrupt = false;
+};
+
+static int bitLength(uint64_t value)
+{
+	int bits = 0;
+	while (value != 0)
+	{
+		bits++;
+		value >>= 1;
+	}
+	return bits;
+}
+
+// Small residuals of either sign get small codes: 0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...
+static uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (0 - ((uint64_t)value >> 63));
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)((value >> 1) ^ (0 - (value & 1)));
+}
+
+static void encodeResidual(RangeEncoder& coder, CodecModel& model, int& previousLength, uint64_t value)
+{
+	int length = bitLength(value);
+	uint16_t* tree = model.length[previousLength < CODEC_LENGTH_CONTEXTS ? previousLength : CODEC_LENGTH_CONTEXTS - 1];
+	int node = 1;
+	for (int i = CODEC_LENGTH_BITS - 1; i >= 0; i--)
+	{
+		int b = (length >> i) & 1;
+		coder.bit(tree[node], b);
+		node = node * 2 + b;
+	}
+	previousLength = length;
+
+	// The top bit of a residual of length bits is always 1, so only the ones below it are coded.
+	if (length >= 2)
+	{
+		coder.bit(model.highBit[length], (int)((value >> (length - 2)) & 1));
+		coder.direct(value, length - 2);
+	}
+}
+
+static uint64_t decodeResidual(RangeDecoder& coder, CodecModel& model, int& previousLength)
+{
+	uint16_t* tree = model.length[previousLength < CODEC_LENGTH_CONTEXTS ? previousLength : CODEC_LENGTH_CONTEXTS - 1];
+	int node = 1;
+	for (int i = 0; i < CODEC_LENGTH_BITS; i++)
+	{
+		node = node * 2 + coder.bit(tree[node]);
+	}
+	int length = node - (1 << CODEC_LENGTH_BITS);
+	if (length > 64)
+	{
+		coder.setCorrupt();
+		length = 0;
+	}
+	previousLength = length;
+
+	if (length == 0)
+	{
+		return 0;
+	}
+	if (length == 1)
+	{
+		return 1;
+	}
+	uint64_t value = 2 | (uint64_t)coder.bit(model.highBit[length]);
+	return (value << (length - 2)) | coder.direct(length - 2);
+}
+
+static int64_t quantize(float value, float tolerance)
+{
+	double q = std::isfinite(value) ? std::round((double)value / tolerance) : 0.0;
+	q = q > CODEC_MAX_QUANTIZED ? CODEC_MAX_QUANTIZED : (q < -CODEC_MAX_QUANTIZED ? -CODEC_MAX_QUANTIZED : q);
+	return (int64_t)q;
+}
+
+// Carries on in a straight line from the two values before, or repeats the one before for the second value of a series. Wild
+// values can take this past the range of int64, so it wraps around as unsigned, and the residual wraps back when it is added.
+static uint64_t predict(const int64_t* previous, int index)
+{
+	if (index == 0)
+	{
+		return 0;
+	}
+	if (index == 1)
+	{
+		return (uint64_t)previous[0];
+	}
+	return 2 * (uint64_t)previous[index - 1] - (uint64_t)previous[index - 2];
+}
+
+void encodeTelemetryBlock(const int64_t* steps, const float* columns, int stepCount, int seriesCount, const float* tolerance,
+	int fieldCount, std::vector<unsigned char>& out)
+{
+	RangeEncoder coder(out);
+
+	// The steps usually count up by one, so the first is stored as it is and the others as how far they are from one more than the
+	// step before.
+	CodecModel stepModel;
+	int stepLength = 0;
+	if (stepCount > 0)
+	{
+		coder.direct((uint64_t)steps[0], 64);
+	}
+	for (int s = 1; s < stepCount; s++)
+	{
+		encodeResidual(coder, stepModel, stepLength, zigzag((int64_t)((uint64_t)steps[s] - (uint64_t)steps[s - 1] - 1)));
+	}
+
+	std::vector<CodecModel> models(fieldCount);
+	std::vector<int64_t> quantized(stepCount);
+	for (int series = 0; series < seriesCount; series++)
+	{
+		int field = series % fieldCount;
+		const float* values = columns + (size_t)series * stepCount;
+		int previousLength = 0;
+		for (int s = 0; s < stepCount; s++)
+		{
+			quantized[s] = quantize(values[s], tolerance[field]);
+			encodeResidual(coder, models[field], previousLength, zigzag((int64_t)((uint64_t)quantized[s] - predict(quantized.data(), s))));
+		}
+	}
+	coder.finish();
+}
+
+bool decodeTelemetryBlock(const unsigned char* data, size_t size, int stepCount, int seriesCount, const float* tolerance,
+	int fieldCount, std::vector<int64_t>& steps, std::vector<float>& columns)
+{
+	RangeDecoder coder(data, size);
+	steps.resize(stepCount);
+	columns.resize((size_t)stepCount * seriesCount);
+
+	CodecModel stepModel;
+	int stepLength = 0;
+	if (stepCount > 0)
+	{
+		steps[0] = (int64_t)coder.direct(64);
+	}
+	for (int s = 1; s < stepCount; s++)
+	{
+		steps[s] = (int64_t)((uint64_t)steps[s - 1] + 1 + (uint64_t)unzigzag(decodeResidual(coder, stepModel, stepLength)));
+	}
+
+	std::vector<CodecModel> models(fieldCount);
+	std::vector<int64_t> quantized(stepCount);
+	for (int series = 0; series < seriesCount; series++)
+	{
+		int field = series % fieldCount;
+		float* values = columns.data() + (size_t)series * stepCount;
+		int previousLength = 0;
+		for (int s = 0; s < stepCount; s++)
+		{
+			quantized[s] = (int64_t)(predict(quantized.data(), s) + (uint64_t)unzigzag(decodeResidual(coder, models[field], previousLength)));
+			values[s] = (float)(quantized[s] * (double)tolerance[field]);
+		}
+	}
+	return !coder.failed();
+}
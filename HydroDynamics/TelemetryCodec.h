@@ -0,0 +1,60 @@
+/*
+Title: HydroDynamics
+File Name: TelemetryCodec.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+The codec of the compressed telemetry format (see Telemetry.h), which stores a block of
+steps in a fraction of the space of the raw floats.
+
+Every series (one field of one vessel over the steps of a block) is quantized to the
+tolerance of its field, so every value is a whole number of tolerances and comes back within
+half a tolerance of what was recorded. The heights and pressures change smoothly, so each
+value is predicted from the two before it (carrying on in a straight line) and only the
+difference to the prediction is kept, which is 0 or close to it most of the time, and exactly
+0 for a vessel at rest. Those residuals are entropy coded with an adaptive binary range
+coder: the number of bits of a residual is coded with probabilities that depend on its field
+and on the size of the residual before it, the highest bit below that with probabilities of its
+own, and the rest as they are. Every block is coded on its own, so it can be decoded without
+the ones before it.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _TELEMETRY_CODEC_H
+#define _TELEMETRY_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Appends the coded block to out. columns holds seriesCount series of stepCount values each, one after the other, and series s
+// belongs to field s % fieldCount, which is quantized to tolerance[field] (above 0).
+void encodeTelemetryBlock(const int64_t* steps, const float* columns, int stepCount, int seriesCount, const float* tolerance,
+	int fieldCount, std::vector<unsigned char>& out);
+
+// Decodes a block written by encodeTelemetryBlock() with the same counts and tolerances into steps and columns, which are resized to
+// fit. Returns false if the data ends before the block does.
+bool decodeTelemetryBlock(const unsigned char* data, size_t size, int stepCount, int seriesCount, const float* tolerance,
+	int fieldCount, std::vector<int64_t>& steps, std::vector<float>& columns);
+
+#endif // _TELEMETRY_CODEC_H
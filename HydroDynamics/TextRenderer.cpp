@@ -0,0 +1,349 @@
+/*
+Title: HydroDynamics
+File Name: TextRenderer.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Draws text over the scene from a glyph atlas: a single small texture with every character
+of a built in 5x7 pixel font in a cell of its own. A piece of text is a row of quads, one
+per character, each showing its cell of the atlas, and all the text of a frame goes into
+one vertex buffer that is drawn with a single draw call.
+
+The text is laid out in pixels from the top left corner of the window, and every pixel
+of the font covers TEXT_SCALE x TEXT_SCALE pixels on screen, so the glyphs stay sharp.
+The font only has capital letters; lower case ones are drawn as capitals. Where the atlas
+is empty the fragment shader discards the pixel, so no blending is needed.
+
+Writing the text costs a few microseconds on the CPU, so the caller decides when it
+changes: between beginText() and endText() the text is written and uploaded, and
+queueText() draws whatever was uploaded last, as often as needed, without touching it.
+*/
+
+#include "TextRenderer.h"
+#include "GLState.h"
+#include "Shaders.h"
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <iostream>
+
+// The atlas has 16 x 8 cells, one for every ASCII character, of TEXT_ADVANCE x 8 texels. The glyph takes up the top left 5 x 7 of
+// its cell, and the rest is the space between characters and lines. The cell of 127 is filled completely, for the backgrounds.
+#define ATLAS_COLUMNS 16
+#define ATLAS_ROWS 8
+#define CELL_WIDTH TEXT_ADVANCE
+#define CELL_HEIGHT 8
+#define ATLAS_WIDTH (ATLAS_COLUMNS * CELL_WIDTH)
+#define ATLAS_HEIGHT (ATLAS_ROWS * CELL_HEIGHT)
+#define SOLID_GLYPH 127
+
+// The font: 7 rows per character from the top, the leftmost pixel of a row in bit 4.
+struct Glyph
+{
+	char character;
+	unsigned char rows[7];
+};
+
+static const Glyph font[] =
+{
+	{ '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+	{ '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+	{ '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+	{ '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+	{ '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+	{ '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+	{ '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+	{ '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+	{ '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+	{ '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+	{ 'A', { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 } },
+	{ 'B', { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E } },
+	{ 'C', { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E } },
+	{ 'D', { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C } },
+	{ 'E', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F } },
+	{ 'F', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 } },
+	{ 'G', { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F } },
+	{ 'H', { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 } },
+	{ 'I', { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+	{ 'J', { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C } },
+	{ 'K', { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 } },
+	{ 'L', { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F } },
+	{ 'M', { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 } },
+	{ 'N', { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 } },
+	{ 'O', { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E } },
+	{ 'P', { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 } },
+	{ 'Q', { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D } },
+	{ 'R', { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 } },
+	{ 'S', { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E } },
+	{ 'T', { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 } },
+	{ 'U', { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E } },
+	{ 'V', { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 } },
+	{ 'W', { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A } },
+	{ 'X', { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 } },
+	{ 'Y', { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 } },
+	{ 'Z', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F } },
+	{ '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+	{ ',', { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 } },
+	{ ':', { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 } },
+	{ '-', { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 } },
+	{ '+', { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 } },
+	{ '=', { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 } },
+	{ '%', { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 } },
+	{ '(', { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 } },
+	{ ')', { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 } },
+	{ '[', { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E } },
+	{ ']', { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E } },
+	{ '<', { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 } },
+	{ '>', { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 } },
+	{ '/', { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 } },
+	{ '|', { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 } },
+	{ '_', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F } },
+	{ '!', { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 } },
+	{ '?', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 } },
+	{ '*', { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 } },
+	{ '#', { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A } },
+	{ '\'', { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 } },
+};
+
+// What a character is drawn as: capitals for lower case letters, and '?' for anything the font doesn't have.
+static unsigned char glyphCells[128];
+
+struct TextVertex
+{
+	float x, y;		// In pixels from the top left of the window
+	float u, v;		// In the atlas, from its top left
+	GLuint color;	// RGBA, 8 bits each
+};
+
+static GLuint textProgram = 0;
+static GLuint textVertexShader = 0;
+static GLuint textFragmentShader = 0;
+static GLuint textVao = 0;
+static GLuint textVbo = 0;
+static GLuint textEbo = 0;
+static GLuint atlasTexture = 0;
+static std::vector<TextVertex> textVertices;
+static int uploadedGlyphs = 0;
+
+bool initTextRenderer(const char* vertexFile, const char* fragmentFile)
+{
+	// Every character starts out as '?', then the ones the font has are filled in.
+	std::vector<unsigned char> atlas(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+	for (int c = 0; c < 128; c++)
+	{
+		glyphCells[c] = '?';
+	}
+	glyphCells[' '] = ' ';
+	for (const Glyph& glyph : font)
+	{
+		int cell = (unsigned char)glyph.character;
+		glyphCells[cell] = (unsigned char)cell;
+		if (cell >= 'A' && cell <= 'Z')
+		{
+			glyphCells[cell - 'A' + 'a'] = (unsigned char)cell;
+		}
+		int left = (cell % ATLAS_COLUMNS) * CELL_WIDTH;
+		int top = (cell / ATLAS_COLUMNS) * CELL_HEIGHT;
+		for (int row = 0; row < 7; row++)
+		{
+			for (int column = 0; column < 5; column++)
+			{
+				if (glyph.rows[row] & (0x10 >> column))
+				{
+					atlas[(top + row) * ATLAS_WIDTH + left + column] = 255;
+				}
+			}
+		}
+	}
+	int solidLeft = (SOLID_GLYPH % ATLAS_COLUMNS) * CELL_WIDTH;
+	int solidTop = (SOLID_GLYPH / ATLAS_COLUMNS) * CELL_HEIGHT;
+	for (int row = 0; row < CELL_HEIGHT; row++)
+	{
+		std::fill_n(&atlas[(solidTop + row) * ATLAS_WIDTH + solidLeft], CELL_WIDTH, 255);
+	}
+
+	// Nearest filtering keeps the pixels of the font sharp at any integer scale.
+	glGenTextures(1, &atlasTexture);
+	cachedBindTexture(GL_TEXTURE_2D, atlasTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	cachedBindTexture(GL_TEXTURE_2D, 0);
+
+	// Every glyph is a quad of 4 vertices, so the indices never change.
+	std::vector<GLuint> indices(TEXT_MAX_GLYPHS * 6);
+	for (int i = 0; i < TEXT_MAX_GLYPHS; i++)
+	{
+		GLuint first = (GLuint)(i * 4);
+		indices[i * 6 + 0] = first + 0;
+		indices[i * 6 + 1] = first + 1;
+		indices[i * 6 + 2] = first + 2;
+		indices[i * 6 + 3] = first + 0;
+		indices[i * 6 + 4] = first + 2;
+		indices[i * 6 + 5] = first + 3;
+	}
+
+	glGenVertexArrays(1, &textVao);
+	cachedBindVertexArray(textVao);
+
+	glGenBuffers(1, &textVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, textVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(TextVertex) * TEXT_MAX_GLYPHS * 4, nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &textEbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, textEbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, x));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, u));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)offsetof(TextVertex, color));
+
+	cachedBindVertexArray(0);
+	textVertices.reserve(TEXT_MAX_GLYPHS * 4);
+
+	textProgram = loadProgramFiles(vertexFile, fragmentFile, textVertexShader, textFragmentShader);
+	if (textProgram == 0)
+	{
+		std::cout << "Can't build the text program, no text is drawn." << std::endl;
+		return false;
+	}
+	cachedUseProgram(textProgram);
+	glUniform1i(glGetUniformLocation(textProgram, "atlas"), 3);
+	cachedUseProgram(0);
+	return true;
+}
+
+void beginText()
+{
+	textVertices.clear();
+}
+
+// Writes a quad from (x0, y0) to (x1, y1) on screen showing the texels (u0, v0) to (u1, v1) of the atlas.
+static void writeQuad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, GLuint color)
+{
+	if (textVertices.size() >= TEXT_MAX_GLYPHS * 4)
+	{
+		return;
+	}
+	u0 /= ATLAS_WIDTH;
+	u1 /= ATLAS_WIDTH;
+	v0 /= ATLAS_HEIGHT;
+	v1 /= ATLAS_HEIGHT;
+	textVertices.push_back({ x0, y0, u0, v0, color });
+	textVertices.push_back({ x1, y0, u1, v0, color });
+	textVertices.push_back({ x1, y1, u1, v1, color });
+	textVertices.push_back({ x0, y1, u0, v1, color });
+}
+
+void addText(float x, float y, std::string_view text, const glm::vec4& color)
+{
+	GLuint packed = glm::packUnorm4x8(color);
+	float left = x;
+	for (char c : text)
+	{
+		if (c == '\n')
+		{
+			x = left;
+			y += TEXT_LINE_HEIGHT * TEXT_SCALE;
+			continue;
+		}
+		int cell = glyphCells[(unsigned char)c & 127];
+		if (cell != ' ')
+		{
+			float u = (float)((cell % ATLAS_COLUMNS) * CELL_WIDTH);
+			float v = (float)((cell / ATLAS_COLUMNS) * CELL_HEIGHT);
+			writeQuad(x, y, x + CELL_WIDTH * TEXT_SCALE, y + CELL_HEIGHT * TEXT_SCALE, u, v, u + CELL_WIDTH, v + CELL_HEIGHT, packed);
+		}
+		x += TEXT_ADVANCE * TEXT_SCALE;
+	}
+}
+
+void addTextBackground(float x, float y, float width, float height, const glm::vec4& color)
+{
+	// The middle of the solid cell, which is filled all around, so no filtering can reach past it.
+	float u = (SOLID_GLYPH % ATLAS_COLUMNS) * CELL_WIDTH + CELL_WIDTH * 0.5f;
+	float v = (SOLID_GLYPH / ATLAS_COLUMNS) * CELL_HEIGHT + CELL_HEIGHT * 0.5f;
+	writeQuad(x, y, x + width, y + height, u, v, u, v, glm::packUnorm4x8(color));
+}
+
+float textWidth(std::string_view text)
+{
+	int longest = 0;
+	int length = 0;
+	for (char c : text)
+	{
+		length = c == '\n' ? 0 : length + 1;
+		longest = std::max(longest, length);
+	}
+	return (float)(longest * TEXT_ADVANCE * TEXT_SCALE);
+}
+
+void endText()
+{
+	// Orphaning the buffer first lets the driver hand us fresh memory instead of waiting for the GPU to finish reading the old text.
+	uploadedGlyphs = (int)(textVertices.size() / 4);
+	glBindBuffer(GL_ARRAY_BUFFER, textVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(TextVertex) * TEXT_MAX_GLYPHS * 4, nullptr, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(TextVertex) * textVertices.size(), textVertices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void queueText(RenderQueue& queue, int width, int height)
+{
+	if (textProgram == 0)
+	{
+		return;
+	}
+	cachedActiveTexture(GL_TEXTURE3);
+	cachedBindTexture(GL_TEXTURE_2D, atlasTexture);
+	cachedActiveTexture(GL_TEXTURE0);
+
+	// Pixels from the top left, so y points down.
+	DrawItem item;
+	item.layer = RENDER_LAYER_OVERLAY;
+	item.program = textProgram;
+	item.vao = textVao;
+	item.indexType = GL_UNSIGNED_INT;
+	item.count = uploadedGlyphs * 6;
+	item.depthTest = false;
+	item.mvp = glm::ortho(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f);
+	queue.add(item);
+}
+
+void destroyTextRenderer()
+{
+	cachedDeleteVertexArrays(1, &textVao);
+	glDeleteBuffers(1, &textVbo);
+	glDeleteBuffers(1, &textEbo);
+	cachedDeleteTextures(1, &atlasTexture);
+	glDeleteShader(textVertexShader);
+	glDeleteShader(textFragmentShader);
+	cachedDeleteProgram(textProgram);
+	textProgram = 0;
+}
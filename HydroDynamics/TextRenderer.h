@@ -0,0 +1,81 @@
+/*
+Title: HydroDynamics
+File Name: TextRenderer.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Draws text over the scene from a glyph atlas: a single small texture with every character
+of a built in 5x7 pixel font in a cell of its own. A piece of text is a row of quads, one
+per character, each showing its cell of the atlas, and all the text of a frame goes into
+one vertex buffer that is drawn with a single draw call.
+
+The text is laid out in pixels from the top left corner of the window, and every pixel
+of the font covers TEXT_SCALE x TEXT_SCALE pixels on screen, so the glyphs stay sharp.
+The font only has capital letters; lower case ones are drawn as capitals. Where the atlas
+is empty the fragment shader discards the pixel, so no blending is needed.
+
+Writing the text costs a few microseconds on the CPU, so the caller decides when it
+changes: between beginText() and endText() the text is written and uploaded, and
+queueText() draws whatever was uploaded last, as often as needed, without touching it.
+*/
+
+#ifndef _TEXT_RENDERER_H
+#define _TEXT_RENDERER_H
+
+#include "GLIncludes.h"
+#include "RenderQueue.h"
+#include <string_view>
+
+// How many characters fit into the buffer. Anything after that is dropped.
+#define TEXT_MAX_GLYPHS 4096
+
+// The size of a pixel of the font on screen, and the cell every character takes up, in pixels of the font.
+#define TEXT_SCALE 2
+#define TEXT_ADVANCE 6
+#define TEXT_LINE_HEIGHT 10
+
+// Creates the atlas, the buffers and the program. Needs a current OpenGL context. Returns false if the program doesn't build, in
+// which case queueText() draws nothing.
+bool initTextRenderer(const char* vertexFile, const char* fragmentFile);
+
+// Starts writing the text again. Nothing is drawn differently until endText().
+void beginText();
+
+// Writes a line of text with its top left corner at (x, y), in pixels from the top left of the window. '\n' starts a new line.
+void addText(float x, float y, std::string_view text, const glm::vec4& color);
+
+// Fills the rectangle from (x, y) to (x + width, y + height) behind the text written after it.
+void addTextBackground(float x, float y, float width, float height, const glm::vec4& color);
+
+// How many pixels wide text is on screen, the longest line if there are several.
+float textWidth(std::string_view text);
+
+// Uploads what was written since beginText().
+void endText();
+
+// Adds the text to the queue in RENDER_LAYER_OVERLAY, for a window of width x height pixels.
+void queueText(RenderQueue& queue, int width, int height);
+
+// Frees everything.
+void destroyTextRenderer();
+
+#endif // _TEXT_RENDERER_H
@@ -0,0 +1,235 @@
+/*
+Title: HydroDynamics
+File Name: ThreadControl.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Which cores every kind of thread may run on, and how it is prioritized against the others.
+Every thread the program starts has a role, and calls applyThreadRole() with it first
+thing, which applies the cores and the priority set for that role. By default nothing is
+pinned, and only the threads that write captures, videos, telemetry and checkpoints (and
+watch files) and a sweep working in the background run at a low priority, so a busy encoder can't push the render thread or the
+simulation off a core and upset the pacing of the frames.
+
+With --affinity role=cores and --priority role=low|normal|high (see main.cpp) every role
+can be configured. The cores are a list like "0-3,8". Raising a priority above normal may
+need privileges (CAP_SYS_NICE on Linux), in which case it stays normal.
+*/
+
+#include "ThreadControl.h"
+#include "TracyZones.h"
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct RoleSettings
+{
+	std::vector<int> cores;		// Empty for any core
+	ThreadPriority priority;
+};
+
+static RoleSettings roles[THREAD_ROLE_COUNT] =
+{
+	{ {}, PRIORITY_NORMAL },
+	{ {}, PRIORITY_NORMAL },
+	{ {}, PRIORITY_NORMAL },
+	{ {}, PRIORITY_NORMAL },
+	{ {}, PRIORITY_LOW },
+	{ {}, PRIORITY_LOW },
+	{ {}, PRIORITY_LOW }
+};
+
+static const char* roleNames[THREAD_ROLE_COUNT] =
+{
+	"render",
+	"simulation",
+	"worker",
+	"render-worker",
+	"capture",
+	"io",
+	"batch"
+};
+
+const char* threadRoleName(ThreadRole role)
+{
+	return role < THREAD_ROLE_COUNT ? roleNames[role] : "unknown";
+}
+
+bool parseCoreList(const std::string& text, std::vector<int>& cores)
+{
+	cores.clear();
+	const char* p = text.c_str();
+	while (*p != 0)
+	{
+		char* end;
+		long first = strtol(p, &end, 10);
+		if (end == p || first < 0)
+		{
+			return false;
+		}
+		long last = first;
+		p = end;
+		if (*p == '-')
+		{
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1 || last < first)
+			{
+				return false;
+			}
+			p = end;
+		}
+		for (long core = first; core <= last; core++)
+		{
+			cores.push_back((int)core);
+		}
+		if (*p == ',')
+		{
+			p++;
+		}
+		else if (*p != 0)
+		{
+			return false;
+		}
+	}
+	return !cores.empty();
+}
+
+// Splits "role=value" and finds the role. Returns false (and prints why) if there is no such role.
+static bool splitSetting(const std::string& setting, ThreadRole& role, std::string& value)
+{
+	size_t equals = setting.find('=');
+	std::string name = setting.substr(0, equals);
+	for (int r = 0; r < THREAD_ROLE_COUNT; r++)
+	{
+		if (equals != std::string::npos && name == roleNames[r])
+		{
+			role = (ThreadRole)r;
+			value = setting.substr(equals + 1);
+			return true;
+		}
+	}
+	std::cout << "Expected role=value with a role of render, simulation, worker, render-worker, capture or io, not " << setting << std::endl;
+	return false;
+}
+
+bool parseThreadAffinity(const std::string& setting)
+{
+	ThreadRole role;
+	std::string value;
+	if (!splitSetting(setting, role, value))
+	{
+		return false;
+	}
+	if (!parseCoreList(value, roles[role].cores))
+	{
+		std::cout << "Expected a list of cores like 0-3,8 for " << roleNames[role] << ", not " << value << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool parseThreadPriority(const std::string& setting)
+{
+	ThreadRole role;
+	std::string value;
+	if (!splitSetting(setting, role, value))
+	{
+		return false;
+	}
+	static const char* priorityNames[] = { "low", "normal", "high" };
+	for (int p = PRIORITY_LOW; p <= PRIORITY_HIGH; p++)
+	{
+		if (value == priorityNames[p])
+		{
+			roles[role].priority = (ThreadPriority)p;
+			return true;
+		}
+	}
+	std::cout << "Expected a priority of low, normal or high for " << roleNames[role] << ", not " << value << std::endl;
+	return false;
+}
+
+#ifdef _WIN32
+static bool pinCurrentThread(const std::vector<int>& cores)
+{
+	DWORD_PTR mask = 0;
+	for (int core : cores)
+	{
+		if (core < (int)(8 * sizeof(DWORD_PTR)))
+		{
+			mask |= (DWORD_PTR)1 << core;
+		}
+	}
+	return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+static bool prioritizeCurrentThread(ThreadPriority priority)
+{
+	static const int levels[] = { THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL };
+	return SetThreadPriority(GetCurrentThread(), levels[priority]) != 0;
+}
+#else
+static bool pinCurrentThread(const std::vector<int>& cores)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int core : cores)
+	{
+		if (core < CPU_SETSIZE)
+		{
+			CPU_SET(core, &set);
+		}
+	}
+	return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// On Linux every thread has its own nice value.
+static bool prioritizeCurrentThread(ThreadPriority priority)
+{
+	static const int niceness[] = { 10, 0, -5 };
+	return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), niceness[priority]) == 0;
+}
+#endif
+
+void applyThreadRole(ThreadRole role)
+{
+	TRACY_THREAD_NAME(threadRoleName(role));
+	const RoleSettings& settings = roles[role];
+	if (!settings.cores.empty() && !pinCurrentThread(settings.cores))
+	{
+		std::cout << "Couldn't pin the " << roleNames[role] << " thread to its cores" << std::endl;
+	}
+	if (settings.priority != PRIORITY_NORMAL && !prioritizeCurrentThread(settings.priority))
+	{
+		std::cout << "Couldn't change the priority of the " << roleNames[role] << " thread" << std::endl;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+Title: HydroDynamics
+File Name: ThreadControl.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Which cores every kind of thread may run on, and how it is prioritized against the others.
+Every thread the program starts has a role, and calls applyThreadRole() with it first
+thing, which applies the cores and the priority set for that role. By default nothing is
+pinned, and only the threads that write captures, videos, telemetry and checkpoints (and
+watch files) and a sweep working in the background run at a low priority, so a busy encoder can't push the render thread or the
+simulation off a core and upset the pacing of the frames.
+
+With --affinity role=cores and --priority role=low|normal|high (see main.cpp) every role
+can be configured. The cores are a list like "0-3,8". Raising a priority above normal may
+need privileges (CAP_SYS_NICE on Linux), in which case it stays normal.
+*/
+
+#ifndef _THREAD_CONTROL_H
+#define _THREAD_CONTROL_H
+
+#include <string>
+#include <vector>
+
+enum ThreadRole
+{
+	THREAD_ROLE_RENDER = 0,		// The main thread: input, rendering and presenting
+	THREAD_ROLE_SIMULATION,		// The simulation thread
+	THREAD_ROLE_WORKER,			// The workers of the pool the simulation steps large networks on
+	THREAD_ROLE_RENDER_WORKER,	// The workers of the pool that writes the instances of large viewed sweeps
+	THREAD_ROLE_CAPTURE,		// Writing screenshots, recordings and videos
+	THREAD_ROLE_IO,				// Telemetry, checkpoints and the file watcher
+	THREAD_ROLE_BATCH,			// A sweep worker running behind the window (see --background-worker in main.cpp)
+	THREAD_ROLE_COUNT
+};
+
+enum ThreadPriority
+{
+	PRIORITY_LOW = 0,
+	PRIORITY_NORMAL,
+	PRIORITY_HIGH
+};
+
+// Parses "role=cores" and "role=low|normal|high", like the command line gives them. Returns false (and prints why) if it can't.
+bool parseThreadAffinity(const std::string& setting);
+bool parseThreadPriority(const std::string& setting);
+
+// Pins the calling thread to the cores of its role, if it has any, and gives it the priority of its role. Call before any other
+// thread is started with the settings, which are read without a lock.
+void applyThreadRole(ThreadRole role);
+
+const char* threadRoleName(ThreadRole role);
+
+// Parses a list of cores like "0-3,8". Returns false if it isn't one.
+bool parseCoreList(const std::string& text, std::vector<int>& cores);
+
+#endif // _THREAD_CONTROL_H
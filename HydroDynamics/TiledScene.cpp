@@ -0,0 +1,676 @@
+/*
+Title: HydroDynamics
+File Name: TiledScene.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scenes too large to load at once are compiled into tiles (--compile-scene with --scene-tiles),
+and streamed in around the view while the simulation runs.
+
+The plane is cut into square tiles, and every component of the network (the vessels joined by
+tubes, directly or through others) goes into the tile its first vessel stands in, whole. So
+no tube ever runs from one tile into another, and a tile can be added to the network or taken
+out of it without touching anything else. The file is a header, the index of every tile
+(its bounds, its counts and where it starts) and then the tiles, each one block holding the
+arrays of its vessels and tubes, with the tubes numbering the vessels of the tile only.
+
+SceneStreamer only reads the header and the index when it opens a file, so opening takes the
+same time whatever the size of the scene. focus() tells it which part of the plane is wanted;
+the tiles it overlaps are read on a background thread, and apply() adds those that arrived
+to the network and takes out the ones that are no longer near the focus. apply() changes the
+network, so nothing may step it meanwhile. A tile only leaves once every component in it is
+asleep, so the parts of the network that are still moving keep moving, and the tile of the
+piston never leaves. A tile that left goes into a least recently used cache bounded in bytes,
+so coming back to it costs no read. A tile whose state changed while it was in the network
+has no copy on disk anymore, so it stays in the cache whatever the bound.
+
+Layered networks can't be tiled. This file has no OpenGL dependency.
+*/
+
+#include "TiledScene.h"
+#include "ThreadControl.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+// The header at the start of the file. Only fixed size types, so the layout is the same with every compiler.
+struct TiledSceneHeader
+{
+	char magic[8];				// "HYDROTIL"
+	uint32_t version;
+	uint32_t headerSize;		// sizeof(TiledSceneHeader), as a second check on the layout
+	uint32_t tileCount;
+	uint32_t vesselCount;		// Over all tiles
+	uint32_t tubeCount;
+	int32_t pistonTile;
+	int32_t pistonVessel;		// Within its tile
+	float pistonPressure;
+	int64_t step;
+	float tileSize;
+	uint32_t reserved;
+};
+
+// One entry of the index, which follows the header. The block of a tile holds height, width, externalPressure, left and bottom of
+// its vessels, then tubeA, tubeB, tubeInvInertance, tubeDamping and tubeFlow of its tubes, all 4 bytes per element.
+struct TiledSceneEntry
+{
+	float minX;
+	float minY;
+	float maxX;
+	float maxY;
+	uint32_t vesselCount;
+	uint32_t tubeCount;
+	uint64_t offset;
+};
+
+static const char tiledSceneMagic[8] = { 'H', 'Y', 'D', 'R', 'O', 'T', 'I', 'L' };
+
+static uint64_t blockBytes(uint64_t vessels, uint64_t tubes)
+{
+	return (vessels + tubes) * 5 * 4;
+}
+
+static int findRoot(std::vector<int>& parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+bool writeTiledScene(const std::string& fileName, const VesselNetwork& network, const CheckpointInfo& info, float tileSize)
+{
+	if (network.layered() || network.profiled() || network.hasComponents())
+	{
+		std::cout << "A layered or profiled scene, or one with components on its tubes, can't be cut into tiles." << std::endl;
+		return false;
+	}
+	if (!(tileSize > 0.0f))
+	{
+		std::cout << "The size of a tile has to be above 0." << std::endl;
+		return false;
+	}
+
+	// The components, with union-find like rebuildTopology() does.
+	int vessels = network.vesselCount();
+	std::vector<int> parent(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		parent[i] = i;
+	}
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		int ra = findRoot(parent, network.tubeA[t]);
+		int rb = findRoot(parent, network.tubeB[t]);
+		if (ra != rb)
+		{
+			parent[std::max(ra, rb)] = std::min(ra, rb);
+		}
+	}
+
+	// The root of a component is its lowest vessel, which decides its tile. The tiles are numbered row by row.
+	std::map<std::pair<long long, long long>, int> tileOfCell;
+	std::vector<std::pair<long long, long long>> cellOf(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		if (findRoot(parent, i) == i)
+		{
+			float x = (network.left[i] + network.right[i]) * 0.5f;
+			cellOf[i] = std::make_pair((long long)std::floor(network.bottom[i] / tileSize), (long long)std::floor(x / tileSize));
+			tileOfCell[cellOf[i]] = 0;
+		}
+	}
+	int tileCount = 0;
+	for (auto& cell : tileOfCell)
+	{
+		cell.second = tileCount++;
+	}
+
+	std::vector<std::vector<int>> tileVessels(tileCount);
+	std::vector<std::vector<int>> tileTubes(tileCount);
+	std::vector<int> tileOf(vessels);
+	std::vector<int> localOf(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		int tile = tileOfCell[cellOf[findRoot(parent, i)]];
+		tileOf[i] = tile;
+		localOf[i] = (int)tileVessels[tile].size();
+		tileVessels[tile].push_back(i);
+	}
+	for (int t = 0; t < network.tubeCount(); t++)
+	{
+		tileTubes[tileOf[network.tubeA[t]]].push_back(t);
+	}
+
+	TiledSceneHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, tiledSceneMagic, sizeof(header.magic));
+	header.version = TILED_SCENE_VERSION;
+	header.headerSize = sizeof(TiledSceneHeader);
+	header.tileCount = (uint32_t)tileCount;
+	header.vesselCount = (uint32_t)vessels;
+	header.tubeCount = (uint32_t)network.tubeCount();
+	bool hasPiston = info.pistonVessel >= 0 && info.pistonVessel < vessels;
+	header.pistonTile = hasPiston ? tileOf[info.pistonVessel] : -1;
+	header.pistonVessel = hasPiston ? localOf[info.pistonVessel] : 0;
+	header.pistonPressure = info.pistonPressure;
+	header.step = info.step;
+	header.tileSize = tileSize;
+
+	std::vector<TiledSceneEntry> entries(tileCount);
+	uint64_t offset = sizeof(TiledSceneHeader) + sizeof(TiledSceneEntry) * (uint64_t)tileCount;
+	for (int tile = 0; tile < tileCount; tile++)
+	{
+		TiledSceneEntry& entry = entries[tile];
+		entry.minX = FLT_MAX;
+		entry.minY = FLT_MAX;
+		entry.maxX = -FLT_MAX;
+		entry.maxY = -FLT_MAX;
+		for (int i : tileVessels[tile])
+		{
+			entry.minX = std::min(entry.minX, network.left[i]);
+			entry.minY = std::min(entry.minY, network.bottom[i]);
+			entry.maxX = std::max(entry.maxX, network.right[i]);
+			entry.maxY = std::max(entry.maxY, network.top[i]);
+		}
+		entry.vesselCount = (uint32_t)tileVessels[tile].size();
+		entry.tubeCount = (uint32_t)tileTubes[tile].size();
+		entry.offset = offset;
+		offset += blockBytes(entry.vesselCount, entry.tubeCount);
+	}
+
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(entries.data(), sizeof(TiledSceneEntry), entries.size(), file) == entries.size();
+	std::vector<float> block;
+	for (int tile = 0; tile < tileCount && written; tile++)
+	{
+		// The floats of the block, with the tube ends stored as ints in the same 4 bytes.
+		block.clear();
+		const std::vector<float>* vesselArrays[5] = { &network.height, &network.width, &network.externalPressure, &network.left, &network.bottom };
+		for (const std::vector<float>* values : vesselArrays)
+		{
+			for (int i : tileVessels[tile])
+			{
+				block.push_back((*values)[i]);
+			}
+		}
+		const std::vector<int>* ends[2] = { &network.tubeA, &network.tubeB };
+		for (const std::vector<int>* end : ends)
+		{
+			for (int t : tileTubes[tile])
+			{
+				int local = localOf[(*end)[t]];
+				float stored;
+				memcpy(&stored, &local, sizeof(stored));
+				block.push_back(stored);
+			}
+		}
+		const std::vector<float>* tubeArrays[3] = { &network.tubeInvInertance, &network.tubeDamping, &network.tubeFlow };
+		for (const std::vector<float>* values : tubeArrays)
+		{
+			for (int t : tileTubes[tile])
+			{
+				block.push_back((*values)[t]);
+			}
+		}
+		written = fwrite(block.data(), sizeof(float), block.size(), file) == block.size();
+	}
+	written = fclose(file) == 0 && written;
+
+	if (!written)
+	{
+		std::cout << "Can't write file: " << fileName << std::endl;
+		remove(fileName.c_str());
+		return false;
+	}
+	std::cout << "Wrote " << fileName << ": " << vessels << " vessels and " << network.tubeCount() << " tubes in " << tileCount
+		<< " tiles" << std::endl;
+	return true;
+}
+
+bool isTiledScene(const std::string& fileName)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	char magic[8];
+	bool tiled = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, tiledSceneMagic, sizeof(magic)) == 0;
+	fclose(file);
+	return tiled;
+}
+
+size_t SceneStreamer::TileData::bytes() const
+{
+	return (height.size() + tubeA.size()) * 5 * sizeof(float);
+}
+
+SceneStreamer::~SceneStreamer()
+{
+	close();
+}
+
+bool SceneStreamer::open(const std::string& name, size_t limit)
+{
+	close();
+	if (!file.open(name.c_str()))
+	{
+		return false;
+	}
+
+	std::string_view view = file.view();
+	TiledSceneHeader header;
+	bool valid = view.size() >= sizeof(header);
+	if (valid)
+	{
+		memcpy(&header, view.data(), sizeof(header));
+		valid = memcmp(header.magic, tiledSceneMagic, sizeof(header.magic)) == 0 && header.version == TILED_SCENE_VERSION &&
+			header.headerSize == sizeof(TiledSceneHeader) &&
+			view.size() >= sizeof(header) + (uint64_t)header.tileCount * sizeof(TiledSceneEntry) &&
+			header.pistonTile >= -1 && header.pistonTile < (int32_t)header.tileCount;
+	}
+	if (!valid)
+	{
+		std::cout << "Not a tiled scene (or one of another version): " << name << std::endl;
+		file.close();
+		return false;
+	}
+
+	tiles.resize(header.tileCount);
+	std::vector<float> minX(header.tileCount), minY(header.tileCount), maxX(header.tileCount), maxY(header.tileCount);
+	for (uint32_t i = 0; i < header.tileCount; i++)
+	{
+		TiledSceneEntry entry;
+		memcpy(&entry, view.data() + sizeof(header) + i * sizeof(TiledSceneEntry), sizeof(entry));
+		if (entry.offset + blockBytes(entry.vesselCount, entry.tubeCount) > view.size())
+		{
+			std::cout << "The tiled scene is cut short: " << name << std::endl;
+			tiles.clear();
+			file.close();
+			return false;
+		}
+		Tile& tile = tiles[i];
+		tile.minX = minX[i] = entry.minX;
+		tile.minY = minY[i] = entry.minY;
+		tile.maxX = maxX[i] = entry.maxX;
+		tile.maxY = maxY[i] = entry.maxY;
+		tile.vesselCount = (int)entry.vesselCount;
+		tile.tubeCount = (int)entry.tubeCount;
+		tile.offset = entry.offset;
+	}
+	if (header.pistonTile >= 0 && (header.pistonVessel < 0 || header.pistonVessel >= tiles[header.pistonTile].vesselCount))
+	{
+		std::cout << "The piston of the tiled scene isn't in its tile: " << name << std::endl;
+		tiles.clear();
+		file.close();
+		return false;
+	}
+	grid.build(minX.data(), minY.data(), maxX.data(), maxY.data(), (int)header.tileCount);
+
+	fileName = name;
+	cacheLimit = limit;
+	pistonTile = header.pistonTile;
+	pistonLocal = header.pistonVessel;
+	pistonVessel = Handle();
+	info = CheckpointInfo();
+	info.step = header.step;
+	info.pistonPressure = header.pistonPressure;
+	info.pistonVessel = -1;
+
+	// The piston has to be in the network before the first step, wherever the view is.
+	if (pistonTile >= 0)
+	{
+		tiles[pistonTile].state = TILE_READING;
+		requests.push_back(pistonTile);
+	}
+	stopping = false;
+	thread = std::thread(&SceneStreamer::run, this);
+
+	std::cout << "Streaming " << name << ": " << header.vesselCount << " vessels and " << header.tubeCount << " tubes in "
+		<< header.tileCount << " tiles" << std::endl;
+	return true;
+}
+
+void SceneStreamer::close()
+{
+	if (thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		thread.join();
+	}
+	file.close();
+	tiles.clear();
+	requests.clear();
+	arrived.clear();
+	lru.clear();
+	reading = 0;
+	pistonTile = -1;
+	cacheBytes = 0;
+	departures = false;
+}
+
+bool SceneStreamer::nearFocus(const Tile& tile, float margin) const
+{
+	float dx = (focusMaxX - focusMinX) * margin;
+	float dy = (focusMaxY - focusMinY) * margin;
+	return tile.maxX >= focusMinX - dx && tile.minX <= focusMaxX + dx && tile.maxY >= focusMinY - dy && tile.minY <= focusMaxY + dy;
+}
+
+void SceneStreamer::focus(float minX, float minY, float maxX, float maxY)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!isOpen() || (minX == focusMinX && minY == focusMinY && maxX == focusMaxX && maxY == focusMaxY))
+	{
+		return;
+	}
+	focusMinX = minX;
+	focusMinY = minY;
+	focusMaxX = maxX;
+	focusMaxY = maxY;
+
+	float dx = (maxX - minX) * STREAM_MARGIN;
+	float dy = (maxY - minY) * STREAM_MARGIN;
+	grid.query(minX - dx, minY - dy, maxX + dx, maxY + dy, found);
+	bool requested = false;
+	for (int t : found)
+	{
+		Tile& tile = tiles[t];
+		if (tile.state != TILE_OUT)
+		{
+			continue;
+		}
+		if (tile.inCache)
+		{
+			uncache(t);
+			tile.state = TILE_ARRIVED;
+			arrived.push_back(t);
+		}
+		else
+		{
+			tile.state = TILE_READING;
+			requests.push_back(t);
+			requested = true;
+		}
+	}
+
+	// A resident tile that is now far from the focus can leave at the next apply().
+	for (int t = 0; t < (int)tiles.size() && !departures; t++)
+	{
+		departures = tiles[t].state == TILE_RESIDENT && t != pistonTile && !nearFocus(tiles[t], 2.0f * STREAM_MARGIN);
+	}
+	if (requested)
+	{
+		changed.notify_all();
+	}
+}
+
+void SceneStreamer::waitForFocus()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return requests.empty() && reading == 0; });
+}
+
+bool SceneStreamer::changesPending()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !arrived.empty() || departures;
+}
+
+int SceneStreamer::residentTiles()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int count = 0;
+	for (const Tile& tile : tiles)
+	{
+		count += tile.state == TILE_RESIDENT;
+	}
+	return count;
+}
+
+size_t SceneStreamer::cachedBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return cacheBytes;
+}
+
+void SceneStreamer::read(int t, TileData& data) const
+{
+	const Tile& tile = tiles[t];
+	const char* at = file.view().data() + tile.offset;
+	std::vector<float>* vesselArrays[5] = { &data.height, &data.width, &data.externalPressure, &data.left, &data.bottom };
+	for (std::vector<float>* values : vesselArrays)
+	{
+		values->resize(tile.vesselCount);
+		memcpy(values->data(), at, sizeof(float) * tile.vesselCount);
+		at += sizeof(float) * tile.vesselCount;
+	}
+	std::vector<int>* ends[2] = { &data.tubeA, &data.tubeB };
+	for (std::vector<int>* end : ends)
+	{
+		end->resize(tile.tubeCount);
+		memcpy(end->data(), at, sizeof(int) * tile.tubeCount);
+		at += sizeof(int) * tile.tubeCount;
+	}
+	std::vector<float>* tubeArrays[3] = { &data.tubeInvInertance, &data.tubeDamping, &data.tubeFlow };
+	for (std::vector<float>* values : tubeArrays)
+	{
+		values->resize(tile.tubeCount);
+		memcpy(values->data(), at, sizeof(float) * tile.tubeCount);
+		at += sizeof(float) * tile.tubeCount;
+	}
+
+	// A broken file must not connect vessels outside of the tile, so a tile with a tube like that gets no tubes at all.
+	for (int k = 0; k < tile.tubeCount; k++)
+	{
+		if (data.tubeA[k] < 0 || data.tubeA[k] >= tile.vesselCount || data.tubeB[k] < 0 || data.tubeB[k] >= tile.vesselCount)
+		{
+			std::cout << "Tile " << t << " of " << fileName << " is broken, leaving out its tubes." << std::endl;
+			std::vector<int>().swap(data.tubeA);
+			std::vector<int>().swap(data.tubeB);
+			std::vector<float>().swap(data.tubeInvInertance);
+			std::vector<float>().swap(data.tubeDamping);
+			std::vector<float>().swap(data.tubeFlow);
+			return;
+		}
+	}
+}
+
+void SceneStreamer::run()
+{
+	applyThreadRole(THREAD_ROLE_IO);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		changed.wait(lock, [this] { return stopping || !requests.empty(); });
+		if (stopping)
+		{
+			return;
+		}
+
+		// The pages of the mapping are read from the disk by this copy, so nothing else ever waits for them.
+		int t = requests.back();
+		requests.pop_back();
+		reading++;
+		lock.unlock();
+		std::unique_ptr<TileData> data(new TileData());
+		read(t, *data);
+		lock.lock();
+
+		tiles[t].data = std::move(data);
+		tiles[t].state = TILE_ARRIVED;
+		arrived.push_back(t);
+		reading--;
+		changed.notify_all();
+		if (onTileRead != nullptr)
+		{
+			lock.unlock();
+			onTileRead();
+			lock.lock();
+		}
+	}
+}
+
+void SceneStreamer::cache(int t)
+{
+	Tile& tile = tiles[t];
+	tile.state = TILE_OUT;
+	tile.vessels.clear();
+	tile.tubes.clear();
+	lru.push_front(t);
+	tile.cached = lru.begin();
+	tile.inCache = true;
+	cacheBytes += tile.data->bytes();
+}
+
+void SceneStreamer::uncache(int t)
+{
+	Tile& tile = tiles[t];
+	lru.erase(tile.cached);
+	tile.inCache = false;
+	cacheBytes -= tile.data->bytes();
+}
+
+void SceneStreamer::trimCache()
+{
+	// From the least recently used end. Tiles whose state changed can't be read again, so they stay.
+	std::list<int>::iterator it = lru.end();
+	while (cacheBytes > cacheLimit && it != lru.begin())
+	{
+		--it;
+		Tile& tile = tiles[*it];
+		if (!tile.data->dirty)
+		{
+			int t = *it;
+			it = std::next(it);
+			uncache(t);
+			tiles[t].data.reset();
+		}
+	}
+}
+
+bool SceneStreamer::apply(VesselNetwork& network)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	bool networkChanged = false;
+
+	// A tile can only leave while its components are asleep, which is only known while the topology is up to date. One that is still
+	// moving stays until the focus moves again.
+	if (departures)
+	{
+		departures = false;
+		std::vector<int> vessels;
+		for (int t = 0; t < (int)tiles.size(); t++)
+		{
+			Tile& tile = tiles[t];
+			if (tile.state != TILE_RESIDENT || t == pistonTile || nearFocus(tile, 2.0f * STREAM_MARGIN) || network.topologyDirty)
+			{
+				continue;
+			}
+			bool asleep = true;
+			for (int i = 0; i < tile.vesselCount && asleep; i++)
+			{
+				asleep = !network.componentAwake[network.componentOf[network.vesselIndex(tile.vessels[i])]];
+			}
+			if (!asleep)
+			{
+				continue;
+			}
+
+			TileData& data = *tile.data;
+			for (int i = 0; i < tile.vesselCount; i++)
+			{
+				int index = network.vesselIndex(tile.vessels[i]);
+				data.dirty |= data.height[i] != network.height[index] || data.externalPressure[i] != network.externalPressure[index];
+				data.height[i] = network.height[index];
+				data.externalPressure[i] = network.externalPressure[index];
+				vessels.push_back(index);
+			}
+			for (int k = 0; k < (int)tile.tubes.size(); k++)
+			{
+				float flow = network.tubeFlow[network.tubeIndex(tile.tubes[k])];
+				data.dirty |= data.tubeFlow[k] != flow;
+				data.tubeFlow[k] = flow;
+			}
+			cache(t);
+		}
+		if (!vessels.empty())
+		{
+			network.removeVessels(vessels);
+			networkChanged = true;
+		}
+	}
+
+	for (int t : arrived)
+	{
+		Tile& tile = tiles[t];
+		if (t != pistonTile && !nearFocus(tile, 2.0f * STREAM_MARGIN))
+		{
+			// The focus moved on while it was read.
+			cache(t);
+			continue;
+		}
+
+		const TileData& data = *tile.data;
+		int first = network.vesselCount();
+		for (int i = 0; i < tile.vesselCount; i++)
+		{
+			int index = network.addVessel(data.left[i], data.bottom[i], data.width[i], data.height[i]);
+			network.externalPressure[index] = data.externalPressure[i];
+			tile.vessels.push_back(network.vesselHandle(index));
+		}
+		for (int k = 0; k < (int)data.tubeA.size(); k++)
+		{
+			int index = network.addTube(first + data.tubeA[k], first + data.tubeB[k], 1.0f / data.tubeInvInertance[k], data.tubeDamping[k]);
+			network.tubeInvInertance[index] = data.tubeInvInertance[k];
+			network.tubeFlow[index] = data.tubeFlow[k];
+			tile.tubes.push_back(network.tubeHandle(index));
+		}
+		if (t == pistonTile)
+		{
+			pistonVessel = tile.vessels[pistonLocal];
+		}
+		tile.state = TILE_RESIDENT;
+		networkChanged = true;
+	}
+	arrived.clear();
+
+	trimCache();
+	return networkChanged;
+}
@@ -0,0 +1,200 @@
+/*
+Title: HydroDynamics
+File Name: TiledScene.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Scenes too large to load at once are compiled into tiles (--compile-scene with --scene-tiles),
+and streamed in around the view while the simulation runs.
+
+The plane is cut into square tiles, and every component of the network (the vessels joined by
+tubes, directly or through others) goes into the tile its first vessel stands in, whole. So
+no tube ever runs from one tile into another, and a tile can be added to the network or taken
+out of it without touching anything else. The file is a header, the index of every tile
+(its bounds, its counts and where it starts) and then the tiles, each one block holding the
+arrays of its vessels and tubes, with the tubes numbering the vessels of the tile only.
+
+SceneStreamer only reads the header and the index when it opens a file, so opening takes the
+same time whatever the size of the scene. focus() tells it which part of the plane is wanted;
+the tiles it overlaps are read on a background thread, and apply() adds those that arrived
+to the network and takes out the ones that are no longer near the focus. apply() changes the
+network, so nothing may step it meanwhile. A tile only leaves once every component in it is
+asleep, so the parts of the network that are still moving keep moving, and the tile of the
+piston never leaves. A tile that left goes into a least recently used cache bounded in bytes,
+so coming back to it costs no read. A tile whose state changed while it was in the network
+has no copy on disk anymore, so it stays in the cache whatever the bound.
+
+Layered networks can't be tiled. This file has no OpenGL dependency.
+*/
+
+#ifndef _TILED_SCENE_H
+#define _TILED_SCENE_H
+
+#include "Checkpoint.h"
+#include "MappedFile.h"
+#include "SpatialGrid.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+
+// Bump the version whenever the layout changes. Files with another version are refused.
+#define TILED_SCENE_VERSION 1
+
+// How many bytes of tiles that left the network are kept in memory by default.
+#define STREAM_CACHE_BYTES (64 * 1048576)
+
+// Tiles are loaded once they are within this much of the size of the focus around it, and only leave once they are more than
+// twice that far out, so moving back and forth across the edge of a tile doesn't load and drop it every time.
+#define STREAM_MARGIN 0.5f
+
+// Writes network cut into tiles of tileSize x tileSize. Returns false (after printing an error) if it is layered or the file
+// can't be written.
+bool writeTiledScene(const std::string& fileName, const VesselNetwork& network, const CheckpointInfo& info, float tileSize);
+
+// Whether fileName starts like a tiled scene.
+bool isTiledScene(const std::string& fileName);
+
+class SceneStreamer
+{
+public:
+	SceneStreamer() {}
+
+	// Waits for the tile that is being read, if there is one.
+	~SceneStreamer();
+
+	SceneStreamer(const SceneStreamer&) = delete;
+	SceneStreamer& operator=(const SceneStreamer&) = delete;
+
+	// Reads the index of a tiled scene and starts reading the tile with the piston. Returns false (after printing what is wrong)
+	// if the file can't be read or isn't a tiled scene.
+	bool open(const std::string& fileName, size_t cacheBytes = STREAM_CACHE_BYTES);
+
+	// Stops reading and forgets every tile. The vessels and tubes that are in the network stay there.
+	void close();
+
+	bool isOpen() const { return file.isOpen(); }
+
+	// Sets the part of the plane that is wanted and starts reading the tiles near it. Can be called from any thread.
+	void focus(float minX, float minY, float maxX, float maxY);
+
+	// Waits until every tile asked for by focus() has been read.
+	void waitForFocus();
+
+	// Whether apply() has anything to do: tiles arrived, or the focus moved away from tiles in the network.
+	bool changesPending();
+
+	// Adds the tiles that arrived to network and takes out the tiles that are far from the focus and at rest. Returns true if the
+	// network changed, which moves vessels and tubes to other indices and leaves the topology to be rebuilt.
+	bool apply(VesselNetwork& network);
+
+	// The vessel the piston sits on, once apply() added its tile, and what else the scene stores about its start.
+	Handle pistonHandle() const { return pistonVessel; }
+	const CheckpointInfo& sceneInfo() const { return info; }
+
+	// Called on the reading thread whenever a tile was read, for waking up whoever calls apply().
+	void (*onTileRead)() = nullptr;
+
+	int tileCount() const { return (int)tiles.size(); }
+	int residentTiles();
+	size_t cachedBytes();
+
+private:
+	// The arrays of one tile, as they are in the file. The tubes number the vessels from 0 within the tile.
+	struct TileData
+	{
+		std::vector<float> height;
+		std::vector<float> width;
+		std::vector<float> externalPressure;
+		std::vector<float> left;
+		std::vector<float> bottom;
+		std::vector<int> tubeA;
+		std::vector<int> tubeB;
+		std::vector<float> tubeInvInertance;
+		std::vector<float> tubeDamping;
+		std::vector<float> tubeFlow;
+		bool dirty = false;		// The state differs from the file
+
+		size_t bytes() const;
+	};
+
+	enum TileState
+	{
+		TILE_OUT = 0,	// On disk, or in the cache if data is set
+		TILE_READING,	// Queued for the reading thread, or being read
+		TILE_ARRIVED,	// Read, waiting for apply()
+		TILE_RESIDENT	// In the network
+	};
+
+	struct Tile
+	{
+		float minX;
+		float minY;
+		float maxX;
+		float maxY;
+		int vesselCount;
+		int tubeCount;
+		uint64_t offset;	// Where its block starts, from the start of the file
+		TileState state = TILE_OUT;
+		std::unique_ptr<TileData> data;		// Set while it is arrived, resident or cached
+		std::vector<Handle> vessels;		// While it is resident
+		std::vector<Handle> tubes;
+		std::list<int>::iterator cached;	// Its place in lru, while it is cached
+		bool inCache = false;
+	};
+
+	void run();
+	void read(int tile, TileData& data) const;
+	bool nearFocus(const Tile& tile, float margin) const;
+	void cache(int tile);
+	void uncache(int tile);
+	void trimCache();
+
+	MappedFile file;
+	std::string fileName;
+	std::vector<Tile> tiles;
+	SpatialGrid grid;
+	std::vector<int> found;
+	int pistonTile = -1;
+	int pistonLocal = 0;
+	Handle pistonVessel;
+	CheckpointInfo info;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping = false;
+	std::vector<int> requests;		// Tiles for the reading thread, the next one at the back
+	int reading = 0;				// Tiles taken from requests that aren't read yet
+	std::vector<int> arrived;
+	bool departures = false;		// The focus moved away from a resident tile since the last apply()
+	float focusMinX = 0.0f;
+	float focusMinY = 0.0f;
+	float focusMaxX = 0.0f;
+	float focusMaxY = 0.0f;
+
+	// The tiles in the cache, the most recently used at the front.
+	std::list<int> lru;
+	size_t cacheBytes = 0;
+	size_t cacheLimit = STREAM_CACHE_BYTES;
+};
+
+#endif // _TILED_SCENE_H
@@ -0,0 +1,155 @@
+/*
+Title: HydroDynamics
+File Name: TraceRecorder.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Records timed spans and counter values into a ring buffer and writes them out in the
+JSON trace event format, which can be opened in chrome://tracing or ui.perfetto.dev.
+
+Recording an event is one atomic increment to claim a slot and a few stores to fill it,
+with no locks, so any thread can record at any time without slowing the others down.
+When the ring is full the oldest events are overwritten, so a long run always keeps
+the most recent TRACE_CAPACITY events.
+
+Every PROFILE_SCOPE() also records a span while tracing is enabled.
+*/
+
+#include "TraceRecorder.h"
+#include <chrono>
+#include <cstdio>
+
+// The ring is allocated when tracing is enabled, so runs without tracing don't pay for the memory.
+static TraceEvent* ring = nullptr;
+static std::atomic<unsigned long long> writeIndex(0);
+static std::atomic<bool> enabled(false);
+static std::chrono::steady_clock::time_point origin;
+
+// Small thread numbers are easier to read in the trace viewer than real thread ids.
+static std::atomic<unsigned int> nextThread(0);
+static thread_local unsigned int threadNumber = nextThread.fetch_add(1);
+
+void traceEnable()
+{
+	if (ring == nullptr)
+	{
+		ring = new TraceEvent[TRACE_CAPACITY];
+		for (int i = 0; i < TRACE_CAPACITY; i++)
+		{
+			ring[i].sequence.store(0);
+		}
+	}
+	origin = std::chrono::steady_clock::now();
+	enabled.store(true);
+}
+
+bool traceEnabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+unsigned long long traceNow()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// Claims the next slot of the ring and fills it in. The sequence is cleared while the slot is being written and set
+// afterwards, so traceWrite() can tell finished events apart from ones that are still being written.
+static void record(const char* name, char phase, unsigned long long start, unsigned long long duration, double value)
+{
+	unsigned long long index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+	TraceEvent& event = ring[index & (TRACE_CAPACITY - 1)];
+
+	event.sequence.store(0, std::memory_order_relaxed);
+	event.name = name;
+	event.phase = phase;
+	event.thread = threadNumber;
+	event.start = start;
+	event.duration = duration;
+	event.value = value;
+	event.sequence.store(index + 1, std::memory_order_release);
+}
+
+void traceSpan(const char* name, unsigned long long start, unsigned long long duration)
+{
+	if (!traceEnabled())
+	{
+		return;
+	}
+	record(name, 'X', start, duration, 0.0);
+}
+
+void traceCounter(const char* name, double value)
+{
+	if (!traceEnabled())
+	{
+		return;
+	}
+	record(name, 'C', traceNow(), 0, value);
+}
+
+bool traceWrite(const std::string& fileName)
+{
+	if (ring == nullptr)
+	{
+		return false;
+	}
+
+	FILE* file = fopen(fileName.c_str(), "w");
+	if (file == nullptr)
+	{
+		printf("Can't write file: %s\n", fileName.c_str());
+		return false;
+	}
+
+	// Only the last TRACE_CAPACITY events are still in the ring.
+	unsigned long long end = writeIndex.load(std::memory_order_acquire);
+	unsigned long long begin = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (unsigned long long i = begin; i < end; i++)
+	{
+		const TraceEvent& event = ring[i & (TRACE_CAPACITY - 1)];
+
+		// Skip slots that are being written right now, or that were already overwritten by a newer event.
+		if (event.sequence.load(std::memory_order_acquire) != i + 1)
+		{
+			continue;
+		}
+
+		// The trace format uses microseconds.
+		if (event.phase == 'X')
+		{
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				first ? "" : ",\n", event.name, event.thread, event.start / 1000.0, event.duration / 1000.0);
+		}
+		else
+		{
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+				first ? "" : ",\n", event.name, event.thread, event.start / 1000.0, event.value);
+		}
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+Title: HydroDynamics
+File Name: TraceRecorder.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Records timed spans and counter values into a ring buffer and writes them out in the
+JSON trace event format, which can be opened in chrome://tracing or ui.perfetto.dev.
+
+Recording an event is one atomic increment to claim a slot and a few stores to fill it,
+with no locks, so any thread can record at any time without slowing the others down.
+When the ring is full the oldest events are overwritten, so a long run always keeps
+the most recent TRACE_CAPACITY events.
+
+Every PROFILE_SCOPE() also records a span while tracing is enabled.
+*/
+
+#ifndef _TRACE_RECORDER_H
+#define _TRACE_RECORDER_H
+
+#include <atomic>
+#include <string>
+
+// Number of events kept in the ring. Must be a power of two.
+#define TRACE_CAPACITY (1 << 18)
+
+struct TraceEvent
+{
+	const char* name;					// Must point to a string that lives forever (a literal)
+	char phase;							// 'X' for a span, 'C' for a counter
+	unsigned int thread;
+	unsigned long long start;			// Nanoseconds since tracing was enabled
+	unsigned long long duration;
+	double value;						// Counter value
+	std::atomic<unsigned long long> sequence;	// 1 + the index the event was written at, 0 while it is being written
+};
+
+// Starts recording. Events recorded while tracing is disabled are dropped right away.
+void traceEnable();
+bool traceEnabled();
+
+// Nanoseconds since tracing was enabled.
+unsigned long long traceNow();
+
+// Records a span that started at start and lasted duration nanoseconds.
+void traceSpan(const char* name, unsigned long long start, unsigned long long duration);
+
+// Records the value of a counter at the current time.
+void traceCounter(const char* name, double value);
+
+// Writes every event still in the ring to a file. Returns false if the file couldn't be written.
+bool traceWrite(const std::string& fileName);
+
+#endif // _TRACE_RECORDER_H
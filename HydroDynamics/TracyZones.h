@@ -0,0 +1,62 @@
+/*
+Title: HydroDynamics
+File Name: TracyZones.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Optional instrumentation for the Tracy profiler (https://github.com/wolfpld/tracy), so a
+developer can attach Tracy's viewer to a running build and see the CPU zones of every thread
+next to the GPU passes on one timeline. It is compiled in with HYDRO_TRACY defined, which
+also needs Tracy's public directory on the include path and its TracyClient.cpp in the
+build. Without HYDRO_TRACY every macro here is empty and Tracy isn't needed at all.
+
+TRACY_ZONE(name) times the block it is declared in, and takes a string literal. The GPU
+passes timed by GpuTimer.h become GPU zones of the same name by themselves (GpuTimer.cpp is
+the only file that needs TracyOpenGL.hpp), and
+applyThreadRole() names every thread after its role. This works next to the trace export
+of TraceRecorder.h; the two don't know about each other.
+*/
+
+#ifndef _TRACY_ZONES_H
+#define _TRACY_ZONES_H
+
+#ifdef HYDRO_TRACY
+
+#ifndef TRACY_ENABLE
+#define TRACY_ENABLE
+#endif
+
+#include <tracy/Tracy.hpp>
+
+#define TRACY_ZONE(name) ZoneScopedN(name)
+#define TRACY_FRAME() FrameMark
+#define TRACY_THREAD_NAME(name) tracy::SetThreadName(name)
+
+#else
+
+#define TRACY_ZONE(name)
+#define TRACY_FRAME()
+#define TRACY_THREAD_NAME(name)
+
+#endif // HYDRO_TRACY
+
+#endif // _TRACY_ZONES_H
@@ -0,0 +1,80 @@
+/*
+Title: HydroDynamics
+File Name: TripleBuffer.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Hands the newest version of some state from one writer thread to one reader thread
+without either of them ever waiting.
+
+There are three copies of the state. The writer fills the back copy and publishes it by
+swapping it with the middle one. The reader takes the middle copy by swapping it with the
+front one, but only if something was published since the last time. Every swap is a single
+atomic exchange, so the writer can publish as often as it likes and the reader always gets
+the newest complete copy. Versions the reader never got around to are simply skipped, and
+neither side ever sees a copy the other one is still using.
+*/
+
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	// Writer only. The copy to fill in; it still holds whatever was written into it three publishes ago.
+	T& writeBuffer() { return slots[back]; }
+
+	// Writer only. Makes the copy from writeBuffer() the newest version.
+	void publish()
+	{
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Reader only. Moves on to the newest version if one was published since the last call, and returns whether there was one.
+	bool acquire()
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+		{
+			return false;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// Reader only. The version taken by the last successful acquire().
+	const T& readBuffer() const { return slots[front]; }
+
+private:
+	// The middle index also carries a flag that says whether it holds a version the reader hasn't taken yet.
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	T slots[3];
+	alignas(64) std::atomic<int> middle{ 1 };
+	alignas(64) int back = 0;	// Only touched by the writer
+	alignas(64) int front = 2;	// Only touched by the reader
+};
+
+#endif // _TRIPLE_BUFFER_H
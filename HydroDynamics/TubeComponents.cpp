@@ -0,0 +1,142 @@
+/*
+Title: HydroDynamics
+File Name: TubeComponents.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Components that sit on tubes: valves, check valves and pumps, and the queue of changes to
+them that a scene can schedule.
+
+A valve lets through a fraction of what the tube would carry on its own: it scales the
+inverse inertance of the tube by its opening, which scales the flow the tube settles at by
+the same amount, and a closed valve (opening 0) stops the tube at once. A check valve only
+lets fluid flow from B to A: the step drops any flow the other way after the tubes moved.
+A running pump moves a fixed flow from B to A, whatever the pressures: the tube loses its
+inertance and damping, so its flow carries over from step to step unchanged, and the step
+gives it its flow again before the tubes move, in case a drain limit cut it. A pump that
+stops gets its tube back as it was.
+
+Changes are queued for the start of a step. The queue is a binary heap ordered by step,
+and changes for the same step keep the order they were queued in, so a run always does
+them in the same order. Starting a step only compares the step with the top of the heap,
+however many components there are, and a change costs O(log n) in the number of changes
+queued. Nothing polls the components.
+
+This file has no OpenGL dependency.
+*/
+
+#include "TubeComponents.h"
+#include <algorithm>
+
+// std::push_heap keeps the largest element at the front, so the earliest event has to compare as the largest.
+static bool later(const TubeEvent& a, const TubeEvent& b)
+{
+	return a.step != b.step ? a.step > b.step : a.order > b.order;
+}
+
+void TubeSchedule::push(TubeEvent event)
+{
+	event.order = queued++;
+	events.push_back(event);
+	std::push_heap(events.begin(), events.end(), later);
+}
+
+TubeEvent TubeSchedule::pop()
+{
+	std::pop_heap(events.begin(), events.end(), later);
+	TubeEvent event = events.back();
+	events.pop_back();
+	return event;
+}
+
+void TubeSchedule::sorted(std::vector<TubeEvent>& result) const
+{
+	result = events;
+	std::sort(result.begin(), result.end(), [](const TubeEvent& a, const TubeEvent& b) { return later(b, a); });
+}
+
+void TubeSchedule::removeTube(int tube, int last)
+{
+	events.erase(std::remove_if(events.begin(), events.end(), [&](const TubeEvent& event) { return event.tube == tube; }), events.end());
+	for (TubeEvent& event : events)
+	{
+		event.tube = event.tube == last ? tube : event.tube;
+	}
+	std::make_heap(events.begin(), events.end(), later);
+}
+
+void TubeSchedule::renumber(const std::vector<int>& newIndex)
+{
+	for (TubeEvent& event : events)
+	{
+		event.tube = newIndex[event.tube];
+	}
+}
+
+void TubeSchedule::clear()
+{
+	events.clear();
+	queued = 0;
+}
+
+bool parseTubeComponent(const std::string& name, TubeComponent& component)
+{
+	if (name == "valve")
+	{
+		component = COMPONENT_VALVE;
+	}
+	else if (name == "checkvalve")
+	{
+		component = COMPONENT_CHECK_VALVE;
+	}
+	else if (name == "pump")
+	{
+		component = COMPONENT_PUMP;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool parseTubeAction(const std::string& name, TubeAction& action, bool& closes)
+{
+	closes = name == "close";
+	if (name == "open" || name == "close")
+	{
+		action = ACTION_OPEN;
+	}
+	else if (name == "start")
+	{
+		action = ACTION_START;
+	}
+	else if (name == "stop")
+	{
+		action = ACTION_STOP;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
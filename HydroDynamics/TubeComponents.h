@@ -0,0 +1,111 @@
+/*
+Title: HydroDynamics
+File Name: TubeComponents.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Components that sit on tubes: valves, check valves and pumps, and the queue of changes to
+them that a scene can schedule.
+
+A valve lets through a fraction of what the tube would carry on its own: it scales the
+inverse inertance of the tube by its opening, which scales the flow the tube settles at by
+the same amount, and a closed valve (opening 0) stops the tube at once. A check valve only
+lets fluid flow from B to A: the step drops any flow the other way after the tubes moved.
+A running pump moves a fixed flow from B to A, whatever the pressures: the tube loses its
+inertance and damping, so its flow carries over from step to step unchanged, and the step
+gives it its flow again before the tubes move, in case a drain limit cut it. A pump that
+stops gets its tube back as it was.
+
+Changes are queued for the start of a step. The queue is a binary heap ordered by step,
+and changes for the same step keep the order they were queued in, so a run always does
+them in the same order. Starting a step only compares the step with the top of the heap,
+however many components there are, and a change costs O(log n) in the number of changes
+queued. Nothing polls the components.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _TUBE_COMPONENTS_H
+#define _TUBE_COMPONENTS_H
+
+#include <string>
+#include <vector>
+
+enum TubeComponent
+{
+	COMPONENT_NONE = 0,		// A plain tube
+	COMPONENT_VALVE,		// Lets through the fraction of the flow its opening says, from 0 (closed) to 1 (open)
+	COMPONENT_CHECK_VALVE,	// Only lets fluid through from B to A
+	COMPONENT_PUMP			// While running, moves a fixed flow from B to A (negative from A to B)
+};
+
+enum TubeAction
+{
+	ACTION_OPEN = 0,		// A valve opens (or closes) to the value, from 0 to 1
+	ACTION_START,			// A pump starts (or changes) to the flow of the value
+	ACTION_STOP				// A pump stops, and its tube is a plain one again
+};
+
+struct TubeEvent
+{
+	long long step;			// The step it happens at the start of
+	long long order;		// The number of events queued before it, which breaks ties between events of the same step
+	int tube;
+	TubeAction action;
+	float value;
+};
+
+class TubeSchedule
+{
+public:
+	// Queues an event. Its order is filled in.
+	void push(TubeEvent event);
+
+	// Whether the earliest event happens at step or before it.
+	bool due(long long step) const { return !events.empty() && events.front().step <= step; }
+
+	// Takes out the earliest event. There has to be one.
+	TubeEvent pop();
+
+	// The events in the order they will happen.
+	void sorted(std::vector<TubeEvent>& result) const;
+
+	// Drops the events of a tube that was removed, and gives the events of last, which took its place, its index.
+	void removeTube(int tube, int last);
+
+	// Moves every event from tube t to tube newIndex[t].
+	void renumber(const std::vector<int>& newIndex);
+
+	int size() const { return (int)events.size(); }
+	void clear();
+
+	// A binary heap with the earliest event at the front.
+	std::vector<TubeEvent> events;
+	long long queued = 0;
+};
+
+// Finds a component by its scene name (valve, checkvalve or pump), and an action by its name (open, close, start or stop; close is
+// an open to 0). Return false if there is none with that name.
+bool parseTubeComponent(const std::string& name, TubeComponent& component);
+bool parseTubeAction(const std::string& name, TubeAction& action, bool& closes);
+
+#endif // _TUBE_COMPONENTS_H
@@ -0,0 +1,2386 @@
+/*
+Title: HydroDynamics
+File Name: VesselNetwork.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A network of communicating vessels. Any number of rectangular vessels can be connected
+by tubes at their bottoms, and the fluid levels of connected vessels move towards the
+height where the pressure at the bottom of every tube is the same on both ends.
+
+Every tube carries a flow of fluid that is driven by the difference in pressure between its
+two ends and slowed down by viscous friction along the tube. The fluid in the tube has
+mass, so the levels overshoot and oscillate around the equilibrium, with every swing a
+little smaller than the one before, just like a real U-tube. The flow is integrated
+implicitly with the real time step, so the motion is the same at any step size, and even
+very large steps stay stable.
+
+The data is stored as a structure of arrays: instead of one struct per vessel, every
+attribute (height, width, pressure, ...) has its own contiguous array, indexed by the
+vessel number. The update loop only touches the arrays it actually needs, so it streams
+through memory and the compiler is free to vectorize it.
+
+INTEGRATOR_ADAPTIVE doesn't move volumes through tubes with limits at all. It treats the
+heights and flows as one system of ODEs, dh/dt from the flows into every vessel and dq/dt
+from the pressure difference and the friction of every tube, and integrates it with the
+Bogacki-Shampine pair: a third order step, and a second order one from the same stages
+whose difference is the error estimate. Substeps with too much error are tried again
+shorter, and the next substep grows or shrinks with the error of the last.
+
+INTEGRATOR_SYMPLECTIC is leapfrog instead: half a step of pressure on the flows, a whole
+step of the flows on the heights, and another half step of the new pressures on the flows.
+Leapfrog is symplectic, so an undamped network swings with the same energy after millions
+of steps (give or take what a step of that size always misses) instead of losing or gaining
+a little every step. The damping is an exact decay of the flows on both sides of it.
+
+With multirate, components whose vessels are narrow (which makes them swing fast) take
+several substeps of the local step per step, while wide and slow ones take a single one.
+The components are independent of each other, so all the substeps of one rate run over
+the pieces of its components in one go.
+
+A profiled vessel (see VesselProfile.h) is first moved like a rectangle by the apply phase,
+and then moved again by the same volume through its profile, by a kernel that only runs
+over the profiled vessels of the piece.
+
+The volumes the tubes moved are normally gathered by every vessel from its own tubes. With
+SCATTER_COLORED they are scattered by the tubes instead, one color of tubes at a time: no two
+tubes of a color share a vessel, so the tubes of a color can run on any number of threads at
+once without atomics or locks.
+
+This file has no OpenGL dependency, so the simulation can run without a window.
+*/
+
+#include "VesselNetwork.h"
+#include "SimdKernels.h"
+#include "TaskPool.h"
+#include "MemoryPlacement.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+
+int VesselNetwork::addVessel(float x, float y, float vesselWidth, float fluidHeight)
+{
+	height.push_back(fluidHeight);
+	width.push_back(vesselWidth);
+	pressure.push_back(0.0f);
+	externalPressure.push_back(0.0f);
+
+	left.push_back(x);
+	right.push_back(x + vesselWidth);
+	bottom.push_back(y);
+	top.push_back(y + fluidHeight);
+
+	degree.push_back(0);
+	delta.push_back(0.0f);
+
+	// In a layered network the new fluid goes into the first fluid.
+	for (int f = 0; f < fluidCount(); f++)
+	{
+		layerHeight[f].push_back(f == 0 ? fluidHeight : 0.0f);
+	}
+	if (profiled())
+	{
+		vesselProfile.push_back(-1);
+	}
+
+	vesselHandles.resize(vesselCount() - 1);
+	vesselHandles.add();
+	return vesselCount() - 1;
+}
+
+int VesselNetwork::addFluid(float density)
+{
+	for (int f = 0; f < fluidCount(); f++)
+	{
+		if (fluidDensity[f] == density)
+		{
+			return f;
+		}
+	}
+
+	fluidDensity.push_back(density);
+	layerHeight.push_back(fluidCount() == 1 ? height : std::vector<float>(vesselCount(), 0.0f));
+	topologyDirty = true;
+	return fluidCount() - 1;
+}
+
+void VesselNetwork::setLayer(int vessel, int fluid, float layer, float gravity)
+{
+	layerHeight[fluid][vessel] = layer;
+
+	float sum = 0.0f;
+	for (int f = 0; f < fluidCount(); f++)
+	{
+		sum += layerHeight[f][vessel];
+	}
+	height[vessel] = sum;
+	top[vessel] = bottom[vessel] + sum;
+	computePressures(0.0f, gravity);
+	wakeAll();
+}
+
+void VesselNetwork::setProfile(int vessel, int profile)
+{
+	if (!profiled())
+	{
+		vesselProfile.assign(vesselCount(), -1);
+	}
+	double volume = vesselVolume(vessel);
+	vesselProfile[vessel] = profile;
+	height[vessel] = profile >= 0 ? profiles.height(profile, (float)volume) : (float)(volume / width[vessel]);
+	top[vessel] = bottom[vessel] + height[vessel];
+	topologyDirty = true;
+	wakeAll();
+}
+
+double VesselNetwork::vesselVolume(int vessel) const
+{
+	int profile = profiled() ? vesselProfile[vessel] : -1;
+	return profile >= 0 ? (double)profiles.volume(profile, height[vessel]) : (double)height[vessel] * width[vessel];
+}
+
+// Sets a component to what an action asks for, and keeps runningPumps up to date. The action has to fit the component.
+static void applyTubeAction(VesselNetwork& network, int t, TubeAction action, float value)
+{
+	if (network.tubeComponent[t] == COMPONENT_VALVE)
+	{
+		network.tubeSetting[t] = value;
+		network.tubeInvInertance[t] = network.tubeBaseInvInertance[t] * value;
+		network.tubeFlow[t] = value > 0.0f ? network.tubeFlow[t] : 0.0f;
+	}
+	else if (network.tubeComponent[t] == COMPONENT_PUMP)
+	{
+		float flow = action == ACTION_START ? value : 0.0f;
+		bool running = flow != 0.0f;
+		network.tubeSetting[t] = flow;
+		network.tubeInvInertance[t] = running ? 0.0f : network.tubeBaseInvInertance[t];
+		network.tubeDamping[t] = running ? 0.0f : network.tubeBaseDamping[t];
+		network.tubeFlow[t] = running ? flow : network.tubeFlow[t];
+
+		std::vector<int>& pumps = network.runningPumps;
+		std::vector<int>::iterator position = std::lower_bound(pumps.begin(), pumps.end(), t);
+		bool listed = position != pumps.end() && *position == t;
+		if (running && !listed)
+		{
+			pumps.insert(position, t);
+		}
+		else if (!running && listed)
+		{
+			pumps.erase(position);
+		}
+	}
+
+	// The tube moves differently now, and the multirate substeps and the solver's matrix depend on how fast it can.
+	network.rateVersion = -1;
+	network.tubeVersion++;
+	network.wake(network.tubeA[t]);
+}
+
+void VesselNetwork::setComponent(int tube, TubeComponent component, float setting)
+{
+	if (!hasComponents())
+	{
+		tubeComponent.assign(tubeCount(), COMPONENT_NONE);
+		tubeSetting.assign(tubeCount(), 0.0f);
+		tubeBaseInvInertance = tubeInvInertance;
+		tubeBaseDamping = tubeDamping;
+	}
+
+	// Back to the plain tube first, then on with the new component.
+	if (tubeComponent[tube] == COMPONENT_PUMP)
+	{
+		applyTubeAction(*this, tube, ACTION_STOP, 0.0f);
+	}
+	tubeInvInertance[tube] = tubeBaseInvInertance[tube];
+	tubeDamping[tube] = tubeBaseDamping[tube];
+	tubeSetting[tube] = 0.0f;
+	tubeComponent[tube] = component;
+	if (component == COMPONENT_VALVE || component == COMPONENT_PUMP)
+	{
+		applyTubeAction(*this, tube, component == COMPONENT_VALVE ? ACTION_OPEN : ACTION_START, setting);
+	}
+	topologyDirty = true;
+}
+
+bool VesselNetwork::scheduleTube(long long step, int tube, TubeAction action, float value)
+{
+	TubeComponent component = hasComponents() ? (TubeComponent)tubeComponent[tube] : COMPONENT_NONE;
+	bool fits = action == ACTION_OPEN ? component == COMPONENT_VALVE && value >= 0.0f && value <= 1.0f : component == COMPONENT_PUMP;
+	if (fits)
+	{
+		schedule.push({ step, 0, tube, action, value });
+	}
+	return fits;
+}
+
+int VesselNetwork::runSchedule(long long step)
+{
+	int applied = 0;
+	while (schedule.due(step))
+	{
+		TubeEvent event = schedule.pop();
+		applyTubeAction(*this, event.tube, event.action, event.value);
+		applied++;
+	}
+	return applied;
+}
+
+int VesselNetwork::addTube(int a, int b, float inertance, float damping)
+{
+	tubeA.push_back(a);
+	tubeB.push_back(b);
+	tubeInvInertance.push_back(1.0f / inertance);
+	tubeDamping.push_back(damping);
+	tubeFlow.push_back(0.0f);
+	if (hasComponents())
+	{
+		tubeComponent.push_back(COMPONENT_NONE);
+		tubeSetting.push_back(0.0f);
+		tubeBaseInvInertance.push_back(1.0f / inertance);
+		tubeBaseDamping.push_back(damping);
+	}
+
+	degree[a]++;
+	degree[b]++;
+	topologyDirty = true;
+
+	tubeHandles.resize(tubeCount() - 1);
+	tubeHandles.add();
+	return tubeCount() - 1;
+}
+
+// Moves the last value into index and drops the last one.
+template <typename T>
+static void removeSwap(std::vector<T>& values, int index)
+{
+	values[index] = values.back();
+	values.pop_back();
+}
+
+// Moves the last vessel into the place of one, in every per vessel array and in the handles. The tubes still have to be relabeled.
+static void removeVesselArrays(VesselNetwork& network, int vessel)
+{
+	removeSwap(network.height, vessel);
+	removeSwap(network.width, vessel);
+	removeSwap(network.pressure, vessel);
+	removeSwap(network.externalPressure, vessel);
+	removeSwap(network.left, vessel);
+	removeSwap(network.right, vessel);
+	removeSwap(network.bottom, vessel);
+	removeSwap(network.top, vessel);
+	removeSwap(network.degree, vessel);
+	removeSwap(network.delta, vessel);
+	for (int f = 0; f < network.fluidCount(); f++)
+	{
+		removeSwap(network.layerHeight[f], vessel);
+	}
+	if (network.profiled())
+	{
+		removeSwap(network.vesselProfile, vessel);
+	}
+	network.vesselHandles.removeSwap(vessel);
+}
+
+void VesselNetwork::removeTube(int tube)
+{
+	tubeHandles.resize(tubeCount());
+	degree[tubeA[tube]]--;
+	degree[tubeB[tube]]--;
+	removeSwap(tubeA, tube);
+	removeSwap(tubeB, tube);
+	removeSwap(tubeInvInertance, tube);
+	removeSwap(tubeDamping, tube);
+	removeSwap(tubeFlow, tube);
+	if (hasComponents())
+	{
+		removeSwap(tubeComponent, tube);
+		removeSwap(tubeSetting, tube);
+		removeSwap(tubeBaseInvInertance, tube);
+		removeSwap(tubeBaseDamping, tube);
+		schedule.removeTube(tube, tubeCount());
+	}
+	tubeHandles.removeSwap(tube);
+	topologyDirty = true;
+}
+
+void VesselNetwork::removeVessel(int vessel)
+{
+	// From the back, so the tube moved into the place of a removed one has been looked at already.
+	for (int t = tubeCount() - 1; t >= 0; t--)
+	{
+		if (tubeA[t] == vessel || tubeB[t] == vessel)
+		{
+			removeTube(t);
+		}
+	}
+
+	vesselHandles.resize(vesselCount());
+	int last = vesselCount() - 1;
+	removeVesselArrays(*this, vessel);
+
+	for (int t = 0; t < tubeCount(); t++)
+	{
+		tubeA[t] = tubeA[t] == last ? vessel : tubeA[t];
+		tubeB[t] = tubeB[t] == last ? vessel : tubeB[t];
+	}
+	topologyDirty = true;
+}
+
+void VesselNetwork::removeVessels(const std::vector<int>& vessels)
+{
+	std::vector<char> removed(vesselCount(), 0);
+	for (int vessel : vessels)
+	{
+		removed[vessel] = 1;
+	}
+	for (int t = tubeCount() - 1; t >= 0; t--)
+	{
+		if (removed[tubeA[t]] || removed[tubeB[t]])
+		{
+			removeTube(t);
+		}
+	}
+
+	// From the highest index down, so the last vessel moved into a gap is never one that goes too. indexOf follows where every vessel
+	// ends up, so the tubes are relabeled once at the end.
+	std::vector<int> order(vessels);
+	std::sort(order.begin(), order.end(), std::greater<int>());
+	order.erase(std::unique(order.begin(), order.end()), order.end());
+	std::vector<int> indexOf(vesselCount());
+	std::vector<int> vesselAt(vesselCount());
+	for (int i = 0; i < vesselCount(); i++)
+	{
+		indexOf[i] = i;
+		vesselAt[i] = i;
+	}
+
+	vesselHandles.resize(vesselCount());
+	for (int vessel : order)
+	{
+		int last = vesselCount() - 1;
+		removeVesselArrays(*this, vessel);
+		indexOf[vesselAt[last]] = vessel;
+		vesselAt[vessel] = vesselAt[last];
+	}
+
+	for (int t = 0; t < tubeCount(); t++)
+	{
+		tubeA[t] = indexOf[tubeA[t]];
+		tubeB[t] = indexOf[tubeB[t]];
+	}
+	topologyDirty = true;
+}
+
+void VesselNetwork::clear()
+{
+	height.clear();
+	width.clear();
+	pressure.clear();
+	externalPressure.clear();
+	left.clear();
+	right.clear();
+	bottom.clear();
+	top.clear();
+	tubeA.clear();
+	tubeB.clear();
+	degree.clear();
+	delta.clear();
+	tubeInvInertance.clear();
+	tubeDamping.clear();
+	tubeFlow.clear();
+	drainShare.clear();
+	stepDrainShare.clear();
+	tubeStiffness.clear();
+	tubeChange.clear();
+	tubeDifference.clear();
+	vesselTubeStart.clear();
+	vesselTubes.clear();
+	vesselTubeBase.clear();
+	compactTubes.clear();
+	colorTubes.clear();
+	colorA.clear();
+	colorB.clear();
+	colorPieces.clear();
+	componentOf.clear();
+	componentCount = 0;
+	vesselRuns.clear();
+	tubeRuns.clear();
+	componentAwake.clear();
+	componentMoved.clear();
+	awakeComponents.clear();
+	preciseHeight.clear();
+	precisePressure.clear();
+	preciseFlow.clear();
+	preciseChange.clear();
+	preciseDirty = true;
+	fixedVolume.clear();
+	fixedFlow.clear();
+	fixedChange.clear();
+	fixedPressure.clear();
+	fixedDrain.clear();
+	fixedInvWidth.clear();
+	fixedKeep.clear();
+	fixedGain.clear();
+	fluidDensity.clear();
+	layerHeight.clear();
+	fluidOrder.clear();
+	bottomDensity.clear();
+	outflow.clear();
+	outflowShare.clear();
+	profiles.clear();
+	vesselProfile.clear();
+	profiledVessels.clear();
+	profiledProfile.clear();
+	tubeComponent.clear();
+	tubeSetting.clear();
+	tubeBaseInvInertance.clear();
+	tubeBaseDamping.clear();
+	checkValves.clear();
+	runningPumps.clear();
+	schedule.clear();
+	vesselHandles.clear();
+	tubeHandles.clear();
+	topologyDirty = true;
+}
+
+// P = gravity * (sum over the layers of density * layer height). One pass per fluid over the vessels, so every pass is a plain
+// multiply-add over two arrays. Afterwards bottomDensity holds the density of the densest fluid each vessel actually holds: the
+// fluids are visited from the lightest to the densest, so the last one that is there wins.
+static void layeredPressures(VesselNetwork& network, int begin, int end, float gravity)
+{
+	float* pressure = network.pressure.data();
+	float* bottomDensity = network.bottomDensity.data();
+	for (int i = begin; i < end; i++)
+	{
+		pressure[i] = 0.0f;
+		bottomDensity[i] = network.fluidDensity[network.fluidOrder[0]];
+	}
+
+	for (int k = network.fluidCount() - 1; k >= 0; k--)
+	{
+		int f = network.fluidOrder[k];
+		const float* layer = network.layerHeight[f].data();
+		float density = network.fluidDensity[f];
+		float scale = gravity * density;
+		for (int i = begin; i < end; i++)
+		{
+			pressure[i] += layer[i] * scale;
+			bottomDensity[i] = layer[i] > 0.0f ? density : bottomDensity[i];
+		}
+	}
+}
+
+void VesselNetwork::computePressures(float density, float gravity)
+{
+	if (layered())
+	{
+		if (topologyDirty)
+		{
+			rebuildTopology();
+		}
+		layeredPressures(*this, 0, vesselCount(), gravity);
+		return;
+	}
+
+	// P = density * height * gravity
+	simdKernels().pressures(height.data(), pressure.data(), vesselCount(), gravity * density);
+}
+
+// Follows the parent links of the union-find forest up to the root, halving the path as it goes.
+static int findRoot(std::vector<int>& parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+void VesselNetwork::rebuildTopology()
+{
+	int vessels = vesselCount();
+	int tubes = tubeCount();
+	vesselHandles.resize(vessels);
+	tubeHandles.resize(tubes);
+
+	// A vessel connected to several tubes can be drained by all of them in the same step, so every tube may only take its share
+	// of the fluid. That way the tubes added together can never drain a vessel below zero.
+	drainShare.resize(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		drainShare[i] = degree[i] > 0 ? width[i] / (float)degree[i] : 0.0f;
+	}
+
+	profiledVessels.clear();
+	profiledProfile.clear();
+	for (int i = 0; i < (int)vesselProfile.size(); i++)
+	{
+		if (vesselProfile[i] >= 0)
+		{
+			profiledVessels.push_back(i);
+			profiledProfile.push_back(vesselProfile[i]);
+		}
+	}
+
+	// runningPumps is rebuilt too, since the arrays of a checkpoint or a reordered network come without it.
+	checkValves.clear();
+	runningPumps.clear();
+	for (int t = 0; t < (int)tubeComponent.size(); t++)
+	{
+		if (tubeComponent[t] == COMPONENT_CHECK_VALVE)
+		{
+			checkValves.push_back(t);
+		}
+		if (tubeComponent[t] == COMPONENT_PUMP && tubeSetting[t] != 0.0f)
+		{
+			runningPumps.push_back(t);
+		}
+	}
+
+	tubeStiffness.resize(tubes);
+	tubeChange.resize(tubes);
+	tubeDifference.resize(tubes);
+	for (int t = 0; t < tubes; t++)
+	{
+		tubeStiffness[t] = 1.0f / width[tubeA[t]] + 1.0f / width[tubeB[t]];
+	}
+
+	// Count the tubes of every vessel, turn the counts into start offsets, then fill in the lists.
+	// Tubes are added in increasing order, so every vessel sums up its changes in the same order a plain loop over tubes would.
+	vesselTubeStart.assign(vessels + 1, 0);
+	for (int i = 0; i < vessels; i++)
+	{
+		vesselTubeStart[i + 1] = vesselTubeStart[i] + degree[i];
+	}
+	vesselTubes.resize(tubes * 2);
+	std::vector<int> fill(vesselTubeStart.begin(), vesselTubeStart.end() - 1);
+	for (int t = 0; t < tubes; t++)
+	{
+		vesselTubes[fill[tubeA[t]]++] = t * 2;
+		vesselTubes[fill[tubeB[t]]++] = t * 2 + 1;
+	}
+
+	// Every list is in increasing order, so its first entry is the smallest and the last one tells how far it reaches.
+	vesselTubeBase.resize(vessels);
+	bool compact = true;
+	for (int i = 0; i < vessels && compact; i++)
+	{
+		vesselTubeBase[i] = degree[i] > 0 ? vesselTubes[vesselTubeStart[i]] : 0;
+		compact = degree[i] == 0 || vesselTubes[vesselTubeStart[i + 1] - 1] - vesselTubeBase[i] < COMPACT_TUBE_RANGE;
+	}
+	compactTubes.clear();
+	if (compact)
+	{
+		compactTubes.resize(tubes * 2);
+		for (int i = 0; i < vessels; i++)
+		{
+			for (int k = vesselTubeStart[i]; k < vesselTubeStart[i + 1]; k++)
+			{
+				compactTubes[k] = (unsigned short)(vesselTubes[k] - vesselTubeBase[i]);
+			}
+		}
+	}
+	else
+	{
+		vesselTubeBase.clear();
+	}
+
+	// Find the connected components with union-find: every tube merges the sets of its two vessels.
+	std::vector<int> parent(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		parent[i] = i;
+	}
+	for (int t = 0; t < tubes; t++)
+	{
+		int ra = findRoot(parent, tubeA[t]);
+		int rb = findRoot(parent, tubeB[t]);
+		if (ra != rb)
+		{
+			parent[std::max(ra, rb)] = std::min(ra, rb);
+		}
+	}
+
+	// Number the components in order of their lowest vessel, so the numbering never depends on the order of the tubes.
+	componentOf.assign(vessels, -1);
+	componentCount = 0;
+	for (int i = 0; i < vessels; i++)
+	{
+		int root = findRoot(parent, i);
+		if (componentOf[root] < 0)
+		{
+			componentOf[root] = componentCount++;
+		}
+		componentOf[i] = componentOf[root];
+	}
+
+	// Runs of consecutive vessels and tubes in the same component, for skipping the sleeping ones.
+	vesselRuns.clear();
+	for (int i = 0; i < vessels; i++)
+	{
+		if (vesselRuns.empty() || vesselRuns.back().component != componentOf[i])
+		{
+			vesselRuns.push_back({ i, i, componentOf[i] });
+		}
+		vesselRuns.back().end = i + 1;
+	}
+	tubeRuns.clear();
+	for (int t = 0; t < tubes; t++)
+	{
+		int component = componentOf[tubeA[t]];
+		if (tubeRuns.empty() || tubeRuns.back().component != component)
+		{
+			tubeRuns.push_back({ t, t, component });
+		}
+		tubeRuns.back().end = t + 1;
+	}
+
+	// The fluids from the densest to the lightest, and room for the scratch arrays of the layered step.
+	fluidOrder.resize(fluidCount());
+	for (int f = 0; f < fluidCount(); f++)
+	{
+		fluidOrder[f] = f;
+	}
+	std::stable_sort(fluidOrder.begin(), fluidOrder.end(), [&](int x, int y) { return fluidDensity[x] > fluidDensity[y]; });
+	if (layered())
+	{
+		bottomDensity.resize(vessels);
+		outflow.resize(vessels);
+		outflowShare.assign(fluidCount(), std::vector<float>(vessels, 0.0f));
+	}
+
+	// A new topology can move anywhere.
+	componentAwake.assign(componentCount, 1);
+	componentMoved.assign(componentCount, 0);
+	awakeDirty = true;
+	preciseDirty = true;
+
+	topologyDirty = false;
+	topologyVersion++;
+}
+
+// Every vessel adds up the volumes moved by its own tubes, then moves its level by that volume over its width.
+// Vessels only write to themselves, so any range of vessels can run at the same time as any other.
+// Compact reads the 16 bit lists, which gives the same entries in the same order, so the result is the same either way.
+template <bool Compact>
+static void gatherAndApply(VesselNetwork& network, int begin, int end)
+{
+	const int* start = network.vesselTubeStart.data();
+	const int* list = network.vesselTubes.data();
+	const int* base = network.vesselTubeBase.data();
+	const unsigned short* compactList = network.compactTubes.data();
+	const float* change = network.tubeChange.data();
+	const float* w = network.width.data();
+	float* d = network.delta.data();
+
+	for (int i = begin; i < end; i++)
+	{
+		float sum = 0.0f;
+		for (int k = start[i]; k < start[i + 1]; k++)
+		{
+			int entry = Compact ? base[i] + compactList[k] : list[k];
+			float c = change[entry >> 1];
+
+			// The volume flows out of the B end of a tube and into the A end.
+			sum += (entry & 1) ? -c : c;
+		}
+		d[i] = sum / w[i];
+	}
+
+	simdKernels().apply(network.height.data() + begin, d + begin, network.bottom.data() + begin, network.top.data() + begin, end - begin);
+}
+
+// The shares of DRAIN_OUTFLOW for the vessels begin to end - 1. The new flow of a tube has the sign of the numerator of its update
+// (the denominator is above 0), so every vessel can count the tubes that are about to drain it before any of them moved: the B end
+// drains when the flow comes out positive, the A end when it comes out negative. The numerator is worked out exactly like the tube
+// kernels do, and a tube whose numerator is 0 counts on both ends, so the tubes draining a vessel never get more than all of it.
+static void outflowShares(VesselNetwork& network, float dt, int begin, int end)
+{
+	const int* start = network.vesselTubeStart.data();
+	const int* list = network.vesselTubes.data();
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const float* flow = network.tubeFlow.data();
+	const float* invInertance = network.tubeInvInertance.data();
+	const float* pressure = network.pressure.data();
+	const float* externalPressure = network.externalPressure.data();
+	const float* w = network.width.data();
+	float* share = network.stepDrainShare.data();
+
+	for (int i = begin; i < end; i++)
+	{
+		int draining = 0;
+		for (int k = start[i]; k < start[i + 1]; k++)
+		{
+			int entry = list[k];
+			int t = entry >> 1;
+			float difference = (pressure[tubeB[t]] + externalPressure[tubeB[t]]) - (pressure[tubeA[t]] + externalPressure[tubeA[t]]);
+			float numerator = flow[t] + dt * difference * invInertance[t];
+			draining += (entry & 1) ? numerator >= 0.0f : numerator <= 0.0f;
+		}
+		share[i] = w[i] / (float)(draining > 1 ? draining : 1);
+	}
+}
+
+// Moves the profiled vessels among begin to end - 1 through their profiles, after the apply phase moved them as rectangles.
+static void applyProfiles(VesselNetwork& network, int begin, int end)
+{
+	const std::vector<int>& vessels = network.profiledVessels;
+	const int* first = std::lower_bound(vessels.data(), vessels.data() + vessels.size(), begin);
+	const int* last = std::lower_bound(first, vessels.data() + vessels.size(), end);
+	if (first == last)
+	{
+		return;
+	}
+
+	const VesselProfiles& profiles = network.profiles;
+	ProfileData data;
+	data.vessel = vessels.data();
+	data.profile = network.profiledProfile.data();
+	data.volumeTable = profiles.volumeTable.data();
+	data.heightTable = profiles.heightTable.data();
+	data.depth = profiles.depth.data();
+	data.fullVolume = profiles.fullVolume.data();
+	data.topWidth = profiles.topWidth.data();
+	data.heightScale = profiles.heightScale.data();
+	data.volumeScale = profiles.volumeScale.data();
+	int offset = (int)(first - vessels.data());
+	simdKernels().profileApply(data, offset, offset + (int)(last - first), network.height.data(), network.delta.data(), network.width.data(),
+		network.bottom.data(), network.top.data());
+}
+
+int VesselNetwork::tubeColors()
+{
+	int tubes = tubeCount();
+	colorTubes.clear();
+	colorA.clear();
+	colorB.clear();
+	colorPieces.clear();
+	colorVersion = topologyVersion;
+
+	// Every tube takes the lowest color neither of its vessels has yet. used[i] has a bit for every color vessel i already has.
+	std::vector<unsigned long long> used(vesselCount(), 0);
+	std::vector<unsigned char> color(tubes);
+	std::vector<int> colorStart(SCATTER_MAX_COLORS + 1, 0);
+	int colors = 0;
+	for (int t = 0; t < tubes; t++)
+	{
+		unsigned long long taken = used[tubeA[t]] | used[tubeB[t]];
+		if (taken == ~0ULL)
+		{
+			return 0;
+		}
+		int c = 0;
+		while (taken & (1ULL << c))
+		{
+			c++;
+		}
+		used[tubeA[t]] |= 1ULL << c;
+		used[tubeB[t]] |= 1ULL << c;
+		color[t] = (unsigned char)c;
+		colorStart[c + 1]++;
+		colors = std::max(colors, c + 1);
+	}
+
+	// Sort the tubes by color, keeping them in order within every color.
+	for (int c = 0; c < colors; c++)
+	{
+		colorStart[c + 1] += colorStart[c];
+	}
+	colorTubes.resize(tubes);
+	colorA.resize(tubes);
+	colorB.resize(tubes);
+	std::vector<int> fill(colorStart.begin(), colorStart.begin() + colors);
+	for (int t = 0; t < tubes; t++)
+	{
+		int k = fill[color[t]]++;
+		colorTubes[k] = t;
+		colorA[k] = tubeA[t];
+		colorB[k] = tubeB[t];
+	}
+
+	colorPieces.resize(colors);
+	for (int c = 0; c < colors; c++)
+	{
+		for (int begin = colorStart[c]; begin < colorStart[c + 1]; begin += parallelBlock)
+		{
+			colorPieces[c].push_back({ begin, std::min(begin + parallelBlock, colorStart[c + 1]), -1 });
+		}
+	}
+	return colors;
+}
+
+// Adds the volumes moved by the tubes k = begin to end - 1 of a color into both of their vessels. The tubes of one color never
+// share a vessel, so any ranges of the same color can run at the same time.
+static void scatterColor(VesselNetwork& network, int begin, int end)
+{
+	const int* tubes = network.colorTubes.data();
+	const int* a = network.colorA.data();
+	const int* b = network.colorB.data();
+	const float* change = network.tubeChange.data();
+	float* d = network.delta.data();
+
+	for (int k = begin; k < end; k++)
+	{
+		float c = change[tubes[k]];
+		d[a[k]] += c;
+		d[b[k]] -= c;
+	}
+}
+
+// The implicit version of the tube phase: solve for the new flows of all tubes together, then apply the same rest and drain limits
+// as the tube kernel. Returns true if any tube moved anything.
+static bool implicitFlows(VesselNetwork& network, const FlowStep& step, float scale, TaskPool* pool)
+{
+	int tubes = network.tubeCount();
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const float* height = network.height.data();
+	const float* pressure = network.pressure.data();
+	const float* externalPressure = network.externalPressure.data();
+	const float* drainShare = network.drainShare.data();
+	float* difference = network.tubeDifference.data();
+	float* flow = network.tubeFlow.data();
+	float* change = network.tubeChange.data();
+
+	for (int t = 0; t < tubes; t++)
+	{
+		difference[t] = (pressure[tubeB[t]] + externalPressure[tubeB[t]]) - (pressure[tubeA[t]] + externalPressure[tubeA[t]]);
+	}
+
+	network.solver.solve(network, difference, step.dt, scale, flow, pool);
+
+	const int* componentOf = network.componentOf.data();
+	const char* awake = network.componentAwake.data();
+	bool moved = false;
+	for (int t = 0; t < tubes; t++)
+	{
+		int a = tubeA[t];
+		int b = tubeB[t];
+		float f = flow[t];
+
+		// The sleeping components are solved too, since they are part of the matrix, but they are already at rest, so whatever
+		// rounding is left in their solution is dropped.
+		if (!awake[componentOf[a]] || (std::fabs(f) < step.restFlow && std::fabs(difference[t]) < step.restPressure))
+		{
+			f = 0.0f;
+		}
+
+		float volume = f * step.dt;
+		volume = std::min(volume, height[b] * drainShare[b]);
+		volume = std::max(volume, -(height[a] * drainShare[a]));
+
+		flow[t] = volume / step.dt;
+		change[t] = volume;
+		moved |= volume != 0.0f;
+	}
+	return moved;
+}
+
+// Joins the runs of the awake components that follow each other, and cuts the result into pieces that never cross a multiple of
+// block. When every component is awake, the pieces are exactly the blocks parallelFor() would make. A piece that covers more than
+// one component has component -1.
+static void awakePieces(const std::vector<IndexRun>& runs, const std::vector<char>& awake, int block, std::vector<IndexRun>& pieces)
+{
+	std::vector<IndexRun> joined;
+	for (const IndexRun& run : runs)
+	{
+		if (!awake[run.component])
+		{
+			continue;
+		}
+		if (!joined.empty() && joined.back().end == run.begin)
+		{
+			joined.back().end = run.end;
+			joined.back().component = joined.back().component == run.component ? run.component : -1;
+		}
+		else
+		{
+			joined.push_back(run);
+		}
+	}
+
+	pieces.clear();
+	for (const IndexRun& run : joined)
+	{
+		for (int begin = run.begin; begin < run.end;)
+		{
+			int end = std::min(run.end, (begin / block + 1) * block);
+			pieces.push_back({ begin, end, run.component });
+			begin = end;
+		}
+	}
+}
+
+// Runs body(index, piece) for every piece: on the pool as one block per piece if one is given, otherwise in order on this thread.
+// The pieces are the same either way, so the result is too.
+template <typename Body>
+static void forPieces(TaskPool* pool, const std::vector<IndexRun>& pieces, const Body& body, UpdateTimes* timing = nullptr)
+{
+	if (pool != nullptr && timing != nullptr)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::atomic<long long> busy(0);
+		pool->parallelFor((int)pieces.size(), 1, [&](int begin, int end)
+		{
+			std::chrono::steady_clock::time_point pieceStart = std::chrono::steady_clock::now();
+			for (int i = begin; i < end; i++)
+			{
+				body(i, pieces[i]);
+			}
+			busy += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pieceStart).count();
+		});
+		timing->parallel += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		timing->busy += busy.load() * 1e-9;
+		return;
+	}
+	if (pool != nullptr)
+	{
+		pool->parallelFor((int)pieces.size(), 1, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				body(i, pieces[i]);
+			}
+		});
+		return;
+	}
+	for (int i = 0; i < (int)pieces.size(); i++)
+	{
+		body(i, pieces[i]);
+	}
+}
+
+// Finds out which awake components moved in the tube phase, reading the pieces back in order so the result doesn't depend on
+// which thread ran which piece. Only pieces that moved and cover several components have to look at their tubes one by one.
+// Returns true if anything moved.
+template <typename Real>
+static bool findMovedComponents(VesselNetwork& network, const Real* change)
+{
+	for (int c : network.awakeComponents)
+	{
+		network.componentMoved[c] = 0;
+	}
+
+	bool moved = false;
+	for (size_t i = 0; i < network.awakeTubes.size(); i++)
+	{
+		if (!network.pieceMoved[i])
+		{
+			continue;
+		}
+		moved = true;
+
+		const IndexRun& piece = network.awakeTubes[i];
+		if (piece.component >= 0)
+		{
+			network.componentMoved[piece.component] = 1;
+			continue;
+		}
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			if (change[t] != 0)
+			{
+				network.componentMoved[network.componentOf[network.tubeA[t]]] = 1;
+			}
+		}
+	}
+	return moved;
+}
+
+// A component where nothing moved is in the same state it started the step in, so every following step would be the same.
+static void sleepResting(VesselNetwork& network)
+{
+	for (int c : network.awakeComponents)
+	{
+		if (!network.componentMoved[c])
+		{
+			network.componentAwake[c] = 0;
+			network.awakeDirty = true;
+		}
+	}
+}
+
+#pragma region Precise
+// The step for PRECISION_MIXED and PRECISION_DOUBLE. It runs the same phases as the single precision step, but as plain loops
+// templated on Real, the type the pressures and flows are worked out in. Mixed precision uses float for those, so it reads and
+// writes almost as little memory as the single precision step, and only adds up the heights in double. Double precision does
+// everything in double. Either way the float arrays are kept up to date, since rendering, telemetry and checkpoints read them.
+
+// Where the pressures, flows and changes of each precision live: the float ones are the regular arrays.
+static void preciseArrays(VesselNetwork& network, float*& pressure, float*& flow, float*& change)
+{
+	pressure = network.pressure.data();
+	flow = network.tubeFlow.data();
+	change = network.tubeChange.data();
+}
+
+static void preciseArrays(VesselNetwork& network, double*& pressure, double*& flow, double*& change)
+{
+	pressure = network.precisePressure.data();
+	flow = network.preciseFlow.data();
+	change = network.preciseChange.data();
+}
+
+template <typename Real>
+struct PreciseStep
+{
+	Real dt;
+	Real dtSquaredScale;
+	Real restFlow;
+	Real restPressure;
+};
+
+// The same operations as the scalar tube kernel (see SimdKernels.cpp), in Real.
+template <typename Real>
+static inline void preciseTubeFlow(int t, const VesselNetwork& network, const Real* pressure, Real* flow, Real* change, const PreciseStep<Real>& step)
+{
+	int a = network.tubeA[t];
+	int b = network.tubeB[t];
+	Real difference = (pressure[b] + (Real)network.externalPressure[b]) - (pressure[a] + (Real)network.externalPressure[a]);
+
+	Real invInertance = network.tubeInvInertance[t];
+	Real f = (flow[t] + step.dt * difference * invInertance)
+		/ (1 + step.dt * (Real)network.tubeDamping[t] + step.dtSquaredScale * (Real)network.tubeStiffness[t] * invInertance);
+
+	if (std::fabs(f) < step.restFlow && std::fabs(difference) < step.restPressure)
+	{
+		f = 0;
+	}
+
+	Real volume = f * step.dt;
+	volume = std::min(volume, (Real)network.preciseHeight[b] * (Real)network.drainShare[b]);
+	volume = std::max(volume, -((Real)network.preciseHeight[a] * (Real)network.drainShare[a]));
+
+	flow[t] = volume / step.dt;
+	change[t] = volume;
+}
+
+template <typename Real>
+static bool preciseUpdate(VesselNetwork& network, float scale, float dt, TaskPool* pool)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+
+	// Start from the float state the first time, and whenever it was changed from outside.
+	if (network.preciseDirty)
+	{
+		network.preciseHeight.assign(network.height.begin(), network.height.end());
+		network.precisePressure.resize(vessels);
+		network.preciseFlow.assign(network.tubeFlow.begin(), network.tubeFlow.end());
+		network.preciseChange.resize(tubes);
+		network.preciseDirty = false;
+	}
+
+	Real* pressure;
+	Real* flow;
+	Real* change;
+	preciseArrays(network, pressure, flow, change);
+	double* height = network.preciseHeight.data();
+
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		for (int i = piece.begin; i < piece.end; i++)
+		{
+			pressure[i] = (Real)height[i] * (Real)scale;
+			network.pressure[i] = (float)pressure[i];
+		}
+	});
+
+	network.pieceMoved.assign(network.awakeTubes.size(), 0);
+	if (network.integrator == INTEGRATOR_IMPLICIT)
+	{
+		// The implicit solve works in float on the float arrays, which are up to date; only its result is taken over.
+		FlowStep step;
+		step.dt = dt;
+		step.dtSquaredScale = dt * dt * scale;
+		step.restFlow = REST_FLOW;
+		step.restPressure = REST_HEIGHT * scale;
+		implicitFlows(network, step, scale, pool);
+
+		forPieces(pool, network.awakeTubes, [&](int i, const IndexRun& piece)
+		{
+			for (int t = piece.begin; t < piece.end; t++)
+			{
+				flow[t] = network.tubeFlow[t];
+				change[t] = network.tubeChange[t];
+				network.pieceMoved[i] |= change[t] != 0;
+			}
+		});
+	}
+	else
+	{
+		PreciseStep<Real> step;
+		step.dt = dt;
+		step.dtSquaredScale = (Real)dt * (Real)dt * (Real)scale;
+		step.restFlow = REST_FLOW;
+		step.restPressure = (Real)REST_HEIGHT * (Real)scale;
+
+		forPieces(pool, network.awakeTubes, [&](int i, const IndexRun& piece)
+		{
+			for (int t = piece.begin; t < piece.end; t++)
+			{
+				preciseTubeFlow(t, network, pressure, flow, change, step);
+				network.tubeFlow[t] = (float)flow[t];
+				network.tubeChange[t] = (float)change[t];
+				network.pieceMoved[i] |= change[t] != 0;
+			}
+		});
+	}
+
+	bool moved = findMovedComponents(network, (const Real*)change);
+	if (moved)
+	{
+		const int* start = network.vesselTubeStart.data();
+		const int* list = network.vesselTubes.data();
+		forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+		{
+			if (piece.component >= 0 && !network.componentMoved[piece.component])
+			{
+				return;
+			}
+			for (int i = piece.begin; i < piece.end; i++)
+			{
+				double sum = 0.0;
+				for (int k = start[i]; k < start[i + 1]; k++)
+				{
+					int entry = list[k];
+					double c = change[entry >> 1];
+					sum += (entry & 1) ? -c : c;
+				}
+				double d = sum / network.width[i];
+				height[i] += d;
+				network.delta[i] = (float)d;
+				network.height[i] = (float)height[i];
+				network.top[i] = network.bottom[i] + network.height[i];
+			}
+		});
+	}
+
+	sleepResting(network);
+	return moved;
+}
+#pragma endregion Precise
+
+#pragma region FixedPoint
+// The step for PRECISION_FIXED_POINT: the local tube step of preciseTubeFlow(), in Q32.32 integers (see FixedPoint.h). The state is
+// the volume of every vessel instead of its height, so the volume a tube takes out of one vessel is exactly the volume it puts into
+// the other, and the total never changes by a single bit. Integer sums don't depend on their order either, so the result is the
+// same however the pieces are split between the threads, on every machine.
+
+// What a tube keeps of its flow over a step, 1 / (1 + dt * damping + dt^2 * scale * stiffness / inertance), and what it gains per
+// pressure difference, dt / inertance over the same, and 1 / width for every vessel. Worked out in fixed point from the float
+// parameters, so they are the same everywhere too.
+static void fixedCoefficients(VesselNetwork& network, float scale, float dt)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	Fixed step = toFixed(dt);
+	Fixed dtSquaredScale = fixedMultiply(step, fixedMultiply(step, toFixed(scale)));
+
+	network.fixedInvWidth.resize(vessels);
+	for (int i = 0; i < vessels; i++)
+	{
+		network.fixedInvWidth[i] = fixedDivide(FIXED_ONE, toFixed(network.width[i]));
+	}
+	network.fixedKeep.resize(tubes);
+	network.fixedGain.resize(tubes);
+	for (int t = 0; t < tubes; t++)
+	{
+		Fixed invInertance = toFixed(network.tubeInvInertance[t]);
+		Fixed denominator = FIXED_ONE + fixedMultiply(step, toFixed(network.tubeDamping[t]))
+			+ fixedMultiply(dtSquaredScale, fixedMultiply(toFixed(network.tubeStiffness[t]), invInertance));
+		network.fixedKeep[t] = fixedDivide(FIXED_ONE, denominator);
+		network.fixedGain[t] = fixedDivide(fixedMultiply(step, invInertance), denominator);
+	}
+	network.fixedDt = dt;
+	network.fixedScale = scale;
+}
+
+static bool fixedPointUpdate(VesselNetwork& network, float scale, float dt, TaskPool* pool)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+
+	// Start from the float state the first time, and whenever it was changed from outside. A float times a float is exact in double.
+	if (network.preciseDirty)
+	{
+		network.fixedVolume.resize(vessels);
+		for (int i = 0; i < vessels; i++)
+		{
+			network.fixedVolume[i] = toFixed((double)network.height[i] * network.width[i]);
+		}
+		network.fixedFlow.resize(tubes);
+		for (int t = 0; t < tubes; t++)
+		{
+			network.fixedFlow[t] = toFixed(network.tubeFlow[t]);
+		}
+		network.fixedChange.resize(tubes);
+		network.fixedPressure.resize(vessels);
+		network.fixedDrain.resize(vessels);
+	}
+	if (network.preciseDirty || network.fixedDt != dt || network.fixedScale != scale)
+	{
+		fixedCoefficients(network, scale, dt);
+	}
+	network.preciseDirty = false;
+
+	Fixed step = toFixed(dt);
+	Fixed fixedScale = toFixed(scale);
+	Fixed restFlow = toFixed(REST_FLOW);
+	Fixed restPressure = toFixed((double)REST_HEIGHT * scale);
+	Fixed* volume = network.fixedVolume.data();
+	Fixed* flow = network.fixedFlow.data();
+	Fixed* change = network.fixedChange.data();
+	Fixed* pressure = network.fixedPressure.data();
+	Fixed* drain = network.fixedDrain.data();
+	const Fixed* invWidth = network.fixedInvWidth.data();
+	const Fixed* keep = network.fixedKeep.data();
+	const Fixed* gain = network.fixedGain.data();
+
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		for (int i = piece.begin; i < piece.end; i++)
+		{
+			Fixed own = fixedMultiply(fixedMultiply(volume[i], invWidth[i]), fixedScale);
+			network.pressure[i] = (float)fromFixed(own);
+			pressure[i] = own + toFixed(network.externalPressure[i]);
+			drain[i] = volume[i] / std::max(network.degree[i], 1);
+		}
+	});
+
+	network.pieceMoved.assign(network.awakeTubes.size(), 0);
+	forPieces(pool, network.awakeTubes, [&](int i, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			int a = network.tubeA[t];
+			int b = network.tubeB[t];
+			Fixed difference = pressure[b] - pressure[a];
+			Fixed f = fixedMultiply(flow[t], keep[t]) + fixedMultiply(difference, gain[t]);
+			if (std::abs(f) < restFlow && std::abs(difference) < restPressure)
+			{
+				f = 0;
+			}
+
+			// Only a flow the drain limits cut back is worked out again from its volume, so the others keep all their bits.
+			Fixed moved = fixedMultiply(f, step);
+			Fixed limited = std::max(std::min(moved, drain[b]), -drain[a]);
+			if (limited != moved)
+			{
+				f = fixedDivide(limited, step);
+			}
+			flow[t] = f;
+			change[t] = limited;
+			network.tubeFlow[t] = (float)fromFixed(f);
+			network.tubeChange[t] = (float)fromFixed(limited);
+			network.pieceMoved[i] |= limited != 0;
+		}
+	});
+
+	bool moved = findMovedComponents(network, (const Fixed*)change);
+	if (moved)
+	{
+		const int* start = network.vesselTubeStart.data();
+		const int* list = network.vesselTubes.data();
+		forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+		{
+			if (piece.component >= 0 && !network.componentMoved[piece.component])
+			{
+				return;
+			}
+			for (int i = piece.begin; i < piece.end; i++)
+			{
+				Fixed sum = 0;
+				for (int k = start[i]; k < start[i + 1]; k++)
+				{
+					int entry = list[k];
+					Fixed c = change[entry >> 1];
+					sum += (entry & 1) ? -c : c;
+				}
+				volume[i] += sum;
+				float height = (float)fromFixed(fixedMultiply(volume[i], invWidth[i]));
+				network.delta[i] = height - network.height[i];
+				network.height[i] = height;
+				network.top[i] = network.bottom[i] + height;
+			}
+		});
+	}
+
+	sleepResting(network);
+	return moved;
+}
+#pragma endregion FixedPoint
+
+#pragma region Adaptive
+// The slopes of the state (height, flow) for INTEGRATOR_ADAPTIVE: dq/dt = (pressure difference) / inertance - damping * q for every
+// tube, and dh/dt = (the flows into the vessel) / width for every vessel. Only the awake pieces are worked out, which is all the
+// steps ever read.
+static void adaptiveSlopes(VesselNetwork& network, float scale, const float* height, const float* flow, float* heightSlope, float* flowSlope,
+	TaskPool* pool)
+{
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const float* externalPressure = network.externalPressure.data();
+	forPieces(pool, network.awakeTubes, [&](int, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			int a = tubeA[t];
+			int b = tubeB[t];
+			float difference = (height[b] * scale + externalPressure[b]) - (height[a] * scale + externalPressure[a]);
+			flowSlope[t] = difference * network.tubeInvInertance[t] - network.tubeDamping[t] * flow[t];
+		}
+	});
+
+	const int* start = network.vesselTubeStart.data();
+	const int* list = network.vesselTubes.data();
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		for (int i = piece.begin; i < piece.end; i++)
+		{
+			float sum = 0.0f;
+			for (int k = start[i]; k < start[i + 1]; k++)
+			{
+				int entry = list[k];
+				float q = flow[entry >> 1];
+				sum += (entry & 1) ? -q : q;
+			}
+			heightSlope[i] = sum / network.width[i];
+		}
+	});
+}
+
+// One substep of the local tube step, for when the adaptive one would drain a vessel below 0 even at its shortest: its drain limits
+// keep every vessel at 0 or above without losing or adding any volume.
+static void drainingSubstep(VesselNetwork& network, float scale, float h, TaskPool* pool)
+{
+	const SimdKernels& simd = simdKernels();
+	TubeFlowData tubeData;
+	tubeData.tubeA = network.tubeA.data();
+	tubeData.tubeB = network.tubeB.data();
+	tubeData.invInertance = network.tubeInvInertance.data();
+	tubeData.damping = network.tubeDamping.data();
+	tubeData.stiffness = network.tubeStiffness.data();
+	tubeData.flow = network.tubeFlow.data();
+	tubeData.change = network.tubeChange.data();
+
+	VesselFlowData vesselData;
+	vesselData.height = network.height.data();
+	vesselData.pressure = network.pressure.data();
+	vesselData.externalPressure = network.externalPressure.data();
+	vesselData.drainShare = network.drainShare.data();
+
+	FlowStep step;
+	step.dt = h;
+	step.dtSquaredScale = h * h * scale;
+	step.restFlow = 0.0f;
+	step.restPressure = 0.0f;
+
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		simd.pressures(network.height.data() + piece.begin, network.pressure.data() + piece.begin, piece.end - piece.begin, scale);
+	});
+	forPieces(pool, network.awakeTubes, [&](int, const IndexRun& piece)
+	{
+		simd.tubeFlows(tubeData, piece.begin, piece.end, vesselData, step);
+	});
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		gatherAndApply<false>(network, piece.begin, piece.end);
+	});
+}
+
+// The step for INTEGRATOR_ADAPTIVE. Works on the float arrays in place: a substep puts its stages into the stage arrays, and only
+// copies them over the state once it is accepted. The error is a maximum, which doesn't depend on the order it is found in, so the
+// result is the same with or without a pool.
+static bool adaptiveUpdate(VesselNetwork& network, float scale, float dt, TaskPool* pool)
+{
+	AdaptiveStepping& adaptive = network.adaptive;
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	adaptive.stageHeight.resize(vessels);
+	adaptive.stageFlow.resize(tubes);
+	adaptive.startFlow.resize(tubes);
+	for (int k = 0; k < 4; k++)
+	{
+		adaptive.heightSlope[k].resize(vessels);
+		adaptive.flowSlope[k].resize(tubes);
+	}
+	adaptive.pieceError.resize(network.awakeVessels.size() + network.awakeTubes.size());
+
+	float* height = network.height.data();
+	float* flow = network.tubeFlow.data();
+	float* stageHeight = adaptive.stageHeight.data();
+	float* stageFlow = adaptive.stageFlow.data();
+	std::vector<float>* heightSlope = adaptive.heightSlope;
+	std::vector<float>* flowSlope = adaptive.flowSlope;
+	std::copy(network.tubeFlow.begin(), network.tubeFlow.end(), adaptive.startFlow.begin());
+
+	// Puts state + substep * (the weighted sum of the slopes) into the stage arrays.
+	auto stage = [&](float substep, const float* weights, int count)
+	{
+		forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+		{
+			for (int i = piece.begin; i < piece.end; i++)
+			{
+				float slope = 0.0f;
+				for (int k = 0; k < count; k++)
+				{
+					slope += weights[k] * heightSlope[k][i];
+				}
+				stageHeight[i] = height[i] + substep * slope;
+			}
+		});
+		forPieces(pool, network.awakeTubes, [&](int, const IndexRun& piece)
+		{
+			for (int t = piece.begin; t < piece.end; t++)
+			{
+				float slope = 0.0f;
+				for (int k = 0; k < count; k++)
+				{
+					slope += weights[k] * flowSlope[k][t];
+				}
+				stageFlow[t] = flow[t] + substep * slope;
+			}
+		});
+	};
+
+	static const float second[1] = { 0.5f };
+	static const float third[2] = { 0.0f, 0.75f };
+	static const float solution[3] = { 2.0f / 9.0f, 1.0f / 3.0f, 4.0f / 9.0f };
+	static const float error[4] = { -5.0f / 72.0f, 1.0f / 12.0f, 1.0f / 9.0f, -1.0f / 8.0f };
+
+	float minSubstep = dt / ADAPTIVE_MAX_SUBSTEPS;
+	float substep = dt;
+	float remaining = dt;
+	adaptiveSlopes(network, scale, height, flow, heightSlope[0].data(), flowSlope[0].data(), pool);
+	while (remaining > 0.0f)
+	{
+		// The last substep takes whatever is left, so the step ends exactly at dt.
+		bool last = substep >= remaining * 0.999f;
+		float h = last ? remaining : substep;
+
+		stage(h, second, 1);
+		adaptiveSlopes(network, scale, stageHeight, stageFlow, heightSlope[1].data(), flowSlope[1].data(), pool);
+		stage(h, third, 2);
+		adaptiveSlopes(network, scale, stageHeight, stageFlow, heightSlope[2].data(), flowSlope[2].data(), pool);
+		stage(h, solution, 3);
+		adaptiveSlopes(network, scale, stageHeight, stageFlow, heightSlope[3].data(), flowSlope[3].data(), pool);
+
+		// The difference between the third and the second order solution, relative to the tolerance. A vessel drained below 0 can't
+		// be accepted either.
+		size_t vesselPieces = network.awakeVessels.size();
+		forPieces(pool, network.awakeVessels, [&](int p, const IndexRun& piece)
+		{
+			float largest = 0.0f;
+			for (int i = piece.begin; i < piece.end; i++)
+			{
+				float slope = 0.0f;
+				for (int k = 0; k < 4; k++)
+				{
+					slope += error[k] * heightSlope[k][i];
+				}
+				largest = std::max(largest, stageHeight[i] < 0.0f ? INFINITY : std::fabs(h * slope));
+			}
+			adaptive.pieceError[p] = largest;
+		});
+		forPieces(pool, network.awakeTubes, [&](int p, const IndexRun& piece)
+		{
+			float largest = 0.0f;
+			for (int t = piece.begin; t < piece.end; t++)
+			{
+				float slope = 0.0f;
+				for (int k = 0; k < 4; k++)
+				{
+					slope += error[k] * flowSlope[k][t];
+				}
+				largest = std::max(largest, std::fabs(h * slope) * h * 0.5f * network.tubeStiffness[t]);
+			}
+			adaptive.pieceError[vesselPieces + p] = largest;
+		});
+		float norm = 0.0f;
+		for (float e : adaptive.pieceError)
+		{
+			norm = std::max(norm, e);
+		}
+		norm /= adaptive.tolerance;
+
+		if (h <= minSubstep && std::isinf(norm))
+		{
+			drainingSubstep(network, scale, h, pool);
+			adaptiveSlopes(network, scale, height, flow, heightSlope[0].data(), flowSlope[0].data(), pool);
+			remaining = last ? 0.0f : remaining - h;
+			adaptive.substeps++;
+			adaptive.drained++;
+		}
+		else if (norm <= 1.0f || h <= minSubstep)
+		{
+			forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+			{
+				std::copy(stageHeight + piece.begin, stageHeight + piece.end, height + piece.begin);
+			});
+			forPieces(pool, network.awakeTubes, [&](int, const IndexRun& piece)
+			{
+				std::copy(stageFlow + piece.begin, stageFlow + piece.end, flow + piece.begin);
+			});
+			std::swap(heightSlope[0], heightSlope[3]);
+			std::swap(flowSlope[0], flowSlope[3]);
+			remaining = last ? 0.0f : remaining - h;
+			adaptive.substeps++;
+		}
+		else
+		{
+			adaptive.rejected++;
+		}
+
+		// The error of a third order step grows with h^3. A drained vessel counts as an infinite error, which shrinks the substep as
+		// far as it goes.
+		float factor = norm > 0.0f ? std::min(5.0f, std::max(0.2f, 0.9f * std::pow(norm, -1.0f / 3.0f))) : 5.0f;
+		substep = std::max(minSubstep, h * factor);
+	}
+	adaptive.steps++;
+
+	// The same rest test as the other integrators, on the flows at the end of the step. What a tube moved is the average of its
+	// flow at both ends of the step, which is only used to find out what moved.
+	float restPressure = REST_HEIGHT * scale;
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const float* externalPressure = network.externalPressure.data();
+	network.pieceMoved.assign(network.awakeTubes.size(), 0);
+	forPieces(pool, network.awakeTubes, [&](int p, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			int a = tubeA[t];
+			int b = tubeB[t];
+			float difference = (height[b] * scale + externalPressure[b]) - (height[a] * scale + externalPressure[a]);
+			if (std::fabs(flow[t]) < REST_FLOW && std::fabs(difference) < restPressure)
+			{
+				flow[t] = 0.0f;
+				network.tubeChange[t] = 0.0f;
+				continue;
+			}
+			network.tubeChange[t] = 0.5f * (adaptive.startFlow[t] + flow[t]) * dt;
+			network.pieceMoved[p] |= network.tubeChange[t] != 0.0f;
+		}
+	});
+
+	bool moved = findMovedComponents(network, network.tubeChange.data());
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		for (int i = piece.begin; i < piece.end; i++)
+		{
+			network.pressure[i] = height[i] * scale;
+			network.top[i] = network.bottom[i] + height[i];
+		}
+	});
+	sleepResting(network);
+	network.preciseDirty = true;
+	return moved;
+}
+#pragma endregion Adaptive
+
+#pragma region Symplectic
+// Half a kick for INTEGRATOR_SYMPLECTIC: the damping decays the flow of every tube for half a step first, then the pressure
+// difference pushes it for half a step. The decay before the first kick and after the second makes the damping symmetric too.
+// The pressures of the awake vessels have to be up to date.
+static void symplecticKick(VesselNetwork& network, float halfStep, bool decayFirst, TaskPool* pool)
+{
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const float* pressure = network.pressure.data();
+	const float* externalPressure = network.externalPressure.data();
+	float* flow = network.tubeFlow.data();
+	forPieces(pool, network.awakeTubes, [&](int, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			int a = tubeA[t];
+			int b = tubeB[t];
+			float difference = (pressure[b] + externalPressure[b]) - (pressure[a] + externalPressure[a]);
+			float decay = std::exp(-network.tubeDamping[t] * halfStep);
+			float f = decayFirst ? flow[t] * decay : flow[t];
+			f += halfStep * difference * network.tubeInvInertance[t];
+			flow[t] = decayFirst ? f : f * decay;
+		}
+	});
+}
+
+// The step for INTEGRATOR_SYMPLECTIC, in single precision. The drift between the kicks has the same drain limits as the local
+// step, which only ever bite on a vessel that is about to run empty (and make that step not quite symplectic).
+static bool symplecticUpdate(VesselNetwork& network, float scale, float dt, TaskPool* pool)
+{
+	const SimdKernels& simd = simdKernels();
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const float* height = network.height.data();
+	const float* drainShare = network.drainShare.data();
+	float* flow = network.tubeFlow.data();
+	float* change = network.tubeChange.data();
+
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		simd.pressures(network.height.data() + piece.begin, network.pressure.data() + piece.begin, piece.end - piece.begin, scale);
+	});
+	symplecticKick(network, 0.5f * dt, true, pool);
+
+	network.pieceMoved.assign(network.awakeTubes.size(), 0);
+	forPieces(pool, network.awakeTubes, [&](int i, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			float volume = flow[t] * dt;
+			volume = std::min(volume, height[tubeB[t]] * drainShare[tubeB[t]]);
+			volume = std::max(volume, -(height[tubeA[t]] * drainShare[tubeA[t]]));
+			flow[t] = volume / dt;
+			change[t] = volume;
+			network.pieceMoved[i] |= volume != 0.0f;
+		}
+	});
+
+	bool moved = findMovedComponents(network, change);
+	if (moved)
+	{
+		bool compact = !network.compactTubes.empty();
+		forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+		{
+			if (piece.component >= 0 && !network.componentMoved[piece.component])
+			{
+				return;
+			}
+			if (compact)
+			{
+				gatherAndApply<true>(network, piece.begin, piece.end);
+			}
+			else
+			{
+				gatherAndApply<false>(network, piece.begin, piece.end);
+			}
+			simd.pressures(network.height.data() + piece.begin, network.pressure.data() + piece.begin, piece.end - piece.begin, scale);
+		});
+	}
+	symplecticKick(network, 0.5f * dt, false, pool);
+
+	// The same rest test as the local step, on the flows at the end of the step, so a network that has come to rest still falls
+	// asleep.
+	const float* pressure = network.pressure.data();
+	const float* externalPressure = network.externalPressure.data();
+	float restPressure = REST_HEIGHT * scale;
+	forPieces(pool, network.awakeTubes, [&](int, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			int a = tubeA[t];
+			int b = tubeB[t];
+			float difference = (pressure[b] + externalPressure[b]) - (pressure[a] + externalPressure[a]);
+			if (std::fabs(flow[t]) < REST_FLOW && std::fabs(difference) < restPressure)
+			{
+				flow[t] = 0.0f;
+			}
+		}
+	});
+
+	sleepResting(network);
+	network.preciseDirty = true;
+	return moved;
+}
+#pragma endregion Symplectic
+
+#pragma region Layered
+// The step for networks with several fluids. The phases are the same as in the single fluid step, with two differences: how
+// strongly a flow changes the pressures depends on the density of the fluid it carries, and the fluid has to be taken from the
+// bottom of one stack and put into the right layer of the other.
+static bool layeredUpdate(VesselNetwork& network, float gravity, float dt, TaskPool* pool)
+{
+	const int* tubeA = network.tubeA.data();
+	const int* tubeB = network.tubeB.data();
+	const int* start = network.vesselTubeStart.data();
+	const int* list = network.vesselTubes.data();
+	const float* width = network.width.data();
+	const float* height = network.height.data();
+	const float* pressure = network.pressure.data();
+	const float* externalPressure = network.externalPressure.data();
+	const float* bottomDensity = network.bottomDensity.data();
+	float* flow = network.tubeFlow.data();
+	float* change = network.tubeChange.data();
+	int fluids = network.fluidCount();
+
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		layeredPressures(network, piece.begin, piece.end, gravity);
+	});
+
+	// The tube carries the bottom fluid of the vessel it flows out of, which sets how fast the flow evens out the pressures.
+	// Apart from that this is the scalar tube kernel.
+	float dtSquaredGravity = dt * dt * gravity;
+	network.pieceMoved.assign(network.awakeTubes.size(), 0);
+	forPieces(pool, network.awakeTubes, [&](int i, const IndexRun& piece)
+	{
+		for (int t = piece.begin; t < piece.end; t++)
+		{
+			int a = tubeA[t];
+			int b = tubeB[t];
+			float difference = (pressure[b] + externalPressure[b]) - (pressure[a] + externalPressure[a]);
+			bool fromB = flow[t] != 0.0f ? flow[t] > 0.0f : difference > 0.0f;
+			float density = bottomDensity[fromB ? b : a];
+
+			float invInertance = network.tubeInvInertance[t];
+			float f = (flow[t] + dt * difference * invInertance)
+				/ (1.0f + dt * network.tubeDamping[t] + dtSquaredGravity * density * network.tubeStiffness[t] * invInertance);
+			if (std::fabs(f) < REST_FLOW && std::fabs(difference) < REST_HEIGHT * gravity * density)
+			{
+				f = 0.0f;
+			}
+
+			float volume = f * dt;
+			volume = std::min(volume, height[b] * network.drainShare[b]);
+			volume = std::max(volume, -(height[a] * network.drainShare[a]));
+
+			flow[t] = volume / dt;
+			change[t] = volume;
+			network.pieceMoved[i] |= volume != 0.0f;
+		}
+	});
+
+	bool moved = findMovedComponents(network, (const float*)change);
+	if (!moved)
+	{
+		sleepResting(network);
+		return false;
+	}
+
+	// Every vessel adds up what flows out of it and takes that from the bottom of its stack, densest fluid first.
+	float* out = network.outflow.data();
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		for (int i = piece.begin; i < piece.end; i++)
+		{
+			float volume = 0.0f;
+			for (int k = start[i]; k < start[i + 1]; k++)
+			{
+				int entry = list[k];
+				float c = change[entry >> 1];
+
+				// The volume flows out of the B end of a tube and into the A end.
+				volume += (entry & 1) ? std::max(c, 0.0f) : std::max(-c, 0.0f);
+			}
+			out[i] = volume;
+
+			float remaining = volume;
+			for (int k = 0; k < fluids; k++)
+			{
+				int f = network.fluidOrder[k];
+				float taken = std::min(remaining, network.layerHeight[f][i] * width[i]);
+				network.outflowShare[f][i] = volume > 0.0f ? taken / volume : 0.0f;
+				remaining -= taken;
+			}
+		}
+	});
+
+	// Then every vessel takes in what flows into it, made up like the outflow of the vessel it comes from, and rebuilds its height.
+	forPieces(pool, network.awakeVessels, [&](int, const IndexRun& piece)
+	{
+		for (int i = piece.begin; i < piece.end; i++)
+		{
+			float sum = 0.0f;
+			for (int f = 0; f < fluids; f++)
+			{
+				float volume = -out[i] * network.outflowShare[f][i];
+				for (int k = start[i]; k < start[i + 1]; k++)
+				{
+					int entry = list[k];
+					int t = entry >> 1;
+					float c = (entry & 1) ? -change[t] : change[t];
+					if (c > 0.0f)
+					{
+						int from = (entry & 1) ? tubeA[t] : tubeB[t];
+						volume += c * network.outflowShare[f][from];
+					}
+				}
+
+				float& layer = network.layerHeight[f][i];
+				layer = std::max(layer + volume / width[i], 0.0f);
+				sum += layer;
+			}
+
+			network.delta[i] = sum - network.height[i];
+			network.height[i] = sum;
+			network.top[i] = network.bottom[i] + sum;
+		}
+	});
+
+	sleepResting(network);
+	return true;
+}
+#pragma endregion Layered
+
+int VesselNetwork::rateComponents(float scale, float dt)
+{
+	if (topologyDirty)
+	{
+		rebuildTopology();
+	}
+
+	std::vector<float> fastest(componentCount, 0.0f);
+	for (int t = 0; t < tubeCount(); t++)
+	{
+		int a = tubeA[t];
+		int b = tubeB[t];
+		float speed = scale * tubeInvInertance[t] * (degree[a] / width[a] + degree[b] / width[b]);
+		int c = componentOf[a];
+		fastest[c] = std::max(fastest[c], speed);
+	}
+
+	int most = 1;
+	componentSubsteps.assign(componentCount, 1);
+	for (int c = 0; c < componentCount; c++)
+	{
+		float angle = std::sqrt(fastest[c]) * dt;
+		while (componentSubsteps[c] < MULTIRATE_MAX_SUBSTEPS && angle / componentSubsteps[c] > MULTIRATE_STEP_ANGLE)
+		{
+			componentSubsteps[c] *= 2;
+		}
+		most = std::max(most, componentSubsteps[c]);
+	}
+
+	rateVersion = topologyVersion;
+	rateDt = dt;
+	rateScale = scale;
+	return most;
+}
+
+// The multirate step: one rate after the other, the awake pieces are swapped for those of the awake components that take that many
+// substeps, and the local step runs that many times over just them. All of them end up at the end of the step together.
+static bool multirateUpdate(VesselNetwork& network, float scale, float dt, TaskPool* pool)
+{
+	if (network.rateVersion != network.topologyVersion || network.rateDt != dt || network.rateScale != scale)
+	{
+		network.rateComponents(scale, dt);
+	}
+
+	std::vector<IndexRun> awakeVessels;
+	std::vector<IndexRun> awakeTubes;
+	std::vector<int> awakeComponents;
+	awakeVessels.swap(network.awakeVessels);
+	awakeTubes.swap(network.awakeTubes);
+	awakeComponents.swap(network.awakeComponents);
+
+	bool moved = false;
+	for (int substeps = 1; substeps <= MULTIRATE_MAX_SUBSTEPS; substeps *= 2)
+	{
+		network.rateAwake.assign(network.componentCount, 0);
+		network.awakeComponents.clear();
+		for (int c : awakeComponents)
+		{
+			if (network.componentSubsteps[c] == substeps)
+			{
+				network.rateAwake[c] = 1;
+				network.awakeComponents.push_back(c);
+			}
+		}
+		if (network.awakeComponents.empty())
+		{
+			continue;
+		}
+
+		awakePieces(network.vesselRuns, network.rateAwake, network.parallelBlock, network.awakeVessels);
+		awakePieces(network.tubeRuns, network.rateAwake, network.parallelBlock, network.awakeTubes);
+		for (int s = 0; s < substeps; s++)
+		{
+			moved |= network.stepAwake(scale, dt / substeps, pool);
+		}
+	}
+
+	// Whatever fell asleep set awakeDirty, which rebuilds the lists from componentAwake before the next step.
+	awakeVessels.swap(network.awakeVessels);
+	awakeTubes.swap(network.awakeTubes);
+	awakeComponents.swap(network.awakeComponents);
+	return moved;
+}
+
+bool VesselNetwork::update(float density, float gravity, float dt, TaskPool* pool)
+{
+	int vessels = vesselCount();
+
+	if (topologyDirty)
+	{
+		rebuildTopology();
+	}
+	if (awakeDirty)
+	{
+		awakePieces(vesselRuns, componentAwake, parallelBlock, awakeVessels);
+		awakePieces(tubeRuns, componentAwake, parallelBlock, awakeTubes);
+		awakeComponents.clear();
+		for (int c = 0; c < componentCount; c++)
+		{
+			if (componentAwake[c])
+			{
+				awakeComponents.push_back(c);
+			}
+		}
+		awakeDirty = false;
+	}
+
+	// The whole network is asleep, so nothing can move.
+	if (awakeVessels.empty())
+	{
+		return false;
+	}
+
+	float scale = gravity * density;
+
+	// Small networks (like the classic two container apparatus) run every phase on this thread. Large ones hand every piece to the
+	// pool as its own block.
+	TaskPool* piecePool = (pool != nullptr && vessels >= parallelMinimum) ? pool : nullptr;
+
+	if (layered())
+	{
+		return layeredUpdate(*this, gravity, dt, piecePool);
+	}
+	if (integrator == INTEGRATOR_ADAPTIVE)
+	{
+		return adaptiveUpdate(*this, scale, dt, piecePool);
+	}
+	if (integrator == INTEGRATOR_SYMPLECTIC)
+	{
+		return symplecticUpdate(*this, scale, dt, piecePool);
+	}
+	if (precision == PRECISION_MIXED)
+	{
+		return preciseUpdate<float>(*this, scale, dt, piecePool);
+	}
+	if (precision == PRECISION_DOUBLE)
+	{
+		return preciseUpdate<double>(*this, scale, dt, piecePool);
+	}
+	if (precision == PRECISION_FIXED_POINT)
+	{
+		return fixedPointUpdate(*this, scale, dt, piecePool);
+	}
+	if (multirate && integrator == INTEGRATOR_LOCAL && scatter == SCATTER_GATHER)
+	{
+		return multirateUpdate(*this, scale, dt, piecePool);
+	}
+	return stepAwake(scale, dt, piecePool);
+}
+
+bool VesselNetwork::stepAwake(float scale, float dt, TaskPool* piecePool)
+{
+	const SimdKernels& simd = simdKernels();
+
+	// A running pump has no inertance, so its flow only changes if the drain limits cut it in the last step.
+	for (int t : runningPumps)
+	{
+		tubeFlow[t] = tubeSetting[t];
+	}
+
+	TubeFlowData tubeData;
+	tubeData.tubeA = tubeA.data();
+	tubeData.tubeB = tubeB.data();
+	tubeData.invInertance = tubeInvInertance.data();
+	tubeData.damping = tubeDamping.data();
+	tubeData.stiffness = tubeStiffness.data();
+	tubeData.flow = tubeFlow.data();
+	tubeData.change = tubeChange.data();
+
+	VesselFlowData vesselData;
+	vesselData.height = height.data();
+	vesselData.pressure = pressure.data();
+	vesselData.externalPressure = externalPressure.data();
+	vesselData.drainShare = drainShare.data();
+
+	FlowStep step;
+	step.dt = dt;
+	step.dtSquaredScale = dt * dt * scale;
+	step.restFlow = REST_FLOW;
+	step.restPressure = REST_HEIGHT * scale;
+
+	// With timing set, every phase adds the time (and the counts) since the end of the one before it.
+	std::chrono::steady_clock::time_point phaseStart;
+	CounterSample phaseSample;
+	bool counting = timing != nullptr && timing->counters != nullptr && timing->counters->read(phaseSample);
+	auto endPhase = [&](double UpdateTimes::* total, UpdatePhase phase)
+	{
+		if (timing != nullptr)
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			timing->*total += std::chrono::duration<double>(now - phaseStart).count();
+			phaseStart = now;
+		}
+		CounterSample sample;
+		if (counting && timing->counters->read(sample))
+		{
+			timing->phaseCounters[phase].addDifference(phaseSample, sample);
+			phaseSample = sample;
+		}
+	};
+	if (timing != nullptr)
+	{
+		phaseStart = std::chrono::steady_clock::now();
+		timing->steps++;
+	}
+
+	// Each phase needs the previous one to be completely done, since tubes read pressures of any vessel and vessels read changes
+	// of any tube. Sleeping vessels keep the pressure they had when they fell asleep, which is still right.
+	forPieces(piecePool, awakeVessels, [&](int, const IndexRun& piece)
+	{
+		simd.pressures(height.data() + piece.begin, pressure.data() + piece.begin, piece.end - piece.begin, scale);
+	}, timing);
+	endPhase(&UpdateTimes::pressure, UPDATE_PRESSURE);
+
+	// With DRAIN_OUTFLOW the shares follow from the pressures just worked out. This counts towards the flow phase.
+	if (drainLimit == DRAIN_OUTFLOW && integrator == INTEGRATOR_LOCAL)
+	{
+		stepDrainShare.resize(vesselCount());
+		forPieces(piecePool, awakeVessels, [&](int, const IndexRun& piece)
+		{
+			outflowShares(*this, dt, piece.begin, piece.end);
+		}, timing);
+		vesselData.drainShare = stepDrainShare.data();
+	}
+
+	// Every tube works out its new flow from the difference in pressure between its ends, and how much volume that moves in this
+	// step. If the tube is at rest, or would take more than its share of a vessel, it moves less (or nothing). Every piece
+	// remembers if one of its tubes moved. The implicit solve spreads its own work across the pool.
+	pieceMoved.assign(awakeTubes.size(), 0);
+	if (integrator == INTEGRATOR_IMPLICIT)
+	{
+		implicitFlows(*this, step, scale, piecePool);
+		forPieces(piecePool, awakeTubes, [&](int i, const IndexRun& piece)
+		{
+			for (int t = piece.begin; t < piece.end && !pieceMoved[i]; t++)
+			{
+				pieceMoved[i] = tubeChange[t] != 0.0f;
+			}
+		}, timing);
+	}
+	else
+	{
+		forPieces(piecePool, awakeTubes, [&](int i, const IndexRun& piece)
+		{
+			pieceMoved[i] = simd.tubeFlows(tubeData, piece.begin, piece.end, vesselData, step);
+		}, timing);
+	}
+
+	// Check valves drop what would flow back from A to B. Both ends read the same change, so nothing is lost. (A component that a
+	// check valve is holding back never counts as at rest, so it stays awake.)
+	for (int t : checkValves)
+	{
+		tubeChange[t] = tubeChange[t] > 0.0f ? tubeChange[t] : 0.0f;
+		tubeFlow[t] = tubeFlow[t] > 0.0f ? tubeFlow[t] : 0.0f;
+	}
+	endPhase(&UpdateTimes::flow, UPDATE_FLOW);
+
+	bool moved = findMovedComponents(*this, tubeChange.data());
+	endPhase(&UpdateTimes::reduction, UPDATE_REDUCTION);
+
+	// Apply the gathered changes and move the top edge of every vessel to the new fluid level. In components that didn't move the
+	// changes are all 0, so only whole pieces of them are skipped.
+	// The colored scatter always runs over every tube, which adds nothing to the sleeping vessels (their tubes moved nothing).
+	if (scatter == SCATTER_COLORED && colorVersion != topologyVersion)
+	{
+		tubeColors();
+	}
+	if (moved && scatter == SCATTER_COLORED && !colorPieces.empty())
+	{
+		forPieces(piecePool, awakeVessels, [&](int, const IndexRun& piece)
+		{
+			std::fill(delta.begin() + piece.begin, delta.begin() + piece.end, 0.0f);
+		}, timing);
+		for (const std::vector<IndexRun>& pieces : colorPieces)
+		{
+			forPieces(piecePool, pieces, [&](int, const IndexRun& piece)
+			{
+				scatterColor(*this, piece.begin, piece.end);
+			}, timing);
+		}
+		forPieces(piecePool, awakeVessels, [&](int, const IndexRun& piece)
+		{
+			if (piece.component < 0 || componentMoved[piece.component])
+			{
+				for (int i = piece.begin; i < piece.end; i++)
+				{
+					delta[i] /= width[i];
+				}
+				simd.apply(height.data() + piece.begin, delta.data() + piece.begin, bottom.data() + piece.begin, top.data() + piece.begin,
+					piece.end - piece.begin);
+				applyProfiles(*this, piece.begin, piece.end);
+			}
+		}, timing);
+	}
+	else if (moved)
+	{
+		bool compact = !compactTubes.empty();
+		forPieces(piecePool, awakeVessels, [&](int, const IndexRun& piece)
+		{
+			if (piece.component >= 0 && !componentMoved[piece.component])
+			{
+				return;
+			}
+			if (compact)
+			{
+				gatherAndApply<true>(*this, piece.begin, piece.end);
+			}
+			else
+			{
+				gatherAndApply<false>(*this, piece.begin, piece.end);
+			}
+			applyProfiles(*this, piece.begin, piece.end);
+		}, timing);
+	}
+	endPhase(&UpdateTimes::apply, UPDATE_APPLY);
+
+	sleepResting(*this);
+	endPhase(&UpdateTimes::reduction, UPDATE_REDUCTION);
+	return moved;
+}
+
+void VesselNetwork::setExternalPressure(int vessel, float value)
+{
+	if (externalPressure[vessel] != value)
+	{
+		externalPressure[vessel] = value;
+		wake(vessel);
+	}
+}
+
+void VesselNetwork::wake(int vessel)
+{
+	// Before the first update there is no topology yet, and everything starts awake anyway.
+	if (topologyDirty)
+	{
+		return;
+	}
+
+	char& awake = componentAwake[componentOf[vessel]];
+	if (!awake)
+	{
+		awake = 1;
+		awakeDirty = true;
+	}
+}
+
+void VesselNetwork::setParallelSplit(int block, int minimum)
+{
+	parallelBlock = std::max(1, block);
+	parallelMinimum = minimum;
+
+	// The colors are cut into pieces when they are built, so they are built again.
+	awakeDirty = true;
+	colorVersion = -1;
+}
+
+void VesselNetwork::wakeAll()
+{
+	std::fill(componentAwake.begin(), componentAwake.end(), 1);
+	awakeDirty = true;
+	preciseDirty = true;
+}
+
+double VesselNetwork::totalVolume() const
+{
+	bool precise = precision != PRECISION_SINGLE && !preciseDirty;
+	double volume = 0.0;
+	if (precise && precision == PRECISION_FIXED_POINT)
+	{
+		Fixed sum = 0;
+		for (Fixed v : fixedVolume)
+		{
+			sum += v;
+		}
+		return fromFixed(sum);
+	}
+	for (int i = 0; i < vesselCount(); i++)
+	{
+		volume += profiled() && vesselProfile[i] >= 0 ? vesselVolume(i) : (precise ? preciseHeight[i] : (double)height[i]) * width[i];
+	}
+	return volume;
+}
+
+double VesselNetwork::energy(float density, float gravity) const
+{
+	double total = 0.0;
+	for (int t = 0; t < tubeCount(); t++)
+	{
+		total += tubeInvInertance[t] > 0.0f ? 0.5 * (double)tubeFlow[t] * tubeFlow[t] / tubeInvInertance[t] : 0.0;
+	}
+	if (!layered())
+	{
+		double scale = (double)density * gravity;
+		for (int i = 0; i < vesselCount(); i++)
+		{
+			double h = height[i];
+			total += width[i] * (0.5 * scale * h * h + externalPressure[i] * h);
+		}
+	}
+	return total;
+}
+
+bool VesselNetwork::equilibriumHeights(float density, float gravity, std::vector<float>& result)
+{
+	if (layered() || profiled())
+	{
+		return false;
+	}
+
+	if (topologyDirty)
+	{
+		rebuildTopology();
+	}
+
+	int vessels = vesselCount();
+	double scale = (double)gravity * density;
+
+	// The volume of every component never changes.
+	std::vector<double> volume(componentCount, 0.0);
+	for (int i = 0; i < vessels; i++)
+	{
+		volume[componentOf[i]] += (double)height[i] * width[i];
+	}
+
+	// At rest, every vessel i of a component that still holds fluid has scale * h[i] + external[i] = P, and the volume is
+	// the sum of width[i] * h[i]. Together that gives P = (scale * volume + sum of width * external) / (sum of width).
+	// Vessels that would need a negative height for that are empty instead; leaving them out lowers P, which may empty more
+	// vessels, so repeat until none change.
+	std::vector<char> empty(vessels, 0);
+	std::vector<double> sumWidth(componentCount);
+	std::vector<double> sumExternal(componentCount);
+	std::vector<double> level(componentCount);
+	result.resize(vessels);
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		std::fill(sumWidth.begin(), sumWidth.end(), 0.0);
+		std::fill(sumExternal.begin(), sumExternal.end(), 0.0);
+		for (int i = 0; i < vessels; i++)
+		{
+			if (!empty[i])
+			{
+				sumWidth[componentOf[i]] += width[i];
+				sumExternal[componentOf[i]] += (double)width[i] * externalPressure[i];
+			}
+		}
+		for (int c = 0; c < componentCount; c++)
+		{
+			level[c] = sumWidth[c] > 0.0 ? (scale * volume[c] + sumExternal[c]) / sumWidth[c] : 0.0;
+		}
+
+		for (int i = 0; i < vessels; i++)
+		{
+			if (empty[i])
+			{
+				continue;
+			}
+
+			double h = (level[componentOf[i]] - externalPressure[i]) / scale;
+			if (h < 0.0)
+			{
+				empty[i] = 1;
+				changed = true;
+				h = 0.0;
+			}
+			result[i] = (float)h;
+		}
+	}
+
+	for (int i = 0; i < vessels; i++)
+	{
+		if (empty[i])
+		{
+			result[i] = 0.0f;
+		}
+	}
+	return true;
+}
+
+bool VesselNetwork::settle(float density, float gravity)
+{
+	if (!equilibriumHeights(density, gravity, height))
+	{
+		return false;
+	}
+	for (int i = 0; i < vesselCount(); i++)
+	{
+		top[i] = bottom[i] + height[i];
+	}
+	std::fill(tubeFlow.begin(), tubeFlow.end(), 0.0f);
+	computePressures(density, gravity);
+	wakeAll();
+	return true;
+}
+
+size_t VesselNetwork::placeMemory(const TaskPool* pool, bool hugePages)
+{
+	if (topologyDirty)
+	{
+		rebuildTopology();
+	}
+
+	// Every thread is dealt a contiguous stretch of the pieces, which covers about the same share of the vessels or tubes.
+	int threads = pool != nullptr && pool->pinned() ? pool->threadCount() : 1;
+	size_t moved = 0;
+	auto place = [&](auto& values)
+	{
+		size_t size = sizeof(values[0]);
+		if (hugePages)
+		{
+			adviseHugePages(values.data(), values.size() * size);
+		}
+		for (int t = 0; t < threads && threads > 1; t++)
+		{
+			size_t begin = (size_t)TaskPool::firstBlock(t, threads, (int)values.size());
+			size_t end = (size_t)TaskPool::firstBlock(t + 1, threads, (int)values.size());
+			if (end > begin && moveToNode(values.data() + begin, (end - begin) * size, pool->threadNode(t)))
+			{
+				moved += (end - begin) * size;
+			}
+		}
+	};
+
+	place(height);
+	place(width);
+	place(pressure);
+	place(externalPressure);
+	place(bottom);
+	place(top);
+	place(delta);
+	place(drainShare);
+	place(componentOf);
+	place(vesselTubeStart);
+	place(vesselTubes);
+	place(vesselTubeBase);
+	place(compactTubes);
+	place(tubeA);
+	place(tubeB);
+	place(tubeInvInertance);
+	place(tubeDamping);
+	place(tubeFlow);
+	place(tubeStiffness);
+	place(tubeChange);
+	return moved;
+}
@@ -0,0 +1,518 @@
+/*
+Title: HydroDynamics
+File Name: VesselNetwork.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A network of communicating vessels. Any number of rectangular vessels can be connected
+by tubes at their bottoms, and the fluid levels of connected vessels move towards the
+height where the pressure at the bottom of every tube is the same on both ends.
+
+Every tube carries a flow of fluid that is driven by the difference in pressure between its
+two ends and slowed down by viscous friction along the tube. The fluid in the tube has
+mass, so the levels overshoot and oscillate around the equilibrium, with every swing a
+little smaller than the one before, just like a real U-tube. The flow is integrated
+implicitly with the real time step, so the motion is the same at any step size, and even
+very large steps stay stable.
+
+A vessel either holds a single fluid, whose density is passed to update(), or, once fluids
+have been added with addFluid(), a stack of layers of different fluids that don't mix. The
+densest fluid sits at the bottom, so that is the one the tubes carry away, and whatever
+arrives through a tube joins the layer of its own fluid. The pressure at the bottom is the
+sum over the layers of density * gravity * layer height.
+
+The data is stored as a structure of arrays: instead of one struct per vessel, every
+attribute (height, width, pressure, ...) has its own contiguous array, indexed by the
+vessel number. The update loop only touches the arrays it actually needs, so it streams
+through memory and the compiler is free to vectorize it.
+
+What only some vessels or tubes have (a profile, a valve or a pump, the layers of other
+fluids) is stored the same way, as arrays of their own that are only allocated once the
+first one is added, next to a packed list of the vessels or tubes that have it
+(profiledVessels, checkValves, runningPumps). A loop over them walks that list instead of
+testing every element, and a network without them pays nothing for them. A new kind of
+object on the apparatus belongs in here like that, not in a struct of its own: that keeps
+every loop over it dense, and removing, reordering and checkpointing the network keep it in
+step with the rest.
+
+Removing a vessel or a tube moves the last one into its place, so the arrays stay packed and
+the indices of the last one change. Anything that has to keep referring to a vessel or tube
+while the network is edited holds a Handle instead (see HandleTable.h).
+
+This file has no OpenGL dependency, so the simulation can run without a window.
+*/
+
+#ifndef _VESSEL_NETWORK_H
+#define _VESSEL_NETWORK_H
+
+#include <cstddef>
+#include <vector>
+#include "ImplicitSolver.h"
+#include "HardwareCounters.h"
+#include "HandleTable.h"
+#include "VesselProfile.h"
+#include "TubeComponents.h"
+#include "FixedPoint.h"
+
+// The defaults for new tubes. Inertance is how much the mass of the fluid in the tube resists a change in flow (it grows with
+// the length of the tube and shrinks with its cross section). Damping is the viscous friction divided by the inertance, in 1 / s.
+// For the classic apparatus these give a swing of about 1.5 s that dies down over several periods.
+#define DEFAULT_TUBE_INERTANCE 3.7f
+#define DEFAULT_TUBE_DAMPING 0.8f
+
+// Below these, a tube counts as being at rest: its flow is set to exactly 0, so the network really stops instead of creeping
+// forever at the limit of float precision. The pressure threshold is a difference in height, so it is multiplied by density * gravity.
+#define REST_FLOW 1e-6f
+#define REST_HEIGHT 1e-6f
+
+class TaskPool;
+
+// Which type the state is kept in.
+enum Precision
+{
+	PRECISION_SINGLE = 0,	// Everything in float, using the SIMD kernels. The fastest, but every step rounds the heights a little, which adds up
+							// over long runs.
+	PRECISION_MIXED,		// Pressures and flows in float, heights added up in double. Almost as fast, and the heights don't drift.
+	PRECISION_DOUBLE,		// Everything in double
+	PRECISION_FIXED_POINT	// Everything in Q32.32 integers (see FixedPoint.h), which gives the same bits on every machine. Always the local
+							// integrator, on a single fluid in rectangular vessels.
+};
+
+// The indices begin to end - 1, which all belong to the same component.
+struct IndexRun
+{
+	int begin;
+	int end;
+	int component;
+};
+
+// How the flows through the tubes are advanced every step.
+enum Integrator
+{
+	INTEGRATOR_LOCAL = 0,	// Every tube on its own. Cheap, and exact for a single tube, but can overshoot on stiff networks.
+	INTEGRATOR_IMPLICIT,	// All tubes solved together (see ImplicitSolver.h). Stable at any step size.
+	INTEGRATOR_ADAPTIVE,	// Heights and flows integrated together with an embedded Runge-Kutta pair (Bogacki-Shampine 3(2)), in as
+							// many substeps as the error estimate asks for (see AdaptiveStepping). Always single precision.
+	INTEGRATOR_SYMPLECTIC	// Leapfrog (kick, drift, kick) of heights and flows, which keeps the energy of an undamped network over any
+							// number of steps instead of letting it drift. Damping is applied exactly on both sides of it.
+};
+
+// A step of INTEGRATOR_ADAPTIVE is cut into at most this many substeps. The shortest substep is taken even if its error is too big.
+// A substep that would still drain a vessel below 0 at that length is taken by the local tube step instead, whose drain limits keep
+// the volume.
+#define ADAPTIVE_MAX_SUBSTEPS 1024
+
+// What the adaptive integrator needs from one substep to the next. Every step starts by trying the whole step at once, so a step
+// only depends on the state of the network, which keeps checkpoints and replays exact. A calm network takes that one substep,
+// while a transient (like the piston pushing in) is cut into as many as it needs.
+struct AdaptiveStepping
+{
+	// The largest error the error estimate may show for the height of any vessel in one substep, in m. A tube's flow counts with
+	// the difference in height its error would make over the substep.
+	float tolerance = 1e-5f;
+
+	// Added up over every step, so the caller can see what the steps cost.
+	long long steps = 0;
+	long long substeps = 0;
+	long long rejected = 0;
+	long long drained = 0;		// Substeps taken by the local tube step (see ADAPTIVE_MAX_SUBSTEPS)
+
+	// Scratch, per vessel and per tube: the state of the current stage and the slopes of the four stages (the last of which is the
+	// first of the next substep), and the largest error of every piece.
+	std::vector<float> stageHeight;
+	std::vector<float> stageFlow;
+	std::vector<float> heightSlope[4];
+	std::vector<float> flowSlope[4];
+	std::vector<float> startFlow;
+	std::vector<float> pieceError;
+};
+
+// With multirate set, every component of the local step takes 1, 2, 4 ... up to this many substeps per step, as many as keep
+// (substep length) * (the fastest swing of the component, in rad / s) below MULTIRATE_STEP_ANGLE.
+#define MULTIRATE_MAX_SUBSTEPS 64
+#define MULTIRATE_STEP_ANGLE 0.5f
+
+// How the volumes the tubes moved get into the vessels they connect.
+enum TubeScatter
+{
+	SCATTER_GATHER = 0,		// Every vessel adds up the changes of its own tubes through vesselTubes.
+	SCATTER_COLORED			// The tubes are colored so that no two tubes of one color share a vessel (see tubeColors), and each color
+							// adds its changes straight into both ends of its tubes. The vessels add up their tubes in color order, so
+							// the result is not bit for bit the gathered one (but still doesn't depend on the pool).
+};
+
+// How much of a vessel a tube may take in one step.
+enum DrainLimit
+{
+	DRAIN_EVEN = 0,		// drainShare: every tube of a vessel gets the same share of it, whichever way it flows.
+	DRAIN_OUTFLOW		// Only the tubes that drain the vessel in this step share it, so a vessel that one of its tubes drains can empty
+						// into that tube in one step, however many tubes it has. The same clamps, so still branch free and exactly
+						// conserving. Only the local step in single precision (with or without multirate) has it.
+};
+
+// How far apart the entries of one vessel's tube list may be for the 16 bit lists.
+#define COMPACT_TUBE_RANGE 65536
+
+// At most this many colors (one bit each) are tried for SCATTER_COLORED. A network that needs more (every vessel with more than
+// SCATTER_MAX_COLORS / 2 tubes can need them) is gathered instead, since a pass per color would cost more than it saves.
+#define SCATTER_MAX_COLORS 64
+
+// Networks smaller than PARALLEL_MIN_VESSELS are stepped on one thread, since handing out blocks would cost more than it saves.
+// Every block covers PARALLEL_BLOCK_SIZE vessels or tubes, which is big enough to amortize the scheduling and small enough to
+// leave plenty of blocks to steal. They are the defaults of VesselNetwork::parallelMinimum and parallelBlock (see Autotune.h).
+#define PARALLEL_MIN_VESSELS 8192
+#define PARALLEL_BLOCK_SIZE 4096
+
+// Where update() spends its time, added up over every step while VesselNetwork::timing points at one. The phases are timed on the
+// thread calling update(), so each of them counts how long the whole network waited for it. Inside the phases that run on the pool,
+// every piece is timed too, and busy counts those times on every thread together, so with n threads, n * parallel - busy is the
+// time threads spent waiting for each other (or for a block to steal) at the end of those phases.
+// With counters set (and open), the hardware counters of every phase are added up too, on the thread calling update() only.
+// Only the single precision step is timed this way.
+enum UpdatePhase
+{
+	UPDATE_PRESSURE = 0,
+	UPDATE_FLOW,
+	UPDATE_REDUCTION,
+	UPDATE_APPLY,
+	UPDATE_PHASES
+};
+
+struct UpdateTimes
+{
+	double pressure = 0.0;		// Seconds working out the pressures
+	double flow = 0.0;			// The flows of the tubes and the volumes they move (or the implicit solve)
+	double reduction = 0.0;		// Finding out which components moved and putting the others to sleep, on one thread
+	double apply = 0.0;			// Gathering the volumes into every vessel and moving its level
+	double parallel = 0.0;		// The part of the above that ran as pieces on the pool
+	double busy = 0.0;			// Seconds spent inside those pieces, over all threads
+	long long steps = 0;
+	HardwareCounters* counters = nullptr;
+	CounterSample phaseCounters[UPDATE_PHASES];
+};
+
+struct VesselNetwork
+{
+	// Per vessel data. Every array has one entry per vessel.
+	std::vector<float> height;				// Height of the fluid column
+	std::vector<float> width;				// Width of the cross section
+	std::vector<float> pressure;			// Pressure at the bottom caused by the fluid column only
+	std::vector<float> externalPressure;	// Pressure pushed onto the surface from outside (e.g. a piston)
+
+	// Fluids, for stratified vessels. Empty unless addFluid() was called. layerHeight[f][i] is how high fluid f stands in vessel i,
+	// and height[i] is the sum of all layers. fluidOrder lists the fluids from the densest (at the bottom of every vessel) to the
+	// lightest.
+	std::vector<float> fluidDensity;
+	std::vector<std::vector<float>> layerHeight;
+	std::vector<int> fluidOrder;
+
+	// Profiles, for vessels that aren't rectangles (see VesselProfile.h). Empty unless setProfile() was called. vesselProfile[i] is
+	// the profile of vessel i, or -1 if it is a rectangle. A profiled vessel keeps its width for what the tubes see of it (their
+	// stiffness and drain limits, as if it were a rectangle of that width) and for drawing it; only its level follows the profile.
+	// A drain limit can then let a vessel that is narrower at the bottom run slightly dry, in which case its level stops at 0.
+	// profiledVessels lists the profiled vessels in increasing order and profiledProfile their profiles, for the apply phase.
+	// Both are rebuilt with the topology.
+	// Only the single precision local and implicit steps (and multirate) follow the profiles. The others, and energy(), treat a
+	// profiled vessel as a rectangle.
+	VesselProfiles profiles;
+	std::vector<int> vesselProfile;
+	std::vector<int> profiledVessels;
+	std::vector<int> profiledProfile;
+
+	// Components on tubes (see TubeComponents.h). Empty unless setComponent() was called. tubeComponent[t] is what sits on tube t,
+	// tubeSetting[t] the opening of its valve or the flow of its pump (0 while the pump is stopped), and tubeBaseInvInertance[t] and
+	// tubeBaseDamping[t] what the tube has on its own, which a valve scales and a pump gives back when it stops. checkValves and
+	// runningPumps list those tubes in increasing order for the step. Both are rebuilt with the topology, and runningPumps
+	// also whenever a pump starts or stops. schedule holds the changes queued for later steps, which runSchedule() applies.
+	// Only the local step in single precision (with or without multirate) knows about check valves and pumps.
+	std::vector<int> tubeComponent;
+	std::vector<float> tubeSetting;
+	std::vector<float> tubeBaseInvInertance;
+	std::vector<float> tubeBaseDamping;
+	std::vector<int> checkValves;
+	std::vector<int> runningPumps;
+	TubeSchedule schedule;
+
+	// Scratch for the layered step: per vessel, the density of the fluid at its bottom, the volume flowing out of it in this step,
+	// and for every fluid the fraction of that volume it makes up.
+	std::vector<float> bottomDensity;
+	std::vector<float> outflow;
+	std::vector<std::vector<float>> outflowShare;
+
+	// Per vessel rendering data. The left and right walls and the floor never move, only top changes with the height.
+	std::vector<float> left;
+	std::vector<float> right;
+	std::vector<float> bottom;
+	std::vector<float> top;
+
+	// Per tube data. A tube connects the bottoms of vessel tubeA[i] and vessel tubeB[i].
+	std::vector<int> tubeA;
+	std::vector<int> tubeB;
+
+	// Per tube physical properties (see DEFAULT_TUBE_INERTANCE), and the flow through every tube from B to A, which is the
+	// state the simulation carries from one step to the next.
+	std::vector<float> tubeInvInertance;
+	std::vector<float> tubeDamping;
+	std::vector<float> tubeFlow;
+
+	// The number of tubes connected to each vessel, and the change in height gathered for each vessel during update().
+	std::vector<int> degree;
+	std::vector<float> delta;
+
+	// Derived from the vessels and tubes, and rebuilt whenever a tube was added:
+	// drainShare[i] = width[i] / degree[i], so no tube can take more than its share of the fluid in a vessel in one step and the
+	// tubes together can never drain it below zero. tubeStiffness[t] = 1 / widthA + 1 / widthB, which is how fast the pressure
+	// difference of a tube shrinks as fluid flows through it.
+	std::vector<float> drainShare;
+	std::vector<float> tubeStiffness;
+
+	// With DRAIN_OUTFLOW, stepDrainShare[i] is the share of vessel i in the current step: its width split evenly between the tubes
+	// that drain it. Worked out by every awake vessel for itself before the tubes move (see outflowShares()).
+	DrainLimit drainLimit = DRAIN_EVEN;
+	std::vector<float> stepDrainShare;
+
+	// The volume each tube moved from B to A during update().
+	std::vector<float> tubeChange;
+	bool topologyDirty = true;
+	int topologyVersion = 0;	// Counts the rebuilds, so anything cached about the topology (like the solver's matrix) knows when it is stale
+	int tubeVersion = 0;		// Counts the changes to the inertance or damping of a tube in between, for the values of the solver's matrix
+
+	Integrator integrator = INTEGRATOR_LOCAL;
+	ImplicitSolver solver;
+	AdaptiveStepping adaptive;
+
+	// With PRECISION_MIXED or PRECISION_DOUBLE, update() keeps the state in these and rounds it into the float arrays above after
+	// every step, so everything that reads the network (rendering, output) keeps working on floats. They start as copies of the
+	// float arrays, and are copied again after wakeAll(). precisePressure, preciseFlow and preciseChange are only used with
+	// PRECISION_DOUBLE.
+	Precision precision = PRECISION_SINGLE;
+	std::vector<double> preciseHeight;
+	std::vector<double> precisePressure;
+	std::vector<double> preciseFlow;
+	std::vector<double> preciseChange;
+	bool preciseDirty = true;
+
+	// With PRECISION_FIXED_POINT, the state is the volume of every vessel and the flow of every tube in fixed point, and the float
+	// arrays are rounded from it after every step. Like the precise arrays, it starts from the float state and is copied from it
+	// again when preciseDirty is set. fixedInvWidth, fixedKeep and fixedGain are worked out from the parameters whenever that
+	// happens or the step (fixedDt, fixedScale) changes, see fixedCoefficients().
+	std::vector<Fixed> fixedVolume;
+	std::vector<Fixed> fixedFlow;
+	std::vector<Fixed> fixedChange;
+	std::vector<Fixed> fixedPressure;	// With the external pressure
+	std::vector<Fixed> fixedDrain;		// The most volume a tube may take out of the vessel in one step, volume / degree
+	std::vector<Fixed> fixedInvWidth;
+	std::vector<Fixed> fixedKeep;
+	std::vector<Fixed> fixedGain;
+	float fixedDt = 0.0f;
+	float fixedScale = 0.0f;
+	std::vector<float> tubeDifference;	// The pressure difference of every tube at the start of the step, for the implicit solve
+
+	// For every vessel, the tubes connected to it in compressed form: the tubes of vessel i are
+	// vesselTubes[vesselTubeStart[i]] to vesselTubes[vesselTubeStart[i + 1] - 1]. Each entry is tube * 2, plus 1 if the vessel
+	// is the B end of the tube. This lets every vessel collect its own changes, so vessels can be processed in parallel.
+	std::vector<int> vesselTubeStart;
+	std::vector<int> vesselTubes;
+
+	// The same lists in half the space, which is what the single precision step gathers through: entry k of vessel i is
+	// vesselTubeBase[i] + compactTubes[k]. They are only built if the entries of every vessel are less than COMPACT_TUBE_RANGE
+	// apart, which a network whose connected vessels are close in memory (see NetworkOrder.h) always is. Otherwise compactTubes
+	// stays empty and the step reads vesselTubes.
+	std::vector<int> vesselTubeBase;
+	std::vector<unsigned short> compactTubes;
+
+	// For SCATTER_COLORED: the tubes grouped by color, every color in increasing order of tube, with both ends copied next to them
+	// so a color streams through three arrays. colorPieces[c] cuts color c into blocks for the pool. Built by update() the first time
+	// it needs them after the topology changed; colorVersion is the topologyVersion they were built for.
+	TubeScatter scatter = SCATTER_GATHER;
+	std::vector<int> colorTubes;
+	std::vector<int> colorA;
+	std::vector<int> colorB;
+	std::vector<std::vector<IndexRun>> colorPieces;
+	int colorVersion = -1;
+
+	// Vessels that are connected through tubes (directly or through other vessels) belong to the same component.
+	// Different components can never affect each other.
+	std::vector<int> componentOf;
+	int componentCount = 0;
+
+	// A component where no tube moved in a step is exactly where it will be in the next step too, unless something from outside
+	// changes it. So it falls asleep and update() skips it until it is woken up by setExternalPressure() or wake(). This pays off
+	// most if the vessels and tubes of a component were added together: vesselRuns and tubeRuns are the stretches of consecutive
+	// indices in one component, and awakeVessels and awakeTubes the parts of them update() still has to run.
+	std::vector<char> componentAwake;
+	std::vector<int> awakeComponents;
+	std::vector<IndexRun> vesselRuns;
+	std::vector<IndexRun> tubeRuns;
+	std::vector<IndexRun> awakeVessels;
+	std::vector<IndexRun> awakeTubes;
+	bool awakeDirty = true;
+
+	// How update() splits the work for the pool: networks with fewer than parallelMinimum vessels are stepped on one thread, larger
+	// ones in pieces of at most parallelBlock vessels or tubes. The phases the pieces cut work element by element, so the split
+	// changes how fast a step is, not what it computes. Change them with setParallelSplit(), which cuts the pieces again.
+	int parallelBlock = PARALLEL_BLOCK_SIZE;
+	int parallelMinimum = PARALLEL_MIN_VESSELS;
+	void setParallelSplit(int block, int minimum);
+
+	// Multirate stepping (only for the local integrator with the gathered apply): narrow vessels swing much faster than wide ones,
+	// so instead of stepping the whole network as finely as its fastest part needs, every component takes its own number of
+	// substeps, componentSubsteps, with every component at the same time again at the end of the step. They are worked out by
+	// rateComponents() for the topology, step and density * gravity in rateVersion, rateDt and rateScale.
+	bool multirate = false;
+	std::vector<int> componentSubsteps;
+	int rateVersion = -1;
+	float rateDt = 0.0f;
+	float rateScale = 0.0f;
+	std::vector<char> rateAwake;	// Scratch: which awake components take the substeps that are being run
+
+	std::vector<char> componentMoved;	// Scratch for update(): per component and per piece of awakeTubes, whether anything moved
+	std::vector<char> pieceMoved;
+
+	// If set, update() adds up where its time goes in here (see UpdateTimes). Costs two clock reads per piece while it is set.
+	UpdateTimes* timing = nullptr;
+
+	// Stable handles to the vessels and tubes, one per index. Arrays filled without addVessel() and addTube() (like a loaded
+	// checkpoint) get theirs when the topology is rebuilt.
+	HandleTable vesselHandles;
+	HandleTable tubeHandles;
+
+	// Adds a vessel whose bottom left corner is at (x, y) and returns its index.
+	int addVessel(float x, float y, float vesselWidth, float fluidHeight);
+
+	// Connects the bottoms of two vessels with a tube and returns the index of the tube.
+	int addTube(int a, int b, float inertance = DEFAULT_TUBE_INERTANCE, float damping = DEFAULT_TUBE_DAMPING);
+
+	// Adds a fluid and returns its index. The first fluid added takes over the fluid already in the vessels; every later one
+	// starts out empty in every vessel. Fill them with setLayer(). Fluids with the same density are the same fluid, so that returns
+	// the existing one.
+	int addFluid(float density);
+
+	// Sets how high a fluid stands in a vessel, and keeps height, top and the pressures up to date.
+	void setLayer(int vessel, int fluid, float layer, float gravity);
+
+	int fluidCount() const { return (int)fluidDensity.size(); }
+	bool layered() const { return !fluidDensity.empty(); }
+
+	// Gives a vessel a profile from profiles (or -1 for a rectangle again), keeping the volume it holds.
+	void setProfile(int vessel, int profile);
+	bool profiled() const { return !vesselProfile.empty(); }
+
+	// The volume a vessel holds at its height.
+	double vesselVolume(int vessel) const;
+
+	// Puts a component on a tube (or COMPONENT_NONE to take it off again): a valve with setting as its opening, a check valve, or
+	// a pump running with setting as its flow (stopped if that is 0).
+	void setComponent(int tube, TubeComponent component, float setting);
+	bool hasComponents() const { return !tubeComponent.empty(); }
+
+	// Queues a change to the component of a tube for the start of a step. Returns false if the component of the tube can't do
+	// that (only valves open, and only pumps start and stop) or the opening isn't between 0 and 1.
+	bool scheduleTube(long long step, int tube, TubeAction action, float value);
+
+	// Applies the changes queued for step and the steps before it, in the order they were queued, and returns how many there were.
+	// Call it before the update() of that step.
+	int runSchedule(long long step);
+
+	// Removes a tube. The last tube takes its index.
+	void removeTube(int tube);
+
+	// Removes a vessel and every tube connected to it. The last vessel takes its index. Takes time linear in the number of tubes.
+	void removeVessel(int vessel);
+
+	// Removes several vessels and every tube connected to them in one go, in time linear in the size of the network instead of per
+	// vessel. The gaps are filled from the back like removeVessel() does.
+	void removeVessels(const std::vector<int>& vessels);
+
+	// Handles to vessels and tubes, and the indices they are at now (or -1 once they were removed).
+	Handle vesselHandle(int vessel) const { return vesselHandles.handle(vessel); }
+	Handle tubeHandle(int tube) const { return tubeHandles.handle(tube); }
+	int vesselIndex(Handle handle) const { return vesselHandles.index(handle); }
+	int tubeIndex(Handle handle) const { return tubeHandles.index(handle); }
+
+	// Removes all vessels, tubes and fluids.
+	void clear();
+
+	int vesselCount() const { return (int)height.size(); }
+	int tubeCount() const { return (int)tubeA.size(); }
+
+	// Computes the pressure of every vessel from its fluid height (or its layers, in which case density isn't used).
+	void computePressures(float density, float gravity);
+
+	// Rebuilds everything derived from the tubes (drainShare, tubeStiffness, the compressed tube lists and the components), and wakes
+	// every component up.
+	// update() calls this automatically after tubes were added.
+	void rebuildTopology();
+
+	// Colors the tubes greedily, so no two tubes of the same color share a vessel, and fills in colorTubes, colorA, colorB and
+	// colorPieces. Returns the number of colors, or 0 (and leaves them empty) if the network needs more than SCATTER_MAX_COLORS.
+	int tubeColors();
+
+	// Advances the simulation by dt seconds. Returns false if nothing moved (every component has come to rest or is asleep).
+	// A layered network ignores density, and is always stepped in single precision with the local integrator.
+	// If a pool is given and the network is large enough, the step is split into blocks that run on every core.
+	// The result is exactly the same with or without a pool.
+	bool update(float density, float gravity, float dt, TaskPool* pool = nullptr);
+
+	// The single precision step of update(), over the awake pieces only, with scale = density * gravity. piecePool is the pool
+	// update() decided to hand the pieces to, or null.
+	bool stepAwake(float scale, float dt, TaskPool* piecePool);
+
+	// Works out componentSubsteps for steps of dt. The fastest swing of a tube is bounded (Gershgorin) by
+	// sqrt(scale / inertance * (degree / width of one end + degree / width of the other)), which takes neighbouring tubes into account,
+	// and a component is as fast as its fastest tube. Returns the most substeps any component takes.
+	int rateComponents(float scale, float dt);
+
+	// Changes the pressure pushed onto a vessel from outside, and wakes its component up if it changed.
+	void setExternalPressure(int vessel, float value);
+
+	// Wakes up the component of a vessel, or all of them. Anything that changes external pressures directly instead of through
+	// setExternalPressure() has to call one of these, and anything that changes the heights or flows directly has to call wakeAll().
+	void wake(int vessel);
+	void wakeAll();
+
+	// The volume of fluid in all vessels, from the most precise heights there are.
+	double totalVolume() const;
+
+	// The energy of the motion: the kinetic energy of the fluid in the tubes (inertance * flow^2 / 2) plus the potential energy of
+	// the columns and of the external pressure pushing on them. Without damping, nothing but the step changes it. A layered network
+	// only counts its tubes, since its columns have no single density.
+	double energy(float density, float gravity) const;
+
+	// Computes the heights the network comes to rest at with the current external pressures, without stepping through the
+	// motion. At rest every vessel of a component has the same pressure at its bottom and the component still holds the same
+	// volume, which gives that pressure directly. Vessels whose external pressure is higher than that are pushed empty and left
+	// out. Takes time linear in the size of the network (per vessel that is pushed empty, in the worst case).
+	// Returns false for a layered or profiled network, whose rest state has no such closed form.
+	bool equilibriumHeights(float density, float gravity, std::vector<float>& result);
+
+	// Moves the network straight to its equilibrium: sets the heights (and tops and pressures) and stops every tube.
+	// Returns false (and changes nothing) for a layered or profiled network.
+	bool settle(float density, float gravity);
+
+	// Places the arrays update() streams through (see MemoryPlacement.h): with a pool that was pinned to NUMA nodes, the part of every
+	// array a thread is dealt first is moved to the node of that thread, and with hugePages they ask for 2 MB pages. Rebuilds the
+	// topology first if it is dirty, and has to be called again after anything that reallocates the arrays. Returns how many bytes
+	// were moved to another node.
+	size_t placeMemory(const TaskPool* pool, bool hugePages);
+};
+
+#endif // _VESSEL_NETWORK_H
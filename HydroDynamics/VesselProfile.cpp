@@ -0,0 +1,184 @@
+/*
+Title: HydroDynamics
+File Name: VesselProfile.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Cross sections for vessels that aren't rectangles: cones, bowls, or any other profile given
+as widths at evenly spaced heights. The width is linear between two of those heights, and
+above the last one the walls go straight up with the last width.
+
+The step moves volumes, and a rectangle turns a volume into a height by dividing it by its
+width. A profiled vessel needs the volume it holds at a height, and the height it stands at
+with a volume, instead. Both are looked up in tables of PROFILE_SAMPLES + 1 entries (one
+over evenly spaced heights, one over evenly spaced volumes), and interpolated linearly
+between the two entries around the value. The lookup clamps the index instead of
+branching, so the AVX2 version (see SimdKernels.h) runs eight vessels at once through
+gathers. The two tables only nearly invert each other, so the step moves a level by the
+difference between the heights before and after in the height table, rather than to the
+height after: a vessel nothing flowed into then stays exactly where it is. A profiled
+vessel costs three table lookups more than a rectangle does.
+
+Vessels with the same profile share its tables, however many of them there are.
+
+This file has no OpenGL dependency.
+*/
+
+#include "VesselProfile.h"
+#include <algorithm>
+#include <cmath>
+
+// The volume is integrated this many times finer than the tables, with the width linear in between.
+#define PROFILE_REFINE 16
+
+// The same lookup as the profile kernel (see SimdKernels.cpp): clamp, then interpolate, and the straight walls above the table.
+static float lookup(const float* table, float position)
+{
+	position = std::max(position, 0.0f);
+	int k = std::min((int)position, PROFILE_SAMPLES - 1);
+	float f = std::min(position - k, 1.0f);
+	return table[k] + f * (table[k + 1] - table[k]);
+}
+
+int VesselProfiles::add(const std::vector<float>& profileWidths, float profileDepth)
+{
+	int given = (int)profileWidths.size();
+	if (given < 2 || profileDepth <= 0.0f || profileWidths.back() <= 0.0f
+		|| std::any_of(profileWidths.begin(), profileWidths.end(), [](float w) { return w < 0.0f; }))
+	{
+		return -1;
+	}
+
+	// Resampled at the heights of the table. Widths that already are at those heights are taken as they are, so a checkpoint gets
+	// back exactly the profiles it stored.
+	std::vector<float> sampled(PROFILE_SAMPLES + 1);
+	for (int k = 0; k <= PROFILE_SAMPLES && given != PROFILE_SAMPLES + 1; k++)
+	{
+		float position = (float)k / PROFILE_SAMPLES * (given - 1);
+		int j = std::min((int)position, given - 2);
+		float f = position - j;
+		sampled[k] = profileWidths[j] + f * (profileWidths[j + 1] - profileWidths[j]);
+	}
+	if (given == PROFILE_SAMPLES + 1)
+	{
+		sampled = profileWidths;
+	}
+
+	for (int p = 0; p < count(); p++)
+	{
+		if (depth[p] == profileDepth && std::equal(sampled.begin(), sampled.end(), widths.begin() + p * (PROFILE_SAMPLES + 1)))
+		{
+			return p;
+		}
+	}
+
+	// The volume below every height of the table, and below every finer step for inverting it. The width is linear within a step
+	// of the table, so the volume of a step is exact.
+	int fine = PROFILE_SAMPLES * PROFILE_REFINE;
+	float step = profileDepth / PROFILE_SAMPLES;
+	std::vector<double> fineVolume(fine + 1, 0.0);
+	for (int s = 0; s < fine; s++)
+	{
+		int k = s / PROFILE_REFINE;
+		double from = sampled[k] + (sampled[k + 1] - sampled[k]) * (double)(s % PROFILE_REFINE) / PROFILE_REFINE;
+		double to = sampled[k] + (sampled[k + 1] - sampled[k]) * (double)(s % PROFILE_REFINE + 1) / PROFILE_REFINE;
+		fineVolume[s + 1] = fineVolume[s] + 0.5 * (from + to) * step / PROFILE_REFINE;
+	}
+	double full = fineVolume[fine];
+	if (full <= 0.0)
+	{
+		return -1;
+	}
+
+	widths.insert(widths.end(), sampled.begin(), sampled.end());
+	for (int k = 0; k <= PROFILE_SAMPLES; k++)
+	{
+		volumeTable.push_back((float)fineVolume[k * PROFILE_REFINE]);
+	}
+	for (int k = 0; k <= PROFILE_SAMPLES; k++)
+	{
+		double target = full * k / PROFILE_SAMPLES;
+		int s = (int)(std::lower_bound(fineVolume.begin(), fineVolume.end(), target) - fineVolume.begin());
+		s = std::max(1, std::min(s, fine));
+		double below = fineVolume[s - 1];
+		double f = fineVolume[s] > below ? (target - below) / (fineVolume[s] - below) : 0.0;
+		heightTable.push_back((float)((s - 1 + f) * step / PROFILE_REFINE));
+	}
+	depth.push_back(profileDepth);
+	fullVolume.push_back((float)full);
+	topWidth.push_back(sampled.back());
+	heightScale.push_back(PROFILE_SAMPLES / profileDepth);
+	volumeScale.push_back((float)(PROFILE_SAMPLES / full));
+	return count() - 1;
+}
+
+int VesselProfiles::add(ProfileShape shape, float width, float profileDepth)
+{
+	std::vector<float> shapeWidths(PROFILE_SAMPLES + 1);
+	for (int k = 0; k <= PROFILE_SAMPLES; k++)
+	{
+		float y = (float)k / PROFILE_SAMPLES;
+		shapeWidths[k] = shape == PROFILE_CONE ? width * y : width * std::sqrt(std::max(0.0f, 1.0f - (1.0f - y) * (1.0f - y)));
+	}
+	return add(shapeWidths, profileDepth);
+}
+
+float VesselProfiles::volume(int profile, float h) const
+{
+	const float* table = volumeTable.data() + profile * (PROFILE_SAMPLES + 1);
+	return lookup(table, h * heightScale[profile]) + std::max(0.0f, h - depth[profile]) * topWidth[profile];
+}
+
+float VesselProfiles::height(int profile, float v) const
+{
+	const float* table = heightTable.data() + profile * (PROFILE_SAMPLES + 1);
+	return lookup(table, v * volumeScale[profile]) + std::max(0.0f, v - fullVolume[profile]) / topWidth[profile];
+}
+
+void VesselProfiles::clear()
+{
+	widths.clear();
+	volumeTable.clear();
+	heightTable.clear();
+	depth.clear();
+	fullVolume.clear();
+	topWidth.clear();
+	heightScale.clear();
+	volumeScale.clear();
+}
+
+bool parseProfileShape(const std::string& name, ProfileShape& shape)
+{
+	if (name == "cone")
+	{
+		shape = PROFILE_CONE;
+	}
+	else if (name == "bowl")
+	{
+		shape = PROFILE_BOWL;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,96 @@
+/*
+Title: HydroDynamics
+File Name: VesselProfile.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Cross sections for vessels that aren't rectangles: cones, bowls, or any other profile given
+as widths at evenly spaced heights. The width is linear between two of those heights, and
+above the last one the walls go straight up with the last width.
+
+The step moves volumes, and a rectangle turns a volume into a height by dividing it by its
+width. A profiled vessel needs the volume it holds at a height, and the height it stands at
+with a volume, instead. Both are looked up in tables of PROFILE_SAMPLES + 1 entries (one
+over evenly spaced heights, one over evenly spaced volumes), and interpolated linearly
+between the two entries around the value. The lookup clamps the index instead of
+branching, so the AVX2 version (see SimdKernels.h) runs eight vessels at once through
+gathers. The two tables only nearly invert each other, so the step moves a level by the
+difference between the heights before and after in the height table, rather than to the
+height after: a vessel nothing flowed into then stays exactly where it is. A profiled
+vessel costs three table lookups more than a rectangle does.
+
+Vessels with the same profile share its tables, however many of them there are.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _VESSEL_PROFILE_H
+#define _VESSEL_PROFILE_H
+
+#include <string>
+#include <vector>
+
+// The number of steps in both tables of every profile.
+#define PROFILE_SAMPLES 64
+
+enum ProfileShape
+{
+	PROFILE_CONE = 0,	// From a point at the bottom to the full width at the top of the profile
+	PROFILE_BOWL		// A half circle (or half ellipse), from a point at the bottom to the full width at the top
+};
+
+class VesselProfiles
+{
+public:
+	// Per profile: the widths at PROFILE_SAMPLES + 1 evenly spaced heights from 0 to depth, which define it, and its tables.
+	// volumeTable holds the volume below every one of those heights, heightTable the height that holds k / PROFILE_SAMPLES of the
+	// volume of the whole profile. The scales turn a height or a volume into a position in its table.
+	std::vector<float> widths;
+	std::vector<float> volumeTable;
+	std::vector<float> heightTable;
+	std::vector<float> depth;
+	std::vector<float> fullVolume;
+	std::vector<float> topWidth;
+	std::vector<float> heightScale;
+	std::vector<float> volumeScale;
+
+	int count() const { return (int)depth.size(); }
+
+	// Adds a profile from widths at evenly spaced heights from 0 to depth (at least two of them, and a last one above 0) and returns
+	// its index. The widths are resampled to PROFILE_SAMPLES + 1 first, so a profile only ever depends on those. A profile that is
+	// already there is returned instead of added again. Returns -1 if the widths can't make a profile.
+	int add(const std::vector<float>& profileWidths, float profileDepth);
+
+	// The same for a named shape, with the given width at the top.
+	int add(ProfileShape shape, float width, float profileDepth);
+
+	// The volume below height h, and the height that holds volume v, the same way the step looks them up.
+	float volume(int profile, float h) const;
+	float height(int profile, float v) const;
+
+	void clear();
+};
+
+// Finds a shape by its name (cone or bowl). Returns false if there is none with that name.
+bool parseProfileShape(const std::string& name, ProfileShape& shape);
+
+#endif // _VESSEL_PROFILE_H
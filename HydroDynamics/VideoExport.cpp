@@ -0,0 +1,455 @@
+/*
+Title: HydroDynamics
+File Name: VideoExport.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Renders the simulation into an offscreen framebuffer of any size (an OffscreenTarget, with
+as many samples per pixel as asked for) and streams the frames to an external encoder
+(ffmpeg by default) as raw video through a pipe. The same pipeline can also send what the
+window shows as a live stream to remote viewers (openVideoStream()).
+
+The frames go to the encoder as NV12, the layout of video that the hardware encoders
+(NVENC, VA-API) take as it is. A shader (Nv12FragmentShader.glsl) works it out on the GPU,
+flipped the right way up, so the CPU only copies 1.5 bytes per pixel instead of 4 and the
+encoder doesn't have to convert anything. One encoded stream can go to any number of
+destinations at once (ffmpeg's tee muxer), so more viewers cost no more encoding.
+
+Three stages run at the same time: the GPU draws frame N while frame N - 1 is copied
+into a pixel buffer and earlier frames are written to the encoder by a worker thread.
+Both hand-overs are bounded. When the GPU falls behind, we wait for the oldest pixel
+buffer. When the encoder falls behind, the queue of VIDEO_QUEUE_FRAMES frames fills up
+and the render loop waits for the encoder instead of piling up memory. Nothing waits on
+the clock, so a run goes as fast as the slowest stage allows.
+*/
+
+#include "VideoExport.h"
+#include "GLState.h"
+#include "FrameUniforms.h"
+#include "Shaders.h"
+#include "ThreadControl.h"
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#define PIPE_WRITE_MODE "w"
+#endif
+
+static OffscreenTarget target;
+static int videoWidth = 0;
+static int videoHeight = 0;
+static size_t frameSize = 0;
+
+// The frame as a texture for the shader, and the NV12 image it draws, one and a half times as tall.
+static GLuint frameFramebuffer = 0;
+static GLuint frameTexture = 0;
+static GLuint nv12Framebuffer = 0;
+static GLuint nv12Texture = 0;
+static GLuint nv12Program = 0;
+static GLuint nv12Vao = 0;
+
+// The ring of pixel buffers the frames are read into, with a fence behind every read.
+static GLuint pixelBuffers[VIDEO_BUFFERS];
+static GLsync fences[VIDEO_BUFFERS];
+static int framesIssued = 0;
+static int framesRetired = 0;
+
+static FILE* encoder = nullptr;
+static std::thread writer;
+static std::mutex queueMutex;
+static std::condition_variable queueChanged;
+
+// Frames waiting for the encoder, and frames the encoder is done with (kept so we don't allocate a new one for every frame).
+static std::deque<std::vector<unsigned char>> queued;
+static std::vector<std::vector<unsigned char>> spare;
+static bool closing = false;
+static bool encoderFailed = false;
+
+// A live stream drops the frames the encoder has no room for.
+static bool live = false;
+static long long dropped = 0;
+
+static void runWriter()
+{
+	applyThreadRole(THREAD_ROLE_CAPTURE);
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (true)
+	{
+		queueChanged.wait(lock, [] { return closing || !queued.empty(); });
+		if (queued.empty())
+		{
+			return;
+		}
+
+		std::vector<unsigned char> frame = std::move(queued.front());
+		queued.pop_front();
+
+		// Writing to the pipe blocks whenever the encoder is busy, which is exactly the backpressure we want.
+		lock.unlock();
+		bool written = !encoderFailed && fwrite(frame.data(), 1, frame.size(), encoder) == frame.size();
+		lock.lock();
+
+		if (!written)
+		{
+			encoderFailed = true;
+		}
+		spare.push_back(std::move(frame));
+		queueChanged.notify_all();
+	}
+}
+
+bool parseVideoEncoder(const std::string& name, VideoEncoder& encoder)
+{
+	if (name == "software")
+	{
+		encoder = VIDEO_ENCODER_SOFTWARE;
+	}
+	else if (name == "nvenc")
+	{
+		encoder = VIDEO_ENCODER_NVENC;
+	}
+	else if (name == "vaapi")
+	{
+		encoder = VIDEO_ENCODER_VAAPI;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+// The options of the encoder in front of the input and after it. A stream is tuned for latency rather than size.
+static const char* encoderInputOptions(VideoEncoder kind)
+{
+	return kind == VIDEO_ENCODER_VAAPI ? "-vaapi_device /dev/dri/renderD128" : "";
+}
+
+static const char* encoderOutputOptions(VideoEncoder kind, bool stream)
+{
+	switch (kind)
+	{
+	case VIDEO_ENCODER_NVENC:
+		return stream ? "-c:v h264_nvenc -preset fast -zerolatency 1" : "-c:v h264_nvenc -preset slow";
+	case VIDEO_ENCODER_VAAPI:
+		return "-vf format=nv12,hwupload -c:v h264_vaapi";
+	default:
+		return stream ? "-c:v libx264 -preset veryfast -tune zerolatency -pix_fmt yuv420p" : "-c:v libx264 -preset fast -pix_fmt yuv420p";
+	}
+}
+
+// Creates what the frames go through on their way out, and starts the encoder with command. Returns false if anything fails.
+static bool openPipeline(const std::string& command, int width, int height)
+{
+	videoWidth = width;
+	videoHeight = height;
+	frameSize = (size_t)width * height * 3 / 2;
+	if (width % 2 != 0 || height % 2 != 0)
+	{
+		std::cout << "The size of a video has to be even, " << width << "x" << height << " isn't." << std::endl;
+		return false;
+	}
+
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	nv12Program = loadProgramFiles(VIDEO_VERTEX_SHADER_FILE, VIDEO_FRAGMENT_SHADER_FILE, vertexShader, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	if (nv12Program == 0)
+	{
+		std::cout << "Can't build the program that converts the video frames." << std::endl;
+		return false;
+	}
+	attachFrameBlock(nv12Program);
+	cachedUseProgram(nv12Program);
+	glUniform1i(glGetUniformLocation(nv12Program, "image"), VIDEO_UNIT);
+	glUniform1i(glGetUniformLocation(nv12Program, "height"), height);
+	cachedUseProgram(0);
+	glGenVertexArrays(1, &nv12Vao);
+
+	// Both images are read texel by texel, so nothing is filtered.
+	GLuint textures[2];
+	GLuint framebuffers[2];
+	glGenTextures(2, textures);
+	glGenFramebuffers(2, framebuffers);
+	frameTexture = textures[0];
+	nv12Texture = textures[1];
+	frameFramebuffer = framebuffers[0];
+	nv12Framebuffer = framebuffers[1];
+	cachedActiveTexture(GL_TEXTURE0 + VIDEO_UNIT);
+	for (int i = 0; i < 2; i++)
+	{
+		cachedBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		if (i == 0)
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height * 3 / 2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+		}
+		cachedBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Can't create the framebuffers that convert the video frames." << std::endl;
+			cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+	}
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(VIDEO_BUFFERS, pixelBuffers);
+	for (int i = 0; i < VIDEO_BUFFERS; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+		fences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	framesIssued = 0;
+	framesRetired = 0;
+
+	encoder = popen(command.c_str(), PIPE_WRITE_MODE);
+	if (encoder == nullptr)
+	{
+		std::cout << "Can't start the encoder: " << command << std::endl;
+		return false;
+	}
+
+	closing = false;
+	encoderFailed = false;
+	dropped = 0;
+	writer = std::thread(runWriter);
+	return true;
+}
+
+bool openVideoExport(const std::string& fileName, int width, int height, double fps, int samples, VideoEncoder kind)
+{
+	live = false;
+	if (!target.create(width, height, samples))
+	{
+		return false;
+	}
+
+	char rate[32];
+	snprintf(rate, sizeof(rate), "-r %g", fps);
+	char command[1024];
+	int length = snprintf(command, sizeof(command), VIDEO_INPUT, encoderInputOptions(kind), width, height, rate);
+	snprintf(command + length, sizeof(command) - length, VIDEO_OUTPUT, encoderOutputOptions(kind, false), ("\"" + fileName + "\"").c_str());
+	return openPipeline(command, width, height);
+}
+
+bool openVideoStream(const std::vector<std::string>& destinations, int width, int height, double fps, VideoEncoder kind)
+{
+	live = true;
+
+	// The tee muxer sends the one encoded stream to all destinations.
+	std::string outputs;
+	for (const std::string& destination : destinations)
+	{
+		outputs += (outputs.empty() ? "" : "|") + std::string("[f=mpegts]") + destination;
+	}
+	char options[256];
+	snprintf(options, sizeof(options), "%s -g %d -bf 0 -map 0:v -f tee", encoderOutputOptions(kind, true), std::max((int)fps, 1));
+
+	char command[4096];
+	int length = snprintf(command, sizeof(command), VIDEO_INPUT, encoderInputOptions(kind), width, height, "-use_wallclock_as_timestamps 1");
+	snprintf(command + length, sizeof(command) - length, VIDEO_OUTPUT, options, ("\"" + outputs + "\"").c_str());
+	return openPipeline(command, width, height);
+}
+
+void beginVideoFrame()
+{
+	target.bind();
+}
+
+// Waits for the oldest frame on the GPU, copies it out of its pixel buffer and hands it to the writer.
+static void retireFrame()
+{
+	int slot = framesRetired % VIDEO_BUFFERS;
+	glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(fences[slot]);
+	fences[slot] = 0;
+	framesRetired++;
+
+	std::vector<unsigned char> frame;
+	{
+		// If the encoder is VIDEO_QUEUE_FRAMES behind, wait for it to take one, or with a stream, leave the frame out.
+		std::unique_lock<std::mutex> lock(queueMutex);
+		if (live && !encoderFailed && queued.size() >= VIDEO_QUEUE_FRAMES)
+		{
+			dropped++;
+			return;
+		}
+		queueChanged.wait(lock, [] { return encoderFailed || queued.size() < VIDEO_QUEUE_FRAMES; });
+		if (!spare.empty())
+		{
+			frame = std::move(spare.back());
+			spare.pop_back();
+		}
+	}
+	frame.resize(frameSize);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+	if (mapped != nullptr)
+	{
+		memcpy(frame.data(), mapped, frameSize);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queued.push_back(std::move(frame));
+	}
+	queueChanged.notify_all();
+}
+
+// Converts the frame in frameTexture to NV12 and starts reading it into the next pixel buffer.
+static bool queueFrame()
+{
+	// The slot we are about to use still holds the frame from VIDEO_BUFFERS frames ago, so that one has to go first.
+	if (framesIssued - framesRetired == VIDEO_BUFFERS)
+	{
+		retireFrame();
+	}
+
+	// There is no depth buffer to test against, and blending is off outside of the fluid surface.
+	cachedBindFramebuffer(GL_FRAMEBUFFER, nv12Framebuffer);
+	cachedViewport(0, 0, videoWidth, videoHeight * 3 / 2);
+	cachedUseProgram(nv12Program);
+	cachedActiveTexture(GL_TEXTURE0 + VIDEO_UNIT);
+	cachedBindTexture(GL_TEXTURE_2D, frameTexture);
+	cachedBindVertexArray(nv12Vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	int slot = framesIssued % VIDEO_BUFFERS;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, videoWidth, videoHeight * 3 / 2, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	framesIssued++;
+
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return !encoderFailed;
+}
+
+bool endVideoFrame()
+{
+	// The pixels are read from the resolved image.
+	target.resolve();
+	cachedBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameFramebuffer);
+	glBlitFramebuffer(0, 0, videoWidth, videoHeight, 0, 0, videoWidth, videoHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	return queueFrame();
+}
+
+bool captureVideoFrame(int windowWidth, int windowHeight)
+{
+	// Fit the window into the frame without stretching it. The bars around it stay black.
+	int width = videoWidth;
+	int height = (int)((long long)videoWidth * windowHeight / std::max(windowWidth, 1));
+	if (height > videoHeight)
+	{
+		height = videoHeight;
+		width = (int)((long long)videoHeight * windowWidth / std::max(windowHeight, 1));
+	}
+	int x = (videoWidth - width) / 2;
+	int y = (videoHeight - height) / 2;
+
+	cachedBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameFramebuffer);
+	if (width != videoWidth || height != videoHeight)
+	{
+		cachedClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	cachedBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, windowWidth, windowHeight, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	bool succeeded = queueFrame();
+	cachedViewport(0, 0, windowWidth, windowHeight);
+	return succeeded;
+}
+
+long long videoFramesDropped()
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return dropped;
+}
+
+bool closeVideoExport()
+{
+	while (framesRetired < framesIssued)
+	{
+		retireFrame();
+	}
+
+	if (writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			closing = true;
+		}
+		queueChanged.notify_all();
+		writer.join();
+	}
+
+	// pclose waits for the encoder to finish writing the file.
+	bool succeeded = !encoderFailed;
+	if (encoder != nullptr)
+	{
+		succeeded &= pclose(encoder) == 0;
+		encoder = nullptr;
+	}
+	if (!succeeded)
+	{
+		std::cout << (live ? "The encoder of the stream failed." : "The encoder failed, the video is incomplete.") << std::endl;
+	}
+
+	glDeleteBuffers(VIDEO_BUFFERS, pixelBuffers);
+	cachedDeleteFramebuffers(1, &frameFramebuffer);
+	cachedDeleteFramebuffers(1, &nv12Framebuffer);
+	cachedDeleteTextures(1, &frameTexture);
+	cachedDeleteTextures(1, &nv12Texture);
+	cachedDeleteProgram(nv12Program);
+	cachedDeleteVertexArrays(1, &nv12Vao);
+	frameFramebuffer = nv12Framebuffer = frameTexture = nv12Texture = nv12Program = nv12Vao = 0;
+	target.destroy();
+	queued.clear();
+	spare.clear();
+	return succeeded;
+}
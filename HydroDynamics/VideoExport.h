@@ -0,0 +1,106 @@
+/*
+Title: HydroDynamics
+File Name: VideoExport.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Renders the simulation into an offscreen framebuffer of any size (an OffscreenTarget, with
+as many samples per pixel as asked for) and streams the frames to an external encoder
+(ffmpeg by default) as raw video through a pipe. The same pipeline can also send what the
+window shows as a live stream to remote viewers (openVideoStream()).
+
+The frames go to the encoder as NV12, the layout of video that the hardware encoders
+(NVENC, VA-API) take as it is. A shader (Nv12FragmentShader.glsl) works it out on the GPU,
+flipped the right way up, so the CPU only copies 1.5 bytes per pixel instead of 4 and the
+encoder doesn't have to convert anything. One encoded stream can go to any number of
+destinations at once (ffmpeg's tee muxer), so more viewers cost no more encoding.
+
+Three stages run at the same time: the GPU draws frame N while frame N - 1 is copied
+into a pixel buffer and earlier frames are written to the encoder by a worker thread.
+Both hand-overs are bounded. When the GPU falls behind, we wait for the oldest pixel
+buffer. When the encoder falls behind, the queue of VIDEO_QUEUE_FRAMES frames fills up
+and the render loop waits for the encoder instead of piling up memory. Nothing waits on
+the clock, so a run goes as fast as the slowest stage allows.
+*/
+
+#ifndef _VIDEO_EXPORT_H
+#define _VIDEO_EXPORT_H
+
+#include "OffscreenTarget.h"
+#include <string>
+#include <vector>
+
+// How many frames can be copying on the GPU, and how many can be waiting for the encoder.
+#define VIDEO_BUFFERS 3
+#define VIDEO_QUEUE_FRAMES 8
+
+// The encoder command reads raw NV12 frames from its standard input. The arguments of VIDEO_INPUT are the input options of the encoder,
+// width, height, frames per second (or 0 to stamp every frame with the time it came), and those of VIDEO_OUTPUT the output options of the
+// encoder and the destination.
+#define VIDEO_INPUT "ffmpeg -loglevel error -y %s -f rawvideo -pix_fmt nv12 -s %dx%d %s -i -"
+#define VIDEO_OUTPUT " %s -colorspace bt709 -color_primaries bt709 -color_trc bt709 -color_range tv %s"
+
+// The shaders that turn a frame into NV12, and the texture unit the frame is read from, past the ones the scene uses.
+#define VIDEO_VERTEX_SHADER_FILE "../Assets/SdfVertexShader.glsl"
+#define VIDEO_FRAGMENT_SHADER_FILE "../Assets/Nv12FragmentShader.glsl"
+#define VIDEO_UNIT 8
+
+// What encodes the frames (--video-encoder in main.cpp). The hardware encoders leave the CPU to the simulation.
+enum VideoEncoder
+{
+	VIDEO_ENCODER_SOFTWARE = 0,	// libx264
+	VIDEO_ENCODER_NVENC,		// h264_nvenc, on NVIDIA GPUs
+	VIDEO_ENCODER_VAAPI			// h264_vaapi, on /dev/dri/renderD128 (Intel and AMD on Linux)
+};
+
+// Parses software, nvenc or vaapi. Returns false if it is none of them.
+bool parseVideoEncoder(const std::string& name, VideoEncoder& encoder);
+
+// Creates the offscreen framebuffer, with samples samples per pixel, and starts the encoder. width and height have to be even. Needs a
+// current OpenGL context. Returns false if either fails.
+bool openVideoExport(const std::string& fileName, int width, int height, double fps, int samples = 1,
+	VideoEncoder encoder = VIDEO_ENCODER_SOFTWARE);
+
+// Starts a live stream of width x height frames (even, both) to every destination, a URL that ffmpeg can send MPEG-TS to, like
+// udp://239.0.0.1:1234 (which any number of viewers can join) or srt://host:port. The frames come from captureVideoFrame() and
+// carry the time they came, with a key frame at least every second, so a viewer can join at any time. When the encoder falls
+// behind, frames are dropped instead of waited for, so the window never slows down for the stream.
+bool openVideoStream(const std::vector<std::string>& destinations, int width, int height, double fps, VideoEncoder encoder);
+
+// Copies a windowWidth x windowHeight back buffer of the window into the stream, fitted into the frame with black bars, and queues it
+// like endVideoFrame(). Call before swapping the buffers. Leaves the window's framebuffer bound again.
+bool captureVideoFrame(int windowWidth, int windowHeight);
+
+// How many frames of the stream were dropped because the encoder was behind.
+long long videoFramesDropped();
+
+// Binds the offscreen framebuffer (and sets the viewport to it), so the next frame is drawn into the video.
+void beginVideoFrame();
+
+// Resolves the frame that was just drawn, queues it and binds the default framebuffer again. Waits if the GPU or the encoder is too far behind.
+// Returns false if the encoder has stopped accepting frames.
+bool endVideoFrame();
+
+// Sends every remaining frame, waits for the encoder to finish the file and frees everything. Returns false if anything failed.
+bool closeVideoExport();
+
+#endif // _VIDEO_EXPORT_H
@@ -0,0 +1,273 @@
+/*
+Title: HydroDynamics
+File Name: WorkerPool.cpp
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A pool of warm worker processes for headless batch jobs (HydroDynamicsHeadless --serve).
+Starting the program for every job of a sweep pays for the process, for reading the scene
+and for the allocator to grow its heap every time, which on short jobs takes longer than
+the job. The pool pays for it once.
+
+The program reads its scene first and then forks the workers, the way a pre-forking web
+server does. A worker starts out as a copy of the program that shares every page of the
+scene with it until one of them writes to it, and only the program's pages were written
+before the fork, so the scene is in memory once however many workers there are. Every job
+copies it into a network of the worker itself, which after its first job has all the
+memory the next one needs.
+
+Jobs come in over a local socket (a Unix domain socket at the path the pool was given).
+The workers all wait in accept() on the socket the program listens on, so the system hands
+each new client to a worker that is free; a worker serves its client until it disconnects,
+one job per line, each answered with one line (see HeadlessRunner.cpp for what they say).
+The program meanwhile only waits for its workers, and forks a new one for any that dies.
+SIGINT or SIGTERM stops the pool: the program stops the workers, waits for them and removes
+the socket. Threads don't survive a fork, so whatever steps with several threads has to
+start them in the worker, inside the job handler.
+
+Windows has no fork(), so there the pool only says so.
+
+This file has no OpenGL dependency.
+*/
+
+#include "WorkerPool.h"
+#include <iostream>
+
+#ifdef _WIN32
+bool servePool(const std::string& path, int workers, PoolJobHandler handler)
+{
+	std::cout << "The worker pool forks its workers, which Windows can't; start the program once per job there." << std::endl;
+	return false;
+}
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// Set by SIGINT and SIGTERM in the program, which stop the pool.
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+	stopRequested = 1;
+}
+
+// Sends all of line and a newline. Returns false if the client is gone.
+static bool sendAnswer(int client, const std::string& line)
+{
+	std::string text = line + "\n";
+	size_t sent = 0;
+	while (sent < text.size())
+	{
+		ssize_t written = send(client, text.data() + sent, text.size() - sent, SEND_FLAGS);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (written <= 0)
+		{
+			return false;
+		}
+		sent += (size_t)written;
+	}
+	return true;
+}
+
+// What a worker does until it is stopped: takes the next client and answers its jobs until it disconnects.
+static void runWorker(int listening, PoolJobHandler handler)
+{
+	std::string received;
+	char buffer[4096];
+	while (true)
+	{
+		int client = accept(listening, nullptr, nullptr);
+		if (client < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			std::cout << "Worker " << getpid() << " can't take a client: " << strerror(errno) << std::endl;
+			_exit(1);
+		}
+
+		received.clear();
+		bool open = true;
+		while (open)
+		{
+			ssize_t count = recv(client, buffer, sizeof(buffer), 0);
+			if (count < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (count <= 0)
+			{
+				break;
+			}
+			received.append(buffer, (size_t)count);
+			size_t end;
+			while (open && (end = received.find('\n')) != std::string::npos)
+			{
+				std::string job = received.substr(0, end);
+				received.erase(0, end + 1);
+				if (!job.empty() && job.back() == '\r')
+				{
+					job.pop_back();
+				}
+				// Every line gets its answer, so a client that counts them never waits for one that doesn't come.
+				open = sendAnswer(client, job.empty() ? std::string("error empty job") : handler(job));
+			}
+		}
+		close(client);
+	}
+}
+
+// Forks a worker. Returns its process id, or -1 if there can't be one.
+static pid_t startWorker(int listening, PoolJobHandler handler)
+{
+	// What is still buffered would be written once by every process otherwise.
+	std::cout.flush();
+	pid_t worker = fork();
+	if (worker == 0)
+	{
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		runWorker(listening, handler);
+		_exit(0);
+	}
+	if (worker < 0)
+	{
+		std::cout << "Can't start a worker: " << strerror(errno) << std::endl;
+	}
+	return worker;
+}
+
+bool servePool(const std::string& path, int workers, PoolJobHandler handler)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(address.sun_path))
+	{
+		std::cout << "Not a path for a local socket: " << path << std::endl;
+		return false;
+	}
+	memcpy(address.sun_path, path.c_str(), path.size());
+
+	// A socket left behind by a pool that didn't stop cleanly is in the way.
+	unlink(path.c_str());
+	int listening = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listening < 0 || bind(listening, (sockaddr*)&address, sizeof(address)) != 0 || listen(listening, POOL_BACKLOG) != 0)
+	{
+		std::cout << "Can't listen on " << path << ": " << strerror(errno) << std::endl;
+		if (listening >= 0)
+		{
+			close(listening);
+		}
+		return false;
+	}
+
+	// Installed without SA_RESTART, so they wake up the waitpid() below.
+	struct sigaction stop;
+	memset(&stop, 0, sizeof(stop));
+	stop.sa_handler = requestStop;
+	sigemptyset(&stop.sa_mask);
+	sigaction(SIGINT, &stop, nullptr);
+	sigaction(SIGTERM, &stop, nullptr);
+
+	std::vector<pid_t> running;
+	for (int i = 0; i < workers; i++)
+	{
+		pid_t worker = startWorker(listening, handler);
+		if (worker > 0)
+		{
+			running.push_back(worker);
+		}
+	}
+	bool started = !running.empty();
+	if (started)
+	{
+		std::cout << running.size() << " workers take jobs on " << path << std::endl;
+	}
+
+	while (started && !stopRequested)
+	{
+		int status;
+		pid_t ended = waitpid(-1, &status, 0);
+		if (ended <= 0)
+		{
+			if (errno != EINTR)
+			{
+				break;
+			}
+			continue;
+		}
+		for (size_t i = 0; i < running.size(); i++)
+		{
+			if (running[i] != ended)
+			{
+				continue;
+			}
+
+			// A job that crashed its worker takes only that worker with it.
+			std::cout << "Worker " << ended << (WIFSIGNALED(status) ? " was killed by signal " + std::to_string(WTERMSIG(status)) :
+				" exited with " + std::to_string(WEXITSTATUS(status))) << ", starting another" << std::endl;
+			pid_t worker = stopRequested ? -1 : startWorker(listening, handler);
+			if (worker > 0)
+			{
+				running[i] = worker;
+			}
+			else
+			{
+				running.erase(running.begin() + i);
+			}
+			break;
+		}
+	}
+
+	for (pid_t worker : running)
+	{
+		kill(worker, SIGTERM);
+	}
+	for (pid_t worker : running)
+	{
+		waitpid(worker, nullptr, 0);
+	}
+	close(listening);
+	unlink(path.c_str());
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	return started;
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+Title: HydroDynamics
+File Name: WorkerPool.h
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+A pool of warm worker processes for headless batch jobs (HydroDynamicsHeadless --serve).
+Starting the program for every job of a sweep pays for the process, for reading the scene
+and for the allocator to grow its heap every time, which on short jobs takes longer than
+the job. The pool pays for it once.
+
+The program reads its scene first and then forks the workers, the way a pre-forking web
+server does. A worker starts out as a copy of the program that shares every page of the
+scene with it until one of them writes to it, and only the program's pages were written
+before the fork, so the scene is in memory once however many workers there are. Every job
+copies it into a network of the worker itself, which after its first job has all the
+memory the next one needs.
+
+Jobs come in over a local socket (a Unix domain socket at the path the pool was given).
+The workers all wait in accept() on the socket the program listens on, so the system hands
+each new client to a worker that is free; a worker serves its client until it disconnects,
+one job per line, each answered with one line (see HeadlessRunner.cpp for what they say).
+The program meanwhile only waits for its workers, and forks a new one for any that dies.
+SIGINT or SIGTERM stops the pool: the program stops the workers, waits for them and removes
+the socket. Threads don't survive a fork, so whatever steps with several threads has to
+start them in the worker, inside the job handler.
+
+Windows has no fork(), so there the pool only says so.
+
+This file has no OpenGL dependency.
+*/
+
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <string>
+
+// How many clients can wait for a free worker before the system turns new ones away.
+#define POOL_BACKLOG 64
+
+// The answer to one job, given the line it came as. Runs in the worker.
+typedef std::string(*PoolJobHandler)(const std::string& job);
+
+// Listens on the local socket at path, forks workers workers that answer every job with handler, and keeps them running until
+// the program is told to stop. Returns false (after printing an error) if the socket can't be made or no worker can be started.
+bool servePool(const std::string& path, int workers, PoolJobHandler handler);
+
+#endif // _WORKER_POOL_H
@@ -52,353 +52,8101 @@ causing the water to flow from right to left.
 */
 
 #include "GLIncludes.h"
+#include "GLDebug.h"
+#include "GLState.h"
+#include "VesselNetwork.h"
+#include "TaskPool.h"
+#include "MemoryPlacement.h"
+#include "ThreadControl.h"
+#include "Benchmark.h"
+#include "Autotune.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "GpuTimer.h"
+#include "LatencyMeter.h"
+#include "TraceRecorder.h"
+#include "TracyZones.h"
+#include "MemoryTracker.h"
+#include "MetricsServer.h"
+#include "FrameArena.h"
+#include "Shaders.h"
+#include "FileWatcher.h"
+#include "FrameCapture.h"
+#include "CompressedTexture.h"
+#include "FlightRecorder.h"
+#include "VideoExport.h"
+#include "Checkpoint.h"
+#include "Scene.h"
+#include "NetworkGenerator.h"
+#include "TiledScene.h"
+#include "Telemetry.h"
+#include "LiveExport.h"
+#include "StateStream.h"
+#include "RemoteControl.h"
+#include "InputLog.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "FixedNetwork.h"
+#include "GridFluid.h"
+#include "ParticleFluid.h"
+#include "GpuParticleFluid.h"
+#include "GpuNetwork.h"
+#include "ShallowWater.h"
+#include "Piston.h"
+#include "Sweep.h"
+#include "Scenario.h"
+#include "PressureSchedule.h"
+#include "Sensors.h"
+#include "SensorIngest.h"
+#include "EnsembleFilter.h"
+#include "FloatingBodies.h"
+#include "SweepCluster.h"
+#include "PartitionedNetwork.h"
+#include "Sensitivity.h"
+#include "Calibration.h"
+#include "ResultCache.h"
+#include "RewindHistory.h"
+#include "Lockstep.h"
+#include "StreamBuffer.h"
+#include "RenderQueue.h"
+#include "RenderCommands.h"
+#include "SpatialGrid.h"
+#include "NetworkLod.h"
+#include "RetainedFrame.h"
+#include "OffscreenTarget.h"
+#include "FrameGraph.h"
+#include "FluidSurface.h"
+#include "SprayEffect.h"
+#include "ComponentPlugins.h"
+#include "TextRenderer.h"
+#include "HistoryPlot.h"
+#include "HitchDetector.h"
+#include "PowerSource.h"
+#include "Settings.h"
+#include "Logger.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
 
-#define density 1.0f
-#define gravity 9.8f
+// The fluid and the gravity, which can be changed with --density and --gravity. The defaults are also template parameters of the
+// fixed apparatus (see ApparatusPhysics).
+#define DEFAULT_DENSITY 1.0f
+#define DEFAULT_GRAVITY 9.8f
+float density = DEFAULT_DENSITY;
+float gravity = DEFAULT_GRAVITY;
+
+// Extra layers of other fluids, from --layer VESSEL DENSITY HEIGHT. Any of them makes the apparatus a layered network, with the
+// fluid of --density at the bottom of the stack it starts with.
+struct LayerSetting
+{
+	int vessel;
+	float density;
+	float height;
+};
+std::vector<LayerSetting> layerSettings;
 
 float externalPressure = 0;
 
-//This structure holds the attributes of a single side of the apparatus.
-struct container
+// All of the vessels of the apparatus and the tubes between them.
+// The classic apparatus is two vessels, one wide (big) and one narrow (small), connected by one tube.
+VesselNetwork network;
+
+// Worker threads used to step large networks in parallel. Created in main().
+TaskPool* taskPool = nullptr;
+
+// With --numa, the workers of taskPool are pinned to the NUMA nodes, and the part of the network every one of them steps is moved to
+// its node. With --huge-pages, the arrays of the network ask for 2 MB pages. Both are applied by placeNetworkMemory() after setup().
+bool numaPlacement = false;
+bool hugePages = false;
+
+// With --autotune, autotune() tries how many threads and how big their blocks step the scene fastest after setup(), and steps it
+// like that (see Autotune.h). With --autotune-cache FILE, what it found is kept in that file for the next run on this machine.
+bool autotuneRun = false;
+std::string autotuneCacheFile;
+
+// Whether the tube flows are solved for the whole network at once (--implicit), which is stable at any step size on stiff networks,
+// or integrated with an error estimate in as many substeps as that asks for (--adaptive), or with leapfrog, which keeps the energy
+// of long undamped runs (--symplectic).
+Integrator integrator = INTEGRATOR_LOCAL;
+SolverPreconditioner preconditioner = PRECONDITIONER_JACOBI;	// --preconditioner jacobi | ic | direct | amg
+float adaptiveTolerance = AdaptiveStepping().tolerance;			// --adaptive-tolerance METERS
+
+// With --multirate, every component of the local step takes as many substeps as its own stiffness needs (see VesselNetwork.h).
+bool multirate = false;
+
+// The damping of the tube of the classic apparatus (--tube-damping D). 0 swings forever, which is what --symplectic is for.
+float tubeDamping = DEFAULT_TUBE_DAMPING;
+
+// Which type the simulation state is kept in (--precision single | mixed | double | fixed). See VesselNetwork.h. A headless run in
+// fixed point prints a hash of its state at the end, which is the same on every machine that ran the same steps.
+Precision precision = PRECISION_SINGLE;
+
+// Whether the tubes scatter their volumes one color at a time (--colored-scatter) instead of every vessel gathering them.
+TubeScatter scatter = SCATTER_GATHER;
+
+// How the fluid in a vessel is shared between the tubes that drain it (--drain-limit even | outflow). See VesselNetwork.h.
+DrainLimit drainLimit = DRAIN_EVEN;
+
+// With --grid RESOLUTION, the apparatus is laid out on a grid of about that many cells across and simulated as a fluid that
+// actually flows through the vessels and the tube (see GridFluid.h), instead of as a network that only knows the levels. The grid
+// reaches up to GRID_CEILING, the top of the window. The levels of the network are still kept up to date from the grid, so the
+// piston and the output work the same.
+#define GRID_CEILING 1.0f
+int gridResolution = 0;
+GridFluid grid;
+
+// How the grid solves for its pressure (--grid-pressure multigrid | jacobi). See GridPressureSolver.h.
+PressureMethod gridPressureMethod = PRESSURE_MULTIGRID;
+
+// How the grid carries the fluid along (--grid-advection semi-lagrangian | flip), and with flip, how much of the change of the grid
+// velocity the particles take over (--flip-ratio R, from 0 for PIC to 1 for FLIP). See GridFluid.h.
+GridAdvection gridAdvection = ADVECTION_SEMI_LAGRANGIAN;
+float flipRatio = GRID_FLIP_RATIO;
+
+// Whether the tubes are cells of the grid or lumped pipes between the vessels (--grid-tubes cells | reduced). Reduced tubes are
+// drawn as the quads of the network, since the grid doesn't hold them.
+GridTubeModel gridTubes = TUBES_CELLS;
+
+// With --particles COUNT, the apparatus is filled with about that many particles of fluid instead (see ParticleFluid.h), which
+// splash and slosh through the vessels and the tube. Like the grid, they keep the levels of the network up to date and reach up to
+// GRID_CEILING.
+int particleTarget = 0;
+ParticleFluid particles;
+
+// The order the particles are sorted in (--particle-order morton | rows). See ParticleSort.h. With --counters, headless mode reports
+// how often the sorts ran and what the passes over the neighbours missed in the caches, so the two orders can be compared.
+ParticleOrder particleOrder = PARTICLE_ORDER_MORTON;
+
+// With --gpu, the particles are stepped by compute shaders instead (see GpuParticleFluid.h), which needs an OpenGL 4.3 context.
+// The simulation thread drives the GPU through a hidden window of its own, whose context shares its buffers with the one we draw
+// with. If anything of that isn't available, the particles stay on the CPU.
+#define PARTICLE_COMPUTE_FILE "../Assets/ParticleCompute.glsl"
+bool gpuParticles = false;
+GpuParticleFluid gpuFluid;
+GLFWwindow* simulationContext = nullptr;
+
+// Debug builds, and release builds with --gl-debug, ask for a debug context and log what the driver reports (see GLDebug.h).
+#ifdef _DEBUG
+bool glDebug = true;
+#else
+bool glDebug = false;
+#endif
+
+// With --gpu-network, the network itself is stepped by compute shaders (see GpuNetwork.h), through the same hidden window, and the
+// fill levels are drawn straight from the buffers it writes. If the GPU can't do it, the network stays on the CPU.
+#define NETWORK_COMPUTE_FILE "../Assets/NetworkCompute.glsl"
+bool gpuNetworkStep = false;
+GpuNetwork gpuNetwork;
+
+// The newest statistics of the network that came back from the GPU (see GpuNetwork::pollStatistics()), and the step they are of,
+// or -1 before the first. Only touched by the simulation thread, which hands them on with its snapshots.
+GpuNetworkStatistics gpuStatistics;
+long long gpuStatisticsStep = -1;
+
+// With --shallow-water CELLS, every vessel at least SHALLOW_WATER_MIN_WIDTH wide gets a surface of that many cells across that
+// sloshes (see ShallowWater.h), while the rest of the network keeps working as before.
+int shallowCells = 0;
+ShallowWater shallowWater;
+
+// With --sweep FILE --sweep-view, the window steps and shows every variant of the sweep side by side instead of the classic
+// apparatus. The pressure of every variant comes from the sweep, so there is no piston.
+bool sweepView = false;
+Sweep viewedSweep;
+
+// The classic apparatus is known when we compile, so unless the command line asks for something it can't do (--implicit,
+// --precision, other fluids or gravity), it is stepped by a FixedNetwork, which the compiler unrolls completely. --generic always uses the general step,
+// for comparing the two. Both give exactly the same result.
+struct ClassicApparatus
+{
+	static constexpr int vessels = 2;
+	static constexpr int tubes = 1;
+	static constexpr FixedTube tube[tubes] = { { 0, 1 } };
+};
+
+struct ApparatusPhysics
+{
+	static constexpr float density = DEFAULT_DENSITY;
+	static constexpr float gravity = DEFAULT_GRAVITY;
+};
+
+FixedNetwork<ClassicApparatus, ApparatusPhysics> apparatus;
+bool useFixedApparatus = false;
+bool genericStep = false;
+
+// Index of the vessel the piston pushes on. externalPressure is applied to this vessel.
+int pistonVessel = 0;
+
+// The piston is a rigid body on the surface of that vessel (see Piston.h). It is pushed down with externalPressure times its width,
+// which the keys change, or with the force a profile gives for the time of the step (--piston-force FILE). With a mass
+// (--piston-mass M) it has inertia and weight of its own; without one it pushes with exactly externalPressure.
+Piston piston;
+std::string forceProfileFile;
+ForceProfile forceProfile;
+
+// With --pressure-schedule FILE, the external pressures of the other vessels follow the expressions of the file, compiled and
+// evaluated in batches before every step (see PressureSchedule.h).
+std::string pressureScheduleFile;
+PressureSchedule pressureSchedule;
+
+// With --scenarios FILE, headless mode runs every scenario of the file side by side on copies of the scene (see Scenario.h and
+// runScenarios()), and the window plays the one --scenario NAME picks (the first by default), which pushes on the piston instead of
+// the keys.
+std::string scenarioFile;
+std::string scenarioName;
+ScenarioRunner scenarios;
+int playedScenario = 0;
+bool scenarioPlaying = false;
+
+// With --component NAME VESSEL [SETTING]..., a component of a plugin (see ComponentPlugins.h) sits on a vessel, and watches it or
+// pushes on it around every step. The ones the command line asks for are added to components once the network is there.
+struct ComponentSpec
+{
+	std::string name;
+	int vessel;
+	std::vector<float> settings;
+};
+std::vector<ComponentSpec> componentSpecs;
+ComponentSet components;
+
+// With --sensors FILE, virtual sensors sample levels, pressures and flows after every step, each at a rate of its own (see
+// Sensors.h). The samples go to the CSV file of --sensor-output FILE, and the newest ones to the metrics endpoint.
+std::string sensorFile;
+std::string sensorOutputFile;
+SensorSet sensors;
+
+// With --ingest-port PORT or --ingest-shm NAME, the session is the digital twin of a plant: the readings the plant sends (see
+// SensorIngest.h) are the external pressures and heights of its vessels, applied when the steps reach their times.
+int ingestPort = 0;
+std::string ingestShmName;
+SensorIngest sensorIngest;
+
+// With --assimilate MEMBERS as well, a measured height doesn't set the height of its vessel, it corrects the whole twin through an
+// ensemble Kalman filter of that many members (see EnsembleFilter.h), with measurements off by up to --assimilate-noise meters and
+// the model by --assimilate-spread.
+int assimilateMembers = 0;
+float assimilateNoise = FILTER_DEFAULT_NOISE;
+float assimilateSpread = FILTER_DEFAULT_SPREAD;
+EnsembleFilter ensembleFilter;
+
+// With --floats COUNT, that many rigid floats bob on the surfaces of the vessels (see FloatingBodies.h), --float-size meters wide and
+// high (0 for FLOAT_DEFAULT_SIZE_FRACTION of the average vessel) and --float-density times as dense as the fluid.
+int floatCount = 0;
+float floatSize = 0.0f;
+float floatDensity = FLOAT_DEFAULT_DENSITY_RATIO;
+FloatingBodies floats;
+
+// The top edge of every vessel before the most recent physics step. The renderer blends between this and the current
+// state so that motion looks smooth even when the physics rate and the render rate don't line up.
+std::vector<float> previousTop;
+
+// How many physics steps have been simulated, counting the steps of a restored checkpoint.
+long long simulationStep = 0;
+
+// Checkpoints. If checkpointFile is set, the state is saved there every checkpointInterval simulated seconds (on a background
+// thread) and once more on exit. If restoreFile is set, the simulation starts from that checkpoint instead of the default setup.
+std::string checkpointFile;
+double checkpointInterval = 10.0;
+std::string restoreFile;
+CheckpointWriter* checkpointWriter = nullptr;
+
+// With --scene, setup() loads the network from a scene file (see Scene.h) instead of building the classic apparatus. With
+// --compile-scene, the text scene in compileSceneFrom is written to compileSceneTo in the binary form, and the program exits.
+// With --scene-tiles, it is cut into tiles of sceneTileSize instead, and --scene then streams them in around the view through
+// sceneStreamer (see TiledScene.h).
+std::string sceneFile;
+std::string compileSceneFrom;
+std::string compileSceneTo;
+float sceneTileSize = 0.0f;
+
+// With --generate-scene KIND VESSELS FILE, a synthetic network is written to FILE in the binary form instead (see
+// NetworkGenerator.h), and the program exits. --scene-tiles and --scene-order apply to it as well.
+std::string generateSceneTo;
+GeneratorSettings generatorSettings;
+
+// With --scene-order, the vessels of a scene (or of a compiled one) are renumbered so connected vessels are close in memory.
+VesselOrder sceneOrder = ORDER_AS_LOADED;
+SceneStreamer sceneStreamer;
+
+// If telemetryFile is set, the state of every vessel is recorded after every physics step (as CSV if the name ends in .csv).
+// With a telemetryTolerance (in meters of height) a binary file is compressed and keeps every height to within half of it.
+std::string telemetryFile;
+float telemetryTolerance = 0.0f;
+TelemetryWriter* telemetry = nullptr;
+
+// If liveExportName is set, the state of every vessel is published to shared memory of that name after every physics step.
+std::string liveExportName;
+LiveExport liveExport;
+
+// If streamPort is set, the fill levels are streamed to remote viewers on that port, streamHz times per simulated second and to
+// within streamTolerance meters.
+int streamPort = 0;
+double streamHz = 30.0;
+float streamTolerance = 0.001f;
+
+// With --stream-view HOST:PORT, the window shows the levels such a stream sends instead of simulating, on the vessels of the same
+// --scene. The frames are played a little behind the newest and interpolated, so even a low --stream-hz moves smoothly (see
+// StreamInterpolator).
+std::string streamViewSource;
+StreamView streamView;
+std::vector<float> streamViewHeights;
+bool streamViewMismatch = false;
+StateStreamServer* stateStream = nullptr;
+
+// With a playbackFile the viewer shows a recorded run instead of simulating one. Every physics step moves playbackSpeed recorded
+// steps on (backwards if it is negative, and on some physics steps not at all if it is below 1), and the keys change the speed,
+// pause it or jump through it (see seekPlayback()) by adding to playbackSeek.
+#define PLAYBACK_MIN_SPEED (1.0f / 64.0f)
+#define PLAYBACK_MAX_SPEED 1024.0f
+std::string playbackFile;
+TelemetryReader playback;
+std::vector<float> playbackValues;
+long long playbackPosition = 0;
+double playbackAdvance = 0.0;	// The part of a step the speed has moved on by so far
+std::atomic<long long> playbackSeek(0);
+std::atomic<bool> playbackPaused(false);
+std::atomic<float> playbackSpeed(1.0f);
+
+// Puts the state recorded after step (or the last step before it) into the network. Returns false if the file doesn't have it.
+bool showPlaybackStep(long long step)
+{
+	if (!playback.readStep(step, playbackValues))
+	{
+		return false;
+	}
+	for (int v = 0; v < network.vesselCount(); v++)
+	{
+		network.height[v] = playbackValues[v * TELEMETRY_FIELDS + 0];
+		network.pressure[v] = playbackValues[v * TELEMETRY_FIELDS + 1];
+		network.externalPressure[v] = playbackValues[v * TELEMETRY_FIELDS + 2];
+		network.top[v] = network.bottom[v] + network.height[v];
+	}
+	playbackPosition = step;
+	simulationStep = step;
+	return true;
+}
+
+// Takes the place of update() during playback. Returns false if the step on screen stays the same. Playback pauses once it reaches
+// the end it is heading to.
+bool playTelemetry()
+{
+	long long target = playbackPosition + playbackSeek.exchange(0);
+	if (!playbackPaused)
+	{
+		float speed = playbackSpeed;
+		playbackAdvance += speed;
+		long long whole = (long long)playbackAdvance;
+		playbackAdvance -= (double)whole;
+		target += whole;
+		if ((speed > 0.0f && target >= playback.lastStep()) || (speed < 0.0f && target <= playback.firstStep()))
+		{
+			playbackPaused = true;
+		}
+	}
+	target = std::max(playback.firstStep(), std::min(playback.lastStep(), target));
+	return target != playbackPosition && showPlaybackStep(target);
+}
+
+// Input that changes the simulation goes through here, stamped with the physics step it is applied on. Keys push their commands into
+// inputQueue, and the next step applies them. The queue is lock-free with one producer and one consumer (the thread running
+// update()), so the two can be separate threads and the consumer never waits. There are two producers, the thread handling GLFW
+// events and the remote control (with controlPort set), so they take inputProducerLock to push one at a time.
+// With recordInputFile set, every applied command is logged and written on exit.
+// With replayInputFile set, the commands come from that log instead of the keyboard.
+SpscQueue<QueuedInput, 256> inputQueue;
+std::mutex inputProducerLock;
+InputLog inputLog;
+std::string recordInputFile;
+std::string replayInputFile;
+int controlPort = 0;
+
+// The state of the last steps of an interactive session, for going back with the left arrow key (a second, 10 with control) or the
+// rewind command of the remote control. A frame is the heights, the flows and the external pressures of the network, then
+// externalPressure and the velocity and the pressure of the piston. With --rewind-memory 0, or with anything that keeps state of its
+// own (the grid, the particles, shallow water, the GPU step, layers, tube components, a streamed scene, telemetry, a playback or a twin),
+// there is no history.
+RewindHistory rewindHistory;
+double rewindMemory = REWIND_DEFAULT_MEMORY / 1048576.0;
+bool rewindEnabled = false;
+std::vector<float> rewindFrame;
+RemoteControl remoteControl;
+
+// With --speculate STEPS, the simulation doesn't wait for a remote controller on a slow link. It steps on as if the commands it has
+// were all there are, and a command stamped with a step that already ran (see RemoteControl.h), up to STEPS back, takes it back to
+// that step through the rewind history and runs the steps since again with the command where it belongs, all before the next step.
+// The network then ends up where it would be had the command come in time, and shows it one step after it arrived. A command from
+// further back is applied at the oldest step it can be. speculatedInputs are the commands applied in the last STEPS steps, which
+// the steps that run again apply again, and arrivedInputs the commands taken from inputQueue for the next step.
+long long speculateSteps = 0;
+std::vector<InputEvent> speculatedInputs;
+std::vector<QueuedInput> arrivedInputs;
+bool resimulating = false;
+
+// With --lockstep-host PORT, this session is the clock of a lockstep session other machines follow, and with
+// --lockstep-join HOST:PORT it follows one (see Lockstep.h). A peer hands the commands of its keys and its remote control to the
+// host instead of applying them, and applies those the host sends back at their steps.
+int lockstepPort = 0;
+std::string lockstepJoin;
+LockstepSession lockstep;
+
+// The key presses the simulation has applied (when they were made, and the step that applied them) that no frame has shown yet, for
+// measuring the latency (see LatencyMeter.h). Only the simulation thread touches appliedInputs, and every snapshot carries a copy of
+// it. The render thread sets shownStep to the step of every snapshot it picks up, after which the key presses up to that step are
+// dropped. Snapshots the render thread skips don't lose any, since they stay until then.
+struct AppliedInput
+{
+	double time;
+	long long step;
+};
+std::vector<AppliedInput> appliedInputs;
+std::atomic<long long> shownStep(-1);
+
+// Idle mode. Once the whole network has come to rest, the simulation thread stops stepping and waits on simulationWake until
+// queueInput() (or stopSimulation()) sets simulationWakeRequested. simulationIdle tells the render thread, which then stops drawing
+// identical frames and waits for window events instead, until something changes (see IDLE_WAIT_SECONDS).
+std::mutex simulationIdleLock;
+std::condition_variable simulationWake;
+bool simulationWakeRequested = false;
+std::atomic<bool> simulationIdle(false);
+
+// Set by the window callbacks when the window has to be drawn again even though the simulation hasn't changed.
+bool redrawRequested = true;
+
+// While idle, the render thread still wakes up this often to pick up shader changes and finish captures.
+#define IDLE_WAIT_SECONDS 0.25
+
+// Timestep settings.
+// physicsHz is how many times per second update() runs. It is fixed, so the simulation gives the same result on any machine.
+// renderHz caps how many frames per second we draw. Set it to 0 to render as fast as possible.
+// Anything above MAX_STEPS_PER_FRAME physics steps in one frame is dropped, so a long stall (e.g. dragging the window) can't
+// make us spend the next frame catching up, which would cause another long frame, and so on.
+double physicsHz = 120.0;
+double renderHz = 60.0;
+#define MAX_STEPS_PER_FRAME 8
+
+// With --power-saving, the frames are capped at POWER_SAVING_HZ while the window is in the background or minimized or the machine
+// runs on battery (checked every POWER_CHECK_SECONDS), and at POWER_IDLE_HZ once there was no input for POWER_IDLE_SECONDS. The
+// next key, click or mouse move lifts the cap. The simulation keeps its fixed step, so it comes to the same states, but while the
+// frames are capped it only wakes up once per frame (simulationWakeHz) and runs the steps that are due in one go. At equilibrium
+// both threads wait for events anyhow, so nothing changes there. frameHz is the rate the render loop paces itself at.
+#define POWER_SAVING_HZ 30.0
+#define POWER_IDLE_HZ 20.0
+#define POWER_IDLE_SECONDS 30.0
+#define POWER_CHECK_SECONDS 5.0
+bool powerSaving = false;
+bool onBattery = false;
+double lastPowerCheck = -POWER_CHECK_SECONDS;
+double lastInputTime = 0.0;
+double frameHz = 60.0;
+std::atomic<double> simulationWakeHz(0.0);
+
+// The time scale is how many simulated seconds pass per second, set with --time-scale and changed with the period (doubles it),
+// comma (halves it) and slash (back to 1) keys, from 1 / TIME_SCALE_MAX to TIME_SCALE_MAX. The steps stay physicsHz apart in
+// simulated time, only more or fewer of them run per second. Above 1 the simulation thread works in rounds of one frame, runs as
+// many of the steps due as fit in FAST_FORWARD_BUDGET of it and publishes only the last one, so the renderer doesn't copy states
+// it never draws. If the steps take longer than that, the rest is dropped like past MAX_STEPS_PER_FRAME, which throttles the scale
+// to what the machine keeps up with instead of falling behind. achievedTimeScale is the speed it really ran at (for the HUD),
+// measured over TIME_SCALE_WINDOW seconds.
+#define TIME_SCALE_MAX 1024.0f
+#define FAST_FORWARD_BUDGET 0.75
+#define TIME_SCALE_WINDOW 0.5
+std::atomic<float> timeScale(1.0f);
+std::atomic<float> achievedTimeScale(1.0f);
+
+// With --metrics-port PORT, the profiler, the memory and the numbers below can be scraped over HTTP (see MetricsServer.h). The
+// steps are only counted while it runs, and only ever go up, also when the session is rewound.
+int metricsPort = 0;
+MetricsServer metricsServer;
+std::atomic<long long> metricSteps(0);
+
+double readStepsTotal()
+{
+	return (double)metricSteps.load(std::memory_order_relaxed);
+}
+
+// Only the thread of the metrics server calls this, so it can keep the last scrape to itself.
+double readStepsPerSecond()
+{
+	static std::chrono::steady_clock::time_point lastTime = std::chrono::steady_clock::now();
+	static long long lastSteps = 0;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	long long steps = metricSteps.load(std::memory_order_relaxed);
+	double seconds = std::chrono::duration<double>(now - lastTime).count();
+	double rate = seconds > 0.0 ? (steps - lastSteps) / seconds : 0.0;
+	lastTime = now;
+	lastSteps = steps;
+	return rate;
+}
+
+double readTimeScale()
+{
+	return achievedTimeScale.load(std::memory_order_relaxed);
+}
+
+double readIdle()
+{
+	return simulationIdle.load(std::memory_order_relaxed) ? 1.0 : 0.0;
+}
+
+double readInputQueue()
+{
+	return (double)inputQueue.size();
+}
+
+void stopMetrics()
+{
+	metricsServer.stop();
+}
+
+// How frames are presented, chosen with --present, and capped at renderHz (--fps) by the render loop either way:
+// PRESENT_IMMEDIATE swaps the buffers straight away, which gives the highest frame rate and can tear.
+// PRESENT_VSYNC waits for the next refresh of the screen.
+// PRESENT_ADAPTIVE waits for the refresh too, but swaps straight away if the frame is already late, instead of waiting for the one
+// after it (EXT_swap_control_tear; without it, this is PRESENT_VSYNC).
+// PRESENT_LOW_LATENCY doesn't wait for the refresh. It sleeps at the start of the frame instead of the end, until just long enough
+// before the next one is due to draw it, so the input and the snapshot it draws are as recent as they can be. After the swap it
+// waits for the GPU to finish, so the driver never queues frames ahead of the screen.
+// The sleeps overshoot by up to a scheduler tick, so they stop SPIN_WAIT_SECONDS early and yield the rest of the way. The low
+// latency mode starts drawing LATENCY_MARGIN_SECONDS before the time the last frames took would require. eventsReadTime is when the
+// window events were last read (see pumpEvents()), below 0 before the first time.
+enum PresentMode
+{
+	PRESENT_IMMEDIATE = 0,
+	PRESENT_VSYNC,
+	PRESENT_ADAPTIVE,
+	PRESENT_LOW_LATENCY
+};
+#define SPIN_WAIT_SECONDS 0.002
+#define LATENCY_MARGIN_SECONDS 0.001
+PresentMode presentMode = PRESENT_IMMEDIATE;
+double eventsReadTime = -1.0;
+
+// Whether the profiler bars are drawn over the scene (toggled with F1), and when the numbers in the title bar were last refreshed.
+bool showProfiler = true;
+double lastProfilerTitle = 0.0;
+
+// Whether the live numbers (the piston, the heights and pressures of the first HUD_VESSELS vessels, with --gpu-network the
+// statistics of the whole network, and the profiler) are drawn in the top right corner (toggled with F2), and when their text was
+// last written. It is only written again every HUD_REFRESH_SECONDS, which is as often as anyone can read it, and every frame in
+// between draws the text already uploaded.
+#define HUD_VESSELS 2
+#define HUD_REFRESH_SECONDS 0.25
+#define TEXT_VERTEX_SHADER_FILE "../Assets/TextVertexShader.glsl"
+#define TEXT_FRAGMENT_SHADER_FILE "../Assets/TextFragmentShader.glsl"
+bool showHud = true;
+double lastHudText = -1.0;
+
+// Frame capture. F12 saves a PNG screenshot and F10 an EXR one; F11 starts and stops recording every frame as a numbered PNG.
+bool screenshotRequested = false;
+CaptureFormat screenshotFormat = CAPTURE_PNG;
+int screenshotCount = 0;
+bool recording = false;
+int recordedFrames = 0;
+
+// With --hitch-capture PREFIX, every frame that takes much longer than the ones before it (see HitchDetector.h) writes the trace
+// to PREFIX_NNN.json and a screenshot of the next frame to PREFIX_NNN.png. --hitch-factor sets how much longer.
+std::string hitchCapturePrefix;
+HitchDetector hitchDetector;
+std::string hitchScreenshot;
+
+// renderSamples is how many samples per pixel the scene is drawn with (--samples), in the window, the screenshots and the video.
+// With --capture-size, screenshots aren't read from the window, but drawn again at that size, so a large screenshot doesn't need a
+// large window and doesn't slow down the frames drawn for it. They are drawn into a float image, so the EXR ones keep more than 8
+// bits. Recordings are still read from the window. The captures of a frame are the passes of captureGraph, which culls the ones no
+// capture asked for, so the target of the screenshots only exists while they are taken.
+int renderSamples = 1;
+int captureWidth = 0;
+int captureHeight = 0;
+FrameGraph captureGraph;
+
+// With --view overview|zoom|plot, as often as there are screens to fill, the scene is also shown in a window of its own next to the
+// main one (see the Dashboard region):
+// overview: the whole apparatus, however the main camera moves.
+// zoom: a close up of the surface in the vessel under the piston, which follows it up and down.
+// plot: the heights and pressures of the first HUD_VESSELS vessels after every step, up to PLOT_CAPACITY steps back.
+#define DASHBOARD_MAX_VIEWS 4
+enum DashboardKind
+{
+	VIEW_OVERVIEW = 0,
+	VIEW_ZOOM,
+	VIEW_PLOT
+};
+std::vector<DashboardKind> dashboardKinds;
+
+void setup()
+{
+	// Set up the variables and attributes for both sides of the apparatus
+	network.clear();
+	network.integrator = integrator;
+	network.solver.preconditioner = preconditioner;
+	network.adaptive.tolerance = adaptiveTolerance;
+	network.precision = precision;
+	network.scatter = scatter;
+	network.multirate = multirate;
+	network.drainLimit = drainLimit;
+	int big = 0;
+	CheckpointInfo sceneInfo;
+	if (sweepView)
+	{
+		SweepSettings settings;
+		settings.integrator = integrator;
+		settings.preconditioner = preconditioner;
+		settings.precision = precision;
+		settings.layout = SWEEP_LAYOUT_NETWORK;
+		viewedSweep.build(network, settings, 0, viewedSweep.variantCount());
+	}
+	else if (!sceneFile.empty() && isTiledScene(sceneFile) && sceneStreamer.open(sceneFile))
+	{
+		// Only the tile of the piston and the ones around the view at the start are there for the first step. The modes that are
+		// built once from the whole network, and the files that cover all of it, can't follow the tiles, so they get all of them.
+		bool wholeScene = gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || !dashboardKinds.empty() || !layerSettings.empty() ||
+			!telemetryFile.empty() || !checkpointFile.empty() || !restoreFile.empty() || !playbackFile.empty() || gpuNetworkStep || !componentSpecs.empty() || !sensorFile.empty();
+		if (wholeScene)
+		{
+			std::cout << "Loading every tile, since the other options need the whole scene." << std::endl;
+			sceneStreamer.focus(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX);
+		}
+		else
+		{
+			sceneStreamer.focus(-1.0f, -1.0f, 1.0f, 1.0f);
+		}
+		sceneStreamer.waitForFocus();
+		sceneStreamer.apply(network);
+		big = network.vesselCount() > 0 ? network.vesselIndex(sceneStreamer.pistonHandle()) : network.addVessel(-0.75f, -0.5f, 0.5f, 0.5f);
+		externalPressure = sceneStreamer.sceneInfo().pistonPressure != 0.0f ? sceneStreamer.sceneInfo().pistonPressure : externalPressure;
+		simulationStep = sceneStreamer.sceneInfo().step;
+		if (wholeScene)
+		{
+			sceneStreamer.close();
+		}
+	}
+	else if (!sceneFile.empty() && readScene(sceneFile, network, sceneInfo, sceneOrder))
+	{
+		// Only a binary scene stores the pressure of the piston. If it has none, the one from --pressure stays.
+		big = sceneInfo.pistonVessel;
+		externalPressure = sceneInfo.pistonPressure != 0.0f ? sceneInfo.pistonPressure : externalPressure;
+		simulationStep = sceneInfo.step;
+	}
+	else
+	{
+		if (!sceneFile.empty())
+		{
+			std::cout << "Starting with the classic apparatus instead." << std::endl;
+		}
+		big = network.addVessel(-0.75f, -0.5f, 0.5f, 0.5f);
+		int small = network.addVessel(0.5f, -0.5f, 0.25f, 0.5f);
+		network.addTube(big, small, DEFAULT_TUBE_INERTANCE, tubeDamping);
+	}
+
+	if (!layerSettings.empty())
+	{
+		network.addFluid(density);
+		for (const LayerSetting& setting : layerSettings)
+		{
+			if (setting.vessel < 0 || setting.vessel >= network.vesselCount())
+			{
+				std::cout << "There is no vessel " << setting.vessel << ", ignoring its layer." << std::endl;
+				continue;
+			}
+			network.setLayer(setting.vessel, network.addFluid(setting.density), setting.height, gravity);
+		}
+	}
+	network.computePressures(density, gravity);
+
+	pistonVessel = big;
+
+	if (!restoreFile.empty())
+	{
+		CheckpointInfo info;
+		if (readCheckpoint(restoreFile, network, info))
+		{
+			simulationStep = info.step;
+			externalPressure = info.pistonPressure;
+			pistonVessel = info.pistonVessel;
+			network.computePressures(density, gravity);
+			std::cout << "Restored " << restoreFile << " at step " << simulationStep << std::endl;
+		}
+	}
+
+	// Only the single precision local and implicit steps follow the profiles (see VesselNetwork::profiles).
+	if (network.profiled() && (precision != PRECISION_SINGLE || integrator == INTEGRATOR_ADAPTIVE || integrator == INTEGRATOR_SYMPLECTIC
+		|| network.layered()))
+	{
+		std::cout << "This step doesn't follow the vessel profiles of the scene, the profiled vessels move as rectangles." << std::endl;
+	}
+
+	// The implicit solve divides by the inertance of every tube, which a closed valve or a running pump doesn't have. The valves
+	// work in every other step, but only the local step in single precision knows about check valves and pumps.
+	if (network.hasComponents() && integrator == INTEGRATOR_IMPLICIT)
+	{
+		std::cout << "The implicit solve can't step tubes with components on them, stepping the tubes one by one instead." << std::endl;
+		integrator = INTEGRATOR_LOCAL;
+		network.integrator = integrator;
+	}
+	if (network.hasComponents() && (precision != PRECISION_SINGLE || integrator != INTEGRATOR_LOCAL || network.layered()))
+	{
+		std::cout << "Only the local step in single precision runs the check valves and pumps of the scene." << std::endl;
+	}
+
+	piston.vessel = pistonVessel;
+	pressureSchedule.bind(network, pistonVessel);
+	components = ComponentSet();
+	for (const ComponentSpec& spec : componentSpecs)
+	{
+		if (!components.add(network, spec.name, spec.vessel, spec.settings))
+		{
+			std::cout << "Leaving out the " << spec.name << " on vessel " << spec.vessel << "." << std::endl;
+		}
+	}
+	sensors.bind(network, physicsHz);
+	if (assimilateMembers > 0 && !ensembleFilter.build(network, assimilateMembers, assimilateNoise, assimilateSpread))
+	{
+		assimilateMembers = 0;
+	}
+	floats.clear();
+	floats.scatter(network, floatCount, floatSize, floatDensity, density);
+
+	grid.advection = gridAdvection;
+	grid.flipRatio = flipRatio;
+	grid.tubeModel = gridTubes;
+	if (gridResolution > 0 && !grid.build(network, gridResolution, GRID_CEILING))
+	{
+		gridResolution = 0;
+	}
+	else if (gridResolution > 0)
+	{
+		std::cout << "Grid " << grid.columns << " x " << grid.rows << " in " << grid.tiles.tileCount() << " of "
+			<< grid.tiles.tileColumns * grid.tiles.tileRows << " tiles, " << grid.bytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+		if (gridAdvection == ADVECTION_FLIP)
+		{
+			std::cout << "Carried by " << grid.particleX.size() << " particles" << std::endl;
+		}
+	}
+	grid.solver.method = gridPressureMethod;
+	particles.sortOrder = particleOrder;
+	if (particleTarget > 0 && !particles.build(network, particleTarget, GRID_CEILING))
+	{
+		particleTarget = 0;
+	}
+	if (shallowCells > 0 && !shallowWater.build(network, shallowCells))
+	{
+		shallowCells = 0;
+	}
+
+	previousTop = network.top;
+
+	useFixedApparatus = !genericStep && gridResolution == 0 && particleTarget == 0 && shallowCells == 0 && integrator == INTEGRATOR_LOCAL && precision == PRECISION_SINGLE && scatter == SCATTER_GATHER && !multirate && drainLimit == DRAIN_EVEN && !gpuNetworkStep && !network.layered() && !network.profiled() && !network.hasComponents()
+		&& density == ApparatusPhysics::density && gravity == ApparatusPhysics::gravity && !sceneStreamer.isOpen() && apparatus.matches(network);
+	if (useFixedApparatus)
+	{
+		// The fixed step writes the flows and changes of the tubes back into the network too, so those arrays have to exist.
+		network.rebuildTopology();
+		apparatus.load(network);
+	}
+
+	if (!checkpointFile.empty())
+	{
+		checkpointWriter = new CheckpointWriter();
+	}
+
+	if (!telemetryFile.empty())
+	{
+		// The pressures are kept to the same height of fluid.
+		float tolerance[TELEMETRY_FIELDS] = { telemetryTolerance, telemetryTolerance * density * gravity,
+			telemetryTolerance * density * gravity };
+		telemetry = new TelemetryWriter();
+		if (!telemetry->open(telemetryFile, network.vesselCount(), telemetryTolerance > 0.0f ? tolerance : nullptr))
+		{
+			delete telemetry;
+			telemetry = nullptr;
+		}
+	}
+
+	if (!sensorOutputFile.empty())
+	{
+		sensors.open(sensorOutputFile);
+	}
+
+	if (!liveExportName.empty() && liveExport.open(liveExportName, network.vesselCount()))
+	{
+		std::cout << "Publishing the state of " << network.vesselCount() << " vessels as " << liveExportName << std::endl;
+	}
+
+	if (streamPort > 0)
+	{
+		stateStream = new StateStreamServer();
+		if (stateStream->start(streamPort, streamTolerance))
+		{
+			std::cout << "Streaming the levels on port " << streamPort << std::endl;
+		}
+		else
+		{
+			delete stateStream;
+			stateStream = nullptr;
+		}
+	}
+
+	if (!playbackFile.empty() && playback.open(playbackFile))
+	{
+		if (playback.vesselCount() != network.vesselCount() || playback.blockCount() == 0)
+		{
+			std::cout << playbackFile << " recorded " << playback.vesselCount() << " vessels and the scene has " << network.vesselCount()
+				<< ", simulating the scene instead." << std::endl;
+			playback.close();
+		}
+		else
+		{
+			// Backwards playback starts at the end.
+			showPlaybackStep(playbackSpeed < 0.0f ? playback.lastStep() : playback.firstStep());
+			previousTop = network.top;
+			std::cout << "Playing steps " << playback.firstStep() << " to " << playback.lastStep() << " of " << playbackFile << std::endl;
+		}
+	}
+}
+
+void autotune()
+{
+	if (!autotuneRun)
+	{
+		return;
+	}
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	ResultCache cache;
+	uint64_t key = tuningKey(network, maxThreads);
+	ParallelTuning tuning;
+	bool cached = !autotuneCacheFile.empty() && cache.load(autotuneCacheFile) && findTuning(cache, key, tuning);
+	if (cached)
+	{
+		std::cout << "Found the tuning of this scene in " << autotuneCacheFile << std::endl;
+	}
+	else
+	{
+		std::cout << "Tuning the threads and blocks of " << network.vesselCount() << " vessels" << std::endl;
+		tuning = tuneParallel(network, density, gravity, (float)(1.0 / physicsHz), maxThreads, &std::cout);
+		if (!autotuneCacheFile.empty())
+		{
+			storeTuning(cache, key, tuning);
+			cache.save(autotuneCacheFile);
+		}
+	}
+
+	applyTuning(network, tuning);
+	std::cout << "Stepping with " << tuning.threads << (tuning.threads == 1 ? " thread" : " threads");
+	if (tuning.threads > 1)
+	{
+		std::cout << " in blocks of " << tuning.block;
+	}
+	std::cout << " (" << tuning.nanoseconds / 1e6 << " ms per step)" << std::endl;
+
+	// With one thread the network doesn't use the pool, but the grid, the particles and the rest still do, so it stays.
+	if (tuning.threads > 1 && tuning.threads != taskPool->threadCount())
+	{
+		delete taskPool;
+		taskPool = new TaskPool(tuning.threads - 1);
+	}
+}
+
+void placeNetworkMemory()
+{
+	if (numaPlacement && !taskPool->pinToNumaNodes())
+	{
+		std::cout << "This machine has a single NUMA node, --numa does nothing." << std::endl;
+	}
+	if (taskPool->pinned() || hugePages)
+	{
+		size_t moved = network.placeMemory(taskPool, hugePages);
+		if (taskPool->pinned())
+		{
+			std::cout << "Moved " << moved / 1048576.0 << " MB of the network to the nodes of the workers stepping it" << std::endl;
+		}
+	}
+}
+
+// Hands the current state to the checkpoint writer. Only the copy happens here, the file is written in the background.
+void saveCheckpoint()
+{
+	CheckpointInfo info;
+	info.step = simulationStep;
+	info.pistonPressure = externalPressure;
+	info.pistonVessel = pistonVessel;
+	checkpointWriter->save(checkpointFile, network, info);
+}
+
+// Writes the final checkpoint and waits for it. Returns false if any checkpoint of this run failed to write.
+bool finishCheckpoints()
+{
+	if (checkpointWriter == nullptr)
+	{
+		return true;
+	}
+
+	saveCheckpoint();
+	bool succeeded = checkpointWriter->flush();
+	delete checkpointWriter;
+	checkpointWriter = nullptr;
+	return succeeded;
+}
+
+// Writes the recorded input log, if one was asked for. Returns false if it failed to write.
+bool finishInputLog()
+{
+	return recordInputFile.empty() || inputLog.write(recordInputFile);
+}
+
+// Writes the rest of the telemetry and closes the file. Returns false if any of it failed to write.
+bool finishTelemetry()
+{
+	if (telemetry == nullptr)
+	{
+		return true;
+	}
+
+	bool succeeded = telemetry->close();
+	delete telemetry;
+	telemetry = nullptr;
+	return succeeded;
+}
+
+// Finishes every output file of the run. All of them are finished even if one fails. Returns false if any failed.
+bool finishOutputs()
+{
+	components.report(std::cout, network);
+	bool succeeded = finishCheckpoints();
+	succeeded &= finishTelemetry();
+	succeeded &= sensors.close();
+	succeeded &= finishInputLog();
+	liveExport.close();
+	remoteControl.stop();
+	sensorIngest.close();
+	lockstep.stop();
+	streamView.stop();
+	delete stateStream;
+	stateStream = nullptr;
+	return succeeded;
+}
+
+// Global data members
+#pragma region Base_data
+// This is your reference to your shader program.
+// This will be assigned with glCreateProgram().
+// This program will run on your GPU.
+GLuint program;
+
+// These are your references to your actual compiled shaders
+GLuint vertex_shader;
+GLuint fragment_shader;
+
+// The MVP matrix itself. The render queue sends it to the shader whenever it changed since the last time.
+glm::mat4 mvp = glm::mat4(1.0f);
+
+// Collects the draws of every frame, sorts them by state and merges them (see RenderQueue.h).
+RenderQueue renderQueue;
+
+// The 2D camera, which the MVP comes from. Along the shorter side of the window, the view spans from cameraCenter - 1 / cameraZoom
+// to cameraCenter + 1 / cameraZoom, so at the start it shows clip space like before, without stretching it on a window that isn't
+// square. The mouse wheel zooms around the cursor, dragging with the left button pans, and Home goes back to the start.
+#define CAMERA_ZOOM_STEP 1.2f
+#define CAMERA_MIN_ZOOM 1e-3f
+#define CAMERA_MAX_ZOOM 1e4f
+glm::vec2 cameraCenter = glm::vec2(0.0f);
+float cameraZoom = 1.0f;
+int framebufferWidth = 800;
+int framebufferHeight = 800;
+
+// The viewport and the camera follow the framebuffer as soon as the window is resized, but what is made at its size (the retained
+// frame and the fluid surface) waits until the size has stayed the same for RESIZE_SETTLE_SECONDS, so dragging the corner of the
+// window doesn't make new render targets for every frame of it. Until then the scene is drawn straight into the window, and the fluid
+// surface is stretched over it. contentScale is how many framebuffer pixels a window pixel is, 2 on most HiDPI screens, and the HUD is
+// laid out in window pixels so its text keeps its size there.
+#define RESIZE_SETTLE_SECONDS 0.25
+int targetWidth = 800;
+int targetHeight = 800;
+double resizedTime = 0.0;
+float contentScale = 1.0f;
+bool panning = false;
+double panX = 0.0;
+double panY = 0.0;
+
+// These are references to the vertex array object, the vertex buffer holding our PackedVertex data and the index buffer.
+GLuint vao;
+GLuint vbo;
+GLuint ebo;
+
+// Reference to the window object being created by GLFW.
+GLFWwindow* window;
+#pragma endregion Base_data								  
+
+// The geometry is kept in a vertex buffer on the GPU instead of being re-sent with glBegin/glEnd every frame.
+// Every shape is a quad made of 4 vertices and 2 triangles (6 indices), laid out in the buffer in this order:
+// [every vessel][piston head][piston rod][every tube]
+// The buffer never changes. The vertices that move with a water level (the tops of the vessels and the piston) name the vessel in
+// PackedVertex::level, and VertexShader.glsl adds its fill level to their y, so all that is sent after a step is the level of
+// every vessel.
+#define QUAD_VERTS 4
+#define QUAD_INDICES 6
+
+glm::vec4 waterColor = glm::vec4(0.2f, 0.2f, 0.8f, 1.0f);
+glm::vec4 pistonColor = glm::vec4(0.8f, 0.2f, 0.2f, 1.0f);
+glm::vec4 floatColor = glm::vec4(0.8f, 0.6f, 0.2f, 1.0f);
+
+// CPU side copy of the vertex data, built once in buildGeometry().
+std::vector<PackedVertex> vertices;
+int quadCount = 0;
+
+// The fill levels are read by the vertex shader from a texture buffer (float per vessel), bound to texture unit 0. Where the driver
+// supports it, the levels are written straight into the next segment of a StreamBuffer and the texture is pointed at that segment;
+// otherwise they are sent to levelBuffer with glBufferSubData.
+GLuint levelTexture = 0;
+GLuint levelBuffer = 0;
+StreamBuffer levelStream;
+
+// Where the driver has glMultiDrawElementsIndirect, the quads are drawn from a buffer of draw commands, one per run of consecutive
+// quads that can be seen. A vessel or tube that is entirely to the left or right of the view, or whose floor is above it, is left
+// out. The commands only change with the view, so they are written when the MVP changes, and every other frame costs one call,
+// however large the network is. Finding what is on screen goes through visibleQuads, a SpatialGrid over the floors of the vessels
+// and tubes, so panning and zooming around a huge network only touch the part of it that is in view.
+SpatialGrid visibleQuads;
+std::vector<int> visibleItems;
+GLuint drawCommandBuffer = 0;
+std::vector<DrawElementsIndirectCommand> drawCommands;
+glm::mat4 drawCommandMvp;
+bool drawCommandsValid = false;
+
+// The blended top edge of every vessel that was last uploaded. Comparing against it tells us when there is nothing new to send.
+std::vector<float> renderTop;
+
+// The levels are blended straight into the mapped segment of levelStream, so there is no second copy of the whole array. Only the
+// vessels from the first to the last whose level or speed changed are sent with glBufferSubData, so a wave running through one
+// corner of a huge network doesn't send all of it every frame.
+
+// In the interactive loop, the quads of the vessels are drawn into sceneFrame (see RetainedFrame.h) instead of straight into the
+// window. As long as the MVP stays the same, only the part of the window where a level moved is drawn again: uploadLevels() adds the
+// box around the old and new top of every vessel that moved to dirtyLow and dirtyHigh (which is empty while dirtyLow is above
+// dirtyHigh), and renderScene() limits the frame to it. The other modes, and the zoomed out bars, draw everything every frame.
+#define DIRTY_MARGIN_PIXELS 2.0f
+RetainedFrame sceneFrame;
+bool retainScene = false;
+glm::mat4 retainedMvp;
+glm::vec2 dirtyLow = glm::vec2(FLT_MAX);
+glm::vec2 dirtyHigh = glm::vec2(-FLT_MAX);
+
+// With --grid, the fluid is drawn as a mesh with one vertex at the center of every cell, colored by how full the cell is and how
+// fast it moves, behind the piston. The positions only change when the tiles of the grid follow the fluid somewhere else, so they
+// have their own buffer, and only the colors (4 bytes per cell) are sent again after a step. The vessel and tube quads aren't drawn.
+#define GRID_DEPTH 0.5f
+#define GRID_SPEED_WHITE 1.0f	// Fluid moving this fast is drawn white
+GLuint gridVao = 0;
+GLuint gridPositionBuffer = 0;
+GLuint gridColorBuffer = 0;
+GLuint gridPressureBuffer = 0;	// With --heatmap, one float per cell
+GLuint gridEbo = 0;
+int gridIndexCount = 0;
+int gridMeshLayout = -1;		// The layoutChanges of the grid the mesh was made for
+std::vector<unsigned char> gridColors;
+std::vector<float> gridSpeeds;
+std::vector<float> gridPressures;
+
+// With --particles, every particle is a point, colored by how fast it moves like the cells of the grid. The positions change with
+// every step, so they are sent again together with the colors. particleProgram draws the points as discs as large as the particles
+// (see ParticleVertexShader.glsl). If it doesn't build, they are drawn with the main program as squares of PARTICLE_POINT_SIZE pixels.
+#define PARTICLE_POINT_SIZE 3.0f
+#define PARTICLE_VERTEX_SHADER_FILE "../Assets/ParticleVertexShader.glsl"
+#define PARTICLE_FRAGMENT_SHADER_FILE "../Assets/ParticleFragmentShader.glsl"
+GLuint particleProgram = 0;
+GLuint particleVertexShader = 0;
+GLuint particleFragmentShader = 0;
+GLuint particleVao = 0;
+GLuint particlePositionBuffer = 0;
+GLuint particleColorBuffer = 0;
+int particlePointCount = 0;
+std::vector<glm::vec3> particlePositions;
+std::vector<unsigned char> particleColors;
+std::vector<float> particleSpeeds;
+
+// With --fluid-surface, the particles are drawn as a surface over them instead (see FluidSurface.h), from the same buffer.
+#define FLUID_SURFACE_SHADER_FILE "../Assets/FluidSurfaceShader.glsl"
+bool fluidSurfaceEnabled = false;
+FluidSurface fluidSurface;
+
+// With --spray, droplets are thrown up over the vessels whose levels move fast, and advanced on the GPU with transform feedback
+// (see SprayEffect.h). They fly in the time of the window, so lastSprayTime is when they were last advanced.
+#define SPRAY_UPDATE_SHADER_FILE "../Assets/SprayUpdate.glsl"
+bool sprayEnabled = false;
+SprayEffect spray;
+double lastSprayTime = 0.0;
+
+// With --shallow-water, the fluid in a vessel with a profile is drawn as a strip with a column of 2 vertices (at the floor and at
+// the surface) at every face between two cells and at both walls, and the quad of the vessel is flattened to nothing. The strips of
+// all profiles share one buffer, which is written again after every step.
+GLuint surfaceVao = 0;
+GLuint surfaceVbo = 0;
+GLuint surfaceEbo = 0;
+int surfaceIndexCount = 0;
+std::vector<PackedVertex> surfaceVertices;
+
+// With --gpu, the points are drawn straight from a buffer the GPU wrote (see writeGpuParticles()). Every snapshot has one of its own,
+// so the simulation never writes the one being drawn; they are all in particleVertexBuffers, to be freed on exit.
+GLuint particleDrawBuffer = 0;
+std::vector<GLuint> particleVertexBuffers;
+
+// With --gpu-network, the levels are drawn from gpuLevelBuffer, which the GPU wrote, instead of being sent from renderTop. Every
+// snapshot has a copy of its own, all of them in levelCopyBuffers, to be freed on exit. gpuLevelsChanged is set whenever a new
+// step is in gpuLevelBuffer, until the texture of the levels was pointed at it.
+GLuint gpuLevelBuffer = 0;
+bool gpuLevelsChanged = false;
+std::vector<GLuint> levelCopyBuffers;
+
+// With --sweep-view, there are far too many vessels for a quad each in the vertex buffer. Instead every vessel and tube is an
+// instance of one unit quad, which VertexShader.glsl built with INSTANCED stretches over the rectangle of the instance, and all of them are
+// drawn with a single glDrawArraysInstanced. The variants are laid out in a square grid of cells, each scaled down from the size
+// of the classic apparatus. The instances of the vessels come first and are written again after every step, with the color
+// showing how fast the level moves; the tubes after them never change. An instance is packed like a PackedVertex, into 12 bytes.
+struct InstanceFormat
+{
+	unsigned int bottomLeft;	// The corners as half floats, so the shader reads left, bottom, right and top
+	unsigned int topRight;
+	unsigned int color;			// RGBA8
+
+	InstanceFormat()
+	{
+		bottomLeft = 0;
+		topRight = 0;
+		color = 0;
+	}
+
+	InstanceFormat(const glm::vec2 &iBottomLeft, const glm::vec2 &iTopRight, const glm::vec4 &iColor)
+	{
+		bottomLeft = glm::packHalf2x16(iBottomLeft);
+		topRight = glm::packHalf2x16(iTopRight);
+		color = glm::packUnorm4x8(iColor);
+	}
+};
+GLuint instanceProgram = 0;
+GLuint instanceVertexShader = 0;
+GLuint instanceFragmentShader = 0;
+GLuint instanceVao = 0;
+GLuint instanceCornerBuffer = 0;
+GLuint instanceBuffer = 0;
+std::vector<InstanceFormat> instances;
+int viewColumns = 1;
+
+// On a viewed sweep of at least INSTANCE_PARALLEL_VESSELS vessels, the instances of the vessels are written in blocks of
+// INSTANCE_BLOCK_VESSELS on renderPool. That is a pool of its own, with half the cores, since taskPool belongs to the simulation
+// thread, which steps the sweep at the same time. Where half the cores leave no worker, there is no renderPool and the blocks are
+// written one after the other. Every block records its part of the upload into a RenderCommands of its own, and they are replayed
+// once all of them are done.
+#define INSTANCE_PARALLEL_VESSELS 65536
+#define INSTANCE_BLOCK_VESSELS 16384
+TaskPool* renderPool = nullptr;
+std::vector<RenderCommands> instanceCommands;
+
+// With --sdf, the vessels, the piston and the tubes aren't drawn as quads, but all at once by SdfFragmentShader.glsl, which covers
+// the screen with one triangle and works out for every pixel which of them cover it. The shapes are the quads, in the same order, as
+// 3 texels each of a texture buffer on texture unit 1, and they follow the levels on unit 0 like the quads do. Every pixel goes
+// through every shape, so this is for the classic apparatus and other small networks: with more than SDF_MAX_SHAPES, the quads are
+// drawn after all.
+#define SDF_MAX_SHAPES 256
+bool sdfRendering = false;
+GLuint sdfProgram = 0;
+GLuint sdfVertexShader = 0;
+GLuint sdfFragmentShader = 0;
+GLuint sdfVao = 0;
+GLuint sdfShapeBuffer = 0;
+GLuint sdfShapeTexture = 0;
+
+// With --heatmap, the vessels (or the cells of the grid) are colored by their pressure through the 1D colormap on texture unit 6,
+// from 0 at the bottom of the colormap to heatmapPressure at its top. The vessels need nothing more from the CPU: the pressure is
+// linear in the depth below the fill level, so the vertex shader works it out at the corners of every quad from the levels already
+// on unit 0. The grid sends the pressure of every cell next to its colors, which then leave the speed out.
+#define HEATMAP_SIZE 256	// Texels of the colormap
+#define HEATMAP_UNIT 6	// 3 is the glyph atlas of the HUD
+bool heatmap = false;
+float heatmapPressure = 0.0f;	// 0 until init() picks that of the deepest column at the start
+GLuint heatmapTexture = 0;
+
+// With --ripples, waves run over the surface of every vessel whose level moves, higher the faster it moves, and settle with it.
+// They are drawn by the fragment shader from the time and the speed of the level alone, so they cost the CPU one float per vessel
+// next to the level, in levelSpeedBuffer (a texture buffer on unit 5), and nothing at all once the levels are at rest.
+#define RIPPLE_UNIT 5
+#define RIPPLE_HEIGHT 0.015f	// The highest a wave gets, below the fill level
+#define RIPPLE_FULL_SPEED 0.5f	// The speed of a level that makes the waves that high
+bool ripples = false;
+bool rippling = false;	// Whether the speeds on the GPU aren't all 0
+GLuint levelSpeedTexture = 0;
+GLuint levelSpeedBuffer = 0;
+std::vector<float> renderSpeed;
+
+// The quads (or the grid) are drawn with a variant of the scene shaders that has the effects above in it, if any are on.
+GLuint effectProgram = 0;
+GLuint effectVertexShader = 0;
+GLuint effectFragmentShader = 0;
+GLuint effectUniformsOf = 0;	// The program the locations below belong to
+GLint vesselVerticesLocation = -1;
+GLint heatmapScaleLocation = -1;
+
+// With --background, an image (a diagram of the apparatus, its labels) is drawn behind everything, over the square from -1 to 1 of
+// the scene. It comes in as a block compressed texture on texture unit 7 (see CompressedTexture.h), and until it is in, the scene
+// is drawn without it.
+#define IMAGE_VERTEX_SHADER_FILE "../Assets/ImageVertexShader.glsl"
+#define IMAGE_FRAGMENT_SHADER_FILE "../Assets/ImageFragmentShader.glsl"
+#define BACKGROUND_UNIT 7
+std::string backgroundFile;
+GLuint backgroundTexture = 0;
+GLuint backgroundProgram = 0;
+GLuint backgroundVertexShader = 0;
+GLuint backgroundFragmentShader = 0;
+GLuint backgroundVao = 0;
+
+// Once the network is zoomed out so far that its vessels are only a few pixels wide, it is drawn from the summaries in networkLod
+// instead (see NetworkLod.h): one bar per tile, as an instance of the same unit quad, colored lighter the fuller its vessels are.
+// There can only be as many bars as fit on screen, and they are written again whenever the levels or the view change.
+NetworkLod networkLod;
+GLuint lodVao = 0;
+GLuint lodBuffer = 0;
+std::vector<LodTile> lodTiles;
+std::vector<InstanceFormat> lodInstances;
+int lodLevel = -1;
+glm::mat4 lodMvp;
+bool lodValid = false;
+
+// With --floats, every float is an instance of the unit quad as well, written again from every snapshot that moved them.
+GLuint floatVao = 0;
+GLuint floatBuffer = 0;
+std::vector<InstanceFormat> floatInstances;
+
+// Writes the 4 corners of a quad in counter-clockwise order starting at the bottom left.
+inline void writeQuad(PackedVertex* out, glm::vec2 bottomLeft, glm::vec2 bottomRight, glm::vec2 topRight, glm::vec2 topLeft, glm::vec4 color)
+{
+	out[0] = PackedVertex(bottomLeft, color);
+	out[1] = PackedVertex(bottomRight, color);
+	out[2] = PackedVertex(topRight, color);
+	out[3] = PackedVertex(topLeft, color);
+}
+
+// Writes the quads of the vessels and the piston. The fluid of a vessel with a shallow water profile is drawn by its strip instead,
+// so its quad is flattened onto its floor.
+inline void writeVesselQuads(PackedVertex* out)
+{
+	TRACY_ZONE("writeVesselQuads");
+	int vessels = network.vesselCount();
+	const float* left = network.left.data();
+	const float* right = network.right.data();
+	const float* bottom = network.bottom.data();
+
+	// The tops of the vessels are at their fill level.
+	for (int i = 0; i < vessels; i++)
+	{
+		bool flat = shallowCells > 0 && shallowWater.profileOf[i] >= 0;
+		float level = flat ? 0.0f : (float)(i + 1);
+		float surface = flat ? bottom[i] : 0.0f;
+		PackedVertex* quad = &out[i * QUAD_VERTS];
+		writeQuad(quad, glm::vec2(left[i], bottom[i]), glm::vec2(right[i], bottom[i]), glm::vec2(right[i], surface), glm::vec2(left[i], surface), waterColor);
+		quad[2].level = level;
+		quad[3].level = level;
+	}
+
+	// The piston sits on top of the water in its vessel.
+	float pistonLevel = (float)(pistonVessel + 1);
+	float pistonLeft = left[pistonVessel];
+	float pistonRight = right[pistonVessel];
+	PackedVertex* head = &out[vessels * QUAD_VERTS];
+	writeQuad(head, glm::vec2(pistonLeft, 0.0f), glm::vec2(pistonRight, 0.0f), glm::vec2(pistonRight, 0.1f), glm::vec2(pistonLeft, 0.1f), pistonColor);
+	for (int k = 0; k < QUAD_VERTS; k++)
+	{
+		head[k].level = pistonLevel;
+	}
+
+	// The rod of the piston goes from the piston head to the top of the screen.
+	float rodCenter = (pistonLeft + pistonRight) / 2.0f;
+	PackedVertex* rod = &out[(vessels + 1) * QUAD_VERTS];
+	writeQuad(rod, glm::vec2(rodCenter - 0.01f, 0.0f), glm::vec2(rodCenter + 0.01f, 0.0f), glm::vec2(rodCenter + 0.01f, 1.0f), glm::vec2(rodCenter - 0.01f, 1.0f), pistonColor);
+	rod[0].level = pistonLevel;
+	rod[1].level = pistonLevel;
+}
+
+// Adds what changes on screen when the level of vessel i moves from one top to another to the dirty box from low to high. The walls
+// are rounded to half floats like the vertices are, the piston sits on top of its vessel, and the waves of --ripples hang below it.
+inline void markDirty(int i, float from, float to, glm::vec2& low, glm::vec2& high)
+{
+	glm::vec2 walls = glm::unpackHalf2x16(glm::packHalf2x16(glm::vec2(network.left[i], network.right[i])));
+	float top = std::max(from, to) + (i == pistonVessel ? 0.1f : 0.0f);
+	low = glm::min(low, glm::vec2(walls.x, std::min(from, to) - (ripples ? RIPPLE_HEIGHT : 0.0f)));
+	high = glm::max(high, glm::vec2(walls.y, top));
+}
+
+// Blends the levels of vessels begin to end - 1 into renderTop, adds the ones that moved to the box from low to high and to the
+// range of vessels in changed (x the first, y the last), and copies them to mapped, unless that is null. With --ripples, the
+// speeds go to renderSpeed, and a vessel whose waves were still up is drawn again as well, since they move on their own.
+inline void blendLevels(int begin, int end, const std::vector<float>& from, const std::vector<float>& to, float alpha, glm::vec2& low,
+	glm::vec2& high, glm::ivec2& changed, float* mapped)
+{
+	for (int i = begin; i < end; i++)
+	{
+		float level = glm::mix(from[i], to[i], alpha);
+		bool waves = false;
+		if (ripples)
+		{
+			float speed = (to[i] - from[i]) * (float)physicsHz;
+			waves = renderSpeed[i] != 0.0f;
+			if (speed != renderSpeed[i])
+			{
+				changed = glm::ivec2(std::min(changed.x, i), i);
+				renderSpeed[i] = speed;
+			}
+		}
+		if (level != renderTop[i] || waves)
+		{
+			markDirty(i, renderTop[i], level, low, high);
+			changed = glm::ivec2(std::min(changed.x, i), i);
+			renderTop[i] = level;
+		}
+	}
+	if (mapped != nullptr)
+	{
+		memcpy(mapped + begin, renderTop.data() + begin, sizeof(float) * (end - begin));
+	}
+}
+
+// Sends the fill level of every vessel to the GPU, which is 4 bytes per vessel.
+// from and to are the top edges before and after the newest physics step, and alpha is how far we are between them, in [0, 1].
+// Returns false if renderTop didn't change, so nothing was sent.
+inline bool uploadLevels(const std::vector<float>& from, const std::vector<float>& to, float alpha)
+{
+	// While the levels are moving, the blended position changes every frame even if no physics step ran.
+	// Once they stop, we upload one last time so the exact state is on screen, and then nothing until they move again.
+	bool moving = from != to;
+	if (!moving && renderTop == to && !rippling)
+	{
+		return false;
+	}
+
+	int vessels = network.vesselCount();
+	renderTop.resize(vessels);
+	if (ripples)
+	{
+		renderSpeed.resize(vessels);
+	}
+	float* mapped = levelStream.valid() ? (float*)levelStream.beginWrite() : nullptr;
+	glm::ivec2 changed(vessels, -1);
+	blendLevels(0, vessels, from, to, alpha, dirtyLow, dirtyHigh, changed, mapped);
+
+	GLsizeiptr size = sizeof(float) * vessels;
+	GLintptr changedOffset = sizeof(float) * (GLintptr)changed.x;
+	GLsizeiptr changedSize = sizeof(float) * (GLsizeiptr)(changed.y - changed.x + 1);
+	if (ripples)
+	{
+		// Once the levels stop, this sends the zeros that let the waves settle, and then nothing again.
+		if (changed.y >= changed.x)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, levelSpeedBuffer);
+			glBufferSubData(GL_TEXTURE_BUFFER, changedOffset, changedSize, renderSpeed.data() + changed.x);
+		}
+		rippling = moving;
+	}
+	if (mapped != nullptr)
+	{
+		// Every segment of the stream starts out with whatever was written into it frames ago, so it always gets all the levels.
+		cachedBindTexture(GL_TEXTURE_BUFFER, levelTexture);
+		glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32F, levelStream.buffer(), levelStream.offset(), size);
+		return true;
+	}
+
+	if (changed.y < changed.x)
+	{
+		return false;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, levelBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, changedOffset, changedSize, renderTop.data() + changed.x);
+	return true;
+}
+
+// The same for --gpu-network, which only has to point the texture at the buffer the levels already are in. Returns false if it
+// already pointed at the newest step.
+inline bool bindGpuLevels()
+{
+	if (!gpuLevelsChanged)
+	{
+		return false;
+	}
+	cachedBindTexture(GL_TEXTURE_BUFFER, levelTexture);
+	glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32F, gpuLevelBuffer, 0, sizeof(float) * network.vesselCount());
+	gpuLevelsChanged = false;
+	return true;
+}
+
+// Sends the colors of the grid mesh to the GPU, from the fill and the speed of every cell. With --heatmap, the colormap stands in
+// for the speed, so the colors are only the fill, and the pressures go along.
+void uploadGridColors(const std::vector<float>& fraction, const std::vector<float>& speed, const std::vector<float>& pressure)
+{
+	int cells = (int)fraction.size();
+	if (cells == 0 || (int)speed.size() != cells || (heatmap && (int)pressure.size() != cells))
+	{
+		return;
+	}
+
+	gridColors.resize(cells * 4);
+	for (int i = 0; i < cells; i++)
+	{
+		glm::vec4 color = heatmap ? glm::vec4(1.0f) : glm::mix(waterColor, glm::vec4(1.0f), glm::clamp(speed[i] / GRID_SPEED_WHITE, 0.0f, 1.0f));
+		color *= fraction[i];
+		gridColors[i * 4 + 0] = (unsigned char)(color.r * 255.0f);
+		gridColors[i * 4 + 1] = (unsigned char)(color.g * 255.0f);
+		gridColors[i * 4 + 2] = (unsigned char)(color.b * 255.0f);
+		gridColors[i * 4 + 3] = 255;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, gridColorBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, gridColors.size(), gridColors.data());
+	if (heatmap)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, gridPressureBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * cells, pressure.data());
+	}
+}
+
+// Sends the positions and colors of the particles to the GPU.
+void uploadParticles(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& speed)
+{
+	int count = std::min((int)x.size(), particlePointCount);
+	if (count == 0 || (int)y.size() < count || (int)speed.size() < count)
+	{
+		return;
+	}
+
+	particlePositions.resize(count);
+	particleColors.resize(count * 4);
+	for (int i = 0; i < count; i++)
+	{
+		particlePositions[i] = glm::vec3(x[i], y[i], GRID_DEPTH);
+		glm::vec4 color = glm::mix(waterColor, glm::vec4(1.0f), glm::clamp(speed[i] / GRID_SPEED_WHITE, 0.0f, 1.0f));
+		particleColors[i * 4 + 0] = (unsigned char)(color.r * 255.0f);
+		particleColors[i * 4 + 1] = (unsigned char)(color.g * 255.0f);
+		particleColors[i * 4 + 2] = (unsigned char)(color.b * 255.0f);
+		particleColors[i * 4 + 3] = 255;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, particlePositionBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3) * count, particlePositions.data());
+	glBindBuffer(GL_ARRAY_BUFFER, particleColorBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, particleColors.size(), particleColors.data());
+}
+
+// Sends the strips of the shallow water profiles to the GPU, from the depth of every cell. A face is drawn at the average depth of
+// the cells on both sides of it, and a wall at the depth of the cell next to it.
+void uploadSurface(const std::vector<float>& depth)
+{
+	if (surfaceVertices.empty() || depth.size() != shallowWater.depth.size())
+	{
+		return;
+	}
+
+	int vertex = 0;
+	for (int p = 0; p < shallowWater.profileCount(); p++)
+	{
+		int vessel = shallowWater.vessels[p];
+		int first = shallowWater.start[p];
+		int cells = shallowWater.start[p + 1] - first;
+		float bottom = network.bottom[vessel];
+		for (int k = 0; k <= cells; k++)
+		{
+			float left = depth[first + std::max(k - 1, 0)];
+			float right = depth[first + std::min(k, cells - 1)];
+			float x = network.left[vessel] + k * shallowWater.cellWidth[p];
+			surfaceVertices[vertex++] = PackedVertex(glm::vec2(x, bottom), waterColor);
+			surfaceVertices[vertex++] = PackedVertex(glm::vec2(x, bottom + 0.5f * (left + right)), waterColor);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, surfaceVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(PackedVertex) * surfaceVertices.size(), surfaceVertices.data());
+}
+
+// Where a point of variant i of the viewed sweep is on screen, given where it is in the network.
+inline glm::vec2 viewPosition(int variant, float x, float y)
+{
+	float scale = 1.0f / viewColumns;
+	int column = variant % viewColumns;
+	int row = variant / viewColumns;
+	glm::vec2 center(-1.0f + (2 * column + 1) * scale, 1.0f - (2 * row + 1) * scale);
+	return center + scale * glm::vec2(x - variant * SWEEP_SPACING, y);
+}
+
+// Adds the quads first to first + count - 1 to the draw commands, extending the last command if it ends where they start.
+inline void addDrawCommand(int first, int count)
+{
+	GLuint firstIndex = (GLuint)(first * QUAD_INDICES);
+	if (!drawCommands.empty() && drawCommands.back().firstIndex + drawCommands.back().count == firstIndex)
+	{
+		drawCommands.back().count += (GLuint)(count * QUAD_INDICES);
+		return;
+	}
+	drawCommands.push_back({ (GLuint)(count * QUAD_INDICES), 1, firstIndex, 0, 0 });
+}
+
+// The part of the scene on screen with the current MVP, from the corners of clip space.
+inline void viewBounds(glm::vec2& low, glm::vec2& high)
+{
+	glm::mat4 inverse = glm::inverse(mvp);
+	low = glm::vec2(FLT_MAX);
+	high = glm::vec2(-FLT_MAX);
+	for (int corner = 0; corner < 4; corner++)
+	{
+		glm::vec4 p = inverse * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, 0.0f, 1.0f);
+		low = glm::min(low, glm::vec2(p) / p.w);
+		high = glm::max(high, glm::vec2(p) / p.w);
+	}
+}
+
+// How large a pixel of the window is in the scene, with the current MVP.
+inline float pixelSize()
+{
+	return 2.0f / (mvp[0][0] * framebufferWidth);
+}
+
+// Whether the render targets that are sized like the framebuffer can be used this frame. Once the framebuffer has kept its size for
+// long enough, they take that size, which the next resize() of each makes them for. Until then another frame is asked for, so the
+// targets catch up even if nothing else happens.
+bool targetsSettled()
+{
+	if (targetWidth == framebufferWidth && targetHeight == framebufferHeight)
+	{
+		return true;
+	}
+	if (glfwGetTime() - resizedTime < RESIZE_SETTLE_SECONDS)
+	{
+		redrawRequested = true;
+		return false;
+	}
+	targetWidth = framebufferWidth;
+	targetHeight = framebufferHeight;
+	return true;
+}
+
+// Works out which part of sceneFrame has to be drawn again, all of it if the MVP changed, and begins drawing it. Returns false if
+// nothing on screen changed.
+bool beginRetainedScene()
+{
+	int width = sceneFrame.width();
+	int height = sceneFrame.height();
+	glm::vec2 low = dirtyLow;
+	glm::vec2 high = dirtyHigh;
+	dirtyLow = glm::vec2(FLT_MAX);
+	dirtyHigh = glm::vec2(-FLT_MAX);
+	if (!sceneFrame.valid() || retainedMvp != mvp)
+	{
+		retainedMvp = mvp;
+		sceneFrame.begin(0, 0, width, height);
+		return true;
+	}
+	if (low.x > high.x || low.y > high.y)
+	{
+		return false;
+	}
+
+	// The box in pixels, with a little to spare for rounding, clamped to the window in float since it can be far larger.
+	glm::vec2 pixelLow(FLT_MAX);
+	glm::vec2 pixelHigh(-FLT_MAX);
+	for (int corner = 0; corner < 4; corner++)
+	{
+		glm::vec4 p = mvp * glm::vec4(corner & 1 ? high.x : low.x, corner & 2 ? high.y : low.y, 0.0f, 1.0f);
+		glm::vec2 pixel = (glm::vec2(p) / p.w * 0.5f + 0.5f) * glm::vec2((float)width, (float)height);
+		pixelLow = glm::min(pixelLow, pixel);
+		pixelHigh = glm::max(pixelHigh, pixel);
+	}
+	glm::vec2 size((float)width, (float)height);
+	glm::ivec2 first = glm::ivec2(glm::clamp(glm::floor(pixelLow) - DIRTY_MARGIN_PIXELS, glm::vec2(0.0f), size));
+	glm::ivec2 last = glm::ivec2(glm::clamp(glm::ceil(pixelHigh) + DIRTY_MARGIN_PIXELS, glm::vec2(0.0f), size));
+	if (first.x >= last.x || first.y >= last.y)
+	{
+		return false;
+	}
+	sceneFrame.begin(first.x, first.y, last.x - first.x, last.y - first.y);
+	return true;
+}
+
+// Writes the draw commands for the quads that can be seen with the current MVP, if it changed since they were last written.
+void updateDrawCommands()
+{
+	if (drawCommandsValid && drawCommandMvp == mvp)
+	{
+		return;
+	}
+	drawCommandMvp = mvp;
+	drawCommandsValid = true;
+
+	glm::vec2 low, high;
+	viewBounds(low, high);
+
+	// The items of the grid are the vessels and then the tubes, in the order of their quads, and come back in increasing order.
+	// The piston follows the water up and down, so it is always drawn, between the two.
+	visibleQuads.query(low.x, -FLT_MAX, high.x, high.y, visibleItems);
+	drawCommands.clear();
+	int vessels = network.vesselCount();
+	bool pistonAdded = false;
+	for (int item : visibleItems)
+	{
+		if (item >= vessels && !pistonAdded)
+		{
+			addDrawCommand(vessels, 2);
+			pistonAdded = true;
+		}
+		addDrawCommand(item < vessels ? item : item + 2, 1);
+	}
+	if (!pistonAdded)
+	{
+		addDrawCommand(vessels, 2);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * drawCommands.size(), drawCommands.data(), GL_STATIC_DRAW);
+}
+
+// Writes the bars of the tiles of a level that can be seen and sends them to the GPU, if the level, the view or (when moved is set)
+// the levels changed since they were last written.
+void uploadLodTiles(int level, bool moved)
+{
+	if (lodValid && !moved && lodLevel == level && lodMvp == mvp)
+	{
+		return;
+	}
+	lodValid = true;
+	lodLevel = level;
+	lodMvp = mvp;
+
+	glm::vec2 low, high;
+	viewBounds(low, high);
+	networkLod.query(level, low.x, high.x, high.y, lodTiles);
+	lodInstances.resize(lodTiles.size());
+	for (size_t i = 0; i < lodTiles.size(); i++)
+	{
+		const LodTile& tile = lodTiles[i];
+		glm::vec4 color = glm::mix(waterColor, glm::vec4(1.0f), glm::clamp(tile.fill, 0.0f, 1.0f));
+		lodInstances[i] = InstanceFormat(glm::vec2(tile.left, tile.bottom), glm::vec2(tile.right, tile.top), color);
+	}
+
+	// The number of bars changes with the view, so the buffer is simply replaced.
+	glBindBuffer(GL_ARRAY_BUFFER, lodBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceFormat) * lodInstances.size(), lodInstances.data(), GL_STREAM_DRAW);
+}
+
+// Writes the rectangles of the floats, centered on x and y, and sends them to the GPU.
+void uploadFloats(const std::vector<float>& x, const std::vector<float>& y)
+{
+	int count = std::min((int)x.size(), floats.count());
+	floatInstances.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec2 half(floats.halfWidth[i], floats.halfHeight[i]);
+		floatInstances[i] = InstanceFormat(glm::vec2(x[i], y[i]) - half, glm::vec2(x[i], y[i]) + half, floatColor);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, floatBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceFormat) * floatInstances.size(), floatInstances.data(), GL_STREAM_DRAW);
+}
+
+// Writes the instances of the vessels of the viewed sweep and sends them to the GPU.
+void uploadInstances(const std::vector<float>& from, const std::vector<float>& to, float alpha)
+{
+	bool moving = from != to;
+	if (!moving && renderTop == to)
+	{
+		return;
+	}
+
+	int vessels = network.vesselCount();
+	renderTop.resize(vessels);
+	bool parallel = renderPool != nullptr && vessels >= INSTANCE_PARALLEL_VESSELS;
+	instanceCommands.resize(parallel ? (vessels + INSTANCE_BLOCK_VESSELS - 1) / INSTANCE_BLOCK_VESSELS : 1);
+	auto record = [&](int begin, int end)
+	{
+		RenderCommands& commands = instanceCommands[begin / INSTANCE_BLOCK_VESSELS];
+		InstanceFormat* written = (InstanceFormat*)commands.write(instanceBuffer, sizeof(InstanceFormat) * begin, sizeof(InstanceFormat) * (end - begin));
+		for (int i = begin; i < end; i++)
+		{
+			renderTop[i] = glm::mix(from[i], to[i], alpha);
+			float speed = std::abs(to[i] - from[i]) * (float)physicsHz;
+			glm::vec2 bottomLeft = viewPosition(i / 2, network.left[i], network.bottom[i]);
+			glm::vec2 topRight = viewPosition(i / 2, network.right[i], renderTop[i]);
+			written[i - begin] = InstanceFormat(bottomLeft, topRight, glm::mix(waterColor, glm::vec4(1.0f), glm::clamp(speed / GRID_SPEED_WHITE, 0.0f, 1.0f)));
+		}
+	};
+	if (parallel)
+	{
+		renderPool->parallelFor(vessels, INSTANCE_BLOCK_VESSELS, record);
+	}
+	else
+	{
+		record(0, vessels);
+	}
+
+	for (RenderCommands& commands : instanceCommands)
+	{
+		commands.replay(renderQueue);
+	}
+}
+
+// Functions called only once every time the program is executed.
+#pragma region Helper_functions
+// Creates a vertex array that draws the unit quad once for every InstanceFormat in a buffer of its own, which starts out holding data.
+// The unit quad is shared by all of them, and created with the first.
+void buildInstanceArray(GLuint& arrayObject, GLuint& buffer, const std::vector<InstanceFormat>& data)
+{
+	// The corners of the unit quad, in the order of a triangle fan.
+	const glm::vec2 corners[4] = { glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f) };
+
+	glGenVertexArrays(1, &arrayObject);
+	cachedBindVertexArray(arrayObject);
+
+	if (instanceCornerBuffer == 0)
+	{
+		glGenBuffers(1, &instanceCornerBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceCornerBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instanceCornerBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+
+	// A divisor of 1 moves these attributes on once per instance instead of once per vertex.
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceFormat) * data.size(), data.data(), GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(InstanceFormat), (void*)offsetof(InstanceFormat, bottomLeft));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceFormat), (void*)offsetof(InstanceFormat, color));
+	glVertexAttribDivisor(2, 1);
+
+	cachedBindVertexArray(0);
+}
+
+// Creates the vertex buffer, index buffer and vertex array object for the apparatus, and the texture buffer of the fill levels.
+// This is only done once, after that only the levels are re-uploaded.
+void buildGeometry()
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+
+	quadCount = vessels + 2 + tubes;
+	vertices.resize(quadCount * QUAD_VERTS);
+
+	writeVesselQuads(vertices.data());
+
+	//Tubes joining the vessels. These never change so they are only written here.
+	for (int t = 0; t < tubes; t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+
+		// The tube runs along the floor from the right wall of the left vessel to the left wall of the right vessel.
+		if (network.left[b] < network.left[a])
+		{
+			std::swap(a, b);
+		}
+		float x0 = network.right[a];
+		float x1 = network.left[b];
+		float y = std::max(network.bottom[a], network.bottom[b]);
+
+		writeQuad(&vertices[(vessels + 2 + t) * QUAD_VERTS],
+			glm::vec2(x0, y), glm::vec2(x1, y),
+			glm::vec2(x1, y + 0.02f), glm::vec2(x0, y + 0.02f), waterColor);
+	}
+
+	// Every quad is drawn as two triangles, since GL_QUADS does not exist in core profile.
+	std::vector<GLuint> indices(quadCount * QUAD_INDICES);
+	for (int i = 0; i < quadCount; i++)
+	{
+		GLuint first = (GLuint)(i * QUAD_VERTS);
+		indices[i * QUAD_INDICES + 0] = first + 0;
+		indices[i * QUAD_INDICES + 1] = first + 1;
+		indices[i * QUAD_INDICES + 2] = first + 2;
+		indices[i * QUAD_INDICES + 3] = first + 0;
+		indices[i * QUAD_INDICES + 4] = first + 2;
+		indices[i * QUAD_INDICES + 5] = first + 3;
+	}
+
+	// The vertex array object remembers the buffer bindings and vertex layout so we only have to bind it when drawing.
+	glGenVertexArrays(1, &vao);
+	cachedBindVertexArray(vao);
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	// Tell OpenGL where the position, color and level live inside of each PackedVertex.
+	// The attribute indices match the layout(location = ...) qualifiers in VertexShader.glsl.
+	setPackedVertexAttributes();
+
+	cachedBindVertexArray(0);
+
+	// A texture buffer can only start at a multiple of GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, so every segment of the stream is rounded
+	// up to it. The other arrays (the grid, the particles, the overlay) don't enable attribute 2, whose value is then 0, so none of
+	// their vertices move.
+	renderTop = network.top;
+	GLint alignment = 256;
+	glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	int floatsPerSegment = (int)((vessels * sizeof(float) + alignment - 1) / alignment * alignment / sizeof(float));
+	std::vector<float> levels(floatsPerSegment, 0.0f);
+	std::copy(renderTop.begin(), renderTop.end(), levels.begin());
+
+	if (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect)
+	{
+		glGenBuffers(1, &drawCommandBuffer);
+
+		// A vessel is indexed by its floor, since its top moves, and a tube by the span it runs along the floor.
+		std::vector<float> minX, maxX, floorY;
+		for (int i = 0; i < vessels; i++)
+		{
+			minX.push_back(network.left[i]);
+			maxX.push_back(network.right[i]);
+			floorY.push_back(network.bottom[i]);
+		}
+		for (int t = 0; t < tubes; t++)
+		{
+			int a = network.tubeA[t];
+			int b = network.tubeB[t];
+			float x0 = std::min(network.right[a], network.right[b]);
+			float x1 = std::max(network.left[a], network.left[b]);
+			minX.push_back(std::min(x0, x1));
+			maxX.push_back(std::max(x0, x1));
+			floorY.push_back(std::max(network.bottom[a], network.bottom[b]));
+		}
+		visibleQuads.build(minX.data(), floorY.data(), maxX.data(), floorY.data(), vessels + tubes);
+	}
+
+	// The bars drawn instead of the quads when they get too small.
+	networkLod.build(network);
+	buildInstanceArray(lodVao, lodBuffer, lodInstances);
+	if (floats.count() > 0)
+	{
+		buildInstanceArray(floatVao, floatBuffer, floatInstances);
+		uploadFloats(floats.positionX, floats.positionY);
+	}
+
+	glGenTextures(1, &levelTexture);
+	cachedBindTexture(GL_TEXTURE_BUFFER, levelTexture);
+	if (levelStream.create(sizeof(float) * levels.size(), levels.data()))
+	{
+		glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32F, levelStream.buffer(), levelStream.offset(), sizeof(float) * vessels);
+	}
+	else
+	{
+		glGenBuffers(1, &levelBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, levelBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * vessels, renderTop.data(), GL_DYNAMIC_DRAW);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, levelBuffer);
+	}
+
+	if (ripples)
+	{
+		renderSpeed.assign(vessels, 0.0f);
+		rippling = false;
+		glGenBuffers(1, &levelSpeedBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, levelSpeedBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * vessels, renderSpeed.data(), GL_DYNAMIC_DRAW);
+		glGenTextures(1, &levelSpeedTexture);
+		cachedBindTexture(GL_TEXTURE_BUFFER, levelSpeedTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, levelSpeedBuffer);
+		cachedBindTexture(GL_TEXTURE_BUFFER, levelTexture);
+	}
+}
+
+// Throws away everything buildGeometry() made and builds it again, after the vessels and tubes changed.
+void rebuildGeometry()
+{
+	cachedDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+	levelStream.destroy();
+	glDeleteBuffers(1, &levelBuffer);
+	glDeleteBuffers(1, &drawCommandBuffer);
+	cachedDeleteTextures(1, &levelTexture);
+	glDeleteBuffers(1, &levelSpeedBuffer);
+	cachedDeleteTextures(1, &levelSpeedTexture);
+	cachedDeleteVertexArrays(1, &lodVao);
+	glDeleteBuffers(1, &lodBuffer);
+	cachedDeleteVertexArrays(1, &floatVao);
+	glDeleteBuffers(1, &floatBuffer);
+	vao = vbo = ebo = levelBuffer = drawCommandBuffer = levelTexture = levelSpeedBuffer = levelSpeedTexture = lodVao = lodBuffer = 0;
+	floatVao = floatBuffer = 0;
+	drawCommandsValid = false;
+	lodValid = false;
+	sceneFrame.invalidate();
+	buildGeometry();
+}
+
+// Creates the mesh the grid is drawn with, in place of the last one: a vertex at the center of every cell that is stored in tiles, in
+// their order, and two triangles between every 2x2 of them. Where a tile isn't stored there is nothing to draw. The colors are up to
+// the caller.
+void buildGridGeometry(const GridTiles& tiles, int layout)
+{
+	cachedDeleteVertexArrays(1, &gridVao);
+	glDeleteBuffers(1, &gridPositionBuffer);
+	glDeleteBuffers(1, &gridColorBuffer);
+	glDeleteBuffers(1, &gridPressureBuffer);
+	glDeleteBuffers(1, &gridEbo);
+	gridVao = gridPositionBuffer = gridColorBuffer = gridPressureBuffer = gridEbo = 0;
+	gridMeshLayout = layout;
+
+	int cells = tiles.cellCount();
+	std::vector<glm::vec3> positions(cells);
+	for (int i = 0; i < cells; i++)
+	{
+		positions[i] = glm::vec3(grid.originX + (tiles.cellX(i) + 0.5f) * grid.cellSize, grid.originY + (tiles.cellY(i) + 0.5f) * grid.cellSize, GRID_DEPTH);
+	}
+
+	std::vector<GLuint> indices;
+	indices.reserve(cells * QUAD_INDICES);
+	for (int i = 0; i < cells; i++)
+	{
+		int x = tiles.cellX(i);
+		int y = tiles.cellY(i);
+		int right = tiles.at(x + 1, y);
+		int above = tiles.at(x, y + 1);
+		int corner = tiles.at(x + 1, y + 1);
+		if (right < 0 || above < 0 || corner < 0)
+		{
+			continue;
+		}
+		indices.push_back((GLuint)i);
+		indices.push_back((GLuint)right);
+		indices.push_back((GLuint)corner);
+		indices.push_back((GLuint)i);
+		indices.push_back((GLuint)corner);
+		indices.push_back((GLuint)above);
+	}
+	gridIndexCount = (int)indices.size();
+
+	glGenVertexArrays(1, &gridVao);
+	cachedBindVertexArray(gridVao);
+
+	glGenBuffers(1, &gridPositionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, gridPositionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(), positions.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+	// The colors are bytes, which the shader sees as floats from 0 to 1.
+	glGenBuffers(1, &gridColorBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, gridColorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, cells * 4, nullptr, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4, 0);
+
+	if (heatmap)
+	{
+		glGenBuffers(1, &gridPressureBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, gridPressureBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * cells, nullptr, GL_DYNAMIC_DRAW);
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), 0);
+	}
+
+	glGenBuffers(1, &gridEbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	cachedBindVertexArray(0);
+}
+
+// Creates the buffers the particles are drawn from. The number of particles never changes, so they are sized once.
+// On the GPU the vertex array only describes the layout of a GpuParticleVertex, and the buffer is bound when drawing.
+void buildParticleGeometry()
+{
+	particlePointCount = particles.particleCount();
+
+	glGenVertexArrays(1, &particleVao);
+	cachedBindVertexArray(particleVao);
+
+	if (gpuParticles)
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribFormat(0, 2, GL_FLOAT, GL_FALSE, offsetof(GpuParticleVertex, x));
+		glVertexAttribBinding(0, 0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribFormat(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(GpuParticleVertex, color));
+		glVertexAttribBinding(1, 0);
+		cachedBindVertexArray(0);
+		return;
+	}
+
+	glGenBuffers(1, &particlePositionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, particlePositionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * particlePointCount, nullptr, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+	glGenBuffers(1, &particleColorBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, particleColorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, particlePointCount * 4, nullptr, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4, 0);
+
+	cachedBindVertexArray(0);
+
+	particles.speeds(particleSpeeds);
+	uploadParticles(particles.positionX, particles.positionY, particleSpeeds);
+}
+
+// Creates the buffers the shallow water profiles are drawn from. Only the vertices change, the triangles between them don't.
+void buildSurfaceGeometry()
+{
+	surfaceVertices.resize((shallowWater.depth.size() + shallowWater.profileCount()) * 2);
+
+	std::vector<GLuint> indices;
+	GLuint column = 0;
+	for (int p = 0; p < shallowWater.profileCount(); p++)
+	{
+		int cells = shallowWater.start[p + 1] - shallowWater.start[p];
+		for (int k = 0; k < cells; k++, column++)
+		{
+			GLuint first = column * 2;
+			indices.push_back(first);
+			indices.push_back(first + 2);
+			indices.push_back(first + 3);
+			indices.push_back(first);
+			indices.push_back(first + 3);
+			indices.push_back(first + 1);
+		}
+		column++;
+	}
+	surfaceIndexCount = (int)indices.size();
+
+	glGenVertexArrays(1, &surfaceVao);
+	cachedBindVertexArray(surfaceVao);
+
+	glGenBuffers(1, &surfaceVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, surfaceVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * surfaceVertices.size(), nullptr, GL_DYNAMIC_DRAW);
+	setPackedVertexAttributes();
+
+	glGenBuffers(1, &surfaceEbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surfaceEbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	cachedBindVertexArray(0);
+
+	uploadSurface(shallowWater.depth);
+}
+
+// Creates the unit quad and the instance buffer of the viewed sweep, and writes the tubes into it. Takes the place of buildGeometry().
+void buildInstanceGeometry()
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	viewColumns = std::max((int)std::ceil(std::sqrt((double)viewedSweep.variantCount())), 1);
+	instances.resize(vessels + tubes);
+
+	// Tube t belongs to variant t, and runs along the floor between its two vessels like in buildGeometry().
+	for (int t = 0; t < tubes; t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		if (network.left[b] < network.left[a])
+		{
+			std::swap(a, b);
+		}
+		float y = std::max(network.bottom[a], network.bottom[b]);
+		instances[vessels + t] = InstanceFormat(viewPosition(t, network.right[a], y), viewPosition(t, network.left[b], y + 0.02f), waterColor);
+	}
+
+	buildInstanceArray(instanceVao, instanceBuffer, instances);
+	uploadInstances(network.top, network.top, 1.0f);
+}
+
+// Adds a shape for SdfFragmentShader.glsl: a rectangle and its color, and the vessel whose level is added to its bottom and its top.
+inline void addSdfShape(std::vector<glm::vec4>& shapes, glm::vec4 box, glm::vec4 color, int vessel, bool bottomFollows, bool topFollows)
+{
+	shapes.push_back(box);
+	shapes.push_back(color);
+	shapes.push_back(glm::vec4((float)(vessel + 1), bottomFollows ? 1.0f : 0.0f, topFollows ? 1.0f : 0.0f, 0.0f));
+}
+
+// Writes the shapes of the apparatus for --sdf into a texture buffer, and creates the (empty) vertex array sdfProgram draws them
+// with. If there are too many shapes or the program didn't build, sdfProgram is set to 0, so the quads are drawn instead.
+void buildSdfGeometry()
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	if (sdfProgram != 0 && vessels + 2 + tubes > SDF_MAX_SHAPES)
+	{
+		std::cout << "The network has " << vessels + 2 + tubes << " shapes, more than --sdf draws (" << SDF_MAX_SHAPES << ")." << std::endl;
+		cachedDeleteProgram(sdfProgram);
+		sdfProgram = 0;
+	}
+	if (sdfProgram == 0)
+	{
+		std::cout << "Drawing quads instead of --sdf." << std::endl;
+		return;
+	}
+
+	// The same shapes as writeVesselQuads() and the tubes of buildGeometry(), with y measured from the level where they follow it.
+	std::vector<glm::vec4> shapes;
+	for (int i = 0; i < vessels; i++)
+	{
+		addSdfShape(shapes, glm::vec4(network.left[i], network.bottom[i], network.right[i], 0.0f), waterColor, i, false, true);
+	}
+	float pistonLeft = network.left[pistonVessel];
+	float pistonRight = network.right[pistonVessel];
+	float rodCenter = (pistonLeft + pistonRight) / 2.0f;
+	addSdfShape(shapes, glm::vec4(pistonLeft, 0.0f, pistonRight, 0.1f), pistonColor, pistonVessel, true, true);
+	addSdfShape(shapes, glm::vec4(rodCenter - 0.01f, 0.0f, rodCenter + 0.01f, 1.0f), pistonColor, pistonVessel, true, false);
+	for (int t = 0; t < tubes; t++)
+	{
+		int a = network.tubeA[t];
+		int b = network.tubeB[t];
+		float x0 = std::min(network.right[a], network.right[b]);
+		float x1 = std::max(network.left[a], network.left[b]);
+		float y = std::max(network.bottom[a], network.bottom[b]);
+		addSdfShape(shapes, glm::vec4(std::min(x0, x1), y, std::max(x0, x1), y + 0.02f), waterColor, -1, false, false);
+	}
+
+	glGenBuffers(1, &sdfShapeBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, sdfShapeBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * shapes.size(), shapes.data(), GL_STATIC_DRAW);
+	glGenTextures(1, &sdfShapeTexture);
+	cachedBindTexture(GL_TEXTURE_BUFFER, sdfShapeTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, sdfShapeBuffer);
+	cachedBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// The uniforms besides the MVP never change, so they are set once here.
+	cachedUseProgram(sdfProgram);
+	glUniform1i(glGetUniformLocation(sdfProgram, "levels"), 0);
+	glUniform1i(glGetUniformLocation(sdfProgram, "shapes"), 1);
+	glUniform1i(glGetUniformLocation(sdfProgram, "shapeCount"), (GLint)(shapes.size() / 3));
+	cachedUseProgram(0);
+
+	// Core profile can't draw without a vertex array, even one that reads nothing.
+	glGenVertexArrays(1, &sdfVao);
+}
+
+// Creates the colormap of --heatmap on texture unit 6, from a handful of points of viridis, which stays readable from dark to
+// light and in gray, and picks the pressure its top stands for if --heatmap didn't: that at the bottom of the deepest column.
+void buildHeatmap()
+{
+	const glm::vec3 points[] = {
+		glm::vec3(0.267f, 0.005f, 0.329f), glm::vec3(0.231f, 0.322f, 0.545f), glm::vec3(0.129f, 0.569f, 0.549f),
+		glm::vec3(0.369f, 0.788f, 0.384f), glm::vec3(0.993f, 0.906f, 0.144f)
+	};
+	const int pointCount = sizeof(points) / sizeof(points[0]);
+	std::vector<unsigned char> texels(HEATMAP_SIZE * 4);
+	for (int i = 0; i < HEATMAP_SIZE; i++)
+	{
+		float along = (float)i / (HEATMAP_SIZE - 1) * (pointCount - 1);
+		int piece = std::min((int)along, pointCount - 2);
+		glm::vec3 color = glm::mix(points[piece], points[piece + 1], along - piece);
+		texels[i * 4 + 0] = (unsigned char)(color.r * 255.0f);
+		texels[i * 4 + 1] = (unsigned char)(color.g * 255.0f);
+		texels[i * 4 + 2] = (unsigned char)(color.b * 255.0f);
+		texels[i * 4 + 3] = 255;
+	}
+
+	glGenTextures(1, &heatmapTexture);
+	cachedActiveTexture(GL_TEXTURE0 + HEATMAP_UNIT);
+	cachedBindTexture(GL_TEXTURE_1D, heatmapTexture);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, HEATMAP_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	cachedActiveTexture(GL_TEXTURE0);
+
+	if (heatmapPressure <= 0.0f)
+	{
+		float deepest = 0.0f;
+		for (int i = 0; i < network.vesselCount(); i++)
+		{
+			deepest = std::max(deepest, network.top[i] - network.bottom[i]);
+		}
+		heatmapPressure = std::max(density * gravity * deepest, 1.0f);
+	}
+}
+
+// Sets the uniforms of the effect program for this frame: which vertices are those of the vessels (or -1 for the grid, where the
+// pressure comes with every vertex), how pressure maps onto the colormap, and how high the waves get. The locations are looked up
+// again only after the program was rebuilt.
+void setEffectUniforms()
+{
+	if (effectUniformsOf != effectProgram)
+	{
+		effectUniformsOf = effectProgram;
+		vesselVerticesLocation = glGetUniformLocation(effectProgram, "vesselVertices");
+		heatmapScaleLocation = glGetUniformLocation(effectProgram, "heatScale");
+		cachedUseProgram(effectProgram);
+		glUniform1i(glGetUniformLocation(effectProgram, "levels"), 0);
+		glUniform1i(glGetUniformLocation(effectProgram, "colormap"), HEATMAP_UNIT);
+		glUniform1i(glGetUniformLocation(effectProgram, "levelSpeeds"), RIPPLE_UNIT);
+		glUniform2f(glGetUniformLocation(effectProgram, "ripple"), RIPPLE_HEIGHT, 1.0f / RIPPLE_FULL_SPEED);
+	}
+	cachedUseProgram(effectProgram);
+	glUniform1i(vesselVerticesLocation, gridResolution > 0 ? -1 : network.vesselCount() * 4);
+	if (heatmap)
+	{
+		glUniform2f(heatmapScaleLocation, density * gravity, 1.0f / heatmapPressure);
+		cachedActiveTexture(GL_TEXTURE0 + HEATMAP_UNIT);
+		cachedBindTexture(GL_TEXTURE_1D, heatmapTexture);
+	}
+	if (ripples)
+	{
+		cachedActiveTexture(GL_TEXTURE0 + RIPPLE_UNIT);
+		cachedBindTexture(GL_TEXTURE_BUFFER, levelSpeedTexture);
+	}
+	cachedActiveTexture(GL_TEXTURE0);
+}
+
+// Has the GPU write where the particles are now into buffer, creating it first if it is 0.
+// Copies the levels of the newest step on the GPU into buffer, which is created if it is 0, for --gpu-network.
+void copyGpuLevels(GLuint& buffer)
+{
+	if (buffer == 0)
+	{
+		gpuNetwork.copyLevels(buffer);
+		levelCopyBuffers.push_back(buffer);
+		return;
+	}
+	gpuNetwork.copyLevels(buffer);
+}
+
+void writeGpuParticles(GLuint& buffer)
+{
+	if (buffer == 0)
+	{
+		buffer = gpuFluid.createVertexBuffer();
+		particleVertexBuffers.push_back(buffer);
+	}
+	gpuFluid.writeVertices(buffer, waterColor, GRID_SPEED_WHITE);
+}
+
+// Sets the MVP matrix that will be used for the next draw.
+// The render queue puts it into the uniform buffer of the frame along with the other MVPs it draws with.
+void setMVP(const glm::mat4& matrix)
+{
+	mvp = matrix;
+}
+
+#pragma region Hot_reload
+#define VERTEX_SHADER_FILE "../Assets/VertexShader.glsl"
+#define FRAGMENT_SHADER_FILE "../Assets/FragmentShader.glsl"
+#define SDF_VERTEX_SHADER_FILE "../Assets/SdfVertexShader.glsl"
+#define SDF_FRAGMENT_SHADER_FILE "../Assets/SdfFragmentShader.glsl"
+
+// Reads the shader files on its own thread whenever they change.
+FileWatcher* shaderWatcher = nullptr;
+
+// With --config FILE, the settings of Settings.h come from that file, on top of the command line, and the loop reads it again
+// whenever it changes, like the shaders. Readers on any thread go through settings(), which never waits for a reload.
+std::string configFile;
+Settings configBase;					// What the file is read on top of: the command line, or the defaults
+FileWatcher* configWatcher = nullptr;
+
+// Reads the shaders (and whatever else is loaded in the background) at the start, so the window is up before they are. The loop
+// links them as they come in, and only shows the clear color until everything is there.
+AssetLoader* assetLoader = nullptr;
+
+// The permutations of the scene shaders: the quads of the scene, and the instanced rectangles of the viewed sweep and the bars of a
+// zoomed out network. Both are built from the same two files, and Python/compile_spirv.py builds their SPIR-V. With --heatmap or
+// --ripples, the quads (or the grid) are drawn with a third one that has those in it, which is only built from GLSL since its
+// uniforms are set by name.
+std::vector<ProgramVariant> sceneVariants()
+{
+	std::vector<ProgramVariant> variants = {
+		{ VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE, {}, &program, &vertex_shader, &fragment_shader, true },
+		{ VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE, { "INSTANCED" }, &instanceProgram, &instanceVertexShader, &instanceFragmentShader, true }
+	};
+	std::vector<std::string> effects;
+	if (heatmap)
+	{
+		effects.push_back("HEATMAP");
+	}
+	if (ripples)
+	{
+		effects.push_back("RIPPLES");
+	}
+	if (!effects.empty())
+	{
+		variants.push_back({ VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE, effects, &effectProgram, &effectVertexShader, &effectFragmentShader });
+	}
+	return variants;
+}
+
+// Called once per frame. If the watcher has new sources, every variant of the scene shaders is built from them again, and all
+// of them replace the current ones. Reading the files happens on the watcher's thread, but compiling has to happen here, since GL
+// objects can only be created on the thread that owns the context. If any of them doesn't compile or link, the old programs simply
+// stay in use. Returns true if the programs were replaced, since the scene then has to be drawn again.
+bool reloadShaders()
+{
+	MEMORY_SCOPE(MEMORY_SHADERS);
+	std::vector<std::string> sources;
+	if (shaderWatcher == nullptr || !shaderWatcher->takeChanges(sources))
+	{
+		return false;
+	}
+
+	std::vector<ProgramVariant> variants = sceneVariants();
+	std::vector<ProgramSources> built(variants.size());
+	bool preprocessed = true;
+	for (size_t i = 0; i < variants.size(); i++)
+	{
+		preprocessed = preprocessed && preprocessShader(sources[0], VERTEX_SHADER_FILE, variants[i].defines, built[i].vertex)
+			&& preprocessShader(sources[1], FRAGMENT_SHADER_FILE, variants[i].defines, built[i].fragment);
+	}
+	if (preprocessed)
+	{
+		loadProgramsCached(built);
+	}
+	bool linked = preprocessed;
+	for (const ProgramSources& result : built)
+	{
+		linked = linked && result.program != 0;
+	}
+	if (!linked)
+	{
+		LOG_WARNING("Reloading the shaders failed, keeping the previous programs.");
+		for (ProgramSources& result : built)
+		{
+			glDeleteShader(result.vertexShader);
+			glDeleteShader(result.fragmentShader);
+			cachedDeleteProgram(result.program);
+		}
+		return false;
+	}
+
+	for (size_t i = 0; i < variants.size(); i++)
+	{
+		glDeleteShader(*variants[i].vertexShader);
+		glDeleteShader(*variants[i].fragmentShader);
+		cachedDeleteProgram(*variants[i].program);
+		*variants[i].program = built[i].program;
+		*variants[i].vertexShader = built[i].vertexShader;
+		*variants[i].fragmentShader = built[i].fragmentShader;
+	}
+
+	// The binding of the Frame block belongs to a program, and a new program starts without it. The name of the old one can
+	// also come back for a new program.
+	renderQueue.forgetPrograms();
+	sceneFrame.invalidate();
+
+	LOG_INFO("Reloaded the shaders.");
+	return true;
+}
+#pragma endregion Hot_reload
+
+// Starts reading the shaders that are always needed, which doesn't take a context yet. If this driver has linked them before, the
+// program comes straight from the cache and the shaders are never compiled (vertex_shader and fragment_shader stay 0, which
+// glDeleteShader ignores). The programs are linked once they are in (see the main loop), which does, all the variants of the
+// scene shaders together so their compiles overlap.
+void queueStartupShaders()
+{
+	assetLoader = new AssetLoader();
+	assetLoader->onJobRead = [] { glfwPostEmptyEvent(); };
+	loadProgramVariantsAsync(*assetLoader, sceneVariants());
+}
+
+// Initialization code
+void init()
+{
+	// Initializes the glew library
+	// glewExperimental is needed on a core profile context, otherwise glew will not load most of the function pointers.
+	glewExperimental = GL_TRUE;
+	glewInit();
+	if (glDebug && !enableGlDebugOutput(true))
+	{
+		LOG_INFO("This driver has no KHR_debug, OpenGL errors are only noticed by the GL_CHECK calls.");
+	}
+
+	// Watch the shader files, so edits show up without restarting.
+	shaderWatcher = new FileWatcher({ VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE });
+	if (!configFile.empty())
+	{
+		configWatcher = new FileWatcher({ configFile });
+	}
+
+	// Our scene is already laid out in clip space, so the MVP starts as identity. The render queue uploads it on the first frame,
+	// and looks the uniform up by name only once per program, since that is a string search in the driver.
+
+	// Enables the depth test, which you will want in most cases. You can disable this in the render loop if you need to.
+	cachedEnable(GL_DEPTH_TEST);
+
+	if (sweepView)
+	{
+		buildInstanceGeometry();
+	}
+	else
+	{
+		buildGeometry();
+	}
+	if (gpuNetworkStep && !gpuNetwork.build(network, NETWORK_COMPUTE_FILE, HUD_VESSELS))
+	{
+		std::cout << "Stepping the network on the CPU instead." << std::endl;
+		gpuNetworkStep = false;
+	}
+	gpuLevelBuffer = gpuNetworkStep ? gpuNetwork.levelBuffer() : 0;
+	gpuLevelsChanged = gpuNetworkStep;
+	gpuStatisticsStep = -1;
+	if (sdfRendering)
+	{
+		loadProgramFilesAsync(*assetLoader, SDF_VERTEX_SHADER_FILE, SDF_FRAGMENT_SHADER_FILE, sdfProgram, sdfVertexShader, sdfFragmentShader, buildSdfGeometry);
+	}
+	if (heatmap)
+	{
+		buildHeatmap();
+	}
+	if (!backgroundFile.empty())
+	{
+		// Core profile can't draw without a vertex array, even one that reads nothing.
+		glGenVertexArrays(1, &backgroundVao);
+		loadProgramFilesAsync(*assetLoader, IMAGE_VERTEX_SHADER_FILE, IMAGE_FRAGMENT_SHADER_FILE, backgroundProgram, backgroundVertexShader,
+			backgroundFragmentShader, []
+		{
+			if (backgroundProgram != 0)
+			{
+				cachedUseProgram(backgroundProgram);
+				glUniform1i(glGetUniformLocation(backgroundProgram, "image"), BACKGROUND_UNIT);
+				cachedUseProgram(0);
+			}
+			sceneFrame.invalidate();
+		});
+		loadCompressedTextureAsync(*assetLoader, backgroundFile, backgroundTexture, [] { sceneFrame.invalidate(); });
+	}
+	if (gridResolution > 0)
+	{
+		buildGridGeometry(grid.tiles, grid.layoutChanges);
+		grid.cellSpeeds(gridSpeeds);
+		if (heatmap)
+		{
+			grid.cellPressures(gridPressures);
+		}
+		uploadGridColors(grid.fraction, gridSpeeds, gridPressures);
+	}
+	if (particleTarget > 0)
+	{
+		if (gpuParticles && !gpuFluid.build(particles, PARTICLE_COMPUTE_FILE))
+		{
+			std::cout << "Stepping the particles on the CPU instead." << std::endl;
+			gpuParticles = false;
+		}
+		buildParticleGeometry();
+
+		// The sprites are as large as a particle: half a spacing around its center.
+		loadProgramFilesAsync(*assetLoader, PARTICLE_VERTEX_SHADER_FILE, PARTICLE_FRAGMENT_SHADER_FILE, particleProgram, particleVertexShader,
+			particleFragmentShader, []
+		{
+			if (particleProgram != 0)
+			{
+				cachedUseProgram(particleProgram);
+				glUniform1i(glGetUniformLocation(particleProgram, "splat"), 0);
+				glUniform1f(glGetUniformLocation(particleProgram, "radius"), particles.spacing * 0.5f);
+				cachedUseProgram(0);
+				cachedEnable(GL_PROGRAM_POINT_SIZE);
+			}
+		});
+		if (fluidSurfaceEnabled && !fluidSurface.build(PARTICLE_VERTEX_SHADER_FILE, PARTICLE_FRAGMENT_SHADER_FILE, SDF_VERTEX_SHADER_FILE,
+			FLUID_SURFACE_SHADER_FILE))
+		{
+			fluidSurfaceEnabled = false;
+		}
+	}
+	if (shallowCells > 0)
+	{
+		buildSurfaceGeometry();
+	}
+	if (sprayEnabled && !spray.build(network, SPRAY_UPDATE_SHADER_FILE, PARTICLE_VERTEX_SHADER_FILE, PARTICLE_FRAGMENT_SHADER_FILE))
+	{
+		sprayEnabled = false;
+	}
+	lastSprayTime = glfwGetTime();
+	initFrameCapture();
+	initProfilerOverlay();
+	initTextRenderer(TEXT_VERTEX_SHADER_FILE, TEXT_FRAGMENT_SHADER_FILE);
+	initGpuTimers();
+	initLatencyMeter();
+}
+
+#pragma endregion Helper_functions
+
+// Functions called between every frame. game logic
+#pragma region util_functions
+// Adds the state after simulationStep to the rewind history.
+void recordRewindFrame()
+{
+	rewindFrame.assign(network.height.begin(), network.height.end());
+	rewindFrame.insert(rewindFrame.end(), network.tubeFlow.begin(), network.tubeFlow.end());
+	rewindFrame.insert(rewindFrame.end(), network.externalPressure.begin(), network.externalPressure.end());
+	rewindFrame.push_back(externalPressure);
+	rewindFrame.push_back(piston.velocity);
+	rewindFrame.push_back(piston.pressure);
+	rewindHistory.record(simulationStep, rewindFrame.data(), rewindFrame.size());
+}
+
+// Starts the rewind history of an interactive session with the state setup() left, if there is to be one. A scenario that plays
+// can't be rewound, since where its script is isn't part of the history.
+void startRewindHistory()
+{
+	rewindEnabled = rewindMemory > 0.0 && scenarioFile.empty() && lockstepPort == 0 && lockstepJoin.empty() && ingestPort == 0 && ingestShmName.empty() && streamViewSource.empty() && !playback.isOpen() && !sweepView && gridResolution == 0 && particleTarget == 0 && shallowCells == 0
+		&& !gpuNetworkStep && telemetry == nullptr && !sceneStreamer.isOpen() && !network.layered() && !network.hasComponents() && components.empty() && floatCount == 0;
+	rewindHistory.clear();
+	rewindHistory.setMemory((size_t)(rewindMemory * 1048576.0));
+	if (rewindEnabled)
+	{
+		recordRewindFrame();
+	}
+	else if (speculateSteps > 0)
+	{
+		LOG_WARNING("This session has no rewind history, so the late commands of --speculate are applied when they arrive.");
+	}
+	speculatedInputs.clear();
+}
+
+// Takes the network back to the state after step target and carries on from there. A recording forgets what came after. Returns
+// false if the history doesn't go back that far.
+bool restoreStep(long long target)
+{
+	int vessels = network.vesselCount();
+	int tubes = network.tubeCount();
+	if (!rewindEnabled || target >= simulationStep || !rewindHistory.rewind(target, rewindFrame)
+		|| rewindFrame.size() != (size_t)(2 * vessels + tubes + 3))
+	{
+		return false;
+	}
+
+	std::copy(rewindFrame.begin(), rewindFrame.begin() + vessels, network.height.begin());
+	std::copy(rewindFrame.begin() + vessels, rewindFrame.begin() + vessels + tubes, network.tubeFlow.begin());
+	std::copy(rewindFrame.begin() + vessels + tubes, rewindFrame.begin() + 2 * vessels + tubes, network.externalPressure.begin());
+	externalPressure = rewindFrame[2 * vessels + tubes];
+	piston.velocity = rewindFrame[2 * vessels + tubes + 1];
+	piston.pressure = rewindFrame[2 * vessels + tubes + 2];
+	for (int i = 0; i < vessels; i++)
+	{
+		network.top[i] = network.bottom[i] + network.height[i];
+	}
+	network.preciseDirty = true;
+	network.computePressures(density, gravity);
+	network.wakeAll();
+	if (useFixedApparatus)
+	{
+		apparatus.load(network);
+	}
+	if (!recordInputFile.empty())
+	{
+		inputLog.truncate(target);
+	}
+	simulationStep = target;
+	return true;
+}
+
+// Goes back steps steps, or as far as the history goes, and carries on from there.
+void rewindSteps(long long steps)
+{
+	long long from = simulationStep;
+	long long target = std::max(rewindHistory.oldestStep(), simulationStep - std::max(steps, 0LL));
+	if (!restoreStep(target))
+	{
+		LOG_INFO("There is no history to go back to.");
+		return;
+	}
+	speculatedInputs.erase(std::remove_if(speculatedInputs.begin(), speculatedInputs.end(), [target](const InputEvent& event) { return event.step >= target; }),
+		speculatedInputs.end());
+	LOG_INFO("Went back {} steps, to step {}", from - target, target);
+}
+
+bool update();
+
+// Takes the commands of arrivedInputs that are late for the step they were stamped with out of it, goes back to the earliest of those
+// steps and runs the steps up to this one again, with each of them applied before its step.
+void rollBack()
+{
+	long long oldest = std::max(simulationStep - speculateSteps, std::max(rewindHistory.oldestStep(), 0LL));
+	speculatedInputs.erase(std::remove_if(speculatedInputs.begin(), speculatedInputs.end(), [oldest](const InputEvent& event) { return event.step < oldest; }),
+		speculatedInputs.end());
+	long long target = simulationStep;
+	for (const QueuedInput& input : arrivedInputs)
+	{
+		if (input.step >= 0 && input.step < simulationStep && input.command != INPUT_REWIND)
+		{
+			target = std::min(target, std::max(input.step, oldest));
+		}
+	}
+	if (target == simulationStep)
+	{
+		return;
+	}
+
+	long long current = simulationStep;
+	if (!restoreStep(target))
+	{
+		return;
+	}
+	size_t kept = 0;
+	for (const QueuedInput& input : arrivedInputs)
+	{
+		if (input.step >= 0 && input.step < current && input.command != INPUT_REWIND)
+		{
+			InputEvent event;
+			event.step = std::max(input.step, target);
+			event.command = input.command;
+			event.vessel = input.vessel;
+			event.value = input.value;
+			speculatedInputs.push_back(event);
+			traceCounter("input latency ms", (glfwGetTime() - input.time) * 1000.0);
+			appliedInputs.push_back({ input.time, current + 1 });
+		}
+		else
+		{
+			arrivedInputs[kept++] = input;
+		}
+	}
+	arrivedInputs.resize(kept);
+
+	resimulating = true;
+	while (simulationStep < current)
+	{
+		update();
+	}
+	resimulating = false;
+	traceCounter("rollback steps", (double)(current - target));
+}
+
+// This runs once every physics timestep.
+// Carries out one command. This is the only place input changes the simulation.
+void applyInput(InputCommand command, int vessel, float value)
+{
+	if (flightRecording())
+	{
+		flightInput(command, vessel, value);
+	}
+	bool validVessel = vessel >= 0 && vessel < network.vesselCount();
+	switch (command)
+	{
+	case INPUT_PRESSURE_UP:
+		externalPressure += value;
+		break;
+	case INPUT_PRESSURE_DOWN:
+		externalPressure -= value;
+		break;
+	case INPUT_SET_PRESSURE:
+		externalPressure = value;
+		break;
+	case INPUT_SET_EXTERNAL:
+		if (validVessel)
+		{
+			network.setExternalPressure(vessel, value);
+		}
+		break;
+	case INPUT_ADD_FLUID:
+		// A layered vessel would have to know which fluid to add. The fixed step keeps its own heights, so it takes them over again.
+		if (validVessel && !network.layered())
+		{
+			// The GPU has the newest heights, and takes all of them over again afterwards.
+			if (gpuNetworkStep)
+			{
+				gpuNetwork.readBack(network);
+			}
+			network.height[vessel] = std::max(0.0f, network.height[vessel] + value);
+			network.top[vessel] = network.bottom[vessel] + network.height[vessel];
+			network.computePressures(density, gravity);
+			network.wake(vessel);
+			if (useFixedApparatus)
+			{
+				apparatus.load(network);
+			}
+			if (gpuNetworkStep)
+			{
+				gpuNetwork.load(network);
+			}
+		}
+		break;
+	case INPUT_REWIND:
+		rewindSteps((long long)value);
+		break;
+	default:
+		break;
+	}
+	if ((command == INPUT_SET_EXTERNAL || command == INPUT_ADD_FLUID) && !validVessel)
+	{
+		LOG_WARNING("There is no vessel {}, ignoring the command.", vessel);
+	}
+}
+
+// What the machines of a lockstep session compare to tell whether they are still in step: the levels, flows and external pressures.
+uint64_t lockstepStateHash()
+{
+	ResultKey state;
+	state.add(network.height);
+	state.add(network.tubeFlow);
+	state.add(network.externalPressure);
+	state.add(externalPressure);
+	return state.value();
+}
+
+// Takes the place of update() while viewing a stream. Input has nothing to change, so it is dropped. Returns false if the levels
+// on screen stay the same.
+bool viewStream()
+{
+	QueuedInput input;
+	while (inputQueue.pop(input))
+	{
+	}
+
+	long long step;
+	if (!streamView.next(streamViewHeights, step))
+	{
+		return false;
+	}
+	if ((int)streamViewHeights.size() != network.vesselCount())
+	{
+		if (!streamViewMismatch)
+		{
+			LOG_ERROR("The stream has {} vessels and the scene {}, it needs the --scene of the server.", streamViewHeights.size(), network.vesselCount());
+			streamViewMismatch = true;
+		}
+		return false;
+	}
+	bool moved = false;
+	for (int v = 0; v < network.vesselCount(); v++)
+	{
+		moved |= network.height[v] != streamViewHeights[v];
+		network.height[v] = streamViewHeights[v];
+		network.top[v] = network.bottom[v] + network.height[v];
+	}
+	network.computePressures(density, gravity);
+	simulationStep = step;
+	return moved;
+}
+
+// Records a copy of the state that came back from the GPU, with --gpu-network and --telemetry (see GpuNetwork::queueState()).
+void recordGpuState(long long step, const float* height, const float* pressure, const float* externalPressure)
+{
+	telemetry->record(step, height, pressure, externalPressure, network.width.data());
+}
+
+// Applies a reading of the plant like the command of a key, and records it the same way, so a replay doesn't need the plant.
+void applyReading(const IngestEvent& reading)
+{
+	if (reading.vessel >= network.vesselCount())
+	{
+		return;
+	}
+	if (reading.kind == INGEST_HEIGHT && ensembleFilter.memberCount() > 0)
+	{
+		ensembleFilter.observe(reading.vessel, reading.value);
+		return;
+	}
+	InputCommand command = INPUT_SET_EXTERNAL;
+	float value = reading.value;
+	if (reading.kind == INGEST_HEIGHT)
+	{
+		command = INPUT_ADD_FLUID;
+		value = reading.value - network.height[reading.vessel];
+	}
+	applyInput(command, reading.vessel, value);
+	if (!recordInputFile.empty())
+	{
+		inputLog.add(simulationStep, command, reading.vessel, value);
+	}
+}
+
+// Returns false if nothing in the network moved, so it has come to rest.
+bool update()
+{
+	TRACY_ZONE("update");
+	if (playback.isOpen())
+	{
+		return playTelemetry();
+	}
+	if (streamView.isOpen())
+	{
+		return viewStream();
+	}
+
+	// Apply the input for this step first, from the replayed log or from the keys pressed since the last step.
+	if (!replayInputFile.empty())
+	{
+		InputEvent event;
+		while (inputLog.next(simulationStep, event))
+		{
+			applyInput(event.command, event.vessel, event.value);
+		}
+	}
+	else if (lockstep.isPeer())
+	{
+		QueuedInput input;
+		while (inputQueue.pop(input))
+		{
+			InputEvent event;
+			event.command = input.command;
+			event.vessel = input.vessel;
+			event.value = input.value;
+			if (input.command != INPUT_REWIND)
+			{
+				lockstep.send(event);
+			}
+		}
+		InputEvent event;
+		while (lockstep.next(simulationStep, event))
+		{
+			applyInput(event.command, event.vessel, event.value);
+			if (!recordInputFile.empty())
+			{
+				inputLog.add(simulationStep, event.command, event.vessel, event.value);
+			}
+		}
+	}
+	else if (resimulating)
+	{
+		// A step of a rollback running again: the commands that were applied before it, and those that came too late for it.
+		for (const InputEvent& event : speculatedInputs)
+		{
+			if (event.step == simulationStep)
+			{
+				applyInput(event.command, event.vessel, event.value);
+				if (!recordInputFile.empty())
+				{
+					inputLog.add(simulationStep, event.command, event.vessel, event.value);
+				}
+			}
+		}
+	}
+	else
+	{
+		QueuedInput input;
+		arrivedInputs.clear();
+		while (inputQueue.pop(input))
+		{
+			arrivedInputs.push_back(input);
+		}
+		if (speculateSteps > 0 && rewindEnabled)
+		{
+			rollBack();
+		}
+		for (const QueuedInput& input : arrivedInputs)
+		{
+			applyInput(input.command, input.vessel, input.value);
+			if (speculateSteps > 0 && rewindEnabled && input.command != INPUT_REWIND)
+			{
+				speculatedInputs.push_back({ simulationStep, input.command, input.vessel, input.value });
+			}
+			if (!recordInputFile.empty() && input.command != INPUT_REWIND)
+			{
+				inputLog.add(simulationStep, input.command, input.vessel, input.value);
+			}
+			if (lockstep.isHost() && input.command != INPUT_REWIND)
+			{
+				InputEvent event;
+				event.step = simulationStep;
+				event.command = input.command;
+				event.vessel = input.vessel;
+				event.value = input.value;
+				lockstep.applied(event);
+			}
+			traceCounter("input latency ms", (glfwGetTime() - input.time) * 1000.0);
+			appliedInputs.push_back({ input.time, simulationStep + 1 });
+		}
+
+		// Only what the plant already sent is applied; a step never waits for it.
+		if (sensorIngest.isOpen())
+		{
+			sensorIngest.take(simulationStep / physicsHz, applyReading);
+		}
+	}
+
+	// The piston pushes on the surface of its vessel, which adds to the pressure caused by the volume of water. A profile gives the
+	// force at the middle of the step, and a scenario the pressure.
+	float dt = (float)(1.0 / physicsHz);
+	if (scenarioPlaying)
+	{
+		scenarioPlaying = scenarios.resume(network, externalPressure, simulationStep, dt);
+	}
+	if (!pressureSchedule.empty())
+	{
+		pressureSchedule.apply(network, (simulationStep + 0.5) / physicsHz, taskPool);
+	}
+	if (!sweepView)
+	{
+		piston.force = forceProfile.empty() ? externalPressure * network.width[pistonVessel] : forceProfile.at((simulationStep + 0.5) / physicsHz);
+		piston.couple(network, density, gravity, dt);
+	}
+	components.beforeStep(network, dt);
+
+	// Move every vessel one fixed step towards equilibrium. The levels overshoot and swing around it, with the friction in the
+	// tubes making every swing a little smaller, until they come to rest.
+	bool moved;
+	if (gridResolution > 0)
+	{
+		moved = grid.update(network, density, gravity, dt, taskPool);
+	}
+	else if (particleTarget > 0)
+	{
+		moved = gpuParticles ? gpuFluid.update(network, density, gravity, dt) : particles.update(network, density, gravity, dt, taskPool);
+	}
+	else if (shallowCells > 0)
+	{
+		moved = shallowWater.update(network, density, gravity, dt, taskPool);
+	}
+	else if (gpuNetworkStep)
+	{
+		moved = gpuNetwork.update(network, density, gravity, dt);
+	}
+	else
+	{
+		network.runSchedule(simulationStep);
+		moved = useFixedApparatus ? apparatus.update(network, dt) : network.update(density, gravity, dt, taskPool);
+	}
+	if (gridResolution == 0 && particleTarget == 0 && !sweepView)
+	{
+		piston.follow(network);
+	}
+	components.afterStep(network, dt);
+	if (ensembleFilter.step(network, density, gravity, dt, taskPool))
+	{
+		if (useFixedApparatus)
+		{
+			apparatus.load(network);
+		}
+		traceCounter("assimilation spread", ensembleFilter.priorSpread());
+		traceCounter("assimilation innovation", ensembleFilter.innovation());
+	}
+	if (floats.count() > 0)
+	{
+		// The network can come to rest before the floats on it do.
+		moved = floats.step(network, density, gravity, dt) || moved;
+		traceCounter("float contacts", floats.lastContacts);
+	}
+	simulationStep++;
+	if (metricsPort > 0)
+	{
+		metricSteps.store(metricSteps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	if (flightRecording() && pistonVessel < network.vesselCount())
+	{
+		flightStep(simulationStep, !moved, network.height[pistonVessel], piston.pressure);
+	}
+
+	// The outputs that read the whole network need it back from the GPU first. Telemetry gets its steps a few steps late instead,
+	// from copies that come back without waiting.
+	long long streamSteps = std::max(1LL, (long long)(physicsHz / streamHz + 0.5));
+	bool streamDue = stateStream != nullptr && simulationStep % streamSteps == 0;
+	long long checkpointSteps = std::max(1LL, (long long)(checkpointInterval * physicsHz));
+	bool checkpointDue = checkpointWriter != nullptr && simulationStep % checkpointSteps == 0;
+	if (gpuNetworkStep && (liveExport.isOpen() || streamDue || checkpointDue))
+	{
+		gpuNetwork.readBack(network);
+	}
+
+	if (telemetry != nullptr && gpuNetworkStep)
+	{
+		gpuNetwork.takeStates(recordGpuState, false);
+		gpuNetwork.queueState(simulationStep, network, recordGpuState);
+	}
+	else if (telemetry != nullptr)
+	{
+		telemetry->record(simulationStep, network);
+	}
+	if (!sensors.empty())
+	{
+		sensors.sample(network, simulationStep);
+	}
+	if (liveExport.isOpen())
+	{
+		liveExport.publish(simulationStep, simulationStep / physicsHz, network);
+	}
+	if (streamDue)
+	{
+		stateStream->publish(simulationStep, network);
+	}
+	if (checkpointDue)
+	{
+		saveCheckpoint();
+	}
+	if (rewindEnabled)
+	{
+		recordRewindFrame();
+	}
+	if (lockstep.isHost())
+	{
+		lockstep.stepped(simulationStep, LockstepSession::checkDue(simulationStep) ? lockstepStateHash() : 0);
+	}
+	else if (lockstep.isPeer() && LockstepSession::checkDue(simulationStep) && !lockstep.check(simulationStep, lockstepStateHash()))
+	{
+		LOG_ERROR("Out of step with the lockstep host at step {}.", simulationStep);
+	}
+	return moved;
+}
+
+// This function runs every frame
+// alpha is how far the current time is between the previous and the current physics step, used to blend the two.
+// Returns false if the scene looks exactly like it did in the last frame, in which case only the overlay is new.
+bool renderScene(const std::vector<float>& from, const std::vector<float>& to, float alpha)
+{
+	TRACY_ZONE("renderScene");
+	// The quads of the vessels are drawn into the retained frame, which clears what it draws again itself (see sceneFrame).
+	bool retained = retainScene && !sweepView && !gpuNetworkStep && gridResolution == 0 && particleTarget == 0 && shallowCells == 0 && !sprayEnabled && floatVao == 0 &&
+		networkLod.levelFor(pixelSize()) < 0 && targetsSettled() && sceneFrame.resize(framebufferWidth, framebufferHeight, renderSamples);
+	bool sceneChanged = true;
+	if (!retained)
+	{
+		sceneFrame.invalidate();
+
+		// Clear the color buffer and the depth buffer
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Clear the screen to white
+	cachedClearColor(0.0, 0.0, 0.0, 1.0);
+
+	// Everything is drawn through the render queue. The items all start out with the program you've created and our MVP.
+	renderQueue.setFrame((float)glfwGetTime(), 1.0f / pixelSize());
+	DrawItem item;
+	item.program = program;
+	item.mvp = mvp;
+
+	// Re-upload the fill levels (if they moved), then draw everything (containers, tube and piston), which is a single item.
+	// On the grid, the mesh of the grid takes the place of the containers and the tube behind it, and only the piston is drawn.
+	// The particles do the same, except that they are drawn in front of the piston, which is in front of the points drawn by the GPU
+	// (they have no depth) and the ones drawn from the CPU alike.
+	// The viewed sweep has no quads, it draws every vessel and tube of every variant as one instanced item instead.
+	gpuTimerBegin(PROFILE_GPU_SCENE);
+	if (sweepView)
+	{
+		uploadInstances(from, to, alpha);
+		DrawItem sweepItem = item;
+		sweepItem.program = instanceProgram;
+		sweepItem.vao = instanceVao;
+		sweepItem.mode = GL_TRIANGLE_FAN;
+		sweepItem.count = 4;
+		sweepItem.instances = (GLsizei)instances.size();
+		renderQueue.add(sweepItem);
+	}
+	else
+	{
+		// The droplets of the spray are advanced first, since that binds texture unit 0 to their vessels.
+		if (sprayEnabled)
+		{
+			double now = glfwGetTime();
+			spray.update(network, from, to, alpha, (float)(1.0 / physicsHz), (float)(now - lastSprayTime), gravity);
+			lastSprayTime = now;
+		}
+
+		bool levelsMoved = gpuNetworkStep ? bindGpuLevels() : uploadLevels(from, to, alpha);
+		cachedActiveTexture(GL_TEXTURE0);
+		cachedBindTexture(GL_TEXTURE_BUFFER, levelTexture);
+
+		DrawItem quads = item;
+		quads.vao = vao;
+		quads.indexType = GL_UNSIGNED_INT;
+		quads.count = quadCount * QUAD_INDICES;
+
+		// The piston on its own, for the grid, the particles and the bars of a zoomed out network.
+		DrawItem pistonQuads = quads;
+		pistonQuads.first = network.vesselCount() * QUAD_INDICES;
+		pistonQuads.count = 2 * QUAD_INDICES;
+
+		if (effectProgram != 0)
+		{
+			setEffectUniforms();
+			quads.program = effectProgram;
+		}
+
+		// How far zoomed out the view is decides whether the vessels or the bars standing in for them are drawn. A pixel is
+		// 2 / framebufferWidth across in clip space.
+		int lodDrawLevel = shallowCells == 0 && sdfProgram == 0 && !gpuNetworkStep ? networkLod.levelFor(pixelSize()) : -1;
+
+		if (gridResolution > 0)
+		{
+			DrawItem mesh = item;
+			mesh.layer = RENDER_LAYER_BACK;
+			mesh.program = quads.program;
+			mesh.vao = gridVao;
+			mesh.indexType = GL_UNSIGNED_INT;
+			mesh.count = gridIndexCount;
+			renderQueue.add(mesh);
+			if (gridTubes == TUBES_REDUCED)
+			{
+				pistonQuads.count += network.tubeCount() * QUAD_INDICES;
+			}
+			renderQueue.add(pistonQuads);
+		}
+		else if (particleTarget > 0)
+		{
+			renderQueue.add(pistonQuads);
+			if (gpuParticles)
+			{
+				cachedBindVertexArray(particleVao);
+				glBindVertexBuffer(0, particleDrawBuffer, 0, sizeof(GpuParticleVertex));
+				cachedBindVertexArray(0);
+			}
+
+			// The splats are drawn and blurred right away, into textures of their own, and the surface is drawn from them with
+			// everything else.
+			if (fluidSurfaceEnabled && (!gpuParticles || particleDrawBuffer != 0) && fluidSurface.resize(targetWidth, targetHeight)
+				&& fluidSurface.render(particleVao, particlePointCount, mvp, pixelSize(), particles.spacing * 0.5f))
+			{
+				fluidSurface.bindField();
+				DrawItem surface = item;
+				surface.layer = RENDER_LAYER_FRONT;
+				surface.program = fluidSurface.surfaceProgram();
+				surface.vao = fluidSurface.emptyVao();
+				surface.count = 3;
+				surface.depthTest = false;
+				renderQueue.add(surface);
+			}
+			else if (!gpuParticles || particleDrawBuffer != 0)
+			{
+				DrawItem points = item;
+				points.layer = RENDER_LAYER_FRONT;
+				points.vao = particleVao;
+				points.mode = GL_POINTS;
+				points.count = particlePointCount;
+				points.pointSize = PARTICLE_POINT_SIZE;
+				if (particleProgram != 0)
+				{
+					// The size of a sprite follows the zoom, through the pointScale of the Frame block.
+					points.program = particleProgram;
+				}
+				renderQueue.add(points);
+			}
+		}
+		else if (lodDrawLevel >= 0)
+		{
+			// Zoomed out too far to see the vessels: the bars of the tiles behind the piston, which they would hide otherwise. The
+			// summaries only follow the levels while they are drawn, so they catch up with everything that moved since the last time.
+			bool tilesMoved = (levelsMoved || !lodValid) && networkLod.update(renderTop);
+			uploadLodTiles(lodDrawLevel, tilesMoved);
+			DrawItem bars = item;
+			bars.layer = RENDER_LAYER_BACK;
+			bars.program = instanceProgram;
+			bars.vao = lodVao;
+			bars.mode = GL_TRIANGLE_FAN;
+			bars.count = 4;
+			bars.instances = (GLsizei)lodInstances.size();
+			bars.depthTest = false;
+			if (bars.instances > 0)
+			{
+				renderQueue.add(bars);
+			}
+			renderQueue.add(pistonQuads);
+		}
+		else
+		{
+			lodValid = false;
+			if (drawCommandBuffer != 0 && sdfProgram == 0)
+			{
+				updateDrawCommands();
+				quads.indirectBuffer = drawCommandBuffer;
+				quads.count = (GLsizei)drawCommands.size();
+			}
+			sceneChanged = !retained || beginRetainedScene();
+			if (sceneChanged && sdfProgram != 0)
+			{
+				// The whole apparatus in one triangle that covers the screen.
+				cachedActiveTexture(GL_TEXTURE1);
+				cachedBindTexture(GL_TEXTURE_BUFFER, sdfShapeTexture);
+				cachedActiveTexture(GL_TEXTURE0);
+				DrawItem shapes = item;
+				shapes.program = sdfProgram;
+				shapes.vao = sdfVao;
+				shapes.count = 3;
+				shapes.depthTest = false;
+				renderQueue.add(shapes);
+			}
+			else if (sceneChanged)
+			{
+				renderQueue.add(quads);
+			}
+			if (shallowCells > 0)
+			{
+				DrawItem surface = item;
+				surface.vao = surfaceVao;
+				surface.indexType = GL_UNSIGNED_INT;
+				surface.count = surfaceIndexCount;
+				renderQueue.add(surface);
+			}
+
+			if (floatVao != 0 && !floatInstances.empty())
+			{
+				DrawItem boxes = item;
+				boxes.layer = RENDER_LAYER_FRONT;
+				boxes.program = instanceProgram;
+				boxes.vao = floatVao;
+				boxes.mode = GL_TRIANGLE_FAN;
+				boxes.count = 4;
+				boxes.instances = (GLsizei)floatInstances.size();
+				boxes.depthTest = false;
+				renderQueue.add(boxes);
+			}
+		}
+		if (sceneChanged && backgroundTexture != 0 && backgroundProgram != 0)
+		{
+			cachedActiveTexture(GL_TEXTURE0 + BACKGROUND_UNIT);
+			cachedBindTexture(GL_TEXTURE_2D, backgroundTexture);
+			cachedActiveTexture(GL_TEXTURE0);
+			DrawItem backdrop = item;
+			backdrop.layer = RENDER_LAYER_IMAGE;
+			backdrop.program = backgroundProgram;
+			backdrop.vao = backgroundVao;
+			backdrop.mode = GL_TRIANGLE_STRIP;
+			backdrop.count = 4;
+			backdrop.depthTest = false;
+			renderQueue.add(backdrop);
+		}
+		if (sprayEnabled)
+		{
+			DrawItem droplets = item;
+			droplets.layer = RENDER_LAYER_FRONT;
+			droplets.program = spray.drawProgram();
+			droplets.vao = spray.dropletVao();
+			droplets.mode = GL_POINTS;
+			droplets.count = SPRAY_DROPLETS;
+			renderQueue.add(droplets);
+		}
+	}
+	renderQueue.flush();
+	if (retained)
+	{
+		sceneFrame.end();
+		sceneFrame.present();
+	}
+	gpuTimerEnd();
+
+	// The segment the levels were read from can only be written again once the GPU has passed this point.
+	if (levelStream.valid())
+	{
+		levelStream.fence();
+	}
+
+	// The overlay is flushed on its own, so the GPU timers can tell its time apart from the scene.
+	if (showProfiler || showHud)
+	{
+		gpuTimerBegin(PROFILE_GPU_OVERLAY);
+		if (showProfiler)
+		{
+			queueProfilerOverlay(renderQueue, program, renderHz > 0.0 ? (float)(1000.0 / renderHz) : 1000.0f / 60.0f);
+		}
+		if (showHud)
+		{
+			queueText(renderQueue, (int)(framebufferWidth / contentScale), (int)(framebufferHeight / contentScale));
+		}
+		renderQueue.flush();
+		gpuTimerEnd();
+	}
+	return sceneChanged;
+}
+
+// Wakes the simulation thread if it is waiting for input.
+void wakeSimulation()
+{
+	std::lock_guard<std::mutex> lock(simulationIdleLock);
+	simulationWakeRequested = true;
+	simulationWake.notify_one();
+}
+
+// Hands a command to the simulation. If the simulation is so far behind that the queue is full, the key press is dropped rather
+// than making the event thread wait.
+void queueInput(InputCommand command, int vessel = -1, float value = 0.0f, long long step = -1)
+{
+	QueuedInput input;
+	input.command = command;
+	input.vessel = vessel;
+	input.value = value;
+	input.time = glfwGetTime();
+	input.step = step;
+	bool queued;
+	{
+		std::lock_guard<std::mutex> lock(inputProducerLock);
+		queued = inputQueue.push(input);
+	}
+	if (!queued)
+	{
+		LOG_WARNING("Input queue full, dropped a command.");
+	}
+	wakeSimulation();
+}
+
+// Reads the settings file before anything is built. Its density and gravity replace those of the command line, since later
+// changes to them are ignored.
+bool loadConfig()
+{
+	configBase = settings();
+	configBase.density = density;
+	configBase.gravity = gravity;
+	std::ifstream file(configFile, std::ios::in);
+	if (!file.good())
+	{
+		std::cout << "Can't read file: " << configFile << std::endl;
+		return false;
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	Settings loaded;
+	if (!parseSettings(text.str(), configFile, configBase, loaded))
+	{
+		return false;
+	}
+	publishSettings(loaded);
+	density = loaded.density;
+	gravity = loaded.gravity;
+	return true;
+}
+
+// Called once per frame. If the settings file changed, its settings replace the ones in use, unless it can't be read, in which case
+// they stay as they are. The density and the gravity are part of the network that was built (and of what a recording replays), so
+// they stay too, and only the next start takes them from the file.
+void reloadConfig()
+{
+	std::vector<std::string> contents;
+	if (configWatcher == nullptr || !configWatcher->takeChanges(contents))
+	{
+		return;
+	}
+
+	Settings loaded;
+	if (!parseSettings(contents[0], configFile, configBase, loaded))
+	{
+		LOG_WARNING("Reloading {} failed, keeping the previous settings.", configFile);
+		return;
+	}
+	if (loaded.density != density || loaded.gravity != gravity)
+	{
+		LOG_WARNING("The density and the gravity of {} only change at the next start.", configFile);
+		loaded.density = density;
+		loaded.gravity = gravity;
+	}
+	if (loaded.windowWidth != settings().windowWidth || loaded.windowHeight != settings().windowHeight)
+	{
+		glfwSetWindowSize(window, loaded.windowWidth, loaded.windowHeight);
+	}
+	publishSettings(loaded);
+	LOG_INFO("Reloaded the settings of {}", configFile);
+}
+
+// With --gamepad, an axis of a gamepad or joystick sets the pressure on the piston, from -gamepad_pressure with the stick all the
+// way down to gamepad_pressure all the way up (see Settings.h), instead of the keys nudging it a pressure step at a time. GLFW only reads joysticks on the thread
+// that owns the window and doesn't make events for their axes, so the stick is polled on that thread: every frame, every
+// GAMEPAD_POLL_SECONDS of the waits between frames, and that often while the loop is idle too. Only a change of more than
+// GAMEPAD_RESOLUTION of the full pressure is handed to the simulation, as an INPUT_SET_PRESSURE, so it is recorded and replayed like
+// any key press, and a stick at rest costs nothing.
+#define GAMEPAD_POLL_SECONDS 0.002
+#define GAMEPAD_SCAN_SECONDS 1.0		// How often to look for a joystick again while none is plugged in
+#define GAMEPAD_DEAD_ZONE 0.08f		// Deflection of the stick that still counts as centered
+#define GAMEPAD_RESOLUTION 0.002f
+bool gamepadEnabled = false;
+int gamepadAxis = 1;					// The vertical axis of the left stick on most gamepads
+int gamepadJoystick = -1;
+double gamepadScanTime = -GAMEPAD_SCAN_SECONDS;
+float gamepadSent = 0.0f;
+
+// Whether a joystick is being polled, in which case the waits of the loop are no longer than GAMEPAD_POLL_SECONDS.
+inline bool gamepadActive()
+{
+	return gamepadEnabled && gamepadJoystick >= 0;
+}
+
+// Reads the axis of the gamepad and queues the pressure it stands for if that changed. Finds the first joystick that has the axis
+// if there is none yet, or if the last one was unplugged.
+void pollGamepad()
+{
+	if (!gamepadEnabled)
+	{
+		return;
+	}
+	if (gamepadJoystick >= 0 && !glfwJoystickPresent(gamepadJoystick))
+	{
+		LOG_INFO("The gamepad was unplugged.");
+		gamepadJoystick = -1;
+	}
+	if (gamepadJoystick < 0)
+	{
+		double now = glfwGetTime();
+		if (now - gamepadScanTime < GAMEPAD_SCAN_SECONDS)
+		{
+			return;
+		}
+		gamepadScanTime = now;
+		for (int joystick = GLFW_JOYSTICK_1; joystick <= GLFW_JOYSTICK_LAST && gamepadJoystick < 0; joystick++)
+		{
+			int axes = 0;
+			if (glfwJoystickPresent(joystick) && glfwGetJoystickAxes(joystick, &axes) != nullptr && axes > gamepadAxis)
+			{
+				gamepadJoystick = joystick;
+				LOG_INFO("Controlling the piston with axis {} of {}.", gamepadAxis, glfwGetJoystickName(joystick));
+			}
+		}
+		if (gamepadJoystick < 0)
+		{
+			return;
+		}
+	}
+
+	int axes = 0;
+	const float* axis = glfwGetJoystickAxes(gamepadJoystick, &axes);
+	if (axis == nullptr || axes <= gamepadAxis)
+	{
+		return;
+	}
+
+	// Up is negative on the sticks of most gamepads. Past the dead zone the pressure starts from 0 again, so it doesn't jump.
+	float deflection = -axis[gamepadAxis];
+	float magnitude = std::max(std::fabs(deflection) - GAMEPAD_DEAD_ZONE, 0.0f) / (1.0f - GAMEPAD_DEAD_ZONE);
+	float fullPressure = settings().gamepadPressure;
+	float pressure = std::copysign(std::min(magnitude, 1.0f), deflection) * fullPressure;
+	if (std::fabs(pressure - gamepadSent) > GAMEPAD_RESOLUTION * fullPressure || (pressure == 0.0f && gamepadSent != 0.0f))
+	{
+		gamepadSent = pressure;
+		lastInputTime = glfwGetTime();
+		queueInput(INPUT_SET_PRESSURE, -1, pressure);
+	}
+}
+
+// Called by the remote control for every command a controller sends.
+void queueRemoteCommand(const InputEvent& event)
+{
+	queueInput(event.command, event.vessel, event.value, event.step);
+}
+
+// Jumps steps forward (or back, if negative) in the playback, and wakes the simulation thread if it paused.
+void seekPlayback(long long steps)
+{
+	playbackSeek += steps;
+
+	std::lock_guard<std::mutex> lock(simulationIdleLock);
+	simulationWakeRequested = true;
+	simulationWake.notify_one();
+}
+
+// This function is used to handle key inputs.
+// It is a callback funciton. i.e. glfw takes the pointer to this function (via function pointer) and calls this function every time a key is pressed in the during event polling.
+// Turns the camera into the MVP.
+void updateCamera()
+{
+	float shorter = (float)std::min(framebufferWidth, framebufferHeight);
+	glm::vec3 scale(cameraZoom * shorter / framebufferWidth, cameraZoom * shorter / framebufferHeight, 1.0f);
+	setMVP(glm::translate(glm::scale(glm::mat4(1.0f), scale), glm::vec3(-cameraCenter, 0.0f)));
+	redrawRequested = true;
+}
+
+// How far in the scene one pixel of the window is, and where the cursor is in the scene. The cursor is in window coordinates,
+// which differ from the framebuffer on screens that scale the window.
+float cameraPixelSize(GLFWwindow* window)
+{
+	int width, height;
+	glfwGetWindowSize(window, &width, &height);
+	return 2.0f / (std::max(std::min(width, height), 1) * cameraZoom);
+}
+
+glm::vec2 cursorInScene(GLFWwindow* window, double x, double y)
+{
+	int width, height;
+	glfwGetWindowSize(window, &width, &height);
+	return cameraCenter + cameraPixelSize(window) * glm::vec2((float)(x - width * 0.5), (float)(height * 0.5 - y));
+}
+
+void scroll_callback(GLFWwindow* window, double xOffset, double yOffset)
+{
+	lastInputTime = glfwGetTime();
+
+	// Zoom around the cursor: the point under it stays where it is.
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	glm::vec2 before = cursorInScene(window, x, y);
+	cameraZoom = glm::clamp(cameraZoom * std::pow(CAMERA_ZOOM_STEP, (float)yOffset), CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM);
+	cameraCenter += before - cursorInScene(window, x, y);
+	updateCamera();
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	lastInputTime = glfwGetTime();
+	if (button == GLFW_MOUSE_BUTTON_LEFT)
+	{
+		panning = action == GLFW_PRESS;
+		glfwGetCursorPos(window, &panX, &panY);
+	}
+}
+
+void cursor_position_callback(GLFWwindow* window, double x, double y)
+{
+	lastInputTime = glfwGetTime();
+	if (!panning)
+	{
+		return;
+	}
+	float pixel = cameraPixelSize(window);
+	cameraCenter -= pixel * glm::vec2((float)(x - panX), (float)(panY - y));
+	panX = x;
+	panY = y;
+	updateCamera();
+}
+
+// Sets the time scale, within its limits. A lockstep peer runs at the pace of its host and a stream view at the pace of the
+// stream, so neither has one of its own.
+void setTimeScale(float scale)
+{
+	if (lockstep.isPeer() || streamView.isOpen())
+	{
+		return;
+	}
+	timeScale = glm::clamp(scale, 1.0f / TIME_SCALE_MAX, TIME_SCALE_MAX);
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	// Most keys change something on screen, so draw again even if we are idle.
+	redrawRequested = true;
+	lastInputTime = glfwGetTime();
+
+	//This set of controls are used to move one point (point1) of the line.
+	// The piston keys only queue a command, which the next physics step applies (and records, if we are recording).
+	// A playback has no piston to push. Its keys jump a second (10 with control) back or forward, halve or double the speed, turn
+	// it around and pause it instead. Otherwise the left arrow goes back as far in the rewind history, and period, comma and slash
+	// change the time scale.
+	if (playback.isOpen())
+	{
+		long long jump = (long long)physicsHz * ((mods & GLFW_MOD_CONTROL) != 0 ? 10 : 1);
+		float speed = playbackSpeed;
+		if (key == GLFW_KEY_LEFT && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			seekPlayback(-jump);
+		if (key == GLFW_KEY_RIGHT && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			seekPlayback(jump);
+		if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS && std::fabs(speed) > PLAYBACK_MIN_SPEED)
+			playbackSpeed = speed * 0.5f;
+		if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS && std::fabs(speed) < PLAYBACK_MAX_SPEED)
+			playbackSpeed = speed * 2.0f;
+		if (key == GLFW_KEY_R && action == GLFW_PRESS)
+			playbackSpeed = -speed;
+		if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		{
+			playbackPaused = !playbackPaused;
+			seekPlayback(0);
+		}
+	}
+	else
+	{
+		if (key == GLFW_KEY_SPACE && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			queueInput(INPUT_PRESSURE_UP, -1, settings().pressureStep);
+		if (key == GLFW_KEY_LEFT_SHIFT && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			queueInput(INPUT_PRESSURE_DOWN, -1, settings().pressureStep);
+		if (key == GLFW_KEY_LEFT && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			queueInput(INPUT_REWIND, -1, (float)(physicsHz * ((mods & GLFW_MOD_CONTROL) != 0 ? 10 : 1)));
+		if (key == GLFW_KEY_PERIOD && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			setTimeScale(timeScale * 2.0f);
+		if (key == GLFW_KEY_COMMA && (action == GLFW_PRESS || action == GLFW_REPEAT))
+			setTimeScale(timeScale * 0.5f);
+		if (key == GLFW_KEY_SLASH && action == GLFW_PRESS)
+			setTimeScale(1.0f);
+	}
+	if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+		showProfiler = !showProfiler;
+	if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+	{
+		screenshotRequested = true;
+		screenshotFormat = CAPTURE_PNG;
+	}
+	if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
+	{
+		screenshotRequested = true;
+		screenshotFormat = CAPTURE_EXR;
+	}
+	if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+		recording = !recording;
+	if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+	{
+		showHud = !showHud;
+		redrawRequested = true;
+	}
+	if (key == GLFW_KEY_HOME && action == GLFW_PRESS)
+	{
+		cameraCenter = glm::vec2(0.0f);
+		cameraZoom = 1.0f;
+		updateCamera();
+	}
+	//if (key == GLFW_KEY_S && action == GLFW_PRESS)
+	//	Line.point1.y -= movrate;
+	//if (key == GLFW_KEY_D && action == GLFW_PRESS)
+	//	Line.point1.x += movrate;
+
+	////This set of controls are used to move one point (point2) of the line.
+	//if (key == GLFW_KEY_I && action == GLFW_PRESS)
+	//	Line.point2.y += movrate;
+	//if (key == GLFW_KEY_J && action == GLFW_PRESS)
+	//	Line.point2.x -= movrate;
+	//if (key == GLFW_KEY_K && action == GLFW_PRESS)
+	//	Line.point2.y -= movrate;
+	//if (key == GLFW_KEY_L && action == GLFW_PRESS)
+	//	Line.point2.x += movrate;
+}
+
+// The window needs to be drawn again, e.g. because it was uncovered or resized.
+void refresh_callback(GLFWwindow* window)
+{
+	redrawRequested = true;
+}
+
+// Called for every size the framebuffer goes through while the window is dragged, and when it moves to a screen of another scale.
+// Only the viewport and the camera change here; the render targets follow once the size settles (see targetsSettled()).
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	if (width > 0 && height > 0)
+	{
+		if (width != framebufferWidth || height != framebufferHeight)
+		{
+			resizedTime = glfwGetTime();
+			lastHudText = -1.0;
+		}
+		framebufferWidth = width;
+		framebufferHeight = height;
+		cachedViewport(0, 0, width, height);
+		updateCamera();
+	}
+
+	int windowWidth, windowHeight;
+	glfwGetWindowSize(window, &windowWidth, &windowHeight);
+	float scale = windowWidth > 0 && width > 0 ? (float)width / windowWidth : 1.0f;
+	if (scale != contentScale)
+	{
+		contentScale = scale;
+		lastHudText = -1.0;
+	}
+	redrawRequested = true;
+}
+
+#pragma endregion util_functions
+
+// Headless mode, for running the simulation on machines without a display or GPU.
+#pragma region Headless
+// Settings that can be changed from the command line.
+bool headless = false;
+long long headlessSteps = 1000;
+double headlessDuration = -1.0;
+std::string outputFile;
+
+// If set, headless mode skips the motion and writes the levels the network comes to rest at (see VesselNetwork::settle()).
+bool equilibriumOnly = false;
+
+// With --sensitivity KIND INDEX, headless mode writes how the levels after headlessSteps steps depend on these parameters, all of
+// them from one run (see Sensitivity.h), instead of the plain results. An index of -1 (all) stands for every vessel or tube.
+std::vector<SensitivityParameter> sensitivityParameters;
+
+// With --calibrate FILE, headless mode fits the parameters of --fit KIND INDEX to the levels measured in that file instead (see
+// Calibration.h), and writes what it found.
+std::string calibrationFile;
+std::vector<SensitivityParameter> calibrationParameters;
+
+// If set, every profiled span and the simulation counters are recorded and written to this file on exit.
+std::string traceFile;
+
+// The messages of the render and simulation threads go through the logger (see Logger.h), to this file with --log FILE, and only
+// from the level of --log-level LEVEL up.
+std::string logFileName;
+int logLevel = LOG_LEVEL_DEBUG;
+
+// With --flight-recorder FILE, the last --flight-seconds of profiled spans, inputs and steps are kept in that file, where they
+// survive a crash (see FlightRecorder.h). --flight-dump FILE turns such a file into a trace.
+std::string flightFile;
+double flightSeconds = 30.0;
+std::string flightDumpFile;
+
+// With --result-cache FILE, the results of headless runs and of the variants of sweeps are kept in that file, and a run or a
+// variant that is in there already isn't run again (see ResultCache.h). Sweeps skip the variants that come up twice either way.
+std::string resultCacheFile;
+
+// If set (--counters), headless mode and the scaling benchmark break update() down into its phases and read the hardware counters
+// of every phase (see HardwareCounters.h).
+bool hardwareCounters = false;
+
+// If set, headless mode compares the pressure solvers of the grid instead of writing results (see runPressureBenchmark()).
+bool pressureBenchmark = false;
+
+// If set (--benchmark, or always in the HydroDynamicsBenchmark project), the window stays hidden, and instead of the simulation
+// the benchmarks run: update() on networks of every size in BENCHMARK_UPDATE_VESSELS, the render path drawing offscreen and the
+// loading of the shaders (see runBenchmarks()). With --output, the results are also written there as comma separated values.
+#ifdef HYDRO_BENCHMARK_BUILD
+bool benchmarkRun = true;
+#else
+bool benchmarkRun = false;
+#endif
+
+// With --benchmark-baselines, the run is compared with the newest baseline of this machine in that file, and the exit code is 1 if
+// any benchmark is significantly more than benchmarkThreshold slower (see Benchmark.h). With --benchmark-store, the run is then
+// stored there as the baseline of benchmarkCommit on this machine. The machine is the name of the computer unless given.
+#define BENCHMARK_DEFAULT_THRESHOLD 0.05
+std::string benchmarkBaselineFile;
+std::string benchmarkCommit = "unknown";
+std::string benchmarkMachine;
+double benchmarkThreshold = BENCHMARK_DEFAULT_THRESHOLD;
+bool benchmarkStore = false;
+
+// The benchmark runs on a grid of this resolution unless --grid says otherwise. It first lets the grid run for a while, so the
+// fluid is moving, and then times this many steps with every pressure method, all starting from the same state. Jacobi needs far
+// more sweeps than multigrid needs iterations, so it gets this many before it gives up.
+#define PRESSURE_BENCHMARK_RESOLUTION 256
+#define PRESSURE_BENCHMARK_WARMUP 60
+#define PRESSURE_BENCHMARK_STEPS 30
+#define PRESSURE_BENCHMARK_JACOBI_SWEEPS 2000
+
+// Every last level cache miss brings in a line of this many bytes.
+#define BENCHMARK_CACHE_LINE 64
+
+// If set, headless mode measures how update() scales with threads instead (see runScalingBenchmark()): on a network of
+// SCALING_STRONG_VESSELS vessels with 1, 2, 4, ... up to scalingThreads threads (strong scaling), and on one of
+// SCALING_WEAK_VESSELS vessels per thread (weak scaling). scalingThreads is every hardware thread unless --scaling-threads says
+// otherwise. With --output, the results are also written there as comma separated values.
+#define SCALING_STRONG_VESSELS 1000000
+#define SCALING_WEAK_VESSELS 250000
+#define SCALING_STEPS 20
+#define SCALING_REPETITIONS 7
+bool scalingBenchmark = false;
+int scalingThreads = 0;
+
+// If set, headless mode compares the integrators instead (see runAccuracyBenchmark()): every one of them steps the two vessels of
+// the classic apparatus, started ACCURACY_START_DIFFERENCE apart with nothing pushing on them, for ACCURACY_SECONDS at every rate
+// of ACCURACY_RATES, against their exact solution (see TwoVesselSolution). What comes out is the error of every integrator and
+// rate with what it cost, and the cheapest one whose error stays within accuracyTolerance meters (--accuracy-tolerance). With
+// --output, the results are also written there as comma separated values.
+#define ACCURACY_SECONDS 10.0
+#define ACCURACY_START_DIFFERENCE 0.6f
+#define ACCURACY_REPETITIONS 7
+static const int ACCURACY_RATES[] = { 15, 30, 60, 120, 240, 480, 960, 1920 };
+bool accuracyBenchmark = false;
+float accuracyTolerance = 1e-3f;
+
+// If set, headless mode runs every variant of the apparatus in this sweep file instead (see Sweep.h and runSweep()).
+// With --sweep-serve PORT it doesn't run them itself but hands them out in chunks to workers started with --sweep-worker HOST:PORT,
+// on any number of machines (see SweepCluster.h).
+std::string sweepFile;
+int sweepPort = 0;
+int sweepChunk = SWEEP_DEFAULT_CHUNK;
+std::string sweepCoordinator;
+
+// With --background-worker HOST:PORT instead, the window works for the coordinator on a thread of its own while it shows the
+// apparatus as usual. The chunks run on taskPool at batch priority, so the simulation of the window always comes first and the
+// sweep only gets the cores it leaves idle (see TaskPool.h).
+bool sweepBackground = false;
+std::thread sweepWorkerThread;
+std::atomic<bool> sweepWorkerStop(false);
+
+// --sweep-layout network steps the variants as components of one network even where the batched layout would apply (see
+// ApparatusBatch.h), for comparing the two.
+SweepLayout sweepLayout = SWEEP_LAYOUT_BATCHED;
+
+// With --sweep-stats FILE, the sweep also writes how the levels of its variants spread, every --sweep-stats-interval seconds of
+// simulated time, and how their results spread at the end (see EnsembleStats.h), instead of anyone having to keep their trajectories.
+std::string sweepStatsFile;
+double sweepStatsInterval = 1.0;
+
+// With --ranks N, headless mode splits the network into that many parts and steps each of them on a thread of its own, exchanging
+// only the vessels at the cuts (see PartitionedNetwork.h). Meant for very large networks, loaded with --restore.
+int rankCount = 0;
+
+// If set, the simulation is rendered offscreen into a video of this size instead of opening an interactive window.
+std::string videoFile;
+int videoWidth = 1920;
+int videoHeight = 1080;
+double videoFps = 60.0;
+
+// With --video-stream, what the window shows is also encoded at the video size and sent to every destination as it is drawn, for
+// operators watching from elsewhere (see openVideoStream()). Both the video and the stream are encoded by videoEncoder.
+std::vector<std::string> videoStreams;
+VideoEncoder videoEncoder = VIDEO_ENCODER_SOFTWARE;
+bool streamingVideo = false;
+
+// Reads the command line arguments. Returns false (after printing the usage) if they don't make sense.
+bool parseArguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--steps" && hasValue)
+		{
+			headlessSteps = atoll(argv[++i]);
+		}
+		else if (arg == "--duration" && hasValue)
+		{
+			// The duration is in simulated seconds. It turns into a number of physics steps once we know the physics rate.
+			headlessDuration = atof(argv[++i]);
+		}
+		else if (arg == "--physics-hz" && hasValue)
+		{
+			physicsHz = atof(argv[++i]);
+		}
+		else if (arg == "--time-scale" && hasValue)
+		{
+			timeScale = (float)atof(argv[++i]);
+		}
+		else if (arg == "--equilibrium")
+		{
+			equilibriumOnly = true;
+		}
+		else if ((arg == "--sensitivity" || arg == "--fit") && i + 2 < argc)
+		{
+			std::string name = argv[++i];
+			std::string index = argv[++i];
+			SensitivityParameter parameter;
+			if (!parseSensitivityKind(name, parameter.kind))
+			{
+				std::cout << "Unknown parameter " << name << ", expected width, pressure, height, conductance, damping or density" << std::endl;
+				return false;
+			}
+			parameter.index = index == "all" ? -1 : atoi(index.c_str());
+			(arg == "--fit" ? calibrationParameters : sensitivityParameters).push_back(parameter);
+			headless = true;
+		}
+		else if (arg == "--calibrate" && hasValue)
+		{
+			calibrationFile = argv[++i];
+			headless = true;
+		}
+		else if (arg == "--rewind-memory" && hasValue)
+		{
+			rewindMemory = atof(argv[++i]);
+		}
+		else if (arg == "--result-cache" && hasValue)
+		{
+			resultCacheFile = argv[++i];
+		}
+		else if (arg == "--autotune")
+		{
+			autotuneRun = true;
+		}
+		else if (arg == "--autotune-cache" && hasValue)
+		{
+			autotuneCacheFile = argv[++i];
+		}
+		else if (arg == "--density" && hasValue)
+		{
+			density = (float)atof(argv[++i]);
+		}
+		else if (arg == "--gravity" && hasValue)
+		{
+			gravity = (float)atof(argv[++i]);
+		}
+		else if (arg == "--layer" && i + 3 < argc)
+		{
+			LayerSetting setting;
+			setting.vessel = atoi(argv[++i]);
+			setting.density = (float)atof(argv[++i]);
+			setting.height = (float)atof(argv[++i]);
+			layerSettings.push_back(setting);
+		}
+		else if (arg == "--grid" && hasValue)
+		{
+			gridResolution = atoi(argv[++i]);
+		}
+		else if (arg == "--particles" && hasValue)
+		{
+			particleTarget = atoi(argv[++i]);
+		}
+		else if (arg == "--shallow-water" && hasValue)
+		{
+			shallowCells = atoi(argv[++i]);
+		}
+		else if (arg == "--gpu")
+		{
+			gpuParticles = true;
+		}
+		else if (arg == "--gpu-network")
+		{
+			gpuNetworkStep = true;
+		}
+		else if (arg == "--fluid-surface")
+		{
+			fluidSurfaceEnabled = true;
+		}
+		else if (arg == "--spray")
+		{
+			sprayEnabled = true;
+		}
+		else if (arg == "--grid-pressure" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "multigrid")
+			{
+				gridPressureMethod = PRESSURE_MULTIGRID;
+			}
+			else if (name == "jacobi")
+			{
+				gridPressureMethod = PRESSURE_JACOBI;
+			}
+			else
+			{
+				std::cout << "Unknown pressure method " << name << ", expected multigrid or jacobi" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--particle-order" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "morton")
+			{
+				particleOrder = PARTICLE_ORDER_MORTON;
+			}
+			else if (name == "rows")
+			{
+				particleOrder = PARTICLE_ORDER_ROWS;
+			}
+			else
+			{
+				std::cout << "Unknown particle order " << name << ", expected morton or rows" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--grid-advection" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "semi-lagrangian")
+			{
+				gridAdvection = ADVECTION_SEMI_LAGRANGIAN;
+			}
+			else if (name == "flip")
+			{
+				gridAdvection = ADVECTION_FLIP;
+			}
+			else
+			{
+				std::cout << "Unknown advection " << name << ", expected semi-lagrangian or flip" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--grid-tubes" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "cells")
+			{
+				gridTubes = TUBES_CELLS;
+			}
+			else if (name == "reduced")
+			{
+				gridTubes = TUBES_REDUCED;
+			}
+			else
+			{
+				std::cout << "Unknown tube model " << name << ", expected cells or reduced" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--flip-ratio" && hasValue)
+		{
+			flipRatio = (float)atof(argv[++i]);
+		}
+		else if (arg == "--sweep" && hasValue)
+		{
+			sweepFile = argv[++i];
+			headless = true;
+		}
+		else if (arg == "--sweep-layout" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "network")
+			{
+				sweepLayout = SWEEP_LAYOUT_NETWORK;
+			}
+			else if (name == "batched")
+			{
+				sweepLayout = SWEEP_LAYOUT_BATCHED;
+			}
+			else
+			{
+				std::cout << "Unknown sweep layout " << name << ", expected network or batched" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--sweep-view")
+		{
+			sweepView = true;
+		}
+		else if (arg == "--sweep-serve" && hasValue)
+		{
+			sweepPort = atoi(argv[++i]);
+		}
+		else if (arg == "--sweep-chunk" && hasValue)
+		{
+			sweepChunk = atoi(argv[++i]);
+		}
+		else if (arg == "--sweep-stats" && hasValue)
+		{
+			sweepStatsFile = argv[++i];
+		}
+		else if (arg == "--sweep-stats-interval" && hasValue)
+		{
+			sweepStatsInterval = atof(argv[++i]);
+		}
+		else if (arg == "--sweep-worker" && hasValue)
+		{
+			sweepCoordinator = argv[++i];
+			headless = true;
+		}
+		else if (arg == "--background-worker" && hasValue)
+		{
+			sweepCoordinator = argv[++i];
+			sweepBackground = true;
+		}
+		else if (arg == "--ranks" && hasValue)
+		{
+			rankCount = atoi(argv[++i]);
+		}
+		else if (arg == "--benchmark")
+		{
+			benchmarkRun = true;
+		}
+		else if (arg == "--benchmark-baselines" && i + 1 < argc)
+		{
+			benchmarkBaselineFile = argv[++i];
+		}
+		else if (arg == "--benchmark-commit" && i + 1 < argc)
+		{
+			benchmarkCommit = argv[++i];
+		}
+		else if (arg == "--benchmark-machine" && i + 1 < argc)
+		{
+			benchmarkMachine = argv[++i];
+		}
+		else if (arg == "--benchmark-threshold" && i + 1 < argc)
+		{
+			benchmarkThreshold = atof(argv[++i]) / 100.0;
+		}
+		else if (arg == "--benchmark-store")
+		{
+			benchmarkStore = true;
+		}
+		else if (arg == "--affinity" && hasValue)
+		{
+			if (!parseThreadAffinity(argv[++i]))
+			{
+				return false;
+			}
+		}
+		else if (arg == "--priority" && hasValue)
+		{
+			if (!parseThreadPriority(argv[++i]))
+			{
+				return false;
+			}
+		}
+		else if (arg == "--numa")
+		{
+			numaPlacement = true;
+		}
+		else if (arg == "--huge-pages")
+		{
+			hugePages = true;
+		}
+		else if (arg == "--counters")
+		{
+			hardwareCounters = true;
+		}
+		else if (arg == "--scaling-benchmark")
+		{
+			scalingBenchmark = true;
+			headless = true;
+		}
+		else if (arg == "--scaling-threads" && i + 1 < argc)
+		{
+			scalingThreads = atoi(argv[++i]);
+		}
+		else if (arg == "--accuracy-benchmark")
+		{
+			accuracyBenchmark = true;
+			headless = true;
+		}
+		else if (arg == "--accuracy-tolerance" && hasValue)
+		{
+			accuracyTolerance = (float)atof(argv[++i]);
+		}
+		else if (arg == "--pressure-benchmark")
+		{
+			pressureBenchmark = true;
+			headless = true;
+		}
+		else if (arg == "--generic")
+		{
+			genericStep = true;
+		}
+		else if (arg == "--implicit")
+		{
+			integrator = INTEGRATOR_IMPLICIT;
+		}
+		else if (arg == "--adaptive")
+		{
+			integrator = INTEGRATOR_ADAPTIVE;
+		}
+		else if (arg == "--adaptive-tolerance" && hasValue)
+		{
+			adaptiveTolerance = (float)atof(argv[++i]);
+		}
+		else if (arg == "--symplectic")
+		{
+			integrator = INTEGRATOR_SYMPLECTIC;
+		}
+		else if (arg == "--multirate")
+		{
+			multirate = true;
+		}
+		else if (arg == "--tube-damping" && hasValue)
+		{
+			tubeDamping = (float)atof(argv[++i]);
+		}
+		else if (arg == "--colored-scatter")
+		{
+			scatter = SCATTER_COLORED;
+		}
+		else if (arg == "--drain-limit" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "even")
+			{
+				drainLimit = DRAIN_EVEN;
+			}
+			else if (name == "outflow")
+			{
+				drainLimit = DRAIN_OUTFLOW;
+			}
+			else
+			{
+				std::cout << "Unknown drain limit " << name << ", expected even or outflow" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--precision" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "single")
+			{
+				precision = PRECISION_SINGLE;
+			}
+			else if (name == "mixed")
+			{
+				precision = PRECISION_MIXED;
+			}
+			else if (name == "double")
+			{
+				precision = PRECISION_DOUBLE;
+			}
+			else if (name == "fixed")
+			{
+				precision = PRECISION_FIXED_POINT;
+			}
+			else
+			{
+				std::cout << "Unknown precision " << name << ", expected single, mixed, double or fixed" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--preconditioner" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "jacobi")
+			{
+				preconditioner = PRECONDITIONER_JACOBI;
+			}
+			else if (name == "ic")
+			{
+				preconditioner = PRECONDITIONER_INCOMPLETE_CHOLESKY;
+			}
+			else if (name == "direct")
+			{
+				preconditioner = PRECONDITIONER_DIRECT;
+			}
+			else if (name == "amg")
+			{
+				preconditioner = PRECONDITIONER_MULTIGRID;
+			}
+			else
+			{
+				std::cout << "Unknown preconditioner " << name << ", expected jacobi, ic, direct or amg" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--gamepad")
+		{
+			gamepadEnabled = true;
+		}
+		else if (arg == "--gamepad-axis" && hasValue)
+		{
+			gamepadAxis = atoi(argv[++i]);
+		}
+		else if (arg == "--config" && hasValue)
+		{
+			configFile = argv[++i];
+		}
+		else if (arg == "--gamepad-pressure" && hasValue)
+		{
+			Settings changed = settings();
+			changed.gamepadPressure = (float)atof(argv[++i]);
+			publishSettings(changed);
+		}
+		else if (arg == "--pressure" && hasValue)
+		{
+			externalPressure = (float)atof(argv[++i]);
+		}
+		else if (arg == "--piston-mass" && hasValue)
+		{
+			piston.mass = (float)atof(argv[++i]);
+		}
+		else if (arg == "--component" && i + 2 < argc)
+		{
+			ComponentSpec spec;
+			spec.name = argv[++i];
+			spec.vessel = atoi(argv[++i]);
+			while (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0)
+			{
+				spec.settings.push_back((float)atof(argv[++i]));
+			}
+			componentSpecs.push_back(spec);
+		}
+		else if (arg == "--piston-force" && hasValue)
+		{
+			forceProfileFile = argv[++i];
+		}
+		else if (arg == "--pressure-schedule" && hasValue)
+		{
+			pressureScheduleFile = argv[++i];
+		}
+		else if (arg == "--sensors" && hasValue)
+		{
+			sensorFile = argv[++i];
+		}
+		else if (arg == "--sensor-output" && hasValue)
+		{
+			sensorOutputFile = argv[++i];
+		}
+		else if (arg == "--ingest-port" && hasValue)
+		{
+			ingestPort = atoi(argv[++i]);
+			if (ingestPort <= 0 || ingestPort > 65535)
+			{
+				std::cout << "Not a port: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--ingest-shm" && hasValue)
+		{
+			ingestShmName = argv[++i];
+		}
+		else if (arg == "--assimilate" && hasValue)
+		{
+			assimilateMembers = atoi(argv[++i]);
+			if (assimilateMembers < 2 || assimilateMembers > FILTER_MAX_MEMBERS)
+			{
+				std::cout << "The ensemble filter needs 2 to " << FILTER_MAX_MEMBERS << " members: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--assimilate-noise" && hasValue)
+		{
+			assimilateNoise = (float)atof(argv[++i]);
+			if (!(assimilateNoise > 0.0f))
+			{
+				std::cout << "The noise of a measurement has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--assimilate-spread" && hasValue)
+		{
+			assimilateSpread = (float)atof(argv[++i]);
+			if (!(assimilateSpread >= 0.0f))
+			{
+				std::cout << "The spread of the model can't be below 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--floats" && hasValue)
+		{
+			floatCount = atoi(argv[++i]);
+			if (floatCount < 1)
+			{
+				std::cout << "The number of floats has to be at least 1: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--float-size" && hasValue)
+		{
+			floatSize = (float)atof(argv[++i]);
+			if (!(floatSize > 0.0f))
+			{
+				std::cout << "The size of a float has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--float-density" && hasValue)
+		{
+			floatDensity = (float)atof(argv[++i]);
+			if (!(floatDensity > 0.0f))
+			{
+				std::cout << "The density of a float has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--scenarios" && hasValue)
+		{
+			scenarioFile = argv[++i];
+		}
+		else if (arg == "--scenario" && hasValue)
+		{
+			scenarioName = argv[++i];
+		}
+		else if (arg == "--output" && hasValue)
+		{
+			outputFile = argv[++i];
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			traceFile = argv[++i];
+		}
+		else if (arg == "--hitch-capture" && hasValue)
+		{
+			hitchCapturePrefix = argv[++i];
+		}
+		else if (arg == "--hitch-factor" && hasValue)
+		{
+			double factor = atof(argv[++i]);
+			if (factor <= 1.0)
+			{
+				std::cout << "Expected a factor above 1 after --hitch-factor" << std::endl;
+				return false;
+			}
+			hitchDetector.setFactor(factor);
+		}
+		else if (arg == "--gl-debug")
+		{
+			glDebug = true;
+		}
+		else if (arg == "--log" && hasValue)
+		{
+			logFileName = argv[++i];
+		}
+		else if (arg == "--flight-recorder" && hasValue)
+		{
+			flightFile = argv[++i];
+		}
+		else if (arg == "--flight-seconds" && hasValue)
+		{
+			flightSeconds = atof(argv[++i]);
+			if (flightSeconds <= 0.0)
+			{
+				std::cout << "Expected a positive number of seconds after --flight-seconds" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--flight-dump" && hasValue)
+		{
+			flightDumpFile = argv[++i];
+		}
+		else if (arg == "--log-level" && hasValue)
+		{
+			if (!parseLogLevel(argv[++i], logLevel))
+			{
+				std::cout << "Expected a log level of debug, info, warning or error, not " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--checkpoint" && hasValue)
+		{
+			checkpointFile = argv[++i];
+		}
+		else if (arg == "--checkpoint-interval" && hasValue)
+		{
+			checkpointInterval = atof(argv[++i]);
+		}
+		else if (arg == "--restore" && hasValue)
+		{
+			restoreFile = argv[++i];
+		}
+		else if (arg == "--scene" && hasValue)
+		{
+			sceneFile = argv[++i];
+		}
+		else if (arg == "--compile-scene" && i + 2 < argc)
+		{
+			compileSceneFrom = argv[++i];
+			compileSceneTo = argv[++i];
+		}
+		else if (arg == "--generate-scene" && i + 3 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "grid")
+			{
+				generatorSettings.topology = TOPOLOGY_GRID;
+			}
+			else if (name == "tree")
+			{
+				generatorSettings.topology = TOPOLOGY_TREE;
+			}
+			else if (name == "geometric")
+			{
+				generatorSettings.topology = TOPOLOGY_GEOMETRIC;
+			}
+			else if (name == "manifold")
+			{
+				generatorSettings.topology = TOPOLOGY_MANIFOLD;
+			}
+			else
+			{
+				std::cout << "Unknown kind of network " << name << ", expected grid, tree, geometric or manifold" << std::endl;
+				return false;
+			}
+			generatorSettings.vessels = atoi(argv[++i]);
+			generateSceneTo = argv[++i];
+		}
+		else if (arg == "--generate-seed" && hasValue)
+		{
+			generatorSettings.seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--generate-degree" && hasValue)
+		{
+			generatorSettings.degree = (float)atof(argv[++i]);
+		}
+		else if (arg == "--generate-widths" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "uniform")
+			{
+				generatorSettings.widths = WIDTHS_UNIFORM;
+			}
+			else if (name == "lognormal")
+			{
+				generatorSettings.widths = WIDTHS_LOGNORMAL;
+			}
+			else
+			{
+				std::cout << "Unknown width distribution " << name << ", expected uniform or lognormal" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--generate-width" && hasValue)
+		{
+			generatorSettings.width = (float)atof(argv[++i]);
+		}
+		else if (arg == "--generate-width-spread" && hasValue)
+		{
+			generatorSettings.widthSpread = (float)atof(argv[++i]);
+		}
+		else if (arg == "--scene-order" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "file")
+			{
+				sceneOrder = ORDER_AS_LOADED;
+			}
+			else if (name == "cuthill-mckee")
+			{
+				sceneOrder = ORDER_CUTHILL_MCKEE;
+			}
+			else if (name == "hilbert")
+			{
+				sceneOrder = ORDER_HILBERT;
+			}
+			else
+			{
+				std::cout << "Unknown scene order " << name << ", expected file, cuthill-mckee or hilbert" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--scene-tiles" && hasValue)
+		{
+			sceneTileSize = (float)atof(argv[++i]);
+			if (!(sceneTileSize > 0.0f))
+			{
+				std::cout << "The size of a tile has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--telemetry" && hasValue)
+		{
+			telemetryFile = argv[++i];
+		}
+		else if (arg == "--control-port" && hasValue)
+		{
+			controlPort = atoi(argv[++i]);
+			if (controlPort <= 0 || controlPort > 65535)
+			{
+				std::cout << "Not a port: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--speculate" && hasValue)
+		{
+			speculateSteps = atoll(argv[++i]);
+			if (speculateSteps < 1)
+			{
+				std::cout << "Speculation has to be able to go back at least 1 step: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--metrics-port" && hasValue)
+		{
+			metricsPort = atoi(argv[++i]);
+			if (metricsPort <= 0 || metricsPort > 65535)
+			{
+				std::cout << "Not a port: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--stream-view" && hasValue)
+		{
+			streamViewSource = argv[++i];
+		}
+		else if (arg == "--lockstep-host" && hasValue)
+		{
+			lockstepPort = atoi(argv[++i]);
+			if (lockstepPort <= 0 || lockstepPort > 65535)
+			{
+				std::cout << "Not a port: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--lockstep-join" && hasValue)
+		{
+			lockstepJoin = argv[++i];
+		}
+		else if (arg == "--stream-port" && hasValue)
+		{
+			streamPort = atoi(argv[++i]);
+			if (streamPort <= 0 || streamPort > 65535)
+			{
+				std::cout << "Not a port: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--stream-hz" && hasValue)
+		{
+			streamHz = atof(argv[++i]);
+			if (!(streamHz > 0.0))
+			{
+				std::cout << "The stream rate has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--stream-tolerance" && hasValue)
+		{
+			streamTolerance = (float)atof(argv[++i]);
+			if (!(streamTolerance > 0.0f))
+			{
+				std::cout << "The stream tolerance has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--live-export" && hasValue)
+		{
+			liveExportName = argv[++i];
+		}
+		else if (arg == "--play-telemetry" && hasValue)
+		{
+			playbackFile = argv[++i];
+		}
+		else if (arg == "--playback-speed" && hasValue)
+		{
+			playbackSpeed = (float)atof(argv[++i]);
+			if (std::fabs(playbackSpeed) < PLAYBACK_MIN_SPEED || std::fabs(playbackSpeed) > PLAYBACK_MAX_SPEED)
+			{
+				std::cout << "The playback speed has to be between " << PLAYBACK_MIN_SPEED << " and " << PLAYBACK_MAX_SPEED
+					<< " (or the same below 0 to play backwards): " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--telemetry-tolerance" && hasValue)
+		{
+			telemetryTolerance = (float)atof(argv[++i]);
+			if (!(telemetryTolerance > 0.0f))
+			{
+				std::cout << "The telemetry tolerance has to be above 0: " << argv[i] << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--record-input" && hasValue)
+		{
+			recordInputFile = argv[++i];
+		}
+		else if (arg == "--replay" && hasValue)
+		{
+			replayInputFile = argv[++i];
+		}
+		else if (arg == "--video" && hasValue)
+		{
+			videoFile = argv[++i];
+		}
+		else if (arg == "--video-size" && hasValue && sscanf(argv[i + 1], "%dx%d", &videoWidth, &videoHeight) == 2)
+		{
+			i++;
+		}
+		else if (arg == "--video-fps" && hasValue)
+		{
+			videoFps = atof(argv[++i]);
+		}
+		else if (arg == "--video-stream" && hasValue)
+		{
+			videoStreams.push_back(argv[++i]);
+		}
+		else if (arg == "--video-encoder" && hasValue && !parseVideoEncoder(argv[i + 1], videoEncoder))
+		{
+			std::cout << "--video-encoder is software, nvenc or vaapi, not " << argv[i + 1] << "." << std::endl;
+			return false;
+		}
+		else if (arg == "--video-encoder" && hasValue)
+		{
+			i++;
+		}
+		else if (arg == "--sdf")
+		{
+			sdfRendering = true;
+		}
+		else if (arg == "--heatmap")
+		{
+			heatmap = true;
+		}
+		else if (arg == "--heatmap-pressure" && hasValue)
+		{
+			heatmapPressure = (float)atof(argv[++i]);
+		}
+		else if (arg == "--ripples")
+		{
+			ripples = true;
+		}
+		else if (arg == "--power-saving")
+		{
+			powerSaving = true;
+		}
+		else if (arg == "--background" && hasValue)
+		{
+			backgroundFile = argv[++i];
+		}
+		else if (arg == "--view" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "overview")
+			{
+				dashboardKinds.push_back(VIEW_OVERVIEW);
+			}
+			else if (name == "zoom")
+			{
+				dashboardKinds.push_back(VIEW_ZOOM);
+			}
+			else if (name == "plot")
+			{
+				dashboardKinds.push_back(VIEW_PLOT);
+			}
+			else
+			{
+				std::cout << "Unknown view " << name << ", expected overview, zoom or plot" << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--samples" && hasValue)
+		{
+			renderSamples = atoi(argv[++i]);
+		}
+		else if (arg == "--capture-size" && hasValue && sscanf(argv[i + 1], "%dx%d", &captureWidth, &captureHeight) == 2)
+		{
+			i++;
+		}
+		else if (arg == "--fps" && hasValue)
+		{
+			renderHz = atof(argv[++i]);
+		}
+		else if (arg == "--present" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "immediate")
+			{
+				presentMode = PRESENT_IMMEDIATE;
+			}
+			else if (name == "vsync")
+			{
+				presentMode = PRESENT_VSYNC;
+			}
+			else if (name == "adaptive")
+			{
+				presentMode = PRESENT_ADAPTIVE;
+			}
+			else if (name == "low-latency")
+			{
+				presentMode = PRESENT_LOW_LATENCY;
+			}
+			else
+			{
+				std::cout << "Unknown present mode " << name << ", expected immediate, vsync, adaptive or low-latency" << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			std::cout << "Unknown argument: " << arg << std::endl;
+			std::cout << "Usage: HydroDynamics [--headless] [--steps N | --duration SECONDS | --equilibrium] [--sensitivity KIND INDEX|all]... [--calibrate FILE [--fit width|pressure|height|conductance|damping|density INDEX|all]...] [--physics-hz HZ] [--time-scale S] [--density D] [--gravity G] [--layer VESSEL DENSITY HEIGHT]... [--grid RESOLUTION [--grid-pressure multigrid|jacobi] [--grid-advection semi-lagrangian|flip [--flip-ratio R]] [--grid-tubes cells|reduced]] [--particles COUNT [--gpu] [--fluid-surface] [--particle-order morton|rows]] [--gpu-network] [--shallow-water CELLS] [--pressure-benchmark] [--scaling-benchmark [--scaling-threads N]] [--accuracy-benchmark [--accuracy-tolerance METERS]] [--benchmark [--benchmark-baselines FILE [--benchmark-store] [--benchmark-commit ID] [--benchmark-machine NAME] [--benchmark-threshold PERCENT]]] [--sweep FILE [--sweep-layout network|batched] [--sweep-stats FILE [--sweep-stats-interval SECONDS]] [--sweep-view | --sweep-serve PORT [--sweep-chunk N]]] [--sweep-worker HOST:PORT | --background-worker HOST:PORT [--sweep-layout network|batched]] [--ranks N] [--generic] [--implicit [--preconditioner jacobi|ic|direct|amg] | --adaptive [--adaptive-tolerance METERS] | --symplectic] [--multirate] [--tube-damping D] [--precision single|mixed|double|fixed] [--colored-scatter] [--drain-limit even|outflow] [--pressure P] [--config FILE] [--gamepad [--gamepad-axis N] [--gamepad-pressure P]] [--piston-mass M] [--piston-force FILE] [--pressure-schedule FILE] [--scenarios FILE [--scenario NAME]] [--component NAME VESSEL [SETTING]...]... [--sensors FILE [--sensor-output FILE]] [--output FILE] [--result-cache FILE] [--autotune [--autotune-cache FILE]] [--trace FILE] [--hitch-capture PREFIX [--hitch-factor F]] [--gl-debug] [--log FILE] [--log-level debug|info|warning|error] [--flight-recorder FILE [--flight-seconds S]] [--flight-dump FILE] [--counters] [--numa] [--huge-pages] [--affinity ROLE=CORES] [--priority ROLE=low|normal|high] [--checkpoint FILE [--checkpoint-interval SECONDS]] [--restore FILE] [--scene FILE] [--compile-scene TEXT BINARY [--scene-tiles SIZE]] [--generate-scene grid|tree|geometric|manifold VESSELS BINARY [--generate-seed N] [--generate-degree D] [--generate-widths uniform|lognormal] [--generate-width W] [--generate-width-spread S] [--scene-tiles SIZE]] [--scene-order file|cuthill-mckee|hilbert] [--telemetry FILE [--telemetry-tolerance METERS]] [--play-telemetry FILE [--playback-speed STEPS]] [--live-export NAME] [--stream-port PORT [--stream-hz HZ] [--stream-tolerance METERS]] [--stream-view HOST:PORT] [--control-port PORT [--speculate STEPS]] [--ingest-port PORT | --ingest-shm NAME] [--assimilate MEMBERS [--assimilate-noise METERS] [--assimilate-spread METERS]] [--floats COUNT [--float-size METERS] [--float-density RATIO]] [--metrics-port PORT] [--lockstep-host PORT | --lockstep-join HOST:PORT] [--record-input FILE | --replay FILE] [--rewind-memory MB] [--video FILE | --video-stream URL...] [--video-size WxH] [--video-fps FPS] [--video-encoder software|nvenc|vaapi] [--sdf] [--heatmap [--heatmap-pressure P]] [--ripples] [--background IMAGE] [--spray] [--view overview|zoom|plot]... [--samples N] [--capture-size WxH] [--fps HZ] [--power-saving] [--present immediate|vsync|adaptive|low-latency]" << std::endl;
+			return false;
+		}
+	}
+
+	if (!configFile.empty() && !loadConfig())
+	{
+		return false;
+	}
+	if (density <= 0.0f || gravity <= 0.0f)
+	{
+		std::cout << "Density and gravity have to be positive." << std::endl;
+		return false;
+	}
+	for (const LayerSetting& setting : layerSettings)
+	{
+		if (setting.density <= 0.0f || setting.height < 0.0f)
+		{
+			std::cout << "A layer needs a positive density and a height of at least 0." << std::endl;
+			return false;
+		}
+	}
+
+	if (gridResolution < 0)
+	{
+		std::cout << "The grid resolution has to be positive." << std::endl;
+		return false;
+	}
+	if (flipRatio < 0.0f || flipRatio > 1.0f)
+	{
+		std::cout << "The FLIP ratio has to be between 0 and 1." << std::endl;
+		return false;
+	}
+	if (gridResolution > 0 && !layerSettings.empty())
+	{
+		std::cout << "The grid holds a single fluid, it can't be combined with --layer." << std::endl;
+		return false;
+	}
+	if (gridResolution > 0 && equilibriumOnly)
+	{
+		std::cout << "--equilibrium skips the motion, which is all the grid simulates." << std::endl;
+		return false;
+	}
+	if (particleTarget < 0)
+	{
+		std::cout << "The number of particles has to be positive." << std::endl;
+		return false;
+	}
+	if (particleTarget > 0 && (gridResolution > 0 || pressureBenchmark))
+	{
+		std::cout << "--particles and --grid are two different ways to simulate the fluid, only one of them can be used." << std::endl;
+		return false;
+	}
+	if (particleTarget > 0 && !layerSettings.empty())
+	{
+		std::cout << "The particles are a single fluid, they can't be combined with --layer." << std::endl;
+		return false;
+	}
+	if (particleTarget > 0 && equilibriumOnly)
+	{
+		std::cout << "--equilibrium skips the motion, which is all the particles simulate." << std::endl;
+		return false;
+	}
+	if (shallowCells < 0)
+	{
+		std::cout << "The number of shallow water cells has to be positive." << std::endl;
+		return false;
+	}
+	if (shallowCells > 0 && (gridResolution > 0 || particleTarget > 0 || pressureBenchmark))
+	{
+		std::cout << "--shallow-water steps the surfaces of the network, it can't be combined with --grid or --particles." << std::endl;
+		return false;
+	}
+	if (shallowCells > 0 && !layerSettings.empty())
+	{
+		std::cout << "The shallow water profiles hold a single fluid, they can't be combined with --layer." << std::endl;
+		return false;
+	}
+	if (shallowCells > 0 && equilibriumOnly)
+	{
+		std::cout << "--equilibrium skips the motion, which is all the shallow water profiles simulate." << std::endl;
+		return false;
+	}
+	if (shallowCells > 0 && precision != PRECISION_SINGLE)
+	{
+		std::cout << "The shallow water profiles keep their depths in float, they can't be combined with --precision." << std::endl;
+		return false;
+	}
+	if ((integrator == INTEGRATOR_ADAPTIVE || integrator == INTEGRATOR_SYMPLECTIC) && precision != PRECISION_SINGLE)
+	{
+		std::cout << "--adaptive and --symplectic integrate in single precision, they can't be combined with --precision." << std::endl;
+		return false;
+	}
+	if (precision == PRECISION_FIXED_POINT && (integrator != INTEGRATOR_LOCAL || !layerSettings.empty()))
+	{
+		std::cout << "--precision fixed steps a single fluid with the local integrator, it can't be combined with --implicit, --adaptive, "
+			"--symplectic or --layer." << std::endl;
+		return false;
+	}
+	if (multirate && (integrator != INTEGRATOR_LOCAL || precision != PRECISION_SINGLE || scatter != SCATTER_GATHER || rankCount > 0 || gpuNetworkStep))
+	{
+		std::cout << "--multirate substeps the local step in single precision, it can't be combined with --implicit, --adaptive, --symplectic, "
+			"--precision, --colored-scatter, --ranks or --gpu-network." << std::endl;
+		return false;
+	}
+	if (drainLimit == DRAIN_OUTFLOW && (integrator != INTEGRATOR_LOCAL || precision != PRECISION_SINGLE || rankCount > 0 || gpuNetworkStep))
+	{
+		std::cout << "--drain-limit outflow only works in the local step in single precision, it can't be combined with --implicit, --adaptive, "
+			"--symplectic, --precision, --ranks or --gpu-network." << std::endl;
+		return false;
+	}
+	if (tubeDamping < 0.0f)
+	{
+		std::cout << "--tube-damping can't be below 0." << std::endl;
+		return false;
+	}
+	if (adaptiveTolerance <= 0.0f)
+	{
+		std::cout << "--adaptive-tolerance has to be greater than 0." << std::endl;
+		return false;
+	}
+	if (gpuParticles && particleTarget == 0)
+	{
+		std::cout << "--gpu steps the particles, it needs --particles." << std::endl;
+		return false;
+	}
+	if (fluidSurfaceEnabled && (particleTarget == 0 || headless))
+	{
+		std::cout << "--fluid-surface draws the particles, it needs --particles and a window." << std::endl;
+		return false;
+	}
+	if (sprayEnabled && (headless || gridResolution > 0 || particleTarget > 0 || sweepView || gpuNetworkStep))
+	{
+		std::cout << "--spray rises from the levels of the vessels, it needs a window and can't be combined with --grid, --particles, --sweep-view or --gpu-network." << std::endl;
+		return false;
+	}
+	if (gpuParticles && headless)
+	{
+		std::cout << "--gpu needs the OpenGL context of the window, it can't be combined with --headless." << std::endl;
+		return false;
+	}
+	if (gpuNetworkStep && (headless || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || !sweepFile.empty() || !playbackFile.empty()
+		|| integrator != INTEGRATOR_LOCAL || precision != PRECISION_SINGLE || !layerSettings.empty() || piston.mass > 0.0f || sdfRendering))
+	{
+		std::cout << "--gpu-network steps the network of the window in single precision with the local integrator, it can't be combined with "
+			"--headless, --grid, --particles, --shallow-water, --sweep, --play-telemetry, --implicit, --adaptive, --symplectic, --precision, --layer, --piston-mass or --sdf."
+			<< std::endl;
+		return false;
+	}
+	if (pressureBenchmark)
+	{
+		if (!layerSettings.empty() || equilibriumOnly)
+		{
+			std::cout << "--pressure-benchmark runs the grid, it can't be combined with --layer or --equilibrium." << std::endl;
+			return false;
+		}
+		if (gridResolution == 0)
+		{
+			gridResolution = PRESSURE_BENCHMARK_RESOLUTION;
+		}
+	}
+
+	if (calibrationFile.empty() != calibrationParameters.empty() || (!calibrationFile.empty() && !sensitivityParameters.empty()))
+	{
+		std::cout << "--calibrate needs at least one --fit parameter, and can't be combined with --sensitivity." << std::endl;
+		return false;
+	}
+	if ((!sensitivityParameters.empty() || !calibrationFile.empty()) && (equilibriumOnly || rankCount > 0 || gridResolution > 0 || particleTarget > 0 || shallowCells > 0
+		|| pressureBenchmark || !layerSettings.empty() || piston.mass > 0.0f || !forceProfileFile.empty() || !videoFile.empty()))
+	{
+		std::cout << "--sensitivity and --calibrate differentiate the plain network with a fixed piston pressure, they can't be combined with --equilibrium, "
+			"--ranks, --grid, --particles, --shallow-water, --pressure-benchmark, --layer, --piston-mass, --piston-force or --video." << std::endl;
+		return false;
+	}
+
+	if (physicsHz <= 0.0)
+	{
+		std::cout << "The physics rate has to be positive." << std::endl;
+		return false;
+	}
+	if (timeScale < 1.0f / TIME_SCALE_MAX || timeScale > TIME_SCALE_MAX)
+	{
+		std::cout << "The time scale has to be between " << 1.0f / TIME_SCALE_MAX << " and " << TIME_SCALE_MAX << "." << std::endl;
+		return false;
+	}
+	if (timeScale != 1.0f && (!lockstepJoin.empty() || !streamViewSource.empty()))
+	{
+		std::cout << "--time-scale can't be used with --lockstep-join or --stream-view, which run at the pace of their source." << std::endl;
+		return false;
+	}
+	if (headlessDuration >= 0.0)
+	{
+		headlessSteps = (long long)(headlessDuration * physicsHz);
+	}
+
+	if (!recordInputFile.empty() && !replayInputFile.empty())
+	{
+		std::cout << "Input can't be recorded and replayed at the same time." << std::endl;
+		return false;
+	}
+	if (!replayInputFile.empty() && !inputLog.read(replayInputFile))
+	{
+		return false;
+	}
+
+	if (!sweepFile.empty() && (gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || pressureBenchmark || !layerSettings.empty()
+		|| equilibriumOnly || !restoreFile.empty() || !videoFile.empty()))
+	{
+		std::cout << "--sweep steps many variants of the plain apparatus, it can't be combined with --grid, --particles, --shallow-water, "
+			"--pressure-benchmark, --layer, --equilibrium, --restore or --video." << std::endl;
+		return false;
+	}
+
+	if (sweepView && (sweepFile.empty() || headless || sweepPort != 0 || piston.mass > 0.0f || !forceProfileFile.empty()))
+	{
+		std::cout << "--sweep-view shows the variants of a --sweep in the window, without a piston. It can't be combined with --headless, "
+			"--sweep-serve, --piston-mass or --piston-force." << std::endl;
+		return false;
+	}
+	if (!sweepStatsFile.empty() && (sweepFile.empty() || sweepView || sweepPort != 0 || sweepStatsInterval <= 0.0))
+	{
+		std::cout << "--sweep-stats needs a --sweep run in this process (not --sweep-view or --sweep-serve) and a positive "
+			"--sweep-stats-interval." << std::endl;
+		return false;
+	}
+	if (sweepPort != 0 && (sweepFile.empty() || sweepPort < 0 || sweepPort > 65535 || sweepChunk <= 0))
+	{
+		std::cout << "--sweep-serve needs --sweep, a port from 1 to 65535 and a positive --sweep-chunk." << std::endl;
+		return false;
+	}
+	if (!sweepCoordinator.empty() && (!sweepFile.empty() || sweepCoordinator.rfind(':') == std::string::npos))
+	{
+		std::cout << "--sweep-worker takes the sweep from the coordinator at HOST:PORT, it can't be combined with --sweep." << std::endl;
+		return false;
+	}
+	if (sweepBackground && (headless || !videoFile.empty() || benchmarkRun || rankCount > 0))
+	{
+		std::cout << "--background-worker works behind the window, it can't be combined with --headless, --sweep-worker, --video, "
+			"--benchmark or --ranks." << std::endl;
+		return false;
+	}
+
+	if (rankCount < 0)
+	{
+		std::cout << "The number of ranks has to be positive." << std::endl;
+		return false;
+	}
+	if (!componentSpecs.empty() && (sweepView || !sweepFile.empty() || gpuNetworkStep || rankCount > 0 || pressureBenchmark || scalingBenchmark
+		|| !sensitivityParameters.empty() || !calibrationFile.empty()))
+	{
+		std::cout << "--component works on the steps of one network on the CPU, it can't be combined with --sweep, --sweep-view, --gpu-network, "
+			"--ranks, the benchmarks, --sensitivity or --calibrate." << std::endl;
+		return false;
+	}
+	if (rankCount > 0 && (!headless || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || !sweepFile.empty() || !sweepCoordinator.empty()
+		|| equilibriumOnly || !videoFile.empty()))
+	{
+		std::cout << "--ranks steps the network of a --headless run, it can't be combined with --grid, --particles, --shallow-water, --sweep, "
+			"--equilibrium or --video." << std::endl;
+		return false;
+	}
+	if (rankCount > 0 && (!telemetryFile.empty() || !checkpointFile.empty() || !recordInputFile.empty() || !replayInputFile.empty()
+		|| piston.mass > 0.0f || !forceProfileFile.empty() || !liveExportName.empty() || streamPort > 0 || controlPort > 0))
+	{
+		std::cout << "The ranks run all steps in one go, so --ranks can't be combined with anything that needs every step: --telemetry, "
+			"--checkpoint, --record-input, --replay, --piston-mass, --piston-force, --live-export, --stream-port or --control-port." << std::endl;
+		return false;
+	}
+	if (!streamViewSource.empty())
+	{
+		if (streamViewSource.rfind(':') == std::string::npos)
+		{
+			std::cout << "--stream-view takes the server as HOST:PORT." << std::endl;
+			return false;
+		}
+		if (headless || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || gpuNetworkStep || !sweepFile.empty() || !playbackFile.empty()
+			|| !replayInputFile.empty() || lockstepPort > 0 || !lockstepJoin.empty())
+		{
+			std::cout << "--stream-view shows the levels of a stream in a window instead of simulating, it can't be combined with --headless, "
+				"--grid, --particles, --shallow-water, --gpu-network, --sweep, --play-telemetry, --replay, --lockstep-host or --lockstep-join." << std::endl;
+			return false;
+		}
+	}
+	if (lockstepPort > 0 || !lockstepJoin.empty())
+	{
+		if (lockstepPort > 0 && !lockstepJoin.empty())
+		{
+			std::cout << "A session either hosts a lockstep session or joins one, not both." << std::endl;
+			return false;
+		}
+		if (!lockstepJoin.empty() && lockstepJoin.rfind(':') == std::string::npos)
+		{
+			std::cout << "--lockstep-join takes the host as HOST:PORT." << std::endl;
+			return false;
+		}
+		if (precision != PRECISION_FIXED_POINT)
+		{
+			std::cout << "Only fixed point steps the same on every machine, a lockstep session needs --precision fixed." << std::endl;
+			return false;
+		}
+		if (headless || gridResolution > 0 || particleTarget > 0 || gpuNetworkStep || !sweepFile.empty() || !playbackFile.empty()
+			|| !replayInputFile.empty() || piston.mass > 0.0f || !forceProfileFile.empty())
+		{
+			std::cout << "A lockstep session shares the input of a window and steps nothing but the network; it can't be combined with "
+				"--headless, --grid, --particles, --gpu-network, --sweep, --play-telemetry, --replay, --piston-mass or --piston-force." << std::endl;
+			return false;
+		}
+	}
+	if (speculateSteps > 0 && (controlPort == 0 || rewindMemory <= 0.0))
+	{
+		std::cout << "--speculate goes back for the late commands of a remote controller, it needs --control-port and a --rewind-memory "
+			"above 0." << std::endl;
+		return false;
+	}
+	if (controlPort > 0 && (!replayInputFile.empty() || !playbackFile.empty()))
+	{
+		std::cout << "A replay or a playback takes no commands, so --control-port can't be combined with --replay or --play-telemetry."
+			<< std::endl;
+		return false;
+	}
+
+	if (!playbackFile.empty() && (headless || rankCount > 0 || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || !sweepFile.empty()
+		|| !sweepCoordinator.empty() || !telemetryFile.empty() || !checkpointFile.empty() || !recordInputFile.empty() || !replayInputFile.empty()
+		|| !videoFile.empty()))
+	{
+		std::cout << "--play-telemetry shows a recorded run in the window, it can't be combined with --headless, --ranks, --grid, --particles, "
+			"--shallow-water, --sweep, --sweep-worker, --telemetry, --checkpoint, --record-input, --replay or --video." << std::endl;
+		return false;
+	}
+
+	if (benchmarkRun && (headless || !videoFile.empty() || !sweepFile.empty() || !sweepCoordinator.empty() || !dashboardKinds.empty()))
+	{
+		std::cout << "--benchmark draws into a hidden window, it can't be combined with --headless, --pressure-benchmark, --video, "
+			"--sweep, --sweep-worker or --view." << std::endl;
+		return false;
+	}
+	if (scalingBenchmark && (pressureBenchmark || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || !layerSettings.empty()
+		|| !sweepFile.empty() || !sweepCoordinator.empty()))
+	{
+		std::cout << "--scaling-benchmark builds networks of its own, it can't be combined with --pressure-benchmark, --grid, --particles, "
+			"--shallow-water, --layer, --sweep or --sweep-worker." << std::endl;
+		return false;
+	}
+	if (accuracyBenchmark && (pressureBenchmark || scalingBenchmark || gridResolution > 0 || particleTarget > 0 || shallowCells > 0
+		|| !layerSettings.empty() || !sweepFile.empty() || !sweepCoordinator.empty()))
+	{
+		std::cout << "--accuracy-benchmark builds the two vessels it compares with, it can't be combined with --pressure-benchmark, "
+			"--scaling-benchmark, --grid, --particles, --shallow-water, --layer, --sweep or --sweep-worker." << std::endl;
+		return false;
+	}
+	if (!generateSceneTo.empty() && (generatorSettings.vessels < 1 || generatorSettings.degree < 0.0f || !(generatorSettings.width > 0.0f)
+		|| generatorSettings.widthSpread < 0.0f || (generatorSettings.widths == WIDTHS_UNIFORM && generatorSettings.widthSpread >= 1.0f)))
+	{
+		std::cout << "--generate-scene needs at least 1 vessel and a width above 0, and --generate-degree and --generate-width-spread can't "
+			"be negative (nor the spread of uniform widths 1 or more)." << std::endl;
+		return false;
+	}
+	if (accuracyTolerance <= 0.0f)
+	{
+		std::cout << "--accuracy-tolerance has to be above 0." << std::endl;
+		return false;
+	}
+	if (!autotuneCacheFile.empty() && !autotuneRun)
+	{
+		std::cout << "--autotune-cache needs --autotune." << std::endl;
+		return false;
+	}
+	if (autotuneRun && (rankCount > 0 || gpuNetworkStep || pressureBenchmark || scalingBenchmark || (!sweepFile.empty() && !sweepView)
+		|| !sweepCoordinator.empty() || !sensitivityParameters.empty() || !calibrationFile.empty()))
+	{
+		std::cout << "--autotune tunes the scene of a plain run, it can't be combined with --ranks, --gpu-network, the benchmarks, --sweep, "
+			"--sweep-worker, --sensitivity or --calibrate." << std::endl;
+		return false;
+	}
+	if (hardwareCounters && (!headless || rankCount > 0 || pressureBenchmark || !sweepFile.empty() || !sweepCoordinator.empty()))
+	{
+		std::cout << "--counters only works with --headless or --scaling-benchmark, without --ranks." << std::endl;
+		return false;
+	}
+	if (scalingThreads <= 0)
+	{
+		scalingThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	if (benchmarkStore && benchmarkBaselineFile.empty())
+	{
+		std::cout << "--benchmark-store needs --benchmark-baselines." << std::endl;
+		return false;
+	}
+	if (benchmarkThreshold < 0.0)
+	{
+		std::cout << "--benchmark-threshold can't be negative." << std::endl;
+		return false;
+	}
+	if (benchmarkMachine.empty())
+	{
+		const char* name = getenv("COMPUTERNAME");
+		if (name == nullptr)
+		{
+			name = getenv("HOSTNAME");
+		}
+		benchmarkMachine = name != nullptr ? name : "unknown";
+	}
+	if (!dashboardKinds.empty() && (headless || !videoFile.empty() || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || sweepView))
+	{
+		std::cout << "--view draws the vessels, tubes and piston in windows of their own, it can't be combined with --headless, --video, "
+			"--grid, --particles, --shallow-water or --sweep-view." << std::endl;
+		return false;
+	}
+	if ((int)dashboardKinds.size() > DASHBOARD_MAX_VIEWS)
+	{
+		std::cout << "There can be at most " << DASHBOARD_MAX_VIEWS << " views." << std::endl;
+		return false;
+	}
+	if (sdfRendering && (headless || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || sweepView))
+	{
+		std::cout << "--sdf draws the vessels, tubes and piston in the window, it can't be combined with --headless, --grid, --particles, "
+			"--shallow-water or --sweep-view." << std::endl;
+		return false;
+	}
+	if (renderSamples < 1 || captureWidth < 0 || captureHeight < 0 || (captureWidth > 0) != (captureHeight > 0))
+	{
+		std::cout << "--samples needs at least 1 sample, and --capture-size a positive width and height." << std::endl;
+		return false;
+	}
+	if (gamepadAxis < 0 || settings().gamepadPressure <= 0.0f)
+	{
+		std::cout << "--gamepad-axis can't be negative, and --gamepad-pressure has to be above 0." << std::endl;
+		return false;
+	}
+	if (renderHz < 0.0 || (presentMode == PRESENT_LOW_LATENCY && renderHz == 0.0))
+	{
+		std::cout << "--fps can't be negative, and --present low-latency needs it above 0 to know when the next frame is due." << std::endl;
+		return false;
+	}
+
+	if (piston.mass < 0.0f)
+	{
+		std::cout << "The mass of the piston can't be negative." << std::endl;
+		return false;
+	}
+	if (piston.mass > 0.0f && (gridResolution > 0 || particleTarget > 0 || pressureBenchmark))
+	{
+		std::cout << "The grid and the particles move the fluid themselves, --piston-mass needs the tubes of the network." << std::endl;
+		return false;
+	}
+	if (!forceProfileFile.empty() && equilibriumOnly)
+	{
+		std::cout << "--equilibrium skips the motion, it can't follow a force over time with --piston-force." << std::endl;
+		return false;
+	}
+	if (!forceProfileFile.empty() && !forceProfile.read(forceProfileFile))
+	{
+		return false;
+	}
+	if (!pressureScheduleFile.empty() && (gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || gpuNetworkStep || rankCount > 0
+		|| !sweepFile.empty() || !sweepCoordinator.empty() || !playbackFile.empty() || !streamViewSource.empty()))
+	{
+		std::cout << "--pressure-schedule sets the pressures of the network before its steps, it can't be combined with --grid, --particles, "
+			"--shallow-water, --gpu-network, --ranks, --sweep, --sweep-worker, --play-telemetry or --stream-view." << std::endl;
+		return false;
+	}
+	if (!pressureScheduleFile.empty() && !pressureSchedule.read(pressureScheduleFile))
+	{
+		return false;
+	}
+	if (!sensorOutputFile.empty() && sensorFile.empty())
+	{
+		std::cout << "--sensor-output writes the samples of the sensors of --sensors FILE." << std::endl;
+		return false;
+	}
+	if (!sensorFile.empty() && (gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || gpuNetworkStep || rankCount > 0
+		|| !sweepFile.empty() || !sweepCoordinator.empty() || !playbackFile.empty() || !streamViewSource.empty()))
+	{
+		std::cout << "--sensors samples the network after its steps, it can't be combined with --grid, --particles, --shallow-water, "
+			"--gpu-network, --ranks, --sweep, --sweep-worker, --play-telemetry or --stream-view." << std::endl;
+		return false;
+	}
+	if (!sensorFile.empty() && !sensors.read(sensorFile))
+	{
+		return false;
+	}
+	if (ingestPort > 0 && !ingestShmName.empty())
+	{
+		std::cout << "A twin follows one plant, so --ingest-port and --ingest-shm can't be combined." << std::endl;
+		return false;
+	}
+	if (assimilateMembers > 0 && ingestPort == 0 && ingestShmName.empty())
+	{
+		std::cout << "--assimilate corrects a twin with the heights the plant measures, it needs --ingest-port or --ingest-shm." << std::endl;
+		return false;
+	}
+	if ((floatSize > 0.0f || floatDensity != FLOAT_DEFAULT_DENSITY_RATIO) && floatCount == 0)
+	{
+		std::cout << "--float-size and --float-density are of the floats of --floats COUNT." << std::endl;
+		return false;
+	}
+	if (floatCount > 0 && (gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || gpuNetworkStep || rankCount > 0
+		|| !sweepFile.empty() || !sweepCoordinator.empty() || !playbackFile.empty() || !streamViewSource.empty()))
+	{
+		std::cout << "The floats ride on the levels of the vessels, so --floats can't be combined with --grid, --particles, --shallow-water, "
+			"--gpu-network, --ranks, --sweep, --sweep-worker, --play-telemetry or --stream-view." << std::endl;
+		return false;
+	}
+	if (assimilateMembers > 0 && !recordInputFile.empty())
+	{
+		std::cout << "The corrections of the ensemble filter aren't commands, so --assimilate can't be combined with --record-input." << std::endl;
+		return false;
+	}
+	if ((ingestPort > 0 || !ingestShmName.empty()) && (headless || gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || gpuNetworkStep
+		|| !sweepFile.empty() || !sweepCoordinator.empty() || !playbackFile.empty() || !streamViewSource.empty() || !replayInputFile.empty()
+		|| lockstepPort > 0 || !lockstepJoin.empty() || !scenarioFile.empty()))
+	{
+		std::cout << "A twin keeps up with the plant in real time and sets the levels of the network, so --ingest-port and --ingest-shm can't "
+			"be combined with --headless, --grid, --particles, --shallow-water, --gpu-network, --sweep, --sweep-worker, --play-telemetry, "
+			"--stream-view, --replay, --lockstep-host, --lockstep-join or --scenarios." << std::endl;
+		return false;
+	}
+	if (!scenarioFile.empty() && (gridResolution > 0 || particleTarget > 0 || shallowCells > 0 || gpuNetworkStep || equilibriumOnly || rankCount > 0
+		|| !sweepFile.empty() || !sweepCoordinator.empty() || !forceProfileFile.empty() || !playbackFile.empty() || !replayInputFile.empty()
+		|| !lockstepJoin.empty() || !streamViewSource.empty() || !videoFile.empty() || benchmarkRun))
+	{
+		std::cout << "--scenarios drives the network with scripts, it can't be combined with --grid, --particles, --shallow-water, --gpu-network, "
+			"--equilibrium, --ranks, --sweep, --sweep-worker, --piston-force, --play-telemetry, --replay, --lockstep-join, --stream-view, "
+			"--video or --benchmark." << std::endl;
+		return false;
+	}
+	if (!scenarioFile.empty() && headless && piston.mass > 0.0f)
+	{
+		std::cout << "The scenarios of a headless run push on copies of the scene directly, without the mass of --piston-mass." << std::endl;
+		return false;
+	}
+	if (!scenarioName.empty() && (scenarioFile.empty() || headless))
+	{
+		std::cout << "--scenario picks the scenario of --scenarios the window plays." << std::endl;
+		return false;
+	}
+	if (!scenarioFile.empty())
+	{
+		if (!scenarios.read(scenarioFile))
+		{
+			return false;
+		}
+		playedScenario = scenarioName.empty() ? 0 : scenarios.find(scenarioName);
+		if (playedScenario < 0 || scenarios.scenarioCount() == 0)
+		{
+			std::cout << scenarioFile << " has no scenario " << (scenarioName.empty() ? "at all" : scenarioName) << "." << std::endl;
+			return false;
+		}
+	}
+
+	if ((!videoFile.empty() || !videoStreams.empty()) && (videoWidth <= 0 || videoHeight <= 0 || videoFps <= 0.0))
+	{
+		std::cout << "The video needs a positive size and frame rate." << std::endl;
+		return false;
+	}
+	if (!videoStreams.empty() && (headless || !videoFile.empty() || benchmarkRun))
+	{
+		std::cout << "--video-stream sends what the window shows, it can't be combined with --headless, --video or --benchmark." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Writes the state of every vessel as comma separated values: one line per vessel.
+void writeResults(std::ostream& out, long long steps)
+{
+	if (equilibriumOnly)
+	{
+		out << "# equilibrium, externalPressure " << externalPressure << ", volume " << network.totalVolume() << std::endl;
+	}
+	else
+	{
+		out << "# steps " << steps << ", externalPressure " << externalPressure << ", volume " << network.totalVolume() << std::endl;
+	}
+	out << "vessel,height,pressure" << std::endl;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		out << i << "," << network.height[i] << "," << network.pressure[i] + network.externalPressure[i] << std::endl;
+	}
+}
+
+// How the sorts of the particles went, and what the passes over their neighbours missed in the caches per substep, which is what
+// the order of the particles is for.
+void reportParticleSort(std::ostream& out, const HardwareCounters& counters)
+{
+	const ParticleSorter& sorter = particles.sorter;
+	long long sorts = std::max(sorter.skipped + sorter.incremental + sorter.full, 1LL);
+	out << "Particle sort (" << (particles.sortOrder == PARTICLE_ORDER_MORTON ? "morton" : "rows") << "): " << sorter.full << " full, "
+		<< sorter.incremental << " incremental, " << sorter.skipped << " skipped, " << (double)sorter.movedParticles / sorts
+		<< " particles changed cells and " << particles.sortMilliseconds / sorts << " ms per sort" << std::endl;
+	if (particles.countedSubsteps == 0)
+	{
+		return;
+	}
+	out << "Neighbour passes:";
+	const char* separator = " ";
+	for (int c = COUNTER_L1_MISSES; c <= COUNTER_LLC_MISSES; c++)
+	{
+		if (counters.available((HardwareCounter)c))
+		{
+			out << separator << (double)particles.neighborCounts.value[c] / particles.countedSubsteps << " " << counterName((HardwareCounter)c);
+			separator = ", ";
+		}
+	}
+	out << " per substep" << std::endl;
+}
+
+// Compares the pressure solvers of the grid on the apparatus: for every method, how long a solve takes, how many iterations
+// (or sweeps) it needs, and how close it gets to the tolerance. Multigrid runs with the smoothing sweeps as a wavefront and as whole
+// sweeps, with how long the smoothing takes and what it brought in from memory. That is measured with the last level cache
+// counter: the steps run once more on this thread alone, which the counter sees all of, and every miss of the smoothing is a cache
+// line from memory. The traffic the solver estimates (see lastSmoothEstimatedBytes) is shown next to it, and is all there is on a
+// machine without the counter. Either way the saving of the wavefront is only visible on a grid that doesn't fit into the cache.
+int runPressureBenchmark()
+{
+	taskPool = new TaskPool();
+	setup();
+	if (gridResolution == 0)
+	{
+		delete taskPool;
+		return 1;
+	}
+
+	// Without the piston the apparatus is at rest, and a solve has nothing to do.
+	if (externalPressure == 0.0f)
+	{
+		externalPressure = 1.0f;
+	}
+	for (int i = 0; i < PRESSURE_BENCHMARK_WARMUP; i++)
+	{
+		update();
+	}
+
+	HardwareCounters counters;
+	bool counted = counters.open() && counters.available(COUNTER_LLC_MISSES);
+
+	std::cout << "Grid " << grid.columns << " x " << grid.rows << ", " << PRESSURE_BENCHMARK_STEPS << " steps per method" << std::endl;
+	const PressureMethod methods[] = { PRESSURE_MULTIGRID, PRESSURE_MULTIGRID, PRESSURE_JACOBI };
+	const bool blocking[] = { true, false, false };
+	const char* names[] = { "multigrid", "multigrid, whole sweeps", "jacobi" };
+	double measuredBytes[2] = {};
+	double estimatedBytes[2] = {};
+	float dt = (float)(1.0 / physicsHz);
+	for (int m = 0; m < 3; m++)
+	{
+		auto prepare = [&](GridFluid& copy)
+		{
+			copy = grid;
+			copy.solver.method = methods[m];
+			copy.solver.temporalBlocking = blocking[m];
+			if (methods[m] == PRESSURE_JACOBI)
+			{
+				copy.solver.maxIterations = PRESSURE_BENCHMARK_JACOBI_SWEEPS;
+			}
+		};
+		GridFluid copy;
+		prepare(copy);
+		VesselNetwork state = network;
+
+		double milliseconds = 0.0;
+		double smoothMilliseconds = 0.0;
+		long long iterations = 0;
+		for (int i = 0; i < PRESSURE_BENCHMARK_STEPS; i++)
+		{
+			copy.update(state, density, gravity, dt, taskPool);
+			milliseconds += copy.solver.lastMilliseconds;
+			smoothMilliseconds += copy.solver.lastSmoothMilliseconds;
+			iterations += copy.solver.lastIterations;
+			if (m < 2)
+			{
+				estimatedBytes[m] += copy.solver.lastSmoothEstimatedBytes / PRESSURE_BENCHMARK_STEPS;
+			}
+		}
+		std::cout << names[m] << ": " << milliseconds / PRESSURE_BENCHMARK_STEPS << " ms per solve, "
+			<< (double)iterations / PRESSURE_BENCHMARK_STEPS << " iterations, last residual " << copy.solver.lastResidual << std::endl;
+		if (methods[m] != PRESSURE_MULTIGRID)
+		{
+			continue;
+		}
+		std::cout << "    smoothing " << smoothMilliseconds / PRESSURE_BENCHMARK_STEPS << " ms per solve" << std::endl;
+
+		if (counted)
+		{
+			prepare(copy);
+			state = network;
+			copy.solver.counters = &counters;
+			double countedMilliseconds = 0.0;
+			for (int i = 0; i < PRESSURE_BENCHMARK_STEPS; i++)
+			{
+				copy.update(state, density, gravity, dt);
+				measuredBytes[m] += (double)copy.solver.lastSmoothCounters.value[COUNTER_LLC_MISSES] * BENCHMARK_CACHE_LINE / PRESSURE_BENCHMARK_STEPS;
+				countedMilliseconds += copy.solver.lastSmoothMilliseconds;
+			}
+			std::cout << "    measured: " << measuredBytes[m] / 1e6 << " MB from memory per solve, "
+				<< (countedMilliseconds > 0.0 ? measuredBytes[m] * PRESSURE_BENCHMARK_STEPS / countedMilliseconds * 1e-6 : 0.0)
+				<< " GB/s, from the last level cache misses of the smoothing on one thread" << std::endl;
+		}
+		std::cout << "    estimated: " << estimatedBytes[m] / 1e6 << " MB per solve if nothing stayed in the cache between passes"
+			<< " (a model, not measured)" << std::endl;
+	}
+	if (counted)
+	{
+		std::cout << "The wavefront saved " << (measuredBytes[1] - measuredBytes[0]) / 1e6 << " MB per solve, measured (estimated "
+			<< (estimatedBytes[1] - estimatedBytes[0]) / 1e6 << " MB)." << std::endl;
+	}
+	else
+	{
+		std::cout << "This machine has no last level cache counter, so the traffic wasn't measured. Going by the estimate alone, the "
+			"wavefront would save " << (estimatedBytes[1] - estimatedBytes[0]) / 1e6 << " MB per solve." << std::endl;
+	}
+
+	delete taskPool;
+	return 0;
+}
+
+// Times update() on networks of every size with every number of threads, and breaks each step down into its phases (see
+// UpdateTimes), with the memory bandwidth each phase reached and how long the threads waited for each other.
+int runScalingBenchmark()
+{
+	std::ofstream file;
+	std::ostream* csv = nullptr;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+		csv = &file;
+		file << "scaling,vessels,threads,ns_per_step,speedup,efficiency,pressure_ns,flow_ns,reduction_ns,apply_ns,sync_ns,"
+			"pressure_gb_per_s,flow_gb_per_s,apply_gb_per_s" << std::endl;
+	}
+
+	// With --counters, they count the thread that calls update(), which is all of the work only with one thread.
+	HardwareCounters counters;
+	if (hardwareCounters && !counters.open())
+	{
+		std::cout << "This machine has no hardware counters, leaving them out." << std::endl;
+	}
+
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < scalingThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(scalingThreads);
+
+	float dt = (float)(1.0 / physicsHz);
+	for (int weak = 0; weak < 2; weak++)
+	{
+		std::cout << (weak ? "Weak scaling, " : "Strong scaling, ") << (weak ? SCALING_WEAK_VESSELS : SCALING_STRONG_VESSELS)
+			<< (weak ? " vessels per thread" : " vessels") << std::endl;
+		double single = 0.0;
+		for (int threads : threadCounts)
+		{
+			int vessels = weak ? SCALING_WEAK_VESSELS * threads : SCALING_STRONG_VESSELS;
+			VesselNetwork scaled;
+			buildBenchmarkNetwork(scaled, vessels, density, gravity);
+			scaled.integrator = integrator;
+			scaled.solver.preconditioner = preconditioner;
+			scaled.adaptive.tolerance = adaptiveTolerance;
+			scaled.precision = precision;
+			scaled.scatter = scatter;
+			scaled.multirate = multirate;
+			scaled.drainLimit = drainLimit;
+
+			// One thread runs without a pool at all, which is what the step costs without any scheduling.
+			TaskPool* pool = threads > 1 ? new TaskPool(threads - 1) : nullptr;
+			BenchmarkResult result = benchmarkUpdate(scaled, SCALING_STEPS, SCALING_REPETITIONS, density, gravity, dt, pool);
+			UpdateTimes phases = timeUpdatePhases(scaled, SCALING_STEPS, density, gravity, dt, pool, hardwareCounters ? &counters : nullptr);
+			delete pool;
+
+			if (threads == 1)
+			{
+				single = result.median;
+			}
+			double speedup = single / result.median * (weak ? threads : 1);
+			double efficiency = speedup / threads;
+			double steps = (double)std::max(phases.steps, 1LL);
+			double sync = std::max(0.0, phases.parallel * threads - phases.busy) / threads;
+			UpdateTraffic traffic = estimateUpdateTraffic(scaled);
+			auto perStep = [&](double seconds) { return seconds / steps * 1e9; };
+			auto bandwidth = [&](double bytes, double seconds) { return seconds > 0.0 ? bytes * steps / seconds * 1e-9 : 0.0; };
+
+			std::cout << "  " << threads << (threads == 1 ? " thread: " : " threads: ") << result.median / 1e6 << " ms per step (spread "
+				<< result.spread * 100.0 << "%), speedup " << speedup << ", efficiency " << efficiency * 100.0 << "%" << std::endl;
+			std::cout << "    pressure " << perStep(phases.pressure) / 1e6 << " ms (" << bandwidth(traffic.pressure, phases.pressure)
+				<< " GB/s), flow " << perStep(phases.flow) / 1e6 << " ms (" << bandwidth(traffic.flow, phases.flow) << " GB/s), reduction "
+				<< perStep(phases.reduction) / 1e6 << " ms, apply " << perStep(phases.apply) / 1e6 << " ms ("
+				<< bandwidth(traffic.apply, phases.apply) << " GB/s), sync " << perStep(sync) / 1e6 << " ms" << std::endl;
+			if (counters.valid())
+			{
+				reportUpdatePhases(std::cout, phases);
+			}
+			if (csv != nullptr)
+			{
+				*csv << (weak ? "weak" : "strong") << "," << vessels << "," << threads << "," << result.median << "," << speedup << ","
+					<< efficiency << "," << perStep(phases.pressure) << "," << perStep(phases.flow) << "," << perStep(phases.reduction) << ","
+					<< perStep(phases.apply) << "," << perStep(sync) << "," << bandwidth(traffic.pressure, phases.pressure) << ","
+					<< bandwidth(traffic.flow, phases.flow) << "," << bandwidth(traffic.apply, phases.apply) << std::endl;
+			}
+		}
+	}
+	return 0;
+}
+
+// Steps the two vessels with every integrator at every rate of ACCURACY_RATES, and writes how far each strayed from the exact
+// solution and what a step and a simulated second cost. The cheapest within --accuracy-tolerance is the one to use on this
+// apparatus; a stiffer network can rank them differently, so it needs a run of its own (see --sweep).
+int runAccuracyBenchmark()
+{
+	std::ofstream file;
+	std::ostream* csv = nullptr;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+		csv = &file;
+		file << "integrator,hz,steps,max_error,final_error,ns_per_step,spread,ms_per_second" << std::endl;
+	}
+
+	// The vessels of the classic apparatus, with the big one low and the small one high.
+	float mean = 0.5f;
+	TwoVesselSolution exact;
+	exact.widthA = 0.5;
+	exact.widthB = 0.25;
+	exact.heightA = mean - ACCURACY_START_DIFFERENCE * exact.widthB / (exact.widthA + exact.widthB);
+	exact.heightB = mean + ACCURACY_START_DIFFERENCE * exact.widthA / (exact.widthA + exact.widthB);
+	exact.inertance = DEFAULT_TUBE_INERTANCE;
+	exact.damping = tubeDamping;
+	exact.scale = (double)density * gravity;
+
+	struct AccuracyVariant
+	{
+		const char* name;
+		Integrator integrator;
+		Precision precision;
+	};
+	const AccuracyVariant variants[] = {
+		{ "local", INTEGRATOR_LOCAL, PRECISION_SINGLE },
+		{ "local, double", INTEGRATOR_LOCAL, PRECISION_DOUBLE },
+		{ "implicit", INTEGRATOR_IMPLICIT, PRECISION_SINGLE },
+		{ "adaptive", INTEGRATOR_ADAPTIVE, PRECISION_SINGLE },
+		{ "symplectic", INTEGRATOR_SYMPLECTIC, PRECISION_SINGLE }
+	};
+
+	std::cout << "Two vessels, " << ACCURACY_START_DIFFERENCE << " m apart, for " << ACCURACY_SECONDS << " s, tolerance " << accuracyTolerance
+		<< " m" << std::endl;
+	const char* cheapestName = nullptr;
+	int cheapestHz = 0;
+	double cheapestCost = 0.0;
+	for (const AccuracyVariant& variant : variants)
+	{
+		VesselNetwork pair;
+		pair.addVessel(-0.75f, -0.5f, (float)exact.widthA, (float)exact.heightA);
+		pair.addVessel(0.5f, -0.5f, (float)exact.widthB, (float)exact.heightB);
+		pair.addTube(0, 1, DEFAULT_TUBE_INERTANCE, tubeDamping);
+		pair.integrator = variant.integrator;
+		pair.precision = variant.precision;
+		pair.solver.preconditioner = preconditioner;
+		pair.adaptive.tolerance = adaptiveTolerance;
+		pair.computePressures(density, gravity);
+
+		std::cout << variant.name << std::endl;
+		for (int hz : ACCURACY_RATES)
+		{
+			float dt = 1.0f / hz;
+			AccuracyResult result = measureAccuracy(pair, exact, ACCURACY_SECONDS, density, gravity, dt, ACCURACY_REPETITIONS);
+
+			// What a second of simulated time costs, which is what compares a cheap small step with an expensive big one.
+			double cost = result.time.median * result.steps / ACCURACY_SECONDS / 1e6;
+			bool within = result.maxError <= accuracyTolerance;
+			if (within && (cheapestName == nullptr || cost < cheapestCost))
+			{
+				cheapestName = variant.name;
+				cheapestHz = hz;
+				cheapestCost = cost;
+			}
+			std::cout << "  " << hz << " Hz: error up to " << result.maxError << " m, " << result.finalError << " m at the end, "
+				<< result.time.median << " ns per step (spread " << result.time.spread * 100.0 << "%), " << cost << " ms per second"
+				<< (within ? "" : " (over the tolerance)") << std::endl;
+			if (csv != nullptr)
+			{
+				*csv << "\"" << variant.name << "\"," << hz << "," << result.steps << "," << result.maxError << "," << result.finalError << ","
+					<< result.time.median << "," << result.time.spread << "," << cost << std::endl;
+			}
+		}
+	}
+
+	if (cheapestName == nullptr)
+	{
+		std::cout << "No integrator stays within " << accuracyTolerance << " m at these rates." << std::endl;
+	}
+	else
+	{
+		std::cout << "Cheapest within " << accuracyTolerance << " m: " << cheapestName << " at " << cheapestHz << " Hz, " << cheapestCost
+			<< " ms per simulated second" << std::endl;
+	}
+	return 0;
+}
+
+// The settings from the command line, for every variant of a sweep.
+SweepSettings sweepSettings()
+{
+	SweepSettings settings;
+	settings.density = density;
+	settings.gravity = gravity;
+	settings.dt = (float)(1.0 / physicsHz);
+	settings.maxSteps = headlessSteps;
+	settings.integrator = integrator;
+	settings.preconditioner = preconditioner;
+	settings.precision = precision;
+	settings.layout = sweepLayout;
+	return settings;
+}
+
+// Steps every variant of the sweep for up to headlessSteps physics steps (fewer if all of them come to rest before), and writes
+// one line of results per variant. With --sweep-serve, workers do the stepping.
+int runSweep()
+{
+	SweepSettings settings = sweepSettings();
+	std::ofstream file;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = outputFile.empty() ? std::cout : file;
+
+	if (sweepPort != 0)
+	{
+		std::ifstream spec(sweepFile, std::ios::in);
+		if (!spec.good())
+		{
+			std::cout << "Can't read file: " << sweepFile << std::endl;
+			return 1;
+		}
+		std::stringstream text;
+		text << spec.rdbuf();
+		return serveSweep(text.str(), sweepFile, settings, sweepPort, sweepChunk, out) && out.good() ? 0 : 1;
+	}
+
+	Sweep sweep;
+	if (!sweep.read(sweepFile))
+	{
+		return 1;
+	}
+
+	ResultCache cache;
+	if (!resultCacheFile.empty() && !cache.load(resultCacheFile))
+	{
+		return 1;
+	}
+
+	EnsembleStats ensemble;
+	if (!sweepStatsFile.empty() && !ensemble.open(sweepStatsFile, Sweep::ensembleQuantities()))
+	{
+		return 1;
+	}
+	ensemble.every = std::max(1LL, (long long)(sweepStatsInterval * physicsHz + 0.5));
+
+	taskPool = new TaskPool();
+	sweep.build(network, settings, 0, sweep.variantCount(), &cache);
+	std::cout << "Sweeping " << sweep.variantCount() << " variants for up to " << headlessSteps << " steps";
+	if (sweep.cachedCount() > 0)
+	{
+		std::cout << ", " << sweep.cachedCount() << " of them cached or repeated";
+	}
+	std::cout << std::endl;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	long long steps;
+	{
+		PROFILE_SCOPE(PROFILE_UPDATE);
+		steps = sweep.run(network, settings, taskPool, ensemble.isOpen() ? &ensemble : nullptr);
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << steps << " steps in " << elapsed.count() << " ms" << std::endl;
+
+	sweep.writeHeader(out);
+	sweep.writeResults(out, network, settings);
+	int result = out.good() ? 0 : 1;
+	if (!resultCacheFile.empty() && !cache.save(resultCacheFile))
+	{
+		result = 1;
+	}
+	if (ensemble.isOpen() && !ensemble.close())
+	{
+		result = 1;
+	}
+	if (!traceFile.empty() && !traceWrite(traceFile))
+	{
+		result = 1;
+	}
+
+	delete taskPool;
+	return result;
+}
+
+// Runs every scenario of scenarioFile on its own copy of the scene, and writes how they ended to outputFile (or the console).
+int runScenarios()
+{
+	std::ofstream file;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = outputFile.empty() ? std::cout : file;
+
+	applyThreadRole(THREAD_ROLE_SIMULATION);
+	taskPool = new TaskPool();
+	setup();
+	VesselNetwork copies;
+	if (!scenarios.build(network, pistonVessel, copies))
+	{
+		delete taskPool;
+		return 1;
+	}
+	std::cout << "Running " << scenarios.scenarioCount() << " scenarios" << std::endl;
+
+	float dt = (float)(1.0 / physicsHz);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	long long steps;
+	{
+		PROFILE_SCOPE(PROFILE_UPDATE);
+		steps = scenarios.run(copies, density, gravity, dt, taskPool);
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << steps << " steps in " << elapsed.count() << " ms, " << scenarios.passedCount() << " of " << scenarios.scenarioCount()
+		<< " scenarios passed" << std::endl;
+
+	scenarios.writeResults(out, dt);
+	delete taskPool;
+	return out.good() && scenarios.passedCount() == scenarios.scenarioCount() ? 0 : 1;
+}
+
+// Works for the sweep coordinator at sweepCoordinator until the sweep is done.
+int runWorker()
+{
+	size_t colon = sweepCoordinator.rfind(':');
+	taskPool = new TaskPool();
+	bool succeeded = runSweepWorker(sweepCoordinator.substr(0, colon), atoi(sweepCoordinator.c_str() + colon + 1), taskPool, sweepLayout);
+	delete taskPool;
+	return succeeded ? 0 : 1;
+}
+
+// Starts working for the coordinator behind the window, with --background-worker. The setup has to be done by then, since the
+// autotuner may replace taskPool.
+void startBackgroundWorker()
+{
+	if (!sweepBackground)
+	{
+		return;
+	}
+	sweepWorkerStop.store(false);
+	sweepWorkerThread = std::thread([]
+	{
+		applyThreadRole(THREAD_ROLE_BATCH);
+		TaskPool::setCallerPriority(TASK_PRIORITY_BATCH);
+		size_t colon = sweepCoordinator.rfind(':');
+		runSweepWorker(sweepCoordinator.substr(0, colon), atoi(sweepCoordinator.c_str() + colon + 1), taskPool, sweepLayout, &sweepWorkerStop);
+	});
+}
+
+// Leaves the sweep after the chunk the background worker is on, and waits for it.
+void stopBackgroundWorker()
+{
+	if (sweepWorkerThread.joinable())
+	{
+		sweepWorkerStop.store(true);
+		sweepWorkerThread.join();
+	}
+}
+
+// The key of the headless run about to start in resultCache. Returns false if its results can't be cached: the network isn't plain,
+// or the run has state or outputs besides the levels and flows.
+bool headlessResultKey(uint64_t& key)
+{
+	if (!plainForCache(network) || piston.mass > 0.0f || !forceProfileFile.empty() || !telemetryFile.empty() || !checkpointFile.empty()
+		|| !liveExportName.empty() || streamPort != 0 || !replayInputFile.empty() || hardwareCounters || !components.empty())
+	{
+		std::cout << "Only runs of a plain network without a moving piston, --telemetry, --checkpoint, --live-export, --stream-port, --replay, "
+			"--counters or --component are cached, running this one." << std::endl;
+		return false;
+	}
+	ResultKey result;
+	result.addNetwork(network);
+	result.add(density);
+	result.add(gravity);
+	result.add(physicsHz);
+	result.add(headlessSteps);
+	result.add(equilibriumOnly);
+	result.add(externalPressure);
+	result.add(pistonVessel);
+	result.add(rankCount);
+	key = result.value();
+	return true;
+}
+
+// Runs the simulation for headlessSteps physics steps without creating a window or touching OpenGL.
+// Without rendering there is nothing to wait for, so the steps run back to back as fast as the CPU allows.
+int runHeadless()
+{
+	applyThreadRole(THREAD_ROLE_SIMULATION);
+	taskPool = new TaskPool();
+	setup();
+	autotune();
+	placeNetworkMemory();
+
+	// Without a view there is nothing to stream towards, so a streamed scene stays at the tiles it started with.
+	sceneStreamer.close();
+
+	// A run that is in the result cache takes its levels and flows from there: the heights of every vessel, then the flows of every tube.
+	ResultCache resultCache;
+	uint64_t resultKey = 0;
+	bool cacheResult = !resultCacheFile.empty() && resultCache.load(resultCacheFile) && headlessResultKey(resultKey);
+	std::vector<double> cached;
+	bool fromCache = cacheResult && resultCache.find(resultKey, cached) && cached.size() == (size_t)(network.vesselCount() + network.tubeCount());
+	if (fromCache)
+	{
+		std::cout << "Found the results of this run in " << resultCacheFile << std::endl;
+		for (int i = 0; i < network.vesselCount(); i++)
+		{
+			network.height[i] = (float)cached[i];
+			network.top[i] = network.bottom[i] + network.height[i];
+		}
+		for (int t = 0; t < network.tubeCount(); t++)
+		{
+			network.tubeFlow[t] = (float)cached[network.vesselCount() + t];
+		}
+		piston.force = externalPressure * network.width[pistonVessel];
+		piston.couple(network, density, gravity, (float)(1.0 / physicsHz));
+		network.computePressures(density, gravity);
+		network.wakeAll();
+		headlessSteps = equilibriumOnly ? 0 : headlessSteps;
+		simulationStep += headlessSteps;
+	}
+	else if (equilibriumOnly)
+	{
+		// The piston pressure is normally applied by update(). At rest it is only the push and the weight of the piston.
+		piston.force = externalPressure * network.width[pistonVessel];
+		network.setExternalPressure(pistonVessel, piston.restingPressure(network, gravity));
+		if (network.settle(density, gravity))
+		{
+			headlessSteps = 0;
+		}
+		else
+		{
+			std::cout << "The equilibrium of a layered or profiled network can't be solved directly, simulating " << headlessSteps << " steps instead." << std::endl;
+			equilibriumOnly = false;
+		}
+	}
+
+	if (fromCache)
+	{
+		// The levels and flows are already there.
+	}
+	else if (rankCount > 0 && headlessSteps > 0)
+	{
+		// The piston doesn't change while the ranks run, so its pressure is set once, as update() would.
+		piston.force = externalPressure * network.width[pistonVessel];
+		piston.couple(network, density, gravity, (float)(1.0 / physicsHz));
+		PartitionedNetwork ranks;
+		if (!ranks.build(network, rankCount))
+		{
+			delete taskPool;
+			return 1;
+		}
+		std::cout << "Stepping " << ranks.rankCount() << " ranks, " << ranks.cutTubes << " of " << network.tubeCount() << " tubes cut" << std::endl;
+		{
+			PROFILE_SCOPE(PROFILE_UPDATE);
+			ranks.run(density, gravity, (float)(1.0 / physicsHz), headlessSteps);
+		}
+		ranks.gather(network);
+		simulationStep += headlessSteps;
+	}
+	else
+	{
+		// The counters count this thread, so the pool only gets the network if they are off.
+		UpdateTimes phases;
+		HardwareCounters counters;
+		if (hardwareCounters)
+		{
+			if (!counters.open())
+			{
+				std::cout << "This machine has no hardware counters, only timing the phases." << std::endl;
+			}
+			phases.counters = &counters;
+			network.timing = &phases;
+			particles.counters = counters.valid() ? &counters : nullptr;
+			delete taskPool;
+			taskPool = nullptr;
+		}
+		// The piston only pushes from the first step on, so the energy is compared from there.
+		double startEnergy = 0.0;
+		for (long long i = 0; i < headlessSteps; i++)
+		{
+			PROFILE_SCOPE(PROFILE_UPDATE);
+			update();
+			if (i == 0)
+			{
+				startEnergy = network.energy(density, gravity);
+			}
+		}
+		network.timing = nullptr;
+		particles.counters = nullptr;
+		if (hardwareCounters && particleTarget > 0 && !gpuParticles)
+		{
+			reportParticleSort(std::cout, counters);
+		}
+		else if (hardwareCounters)
+		{
+			std::cout << "Phases of update(), over " << phases.steps << " steps:" << std::endl;
+			reportUpdatePhases(std::cout, phases);
+		}
+		const AdaptiveStepping& adaptive = network.adaptive;
+		if (integrator == INTEGRATOR_ADAPTIVE && adaptive.steps > 0)
+		{
+			std::cout << "Adaptive steps: " << (double)adaptive.substeps / adaptive.steps << " substeps per step awake, " << adaptive.rejected
+				<< " rejected, " << adaptive.drained << " drained, over " << adaptive.steps << " steps" << std::endl;
+		}
+		if (multirate && network.rateVersion >= 0)
+		{
+			std::cout << "Multirate: " << network.componentCount << " components, taking up to " << network.rateComponents(density * gravity,
+				(float)(1.0 / physicsHz)) << " substeps per step" << std::endl;
+		}
+		if (integrator == INTEGRATOR_SYMPLECTIC)
+		{
+			double endEnergy = network.energy(density, gravity);
+			std::cout << "Energy: " << startEnergy << " after the first step, " << endEnergy << " at the end (" << endEnergy - startEnergy << ")" << std::endl;
+		}
+		if (precision == PRECISION_FIXED_POINT && !network.preciseDirty)
+		{
+			ResultKey state;
+			state.add(network.fixedVolume);
+			state.add(network.fixedFlow);
+			std::cout << "Fixed point state after step " << simulationStep << ": " << std::hex << state.value() << std::dec << std::endl;
+		}
+	}
+
+	int result = 0;
+	if (cacheResult && !fromCache)
+	{
+		cached.assign(network.height.begin(), network.height.end());
+		cached.insert(cached.end(), network.tubeFlow.begin(), network.tubeFlow.end());
+		resultCache.store(resultKey, cached);
+		if (!resultCache.save(resultCacheFile))
+		{
+			result = 1;
+		}
+	}
+	if (outputFile.empty())
+	{
+		writeResults(std::cout, headlessSteps);
+	}
+	else
+	{
+		std::ofstream file(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			result = 1;
+		}
+		else
+		{
+			writeResults(file, headlessSteps);
+		}
+	}
+
+	if (!finishOutputs())
+	{
+		result = 1;
+	}
+
+	if (!traceFile.empty() && !traceWrite(traceFile))
+	{
+		result = 1;
+	}
+
+	delete taskPool;
+	return result;
+}
+
+// Replaces every parameter with an index of -1 by one for every vessel (or tube) of the network.
+void expandParameters(std::vector<SensitivityParameter>& parameters)
+{
+	std::vector<SensitivityParameter> expanded;
+	for (const SensitivityParameter& parameter : parameters)
+	{
+		int count = parameter.kind == SENSITIVITY_DENSITY ? 1 : sensitivityOfTube(parameter.kind) ? network.tubeCount() : network.vesselCount();
+		for (int i = 0; i < count && parameter.index < 0; i++)
+		{
+			expanded.push_back({ parameter.kind, i });
+		}
+		if (parameter.index >= 0)
+		{
+			expanded.push_back(parameter);
+		}
+	}
+	parameters.swap(expanded);
+}
+
+// Sets up the network for --sensitivity and --calibrate. The piston doesn't change while the network is differentiated, so its
+// pressure is set once, as update() would.
+void setupDifferentiation()
+{
+	applyThreadRole(THREAD_ROLE_SIMULATION);
+	taskPool = new TaskPool();
+	setup();
+	piston.force = externalPressure * network.width[pistonVessel];
+	piston.couple(network, density, gravity, (float)(1.0 / physicsHz));
+	expandParameters(sensitivityParameters);
+	expandParameters(calibrationParameters);
+}
+
+// Steps the network for headlessSteps physics steps with the derivatives of sensitivityParameters, and writes the levels it ends at
+// with their derivatives as comma separated values, one column per parameter.
+int runSensitivity()
+{
+	setupDifferentiation();
+
+	std::vector<double> heights;
+	std::vector<double> derivatives;
+	bool succeeded;
+	{
+		PROFILE_SCOPE(PROFILE_UPDATE);
+		succeeded = sensitivities(network, density, gravity, (float)(1.0 / physicsHz), headlessSteps, sensitivityParameters, heights, derivatives,
+			taskPool);
+	}
+	delete taskPool;
+	taskPool = nullptr;
+	if (!succeeded)
+	{
+		return 1;
+	}
+
+	std::ofstream file;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = outputFile.empty() ? std::cout : file;
+	size_t count = sensitivityParameters.size();
+	out << "# steps " << headlessSteps << ", externalPressure " << externalPressure << std::endl;
+	out << "vessel,height";
+	for (const SensitivityParameter& parameter : sensitivityParameters)
+	{
+		out << ",d/" << sensitivityKindName(parameter.kind) << parameter.index;
+	}
+	out << std::endl;
+	for (int i = 0; i < network.vesselCount(); i++)
+	{
+		out << i << "," << heights[i];
+		for (size_t p = 0; p < count; p++)
+		{
+			out << "," << derivatives[i * count + p];
+		}
+		out << std::endl;
+	}
+
+	if (!traceFile.empty() && !traceWrite(traceFile))
+	{
+		return 1;
+	}
+	return 0;
+}
+
+// Fits calibrationParameters to the levels in calibrationFile, and writes the values it found as comma separated values.
+int runCalibration()
+{
+	std::vector<LevelSample> samples;
+	if (!readLevelSamples(calibrationFile, samples))
+	{
+		return 1;
+	}
+	setupDifferentiation();
+
+	CalibrationResult result;
+	bool succeeded;
+	{
+		PROFILE_SCOPE(PROFILE_UPDATE);
+		succeeded = calibrate(network, density, gravity, (float)(1.0 / physicsHz), samples, calibrationParameters, result, CALIBRATION_ITERATIONS,
+			taskPool);
+	}
+	delete taskPool;
+	taskPool = nullptr;
+	if (!succeeded)
+	{
+		return 1;
+	}
+	std::cout << "Calibrated " << calibrationParameters.size() << " parameters to " << samples.size() << " samples in " << result.iterations
+		<< " iterations (" << result.evaluations << " runs): squared error " << result.startLoss << " to " << result.loss
+		<< (result.converged ? "" : ", stopped before it converged") << std::endl;
+
+	std::ofstream file;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = outputFile.empty() ? std::cout : file;
+	out << "parameter,index,value" << std::endl;
+	for (const SensitivityParameter& parameter : calibrationParameters)
+	{
+		out << sensitivityKindName(parameter.kind) << "," << parameter.index << "," << sensitivityValue(network, density, parameter) << std::endl;
+	}
+
+	if (!traceFile.empty() && !traceWrite(traceFile))
+	{
+		return 1;
+	}
+	return 0;
+}
+#pragma endregion Headless
+
+#pragma region Video_export
+// Draws the scene again into target, at the size of the captures and with the camera of the window.
+void renderCapture(OffscreenTarget& target, const std::vector<float>& from, const std::vector<float>& to, float alpha)
+{
+	// The camera keeps its center and zoom, and fits them to the shape of the capture instead of the window. The capture is drawn
+	// in one go, so it doesn't go through the retained frame.
+	int windowWidth = framebufferWidth;
+	int windowHeight = framebufferHeight;
+	bool retained = retainScene;
+	framebufferWidth = captureWidth;
+	framebufferHeight = captureHeight;
+	retainScene = false;
+	updateCamera();
+
+	target.bind();
+	renderScene(from, to, alpha);
+
+	framebufferWidth = windowWidth;
+	framebufferHeight = windowHeight;
+	retainScene = retained;
+	updateCamera();
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+	cachedViewport(0, 0, windowWidth, windowHeight);
+}
+
+// Renders headlessSteps physics steps into videoFile. Every video frame advances the simulation by exactly 1 / videoFps seconds,
+// no matter how long the frame took to draw, so the video plays at the speed of the simulation while the export runs as fast
+// as the GPU and the encoder allow.
+int runVideoExport()
+{
+	if (!openVideoExport(videoFile, videoWidth, videoHeight, videoFps, renderSamples, videoEncoder))
+	{
+		closeVideoExport();
+		return 1;
+	}
+
+	// The scene is laid out in clip space, which would be stretched on a frame that isn't square.
+	if (videoWidth > videoHeight)
+	{
+		mvp = glm::scale(glm::mat4(1.0f), glm::vec3((float)videoHeight / videoWidth, 1.0f, 1.0f));
+	}
+	else
+	{
+		mvp = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, (float)videoWidth / videoHeight, 1.0f));
+	}
+
+	// The profiler bars and the HUD have no place in a recording.
+	showProfiler = false;
+	showHud = false;
+
+	double physicsStep = 1.0 / physicsHz;
+	double frameStep = 1.0 / videoFps;
+	double accumulator = 0.0;
+	long long steps = 0;
+	long long frames = 0;
+	bool succeeded = true;
+
+	while (steps < headlessSteps && succeeded)
+	{
+		accumulator += frameStep;
+		while (accumulator >= physicsStep && steps < headlessSteps)
+		{
+			PROFILE_SCOPE(PROFILE_UPDATE);
+			previousTop = network.top;
+			update();
+			accumulator -= physicsStep;
+			steps++;
+			gpuLevelsChanged = gpuNetworkStep;
+		}
+
+		if (gridResolution > 0)
+		{
+			if (grid.layoutChanges != gridMeshLayout)
+			{
+				buildGridGeometry(grid.tiles, grid.layoutChanges);
+			}
+			grid.cellSpeeds(gridSpeeds);
+			if (heatmap)
+			{
+				grid.cellPressures(gridPressures);
+			}
+			uploadGridColors(grid.fraction, gridSpeeds, gridPressures);
+		}
+		if (gpuParticles)
+		{
+			writeGpuParticles(particleDrawBuffer);
+		}
+		else if (particleTarget > 0)
+		{
+			particles.speeds(particleSpeeds);
+			uploadParticles(particles.positionX, particles.positionY, particleSpeeds);
+		}
+		if (shallowCells > 0)
+		{
+			uploadSurface(shallowWater.depth);
+		}
+
+		{
+			PROFILE_SCOPE(PROFILE_RENDER);
+			beginVideoFrame();
+			renderScene(previousTop, network.top, (float)(accumulator / physicsStep));
+			succeeded = endVideoFrame();
+		}
+		frames++;
+
+		// Keep the window responsive to the OS, even though it is hidden.
+		glfwPollEvents();
+	}
+
+	succeeded &= closeVideoExport();
+	std::cout << "Wrote " << frames << " frames (" << steps << " physics steps) to " << videoFile << std::endl;
+	return succeeded ? 0 : 1;
+}
+#pragma endregion Video_export
+
+#pragma region Benchmark
+// How many steps every run of update() takes on a network of so many vessels. Every network moves for the whole run, since none
+// of them is stepped for more than a few seconds of simulated time.
+#define BENCHMARK_UPDATE_SIZES 4
+static const int BENCHMARK_UPDATE_VESSELS[BENCHMARK_UPDATE_SIZES] = { 2, 1000, 100000, 1000000 };
+static const int BENCHMARK_UPDATE_STEPS[BENCHMARK_UPDATE_SIZES] = { 500, 500, 50, 10 };
+
+// The render path draws this many frames per run into a target of this size, with the levels moving in every frame so they are
+// uploaded every time. Every run waits for the GPU, so the time is that of the frames being finished, not of them being queued.
+#define BENCHMARK_RENDER_FRAMES 100
+#define BENCHMARK_RENDER_WIDTH 1920
+#define BENCHMARK_RENDER_HEIGHT 1080
+
+// Runs every benchmark and prints the results. Returns the exit code.
+int runBenchmarks()
+{
+	std::ofstream file;
+	std::ostream* csv = nullptr;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile, std::ios::out);
+		if (!file.good())
+		{
+			std::cout << "Can't write file: " << outputFile << std::endl;
+			return 1;
+		}
+		csv = &file;
+		reportBenchmarkHeader(file);
+	}
+	BenchmarkBaselines baselines;
+	if (!benchmarkBaselineFile.empty() && !baselines.read(benchmarkBaselineFile))
+	{
+		return 1;
+	}
+	std::cout << std::endl;
+
+	std::vector<BenchmarkRecord> records;
+	auto report = [&](const std::string& name, const char* unit, double itemsPerUnit, const char* items, const BenchmarkResult& result)
+	{
+		reportBenchmark(std::cout, csv, name, unit, itemsPerUnit, items, result);
+		records.push_back({ name, unit, result });
+	};
+
+	// update() on networks of every size, with the integrator and the precision from the command line.
+	float dt = (float)(1.0 / physicsHz);
+	for (int i = 0; i < BENCHMARK_UPDATE_SIZES; i++)
+	{
+		VesselNetwork benchmarkNetwork;
+		buildBenchmarkNetwork(benchmarkNetwork, BENCHMARK_UPDATE_VESSELS[i], density, gravity);
+		benchmarkNetwork.integrator = integrator;
+		benchmarkNetwork.solver.preconditioner = preconditioner;
+		benchmarkNetwork.adaptive.tolerance = adaptiveTolerance;
+		benchmarkNetwork.precision = precision;
+		benchmarkNetwork.scatter = scatter;
+		benchmarkNetwork.multirate = multirate;
+		benchmarkNetwork.drainLimit = drainLimit;
+		BenchmarkResult result = benchmarkUpdate(benchmarkNetwork, BENCHMARK_UPDATE_STEPS[i], BENCHMARK_REPETITIONS, density, gravity, dt,
+			taskPool);
+		report("update " + std::to_string(BENCHMARK_UPDATE_VESSELS[i]) + " vessels", "step", BENCHMARK_UPDATE_VESSELS[i], "vessels", result);
+	}
+
+	// The scene, drawn offscreen like a capture, without the profiler bars and the HUD.
+	OffscreenTarget target;
+	if (target.create(BENCHMARK_RENDER_WIDTH, BENCHMARK_RENDER_HEIGHT, renderSamples))
+	{
+		int windowWidth = framebufferWidth;
+		int windowHeight = framebufferHeight;
+		framebufferWidth = BENCHMARK_RENDER_WIDTH;
+		framebufferHeight = BENCHMARK_RENDER_HEIGHT;
+		retainScene = false;
+		showProfiler = false;
+		showHud = false;
+		updateCamera();
+
+		std::vector<float> from = network.top;
+		for (float& top : from)
+		{
+			top -= 0.05f;
+		}
+		BenchmarkResult result = runBenchmark(BENCHMARK_REPETITIONS, [&]()
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			target.bind();
+			for (int i = 0; i < BENCHMARK_RENDER_FRAMES; i++)
+			{
+				renderScene(from, network.top, (i + 0.5f) / BENCHMARK_RENDER_FRAMES);
+			}
+			target.resolve();
+			glFinish();
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			return (double)elapsed.count() / BENCHMARK_RENDER_FRAMES;
+		});
+		report("render " + std::to_string(BENCHMARK_RENDER_WIDTH) + "x" + std::to_string(BENCHMARK_RENDER_HEIGHT) + " offscreen", "frame",
+			network.vesselCount(), "vessels", result);
+
+		target.destroy();
+		framebufferWidth = windowWidth;
+		framebufferHeight = windowHeight;
+		updateCamera();
+		cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+		cachedViewport(0, 0, windowWidth, windowHeight);
+	}
+	else
+	{
+		std::cout << "Can't create the offscreen target, leaving out the render benchmark." << std::endl;
+	}
+
+	// The scene program, compiled and linked from its sources, and loaded through the cache of linked programs (see Shaders.h).
+	// Both wait for the link to finish, since they ask for its status.
+	MappedFile vertexFile;
+	MappedFile fragmentFile;
+	std::string vertexSource;
+	std::string fragmentSource;
+	if (vertexFile.open(VERTEX_SHADER_FILE) && fragmentFile.open(FRAGMENT_SHADER_FILE)
+		&& preprocessShader(vertexFile.view(), VERTEX_SHADER_FILE, {}, vertexSource) && preprocessShader(fragmentFile.view(), FRAGMENT_SHADER_FILE, {}, fragmentSource))
+	{
+		BenchmarkResult compiled = runBenchmark(BENCHMARK_REPETITIONS, [&]()
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			GLuint vertex = createShader(vertexSource, GL_VERTEX_SHADER);
+			GLuint fragment = createShader(fragmentSource, GL_FRAGMENT_SHADER);
+			GLuint linked = createProgram(vertex, fragment);
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			cachedDeleteProgram(linked);
+			glDeleteShader(vertex);
+			glDeleteShader(fragment);
+			return (double)elapsed.count();
+		});
+		report("compile and link the scene program", "program", 0.0, "", compiled);
+
+		BenchmarkResult cached = runBenchmark(BENCHMARK_REPETITIONS, [&]()
+		{
+			GLuint vertex, fragment;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			GLuint loaded = loadProgramCached(vertexSource, fragmentSource, vertex, fragment);
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			cachedDeleteProgram(loaded);
+			glDeleteShader(vertex);
+			glDeleteShader(fragment);
+			return (double)elapsed.count();
+		});
+		report("load the scene program through the cache", "program", 0.0, "", cached);
+
+		// The deleted programs' names can come back for new programs.
+		renderQueue.forgetPrograms();
+	}
+
+	if (benchmarkBaselineFile.empty())
+	{
+		return 0;
+	}
+	int regressions = 0;
+	std::string baselineCommit;
+	const std::vector<BenchmarkRecord>* baseline = baselines.newest(benchmarkMachine, baselineCommit);
+	if (baseline != nullptr)
+	{
+		std::cout << std::endl << "Compared with " << baselineCommit << " on " << benchmarkMachine << ":" << std::endl;
+		regressions = compareBenchmarks(std::cout, *baseline, records, benchmarkThreshold);
+		if (regressions > 0)
+		{
+			std::cout << regressions << " benchmarks regressed by more than " << benchmarkThreshold * 100.0 << "%." << std::endl;
+		}
+	}
+	else
+	{
+		std::cout << std::endl << "There is no baseline for " << benchmarkMachine << " in " << benchmarkBaselineFile << " yet." << std::endl;
+	}
+	if (benchmarkStore)
+	{
+		baselines.store(benchmarkCommit, benchmarkMachine, records);
+		if (!baselines.write(benchmarkBaselineFile))
+		{
+			return 1;
+		}
+	}
+	return regressions > 0 ? 1 : 0;
+}
+#pragma endregion Benchmark
+
+#pragma region Simulation_thread
+// In the interactive mode the simulation runs on its own thread, so a slow frame or swap never holds up the physics and
+// a burst of physics steps never holds up a frame. After every step it publishes a snapshot of what the renderer needs.
+struct SimulationSnapshot
+{
+	std::vector<float> top;				// The top edge of every vessel after the newest step
+	std::vector<float> previousTop;		// and before it, so the renderer can blend between them
+	std::vector<float> gridFraction;	// With --grid, the fill and the speed of every cell after the newest step
+	std::vector<float> gridSpeed;
+	std::vector<float> gridPressure;	// Only with --heatmap
+	GridTiles gridTiles;				// The tiles they are in, copied when the grid lays them out again
+	int gridLayout = -1;
+	std::vector<float> particleX;		// With --particles, where every particle is and how fast it moves after the newest step
+	std::vector<float> particleY;
+	std::vector<float> particleSpeed;
+	GLuint particleVertices = 0;		// With --gpu, the buffer the GPU wrote them into instead, and the fence that signals when it
+	GLsync particleFence = nullptr;		// is done
+	GLuint levelBuffer = 0;				// With --gpu-network, a copy of the levels on the GPU, and the fence that signals when it is
+	GLsync levelFence = nullptr;		// done
+	GpuNetworkStatistics gpuStatistics;	// With --gpu-network, the newest statistics that came back from the GPU, and their step (-1
+	long long gpuStatisticsStep = -1;	// before the first)
+	std::vector<float> surfaceDepth;	// With --shallow-water, the depth of every cell of the profiles after the newest step
+	std::vector<float> floatX;			// With --floats, where every float is after the newest step
+	std::vector<float> floatY;
+	FrameArena arena;					// Holds the arrays below until this slot is written again
+	FrameSpan<AppliedInput> inputs;		// The key presses applied up to the newest step that no frame has shown yet
+	FrameSpan<float> plotSamples;		// With a plot view, the samples of the steps from plotFirstStep on that no frame has shown yet
+	long long plotFirstStep = 0;
+	float pistonPressure = 0.0f;		// For the HUD: the pressure the keys set, and the height and the pressure at the bottom of
+	std::vector<float> hudHeight;		// the first HUD_VESSELS vessels
+	std::vector<float> hudPressure;
+	long long step = 0;
+	std::chrono::steady_clock::time_point time;	// When the step finished
+
+	// Running total of the time spent in update(), so the render thread can work out how much of it happened during its frame,
+	// even if it skipped some snapshots.
+	double updateMilliseconds = 0.0;
+
+	// The same for the allocations of the simulation thread (see MemoryTracker.h).
+	long long allocations = 0;
+};
+
+TripleBuffer<SimulationSnapshot> snapshots;
+std::thread simulationThread;
+std::atomic<bool> simulationRunning(false);
+
+// Only touched by the simulation thread.
+double simulationUpdateMilliseconds = 0.0;
+
+// With a plot view, recordPlotSample() adds PLOT_SERIES values after every step: the heights of the first HUD_VESSELS vessels, then
+// their pressures. Like appliedInputs, they are kept until a frame has shown their step, so snapshots the render thread skips don't
+// lose any. pendingPlotFirst is the step of the first of them.
+#define PLOT_SERIES (2 * HUD_VESSELS)
+bool plotRecording = false;
+std::vector<float> pendingPlot;
+long long pendingPlotFirst = 0;
+
+void recordPlotSample()
+{
+	if (!plotRecording)
+	{
+		return;
+	}
+	if (pendingPlot.empty())
+	{
+		pendingPlotFirst = simulationStep;
+	}
+	for (int i = 0; i < HUD_VESSELS; i++)
+	{
+		pendingPlot.push_back(i < network.vesselCount() ? network.height[i] : 0.0f);
+	}
+	for (int i = 0; i < HUD_VESSELS; i++)
+	{
+		pendingPlot.push_back(i < network.vesselCount() ? network.pressure[i] + network.externalPressure[i] : 0.0f);
+	}
+}
+
+void publishSnapshot()
+{
+	SimulationSnapshot& snapshot = snapshots.writeBuffer();
+	snapshot.top = network.top;
+	snapshot.previousTop = previousTop;
+	if (gridResolution > 0)
+	{
+		if (snapshot.gridLayout != grid.layoutChanges)
+		{
+			snapshot.gridTiles = grid.tiles;
+			snapshot.gridLayout = grid.layoutChanges;
+		}
+		snapshot.gridFraction = grid.fraction;
+		grid.cellSpeeds(snapshot.gridSpeed);
+		if (heatmap)
+		{
+			grid.cellPressures(snapshot.gridPressure);
+		}
+	}
+	if (gpuParticles)
+	{
+		writeGpuParticles(snapshot.particleVertices);
+		glDeleteSync(snapshot.particleFence);
+		snapshot.particleFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+	}
+	if (gpuNetworkStep)
+	{
+		copyGpuLevels(snapshot.levelBuffer);
+		glDeleteSync(snapshot.levelFence);
+		snapshot.levelFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		// The statistics of the HUD come back a snapshot or so after the step they are of, without waiting for the GPU.
+		gpuNetwork.pollStatistics(gpuStatistics, gpuStatisticsStep);
+		gpuNetwork.requestStatistics(simulationStep);
+		snapshot.gpuStatistics = gpuStatistics;
+		snapshot.gpuStatisticsStep = gpuStatisticsStep;
+	}
+	else if (particleTarget > 0)
+	{
+		snapshot.particleX = particles.positionX;
+		snapshot.particleY = particles.positionY;
+		particles.speeds(snapshot.particleSpeed);
+	}
+	if (shallowCells > 0)
+	{
+		snapshot.surfaceDepth = shallowWater.depth;
+	}
+	if (floats.count() > 0)
+	{
+		snapshot.floatX = floats.positionX;
+		snapshot.floatY = floats.positionY;
+	}
+	long long shown = shownStep.load();
+	appliedInputs.erase(std::remove_if(appliedInputs.begin(), appliedInputs.end(), [shown](const AppliedInput& input) { return input.step <= shown; }),
+		appliedInputs.end());
+	snapshot.arena.reset();
+	snapshot.inputs = snapshot.arena.copy(appliedInputs);
+	if (shown >= pendingPlotFirst && !pendingPlot.empty())
+	{
+		long long dropped = std::min((long long)pendingPlot.size() / PLOT_SERIES, shown - pendingPlotFirst + 1);
+		pendingPlot.erase(pendingPlot.begin(), pendingPlot.begin() + (size_t)dropped * PLOT_SERIES);
+		pendingPlotFirst += dropped;
+	}
+	snapshot.plotSamples = snapshot.arena.copy(pendingPlot);
+	snapshot.plotFirstStep = pendingPlotFirst;
+	int hudVessels = std::min(network.vesselCount(), HUD_VESSELS);
+	snapshot.pistonPressure = externalPressure;
+	snapshot.hudHeight.assign(network.height.begin(), network.height.begin() + hudVessels);
+	snapshot.hudPressure.resize(hudVessels);
+	for (int i = 0; i < hudVessels; i++)
+	{
+		snapshot.hudPressure[i] = network.pressure[i] + network.externalPressure[i];
+	}
+	snapshot.step = simulationStep;
+	snapshot.time = std::chrono::steady_clock::now();
+	snapshot.updateMilliseconds = simulationUpdateMilliseconds;
+	snapshot.allocations = threadAllocations();
+	snapshots.publish();
+}
+
+// The simulation thread. Runs update() physicsHz times per second on its own clock (times the time scale), with the same limit of
+// MAX_STEPS_PER_FRAME steps in a row to catch up after a stall, and sleeps until the next step is due. Fast forwarding, it runs a
+// round per frame instead, limited by FAST_FORWARD_BUDGET rather than a number of steps. While the frames are capped to save power,
+// it wakes up once per frame and runs the steps that are due by then (see POWER_SAVING_HZ). Once the network has come to rest it waits
+// for input instead. A replay keeps stepping, since its input is tied to step numbers and nothing would wake it up, and so does a
+// playback that isn't paused, which doesn't show a new step every time when it is slower than the recording.
+void runSimulation()
+{
+	applyThreadRole(THREAD_ROLE_SIMULATION);
+	setMemoryTag(MEMORY_SIMULATION);
+	if (simulationContext != nullptr)
+	{
+		makeContextCurrent(simulationContext);
+		if (glDebug)
+		{
+			enableGlDebugOutput(true);
+		}
+	}
+
+	std::chrono::duration<double> frame(1.0 / (renderHz > 0.0 ? renderHz : 60.0));
+	std::chrono::steady_clock::time_point nextStep = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point measureStart = nextStep;
+	long long measureSteps = 0;
+
+	while (simulationRunning.load(std::memory_order_relaxed))
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		float scale = timeScale;
+		bool fastForward = scale > 1.0f;
+		std::chrono::steady_clock::duration physicsStep = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / (physicsHz * scale)));
+		std::chrono::steady_clock::time_point budgetEnd = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame * FAST_FORWARD_BUDGET);
+
+		// While the frames are capped to save power, the steps of a frame run together, so the limit grows by that many.
+		double wakeHz = simulationWakeHz.load(std::memory_order_relaxed);
+		int stepLimit = MAX_STEPS_PER_FRAME + (wakeHz > 0.0 ? (int)(physicsHz * scale / wakeHz) : 0);
+
+		// A lockstep peer only runs the steps the host granted, and catches up as fast as it can once it fell too far behind.
+		int steps = 0;
+		bool moved = true;
+		bool peer = lockstep.isPeer();
+		while ((now >= nextStep || (peer && lockstep.granted() - simulationStep > LOCKSTEP_LAG_STEPS))
+			&& (fastForward ? steps == 0 || std::chrono::steady_clock::now() < budgetEnd : steps < stepLimit)
+			&& (!peer || simulationStep < lockstep.granted()))
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			previousTop = network.top;
+			moved = update();
+			recordPlotSample();
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+			// The profiler belongs to the render thread, so the time goes out through the snapshot instead of a PROFILE_SCOPE.
+			simulationUpdateMilliseconds += elapsed.count() / 1000000.0;
+			if (traceEnabled())
+			{
+				traceSpan("update", traceNow() - (unsigned long long)elapsed.count(), (unsigned long long)elapsed.count());
+			}
+
+			if (!fastForward)
+			{
+				publishSnapshot();
+			}
+			nextStep += physicsStep;
+			steps++;
+		}
+		if (fastForward && steps > 0)
+		{
+			publishSnapshot();
+		}
+
+		// If we hit the step limit, throw away the time we couldn't simulate instead of carrying it into the next round.
+		if (now >= nextStep)
+		{
+			nextStep = now + physicsStep;
+		}
+
+		measureSteps += steps;
+		std::chrono::duration<double> measured = std::chrono::steady_clock::now() - measureStart;
+		if (measured.count() >= TIME_SCALE_WINDOW)
+		{
+			achievedTimeScale = (float)(measureSteps / physicsHz / measured.count());
+			measureStart = std::chrono::steady_clock::now();
+			measureSteps = 0;
+		}
+
+		if (steps > 0)
+		{
+			traceCounter("physics steps", steps);
+			traceCounter("externalPressure", externalPressure);
+			traceCounter("piston pressure", piston.pressure);
+			traceCounter("piston vessel height", network.height[pistonVessel]);
+		}
+
+		if (!moved && replayInputFile.empty() && forceProfile.empty() && !scenarioPlaying && pressureSchedule.empty() && !sensorIngest.isOpen() && (!playback.isOpen() || playbackPaused)
+			&& (!peer || simulationStep >= lockstep.granted()) && !streamView.isOpen())
+		{
+			// Nothing changes until the next input, so there is nothing to step and nothing new to draw.
+			simulationIdle = true;
+			{
+				std::unique_lock<std::mutex> lock(simulationIdleLock);
+				simulationWake.wait(lock, [] { return simulationWakeRequested || !simulationRunning.load(std::memory_order_relaxed); });
+				simulationWakeRequested = false;
+			}
+			simulationIdle = false;
+
+			// The render thread may be waiting for events. The time spent idle is not simulated time, so don't catch up on it.
+			glfwPostEmptyEvent();
+			nextStep = std::chrono::steady_clock::now();
+			measureStart = nextStep;
+			measureSteps = 0;
+			continue;
+		}
+
+		std::chrono::steady_clock::time_point wake = nextStep;
+		if (fastForward)
+		{
+			wake = std::max(nextStep, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame));
+		}
+		else if (wakeHz > 0.0)
+		{
+			wake = std::max(nextStep, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / wakeHz)));
+		}
+		std::this_thread::sleep_until(wake);
+	}
+
+	if (simulationContext != nullptr)
+	{
+		makeContextCurrent(nullptr);
+	}
+}
+
+// The key of the setup a lockstep session starts from, which every machine in it has to share: the network with how it is stepped,
+// the settings update() reads and the step it starts at.
+uint64_t lockstepKey()
+{
+	ResultKey key;
+	key.addNetwork(network);
+	key.add(density);
+	key.add(gravity);
+	key.add(physicsHz);
+	key.add(externalPressure);
+	key.add(pistonVessel);
+	key.add(simulationStep);
+	return key.value();
+}
+
+// Hosts or joins the lockstep session, if there is one. Returns false if that fails.
+bool startLockstep()
+{
+	if (lockstepPort > 0)
+	{
+		return lockstep.host(lockstepPort, lockstepKey(), simulationStep, queueRemoteCommand);
+	}
+	if (!lockstepJoin.empty())
+	{
+		size_t colon = lockstepJoin.rfind(':');
+		return lockstep.join(lockstepJoin.substr(0, colon), atoi(lockstepJoin.c_str() + colon + 1), lockstepKey(), wakeSimulation);
+	}
+	return true;
+}
+
+// Connects to the stream to view, if there is one. Returns false if that fails.
+bool startStreamView()
+{
+	if (streamViewSource.empty())
+	{
+		return true;
+	}
+	size_t colon = streamViewSource.rfind(':');
+	return streamView.start(streamViewSource.substr(0, colon), atoi(streamViewSource.c_str() + colon + 1));
+}
+
+void startSimulation()
+{
+	// The renderer needs something to draw before the first step is done.
+	publishSnapshot();
+	snapshots.acquire();
+
+	simulationRunning = true;
+	simulationThread = std::thread(runSimulation);
+}
+
+void stopSimulation()
 {
-	float height;
-	float width;
-	// These values are used for rendering. 
-	// Since we need to change individual vertices to reflect the changes, we shall use openGL primitives to render quads.
-	// This does not require any shaders.
-	glm::vec2 bottomLeft, bottomRight;
-	glm::vec2 topLeft, topRight;
-	float pressure;
-}big, small;
+	if (simulationThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(simulationIdleLock);
+			simulationRunning = false;
+			simulationWake.notify_one();
+		}
+		simulationThread.join();
+	}
+}
 
-void setup()
+// Points the streamed scene at the view, and once tiles arrived or the view left some behind, stops the simulation to add and remove
+// them and builds the geometry again. Returns true if the network changed.
+bool updateSceneStream()
 {
-	// Set up the variables and attributes for both sides of the apparatus
-	big.height = 0.5f;
-	big.width = 0.5f;
-	big.bottomLeft = glm::vec2(-0.75f, -0.5f);
-	big.bottomRight = glm::vec2(-0.25f, -0.5f);
-	big.topLeft = glm::vec2(-0.75f, 0.0f);
-	big.topRight = glm::vec2(-0.25f, 0.0f);
-	big.pressure = big.height * density *  gravity;
-
-	small.height = 0.5f;
-	small.width = 0.25f;
-	small.bottomLeft = glm::vec2(0.5f, -0.5f);
-	small.bottomRight = glm::vec2(0.75f, -0.5f);
-	small.topLeft = glm::vec2(0.5f, 0.0f);
-	small.topRight = glm::vec2(0.75f, 0.0f);
-	small.pressure = small.height * density * gravity;
+	glm::vec2 low, high;
+	viewBounds(low, high);
+	sceneStreamer.focus(low.x, low.y, high.x, high.y);
+	if (!sceneStreamer.changesPending())
+	{
+		return false;
+	}
+
+	stopSimulation();
+	bool changed = sceneStreamer.apply(network);
+	if (changed)
+	{
+		pistonVessel = network.vesselIndex(sceneStreamer.pistonHandle());
+		piston.vessel = pistonVessel;
+		pressureSchedule.bind(network, pistonVessel);
+		network.computePressures(density, gravity);
+		previousTop = network.top;
+		if (taskPool->pinned() || hugePages)
+		{
+			network.placeMemory(taskPool, hugePages);
+		}
+		rebuildGeometry();
+		traceCounter("resident tiles", sceneStreamer.residentTiles());
+		traceCounter("tile cache MB", sceneStreamer.cachedBytes() / 1048576.0);
+	}
+	startSimulation();
+	return changed;
 }
+#pragma endregion Simulation_thread
 
-// Global data members
-#pragma region Base_data
-// This is your reference to your shader program.
-// This will be assigned with glCreateProgram().
-// This program will run on your GPU.
-GLuint program;
+#pragma region Hud
+// The allocations of the last frame on the render thread, and those the simulation thread made while it was drawn. In the steady
+// state both should be 0: everything the loop needs is allocated once and then reused.
+long long frameAllocations = 0;
+long long frameSimulationAllocations = 0;
 
-// These are your references to your actual compiled shaders
-GLuint vertex_shader;
-GLuint fragment_shader;
+// The temporaries of the render thread, like the text of the HUD and the window title. Reset at the start of every frame.
+FrameArena frameArena;
 
-// This is a reference to your uniform MVP matrix in your vertex shader
-GLuint uniMVP;
+// Writes the text of the HUD from the newest snapshot and the profiler, right aligned in the top right corner of the window.
+#define PLAYBACK_BAR 40
+#define PLAYBACK_BAR_FULL "########################################"
+#define PLAYBACK_BAR_EMPTY "----------------------------------------"
+void writeHud(const SimulationSnapshot& snapshot)
+{
+	MEMORY_SCOPE(MEMORY_HUD);
+	FrameText text(frameArena, 1024);
+	if (playback.isOpen())
+	{
+		// The timeline of the playback, with a bar that fills up as it goes.
+		long long first = playback.firstStep();
+		long long length = std::max(1LL, playback.lastStep() - first);
+		int filled = (int)(PLAYBACK_BAR * (snapshot.step - first) / length);
+		text.append("step %lld of %lld to %lld  speed %gx%s\n", snapshot.step, first, playback.lastStep(), playbackSpeed.load(),
+			playbackPaused ? "  paused" : "");
+		text.append("[%.*s%.*s]\n", filled, PLAYBACK_BAR_FULL, PLAYBACK_BAR - filled, PLAYBACK_BAR_EMPTY);
+	}
+	else
+	{
+		text.append("piston pressure %.3f\n", snapshot.pistonPressure);
+		if (timeScale != 1.0f)
+		{
+			text.append("time scale %gx  running at %.1fx\n", timeScale.load(), achievedTimeScale.load());
+		}
+	}
+	for (int i = 0; i < (int)snapshot.hudHeight.size(); i++)
+	{
+		// The classic apparatus has a big vessel under the piston and a small one.
+		if (network.vesselCount() == 2)
+		{
+			text.append(i == pistonVessel ? "big  " : "small");
+		}
+		else
+		{
+			text.append("vessel %d", i);
+		}
+		text.append("  height %.3f  pressure %.3f\n", snapshot.hudHeight[i], snapshot.hudPressure[i]);
+	}
+	if (snapshot.gpuStatisticsStep >= 0)
+	{
+		// The histogram of the heights, one character per bin, from 0 on the left to the top of the histogram on the right.
+		const GpuNetworkStatistics& statistics = snapshot.gpuStatistics;
+		const char shades[] = " .:-=+*#%@";
+		GLuint fullest = std::max(1u, *std::max_element(statistics.histogram, statistics.histogram + GPU_NETWORK_HISTOGRAM_BINS));
+		char bars[GPU_NETWORK_HISTOGRAM_BINS + 1] = {};
+		for (int b = 0; b < GPU_NETWORK_HISTOGRAM_BINS; b++)
+		{
+			bars[b] = shades[(statistics.histogram[b] * 9 + fullest - 1) / fullest];
+		}
+		text.append("step %lld: volume %.3f  highest pressure %.3f\n", snapshot.gpuStatisticsStep, statistics.volume, statistics.highestPressure);
+		text.append("heights %.3f to %.3f  0 [%s] %.3f\n", statistics.lowestHeight, statistics.highestHeight, bars, statistics.histogramTop);
+	}
 
-// Reference to the window object being created by GLFW.
-GLFWwindow* window;
-#pragma endregion Base_data								  
+	ProfileStats frame = profilerStats(PROFILE_FRAME);
+	text.append("fps %.2f\n", frame.mean > 0.0f ? 1000.0f / frame.mean : 0.0f);
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		ProfileStats stats = profilerStats((ProfileId)i);
+		text.append("%s %.2f ms  p99 %.2f\n", profilerScope((ProfileId)i).name, stats.mean, stats.p99);
+	}
+	MemoryStats memory = memoryStats();
+	text.append("memory %.2f MB  peak %.2f MB\n", memory.bytes / 1048576.0, memory.peakBytes / 1048576.0);
+	text.append("allocations per frame %lld  simulation %lld\n", frameAllocations, frameSimulationAllocations);
+	GlStateCounts glState = lastGlStateFrame();
+	text.append("gl state changes %d of %d calls\n", glState.changes, glState.requests);
+
+	text.pop();
+	std::string_view lines = text.view();
+	float margin = 4.0f * TEXT_SCALE;
+	float width = textWidth(lines);
+	float height = (float)(std::count(lines.begin(), lines.end(), '\n') + 1) * TEXT_LINE_HEIGHT * TEXT_SCALE;
+	float left = framebufferWidth / contentScale - width - 2.0f * margin;
+	beginText();
+	addTextBackground(left - margin, margin, width + 2.0f * margin, height + margin, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	addText(left, 1.5f * margin, lines, glm::vec4(0.9f, 0.9f, 0.9f, 1.0f));
+	endText();
+}
+#pragma endregion Hud
+
+#pragma region Dashboard
+// The windows of the views asked for with --view (see dashboardKinds). They all come from the same simulation and the same render
+// thread: the windows share their buffers, textures and programs with the main window's context, so the levels uploaded for the
+// main window are what they draw too, and a view only costs its own draws. Only vertex arrays aren't shared between contexts, so
+// every view has its own.
+#define PLOT_CAPACITY (1 << 20)	// Samples kept per series, 8 MB each
+#define PLOT_VERTEX_SHADER_FILE "../Assets/PlotVertexShader.glsl"
+#define DASHBOARD_ZOOM 4.0f	// The zoom view is a square this many times narrower than the vessel under the piston
 
-inline void drawPiston()
+struct DashboardView
 {
-	glm::vec2 pistonTopLeft, pistonTopRight;
-	pistonTopLeft = big.topLeft + glm::vec2(0, 0.1f);
-	pistonTopRight = big.topRight + glm::vec2(0, 0.1f);
-	
-	glLineWidth(2.5);
-	glColor3f(0.8, 0.2, 0.2);
-	glBegin(GL_QUADS);
+	DashboardKind kind;
+	GLFWwindow* window = nullptr;
+	GLuint vao = 0;					// The quads of the network, from vbo and ebo, or nothing for the plot, which reads its samples itself
+	GLsync done = nullptr;			// Signals when the GPU has finished drawing the view
+};
 
-	glVertex2fv((float*) &big.topLeft);
-	glVertex2fv((float*) &big.topRight);
-	glVertex2fv((float*)&pistonTopRight);
-	glVertex2fv((float*)&pistonTopLeft);
-	
-	glVertex2f(((big.topLeft.x + big.topRight.x) / 2.0f) - 0.01f, big.topLeft.y);
-	glVertex2f(((big.topLeft.x + big.topRight.x) / 2.0f) + 0.01f, big.topLeft.y);
-	glVertex2f(((big.topLeft.x + big.topRight.x) / 2.0f) + 0.01f, 1.0f);
-	glVertex2f(((big.topLeft.x + big.topRight.x) / 2.0f) - 0.01f, 1.0f);
+std::vector<DashboardView> dashboardViews;
+RenderQueue dashboardQueue;
+glm::vec2 overviewLow;
+glm::vec2 overviewHigh;
 
-	glEnd();
-}
+// The samples of the plot view (see HistoryPlot.h), and the newest step added to them.
+HistoryPlot historyPlot;
+GLuint plotProgram = 0;
+GLuint plotVertexShader = 0;
+GLuint plotFragmentShader = 0;
+long long plottedStep = -1;
 
-// Functions called only once every time the program is executed.
-#pragma region Helper_functions
-std::string readShader(std::string fileName)
+// An MVP that shows the box from low to high as large as it fits into a window of width x height, without stretching it.
+glm::mat4 fitView(glm::vec2 low, glm::vec2 high, int width, int height)
 {
-	std::string shaderCode;
-	std::string line;
+	glm::vec2 center = (low + high) * 0.5f;
+	glm::vec2 size = glm::max(high - low, glm::vec2(1e-6f));
+	float pixelsPerUnit = std::min(width / size.x, height / size.y);
+	glm::vec3 scale(2.0f * pixelsPerUnit / width, 2.0f * pixelsPerUnit / height, 1.0f);
+	return glm::translate(glm::scale(glm::mat4(1.0f), scale), glm::vec3(-center, 0.0f));
+}
 
-	// We choose ifstream and std::ios::in because we are opening the file for input into our program.
-	// If we were writing to the file, we would use ofstream and std::ios::out.
-	std::ifstream file(fileName, std::ios::in);
+// Opens the windows asked for with --view, sharing everything with the main window. A view that can't be opened is left out.
+// Leaves the main window's context current.
+void openDashboardViews(GLFWwindow* mainWindow)
+{
+	static const char* titles[] = { "HydroDynamics overview", "HydroDynamics zoom", "HydroDynamics plot" };
 
-	// This checks to make sure that we didn't encounter any errors when getting the file.
-	if (!file.good())
+	// The overview shows every vessel from its floor to well above its walls, with a margin all around.
+	overviewLow = glm::vec2(FLT_MAX);
+	overviewHigh = glm::vec2(-FLT_MAX);
+	for (int i = 0; i < network.vesselCount(); i++)
 	{
-		std::cout << "Can't read file: " << fileName.data() << std::endl;
-
-		// Return so we don't error out.
-		return "";
+		overviewLow = glm::min(overviewLow, glm::vec2(network.left[i], network.bottom[i]));
+		overviewHigh = glm::max(overviewHigh, glm::vec2(network.right[i], network.top[i] + 0.5f));
 	}
+	glm::vec2 margin = (overviewHigh - overviewLow) * 0.1f;
+	overviewLow -= margin;
+	overviewHigh += margin;
 
-	// ifstream keeps an internal "get" position determining the location of the element to be read next
-	// seekg allows you to modify this location, and tellg allows you to get this location
-	// This location is stored as a streampos member type, and the parameters passed in must be of this type as well
-	// seekg parameters are (offset, direction) or you can just use an absolute (position).
-	// The offset parameter is of the type streamoff, and the direction is of the type seekdir (an enum which can be ios::beg, ios::cur, or ios::end referring to the beginning, 
-	// current position, or end of the stream).
-	file.seekg(0, std::ios::end);					// Moves the "get" position to the end of the file.
-	shaderCode.resize((unsigned int)file.tellg());	// Resizes the shaderCode string to the size of the file being read, given that tellg will give the current "get" which is at the end of the file.
-	file.seekg(0, std::ios::beg);					// Moves the "get" position to the start of the file.
-
-	// File streams contain two member functions for reading and writing binary data (read, write). The read function belongs to ifstream, and the write function belongs to ofstream.
-	// The parameters are (memoryBlock, size) where memoryBlock is of type char* and represents the address of an array of bytes are to be read from/written to.
-	// The size parameter is an integer that determines the number of characters to be read/written from/to the memory block.
-	file.read(&shaderCode[0], shaderCode.size());	// Reads from the file (starting at the "get" position which is currently at the start of the file) and writes that data to the beginning
-	// of the shaderCode variable, up until the full size of shaderCode. This is done with binary data, which is why we must ensure that the sizes are all correct.
+	bool plotted = std::find(dashboardKinds.begin(), dashboardKinds.end(), VIEW_PLOT) != dashboardKinds.end();
+	if (plotted)
+	{
+		plotProgram = loadProgramFiles(PLOT_VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE, plotVertexShader, plotFragmentShader);
+	}
+	if (plotted && (plotProgram == 0 || !historyPlot.create(PLOT_SERIES, PLOT_CAPACITY)))
+	{
+		std::cout << "Can't create the plot, leaving it out." << std::endl;
+		cachedDeleteProgram(plotProgram);
+		plotProgram = 0;
+		dashboardKinds.erase(std::remove(dashboardKinds.begin(), dashboardKinds.end(), VIEW_PLOT), dashboardKinds.end());
+		plotted = false;
+	}
+	if (plotted)
+	{
+		// The heights in the upper half, the pressures in the lower one, in the colors of the vessels.
+		static const glm::vec4 colors[HUD_VESSELS] = { glm::vec4(0.3f, 0.5f, 1.0f, 1.0f), glm::vec4(1.0f, 0.6f, 0.1f, 1.0f) };
+		for (int i = 0; i < HUD_VESSELS; i++)
+		{
+			historyPlot.setStyle(i, colors[i], 0.05f, 0.95f);
+			historyPlot.setStyle(HUD_VESSELS + i, colors[i] * glm::vec4(0.7f, 0.7f, 0.7f, 1.0f), -0.95f, -0.05f);
+		}
+		plotRecording = true;
+	}
 
-	file.close(); // Now that we're done, close the file and return the shaderCode.
+	for (DashboardKind kind : dashboardKinds)
+	{
+		DashboardView view;
+		view.kind = kind;
+		view.window = glfwCreateWindow(480, 360, titles[kind], nullptr, mainWindow);
+		if (view.window == nullptr)
+		{
+			std::cout << "Can't open the window of " << titles[kind] << ", leaving it out." << std::endl;
+			continue;
+		}
 
-	return shaderCode;
+		// The main window sets the pace; the views are drawn right after it and never wait for their own vertical blank.
+		makeContextCurrent(view.window);
+		glfwSwapInterval(0);
+		glGenVertexArrays(1, &view.vao);
+		cachedBindVertexArray(view.vao);
+		if (kind != VIEW_PLOT)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+			setPackedVertexAttributes();
+		}
+		cachedBindVertexArray(0);
+		dashboardViews.push_back(view);
+	}
+	makeContextCurrent(mainWindow);
 }
 
-// This method will consolidate some of the shader code we've written to return a GLuint to the compiled shader.
-// It only requires the shader source code and the shader type.
-GLuint createShader(std::string sourceCode, GLenum shaderType)
+// Adds the samples of the steps in a snapshot that aren't in the plot yet, and uploads the blocks they changed.
+void updatePlot(const SimulationSnapshot& snapshot)
 {
-	// glCreateShader, creates a shader given a type (such as GL_VERTEX_SHADER) and returns a GLuint reference to that shader.
-	GLuint shader = glCreateShader(shaderType);
-	const char *shader_code_ptr = sourceCode.c_str(); // We establish a pointer to our shader code string
-	const int shader_code_size = sourceCode.size();   // And we get the size of that string.
-
-	// glShaderSource replaces the source code in a shader object
-	// It takes the reference to the shader (a GLuint), a count of the number of elements in the string array (in case you're passing in multiple strings), a pointer to the string array 
-	// that contains your source code, and a size variable determining the length of the array.
-	glShaderSource(shader, 1, &shader_code_ptr, &shader_code_size);
-	glCompileShader(shader); // This just compiles the shader, given the source code.
-
-	GLint isCompiled = 0;
+	if (plotProgram == 0)
+	{
+		return;
+	}
+	long long count = (long long)snapshot.plotSamples.size() / PLOT_SERIES;
+	for (long long i = std::max(0LL, plottedStep + 1 - snapshot.plotFirstStep); i < count; i++)
+	{
+		historyPlot.add(&snapshot.plotSamples[(size_t)i * PLOT_SERIES]);
+	}
+	if (count > 0)
+	{
+		plottedStep = std::max(plottedStep, snapshot.plotFirstStep + count - 1);
+	}
+	historyPlot.upload();
+}
 
-	// Check the compile status to see if the shader compiled correctly.
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+// Draws every view after the main window's frame, which the GPU has to finish first, since that is where the levels were uploaded.
+// Views whose window was closed are closed for good. Leaves the main window's context current.
+void drawDashboardViews(GLFWwindow* mainWindow)
+{
+	if (dashboardViews.empty())
+	{
+		return;
+	}
+	GLsync sceneDone = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
 
-	if (isCompiled == GL_FALSE)
+	for (int i = 0; i < (int)dashboardViews.size();)
 	{
-		char infolog[1024];
-		glGetShaderInfoLog(shader, 1024, NULL, infolog);
+		DashboardView& view = dashboardViews[i];
+		makeContextCurrent(view.window);
+		if (glfwWindowShouldClose(view.window))
+		{
+			cachedDeleteVertexArrays(1, &view.vao);
+			glDeleteSync(view.done);
+			forgetGlContext(view.window);
+			glfwDestroyWindow(view.window);
+			dashboardViews.erase(dashboardViews.begin() + i);
+			continue;
+		}
+		i++;
 
-		// Print the compile error.
-		std::cout << "The shader failed to compile with the error:" << std::endl << infolog << std::endl;
+		int width, height;
+		glfwGetFramebufferSize(view.window, &width, &height);
+		if (width == 0 || height == 0)
+		{
+			continue;
+		}
+		glWaitSync(sceneDone, 0, GL_TIMEOUT_IGNORED);
+		cachedViewport(0, 0, width, height);
+		cachedClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Provide the infolog in whatever manor you deem best.
-		// Exit with failure.
-		glDeleteShader(shader); // Don't leak the shader.
+		DrawItem item;
+		item.program = program;
+		item.vao = view.vao;
+		if (view.kind == VIEW_PLOT)
+		{
+			// Every series since the first step, one pixel column per triangle pair.
+			item.program = plotProgram;
+			item.mode = GL_TRIANGLE_STRIP;
+			item.count = historyPlot.prepare(plotProgram, width, height, 0);
+			item.instances = historyPlot.seriesCount();
+			item.depthTest = false;
+			dashboardQueue.add(item);
+		}
+		else
+		{
+			// Rebinding the texture is what picks up the range the main window's context pointed it at.
+			cachedActiveTexture(GL_TEXTURE0);
+			cachedBindTexture(GL_TEXTURE_BUFFER, levelTexture);
+			if (view.kind == VIEW_OVERVIEW)
+			{
+				item.mvp = fitView(overviewLow, overviewHigh, width, height);
+			}
+			else
+			{
+				float halfSize = 0.5f * network.width[pistonVessel] / DASHBOARD_ZOOM;
+				glm::vec2 center((network.left[pistonVessel] + network.right[pistonVessel]) * 0.5f, renderTop[pistonVessel]);
+				item.mvp = fitView(center - halfSize, center + halfSize, width, height);
+			}
+			item.indexType = GL_UNSIGNED_INT;
+			item.count = quadCount * QUAD_INDICES;
+			dashboardQueue.add(item);
+		}
+		dashboardQueue.flush();
+		glfwSwapBuffers(view.window);
 
-		// NOTE: I almost always put a break point here, so that instead of the program continuing with a deleted/failed shader, it stops and gives me a chance to look at what may 
-		// have gone wrong. You can check the console output to see what the error was, and usually that will point you in the right direction.
+		glDeleteSync(view.done);
+		view.done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
 	}
 
-	return shader;
+	// Back in the main window's context, its next commands wait for the views, and so does the fence of the level segment, which
+	// is written again only once the views have read it too. The MVP the views sent to the programs has to be sent again.
+	makeContextCurrent(mainWindow);
+	glDeleteSync(sceneDone);
+	for (DashboardView& view : dashboardViews)
+	{
+		if (view.done != nullptr)
+		{
+			glWaitSync(view.done, 0, GL_TIMEOUT_IGNORED);
+		}
+	}
+	if (levelStream.valid())
+	{
+		levelStream.fence();
+	}
+	renderQueue.forgetPrograms();
 }
 
-// Initialization code
-void init()
+// Closes every view and frees what belongs to them. Leaves the main window's context current.
+void closeDashboardViews(GLFWwindow* mainWindow)
 {
-	// Initializes the glew library
-	glewInit();
-
-	// Enables the depth test, which you will want in most cases. You can disable this in the render loop if you need to.
-	glEnable(GL_DEPTH_TEST);
+	for (DashboardView& view : dashboardViews)
+	{
+		makeContextCurrent(view.window);
+		cachedDeleteVertexArrays(1, &view.vao);
+		glDeleteSync(view.done);
+		forgetGlContext(view.window);
+		glfwDestroyWindow(view.window);
+	}
+	dashboardViews.clear();
+	makeContextCurrent(mainWindow);
+	dashboardQueue.destroy();
+	historyPlot.destroy();
+	cachedDeleteProgram(plotProgram);
+	glDeleteShader(plotVertexShader);
+	glDeleteShader(plotFragmentShader);
+	plotProgram = 0;
+	plotRecording = false;
 }
+#pragma endregion Dashboard
 
-#pragma endregion Helper_functions
+#pragma region Startup
+// How long every phase of getting to the first frame took, from the start of the program. The scene is set up on a thread of its
+// own while the window and its context are created, and the shader files are read by the asset loader meanwhile, so phases can
+// overlap. The report lists every phase with when it started and ended, and once the first frame is presented it is printed.
+struct StartupPhase
+{
+	const char* name;
+	double start;	// Milliseconds since the start of the program
+	double end;
+};
+std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+std::vector<StartupPhase> startupPhases;
+std::mutex startupPhaseLock;
+bool startupReported = false;
 
-// Functions called between every frame. game logic
-#pragma region util_functions
-// This runs once every physics timestep.
-void update()
-{
-	// These variables hold the pressure values on the containers.
-	float LeftPressure, rightPressure;
-	
-	// Calculate pressure on each side
-	big.pressure = (big.height) * gravity * density;
-	small.pressure = (small.height) * gravity * density;
-
-	// Since we are adding pressure to the left (big) container, add the external pressure to the pressure caused by the volume of water.
-	LeftPressure = big.pressure + externalPressure;
-	rightPressure = small.pressure;
-	
-	//If the pressure is the same on both sides, then the fluid is already at equilibrium. 
-	if (LeftPressure == rightPressure)
+double startupMilliseconds()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - programStart).count();
+}
+
+// Can be called from any thread. With tracing on, the phase is a span of the trace too.
+void recordStartupPhase(const char* name, double start, double end)
+{
+	if (traceEnabled())
 	{
-		return;
+		unsigned long long duration = (unsigned long long)((end - start) * 1000000.0);
+		traceSpan(name, traceNow() - (unsigned long long)((startupMilliseconds() - start) * 1000000.0), duration);
 	}
+	std::lock_guard<std::mutex> lock(startupPhaseLock);
+	startupPhases.push_back({ name, start, end });
+}
+
+// Times the phase it is alive for.
+struct StartupScope
+{
+	const char* name;
+	double start;
 
-	// Calculate the height on the right container which is needed to maintain equilibrium.
-	float h = LeftPressure / (gravity * density);
-	
-	//Calculate the change in height of the small container.
-	float change = small.height;
-	change -= h;
-	
-	// We are only taking the average of the height to cause quilibrium. In reality, the level on the smaller side
-	// oscillates along with the water level on the other side and eventually comes to an equilibrium due to 
-	// external dampening forces. Since we are simulating an isolated system under no external forces, the water level will continue to osscilate infinitly.
-	change /= 2.0f;
+	StartupScope(const char* phaseName) : name(phaseName), start(startupMilliseconds()) {}
+	~StartupScope() { recordStartupPhase(name, start, startupMilliseconds()); }
+};
 
-	//This is to ensure that if one side of the apparatus is completly drained, then variation in pressure will have no effect unless it is to fill the drained side.
-	if (big.height + change < 0.0f || h + change < 0.0f)
+void reportStartup(std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock(startupPhaseLock);
+	std::sort(startupPhases.begin(), startupPhases.end(), [](const StartupPhase& a, const StartupPhase& b) { return a.start < b.start; });
+	out << std::fixed << std::setprecision(1) << "Startup took " << startupMilliseconds() << " ms to the first frame:" << std::endl;
+	for (const StartupPhase& phase : startupPhases)
 	{
-		return;
+		out << "  " << std::left << std::setw(20) << phase.name << std::right << std::setw(8) << phase.end - phase.start << " ms  ("
+			<< phase.start << " to " << phase.end << ")" << std::endl;
 	}
+	out << std::defaultfloat << std::setprecision(6);
+}
 
-	//Change in height of the bigger side
-	big.height += change;
-	
-	h += change;
+// Many drivers only finish a program, or build its code for state it hasn't been drawn with yet, when it is first drawn. So
+// before the first frame, the scene is drawn once with everything that can be turned on while it runs (the HUD and the profiler
+// bars), and waited for. It goes into an offscreen target of the window's size, so nothing that is sized by the window is made
+// again for the first frame, with the scissor test cutting every draw down to one pixel, so it costs no fill.
+void warmUpPipelines(const SimulationSnapshot& snapshot)
+{
+	StartupScope phase("pipeline warm-up");
+	OffscreenTarget target;
+	if (snapshot.top.empty() || !target.create(framebufferWidth, framebufferHeight, renderSamples))
+	{
+		return;
+	}
+	bool hud = showHud;
+	bool profiler = showProfiler;
+	bool retained = retainScene;
+	showHud = true;
+	showProfiler = true;
+	retainScene = false;
+	writeHud(snapshot);
 
-	//Set the vertices of the smaller and the bigger side.
-	small.topLeft.y = h - 0.5f;
-	small.topRight.y = h - 0.5f; 
+	target.bind();
+	cachedEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, 1, 1);
+	renderScene(snapshot.previousTop, snapshot.top, 1.0f);
+	cachedDisable(GL_SCISSOR_TEST);
+	glFinish();
 
-	big.topLeft.y = big.height - 0.5f;
-	big.topRight.y = big.height - 0.5f;
+	showHud = hud;
+	showProfiler = profiler;
+	retainScene = retained;
+	target.destroy();
+	cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+	cachedViewport(0, 0, framebufferWidth, framebufferHeight);
+}
+#pragma endregion Startup
 
-	small.height = small.topLeft.y - small.bottomLeft.y;
+// The swap interval of a present mode.
+int swapIntervalFor(PresentMode mode)
+{
+	if (mode == PRESENT_ADAPTIVE)
+	{
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			return -1;
+		}
+		std::cout << "This driver has no adaptive VSync, using plain VSync." << std::endl;
+		return 1;
+	}
+	return mode == PRESENT_VSYNC ? 1 : 0;
 }
 
-// This function runs every frame
-void renderScene()
+// Picks the frame rate for the next frame (see POWER_SAVING_HZ), and tells the simulation thread how often to wake up.
+void updatePowerPolicy(double now)
 {
-	// Clear the color buffer and the depth buffer
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	double cap = 0.0;
+	if (powerSaving)
+	{
+		if (now - lastPowerCheck >= POWER_CHECK_SECONDS)
+		{
+			onBattery = onBatteryPower();
+			lastPowerCheck = now;
+		}
+		bool background = glfwGetWindowAttrib(window, GLFW_FOCUSED) == 0 || glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0;
+		if (now - lastInputTime >= POWER_IDLE_SECONDS)
+		{
+			cap = POWER_IDLE_HZ;
+		}
+		else if (background || onBattery)
+		{
+			cap = POWER_SAVING_HZ;
+		}
+	}
 
-	// Clear the screen to white
-	glClearColor(0.0, 0.0, 0.0, 1.0);
-
-	// Tell OpenGL to use the shader program you've created.
-	glUseProgram(0);
-
-	// Draw the Gameobjects
-	glLineWidth(2.5);
-	glColor3f(0.2, 0.2, 0.8);
-	glBegin(GL_QUADS);
-	
-	//Big container
-	glVertex2fv((float *) &big.bottomLeft);
-	glVertex2fv((float *)&big.bottomRight);
-	glVertex2fv((float *)&big.topRight);
-	glVertex2fv((float *)&big.topLeft);
-	
-	//small container
-	glVertex2fv((float *)&small.bottomLeft);
-	glVertex2fv((float *)&small.bottomRight);
-	glVertex2fv((float *)&small.topRight);
-	glVertex2fv((float *)&small.topLeft);
-
-	//Tube joining the two containers
-	glVertex2f(big.bottomRight.x, big.bottomRight.y);
-	glVertex2f(small.bottomLeft.x, small.bottomLeft.y);
-	glVertex2f(small.bottomLeft.x, small.bottomLeft.y + 0.02f);
-	glVertex2f(big.bottomRight.x, big.bottomRight.y + 0.02f);
-
-	glEnd();
-
-	//The draw piston function draws the piston over the larger side. 
-	//This is mainly done for representational purposes i.e. to make the example more obvious.
-	drawPiston();
+	double hz = cap > 0.0 && (renderHz == 0.0 || renderHz > cap) ? cap : renderHz;
+	if (hz != frameHz)
+	{
+		if (hz > 0.0)
+		{
+			LOG_INFO("Drawing at {} frames per second.", hz);
+		}
+		else
+		{
+			LOG_INFO("Drawing as fast as possible.");
+		}
+		frameHz = hz;
+	}
+	simulationWakeHz = hz != renderHz ? hz : 0.0;
 }
 
-// This function is used to handle key inputs.
-// It is a callback funciton. i.e. glfw takes the pointer to this function (via function pointer) and calls this function every time a key is pressed in the during event polling.
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+// Hands the window events over to the callbacks: the ones that are pending, and with a timeout above 0, also the ones that
+// come in for that long. Tells the latency meter how long the events went unread before.
+void pumpEvents(double timeout)
 {
-	//This set of controls are used to move one point (point1) of the line.
-	if (key == GLFW_KEY_SPACE && (action == GLFW_PRESS || action == GLFW_REPEAT)) 
-		externalPressure += 0.1f;
-	if (key == GLFW_KEY_LEFT_SHIFT && (action == GLFW_PRESS || action == GLFW_REPEAT))
-		externalPressure -= 0.1f;
-	//if (key == GLFW_KEY_S && action == GLFW_PRESS)
-	//	Line.point1.y -= movrate;
-	//if (key == GLFW_KEY_D && action == GLFW_PRESS)
-	//	Line.point1.x += movrate;
+	if (eventsReadTime >= 0.0)
+	{
+		latencyEventsRead(glfwGetTime() - eventsReadTime);
+	}
+	if (timeout > 0.0)
+	{
+		glfwWaitEventsTimeout(timeout);
+	}
+	else
+	{
+		glfwPollEvents();
+	}
+	eventsReadTime = glfwGetTime();
+}
 
-	////This set of controls are used to move one point (point2) of the line.
-	//if (key == GLFW_KEY_I && action == GLFW_PRESS)
-	//	Line.point2.y += movrate;
-	//if (key == GLFW_KEY_J && action == GLFW_PRESS)
-	//	Line.point2.x -= movrate;
-	//if (key == GLFW_KEY_K && action == GLFW_PRESS)
-	//	Line.point2.y -= movrate;
-	//if (key == GLFW_KEY_L && action == GLFW_PRESS)
-	//	Line.point2.x += movrate;
+// Waits until glfwGetTime() reaches deadline (see SPIN_WAIT_SECONDS). The wait is spent waiting for events rather than
+// sleeping, so a key press goes to the simulation thread the moment it comes, in time for its next step, instead of waiting
+// for the poll after the frame. With a gamepad, the wait is cut into pieces of GAMEPAD_POLL_SECONDS with the stick polled
+// in between.
+void waitUntil(double deadline)
+{
+	double remaining = deadline - glfwGetTime() - SPIN_WAIT_SECONDS;
+	while (remaining > 0.0)
+	{
+		pumpEvents(gamepadActive() ? std::min(remaining, GAMEPAD_POLL_SECONDS) : remaining);
+		pollGamepad();
+		remaining = deadline - glfwGetTime() - SPIN_WAIT_SECONDS;
+	}
+	while (glfwGetTime() < deadline)
+	{
+		std::this_thread::yield();
+	}
 }
 
-#pragma endregion util_functions
+int main(int argc, char** argv)
+{
+	{
+		StartupScope phase("arguments");
+		if (!parseArguments(argc, argv))
+		{
+			return 1;
+		}
+	}
 
+	if (!traceFile.empty() || !hitchCapturePrefix.empty())
+	{
+		traceEnable();
+	}
+	if (!flightDumpFile.empty())
+	{
+		return flightDump(flightDumpFile, outputFile) ? 0 : 1;
+	}
+	if (!flightFile.empty())
+	{
+		if (!flightStart(flightFile, flightSeconds))
+		{
+			return 1;
+		}
+		std::atexit(flightStop);
+	}
 
-void main()
-{
-	glfwInit();
+	// From here on the LOG_ macros only queue their messages, and a thread of their own writes them out, until the program exits.
+	logSetLevel(logLevel);
+	if (!logStart(logFileName))
+	{
+		return 1;
+	}
+	std::atexit(logStop);
+
+	if (metricsPort > 0)
+	{
+		metricsServer.counter("hydro_steps_total", "Physics steps run.", readStepsTotal);
+		metricsServer.gauge("hydro_steps_per_second", "Physics steps run per second since the last scrape.", readStepsPerSecond);
+		metricsServer.gauge("hydro_time_scale", "Simulated seconds per second the window achieved.", readTimeScale);
+		metricsServer.gauge("hydro_simulation_idle", "1 while the network is at rest and the simulation thread sleeps.", readIdle);
+		metricsServer.gauge("hydro_input_queue_depth", "Commands waiting for the next physics step.", readInputQueue);
+		if (!sensors.empty())
+		{
+			metricsServer.gauges("hydro_sensor", "The newest sample of every sensor of --sensors.", "sensor", &sensors.names(), sensors.latest());
+		}
+		if (!metricsServer.start(metricsPort))
+		{
+			return 1;
+		}
+		std::atexit(stopMetrics);
+	}
+
+	if (!compileSceneFrom.empty())
+	{
+		return compileScene(compileSceneFrom, compileSceneTo, sceneTileSize, sceneOrder) ? 0 : 1;
+	}
+	if (!generateSceneTo.empty())
+	{
+		return generateScene(generatorSettings, generateSceneTo, sceneTileSize, sceneOrder) ? 0 : 1;
+	}
+	if (pressureBenchmark)
+	{
+		return runPressureBenchmark();
+	}
+	if (scalingBenchmark)
+	{
+		return runScalingBenchmark();
+	}
+	if (accuracyBenchmark)
+	{
+		return runAccuracyBenchmark();
+	}
+	if (!sweepFile.empty() && !sweepView)
+	{
+		return runSweep();
+	}
+	if (!sweepCoordinator.empty() && !sweepBackground)
+	{
+		return runWorker();
+	}
+	if (controlPort > 0 && !remoteControl.start(controlPort, queueRemoteCommand))
+	{
+		return 1;
+	}
+	if ((ingestPort > 0 && !sensorIngest.listen(ingestPort)) || (!ingestShmName.empty() && !sensorIngest.attach(ingestShmName)))
+	{
+		return 1;
+	}
+	if (!sensitivityParameters.empty())
+	{
+		return runSensitivity();
+	}
+	if (!calibrationFile.empty())
+	{
+		return runCalibration();
+	}
+	if (headless && !scenarioFile.empty())
+	{
+		return runScenarios();
+	}
+	if (headless)
+	{
+		return runHeadless();
+	}
+	applyThreadRole(THREAD_ROLE_RENDER);
+
+	if (sweepView && !viewedSweep.read(sweepFile))
+	{
+		return 1;
+	}
+
+	// Nothing of the scene needs a window, so it is loaded and set up while the window and its context are created, and the shader
+	// files are read at the same time as both.
+	queueStartupShaders();
+	taskPool = new TaskPool();
+	std::thread setupThread([]
+	{
+		setMemoryTag(MEMORY_SIMULATION);
+		StartupScope phase("scene");
+		setup();
+		autotune();
+		placeNetworkMemory();
+		startRewindHistory();
+	});
+
+	double contextStart = startupMilliseconds();
+	{
+		StartupScope phase("glfwInit");
+		glfwInit();
+	}
+
+	// Ask for an OpenGL 4.0 core profile context, matching the #version 400 core of our shaders (or 4.3 for the compute shaders of
+	// --gpu). Nothing is drawn with the fixed-function pipeline anymore, so we don't need the compatibility profile.
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, gpuParticles || gpuNetworkStep ? 3 : 0);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	if (glDebug)
+	{
+		requestGlDebugContext();
+	}
+
+	// A video export and the benchmarks draw offscreen, so their window is never shown.
+	if (!videoFile.empty() || benchmarkRun)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	}
 
 	// Creates a window given (width, height, title, monitorPtr, windowPtr).
 	// Don't worry about the last two, as they have to do with controlling which monitor to display on and having a reference to other windows. Leaving them as nullptr is fine.
-	window = glfwCreateWindow(800, 800, "HydroDynamics", nullptr, nullptr);
+	window = glfwCreateWindow(settings().windowWidth, settings().windowHeight, "HydroDynamics", nullptr, nullptr);
+	if (window == nullptr && (gpuParticles || gpuNetworkStep))
+	{
+		std::cout << "This driver has no OpenGL 4.3, stepping the " << (gpuParticles ? "particles" : "network") << " on the CPU instead." << std::endl;
+		gpuParticles = false;
+		gpuNetworkStep = false;
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+		window = glfwCreateWindow(settings().windowWidth, settings().windowHeight, "HydroDynamics", nullptr, nullptr);
+	}
+
+	// The simulation thread needs a context of its own to step the particles or the network on the GPU. A video export runs the
+	// simulation on this thread, so it doesn't.
+	if ((gpuParticles || gpuNetworkStep) && videoFile.empty())
+	{
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		simulationContext = glfwCreateWindow(1, 1, "HydroDynamics simulation", nullptr, window);
+		glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+		if (simulationContext == nullptr)
+		{
+			std::cout << "Can't create a context for the simulation thread, stepping the " << (gpuParticles ? "particles" : "network")
+				<< " on the CPU instead." << std::endl;
+			gpuParticles = false;
+			gpuNetworkStep = false;
+		}
+	}
 
 	std::cout << "\n This example demostrates the hydrodynamic property of fluid. \n Namely trhe isotropic behaviour of fluid i.e. it maintains the same level across \n different containers despite the difference in shapes and sizes when connected by a tube at the bottom. ";
 	std::cout << "\n\n\n\n Use \" Space\" to add pressure on the bigger container using the piston. \n Use \"Left Shift\" to reduce pressure on the bigger side using the piston.";
 
 	// Makes the OpenGL context current for the created window.
-	glfwMakeContextCurrent(window);
+	makeContextCurrent(window);
+	recordStartupPhase("window and context", contextStart, startupMilliseconds());
+
+	{
+		StartupScope phase("waiting for the scene");
+		setupThread.join();
+	}
+	sceneStreamer.onTileRead = [] { glfwPostEmptyEvent(); };
+	if (sceneStreamer.isOpen() && sdfRendering)
+	{
+		std::cout << "The shapes of --sdf can't follow a streamed scene, drawing the quads instead." << std::endl;
+		sdfRendering = false;
+	}
+	int renderWorkers = (int)std::thread::hardware_concurrency() / 2 - 1;
+	if (sweepView && network.vesselCount() >= INSTANCE_PARALLEL_VESSELS && renderWorkers >= 1)
+	{
+		renderPool = new TaskPool(renderWorkers, THREAD_ROLE_RENDER_WORKER);
+	}
 
-	setup();
 	// Sets the number of screen updates to wait before swapping the buffers.
-	// Setting this to zero will disable VSync, which allows us to actually get a read on our FPS. Otherwise we'd be consistently getting 60FPS or lower, 
-	// since it would match our FPS to the screen refresh rate.
-	// Set to 1 to enable VSync.
-	glfwSwapInterval(0);
+	// Zero disables VSync, which allows us to actually get a read on our FPS. Otherwise we'd be consistently getting 60FPS or lower,
+	// since it would match our FPS to the screen refresh rate. 1 enables VSync, and -1 is adaptive VSync where the driver has it.
+	glfwSwapInterval(swapIntervalFor(presentMode));
 
 	// Initializes most things needed before the main loop
-	init();
+	{
+		StartupScope phase("init");
+		init();
+	}
 
 	// Sends the funtion as a funtion pointer along with the window to which it should be applied to.
 	glfwSetKeyCallback(window, key_callback);
+	glfwSetWindowRefreshCallback(window, refresh_callback);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
+	glfwSetCursorPosCallback(window, cursor_position_callback);
+
+	// A video export runs its own loop, then skips the interactive one and goes straight to the cleanup. Neither it nor the
+	// benchmarks have a frame to spare for loading, so they wait for the shaders.
+	int result = 0;
+	if (!videoFile.empty() || benchmarkRun)
+	{
+		assetLoader->finishAll();
+	}
+	if (!videoFile.empty())
+	{
+		result = runVideoExport();
+		glfwSetWindowShouldClose(window, GL_TRUE);
+	}
+	else if (benchmarkRun)
+	{
+		result = runBenchmarks();
+		glfwSetWindowShouldClose(window, GL_TRUE);
+	}
+	else
+	{
+		// Fit the camera to the window it actually got, which the size callback isn't called for. From here on, the scene is
+		// kept from one frame to the next.
+		retainScene = true;
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		framebuffer_size_callback(window, width, height);
+		openDashboardViews(window);
+		if (!videoStreams.empty())
+		{
+			streamingVideo = openVideoStream(videoStreams, videoWidth, videoHeight, videoFps, videoEncoder);
+			if (!streamingVideo)
+			{
+				closeVideoExport();
+				glfwSetWindowShouldClose(window, GL_TRUE);
+				result = 1;
+			}
+		}
+		if (startLockstep() && startStreamView() && (scenarioFile.empty() || scenarios.play(playedScenario, network, pistonVessel, simulationStep)))
+		{
+			scenarioPlaying = !scenarioFile.empty();
+			startSimulation();
+			startBackgroundWorker();
+		}
+		else
+		{
+			result = 1;
+			glfwSetWindowShouldClose(window, GL_TRUE);
+		}
+	}
+
+	// How much time the simulation thread had spent at the last frame, so every frame can tell the profiler how much happened during it.
+	double previousUpdateMilliseconds = 0.0;
+	long long previousSimulationAllocations = snapshots.readBuffer().allocations;
+	setMemoryTag(MEMORY_RENDER);
+
+	// The blend factor of the last frame drawn. Once it reached 1 with no newer snapshot, another frame would look the same.
+	float lastAlpha = 0.0f;
+
+	// When the next frame is due with a frame cap, and how long the work of a frame (drawing it and presenting it) took lately.
+	// Counting from the deadline instead of from the start of every frame keeps small overshoots of the sleeps from adding up.
+	double nextFrame = glfwGetTime();
+	double frameWork = 0.0;
+	frameHz = renderHz;
+	lastInputTime = nextFrame;
+
+	// The key presses of the snapshots picked up whose effect hasn't been presented yet, and the newest step they came from.
+	std::vector<double> unshownInputs;
+	long long newestShownStep = -1;
+	bool pipelinesWarm = false;
 
 	// Enter the main loop.
 	while (!glfwWindowShouldClose(window))
 	{
-		// Call to update() which will update the gameobjects.
-		update();
+		// In the low latency mode, the wait for the next frame comes first, and the events are handled right after it.
+		if (presentMode == PRESENT_LOW_LATENCY)
+		{
+			waitUntil(nextFrame - frameWork - LATENCY_MARGIN_SECONDS);
+			PROFILE_SCOPE(PROFILE_POLL);
+			pumpEvents(0.0);
+		}
+		pollGamepad();
+		updatePowerPolicy(glfwGetTime());
+		double frameStart = glfwGetTime();
+		long long allocationsStart = threadAllocations();
+		frameArena.reset();
+
+		// Until the shaders are in, there is nothing to draw with, so the window only shows the clear color. The loader wakes the
+		// wait up whenever it read something.
+		if (assetLoader->busy())
+		{
+			double linkStart = startupMilliseconds();
+			if (assetLoader->finishLoads() > 0)
+			{
+				recordStartupPhase("linking shaders", linkStart, startupMilliseconds());
+			}
+		}
+		if (assetLoader->busy())
+		{
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glfwSwapBuffers(window);
+			pumpEvents(IDLE_WAIT_SECONDS);
+			continue;
+		}
+
+		// The network of a streamed scene changes as the view moves around it.
+		if (sceneStreamer.isOpen() && updateSceneStream())
+		{
+			redrawRequested = true;
+		}
+
+		// Pick up the newest state from the simulation thread. This never waits; if nothing new was published, we keep the last one.
+		// Read the idle flag first: if it was set, the snapshot acquired after it is the last one before the simulation stopped.
+		bool simulationAsleep = simulationIdle.load();
+		bool fresh = snapshots.acquire();
+		bool shadersChanged = reloadShaders();
+		reloadConfig();
+
+		// Nothing new to show: wait for an event (input, a window change, or the simulation waking up) instead of drawing the same
+		// frame again. Only captures that are still in flight need looking after.
+		if (simulationAsleep && !fresh && lastAlpha >= 1.0f && !shadersChanged && !redrawRequested && !screenshotRequested && !recording &&
+			hitchScreenshot.empty())
+		{
+			updateFrameCapture();
+			pumpEvents(gamepadActive() ? GAMEPAD_POLL_SECONDS : IDLE_WAIT_SECONDS);
+			continue;
+		}
+		bool redraw = redrawRequested;
+		redrawRequested = false;
+
+		const SimulationSnapshot& snapshot = snapshots.readBuffer();
+		if (fresh && snapshot.step > newestShownStep)
+		{
+			for (const AppliedInput& input : snapshot.inputs)
+			{
+				if (input.step > newestShownStep)
+				{
+					unshownInputs.push_back(input.time);
+				}
+			}
+			newestShownStep = snapshot.step;
+			shownStep.store(newestShownStep);
+		}
+		if (fresh && gridResolution > 0)
+		{
+			if (snapshot.gridLayout != gridMeshLayout)
+			{
+				buildGridGeometry(snapshot.gridTiles, snapshot.gridLayout);
+			}
+			uploadGridColors(snapshot.gridFraction, snapshot.gridSpeed, snapshot.gridPressure);
+		}
+		if (fresh && gpuParticles)
+		{
+			// The GPU waits until the simulation's context has written the buffer; this thread doesn't.
+			glWaitSync(snapshot.particleFence, 0, GL_TIMEOUT_IGNORED);
+			particleDrawBuffer = snapshot.particleVertices;
+		}
+		if (fresh && gpuNetworkStep)
+		{
+			glWaitSync(snapshot.levelFence, 0, GL_TIMEOUT_IGNORED);
+			gpuLevelBuffer = snapshot.levelBuffer;
+			gpuLevelsChanged = true;
+		}
+		else if (fresh && particleTarget > 0)
+		{
+			uploadParticles(snapshot.particleX, snapshot.particleY, snapshot.particleSpeed);
+		}
+		if (fresh && shallowCells > 0)
+		{
+			uploadSurface(snapshot.surfaceDepth);
+		}
+		if (fresh && floatVao != 0)
+		{
+			uploadFloats(snapshot.floatX, snapshot.floatY);
+		}
+		if (fresh)
+		{
+			updatePlot(snapshot);
+		}
+		profilerAdd(PROFILE_UPDATE, snapshot.updateMilliseconds - previousUpdateMilliseconds);
+		previousUpdateMilliseconds = snapshot.updateMilliseconds;
+		frameSimulationAllocations = snapshot.allocations - previousSimulationAllocations;
+		previousSimulationAllocations = snapshot.allocations;
+
+		// Blend by how far we are into the step after the snapshot, which keeps motion smooth at any ratio of frame rate to physics rate.
+		std::chrono::duration<double> sinceStep = std::chrono::steady_clock::now() - snapshot.time;
+		float alpha = (float)glm::clamp(sinceStep.count() * physicsHz * timeScale, 0.0, 1.0);
+		lastAlpha = alpha;
 
-		// Call the render function.
-		renderScene();
+		// The HUD only changes when its text is written again.
+		bool hudChanged = showHud && frameStart - lastHudText >= HUD_REFRESH_SECONDS;
+		if (hudChanged)
+		{
+			writeHud(snapshot);
+			lastHudText = frameStart;
+		}
+
+		// Call the render function, after everything it can draw with was drawn once.
+		if (!pipelinesWarm)
+		{
+			warmUpPipelines(snapshot);
+			pipelinesWarm = true;
+		}
+		bool sceneChanged;
+		{
+			PROFILE_SCOPE(PROFILE_RENDER);
+			sceneChanged = renderScene(snapshot.previousTop, snapshot.top, alpha);
+		}
+		GL_CHECK_ERRORS("renderScene");
+
+		// Captures have to be queued after rendering and before the swap, while the back buffer still holds this frame. Every kind
+		// is a pass, which only has an effect while it is asked for; the rest are culled, and with them the scene drawn again at the
+		// size of the screenshots.
+		{
+			MEMORY_SCOPE(MEMORY_CAPTURE);
+			int capture = -1;
+			if (captureWidth > 0)
+			{
+				FrameTargetDesc desc;
+				desc.width = captureWidth;
+				desc.height = captureHeight;
+				desc.samples = renderSamples;
+				desc.format = GL_RGBA16F;
+				desc.depth = true;
+				capture = captureGraph.addTarget("screenshot", desc);
+				int pass = captureGraph.addPass("draw screenshot", [&snapshot, alpha, capture](FrameGraph& graph)
+				{
+					renderCapture(graph.target(capture), snapshot.previousTop, snapshot.top, alpha);
+				});
+				captureGraph.writes(pass, capture);
+			}
+
+			int pass = captureGraph.addPass("screenshot", [capture](FrameGraph& graph)
+			{
+				char fileName[64];
+				snprintf(fileName, sizeof(fileName), "Screenshot_%03d.%s", screenshotCount++, screenshotFormat == CAPTURE_EXR ? "exr" : "png");
+				if (capture >= 0)
+				{
+					graph.target(capture).resolve();
+					captureFrame(fileName, captureWidth, captureHeight, screenshotFormat);
+					cachedBindFramebuffer(GL_FRAMEBUFFER, 0);
+				}
+				else
+				{
+					captureFrame(fileName, framebufferWidth, framebufferHeight, screenshotFormat);
+				}
+				screenshotRequested = false;
+			});
+			if (capture >= 0)
+			{
+				captureGraph.reads(pass, capture);
+			}
+			if (screenshotRequested)
+			{
+				captureGraph.sideEffect(pass);
+			}
+
+			pass = captureGraph.addPass("hitch screenshot", [](FrameGraph&)
+			{
+				captureFrame(hitchScreenshot, framebufferWidth, framebufferHeight);
+				hitchScreenshot.clear();
+			});
+			if (!hitchScreenshot.empty())
+			{
+				captureGraph.sideEffect(pass);
+			}
+
+			pass = captureGraph.addPass("recording", [](FrameGraph&)
+			{
+				char fileName[64];
+				snprintf(fileName, sizeof(fileName), "Recording_%05d.png", recordedFrames++);
+				captureFrame(fileName, framebufferWidth, framebufferHeight);
+			});
+			if (recording)
+			{
+				captureGraph.sideEffect(pass);
+			}
+
+			if (!captureGraph.execute() && captureWidth > 0)
+			{
+				std::cout << "Capturing the window instead." << std::endl;
+				captureWidth = 0;
+			}
+		}
+		updateFrameCapture();
 
 		// Swaps the back buffer to the front buffer
 		// Remember, you're rendering to the back buffer, then once rendering is complete, you're moving the back buffer to the front so it can be displayed.
-		glfwSwapBuffers(window);
+		// If nothing on screen changed (the simulation is awake, but nothing moved far enough to show), the front buffer already
+		// holds this frame, so it isn't presented again.
+		bool present = sceneChanged || showProfiler || hudChanged || redraw;
+		if (present && streamingVideo && !captureVideoFrame(framebufferWidth, framebufferHeight))
+		{
+			LOG_ERROR("The video stream stopped.");
+			closeVideoExport();
+			streamingVideo = false;
+		}
+		if (present)
+		{
+			PROFILE_SCOPE(PROFILE_SWAP);
+			glfwSwapBuffers(window);
+			if (presentMode == PRESENT_LOW_LATENCY)
+			{
+				glFinish();
+			}
+			latencyFramePresented(unshownInputs);
+			unshownInputs.clear();
+			if (!startupReported)
+			{
+				if (presentMode != PRESENT_LOW_LATENCY)
+				{
+					glFinish();
+				}
+				reportStartup(std::cout);
+				startupReported = true;
+			}
+		}
+
+		// The other views show the same frame, and the plot every new snapshot.
+		if (present || fresh)
+		{
+			PROFILE_SCOPE(PROFILE_RENDER);
+			drawDashboardViews(window);
+		}
 
 		// Checks to see if any events are pending and then processes them.
-		glfwPollEvents();
+		if (presentMode != PRESENT_LOW_LATENCY)
+		{
+			PROFILE_SCOPE(PROFILE_POLL);
+			pumpEvents(0.0);
+		}
+
+		// The frame time counts everything above, but not the sleep below, so it shows how much of the budget the work uses.
+		double frameMilliseconds = (glfwGetTime() - frameStart) * 1000.0;
+		profilerSet(PROFILE_FRAME, frameMilliseconds);
+		if (!hitchCapturePrefix.empty() && hitchDetector.addFrame(frameMilliseconds, frameStart))
+		{
+			char number[16];
+			snprintf(number, sizeof(number), "_%03d", hitchDetector.hitchCount());
+			std::string name = hitchCapturePrefix + number;
+			hitchScreenshot = name + ".png";
+			redrawRequested = true;
+			if (hitchDetector.writeTrace(name + ".json"))
+			{
+				LOG_WARNING("Hitch: a frame took {} ms against {} ms normally, saving {}.json and .png", frameMilliseconds,
+					hitchDetector.baseline(), name.c_str());
+			}
+			else
+			{
+				LOG_WARNING("Hitch: a frame took {} ms against {} ms normally, saving {}.png (the last trace is still being written)",
+					frameMilliseconds, hitchDetector.baseline(), name.c_str());
+			}
+		}
+		frameAllocations = threadAllocations() - allocationsStart;
+		if (traceEnabled())
+		{
+			traceCounter("allocations per frame", (double)frameAllocations);
+			traceCounter("simulation allocations per frame", (double)frameSimulationAllocations);
+			traceCounter("memory MB", memoryStats().bytes / 1048576.0);
+			traceCounter("gl state changes", glStateCounts().changes);
+			traceCounter("gl state calls", glStateCounts().requests);
+		}
+		endGlStateFrame();
+		gpuTimersEndFrame();
+		updateLatencyMeter();
+		profilerEndFrame();
+		TRACY_FRAME();
+
+		// Rewriting the title every frame would cost more than everything we measure, so only do it twice per second.
+		if (frameStart - lastProfilerTitle > 0.5)
+		{
+			FrameText title(frameArena);
+			title.append("HydroDynamics | ");
+			profilerSummary(title);
+			glfwSetWindowTitle(window, title.data());
+			lastProfilerTitle = frameStart;
+		}
+
+		// The work of a frame is smoothed over the last few frames, and the low latency mode uses the slower of the smoothed and the
+		// last one, so a single slow frame doesn't miss its deadline twice.
+		double work = glfwGetTime() - frameStart;
+		frameWork = std::max(work, glm::mix(frameWork, work, 0.1));
+
+		// If the frame finished early, sleep for the rest of it instead of spinning. This is what keeps us from using a whole core.
+		// A frame that finished after the next one was due starts the count again, rather than rushing to catch up.
+		if (frameHz > 0.0)
+		{
+			nextFrame += 1.0 / frameHz;
+			if (nextFrame < glfwGetTime())
+			{
+				nextFrame = glfwGetTime();
+			}
+			if (presentMode != PRESENT_LOW_LATENCY)
+			{
+				waitUntil(nextFrame);
+			}
+		}
+	}
+
+	// The simulation thread and the background worker have to be stopped before anything they use is freed.
+	stopSimulation();
+	stopBackgroundWorker();
+	sceneStreamer.close();
+	closeDashboardViews(window);
+	if (streamingVideo)
+	{
+		long long dropped = videoFramesDropped();
+		result |= closeVideoExport() ? 0 : 1;
+		if (dropped > 0)
+		{
+			std::cout << "The video stream dropped " << dropped << " frames the encoder couldn't keep up with." << std::endl;
+		}
 	}
 
 	// After the program is over, cleanup your data!
+	destroyProfilerOverlay();
+	destroyTextRenderer();
+	destroyGpuTimers();
+	reportLatency(std::cout);
+	destroyLatencyMeter();
+	destroyFrameCapture();
+	cachedDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	levelStream.destroy();
+	glDeleteBuffers(1, &levelBuffer);
+	glDeleteBuffers(1, &drawCommandBuffer);
+	cachedDeleteTextures(1, &levelTexture);
+	glDeleteBuffers(1, &levelSpeedBuffer);
+	cachedDeleteTextures(1, &levelSpeedTexture);
+	glDeleteBuffers(1, &ebo);
+	cachedDeleteVertexArrays(1, &gridVao);
+	glDeleteBuffers(1, &gridPositionBuffer);
+	glDeleteBuffers(1, &gridColorBuffer);
+	glDeleteBuffers(1, &gridPressureBuffer);
+	glDeleteBuffers(1, &gridEbo);
+	cachedDeleteVertexArrays(1, &particleVao);
+	glDeleteBuffers(1, &particlePositionBuffer);
+	glDeleteBuffers(1, &particleColorBuffer);
+	glDeleteBuffers((GLsizei)particleVertexBuffers.size(), particleVertexBuffers.data());
+	glDeleteShader(particleVertexShader);
+	glDeleteShader(particleFragmentShader);
+	cachedDeleteProgram(particleProgram);
+	fluidSurface.destroy();
+	spray.destroy();
+	renderQueue.destroy();
+	gpuFluid.destroy();
+
+	// finishOutputs() below writes the final state, which is still on the GPU, and the last steps of the telemetry, which are still
+	// on their way back.
+	if (gpuNetworkStep)
+	{
+		if (telemetry != nullptr)
+		{
+			gpuNetwork.takeStates(recordGpuState, true);
+		}
+		gpuNetwork.readBack(network);
+	}
+	gpuNetwork.destroy();
+	glDeleteBuffers((GLsizei)levelCopyBuffers.size(), levelCopyBuffers.data());
+	cachedDeleteVertexArrays(1, &surfaceVao);
+	glDeleteBuffers(1, &surfaceVbo);
+	glDeleteBuffers(1, &surfaceEbo);
+	cachedDeleteVertexArrays(1, &instanceVao);
+	glDeleteBuffers(1, &instanceCornerBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	cachedDeleteVertexArrays(1, &lodVao);
+	cachedDeleteVertexArrays(1, &floatVao);
+	cachedDeleteVertexArrays(1, &sdfVao);
+	cachedDeleteTextures(1, &sdfShapeTexture);
+	glDeleteShader(effectVertexShader);
+	glDeleteShader(effectFragmentShader);
+	cachedDeleteProgram(effectProgram);
+	cachedDeleteTextures(1, &heatmapTexture);
+	glDeleteShader(backgroundVertexShader);
+	glDeleteShader(backgroundFragmentShader);
+	cachedDeleteProgram(backgroundProgram);
+	cachedDeleteTextures(1, &backgroundTexture);
+	cachedDeleteVertexArrays(1, &backgroundVao);
+	glDeleteBuffers(1, &sdfShapeBuffer);
+	glDeleteShader(sdfVertexShader);
+	glDeleteShader(sdfFragmentShader);
+	cachedDeleteProgram(sdfProgram);
+	sceneFrame.destroy();
+	captureGraph.destroy();
+	glDeleteBuffers(1, &lodBuffer);
+	glDeleteBuffers(1, &floatBuffer);
+	glDeleteShader(instanceVertexShader);
+	glDeleteShader(instanceFragmentShader);
+	cachedDeleteProgram(instanceProgram);
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
-	glDeleteProgram(program);
+	cachedDeleteProgram(program);
+	delete shaderWatcher;
+	delete configWatcher;
+	delete assetLoader;
 	// Note: If at any point you stop using a "program" or shaders, you should free the data up then and there.
 
+	if (!finishOutputs())
+	{
+		result = 1;
+	}
+	delete taskPool;
+	delete renderPool;
+
+	if (!traceFile.empty())
+	{
+		traceWrite(traceFile);
+	}
+
 	// Frees up GLFW memory
 	glfwTerminate();
+	return result;
 }
\ No newline at end of file
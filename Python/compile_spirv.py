@@ -0,0 +1,131 @@
+# -*- coding: latin-1 -*-
+"""
+Title: HydroDynamics
+File Name: compile_spirv.py
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Compiles the variants of the scene shaders to SPIR-V ahead of time, which the program loads
+instead of compiling the GLSL where the driver has ARB_gl_spirv (see Shaders.h). Run it
+after changing a shader, or the program notices the SPIR-V is older than its sources and
+goes back to compiling the GLSL:
+
+    python compile_spirv.py [--glslang PATH] [--assets DIRECTORY]
+
+It needs glslangValidator from the Vulkan SDK (or from glslang), found through --glslang,
+the GLSLANG environment variable or the PATH. Every variant is written next to its source,
+with its defines in the name: VertexShader.glsl with INSTANCED becomes
+VertexShader.INSTANCED.spv.
+
+The includes are expanded here the way the program expands them (once per file, not inside
+comments), and the defines are handed to glslang. Names don't have to survive in SPIR-V,
+so glslang assigns the locations of the varyings and the bindings itself, with the uniform
+blocks starting at 1, where the Frame block is bound (FRAME_BLOCK_BINDING in
+FrameUniforms.h), and the samplers at 0, the texture unit the levels are on.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Every shader file with its stage, and the sets of defines it is built with. These are the variants of sceneVariants() in
+# main.cpp, which looks for the files this writes.
+VARIANTS = [
+    ("VertexShader.glsl", "vert", [[], ["INSTANCED"]]),
+    ("FragmentShader.glsl", "frag", [[], ["INSTANCED"]]),
+]
+
+_INCLUDE = re.compile(r'\s*#include\s*"([^"]*)"')
+
+
+def expand_includes(path, included=None):
+    """The source of path with every file it includes in place of its #include, each file once."""
+    if included is None:
+        included = [os.path.normpath(path)]
+    with open(path, "r", encoding="latin-1", newline="") as source:
+        lines = source.read().split("\n")
+
+    out = []
+    in_comment = False
+    for line in lines:
+        match = None if in_comment else _INCLUDE.match(line)
+
+        # The same scan for block comments as in Shaders.cpp, so a line that starts inside one is never taken for a directive.
+        i = 0
+        while i + 1 < len(line):
+            if not in_comment and line[i:i + 2] == "//":
+                break
+            if line[i:i + 2] == ("*/" if in_comment else "/*"):
+                in_comment = not in_comment
+                i += 1
+            i += 1
+
+        if match is None:
+            out.append(line)
+            continue
+        name = os.path.normpath(os.path.join(os.path.dirname(path), match.group(1)))
+        if name not in included:
+            included.append(name)
+            out.append(expand_includes(name, included))
+    return "\n".join(out)
+
+
+def spirv_file(path, defines):
+    """Where the SPIR-V of path built with defines goes, the same name as spirvFile() in Shaders.cpp."""
+    return ".".join([os.path.splitext(path)[0]] + defines) + ".spv"
+
+
+def compile_variant(glslang, path, stage, defines):
+    output = spirv_file(path, defines)
+    command = [glslang, "-G", "-S", stage, "--stdin", "--auto-map-locations", "--auto-map-bindings", "--shift-UBO-binding", "1",
+               "-o", output] + ["-D" + define for define in defines]
+    result = subprocess.run(command, input=expand_includes(path).encode("latin-1"), stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    if result.returncode != 0:
+        sys.stdout.write("%s %s failed:\n%s\n" % (path, " ".join(defines), result.stdout.decode("latin-1")))
+        return False
+    print("Wrote %s" % output)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compiles the scene shaders to SPIR-V.")
+    parser.add_argument("--glslang", default=os.environ.get("GLSLANG", "glslangValidator"), help="the glslangValidator to run")
+    parser.add_argument("--assets", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Assets"),
+                        help="the directory of the shaders")
+    arguments = parser.parse_args()
+
+    failed = 0
+    for name, stage, variants in VARIANTS:
+        for defines in variants:
+            try:
+                if not compile_variant(arguments.glslang, os.path.join(arguments.assets, name), stage, defines):
+                    failed += 1
+            except OSError as error:
+                print("Can't run %s: %s" % (arguments.glslang, error))
+                return 1
+    return 1 if failed > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
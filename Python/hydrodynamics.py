@@ -0,0 +1,221 @@
+# -*- coding: latin-1 -*-
+"""
+Title: HydroDynamics
+File Name: hydrodynamics.py
+Copyright  2015
+Original authors: Brockton Roth
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Description:
+Python bindings for the HydroDynamicsCore library (see HydroSolver.h), for analysing the
+simulation from a notebook or a script without going through files.
+
+The module loads the library with ctypes and calls its C functions (HydroDynamicsC.h), so
+there is nothing to compile on the Python side. It looks for the library in the directory
+named by HYDRODYNAMICS_LIBRARY, then next to this file, then wherever the system looks.
+
+The state comes back as NumPy arrays that view the arrays of the network in place, through
+the buffer protocol, so reading the levels of a million vessels after every step copies
+nothing. The views are read only, follow every step, and belong to the network they were
+taken from: after reset() or load_scene() they point at memory that was freed, so take new
+ones then.
+
+ctypes lets go of the interpreter lock for the length of every call into the library, and
+a solver only touches its own network, so Python threads that step solvers of their own run
+in parallel, one core each. Sharing one solver between threads needs a lock around it.
+"""
+
+import ctypes
+import os
+import sys
+
+import numpy
+
+
+def _library_names():
+    if sys.platform == "win32":
+        return ["HydroDynamicsCore.dll"]
+    if sys.platform == "darwin":
+        return ["libHydroDynamicsCore.dylib"]
+    return ["libHydroDynamicsCore.so"]
+
+
+def _load_library():
+    directories = [os.environ.get("HYDRODYNAMICS_LIBRARY"), os.path.dirname(os.path.abspath(__file__))]
+    for directory in directories:
+        for name in _library_names():
+            if directory and os.path.exists(os.path.join(directory, name)):
+                return ctypes.CDLL(os.path.join(directory, name))
+    return ctypes.CDLL(_library_names()[0])
+
+
+_lib = _load_library()
+
+_handle = ctypes.c_void_p
+_float_array = ctypes.POINTER(ctypes.c_float)
+
+# The signature of every function, as (name, result, arguments).
+for _name, _result, _arguments in [
+    ("hydroCreate", _handle, [ctypes.c_int]),
+    ("hydroDestroy", None, [_handle]),
+    ("hydroReset", None, [_handle]),
+    ("hydroLoadScene", ctypes.c_int, [_handle, ctypes.c_char_p]),
+    ("hydroSaveCheckpoint", ctypes.c_int, [_handle, ctypes.c_char_p]),
+    ("hydroSetDensity", None, [_handle, ctypes.c_float]),
+    ("hydroSetGravity", None, [_handle, ctypes.c_float]),
+    ("hydroSetStepRate", None, [_handle, ctypes.c_double]),
+    ("hydroSetPistonPressure", None, [_handle, ctypes.c_float]),
+    ("hydroSetPistonMass", None, [_handle, ctypes.c_float]),
+    ("hydroSetExternalPressure", None, [_handle, ctypes.c_int, ctypes.c_float]),
+    ("hydroStep", ctypes.c_int, [_handle, ctypes.c_int]),
+    ("hydroSettle", ctypes.c_int, [_handle]),
+    ("hydroStepCount", ctypes.c_longlong, [_handle]),
+    ("hydroTime", ctypes.c_double, [_handle]),
+    ("hydroVesselCount", ctypes.c_int, [_handle]),
+    ("hydroTubeCount", ctypes.c_int, [_handle]),
+    ("hydroPistonVessel", ctypes.c_int, [_handle]),
+    ("hydroTotalVolume", ctypes.c_double, [_handle]),
+    ("hydroLevelArray", _float_array, [_handle]),
+    ("hydroHeightArray", _float_array, [_handle]),
+    ("hydroPressureArray", _float_array, [_handle]),
+    ("hydroFlowArray", _float_array, [_handle]),
+]:
+    _function = getattr(_lib, _name)
+    _function.restype = _result
+    _function.argtypes = _arguments
+
+
+class Solver:
+    """A network with its piston, stepped like the application steps it (see HydroSolver.h).
+
+    It starts with the classic apparatus. threads is the number of threads one step is spread over (0 for every core); to run
+    several solvers at once, give each its own Python thread and leave threads at 1.
+    """
+
+    def __init__(self, threads=1):
+        self._handle = _lib.hydroCreate(threads)
+        if not self._handle:
+            raise MemoryError("Not enough memory for a solver.")
+
+    def close(self):
+        """Frees the network. The views taken from it must not be used afterwards."""
+        if self._handle:
+            _lib.hydroDestroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        self.close()
+
+    def reset(self):
+        _lib.hydroReset(self._handle)
+
+    def load_scene(self, file_name):
+        """Starts over with a scene or checkpoint. Raises IOError (and keeps the network) if the file can't be read."""
+        if not _lib.hydroLoadScene(self._handle, os.fsencode(file_name)):
+            raise IOError("Can't load the scene " + str(file_name))
+
+    def save_checkpoint(self, file_name):
+        if not _lib.hydroSaveCheckpoint(self._handle, os.fsencode(file_name)):
+            raise IOError("Can't write the checkpoint " + str(file_name))
+
+    def set_density(self, density):
+        _lib.hydroSetDensity(self._handle, density)
+
+    def set_gravity(self, gravity):
+        _lib.hydroSetGravity(self._handle, gravity)
+
+    def set_step_rate(self, hz):
+        _lib.hydroSetStepRate(self._handle, hz)
+
+    def set_piston_pressure(self, pressure):
+        _lib.hydroSetPistonPressure(self._handle, pressure)
+
+    def set_piston_mass(self, mass):
+        _lib.hydroSetPistonMass(self._handle, mass)
+
+    def set_external_pressure(self, vessel, pressure):
+        _lib.hydroSetExternalPressure(self._handle, vessel, pressure)
+
+    def step(self, steps=1):
+        """Advances by steps fixed steps without holding the interpreter lock. Returns False if nothing moved in the last one."""
+        return bool(_lib.hydroStep(self._handle, steps))
+
+    def settle(self):
+        return bool(_lib.hydroSettle(self._handle))
+
+    @property
+    def step_count(self):
+        return _lib.hydroStepCount(self._handle)
+
+    @property
+    def time(self):
+        return _lib.hydroTime(self._handle)
+
+    @property
+    def vessel_count(self):
+        return _lib.hydroVesselCount(self._handle)
+
+    @property
+    def tube_count(self):
+        return _lib.hydroTubeCount(self._handle)
+
+    @property
+    def piston_vessel(self):
+        return _lib.hydroPistonVessel(self._handle)
+
+    def total_volume(self):
+        return _lib.hydroTotalVolume(self._handle)
+
+    def _view(self, pointer, count):
+        if count == 0 or not pointer:
+            return numpy.zeros(0, dtype=numpy.float32)
+
+        # The ctypes array is only a window onto the memory of the network, and keeps the solver alive while a view uses it.
+        window = (ctypes.c_float * count).from_address(ctypes.addressof(pointer.contents))
+        window._solver = self
+        view = numpy.frombuffer(window, dtype=numpy.float32)
+        view.flags.writeable = False
+        return view
+
+    @property
+    def levels(self):
+        """Where the surface of every vessel is."""
+        return self._view(_lib.hydroLevelArray(self._handle), self.vessel_count)
+
+    @property
+    def heights(self):
+        """How high the fluid in every vessel stands."""
+        return self._view(_lib.hydroHeightArray(self._handle), self.vessel_count)
+
+    @property
+    def pressures(self):
+        """The pressure at the bottom of every vessel from its fluid column, without what pushes on it from outside."""
+        return self._view(_lib.hydroPressureArray(self._handle), self.vessel_count)
+
+    @property
+    def flows(self):
+        """The flow through every tube, from its end B to its end A."""
+        return self._view(_lib.hydroFlowArray(self._handle), self.tube_count)
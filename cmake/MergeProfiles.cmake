@@ -0,0 +1,13 @@
+# Merges the raw profiles the instrumented programs wrote into DIRECTORY (one per program and process) into the
+# merged.profdata the second pass of a Clang build reads, with the llvm-profdata in PROFDATA. Run by the pgo-train target of
+# CMakeLists.txt: cmake -D PROFDATA=... -D DIRECTORY=... -P MergeProfiles.cmake
+
+file(GLOB RAW_PROFILES "${DIRECTORY}/*.profraw")
+if(NOT RAW_PROFILES)
+	message(FATAL_ERROR "The training wrote no profiles into ${DIRECTORY}")
+endif()
+execute_process(COMMAND ${PROFDATA} merge -output=${DIRECTORY}/merged.profdata ${RAW_PROFILES} RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "llvm-profdata couldn't merge the profiles in ${DIRECTORY}")
+endif()
+file(REMOVE ${RAW_PROFILES})